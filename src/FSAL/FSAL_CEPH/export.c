@@ -72,7 +72,8 @@ static void release(struct fsal_export *export_pub)
 	fsal_detach_export(export->export.fsal, &export->export.exports);
 	free_export_ops(&export->export);
 
-	ceph_shutdown(export->cmount);
+	ceph_put_mount(export->cm);
+	export->cm = NULL;
 	export->cmount = NULL;
 	gsh_free(export);
 	export = NULL;
@@ -141,11 +142,12 @@ static fsal_status_t lookup_path(struct fsal_export *export_pub,
 		return status;
 	}
 
-	/* Advance past the export's fullpath */
-	realpath += strlen(op_ctx->ctx_export->fullpath);
-
-	/* special case the root */
-	if (strcmp(realpath, "/") == 0) {
+	/* special case the root.  The mount may be shared with other
+	 * exports and is rooted at the cluster root, so anything else
+	 * is walked by its full path.
+	 */
+	if (strcmp(realpath + strlen(op_ctx->ctx_export->fullpath), "/") == 0
+	    || strcmp(realpath, op_ctx->ctx_export->fullpath) == 0) {
 		assert(export->root);
 		*pub_handle = &export->root->handle;
 		return status;
@@ -241,7 +243,9 @@ static fsal_status_t create_handle(struct fsal_export *export_pub,
 	/* The ceph_ll_connectable_m should have populated libceph's
 	   cache with all this anyway */
 	rc = fsal_ceph_ll_getattr(export->cmount, i, &stx,
-		attrs_out ? CEPH_STATX_ATTR_MASK : CEPH_STATX_HANDLE_MASK,
+		attrs_out ? attrmask2ceph_want(attrs_out->request_mask) |
+			    CEPH_STATX_HANDLE_MASK :
+			    CEPH_STATX_HANDLE_MASK,
 		op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
@@ -564,9 +564,12 @@ static fsal_status_t getattrs(struct fsal_obj_handle *handle_pub,
 	struct handle *handle = container_of(handle_pub, struct handle, handle);
 	/* Stat buffer */
 	struct ceph_statx stx;
+	/* Only ask for what is wanted, other fields may cost a cap recall */
+	unsigned int want = attrmask2ceph_want(attrs->request_mask) |
+			    CEPH_STATX_HANDLE_MASK;
 
-	rc = fsal_ceph_ll_getattr(export->cmount, handle->i, &stx,
-				CEPH_STATX_ATTR_MASK, op_ctx->creds);
+	rc = fsal_ceph_ll_getattr(export->cmount, handle->i, &stx, want,
+				  op_ctx->creds);
 	LogDebug(COMPONENT_FSAL, "getattr returned %d", rc);
 	if (rc < 0) {
 		if (attrs->request_mask & ATTR_RDATTR_ERR) {
@@ -1077,9 +1080,19 @@ fsal_status_t ceph_open2(struct fsal_obj_handle *obj_hdl,
 		}
 
 		if (createmode >= FSAL_EXCLUSIVE || truncated) {
-			/* Refresh the attributes */
+			/* Refresh the attributes, the verifier is in the
+			 * times.
+			 */
+			unsigned int want = CEPH_STATX_SIZE |
+					    CEPH_STATX_ATIME |
+					    CEPH_STATX_MTIME;
+
+			if (attrs_out != NULL)
+				want |= attrmask2ceph_want(
+						attrs_out->request_mask);
+
 			retval = fsal_ceph_ll_getattr(export->cmount,
-					myself->i, &stx, !!attrs_out,
+					myself->i, &stx, want,
 					op_ctx->creds);
 
 			if (retval == 0) {
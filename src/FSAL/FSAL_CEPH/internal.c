@@ -100,6 +100,17 @@ void deconstruct_handle(struct handle *obj)
 	gsh_free(obj);
 }
 
+/**
+ * @brief Translate an attribute mask into a ceph_statx want mask
+ *
+ * Asking the MDS only for the fields actually needed spares the
+ * acquisition (and recall from other clients) of the caps covering the
+ * others, e.g. size and mtime of a file being written elsewhere.
+ *
+ * @param[in] mask Attributes wanted
+ *
+ * @return The CEPH_STATX_* mask to pass to ceph.
+ */
 unsigned int
 attrmask2ceph_want(attrmask_t mask)
 {
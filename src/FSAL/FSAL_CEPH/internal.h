@@ -62,9 +62,25 @@ struct ceph_fsal_module {
 	struct fsal_module fsal;
 	fsal_staticfsinfo_t fs_info;
 	char *conf_path;
+	struct glist_head mounts; /*< List of shared ceph_mount objects */
+	pthread_mutex_t lock;	/*< Lock protecting the above list */
 };
 extern struct ceph_fsal_module CephFSM;
 
+/**
+ * Ceph client mount shared by all exports of the same cluster using
+ * the same cephx credentials.  The cluster is mounted at its root and
+ * each export walks to its own root inode.
+ */
+
+struct ceph_mount {
+	struct glist_head mounts;	/*< Link in CephFSM.mounts */
+	struct ceph_mount_info *cmount;	/*< The libcephfs mount */
+	char *user_id;			/*< cephx user_id of the mount */
+	char *secret_key;		/*< cephx secret of the mount */
+	int64_t refcnt;			/*< Number of exports using it */
+};
+
 /**
  * Ceph private export object
  */
@@ -74,6 +90,7 @@ struct export {
 	struct ceph_mount_info *cmount;	/*< The mount object used to
 					   access all Ceph methods on
 					   this export. */
+	struct ceph_mount *cm;	/*< The shared mount cmount belongs to */
 	struct handle *root;	/*< The root handle */
 	char *user_id;			/* cephx user_id for this mount */
 	char *secret_key;
@@ -195,4 +212,6 @@ struct state_t *ceph_alloc_state(struct fsal_export *exp_hdl,
 
 void ceph_free_state(struct fsal_export *exp_hdl, struct state_t *state);
 
+void ceph_put_mount(struct ceph_mount *cm);
+
 #endif				/* !FSAL_CEPH_INTERNAL_INTERNAL__ */
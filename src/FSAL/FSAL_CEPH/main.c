@@ -39,6 +39,7 @@
 #include <assert.h>
 #include "fsal.h"
 #include "fsal_types.h"
+#include "gsh_list.h"
 #include "FSAL/fsal_init.h"
 #include "FSAL/fsal_commonlib.h"
 #include "fsal_api.h"
@@ -144,6 +145,131 @@ static fsal_status_t find_cephfs_root(struct ceph_mount_info *cmount,
 }
 #endif /* USE_FSAL_CEPH_LL_LOOKUP_ROOT */
 
+/**
+ * @brief Find or create a shared Ceph mount
+ *
+ * Exports of the same cluster using the same cephx credentials share
+ * one mount of the cluster root, rather than each paying for its own
+ * MDS session, client cache and threads.
+ *
+ * @param[in] user_id    cephx user, may be NULL
+ * @param[in] secret_key cephx secret, may be NULL
+ *
+ * @return A referenced mount, or NULL on failure.
+ */
+
+static struct ceph_mount *ceph_get_mount(const char *user_id,
+					 const char *secret_key)
+{
+	struct ceph_mount *cm;
+	struct glist_head *glist;
+	int ceph_status;
+
+	PTHREAD_MUTEX_lock(&CephFSM.lock);
+
+	glist_for_each(glist, &CephFSM.mounts) {
+		cm = glist_entry(glist, struct ceph_mount, mounts);
+		if (strcmp(cm->user_id ? cm->user_id : "",
+			   user_id ? user_id : "") == 0 &&
+		    strcmp(cm->secret_key ? cm->secret_key : "",
+			   secret_key ? secret_key : "") == 0)
+			goto found;
+	}
+
+	cm = gsh_calloc(1, sizeof(struct ceph_mount));
+	glist_init(&cm->mounts);
+
+	/* allocates ceph_mount_info */
+	ceph_status = ceph_create(&cm->cmount, user_id);
+	if (ceph_status != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to create Ceph handle: %d", ceph_status);
+		goto out;
+	}
+
+	ceph_status = ceph_conf_read_file(cm->cmount, CephFSM.conf_path);
+	if (ceph_status != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to read Ceph configuration: %d", ceph_status);
+		goto out;
+	}
+
+	if (secret_key) {
+		ceph_status = ceph_conf_set(cm->cmount, "key", secret_key);
+		if (ceph_status) {
+			LogCrit(COMPONENT_FSAL,
+				"Unable to set Ceph secret key: %d",
+				ceph_status);
+			goto out;
+		}
+	}
+
+	ceph_status = ceph_mount(cm->cmount, "/");
+	if (ceph_status != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to mount Ceph cluster as %s: %d",
+			user_id ? user_id : "default user", ceph_status);
+		goto out;
+	}
+
+	if (user_id)
+		cm->user_id = gsh_strdup(user_id);
+	if (secret_key)
+		cm->secret_key = gsh_strdup(secret_key);
+
+	glist_add(&CephFSM.mounts, &cm->mounts);
+
+	LogDebug(COMPONENT_FSAL, "Created Ceph mount for %s",
+		 user_id ? user_id : "default user");
+
+found:
+	++(cm->refcnt);
+	PTHREAD_MUTEX_unlock(&CephFSM.lock);
+	return cm;
+
+out:
+	PTHREAD_MUTEX_unlock(&CephFSM.lock);
+
+	if (cm->cmount)
+		ceph_shutdown(cm->cmount);
+	gsh_free(cm);
+	return NULL;
+}
+
+/**
+ * @brief Release a reference to a shared Ceph mount
+ *
+ * The mount is shut down when the last export using it goes away.
+ *
+ * @param[in] cm The mount to release
+ */
+
+void ceph_put_mount(struct ceph_mount *cm)
+{
+	int64_t refcnt;
+
+	PTHREAD_MUTEX_lock(&CephFSM.lock);
+
+	refcnt = --(cm->refcnt);
+	assert(refcnt >= 0);
+
+	if (refcnt) {
+		LogDebug(COMPONENT_FSAL,
+			 "Ceph mount for %s still in use, refcnt %"PRIi64,
+			 cm->user_id ? cm->user_id : "default user", refcnt);
+		PTHREAD_MUTEX_unlock(&CephFSM.lock);
+		return;
+	}
+
+	glist_del(&cm->mounts);
+	PTHREAD_MUTEX_unlock(&CephFSM.lock);
+
+	ceph_shutdown(cm->cmount);
+	gsh_free(cm->user_id);
+	gsh_free(cm->secret_key);
+	gsh_free(cm);
+}
+
 static struct config_item export_params[] = {
 	CONF_ITEM_NOOP("name"),
 	CONF_ITEM_STR("user_id", 0, MAXUIDLEN, NULL, export, user_id),
@@ -166,11 +292,9 @@ static struct config_block export_param_block = {
  *
  * This function creates a new export object for the Ceph FSAL.
  *
- * @todo ACE: We do not handle re-exports of the same cluster in a
- * sane way.  Currently we create multiple handles and cache objects
- * pointing to the same one.  This is not necessarily wrong, but it is
- * inefficient.  It may also not be something we expect to use enough
- * to care about.
+ * Exports of the same cluster using the same cephx credentials share
+ * a single Ceph client mount (and therefore a single MDS session and
+ * client cache); each export holds its own root inode within it.
  *
  * @param[in]     module_in  The supplied module handle
  * @param[in]     path       The path to export
@@ -199,8 +323,6 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 	struct ceph_statx stx;
 	/* Return code */
 	int rc;
-	/* Return code from Ceph calls */
-	int ceph_status;
 	/* True if we have called fsal_export_init */
 	bool initialized = false;
 
@@ -222,60 +344,15 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 
 	initialized = true;
 
-	/* allocates ceph_mount_info */
-	ceph_status = ceph_create(&export->cmount, export->user_id);
-	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
-		LogCrit(COMPONENT_FSAL,
-			"Unable to create Ceph handle for %s.",
-			op_ctx->ctx_export->fullpath);
-		goto error;
-	}
-
-	ceph_status = ceph_conf_read_file(export->cmount, CephFSM.conf_path);
-	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
-		LogCrit(COMPONENT_FSAL,
-			"Unable to read Ceph configuration for %s.",
-			op_ctx->ctx_export->fullpath);
-		goto error;
-	}
-
-	if (export->secret_key) {
-		ceph_status = ceph_conf_set(export->cmount, "key",
-					    export->secret_key);
-		if (ceph_status) {
-			status.major = ERR_FSAL_INVAL;
-			LogCrit(COMPONENT_FSAL,
-				"Unable to set Ceph secret key for %s: %d",
-				op_ctx->ctx_export->fullpath, ceph_status);
-			goto error;
-		}
-	}
-
-	/*
-	 * Workaround for broken libcephfs that doesn't handle the path
-	 * given in ceph_mount properly. Should be harmless for fixed
-	 * libcephfs as well (see http://tracker.ceph.com/issues/18254).
-	 */
-	ceph_status = ceph_conf_set(export->cmount, "client_mountpoint",
-				    op_ctx->ctx_export->fullpath);
-	if (ceph_status) {
-		status.major = ERR_FSAL_INVAL;
-		LogCrit(COMPONENT_FSAL,
-			"Unable to set Ceph client_mountpoint for %s: %d",
-			op_ctx->ctx_export->fullpath, ceph_status);
-		goto error;
-	}
-
-	ceph_status = ceph_mount(export->cmount, op_ctx->ctx_export->fullpath);
-	if (ceph_status != 0) {
+	export->cm = ceph_get_mount(export->user_id, export->secret_key);
+	if (export->cm == NULL) {
 		status.major = ERR_FSAL_SERVERFAULT;
 		LogCrit(COMPONENT_FSAL,
 			"Unable to mount Ceph cluster for %s.",
 			op_ctx->ctx_export->fullpath);
 		goto error;
 	}
+	export->cmount = export->cm->cmount;
 
 	if (fsal_attach_export(module_in, &export->export.exports) != 0) {
 		status.major = ERR_FSAL_SERVERFAULT;
@@ -291,15 +368,25 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 	LogDebug(COMPONENT_FSAL, "Ceph module export %s.",
 		 op_ctx->ctx_export->fullpath);
 
-	status = find_cephfs_root(export->cmount, &i);
-	if (FSAL_IS_ERROR(status))
-		goto error;
-
-	rc = fsal_ceph_ll_getattr(export->cmount, i, &stx,
-				CEPH_STATX_HANDLE_MASK, op_ctx->creds);
+	/* The mount is rooted at the cluster root, walk to the export's */
+	if (strcmp(op_ctx->ctx_export->fullpath, "/") == 0) {
+		status = find_cephfs_root(export->cmount, &i);
+		if (FSAL_IS_ERROR(status))
+			goto detach;
+
+		rc = fsal_ceph_ll_getattr(export->cmount, i, &stx,
+					CEPH_STATX_HANDLE_MASK, op_ctx->creds);
+	} else {
+		rc = fsal_ceph_ll_walk(export->cmount,
+				       op_ctx->ctx_export->fullpath, &i, &stx,
+				       false, op_ctx->creds);
+	}
 	if (rc < 0) {
 		status = ceph2fsal_error(rc);
-		goto error;
+		LogCrit(COMPONENT_FSAL,
+			"Unable to find root of export %s: %d",
+			op_ctx->ctx_export->fullpath, rc);
+		goto detach;
 	}
 
 	construct_handle(&stx, i, export, &handle);
@@ -309,13 +396,16 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 
 	return status;
 
+ detach:
+	fsal_detach_export(module_in, &export->export.exports);
+
  error:
 	if (i)
 		ceph_ll_put(export->cmount, i);
 
 	if (export) {
-		if (export->cmount)
-			ceph_shutdown(export->cmount);
+		if (export->cm)
+			ceph_put_mount(export->cm);
 		gsh_free(export);
 	}
 
@@ -355,6 +445,9 @@ MODULE_INIT void init(void)
 	/* register_fsal seems to expect zeroed memory. */
 	memset(myself, 0, sizeof(*myself));
 
+	PTHREAD_MUTEX_init(&CephFSM.lock, NULL);
+	glist_init(&CephFSM.mounts);
+
 	if (register_fsal(myself, module_name, FSAL_MAJOR_VERSION,
 			  FSAL_MINOR_VERSION, FSAL_ID_CEPH) != 0) {
 		/* The register_fsal function prints its own log
@@ -390,4 +483,6 @@ MODULE_FINI void finish(void)
 			"Unable to unload Ceph FSAL.  Dying with extreme prejudice.");
 		abort();
 	}
+
+	PTHREAD_MUTEX_destroy(&CephFSM.lock);
 }
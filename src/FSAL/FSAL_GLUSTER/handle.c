@@ -150,8 +150,66 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 	return status;
 }
 
+#ifdef USE_GLUSTER_XREADDIRPLUS
+/**
+ * @brief Make an object from an entry returned by glfs_xreaddirplus_r
+ *
+ * @param[in]  glfs_export  Export the directory belongs to
+ * @param[in]  xstat        Handle and attributes of the entry
+ * @param[in]  vol_uuid     Volume id of the export
+ * @param[out] handle       The new object
+ * @param[out] attrs_out    Its attributes
+ *
+ * @return FSAL status, ERR_FSAL_NOENT if gfapi returned no handle or no
+ *         attributes for the entry.
+ */
+static fsal_status_t make_dirent_handle(struct glusterfs_export *glfs_export,
+					struct glfs_xreaddirp_stat *xstat,
+					char *vol_uuid,
+					struct fsal_obj_handle **handle,
+					struct attrlist *attrs_out)
+{
+	int rc = 0;
+	struct stat *sb;
+	struct glfs_object *glhandle;
+	unsigned char globjhdl[GFAPI_HANDLE_LENGTH] = {'\0'};
+	struct glusterfs_handle *objhandle = NULL;
+
+	sb = glfs_xreaddirplus_get_stat(xstat);
+	glhandle = glfs_xreaddirplus_get_object(xstat);
+	if (sb == NULL || glhandle == NULL)
+		return fsalstat(ERR_FSAL_NOENT, 0);
+
+	/* The object belongs to xstat, take our own copy */
+	glhandle = glfs_object_copy(glhandle);
+	if (glhandle == NULL)
+		return gluster2fsal_error(errno);
+
+	rc = glfs_h_extract_handle(glhandle, globjhdl, GFAPI_HANDLE_LENGTH);
+	if (rc < 0) {
+		rc = errno;
+		gluster_cleanup_vars(glhandle);
+		return gluster2fsal_error(rc);
+	}
+
+	construct_handle(glfs_export, sb, glhandle, globjhdl,
+			 GLAPI_HANDLE_LENGTH, &objhandle, vol_uuid);
+
+	if (attrs_out != NULL)
+		posix2fsal_attributes_all(sb, attrs_out);
+
+	*handle = &objhandle->handle;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+#endif
+
 /**
  * @brief Implements GLUSTER FSAL objectoperation readdir
+ *
+ * When gfapi supports it, entries are read with glfs_xreaddirplus_r,
+ * which returns the handle and attributes of each entry along with its
+ * name, saving a lookup per entry.
  */
 
 static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
@@ -168,6 +226,10 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	    container_of(op_ctx->fsal_export, struct glusterfs_export, export);
 	struct glusterfs_handle *objhandle =
 	    container_of(dir_hdl, struct glusterfs_handle, handle);
+#ifdef USE_GLUSTER_XREADDIRPLUS
+	struct glfs_xreaddirp_stat *xstat = NULL;
+	char vol_uuid[GLAPI_UUID_LENGTH] = {'\0'};
+#endif
 #ifdef GLTIMING
 	struct timespec s_time, e_time;
 
@@ -179,6 +241,15 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	if (glfd == NULL)
 		return gluster2fsal_error(errno);
 
+#ifdef USE_GLUSTER_XREADDIRPLUS
+	rc = glfs_get_volumeid(glfs_export->gl_fs->fs, vol_uuid,
+			       GLAPI_UUID_LENGTH);
+	if (rc < 0) {
+		status = gluster2fsal_error(errno);
+		goto out;
+	}
+#endif
+
 	if (whence != NULL)
 		offset = *whence;
 
@@ -188,7 +259,18 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 		struct dirent de;
 		struct fsal_obj_handle *obj;
 
+#ifdef USE_GLUSTER_XREADDIRPLUS
+		/* Returns 1 for an entry, 0 at the end of the directory */
+		rc = glfs_xreaddirplus_r(glfd, GFAPI_XREADDIRP_STAT |
+						   GFAPI_XREADDIRP_HANDLE,
+					 &xstat, &de, &pde);
+		if (rc > 0)
+			rc = 0;
+		else if (rc == 0)
+			pde = NULL;
+#else
 		rc = glfs_readdir_r(glfd, &de, &pde);
+#endif
 		if (rc == 0 && pde != NULL) {
 			struct attrlist attrs;
 			enum fsal_dir_result cb_rc;
@@ -196,11 +278,33 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 			/* skip . and .. */
 			if ((strcmp(de.d_name, ".") == 0)
 			    || (strcmp(de.d_name, "..") == 0)) {
+#ifdef USE_GLUSTER_XREADDIRPLUS
+				if (xstat != NULL) {
+					glfs_free(xstat);
+					xstat = NULL;
+				}
+#endif
 				continue;
 			}
 			fsal_prepare_attrs(&attrs, attrmask);
 
+#ifdef USE_GLUSTER_XREADDIRPLUS
+			status = fsalstat(ERR_FSAL_NOENT, 0);
+			if (xstat != NULL) {
+				status = make_dirent_handle(glfs_export, xstat,
+							    vol_uuid, &obj,
+							    &attrs);
+				glfs_free(xstat);
+				xstat = NULL;
+			}
+
+			/* No handle or attributes came back, look it up */
+			if (status.major == ERR_FSAL_NOENT)
+				status = lookup(dir_hdl, de.d_name, &obj,
+						&attrs);
+#else
 			status = lookup(dir_hdl, de.d_name, &obj, &attrs);
+#endif
 			if (FSAL_IS_ERROR(status))
 				goto out;
 
@@ -1945,6 +2049,175 @@ static fsal_status_t glusterfs_write2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief State carried across an asynchronous gfapi I/O
+ */
+struct glusterfs_async_arg {
+	struct fsal_obj_handle *obj_hdl;	/*< File the I/O is done on */
+	struct fsal_io_arg *io_arg;		/*< I/O description */
+	fsal_async_cb done_cb;			/*< Caller's completion */
+	void *caller_arg;			/*< Argument for done_cb */
+	size_t io_size;				/*< Amount requested */
+	bool is_read;				/*< Read or write */
+};
+
+/**
+ * @brief Completion of an asynchronous gfapi read or write
+ *
+ * Called by gfapi, from one of its own threads.  gfapi sets errno
+ * from the fop reply before calling us.  No gfapi call may be made
+ * from here, they would wait on the thread that is calling us.
+ */
+static void glusterfs_io_async_cbk(struct glfs_fd *glfd, ssize_t ret,
+				   void *data)
+{
+	struct glusterfs_async_arg *arg = data;
+	struct fsal_io_arg *io_arg = arg->io_arg;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	int retval;
+
+	if (ret < 0) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+	} else {
+		io_arg->io_amount = ret;
+		if (arg->is_read)
+			io_arg->end_of_file = (ret < arg->io_size);
+	}
+
+	arg->done_cb(arg->obj_hdl, status, io_arg, arg->caller_arg);
+	gsh_free(arg);
+}
+
+/**
+ * @brief Submit an asynchronous read or write to gfapi
+ *
+ * gfapi holds its own reference on the glfd until the completion has
+ * been called, so the descriptor found by find_fd may be closed, or
+ * the object lock dropped, as soon as the fop has been submitted.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         Bypass any non-mandatory deny read or write
+ * @param[in,out] io_arg         The I/O description and results
+ * @param[in]     done_cb        Callback to invoke on completion
+ * @param[in]     caller_arg     Opaque argument for done_cb
+ * @param[in]     is_read        Read or write
+ */
+static void glusterfs_io_async(struct fsal_obj_handle *obj_hdl,
+			       bool bypass,
+			       struct fsal_io_arg *io_arg,
+			       fsal_async_cb done_cb,
+			       void *caller_arg,
+			       bool is_read)
+{
+	struct glusterfs_fd my_fd = {0};
+	struct glusterfs_async_arg *arg;
+	fsal_status_t status;
+	int retval = 0;
+	int i;
+	bool has_lock = false;
+	bool closefd = false;
+	struct glusterfs_export *glfs_export =
+	     container_of(op_ctx->fsal_export, struct glusterfs_export, export);
+
+	/* Get a usable file descriptor */
+	status = find_fd(&my_fd, obj_hdl, bypass, io_arg->state,
+			 is_read ? FSAL_O_READ : FSAL_O_WRITE,
+			 &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	arg = gsh_malloc(sizeof(*arg));
+	arg->obj_hdl = obj_hdl;
+	arg->io_arg = io_arg;
+	arg->done_cb = done_cb;
+	arg->caller_arg = caller_arg;
+	arg->is_read = is_read;
+	arg->io_size = 0;
+
+	for (i = 0; i < io_arg->iovcnt; i++)
+		arg->io_size += io_arg->iov[i].iov_len;
+
+	io_arg->io_amount = 0;
+
+	if (is_read) {
+		retval = glfs_preadv_async(my_fd.glfd, io_arg->iov,
+					   io_arg->iovcnt, io_arg->offset, 0,
+					   glusterfs_io_async_cbk, arg);
+		if (retval != 0)
+			retval = errno;
+	} else {
+		retval = setglustercreds(glfs_export,
+					 &op_ctx->creds->caller_uid,
+					 &op_ctx->creds->caller_gid,
+					 op_ctx->creds->caller_glen,
+					 op_ctx->creds->caller_garray);
+		if (retval != 0) {
+			gsh_free(arg);
+			status = gluster2fsal_error(EPERM);
+			LogFatal(COMPONENT_FSAL,
+				 "Could not set Ganesha credentials");
+			goto out;
+		}
+
+		retval = glfs_pwritev_async(my_fd.glfd, io_arg->iov,
+					    io_arg->iovcnt, io_arg->offset,
+					    io_arg->fsal_stable ? O_SYNC : 0,
+					    glusterfs_io_async_cbk, arg);
+		if (retval != 0)
+			retval = errno;
+
+		/* restore credentials */
+		if (setglustercreds(glfs_export, NULL, NULL, 0, NULL) != 0)
+			LogFatal(COMPONENT_FSAL,
+				 "Could not set Ganesha credentials");
+	}
+
+	if (retval != 0) {
+		/* Not submitted, the completion will never be called */
+		gsh_free(arg);
+		status = fsalstat(posix2fsal_error(retval), retval);
+	}
+
+ out:
+
+	if (closefd)
+		glusterfs_close_my_fd(&my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	if (FSAL_IS_ERROR(status))
+		done_cb(obj_hdl, status, io_arg, caller_arg);
+}
+
+/* read2_async
+ */
+
+static void glusterfs_read2_async(struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  struct fsal_io_arg *io_arg,
+				  fsal_async_cb done_cb,
+				  void *caller_arg)
+{
+	glusterfs_io_async(obj_hdl, bypass, io_arg, done_cb, caller_arg,
+			   true);
+}
+
+/* write2_async
+ */
+
+static void glusterfs_write2_async(struct fsal_obj_handle *obj_hdl,
+				   bool bypass,
+				   struct fsal_io_arg *io_arg,
+				   fsal_async_cb done_cb,
+				   void *caller_arg)
+{
+	glusterfs_io_async(obj_hdl, bypass, io_arg, done_cb, caller_arg,
+			   false);
+}
+
 /* commit2
  */
 
@@ -2630,6 +2903,8 @@ void handle_ops_init(struct fsal_obj_ops *ops)
 	ops->reopen2 = glusterfs_reopen2;
 	ops->read2 = glusterfs_read2;
 	ops->write2 = glusterfs_write2;
+	ops->read2_async = glusterfs_read2_async;
+	ops->write2_async = glusterfs_write2_async;
 	ops->commit2 = glusterfs_commit2;
 	ops->lock_op2 = glusterfs_lock_op2;
 	ops->setattr2 = glusterfs_setattr2;
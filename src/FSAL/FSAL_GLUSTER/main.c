@@ -78,6 +78,8 @@ static struct config_item glfs_params[] = {
 		       fsal_staticfsinfo_t, pnfs_mds),
 	CONF_ITEM_BOOL("pnfs_ds", true,
 		       fsal_staticfsinfo_t, pnfs_ds),
+	CONF_ITEM_BOOL("up_invalidate", false,
+		       fsal_staticfsinfo_t, up_invalidate),
 	CONFIG_EOL
 };
 
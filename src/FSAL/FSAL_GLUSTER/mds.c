@@ -535,38 +535,97 @@ uint32_t superfasthash(const unsigned char *data, uint32_t len)
 	return hash;
 }
 /**
- * It will extract hostname from pathinfo.PATH_INFO_KEYS gives
+ * Extracts the hostname from one server's entry of the pathinfo,
+ * between its first two ':'.
+ *
+ * Returns zero and valid hostname on success
+ */
+static int ds_hostname(const char *ds_path_info, char *hostname, size_t size)
+{
+	const char *start, *end;
+	size_t i = 0;
+
+	start = strchr(ds_path_info, ':');
+	if (!start)
+		return -1;
+	end = strchr(start + 1, ':');
+	if (!end)
+		return -1;
+
+	memset(hostname, 0, size);
+
+	while (++start != end && i < size - 1)
+		hostname[i++] = *start;
+
+	LogDebug(COMPONENT_PNFS, "hostname %s", hostname);
+
+	return 0;
+}
+
+/**
+ * Resolves the IPv4 address of a data server
+ *
+ * Returns zero and the address on success
+ */
+static int ds_resolve(const char *hostname, uint32_t *ds_addr)
+{
+	char		scratch[SOCK_NAME_MAX] = {0, };
+	struct addrinfo hints                  = {0, };
+	struct addrinfo *res                   = NULL;
+	int             ret;
+
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_family = AF_INET;
+	ret = getaddrinfo(hostname, NULL, &hints, &res);
+	/* we trust getaddrinfo() never returns EAI_AGAIN! */
+	if (ret != 0) {
+		*ds_addr = 0;
+		LogMajor(COMPONENT_PNFS, "error %s\n", gai_strerror(ret));
+		return ret;
+	}
+	sprint_sockip((sockaddr_t *)res->ai_addr, scratch, sizeof(scratch));
+	LogDebug(COMPONENT_PNFS, "ip address : %s", scratch);
+	*ds_addr = ((struct sockaddr_in *)(res->ai_addr))->sin_addr.s_addr;
+	freeaddrinfo(res);
+
+	return 0;
+}
+
+/**
+ * It will select the DS from pathinfo.PATH_INFO_KEYS gives
  * details about all the servers and path in that server where
  * file resides.
- * First it selects the DS based on distributed hashing, then
- * with the help of some basic string manipulations, the hostname
- * can be fetched from the pathinfo
+ * Any of them can serve the file, so the least loaded one is
+ * picked, going by what clients reported with LAYOUTSTATS.  When
+ * none stands out, the DS is chosen by distributed hashing as
+ * before, keeping each file on the same server.
  *
- * Returns zero and valid hostname on success
+ * Returns zero and valid address on success
  */
 
 int
-select_ds(struct glfs_object *object, char *pathinfo, char *hostname,
-	  size_t size)
+select_ds(struct glfs_object *object, char *pathinfo, uint32_t *ds_addr)
 {
 	/* Represents starting of each server in the list*/
 	const char posix[10]    = "POSIX";
 	/* Array of pathinfo of available dses */
 	char	*ds_path_info[MAX_DS_COUNT];
+	/* Deviceids of the dses that resolved */
+	struct pnfs_deviceid devids[MAX_DS_COUNT];
 	/* Key for hashing */
 	unsigned char key[16];
 	/* Starting of first brick path in the pathinfo */
 	char	*tmp		= NULL;
-	/* Stores starting of hostname */
-	char    *start          = NULL;
-	/* Stores ending of hostname */
-	char    *end            = NULL;
+	char	hostname[256];
 	int     ret             = -1;
 	int     i               = 0;
 	/* counts no of available ds */
 	int	no_of_ds	= 0;
+	/* counts no of dses that resolved */
+	int	no_of_devs	= 0;
+	uint32_t hash;
 
-	if (!pathinfo || !size)
+	if (!pathinfo)
 		goto out;
 
 	tmp = pathinfo;
@@ -593,26 +652,35 @@ select_ds(struct glfs_object *object, char *pathinfo, char *hostname,
 	if (ret < 0)
 		goto out;
 
-	/* Pick DS from the list */
-	if (no_of_ds == 1)
-		ret = 0;
-	else
-		ret = superfasthash(key, 16) % no_of_ds;
+	hash = superfasthash(key, 16);
 
-	start = strchr(ds_path_info[ret], ':');
-	if (!start)
-		goto out;
-	end = start + 1;
-	end = strchr(end, ':');
-	if (start == end)
+	/* Pick DS from the list */
+	if (no_of_ds == 1) {
+		ret = ds_hostname(ds_path_info[0], hostname, sizeof(hostname));
+		if (ret == 0)
+			ret = ds_resolve(hostname, ds_addr);
 		goto out;
+	}
 
-	memset(hostname, 0, size);
+	for (i = 0; i < no_of_ds; i++) {
+		struct pnfs_deviceid devid =
+				DEVICE_ID_INIT_ZERO(FSAL_ID_GLUSTER);
 
-	while (++start != end)
-		hostname[i++] = *start;
+		if (ds_hostname(ds_path_info[i], hostname, sizeof(hostname)) ||
+		    ds_resolve(hostname, &devid.device_id4))
+			continue;
+
+		devids[no_of_devs++] = devid;
+	}
+
+	if (no_of_devs == 0) {
+		ret = -1;
+		goto out;
+	}
+
+	*ds_addr = devids[pnfs_device_pick(devids, no_of_devs,
+					   hash)].device_id4;
 	ret = 0;
-	LogDebug(COMPONENT_PNFS, "hostname %s", hostname);
 
 out:
 	return ret;
@@ -621,7 +689,7 @@ out:
 /*
  * The data server address will be send from here
  *
- * The information about the first server present
+ * The information about the least loaded server present
  * in the PATH_INFO_KEY will be returned, since
  * entire file is consistent over the servers
  * (Striped volumes are not considered right now)
@@ -634,10 +702,6 @@ glfs_get_ds_addr(struct glfs *fs, struct glfs_object *object, uint32_t *ds_addr)
 {
 	int             ret                    = 0;
 	char            pathinfo[1024]         = {0, };
-	char            hostname[256]          = {0, };
-	char		scratch[SOCK_NAME_MAX] = {0, };
-	struct addrinfo hints                  = {0, };
-	struct addrinfo *res                   = NULL;
 	const char      *pathinfokey           = "trusted.glusterfs.pathinfo";
 
 	ret = glfs_h_getxattrs(fs, object, pathinfokey, pathinfo,
@@ -645,25 +709,9 @@ glfs_get_ds_addr(struct glfs *fs, struct glfs_object *object, uint32_t *ds_addr)
 
 	LogDebug(COMPONENT_PNFS, "pathinfo %s", pathinfo);
 
-	ret = select_ds(object, pathinfo, hostname, sizeof(hostname));
-	if (ret) {
+	ret = select_ds(object, pathinfo, ds_addr);
+	if (ret)
 		LogMajor(COMPONENT_PNFS, "No DS found");
-		goto out;
-	}
 
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_family = AF_INET;
-	ret = getaddrinfo(hostname, NULL, &hints, &res);
-	/* we trust getaddrinfo() never returns EAI_AGAIN! */
-	if (ret != 0) {
-		*ds_addr = 0;
-		LogMajor(COMPONENT_PNFS, "error %s\n", gai_strerror(ret));
-		goto out;
-	}
-	sprint_sockip((sockaddr_t *)res->ai_addr, scratch, sizeof(scratch));
-	LogDebug(COMPONENT_PNFS, "ip address : %s", scratch);
-	*ds_addr = ((struct sockaddr_in *)(res->ai_addr))->sin_addr.s_addr;
-out:
-	freeaddrinfo(res);
 	return ret;
 }
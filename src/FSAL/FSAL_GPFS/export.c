@@ -482,6 +482,7 @@ void gpfs_export_ops_init(struct export_ops *ops)
 
 static void free_gpfs_filesystem(struct gpfs_filesystem *gpfs_fs)
 {
+	gpfs_up_fini(gpfs_fs);
 	if (gpfs_fs->root_fd >= 0)
 		close(gpfs_fs->root_fd);
 	gsh_free(gpfs_fs);
@@ -594,6 +595,7 @@ int gpfs_claim_filesystem(struct fsal_filesystem *fs, struct fsal_export *exp)
 	glist_init(&gpfs_fs->exports);
 	gpfs_fs->root_fd = -1;
 	gpfs_fs->fs = fs;
+	gpfs_up_init(gpfs_fs);
 
 	retval = open_root_fd(gpfs_fs);
 
@@ -30,6 +30,180 @@
 #include <unistd.h>
 #include <utime.h>
 #include <sys/time.h>
+#include "city.h"
+
+/**
+ * @brief An invalidation handed to the general fridge
+ *
+ * Invalidations run on the general fridge rather than in the upcall
+ * thread, so that a slow one does not hold up the events behind it.
+ * While one is queued for a handle, further invalidations of that
+ * handle with no new flags are dropped, and attribute updates for it
+ * are skipped: the cached attributes will be refetched anyway.
+ */
+struct gpfs_up_pending {
+	struct glist_head node;		/*< On gpfs_fs->up_pending */
+	struct gpfs_filesystem *gpfs_fs;
+	uint32_t flags;			/*< Union of the queued flags */
+	uint32_t refs;			/*< Queued invalidations */
+	size_t len;			/*< Key length */
+	char key[];
+};
+
+static inline struct glist_head *gpfs_up_bucket(
+				struct gpfs_filesystem *gpfs_fs,
+				struct gsh_buffdesc *key)
+{
+	return &gpfs_fs->up_pending[CityHash64(key->addr, key->len) %
+				    GPFS_UP_BUCKETS];
+}
+
+/* Must be called with up_lock held */
+static struct gpfs_up_pending *gpfs_up_find(struct gpfs_filesystem *gpfs_fs,
+					    struct gsh_buffdesc *key)
+{
+	struct glist_head *bucket = gpfs_up_bucket(gpfs_fs, key);
+	struct glist_head *glist;
+	struct gpfs_up_pending *p;
+
+	glist_for_each(glist, bucket) {
+		p = glist_entry(glist, struct gpfs_up_pending, node);
+		if (p->len == key->len && memcmp(p->key, key->addr,
+						 key->len) == 0)
+			return p;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Set up the in-flight invalidation table of a file system
+ *
+ * @param[in] gpfs_fs  File system
+ */
+void gpfs_up_init(struct gpfs_filesystem *gpfs_fs)
+{
+	int i;
+
+	PTHREAD_MUTEX_init(&gpfs_fs->up_lock, NULL);
+	PTHREAD_COND_init(&gpfs_fs->up_cond, NULL);
+
+	for (i = 0; i < GPFS_UP_BUCKETS; i++)
+		glist_init(&gpfs_fs->up_pending[i]);
+}
+
+/**
+ * @brief Wait for queued invalidations of a file system to finish
+ *
+ * @param[in] gpfs_fs  File system
+ */
+void gpfs_up_fini(struct gpfs_filesystem *gpfs_fs)
+{
+	PTHREAD_MUTEX_lock(&gpfs_fs->up_lock);
+	while (gpfs_fs->up_inflight != 0)
+		pthread_cond_wait(&gpfs_fs->up_cond, &gpfs_fs->up_lock);
+	PTHREAD_MUTEX_unlock(&gpfs_fs->up_lock);
+
+	PTHREAD_COND_destroy(&gpfs_fs->up_cond);
+	PTHREAD_MUTEX_destroy(&gpfs_fs->up_lock);
+}
+
+/**
+ * @brief Completion of a queued invalidation
+ *
+ * @param[in] arg     The pending record
+ * @param[in] status  Result of the invalidation
+ */
+static void gpfs_up_done(void *arg, fsal_status_t status)
+{
+	struct gpfs_up_pending *p = arg;
+	struct gpfs_filesystem *gpfs_fs = p->gpfs_fs;
+
+	if (FSAL_IS_ERROR(status) && status.major != ERR_FSAL_NOENT)
+		LogWarn(COMPONENT_FSAL_UP,
+			"Invalidate could not be processed for fd %d rc %s",
+			gpfs_fs->root_fd, fsal_err_txt(status));
+
+	PTHREAD_MUTEX_lock(&gpfs_fs->up_lock);
+	if (--p->refs == 0) {
+		glist_del(&p->node);
+		gsh_free(p);
+	}
+	if (--gpfs_fs->up_inflight == 0)
+		pthread_cond_signal(&gpfs_fs->up_cond);
+	PTHREAD_MUTEX_unlock(&gpfs_fs->up_lock);
+}
+
+/**
+ * @brief Queue an invalidation, unless an equivalent one is queued
+ *
+ * @param[in] gpfs_fs     File system
+ * @param[in] event_func  Up vector
+ * @param[in] key         Handle key
+ * @param[in] flags       FSAL_UP_INVALIDATE_* flags
+ *
+ * @return FSAL status of the submission.
+ */
+static fsal_status_t gpfs_up_invalidate(struct gpfs_filesystem *gpfs_fs,
+					struct fsal_up_vector *event_func,
+					struct gsh_buffdesc *key,
+					uint32_t flags)
+{
+	struct gpfs_up_pending *p;
+	fsal_status_t status;
+
+	PTHREAD_MUTEX_lock(&gpfs_fs->up_lock);
+
+	p = gpfs_up_find(gpfs_fs, key);
+	if (p != NULL && (p->flags & flags) == flags) {
+		PTHREAD_MUTEX_unlock(&gpfs_fs->up_lock);
+		LogFullDebug(COMPONENT_FSAL_UP,
+			     "invalidate %x already queued", flags);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	if (p == NULL) {
+		p = gsh_calloc(1, sizeof(*p) + key->len);
+		p->gpfs_fs = gpfs_fs;
+		p->len = key->len;
+		memcpy(p->key, key->addr, key->len);
+		glist_add_tail(gpfs_up_bucket(gpfs_fs, key), &p->node);
+	}
+
+	status = up_async_invalidate(general_fridge, event_func, key, flags,
+				     gpfs_up_done, p);
+
+	if (!FSAL_IS_ERROR(status)) {
+		p->flags |= flags;
+		p->refs++;
+		gpfs_fs->up_inflight++;
+	} else if (p->refs == 0) {
+		glist_del(&p->node);
+		gsh_free(p);
+	}
+
+	PTHREAD_MUTEX_unlock(&gpfs_fs->up_lock);
+
+	return status;
+}
+
+/**
+ * @brief Whether an invalidation of a handle is queued
+ *
+ * @param[in] gpfs_fs  File system
+ * @param[in] key      Handle key
+ */
+static bool gpfs_up_is_pending(struct gpfs_filesystem *gpfs_fs,
+			       struct gsh_buffdesc *key)
+{
+	bool pending;
+
+	PTHREAD_MUTEX_lock(&gpfs_fs->up_lock);
+	pending = gpfs_up_find(gpfs_fs, key) != NULL;
+	PTHREAD_MUTEX_unlock(&gpfs_fs->up_lock);
+
+	return pending;
+}
 
 /**
  * @brief Up Thread
@@ -317,8 +491,8 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 				 * until this gets fixed!
 				 */
 				if (flags & (UP_SIZE | UP_SIZE_BIG)) {
-					fsal_status = event_func->invalidate(
-						event_func, &key,
+					fsal_status = gpfs_up_invalidate(
+						gpfs_fs, event_func, &key,
 						FSAL_UP_INVALIDATE_CACHE);
 					break;
 				}
@@ -328,9 +502,17 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 				if (flags &
 				    ~(UP_SIZE | UP_NLINK | UP_MODE | UP_OWN |
 				     UP_TIMES | UP_ATIME | UP_SIZE_BIG)) {
-					fsal_status = event_func->invalidate(
-						event_func, &key,
+					fsal_status = gpfs_up_invalidate(
+						gpfs_fs, event_func, &key,
 						FSAL_UP_INVALIDATE_CACHE);
+				} else if (gpfs_up_is_pending(gpfs_fs, &key)) {
+					/* The attributes will be refetched */
+					LogFullDebug(COMPONENT_FSAL_UP,
+						     "inode update: ino %"PRId64
+						     " has an invalidate queued",
+						     callback.buf->st_ino);
+					fsal_status =
+						fsalstat(ERR_FSAL_NO_ERROR, 0);
 				} else {
 					/* buf may not have all attributes set.
 					 * Since posix2fsal_attributes()
@@ -404,11 +586,10 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 				    "inode invalidate: flags:%x update ino %"
 				    PRId64, flags, callback.buf->st_ino);
 
-			upflags = FSAL_UP_INVALIDATE_CACHE;
-			fsal_status = event_func->invalidate_close(
-						event_func,
-						&key,
-						upflags);
+			upflags = FSAL_UP_INVALIDATE_CACHE |
+				  FSAL_UP_INVALIDATE_CLOSE;
+			fsal_status = gpfs_up_invalidate(gpfs_fs, event_func,
+							 &key, upflags);
 			break;
 
 		case THREAD_PAUSE:
@@ -39,6 +39,9 @@ struct gpfs_fsal_export {
 	bool use_acl;
 };
 
+/* Buckets of the in-flight invalidation table of a file system */
+#define GPFS_UP_BUCKETS 64
+
 /*
  * GPFS internal filesystem
  */
@@ -49,8 +52,15 @@ struct gpfs_filesystem {
 	bool up_thread_started;
 	const struct fsal_up_vector *up_ops;
 	pthread_t up_thread; /* upcall thread */
+	pthread_mutex_t up_lock; /* protects the fields below */
+	pthread_cond_t up_cond; /* signalled when up_inflight drops to 0 */
+	uint32_t up_inflight; /* invalidations queued and not yet done */
+	struct glist_head up_pending[GPFS_UP_BUCKETS]; /* by handle key */
 };
 
+void gpfs_up_init(struct gpfs_filesystem *gpfs_fs);
+void gpfs_up_fini(struct gpfs_filesystem *gpfs_fs);
+
 /*
  * Link GPFS file systems and exports
  * Supports a many-to-many relationship
@@ -82,6 +82,7 @@ static struct fsal_staticfsinfo_t default_gpfs_info = {
 	.fsal_trace = true,
 	.fsal_grace = false,
 	.link_supports_permission_checks = true,
+	.up_invalidate = true,
 };
 
 /** @struct gpfs_params
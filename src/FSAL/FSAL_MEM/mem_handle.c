@@ -289,6 +289,264 @@ static void mem_copy_attrs_mask(struct attrlist *attrs_in,
 	attrs_out->change = timespec_to_nsecs(&attrs_out->chgtime);
 }
 
+/**
+ * @brief Hold an operation up as configured
+ *
+ * Sleeps for @a latency microseconds plus a random jitter.  With a
+ * throttle, the @a bytes are first queued behind the ones already
+ * admitted at the configured bandwidth.
+ *
+ * @param[in] latency	Microseconds to add
+ * @param[in] thr	Throttle to go through, or NULL
+ * @param[in] bandwidth	Bytes per second of the throttle, 0 unlimited
+ * @param[in] bytes	Bytes transferred
+ */
+static void mem_delay(uint32_t latency, struct mem_throttle *thr,
+		      uint64_t bandwidth, uint64_t bytes)
+{
+	nsecs_elapsed_t delay = latency * NS_PER_USEC;
+	struct timespec deadline;
+
+	if (MEM.latency_jitter != 0)
+		delay += (random() % (MEM.latency_jitter + 1)) * NS_PER_USEC;
+
+	if (thr == NULL || bandwidth == 0) {
+		if (delay == 0)
+			return;
+		thr = NULL;
+	}
+
+	now(&deadline);
+
+	if (thr != NULL) {
+		PTHREAD_MUTEX_lock(&thr->lock);
+		if (gsh_time_cmp(&thr->next, &deadline) < 0)
+			thr->next = deadline;
+		timespec_add_nsecs(bytes * NS_PER_SEC / bandwidth, &thr->next);
+		deadline = thr->next;
+		PTHREAD_MUTEX_unlock(&thr->lock);
+	}
+
+	timespec_add_nsecs(delay, &deadline);
+
+	while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &deadline,
+			       NULL) == EINTR)
+		;
+}
+
+static inline int
+mem_extent_cmpf(const struct avltree_node *lhs,
+		const struct avltree_node *rhs)
+{
+	struct mem_extent *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct mem_extent, node);
+	rk = avltree_container_of(rhs, struct mem_extent, node);
+
+	if (lk->index < rk->index)
+		return -1;
+
+	if (lk->index == rk->index)
+		return 0;
+
+	return 1;
+}
+
+/**
+ * @brief Find the extent holding an offset
+ *
+ * @param[in] hdl	File
+ * @param[in] index	Offset / MEM_EXTENT_SIZE
+ * @param[in] create	Allocate the extent if there is none
+ *
+ * @return The extent, or NULL if it's a hole.
+ */
+static struct mem_extent *mem_extent_get(struct mem_fsal_obj_handle *hdl,
+					 uint64_t index, bool create)
+{
+	struct mem_extent key, *ext;
+	struct avltree_node *node;
+
+	key.index = index;
+	node = avltree_lookup(&key.node, &hdl->mh_file.extents);
+	if (node != NULL)
+		return avltree_container_of(node, struct mem_extent, node);
+
+	if (!create)
+		return NULL;
+
+	ext = gsh_calloc(1, sizeof(*ext) + MEM_EXTENT_SIZE);
+	ext->index = index;
+	avltree_insert(&ext->node, &hdl->mh_file.extents);
+	hdl->mh_file.nextents++;
+	hdl->attrs.spaceused = hdl->mh_file.nextents * MEM_EXTENT_SIZE;
+
+	return ext;
+}
+
+/**
+ * @brief Copy a range of a file out
+ *
+ * Holes read as zeros, and what lies past the stored part of the file
+ * as 'a's.  The caller holds data_lock.
+ *
+ * @param[in]  hdl	File
+ * @param[in]  offset	Start of the range
+ * @param[in]  len	Length of the range
+ * @param[out] buffer	Buffer for the data
+ */
+static void mem_data_read(struct mem_fsal_obj_handle *hdl, uint64_t offset,
+			  size_t len, char *buffer)
+{
+	struct mem_extent *ext;
+	size_t n;
+
+	while (len > 0) {
+		if (offset >= MEM.inode_size) {
+			memset(buffer, 'a', len);
+			return;
+		}
+
+		n = MIN(len, MEM_EXTENT_SIZE - offset % MEM_EXTENT_SIZE);
+		n = MIN(n, MEM.inode_size - offset);
+
+		ext = mem_extent_get(hdl, offset / MEM_EXTENT_SIZE, false);
+		if (ext != NULL)
+			memcpy(buffer, ext->data + offset % MEM_EXTENT_SIZE, n);
+		else
+			memset(buffer, 0, n);
+
+		buffer += n;
+		offset += n;
+		len -= n;
+	}
+}
+
+/**
+ * @brief Copy a range into a file
+ *
+ * What lies past the stored part of the file is dropped.  The caller
+ * holds data_lock for write.
+ *
+ * @param[in] hdl	File
+ * @param[in] offset	Start of the range
+ * @param[in] len	Length of the range
+ * @param[in] buffer	Data to store
+ */
+static void mem_data_write(struct mem_fsal_obj_handle *hdl, uint64_t offset,
+			   size_t len, const char *buffer)
+{
+	struct mem_extent *ext;
+	size_t n;
+
+	while (len > 0 && offset < MEM.inode_size) {
+		n = MIN(len, MEM_EXTENT_SIZE - offset % MEM_EXTENT_SIZE);
+		n = MIN(n, MEM.inode_size - offset);
+
+		ext = mem_extent_get(hdl, offset / MEM_EXTENT_SIZE, true);
+		memcpy(ext->data + offset % MEM_EXTENT_SIZE, buffer, n);
+
+		buffer += n;
+		offset += n;
+		len -= n;
+	}
+}
+
+/**
+ * @brief Set the size of a file
+ *
+ * Extents past the new size are freed, and the tail of the last one
+ * is zeroed so that growing the file again reads zeros.
+ *
+ * @param[in] hdl	File
+ * @param[in] size	New size
+ */
+static void mem_data_truncate(struct mem_fsal_obj_handle *hdl, uint64_t size)
+{
+	struct avltree_node *node;
+	struct mem_extent *ext;
+
+	PTHREAD_RWLOCK_wrlock(&hdl->mh_file.data_lock);
+
+	while ((node = avltree_last(&hdl->mh_file.extents)) != NULL) {
+		ext = avltree_container_of(node, struct mem_extent, node);
+
+		if (ext->index * MEM_EXTENT_SIZE < size) {
+			if (ext->index == size / MEM_EXTENT_SIZE)
+				memset(ext->data + size % MEM_EXTENT_SIZE, 0,
+				       MEM_EXTENT_SIZE - size % MEM_EXTENT_SIZE);
+			break;
+		}
+
+		avltree_remove(node, &hdl->mh_file.extents);
+		hdl->mh_file.nextents--;
+		gsh_free(ext);
+	}
+
+	hdl->mh_file.length = size;
+	hdl->attrs.filesize = size;
+	hdl->attrs.spaceused = hdl->mh_file.nextents * MEM_EXTENT_SIZE;
+
+	PTHREAD_RWLOCK_unlock(&hdl->mh_file.data_lock);
+}
+
+/**
+ * @brief Read a range as a list of data and hole segments
+ *
+ * The data of data segments is packed at the start of buffer.  The
+ * caller holds data_lock and has clipped the range to the file.
+ *
+ * @param[in]     hdl         File
+ * @param[in]     offset      Start of the range
+ * @param[in]     len         Length of the range
+ * @param[out]    buffer      Buffer for the data
+ * @param[in,out] info        Room for the segments, and segments found
+ *
+ * @return Length of the range covered by the segments.
+ */
+static size_t mem_data_read_plus(struct mem_fsal_obj_handle *hdl,
+				 uint64_t offset, size_t len, char *buffer,
+				 struct io_info *info)
+{
+	uint64_t pos = offset, end = offset + len, seg_end;
+	struct io_segment *seg = NULL;
+	data_content4 what;
+	size_t packed = 0;
+
+	info->io_segcnt = 0;
+
+	while (pos < end) {
+		if (pos >= MEM.inode_size) {
+			what = NFS4_CONTENT_DATA;
+			seg_end = end;
+		} else {
+			seg_end = pos - pos % MEM_EXTENT_SIZE + MEM_EXTENT_SIZE;
+			seg_end = MIN(seg_end, MIN(end, MEM.inode_size));
+			what = mem_extent_get(hdl, pos / MEM_EXTENT_SIZE, false)
+				? NFS4_CONTENT_DATA : NFS4_CONTENT_HOLE;
+		}
+
+		if (seg == NULL || seg->what != what) {
+			if (info->io_segcnt == info->io_segmax)
+				break;
+			seg = &info->io_segs[info->io_segcnt++];
+			seg->what = what;
+			seg->offset = pos;
+			seg->length = 0;
+		}
+
+		if (what == NFS4_CONTENT_DATA) {
+			mem_data_read(hdl, pos, seg_end - pos, buffer + packed);
+			packed += seg_end - pos;
+		}
+
+		seg->length += seg_end - pos;
+		pos = seg_end;
+	}
+
+	return pos - offset;
+}
+
 /**
  * @brief Close a FD
  *
@@ -326,20 +584,12 @@ _mem_alloc_handle(struct mem_fsal_obj_handle *parent,
 	char path[MAXPATHLEN];
 	struct display_buffer pathbuf = {sizeof(path), path, path};
 	int rc;
-	size_t isize;
-
-	isize = sizeof(struct mem_fsal_obj_handle);
-	if (type == REGULAR_FILE) {
-		/* Regular files need space to read/write */
-		isize += MEM.inode_size;
-	}
 
-	hdl = gsh_calloc(1, isize);
+	hdl = gsh_calloc(1, sizeof(struct mem_fsal_obj_handle));
 
 	/* Establish tree details for this directory */
 	hdl->m_name = gsh_strdup(name);
 	hdl->parent = parent;
-	hdl->datasize = MEM.inode_size;
 
 	/* Create the full path */
 	rc = fullpath(&pathbuf, hdl);
@@ -402,14 +652,15 @@ _mem_alloc_handle(struct mem_fsal_obj_handle *parent,
 
 	switch (type) {
 	case REGULAR_FILE:
-		if ((attrs && attrs->valid_mask & ATTR_SIZE) != 0) {
+		/* Files start out sparse */
+		if ((attrs && attrs->valid_mask & ATTR_SIZE) != 0)
 			hdl->attrs.filesize = attrs->filesize;
-			hdl->attrs.spaceused = attrs->filesize;
-		} else {
+		else
 			hdl->attrs.filesize = 0;
-			hdl->attrs.spaceused = 0;
-		}
+		hdl->attrs.spaceused = 0;
 		hdl->mh_file.length = hdl->attrs.filesize;
+		PTHREAD_RWLOCK_init(&hdl->mh_file.data_lock, NULL);
+		avltree_init(&hdl->mh_file.extents, mem_extent_cmpf, 0);
 		hdl->attrs.numlinks = 1;
 		break;
 	case BLOCK_FILE:
@@ -522,6 +773,8 @@ static fsal_status_t mem_create_obj(struct mem_fsal_obj_handle *parent,
 		return fsalstat(ERR_FSAL_NOTDIR, 0);
 	}
 
+	mem_delay(MEM.meta_latency, NULL, 0, 0);
+
 	status = mem_int_lookup(parent, name, &hdl);
 	if (!FSAL_IS_ERROR(status)) {
 		/* It already exists */
@@ -575,9 +828,10 @@ static fsal_status_t mem_lookup(struct fsal_obj_handle *parent,
 	/* Check if this context already holds the lock on
 	 * this directory.
 	 */
-	if (op_ctx->fsal_private != parent)
+	if (op_ctx->fsal_private != parent) {
+		mem_delay(MEM.meta_latency, NULL, 0, 0);
 		PTHREAD_RWLOCK_rdlock(&parent->obj_lock);
-	else
+	} else
 		LogFullDebug(COMPONENT_FSAL,
 			     "Skipping lock for %s",
 			     myself->m_name);
@@ -641,6 +895,8 @@ static fsal_status_t mem_readdir(struct fsal_obj_handle *dir_hdl,
 		 "hdl=%p, name=%s",
 		 myself, myself->m_name);
 
+	mem_delay(MEM.meta_latency, NULL, 0, 0);
+
 	PTHREAD_RWLOCK_rdlock(&dir_hdl->obj_lock);
 
 	/* Use fsal_private to signal to lookup that we hold
@@ -834,6 +1090,8 @@ static fsal_status_t mem_readlink(struct fsal_obj_handle *obj_hdl,
 		return fsalstat(ERR_FSAL_INVAL, 0);
 	}
 
+	mem_delay(MEM.meta_latency, NULL, 0, 0);
+
 	link_content->len = strlen(myself->mh_symlink.link_contents) + 1;
 	link_content->addr = gsh_strdup(myself->mh_symlink.link_contents);
 
@@ -861,9 +1119,12 @@ static fsal_status_t mem_getattrs(struct fsal_obj_handle *obj_hdl,
 		return fsalstat(ERR_FSAL_STALE, ESTALE);
 	}
 
+	mem_delay(MEM.meta_latency, NULL, 0, 0);
+
 	/* We need to update the numlinks */
-	myself->attrs.numlinks =
-		atomic_fetch_uint32_t(&myself->mh_dir.numlinks);
+	if (obj_hdl->type == DIRECTORY)
+		myself->attrs.numlinks =
+			atomic_fetch_uint32_t(&myself->mh_dir.numlinks);
 
 #ifdef USE_LTTNG
 	tracepoint(fsalmem, mem_getattrs, __func__, __LINE__, myself,
@@ -917,10 +1178,11 @@ fsal_status_t mem_setattr2(struct fsal_obj_handle *obj_hdl,
 		return fsalstat(ERR_FSAL_INVAL, EINVAL);
 	}
 
+	mem_delay(MEM.meta_latency, NULL, 0, 0);
+
 	/** TRUNCATE **/
-	if (FSAL_TEST_MASK(attrs_set->valid_mask, ATTR_SIZE)) {
-		myself->attrs.filesize = attrs_set->filesize;
-	}
+	if (FSAL_TEST_MASK(attrs_set->valid_mask, ATTR_SIZE))
+		mem_data_truncate(myself, attrs_set->filesize);
 
 	/** CHMOD **/
 	if (FSAL_TEST_MASK(attrs_set->valid_mask, ATTR_MODE)) {
@@ -982,6 +1244,8 @@ static fsal_status_t mem_unlink(struct fsal_obj_handle *dir_hdl,
 			      struct mem_fsal_obj_handle,
 			      obj_handle);
 
+	mem_delay(MEM.meta_latency, NULL, 0, 0);
+
 	PTHREAD_RWLOCK_wrlock(&dir_hdl->obj_lock);
 
 	switch (obj_hdl->type) {
@@ -1082,6 +1346,8 @@ static fsal_status_t mem_rename(struct fsal_obj_handle *obj_hdl,
 	struct mem_fsal_obj_handle *mem_lookup_dst = NULL;
 	fsal_status_t status;
 
+	mem_delay(MEM.meta_latency, NULL, 0, 0);
+
 	status = mem_int_lookup(mem_newdir, new_name, &mem_lookup_dst);
 	if (!FSAL_IS_ERROR(status)) {
 		uint32_t numlinks;
@@ -1229,7 +1495,7 @@ fsal_status_t mem_open2(struct fsal_obj_handle *obj_hdl,
 			my_fd->openflags |= FSAL_O_READ;
 		my_fd->offset = 0;
 		if (truncated)
-			myself->attrs.filesize = myself->attrs.spaceused = 0;
+			mem_data_truncate(myself, 0);
 
 		/* Now check verifier for exclusive, but not for
 		 * FSAL_EXCLUSIVE_9P.
@@ -1406,7 +1672,7 @@ fsal_status_t mem_reopen2(struct fsal_obj_handle *obj_hdl,
 	my_fd->openflags = openflags;
 	my_fd->offset = 0;
 	if (openflags & FSAL_O_TRUNC)
-		myself->attrs.filesize = myself->attrs.spaceused = 0;
+		mem_data_truncate(myself, 0);
 
 	return status;
 }
@@ -1447,8 +1713,8 @@ fsal_status_t mem_read2(struct fsal_obj_handle *obj_hdl,
 	struct mem_fd *my_fd = NULL;
 	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
 
-	if (info != NULL) {
-		/* Currently we don't support READ_PLUS */
+	if (info != NULL && info->io_segs == NULL) {
+		/* Only READ_PLUS as segments is supported */
 		return fsalstat(ERR_FSAL_NOTSUPP, 0);
 	}
 
@@ -1468,28 +1734,31 @@ fsal_status_t mem_read2(struct fsal_obj_handle *obj_hdl,
 		return status;
 	}
 
+	PTHREAD_RWLOCK_rdlock(&myself->mh_file.data_lock);
+
 	if (offset > myself->mh_file.length) {
 		buffer_size = 0;
 	} else if (offset + buffer_size > myself->mh_file.length) {
 		buffer_size = myself->mh_file.length - offset;
 	}
 
-	if (offset < myself->datasize) {
-		size_t readsize;
-
-		/* Data to read */
-		readsize = MIN(buffer_size, myself->datasize - offset);
-		memcpy(buffer, myself->data + offset, readsize);
-		if (readsize < buffer_size)
-			memset(buffer + readsize, 'a', buffer_size - readsize);
+	if (info != NULL) {
+		*read_amount = mem_data_read_plus(myself, offset, buffer_size,
+						  buffer, info);
 	} else {
-		memset(buffer, 'a', buffer_size);
+		mem_data_read(myself, offset, buffer_size, buffer);
+		*read_amount = buffer_size;
 	}
 
-	*read_amount = buffer_size;
-	*end_of_file = (buffer_size == 0);
+	*end_of_file = offset + *read_amount >= myself->mh_file.length;
+
+	PTHREAD_RWLOCK_unlock(&myself->mh_file.data_lock);
+
 	now(&myself->attrs.atime);
 
+	mem_delay(MEM.data_latency, &MEM.read_throttle, MEM.read_bandwidth,
+		  *read_amount);
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
@@ -1554,18 +1823,19 @@ fsal_status_t mem_write2(struct fsal_obj_handle *obj_hdl,
 		}
 	}
 
+	PTHREAD_RWLOCK_wrlock(&myself->mh_file.data_lock);
+
 	if (offset + buffer_size > myself->mh_file.length) {
 		myself->attrs.filesize = myself->mh_file.length = offset +
 			buffer_size;
 	}
 
-	if (offset < myself->datasize) {
-		size_t writesize;
+	mem_data_write(myself, offset, buffer_size, buffer);
 
-		/* Space to write */
-		writesize = MIN(buffer_size, myself->datasize - offset);
-		memcpy(myself->data + offset, buffer, writesize);
-	}
+	PTHREAD_RWLOCK_unlock(&myself->mh_file.data_lock);
+
+	mem_delay(MEM.data_latency, &MEM.write_throttle, MEM.write_bandwidth,
+		  buffer_size);
 
 	/* Update change stats */
 	now(&myself->attrs.mtime);
@@ -1599,6 +1869,8 @@ fsal_status_t mem_commit2(struct fsal_obj_handle *obj_hdl,
 			  off_t offset,
 			  size_t len)
 {
+	mem_delay(MEM.data_latency, NULL, 0, 0);
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
@@ -1779,6 +2051,8 @@ static void mem_release(struct fsal_obj_handle *obj_hdl)
 		mem_clean_dir_tree(myself);
 		break;
 	case REGULAR_FILE:
+		mem_data_truncate(myself, 0);
+		PTHREAD_RWLOCK_destroy(&myself->mh_file.data_lock);
 		break;
 	case SYMBOLIC_LINK:
 		gsh_free(myself->mh_symlink.link_contents);
@@ -70,6 +70,21 @@ struct mem_fd {
 	off_t offset;
 };
 
+/** Size of the extents file data are stored in */
+#define MEM_EXTENT_SIZE (64 * 1024)
+
+/**
+ * @brief An extent of file data
+ *
+ * Extents are allocated when first written; a range without one reads
+ * as zeros and is a hole to READ_PLUS.
+ */
+struct mem_extent {
+	struct avltree_node node;
+	uint64_t index;		/*< Offset of the extent / MEM_EXTENT_SIZE */
+	char data[];		/*< MEM_EXTENT_SIZE bytes */
+};
+
 /*
  * MEM internal object handle
  */
@@ -91,6 +106,11 @@ struct mem_fsal_obj_handle {
 			struct fsal_share share;
 			struct mem_fd fd;
 			off_t length;
+			/** Protects length and the extents */
+			pthread_rwlock_t data_lock;
+			/** Stored data, by index */
+			struct avltree extents;
+			uint64_t nextents;
 		} mh_file;
 		struct {
 			object_file_type_t nodetype;
@@ -107,8 +127,6 @@ struct mem_fsal_obj_handle {
 	uint32_t next_i; /* next child index */
 	char *m_name;
 	bool inavl;
-	uint32_t datasize;
-	char data[0]; /* Allocated data */
 };
 
 static inline bool mem_unopenable_type(object_file_type_t type)
@@ -157,6 +175,16 @@ static inline void _mem_free_handle(struct mem_fsal_obj_handle *hdl,
 
 void mem_clean_dir_tree(struct mem_fsal_obj_handle *parent);
 
+/**
+ * @brief Throughput cap for one direction of I/O
+ */
+struct mem_throttle {
+	/** Protects next */
+	pthread_mutex_t lock;
+	/** When the bytes already admitted will have gone through */
+	struct timespec next;
+};
+
 /**
  * @brief FSAL Module wrapper for MEM
  */
@@ -167,10 +195,23 @@ struct mem_fsal_module {
 	struct fsal_staticfsinfo_t fs_info;
 	/** List of MEM exports. TODO Locking when we care */
 	struct glist_head mem_exports;
-	/** Config - size of data in inode */
-	uint32_t inode_size;
+	/** Config - bytes at the start of each file that are stored */
+	uint64_t inode_size;
 	/** Config - Interval for UP call thread */
 	uint32_t up_interval;
+	/** Config - microseconds added to each metadata operation */
+	uint32_t meta_latency;
+	/** Config - microseconds added to each read, write or commit */
+	uint32_t data_latency;
+	/** Config - up to this many random microseconds more */
+	uint32_t latency_jitter;
+	/** Config - bytes per second read, 0 unlimited */
+	uint64_t read_bandwidth;
+	/** Config - bytes per second written, 0 unlimited */
+	uint64_t write_bandwidth;
+	/** Throttling of reads and writes */
+	struct mem_throttle read_throttle;
+	struct mem_throttle write_throttle;
 };
 
 
@@ -87,10 +87,20 @@ static struct fsal_staticfsinfo_t default_mem_info = {
 };
 
 static struct config_item mem_items[] = {
-	CONF_ITEM_UI32("Inode_Size", 0, 0x200000, 0,
+	CONF_ITEM_UI64("Inode_Size", 0, UINT64_MAX, 0,
 		       mem_fsal_module, inode_size),
 	CONF_ITEM_UI32("Up_Test_Interval", 0, UINT32_MAX, 0,
 		       mem_fsal_module, up_interval),
+	CONF_ITEM_UI32("Metadata_Latency", 0, 10000000, 0,
+		       mem_fsal_module, meta_latency),
+	CONF_ITEM_UI32("Data_Latency", 0, 10000000, 0,
+		       mem_fsal_module, data_latency),
+	CONF_ITEM_UI32("Latency_Jitter", 0, 10000000, 0,
+		       mem_fsal_module, latency_jitter),
+	CONF_ITEM_UI64("Read_Bandwidth", 0, UINT64_MAX, 0,
+		       mem_fsal_module, read_bandwidth),
+	CONF_ITEM_UI64("Write_Bandwidth", 0, UINT64_MAX, 0,
+		       mem_fsal_module, write_bandwidth),
 	CONFIG_EOL
 };
 
@@ -207,6 +217,8 @@ MODULE_INIT void init(void)
 	myself->m_ops.init_config = mem_init_config;
 	myself->m_ops.support_ex = mem_support_ex;
 	glist_init(&MEM.mem_exports);
+	PTHREAD_MUTEX_init(&MEM.read_throttle.lock, NULL);
+	PTHREAD_MUTEX_init(&MEM.write_throttle.lock, NULL);
 }
 
 MODULE_FINI void finish(void)
@@ -225,4 +237,7 @@ MODULE_FINI void finish(void)
 			"Unable to unload MEM FSAL.  Dying with extreme prejudice.");
 		abort();
 	}
+
+	PTHREAD_MUTEX_destroy(&MEM.read_throttle.lock);
+	PTHREAD_MUTEX_destroy(&MEM.write_throttle.lock);
 }
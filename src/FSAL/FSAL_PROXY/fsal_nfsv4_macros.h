@@ -225,8 +225,8 @@ do { \
 	op->nfs_argop4_u.opreaddir.cookie = c4;				\
 	memset(&op->nfs_argop4_u.opreaddir.cookieverf, \
 	       0, NFS4_VERIFIER_SIZE);					\
-	op->nfs_argop4_u.opreaddir.dircount = 2048;			\
-	op->nfs_argop4_u.opreaddir.maxcount = 4096;			\
+	op->nfs_argop4_u.opreaddir.dircount = 8192;			\
+	op->nfs_argop4_u.opreaddir.maxcount = 32768;			\
 	op->nfs_argop4_u.opreaddir.attr_request = inbitmap;		\
 } while (0)
 
@@ -50,14 +50,9 @@
 static clientid4 pxy_clientid;
 static pthread_mutex_t pxy_clientid_mutex = PTHREAD_MUTEX_INITIALIZER;
 static char pxy_hostname[MAXNAMLEN + 1];
-static pthread_t pxy_recv_thread;
 static pthread_t pxy_renewer_thread;
-static struct glist_head rpc_calls;
 static struct glist_head free_contexts;
-static int rpc_sock = -1;
 static uint32_t rpc_xid;
-static pthread_mutex_t listlock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t sockless = PTHREAD_COND_INITIALIZER;
 static pthread_cond_t need_context = PTHREAD_COND_INITIALIZER;
 
 /*
@@ -65,13 +60,42 @@ static pthread_cond_t need_context = PTHREAD_COND_INITIALIZER;
  */
 static pthread_mutex_t context_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Calls are spread over several connections to the server, each with
+ * its own receiver thread.  The low bits of an xid are the index of the
+ * context it was sent from, so a receiver goes straight to the context
+ * a reply belongs to, taking no lock shared with the other connections.
+ */
+#define PXY_CONTEXTS_PER_CONN 16
+#define PXY_XID_INDEX_BITS 10
+#define PXY_XID_INDEX_MASK ((1U << PXY_XID_INDEX_BITS) - 1)
+
+struct pxy_rpc_conn {
+	/* Serializes sends, and guards rpc_sock changes */
+	pthread_mutex_t listlock;
+	pthread_cond_t sockless;
+	pthread_t recv_thread;
+	int rpc_sock;
+	const struct pxy_client_params *info;
+};
+
+static struct pxy_rpc_conn *rpc_conns;
+static uint32_t rpc_nconns;
+static uint32_t rpc_next_conn;
+static struct pxy_rpc_io_context **rpc_contexts;
+static uint32_t rpc_ncontexts;
+
 /* NB! nfs_prog is just an easy way to get this info into the call
  *     It should really be fetched via export pointer */
 struct pxy_rpc_io_context {
 	pthread_mutex_t iolock;
 	pthread_cond_t iowait;
 	struct glist_head calls;
+	/* Connection the call awaits a reply on, NULL if none, and the
+	 * xid it was sent with; both protected by iolock */
+	struct pxy_rpc_conn *conn;
 	uint32_t rpc_xid;
+	uint32_t index;
 	int iodone;
 	int ioresult;
 	unsigned int nfs_prog;
@@ -260,6 +284,23 @@ static struct bitmap4 pxy_bitmap_getattr = {
 	.bitmap4_len = 2
 };
 
+/* Same as pxy_bitmap_getattr, plus the handle of each entry */
+static struct bitmap4 pxy_bitmap_readdir = {
+	.map[0] =
+	    (PXY_ATTR_BIT(FATTR4_SUPPORTED_ATTRS) |
+	     PXY_ATTR_BIT(FATTR4_TYPE) | PXY_ATTR_BIT(FATTR4_CHANGE) |
+	     PXY_ATTR_BIT(FATTR4_SIZE) | PXY_ATTR_BIT(FATTR4_FSID) |
+	     PXY_ATTR_BIT(FATTR4_FILEHANDLE) | PXY_ATTR_BIT(FATTR4_FILEID)),
+	.map[1] =
+	    (PXY_ATTR_BIT2(FATTR4_MODE) | PXY_ATTR_BIT2(FATTR4_NUMLINKS) |
+	     PXY_ATTR_BIT2(FATTR4_OWNER) | PXY_ATTR_BIT2(FATTR4_OWNER_GROUP) |
+	     PXY_ATTR_BIT2(FATTR4_SPACE_USED) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_ACCESS) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_METADATA) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_MODIFY) | PXY_ATTR_BIT2(FATTR4_RAWDEV)),
+	.bitmap4_len = 2
+};
+
 static struct bitmap4 pxy_bitmap_fsinfo = {
 	.map[0] =
 	    (PXY_ATTR_BIT(FATTR4_FILES_AVAIL) | PXY_ATTR_BIT(FATTR4_FILES_FREE)
@@ -345,16 +386,23 @@ static GETATTR4resok *pxy_fill_getattr_reply(nfs_resop4 *resop, char *blob,
 	return a;
 }
 
+/*
+ * Called with ctx->iolock held, which it releases.
+ */
 static int pxy_got_rpc_reply(struct pxy_rpc_io_context *ctx, int sock, int sz,
 			     u_int xid)
 {
 	char *repbuf = ctx->recvbuf;
 	int size;
 
-	if (sz > ctx->recvbuf_sz)
+	if (sz > ctx->recvbuf_sz) {
+		ctx->iodone = 1;
+		ctx->ioresult = -E2BIG;
+		pthread_cond_signal(&ctx->iowait);
+		PTHREAD_MUTEX_unlock(&ctx->iolock);
 		return -E2BIG;
+	}
 
-	PTHREAD_MUTEX_lock(&ctx->iolock);
 	memcpy(repbuf, &xid, sizeof(xid));
 	/*
 	 * sz includes 4 bytes of xid which have been processed
@@ -384,14 +432,15 @@ static int pxy_got_rpc_reply(struct pxy_rpc_io_context *ctx, int sock, int sz,
 	return size;
 }
 
-static int pxy_rpc_read_reply(int sock)
+static int pxy_rpc_read_reply(struct pxy_rpc_conn *conn)
 {
+	int sock = conn->rpc_sock;
 	struct {
 		uint recmark;
 		uint xid;
 	} h;
 	char *buf = (char *)&h;
-	struct glist_head *c;
+	struct pxy_rpc_io_context *ctx;
 	char sink[256];
 	int cnt = 0;
 
@@ -410,18 +459,16 @@ static int pxy_rpc_read_reply(int sock)
 	LogDebug(COMPONENT_FSAL, "Recmark %x, xid %u\n", h.recmark, h.xid);
 	h.recmark &= ~(1U << 31);
 
-	PTHREAD_MUTEX_lock(&listlock);
-	glist_for_each(c, &rpc_calls) {
-		struct pxy_rpc_io_context *ctx =
-		    container_of(c, struct pxy_rpc_io_context, calls);
+	if ((h.xid & PXY_XID_INDEX_MASK) < rpc_ncontexts) {
+		ctx = rpc_contexts[h.xid & PXY_XID_INDEX_MASK];
 
-		if (ctx->rpc_xid == h.xid) {
-			glist_del(c);
-			PTHREAD_MUTEX_unlock(&listlock);
+		PTHREAD_MUTEX_lock(&ctx->iolock);
+		if (ctx->conn == conn && ctx->rpc_xid == h.xid) {
+			ctx->conn = NULL;
 			return pxy_got_rpc_reply(ctx, sock, h.recmark, h.xid);
 		}
+		PTHREAD_MUTEX_unlock(&ctx->iolock);
 	}
-	PTHREAD_MUTEX_unlock(&listlock);
 
 	cnt = h.recmark - 4;
 	LogDebug(COMPONENT_FSAL, "xid %u is not on the list, skip %d bytes\n",
@@ -438,31 +485,31 @@ static int pxy_rpc_read_reply(int sock)
 	return 0;
 }
 
-static void pxy_new_socket_ready(void)
+static void pxy_new_socket_ready(struct pxy_rpc_conn *conn)
 {
-	struct glist_head *nxt;
-	struct glist_head *c;
+	uint32_t i;
 
 	/* If there is anyone waiting for the socket then tell them
 	 * it's ready */
-	pthread_cond_broadcast(&sockless);
+	pthread_cond_broadcast(&conn->sockless);
 
 	/* If there are any outstanding calls then tell them to resend */
-	glist_for_each_safe(c, nxt, &rpc_calls) {
-		struct pxy_rpc_io_context *ctx =
-		    container_of(c, struct pxy_rpc_io_context, calls);
-
-		glist_del(c);
+	for (i = 0; i < rpc_ncontexts; i++) {
+		struct pxy_rpc_io_context *ctx = rpc_contexts[i];
 
 		PTHREAD_MUTEX_lock(&ctx->iolock);
-		ctx->iodone = 1;
-		ctx->ioresult = -EAGAIN;
-		pthread_cond_signal(&ctx->iowait);
+		if (ctx->conn == conn) {
+			ctx->conn = NULL;
+			ctx->iodone = 1;
+			ctx->ioresult = -EAGAIN;
+			pthread_cond_signal(&ctx->iowait);
+		}
 		PTHREAD_MUTEX_unlock(&ctx->iolock);
 	}
 }
 
-static int pxy_connect(struct pxy_client_params *info,
+static int pxy_connect(struct pxy_rpc_conn *conn,
+		       const struct pxy_client_params *info,
 		       struct sockaddr_in *dest)
 {
 	int sock;
@@ -486,7 +533,8 @@ static int pxy_connect(struct pxy_client_params *info,
 			close(sock);
 			sock = -1;
 		} else {
-			pxy_new_socket_ready();
+			conn->rpc_sock = sock;
+			pxy_new_socket_ready(conn);
 		}
 	}
 	return sock;
@@ -499,7 +547,8 @@ static int pxy_connect(struct pxy_client_params *info,
  */
 static void *pxy_rpc_recv(void *arg)
 {
-	struct pxy_client_params *info = arg;
+	struct pxy_rpc_conn *conn = arg;
+	const struct pxy_client_params *info = conn->info;
 	struct sockaddr_in addr_rpc;
 	struct sockaddr_in *info_sock = (struct sockaddr_in *)&info->srv_addr;
 	char addr[INET_ADDRSTRLEN];
@@ -515,10 +564,10 @@ static void *pxy_rpc_recv(void *arg)
 	for (;;) {
 		int nsleeps = 0;
 
-		PTHREAD_MUTEX_lock(&listlock);
+		PTHREAD_MUTEX_lock(&conn->listlock);
 		do {
-			rpc_sock = pxy_connect(info, &addr_rpc);
-			if (rpc_sock < 0) {
+			conn->rpc_sock = pxy_connect(conn, info, &addr_rpc);
+			if (conn->rpc_sock < 0) {
 				if (nsleeps == 0)
 					LogCrit(COMPONENT_FSAL,
 						"Cannot connect to server %s:%u",
@@ -527,22 +576,22 @@ static void *pxy_rpc_recv(void *arg)
 							  addr,
 							  sizeof(addr)),
 						info->srv_port);
-				PTHREAD_MUTEX_unlock(&listlock);
+				PTHREAD_MUTEX_unlock(&conn->listlock);
 				sleep(info->retry_sleeptime);
 				nsleeps++;
-				PTHREAD_MUTEX_lock(&listlock);
+				PTHREAD_MUTEX_lock(&conn->listlock);
 			} else {
 				LogDebug(COMPONENT_FSAL,
 					 "Connected after %d sleeps, resending outstanding calls",
 					 nsleeps);
 			}
-		} while (rpc_sock < 0);
-		PTHREAD_MUTEX_unlock(&listlock);
+		} while (conn->rpc_sock < 0);
+		PTHREAD_MUTEX_unlock(&conn->listlock);
 
-		pfd.fd = rpc_sock;
+		pfd.fd = conn->rpc_sock;
 		pfd.events = POLLIN | POLLRDHUP;
 
-		while (rpc_sock >= 0) {
+		while (conn->rpc_sock >= 0) {
 			switch (poll(&pfd, 1, millisec)) {
 			case 0:
 				LogDebug(COMPONENT_FSAL,
@@ -560,16 +609,16 @@ static void *pxy_rpc_recv(void *arg)
 					LogEvent(COMPONENT_FSAL,
 						 "Socket is closed");
 				} else {
-					if (pxy_rpc_read_reply(rpc_sock) >= 0)
+					if (pxy_rpc_read_reply(conn) >= 0)
 						continue;
 				}
 				break;
 			}
 
-			PTHREAD_MUTEX_lock(&listlock);
-			close(rpc_sock);
-			rpc_sock = -1;
-			PTHREAD_MUTEX_unlock(&listlock);
+			PTHREAD_MUTEX_lock(&conn->listlock);
+			close(conn->rpc_sock);
+			conn->rpc_sock = -1;
+			PTHREAD_MUTEX_unlock(&conn->listlock);
 		}
 	}
 
@@ -661,29 +710,55 @@ static enum clnt_stat pxy_process_reply(struct pxy_rpc_io_context *ctx,
 	return rc;
 }
 
-static void pxy_rpc_need_sock(void)
+static void pxy_rpc_need_sock(struct pxy_rpc_conn *conn)
 {
-	PTHREAD_MUTEX_lock(&listlock);
-	while (rpc_sock < 0)
-		pthread_cond_wait(&sockless, &listlock);
-	PTHREAD_MUTEX_unlock(&listlock);
+	PTHREAD_MUTEX_lock(&conn->listlock);
+	while (conn->rpc_sock < 0)
+		pthread_cond_wait(&conn->sockless, &conn->listlock);
+	PTHREAD_MUTEX_unlock(&conn->listlock);
 }
 
+/*
+ * The clientid is negotiated over the first connection, so only its
+ * reconnecting wakes up the renewer.
+ */
 static int pxy_rpc_renewer_wait(int timeout)
 {
 	struct timespec ts;
 	int rc;
 
-	PTHREAD_MUTEX_lock(&listlock);
+	PTHREAD_MUTEX_lock(&rpc_conns[0].listlock);
 	ts.tv_sec = time(NULL) + timeout;
 	ts.tv_nsec = 0;
 
-	rc = pthread_cond_timedwait(&sockless, &listlock, &ts);
-	PTHREAD_MUTEX_unlock(&listlock);
+	rc = pthread_cond_timedwait(&rpc_conns[0].sockless,
+				    &rpc_conns[0].listlock, &ts);
+	PTHREAD_MUTEX_unlock(&rpc_conns[0].listlock);
 	return (rc == ETIMEDOUT);
 }
 
+/*
+ * Spread calls over the connections, passing over those being
+ * reconnected as long as another one is up.
+ */
+static struct pxy_rpc_conn *pxy_rpc_pick_conn(void)
+{
+	uint32_t start = atomic_inc_uint32_t(&rpc_next_conn);
+	uint32_t i;
+
+	for (i = 0; i < rpc_nconns; i++) {
+		struct pxy_rpc_conn *conn =
+		    &rpc_conns[(start + i) % rpc_nconns];
+
+		if (conn->rpc_sock >= 0)
+			return conn;
+	}
+
+	return &rpc_conns[start % rpc_nconns];
+}
+
 static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
+			       struct pxy_rpc_conn *conn,
 			       const struct user_cred *cred,
 			       COMPOUND4args *args, COMPOUND4res *res)
 {
@@ -692,9 +767,8 @@ static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 	AUTH *au;
 	enum clnt_stat rc;
 
-	PTHREAD_MUTEX_lock(&listlock);
-	rmsg.rm_xid = rpc_xid++;
-	PTHREAD_MUTEX_unlock(&listlock);
+	rmsg.rm_xid = (atomic_inc_uint32_t(&rpc_xid) << PXY_XID_INDEX_BITS) |
+		      pcontext->index;
 	rmsg.rm_direction = CALL;
 
 	rmsg.rm_call.cb_rpcvers = RPC_MSG_VERSION;
@@ -723,7 +797,12 @@ static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 		u_int recmark = ntohl(pos | (1U << 31));
 		int first_try = 1;
 
+		/* Expect the reply before it can possibly come */
+		PTHREAD_MUTEX_lock(&pcontext->iolock);
 		pcontext->rpc_xid = rmsg.rm_xid;
+		pcontext->conn = conn;
+		pcontext->iodone = 0;
+		PTHREAD_MUTEX_unlock(&pcontext->iolock);
 
 		memcpy(pcontext->sendbuf, &recmark, sizeof(recmark));
 		pos += 4;
@@ -735,29 +814,26 @@ static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 			LogDebug(COMPONENT_FSAL, "%ssend XID %u with %d bytes",
 				 (first_try ? "First attempt to " : "Re"),
 				 rmsg.rm_xid, pos);
-			PTHREAD_MUTEX_lock(&listlock);
+			PTHREAD_MUTEX_lock(&conn->listlock);
 			while (bc < pos) {
-				int wc = write(rpc_sock, buf, pos - bc);
+				int wc = write(conn->rpc_sock, buf, pos - bc);
 
 				if (wc <= 0) {
-					close(rpc_sock);
+					close(conn->rpc_sock);
 					break;
 				}
 				bc += wc;
 				buf += wc;
 			}
+			PTHREAD_MUTEX_unlock(&conn->listlock);
 
 			if (bc == pos) {
-				if (first_try) {
-					glist_add_tail(&rpc_calls,
-						       &pcontext->calls);
-					first_try = 0;
-				}
+				first_try = 0;
 			} else {
-				if (!first_try)
-					glist_del(&pcontext->calls);
+				PTHREAD_MUTEX_lock(&pcontext->iolock);
+				pcontext->conn = NULL;
+				PTHREAD_MUTEX_unlock(&pcontext->iolock);
 			}
-			PTHREAD_MUTEX_unlock(&listlock);
 
 			if (bc == pos)
 				rc = pxy_process_reply(pcontext, res);
@@ -778,6 +854,7 @@ int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
 {
 	enum clnt_stat rc;
 	struct pxy_rpc_io_context *ctx;
+	struct pxy_rpc_conn *conn;
 	COMPOUND4args arg = {
 		.argarray.argarray_val = argoparray,
 		.argarray.argarray_len = cnt
@@ -796,12 +873,13 @@ int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
 	PTHREAD_MUTEX_unlock(&context_lock);
 
 	do {
-		rc = pxy_compoundv4_call(ctx, creds, &arg, &res);
+		conn = pxy_rpc_pick_conn();
+		rc = pxy_compoundv4_call(ctx, conn, creds, &arg, &res);
 		if (rc != RPC_SUCCESS)
 			LogDebug(COMPONENT_FSAL, "%s failed with %d", caller,
 				 rc);
 		if (rc == RPC_CANTSEND)
-			pxy_rpc_need_sock();
+			pxy_rpc_need_sock(conn);
 	} while ((rc == RPC_CANTRECV && (ctx->ioresult == -EAGAIN))
 		 || (rc == RPC_CANTSEND));
 
@@ -844,7 +922,7 @@ static int pxy_setclientid(clientid4 *resultclientid, uint32_t *lease_time)
 	LogEvent(COMPONENT_FSAL,
 		 "Negotiating a new ClientId with the remote server");
 
-	if (getsockname(rpc_sock, &sin, &slen))
+	if (getsockname(rpc_conns[0].rpc_sock, &sin, &slen))
 		return -errno;
 
 	snprintf(clientid_name, MAXNAMLEN, "%s(%d) - GANESHA NFSv4 Proxy",
@@ -930,7 +1008,7 @@ static void *pxy_clientid_renewer(void *Arg)
 		/* We've either failed to renew or rpc socket has been
 		 * reconnected and we need new client id */
 		LogDebug(COMPONENT_FSAL, "Need %d new client id", needed);
-		pxy_rpc_need_sock();
+		pxy_rpc_need_sock(&rpc_conns[0]);
 		needed = pxy_setclientid(&newcid, &lease_time);
 		if (!needed) {
 			PTHREAD_MUTEX_lock(&pxy_clientid_mutex);
@@ -952,14 +1030,17 @@ static void free_io_contexts(void)
 		glist_del(cur);
 		gsh_free(c);
 	}
+
+	gsh_free(rpc_contexts);
+	rpc_contexts = NULL;
+	rpc_ncontexts = 0;
 }
 
 int pxy_init_rpc(const struct pxy_fsal_module *pm)
 {
 	int rc;
-	int i = 16;
+	uint32_t i;
 
-	glist_init(&rpc_calls);
 	glist_init(&free_contexts);
 
 /**
@@ -968,41 +1049,60 @@ int pxy_init_rpc(const struct pxy_fsal_module *pm)
  *       there is work to do to get this fnctn to truely be
  *       per export.
  */
-	PTHREAD_MUTEX_lock(&listlock);
+	PTHREAD_MUTEX_lock(&context_lock);
 	if (rpc_xid == 0)
 		rpc_xid = getpid() ^ time(NULL);
-	PTHREAD_MUTEX_unlock(&listlock);
+	PTHREAD_MUTEX_unlock(&context_lock);
 	if (gethostname(pxy_hostname, sizeof(pxy_hostname)))
 		strncpy(pxy_hostname, "NFS-GANESHA/Proxy",
 			sizeof(pxy_hostname));
 
-	for (i = 16; i > 0; i--) {
+	rpc_nconns = pm->special.srv_connections;
+	rpc_conns = gsh_calloc(rpc_nconns, sizeof(*rpc_conns));
+
+	rpc_ncontexts = rpc_nconns * PXY_CONTEXTS_PER_CONN;
+	rpc_contexts = gsh_calloc(rpc_ncontexts, sizeof(*rpc_contexts));
+
+	for (i = 0; i < rpc_ncontexts; i++) {
 		struct pxy_rpc_io_context *c =
 		    gsh_malloc(sizeof(*c) + pm->special.srv_sendsize +
 			       pm->special.srv_recvsize);
-		if (!c) {
-			free_io_contexts();
-			return ENOMEM;
-		}
+
 		PTHREAD_MUTEX_init(&c->iolock, NULL);
 		PTHREAD_COND_init(&c->iowait, NULL);
+		c->conn = NULL;
+		c->index = i;
+		c->iodone = 0;
 		c->nfs_prog = pm->special.srv_prognum;
 		c->sendbuf_sz = pm->special.srv_sendsize;
 		c->recvbuf_sz = pm->special.srv_recvsize;
 		c->sendbuf = (char *)(c + 1);
 		c->recvbuf = c->sendbuf + c->sendbuf_sz;
 
+		rpc_contexts[i] = c;
 		glist_add(&free_contexts, &c->calls);
 	}
 
-	rc = pthread_create(&pxy_recv_thread, NULL, pxy_rpc_recv,
-			    (void *)&pm->special);
-	if (rc) {
-		LogCrit(COMPONENT_FSAL,
-			"Cannot create proxy rpc receiver thread - %s",
-			strerror(rc));
-		free_io_contexts();
-		return rc;
+	for (i = 0; i < rpc_nconns; i++) {
+		struct pxy_rpc_conn *conn = &rpc_conns[i];
+
+		PTHREAD_MUTEX_init(&conn->listlock, NULL);
+		PTHREAD_COND_init(&conn->sockless, NULL);
+		conn->rpc_sock = -1;
+		conn->info = &pm->special;
+
+		rc = pthread_create(&conn->recv_thread, NULL, pxy_rpc_recv,
+				    conn);
+		if (rc) {
+			LogCrit(COMPONENT_FSAL,
+				"Cannot create proxy rpc receiver thread - %s",
+				strerror(rc));
+			/* Receivers already started keep their contexts */
+			if (i == 0)
+				free_io_contexts();
+			rpc_nconns = i;
+			return rc;
+		}
 	}
 
 	rc = pthread_create(&pxy_renewer_thread, NULL, pxy_clientid_renewer,
@@ -1011,7 +1111,6 @@ int pxy_init_rpc(const struct pxy_fsal_module *pm)
 		LogCrit(COMPONENT_FSAL,
 			"Cannot create proxy clientid renewer thread - %s",
 			strerror(rc));
-		free_io_contexts();
 	}
 	return rc;
 }
@@ -1031,6 +1130,30 @@ static fsal_status_t pxy_make_object(struct fsal_export *export,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/*
+ * Make the handle of an object just created.  The GETATTR sent along
+ * with the creation fills in the caller's attributes as well, saving
+ * a GETATTR round trip of its own.
+ */
+static fsal_status_t pxy_make_created(fattr4 *obj_attributes,
+				      const nfs_fh4 *fh,
+				      struct fsal_obj_handle **handle,
+				      struct attrlist *attrib,
+				      struct attrlist *attrs_out)
+{
+	fsal_status_t st;
+
+	st = pxy_make_object(op_ctx->fsal_export, obj_attributes, fh,
+			     handle, attrs_out);
+	if (FSAL_IS_ERROR(st))
+		return st;
+
+	if (nfs4_Fattr_To_FSAL_attr(attrib, obj_attributes, NULL) != NFS4_OK)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /*
  * cap maxread and maxwrite config values to background server values
  */
@@ -1194,25 +1317,30 @@ static fsal_status_t pxy_do_close(const struct user_cred *creds,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
-static fsal_status_t pxy_open_confirm(const struct user_cred *cred,
-				      const nfs_fh4 *fh4,
-				      seqid4 open_owner_seqid,
-				      stateid4 *stateid,
-				      struct fsal_export *export)
+/*
+ * Confirm a fresh open and close it again in one compound.  The stateid
+ * OPEN_CONFIRM hands back is the open's with its seqid bumped, which
+ * is what the CLOSE is built with; should the server see it otherwise,
+ * the CLOSE is sent again with the stateid it actually returned.
+ */
+static fsal_status_t pxy_confirm_and_close(const struct user_cred *cred,
+					   const nfs_fh4 *fh4,
+					   seqid4 open_owner_seqid,
+					   stateid4 *stateid,
+					   struct fsal_export *export)
 {
 	int rc;
 	int opcnt = 0;
-#define FSAL_PROXY_OPEN_CONFIRM_NB_OP_ALLOC 2
-	nfs_argop4 argoparray[FSAL_PROXY_OPEN_CONFIRM_NB_OP_ALLOC];
-	nfs_resop4 resoparray[FSAL_PROXY_OPEN_CONFIRM_NB_OP_ALLOC];
+#define FSAL_PROXY_CONFIRM_CLOSE_NB_OP_ALLOC 3
+	nfs_argop4 argoparray[FSAL_PROXY_CONFIRM_CLOSE_NB_OP_ALLOC];
+	nfs_resop4 resoparray[FSAL_PROXY_CONFIRM_CLOSE_NB_OP_ALLOC];
 	nfs_argop4 *op;
-	OPEN_CONFIRM4resok *conok;
+	OPEN_CONFIRM4res *conres;
+	stateid4 confirmed;
 
 	COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, *fh4);
 
-	conok =
-	    &resoparray[opcnt].nfs_resop4_u.opopen_confirm.OPEN_CONFIRM4res_u.
-	    resok4;
+	conres = &resoparray[opcnt].nfs_resop4_u.opopen_confirm;
 
 	op = argoparray + opcnt++;
 	op->argop = NFS4_OP_OPEN_CONFIRM;
@@ -1221,13 +1349,23 @@ static fsal_status_t pxy_open_confirm(const struct user_cred *cred,
 	       stateid->other, 12);
 	op->nfs_argop4_u.opopen_confirm.seqid = open_owner_seqid;
 
+	confirmed.seqid = stateid->seqid + 1;
+	memcpy(confirmed.other, stateid->other, 12);
+	COMPOUNDV4_ARG_ADD_OP_CLOSE(opcnt, argoparray, (&confirmed),
+				    open_owner_seqid + 1);
+
+	conres->status = NFS4ERR_SERVERFAULT;
 	rc = pxy_nfsv4_call(export, cred, opcnt, argoparray, resoparray);
-	if (rc != NFS4_OK)
+	if (rc == NFS4_OK)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	if (conres->status != NFS4_OK)
 		return nfsstat4_to_fsal(rc);
 
-	stateid->seqid = conok->open_stateid.seqid;
-	memcpy(stateid->other, conok->open_stateid.other, 12);
-	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	/* Confirmed, but not closed */
+	return pxy_do_close(cred, fh4, open_owner_seqid + 1,
+			    &conres->OPEN_CONFIRM4res_u.resok4.open_stateid,
+			    export);
 }
 
 /* TODO: make this per-export */
@@ -1291,27 +1429,22 @@ static fsal_status_t pxy_create(struct fsal_obj_handle *dir_hdl,
 	if (rc != NFS4_OK)
 		return nfsstat4_to_fsal(rc);
 
-	/* See if a OPEN_CONFIRM is required */
-	if (opok->rflags & OPEN4_RESULT_CONFIRM) {
-		st = pxy_open_confirm(op_ctx->creds, &fhok->object,
-				      ++open_owner_seqid, &opok->stateid,
-				      op_ctx->fsal_export);
-		if (FSAL_IS_ERROR(st))
-			return st;
-	}
-
 	/* The created file is still opened, to preserve the correct
-	 * seqid for later use, we close it */
-	st = pxy_do_close(op_ctx->creds, &fhok->object, ++open_owner_seqid,
-			  &opok->stateid, op_ctx->fsal_export);
-	if (FSAL_IS_ERROR(st))
-		return st;
-	st = pxy_make_object(op_ctx->fsal_export, &atok->obj_attributes,
-			     &fhok->object, handle, attrs_out);
+	 * seqid for later use, we close it, confirming the open on the
+	 * way if required */
+	if (opok->rflags & OPEN4_RESULT_CONFIRM)
+		st = pxy_confirm_and_close(op_ctx->creds, &fhok->object,
+					   ++open_owner_seqid, &opok->stateid,
+					   op_ctx->fsal_export);
+	else
+		st = pxy_do_close(op_ctx->creds, &fhok->object,
+				  ++open_owner_seqid, &opok->stateid,
+				  op_ctx->fsal_export);
 	if (FSAL_IS_ERROR(st))
 		return st;
 
-	return (*handle)->obj_ops.getattrs(*handle, attrib);
+	return pxy_make_created(&atok->obj_attributes, &fhok->object,
+				handle, attrib, attrs_out);
 }
 
 static fsal_status_t pxy_mkdir(struct fsal_obj_handle *dir_hdl,
@@ -1365,12 +1498,8 @@ static fsal_status_t pxy_mkdir(struct fsal_obj_handle *dir_hdl,
 	if (rc != NFS4_OK)
 		return nfsstat4_to_fsal(rc);
 
-	st = pxy_make_object(op_ctx->fsal_export, &atok->obj_attributes,
-			     &fhok->object, handle, attrs_out);
-	if (FSAL_IS_ERROR(st))
-		return st;
-
-	return (*handle)->obj_ops.getattrs(*handle, attrib);
+	return pxy_make_created(&atok->obj_attributes, &fhok->object,
+				handle, attrib, attrs_out);
 }
 
 static fsal_status_t pxy_mknod(struct fsal_obj_handle *dir_hdl,
@@ -1447,12 +1576,8 @@ static fsal_status_t pxy_mknod(struct fsal_obj_handle *dir_hdl,
 	if (rc != NFS4_OK)
 		return nfsstat4_to_fsal(rc);
 
-	st = pxy_make_object(op_ctx->fsal_export, &atok->obj_attributes,
-			     &fhok->object, handle, attrs_out);
-	if (FSAL_IS_ERROR(st))
-		return st;
-
-	return (*handle)->obj_ops.getattrs(*handle, attrib);
+	return pxy_make_created(&atok->obj_attributes, &fhok->object,
+				handle, attrib, attrs_out);
 }
 
 static fsal_status_t pxy_symlink(struct fsal_obj_handle *dir_hdl,
@@ -1507,12 +1632,8 @@ static fsal_status_t pxy_symlink(struct fsal_obj_handle *dir_hdl,
 	if (rc != NFS4_OK)
 		return nfsstat4_to_fsal(rc);
 
-	st = pxy_make_object(op_ctx->fsal_export, &atok->obj_attributes,
-			     &fhok->object, handle, attrs_out);
-	if (FSAL_IS_ERROR(st))
-		return st;
-
-	return (*handle)->obj_ops.getattrs(*handle, attrib);
+	return pxy_make_created(&atok->obj_attributes, &fhok->object,
+				handle, attrib, attrs_out);
 }
 
 static fsal_status_t pxy_readlink(struct fsal_obj_handle *obj_hdl,
@@ -1617,7 +1738,7 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 	rdok = &resoparray[opcnt].nfs_resop4_u.opreaddir.READDIR4res_u.resok4;
 	rdok->reply.entries = NULL;
 	COMPOUNDV4_ARG_ADD_OP_READDIR(opcnt, argoparray, *cookie,
-				      pxy_bitmap_getattr);
+				      pxy_bitmap_readdir);
 
 	rc = pxy_nfsv4_call(ph->obj.export, op_ctx->creds, opcnt, argoparray,
 			    resoparray);
@@ -1629,6 +1750,8 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 	for (e4 = rdok->reply.entries; e4; e4 = e4->nextentry) {
 		struct attrlist attrs;
 		char name[MAXNAMLEN + 1];
+		char fhbuf[NFS4_FHSIZE];
+		nfs_fh4 fh4 = { .nfs_fh4_val = fhbuf, .nfs_fh4_len = 0 };
 		struct fsal_obj_handle *handle;
 		enum fsal_dir_result cb_rc;
 
@@ -1638,7 +1761,7 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 		memcpy(name, e4->name.utf8string_val, e4->name.utf8string_len);
 		name[e4->name.utf8string_len] = '\0';
 
-		if (nfs4_Fattr_To_FSAL_attr(&attrs, &e4->attrs, NULL))
+		if (nfs4_Fattr_To_FSAL_attr_fh(&attrs, &e4->attrs, &fh4))
 			return fsalstat(ERR_FSAL_FAULT, 0);
 
 		/*
@@ -1651,15 +1774,20 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 			*eof = rdok->reply.eof && !e4->nextentry;
 		}
 
-		/** @todo FSF: this could be handled by getting handle as part
-		 *             of readdir attributes. However, if acl is
-		 *             requested, we might get it separately to
-		 *             avoid over large READDIR response.
+		/* The handle normally comes along with the attributes, only
+		 * look the entry up if the server did not send it.
 		 */
-		st = pxy_lookup_impl(&ph->obj, op_ctx->fsal_export,
-				     op_ctx->creds, name, &handle, NULL);
-		if (FSAL_IS_ERROR(st))
+		if (fh4.nfs_fh4_len != 0)
+			st = pxy_make_object(op_ctx->fsal_export, &e4->attrs,
+					     &fh4, &handle, NULL);
+		else
+			st = pxy_lookup_impl(&ph->obj, op_ctx->fsal_export,
+					     op_ctx->creds, name, &handle,
+					     NULL);
+		if (FSAL_IS_ERROR(st)) {
+			fsal_release_attrs(&attrs);
 			break;
+		}
 
 		cb_rc = cb(name, handle, &attrs, cbarg, e4->cookie);
 
@@ -2340,22 +2468,20 @@ static fsal_status_t pxy_open2(struct fsal_obj_handle *obj_hdl,
 		if (rc != NFS4_OK)
 			return nfsstat4_to_fsal(rc);
 
-		/* See if a OPEN_CONFIRM is required */
-		if (opok->rflags & OPEN4_RESULT_CONFIRM) {
-			st = pxy_open_confirm(op_ctx->creds, &fhok->object,
-					      ++open_owner_seqid,
-					      &opok->stateid,
-					      op_ctx->fsal_export);
-			if (FSAL_IS_ERROR(st))
-				return st;
-		}
-
 		/* The created file is still opened, to preserve the correct
 		 * seqid for later use, we close it */
-		/* we don't manage state : immediately close state on server */
-		st = pxy_do_close(op_ctx->creds, &fhok->object,
-				  ++open_owner_seqid, &opok->stateid,
-				  op_ctx->fsal_export);
+		/* we don't manage state : immediately close state on server,
+		 * confirming the open along if required */
+		if (opok->rflags & OPEN4_RESULT_CONFIRM)
+			st = pxy_confirm_and_close(op_ctx->creds,
+						   &fhok->object,
+						   ++open_owner_seqid,
+						   &opok->stateid,
+						   op_ctx->fsal_export);
+		else
+			st = pxy_do_close(op_ctx->creds, &fhok->object,
+					  ++open_owner_seqid, &opok->stateid,
+					  op_ctx->fsal_export);
 		if (FSAL_IS_ERROR(st))
 			return st;
 	} else if (attrs_out || openflags & FSAL_O_TRUNC) {
@@ -2775,52 +2901,95 @@ fsal_status_t pxy_lookup_path(struct fsal_export *exp_hdl,
 			      struct fsal_obj_handle **handle,
 			      struct attrlist *attrs_out)
 {
-	struct fsal_obj_handle *next;
-	struct fsal_obj_handle *parent = NULL;
 	char *saved;
 	char *pcopy;
-	char *p, *pnext;
-	struct user_cred *creds = op_ctx->creds;
+	char *p;
+	int rc;
+	uint32_t opcnt = 0;
+	uint32_t nelem = 0;
+	GETATTR4resok *atok;
+	GETATTR4resok *atok_mread_mwrite;
+	GETFH4resok *fhok;
+	nfs_argop4 *argoparray;
+	nfs_resop4 *resoparray;
+	char fattr_blob[FATTR_BLOB_SZ];
+	char fattr_blob_mread_mwrite[FATTR_BLOB_SZ];
+	char padfilehandle[NFS4_FHSIZE];
+	fsal_status_t st;
 
 	pcopy = gsh_strdup(path);
 
-	p = strtok_r(pcopy, "/", &saved);
-	while (p) {
+	for (p = pcopy; *p != '\0'; p++)
+		if (*p == '/')
+			nelem++;
+
+	/* The whole path is walked in a single compound:
+	 * PUTROOTFH LOOKUP... GETFH GETATTR GETATTR
+	 */
+	argoparray = gsh_calloc(nelem + 5, sizeof(*argoparray));
+	resoparray = gsh_calloc(nelem + 5, sizeof(*resoparray));
+
+	COMPOUNDV4_ARG_ADD_OP_PUTROOTFH(opcnt, argoparray);
+
+	for (p = strtok_r(pcopy, "/", &saved); p;
+	     p = strtok_r(NULL, "/", &saved)) {
 		if (strcmp(p, "..") == 0) {
 			/* Don't allow lookup of ".." */
 			LogInfo(COMPONENT_FSAL,
 				"Attempt to use \"..\" element in path %s",
 				path);
-			gsh_free(pcopy);
-			return fsalstat(ERR_FSAL_ACCESS, EACCES);
+			st = fsalstat(ERR_FSAL_ACCESS, EACCES);
+			goto out;
 		}
-		/* Get the next token now, so we know if we are at the
-		 * terminal token or not.
-		 */
-		pnext = strtok_r(NULL, "/", &saved);
+		if (strcmp(p, ".") == 0)
+			continue;
 
-		/* Note that if any element is a symlink, the following will
-		 * fail, thus no security exposure. Only pass back the
-		 * attributes of the terminal lookup.
+		/* Note that if any element is a symlink, the LOOKUP after it
+		 * will fail, thus no security exposure. Only the attributes
+		 * of the terminal lookup are asked for.
 		 */
-		fsal_status_t st = pxy_lookup_impl(parent, exp_hdl, creds, p,
-						   &next, pnext == NULL ?
-						   attrs_out : NULL);
-		if (FSAL_IS_ERROR(st)) {
-			gsh_free(pcopy);
-			return st;
-		}
-
-		p = pnext;
-		parent = next;
+		COMPOUNDV4_ARG_ADD_OP_LOOKUP(opcnt, argoparray, p);
 	}
 	/* The final element could be a symlink, but either way we are called
 	 * will not work with a symlink, so no security exposure there.
 	 */
 
+	fhok = &resoparray[opcnt].nfs_resop4_u.opgetfh.GETFH4res_u.resok4;
+	COMPOUNDV4_ARG_ADD_OP_GETFH(opcnt, argoparray);
+
+	atok = pxy_fill_getattr_reply(resoparray + opcnt, fattr_blob,
+				      sizeof(fattr_blob));
+	COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, argoparray, pxy_bitmap_getattr);
+
+	/* Dynamic ask of server maxread and maxwrite */
+	atok_mread_mwrite =
+	    pxy_fill_getattr_reply(resoparray + opcnt,
+				   fattr_blob_mread_mwrite,
+				   sizeof(fattr_blob_mread_mwrite));
+	COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, argoparray,
+				      pxy_bitmap_mread_mwrite);
+
+	fhok->object.nfs_fh4_val = (char *)padfilehandle;
+	fhok->object.nfs_fh4_len = sizeof(padfilehandle);
+
+	rc = pxy_nfsv4_call(exp_hdl, op_ctx->creds, opcnt, argoparray,
+			    resoparray);
+	if (rc != NFS4_OK) {
+		st = nfsstat4_to_fsal(rc);
+		goto out;
+	}
+
+	/* Dynamic check of server maxread and maxwrite */
+	pxy_check_maxread_maxwrite(exp_hdl, &atok_mread_mwrite->obj_attributes);
+
+	st = pxy_make_object(exp_hdl, &atok->obj_attributes, &fhok->object,
+			     handle, attrs_out);
+
+out:
+	gsh_free(resoparray);
+	gsh_free(argoparray);
 	gsh_free(pcopy);
-	*handle = next;
-	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	return st;
 }
 
 /*
@@ -37,10 +37,14 @@
 #include "nfs4.h"
 #include "handle_mapping.h"
 #include "handle_mapping_db.h"
+#include "handle_mapping_log.h"
 #include "handle_mapping_internal.h"
 
 static hash_table_t *handle_map_hash;
 
+/* the mmap store is its own index, and needs no hash table */
+static bool handle_map_mmap;
+
 /* memory pool definitions */
 
 typedef struct digest_pool_entry__ {
@@ -240,6 +244,12 @@ int HandleMap_Init(const handle_map_param_t *p_param)
 {
 	int rc;
 
+	if (p_param->store == HANDLEMAP_STORE_MMAP) {
+		handle_map_mmap = true;
+		return handlemap_log_init(p_param->databases_directory,
+					  p_param->synchronous_insert);
+	}
+
 	/* first check database count */
 
 	rc = handlemap_db_count(p_param->databases_directory);
@@ -319,6 +329,9 @@ int HandleMap_GetFH(const nfs23_map_handle_t *nfs23_digest,
 	digest_pool_entry_t digest;
 	struct hash_latch hl;
 
+	if (handle_map_mmap)
+		return handlemap_log_get(nfs23_digest, fsal_handle);
+
 	digest.nfs23_digest = *nfs23_digest;
 
 	buffkey.addr = (caddr_t) &digest;
@@ -353,6 +366,9 @@ int HandleMap_SetFH(nfs23_map_handle_t *p_in_nfs23_digest, const void *data,
 {
 	int rc;
 
+	if (handle_map_mmap)
+		return handlemap_log_insert(p_in_nfs23_digest, data, len);
+
 	/* first, try to insert it to the hash table */
 
 	rc = handle_mapping_hash_add(handle_map_hash,
@@ -387,6 +403,9 @@ int HandleMap_DelFH(nfs23_map_handle_t *p_in_nfs23_digest)
 	digest_pool_entry_t *p_stored_digest;
 	handle_pool_entry_t *p_stored_handle;
 
+	if (handle_map_mmap)
+		return handlemap_log_delete(p_in_nfs23_digest);
+
 	/* first, delete it from hash table */
 
 	digest.nfs23_digest = *p_in_nfs23_digest;
@@ -417,5 +436,8 @@ int HandleMap_DelFH(nfs23_map_handle_t *p_in_nfs23_digest)
  */
 int HandleMap_Flush(void)
 {
+	if (handle_map_mmap)
+		return handlemap_log_flush();
+
 	return handlemap_db_flush();
 }
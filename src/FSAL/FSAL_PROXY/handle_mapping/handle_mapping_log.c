@@ -0,0 +1,672 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file handle_mapping_log.c
+ *
+ * @brief Memory-mapped store for the handle map.
+ *
+ * Mappings are appended to a log file, and found again through an
+ * open-addressing index kept in a second file.  Both are mapped, so a
+ * lookup is a probe of the index and a copy out of the log, and startup
+ * is only a matter of mapping the files.  Removals append a tombstone
+ * record, which lets the index be rebuilt from the log alone when it
+ * was not flushed cleanly.
+ */
+#include "config.h"
+#include "handle_mapping.h"
+#include "handle_mapping_log.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#define HDLMAP_LOG_MAGIC	0x484d4c47	/* "HMLG" */
+#define HDLMAP_IDX_MAGIC	0x484d4958	/* "HMIX" */
+#define HDLMAP_REC_MAGIC	0x4d52
+#define HDLMAP_VERSION		1
+
+/* record flags */
+#define HDLMAP_REC_DELETE	0x01
+
+/* the log grows by extents, so it is not remapped on every insert */
+#define HDLMAP_LOG_EXTENT	(16 << 20)
+
+/* must be a power of 2 */
+#define HDLMAP_IDX_MIN_SLOTS	4096
+
+/* slot offsets: no record lives at offset 0, it is the log header */
+#define SLOT_EMPTY	0
+#define SLOT_DELETED	UINT64_MAX
+
+#define HDLMAP_ALIGN(_x) (((_x) + 7) & ~((size_t)7))
+
+struct hdlmap_log_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t end;		/* offset past the last record */
+};
+
+struct hdlmap_rec {
+	uint16_t magic;
+	uint8_t flags;
+	uint8_t fh_len;
+	uint32_t handle_hash;
+	uint64_t object_id;
+	char fh_data[];
+};
+
+struct hdlmap_idx_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t nslots;
+	uint64_t used;
+	uint64_t deleted;
+	uint64_t log_end;	/* log end when the index was last synced */
+	uint32_t clean;
+	uint32_t pad;
+};
+
+struct hdlmap_slot {
+	uint64_t object_id;
+	uint64_t offset;
+	uint32_t handle_hash;
+	uint32_t pad;
+};
+
+struct hdlmap_idx {
+	int fd;
+	size_t len;
+	struct hdlmap_idx_hdr *hdr;
+	struct hdlmap_slot *slots;
+};
+
+static struct {
+	pthread_rwlock_t lock;
+	char dir[MAXPATHLEN + 1];
+	int synchronous;
+
+	int log_fd;
+	size_t log_len;
+	char *log_map;
+	struct hdlmap_log_hdr *log_hdr;
+
+	struct hdlmap_idx idx;
+} hdlmap;
+
+static inline uint64_t slot_hash(uint64_t object_id, uint32_t handle_hash)
+{
+	uint64_t h = (object_id ^ ((uint64_t)handle_hash << 32)) *
+		     0x9E3779B97F4A7C15ULL;
+
+	return h ^ (h >> 29);
+}
+
+/**
+ * @brief Probe the index for a digest.
+ *
+ * @param[in] idx         Index to probe
+ * @param[in] object_id   Digest object id
+ * @param[in] handle_hash Digest handle hash
+ * @param[in] insert      Whether a free slot is wanted if it is not found
+ *
+ * @return The matching slot, or the slot to insert into, or NULL.
+ */
+static struct hdlmap_slot *idx_find(struct hdlmap_idx *idx,
+				    uint64_t object_id,
+				    uint32_t handle_hash,
+				    bool insert)
+{
+	uint64_t mask = idx->hdr->nslots - 1;
+	uint64_t i = slot_hash(object_id, handle_hash) & mask;
+	struct hdlmap_slot *free_slot = NULL;
+	uint64_t n;
+
+	for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+		struct hdlmap_slot *s = &idx->slots[i];
+
+		if (s->offset == SLOT_EMPTY)
+			return insert ? (free_slot ? free_slot : s) : NULL;
+
+		if (s->offset == SLOT_DELETED) {
+			if (!free_slot)
+				free_slot = s;
+			continue;
+		}
+
+		if (s->object_id == object_id && s->handle_hash == handle_hash)
+			return s;
+	}
+
+	return insert ? free_slot : NULL;
+}
+
+static void idx_set(struct hdlmap_idx *idx, struct hdlmap_slot *s,
+		    uint64_t object_id, uint32_t handle_hash, uint64_t offset)
+{
+	if (s->offset == SLOT_DELETED)
+		idx->hdr->deleted--;
+	if (s->offset == SLOT_EMPTY || s->offset == SLOT_DELETED)
+		idx->hdr->used++;
+
+	s->object_id = object_id;
+	s->handle_hash = handle_hash;
+	s->offset = offset;
+}
+
+static void idx_unmap(struct hdlmap_idx *idx)
+{
+	if (idx->hdr)
+		munmap(idx->hdr, idx->len);
+	if (idx->fd >= 0)
+		close(idx->fd);
+	idx->hdr = NULL;
+	idx->slots = NULL;
+	idx->fd = -1;
+}
+
+static int idx_map(struct hdlmap_idx *idx, const char *path, uint64_t nslots)
+{
+	struct stat st;
+	bool create = nslots != 0;
+
+	idx->fd = open(path, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR,
+		       0600);
+	if (idx->fd < 0)
+		return errno;
+
+	if (create) {
+		idx->len = sizeof(struct hdlmap_idx_hdr) +
+			   nslots * sizeof(struct hdlmap_slot);
+		if (ftruncate(idx->fd, idx->len) != 0)
+			goto err;
+	} else {
+		if (fstat(idx->fd, &st) != 0)
+			goto err;
+		if (st.st_size < sizeof(struct hdlmap_idx_hdr)) {
+			errno = EINVAL;
+			goto err;
+		}
+		idx->len = st.st_size;
+	}
+
+	idx->hdr = mmap(NULL, idx->len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			idx->fd, 0);
+	if (idx->hdr == MAP_FAILED) {
+		idx->hdr = NULL;
+		goto err;
+	}
+	idx->slots = (struct hdlmap_slot *)(idx->hdr + 1);
+
+	if (create) {
+		/* the file was zero filled, all slots are empty */
+		idx->hdr->magic = HDLMAP_IDX_MAGIC;
+		idx->hdr->version = HDLMAP_VERSION;
+		idx->hdr->nslots = nslots;
+		return 0;
+	}
+
+	nslots = idx->hdr->nslots;
+	if (idx->hdr->magic != HDLMAP_IDX_MAGIC ||
+	    idx->hdr->version != HDLMAP_VERSION ||
+	    nslots == 0 || (nslots & (nslots - 1)) != 0 ||
+	    idx->len != sizeof(struct hdlmap_idx_hdr) +
+			nslots * sizeof(struct hdlmap_slot)) {
+		errno = EINVAL;
+		goto err;
+	}
+
+	return 0;
+
+ err:
+	{
+		int rc = errno;
+
+		idx_unmap(idx);
+		return rc;
+	}
+}
+
+static inline struct hdlmap_rec *log_rec(uint64_t offset)
+{
+	return (struct hdlmap_rec *)(hdlmap.log_map + offset);
+}
+
+/* Check that a record lies within the log and looks like one */
+static bool log_rec_valid(uint64_t offset)
+{
+	struct hdlmap_rec *rec;
+
+	if (offset < sizeof(struct hdlmap_log_hdr) ||
+	    offset + sizeof(*rec) > hdlmap.log_hdr->end)
+		return false;
+
+	rec = log_rec(offset);
+	return rec->magic == HDLMAP_REC_MAGIC &&
+	       offset + sizeof(*rec) + rec->fh_len <= hdlmap.log_hdr->end;
+}
+
+/**
+ * @brief Rebuild the index into a new file, then swap it in
+ *
+ * The live entries come either from the current index, when it is only
+ * grown, or from a scan of the whole log, when it cannot be trusted.
+ */
+static int idx_rebuild(uint64_t nslots, bool from_log)
+{
+	char path[MAXPATHLEN + 1];
+	char tmp[MAXPATHLEN + 1];
+	struct hdlmap_idx nidx;
+	struct hdlmap_slot *s;
+	uint64_t i;
+	int rc;
+
+	snprintf(path, sizeof(path), "%s/%s", hdlmap.dir, IDX_FILE_NAME);
+	snprintf(tmp, sizeof(tmp), "%s/%s.tmp", hdlmap.dir, IDX_FILE_NAME);
+
+	rc = idx_map(&nidx, tmp, nslots);
+	if (rc != 0) {
+		LogCrit(COMPONENT_FSAL, "Could not create %s: %s", tmp,
+			strerror(rc));
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	if (from_log) {
+		uint64_t off = HDLMAP_ALIGN(sizeof(struct hdlmap_log_hdr));
+
+		while (off < hdlmap.log_hdr->end) {
+			struct hdlmap_rec *rec = log_rec(off);
+
+			if (!log_rec_valid(off)) {
+				/* torn tail, cut the log there */
+				LogWarn(COMPONENT_FSAL,
+					"Handle map log truncated at %"PRIu64
+					" (was %"PRIu64")",
+					off, hdlmap.log_hdr->end);
+				hdlmap.log_hdr->end = off;
+				break;
+			}
+
+			s = idx_find(&nidx, rec->object_id, rec->handle_hash,
+				     !(rec->flags & HDLMAP_REC_DELETE));
+			if (!(rec->flags & HDLMAP_REC_DELETE)) {
+				idx_set(&nidx, s, rec->object_id,
+					rec->handle_hash, off);
+			} else if (s) {
+				s->offset = SLOT_DELETED;
+				nidx.hdr->used--;
+				nidx.hdr->deleted++;
+			}
+
+			off += HDLMAP_ALIGN(sizeof(*rec) + rec->fh_len);
+		}
+	} else {
+		for (i = 0; i < hdlmap.idx.hdr->nslots; i++) {
+			struct hdlmap_slot *o = &hdlmap.idx.slots[i];
+
+			if (o->offset == SLOT_EMPTY ||
+			    o->offset == SLOT_DELETED)
+				continue;
+
+			s = idx_find(&nidx, o->object_id, o->handle_hash,
+				     true);
+			idx_set(&nidx, s, o->object_id, o->handle_hash,
+				o->offset);
+		}
+	}
+
+	nidx.hdr->log_end = hdlmap.log_hdr->end;
+
+	if (rename(tmp, path) != 0) {
+		rc = errno;
+		LogCrit(COMPONENT_FSAL, "Could not rename %s: %s", tmp,
+			strerror(rc));
+		idx_unmap(&nidx);
+		unlink(tmp);
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	idx_unmap(&hdlmap.idx);
+	hdlmap.idx = nidx;
+
+	return HANDLEMAP_SUCCESS;
+}
+
+/* Make room for len more bytes at the end of the log */
+static int log_reserve(size_t len)
+{
+	size_t nlen;
+	void *map;
+
+	if (hdlmap.log_hdr->end + len <= hdlmap.log_len)
+		return HANDLEMAP_SUCCESS;
+
+	nlen = hdlmap.log_len + HDLMAP_LOG_EXTENT;
+
+	if (ftruncate(hdlmap.log_fd, nlen) != 0) {
+		LogCrit(COMPONENT_FSAL, "Could not grow handle map log: %s",
+			strerror(errno));
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	map = mremap(hdlmap.log_map, hdlmap.log_len, nlen, MREMAP_MAYMOVE);
+	if (map == MAP_FAILED) {
+		LogCrit(COMPONENT_FSAL, "Could not remap handle map log: %s",
+			strerror(errno));
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	hdlmap.log_map = map;
+	hdlmap.log_hdr = map;
+	hdlmap.log_len = nlen;
+
+	return HANDLEMAP_SUCCESS;
+}
+
+/* Append a record, returning its offset, or 0 on error */
+static uint64_t log_append(const nfs23_map_handle_t *digest, uint8_t flags,
+			   const void *data, uint32_t len)
+{
+	size_t size = HDLMAP_ALIGN(sizeof(struct hdlmap_rec) + len);
+	uint64_t off = hdlmap.log_hdr->end;
+	struct hdlmap_rec *rec;
+
+	if (log_reserve(size) != HANDLEMAP_SUCCESS)
+		return 0;
+
+	rec = log_rec(off);
+	rec->flags = flags;
+	rec->fh_len = len;
+	rec->handle_hash = digest->handle_hash;
+	rec->object_id = digest->object_id;
+	if (len)
+		memcpy(rec->fh_data, data, len);
+	rec->magic = HDLMAP_REC_MAGIC;
+
+	hdlmap.log_hdr->end = off + size;
+
+	if (hdlmap.synchronous) {
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t start = off & ~(page - 1);
+
+		msync(hdlmap.log_map + start, off + size - start, MS_SYNC);
+		msync(hdlmap.log_map, sizeof(struct hdlmap_log_hdr), MS_SYNC);
+	}
+
+	/* The index no longer matches what is on disk */
+	hdlmap.idx.hdr->clean = 0;
+
+	return off;
+}
+
+/* Count the mappings the log holds, to size a rebuilt index */
+static uint64_t log_count(void)
+{
+	uint64_t off = HDLMAP_ALIGN(sizeof(struct hdlmap_log_hdr));
+	uint64_t count = 0;
+
+	while (off < hdlmap.log_hdr->end && log_rec_valid(off)) {
+		struct hdlmap_rec *rec = log_rec(off);
+
+		if (rec->flags & HDLMAP_REC_DELETE)
+			count--;
+		else
+			count++;
+
+		off += HDLMAP_ALIGN(sizeof(*rec) + rec->fh_len);
+	}
+
+	return count;
+}
+
+static int log_map(const char *path)
+{
+	struct stat st;
+	bool fresh;
+
+	hdlmap.log_fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (hdlmap.log_fd < 0)
+		return errno;
+
+	if (fstat(hdlmap.log_fd, &st) != 0)
+		return errno;
+
+	fresh = st.st_size == 0;
+	if (fresh) {
+		if (ftruncate(hdlmap.log_fd, HDLMAP_LOG_EXTENT) != 0)
+			return errno;
+		hdlmap.log_len = HDLMAP_LOG_EXTENT;
+	} else if (st.st_size < sizeof(struct hdlmap_log_hdr)) {
+		return EINVAL;
+	} else {
+		hdlmap.log_len = st.st_size;
+	}
+
+	hdlmap.log_map = mmap(NULL, hdlmap.log_len, PROT_READ | PROT_WRITE,
+			      MAP_SHARED, hdlmap.log_fd, 0);
+	if (hdlmap.log_map == MAP_FAILED) {
+		hdlmap.log_map = NULL;
+		return errno;
+	}
+	hdlmap.log_hdr = (struct hdlmap_log_hdr *)hdlmap.log_map;
+
+	if (fresh) {
+		hdlmap.log_hdr->magic = HDLMAP_LOG_MAGIC;
+		hdlmap.log_hdr->version = HDLMAP_VERSION;
+		hdlmap.log_hdr->end =
+			HDLMAP_ALIGN(sizeof(struct hdlmap_log_hdr));
+	} else if (hdlmap.log_hdr->magic != HDLMAP_LOG_MAGIC ||
+		   hdlmap.log_hdr->version != HDLMAP_VERSION ||
+		   hdlmap.log_hdr->end > hdlmap.log_len) {
+		return EINVAL;
+	}
+
+	return 0;
+}
+
+int handlemap_log_init(const char *db_dir, int synchronous_insert)
+{
+	char path[MAXPATHLEN + 1];
+	uint64_t count, nslots;
+	int rc;
+
+	PTHREAD_RWLOCK_init(&hdlmap.lock, NULL);
+	hdlmap.synchronous = synchronous_insert;
+	hdlmap.idx.fd = -1;
+	strncpy(hdlmap.dir, db_dir, MAXPATHLEN);
+
+	snprintf(path, sizeof(path), "%s/%s", hdlmap.dir, LOG_FILE_NAME);
+	rc = log_map(path);
+	if (rc != 0) {
+		LogCrit(COMPONENT_FSAL, "Could not map handle map log %s: %s",
+			path, strerror(rc));
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	snprintf(path, sizeof(path), "%s/%s", hdlmap.dir, IDX_FILE_NAME);
+	rc = idx_map(&hdlmap.idx, path, 0);
+	if (rc == 0 && hdlmap.idx.hdr->clean &&
+	    hdlmap.idx.hdr->log_end == hdlmap.log_hdr->end) {
+		LogEvent(COMPONENT_FSAL,
+			 "Handle map index mapped, %"PRIu64" handles",
+			 hdlmap.idx.hdr->used);
+		return HANDLEMAP_SUCCESS;
+	}
+
+	if (rc == 0)
+		LogEvent(COMPONENT_FSAL,
+			 "Handle map index was not synced, rebuilding it from the log");
+
+	count = log_count();
+	nslots = HDLMAP_IDX_MIN_SLOTS;
+	while (count * 2 > nslots)
+		nslots *= 2;
+
+	rc = idx_rebuild(nslots, true);
+	if (rc != HANDLEMAP_SUCCESS)
+		return rc;
+
+	LogEvent(COMPONENT_FSAL, "Handle map index rebuilt, %"PRIu64" handles",
+		 hdlmap.idx.hdr->used);
+
+	return handlemap_log_flush();
+}
+
+int handlemap_log_get(const nfs23_map_handle_t *p_in_nfs23_digest,
+		      struct gsh_buffdesc *fsal_handle)
+{
+	struct hdlmap_slot *s;
+	struct hdlmap_rec *rec;
+	int rc = HANDLEMAP_STALE;
+
+	PTHREAD_RWLOCK_rdlock(&hdlmap.lock);
+
+	s = idx_find(&hdlmap.idx, p_in_nfs23_digest->object_id,
+		     p_in_nfs23_digest->handle_hash, false);
+
+	if (s && log_rec_valid(s->offset)) {
+		rec = log_rec(s->offset);
+
+		if (rec->object_id != p_in_nfs23_digest->object_id ||
+		    rec->handle_hash != p_in_nfs23_digest->handle_hash) {
+			rc = HANDLEMAP_INCONSISTENCY;
+		} else if (rec->fh_len < fsal_handle->len) {
+			fsal_handle->len = rec->fh_len;
+			memcpy(fsal_handle->addr, rec->fh_data, rec->fh_len);
+			rc = HANDLEMAP_SUCCESS;
+		} else {
+			rc = HANDLEMAP_INTERNAL_ERROR;
+		}
+	}
+
+	PTHREAD_RWLOCK_unlock(&hdlmap.lock);
+
+	return rc;
+}
+
+int handlemap_log_insert(nfs23_map_handle_t *p_in_nfs23_digest,
+			 const void *data, uint32_t len)
+{
+	struct hdlmap_idx_hdr *hdr;
+	struct hdlmap_slot *s;
+	uint64_t off;
+	int rc = HANDLEMAP_SUCCESS;
+
+	if (len >= NFS4_FHSIZE)
+		return HANDLEMAP_INVALID_PARAM;
+
+	PTHREAD_RWLOCK_wrlock(&hdlmap.lock);
+
+	hdr = hdlmap.idx.hdr;
+
+	/* keep the load below 3/4, growing back to below 1/2 */
+	if ((hdr->used + hdr->deleted + 1) * 4 > hdr->nslots * 3) {
+		uint64_t nslots = hdr->nslots;
+
+		while ((hdr->used + 1) * 2 > nslots)
+			nslots *= 2;
+
+		rc = idx_rebuild(nslots, false);
+		if (rc != HANDLEMAP_SUCCESS)
+			goto out;
+	}
+
+	s = idx_find(&hdlmap.idx, p_in_nfs23_digest->object_id,
+		     p_in_nfs23_digest->handle_hash, true);
+
+	if (s->offset != SLOT_EMPTY && s->offset != SLOT_DELETED) {
+		rc = HANDLEMAP_EXISTS;
+		goto out;
+	}
+
+	off = log_append(p_in_nfs23_digest, 0, data, len);
+	if (off == 0) {
+		rc = HANDLEMAP_SYSTEM_ERROR;
+		goto out;
+	}
+
+	idx_set(&hdlmap.idx, s, p_in_nfs23_digest->object_id,
+		p_in_nfs23_digest->handle_hash, off);
+
+ out:
+	PTHREAD_RWLOCK_unlock(&hdlmap.lock);
+
+	return rc;
+}
+
+int handlemap_log_delete(nfs23_map_handle_t *p_in_nfs23_digest)
+{
+	struct hdlmap_slot *s;
+	int rc = HANDLEMAP_SUCCESS;
+
+	PTHREAD_RWLOCK_wrlock(&hdlmap.lock);
+
+	s = idx_find(&hdlmap.idx, p_in_nfs23_digest->object_id,
+		     p_in_nfs23_digest->handle_hash, false);
+
+	if (!s) {
+		rc = HANDLEMAP_STALE;
+		goto out;
+	}
+
+	if (log_append(p_in_nfs23_digest, HDLMAP_REC_DELETE, NULL, 0) == 0) {
+		rc = HANDLEMAP_SYSTEM_ERROR;
+		goto out;
+	}
+
+	s->offset = SLOT_DELETED;
+	hdlmap.idx.hdr->used--;
+	hdlmap.idx.hdr->deleted++;
+
+ out:
+	PTHREAD_RWLOCK_unlock(&hdlmap.lock);
+
+	return rc;
+}
+
+int handlemap_log_flush(void)
+{
+	int rc = HANDLEMAP_SUCCESS;
+
+	PTHREAD_RWLOCK_wrlock(&hdlmap.lock);
+
+	if (msync(hdlmap.log_map, hdlmap.log_len, MS_SYNC) != 0 ||
+	    msync(hdlmap.idx.hdr, hdlmap.idx.len, MS_SYNC) != 0) {
+		LogCrit(COMPONENT_FSAL, "Could not sync handle map: %s",
+			strerror(errno));
+		rc = HANDLEMAP_SYSTEM_ERROR;
+		goto out;
+	}
+
+	/* only now does the index match the log on disk */
+	hdlmap.idx.hdr->log_end = hdlmap.log_hdr->end;
+	hdlmap.idx.hdr->clean = 1;
+	msync(hdlmap.idx.hdr, sizeof(struct hdlmap_idx_hdr), MS_SYNC);
+
+ out:
+	PTHREAD_RWLOCK_unlock(&hdlmap.lock);
+
+	return rc;
+}
@@ -0,0 +1,38 @@
+#ifndef _HANDLE_MAPPING_LOG_H
+#define _HANDLE_MAPPING_LOG_H
+
+#include "handle_mapping.h"
+
+#define LOG_FILE_NAME "handlemap.log"
+#define IDX_FILE_NAME "handlemap.idx"
+
+/**
+ * Map the handle log and its index, creating them if needed.
+ * The index is rebuilt from the log if it was not cleanly flushed.
+ */
+int handlemap_log_init(const char *db_dir, int synchronous_insert);
+
+/**
+ * Look a digest up in the persistent index.
+ */
+int handlemap_log_get(const nfs23_map_handle_t *p_in_nfs23_digest,
+		      struct gsh_buffdesc *fsal_handle);
+
+/**
+ * Append a mapping to the log and index it.
+ * Returns HANDLEMAP_EXISTS if the digest is already mapped.
+ */
+int handlemap_log_insert(nfs23_map_handle_t *p_in_nfs23_digest,
+			 const void *data, uint32_t len);
+
+/**
+ * Append a removal record to the log and drop the digest from the index.
+ */
+int handlemap_log_delete(nfs23_map_handle_t *p_in_nfs23_digest);
+
+/**
+ * Sync the log and the index, and mark the index as clean.
+ */
+int handlemap_log_flush(void);
+
+#endif
@@ -67,6 +67,14 @@ static struct config_item_list sec_types[] = {
 };
 #endif
 
+#ifdef PROXY_HANDLE_MAPPING
+static struct config_item_list handlemap_stores[] = {
+	CONFIG_LIST_TOK("sqlite", HANDLEMAP_STORE_SQLITE),
+	CONFIG_LIST_TOK("mmap", HANDLEMAP_STORE_MMAP),
+	CONFIG_LIST_EOL
+};
+#endif
+
 /*512 bytes to store header*/
 #define SEND_RECV_HEADER_SPACE 512
 /*1MB of default maxsize*/
@@ -93,6 +101,8 @@ static struct config_item proxy_remote_params[] = {
 		       pxy_client_params, use_privileged_client_port),
 	CONF_ITEM_UI32("RPC_Client_Timeout", 1, 60*4, 60,
 		       pxy_client_params, srv_timeout),
+	CONF_ITEM_UI32("Num_Connections", 1, 16, 1,
+		       pxy_client_params, srv_connections),
 #ifdef _USE_GSSRPC
 	CONF_ITEM_STR("Remote_PrincipalName", 0, MAXNAMLEN, NULL,
 		      pxy_client_params, remote_principal),
@@ -118,6 +128,9 @@ static struct config_item proxy_remote_params[] = {
 		       pxy_client_params, hdlmap.database_count),
 	CONF_ITEM_UI32("HandleMap_HashTable_Size", 1, 127, 103,
 		       pxy_client_params, hdlmap.hashtable_size),
+	CONF_ITEM_TOKEN("HandleMap_Store", HANDLEMAP_STORE_SQLITE,
+			handlemap_stores,
+			pxy_client_params, hdlmap.store),
 #endif
 	CONFIG_EOL
 };
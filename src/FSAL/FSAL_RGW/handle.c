@@ -131,8 +131,76 @@ struct rgw_cb_arg {
 	void *fsal_arg;
 	struct fsal_obj_handle *dir_hdl;
 	attrmask_t attrmask;
+	uint64_t last_cookie;		/*< Cookie of the last entry passed */
+	char last_name[NAME_MAX + 1];	/*< Its name, "" if none or too long */
 };
 
+#ifdef USE_FSAL_RGW_READDIR2
+/**
+ * @brief Find the name a readdir cookie was handed out for
+ *
+ * @param[in] dir     Directory being read
+ * @param[in] cookie  Cookie to resume after
+ *
+ * @return A copy of the name for the caller to free, or NULL.
+ */
+
+static char *rgw_find_marker(struct rgw_handle *dir, uint64_t cookie)
+{
+	char *name = NULL;
+	int i;
+
+	PTHREAD_MUTEX_lock(&dir->marker_lock);
+	for (i = 0; i < RGW_READDIR_MARKERS; i++) {
+		if (dir->markers[i].name != NULL &&
+		    dir->markers[i].cookie == cookie) {
+			name = gsh_strdup(dir->markers[i].name);
+			break;
+		}
+	}
+	PTHREAD_MUTEX_unlock(&dir->marker_lock);
+
+	return name;
+}
+
+/**
+ * @brief Remember where a readdir stopped
+ *
+ * @param[in] dir     Directory being read
+ * @param[in] cookie  Cookie of the last entry passed up
+ * @param[in] name    Name of that entry
+ */
+
+static void rgw_save_marker(struct rgw_handle *dir, uint64_t cookie,
+			    const char *name)
+{
+	struct rgw_readdir_marker *marker = NULL;
+	char *old;
+	int i;
+
+	PTHREAD_MUTEX_lock(&dir->marker_lock);
+	for (i = 0; i < RGW_READDIR_MARKERS; i++) {
+		if (dir->markers[i].name != NULL &&
+		    dir->markers[i].cookie == cookie) {
+			marker = &dir->markers[i];
+			break;
+		}
+	}
+
+	if (marker == NULL) {
+		marker = &dir->markers[dir->next_marker];
+		dir->next_marker = (dir->next_marker + 1) % RGW_READDIR_MARKERS;
+	}
+
+	old = marker->name;
+	marker->cookie = cookie;
+	marker->name = gsh_strdup(name);
+	PTHREAD_MUTEX_unlock(&dir->marker_lock);
+
+	gsh_free(old);
+}
+#endif
+
 static bool rgw_cb(const char *name, void *arg, uint64_t offset, uint32_t flags)
 {
 	struct rgw_cb_arg *rgw_cb_arg = arg;
@@ -157,6 +225,13 @@ static bool rgw_cb(const char *name, void *arg, uint64_t offset, uint32_t flags)
 
 	fsal_release_attrs(&attrs);
 
+	/* The next call resumes after this entry */
+	rgw_cb_arg->last_cookie = offset;
+	if (strlen(name) < sizeof(rgw_cb_arg->last_name))
+		strcpy(rgw_cb_arg->last_name, name);
+	else
+		rgw_cb_arg->last_name[0] = '\0';
+
 	return cb_rc <= DIR_READAHEAD;
 }
 
@@ -168,6 +243,11 @@ static bool rgw_cb(const char *name, void *arg, uint64_t offset, uint32_t flags)
  * out of nothing) and passes dirent information to the supplied
  * callback.
  *
+ * A bucket listing can only be resumed after a name; resuming at an
+ * offset lists the bucket again from the start.  So the name behind
+ * the cookie each call stops at is remembered on the directory, and
+ * when that cookie comes back the listing resumes after the name.
+ *
  * @param[in]  dir_hdl     The directory to read
  * @param[in]  whence      The cookie indicating resumption, NULL to start
  * @param[in]  dir_state   Opaque, passed to cb
@@ -186,6 +266,9 @@ static fsal_status_t rgw_fsal_readdir(struct fsal_obj_handle *dir_hdl,
 	fsal_status_t fsal_status = {ERR_FSAL_NO_ERROR, 0};
 	struct rgw_cb_arg rgw_cb_arg = {cb, cb_arg, dir_hdl, attrmask};
 	uint64_t r_whence = (whence) ? *whence : 0;
+#ifdef USE_FSAL_RGW_READDIR2
+	char *marker = NULL;
+#endif
 
 	struct rgw_export *export =
 		container_of(op_ctx->fsal_export, struct rgw_export, export);
@@ -198,11 +281,28 @@ static fsal_status_t rgw_fsal_readdir(struct fsal_obj_handle *dir_hdl,
 
 	rc = 0;
 	*eof = false;
-	rc = rgw_readdir(export->rgw_fs, dir->rgw_fh, &r_whence, rgw_cb,
-			&rgw_cb_arg, eof, RGW_READDIR_FLAG_NONE);
+#ifdef USE_FSAL_RGW_READDIR2
+	if (whence != NULL)
+		marker = rgw_find_marker(dir, *whence);
+
+	if (marker != NULL) {
+		rc = rgw_readdir2(export->rgw_fs, dir->rgw_fh, marker, rgw_cb,
+				  &rgw_cb_arg, eof, RGW_READDIR_FLAG_NONE);
+		gsh_free(marker);
+	} else
+#endif
+		rc = rgw_readdir(export->rgw_fs, dir->rgw_fh, &r_whence,
+				 rgw_cb, &rgw_cb_arg, eof,
+				 RGW_READDIR_FLAG_NONE);
 	if (rc < 0)
 		return rgw2fsal_error(rc);
 
+#ifdef USE_FSAL_RGW_READDIR2
+	if (!*eof && rgw_cb_arg.last_name[0] != '\0')
+		rgw_save_marker(dir, rgw_cb_arg.last_cookie,
+				rgw_cb_arg.last_name);
+#endif
+
 	return fsal_status;
 }
 
@@ -338,6 +438,112 @@ static fsal_status_t rgw_fsal_mkdir(struct fsal_obj_handle *dir_hdl,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief Push buffered writes to RGW
+ *
+ * Must be called with the write buffer locked.
+ *
+ * @param[in] export  Export of the object
+ * @param[in] handle  Object whose buffer to push
+ *
+ * @return 0 or a negative RGW error.
+ */
+
+static int rgw_wb_flush(struct rgw_export *export, struct rgw_handle *handle)
+{
+	struct rgw_write_buffer *wb = &handle->wb;
+	size_t written = 0;
+	int rc;
+
+	if (wb->len == 0)
+		return 0;
+
+	rc = rgw_write(export->rgw_fs, handle->rgw_fh, wb->offset, wb->len,
+		       &written, wb->data, RGW_WRITE_FLAG_NONE);
+
+	LogFullDebug(COMPONENT_FSAL,
+		"%s obj_hdl %p offset %"PRIu64" len %zu returned %d",
+		__func__, &handle->handle, wb->offset, wb->len, rc);
+
+	wb->offset += wb->len;
+	wb->len = 0;
+
+	return rc < 0 ? rc : 0;
+}
+
+/**
+ * @brief Push buffered writes to RGW, taking the buffer lock
+ *
+ * @param[in] export  Export of the object
+ * @param[in] handle  Object whose buffer to push
+ *
+ * @return 0 or a negative RGW error.
+ */
+
+static int rgw_wb_sync(struct rgw_export *export, struct rgw_handle *handle)
+{
+	int rc;
+
+	PTHREAD_MUTEX_lock(&handle->wb.lock);
+	rc = rgw_wb_flush(export, handle);
+	PTHREAD_MUTEX_unlock(&handle->wb.lock);
+
+	return rc;
+}
+
+/**
+ * @brief Buffer an unstable write
+ *
+ * librgw uploads an object sequentially, one rgw_write at a time, so
+ * small NFS writes become as many small uploads.  Sequential writes are
+ * gathered here and handed to RGW as one large write when the buffer
+ * fills, the writer seeks, or the data is committed or read.
+ *
+ * Must be called with the write buffer locked.
+ *
+ * @param[in]  export        Export of the object
+ * @param[in]  handle        Object to write
+ * @param[in]  offset        Position at which to write
+ * @param[in]  buffer_size   Amount to write
+ * @param[in]  buffer        Data to be written
+ * @param[out] wrote_amount  Amount accepted
+ *
+ * @return 0 or a negative RGW error.
+ */
+
+static int rgw_wb_write(struct rgw_export *export, struct rgw_handle *handle,
+			uint64_t offset, size_t buffer_size, void *buffer,
+			size_t *wrote_amount)
+{
+	struct rgw_write_buffer *wb = &handle->wb;
+	size_t size = RGWFSM.write_buffer_size;
+	int rc = 0;
+
+	if (wb->len != 0 &&
+	    (offset != wb->offset + wb->len || wb->len + buffer_size > size)) {
+		rc = rgw_wb_flush(export, handle);
+		if (rc < 0)
+			return rc;
+	}
+
+	if (buffer_size >= size)
+		return rgw_write(export->rgw_fs, handle->rgw_fh, offset,
+				 buffer_size, wrote_amount, buffer,
+				 RGW_WRITE_FLAG_NONE);
+
+	if (wb->data == NULL)
+		wb->data = gsh_malloc(size);
+
+	if (wb->len == 0)
+		wb->offset = offset;
+
+	memcpy(wb->data + wb->len, buffer, buffer_size);
+	wb->len += buffer_size;
+	*wrote_amount = buffer_size;
+
+	return rc;
+}
+
 /**
  * @brief Freshen and return attributes
  *
@@ -374,6 +580,13 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 		return rgw2fsal_error(rc);
 	}
 
+	/* Buffered writes are not in RGW yet, but do extend the file */
+	PTHREAD_MUTEX_lock(&handle->wb.lock);
+	if (handle->wb.len != 0 &&
+	    handle->wb.offset + handle->wb.len > st.st_size)
+		st.st_size = handle->wb.offset + handle->wb.len;
+	PTHREAD_MUTEX_unlock(&handle->wb.lock);
+
 	posix2fsal_attributes_all(&st, attrs);
 
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -459,7 +672,9 @@ fsal_status_t rgw_fsal_setattr2(struct fsal_obj_handle *obj_hdl,
 	memset(&st, 0, sizeof(struct stat));
 
 	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_SIZE)) {
-		rc = rgw_truncate(export->rgw_fs, handle->rgw_fh,
+		rc = rgw_wb_sync(export, handle);
+		if (rc == 0)
+			rc = rgw_truncate(export->rgw_fs, handle->rgw_fh,
 				attrib_set->filesize, RGW_TRUNCATE_FLAG_NONE);
 
 		if (rc < 0) {
@@ -1275,10 +1490,16 @@ fsal_status_t rgw_fsal_read2(struct fsal_obj_handle *obj_hdl,
 		return fsalstat(ERR_FSAL_NOTSUPP, 0);
 	}
 
+	/* Reads must see buffered writes */
+	int rc = rgw_wb_sync(export, handle);
+
+	if (rc < 0)
+		return rgw2fsal_error(rc);
+
 	/* RGW does not support a file descriptor abstraction--so
 	 * reads are handle based */
 
-	int rc = rgw_read(export->rgw_fs, handle->rgw_fh, offset,
+	rc = rgw_read(export->rgw_fs, handle->rgw_fh, offset,
 			buffer_size, read_amount, buffer,
 			RGW_READ_FLAG_NONE);
 
@@ -1340,9 +1561,22 @@ fsal_status_t rgw_fsal_write2(struct fsal_obj_handle *obj_hdl,
 
 	/* XXX note no call to fsal_find_fd (or wrapper) */
 
-	int rc = rgw_write(export->rgw_fs, handle->rgw_fh, offset,
-			buffer_size, wrote_amount, buffer,
-			RGW_WRITE_FLAG_NONE);
+	int rc;
+
+	PTHREAD_MUTEX_lock(&handle->wb.lock);
+
+	if (RGWFSM.write_buffer_size != 0 && !*fsal_stable) {
+		rc = rgw_wb_write(export, handle, offset, buffer_size, buffer,
+				  wrote_amount);
+	} else {
+		rc = rgw_wb_flush(export, handle);
+		if (rc == 0)
+			rc = rgw_write(export->rgw_fs, handle->rgw_fh, offset,
+				       buffer_size, wrote_amount, buffer,
+				       RGW_WRITE_FLAG_NONE);
+	}
+
+	PTHREAD_MUTEX_unlock(&handle->wb.lock);
 
 	LogFullDebug(COMPONENT_FSAL,
 		"%s post obj_hdl %p state %p returned %d", __func__, obj_hdl,
@@ -1393,6 +1627,10 @@ fsal_status_t rgw_fsal_commit2(struct fsal_obj_handle *obj_hdl,
 		"%s enter obj_hdl %p offset %"PRIx64" length %zx",
 		__func__, obj_hdl, (uint64_t) offset, length);
 
+	rc = rgw_wb_sync(export, handle);
+	if (rc < 0)
+		return rgw2fsal_error(rc);
+
 	rc = rgw_commit(export->rgw_fs, handle->rgw_fh, offset, length,
 			RGW_FSYNC_FLAG_NONE);
 	if (rc < 0)
@@ -1473,6 +1711,19 @@ fsal_status_t rgw_fsal_close2(struct fsal_obj_handle *obj_hdl,
 		}
 	}
 
+	/* Flush and drop the write buffer, the object is complete */
+	PTHREAD_MUTEX_lock(&handle->wb.lock);
+	rc = rgw_wb_flush(export, handle);
+	gsh_free(handle->wb.data);
+	handle->wb.data = NULL;
+	PTHREAD_MUTEX_unlock(&handle->wb.lock);
+
+	if (rc < 0) {
+		(void) rgw_close(export->rgw_fs, handle->rgw_fh,
+				 RGW_CLOSE_FLAG_NONE);
+		return rgw2fsal_error(rc);
+	}
+
 	rc = rgw_close(export->rgw_fs, handle->rgw_fh, RGW_CLOSE_FLAG_NONE);
 	if (rc < 0)
 		return rgw2fsal_error(rc);
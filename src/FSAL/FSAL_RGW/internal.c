@@ -212,6 +212,8 @@ int construct_handle(struct rgw_export *export,
 	constructing->handle.fileid = st->st_ino;
 
 	constructing->export = export;
+	PTHREAD_MUTEX_init(&constructing->wb.lock, NULL);
+	PTHREAD_MUTEX_init(&constructing->marker_lock, NULL);
 
 	*obj = constructing;
 
@@ -220,6 +222,14 @@ int construct_handle(struct rgw_export *export,
 
 void deconstruct_handle(struct rgw_handle *obj)
 {
+	int i;
+
+	for (i = 0; i < RGW_READDIR_MARKERS; i++)
+		gsh_free(obj->markers[i].name);
+
+	gsh_free(obj->wb.data);
+	PTHREAD_MUTEX_destroy(&obj->wb.lock);
+	PTHREAD_MUTEX_destroy(&obj->marker_lock);
 	fsal_obj_handle_fini(&obj->handle);
 	gsh_free(obj);
 }
@@ -61,6 +61,7 @@ struct rgw_fsal_module {
 	char *name;
 	char *cluster;
 	char *init_args;
+	uint32_t write_buffer_size;
 	librgw_t rgw;
 };
 extern struct rgw_fsal_module RGWFSM;
@@ -84,6 +85,32 @@ struct rgw_export {
 	char *rgw_secret_access_key;
 };
 
+/**
+ * Unstable writes gathered into one large rgw_write
+ */
+
+struct rgw_write_buffer {
+	pthread_mutex_t lock;	/*< Serializes writes to the object */
+	char *data;		/*< Buffered bytes, allocated on first use */
+	uint64_t offset;	/*< File offset of data[0] */
+	size_t len;		/*< Bytes buffered */
+};
+
+/**
+ * Number of resume points remembered per directory
+ */
+#define RGW_READDIR_MARKERS 8
+
+/**
+ * Name of the entry a readdir cookie was handed out for, so that a
+ * listing can resume after it instead of starting over
+ */
+
+struct rgw_readdir_marker {
+	uint64_t cookie;
+	char *name;
+};
+
 /**
  * The RGW FSAL internal handle
  */
@@ -97,6 +124,10 @@ struct rgw_handle {
 					 *< belongs to */
 	struct fsal_share share;
 	fsal_openflags_t openflags;
+	struct rgw_write_buffer wb;
+	pthread_mutex_t marker_lock;	/*< Protects markers */
+	struct rgw_readdir_marker markers[RGW_READDIR_MARKERS];
+	uint32_t next_marker;		/*< Next slot to reuse */
 };
 
 /**
@@ -82,6 +82,8 @@ static struct config_item rgw_items[] = {
 			rgw_fsal_module, fs_info.umask),
 	CONF_ITEM_MODE("xattr_access_rights", 0,
 			rgw_fsal_module, fs_info.xattr_access_rights),
+	CONF_ITEM_UI32("write_buffer_size", 0, 64 * 1024 * 1024, 0,
+			rgw_fsal_module, write_buffer_size),
 	CONFIG_EOL
 };
 
@@ -78,6 +78,10 @@ static void release(struct fsal_export *exp_hdl)
 
 	vfs_sub_fini(myself);
 
+#ifdef F_OFD_GETLK
+	vfs_lock_wait_fini(exp_hdl);
+#endif
+
 	vfs_unexport_filesystems(myself);
 
 	fsal_detach_export(exp_hdl->fsal, &exp_hdl->exports);
@@ -617,6 +621,7 @@ err_cleanup:
 	vfs_unexport_filesystems(myself);
 	fsal_detach_export(fsal_hdl, &myself->export.exports);
 err_free:
+	vfs_ff_fini(myself);
 	free_export_ops(&myself->export);
 	gsh_free(myself);	/* elvis has left the building */
 	return fsal_status;
@@ -38,6 +38,13 @@
 #include "fsal_convert.h"
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#ifdef HAVE_STATX
+#include <sys/sysmacros.h>
+#endif
 #include "vfs_methods.h"
 #include "os/subr.h"
 #include "sal_data.h"
@@ -84,11 +91,65 @@ fsal_status_t vfs_open_my_fd(struct vfs_fsal_obj_handle *myself,
 	return fsalstat(fsal_error, retval);
 }
 
+#ifdef USE_IO_URING
+/* Wakes closers waiting for asynchronous I/O on a descriptor */
+static pthread_mutex_t vfs_io_work_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t vfs_io_work_cond = PTHREAD_COND_INITIALIZER;
+static int32_t vfs_io_work_waiters;
+
+/**
+ * @brief Wait for the asynchronous I/O in flight on a descriptor
+ *
+ * No new I/O can start on it, the caller is closing it.
+ *
+ * @param[in] my_fd The descriptor
+ */
+static void vfs_io_work_wait(struct vfs_fd *my_fd)
+{
+	if (atomic_fetch_int32_t(&my_fd->io_work) == 0)
+		return;
+
+	atomic_inc_int32_t(&vfs_io_work_waiters);
+
+	PTHREAD_MUTEX_lock(&vfs_io_work_mtx);
+	while (atomic_fetch_int32_t(&my_fd->io_work) != 0)
+		pthread_cond_wait(&vfs_io_work_cond, &vfs_io_work_mtx);
+	PTHREAD_MUTEX_unlock(&vfs_io_work_mtx);
+
+	atomic_dec_int32_t(&vfs_io_work_waiters);
+}
+
+/**
+ * @brief Let go of the descriptor of a finished asynchronous I/O
+ *
+ * @param[in] fd    The descriptor used
+ * @param[in] io_fd The vfs_fd it belongs to, NULL if fd is temporary
+ */
+void vfs_async_fd_release(int fd, struct vfs_fd *io_fd)
+{
+	if (io_fd == NULL) {
+		close(fd);
+		return;
+	}
+
+	if (atomic_dec_int32_t(&io_fd->io_work) == 0 &&
+	    atomic_fetch_int32_t(&vfs_io_work_waiters) != 0) {
+		PTHREAD_MUTEX_lock(&vfs_io_work_mtx);
+		pthread_cond_broadcast(&vfs_io_work_cond);
+		PTHREAD_MUTEX_unlock(&vfs_io_work_mtx);
+	}
+}
+#endif
+
 fsal_status_t vfs_close_my_fd(struct vfs_fd *my_fd)
 {
 	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
 	int retval = 0;
 
+#ifdef USE_IO_URING
+	vfs_io_work_wait(my_fd);
+#endif
+
 	if (my_fd->fd >= 0 && my_fd->openflags != FSAL_O_CLOSED) {
 		retval = close(my_fd->fd);
 		if (retval < 0) {
@@ -959,6 +1020,91 @@ fsal_status_t find_fd(int *fd,
 	return status;
 }
 
+/**
+ * @brief Read a range as a list of data and hole segments
+ *
+ * The file is walked with SEEK_DATA and SEEK_HOLE.  The data of data
+ * segments is packed at the start of buffer.  If the file system
+ * can't tell holes apart, the whole range is one data segment.
+ *
+ * @param[in]     fd          File descriptor to read with
+ * @param[in]     offset      Position from which to read
+ * @param[in]     buffer_size Length of the range
+ * @param[out]    buffer      Buffer for the data
+ * @param[out]    read_amount Length of the range covered
+ * @param[out]    end_of_file true if the end of file has been reached
+ * @param[in,out] info        Room for the segments, and segments found
+ *
+ * @return 0 or an errno.
+ */
+
+static int vfs_read_plus_fd(int fd, uint64_t offset, size_t buffer_size,
+			    void *buffer, size_t *read_amount,
+			    bool *end_of_file, struct io_info *info)
+{
+	uint64_t pos = offset, end = offset + buffer_size, seg_end;
+	struct io_segment *seg;
+	size_t packed = 0;
+	struct stat st;
+	off_t next;
+	ssize_t nb_read;
+
+	info->io_segcnt = 0;
+
+	if (fstat(fd, &st) != 0)
+		return errno;
+
+	if (end > (uint64_t)st.st_size)
+		end = st.st_size;
+
+	while (pos < end && info->io_segcnt < info->io_segmax) {
+		seg = &info->io_segs[info->io_segcnt];
+
+		next = lseek(fd, pos, SEEK_DATA);
+		if (next == -1) {
+			if (errno != ENXIO)
+				/* Holes unknown here, all of it is data */
+				next = pos;
+			else
+				/* A hole up to the end of file */
+				next = end;
+		}
+
+		if ((uint64_t)next > pos) {
+			seg->what = NFS4_CONTENT_HOLE;
+			seg->offset = pos;
+			seg->length = ((uint64_t)next < end ? next : end) - pos;
+			pos += seg->length;
+			info->io_segcnt++;
+			continue;
+		}
+
+		next = lseek(fd, pos, SEEK_HOLE);
+		seg_end = next == -1 || (uint64_t)next > end ? end : next;
+
+		nb_read = pread(fd, (char *)buffer + packed, seg_end - pos,
+				pos);
+		if (nb_read == -1)
+			return errno;
+
+		if (nb_read == 0)
+			/* Truncated under us */
+			break;
+
+		seg->what = NFS4_CONTENT_DATA;
+		seg->offset = pos;
+		seg->length = nb_read;
+		packed += nb_read;
+		pos += nb_read;
+		info->io_segcnt++;
+	}
+
+	*read_amount = pos > offset ? pos - offset : 0;
+	*end_of_file = pos >= (uint64_t)st.st_size;
+
+	return 0;
+}
+
 /**
  * @brief Read data from a file
  *
@@ -990,6 +1136,8 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 			bool *end_of_file,
 			struct io_info *info)
 {
+	struct vfs_ff_export *ff =
+		EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->ff;
 	int my_fd = -1;
 	ssize_t nb_read;
 	fsal_status_t status;
@@ -997,8 +1145,10 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 	bool has_lock = false;
 	bool closefd = false;
 
-	if (info != NULL) {
-		/* Currently we don't support READ_PLUS */
+	if (info != NULL && (info->io_segs == NULL || ff != NULL)) {
+		/* Only READ_PLUS as segments is supported, and the holes
+		 * of a flexible file are on its data servers.
+		 */
 		return fsalstat(ERR_FSAL_NOTSUPP, 0);
 	}
 
@@ -1016,6 +1166,25 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
+	if (info != NULL) {
+		retval = vfs_read_plus_fd(my_fd, offset, buffer_size, buffer,
+					  read_amount, end_of_file, info);
+		if (retval != 0)
+			status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
+	if (ff != NULL) {
+		struct iovec iov = { buffer, buffer_size };
+
+		retval = vfs_ff_readv(ff, OBJ_VFS_FROM_FSAL(obj_hdl), my_fd,
+				      offset, &iov, 1, read_amount,
+				      end_of_file);
+		if (retval != 0)
+			status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
 	nb_read = pread(my_fd, buffer, buffer_size, offset);
 
 	if (offset == -1 || nb_read == -1) {
@@ -1028,21 +1197,88 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 
 	*end_of_file = (nb_read == 0);
 
-#if 0
-	/** @todo
-	 *
-	 * Is this all we really need to do to support READ_PLUS? Will anyone
-	 * ever get upset that we don't return holes, even for blocks of all
-	 * zeroes?
-	 *
-	 */
-	if (info != NULL) {
-		info->io_content.what = NFS4_CONTENT_DATA;
-		info->io_content.data.d_offset = offset + nb_read;
-		info->io_content.data.d_data.data_len = nb_read;
-		info->io_content.data.d_data.data_val = buffer;
+ out:
+
+	if (closefd)
+		close(my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
+/**
+ * @brief Read data from a file into a list of buffers
+ *
+ * Same as vfs_read2 but fills the caller's buffers with a single
+ * preadv so the protocol layer never needs one contiguous buffer.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position from which to read
+ * @param[in,out] iov            Buffers to which data are to be copied
+ * @param[in]     iovcnt         Number of entries in iov
+ * @param[out]    read_amount    Amount of data read
+ * @param[out]    end_of_file    true if the end of file has been reached
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_readv2(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct state_t *state,
+			 uint64_t offset,
+			 struct iovec *iov,
+			 int iovcnt,
+			 size_t *read_amount,
+			 bool *end_of_file)
+{
+	struct vfs_ff_export *ff =
+		EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->ff;
+	int my_fd = -1;
+	ssize_t nb_read;
+	fsal_status_t status;
+	int retval = 0;
+	bool has_lock = false;
+	bool closefd = false;
+
+	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 obj_hdl->fsal->name, obj_hdl->fs->fsal->name);
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+	}
+
+	/* Get a usable file descriptor */
+	status = find_fd(&my_fd, obj_hdl, bypass, state, FSAL_O_READ,
+			 &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	if (ff != NULL) {
+		retval = vfs_ff_readv(ff, OBJ_VFS_FROM_FSAL(obj_hdl), my_fd,
+				      offset, iov, iovcnt, read_amount,
+				      end_of_file);
+		if (retval != 0)
+			status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
+	nb_read = preadv(my_fd, iov, iovcnt, offset);
+
+	if (nb_read == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
 	}
-#endif
+
+	*read_amount = nb_read;
+
+	*end_of_file = (nb_read == 0);
 
  out:
 
@@ -1055,6 +1291,314 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief Get a private file descriptor for an I/O done later
+ *
+ * The descriptor found by find_fd is only guaranteed while the
+ * object lock is held, so duplicate it unless it is already a
+ * temporary one.
+ *
+ * @param[out] fd        The private descriptor
+ * @param[in]  obj_hdl   File on which to operate
+ * @param[in]  bypass    Bypass non-mandatory share reservations
+ * @param[in]  state     state_t to use for this operation
+ * @param[in]  openflags Mode the descriptor is needed for
+ *
+ * @return FSAL status.
+ */
+static fsal_status_t vfs_private_fd(int *fd,
+				  struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  struct state_t *state,
+				  fsal_openflags_t openflags)
+{
+	int my_fd = -1;
+	fsal_status_t status;
+	int retval = 0;
+	bool has_lock = false;
+	bool closefd = false;
+
+	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 obj_hdl->fsal->name, obj_hdl->fs->fsal->name);
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+	}
+
+	status = find_fd(&my_fd, obj_hdl, bypass, state, openflags,
+			 &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	if (closefd) {
+		*fd = my_fd;
+	} else {
+		*fd = dup(my_fd);
+
+		if (*fd == -1) {
+			retval = errno;
+			status = fsalstat(posix2fsal_error(retval), retval);
+		}
+	}
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
+#ifdef USE_IO_URING
+/**
+ * @brief Get a file descriptor for an asynchronous I/O
+ *
+ * The descriptor of the share reservation is used as is, its count
+ * of I/O in flight keeps it open until vfs_async_fd_release.  A
+ * temporary descriptor is handed over instead, and closed then.
+ *
+ * @param[out] fd        The descriptor to do the I/O with
+ * @param[out] io_fd     The vfs_fd holding fd, NULL if it is temporary
+ * @param[in]  obj_hdl   File on which to operate
+ * @param[in]  bypass    Bypass non-mandatory share reservations
+ * @param[in]  state     state_t to use for this operation
+ * @param[in]  openflags Mode the descriptor is needed for
+ *
+ * @return FSAL status.
+ */
+static fsal_status_t vfs_async_fd(int *fd, struct vfs_fd **io_fd,
+				  struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  struct state_t *state,
+				  fsal_openflags_t openflags)
+{
+	struct vfs_fsal_obj_handle *myself;
+	struct vfs_fd temp_fd = {0, -1}, *out_fd = &temp_fd;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool closefd = false;
+
+	*io_fd = NULL;
+
+	if (obj_hdl->type != REGULAR_FILE)
+		return vfs_private_fd(fd, obj_hdl, bypass, state, openflags);
+
+	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 obj_hdl->fsal->name, obj_hdl->fs->fsal->name);
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+	}
+
+	myself = container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
+
+	status = fsal_find_fd((struct fsal_fd **)&out_fd, obj_hdl,
+			      (struct fsal_fd *)&myself->u.file.fd,
+			      &myself->u.file.share,
+			      bypass, state, openflags,
+			      vfs_open_func, vfs_close_func,
+			      &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	*fd = out_fd->fd;
+
+	if (!closefd) {
+		/* The object lock or the state keeps it open until here */
+		atomic_inc_int32_t(&out_fd->io_work);
+		*io_fd = out_fd;
+	}
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+#endif
+
+/**
+ * @brief Get a descriptor to read a range of a file from
+ *
+ * The data is left in the file, for the caller to read straight
+ * where it wants it.  Files of a flexible file layout export are read
+ * through their data servers with readv2 instead.
+ *
+ * @param[in]  obj_hdl      File on which to operate
+ * @param[in]  bypass       If state doesn't indicate a share reservation,
+ *                          bypass any deny read
+ * @param[in]  state        state_t to use for this operation
+ * @param[in]  offset       Position from which to read
+ * @param[in]  size         Amount of data to read
+ * @param[out] fd           Private descriptor, -1 if nothing to read
+ * @param[out] read_amount  Amount of data that can be read from fd
+ * @param[out] end_of_file  true if the range reaches the end of file
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_read_fd(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct state_t *state,
+			  uint64_t offset,
+			  size_t size,
+			  int *fd,
+			  size_t *read_amount,
+			  bool *end_of_file)
+{
+	struct stat st;
+	fsal_status_t status;
+	int retval;
+
+	if (EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->ff != NULL)
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+
+	status = vfs_private_fd(fd, obj_hdl, bypass, state, FSAL_O_READ);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	if (fstat(*fd, &st) != 0) {
+		retval = errno;
+		close(*fd);
+		*fd = -1;
+		return fsalstat(posix2fsal_error(retval), retval);
+	}
+
+	if (offset < (uint64_t) st.st_size) {
+		*read_amount = st.st_size - offset;
+		if (*read_amount > size)
+			*read_amount = size;
+	} else {
+		*read_amount = 0;
+		close(*fd);
+		*fd = -1;
+	}
+
+	*end_of_file = offset + *read_amount >= (uint64_t) st.st_size;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+#ifdef USE_IO_URING
+/**
+ * @brief Submit an asynchronous read
+ *
+ * Queued on the io_uring engine when it is running, otherwise, or
+ * when the ring is full, done synchronously.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in,out] io_arg         The I/O description and results
+ * @param[in]     done_cb        Callback to invoke on completion
+ * @param[in]     caller_arg     Opaque argument for done_cb
+ */
+void vfs_read2_async(struct fsal_obj_handle *obj_hdl,
+		     bool bypass,
+		     struct fsal_io_arg *io_arg,
+		     fsal_async_cb done_cb,
+		     void *caller_arg)
+{
+	fsal_status_t status;
+	struct vfs_fd *io_fd;
+	int fd;
+
+	/* Data of a flexible file is on its data servers, not local */
+	if (!vfs_uring_enabled() ||
+	    EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->ff != NULL)
+		goto sync;
+
+	status = vfs_async_fd(&fd, &io_fd, obj_hdl, bypass, io_arg->state,
+			      FSAL_O_READ);
+
+	if (FSAL_IS_ERROR(status)) {
+		done_cb(obj_hdl, status, io_arg, caller_arg);
+		return;
+	}
+
+	if (vfs_uring_submit(obj_hdl, fd, io_fd, false, io_arg,
+			     done_cb, caller_arg))
+		return;
+
+	/* The ring is full, don't fail the read for that */
+	vfs_async_fd_release(fd, io_fd);
+
+sync:
+	status = vfs_readv2(obj_hdl, bypass, io_arg->state,
+			    io_arg->offset, io_arg->iov,
+			    io_arg->iovcnt, &io_arg->io_amount,
+			    &io_arg->end_of_file);
+	done_cb(obj_hdl, status, io_arg, caller_arg);
+}
+
+/**
+ * @brief Submit an asynchronous write
+ *
+ * Queued on the io_uring engine when it is running, otherwise, or
+ * when the ring is full, done synchronously.  A stable write is
+ * followed by an fsync linked to it on the ring.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any non-mandatory deny write
+ * @param[in,out] io_arg         The I/O description and results
+ * @param[in]     done_cb        Callback to invoke on completion
+ * @param[in]     caller_arg     Opaque argument for done_cb
+ */
+void vfs_write2_async(struct fsal_obj_handle *obj_hdl,
+		      bool bypass,
+		      struct fsal_io_arg *io_arg,
+		      fsal_async_cb done_cb,
+		      void *caller_arg)
+{
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	struct vfs_fd *io_fd;
+	size_t nb_written;
+	int fd, i;
+
+	if (!vfs_uring_enabled() ||
+	    EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->ff != NULL)
+		goto sync;
+
+	status = vfs_async_fd(&fd, &io_fd, obj_hdl, bypass, io_arg->state,
+			      FSAL_O_WRITE);
+
+	if (FSAL_IS_ERROR(status)) {
+		done_cb(obj_hdl, status, io_arg, caller_arg);
+		return;
+	}
+
+	if (vfs_uring_submit(obj_hdl, fd, io_fd, true, io_arg,
+			     done_cb, caller_arg))
+		return;
+
+	/* The ring is full, don't fail the write for that */
+	vfs_async_fd_release(fd, io_fd);
+
+sync:
+	io_arg->io_amount = 0;
+
+	for (i = 0; i < io_arg->iovcnt; i++) {
+		nb_written = 0;
+		status = vfs_write2(obj_hdl, bypass, io_arg->state,
+				    io_arg->offset + io_arg->io_amount,
+				    io_arg->iov[i].iov_len,
+				    io_arg->iov[i].iov_base,
+				    &nb_written, &io_arg->fsal_stable,
+				    NULL);
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		io_arg->io_amount += nb_written;
+
+		if (nb_written < io_arg->iov[i].iov_len)
+			break;
+	}
+
+	done_cb(obj_hdl, status, io_arg, caller_arg);
+}
+#endif
+
 /**
  * @brief Write data to a file
  *
@@ -1090,6 +1634,8 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 			 bool *fsal_stable,
 			 struct io_info *info)
 {
+	struct vfs_ff_export *ff =
+		EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->ff;
 	ssize_t nb_written;
 	fsal_status_t status;
 	int retval = 0;
@@ -1120,6 +1666,17 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 
+	if (ff != NULL) {
+		/* Data servers write FILE_SYNC */
+		retval = vfs_ff_write(ff, OBJ_VFS_FROM_FSAL(obj_hdl), my_fd,
+				      offset, buffer_size, buffer,
+				      wrote_amount);
+		if (retval != 0)
+			status = fsalstat(posix2fsal_error(retval), retval);
+		*fsal_stable = true;
+		goto out;
+	}
+
 	fsal_set_credentials(op_ctx->creds);
 
 	nb_written = pwrite(my_fd, buffer, buffer_size, offset);
@@ -1138,6 +1695,8 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 			retval = errno;
 			status = fsalstat(posix2fsal_error(retval), retval);
 		}
+	} else if (nb_written > 0) {
+		vfs_note_unstable(obj_hdl);
 	}
 
  out:
@@ -1152,6 +1711,292 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/** Bounce buffer of a copy the kernel can't do */
+#define VFS_COPY_CHUNK (1024 * 1024)
+
+/**
+ * @brief One end of a copy
+ */
+struct vfs_copy_fd {
+	int fd;
+	bool has_lock;
+	bool closefd;
+};
+
+static void vfs_copy_put_fd(struct fsal_obj_handle *obj_hdl,
+			    struct vfs_copy_fd *cfd)
+{
+	if (cfd->closefd)
+		close(cfd->fd);
+
+	if (cfd->has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+}
+
+/**
+ * @brief Get usable file descriptors for both ends of a copy
+ *
+ * Both objects are held in address order, so copies running in
+ * opposite directions can't deadlock.
+ */
+static fsal_status_t vfs_copy_get_fds(struct fsal_obj_handle *src_hdl,
+				      struct state_t *src_state,
+				      struct vfs_copy_fd *src,
+				      struct fsal_obj_handle *dst_hdl,
+				      struct state_t *dst_state,
+				      struct vfs_copy_fd *dst)
+{
+	fsal_status_t status;
+
+	memset(src, 0, sizeof(*src));
+	memset(dst, 0, sizeof(*dst));
+	src->fd = dst->fd = -1;
+
+	if (src_hdl->fsal != src_hdl->fs->fsal ||
+	    dst_hdl->fsal != dst_hdl->fs->fsal)
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+
+	if (src_hdl == dst_hdl) {
+		status = find_fd(&dst->fd, dst_hdl, false,
+				 dst_state != NULL ? dst_state : src_state,
+				 FSAL_O_RDWR, &dst->has_lock, &dst->closefd,
+				 false);
+		src->fd = dst->fd;
+		return status;
+	}
+
+	if (src_hdl < dst_hdl) {
+		status = find_fd(&src->fd, src_hdl, false, src_state,
+				 FSAL_O_READ, &src->has_lock, &src->closefd,
+				 false);
+		if (FSAL_IS_ERROR(status))
+			return status;
+
+		status = find_fd(&dst->fd, dst_hdl, false, dst_state,
+				 FSAL_O_WRITE, &dst->has_lock, &dst->closefd,
+				 false);
+		if (FSAL_IS_ERROR(status))
+			vfs_copy_put_fd(src_hdl, src);
+	} else {
+		status = find_fd(&dst->fd, dst_hdl, false, dst_state,
+				 FSAL_O_WRITE, &dst->has_lock, &dst->closefd,
+				 false);
+		if (FSAL_IS_ERROR(status))
+			return status;
+
+		status = find_fd(&src->fd, src_hdl, false, src_state,
+				 FSAL_O_READ, &src->has_lock, &src->closefd,
+				 false);
+		if (FSAL_IS_ERROR(status))
+			vfs_copy_put_fd(dst_hdl, dst);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Copy through a bounce buffer
+ *
+ * @return 0 or an errno.
+ */
+static int vfs_copy_rw(int src_fd, uint64_t src_offset,
+		       int dst_fd, uint64_t dst_offset,
+		       uint64_t count, uint64_t *copied)
+{
+	size_t chunk = count < VFS_COPY_CHUNK ? count : VFS_COPY_CHUNK;
+	char *buf = gsh_malloc(chunk);
+	ssize_t nread, nwritten;
+	int retval = 0;
+
+	while (*copied < count) {
+		if (count - *copied < chunk)
+			chunk = count - *copied;
+
+		nread = pread(src_fd, buf, chunk, src_offset + *copied);
+		if (nread <= 0) {
+			if (nread < 0)
+				retval = errno;
+			break;
+		}
+
+		nwritten = pwrite(dst_fd, buf, nread, dst_offset + *copied);
+		if (nwritten < 0) {
+			retval = errno;
+			break;
+		}
+
+		*copied += nwritten;
+		if (nwritten < nread)
+			break;
+	}
+
+	gsh_free(buf);
+	return retval;
+}
+
+/**
+ * @brief Copy a range of a file into another file
+ *
+ * The kernel copies with copy_file_range, which may share blocks or
+ * copy on the storage.  Where it can't, the copy goes through a
+ * buffer, still without any data going to the client.
+ *
+ * @param[in]  src_hdl     File to copy from
+ * @param[in]  src_state   state_t to read with
+ * @param[in]  src_offset  Where to start reading
+ * @param[in]  dst_hdl     File to copy to
+ * @param[in]  dst_state   state_t to write with
+ * @param[in]  dst_offset  Where to start writing
+ * @param[in]  count       Bytes to copy
+ * @param[out] copied      Bytes copied
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_copy2(struct fsal_obj_handle *src_hdl,
+			struct state_t *src_state,
+			uint64_t src_offset,
+			struct fsal_obj_handle *dst_hdl,
+			struct state_t *dst_state,
+			uint64_t dst_offset,
+			uint64_t count,
+			uint64_t *copied)
+{
+	struct vfs_copy_fd src, dst;
+	fsal_status_t status;
+	int retval = 0;
+
+	*copied = 0;
+
+	/* The local files of flexible files hold no data */
+	if (EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->ff != NULL)
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+
+	status = vfs_copy_get_fds(src_hdl, src_state, &src,
+				  dst_hdl, dst_state, &dst);
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		return status;
+	}
+
+	fsal_set_credentials(op_ctx->creds);
+
+#ifdef __NR_copy_file_range
+	while (*copied < count) {
+		loff_t soff = src_offset + *copied;
+		loff_t doff = dst_offset + *copied;
+		ssize_t n;
+
+		n = syscall(__NR_copy_file_range, src.fd, &soff, dst.fd, &doff,
+			    (size_t)(count - *copied), 0);
+		if (n < 0) {
+			retval = errno;
+			break;
+		}
+		if (n == 0)
+			break;
+		*copied += n;
+	}
+
+	/* Older kernels only copy within a file system */
+	if (retval == EXDEV || retval == ENOSYS || retval == EINVAL ||
+	    retval == EOPNOTSUPP)
+		retval = vfs_copy_rw(src.fd, src_offset, dst.fd, dst_offset,
+				     count, copied);
+#else
+	retval = vfs_copy_rw(src.fd, src_offset, dst.fd, dst_offset, count,
+			     copied);
+#endif
+
+	fsal_restore_ganesha_credentials();
+
+	/* What was copied stays copied */
+	if (retval != 0 && *copied == 0)
+		status = fsalstat(posix2fsal_error(retval), retval);
+
+	if (*copied != 0)
+		vfs_note_unstable(dst_hdl);
+
+	vfs_copy_put_fd(src_hdl, &src);
+	if (dst_hdl != src_hdl)
+		vfs_copy_put_fd(dst_hdl, &dst);
+
+	return status;
+}
+
+/**
+ * @brief Share a range of a file with another file
+ *
+ * Only file systems that share blocks, such as XFS or btrfs, can
+ * clone.
+ *
+ * @param[in] src_hdl     File to clone from
+ * @param[in] src_state   state_t to read with
+ * @param[in] src_offset  Start of the source range
+ * @param[in] dst_hdl     File to clone to
+ * @param[in] dst_state   state_t to write with
+ * @param[in] dst_offset  Start of the destination range
+ * @param[in] count       Length of the range, 0 for up to end of file
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_clone2(struct fsal_obj_handle *src_hdl,
+			 struct state_t *src_state,
+			 uint64_t src_offset,
+			 struct fsal_obj_handle *dst_hdl,
+			 struct state_t *dst_state,
+			 uint64_t dst_offset,
+			 uint64_t count)
+{
+#ifdef FICLONERANGE
+	struct vfs_copy_fd src, dst;
+	struct file_clone_range range;
+	fsal_status_t status;
+	int retval;
+
+	if (EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->ff != NULL)
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+
+	status = vfs_copy_get_fds(src_hdl, src_state, &src,
+				  dst_hdl, dst_state, &dst);
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		return status;
+	}
+
+	range.src_fd = src.fd;
+	range.src_offset = src_offset;
+	range.src_length = count;
+	range.dest_offset = dst_offset;
+
+	fsal_set_credentials(op_ctx->creds);
+
+	retval = ioctl(dst.fd, FICLONERANGE, &range);
+	if (retval == -1) {
+		retval = errno;
+		if (retval == EOPNOTSUPP || retval == ENOTTY)
+			status = fsalstat(ERR_FSAL_NOTSUPP, retval);
+		else
+			status = fsalstat(posix2fsal_error(retval), retval);
+	} else {
+		vfs_note_unstable(dst_hdl);
+	}
+
+	fsal_restore_ganesha_credentials();
+
+	vfs_copy_put_fd(src_hdl, &src);
+	if (dst_hdl != src_hdl)
+		vfs_copy_put_fd(dst_hdl, &dst);
+
+	return status;
+#else
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+#endif
+}
+
 /**
  * @brief Commit written data
  *
@@ -1161,10 +2006,17 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
  * FSAL must be able to perform this operation without being passed a specific
  * state.
  *
+ * Nothing is flushed if no unstable write reached the file since the
+ * last full commit.  COMMIT only asks for data and the metadata needed
+ * to read it back, so fdatasync is enough.  With commit_range_only set,
+ * a COMMIT of a range only writes out that range with sync_file_range,
+ * which is only stable on file systems that don't allocate on writeback
+ * and storage with a non-volatile write cache.
+ *
  * @param[in] obj_hdl          File on which to operate
  * @param[in] state            state_t to use for this operation
  * @param[in] offset           Start of range to commit
- * @param[in] len              Length of range to commit
+ * @param[in] len              Length of range to commit, 0 for all
  *
  * @return FSAL status.
  */
@@ -1179,9 +2031,24 @@ fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 	struct vfs_fd temp_fd = {0, -1}, *out_fd = &temp_fd;
 	bool has_lock = false;
 	bool closefd = false;
+	bool range_only;
+	uint64_t gen;
 
 	myself = container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
 
+	/* Writes counted after this are not covered by this commit */
+	gen = atomic_fetch_uint64_t(&myself->u.file.unstable_gen);
+
+	if (gen == atomic_fetch_uint64_t(&myself->u.file.committed_gen)) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "Nothing to commit on fileid %"PRIu64,
+			     obj_hdl->fileid);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	range_only = len != 0 &&
+		EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->commit_range_only;
+
 	/* Make sure file is open in appropriate mode.
 	 * Do not check share reservation.
 	 */
@@ -1196,11 +2063,23 @@ fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 
 		fsal_set_credentials(op_ctx->creds);
 
-		retval = fsync(out_fd->fd);
+		if (range_only)
+			retval = sync_file_range(out_fd->fd, offset, len,
+						 SYNC_FILE_RANGE_WAIT_BEFORE |
+						 SYNC_FILE_RANGE_WRITE |
+						 SYNC_FILE_RANGE_WAIT_AFTER);
+		else
+			retval = fdatasync(out_fd->fd);
 
 		if (retval == -1) {
 			retval = errno;
 			status = fsalstat(posix2fsal_error(retval), retval);
+		} else if (!range_only) {
+			/* A racing commit may store an older gen, that only
+			 * costs a needless flush later.
+			 */
+			atomic_store_uint64_t(&myself->u.file.committed_gen,
+					      gen);
 		}
 
 		fsal_restore_ganesha_credentials();
@@ -1267,12 +2146,20 @@ fsal_status_t vfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 		     lock_op, request_lock->lock_type, request_lock->lock_start,
 		     request_lock->lock_length);
 
-	if (lock_op == FSAL_OP_LOCKT) {
+	if (lock_op == FSAL_OP_CANCEL) {
+		/* Nothing is locked yet, only the waiter is left to stop */
+		vfs_lock_wait_disarm(container_of(obj_hdl,
+						  struct vfs_fsal_obj_handle,
+						  obj_handle),
+				     owner, request_lock);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	} else if (lock_op == FSAL_OP_LOCKT) {
 		fcntl_comm = F_OFD_GETLK;
 		/* We may end up using global fd, don't fail on a deny mode */
 		bypass = true;
 		openflags = FSAL_O_ANY;
-	} else if (lock_op == FSAL_OP_LOCK) {
+	} else if (lock_op == FSAL_OP_LOCK || lock_op == FSAL_OP_LOCKB) {
+		/* LOCKB doesn't block either, see vfs_lock_wait_arm */
 		fcntl_comm = F_OFD_SETLK;
 
 		if (request_lock->lock_type == FSAL_LOCK_R)
@@ -1343,6 +2230,13 @@ fsal_status_t vfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 			 "fcntl returned %d %s",
 			 retval, strerror(retval));
 
+		if (lock_op == FSAL_OP_LOCKB &&
+		    (retval == EAGAIN || retval == EACCES))
+			vfs_lock_wait_arm(container_of(obj_hdl,
+						       struct vfs_fsal_obj_handle,
+						       obj_handle),
+					  owner, request_lock);
+
 		if (conflicting_lock != NULL) {
 			/* Get the conflicting lock */
 			int rc = fcntl(my_fd, F_GETLK, &lock_args);
@@ -1365,6 +2259,14 @@ fsal_status_t vfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 		goto err;
 	}
 
+	if (lock_op != FSAL_OP_LOCKT) {
+		/* Granted or released, stop waiting for it */
+		vfs_lock_wait_disarm(container_of(obj_hdl,
+						  struct vfs_fsal_obj_handle,
+						  obj_handle),
+				     owner, request_lock);
+	}
+
 	/* F_UNLCK is returned then the tested operation would be possible. */
 	if (conflicting_lock != NULL) {
 		if (lock_op == FSAL_OP_LOCKT && lock_args.l_type != F_UNLCK) {
@@ -1392,14 +2294,195 @@ fsal_status_t vfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 }
 #endif
 
+#ifdef HAVE_STATX
+/**
+ * @brief Translate an attribute mask into a statx mask
+ *
+ * The type and link count are always asked for, they are cheap and
+ * callers depend on them.  A request for no POSIX attribute at all
+ * gets the basic stats.
+ *
+ * @param[in] mask  Requested attributes
+ *
+ * @return The statx mask.
+ */
+
+unsigned int vfs_attrmask2statx(attrmask_t mask)
+{
+	unsigned int want = STATX_TYPE | STATX_NLINK;
+
+	if ((mask & ATTRS_POSIX) == 0)
+		return STATX_BASIC_STATS;
+
+	if (mask & ATTR_MODE)
+		want |= STATX_MODE;
+	if (mask & ATTR_OWNER)
+		want |= STATX_UID;
+	if (mask & ATTR_GROUP)
+		want |= STATX_GID;
+	if (mask & ATTR_ATIME)
+		want |= STATX_ATIME;
+	if (mask & ATTR_MTIME)
+		want |= STATX_MTIME;
+	if (mask & ATTR_CTIME)
+		want |= STATX_CTIME;
+	if (mask & (ATTR_CHGTIME | ATTR_CHANGE))
+		want |= STATX_MTIME | STATX_CTIME;
+#ifdef STATX_CHANGE_COOKIE
+	if (mask & ATTR_CHANGE)
+		want |= STATX_CHANGE_COOKIE;
+#endif
+	if (mask & ATTR_FILEID)
+		want |= STATX_INO;
+	if (mask & ATTR_SIZE)
+		want |= STATX_SIZE;
+	if (mask & ATTR_SPACEUSED)
+		want |= STATX_BLOCKS;
+	if (mask & ATTR_CREATION)
+		want |= STATX_BTIME;
+
+	return want;
+}
+
+/**
+ * @brief Convert the result of statx
+ *
+ * Only the attributes the file system actually returned are marked
+ * valid.  The device numbers are always filled in by statx.  The
+ * change attribute is the inode's change cookie (i_version) when the
+ * kernel reports it, and derived from the times otherwise.
+ *
+ * @param[in]     stx    statx result
+ * @param[out]    stp    Same result as a struct stat, may be NULL
+ * @param[in,out] attrs  Attributes, may be NULL
+ */
+
+void vfs_statx2fsal(const struct statx *stx, struct stat *stp,
+		    struct attrlist *attrs)
+{
+	struct stat st;
+	attrmask_t valid = ATTR_FSID | ATTR_RAWDEV;
+
+	memset(&st, 0, sizeof(st));
+
+	st.st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st.st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	st.st_mode = stx->stx_mode;
+	st.st_nlink = stx->stx_nlink;
+	st.st_uid = stx->stx_uid;
+	st.st_gid = stx->stx_gid;
+	st.st_ino = stx->stx_ino;
+	st.st_size = stx->stx_size;
+	st.st_blksize = stx->stx_blksize;
+	st.st_blocks = stx->stx_blocks;
+	st.st_atim.tv_sec = stx->stx_atime.tv_sec;
+	st.st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	st.st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st.st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st.st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st.st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+
+	if (stp != NULL)
+		*stp = st;
+
+	if (attrs == NULL)
+		return;
+
+	if (stx->stx_mask & STATX_TYPE)
+		valid |= ATTR_TYPE;
+	if (stx->stx_mask & STATX_MODE)
+		valid |= ATTR_MODE;
+	if (stx->stx_mask & STATX_NLINK)
+		valid |= ATTR_NUMLINKS;
+	if (stx->stx_mask & STATX_UID)
+		valid |= ATTR_OWNER;
+	if (stx->stx_mask & STATX_GID)
+		valid |= ATTR_GROUP;
+	if (stx->stx_mask & STATX_ATIME)
+		valid |= ATTR_ATIME;
+	if (stx->stx_mask & STATX_MTIME)
+		valid |= ATTR_MTIME;
+	if (stx->stx_mask & STATX_CTIME)
+		valid |= ATTR_CTIME;
+	if ((stx->stx_mask & (STATX_MTIME | STATX_CTIME)) ==
+	    (STATX_MTIME | STATX_CTIME))
+		valid |= ATTR_CHGTIME | ATTR_CHANGE;
+	if (stx->stx_mask & STATX_INO)
+		valid |= ATTR_FILEID;
+	if (stx->stx_mask & STATX_SIZE)
+		valid |= ATTR_SIZE;
+	if (stx->stx_mask & STATX_BLOCKS)
+		valid |= ATTR_SPACEUSED;
+
+	attrs->valid_mask |= valid;
+	posix2fsal_attributes(&st, attrs);
+
+#ifdef STATX_CHANGE_COOKIE
+	/* i_version moves on every change, even two within one tick of
+	 * a coarse ctime, and nothing else moves it.
+	 */
+	if ((stx->stx_mask & STATX_CHANGE_COOKIE) &&
+	    (attrs->valid_mask & ATTR_CHANGE))
+		attrs->change = stx->stx_change_cookie;
+#endif
+
+	if ((stx->stx_mask & STATX_BTIME) &&
+	    (attrs->request_mask & ATTR_CREATION)) {
+		attrs->creation.tv_sec = stx->stx_btime.tv_sec;
+		attrs->creation.tv_nsec = stx->stx_btime.tv_nsec;
+		attrs->valid_mask |= ATTR_CREATION;
+	}
+}
+#endif
+
 fsal_status_t fetch_attrs(struct vfs_fsal_obj_handle *myself,
 			  int my_fd, struct attrlist *attrs)
 {
+#ifdef HAVE_STATX
+	struct vfs_fsal_export *exp = container_of(op_ctx->fsal_export,
+						   struct vfs_fsal_export,
+						   export);
+	struct statx stx;
+	unsigned int want = vfs_attrmask2statx(attrs->request_mask);
+	int flags = AT_SYMLINK_NOFOLLOW;
+#else
 	struct stat stat;
+#endif
 	int retval = 0;
 	fsal_status_t status = {0, 0};
 	const char *func = "unknown";
 
+#ifdef HAVE_STATX
+	/* Let a network file system answer from its own cache */
+	if (exp->statx_dont_sync)
+		flags |= AT_STATX_DONT_SYNC;
+
+	stx.stx_mask = 0;
+
+	/* statx works on O_PATH descriptors, so one call fits all */
+	switch (myself->obj_handle.type) {
+	case SOCKET_FILE:
+	case CHARACTER_FILE:
+	case BLOCK_FILE:
+		retval = statx(my_fd, myself->u.unopenable.name, flags, want,
+			       &stx);
+		func = "statx";
+		break;
+
+	case REGULAR_FILE:
+	case SYMBOLIC_LINK:
+	case FIFO_FILE:
+	case DIRECTORY:
+		retval = statx(my_fd, "", flags | AT_EMPTY_PATH, want, &stx);
+		func = "statx";
+		break;
+
+	case NO_FILE_TYPE:
+	case EXTENDED_ATTR:
+		/* Caught during open with EINVAL */
+		break;
+	}
+#else
 	/* Now stat the file as appropriate */
 	switch (myself->obj_handle.type) {
 	case SOCKET_FILE:
@@ -1427,6 +2510,7 @@ fsal_status_t fetch_attrs(struct vfs_fsal_obj_handle *myself,
 		/* Caught during open with EINVAL */
 		break;
 	}
+#endif
 
 	if (retval < 0) {
 		if (errno == ENOENT)
@@ -1445,7 +2529,11 @@ fsal_status_t fetch_attrs(struct vfs_fsal_obj_handle *myself,
 		return fsalstat(posix2fsal_error(retval), retval);
 	}
 
+#ifdef HAVE_STATX
+	vfs_statx2fsal(&stx, NULL, attrs);
+#else
 	posix2fsal_attributes_all(&stat, attrs);
+#endif
 	attrs->fsid = myself->obj_handle.fs->fsid;
 
 	if (myself->sub_ops && myself->sub_ops->getattrs) {
@@ -1463,6 +2551,66 @@ fsal_status_t fetch_attrs(struct vfs_fsal_obj_handle *myself,
 	return status;
 }
 
+/**
+ * @brief Fetch attributes through an O_PATH descriptor
+ *
+ * Stat works on an O_PATH descriptor, so there is no need to open
+ * directories, symlinks and fifos, nor regular files without a global
+ * fd, just to stat them.  The descriptor comes from the O_PATH cache.
+ * A cached descriptor may have outlived the unlink of its file, so a
+ * link count of 0 is checked again with a fresh one.
+ *
+ * @param[in]     myself  Object to query
+ * @param[in,out] attrs   Attributes
+ * @param[out]    status  Result
+ *
+ * @return true if done, false if the caller must do it the usual way.
+ */
+
+static bool vfs_getattr_pathfd(struct vfs_fsal_obj_handle *myself,
+			       struct attrlist *attrs,
+			       fsal_status_t *status)
+{
+	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+	int fd, retry;
+
+	/* Sub-FSALs may need a real descriptor */
+	if (myself->sub_ops != NULL && myself->sub_ops->getattrs != NULL)
+		return false;
+
+	switch (myself->obj_handle.type) {
+	case REGULAR_FILE:
+		/* Unlocked peek, any open fd will do as well */
+		if (myself->u.file.fd.openflags != FSAL_O_CLOSED)
+			return false;
+		break;
+	case DIRECTORY:
+	case SYMBOLIC_LINK:
+	case FIFO_FILE:
+		break;
+	default:
+		return false;
+	}
+
+	for (retry = 0; retry < 2; retry++) {
+		fd = vfs_pathfd_open(myself, &fsal_error);
+		if (fd < 0)
+			return false;
+
+		*status = fetch_attrs(myself, fd, attrs);
+		close(fd);
+
+		if (FSAL_IS_ERROR(*status) ||
+		    !(attrs->valid_mask & ATTR_NUMLINKS) ||
+		    attrs->numlinks != 0)
+			break;
+
+		vfs_pathfd_forget(myself);
+	}
+
+	return true;
+}
+
 /**
  * @brief Get attributes
  *
@@ -1496,6 +2644,9 @@ fsal_status_t vfs_getattr2(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 
+	if (vfs_getattr_pathfd(myself, attrs, &status))
+		goto out;
+
 	/* Get a usable file descriptor (don't need to bypass - FSAL_O_ANY
 	 * won't conflict with any share reservation).
 	 */
@@ -1686,6 +2837,24 @@ fsal_status_t vfs_setattr2(struct fsal_obj_handle *obj_hdl,
 				goto fileerr;
 			}
 		}
+
+		vfs_note_unstable(obj_hdl);
+
+		if (obj_hdl->type == REGULAR_FILE) {
+			struct vfs_ff_export *ff =
+				EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->ff;
+
+			if (ff != NULL) {
+				retval = vfs_ff_truncate(ff, myself,
+							 attrib_set->filesize);
+				if (retval != 0) {
+					status = fsalstat(
+						posix2fsal_error(retval),
+						retval);
+					goto out;
+				}
+			}
+		}
 	}
 
 	/** CHMOD **/
@@ -0,0 +1,1324 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file FSAL/FSAL_VFS/flexfiles.c
+ * @brief Flexible file layouts (RFC 8435) for the VFS FSAL
+ *
+ * An export with a FlexFiles block is a pNFS metadata server whose
+ * file data lives on a pool of plain NFSv3 data servers.  The local
+ * file only carries the metadata and the size; the contents are kept
+ * in data files, one per data server the file uses, in the directory
+ * each data server exports.  A data file is named after the fsid and
+ * fileid of the local file.
+ *
+ * A file is striped over Stripe_Width data servers in units of
+ * Stripe_Unit bytes and each stripe is kept on Mirrors data servers.
+ * Flexible file layouts only map offsets sparsely: a byte is at the
+ * same offset in the data file that holds it.  The Stripe_Width *
+ * Mirrors data servers of a file are consecutive in the pool,
+ * starting at one picked by hashing the fileid, so no placement has
+ * to be stored.
+ *
+ * Clients get the NFSv3 handles of the data files and go to the data
+ * servers directly, with AUTH_SYS as Data_Uid/Data_Gid, the owner of
+ * every data file.  The reads and writes that still reach the MDS are
+ * done against the data servers as well, as root, so the data
+ * servers must not squash the MDS.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "pnfs_utils.h"
+#include "gsh_rpc.h"
+#include "nfs23.h"
+#include "mount.h"
+#include "nfsv41.h"
+#include "config_parsing.h"
+#include "gsh_config.h"
+#include "abstract_atomic.h"
+#include "vfs_methods.h"
+
+/** Timeout of a call to a data server */
+static struct timeval ff_timeout = { 25, 0 };
+
+/** Seconds before connecting again to a data server that failed */
+#define FF_RETRY_DELAY 5
+
+/** Upper bound of the encoded size of one ff_data_server4 */
+#define FF_DS_BODY_SIZE (NFS4_DEVICEID4_SIZE + 4 + 16 + 4 + 4 + \
+			 NFS3_FHSIZE + 2 * (4 + 12))
+
+/**
+ * @brief A data server
+ */
+struct vfs_ff_ds {
+	struct glist_head link;		/*< Link in vfs_ff_export.ds_list */
+	sockaddr_t addr;		/*< Address of the data server */
+	uint16_t port;			/*< NFS port given to clients */
+	char *path;			/*< Directory holding the data files */
+	pthread_rwlock_t lock;		/*< Protects clnt and auth */
+	CLIENT *clnt;			/*< NFSv3 client, NULL if not connected */
+	AUTH *auth;			/*< Credentials of the MDS */
+	time_t retry_at;		/*< No connection attempt before this */
+	u_int root_len;			/*< Length of root_val, 0 until mounted */
+	char root_val[NFS3_FHSIZE];	/*< Handle of path */
+};
+
+/**
+ * @brief Flexible file layout of an export
+ */
+struct vfs_ff_export {
+	struct glist_head link;		/*< Link in ff_exports */
+	uint16_t export_id;		/*< Export the layout serves */
+	uint64_t stripe_unit;		/*< Bytes per stripe unit */
+	uint32_t stripe_width;		/*< Data servers per mirror */
+	uint32_t mirrors;		/*< Copies of each stripe */
+	uint32_t data_uid;		/*< Owner of the data files */
+	uint32_t data_gid;		/*< Group of the data files */
+	uint32_t rsize;			/*< Largest read sent to a data server */
+	uint32_t wsize;			/*< Largest write sent to a data server */
+	struct glist_head ds_list;	/*< Data servers, as configured */
+	uint32_t nds;			/*< Number of data servers */
+	struct vfs_ff_ds **ds;		/*< Data servers by device number */
+	pthread_mutex_t files_mtx;	/*< Serializes publishing vfs_ff_file */
+};
+
+/**
+ * @brief A data file
+ */
+struct vfs_ff_slot {
+	uint32_t ds;			/*< Device number of the data server */
+	u_int fh_len;			/*< Length of fh_val */
+	char fh_val[NFS3_FHSIZE];	/*< NFSv3 handle of the data file */
+};
+
+/**
+ * @brief The data files of a regular file
+ *
+ * Slot m * stripe_width + i holds stripe i of mirror m.
+ */
+struct vfs_ff_file {
+	uint32_t nslots;
+	struct vfs_ff_slot slot[];
+};
+
+/** Exports with a flexible file layout, for GETDEVICEINFO */
+static pthread_mutex_t ff_exports_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head ff_exports = GLIST_HEAD_INIT(ff_exports);
+
+/*
+ * Configuration
+ */
+
+static void ff_ds_disconnect(struct vfs_ff_ds *ds)
+{
+	if (ds->clnt != NULL) {
+		gsh_clnt_destroy(ds->clnt);
+		ds->clnt = NULL;
+	}
+	if (ds->auth != NULL) {
+		AUTH_DESTROY(ds->auth);
+		ds->auth = NULL;
+	}
+}
+
+static void ff_ds_free(struct vfs_ff_ds *ds)
+{
+	ff_ds_disconnect(ds);
+	gsh_free(ds->path);
+	PTHREAD_RWLOCK_destroy(&ds->lock);
+	gsh_free(ds);
+}
+
+static void ff_free(struct vfs_ff_export *ff)
+{
+	struct glist_head *glist, *glistn;
+
+	glist_for_each_safe(glist, glistn, &ff->ds_list) {
+		glist_del(glist);
+		ff_ds_free(glist_entry(glist, struct vfs_ff_ds, link));
+	}
+	gsh_free(ff->ds);
+	PTHREAD_MUTEX_destroy(&ff->files_mtx);
+	gsh_free(ff);
+}
+
+static void *ff_ds_init(void *link_mem, void *self_struct)
+{
+	struct vfs_ff_ds *ds;
+
+	assert(link_mem != NULL || self_struct != NULL);
+
+	if (link_mem == NULL) {
+		return self_struct;
+	} else if (self_struct == NULL) {
+		ds = gsh_calloc(1, sizeof(struct vfs_ff_ds));
+		glist_init(&ds->link);
+		PTHREAD_RWLOCK_init(&ds->lock, NULL);
+		return ds;
+	} else {
+		ff_ds_free(self_struct);
+		return NULL;
+	}
+}
+
+static int ff_ds_commit(void *node, void *link_mem, void *self_struct,
+			struct config_error_type *err_type)
+{
+	struct vfs_ff_export *ff =
+		container_of(link_mem, struct vfs_ff_export, ds_list);
+	struct vfs_ff_ds *ds = self_struct;
+
+	/* Device addresses are only encoded for IPv4 */
+	if (ds->addr.ss_family != AF_INET) {
+		config_proc_error(node, err_type,
+				  "Data server Address must be IPv4");
+		err_type->invalid = true;
+		return 1;
+	}
+
+	glist_add_tail(&ff->ds_list, &ds->link);
+	ff->nds++;
+	return 0;
+}
+
+static struct config_item ff_ds_params[] = {
+	CONF_MAND_IP_ADDR("Address", "0.0.0.0",
+			  vfs_ff_ds, addr),
+	CONF_ITEM_UI16("Port", 1, UINT16_MAX, NFS_PORT,
+		       vfs_ff_ds, port),
+	CONF_MAND_PATH("Export", 1, MAXPATHLEN, NULL,
+		       vfs_ff_ds, path),
+	CONFIG_EOL
+};
+
+struct config_item vfs_ff_params[] = {
+	CONF_ITEM_UI64("Stripe_Unit", 0, UINT32_MAX, 1048576,
+		       vfs_ff_export, stripe_unit),
+	CONF_ITEM_UI32("Stripe_Width", 1, 256, 1,
+		       vfs_ff_export, stripe_width),
+	CONF_ITEM_UI32("Mirrors", 1, 16, 1,
+		       vfs_ff_export, mirrors),
+	CONF_ITEM_UI32("Data_Uid", 0, UINT32_MAX, 0,
+		       vfs_ff_export, data_uid),
+	CONF_ITEM_UI32("Data_Gid", 0, UINT32_MAX, 0,
+		       vfs_ff_export, data_gid),
+	CONF_ITEM_UI32("Rsize", 4096, FSAL_MAXIOSIZE, 1048576,
+		       vfs_ff_export, rsize),
+	CONF_ITEM_UI32("Wsize", 4096, FSAL_MAXIOSIZE, 1048576,
+		       vfs_ff_export, wsize),
+	CONF_ITEM_BLOCK("DS", ff_ds_params,
+			ff_ds_init, ff_ds_commit,
+			vfs_ff_export, ds_list),
+	CONFIG_EOL
+};
+
+void *vfs_ff_conf_init(void *link_mem, void *self_struct)
+{
+	struct vfs_ff_export *ff;
+
+	assert(link_mem != NULL || self_struct != NULL);
+
+	if (link_mem == NULL) {
+		return self_struct;
+	} else if (self_struct == NULL) {
+		ff = gsh_calloc(1, sizeof(struct vfs_ff_export));
+		glist_init(&ff->link);
+		glist_init(&ff->ds_list);
+		PTHREAD_MUTEX_init(&ff->files_mtx, NULL);
+		return ff;
+	} else {
+		ff_free(self_struct);
+		return NULL;
+	}
+}
+
+int vfs_ff_conf_commit(void *node, void *link_mem, void *self_struct,
+		       struct config_error_type *err_type)
+{
+	struct vfs_ff_export *ff = self_struct;
+	struct glist_head *glist;
+	uint32_t i = 0;
+
+	if (ff->nds == 0) {
+		config_proc_error(node, err_type,
+				  "FlexFiles needs at least one DS block");
+		err_type->invalid = true;
+		return 1;
+	}
+
+	if (ff->stripe_width * ff->mirrors > ff->nds) {
+		config_proc_error(node, err_type,
+				  "Stripe_Width * Mirrors (%" PRIu32
+				  ") is more than the %" PRIu32
+				  " data servers",
+				  ff->stripe_width * ff->mirrors, ff->nds);
+		err_type->invalid = true;
+		return 1;
+	}
+
+	if (ff->stripe_width > 1 && ff->stripe_unit == 0) {
+		config_proc_error(node, err_type,
+				  "Striping over several data servers needs a Stripe_Unit");
+		err_type->invalid = true;
+		return 1;
+	}
+
+	ff->ds = gsh_calloc(ff->nds, sizeof(struct vfs_ff_ds *));
+	glist_for_each(glist, &ff->ds_list)
+		ff->ds[i++] = glist_entry(glist, struct vfs_ff_ds, link);
+
+	*(struct vfs_ff_export **)link_mem = ff;
+	return 0;
+}
+
+/*
+ * Data servers
+ */
+
+/**
+ * @brief Connect to a data server and mount its directory
+ *
+ * Must be called with the data server write locked.
+ *
+ * @return 0 or an errno.
+ */
+static int ff_ds_connect(struct vfs_ff_ds *ds)
+{
+	char host[SOCK_NAME_MAX];
+	dirpath path = ds->path;
+	mountres3 res;
+	fhandle3 *fh;
+	CLIENT *clnt;
+	enum clnt_stat rc;
+	int retval = 0;
+
+	sprint_sockip(&ds->addr, host, sizeof(host));
+
+	clnt = gsh_clnt_create(host, MOUNTPROG, MOUNT_V3, "tcp");
+	if (clnt == NULL) {
+		LogCrit(COMPONENT_FSAL,
+			"Cannot reach the MOUNT service of data server %s",
+			host);
+		return EHOSTUNREACH;
+	}
+
+	ds->auth = authunix_create_default();
+
+	memset(&res, 0, sizeof(res));
+	rc = clnt_call(clnt, ds->auth, MOUNTPROC3_MNT,
+		       (xdrproc_t) xdr_dirpath, &path,
+		       (xdrproc_t) xdr_mountres3, &res,
+		       ff_timeout);
+
+	if (rc != RPC_SUCCESS || res.fhs_status != MNT3_OK) {
+		LogCrit(COMPONENT_FSAL,
+			"Cannot mount %s:%s, rpc %d status %d",
+			host, ds->path, rc,
+			rc == RPC_SUCCESS ? (int) res.fhs_status : -1);
+		retval = EIO;
+	} else {
+		fh = &res.mountres3_u.mountinfo.fhandle;
+		if (fh->fhandle3_len > NFS3_FHSIZE) {
+			retval = EIO;
+		} else {
+			memcpy(ds->root_val, fh->fhandle3_val,
+			       fh->fhandle3_len);
+			ds->root_len = fh->fhandle3_len;
+		}
+	}
+
+	if (rc == RPC_SUCCESS)
+		xdr_free((xdrproc_t) xdr_mountres3, &res);
+	gsh_clnt_destroy(clnt);
+
+	if (retval == 0) {
+		ds->clnt = gsh_clnt_create(host, NFS_PROGRAM, NFS_V3, "tcp");
+		if (ds->clnt == NULL)
+			retval = EHOSTUNREACH;
+	}
+
+	if (retval != 0) {
+		ff_ds_disconnect(ds);
+		return retval;
+	}
+
+	LogInfo(COMPONENT_FSAL, "Connected to data server %s:%s",
+		host, ds->path);
+	return 0;
+}
+
+/**
+ * @brief Make sure the data server is connected
+ *
+ * A data server that could not be reached is not tried again for
+ * FF_RETRY_DELAY seconds, so I/O does not pile up behind connection
+ * timeouts.
+ *
+ * @return 0 or an errno.
+ */
+static int ff_ds_ready(struct vfs_ff_ds *ds)
+{
+	int retval = 0;
+
+	PTHREAD_RWLOCK_rdlock(&ds->lock);
+	if (ds->clnt != NULL) {
+		PTHREAD_RWLOCK_unlock(&ds->lock);
+		return 0;
+	}
+	PTHREAD_RWLOCK_unlock(&ds->lock);
+
+	PTHREAD_RWLOCK_wrlock(&ds->lock);
+	if (ds->clnt == NULL) {
+		if (time(NULL) < ds->retry_at)
+			retval = EIO;
+		else
+			retval = ff_ds_connect(ds);
+		if (retval != 0)
+			ds->retry_at = time(NULL) + FF_RETRY_DELAY;
+	}
+	PTHREAD_RWLOCK_unlock(&ds->lock);
+
+	return retval;
+}
+
+/**
+ * @brief Call an NFSv3 procedure on a data server
+ *
+ * A call that fails drops the connection; the next one makes a new
+ * one.
+ *
+ * @return 0 or an errno.
+ */
+static int ff_ds_call(struct vfs_ff_ds *ds, rpcproc_t proc,
+		      xdrproc_t xargs, void *args,
+		      xdrproc_t xres, void *res)
+{
+	CLIENT *clnt;
+	enum clnt_stat rc;
+	int retval;
+
+	retval = ff_ds_ready(ds);
+	if (retval != 0)
+		return retval;
+
+	PTHREAD_RWLOCK_rdlock(&ds->lock);
+	clnt = ds->clnt;
+	if (clnt == NULL) {
+		PTHREAD_RWLOCK_unlock(&ds->lock);
+		return EIO;
+	}
+	rc = clnt_call(clnt, ds->auth, proc, xargs, args, xres, res,
+		       ff_timeout);
+	PTHREAD_RWLOCK_unlock(&ds->lock);
+
+	if (rc == RPC_SUCCESS)
+		return 0;
+
+	LogEvent(COMPONENT_FSAL,
+		 "NFSv3 procedure %" PRIu32 " to data server %s failed: %d",
+		 (uint32_t) proc, ds->path, rc);
+
+	PTHREAD_RWLOCK_wrlock(&ds->lock);
+	if (ds->clnt == clnt)
+		ff_ds_disconnect(ds);
+	PTHREAD_RWLOCK_unlock(&ds->lock);
+
+	return EIO;
+}
+
+static int ff_nfs3_errno(nfsstat3 status)
+{
+	switch (status) {
+	case NFS3_OK:
+		return 0;
+	case NFS3ERR_PERM:
+		return EPERM;
+	case NFS3ERR_NOENT:
+		return ENOENT;
+	case NFS3ERR_ACCES:
+		return EACCES;
+	case NFS3ERR_EXIST:
+		return EEXIST;
+	case NFS3ERR_FBIG:
+		return EFBIG;
+	case NFS3ERR_NOSPC:
+		return ENOSPC;
+	case NFS3ERR_ROFS:
+		return EROFS;
+	case NFS3ERR_DQUOT:
+		return EDQUOT;
+	case NFS3ERR_JUKEBOX:
+		return EAGAIN;
+	default:
+		return EIO;
+	}
+}
+
+/*
+ * Data files
+ */
+
+static void ff_file_name(struct vfs_fsal_obj_handle *hdl, char *name,
+			 size_t size)
+{
+	snprintf(name, size, "%" PRIx64 ".%" PRIx64 ".%" PRIx64,
+		 hdl->obj_handle.fsid.major, hdl->obj_handle.fsid.minor,
+		 hdl->obj_handle.fileid);
+}
+
+/**
+ * @brief Create a data file, or get its handle if it exists
+ *
+ * @return 0 or an errno.
+ */
+static int ff_slot_create(struct vfs_ff_export *ff, struct vfs_ff_ds *ds,
+			  char *name, struct vfs_ff_slot *slot)
+{
+	CREATE3args args;
+	CREATE3res res;
+	LOOKUP3args largs;
+	LOOKUP3res lres;
+	sattr3 *sattr = &args.how.createhow3_u.obj_attributes;
+	nfs_fh3 *fh;
+	int retval;
+
+	retval = ff_ds_ready(ds);
+	if (retval != 0)
+		return retval;
+
+	memset(&args, 0, sizeof(args));
+	args.where.dir.data.data_len = ds->root_len;
+	args.where.dir.data.data_val = ds->root_val;
+	args.where.name = name;
+	args.how.mode = UNCHECKED;
+	sattr->mode.set_it = true;
+	sattr->mode.set_mode3_u.mode = 0600;
+	sattr->uid.set_it = true;
+	sattr->uid.set_uid3_u.uid = ff->data_uid;
+	sattr->gid.set_it = true;
+	sattr->gid.set_gid3_u.gid = ff->data_gid;
+
+	memset(&res, 0, sizeof(res));
+	retval = ff_ds_call(ds, NFSPROC3_CREATE,
+			    (xdrproc_t) xdr_CREATE3args, &args,
+			    (xdrproc_t) xdr_CREATE3res, &res);
+	if (retval != 0)
+		return retval;
+
+	retval = ff_nfs3_errno(res.status);
+
+	if (retval == 0 && res.CREATE3res_u.resok.obj.handle_follows) {
+		fh = &res.CREATE3res_u.resok.obj.post_op_fh3_u.handle;
+		if (fh->data.data_len > NFS3_FHSIZE) {
+			retval = EIO;
+		} else {
+			memcpy(slot->fh_val, fh->data.data_val,
+			       fh->data.data_len);
+			slot->fh_len = fh->data.data_len;
+		}
+	}
+
+	xdr_free((xdrproc_t) xdr_CREATE3res, &res);
+
+	if (retval != 0 || slot->fh_len != 0)
+		return retval;
+
+	/* The server did not return the handle, look it up */
+	memset(&largs, 0, sizeof(largs));
+	largs.what = args.where;
+
+	memset(&lres, 0, sizeof(lres));
+	retval = ff_ds_call(ds, NFSPROC3_LOOKUP,
+			    (xdrproc_t) xdr_LOOKUP3args, &largs,
+			    (xdrproc_t) xdr_LOOKUP3res, &lres);
+	if (retval != 0)
+		return retval;
+
+	retval = ff_nfs3_errno(lres.status);
+
+	if (retval == 0) {
+		fh = &lres.LOOKUP3res_u.resok.object;
+		if (fh->data.data_len > NFS3_FHSIZE) {
+			retval = EIO;
+		} else {
+			memcpy(slot->fh_val, fh->data.data_val,
+			       fh->data.data_len);
+			slot->fh_len = fh->data.data_len;
+		}
+	}
+
+	xdr_free((xdrproc_t) xdr_LOOKUP3res, &lres);
+
+	return retval;
+}
+
+/**
+ * @brief First data server of a file
+ */
+static uint32_t ff_first_ds(struct vfs_ff_export *ff,
+			    struct vfs_fsal_obj_handle *hdl)
+{
+	uint64_t hash = hdl->obj_handle.fileid * 0x9e3779b97f4a7c15ULL;
+
+	return (uint32_t) (hash >> 32) % ff->nds;
+}
+
+/**
+ * @brief Get the data files of a regular file
+ *
+ * They are created on first use and remembered in the handle.
+ *
+ * @param[in]  ff    Flexible file layout of the export
+ * @param[in]  hdl   The regular file
+ * @param[out] error errno on failure
+ *
+ * @return The data files, NULL on failure.
+ */
+static struct vfs_ff_file *ff_file_get(struct vfs_ff_export *ff,
+				       struct vfs_fsal_obj_handle *hdl,
+				       int *error)
+{
+	struct vfs_ff_file *file;
+	char name[64];
+	uint32_t first, i;
+
+	file = atomic_fetch_voidptr((void **)&hdl->u.file.ff);
+	if (file != NULL)
+		return file;
+
+	ff_file_name(hdl, name, sizeof(name));
+	first = ff_first_ds(ff, hdl);
+
+	file = gsh_calloc(1, sizeof(struct vfs_ff_file) +
+			     ff->stripe_width * ff->mirrors *
+			     sizeof(struct vfs_ff_slot));
+	file->nslots = ff->stripe_width * ff->mirrors;
+
+	for (i = 0; i < file->nslots; i++) {
+		file->slot[i].ds = (first + i) % ff->nds;
+		*error = ff_slot_create(ff, ff->ds[file->slot[i].ds], name,
+					&file->slot[i]);
+		if (*error != 0) {
+			LogMajor(COMPONENT_FSAL,
+				 "Cannot create data file %s on %s: %s",
+				 name, ff->ds[file->slot[i].ds]->path,
+				 strerror(*error));
+			gsh_free(file);
+			return NULL;
+		}
+	}
+
+	/* Someone else may have set it up meanwhile */
+	PTHREAD_MUTEX_lock(&ff->files_mtx);
+	if (hdl->u.file.ff == NULL) {
+		atomic_store_voidptr((void **)&hdl->u.file.ff, file);
+	} else {
+		gsh_free(file);
+		file = hdl->u.file.ff;
+	}
+	PTHREAD_MUTEX_unlock(&ff->files_mtx);
+
+	return file;
+}
+
+/** Stripe holding an offset */
+static inline uint32_t ff_stripe(struct vfs_ff_export *ff, uint64_t offset)
+{
+	if (ff->stripe_width == 1)
+		return 0;
+	return (offset / ff->stripe_unit) % ff->stripe_width;
+}
+
+/** Bytes from offset that are in the same stripe unit, at most len */
+static inline size_t ff_chunk(struct vfs_ff_export *ff, uint64_t offset,
+			      size_t len, uint32_t maxio)
+{
+	size_t n = MIN(len, maxio);
+
+	if (ff->stripe_unit != 0)
+		n = MIN(n, ff->stripe_unit - offset % ff->stripe_unit);
+	return n;
+}
+
+static int ff_slot_read(struct vfs_ff_ds *ds, struct vfs_ff_slot *slot,
+			uint64_t offset, size_t len, char *buf,
+			size_t *got, bool *eof)
+{
+	READ3args args;
+	READ3res res;
+	int retval;
+
+	args.file.data.data_len = slot->fh_len;
+	args.file.data.data_val = slot->fh_val;
+	args.offset = offset;
+	args.count = len;
+
+	memset(&res, 0, sizeof(res));
+	retval = ff_ds_call(ds, NFSPROC3_READ,
+			    (xdrproc_t) xdr_READ3args, &args,
+			    (xdrproc_t) xdr_READ3res, &res);
+	if (retval != 0)
+		return retval;
+
+	retval = ff_nfs3_errno(res.status);
+
+	if (retval == 0) {
+		*got = MIN(len, res.READ3res_u.resok.data.data_len);
+		*eof = res.READ3res_u.resok.eof;
+		memcpy(buf, res.READ3res_u.resok.data.data_val, *got);
+	}
+
+	xdr_free((xdrproc_t) xdr_READ3res, &res);
+
+	return retval;
+}
+
+static int ff_slot_write(struct vfs_ff_ds *ds, struct vfs_ff_slot *slot,
+			 uint64_t offset, size_t len, char *buf)
+{
+	WRITE3args args;
+	WRITE3res res;
+	int retval = 0;
+
+	args.file.data.data_len = slot->fh_len;
+	args.file.data.data_val = slot->fh_val;
+	args.stable = FILE_SYNC;
+
+	while (len > 0 && retval == 0) {
+		args.offset = offset;
+		args.count = len;
+		args.data.data_len = len;
+		args.data.data_val = buf;
+
+		memset(&res, 0, sizeof(res));
+		retval = ff_ds_call(ds, NFSPROC3_WRITE,
+				    (xdrproc_t) xdr_WRITE3args, &args,
+				    (xdrproc_t) xdr_WRITE3res, &res);
+		if (retval != 0)
+			return retval;
+
+		retval = ff_nfs3_errno(res.status);
+
+		if (retval == 0) {
+			if (res.WRITE3res_u.resok.count == 0 ||
+			    res.WRITE3res_u.resok.count > len) {
+				retval = EIO;
+			} else {
+				offset += res.WRITE3res_u.resok.count;
+				buf += res.WRITE3res_u.resok.count;
+				len -= res.WRITE3res_u.resok.count;
+			}
+		}
+
+		xdr_free((xdrproc_t) xdr_WRITE3res, &res);
+	}
+
+	return retval;
+}
+
+static int ff_slot_truncate(struct vfs_ff_ds *ds, struct vfs_ff_slot *slot,
+			    uint64_t size)
+{
+	SETATTR3args args;
+	SETATTR3res res;
+	int retval;
+
+	memset(&args, 0, sizeof(args));
+	args.object.data.data_len = slot->fh_len;
+	args.object.data.data_val = slot->fh_val;
+	args.new_attributes.size.set_it = true;
+	args.new_attributes.size.set_size3_u.size = size;
+
+	memset(&res, 0, sizeof(res));
+	retval = ff_ds_call(ds, NFSPROC3_SETATTR,
+			    (xdrproc_t) xdr_SETATTR3args, &args,
+			    (xdrproc_t) xdr_SETATTR3res, &res);
+	if (retval != 0)
+		return retval;
+
+	retval = ff_nfs3_errno(res.status);
+	xdr_free((xdrproc_t) xdr_SETATTR3res, &res);
+
+	return retval;
+}
+
+/**
+ * @brief Read a range of a file from its data servers
+ *
+ * Each stripe unit is read from the first mirror that answers.  What
+ * is past the end of a data file is a hole.
+ */
+static int ff_read(struct vfs_ff_export *ff, struct vfs_ff_file *file,
+		   uint64_t offset, size_t len, char *buf)
+{
+	struct vfs_ff_slot *slot;
+	size_t n, got;
+	uint32_t stripe, m;
+	bool eof;
+	int retval = 0;
+
+	while (len > 0) {
+		n = ff_chunk(ff, offset, len, ff->rsize);
+		stripe = ff_stripe(ff, offset);
+		got = 0;
+		eof = false;
+
+		for (m = 0; m < ff->mirrors; m++) {
+			slot = &file->slot[m * ff->stripe_width + stripe];
+			retval = ff_slot_read(ff->ds[slot->ds], slot, offset,
+					      n, buf, &got, &eof);
+			if (retval == 0)
+				break;
+		}
+
+		if (retval != 0)
+			return retval;
+
+		if (got < n && (eof || got == 0)) {
+			memset(buf + got, 0, n - got);
+			got = n;
+		}
+
+		offset += got;
+		buf += got;
+		len -= got;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Extend the local file to at least size
+ *
+ * The contents of the local file are not used, writing its last byte
+ * grows it without ever shrinking it, unlike a racing ftruncate.
+ */
+static int ff_extend(int fd, uint64_t size)
+{
+	struct stat st;
+
+	if (size == 0)
+		return 0;
+
+	if (fstat(fd, &st) != 0)
+		return errno;
+
+	if ((uint64_t) st.st_size >= size)
+		return 0;
+
+	if (pwrite(fd, "", 1, size - 1) != 1)
+		return errno;
+
+	return 0;
+}
+
+int vfs_ff_readv(struct vfs_ff_export *ff, struct vfs_fsal_obj_handle *hdl,
+		 int fd, uint64_t offset, struct iovec *iov, int iovcnt,
+		 size_t *read_amount, bool *end_of_file)
+{
+	struct vfs_ff_file *file;
+	struct stat st;
+	size_t len;
+	int i, retval = 0;
+
+	if (fstat(fd, &st) != 0)
+		return errno;
+
+	*read_amount = 0;
+
+	if (offset < (uint64_t) st.st_size) {
+		file = ff_file_get(ff, hdl, &retval);
+		if (file == NULL)
+			return retval;
+
+		for (i = 0; i < iovcnt; i++) {
+			if (offset >= (uint64_t) st.st_size)
+				break;
+
+			len = MIN(iov[i].iov_len, st.st_size - offset);
+			retval = ff_read(ff, file, offset, len,
+					 iov[i].iov_base);
+			if (retval != 0)
+				return retval;
+
+			offset += len;
+			*read_amount += len;
+		}
+	}
+
+	*end_of_file = offset >= (uint64_t) st.st_size;
+	return 0;
+}
+
+int vfs_ff_write(struct vfs_ff_export *ff, struct vfs_fsal_obj_handle *hdl,
+		 int fd, uint64_t offset, size_t buffer_size, void *buffer,
+		 size_t *wrote_amount)
+{
+	struct vfs_ff_file *file;
+	struct vfs_ff_slot *slot;
+	char *buf = buffer;
+	uint64_t pos = offset;
+	size_t left = buffer_size, n;
+	uint32_t stripe, m;
+	int retval = 0;
+
+	file = ff_file_get(ff, hdl, &retval);
+	if (file == NULL)
+		return retval;
+
+	while (left > 0) {
+		n = ff_chunk(ff, pos, left, ff->wsize);
+		stripe = ff_stripe(ff, pos);
+
+		for (m = 0; m < ff->mirrors; m++) {
+			slot = &file->slot[m * ff->stripe_width + stripe];
+			retval = ff_slot_write(ff->ds[slot->ds], slot, pos, n,
+					       buf);
+			if (retval != 0)
+				return retval;
+		}
+
+		pos += n;
+		buf += n;
+		left -= n;
+	}
+
+	retval = ff_extend(fd, offset + buffer_size);
+	if (retval != 0)
+		return retval;
+
+	*wrote_amount = buffer_size;
+	return 0;
+}
+
+int vfs_ff_truncate(struct vfs_ff_export *ff, struct vfs_fsal_obj_handle *hdl,
+		    uint64_t size)
+{
+	struct vfs_ff_file *file;
+	uint32_t i;
+	int retval = 0;
+
+	file = ff_file_get(ff, hdl, &retval);
+	if (file == NULL)
+		return retval;
+
+	/* Mapping is sparse, every data file has the size of the file */
+	for (i = 0; i < file->nslots; i++) {
+		retval = ff_slot_truncate(ff->ds[file->slot[i].ds],
+					  &file->slot[i], size);
+		if (retval != 0)
+			return retval;
+	}
+
+	return 0;
+}
+
+void vfs_ff_remove(struct vfs_ff_export *ff, struct vfs_fsal_obj_handle *hdl)
+{
+	REMOVE3args args;
+	REMOVE3res res;
+	struct vfs_ff_ds *ds;
+	char name[64];
+	uint32_t first, i;
+	int retval;
+
+	ff_file_name(hdl, name, sizeof(name));
+	first = ff_first_ds(ff, hdl);
+
+	for (i = 0; i < ff->stripe_width * ff->mirrors; i++) {
+		ds = ff->ds[(first + i) % ff->nds];
+
+		retval = ff_ds_ready(ds);
+		if (retval == 0) {
+			memset(&args, 0, sizeof(args));
+			args.object.dir.data.data_len = ds->root_len;
+			args.object.dir.data.data_val = ds->root_val;
+			args.object.name = name;
+
+			memset(&res, 0, sizeof(res));
+			retval = ff_ds_call(ds, NFSPROC3_REMOVE,
+					    (xdrproc_t) xdr_REMOVE3args, &args,
+					    (xdrproc_t) xdr_REMOVE3res, &res);
+		}
+
+		if (retval == 0) {
+			retval = ff_nfs3_errno(res.status);
+			xdr_free((xdrproc_t) xdr_REMOVE3res, &res);
+		}
+
+		if (retval != 0 && retval != ENOENT)
+			LogMajor(COMPONENT_FSAL,
+				 "Cannot remove data file %s from %s: %s",
+				 name, ds->path, strerror(retval));
+	}
+}
+
+/*
+ * pNFS MDS
+ */
+
+static void fs_layouttypes(struct fsal_export *export_pub, int32_t *count,
+			   const layouttype4 **types)
+{
+	static const layouttype4 supported_layout_type = LAYOUT4_FLEX_FILES;
+
+	*types = &supported_layout_type;
+	*count = 1;
+}
+
+static uint32_t fs_layout_blocksize(struct fsal_export *export_pub)
+{
+	struct vfs_ff_export *ff = EXPORT_VFS_FROM_FSAL(export_pub)->ff;
+
+	return ff->stripe_unit != 0 ? ff->stripe_unit : ff->wsize;
+}
+
+static uint32_t fs_maximum_segments(struct fsal_export *export_pub)
+{
+	return 1;
+}
+
+static size_t fs_loc_body_size(struct fsal_export *export_pub)
+{
+	struct vfs_ff_export *ff = EXPORT_VFS_FROM_FSAL(export_pub)->ff;
+
+	return 8 + 4 + ff->mirrors * (4 + ff->stripe_width * FF_DS_BODY_SIZE);
+}
+
+static size_t fs_da_addr_size(struct fsal_module *fsal_hdl)
+{
+	return 0x100;
+}
+
+static nfsstat4 getdevicelist(struct fsal_export *export_pub, layouttype4 type,
+			      void *opaque,
+			      bool (*cb)(void *opaque, const uint64_t id),
+			      struct fsal_getdevicelist_res *res)
+{
+	res->eof = true;
+	return NFS4_OK;
+}
+
+/**
+ * @brief Describe a data server
+ *
+ * The device number is the position of the data server in the
+ * FlexFiles block of the export named by the deviceid.
+ */
+static nfsstat4 getdeviceinfo(struct fsal_module *fsal_hdl,
+			      XDR *da_addr_body, const layouttype4 type,
+			      const struct pnfs_deviceid *deviceid)
+{
+	struct vfs_ff_export *ff;
+	struct vfs_ff_ds *ds;
+	struct glist_head *glist;
+	fsal_multipath_member_t host;
+	ff_device_versions4 version;
+	uint32_t nversions = 1;
+	nfsstat4 nfs_status = NFS4ERR_NOENT;
+
+	if (type != LAYOUT4_FLEX_FILES) {
+		LogMajor(COMPONENT_PNFS, "Unsupported layout type: %x", type);
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+	}
+
+	PTHREAD_MUTEX_lock(&ff_exports_mtx);
+
+	glist_for_each(glist, &ff_exports) {
+		ff = glist_entry(glist, struct vfs_ff_export, link);
+
+		if (ff->export_id != deviceid->device_id2 ||
+		    deviceid->devid >= ff->nds)
+			continue;
+
+		ds = ff->ds[deviceid->devid];
+
+		memset(&host, 0, sizeof(host));
+		host.proto = 6;
+		host.addr = ntohl(((struct sockaddr_in *)&ds->addr)->
+							sin_addr.s_addr);
+		host.port = ds->port;
+
+		nfs_status = FSAL_encode_v4_multipath(da_addr_body, 1, &host);
+		if (nfs_status != NFS4_OK)
+			break;
+
+		version.ffdv_version = NFS_V3;
+		version.ffdv_minorversion = 0;
+		version.ffdv_rsize = ff->rsize;
+		version.ffdv_wsize = ff->wsize;
+		version.ffdv_tightly_coupled = false;
+
+		if (!inline_xdr_u_int32_t(da_addr_body, &nversions) ||
+		    !xdr_ff_device_versions4(da_addr_body, &version)) {
+			LogMajor(COMPONENT_PNFS,
+				 "Failed to encode data server versions");
+			nfs_status = NFS4ERR_SERVERFAULT;
+		}
+		break;
+	}
+
+	PTHREAD_MUTEX_unlock(&ff_exports_mtx);
+
+	return nfs_status;
+}
+
+/**
+ * @brief Grant a layout segment
+ *
+ * The layout covers what was asked for, with every data file of the
+ * file.  Data servers get the anonymous stateid, NFSv3 has no use for
+ * it.
+ */
+static nfsstat4 pnfs_layout_get(struct fsal_obj_handle *obj_pub,
+				struct req_op_context *req_ctx,
+				XDR *loc_body,
+				const struct fsal_layoutget_arg *arg,
+				struct fsal_layoutget_res *res)
+{
+	struct vfs_ff_export *ff =
+		EXPORT_VFS_FROM_FSAL(req_ctx->fsal_export)->ff;
+	struct vfs_fsal_obj_handle *hdl =
+		container_of(obj_pub, struct vfs_fsal_obj_handle, obj_handle);
+	struct pnfs_deviceid deviceid = DEVICE_ID_INIT_ZERO(FSAL_ID_VFS);
+	struct vfs_ff_file *file;
+	ff_layout4 layout;
+	ff_mirror4 *mirrors;
+	ff_data_server4 *servers;
+	nfs_fh4 *fhs;
+	char uid[16], gid[16];
+	nfsstat4 nfs_status = NFS4_OK;
+	uint32_t i;
+	int retval = 0;
+
+	if (arg->type != LAYOUT4_FLEX_FILES) {
+		LogMajor(COMPONENT_PNFS, "Unsupported layout type: %x",
+			 arg->type);
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+	}
+
+	file = ff_file_get(ff, hdl, &retval);
+	if (file == NULL)
+		return NFS4ERR_LAYOUTTRYLATER;
+
+	snprintf(uid, sizeof(uid), "%" PRIu32, ff->data_uid);
+	snprintf(gid, sizeof(gid), "%" PRIu32, ff->data_gid);
+
+	mirrors = gsh_calloc(ff->mirrors, sizeof(ff_mirror4));
+	servers = gsh_calloc(file->nslots, sizeof(ff_data_server4));
+	fhs = gsh_calloc(file->nslots, sizeof(nfs_fh4));
+
+	deviceid.device_id2 = ff->export_id;
+
+	for (i = 0; i < file->nslots; i++) {
+		deviceid.devid = file->slot[i].ds;
+		memcpy(servers[i].ffds_deviceid, &deviceid,
+		       NFS4_DEVICEID4_SIZE);
+		/* Prefer the first mirror */
+		servers[i].ffds_efficiency =
+			ff->mirrors - i / ff->stripe_width;
+		fhs[i].nfs_fh4_len = file->slot[i].fh_len;
+		fhs[i].nfs_fh4_val = file->slot[i].fh_val;
+		servers[i].ffds_fh_vers.ffds_fh_vers_len = 1;
+		servers[i].ffds_fh_vers.ffds_fh_vers_val = &fhs[i];
+		servers[i].ffds_user.utf8string_len = strlen(uid);
+		servers[i].ffds_user.utf8string_val = uid;
+		servers[i].ffds_group.utf8string_len = strlen(gid);
+		servers[i].ffds_group.utf8string_val = gid;
+	}
+
+	for (i = 0; i < ff->mirrors; i++) {
+		mirrors[i].ffm_data_servers.ffm_data_servers_len =
+			ff->stripe_width;
+		mirrors[i].ffm_data_servers.ffm_data_servers_val =
+			&servers[i * ff->stripe_width];
+	}
+
+	layout.ffl_stripe_unit = ff->stripe_unit;
+	layout.ffl_mirrors.ffl_mirrors_len = ff->mirrors;
+	layout.ffl_mirrors.ffl_mirrors_val = mirrors;
+
+	if (!xdr_ff_layout4(loc_body, &layout)) {
+		LogMajor(COMPONENT_PNFS, "Failed to encode ff_layout4.");
+		nfs_status = NFS4ERR_TOOSMALL;
+	}
+
+	gsh_free(fhs);
+	gsh_free(servers);
+	gsh_free(mirrors);
+
+	res->return_on_close = false;
+	res->last_segment = true;
+
+	return nfs_status;
+}
+
+static nfsstat4 pnfs_layout_return(struct fsal_obj_handle *obj_pub,
+				   struct req_op_context *req_ctx,
+				   XDR *lrf_body,
+				   const struct fsal_layoutreturn_arg *arg)
+{
+	if (arg->lo_type != LAYOUT4_FLEX_FILES) {
+		LogDebug(COMPONENT_PNFS, "Unsupported layout type: %x",
+			 arg->lo_type);
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+	}
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Commit a segment of a layout
+ *
+ * The data is already on the data servers, the local file takes the
+ * new size and modification time.
+ */
+static nfsstat4 pnfs_layout_commit(struct fsal_obj_handle *obj_pub,
+				   struct req_op_context *req_ctx,
+				   XDR *lou_body,
+				   const struct fsal_layoutcommit_arg *arg,
+				   struct fsal_layoutcommit_res *res)
+{
+	struct vfs_fsal_obj_handle *hdl =
+		container_of(obj_pub, struct vfs_fsal_obj_handle, obj_handle);
+	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+	struct timespec times[2];
+	struct stat st;
+	int fd, retval = 0;
+
+	if (arg->type != LAYOUT4_FLEX_FILES) {
+		LogMajor(COMPONENT_PNFS, "Unsupported layout type: %x",
+			 arg->type);
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+	}
+
+	fd = vfs_fsal_open(hdl, O_WRONLY, &fsal_error);
+	if (fd < 0)
+		return posix2nfs4_error(-fd);
+
+	if (fstat(fd, &st) != 0) {
+		retval = errno;
+		goto out;
+	}
+
+	if (arg->new_offset &&
+	    (uint64_t) st.st_size < arg->last_write + 1) {
+		retval = ff_extend(fd, arg->last_write + 1);
+		if (retval != 0)
+			goto out;
+		res->size_supplied = true;
+		res->new_size = arg->last_write + 1;
+	}
+
+	times[0].tv_sec = 0;
+	times[0].tv_nsec = UTIME_OMIT;
+	if (arg->time_changed &&
+	    arg->new_time.seconds > (uint64_t) st.st_mtime) {
+		times[1].tv_sec = arg->new_time.seconds;
+		times[1].tv_nsec = arg->new_time.nseconds;
+	} else {
+		times[1].tv_sec = 0;
+		times[1].tv_nsec = UTIME_NOW;
+	}
+
+	if (futimens(fd, times) != 0)
+		retval = errno;
+
+ out:
+	close(fd);
+
+	if (retval != 0) {
+		LogMajor(COMPONENT_PNFS, "Commit layout failed: %s",
+			 strerror(retval));
+		return posix2nfs4_error(retval);
+	}
+
+	res->commit_done = true;
+	return NFS4_OK;
+}
+
+void vfs_ff_export_ops_init(struct vfs_fsal_export *myself)
+{
+	struct export_ops *ops = &myself->export.exp_ops;
+
+	ops->getdevicelist = getdevicelist;
+	ops->fs_layouttypes = fs_layouttypes;
+	ops->fs_layout_blocksize = fs_layout_blocksize;
+	ops->fs_maximum_segments = fs_maximum_segments;
+	ops->fs_loc_body_size = fs_loc_body_size;
+
+	myself->export.fsal->m_ops.getdeviceinfo = getdeviceinfo;
+	myself->export.fsal->m_ops.fs_da_addr_size = fs_da_addr_size;
+}
+
+void vfs_ff_handle_ops_init(struct fsal_obj_ops *ops)
+{
+	ops->layoutget = pnfs_layout_get;
+	ops->layoutreturn = pnfs_layout_return;
+	ops->layoutcommit = pnfs_layout_commit;
+}
+
+void vfs_ff_init(struct vfs_fsal_export *myself)
+{
+	struct vfs_ff_export *ff = myself->ff;
+
+	ff->export_id = myself->export.export_id;
+
+	PTHREAD_MUTEX_lock(&ff_exports_mtx);
+	glist_add_tail(&ff_exports, &ff->link);
+	PTHREAD_MUTEX_unlock(&ff_exports_mtx);
+
+	LogInfo(COMPONENT_FSAL,
+		"Export %" PRIu16 " uses flexible file layouts over %"
+		PRIu32 " data servers, %" PRIu32 " wide, %" PRIu32
+		" mirrors",
+		ff->export_id, ff->nds, ff->stripe_width, ff->mirrors);
+}
+
+void vfs_ff_fini(struct vfs_fsal_export *myself)
+{
+	struct vfs_ff_export *ff = myself->ff;
+
+	if (ff == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&ff_exports_mtx);
+	if (!glist_null(&ff->link))
+		glist_del(&ff->link);
+	PTHREAD_MUTEX_unlock(&ff_exports_mtx);
+
+	ff_free(ff);
+	myself->ff = NULL;
+}
@@ -35,6 +35,7 @@
 #ifdef LINUX
 #include <sys/sysmacros.h> /* for makedev(3) */
 #endif
+#include <dirent.h>
 #include <libgen.h>		/* used for 'dirname' */
 #include <pthread.h>
 #include <string.h>
@@ -98,6 +99,9 @@ struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 	if (hdl->obj_handle.type == REGULAR_FILE) {
 		hdl->u.file.fd.fd = -1;	/* no open on this yet */
 		hdl->u.file.fd.openflags = FSAL_O_CLOSED;
+		/* An earlier handle may have left unstable data behind */
+		hdl->u.file.unstable_gen = 1;
+		hdl->u.file.committed_gen = 0;
 	} else if (hdl->obj_handle.type == DIRECTORY) {
 		hdl->u.directory.path = NULL;
 		hdl->u.directory.fs_location = NULL;
@@ -174,10 +178,30 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 	bool xfsal = false;
 	fsal_status_t status;
 	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+#ifdef HAVE_STATX
+	struct vfs_fsal_export *exp = container_of(op_ctx->fsal_export,
+						   struct vfs_fsal_export,
+						   export);
+	struct statx stx;
+	int flags = AT_SYMLINK_NOFOLLOW;
+	/* alloc_handle needs the inode and, for symlinks, the size */
+	unsigned int want = STATX_INO | STATX_SIZE |
+		vfs_attrmask2statx(attrs_out != NULL
+					? attrs_out->request_mask : 0);
+#endif
 
 	vfs_alloc_handle(fh);
 
+#ifdef HAVE_STATX
+	if (exp->statx_dont_sync)
+		flags |= AT_STATX_DONT_SYNC;
+
+	retval = statx(dirfd, path, flags, want, &stx);
+	if (retval == 0)
+		vfs_statx2fsal(&stx, &stat, NULL);
+#else
 	retval = fstatat(dirfd, path, &stat, AT_SYMLINK_NOFOLLOW);
+#endif
 
 	if (retval < 0) {
 		retval = errno;
@@ -267,7 +291,11 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 	}
 
 	if (attrs_out != NULL) {
+#ifdef HAVE_STATX
+		vfs_statx2fsal(&stx, NULL, attrs_out);
+#else
 		posix2fsal_attributes_all(&stat, attrs_out);
+#endif
 	}
 
 	/* if it is a directory and the sticky bit is set
@@ -381,6 +409,56 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief Look up a directory entry using prefetched attributes
+ *
+ * Non-directories whose attributes the sub-FSAL fetched in bulk are
+ * built straight from them; everything else goes through
+ * lookup_with_fd.  Directories are always looked up by name since
+ * they may be mount points or referrals.
+ */
+
+static fsal_status_t lookup_prefetched(struct vfs_fsal_obj_handle *parent_hdl,
+				       int dirfd,
+				       struct vfs_dirent_prefetch *pf,
+				       struct vfs_dirent *dentryp,
+				       struct fsal_obj_handle **handle,
+				       struct attrlist *attrs_out)
+{
+	struct vfs_fsal_obj_handle *hdl;
+	vfs_file_handle_t *fh = NULL;
+	struct stat stat;
+
+	vfs_alloc_handle(fh);
+
+#ifdef STATX_CHANGE_COOKIE
+	/* bulkstat has no change cookie, keep the change attribute the
+	 * same as getattrs would report it
+	 */
+	if (attrs_out != NULL && (attrs_out->request_mask & ATTR_CHANGE))
+		pf = NULL;
+#endif
+
+	if (pf == NULL ||
+	    vfs_prefetched_lookup(pf, dentryp->vd_ino, fh, &stat) < 0 ||
+	    S_ISDIR(stat.st_mode))
+		return lookup_with_fd(parent_hdl, dirfd, dentryp->vd_name,
+				      handle, attrs_out);
+
+	hdl = alloc_handle(dirfd, fh, parent_hdl->obj_handle.fs, &stat,
+			   parent_hdl->handle, dentryp->vd_name,
+			   op_ctx->fsal_export);
+
+	if (hdl == NULL)
+		return fsalstat(ERR_FSAL_NOMEM, ENOMEM);
+
+	if (attrs_out != NULL)
+		posix2fsal_attributes_all(&stat, attrs_out);
+
+	*handle = &hdl->obj_handle;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /* handle methods
  */
 
@@ -416,7 +494,7 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 		return fsalstat(ERR_FSAL_XDEV, EXDEV);
 	}
 
-	dirfd = vfs_fsal_open(parent_hdl, O_PATH | O_NOACCESS, &fsal_error);
+	dirfd = vfs_pathfd_open(parent_hdl, &fsal_error);
 
 	if (dirfd < 0) {
 		LogDebug(COMPONENT_FSAL, "Failed to open parent: %s",
@@ -1155,11 +1233,14 @@ static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(fsal_error, retval);
 }
 
-#define BUF_SIZE 1024
+/* Large enough for a few hundred entries per getdents64 call */
+#define BUF_SIZE (64 * 1024)
 /**
  * read_dirents
  * read the directory and call through the callback function for
- * each entry.
+ * each entry.  Each entry's handle and attributes come from a single
+ * lookup_with_fd on the open directory, so the callback need not
+ * look the name up again.
  * @param dir_hdl [IN] the directory to read
  * @param whence [IN] where to start (next)
  * @param dir_state [IN] pass thru of state to callback
@@ -1181,7 +1262,10 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	unsigned int bpos;
 	int nread;
 	struct vfs_dirent dentry, *dentryp = &dentry;
-	char buf[BUF_SIZE];
+	struct vfs_dirent_prefetch *pf;
+	uint64_t *inos;
+	int ninos;
+	char *buf;
 
 	if (whence != NULL)
 		seekloc = (off_t) *whence;
@@ -1210,16 +1294,31 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 		goto done;
 	}
 
+	buf = gsh_malloc(BUF_SIZE);
+	/* a dirent64 is at least 24 bytes */
+	inos = gsh_malloc(BUF_SIZE / 24 * sizeof(uint64_t));
+
 	do {
 		baseloc = seekloc;
 		nread = vfs_readents(dirfd, buf, BUF_SIZE, &seekloc);
 		if (nread < 0) {
 			retval = errno;
 			status = posix2fsal_status(retval);
-			goto done;
+			goto freebuf;
 		}
 		if (nread == 0)
 			break;
+
+		/* Let the sub-FSAL fetch the chunk's attributes in bulk */
+		ninos = 0;
+		for (bpos = 0; bpos < nread; bpos += dentryp->vd_reclen) {
+			if (to_vfs_dirent(buf, bpos, dentryp, baseloc)
+			    && dentryp->vd_type != DT_DIR
+			    && dentryp->vd_type != DT_UNKNOWN)
+				inos[ninos++] = dentryp->vd_ino;
+		}
+		pf = vfs_prefetch_dirents(dirfd, inos, ninos);
+
 		for (bpos = 0; bpos < nread;) {
 			struct fsal_obj_handle *hdl;
 			struct attrlist attrs;
@@ -1232,11 +1331,12 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 
 			fsal_prepare_attrs(&attrs, attrmask);
 
-			status = lookup_with_fd(myself, dirfd, dentryp->vd_name,
-					&hdl, &attrs);
+			status = lookup_prefetched(myself, dirfd, pf, dentryp,
+						   &hdl, &attrs);
 
 			if (FSAL_IS_ERROR(status)) {
-				goto done;
+				vfs_prefetch_release(pf);
+				goto freebuf;
 			}
 
 			/* callback to cache inode */
@@ -1246,15 +1346,22 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 			fsal_release_attrs(&attrs);
 
 			/* Read ahead not supported by this FSAL. */
-			if (cb_rc >= DIR_READAHEAD)
-				goto done;
+			if (cb_rc >= DIR_READAHEAD) {
+				vfs_prefetch_release(pf);
+				goto freebuf;
+			}
 
  skip:
 			bpos += dentryp->vd_reclen;
 		}
+
+		vfs_prefetch_release(pf);
 	} while (nread > 0);
 
 	*eof = true;
+ freebuf:
+	gsh_free(inos);
+	gsh_free(buf);
  done:
 	close(dirfd);
 
@@ -1512,6 +1619,20 @@ static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 			fsal_error = ERR_FSAL_STALE;
 		else
 			fsal_error = posix2fsal_error(retval);
+	} else {
+		struct vfs_ff_export *ff =
+			EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export)->ff;
+
+		/* Don't keep the inode around */
+		vfs_pathfd_forget(container_of(obj_hdl,
+					       struct vfs_fsal_obj_handle,
+					       obj_handle));
+
+		/* The last link of a flexible file takes its data along */
+		if (ff != NULL && S_ISREG(stat.st_mode) && stat.st_nlink == 1)
+			vfs_ff_remove(ff, container_of(obj_hdl,
+						       struct vfs_fsal_obj_handle,
+						       obj_handle));
 	}
 	fsal_restore_ganesha_credentials();
 
@@ -1598,6 +1719,8 @@ static void release(struct fsal_obj_handle *obj_hdl)
 
 	myself = container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
 
+	vfs_pathfd_forget(myself);
+
 	if (type == REGULAR_FILE) {
 		fsal_status_t st;
 
@@ -1627,6 +1750,7 @@ static void release(struct fsal_obj_handle *obj_hdl)
 
 		handle_to_key(obj_hdl, &key);
 		vfs_state_release(&key);
+		gsh_free(myself->u.file.ff);
 	} else if (type == DIRECTORY) {
 		if (myself->u.directory.path != NULL)
 			gsh_free(myself->u.directory.path);
@@ -1726,8 +1850,16 @@ void vfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->open2 = vfs_open2;
 	ops->reopen2 = vfs_reopen2;
 	ops->read2 = vfs_read2;
+	ops->readv2 = vfs_readv2;
+	ops->read_fd = vfs_read_fd;
+#ifdef USE_IO_URING
+	ops->read2_async = vfs_read2_async;
+	ops->write2_async = vfs_write2_async;
+#endif
 	ops->write2 = vfs_write2;
 	ops->commit2 = vfs_commit2;
+	ops->copy2 = vfs_copy2;
+	ops->clone2 = vfs_clone2;
 	ops->lock_op2 = vfs_lock_op2;
 	ops->setattr2 = vfs_setattr2;
 	ops->close2 = vfs_close2;
@@ -1966,8 +2098,9 @@ fsal_status_t vfs_create_handle(struct fsal_export *exp_hdl,
 
 	hdl = alloc_handle(fd, fh, fs, &obj_stat, NULL, "", exp_hdl);
 
+	/* The attributes are usually wanted next, keep the fd for that */
 	if (fd >= 0)
-		close(fd);
+		vfs_pathfd_insert(fs->private_data, fh, fd);
 
 	if (hdl == NULL) {
 		LogDebug(COMPONENT_FSAL,
@@ -131,3 +131,21 @@ int vfs_get_root_handle(struct vfs_filesystem *vfs_fs,
 	return vfs_re_index(vfs_fs, exp);
 }
 
+struct vfs_dirent_prefetch *vfs_prefetch_dirents(int dirfd,
+						 const uint64_t *inos,
+						 int count)
+{
+	/* No bulk attribute interface, entries are looked up one by one */
+	return NULL;
+}
+
+int vfs_prefetched_lookup(struct vfs_dirent_prefetch *pf, uint64_t ino,
+			  vfs_file_handle_t *fh, struct stat *st)
+{
+	errno = ENOENT;
+	return -1;
+}
+
+void vfs_prefetch_release(struct vfs_dirent_prefetch *pf)
+{
+}
@@ -76,6 +76,7 @@ static struct fsal_staticfsinfo_t default_posix_info = {
 	.maxread = FSAL_MAXIOSIZE,
 	.maxwrite = FSAL_MAXIOSIZE,
 	.link_supports_permission_checks = false,
+	.readv = true,
 };
 
 static struct config_item panfs_params[] = {
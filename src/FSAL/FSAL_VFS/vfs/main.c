@@ -40,6 +40,7 @@
 #include "fsal.h"
 #include "FSAL/fsal_init.h"
 #include "fsal_handle_syscalls.h"
+#include "../vfs_methods.h"
 
 /* VFS FSAL module private storage
  */
@@ -55,6 +56,10 @@ struct vfs_fsal_module {
 	struct fsal_module fsal;
 	struct fsal_staticfsinfo_t fs_info;
 	/* vfsfs_specific_initinfo_t specific_info;  placeholder */
+	uint32_t pathfd_cache_size;
+#ifdef USE_IO_URING
+	struct vfs_uring_params uring;
+#endif
 };
 
 const char myname[] = "VFS";
@@ -81,25 +86,38 @@ static struct fsal_staticfsinfo_t default_posix_info = {
 	.maxread = FSAL_MAXIOSIZE,
 	.maxwrite = FSAL_MAXIOSIZE,
 	.link_supports_permission_checks = false,
+	.readv = true,
 };
 
 static struct config_item vfs_params[] = {
 	CONF_ITEM_BOOL("link_support", true,
-		       fsal_staticfsinfo_t, link_support),
+		       vfs_fsal_module, fs_info.link_support),
 	CONF_ITEM_BOOL("symlink_support", true,
-		       fsal_staticfsinfo_t, symlink_support),
+		       vfs_fsal_module, fs_info.symlink_support),
 	CONF_ITEM_BOOL("cansettime", true,
-		       fsal_staticfsinfo_t, cansettime),
+		       vfs_fsal_module, fs_info.cansettime),
 	CONF_ITEM_UI64("maxread", 512, FSAL_MAXIOSIZE, FSAL_MAXIOSIZE,
-		       fsal_staticfsinfo_t, maxread),
+		       vfs_fsal_module, fs_info.maxread),
 	CONF_ITEM_UI64("maxwrite", 512, FSAL_MAXIOSIZE, FSAL_MAXIOSIZE,
-		       fsal_staticfsinfo_t, maxwrite),
+		       vfs_fsal_module, fs_info.maxwrite),
 	CONF_ITEM_MODE("umask", 0,
-		       fsal_staticfsinfo_t, umask),
+		       vfs_fsal_module, fs_info.umask),
 	CONF_ITEM_BOOL("auth_xdev_export", false,
-		       fsal_staticfsinfo_t, auth_exportpath_xdev),
+		       vfs_fsal_module, fs_info.auth_exportpath_xdev),
 	CONF_ITEM_MODE("xattr_access_rights", 0400,
-		       fsal_staticfsinfo_t, xattr_access_rights),
+		       vfs_fsal_module, fs_info.xattr_access_rights),
+	CONF_ITEM_UI32("pathfd_cache_size", 0, 1048576, 1024,
+		       vfs_fsal_module, pathfd_cache_size),
+#ifdef USE_IO_URING
+	CONF_ITEM_BOOL("io_uring", false,
+		       vfs_fsal_module, uring.enable),
+	CONF_ITEM_UI32("io_uring_rings", 0, 1024, 0,
+		       vfs_fsal_module, uring.rings),
+	CONF_ITEM_UI32("io_uring_depth", 1, 32768, 256,
+		       vfs_fsal_module, uring.depth),
+	CONF_ITEM_BOOL("io_uring_sq_poll", false,
+		       vfs_fsal_module, uring.sq_poll),
+#endif
 	CONFIG_EOL
 };
 
@@ -160,9 +178,10 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 
 		rc = fcntl(fd, F_OFD_GETLK, &lock);
 
-		if (rc == 0)
+		if (rc == 0) {
 			vfs_me->fs_info.lock_support = true;
-		else
+			vfs_me->fs_info.lock_avail_upcall = true;
+		} else
 			LogInfo(COMPONENT_FSAL, "Could not use OFD locks");
 
 		close(fd);
@@ -182,12 +201,18 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 
 	(void) load_config_from_parse(config_struct,
 				      &vfs_param,
-				      &vfs_me->fs_info,
+				      vfs_me,
 				      true,
 				      err_type);
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
 	display_fsinfo(&vfs_me->fs_info);
+	vfs_pathfd_init(vfs_me->pathfd_cache_size);
+#ifdef USE_IO_URING
+	if (vfs_uring_init(&vfs_me->uring) < 0)
+		LogWarn(COMPONENT_FSAL,
+			"io_uring engine unavailable, using synchronous I/O");
+#endif
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
 		     VFS_SUPPORTED_ATTRIBUTES);
@@ -253,6 +278,14 @@ MODULE_FINI void vfs_unload(void)
 {
 	int retval;
 
+#ifdef USE_IO_URING
+	vfs_uring_fini();
+#endif
+	vfs_pathfd_fini();
+#ifdef F_OFD_GETLK
+	vfs_lock_wait_fini(NULL);
+#endif
+
 	retval = unregister_fsal(&VFS.fsal);
 	if (retval != 0) {
 		fprintf(stderr, "VFS module failed to unregister");
@@ -55,6 +55,13 @@ static struct config_item export_params[] = {
 	CONF_ITEM_TOKEN("fsid_type", FSID_NO_TYPE,
 			fsid_types,
 			vfs_fsal_export, fsid_type),
+	CONF_ITEM_BOOL("statx_dont_sync", false,
+		       vfs_fsal_export, statx_dont_sync),
+	CONF_ITEM_BOOL("commit_range_only", false,
+		       vfs_fsal_export, commit_range_only),
+	CONF_ITEM_BLOCK("FlexFiles", vfs_ff_params,
+			vfs_ff_conf_init, vfs_ff_conf_commit,
+			vfs_fsal_export, ff),
 	CONFIG_EOL
 };
 
@@ -73,11 +80,14 @@ struct config_block *vfs_sub_export_param = &export_param_block;
 
 void vfs_sub_fini(struct vfs_fsal_export *myself)
 {
+	vfs_ff_fini(myself);
 }
 
 void vfs_sub_init_export_ops(struct vfs_fsal_export *myself,
 			      const char *export_path)
 {
+	if (myself->ff != NULL)
+		vfs_ff_export_ops_init(myself);
 }
 
 int vfs_sub_init_export(struct vfs_fsal_export *myself)
@@ -85,6 +95,8 @@ int vfs_sub_init_export(struct vfs_fsal_export *myself)
 #ifdef ENABLE_VFS_DEBUG_ACL
 	vfs_acl_init();
 #endif /* ENABLE_VFS_DEBUG_ACL */
+	if (myself->ff != NULL)
+		vfs_ff_init(myself);
 	return 0;
 }
 
@@ -114,5 +126,7 @@ int vfs_sub_init_handle(struct vfs_fsal_export *myself,
 		const char *path)
 {
 	hdl->sub_ops = &vfs_obj_subops;
+	if (myself->ff != NULL)
+		vfs_ff_handle_ops_init(&hdl->obj_handle.obj_ops);
 	return 0;
 }
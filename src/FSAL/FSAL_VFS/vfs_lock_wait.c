@@ -0,0 +1,344 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file vfs_lock_wait.c
+ * @brief Watch for the release of locks that blocked
+ *
+ * VFS can't grant a blocked lock on its own, SAL would have to poll for
+ * it every Blocked_Lock_Poller_Interval.  Instead, for each lock that
+ * would block, a thread waits for the same lock with F_OFD_SETLKW on a
+ * file descriptor of its own.  Once the kernel hands it over, the
+ * thread drops it and sends a lock_avail upcall, and SAL grants the
+ * blocked lock right away.  A waiter is stopped when its lock is
+ * granted, unlocked or cancelled, see vfs_lock_wait_disarm.
+ */
+
+#include "config.h"
+#include <fcntl.h>
+
+#ifdef F_OFD_GETLK
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "gsh_list.h"
+#include "fsal.h"
+#include "fsal_up.h"
+#include "fridgethr.h"
+#include "abstract_atomic.h"
+#include "vfs_methods.h"
+
+/** Most threads waiting at once, SAL polls for the others */
+#define VFS_LOCK_WAITERS_MAX 256
+
+struct vfs_lock_waiter {
+	struct glist_head list;
+	pthread_t thread;
+	struct fsal_export *exp;
+	void *owner;
+	fsal_lock_param_t lock;
+	int fd;
+	bool disarmed;		/*< no longer wanted, send no upcall */
+	vfs_file_handle_t fh;
+};
+
+static struct glist_head lock_waiters = GLIST_HEAD_INIT(lock_waiters);
+static pthread_mutex_t lock_waiters_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lock_waiters_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t lock_waiters_count;
+
+/**
+ * @brief Forget a waiter, called by its own thread
+ */
+static void vfs_lock_waiter_done(void *arg)
+{
+	struct vfs_lock_waiter *waiter = arg;
+
+	if (waiter->fd >= 0)
+		close(waiter->fd);
+
+	PTHREAD_MUTEX_lock(&lock_waiters_mtx);
+	glist_del(&waiter->list);
+	lock_waiters_count--;
+	pthread_cond_broadcast(&lock_waiters_cond);
+	PTHREAD_MUTEX_unlock(&lock_waiters_mtx);
+
+	gsh_free(waiter);
+}
+
+static void *vfs_lock_waiter_run(void *arg)
+{
+	struct vfs_lock_waiter *waiter = arg;
+	struct gsh_buffdesc key;
+	struct flock lock_args;
+	bool disarmed;
+	int rc;
+
+	SetNameFunction("vfs_lkwait");
+
+	memset(&lock_args, 0, sizeof(lock_args));
+	lock_args.l_type = waiter->lock.lock_type == FSAL_LOCK_W
+				? F_WRLCK : F_RDLCK;
+	lock_args.l_whence = SEEK_SET;
+	lock_args.l_start = waiter->lock.lock_start;
+	lock_args.l_len = waiter->lock.lock_length;
+
+	pthread_cleanup_push(vfs_lock_waiter_done, waiter);
+
+	/* Cancelled here when the export goes away */
+	do {
+		rc = fcntl(waiter->fd, F_OFD_SETLKW, &lock_args);
+	} while (rc == -1 && errno == EINTR);
+
+	(void) pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+	/* Closing drops the lock at once */
+	close(waiter->fd);
+	waiter->fd = -1;
+
+	PTHREAD_MUTEX_lock(&lock_waiters_mtx);
+	disarmed = waiter->disarmed;
+	PTHREAD_MUTEX_unlock(&lock_waiters_mtx);
+
+	if (disarmed) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "Lock %" PRIu64 "/%" PRIu64 " no longer waited for",
+			     waiter->lock.lock_start,
+			     waiter->lock.lock_length);
+	} else if (rc == 0) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "Lock %" PRIu64 "/%" PRIu64 " released",
+			     waiter->lock.lock_start,
+			     waiter->lock.lock_length);
+
+		key.addr = waiter->fh.handle_data;
+		key.len = waiter->fh.handle_len;
+
+		(void) up_async_lock_avail(general_fridge,
+					   waiter->exp->up_ops, &key,
+					   waiter->owner, &waiter->lock,
+					   NULL, NULL);
+	} else {
+		LogDebug(COMPONENT_FSAL, "F_OFD_SETLKW failed: %s",
+			 strerror(errno));
+	}
+
+	pthread_cleanup_pop(1);
+
+	return NULL;
+}
+
+void vfs_lock_wait_arm(struct vfs_fsal_obj_handle *myself, void *owner,
+		       fsal_lock_param_t *lock)
+{
+	struct fsal_export *exp = op_ctx->fsal_export;
+	struct vfs_lock_waiter *waiter;
+	struct glist_head *glist;
+	fsal_errors_t fsal_error;
+	pthread_attr_t attr;
+	int fd, rc;
+
+	PTHREAD_MUTEX_lock(&lock_waiters_mtx);
+
+	if (lock_waiters_count >= VFS_LOCK_WAITERS_MAX) {
+		PTHREAD_MUTEX_unlock(&lock_waiters_mtx);
+		return;
+	}
+
+	/* Someone already waits for this very lock */
+	glist_for_each(glist, &lock_waiters) {
+		waiter = glist_entry(glist, struct vfs_lock_waiter, list);
+
+		if (waiter->owner == owner &&
+		    waiter->lock.lock_start == lock->lock_start &&
+		    waiter->lock.lock_length == lock->lock_length &&
+		    waiter->fh.handle_len == myself->handle->handle_len &&
+		    memcmp(waiter->fh.handle_data, myself->handle->handle_data,
+			   waiter->fh.handle_len) == 0) {
+			PTHREAD_MUTEX_unlock(&lock_waiters_mtx);
+			return;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&lock_waiters_mtx);
+
+	fd = vfs_fsal_open(myself,
+			   lock->lock_type == FSAL_LOCK_W ? O_RDWR : O_RDONLY,
+			   &fsal_error);
+	if (fd < 0) {
+		LogDebug(COMPONENT_FSAL,
+			 "Can't open file to wait for lock: %s",
+			 msg_fsal_err(fsal_error));
+		return;
+	}
+
+	waiter = gsh_calloc(1, sizeof(*waiter));
+	waiter->exp = exp;
+	waiter->owner = owner;
+	waiter->lock = *lock;
+	waiter->fd = fd;
+	memcpy(&waiter->fh, myself->handle, sizeof(waiter->fh));
+
+	PTHREAD_ATTR_init(&attr);
+	PTHREAD_ATTR_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	/* The list lock keeps the thread from finishing before it is
+	 * on the list.
+	 */
+	PTHREAD_MUTEX_lock(&lock_waiters_mtx);
+
+	rc = pthread_create(&waiter->thread, &attr, vfs_lock_waiter_run,
+			    waiter);
+	if (rc == 0) {
+		glist_add_tail(&lock_waiters, &waiter->list);
+		lock_waiters_count++;
+	}
+
+	PTHREAD_MUTEX_unlock(&lock_waiters_mtx);
+
+	PTHREAD_ATTR_destroy(&attr);
+
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Can't start lock waiter: %s", strerror(rc));
+		close(fd);
+		gsh_free(waiter);
+	}
+}
+
+/**
+ * @brief Whether a waiter waits for a lock of an owner overlapping a range
+ */
+static bool vfs_lock_waiter_match(struct vfs_lock_waiter *waiter,
+				  vfs_file_handle_t *fh, void *owner,
+				  fsal_lock_param_t *lock)
+{
+	uint64_t end = lock->lock_length == 0
+			? UINT64_MAX : lock->lock_start + lock->lock_length;
+	uint64_t wend = waiter->lock.lock_length == 0
+			? UINT64_MAX
+			: waiter->lock.lock_start + waiter->lock.lock_length;
+
+	return waiter->owner == owner &&
+	       waiter->lock.lock_start < end && lock->lock_start < wend &&
+	       waiter->fh.handle_len == fh->handle_len &&
+	       memcmp(waiter->fh.handle_data, fh->handle_data,
+		      fh->handle_len) == 0;
+}
+
+/**
+ * @brief Stop waiting for the locks of an owner overlapping a range
+ *
+ * Called once a lock is granted, unlocked or its blocked request is
+ * cancelled or expires, so that its waiter neither holds a slot nor
+ * sends a lock_avail for a lock nobody waits for.  Returns once the
+ * waiters are gone.
+ *
+ * @param[in] myself  File the lock is on
+ * @param[in] owner   Owner of the lock
+ * @param[in] lock    Range of the lock
+ */
+void vfs_lock_wait_disarm(struct vfs_fsal_obj_handle *myself, void *owner,
+			  fsal_lock_param_t *lock)
+{
+	struct glist_head *glist;
+	struct vfs_lock_waiter *waiter;
+	bool waiting;
+
+	if (atomic_fetch_uint32_t(&lock_waiters_count) == 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&lock_waiters_mtx);
+
+	glist_for_each(glist, &lock_waiters) {
+		waiter = glist_entry(glist, struct vfs_lock_waiter, list);
+
+		if (!waiter->disarmed &&
+		    vfs_lock_waiter_match(waiter, myself->handle, owner,
+					  lock)) {
+			waiter->disarmed = true;
+			(void) pthread_cancel(waiter->thread);
+		}
+	}
+
+	/* The thread leaves the list as it ends */
+	do {
+		waiting = false;
+
+		glist_for_each(glist, &lock_waiters) {
+			waiter = glist_entry(glist, struct vfs_lock_waiter,
+					     list);
+
+			if (waiter->disarmed &&
+			    vfs_lock_waiter_match(waiter, myself->handle,
+						  owner, lock)) {
+				waiting = true;
+				break;
+			}
+		}
+
+		if (waiting)
+			pthread_cond_wait(&lock_waiters_cond,
+					  &lock_waiters_mtx);
+	} while (waiting);
+
+	PTHREAD_MUTEX_unlock(&lock_waiters_mtx);
+}
+
+void vfs_lock_wait_fini(struct fsal_export *exp)
+{
+	struct glist_head *glist;
+	struct vfs_lock_waiter *waiter;
+	bool waiting;
+
+	PTHREAD_MUTEX_lock(&lock_waiters_mtx);
+
+	glist_for_each(glist, &lock_waiters) {
+		waiter = glist_entry(glist, struct vfs_lock_waiter, list);
+
+		if (exp == NULL || waiter->exp == exp)
+			(void) pthread_cancel(waiter->thread);
+	}
+
+	/* Waiters still reference the export until they are gone */
+	do {
+		waiting = false;
+
+		glist_for_each(glist, &lock_waiters) {
+			waiter = glist_entry(glist, struct vfs_lock_waiter,
+					     list);
+
+			if (exp == NULL || waiter->exp == exp) {
+				waiting = true;
+				break;
+			}
+		}
+
+		if (waiting)
+			pthread_cond_wait(&lock_waiters_cond,
+					  &lock_waiters_mtx);
+	} while (waiting);
+
+	PTHREAD_MUTEX_unlock(&lock_waiters_mtx);
+}
+
+#endif /* F_OFD_GETLK */
@@ -31,10 +31,13 @@
 #include "fsal_handle_syscalls.h"
 #include "fsal_api.h"
 #include "FSAL/fsal_commonlib.h"
+#include "abstract_atomic.h"
 
 struct vfs_fsal_obj_handle;
 struct vfs_fsal_export;
 struct vfs_filesystem;
+struct vfs_ff_export;
+struct vfs_ff_file;
 
 /*
  * VFS internal export
@@ -44,6 +47,9 @@ struct vfs_fsal_export {
 	struct fsal_filesystem *root_fs;
 	struct glist_head filesystems;
 	int fsid_type;
+	bool statx_dont_sync;
+	bool commit_range_only;
+	struct vfs_ff_export *ff;	/*< Flexible file layout, if any */
 };
 
 #define EXPORT_VFS_FROM_FSAL(fsal) \
@@ -71,6 +77,68 @@ struct vfs_filesystem_export_map {
 
 void vfs_unexport_filesystems(struct vfs_fsal_export *exp);
 
+#ifdef USE_IO_URING
+/*
+ * io_uring I/O engine
+ */
+struct vfs_uring_params {
+	bool enable;		/*< Use io_uring for async read/write */
+	uint32_t rings;		/*< Number of rings, 0 for one per CPU */
+	uint32_t depth;		/*< Submission queue depth of each ring */
+	bool sq_poll;		/*< Use a kernel submission polling thread */
+};
+
+int vfs_uring_init(struct vfs_uring_params *params);
+void vfs_uring_fini(void);
+bool vfs_uring_enabled(void);
+bool vfs_uring_submit(struct fsal_obj_handle *obj_hdl, int fd,
+		      struct vfs_fd *io_fd, bool is_write,
+		      struct fsal_io_arg *io_arg,
+		      fsal_async_cb done_cb, void *caller_arg);
+void vfs_async_fd_release(int fd, struct vfs_fd *io_fd);
+#endif
+
+/*
+ * O_PATH descriptor cache
+ */
+void vfs_pathfd_init(uint32_t size);
+void vfs_pathfd_fini(void);
+void vfs_pathfd_insert(struct vfs_filesystem *fs, vfs_file_handle_t *fh,
+		       int fd);
+int vfs_pathfd_open(struct vfs_fsal_obj_handle *hdl,
+		    fsal_errors_t *fsal_error);
+void vfs_pathfd_forget(struct vfs_fsal_obj_handle *hdl);
+
+/*
+ * Waiters for blocked locks
+ */
+void vfs_lock_wait_arm(struct vfs_fsal_obj_handle *myself, void *owner,
+		       fsal_lock_param_t *lock);
+void vfs_lock_wait_disarm(struct vfs_fsal_obj_handle *myself, void *owner,
+			  fsal_lock_param_t *lock);
+void vfs_lock_wait_fini(struct fsal_export *exp);
+
+/*
+ * Flexible file layouts
+ */
+extern struct config_item vfs_ff_params[];
+void *vfs_ff_conf_init(void *link_mem, void *self_struct);
+int vfs_ff_conf_commit(void *node, void *link_mem, void *self_struct,
+		       struct config_error_type *err_type);
+void vfs_ff_init(struct vfs_fsal_export *myself);
+void vfs_ff_fini(struct vfs_fsal_export *myself);
+void vfs_ff_export_ops_init(struct vfs_fsal_export *myself);
+void vfs_ff_handle_ops_init(struct fsal_obj_ops *ops);
+int vfs_ff_readv(struct vfs_ff_export *ff, struct vfs_fsal_obj_handle *hdl,
+		 int fd, uint64_t offset, struct iovec *iov, int iovcnt,
+		 size_t *read_amount, bool *end_of_file);
+int vfs_ff_write(struct vfs_ff_export *ff, struct vfs_fsal_obj_handle *hdl,
+		 int fd, uint64_t offset, size_t buffer_size, void *buffer,
+		 size_t *wrote_amount);
+int vfs_ff_truncate(struct vfs_ff_export *ff, struct vfs_fsal_obj_handle *hdl,
+		    uint64_t size);
+void vfs_ff_remove(struct vfs_ff_export *ff, struct vfs_fsal_obj_handle *hdl);
+
 /* private helpers from export
  */
 
@@ -122,6 +190,8 @@ struct vfs_fd {
 	fsal_openflags_t openflags;
 	/** The kernel file descriptor. */
 	int fd;
+	/** Asynchronous I/O in flight on fd, close waits for it. */
+	int32_t io_work;
 };
 
 struct vfs_state_fd {
@@ -156,6 +226,12 @@ struct vfs_fsal_obj_handle {
 		struct {
 			struct fsal_share share;
 			struct vfs_fd fd;
+			struct vfs_ff_file *ff;	/*< Data files, if any */
+			/** Unstable writes done, bumped once they are
+			 *  in the page cache */
+			uint64_t unstable_gen;
+			/** unstable_gen covered by the last full commit */
+			uint64_t committed_gen;
 		} file;
 		struct {
 			char *path;
@@ -175,6 +251,19 @@ struct vfs_fsal_obj_handle {
 #define OBJ_VFS_FROM_FSAL(fsal) \
 	container_of((fsal), struct vfs_fsal_obj_handle, obj_handle)
 
+/**
+ * @brief Note data a COMMIT will have to flush
+ *
+ * Call once the data is in the page cache, never before, or a commit
+ * running in between could mark it stable.
+ */
+static inline void vfs_note_unstable(struct fsal_obj_handle *obj_hdl)
+{
+	if (obj_hdl->type == REGULAR_FILE)
+		(void) atomic_inc_uint64_t(
+			&OBJ_VFS_FROM_FSAL(obj_hdl)->u.file.unstable_gen);
+}
+
 /* default vex ops */
 int vfs_fd_to_handle(int fd, struct fsal_filesystem *fs,
 		     vfs_file_handle_t *fh);
@@ -214,6 +303,22 @@ int vfs_get_root_handle(struct vfs_filesystem *vfs_fs,
 int vfs_re_index(struct vfs_filesystem *vfs_fs,
 		 struct vfs_fsal_export *exp);
 
+/*
+ * Attributes of a chunk of directory entries fetched in bulk, for
+ * sub-FSALs that can do so (XFS bulkstat).  Others return NULL from
+ * vfs_prefetch_dirents and every entry is looked up on its own.
+ */
+struct vfs_dirent_prefetch;
+
+struct vfs_dirent_prefetch *vfs_prefetch_dirents(int dirfd,
+						 const uint64_t *inos,
+						 int count);
+
+int vfs_prefetched_lookup(struct vfs_dirent_prefetch *pf, uint64_t ino,
+			  vfs_file_handle_t *fh, struct stat *st);
+
+void vfs_prefetch_release(struct vfs_dirent_prefetch *pf);
+
 /*
  * VFS structure to tell subfunctions wether they should close the
  * returned fd or not
@@ -245,6 +350,12 @@ static inline bool vfs_unopenable_type(object_file_type_t type)
 	}
 }
 
+#ifdef HAVE_STATX
+unsigned int vfs_attrmask2statx(attrmask_t mask);
+void vfs_statx2fsal(const struct statx *stx, struct stat *stp,
+		    struct attrlist *attrs);
+#endif
+
 struct closefd vfs_fsal_open_and_stat(struct fsal_export *exp,
 				      struct vfs_fsal_obj_handle *myself,
 				      struct stat *stat,
@@ -295,6 +406,38 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 			bool *end_of_file,
 			struct io_info *info);
 
+fsal_status_t vfs_readv2(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct state_t *state,
+			 uint64_t offset,
+			 struct iovec *iov,
+			 int iovcnt,
+			 size_t *read_amount,
+			 bool *end_of_file);
+
+fsal_status_t vfs_read_fd(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct state_t *state,
+			  uint64_t offset,
+			  size_t size,
+			  int *fd,
+			  size_t *read_amount,
+			  bool *end_of_file);
+
+#ifdef USE_IO_URING
+void vfs_read2_async(struct fsal_obj_handle *obj_hdl,
+		     bool bypass,
+		     struct fsal_io_arg *io_arg,
+		     fsal_async_cb done_cb,
+		     void *caller_arg);
+
+void vfs_write2_async(struct fsal_obj_handle *obj_hdl,
+		      bool bypass,
+		      struct fsal_io_arg *io_arg,
+		      fsal_async_cb done_cb,
+		      void *caller_arg);
+#endif
+
 fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 			 bool bypass,
 			 struct state_t *state,
@@ -305,6 +448,23 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 			 bool *fsal_stable,
 			 struct io_info *info);
 
+fsal_status_t vfs_copy2(struct fsal_obj_handle *src_hdl,
+			struct state_t *src_state,
+			uint64_t src_offset,
+			struct fsal_obj_handle *dst_hdl,
+			struct state_t *dst_state,
+			uint64_t dst_offset,
+			uint64_t count,
+			uint64_t *copied);
+
+fsal_status_t vfs_clone2(struct fsal_obj_handle *src_hdl,
+			 struct state_t *src_state,
+			 uint64_t src_offset,
+			 struct fsal_obj_handle *dst_hdl,
+			 struct state_t *dst_state,
+			 uint64_t dst_offset,
+			 uint64_t count);
+
 fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 			  off_t offset,
 			  size_t len);
@@ -0,0 +1,233 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file FSAL/FSAL_VFS/vfs_pathfd.c
+ * @brief Cache of O_PATH descriptors for the VFS FSAL
+ *
+ * Metadata operations (lookup, getattr, ...) only need an O_PATH
+ * descriptor on the object, yet each of them decoded its handle with
+ * open_by_handle_at.  This keeps the O_PATH descriptors of recently
+ * used handles in a direct mapped table; a hit costs a dup instead of
+ * a decode.  Callers always get their own descriptor, which they close
+ * as before.
+ *
+ * A cached descriptor pins its inode, so entries are dropped when the
+ * object handle is released or unlinked.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "fsal_handle_syscalls.h"
+#include "vfs_methods.h"
+#include "city.h"
+
+/** Number of locks the slots are spread over */
+#define VFS_PATHFD_LOCKS 64
+
+/**
+ * @brief A cached descriptor
+ */
+struct vfs_pathfd_slot {
+	int fd;				/*< O_PATH descriptor, -1 if empty */
+	struct vfs_filesystem *fs;	/*< File system of the handle */
+	vfs_file_handle_t handle;	/*< Handle the descriptor is on */
+};
+
+static struct vfs_pathfd_slot *slots;
+static uint32_t nr_slots;
+static pthread_mutex_t locks[VFS_PATHFD_LOCKS];
+
+static inline uint32_t vfs_pathfd_index(vfs_file_handle_t *fh)
+{
+	return CityHash64((char *)fh->handle_data, fh->handle_len) % nr_slots;
+}
+
+static inline bool vfs_pathfd_match(struct vfs_pathfd_slot *slot,
+				    struct vfs_filesystem *fs,
+				    vfs_file_handle_t *fh)
+{
+	return slot->fd >= 0 && slot->fs == fs &&
+	       slot->handle.handle_len == fh->handle_len &&
+	       memcmp(slot->handle.handle_data, fh->handle_data,
+		      fh->handle_len) == 0;
+}
+
+/**
+ * @brief Set up the cache
+ *
+ * @param[in] size  Number of descriptors to cache, 0 to disable
+ */
+void vfs_pathfd_init(uint32_t size)
+{
+	uint32_t i;
+
+	if (size == 0 || slots != NULL)
+		return;
+
+	slots = gsh_calloc(size, sizeof(*slots));
+	nr_slots = size;
+
+	for (i = 0; i < size; i++)
+		slots[i].fd = -1;
+
+	for (i = 0; i < VFS_PATHFD_LOCKS; i++)
+		PTHREAD_MUTEX_init(&locks[i], NULL);
+
+	LogInfo(COMPONENT_FSAL, "Caching up to %"PRIu32" O_PATH descriptors",
+		size);
+}
+
+/**
+ * @brief Close all cached descriptors and free the cache
+ */
+void vfs_pathfd_fini(void)
+{
+	uint32_t i;
+
+	if (slots == NULL)
+		return;
+
+	for (i = 0; i < nr_slots; i++)
+		if (slots[i].fd >= 0)
+			close(slots[i].fd);
+
+	for (i = 0; i < VFS_PATHFD_LOCKS; i++)
+		PTHREAD_MUTEX_destroy(&locks[i]);
+
+	gsh_free(slots);
+	slots = NULL;
+	nr_slots = 0;
+}
+
+/**
+ * @brief Hand a descriptor over to the cache
+ *
+ * The descriptor is owned by the cache afterwards; it displaces what
+ * was cached in its slot.  Without a cache it is simply closed.
+ *
+ * @param[in] fs  File system of the handle
+ * @param[in] fh  Handle the descriptor was opened from
+ * @param[in] fd  O_PATH descriptor
+ */
+void vfs_pathfd_insert(struct vfs_filesystem *fs, vfs_file_handle_t *fh,
+		       int fd)
+{
+	struct vfs_pathfd_slot *slot;
+	uint32_t idx;
+	int old_fd;
+
+	if (slots == NULL) {
+		close(fd);
+		return;
+	}
+
+	idx = vfs_pathfd_index(fh);
+	slot = &slots[idx];
+
+	PTHREAD_MUTEX_lock(&locks[idx % VFS_PATHFD_LOCKS]);
+	old_fd = slot->fd;
+	slot->fd = fd;
+	slot->fs = fs;
+	memcpy(&slot->handle, fh, sizeof(slot->handle));
+	PTHREAD_MUTEX_unlock(&locks[idx % VFS_PATHFD_LOCKS]);
+
+	if (old_fd >= 0)
+		close(old_fd);
+}
+
+/**
+ * @brief Get an O_PATH descriptor on an object
+ *
+ * @param[in]  hdl         The object
+ * @param[out] fsal_error  Error if the object could not be opened
+ *
+ * @return A descriptor the caller must close, or -errno.
+ */
+int vfs_pathfd_open(struct vfs_fsal_obj_handle *hdl,
+		    fsal_errors_t *fsal_error)
+{
+	struct vfs_filesystem *vfs_fs = hdl->obj_handle.fs->private_data;
+	struct vfs_pathfd_slot *slot;
+	uint32_t idx;
+	int fd = -1, cfd;
+
+	if (slots == NULL)
+		return vfs_fsal_open(hdl, O_PATH | O_NOACCESS, fsal_error);
+
+	idx = vfs_pathfd_index(hdl->handle);
+	slot = &slots[idx];
+
+	PTHREAD_MUTEX_lock(&locks[idx % VFS_PATHFD_LOCKS]);
+	if (vfs_pathfd_match(slot, vfs_fs, hdl->handle))
+		fd = dup(slot->fd);
+	PTHREAD_MUTEX_unlock(&locks[idx % VFS_PATHFD_LOCKS]);
+
+	if (fd >= 0)
+		return fd;
+
+	fd = vfs_fsal_open(hdl, O_PATH | O_NOACCESS, fsal_error);
+	if (fd < 0)
+		return fd;
+
+	/* Keep a copy; if that fails the caller's descriptor is fine */
+	cfd = dup(fd);
+	if (cfd >= 0)
+		vfs_pathfd_insert(vfs_fs, hdl->handle, cfd);
+
+	return fd;
+}
+
+/**
+ * @brief Drop the cached descriptor of an object, if any
+ *
+ * @param[in] hdl  The object
+ */
+void vfs_pathfd_forget(struct vfs_fsal_obj_handle *hdl)
+{
+	struct vfs_filesystem *vfs_fs;
+	struct vfs_pathfd_slot *slot;
+	uint32_t idx;
+	int fd = -1;
+
+	if (slots == NULL || hdl->obj_handle.fs == NULL)
+		return;
+
+	vfs_fs = hdl->obj_handle.fs->private_data;
+	idx = vfs_pathfd_index(hdl->handle);
+	slot = &slots[idx];
+
+	PTHREAD_MUTEX_lock(&locks[idx % VFS_PATHFD_LOCKS]);
+	if (vfs_pathfd_match(slot, vfs_fs, hdl->handle)) {
+		fd = slot->fd;
+		slot->fd = -1;
+	}
+	PTHREAD_MUTEX_unlock(&locks[idx % VFS_PATHFD_LOCKS]);
+
+	if (fd >= 0)
+		close(fd);
+}
@@ -0,0 +1,382 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file FSAL/FSAL_VFS/vfs_uring.c
+ * @brief io_uring I/O engine for the VFS FSAL
+ *
+ * A set of rings, one per CPU by default, is shared by all workers.
+ * Submitters pick the ring of the CPU they run on; each ring has a
+ * reaper thread that waits for completions and invokes the async
+ * callbacks, so workers never block on the disk.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <liburing.h>
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "vfs_methods.h"
+
+/**
+ * @brief One ring and its reaper
+ */
+struct vfs_uring {
+	struct io_uring ring;
+	pthread_mutex_t sq_lock;	/*< Serializes SQE preparation */
+	pthread_t reaper;
+	bool running;
+};
+
+/**
+ * @brief An I/O in flight
+ */
+struct vfs_uring_req {
+	struct fsal_obj_handle *obj_hdl;
+	struct fsal_io_arg *io_arg;
+	fsal_async_cb done_cb;
+	void *caller_arg;
+	int fd;			/*< The fd the I/O is done with */
+	struct vfs_fd *io_fd;	/*< Its vfs_fd, NULL if fd is temporary */
+	bool is_write;
+	int nr_cqe;		/*< Completions still expected */
+	int res;		/*< Result of the read or write */
+	int sync_res;		/*< Result of the linked fsync */
+};
+
+static struct vfs_uring *rings;
+static uint32_t nr_rings;
+
+/* Data of SQEs withdrawn after a failed submit */
+static char vfs_uring_withdrawn;
+
+/**
+ * @brief Deliver the result of a finished I/O
+ */
+static void vfs_uring_complete(struct vfs_uring_req *req)
+{
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	struct fsal_io_arg *io_arg = req->io_arg;
+	int err;
+
+	if (req->res < 0) {
+		err = -req->res;
+		status = fsalstat(posix2fsal_error(err), err);
+		io_arg->io_amount = 0;
+	} else {
+		io_arg->io_amount = req->res;
+
+		if (!req->is_write)
+			io_arg->end_of_file = (req->res == 0);
+		else if (io_arg->fsal_stable && req->sync_res < 0) {
+			err = -req->sync_res;
+			status = fsalstat(posix2fsal_error(err), err);
+		} else if (!io_arg->fsal_stable && req->res > 0)
+			vfs_note_unstable(req->obj_hdl);
+	}
+
+	vfs_async_fd_release(req->fd, req->io_fd);
+
+	req->done_cb(req->obj_hdl, status, io_arg, req->caller_arg);
+	gsh_free(req);
+}
+
+/**
+ * @brief Reaper thread, one per ring
+ */
+static void *vfs_uring_reaper(void *arg)
+{
+	struct vfs_uring *ur = arg;
+	struct io_uring_cqe *cqe;
+	struct vfs_uring_req *req;
+	int rc;
+
+	SetNameFunction("uring_reap");
+
+	for (;;) {
+		rc = io_uring_wait_cqe(&ur->ring, &cqe);
+
+		if (rc == -EINTR)
+			continue;
+
+		if (rc < 0) {
+			LogCrit(COMPONENT_FSAL,
+				"io_uring_wait_cqe failed: %s",
+				strerror(-rc));
+			break;
+		}
+
+		req = io_uring_cqe_get_data(cqe);
+
+		if (req == NULL) {
+			/* Shutdown marker */
+			io_uring_cqe_seen(&ur->ring, cqe);
+			break;
+		}
+
+		if (req == (void *)&vfs_uring_withdrawn) {
+			io_uring_cqe_seen(&ur->ring, cqe);
+			continue;
+		}
+
+		/* The read or write completes first, then the fsync
+		 * linked to it, if any.
+		 */
+		if (req->nr_cqe == 2 ||
+		    !(req->is_write && req->io_arg->fsal_stable))
+			req->res = cqe->res;
+		else
+			req->sync_res = cqe->res;
+
+		io_uring_cqe_seen(&ur->ring, cqe);
+
+		if (--req->nr_cqe == 0)
+			vfs_uring_complete(req);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Start the io_uring engine
+ *
+ * @param[in] params Engine configuration
+ *
+ * @return 0 on success, a negative errno otherwise.
+ */
+int vfs_uring_init(struct vfs_uring_params *params)
+{
+	struct io_uring_params up;
+	uint32_t i;
+	int rc = 0;
+
+	if (!params->enable || rings != NULL)
+		return 0;
+
+	nr_rings = params->rings;
+	if (nr_rings == 0)
+		nr_rings = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_rings == 0)
+		nr_rings = 1;
+
+	rings = gsh_calloc(nr_rings, sizeof(*rings));
+
+	for (i = 0; i < nr_rings; i++) {
+		memset(&up, 0, sizeof(up));
+		if (params->sq_poll)
+			up.flags |= IORING_SETUP_SQPOLL;
+
+		rc = io_uring_queue_init_params(params->depth,
+						&rings[i].ring, &up);
+		if (rc < 0) {
+			LogCrit(COMPONENT_FSAL,
+				"Could not set up io_uring %" PRIu32 ": %s",
+				i, strerror(-rc));
+			break;
+		}
+
+		PTHREAD_MUTEX_init(&rings[i].sq_lock, NULL);
+
+		rc = -pthread_create(&rings[i].reaper, NULL,
+				     vfs_uring_reaper, &rings[i]);
+		if (rc < 0) {
+			LogCrit(COMPONENT_FSAL,
+				"Could not start io_uring reaper: %s",
+				strerror(-rc));
+			PTHREAD_MUTEX_destroy(&rings[i].sq_lock);
+			io_uring_queue_exit(&rings[i].ring);
+			break;
+		}
+
+		rings[i].running = true;
+	}
+
+	if (rc < 0) {
+		vfs_uring_fini();
+		return rc;
+	}
+
+	LogInfo(COMPONENT_FSAL,
+		"io_uring engine started with %" PRIu32
+		" rings of depth %" PRIu32 "%s",
+		nr_rings, params->depth,
+		params->sq_poll ? " (SQ polling)" : "");
+
+	return 0;
+}
+
+/**
+ * @brief Stop the io_uring engine
+ *
+ * Outstanding I/O is waited for by the reapers before they exit.
+ */
+void vfs_uring_fini(void)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t i;
+
+	if (rings == NULL)
+		return;
+
+	for (i = 0; i < nr_rings; i++) {
+		if (!rings[i].running)
+			continue;
+
+		PTHREAD_MUTEX_lock(&rings[i].sq_lock);
+		sqe = io_uring_get_sqe(&rings[i].ring);
+		while (sqe == NULL) {
+			io_uring_submit(&rings[i].ring);
+			sqe = io_uring_get_sqe(&rings[i].ring);
+		}
+		io_uring_prep_nop(sqe);
+		io_uring_sqe_set_data(sqe, NULL);
+		io_uring_submit(&rings[i].ring);
+		PTHREAD_MUTEX_unlock(&rings[i].sq_lock);
+
+		pthread_join(rings[i].reaper, NULL);
+		PTHREAD_MUTEX_destroy(&rings[i].sq_lock);
+		io_uring_queue_exit(&rings[i].ring);
+	}
+
+	gsh_free(rings);
+	rings = NULL;
+	nr_rings = 0;
+}
+
+/**
+ * @brief Whether the engine is running
+ */
+bool vfs_uring_enabled(void)
+{
+	return rings != NULL;
+}
+
+/**
+ * @brief Queue a read or write on the ring of the current CPU
+ *
+ * The engine holds on to fd until the I/O completes, then releases
+ * it with vfs_async_fd_release.  A stable write is followed by a
+ * linked fsync.
+ *
+ * When the ring has no room for the I/O, nothing is queued and the
+ * caller keeps fd, so it can do the I/O synchronously instead.
+ *
+ * @param[in]     obj_hdl    File on which to operate
+ * @param[in]     fd         File descriptor for the I/O
+ * @param[in]     io_fd      The vfs_fd holding fd, NULL if fd is temporary
+ * @param[in]     is_write   Whether this is a write
+ * @param[in,out] io_arg     The I/O description and results
+ * @param[in]     done_cb    Callback to invoke on completion
+ * @param[in]     caller_arg Opaque argument for done_cb
+ *
+ * @retval true  The I/O was queued, or failed and done_cb was called.
+ * @retval false The ring is full.
+ */
+bool vfs_uring_submit(struct fsal_obj_handle *obj_hdl, int fd,
+		      struct vfs_fd *io_fd, bool is_write,
+		      struct fsal_io_arg *io_arg,
+		      fsal_async_cb done_cb, void *caller_arg)
+{
+	struct vfs_uring_req *req;
+	struct io_uring_sqe *sqe[2] = {NULL, NULL};
+	struct vfs_uring *ur;
+	int cpu = sched_getcpu();
+	int nr_sqe = (is_write && io_arg->fsal_stable) ? 2 : 1;
+	int rc, i;
+
+	ur = &rings[(cpu < 0 ? 0 : cpu) % nr_rings];
+
+	PTHREAD_MUTEX_lock(&ur->sq_lock);
+
+	if (io_uring_sq_space_left(&ur->ring) < nr_sqe) {
+		/* Ring full, flush it and retry */
+		io_uring_submit(&ur->ring);
+	}
+
+	if (io_uring_sq_space_left(&ur->ring) < nr_sqe) {
+		PTHREAD_MUTEX_unlock(&ur->sq_lock);
+		LogDebug(COMPONENT_FSAL, "io_uring submission queue full");
+		return false;
+	}
+
+	req = gsh_calloc(1, sizeof(*req));
+	req->obj_hdl = obj_hdl;
+	req->io_arg = io_arg;
+	req->done_cb = done_cb;
+	req->caller_arg = caller_arg;
+	req->fd = fd;
+	req->io_fd = io_fd;
+	req->is_write = is_write;
+	req->nr_cqe = nr_sqe;
+
+	sqe[0] = io_uring_get_sqe(&ur->ring);
+	if (is_write)
+		io_uring_prep_writev(sqe[0], fd, io_arg->iov, io_arg->iovcnt,
+				     io_arg->offset);
+	else
+		io_uring_prep_readv(sqe[0], fd, io_arg->iov, io_arg->iovcnt,
+				    io_arg->offset);
+	io_uring_sqe_set_data(sqe[0], req);
+
+	if (nr_sqe == 2) {
+		sqe[0]->flags |= IOSQE_IO_LINK;
+		sqe[1] = io_uring_get_sqe(&ur->ring);
+		io_uring_prep_fsync(sqe[1], fd, 0);
+		io_uring_sqe_set_data(sqe[1], req);
+	}
+
+	/* With SQ polling this only wakes the kernel thread if needed */
+	rc = io_uring_submit(&ur->ring);
+
+	if (rc >= 0 || (ur->ring.flags & IORING_SETUP_SQPOLL)) {
+		/* The kernel thread picks the SQEs up regardless */
+		PTHREAD_MUTEX_unlock(&ur->sq_lock);
+		return true;
+	}
+
+	/* Nothing was consumed, turn the SQEs into no-ops that a later
+	 * submit flushes without touching req.
+	 */
+	for (i = 0; i < nr_sqe; i++) {
+		io_uring_prep_nop(sqe[i]);
+		io_uring_sqe_set_data(sqe[i], &vfs_uring_withdrawn);
+	}
+
+	PTHREAD_MUTEX_unlock(&ur->sq_lock);
+
+	LogDebug(COMPONENT_FSAL, "io_uring_submit failed: %s",
+		 strerror(-rc));
+
+	if (rc == -EAGAIN || rc == -EBUSY) {
+		/* Out of kernel resources for now, like a full ring */
+		gsh_free(req);
+		return false;
+	}
+
+	req->res = rc;
+	vfs_uring_complete(req);
+	return true;
+}
@@ -39,6 +39,7 @@
 #include "fsal.h"
 #include "FSAL/fsal_init.h"
 #include "fsal_handle_syscalls.h"
+#include "../vfs_methods.h"
 
 /* VFS FSAL module private storage
  */
@@ -54,6 +55,10 @@ struct xfs_fsal_module {
 	struct fsal_module fsal;
 	struct fsal_staticfsinfo_t fs_info;
 	/* xfsfs_specific_initinfo_t specific_info;  placeholder */
+	uint32_t pathfd_cache_size;
+#ifdef USE_IO_URING
+	struct vfs_uring_params uring;
+#endif
 };
 
 const char myname[] = "XFS";
@@ -80,25 +85,38 @@ static struct fsal_staticfsinfo_t default_posix_info = {
 	.maxread = FSAL_MAXIOSIZE,
 	.maxwrite = FSAL_MAXIOSIZE,
 	.link_supports_permission_checks = false,
+	.readv = true,
 };
 
 static struct config_item xfs_params[] = {
 	CONF_ITEM_BOOL("link_support", true,
-		       fsal_staticfsinfo_t, link_support),
+		       xfs_fsal_module, fs_info.link_support),
 	CONF_ITEM_BOOL("symlink_support", true,
-		       fsal_staticfsinfo_t, symlink_support),
+		       xfs_fsal_module, fs_info.symlink_support),
 	CONF_ITEM_BOOL("cansettime", true,
-		       fsal_staticfsinfo_t, cansettime),
+		       xfs_fsal_module, fs_info.cansettime),
 	CONF_ITEM_UI64("maxread", 512, FSAL_MAXIOSIZE, FSAL_MAXIOSIZE,
-		       fsal_staticfsinfo_t, maxread),
+		       xfs_fsal_module, fs_info.maxread),
 	CONF_ITEM_UI64("maxwrite", 512, FSAL_MAXIOSIZE, FSAL_MAXIOSIZE,
-		       fsal_staticfsinfo_t, maxwrite),
+		       xfs_fsal_module, fs_info.maxwrite),
 	CONF_ITEM_MODE("umask", 0,
-		       fsal_staticfsinfo_t, umask),
+		       xfs_fsal_module, fs_info.umask),
 	CONF_ITEM_BOOL("auth_xdev_export", false,
-		       fsal_staticfsinfo_t, auth_exportpath_xdev),
+		       xfs_fsal_module, fs_info.auth_exportpath_xdev),
 	CONF_ITEM_MODE("xattr_access_rights", 0400,
-		       fsal_staticfsinfo_t, xattr_access_rights),
+		       xfs_fsal_module, fs_info.xattr_access_rights),
+	CONF_ITEM_UI32("pathfd_cache_size", 0, 1048576, 1024,
+		       xfs_fsal_module, pathfd_cache_size),
+#ifdef USE_IO_URING
+	CONF_ITEM_BOOL("io_uring", false,
+		       xfs_fsal_module, uring.enable),
+	CONF_ITEM_UI32("io_uring_rings", 0, 1024, 0,
+		       xfs_fsal_module, uring.rings),
+	CONF_ITEM_UI32("io_uring_depth", 1, 32768, 256,
+		       xfs_fsal_module, uring.depth),
+	CONF_ITEM_BOOL("io_uring_sq_poll", false,
+		       xfs_fsal_module, uring.sq_poll),
+#endif
 	CONFIG_EOL
 };
 
@@ -159,9 +177,10 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 
 		rc = fcntl(fd, F_OFD_GETLK, &lock);
 
-		if (rc == 0)
+		if (rc == 0) {
 			xfs_me->fs_info.lock_support = true;
-		else
+			xfs_me->fs_info.lock_avail_upcall = true;
+		} else
 			LogInfo(COMPONENT_FSAL, "Could not use OFD locks");
 
 		close(fd);
@@ -181,12 +200,18 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 
 	(void) load_config_from_parse(config_struct,
 				      &xfs_param,
-				      &xfs_me->fs_info,
+				      xfs_me,
 				      true,
 				      err_type);
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
 	display_fsinfo(&xfs_me->fs_info);
+	vfs_pathfd_init(xfs_me->pathfd_cache_size);
+#ifdef USE_IO_URING
+	if (vfs_uring_init(&xfs_me->uring) < 0)
+		LogWarn(COMPONENT_FSAL,
+			"io_uring engine unavailable, using synchronous I/O");
+#endif
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
 		     XFS_SUPPORTED_ATTRIBUTES);
@@ -251,6 +276,14 @@ MODULE_FINI void xfs_unload(void)
 {
 	int retval;
 
+#ifdef USE_IO_URING
+	vfs_uring_fini();
+#endif
+	vfs_pathfd_fini();
+#ifdef F_OFD_GETLK
+	vfs_lock_wait_fini(NULL);
+#endif
+
 	retval = unregister_fsal(&XFS.fsal);
 	if (retval != 0) {
 		fprintf(stderr, "XFS module failed to unregister");
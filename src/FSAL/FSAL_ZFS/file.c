@@ -104,6 +104,10 @@ fsal_openflags_t tank_status(struct fsal_obj_handle *obj_hdl)
 
 /* tank_read
  * concurrency (locks) is managed in cache_inode_*
+ *
+ * The data go straight from libzfswrap into the reply buffer; the one
+ * copy left is the ARC to buffer copy inside libzfswrap_read, which
+ * has no interface to loan ARC buffers out.
  */
 
 fsal_status_t tank_read(struct fsal_obj_handle *obj_hdl,
@@ -142,6 +146,9 @@ fsal_status_t tank_read(struct fsal_obj_handle *obj_hdl,
 
 /* tank_write
  * concurrency (locks) is managed in cache_inode_*
+ *
+ * As for reads, the request buffer is handed to libzfswrap as is, and
+ * libzfswrap_write has no way to take over a loaned buffer.
  */
 
 fsal_status_t tank_write(struct fsal_obj_handle *obj_hdl,
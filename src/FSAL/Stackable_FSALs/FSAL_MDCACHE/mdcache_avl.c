@@ -53,6 +53,36 @@
 #include <pthread.h>
 #include <assert.h>
 
+/**
+ * @brief A name known not to exist in a directory
+ *
+ * Names are kept by hash only, a colliding name simply replaces the
+ * one cached.
+ */
+struct mdcache_neg_entry {
+	struct avltree_node node;
+	uint64_t k;		/*< Name hash */
+	time_t expire;		/*< Expiration time, 0 for none */
+	char name[];
+};
+
+static int avl_neg_cmpf(const struct avltree_node *lhs,
+			const struct avltree_node *rhs)
+{
+	struct mdcache_neg_entry *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct mdcache_neg_entry, node);
+	rk = avltree_container_of(rhs, struct mdcache_neg_entry, node);
+
+	if (lk->k < rk->k)
+		return -1;
+
+	if (lk->k == rk->k)
+		return 0;
+
+	return 1;
+}
+
 void
 mdcache_avl_init(mdcache_entry_t *entry)
 {
@@ -64,6 +94,9 @@ mdcache_avl_init(mdcache_entry_t *entry)
 		     0 /* flags */);
 	avltree_init(&entry->fsobj.fsdir.avl.sorted, avl_dirent_sorted_cmpf,
 		     0 /* flags */);
+	avltree_init(&entry->fsobj.fsdir.avl.neg, avl_neg_cmpf,
+		     0 /* flags */);
+	entry->fsobj.fsdir.avl.nneg = 0;
 }
 
 static inline struct avltree_node *
@@ -90,7 +123,7 @@ avl_dirent_set_deleted(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
 	avltree_remove(&v->node_hk, &entry->fsobj.fsdir.avl.t);
 
 	v->flags |= DIR_ENTRY_FLAG_DELETED;
-	mdcache_key_delete(&v->ckey);
+	mdcache_dirent_key_delete(v);
 
 	/* save cookie in deleted avl */
 	node = avltree_insert(&v->node_hk, &entry->fsobj.fsdir.avl.c);
@@ -207,9 +240,9 @@ void mdcache_avl_remove(mdcache_dir_entry_t *dirent, struct avltree *t)
 		unchunk_dirent(dirent);
 
 	if (dirent->ckey.kv.len)
-		mdcache_key_delete(&dirent->ckey);
+		mdcache_dirent_key_delete(dirent);
 
-	gsh_free(dirent);
+	mdcache_dirent_free(dirent);
 }
 
 /**
@@ -584,8 +617,8 @@ again:
 
 out:
 
-	mdcache_key_delete(&v->ckey);
-	gsh_free(v);
+	mdcache_dirent_key_delete(v);
+	mdcache_dirent_free(v);
 	*dirent = v2;
 
 	return code;
@@ -781,4 +814,142 @@ void mdcache_avl_clean_tree(struct avltree *tree)
 	}
 }
 
+static inline uint64_t avl_neg_hash(const char *name)
+{
+#if AVL_HASH_MURMUR3
+	uint32_t hk[4];
+	uint64_t k;
+
+	MurmurHash3_x64_128(name, strlen(name), 67, hk);
+	memcpy(&k, hk, 8);
+	return k;
+#else
+	return CityHash64WithSeed(name, strlen(name), 67);
+#endif
+}
+
+static struct mdcache_neg_entry *avl_neg_find(mdcache_entry_t *entry,
+					      uint64_t k)
+{
+	struct mdcache_neg_entry v;
+	struct avltree_node *node;
+
+	v.k = k;
+	node = avltree_lookup(&v.node, &entry->fsobj.fsdir.avl.neg);
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, struct mdcache_neg_entry, node);
+}
+
+static void avl_neg_free(mdcache_entry_t *entry,
+			 struct mdcache_neg_entry *neg)
+{
+	avltree_remove(&neg->node, &entry->fsobj.fsdir.avl.neg);
+	entry->fsobj.fsdir.avl.nneg--;
+	mdcache_mem_uncharge(sizeof(*neg) + strlen(neg->name) + 1);
+	gsh_free(neg);
+}
+
+/**
+ * @brief Remember that a name does not exist
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] entry   The directory
+ * @param[in] name    The name that was not found
+ * @param[in] expire  When to stop trusting this, 0 for never
+ */
+void mdcache_avl_neg_insert(mdcache_entry_t *entry, const char *name,
+			    time_t expire)
+{
+	size_t namesize = strlen(name) + 1;
+	struct mdcache_neg_entry *neg;
+	uint64_t k = avl_neg_hash(name);
+	struct avltree_node *first;
+
+	if (mdcache_param.dir.avl_max_negative == 0)
+		return;
+
+	neg = avl_neg_find(entry, k);
+	if (neg != NULL)
+		avl_neg_free(entry, neg);
+
+	if (entry->fsobj.fsdir.avl.nneg >= mdcache_param.dir.avl_max_negative) {
+		/* Full, make room by dropping an arbitrary name */
+		first = avltree_first(&entry->fsobj.fsdir.avl.neg);
+		avl_neg_free(entry, avltree_container_of(
+				first, struct mdcache_neg_entry, node));
+	}
+
+	mdcache_mem_charge(sizeof(*neg) + namesize);
+	neg = gsh_malloc(sizeof(*neg) + namesize);
+	neg->k = k;
+	neg->expire = expire;
+	memcpy(neg->name, name, namesize);
+
+	(void)avltree_insert(&neg->node, &entry->fsobj.fsdir.avl.neg);
+	entry->fsobj.fsdir.avl.nneg++;
+}
+
+/**
+ * @brief Check whether a name is known not to exist
+ *
+ * @note The content lock MUST be held
+ *
+ * @param[in] entry  The directory
+ * @param[in] name   The name to look up
+ *
+ * @return true if the name is cached as not existing and still valid.
+ */
+bool mdcache_avl_neg_lookup(mdcache_entry_t *entry, const char *name)
+{
+	struct mdcache_neg_entry *neg;
+
+	if (entry->fsobj.fsdir.avl.nneg == 0)
+		return false;
+
+	neg = avl_neg_find(entry, avl_neg_hash(name));
+	if (neg == NULL || strcmp(neg->name, name) != 0)
+		return false;
+
+	return neg->expire == 0 || time(NULL) < neg->expire;
+}
+
+/**
+ * @brief Forget that a name does not exist
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] entry  The directory
+ * @param[in] name   The name now existing
+ */
+void mdcache_avl_neg_remove(mdcache_entry_t *entry, const char *name)
+{
+	struct mdcache_neg_entry *neg;
+
+	if (entry->fsobj.fsdir.avl.nneg == 0)
+		return;
+
+	neg = avl_neg_find(entry, avl_neg_hash(name));
+	if (neg != NULL)
+		avl_neg_free(entry, neg);
+}
+
+/**
+ * @brief Forget all names known not to exist
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] entry  The directory
+ */
+void mdcache_avl_neg_clean(mdcache_entry_t *entry)
+{
+	struct avltree_node *node;
+
+	while ((node = avltree_first(&entry->fsobj.fsdir.avl.neg)))
+		avl_neg_free(entry, avltree_container_of(
+				node, struct mdcache_neg_entry, node));
+}
+
 /** @} */
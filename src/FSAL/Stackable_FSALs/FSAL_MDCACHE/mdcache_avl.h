@@ -143,6 +143,12 @@ mdcache_dir_entry_t *mdcache_avl_qp_lookup_s(mdcache_entry_t *entry,
 					     const char *name, int maxj);
 void mdcache_avl_clean_tree(struct avltree *tree);
 
+void mdcache_avl_neg_insert(mdcache_entry_t *entry, const char *name,
+			    time_t expire);
+bool mdcache_avl_neg_lookup(mdcache_entry_t *entry, const char *name);
+void mdcache_avl_neg_remove(mdcache_entry_t *entry, const char *name);
+void mdcache_avl_neg_clean(mdcache_entry_t *entry);
+
 void unchunk_dirent(mdcache_dir_entry_t *dirent);
 #endif				/* MDCACHE_AVL_H */
 
@@ -38,6 +38,14 @@
  * @{
  */
 
+/**
+ * @brief Replacement policy of the entry LRU
+ */
+enum mdcache_lru_policy {
+	LRU_POLICY_LRU, /*< Multi-level LRU */
+	LRU_POLICY_2Q, /*< Scan resistant 2Q with a ghost list */
+};
+
 /**
  * @brief Structure to hold MDCACHE paramaters
  */
@@ -46,12 +54,18 @@ struct mdcache_parameter {
 	/** Partitions in the Cache_Inode tree.  Defaults to 7,
 	 * settable with NParts. */
 	uint32_t nparts;
-	/** Per-partition hash table size.  Defaults to 32633,
-	 * settable with Cache_Size. */
+	/** Initial per-partition hash table size, rounded up to a
+	 * power of two, the tables grow with the number of entries.
+	 * Defaults to 32633, settable with Cache_Size. */
 	uint32_t cache_size;
 	/** Use getattr for directory invalidation.  Defaults to
 	    false.  Settable with Use_Getattr_Directory_Invalidation. */
 	bool getattr_dir_invalidation;
+	/** Keep attributes of exports whose FSAL reports every change
+	    by upcall until an upcall invalidates them, instead of
+	    expiring them.  Defaults to false, settable with
+	    Trust_Upcalls. */
+	bool trust_upcalls;
 	struct {
 		/** Max size of per-directory cache of removed
 		    entries */
@@ -62,13 +76,47 @@ struct mdcache_parameter {
 		 *  directory chunking is not enabled.
 		 */
 		uint32_t avl_chunk;
+		/** Number of chunks read ahead of a client listing a
+		 *  directory sequentially, 0 disables prefetch.
+		 */
+		uint32_t chunk_prefetch;
+		/** Number of threads refreshing the attributes of a
+		 *  chunk's entries concurrently for readdir, 0 refreshes
+		 *  them one by one.
+		 */
+		uint32_t attr_prefetch_threads;
+		/** Max number of names cached per directory as not
+		 *  existing, 0 disables the negative lookup cache.
+		 */
+		uint32_t avl_max_negative;
+		/** Max number of dirent chunks cached for all
+		 *  directories, the least recently used are freed above
+		 *  it.  0 means no limit.
+		 */
+		uint32_t max_chunks;
 	} dir;
 	/** High water mark for cache entries.  Defaults to 100000,
 	    settable by Entries_HWMark. */
 	uint32_t entries_hwmark;
+	/** Memory budget in bytes for cache entries, their keys and
+	    dirents.  When non-zero, entries are reclaimed against it
+	    instead of against entries_hwmark.  Defaults to 0, settable
+	    by Entries_Mem_Budget. */
+	uint64_t entries_mem_budget;
 	/** Base interval in seconds between runs of the LRU cleaner
 	    thread. Defaults to 60, settable with LRU_Run_Interval. */
 	time_t lru_run_interval;
+	/** Bytes read ahead of a sequential reader of a file, 0
+	    disables readahead.  Defaults to 0, settable with
+	    Readahead_Size. */
+	uint32_t readahead_size;
+	/** Memory in bytes all readahead windows may take together.
+	    Defaults to 64MiB, settable with Readahead_Max_Memory. */
+	uint64_t readahead_max_memory;
+	/** Largest run of contiguous unstable writes of a file gathered
+	    into one write, 0 disables gathering.  Defaults to 0,
+	    settable with Write_Gather_Size. */
+	uint32_t write_gather_size;
 	/** Whether to cache open files.  Defaults to true, settable
 	    with Cache_FDs. */
 	bool use_fd_cache;
@@ -103,11 +151,52 @@ struct mdcache_parameter {
 	    we disable caching, when in extremis.  Defaults to 8,
 	    settable with Futility_Count */
 	uint32_t futility_count;
+	/** Replacement policy for cache entries.  Defaults to LRU,
+	    settable with LRU_Policy. */
+	enum mdcache_lru_policy lru_policy;
+	/** With the 2Q policy, the share of Entries_HWMark (in
+	    percent) that entries referenced only once may occupy
+	    before they are reclaimed first.  Defaults to 25, settable
+	    with LRU_2Q_In_Percent. */
+	uint32_t lru_2q_in_percent;
+	/** With the 2Q policy, the number of recently reclaimed
+	    entries remembered, as a percentage of Entries_HWMark.
+	    Defaults to 50, settable with LRU_2Q_Ghost_Percent. */
+	uint32_t lru_2q_ghost_percent;
 	/** Behavior for when readdir fails for some reason:
 	    true will ask the client to retry later, false will give the
 	    client a partial reply based on what we have.
 	    Defaults to false, settable with Retry_Readdir */
 	bool retry_readdir;
+	/** File the handles of the hottest entries are saved to at
+	    shutdown and prewarmed from at startup.  Defaults to NULL
+	    (no snapshot), settable with Snapshot_File. */
+	char *snapshot_file;
+	/** Maximum number of entries saved in the snapshot.  Defaults
+	    to 65536, settable with Snapshot_Entries. */
+	uint32_t snapshot_entries;
+	/** File the dirents of reaped directories are spilled to, to be
+	    restored if the directory is cached again unchanged.  Defaults
+	    to NULL (no spilling), settable with Spill_File. */
+	char *spill_file;
+	/** Size of the spill file.  Defaults to 1 GiB, settable with
+	    Spill_Size. */
+	uint64_t spill_size;
+	/** Seconds past their expiry that attributes are still served
+	    while one refresh runs in the background.  Defaults to 0
+	    (refresh inline), settable with Attr_Stale_Grace. */
+	uint32_t attr_stale_grace;
+	/** Shortest expiry, in seconds, adaptive expiry lowers an entry
+	    to.  Defaults to 1, settable with Attr_Expiration_Min. */
+	uint32_t attr_expiration_min;
+	/** Longest expiry, in seconds, adaptive expiry raises an entry
+	    to.  Defaults to 0 (adaptive expiry off), settable with
+	    Attr_Expiration_Max. */
+	uint32_t attr_expiration_max;
+	/** Tear down entries whose last reference is dropped in a
+	    background thread rather than in the thread dropping it.
+	    Defaults to false, settable with Deferred_Cleanup. */
+	bool deferred_cleanup;
 };
 
 extern struct mdcache_parameter mdcache_param;
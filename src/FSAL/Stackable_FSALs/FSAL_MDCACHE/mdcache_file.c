@@ -33,6 +33,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include "FSAL/fsal_commonlib.h"
+#include "sal_functions.h"
 #include "mdcache_int.h"
 #include "mdcache_lru.h"
 
@@ -244,6 +245,8 @@ fsal_status_t mdcache_write(struct fsal_obj_handle *obj_hdl, uint64_t offset,
 			write_amount, fsal_stable)
 	       );
 
+	mdc_ra_invalidate(entry);
+
 	if (status.major == ERR_FSAL_DELAY)
 		mdcache_kill_entry(entry);
 	else if (!FSAL_IS_ERROR(status))
@@ -434,13 +437,18 @@ fsal_status_t mdcache_close(struct fsal_obj_handle *obj_hdl)
 {
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
-	fsal_status_t status;
+	fsal_status_t status, wg_status;
+
+	wg_status = mdc_wg_flush(entry);
 
 	/* XXX dang caching FDs?  How does it interact with multi-FD */
 	subcall(
 		status = entry->sub_handle->obj_ops.close(entry->sub_handle)
 	       );
 
+	if (!FSAL_IS_ERROR(status))
+		status = wg_status;
+
 	return status;
 }
 
@@ -514,6 +522,7 @@ static fsal_status_t mdc_open2_by_name(mdcache_entry_t *mdc_parent,
 			/* Invalidate the attributes since we just truncated. */
 			atomic_clear_uint32_t_bits(&entry->mde_flags,
 						   MDCACHE_TRUST_ATTRS);
+			mdc_ra_invalidate(entry);
 		}
 		*new_entry = entry;
 	}
@@ -643,6 +652,15 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 		}
 	}
 
+	/* A create by name changes the directory: other clients'
+	 * delegations of it go first.
+	 */
+	if (name != NULL && createmode != FSAL_NO_CREATE &&
+	    state_dir_deleg_conflict(obj_hdl)) {
+		*new_obj = NULL;
+		return fsalstat(ERR_FSAL_DELAY, 0);
+	}
+
 	/* Ask for all supported attributes except ACL (we defer fetching ACL
 	 * until asked for it (including a permission check).
 	 *
@@ -800,6 +818,7 @@ fsal_status_t mdcache_reopen2(struct fsal_obj_handle *obj_hdl,
 	if (truncated && !FSAL_IS_ERROR(status)) {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_ra_invalidate(entry);
 	}
 
 	return status;
@@ -808,7 +827,7 @@ fsal_status_t mdcache_reopen2(struct fsal_obj_handle *obj_hdl,
 /**
  * @brief Read from a file (new style)
  *
- * Delegate to sub-FSAL
+ * Serve from the readahead window if possible, else delegate to sub-FSAL
  *
  * @param[in] obj_hdl	Object owning state
  * @param[in] bypass	Bypass deny read
@@ -833,7 +852,23 @@ fsal_status_t mdcache_read2(struct fsal_obj_handle *obj_hdl,
 {
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct iovec iov = {buffer, buf_size};
 	fsal_status_t status;
+	bool served;
+
+	mdcache_lru_fd_touch(entry);
+
+	/* Reads see gathered writes */
+	(void) mdc_wg_flush(entry);
+
+	/* READ_PLUS wants holes reported, leave those to the FSAL */
+	served = info == NULL &&
+		 mdc_ra_read(entry, offset, &iov, 1, read_amount, eof);
+	mdc_ra_advance(entry, offset, &iov, 1);
+	if (served) {
+		mdc_set_time_current(&entry->attrs.atime);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
 
 	subcall(
 		status = entry->sub_handle->obj_ops.read2(
@@ -849,10 +884,264 @@ fsal_status_t mdcache_read2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief Read from a file into a list of buffers (new style)
+ *
+ * Serve from the readahead window if possible, else delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl	Object owning state
+ * @param[in] bypass	Bypass any non-mandatory deny read
+ * @param[in] state	Open file state to read
+ * @param[in] offset	Offset into file
+ * @param[in,out] iov	Buffers to read into
+ * @param[in] iovcnt	Number of buffers in iov
+ * @param[out] read_amount	Amount read in bytes
+ * @param[out] eof	true if End of File was hit
+ * @return FSAL status
+ */
+fsal_status_t mdcache_readv2(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     struct iovec *iov,
+			     int iovcnt,
+			     size_t *read_amount,
+			     bool *eof)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+	bool served;
+
+	(void) mdc_wg_flush(entry);
+
+	served = mdc_ra_read(entry, offset, iov, iovcnt, read_amount, eof);
+	mdc_ra_advance(entry, offset, iov, iovcnt);
+	if (served) {
+		mdc_set_time_current(&entry->attrs.atime);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	subcall(
+		status = entry->sub_handle->obj_ops.readv2(
+			entry->sub_handle, bypass, state, offset, iov, iovcnt,
+			read_amount, eof)
+	       );
+
+	if (!FSAL_IS_ERROR(status))
+		mdc_set_time_current(&entry->attrs.atime);
+	else if (status.major == ERR_FSAL_DELAY)
+		mdcache_kill_entry(entry);
+
+	return status;
+}
+
+/**
+ * @brief Get a descriptor to read a range of a file from
+ *
+ * Gathered writes are flushed first, so that the descriptor sees
+ * them.  The read-ahead buffers are not used.
+ *
+ * @param[in]  obj_hdl     File to read
+ * @param[in]  bypass      Bypass any non-mandatory deny read
+ * @param[in]  state       state_t to use for this operation
+ * @param[in]  offset      Position at which to read
+ * @param[in]  size        Amount of data to read
+ * @param[out] fd          Descriptor to read from
+ * @param[out] read_amount Amount of data that can be read
+ * @param[out] eof         true if the range reaches end of file
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_read_fd(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct state_t *state,
+			      uint64_t offset,
+			      size_t size,
+			      int *fd,
+			      size_t *read_amount,
+			      bool *eof)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	(void) mdc_wg_flush(entry);
+
+	subcall(
+		status = entry->sub_handle->obj_ops.read_fd(
+			entry->sub_handle, bypass, state, offset, size, fd,
+			read_amount, eof)
+	       );
+
+	if (!FSAL_IS_ERROR(status))
+		mdc_set_time_current(&entry->attrs.atime);
+	else if (status.major == ERR_FSAL_DELAY)
+		mdcache_kill_entry(entry);
+
+	return status;
+}
+
+/**
+ * @brief State carried across an asynchronous sub-FSAL I/O
+ */
+struct mdc_async_arg {
+	mdcache_entry_t *entry;		/*< Entry the I/O is done on */
+	fsal_async_cb done_cb;		/*< Caller's completion callback */
+	void *caller_arg;		/*< Caller's callback argument */
+};
+
+/**
+ * @brief Completion of an asynchronous read on the sub-FSAL
+ */
+static void mdc_read2_async_cb(struct fsal_obj_handle *sub_hdl,
+			       fsal_status_t ret,
+			       struct fsal_io_arg *io_arg,
+			       void *caller_arg)
+{
+	struct mdc_async_arg *arg = caller_arg;
+	mdcache_entry_t *entry = arg->entry;
+
+	if (!FSAL_IS_ERROR(ret))
+		mdc_set_time_current(&entry->attrs.atime);
+	else if (ret.major == ERR_FSAL_DELAY)
+		mdcache_kill_entry(entry);
+
+	arg->done_cb(&entry->obj_handle, ret, io_arg, arg->caller_arg);
+	gsh_free(arg);
+}
+
+/**
+ * @brief Completion of an asynchronous write on the sub-FSAL
+ */
+static void mdc_write2_async_cb(struct fsal_obj_handle *sub_hdl,
+				fsal_status_t ret,
+				struct fsal_io_arg *io_arg,
+				void *caller_arg)
+{
+	struct mdc_async_arg *arg = caller_arg;
+	mdcache_entry_t *entry = arg->entry;
+
+	mdc_ra_invalidate(entry);
+
+	if (ret.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(entry);
+	else
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+
+	arg->done_cb(&entry->obj_handle, ret, io_arg, arg->caller_arg);
+	gsh_free(arg);
+}
+
+/**
+ * @brief Submit an asynchronous read
+ *
+ * Reads served from the readahead window complete at once.  Others
+ * are delegated to sub-FSAL, the completion is forwarded to the
+ * caller once the cache has been updated.
+ *
+ * @param[in] obj_hdl	Object to read
+ * @param[in] bypass	Bypass any non-mandatory deny read
+ * @param[in,out] io_arg	I/O description and results
+ * @param[in] done_cb	Caller's completion callback
+ * @param[in] caller_arg	Argument for done_cb
+ */
+void mdcache_read2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct fsal_io_arg *io_arg,
+			 fsal_async_cb done_cb,
+			 void *caller_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_async_arg *arg;
+	bool served;
+
+	mdcache_lru_fd_touch(entry);
+
+	(void) mdc_wg_flush(entry);
+
+	served = mdc_ra_read(entry, io_arg->offset, io_arg->iov,
+			     io_arg->iovcnt, &io_arg->io_amount,
+			     &io_arg->end_of_file);
+	mdc_ra_advance(entry, io_arg->offset, io_arg->iov, io_arg->iovcnt);
+	if (served) {
+		mdc_set_time_current(&entry->attrs.atime);
+		done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), io_arg,
+			caller_arg);
+		return;
+	}
+
+	arg = gsh_malloc(sizeof(*arg));
+	arg->entry = entry;
+	arg->done_cb = done_cb;
+	arg->caller_arg = caller_arg;
+
+	subcall(
+		entry->sub_handle->obj_ops.read2_async(
+			entry->sub_handle, bypass, io_arg,
+			mdc_read2_async_cb, arg)
+	       );
+}
+
+/**
+ * @brief Submit an asynchronous write
+ *
+ * Gathered writes complete at once.  Others are delegated to sub-FSAL,
+ * the completion is forwarded to the caller once the cache has been
+ * updated.
+ *
+ * @param[in] obj_hdl	Object to write
+ * @param[in] bypass	Bypass any non-mandatory deny write
+ * @param[in,out] io_arg	I/O description and results
+ * @param[in] done_cb	Caller's completion callback
+ * @param[in] caller_arg	Argument for done_cb
+ */
+void mdcache_write2_async(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct fsal_io_arg *io_arg,
+			  fsal_async_cb done_cb,
+			  void *caller_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_async_arg *arg;
+	fsal_status_t status;
+
+	mdcache_lru_fd_touch(entry);
+
+	if (io_arg->iovcnt != 1) {
+		/* Not gathered, but must follow what was */
+		status = mdc_wg_flush(entry);
+		if (FSAL_IS_ERROR(status)) {
+			done_cb(obj_hdl, status, io_arg, caller_arg);
+			return;
+		}
+	} else if (mdc_wg_write(entry, bypass, io_arg->state, io_arg->offset,
+				io_arg->iov[0].iov_len,
+				io_arg->iov[0].iov_base, &io_arg->io_amount,
+				&io_arg->fsal_stable, &status)) {
+		done_cb(obj_hdl, status, io_arg, caller_arg);
+		return;
+	}
+
+	arg = gsh_malloc(sizeof(*arg));
+	arg->entry = entry;
+	arg->done_cb = done_cb;
+	arg->caller_arg = caller_arg;
+
+	subcall(
+		entry->sub_handle->obj_ops.write2_async(
+			entry->sub_handle, bypass, io_arg,
+			mdc_write2_async_cb, arg)
+	       );
+}
+
 /**
  * @brief Write to a file (new style)
  *
- * Delegate to sub-FSAL
+ * Gather small unstable writes, delegate others to sub-FSAL
  *
  * @param[in] obj_hdl	Object owning state
  * @param[in] bypass	Bypass any non-mandatory deny write
@@ -879,12 +1168,26 @@ fsal_status_t mdcache_write2(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
+	mdcache_lru_fd_touch(entry);
+
+	if (info != NULL) {
+		/* WRITE_PLUS goes straight through, after what it follows */
+		status = mdc_wg_flush(entry);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	} else if (mdc_wg_write(entry, bypass, state, offset, buf_size,
+				buffer, write_amount, fsal_stable, &status)) {
+		return status;
+	}
+
 	subcall(
 		status = entry->sub_handle->obj_ops.write2(
 			entry->sub_handle, bypass, state, offset, buf_size,
 			buffer, write_amount, fsal_stable, info)
 	       );
 
+	mdc_ra_invalidate(entry);
+
 	if (status.major == ERR_FSAL_STALE)
 		mdcache_kill_entry(entry);
 	else
@@ -955,7 +1258,8 @@ fsal_status_t mdcache_io_advise2(struct fsal_obj_handle *obj_hdl,
 /**
  * @brief Commit to a file (new style)
  *
- * Delegate to sub-FSAL
+ * Write out gathered data, then sync through sub-FSAL, sharing the sync
+ * with concurrent COMMITs of the file.
  *
  * @param[in] obj_hdl	Object to commit
  * @param[in] offset	Offset into file
@@ -969,10 +1273,15 @@ fsal_status_t mdcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
-	subcall(
-		status = entry->sub_handle->obj_ops.commit2(
-			entry->sub_handle, offset, len)
-	       );
+	mdcache_lru_fd_touch(entry);
+
+	if (obj_hdl->type == REGULAR_FILE)
+		status = mdc_wg_commit(entry, offset, len);
+	else
+		subcall(
+			status = entry->sub_handle->obj_ops.commit2(
+				entry->sub_handle, offset, len)
+		       );
 
 	if (status.major == ERR_FSAL_STALE)
 		mdcache_kill_entry(entry);
@@ -983,6 +1292,113 @@ fsal_status_t mdcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 	return status;
 }
 
+/**
+ * @brief Copy a range of a file into another file
+ *
+ * Write out data gathered on either file, then delegate to sub-FSAL.
+ * Whatever is cached of the destination is stale afterwards.
+ *
+ * @param[in]  src_hdl		File to copy from
+ * @param[in]  src_state	state_t to read with
+ * @param[in]  src_offset	Where to start reading
+ * @param[in]  dst_hdl		File to copy to
+ * @param[in]  dst_state	state_t to write with
+ * @param[in]  dst_offset	Where to start writing
+ * @param[in]  count		Bytes to copy
+ * @param[out] copied		Bytes copied
+ * @return FSAL status
+ */
+fsal_status_t mdcache_copy2(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state,
+			    uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state,
+			    uint64_t dst_offset,
+			    uint64_t count,
+			    uint64_t *copied)
+{
+	mdcache_entry_t *src =
+		container_of(src_hdl, mdcache_entry_t, obj_handle);
+	mdcache_entry_t *dst =
+		container_of(dst_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	status = mdc_wg_flush(src);
+	if (FSAL_IS_ERROR(status))
+		return status;
+	status = mdc_wg_flush(dst);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	subcall(
+		status = src->sub_handle->obj_ops.copy2(
+			src->sub_handle, src_state, src_offset,
+			dst->sub_handle, dst_state, dst_offset, count, copied)
+	       );
+
+	mdc_ra_invalidate(dst);
+
+	if (status.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(dst);
+	else
+		atomic_clear_uint32_t_bits(&dst->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+
+	return status;
+}
+
+/**
+ * @brief Share a range of a file with another file
+ *
+ * Write out data gathered on either file, then delegate to sub-FSAL.
+ *
+ * @param[in] src_hdl		File to clone from
+ * @param[in] src_state		state_t to read with
+ * @param[in] src_offset	Start of the source range
+ * @param[in] dst_hdl		File to clone to
+ * @param[in] dst_state		state_t to write with
+ * @param[in] dst_offset	Start of the destination range
+ * @param[in] count		Length of the range, 0 for up to end of file
+ * @return FSAL status
+ */
+fsal_status_t mdcache_clone2(struct fsal_obj_handle *src_hdl,
+			     struct state_t *src_state,
+			     uint64_t src_offset,
+			     struct fsal_obj_handle *dst_hdl,
+			     struct state_t *dst_state,
+			     uint64_t dst_offset,
+			     uint64_t count)
+{
+	mdcache_entry_t *src =
+		container_of(src_hdl, mdcache_entry_t, obj_handle);
+	mdcache_entry_t *dst =
+		container_of(dst_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	status = mdc_wg_flush(src);
+	if (FSAL_IS_ERROR(status))
+		return status;
+	status = mdc_wg_flush(dst);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	subcall(
+		status = src->sub_handle->obj_ops.clone2(
+			src->sub_handle, src_state, src_offset,
+			dst->sub_handle, dst_state, dst_offset, count)
+	       );
+
+	mdc_ra_invalidate(dst);
+
+	if (status.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(dst);
+	else
+		atomic_clear_uint32_t_bits(&dst->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+
+	return status;
+}
+
 /**
  * @brief Lock/unlock a range in a file (new style)
  *
@@ -1007,6 +1423,8 @@ fsal_status_t mdcache_lock_op2(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
+	mdcache_lru_fd_touch(entry);
+
 	subcall(
 		status = entry->sub_handle->obj_ops.lock_op2(
 			entry->sub_handle, state, p_owner, lock_op, req_lock,
@@ -1028,13 +1446,18 @@ fsal_status_t mdcache_close2(struct fsal_obj_handle *obj_hdl,
 {
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
-	fsal_status_t status;
+	fsal_status_t status, wg_status;
+
+	wg_status = mdc_wg_flush(entry);
 
 	subcall(
 		status = entry->sub_handle->obj_ops.close2(
 			  entry->sub_handle, state)
 	       );
 
+	if (!FSAL_IS_ERROR(status))
+		status = wg_status;
+
 	if ((entry->mde_flags & MDCACHE_UNREACHABLE) &&
 	    !mdc_has_state(entry)) {
 		/* Entry was marked unreachable, and last state is gone */
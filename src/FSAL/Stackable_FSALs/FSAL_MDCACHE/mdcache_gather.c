@@ -0,0 +1,347 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_gather.c
+ * @brief Write gathering and COMMIT coalescing
+ *
+ * Unstable writes that each start where the previous one ended are
+ * gathered, up to Write_Gather_Size bytes, and reach the sub-FSAL as
+ * one write.  Gathered data is written out before anything that could
+ * see the file without it: a read, an attribute refresh, a setattr, a
+ * COMMIT or a close.  Being unstable, it may still be lost on a crash
+ * like any data not yet committed, and the write verifier tells the
+ * client so.
+ *
+ * COMMITs of a file are collapsed: while a sync is in flight, later
+ * COMMITs wait and are all answered by the one sync started next.
+ */
+
+#include "config.h"
+#include <string.h>
+#include "fsal.h"
+#include "sal_functions.h"
+#include "mdcache_int.h"
+
+static void mdc_wg_save_creds(struct mdc_gather *wg)
+{
+	gsh_free(wg->creds.caller_garray);
+	memset(&wg->creds, 0, sizeof(wg->creds));
+
+	if (op_ctx->creds == NULL)
+		return;
+
+	wg->creds = *op_ctx->creds;
+	if (wg->creds.caller_glen != 0) {
+		wg->creds.caller_garray =
+			gsh_malloc(wg->creds.caller_glen * sizeof(gid_t));
+		memcpy(wg->creds.caller_garray,
+		       op_ctx->creds->caller_garray,
+		       wg->creds.caller_glen * sizeof(gid_t));
+	} else {
+		wg->creds.caller_garray = NULL;
+	}
+}
+
+static inline bool mdc_wg_same_creds(struct mdc_gather *wg)
+{
+	if (op_ctx->creds == NULL)
+		return wg->creds.caller_uid == 0 && wg->creds.caller_gid == 0;
+
+	return wg->creds.caller_uid == op_ctx->creds->caller_uid &&
+	       wg->creds.caller_gid == op_ctx->creds->caller_gid;
+}
+
+/**
+ * @brief Initialize the gathering state of a file
+ *
+ * @param[in] entry	Regular file entry
+ */
+void mdc_wg_init(mdcache_entry_t *entry)
+{
+	struct mdc_gather *wg = &entry->fsobj.fsfile.wg;
+
+	memset(wg, 0, sizeof(*wg));
+	PTHREAD_MUTEX_init(&wg->mtx, NULL);
+	PTHREAD_COND_init(&wg->cv, NULL);
+}
+
+/**
+ * @brief Release the gathering state of a file
+ *
+ * Gathered data is written out by close, which the LRU does on every
+ * file before it is reclaimed, so nothing should be left here.
+ *
+ * @param[in] entry	Regular file entry
+ */
+void mdc_wg_destroy(mdcache_entry_t *entry)
+{
+	struct mdc_gather *wg = &entry->fsobj.fsfile.wg;
+
+	if (wg->len != 0)
+		LogCrit(COMPONENT_CACHE_INODE,
+			"Entry %p dropped %zu gathered bytes", entry, wg->len);
+
+	if (wg->state != NULL)
+		dec_state_t_ref(wg->state);
+	gsh_free(wg->buf);
+	gsh_free(wg->creds.caller_garray);
+	PTHREAD_COND_destroy(&wg->cv);
+	PTHREAD_MUTEX_destroy(&wg->mtx);
+}
+
+/**
+ * @brief Write out gathered data
+ *
+ * A failure is kept to be returned by the next COMMIT as well, since
+ * the writers of the data were told it was written.
+ *
+ * @note wg->mtx MUST be held
+ *
+ * @param[in] entry	Regular file entry
+ *
+ * @return FSAL status of the write
+ */
+static fsal_status_t mdc_wg_flush_locked(mdcache_entry_t *entry)
+{
+	struct mdc_gather *wg = &entry->fsobj.fsfile.wg;
+	fsal_status_t status = {0, 0};
+	struct user_cred *save_creds = op_ctx->creds;
+	size_t done = 0, written;
+	bool stable;
+
+	op_ctx->creds = &wg->creds;
+	while (done < wg->len) {
+		written = 0;
+		stable = false;
+		subcall(
+			status = entry->sub_handle->obj_ops.write2(
+				entry->sub_handle, wg->bypass, wg->state,
+				wg->offset + done, wg->len - done,
+				wg->buf + done, &written, &stable, NULL)
+		       );
+		if (FSAL_IS_ERROR(status))
+			break;
+		if (written == 0) {
+			status = fsalstat(ERR_FSAL_IO, 0);
+			break;
+		}
+		done += written;
+	}
+	op_ctx->creds = save_creds;
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Writing %zu gathered bytes at %" PRIu64 " failed: %s",
+			 wg->len, wg->offset, fsal_err_txt(status));
+		wg->error = status;
+	}
+
+	if (wg->state != NULL) {
+		dec_state_t_ref(wg->state);
+		wg->state = NULL;
+	}
+	atomic_store_size_t(&wg->len, 0);
+	gsh_free(wg->buf);
+	wg->buf = NULL;
+
+	mdc_ra_invalidate(entry);
+	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_ATTRS);
+
+	return status;
+}
+
+/**
+ * @brief Write out gathered data, if any
+ *
+ * @param[in] entry	Entry, of any type
+ *
+ * @return FSAL status of the write
+ */
+fsal_status_t mdc_wg_flush(mdcache_entry_t *entry)
+{
+	struct mdc_gather *wg = &entry->fsobj.fsfile.wg;
+	fsal_status_t status = {0, 0};
+
+	if (entry->obj_handle.type != REGULAR_FILE ||
+	    atomic_fetch_size_t(&wg->len) == 0)
+		return status;
+
+	PTHREAD_MUTEX_lock(&wg->mtx);
+	if (wg->len != 0)
+		status = mdc_wg_flush_locked(entry);
+	PTHREAD_MUTEX_unlock(&wg->mtx);
+
+	return status;
+}
+
+/**
+ * @brief Try to gather an unstable write
+ *
+ * @param[in]     entry		Regular file entry
+ * @param[in]     bypass	Bypass any non-mandatory deny write
+ * @param[in]     state		Open file state to write with
+ * @param[in]     offset	Offset of the write
+ * @param[in]     buf_size	Size of the write
+ * @param[in]     buffer	Data to write
+ * @param[out]    write_amount	Bytes written
+ * @param[in,out] fsal_stable	Stability asked for, and given
+ * @param[out]    status	Status of the write, if gathered
+ *
+ * @return true if the write was gathered, false if it is for the
+ *         caller to pass on.
+ */
+bool mdc_wg_write(mdcache_entry_t *entry, bool bypass, struct state_t *state,
+		  uint64_t offset, size_t buf_size, void *buffer,
+		  size_t *write_amount, bool *fsal_stable,
+		  fsal_status_t *status)
+{
+	struct mdc_gather *wg = &entry->fsobj.fsfile.wg;
+	size_t max = mdcache_param.write_gather_size;
+
+	*status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	if (*fsal_stable || buf_size == 0 || buf_size >= max) {
+		/* Keep the order of writes */
+		*status = mdc_wg_flush(entry);
+		return FSAL_IS_ERROR(*status);
+	}
+
+	PTHREAD_MUTEX_lock(&wg->mtx);
+
+	if (wg->len != 0 &&
+	    (wg->state != state || wg->bypass != bypass ||
+	     offset != wg->offset + wg->len || wg->len + buf_size > max ||
+	     !mdc_wg_same_creds(wg))) {
+		*status = mdc_wg_flush_locked(entry);
+		if (FSAL_IS_ERROR(*status)) {
+			PTHREAD_MUTEX_unlock(&wg->mtx);
+			return true;
+		}
+	}
+
+	if (wg->len == 0) {
+		wg->buf = gsh_malloc(max);
+		wg->state = state;
+		if (state != NULL)
+			inc_state_t_ref(state);
+		wg->bypass = bypass;
+		wg->offset = offset;
+		mdc_wg_save_creds(wg);
+	}
+
+	memcpy(wg->buf + wg->len, buffer, buf_size);
+	atomic_add_size_t(&wg->len, buf_size);
+	*write_amount = buf_size;
+	*fsal_stable = false;
+
+	mdc_ra_invalidate(entry);
+	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_ATTRS);
+
+	if (wg->len == max)
+		*status = mdc_wg_flush_locked(entry);
+
+	PTHREAD_MUTEX_unlock(&wg->mtx);
+
+	return true;
+}
+
+/**
+ * @brief Commit a file, sharing syncs with concurrent COMMITs
+ *
+ * A COMMIT is answered by the first sync started after it arrived,
+ * covering the union of the ranges asked for by all the COMMITs
+ * waiting for it.
+ *
+ * @param[in] entry	Regular file entry
+ * @param[in] offset	Start of the range to commit
+ * @param[in] len	Length of the range, 0 for all of the file
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdc_wg_commit(mdcache_entry_t *entry, off_t offset, size_t len)
+{
+	struct mdc_gather *wg = &entry->fsobj.fsfile.wg;
+	fsal_status_t status = {0, 0};
+	uint64_t target, mine, lo, hi;
+
+	PTHREAD_MUTEX_lock(&wg->mtx);
+
+	if (wg->len != 0)
+		(void) mdc_wg_flush_locked(entry);
+
+	/* Ask for the next sync, and widen it to our range */
+	target = wg->started + 1;
+	hi = len == 0 ? UINT64_MAX : offset + len;
+	if (!wg->want) {
+		wg->lo = offset;
+		wg->hi = hi;
+		wg->want = true;
+	} else {
+		if ((uint64_t)offset < wg->lo)
+			wg->lo = offset;
+		if (hi > wg->hi)
+			wg->hi = hi;
+	}
+
+	while (wg->done < target) {
+		if (wg->syncing) {
+			pthread_cond_wait(&wg->cv, &wg->mtx);
+			continue;
+		}
+
+		wg->syncing = true;
+		mine = ++wg->started;
+		lo = wg->lo;
+		hi = wg->hi;
+		wg->want = false;
+		PTHREAD_MUTEX_unlock(&wg->mtx);
+
+		subcall(
+			status = entry->sub_handle->obj_ops.commit2(
+				entry->sub_handle, lo,
+				hi == UINT64_MAX ? 0 : hi - lo)
+		       );
+
+		PTHREAD_MUTEX_lock(&wg->mtx);
+		wg->last = status;
+		wg->done = mine;
+		wg->syncing = false;
+		pthread_cond_broadcast(&wg->cv);
+	}
+
+	status = wg->last;
+	if (!FSAL_IS_ERROR(status) && FSAL_IS_ERROR(wg->error)) {
+		status = wg->error;
+		wg->error = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	PTHREAD_MUTEX_unlock(&wg->mtx);
+
+	return status;
+}
+
+/** @} */
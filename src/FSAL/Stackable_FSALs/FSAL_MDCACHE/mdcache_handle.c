@@ -39,6 +39,7 @@
 #include "nfs_exports.h"
 #include "sal_functions.h"
 #include <os/subr.h>
+#include "fridgethr.h"
 
 #include "mdcache_lru.h"
 #include "mdcache_hash.h"
@@ -97,6 +98,11 @@ fsal_status_t mdcache_alloc_and_check_handle(
 	fsal_status_t status;
 	mdcache_entry_t *new_entry;
 
+	if (*invalidate) {
+		/* A create rather than a lookup */
+		mdc_dir_ns_changed(parent);
+	}
+
 	status = mdcache_new_entry(export, sub_handle, attrs_in, attrs_out,
 				   new_directory, &new_entry, state);
 
@@ -206,6 +212,10 @@ static fsal_status_t mdcache_create(struct fsal_obj_handle *dir_hdl,
 	struct attrlist attrs;
 	bool invalidate = true;
 
+	/* Other clients' delegations of the directory go first */
+	if (state_dir_deleg_conflict(dir_hdl))
+		return fsalstat(ERR_FSAL_DELAY, 0);
+
 	/* Ask for all supported attributes except ACL (we defer fetching ACL
 	 * until asked for it (including a permission check).
 	 */
@@ -284,6 +294,10 @@ static fsal_status_t mdcache_mkdir(struct fsal_obj_handle *dir_hdl,
 
 	*handle = NULL;
 
+	/* Other clients' delegations of the directory go first */
+	if (state_dir_deleg_conflict(dir_hdl))
+		return fsalstat(ERR_FSAL_DELAY, 0);
+
 	/* Ask for all supported attributes except ACL (we defer fetching ACL
 	 * until asked for it (including a permission check).
 	 */
@@ -364,6 +378,10 @@ static fsal_status_t mdcache_mknode(struct fsal_obj_handle *dir_hdl,
 
 	*handle = NULL;
 
+	/* Other clients' delegations of the directory go first */
+	if (state_dir_deleg_conflict(dir_hdl))
+		return fsalstat(ERR_FSAL_DELAY, 0);
+
 	/* Ask for all supported attributes except ACL (we defer fetching ACL
 	 * until asked for it (including a permission check).
 	 */
@@ -445,6 +463,10 @@ static fsal_status_t mdcache_symlink(struct fsal_obj_handle *dir_hdl,
 
 	*handle = NULL;
 
+	/* Other clients' delegations of the directory go first */
+	if (state_dir_deleg_conflict(dir_hdl))
+		return fsalstat(ERR_FSAL_DELAY, 0);
+
 	/* Ask for all supported attributes except ACL (we defer fetching ACL
 	 * until asked for it (including a permission check).
 	 */
@@ -497,9 +519,37 @@ static fsal_status_t mdcache_symlink(struct fsal_obj_handle *dir_hdl,
 	return status;
 }
 
+/**
+ * @brief Copy out the cached target of a symlink
+ *
+ * @note The caller MUST hold the content_lock
+ *
+ * @param[in] entry		The symlink
+ * @param[out] link_content	Buffer to fill with link contents
+ * @return true if the cached target was copied.
+ */
+static bool mdc_readlink_cached(mdcache_entry_t *entry,
+				struct gsh_buffdesc *link_content)
+{
+	struct gsh_buffdesc *link = &entry->fsobj.fssym.link;
+
+	if (!(entry->mde_flags & MDCACHE_TRUST_CONTENT) || link->addr == NULL)
+		return false;
+
+	link_content->len = link->len;
+	link_content->addr = gsh_malloc(link->len);
+	memcpy(link_content->addr, link->addr, link->len);
+
+	return true;
+}
+
 /**
  * @brief Read a symlink
  *
+ * The target is cached in the entry, and served for as long as the
+ * attributes are valid.  An invalidate from FSAL_UP clears
+ * MDCACHE_TRUST_CONTENT, which stops it being served.
+ *
  * @param[in] obj_hdl	Handle for symlink
  * @param[out] link_content	Buffer to fill with link contents
  * @param[in] refresh	If true, refresh attributes on symlink
@@ -511,28 +561,44 @@ static fsal_status_t mdcache_readlink(struct fsal_obj_handle *obj_hdl,
 {
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct gsh_buffdesc *link = &entry->fsobj.fssym.link;
 	fsal_status_t status;
+	bool attrs_valid;
+
+	/* attr_lock is not taken under the content_lock */
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+	attrs_valid = mdcache_is_attrs_valid(entry, ATTR_CHANGE);
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
 
 	PTHREAD_RWLOCK_rdlock(&entry->content_lock);
-	if (!refresh && !(entry->mde_flags & MDCACHE_TRUST_CONTENT)) {
-		/* Our data are stale.  Drop the lock, get a
-		   write-lock, load in new data, and copy it out to
-		   the caller. */
+	if (!refresh && attrs_valid &&
+	    mdc_readlink_cached(entry, link_content)) {
 		PTHREAD_RWLOCK_unlock(&entry->content_lock);
-		PTHREAD_RWLOCK_wrlock(&entry->content_lock);
-		/* Make sure nobody updated the content while we were
-		   waiting. */
-		refresh = !(entry->mde_flags & MDCACHE_TRUST_CONTENT);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 	}
 
+	/* The copy is replaced, so get a write-lock. */
+	PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+	/* Make sure nobody updated the content while we were
+	   waiting. */
+	if (!refresh)
+		refresh = !(entry->mde_flags & MDCACHE_TRUST_CONTENT);
+
 	subcall(
 		status = entry->sub_handle->obj_ops.readlink(
 			entry->sub_handle, link_content, refresh)
 	       );
 
-	if (refresh && !(FSAL_IS_ERROR(status)))
-		atomic_set_uint32_t_bits(&entry->mde_flags,
-					 MDCACHE_TRUST_CONTENT);
+	if (!FSAL_IS_ERROR(status)) {
+		gsh_free(link->addr);
+		link->len = link_content->len;
+		link->addr = gsh_malloc(link->len);
+		memcpy(link->addr, link_content->addr, link->len);
+		if (refresh)
+			atomic_set_uint32_t_bits(&entry->mde_flags,
+						 MDCACHE_TRUST_CONTENT);
+	}
 
 	PTHREAD_RWLOCK_unlock(&entry->content_lock);
 
@@ -567,6 +633,10 @@ static fsal_status_t mdcache_link(struct fsal_obj_handle *obj_hdl,
 		return fsalstat(ERR_FSAL_XDEV, 0);
 	}
 
+	/* Other clients' delegations of the directory go first */
+	if (state_dir_deleg_conflict(destdir_hdl))
+		return fsalstat(ERR_FSAL_DELAY, 0);
+
 	subcall(
 		status = entry->sub_handle->obj_ops.link(
 			entry->sub_handle, dest->sub_handle, name)
@@ -581,6 +651,8 @@ static fsal_status_t mdcache_link(struct fsal_obj_handle *obj_hdl,
 
 	PTHREAD_RWLOCK_wrlock(&dest->content_lock);
 
+	mdc_dir_ns_changed(dest);
+
 	/* Add this entry to the directory (also takes an internal ref)
 	 */
 	status = mdcache_dirent_add(dest, name, entry, &invalidate);
@@ -650,7 +722,7 @@ static fsal_status_t mdcache_readdir(struct fsal_obj_handle *dir_hdl,
 
 		return mdcache_readdir_chunked(directory,
 					       whence ? *whence : (uint64_t) 0,
-					       dir_state, cb, attrmask,
+					       dir_state, cb, NULL, attrmask,
 					       eod_met);
 	}
 
@@ -803,6 +875,42 @@ unlock_dir:
 	return status;
 }
 
+/**
+ * @brief List the names in a directory
+ *
+ * Served from the dirent chunks, which keep the fileid and type of
+ * each name.  Without chunking, or for a directory too big to be
+ * cached, the caller falls back to readdir.
+ *
+ * @param[in] dir_hdl    The directory to read
+ * @param[in] whence     Where to start (next)
+ * @param[in] dir_state  Pass thru of state to callback
+ * @param[in] cb         Callback function
+ * @param[out] eod_met   eod marker true == end of dir
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdcache_readdir_names(struct fsal_obj_handle *dir_hdl,
+					   fsal_cookie_t *whence,
+					   void *dir_state,
+					   fsal_readdir_names_cb cb,
+					   bool *eod_met)
+{
+	mdcache_entry_t *directory = container_of(dir_hdl, mdcache_entry_t,
+						  obj_handle);
+
+	if (directory->obj_handle.type != DIRECTORY)
+		return fsalstat(ERR_FSAL_NOTDIR, 0);
+
+	if (mdcache_param.dir.avl_chunk == 0 ||
+	    (directory->mde_flags & MDCACHE_BYPASS_DIRCACHE))
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+
+	return mdcache_readdir_chunked(directory,
+				       whence ? *whence : (uint64_t) 0,
+				       dir_state, NULL, cb, 0, eod_met);
+}
+
 /**
  * @brief Check access for a given user against a given object
  *
@@ -885,6 +993,14 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 		}
 	}
 
+	/* Other clients' delegations of the directories go first */
+	if (state_dir_deleg_conflict(olddir_hdl) ||
+	    (newdir_hdl != olddir_hdl &&
+	     state_dir_deleg_conflict(newdir_hdl))) {
+		status = fsalstat(ERR_FSAL_DELAY, 0);
+		goto out;
+	}
+
 	subcall(
 		status = mdc_olddir->sub_handle->obj_ops.rename(
 			mdc_obj->sub_handle, mdc_olddir->sub_handle,
@@ -897,6 +1013,10 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 	/* Now update cached dirents.  Must take locks in the correct order */
 	mdcache_src_dest_lock(mdc_olddir, mdc_newdir);
 
+	mdc_dir_ns_changed(mdc_olddir);
+	if (mdc_olddir != mdc_newdir)
+		mdc_dir_ns_changed(mdc_newdir);
+
 	if (mdc_lookup_dst != NULL) {
 		/* Mark target file attributes as invalid */
 		atomic_clear_uint32_t_bits(&mdc_lookup_dst->mde_flags,
@@ -1064,6 +1184,119 @@ out:
 	return status;
 }
 
+/**
+ * @brief Adapt an entry's expiry to how often it changes
+ *
+ * An entry found unchanged on refresh keeps its attributes twice as
+ * long, up to Attr_Expiration_Max, one found changed half as long,
+ * down to Attr_Expiration_Min.  A directory's dirents are trusted for
+ * as long as its attributes show no change, so they follow.  Entries
+ * that never expire or always refresh are left alone.
+ *
+ * NOTE: Caller must hold the attribute lock for write.
+ *
+ * @param[in]     entry  The mdcache entry, still with its old attributes
+ * @param[in,out] attrs  Fresh attributes about to be cached
+ */
+
+static void mdc_adapt_expiry(mdcache_entry_t *entry, struct attrlist *attrs)
+{
+	uint32_t min = mdcache_param.attr_expiration_min;
+	uint32_t max = mdcache_param.attr_expiration_max;
+	int64_t ttl = entry->attrs.expire_time_attr;
+	bool changed;
+
+	if (max == 0 || ttl <= 0 || attrs->expire_time_attr <= 0)
+		return;
+
+	if (FSAL_TEST_MASK(entry->attrs.valid_mask, ATTR_CHANGE) &&
+	    FSAL_TEST_MASK(attrs->valid_mask, ATTR_CHANGE))
+		changed = entry->attrs.change != attrs->change;
+	else
+		changed = gsh_time_cmp(&entry->attrs.ctime, &attrs->ctime) != 0;
+
+	ttl = changed ? ttl / 2 : ttl * 2;
+
+	if (ttl < min)
+		ttl = min;
+	if (ttl > max)
+		ttl = max;
+
+	attrs->expire_time_attr = ttl;
+}
+
+/**
+ * @brief Move freshly fetched attributes into an mdcache entry.
+ *
+ * NOTE: Caller must hold the attribute lock for write.
+ *
+ * @param[in] entry       The mdcache entry to update
+ * @param[in] attrs       Attributes from the sub-FSAL, consumed
+ * @param[in] need_acl    Indicates if the ACL was fetched.
+ * @param[in] invalidate  Invalidate the dirent cache if the entry is a
+ *                        directory that changed.
+ */
+
+static void mdc_update_attrs(mdcache_entry_t *entry, struct attrlist *attrs,
+			     bool need_acl, bool invalidate)
+{
+	struct timespec oldmtime;
+
+	/* Use this to detect if we should invalidate a directory. */
+	oldmtime = entry->attrs.mtime;
+
+	if (entry->attrs.acl != NULL) {
+		/* We used to have an ACL... */
+		if (need_acl) {
+			/* We requested update of an existing ACL, release the
+			 * old one.
+			 */
+			nfs4_acl_release_entry(entry->attrs.acl);
+		} else {
+			/* The ACL wasn't requested, move it into the
+			 * new attributes so we will retain it and make
+			 * it such that the entry attrs DO request the
+			 * ACL.
+			 */
+			attrs->acl = entry->attrs.acl;
+			attrs->valid_mask |= ATTR_ACL;
+			entry->attrs.request_mask |= ATTR_ACL;
+		}
+
+		/* ACL was released or moved to new attributes. */
+		entry->attrs.acl = NULL;
+	}
+
+	if (attrs->expire_time_attr == 0) {
+		/* FSAL did not set this, retain what was in the entry. */
+		attrs->expire_time_attr = entry->attrs.expire_time_attr;
+	}
+	mdc_adapt_expiry(entry, attrs);
+	mdc_trust_upcall_expiry(attrs);
+
+	/* Now move the new attributes into the entry. */
+	fsal_copy_attrs(&entry->attrs, attrs, true);
+
+	/* Done with the attrs (we didn't need to call this since the
+	 * fsal_copy_attrs preceding consumed all the references, but we
+	 * release them anyway to make it easy to scan the code for correctness.
+	 */
+	fsal_release_attrs(attrs);
+
+	mdc_fixup_md(entry, attrs);
+
+	LogAttrlist(COMPONENT_CACHE_INODE, NIV_FULL_DEBUG,
+		    "attrs ", &entry->attrs, true);
+
+	if (invalidate && entry->obj_handle.type == DIRECTORY &&
+	    gsh_time_cmp(&oldmtime, &entry->attrs.mtime) < 0) {
+
+		PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+		mdcache_dirent_invalidate_all(entry);
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	}
+}
+
 /**
  * @brief Refresh the attributes for an mdcache entry.
  *
@@ -1083,10 +1316,6 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
 {
 	struct attrlist attrs;
 	fsal_status_t status = {0, 0};
-	struct timespec oldmtime;
-
-	/* Use this to detect if we should invalidate a directory. */
-	oldmtime = entry->attrs.mtime;
 
 	/* We always ask for all regular attributes, even if the caller was
 	 * only interested in the ACL.
@@ -1102,6 +1331,9 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
 	/* We will want all the requested attributes in the entry */
 	entry->attrs.request_mask = attrs.request_mask;
 
+	/* Size and times must account for gathered writes */
+	(void) mdc_wg_flush(entry);
+
 	subcall(
 		status = entry->sub_handle->obj_ops.getattrs(
 			entry->sub_handle, &attrs)
@@ -1114,63 +1346,251 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
 		return status;
 	}
 
-	if (entry->attrs.acl != NULL) {
-		/* We used to have an ACL... */
-		if (need_acl) {
-			/* We requested update of an existing ACL, release the
-			 * old one.
-			 */
-			nfs4_acl_release_entry(entry->attrs.acl);
-		} else {
-			/* The ACL wasn't requested, move it into the
-			 * new attributes so we will retain it and make
-			 * it such that the entry attrs DO request the
-			 * ACL.
-			 */
-			attrs.acl = entry->attrs.acl;
-			attrs.valid_mask |= ATTR_ACL;
-			entry->attrs.request_mask |= ATTR_ACL;
+	mdc_update_attrs(entry, &attrs, need_acl, invalidate);
+
+	return status;
+}
+
+/**
+ * @brief Refresh the attributes of several mdcache entries at once.
+ *
+ * The stale entries are fetched with one getattrs_bulk call on the
+ * sub-FSAL.  Entries whose attr_lock is busy are skipped, whoever
+ * holds it is refreshing or changing them, and the caller's own
+ * getattrs will catch up.  ACLs are not refreshed.
+ *
+ * NOTE: Caller must hold no attribute lock on the entries.
+ *
+ * @param[in] entries   Entries to refresh, all of the current export
+ * @param[in] count     Number of entries
+ * @param[in] attrmask  Attributes the caller needs valid
+ */
+
+void mdcache_refresh_attrs_bulk(mdcache_entry_t **entries, uint32_t count,
+				attrmask_t attrmask)
+{
+	struct fsal_obj_handle **sub_hdls;
+	mdcache_entry_t **locked;
+	struct attrlist *attrs;
+	fsal_status_t *statuses;
+	fsal_status_t status;
+	attrmask_t mask;
+	uint32_t n = 0, i;
+
+	locked = gsh_malloc(count * sizeof(*locked));
+
+	for (i = 0; i < count; i++) {
+		if (pthread_rwlock_trywrlock(&entries[i]->attr_lock) != 0)
+			continue;
+
+		if (mdcache_is_attrs_valid(entries[i], attrmask & ~ATTR_ACL)) {
+			PTHREAD_RWLOCK_unlock(&entries[i]->attr_lock);
+			continue;
 		}
 
-		/* ACL was released or moved to new attributes. */
-		entry->attrs.acl = NULL;
+		locked[n++] = entries[i];
 	}
 
-	if (attrs.expire_time_attr == 0) {
-		/* FSAL did not set this, retain what was in the entry. */
-		attrs.expire_time_attr = entry->attrs.expire_time_attr;
+	if (n == 0) {
+		gsh_free(locked);
+		return;
 	}
 
-	/* Now move the new attributes into the entry. */
-	fsal_copy_attrs(&entry->attrs, &attrs, true);
+	sub_hdls = gsh_malloc(n * sizeof(*sub_hdls));
+	attrs = gsh_malloc(n * sizeof(*attrs));
+	statuses = gsh_malloc(n * sizeof(*statuses));
 
-	/* Done with the attrs (we didn't need to call this since the
-	 * fsal_copy_attrs preceding consumed all the references, but we
-	 * release them anyway to make it easy to scan the code for correctness.
-	 */
-	fsal_release_attrs(&attrs);
+	mask = (op_ctx->fsal_export->exp_ops.fs_supported_attrs(
+			op_ctx->fsal_export) | ATTR_RDATTR_ERR) & ~ATTR_ACL;
 
-	mdc_fixup_md(entry, &attrs);
+	for (i = 0; i < n; i++) {
+		sub_hdls[i] = locked[i]->sub_handle;
+		fsal_prepare_attrs(&attrs[i], mask);
+	}
 
-	LogAttrlist(COMPONENT_CACHE_INODE, NIV_FULL_DEBUG,
-		    "attrs ", &entry->attrs, true);
+	subcall(
+		status = op_ctx->fsal_export->exp_ops.getattrs_bulk(
+			op_ctx->fsal_export, n, sub_hdls, attrs, statuses)
+	       );
 
-	if (invalidate && entry->obj_handle.type == DIRECTORY &&
-	    gsh_time_cmp(&oldmtime, &entry->attrs.mtime) < 0) {
+	for (i = 0; i < n; i++) {
+		if (FSAL_IS_ERROR(status) || FSAL_IS_ERROR(statuses[i])) {
+			fsal_release_attrs(&attrs[i]);
+			PTHREAD_RWLOCK_unlock(&locked[i]->attr_lock);
 
-		PTHREAD_RWLOCK_wrlock(&entry->content_lock);
-		mdcache_dirent_invalidate_all(entry);
-		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+			if (!FSAL_IS_ERROR(status) &&
+			    statuses[i].major == ERR_FSAL_STALE)
+				mdcache_kill_entry(locked[i]);
+			continue;
+		}
+
+		/* We will want all the requested attributes in the entry */
+		locked[i]->attrs.request_mask = attrs[i].request_mask;
+		mdc_update_attrs(locked[i], &attrs[i], false, true);
+		PTHREAD_RWLOCK_unlock(&locked[i]->attr_lock);
 	}
 
-	return status;
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Refreshed attributes of %" PRIu32 " entries in bulk", n);
+
+	gsh_free(statuses);
+	gsh_free(attrs);
+	gsh_free(sub_hdls);
+	gsh_free(locked);
+}
+
+/** Workers refreshing attributes served stale */
+#define MDC_ATTR_REFRESH_THREADS 4
+
+static struct fridgethr *attr_refresh_fridge;
+
+/**
+ * @brief A background refresh of an entry's attributes
+ */
+struct mdc_attr_refresh {
+	mdcache_entry_t *entry;		/*< Entry, referenced */
+	struct gsh_export *export;	/*< Export, referenced */
+	struct fsal_export *fsal_export;
+	struct user_cred creds;		/*< Credentials of the requester */
+	attrmask_t mask;		/*< Attributes the requester wanted */
+};
+
+/**
+ * @brief Refresh attributes in the background
+ *
+ * @param[in] ctx	Thread context, the refresh is the argument
+ */
+static void mdc_attr_refresh_run(struct fridgethr_context *ctx)
+{
+	struct mdc_attr_refresh *rf = ctx->arg;
+	mdcache_entry_t *entry = rf->entry;
+	struct req_op_context *save_ctx = op_ctx, req_ctx = {0};
+	fsal_status_t status = {0, 0};
+
+	req_ctx.ctx_export = rf->export;
+	req_ctx.fsal_export = rf->fsal_export;
+	req_ctx.creds = &rf->creds;
+	op_ctx = &req_ctx;
+
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+	if (!mdcache_is_attrs_valid(entry, rf->mask))
+		status = mdcache_refresh_attrs(entry, false, true);
+
+	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_REFRESHING);
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Background attribute refresh of %p: %s",
+		     entry, fsal_err_txt(status));
+
+	if (status.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(entry);
+
+	mdcache_put(entry);
+	put_gsh_export(rf->export);
+	op_ctx = save_ctx;
+	gsh_free(rf->creds.caller_garray);
+	gsh_free(rf);
+}
+
+/**
+ * @brief Start a background refresh of attributes served stale
+ *
+ * Only one refresh of an entry is in flight at a time.  May be called
+ * with the attr_lock held.
+ *
+ * @param[in] entry	Entry whose attributes expired
+ * @param[in] mask	Attributes the caller wants valid
+ *
+ * @return true if a refresh is running, false if the caller must
+ *         refresh the attributes itself.
+ */
+static bool mdc_attr_refresh_submit(mdcache_entry_t *entry, attrmask_t mask)
+{
+	struct mdc_attr_refresh *rf;
+	fsal_status_t status;
+	int rc;
+
+	if (attr_refresh_fridge == NULL)
+		return false;
+
+	if (atomic_postset_uint32_t_bits(&entry->mde_flags,
+					 MDCACHE_REFRESHING) &
+	    MDCACHE_REFRESHING)
+		return true;
+
+	status = mdcache_get(entry);
+	if (FSAL_IS_ERROR(status))
+		goto out_clear;
+
+	rf = gsh_calloc(1, sizeof(*rf));
+	rf->entry = entry;
+	rf->export = op_ctx->ctx_export;
+	get_gsh_export_ref(rf->export);
+	rf->fsal_export = op_ctx->fsal_export;
+	rf->mask = mask;
+
+	if (op_ctx->creds != NULL) {
+		rf->creds = *op_ctx->creds;
+		if (rf->creds.caller_glen != 0) {
+			rf->creds.caller_garray =
+				gsh_malloc(rf->creds.caller_glen *
+					   sizeof(gid_t));
+			memcpy(rf->creds.caller_garray,
+			       op_ctx->creds->caller_garray,
+			       rf->creds.caller_glen * sizeof(gid_t));
+		} else {
+			rf->creds.caller_garray = NULL;
+		}
+	}
+
+	rc = fridgethr_submit(attr_refresh_fridge, mdc_attr_refresh_run, rf);
+	if (rc == 0)
+		return true;
+
+	LogDebug(COMPONENT_CACHE_INODE,
+		 "Could not submit attribute refresh, error %d", rc);
+	mdcache_put(entry);
+	put_gsh_export(rf->export);
+	gsh_free(rf->creds.caller_garray);
+	gsh_free(rf);
+
+out_clear:
+	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_REFRESHING);
+	return false;
+}
+
+/**
+ * @brief Start the background refresh threads, if Attr_Stale_Grace is set
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_attr_refresh_pkginit(void)
+{
+	if (mdcache_param.attr_stale_grace == 0)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	return mdc_prefetch_fridge_init(&attr_refresh_fridge,
+					"mdc_attr_refresh",
+					MDC_ATTR_REFRESH_THREADS);
+}
+
+/**
+ * @brief Stop the background refresh threads
+ */
+void mdcache_attr_refresh_pkgshutdown(void)
+{
+	mdc_prefetch_fridge_shutdown(&attr_refresh_fridge);
 }
 
 /**
  * @brief Get the attributes for an object
  *
  * If the attribute cache is valid, just return them.  Otherwise, resfresh the
- * cache.
+ * cache.  Attributes that expired less than Attr_Stale_Grace seconds ago
+ * are returned as they are while they are refreshed in the background.
  *
  * @param[in]     obj_hdl   Object to get attributes from
  * @param[in,out] attrs_out Attributes fetched
@@ -1190,6 +1610,12 @@ static fsal_status_t mdcache_getattrs(struct fsal_obj_handle *obj_hdl,
 		goto unlock;
 	}
 
+	if (mdcache_is_attrs_in_grace(entry, attrs_out->request_mask) &&
+	    mdc_attr_refresh_submit(entry, attrs_out->request_mask)) {
+		/* Recently expired, somebody else refreshes them */
+		goto unlock;
+	}
+
 	/* Promote to write lock */
 	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
 	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
@@ -1245,6 +1671,10 @@ static fsal_status_t mdcache_setattrs(struct fsal_obj_handle *obj_hdl,
 	fsal_status_t status;
 	uint64_t change;
 
+	/* Other clients' delegations of a directory go first */
+	if (state_dir_deleg_conflict(obj_hdl))
+		return fsalstat(ERR_FSAL_DELAY, 0);
+
 	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
 
 	change = entry->attrs.change;
@@ -1307,10 +1737,21 @@ static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 	uint64_t change;
 	bool need_acl = false;
 
+	mdcache_lru_fd_touch(entry);
+
+	/* Other clients' delegations of a directory go first */
+	if (state_dir_deleg_conflict(obj_hdl))
+		return fsalstat(ERR_FSAL_DELAY, 0);
+
 	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
 
 	change = entry->attrs.change;
 
+	/* A truncate must not be undone by gathered writes */
+	status = mdc_wg_flush(entry);
+	if (FSAL_IS_ERROR(status))
+		goto unlock;
+
 	subcall(
 		status = entry->sub_handle->obj_ops.setattr2(
 			entry->sub_handle, bypass, state, attrs)
@@ -1319,6 +1760,9 @@ static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto unlock;
 
+	if (FSAL_TEST_MASK(attrs->valid_mask, ATTR_SIZE))
+		mdc_ra_invalidate(entry);
+
 	/* In case of ACL enabled, any of the below attribute changes
 	 * result in change of ACL set as well.
 	 */
@@ -1377,6 +1821,10 @@ static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 		return fsalstat(ERR_FSAL_XDEV, 0);
 	}
 
+	/* Other clients' delegations of the directory go first */
+	if (state_dir_deleg_conflict(dir_hdl))
+		return fsalstat(ERR_FSAL_DELAY, 0);
+
 	subcall(
 		status = parent->sub_handle->obj_ops.unlink(
 			parent->sub_handle, entry->sub_handle, name)
@@ -1396,6 +1844,7 @@ static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 		}
 	} else {
 		PTHREAD_RWLOCK_wrlock(&parent->content_lock);
+		mdc_dir_ns_changed(parent);
 		(void)mdcache_dirent_remove(parent, name);
 		PTHREAD_RWLOCK_unlock(&parent->content_lock);
 
@@ -1728,6 +2177,7 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->merge = mdcache_merge;
 	ops->lookup = mdcache_lookup;
 	ops->readdir = mdcache_readdir;
+	ops->readdir_names = mdcache_readdir_names;
 	ops->create = mdcache_create;
 	ops->mkdir = mdcache_mkdir;
 	ops->mknode = mdcache_mknode;
@@ -1769,10 +2219,16 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->status2 = mdcache_status2;
 	ops->reopen2 = mdcache_reopen2;
 	ops->read2 = mdcache_read2;
+	ops->readv2 = mdcache_readv2;
+	ops->read_fd = mdcache_read_fd;
+	ops->read2_async = mdcache_read2_async;
+	ops->write2_async = mdcache_write2_async;
 	ops->write2 = mdcache_write2;
 	ops->seek2 = mdcache_seek2;
 	ops->io_advise2 = mdcache_io_advise2;
 	ops->commit2 = mdcache_commit2;
+	ops->copy2 = mdcache_copy2;
+	ops->clone2 = mdcache_clone2;
 	ops->lock_op2 = mdcache_lock_op2;
 	ops->setattr2 = mdcache_setattr2;
 	ops->close2 = mdcache_close2;
@@ -71,6 +71,7 @@ cih_pkginit(void)
 {
 	pthread_rwlockattr_t rwlock_attr;
 	cih_partition_t *cp;
+	uint32_t nbuckets = 1;
 	int ix;
 
 	/* avoid writer starvation */
@@ -80,18 +81,23 @@ cih_pkginit(void)
 		&rwlock_attr,
 		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
 #endif
+	/* Partitions start with Cache_Size buckets, rounded up to a power
+	 * of two, and grow from there.
+	 */
+	while (nbuckets < mdcache_param.cache_size &&
+	       nbuckets < CIH_MAX_BUCKETS)
+		nbuckets <<= 1;
+
 	cih_fhcache.npart = mdcache_param.nparts;
 	cih_fhcache.partition =
 		gsh_calloc(cih_fhcache.npart, sizeof(cih_partition_t));
-	cih_fhcache.cache_sz = mdcache_param.cache_size;
+	cih_fhcache.nbuckets = nbuckets;
 	for (ix = 0; ix < cih_fhcache.npart; ++ix) {
 		cp = &cih_fhcache.partition[ix];
 		cp->part_ix = ix;
 		PTHREAD_RWLOCK_init(&cp->lock, &rwlock_attr);
-		avltree_init(&cp->t, cih_fh_cmpf, 0 /* must be 0 */);
-		cp->cache =
-			gsh_calloc(cih_fhcache.cache_sz,
-				sizeof(struct avltree_node *));
+		cp->nbuckets = nbuckets;
+		cp->buckets = gsh_calloc(nbuckets, sizeof(*cp->buckets));
 	}
 	initialized = true;
 }
@@ -107,11 +113,12 @@ cih_pkgdestroy(void)
 
 	/* Destroy the partitions, warning if not empty */
 	for (ix = 0; ix < cih_fhcache.npart; ++ix) {
-		if (avltree_first(&cih_fhcache.partition[ix].t) != NULL)
+		if (cih_fhcache.partition[ix].count != 0)
 			LogMajor(COMPONENT_CACHE_INODE,
-				 "Cache inode AVL tree not empty");
+				 "Cache inode hash partition not empty");
 		PTHREAD_RWLOCK_destroy(&cih_fhcache.partition[ix].lock);
-		gsh_free(cih_fhcache.partition[ix].cache);
+		gsh_free(cih_fhcache.partition[ix].buckets);
+		gsh_free(cih_fhcache.partition[ix].old);
 	}
 	/* Destroy the partition table */
 	gsh_free(cih_fhcache.partition);
@@ -119,4 +126,38 @@ cih_pkgdestroy(void)
 	initialized = false;
 }
 
+/**
+ * @brief Start growing a partition
+ *
+ * The partition gets twice the buckets.  The current ones become the
+ * old table, drained into the new one by later inserts and removes.
+ * If the previous growth has not finished yet, it is finished first,
+ * which only happens when entries are added far faster than chains
+ * are moved.
+ *
+ * @note The partition lock MUST be held for write
+ *
+ * @param[in,out] cp  The partition
+ */
+void
+cih_partition_grow(cih_partition_t *cp)
+{
+	if (cp->nbuckets >= CIH_MAX_BUCKETS)
+		return;
+
+	while (cp->old != NULL)
+		cih_partition_move(cp);
+
+	cp->old = cp->buckets;
+	cp->nold = cp->nbuckets;
+	cp->moved = 0;
+	cp->nbuckets <<= 1;
+	cp->buckets = gsh_calloc(cp->nbuckets, sizeof(*cp->buckets));
+
+	LogDebug(COMPONENT_HASHTABLE_CACHE,
+		 "cih partition %" PRIu32 " growing to %" PRIu32
+		 " buckets for %" PRIu64 " entries",
+		 cp->part_ix, cp->nbuckets, cp->count);
+}
+
 /** @} */
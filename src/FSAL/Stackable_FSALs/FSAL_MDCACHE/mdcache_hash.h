@@ -59,14 +59,22 @@
 /**
  * @brief The table partition
  *
- * Each tree is independent, having its own lock, thus reducing thread
- * contention.
+ * Each partition is an independent chained hash table, having its own
+ * lock, thus reducing thread contention.  A partition doubles its
+ * buckets when the average chain grows past CIH_LOAD_FACTOR.  The
+ * entries are not rehashed all at once, every insert and remove moves
+ * a few of the old buckets over, and lookups search both tables until
+ * the old one is empty.
  */
 typedef struct cih_partition {
 	uint32_t part_ix;
 	pthread_rwlock_t lock;
-	struct avltree t;
-	struct avltree_node **cache;
+	mdcache_entry_t **buckets;	/*< Chains, a power of two of them */
+	uint32_t nbuckets;
+	mdcache_entry_t **old;		/*< Chains being moved, or NULL */
+	uint32_t nold;
+	uint32_t moved;			/*< Old chains already moved */
+	uint64_t count;			/*< Entries in the partition */
 #ifdef ENABLE_LOCKTRACE
 	struct {
 		char *func;
@@ -85,12 +93,21 @@ struct cih_lookup_table {
 	GSH_CACHE_PAD(0);
 	cih_partition_t *partition;
 	uint32_t npart;
-	uint32_t cache_sz;
+	uint32_t nbuckets;	/*< Initial buckets per partition */
 };
 
 /* Support inline lookups */
 extern struct cih_lookup_table cih_fhcache;
 
+/** Average chain length past which a partition grows */
+#define CIH_LOAD_FACTOR 2
+
+/** Old chains moved on each insert or remove while growing */
+#define CIH_MOVE_BATCH 8
+
+/** Most buckets a partition grows to */
+#define CIH_MAX_BUCKETS (1U << 31)
+
 /**
  * @brief Initialize the package.
  */
@@ -101,11 +118,16 @@ void cih_pkginit(void);
  */
 void cih_pkgdestroy(void);
 
+/**
+ * @brief Start growing a partition
+ */
+void cih_partition_grow(cih_partition_t *cp);
+
 /**
  * @brief Find the correct partition for a pointer
  *
  * To lower thread contention, the table is composed of multiple
- * trees, with the tree that receives a pointer determined by a
+ * hash tables, with the table that receives a pointer determined by a
  * modulus.  This macro yields an expression that yields a pointer to
  * the correct partition.
  */
@@ -114,68 +136,129 @@ void cih_pkgdestroy(void);
 	(((lt)->partition)+(((uint64_t)k)%(lt)->npart))
 
 /**
- * @brief Compute cache slot for an entry
+ * @brief Compute the chain of a hash in a bucket array
  *
- * This function computes a hash slot, taking an address modulo the
- * number of cache slotes (which should be prime).
+ * The partition is picked from the low bits of the hash, so the chain
+ * is picked from the high ones.
  *
- * @param wt [in] The table
- * @param ptr [in] Entry address
+ * @param[in] k         The hash
+ * @param[in] nbuckets  Number of buckets, a power of two
  *
- * @return The computed offset.
+ * @return The bucket index.
  */
 static inline uint32_t
-cih_cache_offsetof(struct cih_lookup_table *lt, uint64_t k)
+cih_bucket_of(uint64_t k, uint32_t nbuckets)
 {
-	return k % lt->cache_sz;
+	return (uint32_t)(k >> 32) & (nbuckets - 1);
 }
 
 /**
- * @brief Cache inode FH hashed comparison function.
- *
- * Entries are ordered by integer hash first, and second by bitwise
- * comparison of the corresponding file handle.
- *
- * For key prototypes, which have no object handle, the buffer pointed to
- * by fh_k.fh_desc_k is taken to be the file handle.  Further, ONLY key
- * prototype entries may have a non-NULL value for fh_k.fh_desc_k.
+ * @brief Search a chain for a key
+ */
+static inline mdcache_entry_t *
+cih_chain_lookup(mdcache_entry_t *chain, mdcache_key_t *key)
+{
+	for (; chain != NULL; chain = chain->fh_hk.next_k) {
+		if (mdcache_key_cmp(&chain->fh_hk.key, key) == 0)
+			return chain;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Unlink an entry from a chain
  *
- * @param lhs [in] First node
- * @param rhs [in] Second node
+ * @return true if the entry was on the chain.
+ */
+static inline bool
+cih_chain_unlink(mdcache_entry_t **link, mdcache_entry_t *entry)
+{
+	for (; *link != NULL; link = &(*link)->fh_hk.next_k) {
+		if (*link == entry) {
+			*link = entry->fh_hk.next_k;
+			entry->fh_hk.next_k = NULL;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief Look up a key in a partition
  *
- * @retval -1: lhs compares as less than rhs
- * @retval 0: lhs and rhs compare equal
- * @retval 1: lhs is greater than rhs
+ * @note The partition lock MUST be held
  */
-static inline int cih_fh_cmpf(const struct avltree_node *lhs,
-			      const struct avltree_node *rhs)
+static inline mdcache_entry_t *
+cih_partition_lookup(cih_partition_t *cp, mdcache_key_t *key)
 {
-	mdcache_entry_t *lk, *rk;
+	mdcache_entry_t *entry;
+
+	entry = cih_chain_lookup(
+		cp->buckets[cih_bucket_of(key->hk, cp->nbuckets)], key);
 
-	lk = avltree_container_of(lhs, mdcache_entry_t, fh_hk.node_k);
-	rk = avltree_container_of(rhs, mdcache_entry_t, fh_hk.node_k);
+	if (entry == NULL && unlikely(cp->old != NULL))
+		entry = cih_chain_lookup(
+			cp->old[cih_bucket_of(key->hk, cp->nold)], key);
 
-	return mdcache_key_cmp(&lk->fh_hk.key, &rk->fh_hk.key);
+	return entry;
 }
 
 /**
- * @brief Open-coded avltree lookup
- *
- * Search for an entry matching key in avltree tree.
+ * @brief Move some chains of a growing partition to its new buckets
  *
- * @todo dang this should be in the avltree implementation.  It's dangerous to
- * open-code an avltree lookup elsewhere.
+ * @note The partition lock MUST be held for write
+ */
+static inline void
+cih_partition_move(cih_partition_t *cp)
+{
+	mdcache_entry_t *entry, *next, **bucket;
+	uint32_t n;
+
+	for (n = 0; cp->old != NULL && n < CIH_MOVE_BATCH; n++) {
+		for (entry = cp->old[cp->moved]; entry != NULL; entry = next) {
+			next = entry->fh_hk.next_k;
+			bucket = &cp->buckets[cih_bucket_of(
+					entry->fh_hk.key.hk, cp->nbuckets)];
+			entry->fh_hk.next_k = *bucket;
+			*bucket = entry;
+		}
+		cp->old[cp->moved] = NULL;
+
+		if (++cp->moved == cp->nold) {
+			gsh_free(cp->old);
+			cp->old = NULL;
+			cp->nold = 0;
+			cp->moved = 0;
+		}
+	}
+}
+
+/**
+ * @brief Remove an entry from a partition
  *
- * @param tree [in] The avltree to search
- * @param key [in] Entry being searched for, as an avltree node
+ * @note The partition lock MUST be held for write
  *
- * @return Pointer to node if found, else NULL.
+ * @return true if the entry was found and removed.
  */
-static inline struct avltree_node *
-cih_fhcache_inline_lookup(const struct avltree *tree,
-			  const struct avltree_node *key)
+static inline bool
+cih_partition_remove(cih_partition_t *cp, mdcache_entry_t *entry)
 {
-	return avltree_inline_lookup(key, tree, cih_fh_cmpf);
+	uint64_t k = entry->fh_hk.key.hk;
+	bool found;
+
+	found = cih_chain_unlink(&cp->buckets[cih_bucket_of(k, cp->nbuckets)],
+				 entry);
+	if (!found && cp->old != NULL)
+		found = cih_chain_unlink(&cp->old[cih_bucket_of(k, cp->nold)],
+					 entry);
+	if (found)
+		cp->count--;
+
+	cih_partition_move(cp);
+
+	return found;
 }
 
 #define CIH_HASH_NONE           0x0000
@@ -207,6 +290,7 @@ cih_hash_key(mdcache_key_t *key,
 		/* XXX dups fh_desc */
 		key->kv.len = fh_desc->len;
 		key->kv.addr = gsh_malloc(fh_desc->len);
+		mdcache_mem_charge(fh_desc->len);
 		memcpy(key->kv.addr, fh_desc->addr, fh_desc->len);
 	}
 
@@ -286,47 +370,22 @@ static inline mdcache_entry_t *
 cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
 		       uint32_t flags, const char *func, int line)
 {
-	mdcache_entry_t k_entry, *entry = NULL;
-	struct avltree_node *node;
-	void **cache_slot;
+	mdcache_entry_t *entry;
 
 	if (!cih_latch_entry(key, latch, flags, func, line))
 		return NULL;
 
-	k_entry.fh_hk.key = *key;
-
-	/* check cache */
-	cache_slot = (void **)
-	    &(latch->cp->cache[cih_cache_offsetof(&cih_fhcache, key->hk)]);
-	node = (struct avltree_node *)atomic_fetch_voidptr(cache_slot);
-	if (node) {
-		if (cih_fh_cmpf(&k_entry.fh_hk.node_k, node) == 0) {
-			/* got it in 1 */
-			LogDebug(COMPONENT_HASHTABLE_CACHE,
-				 "cih cache hit slot %d",
-				 cih_cache_offsetof(&cih_fhcache, key->hk));
-			goto found;
-		}
-	}
-
-	/* check AVL */
-	node = cih_fhcache_inline_lookup(&latch->cp->t, &k_entry.fh_hk.node_k);
-	if (!node) {
+	entry = cih_partition_lookup(latch->cp, key);
+	if (!entry) {
 		if (flags & CIH_GET_UNLOCK_ON_MISS)
 			cih_hash_release(latch);
 		LogDebug(COMPONENT_HASHTABLE_CACHE, "fdcache MISS");
-		goto out;
+		return NULL;
 	}
 
-	/* update cache */
-	atomic_store_voidptr(cache_slot, node);
+	LogDebug(COMPONENT_HASHTABLE_CACHE, "cih hit partition %" PRIu32,
+		 latch->cp->part_ix);
 
-	LogDebug(COMPONENT_HASHTABLE_CACHE, "cih AVL hit slot %d",
-		 cih_cache_offsetof(&cih_fhcache, key->hk));
-
- found:
-	entry = avltree_container_of(node, mdcache_entry_t, fh_hk.node_k);
- out:
 	return entry;
 }
 
@@ -352,6 +411,7 @@ cih_set_latched(mdcache_entry_t *entry, cih_latch_t *latch,
 		uint32_t flags)
 {
 	cih_partition_t *cp = latch->cp;
+	mdcache_entry_t **bucket;
 
 	/* Omit hash if you are SURE we hashed it, and that the
 	 * hash remains valid */
@@ -360,8 +420,16 @@ cih_set_latched(mdcache_entry_t *entry, cih_latch_t *latch,
 				  fh_desc, CIH_HASH_NONE))
 			return 1;
 
-	(void)avltree_insert(&entry->fh_hk.node_k, &cp->t);
-	entry->fh_hk.inavl = true;
+	cih_partition_move(cp);
+
+	bucket = &cp->buckets[cih_bucket_of(entry->fh_hk.key.hk,
+					    cp->nbuckets)];
+	entry->fh_hk.next_k = *bucket;
+	*bucket = entry;
+	entry->fh_hk.inhash = true;
+
+	if (unlikely(++cp->count > (uint64_t)cp->nbuckets * CIH_LOAD_FACTOR))
+		cih_partition_grow(cp);
 #ifdef USE_LTTNG
 	tracepoint(mdcache, mdc_lru_insert, __func__, __LINE__, entry,
 		   entry->lru.refcnt);
@@ -386,22 +454,17 @@ cih_set_latched(mdcache_entry_t *entry, cih_latch_t *latch,
 static inline bool
 cih_remove_checked(mdcache_entry_t *entry)
 {
-	struct avltree_node *node;
 	cih_partition_t *cp =
 	    cih_partition_of_scalar(&cih_fhcache, entry->fh_hk.key.hk);
 	bool freed = false;
 
 	PTHREAD_RWLOCK_wrlock(&cp->lock);
-	node = cih_fhcache_inline_lookup(&cp->t, &entry->fh_hk.node_k);
-	if (entry->fh_hk.inavl && node) {
+	if (entry->fh_hk.inhash && cih_partition_remove(cp, entry)) {
 #ifdef USE_LTTNG
 		tracepoint(mdcache, mdc_lru_remove, __func__, __LINE__, entry,
 			   entry->lru.refcnt);
 #endif
-		avltree_remove(node, &cp->t);
-		cp->cache[cih_cache_offsetof(&cih_fhcache,
-					     entry->fh_hk.key.hk)] = NULL;
-		entry->fh_hk.inavl = false;
+		entry->fh_hk.inhash = false;
 		/* return sentinel ref */
 		freed = mdcache_lru_unref(entry, LRU_FLAG_NONE);
 	}
@@ -430,15 +493,13 @@ cih_remove_latched(mdcache_entry_t *entry, cih_latch_t *latch, uint32_t flags)
 	    cih_partition_of_scalar(&cih_fhcache, entry->fh_hk.key.hk);
 	uint32_t lflags = LRU_FLAG_NONE;
 
-	if (entry->fh_hk.inavl) {
+	if (entry->fh_hk.inhash) {
 #ifdef USE_LTTNG
 		tracepoint(mdcache, mdc_lru_remove, __func__, __LINE__, entry,
 			   entry->lru.refcnt);
 #endif
-		avltree_remove(&entry->fh_hk.node_k, &cp->t);
-		cp->cache[cih_cache_offsetof(&cih_fhcache,
-					     entry->fh_hk.key.hk)] = NULL;
-		entry->fh_hk.inavl = false;
+		(void)cih_partition_remove(cp, entry);
+		entry->fh_hk.inhash = false;
 		if (flags & CIH_REMOVE_QLOCKED)
 			lflags |= LRU_UNREF_QLOCKED;
 		mdcache_lru_unref(entry, lflags);
@@ -49,14 +49,19 @@
 #include "mdcache_lru.h"
 #include "mdcache_hash.h"
 #include "mdcache_avl.h"
+#include "export_mgr.h"
+#include "nfs_file_handle.h"
+#include "fridgethr.h"
+#include "city.h"
 #ifdef USE_LTTNG
 #include "gsh_lttng/mdcache.h"
 #endif
 
 static inline bool trust_negative_cache(mdcache_entry_t *parent)
 {
-	return op_ctx_export_has_option(
-				  EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE) &&
+	return (op_ctx_export_has_option(
+				  EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE) ||
+		op_ctx->ctx_export->immutable) &&
 		parent->icreate_refcnt == 0 &&
 		(parent->mde_flags & MDCACHE_DIR_POPULATED) != 0;
 }
@@ -144,6 +149,10 @@ static mdcache_entry_t *mdcache_alloc_handle(
 		result->obj_handle.state_hdl = &result->fsobj.hdl;
 	state_hdl_init(result->obj_handle.state_hdl, result->obj_handle.type,
 		       &result->obj_handle);
+	if (sub_handle->type == REGULAR_FILE) {
+		mdc_ra_init(result);
+		mdc_wg_init(result);
+	}
 
 	/* Initialize common fields */
 	result->mde_flags = 0;
@@ -176,12 +185,13 @@ static mdcache_entry_t *mdcache_alloc_handle(
 }
 
 /**
+ * @brief Detach an entry from all its exports
  *
- * @brief Cleans up an entry so it can be reused
+ * Once done, unexport can no longer find the entry.
  *
- * @param[in]  entry     The cache entry to clean
+ * @param[in]  entry     The cache entry
  */
-void mdc_clean_entry(mdcache_entry_t *entry)
+void mdc_unmap_entry(mdcache_entry_t *entry)
 {
 	struct glist_head *glist;
 	struct glist_head *glistn;
@@ -209,6 +219,17 @@ void mdc_clean_entry(mdcache_entry_t *entry)
 	atomic_store_int32_t(&entry->first_export_id, -1);
 
 	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+}
+
+/**
+ *
+ * @brief Cleans up an entry so it can be reused
+ *
+ * @param[in]  entry     The cache entry to clean
+ */
+void mdc_clean_entry(mdcache_entry_t *entry)
+{
+	mdc_unmap_entry(entry);
 
 	if (entry->obj_handle.type == DIRECTORY) {
 		PTHREAD_RWLOCK_wrlock(&entry->content_lock);
@@ -219,6 +240,9 @@ void mdc_clean_entry(mdcache_entry_t *entry)
 		mdcache_free_fh(&entry->fsobj.fsdir.parent);
 
 		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	} else if (entry->obj_handle.type == REGULAR_FILE) {
+		mdc_ra_destroy(entry);
+		mdc_wg_destroy(entry);
 	}
 	cih_remove_checked(entry);
 
@@ -310,6 +334,7 @@ again:
 	if (glist_empty(&entry->export_list)) {
 		atomic_store_int32_t(&entry->first_export_id,
 				     (int32_t) op_ctx->ctx_export->export_id);
+		(void)atomic_inc_int64_t(&export->entries_used);
 	}
 
 	expmap->export = export;
@@ -412,16 +437,17 @@ void mdcache_clean_dirent_chunk(struct dir_chunk *chunk)
 		}
 
 		if (dirent->ckey.kv.len)
-			mdcache_key_delete(&dirent->ckey);
-		gsh_free(dirent);
+			mdcache_dirent_key_delete(dirent);
+		mdcache_dirent_free(dirent);
 
 		/* Don't count this dirent anymore. */
 		parent->fsobj.fsdir.nbactive--;
 	}
 
 	/* Remove chunk from directory and free it */
+	mdcache_lru_chunk_remove(chunk);
 	glist_del(&chunk->chunks);
-	gsh_free(chunk);
+	gsh_free_tag(GSH_MEM_MDCACHE_DIRENTS, chunk);
 }
 
 /**
@@ -473,6 +499,9 @@ void mdcache_dirent_invalidate_all(mdcache_entry_t *entry)
 	/* Next the inactive tree */
 	mdcache_avl_clean_tree(&entry->fsobj.fsdir.avl.c);
 
+	/* And the names known not to exist */
+	mdcache_avl_neg_clean(entry);
+
 	/* Now we can trust the content */
 	atomic_set_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_CONTENT);
 }
@@ -608,6 +637,11 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 		goto out_release_new_entry;
 	}
 
+	/* Now that the key is known, let a recently reclaimed entry
+	 * skip probation.
+	 */
+	mdcache_lru_admit(nentry);
+
 	switch (nentry->obj_handle.type) {
 	case REGULAR_FILE:
 		LogDebug(COMPONENT_CACHE_INODE,
@@ -680,6 +714,7 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 		    atomic_fetch_uint32_t(
 			    &op_ctx->ctx_export->expire_time_attr);
 	}
+	mdc_trust_upcall_expiry(&nentry->attrs);
 
 	/* Validate the attributes we just set. */
 	mdc_fixup_md(nentry, &nentry->attrs);
@@ -713,6 +748,11 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 	} else {
 		LogDebug(COMPONENT_CACHE_INODE, "New entry %p added", nentry);
 	}
+
+	/* Bring back the dirents spilled when it was last reaped */
+	if (nentry->obj_handle.type == DIRECTORY && !new_directory)
+		mdc_spill_load(nentry, attrs_in);
+
 	*entry = nentry;
 	(void)atomic_inc_uint64_t(&cache_stp->inode_added);
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -877,6 +917,18 @@ mdcache_find_keyed(mdcache_key_t *key, mdcache_entry_t **entry)
 	return fsalstat(ERR_FSAL_NOENT, 0);
 }
 
+/**
+ * @brief Locks serializing sub-FSAL lookups of one handle
+ *
+ * Like the name stripes below, but for handles: when many clients
+ * present the same uncached handle at once, only the first calls
+ * create_handle on the sub-FSAL and the others find its entry cached.
+ * A stripe is taken before, never while holding, a content_lock.
+ */
+#define MDC_KEY_LOCKS 251
+
+static pthread_mutex_t mdc_key_locks[MDC_KEY_LOCKS];
+
 /**
  * @brief Find or create a cache entry by it's host-handle
  *
@@ -902,6 +954,7 @@ mdcache_locate_host(struct gsh_buffdesc *fh_desc,
 	mdcache_key_t key;
 	struct fsal_obj_handle *sub_handle;
 	struct attrlist attrs;
+	pthread_mutex_t *key_lock = NULL;
 	fsal_status_t status;
 
 	/* Copy the fh_desc into key, todo: is there a function for this? */
@@ -923,11 +976,24 @@ mdcache_locate_host(struct gsh_buffdesc *fh_desc,
 
 	status = mdcache_find_keyed(&key, entry);
 
+	if (status.major == ERR_FSAL_NOENT) {
+		/* Somebody else may be bringing the same handle in, wait for
+		 * them and look again.
+		 */
+		key_lock = &mdc_key_locks[key.hk % MDC_KEY_LOCKS];
+		PTHREAD_MUTEX_lock(key_lock);
+		status = mdcache_find_keyed(&key, entry);
+	}
+
 	if (!FSAL_IS_ERROR(status)) {
+		if (key_lock != NULL)
+			PTHREAD_MUTEX_unlock(key_lock);
 		status = get_optional_attrs(&(*entry)->obj_handle, attrs_out);
 		return status;
 	} else if (status.major != ERR_FSAL_NOENT) {
 		/* Actual error */
+		if (key_lock != NULL)
+			PTHREAD_MUTEX_unlock(key_lock);
 		return status;
 	}
 
@@ -954,12 +1020,15 @@ mdcache_locate_host(struct gsh_buffdesc *fh_desc,
 			 fsal_err_txt(status));
 		*entry = NULL;
 		fsal_release_attrs(&attrs);
+		PTHREAD_MUTEX_unlock(key_lock);
 		return status;
 	}
 
 	status = mdcache_new_entry(export, sub_handle, &attrs, attrs_out,
 				   false, entry, NULL);
 
+	PTHREAD_MUTEX_unlock(key_lock);
+
 	fsal_release_attrs(&attrs);
 
 	if (!FSAL_IS_ERROR(status)) {
@@ -1039,6 +1108,77 @@ fsal_status_t mdc_add_cache(mdcache_entry_t *mdc_parent,
 	return status;
 }
 
+/**
+ * @brief Locks serializing sub-FSAL lookups of one name
+ *
+ * Lookups that miss the dirent cache go to the sub-FSAL without the
+ * directory's content_lock, so misses, creates and removes of other
+ * names in the directory proceed in parallel.  Misses of the same name
+ * in the same directory serialize on one of these stripes, so only the
+ * first goes to the sub-FSAL and the others find its result cached.
+ * A stripe is taken before, never while holding, a content_lock.
+ */
+#define MDC_NAME_LOCKS 251
+
+static fsal_status_t mdc_lookup_sub(mdcache_entry_t *mdc_parent,
+				    const char *name,
+				    mdcache_entry_t **new_entry,
+				    struct attrlist *attrs_out,
+				    const uint32_t *ns_gen);
+
+static pthread_mutex_t mdc_name_locks[MDC_NAME_LOCKS];
+
+void mdc_name_locks_init(void)
+{
+	int i;
+
+	for (i = 0; i < MDC_NAME_LOCKS; i++)
+		PTHREAD_MUTEX_init(&mdc_name_locks[i], NULL);
+	for (i = 0; i < MDC_KEY_LOCKS; i++)
+		PTHREAD_MUTEX_init(&mdc_key_locks[i], NULL);
+}
+
+static pthread_mutex_t *mdc_name_lock(mdcache_entry_t *mdc_parent,
+				      const char *name)
+{
+	uint64_t hk = CityHash64WithSeed(name, strlen(name),
+					 (uintptr_t)mdc_parent);
+
+	return &mdc_name_locks[hk % MDC_NAME_LOCKS];
+}
+
+/**
+ * @brief Finish a lookup that found a cached child
+ *
+ * @param[in]     name      Name of child
+ * @param[in,out] new_entry Child entry, dropped on failure
+ * @param[in,out] attrs_out Optional attributes for the child
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_lookup_found(const char *name,
+				      mdcache_entry_t **new_entry,
+				      struct attrlist *attrs_out)
+{
+	fsal_status_t status;
+
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Found, possible getattrs %s (%s)",
+		     name, attrs_out != NULL ? "yes" : "no");
+
+	status = get_optional_attrs(&(*new_entry)->obj_handle, attrs_out);
+
+	if (FSAL_IS_ERROR(status)) {
+		/* Oops, failed to get attributes and ATTR_RDATTR_ERR
+		 * was not requested, so we are failing lookup and
+		 * thus must drop the object reference we got.
+		 */
+		mdcache_put(*new_entry);
+		*new_entry = NULL;
+	}
+	return status;
+}
+
 /**
  * @brief Try to get a cached child
  *
@@ -1095,6 +1235,12 @@ fsal_status_t mdc_try_get_cached(mdcache_entry_t *mdc_parent,
 			 * valid, it can serve negative lookups. */
 			return fsalstat(ERR_FSAL_NOENT, 0);
 		}
+		if (mdcache_avl_neg_lookup(mdc_parent, name)) {
+			/* Looked up and not found recently */
+			LogFullDebug(COMPONENT_CACHE_INODE,
+				     "Negative cache hit for %s", name);
+			return fsalstat(ERR_FSAL_NOENT, 0);
+		}
 	}
 	return fsalstat(ERR_FSAL_STALE, 0);
 }
@@ -1132,6 +1278,9 @@ fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 {
 	*new_entry = NULL;
 	fsal_status_t status;
+	pthread_mutex_t *name_lock;
+	uint32_t ns_gen;
+	bool cached;
 
 	LogFullDebug(COMPONENT_CACHE_INODE, "Lookup %s", name);
 
@@ -1139,14 +1288,25 @@ fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 
 	if (!strcmp(name, "..")) {
 		struct mdcache_fsal_export *export = mdc_cur_export();
+		struct gsh_buffdesc parent;
 
 		LogFullDebug(COMPONENT_CACHE_INODE,
 			     "Lookup parent (..) of %p", mdc_parent);
-		/* ".." doesn't end up in the cache */
-		status =  mdcache_locate_host(
-				&mdc_parent->fsobj.fsdir.parent,
-				export, new_entry, attrs_out);
-		goto out;
+		/* ".." doesn't end up in the cache.  The handle stripe
+		 * can't be taken under the content_lock, so copy the
+		 * parent handle out first.
+		 */
+		parent.len = mdc_parent->fsobj.fsdir.parent.len;
+		parent.addr = alloca(parent.len);
+		memcpy(parent.addr, mdc_parent->fsobj.fsdir.parent.addr,
+		       parent.len);
+		PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
+
+		status =  mdcache_locate_host(&parent, export, new_entry,
+					      attrs_out);
+		if (status.major == ERR_FSAL_STALE)
+			status.major = ERR_FSAL_NOENT;
+		return status;
 	}
 
 	if (mdc_parent->mde_flags & MDCACHE_BYPASS_DIRCACHE) {
@@ -1173,23 +1333,7 @@ fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 		 * to avoid ABBA locking situation.
 		 */
 		PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
-
-		LogFullDebug(COMPONENT_CACHE_INODE,
-			     "Found, possible getattrs %s (%s)",
-			     name, attrs_out != NULL ? "yes" : "no");
-
-		status = get_optional_attrs(&(*new_entry)->obj_handle,
-					    attrs_out);
-
-		if (FSAL_IS_ERROR(status)) {
-			/* Oops, failed to get attributes and ATTR_RDATTR_ERR
-			 * was not requested, so we are failing lookup and
-			 * thus must drop the object reference we got.
-			 */
-			mdcache_put(*new_entry);
-			*new_entry = NULL;
-		}
-		return status;
+		return mdc_lookup_found(name, new_entry, attrs_out);
 	} else if (!uncached) {
 		/* Was only looking in cache, so don't bother looking further */
 		goto out;
@@ -1211,6 +1355,52 @@ fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 
 	LogDebug(COMPONENT_CACHE_INODE, "Cache Miss detected for %s", name);
 
+	/* Go to the sub-FSAL without the content_lock, see
+	 * mdc_name_lock.  Somebody else may have looked the name up
+	 * while we waited for its stripe.  Creates, links, unlinks and
+	 * renames don't take the stripe, so what the sub-FSAL answers is
+	 * only cached if none of them changed the directory meanwhile.
+	 */
+	PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
+	name_lock = mdc_name_lock(mdc_parent, name);
+	PTHREAD_MUTEX_lock(name_lock);
+
+	PTHREAD_RWLOCK_rdlock(&mdc_parent->content_lock);
+	status = mdc_try_get_cached(mdc_parent, name, new_entry);
+	ns_gen = mdc_parent->fsobj.fsdir.ns_gen;
+	PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
+	cached = !FSAL_IS_ERROR(status);
+
+	if (status.major == ERR_FSAL_STALE) {
+		status = mdc_lookup_sub(mdc_parent, name, new_entry,
+					attrs_out, &ns_gen);
+
+		if (status.major == ERR_FSAL_NOENT) {
+			/* Remember the name is missing for as long as the
+			 * directory's attributes are trusted.
+			 */
+			int32_t ttl = atomic_fetch_int32_t(
+					&mdc_parent->attrs.expire_time_attr);
+
+			PTHREAD_RWLOCK_wrlock(&mdc_parent->content_lock);
+			if (ttl != 0 &&
+			    ns_gen == mdc_parent->fsobj.fsdir.ns_gen &&
+			    !(mdc_parent->mde_flags & MDCACHE_BYPASS_DIRCACHE))
+				mdcache_avl_neg_insert(
+					mdc_parent, name,
+					ttl > 0 ? time(NULL) + ttl : 0);
+			PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(name_lock);
+
+	if (cached)
+		return mdc_lookup_found(name, new_entry, attrs_out);
+	if (status.major == ERR_FSAL_STALE)
+		status.major = ERR_FSAL_NOENT;
+	return status;
+
 uncached:
 	status = mdc_lookup_uncached(mdc_parent, name, new_entry, attrs_out);
 
@@ -1242,6 +1432,66 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 				  const char *name,
 				  mdcache_entry_t **new_entry,
 				  struct attrlist *attrs_out)
+{
+	return mdc_lookup_sub(mdc_parent, name, new_entry, attrs_out, NULL);
+}
+
+/**
+ * @brief Make the entry of a child found in the sub-FSAL, without a dirent
+ *
+ * @param[in]     export	The mdcache export
+ * @param[in]     sub_handle	Handle of the child in the sub-FSAL
+ * @param[in]     mdc_parent	Parent entry
+ * @param[in]     attrs_in	Attributes of the child
+ * @param[in,out] attrs_out	Optional attributes for entry
+ * @param[out]    new_entry	New entry to return
+ *
+ * @note This returns an INITIAL ref'd entry on success
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_lookup_sub_nocache(struct mdcache_fsal_export *export,
+					    struct fsal_obj_handle *sub_handle,
+					    mdcache_entry_t *mdc_parent,
+					    struct attrlist *attrs_in,
+					    struct attrlist *attrs_out,
+					    mdcache_entry_t **new_entry)
+{
+	fsal_status_t status;
+
+	status = mdcache_new_entry(export, sub_handle, attrs_in, attrs_out,
+				   false, new_entry, NULL);
+	if (FSAL_IS_ERROR(status)) {
+		*new_entry = NULL;
+		return status;
+	}
+
+	if ((*new_entry)->obj_handle.type == DIRECTORY)
+		mdc_dir_add_parent(*new_entry, mdc_parent);
+
+	return status;
+}
+
+/**
+ * @brief Lookup a child in the sub-FSAL and cache it
+ *
+ * @param[in]     mdc_parent	Parent entry
+ * @param[in]     name		Name of entry to find
+ * @param[out]    new_entry	New entry to return;
+ * @param[in,out] attrs_out     Optional attributes for entry
+ * @param[in]     ns_gen	If not NULL, the parent's content_lock is
+ *				not held, and the entry is only cached if
+ *				the parent's fsdir.ns_gen is still this
+ *
+ * @note This returns an INITIAL ref'd entry on success
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_lookup_sub(mdcache_entry_t *mdc_parent,
+				    const char *name,
+				    mdcache_entry_t **new_entry,
+				    struct attrlist *attrs_out,
+				    const uint32_t *ns_gen)
 {
 	struct fsal_obj_handle *sub_handle = NULL, *new_obj = NULL;
 	fsal_status_t status;
@@ -1279,11 +1529,33 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 	 *       the dirent cache, however, that should still result in an
 	 *       attribute change which should dump the cache.
 	 */
+	if (ns_gen != NULL) {
+		PTHREAD_RWLOCK_wrlock(&mdc_parent->content_lock);
+
+		if (*ns_gen != mdc_parent->fsobj.fsdir.ns_gen) {
+			/* The name may be gone already, hand the entry back
+			 * without a dirent.
+			 */
+			PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
+			LogFullDebug(COMPONENT_CACHE_INODE,
+				     "%s changed while looked up, not cached",
+				     name);
+			status = mdc_lookup_sub_nocache(export, sub_handle,
+							mdc_parent, &attrs,
+							attrs_out, new_entry);
+			fsal_release_attrs(&attrs);
+			return status;
+		}
+	}
+
 	status = mdcache_alloc_and_check_handle(export, sub_handle, &new_obj,
 						false, &attrs, attrs_out,
 						"lookup ", mdc_parent, name,
 						&invalidate, NULL);
 
+	if (ns_gen != NULL)
+		PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
+
 	fsal_release_attrs(&attrs);
 
 	if (FSAL_IS_ERROR(status)) {
@@ -1295,6 +1567,73 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 	return status;
 }
 
+/**
+ * @brief Look up several names in the underlying FSAL at once
+ *
+ * Cache entries are created for the names found, as mdc_lookup_uncached
+ * does for one name, with a single lookup_bulk call on the sub-FSAL.
+ *
+ * @note mdc_parent MUST have it's content_lock held
+ *
+ * @param[in]  mdc_parent  Parent directory
+ * @param[in]  count       Number of names
+ * @param[in]  names       Names to look up
+ * @param[out] new_entries Entries found, ref'd, NULL where not found
+ */
+
+void mdc_lookup_uncached_bulk(mdcache_entry_t *mdc_parent, uint32_t count,
+			      const char **names,
+			      mdcache_entry_t **new_entries)
+{
+	struct mdcache_fsal_export *export = mdc_cur_export();
+	struct fsal_obj_handle **sub_handles, *new_obj = NULL;
+	struct attrlist *attrs;
+	fsal_status_t *statuses;
+	fsal_status_t status;
+	attrmask_t mask;
+	bool invalidate = false;
+	uint32_t i;
+
+	sub_handles = gsh_calloc(count, sizeof(*sub_handles));
+	attrs = gsh_malloc(count * sizeof(*attrs));
+	statuses = gsh_malloc(count * sizeof(*statuses));
+
+	/* As for a single lookup, the ACL is fetched when asked for. */
+	mask = op_ctx->fsal_export->exp_ops.fs_supported_attrs(
+			op_ctx->fsal_export) & ~ATTR_ACL;
+
+	for (i = 0; i < count; i++)
+		fsal_prepare_attrs(&attrs[i], mask);
+
+	subcall(
+		status = mdc_parent->sub_handle->obj_ops.lookup_bulk(
+			mdc_parent->sub_handle, count, names, sub_handles,
+			attrs, statuses)
+	       );
+
+	for (i = 0; i < count; i++) {
+		new_entries[i] = NULL;
+
+		if (FSAL_IS_ERROR(status) || FSAL_IS_ERROR(statuses[i])) {
+			fsal_release_attrs(&attrs[i]);
+			continue;
+		}
+
+		if (!FSAL_IS_ERROR(mdcache_alloc_and_check_handle(
+				export, sub_handles[i], &new_obj, false,
+				&attrs[i], NULL, "lookup ", mdc_parent,
+				names[i], &invalidate, NULL)))
+			new_entries[i] = container_of(new_obj, mdcache_entry_t,
+						      obj_handle);
+
+		fsal_release_attrs(&attrs[i]);
+	}
+
+	gsh_free(statuses);
+	gsh_free(attrs);
+	gsh_free(sub_handles);
+}
+
 /**
  * @brief Lock two directories in order
  *
@@ -1459,17 +1798,21 @@ mdcache_dirent_add(mdcache_entry_t *parent, const char *name,
 	if (parent->obj_handle.type != DIRECTORY)
 		return fsalstat(ERR_FSAL_NOTDIR, 0);
 
+	/* The name exists now */
+	mdcache_avl_neg_remove(parent, name);
+
 	/* Don't cache if parent is not being cached */
 	if (parent->mde_flags & MDCACHE_BYPASS_DIRCACHE)
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 
 	/* in cache avl, we always insert on pentry_parent */
-	new_dir_entry = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + namesize);
+	new_dir_entry = mdcache_dirent_alloc(namesize, &entry->fh_hk.key);
 	new_dir_entry->flags = DIR_ENTRY_FLAG_NONE;
+	new_dir_entry->fileid = entry->obj_handle.fileid;
+	new_dir_entry->type = entry->obj_handle.type;
 	allocated_dir_entry = new_dir_entry;
 
 	memcpy(&new_dir_entry->name, name, namesize);
-	mdcache_key_dup(&new_dir_entry->ckey, &entry->fh_hk.key);
 
 	/* add to avl */
 	code = mdcache_avl_qp_insert(parent, &new_dir_entry);
@@ -1573,6 +1916,9 @@ mdcache_dirent_rename(mdcache_entry_t *parent, const char *oldname,
 		     "Rename dir entry %s to %s",
 		     oldname, newname);
 
+	/* The new name exists now */
+	mdcache_avl_neg_remove(parent, newname);
+
 	/* Don't rename if parent is not being cached */
 	if (parent->mde_flags & MDCACHE_BYPASS_DIRCACHE)
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -1603,7 +1949,7 @@ mdcache_dirent_rename(mdcache_entry_t *parent, const char *oldname,
 			(void)mdcache_find_keyed(&dirent2->ckey, &oldentry);
 
 			/* dirent2 (newname) will now point to renamed entry */
-			mdcache_key_delete(&dirent2->ckey);
+			mdcache_dirent_key_delete(dirent2);
 			mdcache_key_dup(&dirent2->ckey, &dirent->ckey);
 
 			/* Delete dirent for oldname */
@@ -1630,10 +1976,11 @@ mdcache_dirent_rename(mdcache_entry_t *parent, const char *oldname,
 	size_t newnamesize = strlen(newname) + 1;
 
 	/* try to rename--no longer in-place */
-	dirent2 = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + newnamesize);
+	dirent2 = mdcache_dirent_alloc(newnamesize, &dirent->ckey);
 	memcpy(dirent2->name, newname, newnamesize);
 	dirent2->flags = DIR_ENTRY_FLAG_NONE;
-	mdcache_key_dup(&dirent2->ckey, &dirent->ckey);
+	dirent2->fileid = dirent->fileid;
+	dirent2->type = dirent->type;
 
 	/* Delete the entry for oldname */
 	avl_dirent_set_deleted(parent, dirent);
@@ -2097,10 +2444,12 @@ mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
 		 */
 		glist_add_tail(&chunk->parent->fsobj.fsdir.chunks,
 			       &chunk->chunks);
+		mdcache_lru_chunk_insert(chunk);
 
 
 		/* Now start a new chunk. */
-		new_chunk = gsh_calloc(1, sizeof(struct dir_chunk));
+		new_chunk = gsh_calloc_tag(GSH_MEM_MDCACHE_DIRENTS, 1,
+					   sizeof(struct dir_chunk));
 
 		/* Setup new chunk. */
 		glist_init(&new_chunk->dirents);
@@ -2138,8 +2487,10 @@ mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
 		     new_entry, name, new_entry->sub_handle->fsal->name);
 
 	/* in cache avl, we always insert on mdc_parent */
-	new_dir_entry = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + namesize);
+	new_dir_entry = mdcache_dirent_alloc(namesize, &new_entry->fh_hk.key);
 	new_dir_entry->flags = DIR_ENTRY_FLAG_NONE;
+	new_dir_entry->fileid = new_entry->obj_handle.fileid;
+	new_dir_entry->type = new_entry->obj_handle.type;
 	new_dir_entry->chunk = chunk;
 	new_dir_entry->ck = cookie;
 	allocated_dir_entry = new_dir_entry;
@@ -2153,7 +2504,6 @@ mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
 	 */
 
 	memcpy(&new_dir_entry->name, name, namesize);
-	mdcache_key_dup(&new_dir_entry->ckey, &new_entry->fh_hk.key);
 
 	/* add to avl */
 	code = mdcache_avl_qp_insert(mdc_parent, &new_dir_entry);
@@ -2393,7 +2743,9 @@ fsal_status_t mdcache_populate_dir_chunk(mdcache_entry_t *directory,
 	fsal_status_t status = {0, 0};
 	fsal_status_t readdir_status = {0, 0};
 	struct mdcache_populate_cb_state state;
-	struct dir_chunk *first_chunk = gsh_calloc(1, sizeof(struct dir_chunk));
+	struct dir_chunk *first_chunk =
+		gsh_calloc_tag(GSH_MEM_MDCACHE_DIRENTS, 1,
+			       sizeof(struct dir_chunk));
 	struct dir_chunk *chunk = first_chunk;
 	attrmask_t attrmask;
 	bool eod = false;
@@ -2453,7 +2805,7 @@ again:
 		LogDebug(COMPONENT_NFS_READDIR, "FSAL readdir status=%s",
 			 fsal_err_txt(readdir_status));
 		*dirent = NULL;
-		gsh_free(chunk);
+		gsh_free_tag(GSH_MEM_MDCACHE_DIRENTS, chunk);
 		return readdir_status;
 	}
 
@@ -2461,7 +2813,7 @@ again:
 		LogDebug(COMPONENT_NFS_READDIR, "status=%s",
 			 fsal_err_txt(status));
 		*dirent = NULL;
-		gsh_free(chunk);
+		gsh_free_tag(GSH_MEM_MDCACHE_DIRENTS, chunk);
 		return status;
 	}
 
@@ -2481,7 +2833,7 @@ again:
 		 */
 		LogFullDebug(COMPONENT_NFS_READDIR, "Empty chunk");
 
-		gsh_free(chunk);
+		gsh_free_tag(GSH_MEM_MDCACHE_DIRENTS, chunk);
 
 		if (chunk == first_chunk) {
 			/* We really got nothing on this readdir, so don't
@@ -2518,6 +2870,7 @@ again:
 		 */
 		glist_add_tail(&directory->fsobj.fsdir.chunks,
 			       &chunk->chunks);
+		mdcache_lru_chunk_insert(chunk);
 	}
 
 	if (state.whence_is_name && *dirent == NULL) {
@@ -2549,7 +2902,8 @@ again:
 		prev_chunk = chunk;
 
 		/* And we need to allocate a fresh chunk. */
-		chunk = gsh_calloc(1, sizeof(struct dir_chunk));
+		chunk = gsh_calloc_tag(GSH_MEM_MDCACHE_DIRENTS, 1,
+				       sizeof(struct dir_chunk));
 
 		/* And go start a new FSAL readdir call. */
 		goto again;
@@ -2567,6 +2921,470 @@ again:
 	return status;
 }
 
+/**
+ * @brief Directory chunk prefetch
+ *
+ * A client that continues reading a directory from a cookie is most
+ * likely listing it through.  When its readdir stops within a chunk,
+ * the next Dir_Chunk_Prefetch chunks are read from the FSAL in the
+ * background, while the reply is encoded and the client asks for
+ * more, rather than when its cookie misses.
+ */
+#define MDC_DIR_PREFETCH_THREADS 4
+
+struct mdc_dir_prefetch {
+	mdcache_entry_t *dir;		/*< Directory, referenced */
+	struct gsh_export *export;	/*< Export, referenced */
+	struct fsal_export *fsal_export;
+	struct user_cred creds;		/*< Credentials of the requester */
+	fsal_cookie_t ck;		/*< Last cookie the client got to */
+};
+
+static struct fridgethr *dir_prefetch_fridge;
+
+/**
+ * @brief Read ahead the chunks following a cookie
+ *
+ * @param[in] ctx  Thread context, arg is the struct mdc_dir_prefetch
+ */
+static void mdc_dir_prefetch_run(struct fridgethr_context *ctx)
+{
+	struct mdc_dir_prefetch *pf = ctx->arg;
+	mdcache_entry_t *directory = pf->dir;
+	struct req_op_context *save_ctx = op_ctx, req_ctx = {0};
+	mdcache_dir_entry_t *dirent, *last;
+	struct dir_chunk *chunk;
+	fsal_cookie_t ck = pf->ck;
+	fsal_status_t status;
+	uint32_t i;
+
+	req_ctx.ctx_export = pf->export;
+	req_ctx.fsal_export = pf->fsal_export;
+	req_ctx.creds = &pf->creds;
+	op_ctx = &req_ctx;
+
+	PTHREAD_RWLOCK_wrlock(&directory->content_lock);
+
+	for (i = 0; i < mdcache_param.dir.chunk_prefetch; i++) {
+		/* Stop if the dirents were invalidated or the chunk we
+		 * continue from was reclaimed meanwhile.
+		 */
+		if ((directory->mde_flags & MDCACHE_TRUST_CONTENT) == 0 ||
+		    !mdcache_avl_lookup_ck(directory, ck, &dirent))
+			break;
+
+		chunk = dirent->chunk;
+		last = glist_last_entry(&chunk->dirents, mdcache_dir_entry_t,
+					chunk_list);
+		if (last->eod)
+			break;
+
+		if (chunk->next_ck == 0 ||
+		    !mdcache_avl_lookup_ck(directory, chunk->next_ck,
+					   &dirent)) {
+			status = mdcache_populate_dir_chunk(directory, last->ck,
+							    &dirent, chunk);
+			if (FSAL_IS_ERROR(status) || dirent == NULL)
+				break;
+		}
+
+		/* Continue from the end of the chunk just read or found */
+		ck = glist_last_entry(&dirent->chunk->dirents,
+				      mdcache_dir_entry_t, chunk_list)->ck;
+	}
+
+	PTHREAD_RWLOCK_unlock(&directory->content_lock);
+
+	LogFullDebug(COMPONENT_NFS_READDIR,
+		     "Prefetched %" PRIu32 " chunks of directory %p",
+		     i, directory);
+
+	op_ctx = save_ctx;
+
+	atomic_store_uint32_t(&directory->fsobj.fsdir.prefetching, 0);
+	mdcache_put(directory);
+	put_gsh_export(pf->export);
+	gsh_free(pf->creds.caller_garray);
+	gsh_free(pf);
+}
+
+/**
+ * @brief Start reading ahead the chunks following a chunk
+ *
+ * At most one prefetch is running per directory.  Called with the
+ * content_lock held.
+ *
+ * @param[in] directory  The directory being read
+ * @param[in] chunk      The chunk the client stopped in
+ */
+static void mdcache_dir_prefetch(mdcache_entry_t *directory,
+				 struct dir_chunk *chunk)
+{
+	struct mdc_dir_prefetch *pf;
+	mdcache_dir_entry_t *last;
+	fsal_status_t status;
+	int rc;
+
+	if (dir_prefetch_fridge == NULL)
+		return;
+
+	last = glist_last_entry(&chunk->dirents, mdcache_dir_entry_t,
+				chunk_list);
+	if (last == NULL || last->eod)
+		return;
+
+	if (atomic_inc_uint32_t(&directory->fsobj.fsdir.prefetching) != 1) {
+		(void)atomic_dec_uint32_t(&directory->fsobj.fsdir.prefetching);
+		return;
+	}
+
+	status = mdcache_get(directory);
+	if (FSAL_IS_ERROR(status)) {
+		atomic_store_uint32_t(&directory->fsobj.fsdir.prefetching, 0);
+		return;
+	}
+
+	pf = gsh_calloc(1, sizeof(*pf));
+	pf->dir = directory;
+	pf->export = op_ctx->ctx_export;
+	get_gsh_export_ref(pf->export);
+	pf->fsal_export = op_ctx->fsal_export;
+	pf->ck = last->ck;
+
+	if (op_ctx->creds != NULL) {
+		pf->creds = *op_ctx->creds;
+		if (pf->creds.caller_glen != 0) {
+			pf->creds.caller_garray =
+				gsh_malloc(pf->creds.caller_glen *
+					   sizeof(gid_t));
+			memcpy(pf->creds.caller_garray,
+			       op_ctx->creds->caller_garray,
+			       pf->creds.caller_glen * sizeof(gid_t));
+		} else {
+			pf->creds.caller_garray = NULL;
+		}
+	}
+
+	rc = fridgethr_submit(dir_prefetch_fridge, mdc_dir_prefetch_run, pf);
+	if (rc != 0) {
+		LogDebug(COMPONENT_NFS_READDIR,
+			 "Could not submit directory prefetch, error %d", rc);
+		atomic_store_uint32_t(&directory->fsobj.fsdir.prefetching, 0);
+		mdcache_put(directory);
+		put_gsh_export(pf->export);
+		gsh_free(pf->creds.caller_garray);
+		gsh_free(pf);
+	}
+}
+
+/**
+ * @brief Attribute prefetch for readdir
+ *
+ * When a readdir wants attributes, each entry whose cached attributes
+ * have expired costs a getattrs on the sub-FSAL.  For FSALs where that
+ * is a remote stat, the entries of a chunk are refreshed before the
+ * chunk is walked, through the sub-FSAL's bulk operations or else
+ * concurrently on Dir_Attr_Prefetch_Threads workers, so a reply costs
+ * about one backend round trip instead of one per entry.
+ */
+struct mdc_attr_batch {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	uint32_t pending;		/*< Jobs not finished yet */
+	struct req_op_context *ctx;	/*< Context of the waiting caller */
+	attrmask_t attrmask;
+};
+
+struct mdc_attr_job {
+	struct mdc_attr_batch *batch;
+	mdcache_entry_t *entry;		/*< Entry to refresh */
+};
+
+static struct fridgethr *attr_prefetch_fridge;
+
+/**
+ * @brief Account for a finished attribute job
+ */
+static void mdc_attr_job_done(struct mdc_attr_batch *batch)
+{
+	PTHREAD_MUTEX_lock(&batch->mtx);
+	if (--batch->pending == 0)
+		pthread_cond_signal(&batch->cv);
+	PTHREAD_MUTEX_unlock(&batch->mtx);
+}
+
+/**
+ * @brief Refresh the attributes of one entry
+ *
+ * Errors are not reported here, the readdir walking the chunk will hit
+ * them again and handle them.
+ *
+ * @param[in] ctx  Thread context, arg is the struct mdc_attr_job
+ */
+static void mdc_attr_prefetch_run(struct fridgethr_context *ctx)
+{
+	struct mdc_attr_job *job = ctx->arg;
+	struct mdc_attr_batch *batch = job->batch;
+	struct req_op_context *save_ctx = op_ctx, req_ctx;
+	struct attrlist attrs;
+
+	/* The caller waits for us, its context stays valid */
+	req_ctx = *batch->ctx;
+	op_ctx = &req_ctx;
+
+	fsal_prepare_attrs(&attrs, batch->attrmask);
+	(void)job->entry->obj_handle.obj_ops.getattrs(&job->entry->obj_handle,
+						       &attrs);
+	fsal_release_attrs(&attrs);
+
+	op_ctx = save_ctx;
+
+	mdc_attr_job_done(batch);
+}
+
+/**
+ * @brief Refresh the attributes of entries on the prefetch workers
+ *
+ * Returns once every job is done.
+ *
+ * @param[in] entries   Entries to refresh
+ * @param[in] count     Number of entries
+ * @param[in] attrmask  Attributes the caller wants
+ */
+static void mdc_attr_prefetch_workers(mdcache_entry_t **entries,
+				      uint32_t count, attrmask_t attrmask)
+{
+	struct mdc_attr_batch batch;
+	struct mdc_attr_job *jobs;
+	uint32_t i;
+
+	jobs = gsh_malloc(count * sizeof(*jobs));
+
+	PTHREAD_MUTEX_init(&batch.mtx, NULL);
+	PTHREAD_COND_init(&batch.cv, NULL);
+	batch.pending = count;
+	batch.ctx = op_ctx;
+	batch.attrmask = attrmask;
+
+	for (i = 0; i < count; i++) {
+		jobs[i].batch = &batch;
+		jobs[i].entry = entries[i];
+		if (fridgethr_submit(attr_prefetch_fridge,
+				     mdc_attr_prefetch_run, &jobs[i]) != 0)
+			mdc_attr_job_done(&batch);
+	}
+
+	PTHREAD_MUTEX_lock(&batch.mtx);
+	while (batch.pending != 0)
+		pthread_cond_wait(&batch.cv, &batch.mtx);
+	PTHREAD_MUTEX_unlock(&batch.mtx);
+
+	PTHREAD_COND_destroy(&batch.cv);
+	PTHREAD_MUTEX_destroy(&batch.mtx);
+	gsh_free(jobs);
+}
+
+/**
+ * @brief Resolve the entries of a chunk and refresh their attributes
+ *
+ * When the sub-FSAL has native bulk operations, the names not in the
+ * cache are looked up with one lookup_bulk and the stale attributes
+ * fetched with one getattrs_bulk.  Otherwise, if attribute prefetch
+ * threads are configured, stale attributes are refreshed concurrently
+ * on them.
+ *
+ * Called with the content_lock held, returns once all is done.
+ *
+ * @param[in] directory The directory being read
+ * @param[in] chunk     The chunk about to be walked
+ * @param[in] dirent    Dirent the walk starts from
+ * @param[in] whence    Cookie the walk skips
+ * @param[in] attrmask  Attributes the caller wants
+ */
+static void mdc_readdir_prefetch_attrs(mdcache_entry_t *directory,
+				       struct dir_chunk *chunk,
+				       mdcache_dir_entry_t *dirent,
+				       fsal_cookie_t whence,
+				       attrmask_t attrmask)
+{
+	mdcache_entry_t **entries, **found;
+	const char **names;
+	mdcache_entry_t *entry;
+	fsal_status_t status;
+	uint32_t nentries = 0, nnames = 0, max, i;
+	bool bulk, valid;
+
+	if (attrmask == 0 || chunk->num_entries < 2)
+		return;
+
+	bulk = op_ctx->fsal_export->exp_ops.fs_supports(op_ctx->fsal_export,
+							fso_bulk_ops);
+	if (!bulk && attr_prefetch_fridge == NULL)
+		return;
+
+	max = chunk->num_entries;
+	entries = gsh_malloc(max * sizeof(*entries));
+	names = gsh_malloc(max * sizeof(*names));
+
+	for (; dirent != NULL && nentries + nnames < max;
+	     dirent = glist_next_entry(&chunk->dirents, mdcache_dir_entry_t,
+				       chunk_list, &dirent->chunk_list)) {
+		if (dirent->ck == whence ||
+		    (dirent->flags & DIR_ENTRY_FLAG_DELETED))
+			continue;
+
+		status = mdcache_find_keyed(&dirent->ckey, &entry);
+		if (FSAL_IS_ERROR(status)) {
+			/* A lookup fetches the attributes as well */
+			if (bulk)
+				names[nnames++] = dirent->name;
+			continue;
+		}
+
+		PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+		valid = mdcache_is_attrs_valid(entry, attrmask);
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+		if (valid) {
+			mdcache_put(entry);
+			continue;
+		}
+
+		entries[nentries++] = entry;
+	}
+
+	/* With a single entry there is nothing to overlap, the walk
+	 * will do it.
+	 */
+	if (nnames > 1) {
+		found = gsh_malloc(nnames * sizeof(*found));
+		mdc_lookup_uncached_bulk(directory, nnames, names, found);
+		for (i = 0; i < nnames; i++)
+			if (found[i] != NULL)
+				mdcache_put(found[i]);
+		gsh_free(found);
+	}
+
+	if (nentries > 1) {
+		if (bulk)
+			mdcache_refresh_attrs_bulk(entries, nentries, attrmask);
+		else
+			mdc_attr_prefetch_workers(entries, nentries, attrmask);
+
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "Refreshed attributes of %" PRIu32 " entries",
+			     nentries);
+	}
+
+	for (i = 0; i < nentries; i++)
+		mdcache_put(entries[i]);
+
+	gsh_free(names);
+	gsh_free(entries);
+}
+
+/**
+ * @brief Start a fridge of prefetch workers
+ *
+ * @param[out] fr       The fridge
+ * @param[in]  name     Name of the fridge
+ * @param[in]  threads  Maximum number of workers
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdc_prefetch_fridge_init(struct fridgethr **fr,
+				       const char *name,
+				       uint32_t threads)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = threads;
+	frp.thr_min = 0;
+	frp.thread_delay = 600;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(fr, name, &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize %s fridge, error code %d.",
+			 name, rc);
+		return fsalstat(posix2fsal_error(rc), rc);
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Stop a fridge of prefetch workers
+ *
+ * @param[in,out] fr  The fridge, NULL if it was never started
+ */
+void mdc_prefetch_fridge_shutdown(struct fridgethr **fr)
+{
+	int rc;
+
+	if (*fr == NULL)
+		return;
+
+	rc = fridgethr_sync_command(*fr, fridgethr_comm_stop, 120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Shutdown timed out, cancelling prefetch threads.");
+		fridgethr_cancel(*fr);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down prefetch threads: %d", rc);
+	}
+
+	fridgethr_destroy(*fr);
+	*fr = NULL;
+}
+
+/**
+ * @brief Start the directory and attribute prefetch threads
+ *
+ * Each pool is only started if its prefetch is enabled.
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_dir_prefetch_pkginit(void)
+{
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+
+	if (mdcache_param.dir.avl_chunk == 0)
+		return status;
+
+	if (mdcache_param.dir.chunk_prefetch != 0) {
+		status = mdc_prefetch_fridge_init(&dir_prefetch_fridge,
+						  "mdc_dir_prefetch",
+						  MDC_DIR_PREFETCH_THREADS);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
+	if (mdcache_param.dir.attr_prefetch_threads != 0) {
+		status = mdc_prefetch_fridge_init(
+				&attr_prefetch_fridge, "mdc_attr_prefetch",
+				mdcache_param.dir.attr_prefetch_threads);
+		if (FSAL_IS_ERROR(status))
+			mdc_prefetch_fridge_shutdown(&dir_prefetch_fridge);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Stop the directory and attribute prefetch threads
+ */
+void mdcache_dir_prefetch_pkgshutdown(void)
+{
+	mdc_prefetch_fridge_shutdown(&dir_prefetch_fridge);
+	mdc_prefetch_fridge_shutdown(&attr_prefetch_fridge);
+}
+
 /**
  * @brief Read the contents of a directory
  *
@@ -2576,10 +3394,16 @@ again:
  * @note The object passed into the callback is ref'd and must be unref'd by the
  * callback.
  *
+ * With names_cb rather than cb, only the names, fileids and types are
+ * passed up, straight from the dirents: no entry is looked up nor
+ * attribute refreshed, except for a dirent that was not given its
+ * fileid and type when created.
+ *
  * @param[in] directory  The directory to read
  * @param[in] whence     Where to start (next)
  * @param[in] dir_state  Pass thru of state to callback
  * @param[in] cb         Callback function
+ * @param[in] names_cb   Callback function for names only, when cb is NULL
  * @param[in] attrmask   Which attributes to fill
  * @param[out] eod_met   eod marker true == end of dir
  *
@@ -2590,6 +3414,7 @@ fsal_status_t mdcache_readdir_chunked(mdcache_entry_t *directory,
 				      fsal_cookie_t whence,
 				      void *dir_state,
 				      fsal_readdir_cb cb,
+				      fsal_readdir_names_cb names_cb,
 				      attrmask_t attrmask,
 				      bool *eod_met)
 {
@@ -2737,6 +3562,14 @@ again:
 
 	/* dirent WILL be non-NULL, remember the chunk we are in. */
 	chunk = dirent->chunk;
+	mdcache_lru_chunk_touch(chunk);
+
+	/* Refresh what the walk needs in one go rather than entry by
+	 * entry.
+	 */
+	if (cb != NULL)
+		mdc_readdir_prefetch_attrs(directory, chunk, dirent, whence,
+					   attrmask);
 
 	LogFullDebug(COMPONENT_NFS_READDIR,
 		     "About to read directory=%p cookie=%" PRIx64,
@@ -2768,6 +3601,14 @@ again:
 			continue;
 		}
 
+		if (names_cb != NULL && dirent->type != NO_FILE_TYPE) {
+			next_ck = dirent->ck;
+			status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+			cb_result = names_cb(dirent->name, dirent->fileid,
+					     dirent->type, dir_state, next_ck);
+			goto done;
+		}
+
 		/* Get actual entry using the dirent ckey */
 		status = mdcache_find_keyed(&dirent->ckey, &entry);
 
@@ -2796,6 +3637,15 @@ again:
 
 		next_ck = dirent->ck;
 
+		if (names_cb != NULL) {
+			cb_result = names_cb(dirent->name,
+					     entry->obj_handle.fileid,
+					     entry->obj_handle.type,
+					     dir_state, next_ck);
+			mdcache_put(entry);
+			goto done;
+		}
+
 		/* Ensure the attribute cache is valid.  The simplest way to do
 		 * this is to call getattrs().  We need a copy anyway, to ensure
 		 * thread safety.
@@ -2819,6 +3669,7 @@ again:
 
 		fsal_release_attrs(&attrs);
 
+done:
 		if (cb_result >= DIR_TERMINATE || dirent->eod) {
 			/* Caller is done, or we have reached the end of
 			 * the directory, no need to get another dirent.
@@ -2836,6 +3687,13 @@ again:
 				 fsal_dir_result_str(cb_result),
 				 *eod_met ? "true" : "false");
 
+			/* A client continuing from a cookie is reading
+			 * the directory through, fetch what it will ask
+			 * for next while this reply goes out.
+			 */
+			if (whence != 0 && !*eod_met)
+				mdcache_dir_prefetch(directory, chunk);
+
 			PTHREAD_RWLOCK_unlock(&directory->content_lock);
 
 			return status;
@@ -3051,6 +3909,9 @@ _mdcache_kill_entry(mdcache_entry_t *entry,
 {
 	bool freed;
 
+	/* Handles PUTFH cached may resolve to this entry */
+	nfs4_fh_cache_invalidate();
+
 	if (isDebug(COMPONENT_CACHE_INODE)) {
 		DisplayLogComponentLevel(COMPONENT_CACHE_INODE,
 					 file, line, function, NIV_DEBUG,
@@ -40,10 +40,61 @@
 #include "fsal_up.h"
 #include "fsal_convert.h"
 #include "display.h"
+#include "abstract_atomic.h"
+
+#ifdef USE_LTTNG
+#include "gsh_lttng/mdcache.h"
+#endif
+
+struct fridgethr;
 
 typedef struct mdcache_fsal_obj_handle mdcache_entry_t;
 
 #define MDC_UNEXPORT 1
+/** Attributes stay valid until an upcall invalidates them */
+#define MDC_TRUST_UPCALLS 2
+/** Export is Immutable, attributes and dirents stay valid until
+ *  invalidated by upcall or the export goes away */
+#define MDC_IMMUTABLE 4
+
+/**
+ * @brief Read stream of a file and its readahead window
+ */
+struct mdc_readahead {
+	pthread_mutex_t mtx;
+	uint64_t next;		/*< Where a sequential read would start */
+	uint32_t seq;		/*< Sequential reads in a row */
+	uint32_t gen;		/*< Bumped when the window is discarded */
+	bool filling;		/*< A fill is in flight */
+	bool eof;		/*< The window ends at end of file */
+	uint64_t offset;	/*< Start of the window */
+	size_t len;		/*< Bytes of data in the window */
+	size_t size;		/*< Size of buf */
+	uint64_t change;	/*< Change attribute the data goes with */
+	char *buf;		/*< Window data, NULL if none */
+};
+
+/**
+ * @brief Gathered unstable writes and COMMITs in flight of a file
+ */
+struct mdc_gather {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	struct state_t *state;	/*< State of the gathered writes, referenced */
+	struct user_cred creds;	/*< Credentials of the gathered writes */
+	bool bypass;		/*< Bypass of the gathered writes */
+	uint64_t offset;	/*< Offset of the gathered data */
+	size_t len;		/*< Bytes of gathered data */
+	char *buf;		/*< Gathered data, Write_Gather_Size bytes */
+	fsal_status_t error;	/*< Failed write out, for the next COMMIT */
+	bool syncing;		/*< A sync is in flight */
+	bool want;		/*< A COMMIT waits for the next sync */
+	uint64_t started;	/*< Syncs started */
+	uint64_t done;		/*< Last sync finished */
+	fsal_status_t last;	/*< Status of that sync */
+	uint64_t lo;		/*< Range of the next sync */
+	uint64_t hi;		/*< End of that range, UINT64_MAX for EOF */
+};
 
 /*
  * MDCACHE internal export
@@ -61,6 +112,9 @@ struct mdcache_fsal_export {
 	pthread_rwlock_t mdc_exp_lock;
 	/** Flags for the export. */
 	uint8_t flags;
+	/** Entries whose first mapping is this export, charged against
+	    the export's Cache_Entries_HWMark */
+	int64_t entries_used;
 };
 
 /**
@@ -114,11 +168,13 @@ enum lru_q_id {
 	LRU_ENTRY_NONE = 0, /* entry not queued */
 	LRU_ENTRY_L1,
 	LRU_ENTRY_L2,
-	LRU_ENTRY_CLEANUP
+	LRU_ENTRY_CLEANUP,
+	LRU_ENTRY_PROBATION /* 2Q: entry referenced only once so far */
 };
 
 #define LRU_CLEANUP 0x00000001 /* Entry is on cleanup queue */
 #define LRU_CLEANED 0x00000002 /* Entry has been cleaned */
+#define LRU_FDQ 0x00000004 /* Entry is on its lane's fd queue */
 
 typedef struct mdcache_lru__ {
 	struct glist_head q;	/*< Link in the physical deque
@@ -133,6 +189,9 @@ typedef struct mdcache_lru__ {
 				 *< decrement the correct counter when moving
 				 *< or deleting the entry. */
 	uint32_t cf;		/*< Confounder */
+	struct glist_head fdq;	/*< Link in the lane's fd queue */
+	time_t fd_time;		/*< Last time the entry was moved to the
+				   MRU of the fd queue */
 } mdcache_lru_t;
 
 /**
@@ -145,10 +204,33 @@ struct mdcache_stats {
 	uint64_t inode_conf;
 	uint64_t inode_added;
 	uint64_t inode_mapping;
+	uint64_t mem_used;	/*< Bytes held by entries, keys and dirents */
+	uint64_t spill_out;	/*< Directories spilled to Spill_File */
+	uint64_t spill_in;	/*< Directories restored from Spill_File */
 };
 
 extern struct mdcache_stats *cache_stp;
 
+/**
+ * @brief Account memory allocated to the cache
+ *
+ * @param[in] bytes  Bytes allocated
+ */
+static inline void mdcache_mem_charge(size_t bytes)
+{
+	(void) atomic_add_uint64_t(&cache_stp->mem_used, bytes);
+}
+
+/**
+ * @brief Account memory released by the cache
+ *
+ * @param[in] bytes  Bytes freed
+ */
+static inline void mdcache_mem_uncharge(size_t bytes)
+{
+	(void) atomic_sub_uint64_t(&cache_stp->mem_used, bytes);
+}
+
 /**
  * @brief Represents one of the many-many links between inodes and exports.
  *
@@ -181,6 +263,8 @@ struct entry_export_map {
 static const uint32_t MDCACHE_UNREACHABLE = 0x100;
 /** The directory is too big; skip the dirent cache */
 static const uint32_t MDCACHE_BYPASS_DIRCACHE = 0x200;
+/** A background refresh of the attributes is in flight */
+static const uint32_t MDCACHE_REFRESHING = 0x400;
 
 
 /**
@@ -203,6 +287,13 @@ static const uint32_t MDCACHE_BYPASS_DIRCACHE = 0x200;
  *     READ when dereferencing the object.symlink pointer or reading
  *     cached content. XXX dang symlink content is in FSAL now
  *
+ * (4) A lookup that misses the dirent cache calls the sub-FSAL holding
+ *     only the stripe of mdc_name_lock for the directory and name, not
+ *     the content_lock, which is taken again to cache the result.  The
+ *     result is only cached if fsdir.ns_gen did not move meanwhile.  A
+ *     name stripe is never taken while holding a content_lock.  The
+ *     same goes for the handle stripes of mdcache_locate_host.
+ *
  * The handle, cache key, and type fields are unprotected, as they are
  * considered to be immutable throughout the life of the object.
  *
@@ -226,37 +317,41 @@ static const uint32_t MDCACHE_BYPASS_DIRCACHE = 0x200;
  */
 
 struct mdcache_fsal_obj_handle {
-	/** Reader-writer lock for attributes */
-	pthread_rwlock_t attr_lock;
-	/** MDCache FSAL Handle */
-	struct fsal_obj_handle obj_handle;
-	/** Sub-FSAL handle */
-	struct fsal_obj_handle *sub_handle;
-	/** Cached attributes */
-	struct attrlist attrs;
+	/* What a lookup that hits reads and writes comes first, so that
+	 * it touches the first lines of the entry only.
+	 */
 	/** FH hash linkage */
 	struct {
-		struct avltree_node node_k;	/*< AVL node in tree */
+		/** Next entry in the hash chain */
+		struct mdcache_fsal_obj_handle *next_k;
 		mdcache_key_t key;	/*< Key of this entry */
-		bool inavl;
+		bool inhash;
 	} fh_hk;
+	/** New style LRU link */
+	mdcache_lru_t lru;
 	/** Flags for this entry */
 	uint32_t mde_flags;
-	/** refcount for number of active icreate */
-	int32_t icreate_refcnt;
+	/** ID of the first mapped export for fast path
+	 *  This is an int32_t because we need it to be -1 to indicate
+	 *  no mapped export.
+	 */
+	int32_t first_export_id;
 	/** Time at which we last refreshed attributes. */
 	time_t attr_time;
 	/** Time at which we last refreshed acl. */
 	time_t acl_time;
-	/** New style LRU link */
-	mdcache_lru_t lru;
+	/** Sub-FSAL handle */
+	struct fsal_obj_handle *sub_handle;
+	/** Reader-writer lock for attributes */
+	pthread_rwlock_t attr_lock;
+	/** MDCache FSAL Handle */
+	struct fsal_obj_handle obj_handle;
+	/** Cached attributes */
+	struct attrlist attrs;
 	/** Exports per entry (protected by attr_lock) */
 	struct glist_head export_list;
-	/** ID of the first mapped export for fast path
-	 *  This is an int32_t because we need it to be -1 to indicate
-	 *  no mapped export.
-	 */
-	int32_t first_export_id;
+	/** refcount for number of active icreate */
+	int32_t icreate_refcnt;
 	/** Lock on type-specific cached content.  See locking
 	    discipline for details. */
 	pthread_rwlock_t content_lock;
@@ -291,6 +386,13 @@ struct mdcache_fsal_obj_handle {
 			 *  0 if not known.
 			 */
 			fsal_cookie_t first_ck;
+			/** Non-zero while chunks are being prefetched */
+			uint32_t prefetching;
+			/** Bumped by every create, link, unlink and rename
+			 *  in this directory, see mdc_lookup.  Protected by
+			 *  content_lock.
+			 */
+			uint32_t ns_gen;
 			struct {
 				/** Children by name hash */
 				struct avltree t;
@@ -300,12 +402,33 @@ struct mdcache_fsal_obj_handle {
 				struct avltree ck;
 				/** Table of dirents in sorted order. */
 				struct avltree sorted;
+				/** Names known not to exist */
+				struct avltree neg;
+				/** Number of names in neg */
+				uint32_t nneg;
 				/** Heuristic. Expect 0. */
 				uint32_t collisions;
 			} avl;
 		} fsdir;		/**< DIRECTORY data */
+		struct {
+			/** Storage for file state, this overlays hdl */
+			struct state_hdl fhdl;
+			/** Sequential read stream */
+			struct mdc_readahead ra;
+			/** Write gathering and COMMIT coalescing */
+			struct mdc_gather wg;
+		} fsfile;		/**< REGULAR_FILE data */
+		struct {
+			/** Storage for state, this overlays hdl */
+			struct state_hdl lhdl;
+			/** Copy of the target, served while
+			 *  MDCACHE_TRUST_CONTENT and the attributes are
+			 *  valid.  NULL addr if not loaded.
+			 */
+			struct gsh_buffdesc link;
+		} fssym;		/**< SYMBOLIC_LINK data */
 	} fsobj;
-};
+} __attribute__ ((aligned(GSH_CACHE_LINE_SIZE)));
 
 struct dir_chunk {
 	/** This chunk is part of a directory */
@@ -326,6 +449,8 @@ struct dir_chunk {
 	fsal_cookie_t next_ck;
 	/** Number of entries in chunk */
 	int num_entries;
+	/** Chunk LRU linkage, not linked unless Dir_Max_Chunks is set */
+	struct glist_head chunk_lru;
 };
 
 /**
@@ -355,23 +480,74 @@ typedef struct mdcache_dir_entry__ {
 	 *  a readdir with whence will be looking for the NEXT entry.
 	 */
 	uint64_t ck;
-	/** Indicates if this dirent is the last dirent in a chunked directory.
-	 */
-	bool eod;
 	struct {
 		/** Name Hash */
 		uint64_t k;
 		/** Number of probes, an efficiency metric */
 		uint32_t p;
 	} hk;
-	/** Key of cache entry */
+	/** Key of cache entry, its handle normally stored after name */
 	mdcache_key_t ckey;
+	/** Fileid of the entry, valid unless type is NO_FILE_TYPE */
+	uint64_t fileid;
+	/** Type of the entry, so that listing names needs no entry */
+	object_file_type_t type;
 	/** Flags */
 	uint32_t flags;
-	/** The NUL-terminated filename */
+	/** Bytes of handle stored after name */
+	uint16_t keyspace;
+	/** Indicates if this dirent is the last dirent in a chunked directory.
+	 */
+	bool eod;
+	/** The NUL-terminated filename, followed by the key's handle */
 	char name[];
 } mdcache_dir_entry_t;
 
+/**
+ * @brief Allocate a dirent with room for its name and key
+ *
+ * The name and the handle of the key are packed into the same
+ * allocation as the dirent, so a cached dirent is a single block.
+ *
+ * @param[in] namesize  Size of the name, including its NUL
+ * @param[in] key       Key of the cache entry, copied into the dirent
+ *
+ * @return The zeroed dirent, with its key set.
+ */
+static inline mdcache_dir_entry_t *mdcache_dirent_alloc(size_t namesize,
+							mdcache_key_t *key)
+{
+	size_t size = offsetof(mdcache_dir_entry_t, name) + namesize +
+		      key->kv.len;
+	mdcache_dir_entry_t *dirent;
+
+	mdcache_mem_charge(size);
+	dirent = gsh_calloc_tag(GSH_MEM_MDCACHE_DIRENTS, 1, size);
+
+	dirent->keyspace = key->kv.len;
+	dirent->ckey.kv.addr = dirent->name + namesize;
+	dirent->ckey.kv.len = key->kv.len;
+	memcpy(dirent->ckey.kv.addr, key->kv.addr, key->kv.len);
+	dirent->ckey.hk = key->hk;
+	dirent->ckey.fsal = key->fsal;
+
+	return dirent;
+}
+
+/**
+ * @brief Free a dirent allocated by mdcache_dirent_alloc
+ *
+ * The key, if any, must already have been deleted.
+ *
+ * @param[in] dirent  The dirent to free
+ */
+static inline void mdcache_dirent_free(mdcache_dir_entry_t *dirent)
+{
+	mdcache_mem_uncharge(offsetof(mdcache_dir_entry_t, name) +
+			     strlen(dirent->name) + 1 + dirent->keyspace);
+	gsh_free_tag(GSH_MEM_MDCACHE_DIRENTS, dirent);
+}
+
 /* Helpers */
 fsal_status_t mdcache_alloc_and_check_handle(
 		struct mdcache_fsal_export *export,
@@ -388,6 +564,8 @@ fsal_status_t mdcache_alloc_and_check_handle(
 
 fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
 				    bool invalidate);
+void mdcache_refresh_attrs_bulk(mdcache_entry_t **entries, uint32_t count,
+				attrmask_t attrmask);
 
 static inline
 void mdcache_refresh_attrs_no_invalidate(mdcache_entry_t *entry)
@@ -425,6 +603,7 @@ fsal_status_t mdc_try_get_cached(mdcache_entry_t *mdc_parent, const char *name,
 fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 			 bool uncached, mdcache_entry_t **new_entry,
 			 struct attrlist *attrs_out);
+void mdc_name_locks_init(void);
 fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 				  const char *name,
 				  mdcache_entry_t **new_entry,
@@ -449,12 +628,55 @@ fsal_status_t mdcache_readdir_uncached(mdcache_entry_t *directory, fsal_cookie_t
 				       bool *eod_met);
 bool add_dirent_to_chunk(mdcache_entry_t *parent_dir,
 			 mdcache_dir_entry_t *new_dir_entry);
+void mdc_lookup_uncached_bulk(mdcache_entry_t *mdc_parent, uint32_t count,
+			      const char **names,
+			      mdcache_entry_t **new_entries);
 fsal_status_t mdcache_readdir_chunked(mdcache_entry_t *directory,
 				      fsal_cookie_t whence,
 				      void *dir_state,
 				      fsal_readdir_cb cb,
+				      fsal_readdir_names_cb names_cb,
 				      attrmask_t attrmask,
 				      bool *eod_met);
+fsal_status_t mdcache_populate_dir_chunk(mdcache_entry_t *directory,
+					 fsal_cookie_t whence,
+					 mdcache_dir_entry_t **dirent,
+					 struct dir_chunk *prev_chunk);
+fsal_status_t mdcache_dir_prefetch_pkginit(void);
+void mdcache_dir_prefetch_pkgshutdown(void);
+fsal_status_t mdc_prefetch_fridge_init(struct fridgethr **fr,
+				       const char *name,
+				       uint32_t threads);
+void mdc_prefetch_fridge_shutdown(struct fridgethr **fr);
+
+void mdc_ra_init(mdcache_entry_t *entry);
+void mdc_ra_destroy(mdcache_entry_t *entry);
+void mdc_ra_invalidate(mdcache_entry_t *entry);
+bool mdc_ra_read(mdcache_entry_t *entry, uint64_t offset,
+		 struct iovec *iov, int iovcnt, size_t *amount, bool *eof);
+void mdc_ra_advance(mdcache_entry_t *entry, uint64_t offset,
+		    const struct iovec *iov, int iovcnt);
+fsal_status_t mdcache_readahead_pkginit(void);
+void mdcache_readahead_pkgshutdown(void);
+
+void mdcache_snapshot_pkgshutdown(void);
+
+fsal_status_t mdcache_attr_refresh_pkginit(void);
+void mdcache_attr_refresh_pkgshutdown(void);
+
+void mdc_spill_dir(mdcache_entry_t *entry);
+void mdc_spill_load(mdcache_entry_t *entry, const struct attrlist *attrs);
+void mdcache_spill_pkginit(void);
+void mdcache_spill_pkgshutdown(void);
+
+void mdc_wg_init(mdcache_entry_t *entry);
+void mdc_wg_destroy(mdcache_entry_t *entry);
+fsal_status_t mdc_wg_flush(mdcache_entry_t *entry);
+bool mdc_wg_write(mdcache_entry_t *entry, bool bypass, struct state_t *state,
+		  uint64_t offset, size_t buf_size, void *buffer,
+		  size_t *write_amount, bool *fsal_stable,
+		  fsal_status_t *status);
+fsal_status_t mdc_wg_commit(mdcache_entry_t *entry, off_t offset, size_t len);
 
 void mdc_get_parent(struct mdcache_fsal_export *export,
 		    mdcache_entry_t *entry);
@@ -476,6 +698,23 @@ static inline struct mdcache_fsal_export *mdc_cur_export(void)
 	return mdc_export(op_ctx->fsal_export);
 }
 
+/**
+ * @brief Apply the export's upcall trust to fresh attributes
+ *
+ * On exports whose FSAL reports every change by upcall, and on
+ * Immutable exports, attributes never expire; an upcall clears
+ * MDCACHE_TRUST_ATTRS instead.
+ *
+ * @param[in,out] attrs	Attributes about to be cached
+ */
+static inline void mdc_trust_upcall_expiry(struct attrlist *attrs)
+{
+	if (atomic_fetch_uint8_t(&mdc_cur_export()->flags) &
+	    (MDC_TRUST_UPCALLS | MDC_IMMUTABLE))
+		attrs->expire_time_attr = -1;
+}
+
+void mdc_unmap_entry(mdcache_entry_t *entry);
 void mdc_clean_entry(mdcache_entry_t *entry);
 fsal_status_t mdc_check_mapping(mdcache_entry_t *entry);
 void _mdcache_kill_entry(mdcache_entry_t *entry,
@@ -503,10 +742,20 @@ extern struct config_block mdcache_param_blk;
 		op_ctx->fsal_export = &(myexp)->export; \
 } while (0)
 
+/* Trace the time spent in the sub-FSAL as part of a request span */
+#ifdef USE_LTTNG
+#define mdc_trace_subcall(event) \
+	tracepoint(mdcache, event, __func__, op_ctx->xid)
+#else
+#define mdc_trace_subcall(event) do { } while (0)
+#endif
+
 /* Call a sub-FSAL function using it's export */
 #define subcall_raw(myexp, call) do { \
 	op_ctx->fsal_export = (myexp)->export.sub_export; \
+	mdc_trace_subcall(fsal_start); \
 	call; \
+	mdc_trace_subcall(fsal_end); \
 	op_ctx->fsal_export = &(myexp)->export; \
 } while (0)
 
@@ -553,12 +802,28 @@ mdcache_key_dup(mdcache_key_t *tgt,
 {
 	tgt->kv.len = src->kv.len;
 	tgt->kv.addr = gsh_malloc(src->kv.len);
+	mdcache_mem_charge(src->kv.len);
 
 	memcpy(tgt->kv.addr, src->kv.addr, src->kv.len);
 	tgt->hk = src->hk;
 	tgt->fsal = src->fsal;
 }
 
+/**
+ * @brief Note that names came or went in a directory
+ *
+ * A lookup that went to the sub-FSAL meanwhile then does not cache
+ * what it found, which may already be stale.
+ *
+ * @note Caller MUST hold the content_lock for write
+ *
+ * @param[in] dir	The directory
+ */
+static inline void mdc_dir_ns_changed(mdcache_entry_t *dir)
+{
+	dir->fsobj.fsdir.ns_gen++;
+}
+
 /**
  * @brief Set the parent key of an entry
  *
@@ -591,17 +856,38 @@ mdc_dir_add_parent(mdcache_entry_t *entry, mdcache_entry_t *mdc_parent)
 static inline void
 mdcache_key_delete(mdcache_key_t *key)
 {
+	mdcache_mem_uncharge(key->kv.len);
 	key->kv.len = 0;
 	gsh_free(key->kv.addr);
 	key->kv.addr = NULL;
 }
 
+/**
+ * @brief Delete the key of a dirent
+ *
+ * Safe to call even if the key was deleted already.
+ *
+ * @param[in] dirent  The dirent
+ */
+static inline void mdcache_dirent_key_delete(mdcache_dir_entry_t *dirent)
+{
+	if (dirent->ckey.kv.addr !=
+	    dirent->name + strlen(dirent->name) + 1) {
+		/* replaced by mdcache_key_dup */
+		mdcache_key_delete(&dirent->ckey);
+		return;
+	}
+	dirent->ckey.kv.len = 0;
+	dirent->ckey.kv.addr = NULL;
+}
+
 /* Create a copy of host-handle */
 static inline void
 mdcache_copy_fh(struct gsh_buffdesc *dest, struct gsh_buffdesc *src)
 {
 	dest->len = src->len;
 	dest->addr = gsh_malloc(dest->len);
+	mdcache_mem_charge(dest->len);
 	(void)memcpy(dest->addr, src->addr, dest->len);
 }
 
@@ -609,6 +895,7 @@ mdcache_copy_fh(struct gsh_buffdesc *dest, struct gsh_buffdesc *src)
 static inline void
 mdcache_free_fh(struct gsh_buffdesc *fh_desc)
 {
+	mdcache_mem_uncharge(fh_desc->len);
 	fh_desc->len = 0;
 	gsh_free(fh_desc->addr);
 	fh_desc->addr = NULL;
@@ -733,9 +1020,45 @@ mdcache_is_attrs_valid(const mdcache_entry_t *entry, attrmask_t mask)
 	return true;
 }
 
+/**
+ * @brief Check if expired attributes may still be served
+ *
+ * Attributes that merely timed out, rather than being invalidated, may
+ * be served for Attr_Stale_Grace seconds past their expiry while they
+ * are refreshed.  ACLs are never served stale.
+ *
+ * @note the caller must hold attr_lock
+ *
+ * @param[in] entry	Entry to check
+ * @param[in] mask	Attributes the caller wants
+ *
+ * @return true if the cached attributes may be returned.
+ */
+static inline bool
+mdcache_is_attrs_in_grace(const mdcache_entry_t *entry, attrmask_t mask)
+{
+	uint32_t grace = mdcache_param.attr_stale_grace;
+
+	if (grace == 0 || (mask & ATTR_ACL) != 0 ||
+	    !(entry->mde_flags & MDCACHE_TRUST_ATTRS) ||
+	    entry->attrs.valid_mask == ATTR_RDATTR_ERR ||
+	    entry->attrs.expire_time_attr <= 0)
+		return false;
+
+	if (entry->obj_handle.type == DIRECTORY
+	    && mdcache_param.getattr_dir_invalidation)
+		return false;
+
+	return time(NULL) - entry->attr_time <=
+	       entry->attrs.expire_time_attr + grace;
+}
+
 /**
  * @brief Remove an export <-> entry mapping
  *
+ * An entry is charged to the export of its first mapping, so removing
+ * that one moves the charge to the next.
+ *
  * @param[in] expmap	Mapping to remove
  *
  * @note must be called with the mdc_exp_lock and attr_lock held
@@ -743,6 +1066,19 @@ mdcache_is_attrs_valid(const mdcache_entry_t *entry, attrmask_t mask)
 static inline void
 mdc_remove_export_map(struct entry_export_map *expmap)
 {
+	struct glist_head *export_list = &expmap->entry->export_list;
+	struct glist_head *next = expmap->export_per_entry.next;
+	struct entry_export_map *first;
+
+	if (export_list->next == &expmap->export_per_entry) {
+		(void)atomic_dec_int64_t(&expmap->export->entries_used);
+		if (next != export_list) {
+			first = glist_entry(next, struct entry_export_map,
+					    export_per_entry);
+			(void)atomic_inc_int64_t(&first->export->entries_used);
+		}
+	}
+
 	glist_del(&expmap->export_per_entry);
 	glist_del(&expmap->entry_per_export);
 	gsh_free(expmap);
@@ -919,6 +1255,32 @@ fsal_status_t mdcache_read2(struct fsal_obj_handle *obj_hdl,
 			   size_t *read_amount,
 			   bool *eof,
 			   struct io_info *info);
+fsal_status_t mdcache_readv2(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     struct iovec *iov,
+			     int iovcnt,
+			     size_t *read_amount,
+			     bool *eof);
+fsal_status_t mdcache_read_fd(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct state_t *state,
+			      uint64_t offset,
+			      size_t size,
+			      int *fd,
+			      size_t *read_amount,
+			      bool *eof);
+void mdcache_read2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct fsal_io_arg *io_arg,
+			 fsal_async_cb done_cb,
+			 void *caller_arg);
+void mdcache_write2_async(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct fsal_io_arg *io_arg,
+			  fsal_async_cb done_cb,
+			  void *caller_arg);
 fsal_status_t mdcache_write2(struct fsal_obj_handle *obj_hdl,
 			     bool bypass,
 			     struct state_t *state,
@@ -936,6 +1298,21 @@ fsal_status_t mdcache_io_advise2(struct fsal_obj_handle *obj_hdl,
 				 struct io_hints *hints);
 fsal_status_t mdcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 			      size_t len);
+fsal_status_t mdcache_copy2(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state,
+			    uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state,
+			    uint64_t dst_offset,
+			    uint64_t count,
+			    uint64_t *copied);
+fsal_status_t mdcache_clone2(struct fsal_obj_handle *src_hdl,
+			     struct state_t *src_state,
+			     uint64_t src_offset,
+			     struct fsal_obj_handle *dst_hdl,
+			     struct state_t *dst_state,
+			     uint64_t dst_offset,
+			     uint64_t count);
 fsal_status_t mdcache_lock_op2(struct fsal_obj_handle *obj_hdl,
 			      struct state_t *state,
 			      void *p_owner,
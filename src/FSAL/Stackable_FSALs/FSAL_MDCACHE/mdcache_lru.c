@@ -56,6 +56,7 @@
 #include "gsh_intrinsic.h"
 #include "sal_functions.h"
 #include "nfs_exports.h"
+#include "gsh_mem_pressure.h"
 #ifdef USE_LTTNG
 #include "gsh_lttng/mdcache.h"
 #endif
@@ -85,6 +86,20 @@
  * under the cache inode hash table latch.  Likewise, entries must first be
  * made unreachable to the cache inode hash table, then independently reach
  * a refcnt of 0, before they may be disposed or recycled.
+ *
+ * With LRU_Policy = 2Q, new entries start on a FIFO probation queue
+ * (A1in in [Johnson and Shasha 1994]) where further references do not
+ * move them.  Once the probation queues hold more than their share of
+ * the cache, reclaim takes from them first, and remembers the hash key
+ * of each entry it reclaims in a ghost table (A1out).  An entry created
+ * again while its key is remembered skips probation and goes straight
+ * to L1.  A scan thus only ever recycles its own entries.
+ *
+ * Regular files are also kept, per lane, on an fd queue ordered by
+ * their last I/O, independently of the entry queues above.  The LRU
+ * thread closes global file descriptors from the cold end of the fd
+ * queues, as many as needed to come back to the low water mark, so
+ * closing fds doesn't depend on walking millions of entries.
  */
 
 struct lru_state lru_state;
@@ -107,7 +122,9 @@ struct lru_q {
 struct lru_q_lane {
 	struct lru_q L1;
 	struct lru_q L2;
+	struct lru_q probation;	/* 2Q: referenced once, FIFO */
 	struct lru_q cleanup;	/* deferred cleanup */
+	struct lru_q fds;	/* entries that did I/O, LRU at HEAD */
 	pthread_mutex_t mtx;
 	/* LRU thread scan position */
 	struct {
@@ -148,6 +165,14 @@ struct lru_q_lane {
 
 static struct lru_q_lane LRU[LRU_N_Q_LANES];
 
+/**
+ * 2Q ghost table: hash keys of entries recently reclaimed from
+ * probation, direct mapped so a newer key simply displaces an older
+ * one.  Zero marks an empty slot.
+ */
+static uint64_t *lru_ghost;
+static uint32_t lru_ghost_size;
+
 /**
  * The refcount mechanism distinguishes 3 key object states:
  *
@@ -171,6 +196,47 @@ static struct lru_q_lane LRU[LRU_N_Q_LANES];
  * independent partition of the LRU queue.
  */
 
+/**
+ * Dirent chunks, most recently used first.  Only kept when
+ * Dir_Max_Chunks is set; the LRU thread frees the coldest chunks above
+ * it one by one, so a huge directory keeps its hot chunks cached.
+ *
+ * Lock order is a directory's content_lock, then chunk_lru_mtx; the LRU
+ * thread only tries the content_lock of a chunk's directory.
+ */
+static struct glist_head chunk_lru = GLIST_HEAD_INIT(chunk_lru);
+static pthread_mutex_t chunk_lru_mtx = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t chunk_lru_count;
+
+/** Most entries waiting for teardown, beyond that they are torn down
+    by whoever drops their last reference */
+#define LRU_TEARDOWN_MAX 65536
+
+/**
+ * Entries of one export waiting for teardown
+ */
+struct lru_teardown_batch {
+	struct glist_head list;
+	struct gsh_export *export;	/*< Export to tear down in, referenced */
+	struct glist_head entries;	/*< Entries, linked by lru.q */
+};
+
+/**
+ * With Deferred_Cleanup, entries whose last reference is dropped are
+ * queued here, and a single thread releases their sub-FSAL handles,
+ * a batch of the same export at a time.
+ */
+static struct {
+	pthread_mutex_t mtx;
+	struct glist_head batches;
+	uint32_t count;
+	bool running;		/*< A teardown pass is submitted */
+	struct fridgethr *fridge;
+} teardown = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.batches = GLIST_HEAD_INIT(teardown.batches),
+};
+
 static struct fridgethr *lru_fridge;
 
 enum lru_edge {
@@ -180,6 +246,10 @@ enum lru_edge {
 
 static const uint32_t FD_FALLBACK_LIMIT = 0x400;
 
+/* Entries looked at from the LRU end of each lane when reaping for
+ * one export */
+#define LRU_EXPORT_REAP_SCAN 16
+
 /* Some helper macros */
 #define LRU_NEXT(n) \
 	(atomic_inc_uint32_t(&(n)) % LRU_N_Q_LANES)
@@ -189,25 +259,41 @@ static const uint32_t FD_FALLBACK_LIMIT = 0x400;
  * qlane its lane. */
 #define LRU_DQ_SAFE(lru, q) \
 	do { \
-		if ((lru)->qid == LRU_ENTRY_L1) { \
+		if ((lru)->qid == LRU_ENTRY_L1 || \
+		    (lru)->qid == LRU_ENTRY_PROBATION) { \
 			struct lru_q_lane *qlane = &LRU[(lru)->lane]; \
 			if (unlikely((qlane->iter.active) && \
 				     ((&(lru)->q) == qlane->iter.glistn))) { \
 				qlane->iter.glistn = (lru)->q.next; \
 			} \
 		} \
+		if ((lru)->qid == LRU_ENTRY_PROBATION) \
+			(void) atomic_dec_uint64_t( \
+					&lru_state.probation_used); \
 		glist_del(&(lru)->q); \
 		--((q)->size); \
 	} while (0)
 
+/* Unlink lru from the fd queue of qlane, which must be locked */
+#define LRU_FDQ_DEL(lru, qlane) \
+	do { \
+		if ((lru)->flags & LRU_FDQ) { \
+			glist_del(&(lru)->fdq); \
+			--((qlane)->fds.size); \
+			atomic_clear_uint32_t_bits(&(lru)->flags, LRU_FDQ); \
+		} \
+	} while (0)
+
+/* Probation entries are as reclaimable as L1 and L2 ones */
 #define LRU_ENTRY_L1_OR_L2(e) \
 	(((e)->lru.qid == LRU_ENTRY_L2) || \
-	 ((e)->lru.qid == LRU_ENTRY_L1))
+	 ((e)->lru.qid == LRU_ENTRY_L1) || \
+	 ((e)->lru.qid == LRU_ENTRY_PROBATION))
 
 #define LRU_ENTRY_RECLAIMABLE(e, n) \
 	(LRU_ENTRY_L1_OR_L2(e) && \
 	((n) == LRU_SENTINEL_REFCOUNT+1) && \
-	 ((e)->fh_hk.inavl))
+	 ((e)->fh_hk.inhash))
 
 /**
  * @brief Initialize a single base queue.
@@ -240,7 +326,9 @@ lru_init_queues(void)
 		/* init lane queues */
 		lru_init_queue(&LRU[ix].L1, LRU_ENTRY_L1);
 		lru_init_queue(&LRU[ix].L2, LRU_ENTRY_L2);
+		lru_init_queue(&LRU[ix].probation, LRU_ENTRY_PROBATION);
 		lru_init_queue(&LRU[ix].cleanup, LRU_ENTRY_CLEANUP);
+		lru_init_queue(&LRU[ix].fds, LRU_ENTRY_NONE);
 	}
 }
 
@@ -268,6 +356,9 @@ lru_queue_of(mdcache_entry_t *entry)
 	case LRU_ENTRY_L2:
 		q = &LRU[(entry->lru.lane)].L2;
 		break;
+	case LRU_ENTRY_PROBATION:
+		q = &LRU[(entry->lru.lane)].probation;
+		break;
 	case LRU_ENTRY_CLEANUP:
 		q = &LRU[(entry->lru.lane)].cleanup;
 		break;
@@ -316,6 +407,8 @@ lru_insert(mdcache_lru_t *lru, struct lru_q *q, enum lru_edge edge)
 	lru->qid = q->id;	/* initial */
 	if (lru->qid == LRU_ENTRY_CLEANUP)
 		atomic_set_uint32_t_bits(&lru->flags, LRU_CLEANUP);
+	else if (lru->qid == LRU_ENTRY_PROBATION)
+		(void) atomic_inc_uint64_t(&lru_state.probation_used);
 
 	switch (edge) {
 	case LRU_LRU:
@@ -490,6 +583,11 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 	/* Done with the attrs */
 	fsal_release_attrs(&entry->attrs);
 
+	if (entry->obj_handle.type == SYMBOLIC_LINK) {
+		gsh_free(entry->fsobj.fssym.link.addr);
+		entry->fsobj.fssym.link.addr = NULL;
+	}
+
 	/* Clean our handle */
 	fsal_obj_handle_fini(&entry->obj_handle);
 
@@ -504,6 +602,187 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 	PTHREAD_RWLOCK_destroy(&entry->attr_lock);
 }
 
+/**
+ * @brief Tear down and free an entry with no reference left
+ *
+ * @param[in] entry  The entry
+ */
+static void lru_free_entry(mdcache_entry_t *entry)
+{
+	mdcache_lru_clean(entry);
+	pool_free(mdcache_entry_pool, entry);
+
+	(void) atomic_dec_int64_t(&lru_state.entries_used);
+	mdcache_mem_uncharge(sizeof(mdcache_entry_t));
+}
+
+/**
+ * @brief Tear down all the entries queued
+ *
+ * Each batch runs in a root context on its export.
+ */
+static void lru_teardown_drain(void)
+{
+	struct lru_teardown_batch *batch;
+	struct root_op_context ctx;
+	mdcache_entry_t *entry;
+	uint32_t n;
+
+	PTHREAD_MUTEX_lock(&teardown.mtx);
+
+	while ((batch = glist_first_entry(&teardown.batches,
+					  struct lru_teardown_batch,
+					  list)) != NULL) {
+		glist_del(&batch->list);
+		PTHREAD_MUTEX_unlock(&teardown.mtx);
+
+		init_root_op_context(&ctx, batch->export,
+				     batch->export->fsal_export,
+				     0, 0, UNKNOWN_REQUEST);
+
+		n = 0;
+		while ((entry = glist_first_entry(&batch->entries,
+						  mdcache_entry_t,
+						  lru.q)) != NULL) {
+			glist_del(&entry->lru.q);
+			lru_free_entry(entry);
+			n++;
+		}
+
+		release_root_op_context();
+
+		LogFullDebug(COMPONENT_CACHE_INODE_LRU,
+			     "Tore down %" PRIu32 " entries of export %" PRIu16,
+			     n, batch->export->export_id);
+
+		put_gsh_export(batch->export);
+		gsh_free(batch);
+
+		PTHREAD_MUTEX_lock(&teardown.mtx);
+		teardown.count -= n;
+	}
+
+	teardown.running = false;
+
+	PTHREAD_MUTEX_unlock(&teardown.mtx);
+}
+
+static void lru_teardown_run(struct fridgethr_context *ctx)
+{
+	SetNameFunction("cache_teardown");
+
+	lru_teardown_drain();
+}
+
+/**
+ * @brief Queue an entry with no reference left for teardown
+ *
+ * The entry is detached from its exports first, so an unexport can't
+ * find it while it waits.  Entries with no export left are torn down
+ * by the caller, whose op context is the one they need.
+ *
+ * @param[in] entry  The entry
+ *
+ * @return true if queued.
+ */
+static bool lru_defer_teardown(mdcache_entry_t *entry)
+{
+	struct lru_teardown_batch *batch;
+	struct gsh_export *export, *spare = NULL;
+	int32_t export_id;
+	bool submit;
+
+	if (teardown.fridge == NULL || entry->sub_handle == NULL ||
+	    atomic_fetch_uint32_t(&teardown.count) >= LRU_TEARDOWN_MAX)
+		return false;
+
+	export_id = atomic_fetch_int32_t(&entry->first_export_id);
+	if (export_id < 0)
+		return false;
+
+	if (op_ctx != NULL && op_ctx->ctx_export != NULL &&
+	    op_ctx->ctx_export->export_id == export_id) {
+		export = op_ctx->ctx_export;
+		get_gsh_export_ref(export);
+	} else {
+		export = get_gsh_export(export_id);
+		if (export == NULL)
+			return false;
+	}
+
+	mdc_unmap_entry(entry);
+
+	PTHREAD_MUTEX_lock(&teardown.mtx);
+
+	batch = glist_last_entry(&teardown.batches, struct lru_teardown_batch,
+				 list);
+	if (batch == NULL || batch->export != export) {
+		batch = gsh_malloc(sizeof(*batch));
+		batch->export = export;
+		glist_init(&batch->entries);
+		glist_add_tail(&teardown.batches, &batch->list);
+	} else {
+		/* The batch holds a reference already */
+		spare = export;
+	}
+
+	glist_add_tail(&batch->entries, &entry->lru.q);
+	teardown.count++;
+
+	submit = !teardown.running;
+	teardown.running = true;
+
+	PTHREAD_MUTEX_unlock(&teardown.mtx);
+
+	if (spare != NULL)
+		put_gsh_export(spare);
+
+	if (submit &&
+	    fridgethr_submit(teardown.fridge, lru_teardown_run, NULL) != 0)
+		lru_teardown_drain();
+
+	return true;
+}
+
+/**
+ * @brief Remember the key of an entry reclaimed from probation
+ *
+ * @param[in] hk  Hash key of the entry
+ */
+static inline void
+lru_ghost_add(uint64_t hk)
+{
+	if (lru_ghost == NULL)
+		return;
+
+	atomic_store_uint64_t(&lru_ghost[hk % lru_ghost_size],
+			      hk != 0 ? hk : 1);
+}
+
+/**
+ * @brief Check and forget whether a key was recently reclaimed
+ *
+ * @param[in] hk  Hash key of the entry
+ *
+ * @return true if the key was in the ghost table.
+ */
+static inline bool
+lru_ghost_take(uint64_t hk)
+{
+	uint64_t *slot;
+
+	if (lru_ghost == NULL)
+		return false;
+
+	slot = &lru_ghost[hk % lru_ghost_size];
+
+	if (atomic_fetch_uint64_t(slot) != (hk != 0 ? hk : 1))
+		return false;
+
+	atomic_store_uint64_t(slot, 0);
+	return true;
+}
+
 /**
  * @brief Try to pull an entry off the queue
  *
@@ -517,14 +796,48 @@ mdcache_lru_clean(mdcache_entry_t *entry)
  *
  * @note The caller @a MUST @a NOT hold the lane lock
  *
- * @param[in] qid  Queue to reap
+ * @param[in] qid        Queue to reap
+ * @param[in] export_id  Only reap entries first mapped by this export,
+ *                       or -1 for any
  * @return Available entry if found, NULL otherwise
  */
 
 static uint32_t reap_lane;
 
+/**
+ * @brief Find the oldest entry of a queue that may be reaped for an export
+ *
+ * @note The caller must hold the lane lock
+ *
+ * @param[in] lq         Queue to look at
+ * @param[in] export_id  Export, or -1 for any
+ */
+static inline mdcache_lru_t *
+lru_first_of(struct lru_q *lq, int32_t export_id)
+{
+	struct glist_head *glist;
+	mdcache_lru_t *lru;
+	mdcache_entry_t *entry;
+	int scanned = 0;
+
+	if (export_id < 0)
+		return glist_first_entry(&lq->q, mdcache_lru_t, q);
+
+	glist_for_each(glist, &lq->q) {
+		lru = glist_entry(glist, mdcache_lru_t, q);
+		entry = container_of(lru, mdcache_entry_t, lru);
+		if (atomic_fetch_int32_t(&entry->first_export_id) ==
+		    export_id)
+			return lru;
+		if (++scanned >= LRU_EXPORT_REAP_SCAN)
+			break;
+	}
+
+	return NULL;
+}
+
 static inline mdcache_lru_t *
-lru_reap_impl(enum lru_q_id qid)
+lru_reap_impl(enum lru_q_id qid, int32_t export_id)
 {
 	uint32_t lane;
 	struct lru_q_lane *qlane;
@@ -538,10 +851,15 @@ lru_reap_impl(enum lru_q_id qid)
 	lane = LRU_NEXT(reap_lane);
 	for (ix = 0; ix < LRU_N_Q_LANES; ++ix, lane = LRU_NEXT(reap_lane)) {
 		qlane = &LRU[lane];
-		lq = (qid == LRU_ENTRY_L1) ? &qlane->L1 : &qlane->L2;
+		if (qid == LRU_ENTRY_L1)
+			lq = &qlane->L1;
+		else if (qid == LRU_ENTRY_PROBATION)
+			lq = &qlane->probation;
+		else
+			lq = &qlane->L2;
 
 		QLOCK(qlane);
-		lru = glist_first_entry(&lq->q, mdcache_lru_t, q);
+		lru = lru_first_of(lq, export_id);
 		if (!lru)
 			goto next_lane;
 		refcnt = atomic_inc_int32_t(&lru->refcnt);
@@ -573,12 +891,16 @@ lru_reap_impl(enum lru_q_id qid)
 					   __LINE__, entry,
 					   entry->lru.refcnt);
 #endif
+				if (entry->lru.qid == LRU_ENTRY_PROBATION)
+					lru_ghost_add(entry->fh_hk.key.hk);
 				cih_remove_latched(entry, &latch,
 						   CIH_REMOVE_QLOCKED);
 				LRU_DQ_SAFE(lru, q);
+				LRU_FDQ_DEL(lru, qlane);
 				entry->lru.qid = LRU_ENTRY_NONE;
 				QUNLOCK(qlane);
 				cih_hash_release(&latch);
+				mdc_spill_dir(entry);
 				/* Note, we're not releasing our ref here.
 				 * cih_remove_latched() called
 				 * mdcache_lru_unref(), which released the
@@ -607,18 +929,81 @@ lru_reap_impl(enum lru_q_id qid)
 	return lru;
 }
 
+/**
+ * @brief Reap the least recently used reclaimable entry
+ *
+ * @return The entry, or NULL if none can be reaped.
+ */
+static inline mdcache_lru_t *
+lru_reap_lru(void)
+{
+	mdcache_lru_t *lru;
+
+	/* 2Q: entries seen only once go first while they are over
+	 * their share of the cache.
+	 */
+	if (mdcache_param.lru_policy == LRU_POLICY_2Q &&
+	    atomic_fetch_uint64_t(&lru_state.probation_used) >
+	    lru_state.probation_hiwat) {
+		lru = lru_reap_impl(LRU_ENTRY_PROBATION, -1);
+		if (lru)
+			return lru;
+	}
+
+	/* XXX dang why not start with the cleanup list? */
+	lru = lru_reap_impl(LRU_ENTRY_L2, -1);
+	if (!lru)
+		lru = lru_reap_impl(LRU_ENTRY_L1, -1);
+	if (!lru && mdcache_param.lru_policy == LRU_POLICY_2Q)
+		lru = lru_reap_impl(LRU_ENTRY_PROBATION, -1);
+
+	return lru;
+}
+
 static inline mdcache_lru_t *
 lru_try_reap_entry(void)
 {
+	if (mdcache_param.entries_mem_budget != 0) {
+		if (atomic_fetch_uint64_t(&cache_stp->mem_used) <
+		    mdcache_param.entries_mem_budget)
+			return NULL;
+	} else if (lru_state.entries_used < lru_state.entries_hiwat)
+		return NULL;
+
+	return lru_reap_lru();
+}
+
+/**
+ * @brief Try to recycle an entry of the current export
+ *
+ * An export with its own Cache_Entries_HWMark that is over it recycles
+ * its own entries, so it doesn't grow the cache at the expense of the
+ * other exports.  This is best effort: if none of its entries can be
+ * reaped, the caller falls back to the global budget.
+ *
+ * @return An entry of the export, or NULL.
+ */
+static inline mdcache_lru_t *
+lru_try_reap_export(void)
+{
+	struct mdcache_fsal_export *export = mdc_cur_export();
+	int32_t export_id = op_ctx->ctx_export->export_id;
+	uint32_t hwmark;
 	mdcache_lru_t *lru;
 
-	if (lru_state.entries_used < lru_state.entries_hiwat)
+	hwmark = atomic_fetch_uint32_t(
+			&op_ctx->ctx_export->cache_entries_hwmark);
+	if (hwmark == 0 ||
+	    atomic_fetch_int64_t(&export->entries_used) < (int64_t) hwmark)
 		return NULL;
 
-	/* XXX dang why not start with the cleanup list? */
-	lru = lru_reap_impl(LRU_ENTRY_L2);
+	lru = NULL;
+	if (mdcache_param.lru_policy == LRU_POLICY_2Q)
+		lru = lru_reap_impl(LRU_ENTRY_PROBATION, export_id);
+	if (!lru)
+		lru = lru_reap_impl(LRU_ENTRY_L2, export_id);
 	if (!lru)
-		lru = lru_reap_impl(LRU_ENTRY_L1);
+		lru = lru_reap_impl(LRU_ENTRY_L1, export_id);
 
 	return lru;
 }
@@ -718,17 +1103,118 @@ mdcache_lru_cleanup_try_push(mdcache_entry_t *entry)
 	}
 }
 
+/**
+ * @brief Close the global file descriptor of an entry
+ *
+ * @note The caller must hold the lane lock and a reference on the
+ *       entry.  The lock is dropped while closing and taken again
+ *       before returning.
+ *
+ * @param[in] entry  The entry
+ * @param[in] qlane  Its lane
+ *
+ * @return FSAL status of the close.
+ */
+
+static fsal_status_t lru_close_entry_fd(mdcache_entry_t *entry,
+					struct lru_q_lane *qlane)
+{
+	struct root_op_context ctx;
+	struct req_op_context *saved_ctx = op_ctx;
+	int32_t export_id;
+	struct gsh_export *export;
+	fsal_status_t status;
+	bool not_support_ex;
+
+	/* Get a reference to the first export and build an op context
+	 * with it. By holding the QLANE lock while we get the export
+	 * reference we assure that the entry doesn't get detached from
+	 * the export before we get an export reference, which
+	 * guarantees the export is good for the length of time we need
+	 * it to perform sub_fsal operations.
+	 */
+	export_id = atomic_fetch_int32_t(&entry->first_export_id);
+
+	if (export_id < 0) {
+		/* This should never happen, since any entry that only
+		 * had a sentinel reference must either have a mapped
+		 * export or be in the LRU_ENTRY_CLEANUP queue and thus
+		 * not eligible for the LRU thread.
+		 */
+		LogFatal(COMPONENT_CACHE_INODE,
+			 "No first_export for entry %p is unexpected.",
+			 entry);
+	}
+
+	export = get_gsh_export(export_id);
+
+	if (export == NULL) {
+		/* This really should not happen, if an unexport is in
+		 * progress, the export_id is now not removed until
+		 * after mdcache has detached all entries from the
+		 * export. An entry that is actually in the process of
+		 * being detached has an LRU reference which prevents it
+		 * from being processed by the LRU thread, so there is no
+		 * path to get here without the export still being
+		 * valid.
+		 */
+		LogFatal(COMPONENT_CACHE_INODE,
+			 "An entry (%p) having an unmappable export_id (%"
+			 PRIi32") is unexpected",
+			 entry, export_id);
+	}
+
+	init_root_op_context(&ctx, export, export->fsal_export, 0, 0,
+			     UNKNOWN_REQUEST);
+
+	/* Drop the lane lock while performing (slow) operations on
+	 * entry */
+	QUNLOCK(qlane);
+
+	not_support_ex = !entry->obj_handle.fsal->m_ops.support_ex(
+						&entry->obj_handle);
+
+	if (not_support_ex) {
+		/* Acquire the content lock first; we may need to look
+		 * at fds and close it.
+		 */
+		PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+	}
+
+	/* Make sure any FSAL global file descriptor is closed. */
+	status = fsal_close(&entry->obj_handle);
+
+	if (not_support_ex) {
+		/* Release the content lock. */
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	}
+
+	put_gsh_export(export);
+	op_ctx = saved_ctx;
+
+
+	QLOCK(qlane);
+
+	return status;
+}
+
 /**
  * @brief Function that executes in the lru thread to process one lane
  *
+ * Entries on L1 are demoted to L2 as their files are closed.  Entries
+ * on the 2Q probation queue stay where they are, only their files are
+ * closed.
+ *
  * @param[in]     lane          The lane to process
+ * @param[in]     qid           Queue to process, L1 or probation
  * @param[in,out] totalclosed   Track the number of file closes
  *
  * @returns the number of files worked on (workdone)
  *
  */
 
-static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
+static inline size_t lru_run_lane(size_t lane, enum lru_q_id qid,
+				  uint64_t *const totalclosed)
 {
 	struct lru_q *q;
 	/* The amount of work done on this lane on this pass. */
@@ -744,9 +1230,8 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 	struct lru_q_lane *qlane = &LRU[lane];
 	/* entry refcnt */
 	uint32_t refcnt;
-	bool not_support_ex;
 
-	q = &qlane->L1;
+	q = (qid == LRU_ENTRY_PROBATION) ? &qlane->probation : &qlane->L1;
 
 	LogDebug(COMPONENT_CACHE_INODE_LRU,
 		 "Reaping up to %d entries from lane %zd",
@@ -761,10 +1246,6 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 	 * the iteration also adjusts glist and (in particular) glistn */
 	glist_for_each_safe(qlane->iter.glist, qlane->iter.glistn, &q->q) {
 		struct lru_q *q;
-		struct root_op_context ctx;
-		struct req_op_context *saved_ctx = op_ctx;
-		int32_t export_id;
-		struct gsh_export *export;
 
 		/* check per-lane work */
 		if (workdone >= lru_state.per_lane_work)
@@ -791,75 +1272,16 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 		}
 
 		/* Move entry to MRU of L2 */
-		q = &qlane->L1;
-		LRU_DQ_SAFE(lru, q);
-		lru->qid = LRU_ENTRY_L2;
-		q = &qlane->L2;
-		lru_insert(lru, q, LRU_MRU);
-		++(q->size);
-
-		/* Get a reference to the first export and build an op context
-		 * with it. By holding the QLANE lock while we get the export
-		 * reference we assure that the entry doesn't get detached from
-		 * the export before we get an export reference, which
-		 * guarantees the export is good for the length of time we need
-		 * it to perform sub_fsal operations.
-		 */
-		export_id = atomic_fetch_int32_t(&entry->first_export_id);
-
-		if (export_id < 0) {
-			/* This should never happen, since any entry that only
-			 * had a sentinel reference must either have a mapped
-			 * export or be in the LRU_ENTRY_CLEANUP queue and thus
-			 * not eligible for lru_run_lane.
-			 */
-			LogFatal(COMPONENT_CACHE_INODE,
-				 "No first_export for entry %p is unexpected.",
-				 entry);
-		}
-
-		export = get_gsh_export(export_id);
-
-		if (export == NULL) {
-			/* This really should not happen, if an unexport is in
-			 * progress, the export_id is now not removed until
-			 * after mdcache has detached all entries from the
-			 * export. An entry that is actually in the process of
-			 * being detached has an LRU reference which prevents it
-			 * from being processed by lru_run_lane, so there is no
-			 * path to get here without the export still being
-			 * valid.
-			 */
-			LogFatal(COMPONENT_CACHE_INODE,
-				 "An entry (%p) having an unmappable export_id (%"
-				 PRIi32") is unexpected",
-				 entry, export_id);
+		if (qid == LRU_ENTRY_L1) {
+			q = &qlane->L1;
+			LRU_DQ_SAFE(lru, q);
+			lru->qid = LRU_ENTRY_L2;
+			q = &qlane->L2;
+			lru_insert(lru, q, LRU_MRU);
+			++(q->size);
 		}
 
-		init_root_op_context(&ctx, export, export->fsal_export, 0, 0,
-				     UNKNOWN_REQUEST);
-
-		/* Drop the lane lock while performing (slow) operations on
-		 * entry */
-		QUNLOCK(qlane);
-
-		not_support_ex = !entry->obj_handle.fsal->m_ops.support_ex(
-							&entry->obj_handle);
-
-		if (not_support_ex) {
-			/* Acquire the content lock first; we may need to look
-			 * at fds and close it.
-			 */
-			PTHREAD_RWLOCK_wrlock(&entry->content_lock);
-		}
-
-		/* Make sure any FSAL global file descriptor is closed. */
-		status = fsal_close(&entry->obj_handle);
-
-		if (not_support_ex) {
-			/* Release the content lock. */
-			PTHREAD_RWLOCK_unlock(&entry->content_lock);
-		}
+		status = lru_close_entry_fd(entry, qlane);
 
 		if (FSAL_IS_ERROR(status)) {
 			LogCrit(COMPONENT_CACHE_INODE_LRU,
@@ -869,10 +1291,7 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 			++closed;
 		}
 
-		put_gsh_export(export);
-		op_ctx = saved_ctx;
-
-		QLOCK(qlane); /* QLOCKED */
+		/* QLOCKED */
 		mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
 		++workdone;
 	} /* for_each_safe lru */
@@ -887,6 +1306,281 @@ next_lane:
 	return workdone;
 }
 
+/**
+ * @brief Close file descriptors from the cold end of the fd queues
+ *
+ * Lanes are taken in turn, each giving up an even share of the work
+ * per pass, until @a to_close descriptors have been closed or the fd
+ * queues are empty.  An entry leaves its fd queue when examined.  One
+ * that is in use goes back at its next I/O.
+ *
+ * @param[in] to_close  Number of descriptors to close
+ *
+ * @returns the number of descriptors closed.
+ */
+
+static size_t lru_run_fds(size_t to_close)
+{
+	size_t per_lane = to_close / LRU_N_Q_LANES + 1;
+	size_t closed = 0;
+	size_t lane, work;
+	bool progress;
+	struct lru_q_lane *qlane;
+	mdcache_lru_t *lru;
+	mdcache_entry_t *entry;
+	uint32_t refcnt;
+	fsal_status_t status;
+
+	do {
+		progress = false;
+
+		for (lane = 0; lane < LRU_N_Q_LANES && closed < to_close;
+		     ++lane) {
+			qlane = &LRU[lane];
+
+			QLOCK(qlane);
+
+			for (work = 0; work < per_lane && closed < to_close;
+			     ++work) {
+				lru = glist_first_entry(&qlane->fds.q,
+							mdcache_lru_t, fdq);
+				if (lru == NULL)
+					break;
+
+				progress = true;
+				LRU_FDQ_DEL(lru, qlane);
+				entry = container_of(lru, mdcache_entry_t, lru);
+				refcnt = atomic_inc_int32_t(&lru->refcnt);
+
+				/* Skip the busy and the dying */
+				if (refcnt > LRU_SENTINEL_REFCOUNT + 1 ||
+				    !LRU_ENTRY_L1_OR_L2(entry)) {
+					mdcache_lru_unref(entry,
+							  LRU_UNREF_QLOCKED);
+					continue;
+				}
+
+				status = lru_close_entry_fd(entry, qlane);
+
+				if (!FSAL_IS_ERROR(status))
+					++closed;
+				else if (status.major != ERR_FSAL_NOT_OPENED)
+					LogCrit(COMPONENT_CACHE_INODE_LRU,
+						"Error closing file in LRU thread.");
+
+				mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
+			}
+
+			QUNLOCK(qlane);
+		}
+	} while (progress && closed < to_close);
+
+	LogDebug(COMPONENT_CACHE_INODE_LRU,
+		 "Closed %zu of %zu descriptors from the fd queues",
+		 closed, to_close);
+
+	return closed;
+}
+
+/**
+ * @brief Reclaim entries until the cache is within its memory budget
+ *
+ * Dirents grow the cache without allocating entries, so allocation
+ * alone cannot keep it within Entries_Mem_Budget.  Work is bounded by
+ * biggest_window entries per run.
+ *
+ * @returns the number of entries freed
+ */
+
+static size_t lru_reap_to_budget(void)
+{
+	mdcache_lru_t *lru;
+	size_t freed = 0;
+
+	if (mdcache_param.entries_mem_budget == 0)
+		return 0;
+
+	while (freed < lru_state.biggest_window) {
+		lru = lru_try_reap_entry();
+		if (lru == NULL)
+			break;
+
+		/* Only the sentinel ref is left, this frees the entry */
+		mdcache_lru_unref(container_of(lru, mdcache_entry_t, lru),
+				  LRU_FLAG_NONE);
+		++freed;
+	}
+
+	if (freed > 0)
+		LogDebug(COMPONENT_CACHE_INODE_LRU,
+			 "Freed %zu entries, cache memory now %" PRIu64
+			 " bytes of %" PRIu64,
+			 freed, atomic_fetch_uint64_t(&cache_stp->mem_used),
+			 mdcache_param.entries_mem_budget);
+
+	return freed;
+}
+
+/**
+ * @brief Free the coldest dirent chunks above Dir_Max_Chunks
+ *
+ * Chunks whose directory is busy are passed over.  Freeing a chunk
+ * leaves a gap in the directory's cookies that readdir fills again
+ * from the FSAL when it gets there.  Work is bounded by biggest_window
+ * chunks looked at per run.
+ *
+ * @returns the number of chunks freed
+ */
+
+static size_t lru_reap_chunks(void)
+{
+	uint32_t max = mdcache_param.dir.max_chunks;
+	struct dir_chunk *chunk, *prev;
+	mdcache_entry_t *parent;
+	size_t freed = 0, scanned = 0;
+
+	if (max == 0)
+		return 0;
+
+	PTHREAD_MUTEX_lock(&chunk_lru_mtx);
+
+	chunk = glist_last_entry(&chunk_lru, struct dir_chunk, chunk_lru);
+
+	while (chunk != NULL && chunk_lru_count > max &&
+	       scanned++ < lru_state.biggest_window) {
+		prev = glist_prev_entry(&chunk_lru, struct dir_chunk,
+					chunk_lru, &chunk->chunk_lru);
+		parent = chunk->parent;
+
+		/* The chunk is still on its directory, which can't go
+		 * away before taking chunk_lru_mtx to remove it.
+		 */
+		if (pthread_rwlock_trywrlock(&parent->content_lock) != 0) {
+			chunk = prev;
+			continue;
+		}
+
+		glist_del(&chunk->chunk_lru);
+		chunk_lru_count--;
+
+		PTHREAD_MUTEX_unlock(&chunk_lru_mtx);
+
+		/* The directory no longer has all its dirents */
+		atomic_clear_uint32_t_bits(&parent->mde_flags,
+					   MDCACHE_DIR_POPULATED);
+		mdcache_clean_dirent_chunk(chunk);
+		freed++;
+
+		PTHREAD_RWLOCK_unlock(&parent->content_lock);
+
+		/* Start over, the list may have changed meanwhile */
+		PTHREAD_MUTEX_lock(&chunk_lru_mtx);
+		chunk = glist_last_entry(&chunk_lru, struct dir_chunk,
+					 chunk_lru);
+	}
+
+	PTHREAD_MUTEX_unlock(&chunk_lru_mtx);
+
+	if (freed > 0)
+		LogDebug(COMPONENT_CACHE_INODE_LRU,
+			 "Freed %zu dirent chunks, %" PRIu32 " of %" PRIu32
+			 " left", freed, chunk_lru_count, max);
+
+	return freed;
+}
+
+/**
+ * @brief Free the entries the memory pressure monitor asked for
+ *
+ * Unlike lru_reap_to_budget this goes below the high water mark; it
+ * stops when nothing more can be reaped.
+ *
+ * @returns the number of entries freed
+ */
+
+static size_t lru_reap_pressure(void)
+{
+	uint64_t want = atomic_fetch_uint64_t(&lru_state.pressure_reap);
+	mdcache_lru_t *lru;
+	size_t freed = 0;
+
+	while (freed < want) {
+		lru = lru_reap_lru();
+		if (lru == NULL)
+			break;
+
+		/* Only the sentinel ref is left, this frees the entry */
+		mdcache_lru_unref(container_of(lru, mdcache_entry_t, lru),
+				  LRU_FLAG_NONE);
+		++freed;
+	}
+
+	/* Whatever could not be reaped now is not owed next time */
+	if (want > 0) {
+		atomic_sub_uint64_t(&lru_state.pressure_reap, want);
+		LogDebug(COMPONENT_CACHE_INODE_LRU,
+			 "Freed %zu of %" PRIu64
+			 " entries for memory pressure, %" PRIu64 " left",
+			 freed, want, lru_state.entries_used);
+	}
+
+	return freed;
+}
+
+/**
+ * @brief Shrink the cache for the memory pressure monitor
+ *
+ * The LRU thread does the freeing.
+ *
+ * @param[in] percent Share of the entries to free
+ */
+
+static void mdcache_lru_shrink(uint32_t percent)
+{
+	(void) atomic_add_uint64_t(&lru_state.pressure_reap,
+				   lru_state.entries_used * percent / 100);
+	lru_wake_thread();
+}
+
+/**
+ * @brief Change Entries_HWMark of a running server
+ *
+ * The LRU thread is woken so it starts reaping down to a lowered mark
+ * right away.
+ *
+ * @param[in] hwmark New high water mark
+ */
+void mdcache_lru_set_hwmark(uint32_t hwmark)
+{
+	mdcache_param.entries_hwmark = hwmark;
+	atomic_store_uint64_t(&lru_state.entries_hiwat, hwmark);
+	atomic_store_uint64_t(&lru_state.probation_hiwat,
+			      ((uint64_t) hwmark *
+			       mdcache_param.lru_2q_in_percent) / 100);
+	lru_wake_thread();
+}
+
+uint32_t mdcache_lru_get_hwmark(void)
+{
+	return mdcache_param.entries_hwmark;
+}
+
+/**
+ * @brief Change LRU_Run_Interval of a running server
+ *
+ * @param[in] interval New interval, in seconds
+ */
+void mdcache_lru_set_run_interval(time_t interval)
+{
+	mdcache_param.lru_run_interval = interval;
+	lru_wake_thread();
+}
+
+time_t mdcache_lru_get_run_interval(void)
+{
+	return mdcache_param.lru_run_interval;
+}
+
 /**
  * @brief Function that executes in the lru thread
  *
@@ -903,22 +1597,19 @@ next_lane:
  *  - If the number of open FDs is below the low water mark, do
  *    nothing.
  *
- *  - If the number of open FDs is between the low and high water
- *    mark, make one pass through the queues, and exit.  Each pass
- *    consists of taking an entry from L1, examining to see if it is a
- *    regular file not bearing state with an open FD, closing the open
- *    FD if it is, and then moving it to L2.  The advantage of the two
- *    level system is twofold: First, seldom used entries congregate
- *    in L2 and the promotion behaviour provides some scan
- *    resistance.  Second, once an entry is examined, it is moved to
- *    L2, so we won't examine the same cache entry repeatedly.
- *
- *  - If the number of open FDs is greater than the high water mark,
- *    we consider ourselves to be in extremis.  In this case we make a
- *    number of passes through the queue not to exceed the number of
- *    passes that would be required to process the number of entries
- *    equal to a biggest_window percent of the system specified
- *    maximum.
+ *  - If the number of open FDs is above the low water mark, close
+ *    the FDs of the least recently used files on the fd queues, as
+ *    many as are needed to come back to the low water mark, but no
+ *    more than biggest_window per run.
+ *
+ *  - If the number of open FDs is still greater than the high water
+ *    mark, we consider ourselves to be in extremis.  FDs may have
+ *    been opened by operations that don't go through the fd queues.
+ *    In this case we also make a number of passes through the entry
+ *    queues, each consisting of taking an entry from L1, closing its
+ *    FD and moving it to L2, not to exceed the number of passes that
+ *    would be required to process the number of entries equal to a
+ *    biggest_window percent of the system specified maximum.
  *
  *  - If we are in extremis, and performing the maximum amount of work
  *    allowed has not moved the open FD count required_progress%
@@ -931,6 +1622,10 @@ next_lane:
  *  - If we fall below the low water mark and FD caching has been
  *    temporarily disabled, re-enable it.
  *
+ * With Entries_Mem_Budget set, it also frees entries until the cache
+ * is back within budget.  It frees the entries asked for by the memory
+ * pressure monitor.
+ *
  * This function uses the lock discipline for functions accessing LRU
  * entries through a queue partition.
  *
@@ -979,6 +1674,10 @@ lru_run(struct fridgethr_context *ctx)
 	LogFullDebug(COMPONENT_CACHE_INODE_LRU, "lru entries: %" PRIu64,
 		     lru_state.entries_used);
 
+	(void) lru_reap_to_budget();
+	(void) lru_reap_pressure();
+	(void) lru_reap_chunks();
+
 	/* Reap file descriptors.  This is a preliminary example of the
 	   L2 functionality rather than something we expect to be
 	   permanent.  (It will have to adapt heavily to the new FSAL
@@ -1005,6 +1704,8 @@ lru_run(struct fridgethr_context *ctx)
 		   value is less than the work to do in a single queue,
 		   don't spin through more passes. */
 		size_t workpass = 0;
+		/* Number of FDs to close from the fd queues */
+		size_t toclose;
 		time_t curr_time = time(NULL);
 
 		fdratepersec = (curr_time <= lru_state.prev_time)
@@ -1016,13 +1717,32 @@ lru_run(struct fridgethr_context *ctx)
 			     fdratepersec, formeropen,
 			     ((uint64_t) (curr_time - lru_state.prev_time)));
 
+		/* Close just enough of the least recently used to get
+		 * back to the low water mark.
+		 */
+		toclose = formeropen;
+		if (mdcache_param.use_fd_cache)
+			toclose = (formeropen > lru_state.fds_lowat)
+				? formeropen - lru_state.fds_lowat : 0;
+		if (toclose > lru_state.biggest_window)
+			toclose = lru_state.biggest_window;
+
+		totalclosed = lru_run_fds(toclose);
+
+		/* Still over the high water mark, some FDs were opened
+		 * out of the fd queues' sight.
+		 */
+		if (extremis)
+			extremis = (atomic_fetch_size_t(&open_fd_count) >
+				    lru_state.fds_hiwat);
+
 		if (extremis) {
 			LogDebug(COMPONENT_CACHE_INODE_LRU,
 				 "Open FDs over high water mark, reapring aggressively.");
 		}
 
 		/* Total fds closed between all lanes and all current runs. */
-		do {
+		while (extremis && totalwork < lru_state.biggest_window) {
 			workpass = 0;
 			for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
 				LogDebug(COMPONENT_CACHE_INODE_LRU,
@@ -1034,11 +1754,18 @@ lru_run(struct fridgethr_context *ctx)
 					     PRIu64, formeropen, totalwork,
 					     workpass, totalclosed);
 
-				workpass += lru_run_lane(lane, &totalclosed);
+				workpass += lru_run_lane(lane, LRU_ENTRY_L1,
+							 &totalclosed);
+				if (mdcache_param.lru_policy == LRU_POLICY_2Q)
+					workpass += lru_run_lane(
+							lane,
+							LRU_ENTRY_PROBATION,
+							&totalclosed);
 			}
 			totalwork += workpass;
-		} while (extremis && (workpass >= lru_state.per_lane_work)
-			 && (totalwork < lru_state.biggest_window));
+			if (workpass < lru_state.per_lane_work)
+				break;
+		}
 
 		currentopen = atomic_fetch_size_t(&open_fd_count);
 		if (extremis
@@ -1083,6 +1810,9 @@ lru_run(struct fridgethr_context *ctx)
 
 	if (new_thread_wait < mdcache_param.lru_run_interval / 10)
 		new_thread_wait = mdcache_param.lru_run_interval / 10;
+	/* LRU_Run_Interval may have been lowered at runtime */
+	if (new_thread_wait > mdcache_param.lru_run_interval)
+		new_thread_wait = mdcache_param.lru_run_interval;
 
 	fridgethr_setwait(ctx, new_thread_wait);
 
@@ -1129,6 +1859,19 @@ mdcache_lru_pkginit(void)
 	lru_state.entries_hiwat = mdcache_param.entries_hwmark;
 	lru_state.entries_used = 0;
 
+	/* 2Q probation share and ghost table */
+	lru_state.probation_used = 0;
+	lru_state.probation_hiwat = ((uint64_t) mdcache_param.entries_hwmark *
+				     mdcache_param.lru_2q_in_percent) / 100;
+	if (mdcache_param.lru_policy == LRU_POLICY_2Q &&
+	    mdcache_param.lru_2q_ghost_percent > 0) {
+		lru_ghost_size = ((uint64_t) mdcache_param.entries_hwmark *
+				  mdcache_param.lru_2q_ghost_percent) / 100;
+		if (lru_ghost_size == 0)
+			lru_ghost_size = 1;
+		lru_ghost = gsh_calloc(lru_ghost_size, sizeof(*lru_ghost));
+	}
+
 	/* Find out the system-imposed file descriptor limit */
 	if (getrlimit(RLIMIT_NOFILE, &rlim) != 0) {
 		code = errno;
@@ -1237,9 +1980,71 @@ err_open:
 		return fsalstat(posix2fsal_error(code), code);
 	}
 
+	mem_pressure_register("mdcache", mdcache_lru_shrink);
+
+	if (mdcache_param.deferred_cleanup) {
+		memset(&frp, 0, sizeof(struct fridgethr_params));
+		frp.thr_max = 1;
+		frp.thr_min = 0;
+		frp.thread_delay = 600;
+		frp.flavor = fridgethr_flavor_worker;
+		frp.deferment = fridgethr_defer_queue;
+
+		code = fridgethr_init(&teardown.fridge, "LRU_teardown", &frp);
+		if (code != 0) {
+			/* Entries are then torn down inline */
+			LogMajor(COMPONENT_CACHE_INODE_LRU,
+				 "Unable to initialize teardown fridge, error code %d.",
+				 code);
+			teardown.fridge = NULL;
+		}
+	}
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief Collect the hottest entries of the L1 queues
+ *
+ * Entries are taken MRU first, the same share from each lane, so the
+ * result is spread over the lanes.  Every entry returned carries a
+ * reference the caller must put.
+ *
+ * @param[out] entries  Array receiving the entries
+ * @param[in]  max      Size of entries
+ *
+ * @return Number of entries returned.
+ */
+uint32_t mdcache_lru_hot_entries(mdcache_entry_t **entries, uint32_t max)
+{
+	uint32_t per_lane = (max + LRU_N_Q_LANES - 1) / LRU_N_Q_LANES;
+	uint32_t count = 0, taken, lane;
+	struct lru_q_lane *qlane;
+	struct glist_head *node;
+	mdcache_lru_t *lru;
+
+	for (lane = 0; lane < LRU_N_Q_LANES && count < max; lane++) {
+		qlane = &LRU[lane];
+		taken = 0;
+
+		QLOCK(qlane);
+		for (node = qlane->L1.q.prev;
+		     node != &qlane->L1.q && taken < per_lane && count < max;
+		     node = node->prev) {
+			lru = glist_entry(node, mdcache_lru_t, q);
+			if (lru->flags & (LRU_CLEANUP | LRU_CLEANED))
+				continue;
+			atomic_inc_int32_t(&lru->refcnt);
+			entries[count++] = container_of(lru, mdcache_entry_t,
+							lru);
+			taken++;
+		}
+		QUNLOCK(qlane);
+	}
+
+	return count;
+}
+
 /**
  * Shutdown subsystem
  *
@@ -1260,9 +2065,90 @@ mdcache_lru_pkgshutdown(void)
 		LogMajor(COMPONENT_CACHE_INODE_LRU,
 			 "Failed shutting down LRU thread: %d", rc);
 	}
+
+	if (teardown.fridge != NULL) {
+		struct fridgethr *fr = teardown.fridge;
+
+		/* From now on entries are torn down inline */
+		teardown.fridge = NULL;
+
+		if (fridgethr_sync_command(fr, fridgethr_comm_stop,
+					   120) == ETIMEDOUT)
+			fridgethr_cancel(fr);
+		fridgethr_destroy(fr);
+
+		lru_teardown_drain();
+	}
+
+	gsh_free(lru_ghost);
+	lru_ghost = NULL;
+	lru_ghost_size = 0;
+
 	return fsalstat(posix2fsal_error(rc), rc);
 }
 
+/**
+ * @brief Put a chunk just added to its directory on the chunk LRU
+ *
+ * @note The directory's content_lock MUST be held for write
+ *
+ * @param[in] chunk  The chunk
+ */
+void mdcache_lru_chunk_insert(struct dir_chunk *chunk)
+{
+	bool over;
+
+	if (mdcache_param.dir.max_chunks == 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&chunk_lru_mtx);
+	glist_add(&chunk_lru, &chunk->chunk_lru);
+	over = ++chunk_lru_count > mdcache_param.dir.max_chunks;
+	PTHREAD_MUTEX_unlock(&chunk_lru_mtx);
+
+	if (over)
+		lru_wake_thread();
+}
+
+/**
+ * @brief Mark a chunk as just used by readdir
+ *
+ * @note The directory's content_lock MUST be held
+ *
+ * @param[in] chunk  The chunk
+ */
+void mdcache_lru_chunk_touch(struct dir_chunk *chunk)
+{
+	if (mdcache_param.dir.max_chunks == 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&chunk_lru_mtx);
+	if (chunk->chunk_lru.next != NULL &&
+	    chunk_lru.next != &chunk->chunk_lru) {
+		glist_del(&chunk->chunk_lru);
+		glist_add(&chunk_lru, &chunk->chunk_lru);
+	}
+	PTHREAD_MUTEX_unlock(&chunk_lru_mtx);
+}
+
+/**
+ * @brief Take a chunk about to be freed off the chunk LRU
+ *
+ * @note The directory's content_lock MUST be held for write
+ *
+ * @param[in] chunk  The chunk
+ */
+void mdcache_lru_chunk_remove(struct dir_chunk *chunk)
+{
+	if (chunk->chunk_lru.next == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&chunk_lru_mtx);
+	glist_del(&chunk->chunk_lru);
+	chunk_lru_count--;
+	PTHREAD_MUTEX_unlock(&chunk_lru_mtx);
+}
+
 static inline void init_rw_locks(mdcache_entry_t *entry)
 {
 	/* Initialize the entry locks */
@@ -1280,6 +2166,7 @@ mdcache_entry_t *alloc_cache_entry(void)
 	init_rw_locks(nentry);
 
 	(void) atomic_inc_int64_t(&lru_state.entries_used);
+	mdcache_mem_charge(sizeof(mdcache_entry_t));
 
 	return nentry;
 }
@@ -1287,8 +2174,9 @@ mdcache_entry_t *alloc_cache_entry(void)
 /**
  * @brief Re-use or allocate an entry
  *
- * This function repurposes a resident entry in the LRU system if the system is
- * above the high-water mark, and allocates a new one otherwise.  On success,
+ * This function repurposes a resident entry in the LRU system if the system,
+ * or the current export, is above its high-water mark, and allocates a new one
+ * otherwise.  On success,
  * this function always returns an entry with two references (one for the
  * sentinel, one to allow the caller's use.)
  *
@@ -1302,7 +2190,9 @@ mdcache_entry_t *mdcache_lru_get(void)
 	mdcache_lru_t *lru;
 	mdcache_entry_t *nentry = NULL;
 
-	lru = lru_try_reap_entry();
+	lru = lru_try_reap_export();
+	if (!lru)
+		lru = lru_try_reap_entry();
 	if (lru) {
 		/* we uniquely hold entry */
 		nentry = container_of(lru, mdcache_entry_t, lru);
@@ -1319,6 +2209,7 @@ mdcache_entry_t *mdcache_lru_get(void)
 	/* Since the entry isn't in a queue, nobody can bump refcnt. */
 	nentry->lru.refcnt = 2;
 	nentry->lru.cf = 0;
+	nentry->lru.fd_time = 0;
 	nentry->lru.lane = lru_lane_of_entry(nentry);
 
 #ifdef USE_LTTNG
@@ -1339,7 +2230,77 @@ mdcache_entry_t *mdcache_lru_get(void)
 void mdcache_lru_insert(mdcache_entry_t *entry)
 {
 	/* Enqueue. */
-	lru_insert_entry(entry, &LRU[entry->lru.lane].L1, LRU_LRU);
+	if (mdcache_param.lru_policy == LRU_POLICY_2Q)
+		lru_insert_entry(entry, &LRU[entry->lru.lane].probation,
+				 LRU_MRU);
+	else
+		lru_insert_entry(entry, &LRU[entry->lru.lane].L1, LRU_LRU);
+}
+
+/**
+ * @brief Admit a newly keyed entry under the 2Q policy
+ *
+ * If the entry's key was reclaimed from probation recently, it has
+ * been referenced more than once and goes straight to L1.
+ *
+ * @param[in] entry  The entry, with its hash key set
+ */
+void mdcache_lru_admit(mdcache_entry_t *entry)
+{
+	mdcache_lru_t *lru = &entry->lru;
+	struct lru_q_lane *qlane = &LRU[lru->lane];
+	struct lru_q *q;
+
+	if (mdcache_param.lru_policy != LRU_POLICY_2Q ||
+	    !lru_ghost_take(entry->fh_hk.key.hk))
+		return;
+
+	QLOCK(qlane);
+
+	if (lru->qid == LRU_ENTRY_PROBATION) {
+		q = &qlane->probation;
+		LRU_DQ_SAFE(lru, q);
+		q = &qlane->L1;
+		lru_insert(lru, q, LRU_MRU);
+		++(q->size);
+	}
+
+	QUNLOCK(qlane);
+}
+
+/**
+ * @brief Note I/O on an entry for the fd queue
+ *
+ * The entry is moved to the MRU of its lane's fd queue, at most once a
+ * second so that the lane lock isn't taken on every I/O.
+ *
+ * @param[in] entry  The entry, on which the caller holds a reference
+ */
+void mdcache_lru_fd_touch(mdcache_entry_t *entry)
+{
+	mdcache_lru_t *lru = &entry->lru;
+	struct lru_q_lane *qlane = &LRU[lru->lane];
+	time_t now = time(NULL);
+
+	if (entry->obj_handle.type != REGULAR_FILE ||
+	    atomic_fetch_time_t(&lru->fd_time) == now)
+		return;
+
+	QLOCK(qlane);
+
+	atomic_store_time_t(&lru->fd_time, now);
+
+	if (LRU_ENTRY_L1_OR_L2(entry)) {
+		if (lru->flags & LRU_FDQ) {
+			glist_del(&lru->fdq);
+		} else {
+			++(qlane->fds.size);
+			atomic_set_uint32_t_bits(&lru->flags, LRU_FDQ);
+		}
+		glist_add_tail(&qlane->fds.q, &lru->fdq);
+	}
+
+	QUNLOCK(qlane);
 }
 
 /**
@@ -1404,6 +2365,11 @@ _mdcache_lru_ref(mdcache_entry_t *entry, uint32_t flags, const char *func,
 			lru_insert(lru, q, LRU_LRU);
 			++(q->size);
 			break;
+		case LRU_ENTRY_PROBATION:
+			/* 2Q: references while on probation are taken as
+			 * correlated, the entry stays in FIFO order.
+			 */
+			break;
 		default:
 			/* do nothing */
 			break;
@@ -1490,15 +2456,14 @@ _mdcache_lru_unref(mdcache_entry_t *entry, uint32_t flags, const char *func,
 			 * are LRU_ENTRY_NONE */
 			LRU_DQ_SAFE(&entry->lru, q);
 		}
+		LRU_FDQ_DEL(&entry->lru, qlane);
 
 		if (!qlocked)
 			QUNLOCK(qlane);
 
-		mdcache_lru_clean(entry);
-		pool_free(mdcache_entry_pool, entry);
+		if (qlocked || !lru_defer_teardown(entry))
+			lru_free_entry(entry);
 		freed = true;
-
-		(void) atomic_dec_int64_t(&lru_state.entries_used);
 	}			/* refcnt == 0 */
  out:
 	return freed;
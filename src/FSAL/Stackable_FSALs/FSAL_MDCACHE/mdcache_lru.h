@@ -80,6 +80,12 @@ struct lru_state {
 	uint64_t prev_fd_count;	/* previous # of open fds */
 	time_t prev_time;	/* previous time the gc thread was run. */
 	bool caching_fds;
+	/** 2Q: entries on the probation queues, and how many may be
+	    there before they are reclaimed ahead of the others */
+	uint64_t probation_used;
+	uint64_t probation_hiwat;
+	/** Entries the memory pressure monitor asked us to free */
+	uint64_t pressure_reap;
 };
 
 extern struct lru_state lru_state;
@@ -140,6 +146,15 @@ extern size_t open_fd_count;
 
 mdcache_entry_t *mdcache_lru_get(void);
 void mdcache_lru_insert(mdcache_entry_t *entry);
+void mdcache_lru_admit(mdcache_entry_t *entry);
+void mdcache_lru_fd_touch(mdcache_entry_t *entry);
+uint32_t mdcache_lru_hot_entries(mdcache_entry_t **entries, uint32_t max);
+
+struct dir_chunk;
+
+void mdcache_lru_chunk_insert(struct dir_chunk *chunk);
+void mdcache_lru_chunk_touch(struct dir_chunk *chunk);
+void mdcache_lru_chunk_remove(struct dir_chunk *chunk);
 #define mdcache_lru_ref(e, f) _mdcache_lru_ref(e, f, __func__, __LINE__)
 fsal_status_t _mdcache_lru_ref(mdcache_entry_t *entry, uint32_t flags,
 			       const char *func, int line);
@@ -47,6 +47,7 @@
 #include "FSAL/fsal_commonlib.h"
 #include "mdcache_hash.h"
 #include "mdcache_lru.h"
+#include "nfs_metrics.h"
 
 pool_t *mdcache_entry_pool;
 
@@ -284,6 +285,24 @@ mdcache_fsal_create_export(struct fsal_module *sub_fsal, void *parse_node,
 	fsal_get(myself->export.fsal);
 	fsal_export_stack(op_ctx->fsal_export, &myself->export);
 
+	/* Only an FSAL that reports every change can be trusted to
+	 * invalidate what we cache.
+	 */
+	if (mdcache_param.trust_upcalls &&
+	    op_ctx->fsal_export->exp_ops.fs_supports(op_ctx->fsal_export,
+						     fso_up_invalidate)) {
+		myself->flags |= MDC_TRUST_UPCALLS;
+		LogInfo(COMPONENT_FSAL,
+			"%s attributes are kept until invalidated by upcall",
+			myself->name);
+	}
+
+	if (op_ctx->ctx_export->immutable) {
+		myself->flags |= MDC_IMMUTABLE;
+		LogInfo(COMPONENT_FSAL,
+			"%s is immutable, attributes and dirents are kept until invalidated",
+			myself->name);
+	}
 
 	/* Set up op_ctx */
 	op_ctx->fsal_export = &myself->export;
@@ -310,6 +329,12 @@ mdcache_fsal_unload(struct fsal_module *fsal_hdl)
 	fsal_status_t status;
 	int retval;
 
+	/* No more background readdir or readahead once the cache goes */
+	mdcache_dir_prefetch_pkgshutdown();
+	mdcache_readahead_pkgshutdown();
+	mdcache_attr_refresh_pkgshutdown();
+	mdcache_snapshot_pkgshutdown();
+
 	/* Destroy the cache inode AVL tree */
 	cih_pkgdestroy();
 
@@ -317,6 +342,8 @@ mdcache_fsal_unload(struct fsal_module *fsal_hdl)
 	if (FSAL_IS_ERROR(status))
 		fprintf(stderr, "MDCACHE LRU failed to shut down");
 
+	mdcache_spill_pkgshutdown();
+
 	/* Destroy the cache inode entry pool */
 	pool_destroy(mdcache_entry_pool);
 	mdcache_entry_pool = NULL;
@@ -379,8 +406,9 @@ fsal_status_t mdcache_pkginit(void)
 	if (mdcache_entry_pool)
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 
-	mdcache_entry_pool = pool_basic_init("MDCACHE Entry Pool",
-					     sizeof(mdcache_entry_t));
+	mdcache_entry_pool = pool_magazine_init_aligned("MDCACHE Entry Pool",
+						     sizeof(mdcache_entry_t),
+						     GSH_CACHE_LINE_SIZE);
 
 	status = mdcache_lru_pkginit();
 	if (FSAL_IS_ERROR(status)) {
@@ -390,6 +418,29 @@ fsal_status_t mdcache_pkginit(void)
 	}
 
 	cih_pkginit();
+	mdc_name_locks_init();
+	mdcache_spill_pkginit();
+
+	status = mdcache_dir_prefetch_pkginit();
+	if (!FSAL_IS_ERROR(status)) {
+		status = mdcache_readahead_pkginit();
+		if (FSAL_IS_ERROR(status))
+			mdcache_dir_prefetch_pkgshutdown();
+	}
+	if (!FSAL_IS_ERROR(status)) {
+		status = mdcache_attr_refresh_pkginit();
+		if (FSAL_IS_ERROR(status)) {
+			mdcache_readahead_pkgshutdown();
+			mdcache_dir_prefetch_pkgshutdown();
+		}
+	}
+	if (FSAL_IS_ERROR(status)) {
+		mdcache_spill_pkgshutdown();
+		cih_pkgdestroy();
+		(void)mdcache_lru_pkgshutdown();
+		pool_destroy(mdcache_entry_pool);
+		mdcache_entry_pool = NULL;
+	}
 
 	return status;
 }
@@ -430,9 +481,56 @@ void mdcache_dbus_show(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 					&cache_st.inode_mapping);
+	type = "cache_mem_used";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.mem_used);
+	type = "cache_mem_budget";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&mdcache_param.entries_mem_budget);
 
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 #endif /* USE_DBUS */
 
+/**
+ * @brief Write the cache statistics in OpenMetrics text format
+ *
+ * @param[in] out  Reply stream
+ */
+void mdcache_metrics(FILE *out)
+{
+	metrics_counter(out, "ganesha_mdcache_requests",
+			"Lookups of cache entries",
+			atomic_fetch_uint64_t(&cache_st.inode_req));
+	metrics_counter(out, "ganesha_mdcache_hits",
+			"Lookups that found the entry cached",
+			atomic_fetch_uint64_t(&cache_st.inode_hit));
+	metrics_counter(out, "ganesha_mdcache_misses",
+			"Lookups that did not find the entry cached",
+			atomic_fetch_uint64_t(&cache_st.inode_miss));
+	metrics_counter(out, "ganesha_mdcache_conflicts",
+			"Entries found cached while being added",
+			atomic_fetch_uint64_t(&cache_st.inode_conf));
+	metrics_counter(out, "ganesha_mdcache_added",
+			"Entries added to the cache",
+			atomic_fetch_uint64_t(&cache_st.inode_added));
+	metrics_counter(out, "ganesha_mdcache_mappings",
+			"Entries mapped into an export",
+			atomic_fetch_uint64_t(&cache_st.inode_mapping));
+	metrics_gauge(out, "ganesha_mdcache_memory_bytes",
+		      "Memory held by cache entries, keys and dirents",
+		      atomic_fetch_uint64_t(&cache_st.mem_used));
+	metrics_gauge(out, "ganesha_mdcache_memory_budget_bytes",
+		      "Memory budget of the cache entries",
+		      mdcache_param.entries_mem_budget);
+	metrics_counter(out, "ganesha_mdcache_spilled_dirs",
+			"Reaped directories whose dirents were spilled",
+			atomic_fetch_uint64_t(&cache_st.spill_out));
+	metrics_counter(out, "ganesha_mdcache_restored_dirs",
+			"Directories whose spilled dirents were restored",
+			atomic_fetch_uint64_t(&cache_st.spill_in));
+}
+
 /** @} */
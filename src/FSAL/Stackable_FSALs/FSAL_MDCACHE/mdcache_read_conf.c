@@ -52,6 +52,12 @@
 
 struct mdcache_parameter mdcache_param;
 
+static struct config_item_list lru_policies[] = {
+	CONFIG_LIST_TOK("LRU", LRU_POLICY_LRU),
+	CONFIG_LIST_TOK("2Q", LRU_POLICY_2Q),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item mdcache_params[] = {
 	CONF_ITEM_UI32("NParts", 1, 32633, 7,
 		       mdcache_parameter, nparts),
@@ -59,16 +65,34 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, cache_size),
 	CONF_ITEM_BOOL("Use_Getattr_Directory_Invalidation", false,
 		       mdcache_parameter, getattr_dir_invalidation),
+	CONF_ITEM_BOOL("Trust_Upcalls", false,
+		       mdcache_parameter, trust_upcalls),
 	CONF_ITEM_UI32("Dir_Max_Deleted", 1, UINT32_MAX, 65536,
 		       mdcache_parameter, dir.avl_max_deleted),
 	CONF_ITEM_UI32("Dir_Max", 1, UINT32_MAX, 65536,
 		       mdcache_parameter, dir.avl_max),
 	CONF_ITEM_UI32("Dir_Chunk", 0, UINT32_MAX, 128,
 		       mdcache_parameter, dir.avl_chunk),
+	CONF_ITEM_UI32("Dir_Max_Negative", 0, UINT32_MAX, 0,
+		       mdcache_parameter, dir.avl_max_negative),
+	CONF_ITEM_UI32("Dir_Max_Chunks", 0, UINT32_MAX, 0,
+		       mdcache_parameter, dir.max_chunks),
+	CONF_ITEM_UI32("Dir_Chunk_Prefetch", 0, 64, 0,
+		       mdcache_parameter, dir.chunk_prefetch),
+	CONF_ITEM_UI32("Dir_Attr_Prefetch_Threads", 0, 256, 0,
+		       mdcache_parameter, dir.attr_prefetch_threads),
 	CONF_ITEM_UI32("Entries_HWMark", 1, UINT32_MAX, 100000,
 		       mdcache_parameter, entries_hwmark),
+	CONF_ITEM_UI64("Entries_Mem_Budget", 0, UINT64_MAX, 0,
+		       mdcache_parameter, entries_mem_budget),
 	CONF_ITEM_UI32("LRU_Run_Interval", 1, 24 * 3600, 90,
 		       mdcache_parameter, lru_run_interval),
+	CONF_ITEM_UI32("Readahead_Size", 0, FSAL_MAXIOSIZE, 0,
+		       mdcache_parameter, readahead_size),
+	CONF_ITEM_UI64("Readahead_Max_Memory", 0, UINT64_MAX, 64 * 1024 * 1024,
+		       mdcache_parameter, readahead_max_memory),
+	CONF_ITEM_UI32("Write_Gather_Size", 0, FSAL_MAXIOSIZE, 0,
+		       mdcache_parameter, write_gather_size),
 	CONF_ITEM_BOOL("Cache_FDs", true,
 		       mdcache_parameter, use_fd_cache),
 	CONF_ITEM_UI32("FD_Limit_Percent", 0, 100, 99,
@@ -85,8 +109,31 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, required_progress),
 	CONF_ITEM_UI32("Futility_Count", 1, 50, 8,
 		       mdcache_parameter, futility_count),
+	CONF_ITEM_TOKEN("LRU_Policy", LRU_POLICY_LRU, lru_policies,
+			mdcache_parameter, lru_policy),
+	CONF_ITEM_UI32("LRU_2Q_In_Percent", 1, 90, 25,
+		       mdcache_parameter, lru_2q_in_percent),
+	CONF_ITEM_UI32("LRU_2Q_Ghost_Percent", 0, 200, 50,
+		       mdcache_parameter, lru_2q_ghost_percent),
 	CONF_ITEM_BOOL("Retry_Readdir", false,
 		       mdcache_parameter, retry_readdir),
+	CONF_ITEM_PATH("Snapshot_File", 1, MAXPATHLEN, NULL,
+		       mdcache_parameter, snapshot_file),
+	CONF_ITEM_UI32("Snapshot_Entries", 1, 10000000, 65536,
+		       mdcache_parameter, snapshot_entries),
+	CONF_ITEM_PATH("Spill_File", 1, MAXPATHLEN, NULL,
+		       mdcache_parameter, spill_file),
+	CONF_ITEM_UI64("Spill_Size", 1024 * 1024, UINT64_MAX,
+		       1024 * 1024 * 1024,
+		       mdcache_parameter, spill_size),
+	CONF_ITEM_UI32("Attr_Stale_Grace", 0, 3600, 0,
+		       mdcache_parameter, attr_stale_grace),
+	CONF_ITEM_UI32("Attr_Expiration_Min", 1, INT32_MAX, 1,
+		       mdcache_parameter, attr_expiration_min),
+	CONF_ITEM_UI32("Attr_Expiration_Max", 0, INT32_MAX, 0,
+		       mdcache_parameter, attr_expiration_max),
+	CONF_ITEM_BOOL("Deferred_Cleanup", false,
+		       mdcache_parameter, deferred_cleanup),
 	CONFIG_EOL
 };
 
@@ -0,0 +1,422 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_readahead.c
+ * @brief Readahead for sequential readers
+ *
+ * Each regular file tracks one read stream.  Once a few reads in a row
+ * start where the previous one ended, the next Readahead_Size bytes
+ * are read in the background into a window the following reads are
+ * served from.  A window is only used while the entry's attributes are
+ * valid and carry the change attribute seen when its fill was
+ * issued, and any write through this server discards it.
+ */
+
+#include "config.h"
+#include <string.h>
+#include "fsal.h"
+#include "fridgethr.h"
+#include "export_mgr.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+
+/** Sequential reads in a row before reading ahead */
+#define MDC_RA_MIN_SEQ 2
+
+/** Workers doing readahead fills */
+#define MDC_RA_THREADS 8
+
+/**
+ * @brief A window being filled
+ */
+struct mdc_ra_fill {
+	mdcache_entry_t *entry;		/*< File, referenced */
+	struct gsh_export *export;	/*< Export, referenced */
+	struct fsal_export *fsal_export;
+	struct user_cred creds;		/*< Credentials of the reader */
+	uint32_t gen;			/*< Window generation at submission */
+	uint64_t change;		/*< Change attribute at submission */
+	uint64_t offset;		/*< Start of the window */
+	size_t size;			/*< Size of buf */
+	char *buf;			/*< Data being read */
+};
+
+static struct fridgethr *ra_fridge;
+
+/** Bytes held by all windows and fills in flight */
+static uint64_t mdc_ra_bytes;
+
+static size_t mdc_ra_iov_len(const struct iovec *iov, int iovcnt)
+{
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	return len;
+}
+
+/**
+ * @brief Free the window of a stream
+ *
+ * @note The stream's mtx MUST be held
+ */
+static void mdc_ra_drop(struct mdc_readahead *ra)
+{
+	if (ra->buf != NULL) {
+		gsh_free(ra->buf);
+		(void)atomic_sub_uint64_t(&mdc_ra_bytes, ra->size);
+		ra->buf = NULL;
+	}
+
+	ra->size = 0;
+	ra->len = 0;
+	ra->eof = false;
+}
+
+/**
+ * @brief Set up the read stream of a new file entry
+ *
+ * @param[in] entry	Regular file entry
+ */
+void mdc_ra_init(mdcache_entry_t *entry)
+{
+	struct mdc_readahead *ra = &entry->fsobj.fsfile.ra;
+
+	memset(ra, 0, sizeof(*ra));
+	PTHREAD_MUTEX_init(&ra->mtx, NULL);
+}
+
+/**
+ * @brief Release the read stream of a file entry
+ *
+ * No fill can be in flight, fills hold a reference on the entry.
+ *
+ * @param[in] entry	Regular file entry
+ */
+void mdc_ra_destroy(mdcache_entry_t *entry)
+{
+	struct mdc_readahead *ra = &entry->fsobj.fsfile.ra;
+
+	PTHREAD_MUTEX_lock(&ra->mtx);
+	mdc_ra_drop(ra);
+	PTHREAD_MUTEX_unlock(&ra->mtx);
+	PTHREAD_MUTEX_destroy(&ra->mtx);
+}
+
+/**
+ * @brief Discard the readahead window of a file
+ *
+ * A fill in flight is discarded when it completes.
+ *
+ * @param[in] entry	Entry whose data changed
+ */
+void mdc_ra_invalidate(mdcache_entry_t *entry)
+{
+	struct mdc_readahead *ra = &entry->fsobj.fsfile.ra;
+
+	if (entry->obj_handle.type != REGULAR_FILE)
+		return;
+
+	PTHREAD_MUTEX_lock(&ra->mtx);
+	ra->gen++;
+	ra->seq = 0;
+	mdc_ra_drop(ra);
+	PTHREAD_MUTEX_unlock(&ra->mtx);
+}
+
+/**
+ * @brief Serve a read from the readahead window
+ *
+ * @param[in]  entry	File being read
+ * @param[in]  offset	Offset of the read
+ * @param[in]  iov	Buffers to read into
+ * @param[in]  iovcnt	Number of buffers in iov
+ * @param[out] amount	Bytes read
+ * @param[out] eof	true if the read ended at end of file
+ *
+ * @return true if the read was served, false if it must go to the FSAL.
+ */
+bool mdc_ra_read(mdcache_entry_t *entry, uint64_t offset,
+		 struct iovec *iov, int iovcnt, size_t *amount, bool *eof)
+{
+	struct mdc_readahead *ra = &entry->fsobj.fsfile.ra;
+	size_t want, got, n;
+	uint64_t change, end;
+	char *src;
+	bool valid;
+	int i;
+
+	if (mdcache_param.readahead_size == 0 ||
+	    entry->obj_handle.type != REGULAR_FILE)
+		return false;
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+	valid = mdcache_is_attrs_valid(entry, ATTR_CHANGE);
+	change = entry->attrs.change;
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	want = mdc_ra_iov_len(iov, iovcnt);
+
+	PTHREAD_MUTEX_lock(&ra->mtx);
+
+	if (ra->buf == NULL) {
+		PTHREAD_MUTEX_unlock(&ra->mtx);
+		return false;
+	}
+
+	if (!valid || change != ra->change) {
+		mdc_ra_drop(ra);
+		PTHREAD_MUTEX_unlock(&ra->mtx);
+		return false;
+	}
+
+	end = ra->offset + ra->len;
+	if (offset < ra->offset || offset > end ||
+	    (offset + want > end && !ra->eof)) {
+		PTHREAD_MUTEX_unlock(&ra->mtx);
+		return false;
+	}
+
+	got = want < end - offset ? want : end - offset;
+	src = ra->buf + (offset - ra->offset);
+	for (i = 0, n = got; i < iovcnt && n > 0; i++) {
+		size_t len = iov[i].iov_len < n ? iov[i].iov_len : n;
+
+		memcpy(iov[i].iov_base, src, len);
+		src += len;
+		n -= len;
+	}
+
+	*amount = got;
+	*eof = ra->eof && offset + got == end;
+
+	PTHREAD_MUTEX_unlock(&ra->mtx);
+
+	return true;
+}
+
+/**
+ * @brief Fill a readahead window
+ *
+ * @param[in] ctx	Thread context, the fill is the argument
+ */
+static void mdc_ra_fill_run(struct fridgethr_context *ctx)
+{
+	struct mdc_ra_fill *fill = ctx->arg;
+	mdcache_entry_t *entry = fill->entry;
+	struct mdc_readahead *ra = &entry->fsobj.fsfile.ra;
+	struct req_op_context *save_ctx = op_ctx, req_ctx = {0};
+	struct iovec iov = {fill->buf, fill->size};
+	size_t amount = 0;
+	bool eof = false;
+	fsal_status_t status;
+
+	req_ctx.ctx_export = fill->export;
+	req_ctx.fsal_export = fill->fsal_export;
+	req_ctx.creds = &fill->creds;
+	op_ctx = &req_ctx;
+
+	subcall(
+		status = entry->sub_handle->obj_ops.readv2(
+			entry->sub_handle, true, NULL, fill->offset, &iov, 1,
+			&amount, &eof)
+	       );
+
+	PTHREAD_MUTEX_lock(&ra->mtx);
+
+	ra->filling = false;
+	if (!FSAL_IS_ERROR(status) && fill->gen == ra->gen) {
+		mdc_ra_drop(ra);
+		ra->buf = fill->buf;
+		ra->size = fill->size;
+		ra->offset = fill->offset;
+		ra->len = amount;
+		ra->eof = eof;
+		ra->change = fill->change;
+		fill->buf = NULL;
+	}
+
+	PTHREAD_MUTEX_unlock(&ra->mtx);
+
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Readahead of %zu bytes at %" PRIu64 " for %p: %s",
+		     amount, fill->offset, entry, fsal_err_txt(status));
+
+	if (fill->buf != NULL) {
+		gsh_free(fill->buf);
+		(void)atomic_sub_uint64_t(&mdc_ra_bytes, fill->size);
+	}
+
+	mdcache_put(entry);
+	put_gsh_export(fill->export);
+	op_ctx = save_ctx;
+	gsh_free(fill->creds.caller_garray);
+	gsh_free(fill);
+}
+
+/**
+ * @brief Track the read stream of a file and read ahead when sequential
+ *
+ * Called for every read, before it is passed to the FSAL.  The next
+ * window is filled once the current one has less than a read left.
+ *
+ * @param[in] entry	File being read
+ * @param[in] offset	Offset of the read
+ * @param[in] iov	Buffers of the read
+ * @param[in] iovcnt	Number of buffers in iov
+ */
+void mdc_ra_advance(mdcache_entry_t *entry, uint64_t offset,
+		    const struct iovec *iov, int iovcnt)
+{
+	struct mdc_readahead *ra = &entry->fsobj.fsfile.ra;
+	size_t size = mdc_ra_iov_len(iov, iovcnt);
+	uint32_t wsize = mdcache_param.readahead_size;
+	struct mdc_ra_fill *fill;
+	fsal_status_t status;
+	uint64_t start;
+	uint32_t gen;
+	int rc;
+
+	if (wsize == 0 || ra_fridge == NULL ||
+	    entry->obj_handle.type != REGULAR_FILE)
+		return;
+
+	PTHREAD_MUTEX_lock(&ra->mtx);
+
+	if (offset == ra->next)
+		ra->seq++;
+	else
+		ra->seq = 0;
+	ra->next = offset + size;
+
+	if (ra->seq < MDC_RA_MIN_SEQ || ra->filling) {
+		PTHREAD_MUTEX_unlock(&ra->mtx);
+		return;
+	}
+
+	if (ra->buf != NULL && offset >= ra->offset &&
+	    offset <= ra->offset + ra->len) {
+		/* Reading through the window, fill the next one once
+		 * less than a read is left.
+		 */
+		if (ra->eof || ra->offset + ra->len >= ra->next + size) {
+			PTHREAD_MUTEX_unlock(&ra->mtx);
+			return;
+		}
+		start = ra->offset + ra->len;
+	} else {
+		start = ra->next;
+	}
+
+	if (atomic_add_uint64_t(&mdc_ra_bytes, wsize) >
+	    mdcache_param.readahead_max_memory) {
+		(void)atomic_sub_uint64_t(&mdc_ra_bytes, wsize);
+		PTHREAD_MUTEX_unlock(&ra->mtx);
+		return;
+	}
+
+	ra->filling = true;
+	gen = ra->gen;
+
+	PTHREAD_MUTEX_unlock(&ra->mtx);
+
+	status = mdcache_get(entry);
+	if (FSAL_IS_ERROR(status))
+		goto out_unfill;
+
+	fill = gsh_calloc(1, sizeof(*fill));
+	fill->entry = entry;
+	fill->export = op_ctx->ctx_export;
+	get_gsh_export_ref(fill->export);
+	fill->fsal_export = op_ctx->fsal_export;
+	fill->gen = gen;
+	fill->offset = start;
+	fill->size = wsize;
+	fill->buf = gsh_malloc(wsize);
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+	fill->change = entry->attrs.change;
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	if (op_ctx->creds != NULL) {
+		fill->creds = *op_ctx->creds;
+		if (fill->creds.caller_glen != 0) {
+			fill->creds.caller_garray =
+				gsh_malloc(fill->creds.caller_glen *
+					   sizeof(gid_t));
+			memcpy(fill->creds.caller_garray,
+			       op_ctx->creds->caller_garray,
+			       fill->creds.caller_glen * sizeof(gid_t));
+		} else {
+			fill->creds.caller_garray = NULL;
+		}
+	}
+
+	rc = fridgethr_submit(ra_fridge, mdc_ra_fill_run, fill);
+	if (rc == 0)
+		return;
+
+	LogDebug(COMPONENT_CACHE_INODE,
+		 "Could not submit readahead, error %d", rc);
+	mdcache_put(entry);
+	put_gsh_export(fill->export);
+	gsh_free(fill->creds.caller_garray);
+	gsh_free(fill->buf);
+	gsh_free(fill);
+
+out_unfill:
+	(void)atomic_sub_uint64_t(&mdc_ra_bytes, wsize);
+	PTHREAD_MUTEX_lock(&ra->mtx);
+	ra->filling = false;
+	PTHREAD_MUTEX_unlock(&ra->mtx);
+}
+
+/**
+ * @brief Start the readahead threads, if readahead is enabled
+ *
+ * @return FSAL status
+ */
+fsal_status_t mdcache_readahead_pkginit(void)
+{
+	if (mdcache_param.readahead_size == 0)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	return mdc_prefetch_fridge_init(&ra_fridge, "mdc_readahead",
+					MDC_RA_THREADS);
+}
+
+/**
+ * @brief Stop the readahead threads
+ */
+void mdcache_readahead_pkgshutdown(void)
+{
+	mdc_prefetch_fridge_shutdown(&ra_fridge);
+}
+
+/** @} */
@@ -0,0 +1,452 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_snapshot.c
+ * @brief Cache snapshot across restarts
+ *
+ * At shutdown the wire handles of the hottest L1 entries are written
+ * to Snapshot_File, with the export they were first reached through.
+ * At startup they are looked up again in the background while the
+ * grace period runs, so the cache is warm by the time clients come
+ * back.  Directories also get their first dirent chunk read again.
+ *
+ * The file is a header followed by one record per entry:
+ *
+ *   uint16_t export_id, uint8_t flags, uint16_t len, len bytes of handle
+ *
+ * in host byte order; it is only meant to be read back by the same
+ * server.  A file that does not look right is ignored.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include "fsal.h"
+#include "fridgethr.h"
+#include "export_mgr.h"
+#include "mdcache.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+
+/** Magic of a snapshot file, "MDCS" and a version */
+#define MDC_SNAP_MAGIC 0x4d444353
+#define MDC_SNAP_VERSION 1
+
+/** Record is for a directory */
+#define MDC_SNAP_DIR 0x01
+
+/** Workers prewarming the cache */
+#define MDC_SNAP_THREADS 4
+
+struct mdc_snap_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+};
+
+/**
+ * @brief A saved entry
+ */
+struct mdc_snap_rec {
+	uint16_t export_id;
+	uint8_t flags;
+	uint16_t len;
+	char handle[NFS4_FHSIZE];
+};
+
+/**
+ * @brief Entries being restored, shared by the workers
+ */
+struct mdc_snap_restore {
+	struct mdc_snap_rec *recs;
+	uint32_t count;
+	uint32_t next;		/*< Next record to restore */
+	uint32_t running;	/*< Workers still running */
+	uint32_t loaded;	/*< Entries found again */
+};
+
+static struct fridgethr *snap_fridge;
+
+/** Set to have the workers give up */
+static uint32_t snap_stop;
+
+/**
+ * @brief Write one entry of the snapshot
+ *
+ * @param[in] f      Snapshot file
+ * @param[in] entry  Entry, referenced; the reference is put
+ *
+ * @return true if a record was written.
+ */
+static bool mdc_snap_write_entry(FILE *f, mdcache_entry_t *entry)
+{
+	struct gsh_buffdesc fh_desc;
+	struct root_op_context ctx;
+	struct gsh_export *export;
+	struct mdc_snap_rec rec;
+	fsal_status_t status;
+	int32_t export_id;
+	bool written = false;
+
+	export_id = atomic_fetch_int32_t(&entry->first_export_id);
+	export = export_id >= 0 ? get_gsh_export(export_id) : NULL;
+	if (export == NULL) {
+		mdcache_put(entry);
+		return false;
+	}
+
+	init_root_op_context(&ctx, export, export->fsal_export,
+			     0, 0, UNKNOWN_REQUEST);
+
+	fh_desc.addr = rec.handle;
+	fh_desc.len = sizeof(rec.handle);
+
+	subcall(
+		status = entry->sub_handle->obj_ops.handle_to_wire(
+			entry->sub_handle, FSAL_DIGEST_NFSV4, &fh_desc)
+	       );
+
+	if (!FSAL_IS_ERROR(status)) {
+		rec.export_id = export_id;
+		rec.flags = entry->obj_handle.type == DIRECTORY ?
+							MDC_SNAP_DIR : 0;
+		rec.len = fh_desc.len;
+		written = fwrite(&rec.export_id, sizeof(rec.export_id), 1,
+				 f) == 1 &&
+			  fwrite(&rec.flags, sizeof(rec.flags), 1, f) == 1 &&
+			  fwrite(&rec.len, sizeof(rec.len), 1, f) == 1 &&
+			  fwrite(rec.handle, rec.len, 1, f) == 1;
+	}
+
+	mdcache_put(entry);
+	release_root_op_context();
+	put_gsh_export(export);
+
+	return written;
+}
+
+/**
+ * @brief Save the handles of the hottest entries to the snapshot file
+ *
+ * Called at shutdown, once the workers are stopped and before the
+ * exports are removed.  The file is written aside and renamed into
+ * place, so a crash leaves the previous snapshot.
+ */
+void mdcache_snapshot_save(void)
+{
+	struct mdc_snap_header hdr = {MDC_SNAP_MAGIC, MDC_SNAP_VERSION, 0};
+	const char *path = mdcache_param.snapshot_file;
+	mdcache_entry_t **entries;
+	char tmp[MAXPATHLEN + 5];
+	uint32_t count, i;
+	bool ok;
+	FILE *f;
+
+	if (path == NULL)
+		return;
+
+	/* A restore still running would only compete with us */
+	mdcache_snapshot_pkgshutdown();
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+		return;
+
+	f = fopen(tmp, "w");
+	if (f == NULL) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Could not create cache snapshot %s: %s",
+			 tmp, strerror(errno));
+		return;
+	}
+
+	entries = gsh_malloc(mdcache_param.snapshot_entries *
+			     sizeof(*entries));
+	count = mdcache_lru_hot_entries(entries,
+					mdcache_param.snapshot_entries);
+
+	/* The count is filled in once known */
+	ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+
+	for (i = 0; i < count; i++) {
+		if (ok && mdc_snap_write_entry(f, entries[i]))
+			hdr.count++;
+		else if (!ok)
+			mdcache_put(entries[i]);
+	}
+
+	gsh_free(entries);
+
+	ok = ok && fseek(f, 0, SEEK_SET) == 0 &&
+	     fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+	ok = fclose(f) == 0 && ok;
+
+	if (!ok || rename(tmp, path) != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Could not write cache snapshot %s: %s",
+			 path, strerror(errno));
+		(void)unlink(tmp);
+		return;
+	}
+
+	LogEvent(COMPONENT_CACHE_INODE,
+		 "Saved %" PRIu32 " cache entries to %s", hdr.count, path);
+}
+
+/**
+ * @brief Read the first chunk of a directory, if nothing is cached
+ *
+ * @param[in] directory  Directory, referenced
+ */
+static void mdc_snap_load_dir(mdcache_entry_t *directory)
+{
+	mdcache_dir_entry_t *dirent = NULL;
+	fsal_status_t status;
+
+	PTHREAD_RWLOCK_wrlock(&directory->content_lock);
+
+	if ((directory->mde_flags & MDCACHE_TRUST_CONTENT) == 0)
+		mdcache_dirent_invalidate_all(directory);
+
+	if (directory->fsobj.fsdir.first_ck == 0) {
+		status = mdcache_populate_dir_chunk(directory, 0, &dirent,
+						    NULL);
+		if (!FSAL_IS_ERROR(status) && dirent != NULL)
+			directory->fsobj.fsdir.first_ck = dirent->ck;
+	}
+
+	PTHREAD_RWLOCK_unlock(&directory->content_lock);
+}
+
+/**
+ * @brief Look a saved entry up again
+ *
+ * Exports that went away or are not attached yet are skipped; the
+ * entries of an on demand export are found when it is first used.
+ *
+ * @param[in] rec  The saved entry
+ *
+ * @return true if the entry is cached.
+ */
+static bool mdc_snap_load_rec(struct mdc_snap_rec *rec)
+{
+	struct fsal_obj_handle *obj = NULL;
+	struct gsh_buffdesc fh_desc;
+	struct root_op_context ctx;
+	struct gsh_export *export;
+	fsal_status_t status;
+
+	export = get_gsh_export(rec->export_id);
+	if (export == NULL)
+		return false;
+
+	if (!export_attached(export)) {
+		put_gsh_export(export);
+		return false;
+	}
+
+	init_root_op_context(&ctx, export, export->fsal_export,
+			     0, 0, UNKNOWN_REQUEST);
+
+	fh_desc.addr = rec->handle;
+	fh_desc.len = rec->len;
+
+	status = export->fsal_export->exp_ops.wire_to_host(
+			export->fsal_export, FSAL_DIGEST_NFSV4, &fh_desc, 0);
+
+	if (!FSAL_IS_ERROR(status))
+		status = export->fsal_export->exp_ops.create_handle(
+				export->fsal_export, &fh_desc, &obj, NULL);
+
+	if (!FSAL_IS_ERROR(status)) {
+		if ((rec->flags & MDC_SNAP_DIR) && obj->type == DIRECTORY &&
+		    mdcache_param.dir.avl_chunk != 0)
+			mdc_snap_load_dir(container_of(obj, mdcache_entry_t,
+						       obj_handle));
+		obj->obj_ops.put_ref(obj);
+	}
+
+	release_root_op_context();
+	put_gsh_export(export);
+
+	return !FSAL_IS_ERROR(status);
+}
+
+/**
+ * @brief Restore saved entries until none are left
+ *
+ * @param[in] ctx  Thread context, arg is the struct mdc_snap_restore
+ */
+static void mdc_snap_restore_run(struct fridgethr_context *ctx)
+{
+	struct mdc_snap_restore *rs = ctx->arg;
+	uint32_t i;
+
+	while (!atomic_fetch_uint32_t(&snap_stop)) {
+		i = atomic_postinc_uint32_t(&rs->next);
+		if (i >= rs->count)
+			break;
+
+		if (mdc_snap_load_rec(&rs->recs[i]))
+			(void)atomic_inc_uint32_t(&rs->loaded);
+	}
+
+	if (atomic_dec_uint32_t(&rs->running) != 0)
+		return;
+
+	LogEvent(COMPONENT_CACHE_INODE,
+		 "Prewarmed %" PRIu32 " of %" PRIu32 " saved cache entries",
+		 rs->loaded, rs->count);
+
+	gsh_free(rs->recs);
+	gsh_free(rs);
+}
+
+/**
+ * @brief Read the snapshot file
+ *
+ * @param[in]  path   Snapshot file
+ * @param[out] count  Number of records read
+ *
+ * @return The records, NULL if there are none.
+ */
+static struct mdc_snap_rec *mdc_snap_read(const char *path, uint32_t *count)
+{
+	struct mdc_snap_header hdr;
+	struct mdc_snap_rec *recs, *rec;
+	uint32_t i;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		if (errno != ENOENT)
+			LogWarn(COMPONENT_CACHE_INODE,
+				"Could not open cache snapshot %s: %s",
+				path, strerror(errno));
+		return NULL;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    hdr.magic != MDC_SNAP_MAGIC || hdr.version != MDC_SNAP_VERSION ||
+	    hdr.count == 0 || hdr.count > mdcache_param.snapshot_entries) {
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Ignoring cache snapshot %s", path);
+		fclose(f);
+		return NULL;
+	}
+
+	recs = gsh_malloc(hdr.count * sizeof(*recs));
+
+	for (i = 0; i < hdr.count; i++) {
+		rec = &recs[i];
+		if (fread(&rec->export_id, sizeof(rec->export_id), 1, f) != 1 ||
+		    fread(&rec->flags, sizeof(rec->flags), 1, f) != 1 ||
+		    fread(&rec->len, sizeof(rec->len), 1, f) != 1 ||
+		    rec->len == 0 || rec->len > sizeof(rec->handle) ||
+		    fread(rec->handle, rec->len, 1, f) != 1)
+			break;
+	}
+
+	fclose(f);
+
+	if (i != hdr.count)
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Cache snapshot %s is truncated, using %" PRIu32
+			" of %" PRIu32 " entries", path, i, hdr.count);
+
+	if (i == 0) {
+		gsh_free(recs);
+		return NULL;
+	}
+
+	*count = i;
+	return recs;
+}
+
+/**
+ * @brief Start prewarming the cache from the snapshot file
+ *
+ * Called once the exports are set up.  The entries are looked up in
+ * the background; this returns as soon as the file is read.
+ */
+void mdcache_snapshot_restore(void)
+{
+	struct mdc_snap_restore *rs;
+	struct mdc_snap_rec *recs;
+	fsal_status_t status;
+	uint32_t count, i;
+
+	if (mdcache_param.snapshot_file == NULL || snap_fridge != NULL)
+		return;
+
+	recs = mdc_snap_read(mdcache_param.snapshot_file, &count);
+	if (recs == NULL)
+		return;
+
+	status = mdc_prefetch_fridge_init(&snap_fridge, "mdc_snapshot",
+					  MDC_SNAP_THREADS);
+	if (FSAL_IS_ERROR(status)) {
+		gsh_free(recs);
+		return;
+	}
+
+	rs = gsh_calloc(1, sizeof(*rs));
+	rs->recs = recs;
+	rs->count = count;
+	rs->running = MDC_SNAP_THREADS;
+	atomic_store_uint32_t(&snap_stop, 0);
+
+	LogInfo(COMPONENT_CACHE_INODE,
+		"Prewarming cache with %" PRIu32 " entries from %s",
+		count, mdcache_param.snapshot_file);
+
+	for (i = 0; i < MDC_SNAP_THREADS; i++) {
+		if (fridgethr_submit(snap_fridge, mdc_snap_restore_run,
+				     rs) != 0) {
+			/* Account for the workers that will not run */
+			if (atomic_sub_uint32_t(&rs->running,
+						MDC_SNAP_THREADS - i) == 0) {
+				gsh_free(rs->recs);
+				gsh_free(rs);
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Stop prewarming the cache
+ */
+void mdcache_snapshot_pkgshutdown(void)
+{
+	atomic_store_uint32_t(&snap_stop, 1);
+	mdc_prefetch_fridge_shutdown(&snap_fridge);
+}
+
+/** @} */
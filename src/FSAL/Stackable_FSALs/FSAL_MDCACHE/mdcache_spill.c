@@ -0,0 +1,432 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_spill.c
+ * @brief Second level store for the dirents of reaped directories
+ *
+ * When a directory is reaped, its cached names are appended to
+ * Spill_File, a circular log on local storage, together with the
+ * directory's change attribute.  When the directory is cached again
+ * and the change attribute the FSAL returns is the same, the names
+ * are put back in the dirent cache, so lookups are answered without
+ * going back to the FSAL for a READDIR.  If the directory was fully
+ * cached, negative lookups are too.
+ *
+ * Attributes are not spilled: every path that brings an entry back
+ * gets fresh attributes from the FSAL along with the handle.
+ *
+ * A record is a header, the key of the directory, then one name per
+ * dirent:
+ *
+ *   struct mdc_spill_name, namesize bytes of name, keylen bytes of key
+ *
+ * in host byte order.  An in memory index maps the hash of a
+ * directory's key to the position of its latest record in the log;
+ * the log is not read back across restarts.  A record that has been
+ * overwritten, or is still being written, fails its checksum and is
+ * ignored.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "fsal.h"
+#include "gsh_crc32c.h"
+#include "mdcache.h"
+#include "mdcache_int.h"
+#include "mdcache_avl.h"
+
+/** Magic of a spilled directory, "MDCL" */
+#define MDC_SPILL_MAGIC 0x4d44434c
+
+/** Largest record written, larger directories are spilled in part */
+#define MDC_SPILL_MAX_RECORD (1024 * 1024)
+
+/** Log bytes per index slot */
+#define MDC_SPILL_SLOT_BYTES 1024
+
+/** The record holds every name in the directory */
+#define MDC_SPILL_COMPLETE 0x01
+
+struct mdc_spill_header {
+	uint32_t magic;
+	uint32_t crc;		/*< CRC32C of the record after this field */
+	uint32_t len;		/*< Length of the record, header included */
+	uint32_t count;		/*< Names in the record */
+	uint64_t pos;		/*< Position of the record in the log */
+	uint64_t hk;		/*< Hash of the directory's key */
+	uint64_t change;	/*< Change attribute of the directory */
+	uint16_t keylen;	/*< Length of the directory's key */
+	uint8_t flags;
+	uint8_t pad[5];
+};
+
+struct mdc_spill_name {
+	uint64_t hk;		/*< Hash of the entry's key */
+	uint16_t namesize;	/*< Length of the name, with its NUL */
+	uint16_t keylen;	/*< Length of the entry's key */
+	uint8_t pad[4];
+};
+
+struct mdc_spill_slot {
+	uint64_t hk;
+	uint64_t pos;
+};
+
+static int spill_fd = -1;
+static uint64_t spill_size;
+
+/** Protects spill_head and the index */
+static pthread_mutex_t spill_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/** Log position the next record goes to; it only grows, so a
+ *  position is never reused */
+static uint64_t spill_head;
+
+static struct mdc_spill_slot *spill_index;
+static uint64_t spill_slots;
+
+static inline uint32_t mdc_spill_crc(const struct mdc_spill_header *hdr)
+{
+	size_t skip = offsetof(struct mdc_spill_header, len);
+
+	return gsh_crc32c(0, (const char *)hdr + skip, hdr->len - skip);
+}
+
+/**
+ * @brief Append a record to the log
+ *
+ * @param[in] hdr  Record, with len set; pos and crc are filled in
+ */
+static void mdc_spill_append(struct mdc_spill_header *hdr)
+{
+	struct mdc_spill_slot *slot;
+	uint64_t pos;
+	ssize_t rc;
+
+	PTHREAD_MUTEX_lock(&spill_mtx);
+
+	/* records don't wrap, skip to the start of the file instead */
+	pos = spill_head;
+	if (pos % spill_size + hdr->len > spill_size)
+		pos += spill_size - pos % spill_size;
+	spill_head = pos + hdr->len;
+
+	slot = &spill_index[hdr->hk % spill_slots];
+	slot->hk = hdr->hk;
+	slot->pos = pos;
+
+	PTHREAD_MUTEX_unlock(&spill_mtx);
+
+	hdr->pos = pos;
+	hdr->crc = mdc_spill_crc(hdr);
+
+	rc = pwrite(spill_fd, hdr, hdr->len, pos % spill_size);
+	if (rc != hdr->len) {
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Spill write of %"PRIu32" bytes failed: %s",
+			 hdr->len, rc < 0 ? strerror(errno) : "short write");
+		return;
+	}
+
+	(void)atomic_inc_uint64_t(&cache_stp->spill_out);
+}
+
+/**
+ * @brief Spill the names of a directory being reaped
+ *
+ * Only directories whose dirents and attributes are both trusted are
+ * spilled, so the change attribute matches the names.
+ *
+ * @param[in] entry  Entry, unreachable and held only by the caller
+ */
+void mdc_spill_dir(mdcache_entry_t *entry)
+{
+	struct mdc_spill_header *hdr;
+	struct mdc_spill_name name;
+	struct avltree_node *node;
+	mdcache_dir_entry_t *dirent;
+	mdcache_key_t *key = &entry->fh_hk.key;
+	size_t len, need;
+	char *p;
+
+	if (spill_fd < 0 || entry->obj_handle.type != DIRECTORY)
+		return;
+
+	if (!(entry->mde_flags & MDCACHE_TRUST_CONTENT) ||
+	    !(entry->mde_flags & MDCACHE_TRUST_ATTRS) ||
+	    !(entry->attrs.valid_mask & ATTR_CHANGE) ||
+	    sizeof(*hdr) + key->kv.len > MDC_SPILL_MAX_RECORD)
+		return;
+
+	PTHREAD_RWLOCK_rdlock(&entry->content_lock);
+
+	if (avltree_first(&entry->fsobj.fsdir.avl.t) == NULL) {
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+		return;
+	}
+
+	hdr = gsh_malloc(MDC_SPILL_MAX_RECORD);
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = MDC_SPILL_MAGIC;
+	hdr->hk = key->hk;
+	hdr->change = entry->attrs.change;
+	hdr->keylen = key->kv.len;
+	if (mdc_dircache_trusted(entry) && mdcache_param.dir.avl_chunk == 0)
+		hdr->flags |= MDC_SPILL_COMPLETE;
+
+	p = (char *)(hdr + 1);
+	memcpy(p, key->kv.addr, key->kv.len);
+	p += key->kv.len;
+	len = p - (char *)hdr;
+
+	for (node = avltree_first(&entry->fsobj.fsdir.avl.t); node != NULL;
+	     node = avltree_next(node)) {
+		dirent = avltree_container_of(node, mdcache_dir_entry_t,
+					      node_hk);
+		if (dirent->flags & DIR_ENTRY_FLAG_DELETED)
+			continue;
+
+		memset(&name, 0, sizeof(name));
+		name.hk = dirent->ckey.hk;
+		name.namesize = strlen(dirent->name) + 1;
+		name.keylen = dirent->ckey.kv.len;
+
+		need = sizeof(name) + name.namesize + name.keylen;
+		if (len + need > MDC_SPILL_MAX_RECORD ||
+		    dirent->ckey.fsal != key->fsal) {
+			/* too big, or under a junction to another FSAL */
+			hdr->flags &= ~MDC_SPILL_COMPLETE;
+			if (len + need > MDC_SPILL_MAX_RECORD)
+				break;
+			continue;
+		}
+
+		memcpy(p, &name, sizeof(name));
+		p += sizeof(name);
+		memcpy(p, dirent->name, name.namesize);
+		p += name.namesize;
+		memcpy(p, dirent->ckey.kv.addr, name.keylen);
+		p += name.keylen;
+		len += need;
+		hdr->count++;
+	}
+
+	PTHREAD_RWLOCK_unlock(&entry->content_lock);
+
+	hdr->len = len;
+	if (hdr->count != 0)
+		mdc_spill_append(hdr);
+
+	gsh_free(hdr);
+}
+
+/**
+ * @brief Read back the latest record of a directory
+ *
+ * @param[in] key  Key of the directory
+ *
+ * @return The record, to be freed by the caller, or NULL.
+ */
+static struct mdc_spill_header *mdc_spill_read(mdcache_key_t *key)
+{
+	struct mdc_spill_header head, *hdr;
+	struct mdc_spill_slot *slot;
+	uint64_t pos;
+	bool live;
+
+	PTHREAD_MUTEX_lock(&spill_mtx);
+	slot = &spill_index[key->hk % spill_slots];
+	pos = slot->pos;
+	live = slot->hk == key->hk && spill_head - pos <= spill_size;
+	PTHREAD_MUTEX_unlock(&spill_mtx);
+
+	if (!live)
+		return NULL;
+
+	if (pread(spill_fd, &head, sizeof(head), pos % spill_size) !=
+	    (ssize_t)sizeof(head) ||
+	    head.magic != MDC_SPILL_MAGIC || head.pos != pos ||
+	    head.hk != key->hk || head.keylen != key->kv.len ||
+	    head.len < sizeof(head) + head.keylen ||
+	    head.len > MDC_SPILL_MAX_RECORD)
+		return NULL;
+
+	hdr = gsh_malloc(head.len);
+
+	if (pread(spill_fd, hdr, head.len, pos % spill_size) != head.len ||
+	    memcmp(hdr, &head, sizeof(head)) != 0 ||
+	    mdc_spill_crc(hdr) != hdr->crc ||
+	    memcmp(hdr + 1, key->kv.addr, key->kv.len) != 0) {
+		gsh_free(hdr);
+		return NULL;
+	}
+
+	return hdr;
+}
+
+/**
+ * @brief Restore the names of a directory being cached again
+ *
+ * The record is read before the content lock is taken, so the
+ * directory is not held up by the I/O.
+ *
+ * @param[in] entry  New directory entry, referenced by the caller
+ * @param[in] attrs  Attributes just fetched from the FSAL
+ */
+void mdc_spill_load(mdcache_entry_t *entry, const struct attrlist *attrs)
+{
+	struct mdc_spill_header *hdr;
+	struct mdc_spill_name name;
+	mdcache_dir_entry_t *dirent, *allocated;
+	mdcache_key_t ckey;
+	const char *p, *end;
+	uint32_t i;
+
+	if (spill_fd < 0 || !(attrs->valid_mask & ATTR_CHANGE))
+		return;
+
+	hdr = mdc_spill_read(&entry->fh_hk.key);
+	if (hdr == NULL)
+		return;
+
+	if (hdr->change != attrs->change) {
+		LogFullDebug(COMPONENT_CACHE_INODE,
+			     "Spilled dirents of %p are stale", entry);
+		gsh_free(hdr);
+		return;
+	}
+
+	p = (const char *)(hdr + 1) + hdr->keylen;
+	end = (const char *)hdr + hdr->len;
+	ckey.fsal = entry->fh_hk.key.fsal;
+
+	PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+
+	/* Invalidated since it was cached, the names can't be trusted */
+	if (!(entry->mde_flags & MDCACHE_TRUST_CONTENT) ||
+	    (entry->mde_flags & MDCACHE_BYPASS_DIRCACHE)) {
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+		gsh_free(hdr);
+		return;
+	}
+
+	for (i = 0; i < hdr->count; i++) {
+		if ((size_t)(end - p) < sizeof(name))
+			break;
+		memcpy(&name, p, sizeof(name));
+		p += sizeof(name);
+		if (name.namesize == 0 ||
+		    (size_t)(end - p) < name.namesize + name.keylen ||
+		    p[name.namesize - 1] != '\0')
+			break;
+
+		ckey.hk = name.hk;
+		ckey.kv.addr = (void *)(p + name.namesize);
+		ckey.kv.len = name.keylen;
+
+		dirent = mdcache_dirent_alloc(name.namesize, &ckey);
+		dirent->flags = DIR_ENTRY_FLAG_NONE;
+		memcpy(dirent->name, p, name.namesize);
+		allocated = dirent;
+
+		if (mdcache_avl_qp_insert(entry, &dirent) >= 0 &&
+		    dirent == allocated)
+			entry->fsobj.fsdir.nbactive++;
+
+		p += name.namesize + name.keylen;
+	}
+
+	if (i == hdr->count && (hdr->flags & MDC_SPILL_COMPLETE) &&
+	    mdcache_param.dir.avl_chunk == 0)
+		atomic_set_uint32_t_bits(&entry->mde_flags,
+					 MDCACHE_DIR_POPULATED);
+
+	PTHREAD_RWLOCK_unlock(&entry->content_lock);
+
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Restored %"PRIu32" spilled dirents of %p", i, entry);
+	(void)atomic_inc_uint64_t(&cache_stp->spill_in);
+
+	gsh_free(hdr);
+}
+
+/**
+ * @brief Open the spill log, if one is configured
+ */
+void mdcache_spill_pkginit(void)
+{
+	int fd;
+
+	if (mdcache_param.spill_file == NULL)
+		return;
+
+	fd = open(mdcache_param.spill_file, O_RDWR | O_CREAT | O_TRUNC,
+		  0600);
+	if (fd < 0) {
+		LogCrit(COMPONENT_CACHE_INODE,
+			"Could not open Spill_File %s: %s",
+			mdcache_param.spill_file, strerror(errno));
+		return;
+	}
+
+	if (ftruncate(fd, mdcache_param.spill_size) != 0) {
+		LogCrit(COMPONENT_CACHE_INODE,
+			"Could not size Spill_File %s: %s",
+			mdcache_param.spill_file, strerror(errno));
+		close(fd);
+		return;
+	}
+
+	spill_size = mdcache_param.spill_size;
+	spill_slots = spill_size / MDC_SPILL_SLOT_BYTES;
+	spill_index = gsh_calloc(spill_slots, sizeof(*spill_index));
+	spill_head = 0;
+	spill_fd = fd;
+
+	LogEvent(COMPONENT_CACHE_INODE,
+		 "Spilling reaped dirents to %s, %"PRIu64" bytes",
+		 mdcache_param.spill_file, spill_size);
+}
+
+/**
+ * @brief Close the spill log
+ */
+void mdcache_spill_pkgshutdown(void)
+{
+	if (spill_fd < 0)
+		return;
+
+	close(spill_fd);
+	spill_fd = -1;
+	gsh_free(spill_index);
+	spill_index = NULL;
+}
+
+/** @} */
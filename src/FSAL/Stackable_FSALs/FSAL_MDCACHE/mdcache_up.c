@@ -35,6 +35,7 @@
 #include "config.h"
 #include "fsal.h"
 #include "nfs4_acls.h"
+#include "sal_functions.h"
 #include "mdcache_hash.h"
 #include "mdcache_int.h"
 
@@ -69,6 +70,12 @@ mdc_up_invalidate(const struct fsal_up_vector *vec, struct gsh_buffdesc *handle,
 	atomic_clear_uint32_t_bits(&entry->mde_flags,
 				   flags & FSAL_UP_INVALIDATE_CACHE);
 
+	if (flags & (FSAL_UP_INVALIDATE_ATTRS | FSAL_UP_INVALIDATE_CONTENT)) {
+		mdc_ra_invalidate(entry);
+		/* Changed behind our back, recall directory delegations */
+		(void) state_dir_deleg_conflict(&entry->obj_handle);
+	}
+
 	if (flags & FSAL_UP_INVALIDATE_CLOSE)
 		status = fsal_close(&entry->obj_handle);
 
@@ -162,6 +169,7 @@ mdc_up_update(const struct fsal_up_vector *vec, struct gsh_buffdesc *handle,
 
 	if (attr->expire_time_attr != 0)
 		entry->attrs.expire_time_attr = attr->expire_time_attr;
+	mdc_trust_upcall_expiry(&entry->attrs);
 
 	if (FSAL_TEST_MASK(attr->valid_mask, ATTR_SIZE)) {
 		if (flags & fsal_up_update_filesize_inc) {
@@ -275,6 +283,8 @@ mdc_up_update(const struct fsal_up_vector *vec, struct gsh_buffdesc *handle,
 						   MDCACHE_TRUST_CONTENT |
 						   MDCACHE_DIR_POPULATED);
 		}
+		/* Nor can a file's readahead */
+		mdc_ra_invalidate(entry);
 		status = fsalstat(ERR_FSAL_NO_ERROR, 0);
 	} else {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
@@ -284,6 +294,10 @@ mdc_up_update(const struct fsal_up_vector *vec, struct gsh_buffdesc *handle,
 
 	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
 
+	/* Changed behind our back, recall directory delegations */
+	if (mutatis_mutandis)
+		(void) state_dir_deleg_conflict(&entry->obj_handle);
+
 put:
 	mdcache_put(entry);
 out:
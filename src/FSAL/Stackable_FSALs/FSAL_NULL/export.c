@@ -88,8 +88,10 @@ static fsal_status_t get_dynamic_info(struct fsal_export *exp_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = exp->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = op_ctx->fsal_export->exp_ops.get_fs_dynamic_info(
 		op_ctx->fsal_export, handle->sub_handle, infop);
+	nullfs_op_done(NULLFS_OP_get_fs_dynamic_info, op_start, status.major);
 	op_ctx->fsal_export = &exp->export;
 
 	return status;
@@ -281,10 +283,12 @@ static fsal_status_t get_quota(struct fsal_export *exp_hdl,
 		container_of(exp_hdl, struct nullfs_fsal_export, export);
 
 	op_ctx->fsal_export = exp->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t result =
 		exp->export.sub_export->exp_ops.get_quota(
 			exp->export.sub_export, filepath,
 			quota_type, quota_id, pquota);
+	nullfs_op_done(NULLFS_OP_get_quota, op_start, result.major);
 	op_ctx->fsal_export = &exp->export;
 
 	return result;
@@ -303,10 +307,12 @@ static fsal_status_t set_quota(struct fsal_export *exp_hdl,
 		container_of(exp_hdl, struct nullfs_fsal_export, export);
 
 	op_ctx->fsal_export = exp->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t result =
 		exp->export.sub_export->exp_ops.set_quota(
 			exp->export.sub_export, filepath, quota_type, quota_id,
 			pquota, presquota);
+	nullfs_op_done(NULLFS_OP_set_quota, op_start, result.major);
 	op_ctx->fsal_export = &exp->export;
 
 	return result;
@@ -57,8 +57,10 @@ fsal_status_t nullfs_open(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.open(handle->sub_handle, openflags);
+	nullfs_op_done(NULLFS_OP_open, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -80,8 +82,10 @@ fsal_openflags_t nullfs_status(struct fsal_obj_handle *obj_hdl)
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_openflags_t status =
 		handle->sub_handle->obj_ops.status(handle->sub_handle);
+	nullfs_op_done(NULLFS_OP_status, op_start, ERR_FSAL_NO_ERROR);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -107,10 +111,12 @@ fsal_status_t nullfs_read(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.read(handle->sub_handle, offset,
 						 buffer_size, buffer,
 						 read_amount, end_of_file);
+	nullfs_op_done(NULLFS_OP_read, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -135,6 +141,7 @@ fsal_status_t nullfs_write(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.write(handle->sub_handle,
 						  offset,
@@ -142,6 +149,7 @@ fsal_status_t nullfs_write(struct fsal_obj_handle *obj_hdl,
 						  buffer,
 						  write_amount,
 						  fsal_stable);
+	nullfs_op_done(NULLFS_OP_write, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -165,9 +173,11 @@ fsal_status_t nullfs_commit(struct fsal_obj_handle *obj_hdl,	/* sync */
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.commit(handle->sub_handle,
 						   offset, len);
+	nullfs_op_done(NULLFS_OP_commit, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -195,12 +205,14 @@ fsal_status_t nullfs_lock_op(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.lock_op(handle->sub_handle,
 						    p_owner,
 						    lock_op,
 						    request_lock,
 						    conflicting_lock);
+	nullfs_op_done(NULLFS_OP_lock_op, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -224,8 +236,10 @@ fsal_status_t nullfs_close(struct fsal_obj_handle *obj_hdl)
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.close(handle->sub_handle);
+	nullfs_op_done(NULLFS_OP_close, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -252,12 +266,14 @@ fsal_status_t nullfs_open2(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.open2(handle->sub_handle, state,
 						  openflags, createmode, name,
 						  attrs_in, verifier,
 						  &sub_handle, attrs_out,
 						  caller_perm_check);
+	nullfs_op_done(NULLFS_OP_open2, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	if (sub_handle) {
@@ -283,9 +299,11 @@ bool nullfs_check_verifier(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	bool result =
 		handle->sub_handle->obj_ops.check_verifier(handle->sub_handle,
 							   verifier);
+	nullfs_op_done(NULLFS_OP_check_verifier, op_start, ERR_FSAL_NO_ERROR);
 	op_ctx->fsal_export = &export->export;
 
 	return result;
@@ -304,9 +322,11 @@ fsal_openflags_t nullfs_status2(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_openflags_t result =
 		handle->sub_handle->obj_ops.status2(handle->sub_handle,
 						    state);
+	nullfs_op_done(NULLFS_OP_status2, op_start, ERR_FSAL_NO_ERROR);
 	op_ctx->fsal_export = &export->export;
 
 	return result;
@@ -326,9 +346,11 @@ fsal_status_t nullfs_reopen2(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.reopen2(handle->sub_handle,
 						    state, openflags);
+	nullfs_op_done(NULLFS_OP_reopen2, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -354,11 +376,73 @@ fsal_status_t nullfs_read2(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.read2(handle->sub_handle, bypass,
 						  state, offset, buf_size,
 						  buffer, read_amount, eof,
 						  info);
+	nullfs_op_done(NULLFS_OP_read2, op_start, status.major);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t nullfs_readv2(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    struct iovec *iov,
+			    int iovcnt,
+			    size_t *read_amount,
+			    bool *eof)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
+	fsal_status_t status =
+		handle->sub_handle->obj_ops.readv2(handle->sub_handle, bypass,
+						   state, offset, iov, iovcnt,
+						   read_amount, eof);
+	nullfs_op_done(NULLFS_OP_readv2, op_start, status.major);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t nullfs_read_fd(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     size_t size,
+			     int *fd,
+			     size_t *read_amount,
+			     bool *eof)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
+	fsal_status_t status =
+		handle->sub_handle->obj_ops.read_fd(handle->sub_handle, bypass,
+						    state, offset, size, fd,
+						    read_amount, eof);
+	nullfs_op_done(NULLFS_OP_read_fd, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -384,11 +468,13 @@ fsal_status_t nullfs_write2(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.write2(handle->sub_handle, bypass,
 						  state, offset, buf_size,
 						  buffer, write_amount,
 						  fsal_stable, info);
+	nullfs_op_done(NULLFS_OP_write2, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -408,9 +494,11 @@ fsal_status_t nullfs_seek2(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.seek2(handle->sub_handle, state,
 						  info);
+	nullfs_op_done(NULLFS_OP_seek2, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -430,9 +518,11 @@ fsal_status_t nullfs_io_advise2(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.io_advise2(handle->sub_handle,
 						       state, hints);
+	nullfs_op_done(NULLFS_OP_io_advise2, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -451,9 +541,77 @@ fsal_status_t nullfs_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.commit2(handle->sub_handle, offset,
 						    len);
+	nullfs_op_done(NULLFS_OP_commit2, op_start, status.major);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t nullfs_copy2(struct fsal_obj_handle *src_hdl,
+			  struct state_t *src_state,
+			  uint64_t src_offset,
+			  struct fsal_obj_handle *dst_hdl,
+			  struct state_t *dst_state,
+			  uint64_t dst_offset,
+			  uint64_t count,
+			  uint64_t *copied)
+{
+	struct nullfs_fsal_obj_handle *src =
+		container_of(src_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+	struct nullfs_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
+	fsal_status_t status =
+		src->sub_handle->obj_ops.copy2(src->sub_handle, src_state,
+					       src_offset, dst->sub_handle,
+					       dst_state, dst_offset, count,
+					       copied);
+	nullfs_op_done(NULLFS_OP_copy2, op_start, status.major);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t nullfs_clone2(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count)
+{
+	struct nullfs_fsal_obj_handle *src =
+		container_of(src_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+	struct nullfs_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
+	fsal_status_t status =
+		src->sub_handle->obj_ops.clone2(src->sub_handle, src_state,
+						src_offset, dst->sub_handle,
+						dst_state, dst_offset, count);
+	nullfs_op_done(NULLFS_OP_clone2, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -476,10 +634,12 @@ fsal_status_t nullfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.lock_op2(handle->sub_handle, state,
 						     p_owner, lock_op, req_lock,
 						     conflicting_lock);
+	nullfs_op_done(NULLFS_OP_lock_op2, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -498,8 +658,10 @@ fsal_status_t nullfs_close2(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.close2(handle->sub_handle, state);
+	nullfs_op_done(NULLFS_OP_close2, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
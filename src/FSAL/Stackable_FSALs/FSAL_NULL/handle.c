@@ -145,8 +145,10 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	status = null_parent->sub_handle->obj_ops.lookup(
 			null_parent->sub_handle, path, &sub_handle, attrs_out);
+	nullfs_op_done(NULLFS_OP_lookup, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	/* wraping the subfsal handle in a nullfs handle. */
@@ -175,8 +177,10 @@ static fsal_status_t create(struct fsal_obj_handle *dir_hdl,
 
 	/* creating the file with a subfsal handle. */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = nullfs_dir->sub_handle->obj_ops.create(
 		nullfs_dir->sub_handle, name, attrs_in, &sub_handle, attrs_out);
+	nullfs_op_done(NULLFS_OP_create, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	/* wraping the subfsal handle in a nullfs handle. */
@@ -204,8 +208,10 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 
 	/* Creating the directory with a subfsal handle. */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = parent_hdl->sub_handle->obj_ops.mkdir(
 		parent_hdl->sub_handle, name, attrs_in, &sub_handle, attrs_out);
+	nullfs_op_done(NULLFS_OP_mkdir, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	/* wraping the subfsal handle in a nullfs handle. */
@@ -236,9 +242,11 @@ static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
 
 	/* Creating the node with a subfsal handle. */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = nullfs_dir->sub_handle->obj_ops.mknode(
 		nullfs_dir->sub_handle, name, nodetype, attrs_in,
 		&sub_handle, attrs_out);
+	nullfs_op_done(NULLFS_OP_mknode, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	/* wraping the subfsal handle in a nullfs handle. */
@@ -275,9 +283,11 @@ static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
 
 	/* creating the file with a subfsal handle. */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = nullfs_dir->sub_handle->obj_ops.symlink(
 		nullfs_dir->sub_handle, name, link_path, attrs_in, &sub_handle,
 		attrs_out);
+	nullfs_op_done(NULLFS_OP_symlink, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	/* wraping the subfsal handle in a nullfs handle. */
@@ -297,9 +307,11 @@ static fsal_status_t readsymlink(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.readlink(handle->sub_handle,
 						     link_content, refresh);
+	nullfs_op_done(NULLFS_OP_readlink, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -319,8 +331,10 @@ static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = handle->sub_handle->obj_ops.link(
 		handle->sub_handle, nullfs_dir->sub_handle, name);
+	nullfs_op_done(NULLFS_OP_link, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -395,9 +409,11 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.readdir(handle->sub_handle,
 		whence, &cb_state, nullfs_readdir_cb, attrmask, eof);
+	nullfs_op_done(NULLFS_OP_readdir, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -437,8 +453,11 @@ fsal_cookie_t compute_readdir_cookie(struct fsal_obj_handle *parent,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	cookie = handle->sub_handle->obj_ops.compute_readdir_cookie(
 						handle->sub_handle, name);
+	nullfs_op_done(NULLFS_OP_compute_readdir_cookie, op_start,
+		       ERR_FSAL_NO_ERROR);
 	op_ctx->fsal_export = &export->export;
 	return cookie;
 }
@@ -480,9 +499,11 @@ int dirent_cmp(struct fsal_obj_handle *parent,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	rc = handle->sub_handle->obj_ops.dirent_cmp(handle->sub_handle,
 						    name1, cookie1,
 						    name2, cookie2);
+	nullfs_op_done(NULLFS_OP_dirent_cmp, op_start, ERR_FSAL_NO_ERROR);
 	op_ctx->fsal_export = &export->export;
 	return rc;
 }
@@ -509,9 +530,11 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = nullfs_olddir->sub_handle->obj_ops.rename(
 		nullfs_obj->sub_handle, nullfs_olddir->sub_handle,
 		old_name, nullfs_newdir->sub_handle, new_name);
+	nullfs_op_done(NULLFS_OP_rename, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -530,9 +553,11 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.getattrs(handle->sub_handle,
 						     attrib_get);
+	nullfs_op_done(NULLFS_OP_getattrs, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -556,8 +581,10 @@ static fsal_status_t setattrs(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = handle->sub_handle->obj_ops.setattrs(
 		handle->sub_handle, attrs);
+	nullfs_op_done(NULLFS_OP_setattrs, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -578,8 +605,10 @@ static fsal_status_t nullfs_setattr2(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = handle->sub_handle->obj_ops.setattr2(
 		handle->sub_handle, bypass, state, attrs);
+	nullfs_op_done(NULLFS_OP_setattr2, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -605,8 +634,10 @@ static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = nullfs_dir->sub_handle->obj_ops.unlink(
 		nullfs_dir->sub_handle, nullfs_obj->sub_handle, name);
+	nullfs_op_done(NULLFS_OP_unlink, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -633,8 +664,10 @@ static fsal_status_t handle_to_wire(const struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = handle->sub_handle->obj_ops.handle_to_wire(
 		handle->sub_handle, output_type, fh_desc);
+	nullfs_op_done(NULLFS_OP_handle_to_wire, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -660,7 +693,9 @@ static void handle_to_key(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	handle->sub_handle->obj_ops.handle_to_key(handle->sub_handle, fh_desc);
+	nullfs_op_done(NULLFS_OP_handle_to_key, op_start, ERR_FSAL_NO_ERROR);
 	op_ctx->fsal_export = &export->export;
 }
 
@@ -681,7 +716,9 @@ static void release(struct fsal_obj_handle *obj_hdl)
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	hdl->sub_handle->obj_ops.release(hdl->sub_handle);
+	nullfs_op_done(NULLFS_OP_release, op_start, ERR_FSAL_NO_ERROR);
 	op_ctx->fsal_export = &export->export;
 
 	/* cleaning data allocated by nullfs */
@@ -722,10 +759,14 @@ void nullfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->status2 = nullfs_status2;
 	ops->reopen2 = nullfs_reopen2;
 	ops->read2 = nullfs_read2;
+	ops->readv2 = nullfs_readv2;
+	ops->read_fd = nullfs_read_fd;
 	ops->write2 = nullfs_write2;
 	ops->seek2 = nullfs_seek2;
 	ops->io_advise2 = nullfs_io_advise2;
 	ops->commit2 = nullfs_commit2;
+	ops->copy2 = nullfs_copy2;
+	ops->clone2 = nullfs_clone2;
 	ops->lock_op2 = nullfs_lock_op2;
 	ops->setattr2 = nullfs_setattr2;
 	ops->close2 = nullfs_close2;
@@ -767,11 +808,11 @@ fsal_status_t nullfs_lookup_path(struct fsal_export *exp_hdl,
 	fsal_status_t status;
 
 	op_ctx->fsal_export = exp->export.sub_export;
-
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	status = exp->export.sub_export->exp_ops.lookup_path(
 				exp->export.sub_export, path, &sub_handle,
 				attrs_out);
-
+	nullfs_op_done(NULLFS_OP_lookup_path, op_start, status.major);
 	op_ctx->fsal_export = &exp->export;
 
 	/* wraping the subfsal handle in a nullfs handle. */
@@ -808,11 +849,11 @@ fsal_status_t nullfs_create_handle(struct fsal_export *exp_hdl,
 	fsal_status_t status;
 
 	op_ctx->fsal_export = export->export.sub_export;
-
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	status = export->export.sub_export->exp_ops.create_handle(
 			export->export.sub_export, hdl_desc, &sub_handle,
 			attrs_out);
-
+	nullfs_op_done(NULLFS_OP_create_handle, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	/* wraping the subfsal handle in a nullfs handle. */
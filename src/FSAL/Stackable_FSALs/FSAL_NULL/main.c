@@ -178,12 +178,18 @@ MODULE_INIT void nullfs_init(void)
 	myself->m_ops.create_export = nullfs_create_export;
 	myself->m_ops.init_config = init_config;
 	myself->m_ops.support_ex = nullfs_support_ex;
+
+	if (nullfs_stats_init() != 0)
+		LogWarn(COMPONENT_FSAL,
+			"NULLFS statistics will not be in the metrics");
 }
 
 MODULE_FINI void nullfs_unload(void)
 {
 	int retval;
 
+	nullfs_stats_fini();
+
 	retval = unregister_fsal(&NULLFS.fsal);
 	if (retval != 0) {
 		fprintf(stderr, "NULLFS module failed to unregister");
@@ -27,6 +27,40 @@ extern struct next_ops next_ops;
 extern struct fsal_up_vector fsal_up_top;
 void nullfs_handle_ops_init(struct fsal_obj_ops *ops);
 
+/*
+ * Statistics of the calls to the sub-FSAL
+ *
+ * Each method passed down is counted and timed, readdir including the
+ * upper layer callbacks.  The families are added to the metrics
+ * endpoint as ganesha_fsal_null_*.
+ */
+#define NULLFS_OPS(X) X(lookup) X(create) X(mkdir) X(mknode) X(symlink) \
+	X(readlink) X(link) X(readdir) X(compute_readdir_cookie) X(dirent_cmp) \
+	X(rename) X(getattrs) X(setattrs) X(setattr2) X(unlink) \
+	X(handle_to_wire) X(handle_to_key) X(release) X(lookup_path) \
+	X(create_handle) X(open) X(status) X(read) X(write) X(commit) \
+	X(lock_op) X(close) X(open2) X(check_verifier) X(status2) X(reopen2) \
+	X(read2) X(readv2) X(read_fd) X(write2) X(seek2) X(io_advise2) X(commit2) \
+	X(copy2) X(clone2) X(lock_op2) X(close2) X(list_ext_attrs) \
+	X(getextattr_id_by_name) X(getextattr_value_by_id) \
+	X(getextattr_value_by_name) X(setextattr_value) \
+	X(setextattr_value_by_id) X(remove_extattr_by_id) \
+	X(remove_extattr_by_name) X(get_fs_dynamic_info) X(get_quota) \
+	X(set_quota)
+
+enum nullfs_op {
+#define NULLFS_OP_ENUM(name) NULLFS_OP_##name,
+	NULLFS_OPS(NULLFS_OP_ENUM)
+#undef NULLFS_OP_ENUM
+	NULLFS_OP_COUNT
+};
+
+nsecs_elapsed_t nullfs_op_start(void);
+void nullfs_op_done(enum nullfs_op op, nsecs_elapsed_t start,
+		    fsal_errors_t major);
+int nullfs_stats_init(void);
+void nullfs_stats_fini(void);
+
 /*
  * NULLFS internal export
  */
@@ -134,6 +168,22 @@ fsal_status_t nullfs_read2(struct fsal_obj_handle *obj_hdl,
 			   size_t *read_amount,
 			   bool *eof,
 			   struct io_info *info);
+fsal_status_t nullfs_readv2(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    struct iovec *iov,
+			    int iovcnt,
+			    size_t *read_amount,
+			    bool *eof);
+fsal_status_t nullfs_read_fd(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     size_t size,
+			     int *fd,
+			     size_t *read_amount,
+			     bool *eof);
 fsal_status_t nullfs_write2(struct fsal_obj_handle *obj_hdl,
 			    bool bypass,
 			    struct state_t *state,
@@ -151,6 +201,21 @@ fsal_status_t nullfs_io_advise2(struct fsal_obj_handle *obj_hdl,
 				struct io_hints *hints);
 fsal_status_t nullfs_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 			     size_t len);
+fsal_status_t nullfs_copy2(struct fsal_obj_handle *src_hdl,
+			  struct state_t *src_state,
+			  uint64_t src_offset,
+			  struct fsal_obj_handle *dst_hdl,
+			  struct state_t *dst_state,
+			  uint64_t dst_offset,
+			  uint64_t count,
+			  uint64_t *copied);
+fsal_status_t nullfs_clone2(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count);
 fsal_status_t nullfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 			      struct state_t *state,
 			      void *p_owner,
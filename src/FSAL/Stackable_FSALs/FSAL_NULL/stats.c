@@ -0,0 +1,142 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * -------------
+ */
+
+/* stats.c
+ * Counts and latencies of the calls to the sub-FSAL
+ *
+ * Stacked under MDCACHE and over the FSAL of an export, NULL shows
+ * how much of an operation's time is spent below the cache.
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <time.h>
+#include "abstract_atomic.h"
+#include "gsh_lat_hist.h"
+#include "nfs_metrics.h"
+#include "nullfs_methods.h"
+
+struct nullfs_op_stats {
+	uint64_t calls;
+	uint64_t errors;
+	uint64_t total_ns;
+	struct lat_hist latency;
+};
+
+static const char * const nullfs_op_names[NULLFS_OP_COUNT] = {
+#define NULLFS_OP_NAME(name) #name,
+	NULLFS_OPS(NULLFS_OP_NAME)
+#undef NULLFS_OP_NAME
+};
+
+static struct nullfs_op_stats nullfs_stats[NULLFS_OP_COUNT];
+
+/**
+ * @brief Time a call to the sub-FSAL starts at
+ *
+ * @return Monotonic time in ns.
+ */
+nsecs_elapsed_t nullfs_op_start(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return timespec_to_nsecs(&ts);
+}
+
+/**
+ * @brief Account a call to the sub-FSAL
+ *
+ * @param[in] op    The method called
+ * @param[in] start What nullfs_op_start() returned before the call
+ * @param[in] major Its result, ERR_FSAL_NO_ERROR for methods without
+ */
+void nullfs_op_done(enum nullfs_op op, nsecs_elapsed_t start,
+		    fsal_errors_t major)
+{
+	struct nullfs_op_stats *st = &nullfs_stats[op];
+	nsecs_elapsed_t elapsed = nullfs_op_start() - start;
+
+	(void) atomic_inc_uint64_t(&st->calls);
+	if (major != ERR_FSAL_NO_ERROR)
+		(void) atomic_inc_uint64_t(&st->errors);
+	(void) atomic_add_uint64_t(&st->total_ns, elapsed);
+	lat_hist_record(&st->latency, elapsed);
+}
+
+/**
+ * @brief Write the sub-FSAL call families for a scrape
+ *
+ * @param[in] out Reply stream
+ */
+static void nullfs_metrics(FILE *out)
+{
+	char labels[64];
+	int i;
+
+	fprintf(out, "# TYPE ganesha_fsal_null_calls counter\n"
+		"# HELP ganesha_fsal_null_calls Calls to the sub-FSAL, by "
+		"method\n");
+	for (i = 0; i < NULLFS_OP_COUNT; i++) {
+		if (nullfs_stats[i].calls == 0)
+			continue;
+		fprintf(out, "ganesha_fsal_null_calls_total{op=\"%s\"} %"
+			PRIu64 "\n", nullfs_op_names[i],
+			atomic_fetch_uint64_t(&nullfs_stats[i].calls));
+	}
+
+	fprintf(out, "# TYPE ganesha_fsal_null_errors counter\n"
+		"# HELP ganesha_fsal_null_errors Calls to the sub-FSAL that "
+		"failed, by method\n");
+	for (i = 0; i < NULLFS_OP_COUNT; i++) {
+		if (nullfs_stats[i].calls == 0)
+			continue;
+		fprintf(out, "ganesha_fsal_null_errors_total{op=\"%s\"} %"
+			PRIu64 "\n", nullfs_op_names[i],
+			atomic_fetch_uint64_t(&nullfs_stats[i].errors));
+	}
+
+	fprintf(out, "# TYPE ganesha_fsal_null_latency_seconds histogram\n"
+		"# HELP ganesha_fsal_null_latency_seconds Time taken by the "
+		"sub-FSAL, by method\n");
+	for (i = 0; i < NULLFS_OP_COUNT; i++) {
+		if (nullfs_stats[i].calls == 0)
+			continue;
+		(void) snprintf(labels, sizeof(labels), "op=\"%s\"",
+				nullfs_op_names[i]);
+		metrics_lat_hist(out, "ganesha_fsal_null_latency_seconds",
+				 labels, &nullfs_stats[i].latency,
+				 atomic_fetch_uint64_t(&nullfs_stats[i].total_ns)
+				 / 1e9);
+	}
+}
+
+int nullfs_stats_init(void)
+{
+	return metrics_register(nullfs_metrics);
+}
+
+void nullfs_stats_fini(void)
+{
+	metrics_unregister(nullfs_metrics);
+}
@@ -61,10 +61,12 @@ fsal_status_t nullfs_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = handle->sub_handle->obj_ops.list_ext_attrs(
 		handle->sub_handle, argcookie,
 		xattrs_tab, xattrs_tabsize,
 		p_nb_returned, end_of_list);
+	nullfs_op_done(NULLFS_OP_list_ext_attrs, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -84,9 +86,11 @@ fsal_status_t nullfs_getextattr_id_by_name(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.getextattr_id_by_name(
 				handle->sub_handle, xattr_name, pxattr_id);
+	nullfs_op_done(NULLFS_OP_getextattr_id_by_name, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -108,12 +112,15 @@ fsal_status_t nullfs_getextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 	handle->sub_handle->obj_ops.getextattr_value_by_id(
 				handle->sub_handle,
 				xattr_id, buffer_addr,
 				buffer_size,
 				p_output_size);
+	nullfs_op_done(NULLFS_OP_getextattr_value_by_id, op_start,
+		       status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -135,6 +142,7 @@ fsal_status_t nullfs_getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.getextattr_value_by_name(
 				handle->sub_handle,
@@ -142,6 +150,8 @@ fsal_status_t nullfs_getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
 				buffer_addr,
 				buffer_size,
 				p_output_size);
+	nullfs_op_done(NULLFS_OP_getextattr_value_by_name, op_start,
+		       status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -162,10 +172,12 @@ fsal_status_t nullfs_setextattr_value(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = handle->sub_handle->obj_ops.setextattr_value(
 		handle->sub_handle, xattr_name,
 		buffer_addr, buffer_size,
 		create);
+	nullfs_op_done(NULLFS_OP_setextattr_value, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -186,11 +198,14 @@ fsal_status_t nullfs_setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.setextattr_value_by_id(
 				handle->sub_handle,
 				xattr_id, buffer_addr,
 				buffer_size);
+	nullfs_op_done(NULLFS_OP_setextattr_value_by_id, op_start,
+		       status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -209,8 +224,10 @@ fsal_status_t nullfs_remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status = handle->sub_handle->obj_ops.remove_extattr_by_id(
 		handle->sub_handle, xattr_id);
+	nullfs_op_done(NULLFS_OP_remove_extattr_by_id, op_start, status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -229,9 +246,12 @@ fsal_status_t nullfs_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
 
 	/* calling subfsal method */
 	op_ctx->fsal_export = export->export.sub_export;
+	nsecs_elapsed_t op_start = nullfs_op_start();
 	fsal_status_t status =
 		handle->sub_handle->obj_ops.remove_extattr_by_name(
 				handle->sub_handle, xattr_name);
+	nullfs_op_done(NULLFS_OP_remove_extattr_by_name, op_start,
+		       status.major);
 	op_ctx->fsal_export = &export->export;
 
 	return status;
@@ -0,0 +1,583 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* pages.c
+ * Data page cache of the PCACHE module
+ *
+ * File data is cached in pages of Page_Size bytes, keyed by the sub-FSAL
+ * handle key and the page index.  The pages of a file are only trusted
+ * for the change attribute they were read with: any getattrs through
+ * this layer that returns another change attribute, any write or
+ * truncate through it and any invalidation upcall from the sub-FSAL
+ * drop them.
+ *
+ * All pages share one lock, held for reading by cache hits, and one
+ * CLOCK list bounding them to Cache_Size bytes.
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <pthread.h>
+#include <string.h>
+#include "gsh_list.h"
+#include "avltree.h"
+#include "city.h"
+#include "abstract_atomic.h"
+#include "FSAL/fsal_commonlib.h"
+#include "pcache_methods.h"
+
+/** Buckets of the table of files by key */
+#define PCACHE_FILE_BUCKETS 1024
+
+struct pcache_page {
+	struct avltree_node node;	/*< In the file's page tree */
+	struct glist_head clock;	/*< On the CLOCK list */
+	struct pcache_file *file;	/*< File the page belongs to */
+	uint64_t index;			/*< Offset / Page_Size */
+	uint32_t len;			/*< Bytes of data */
+	uint32_t referenced;		/*< Hit since the hand last passed */
+	bool eof;			/*< The file ends with this page */
+	char data[];
+};
+
+struct pcache_file {
+	struct glist_head link;		/*< In its bucket */
+	struct fsal_module *sub_fsal;	/*< FSAL the key belongs to */
+	int32_t refcnt;			/*< Handles using the file */
+	uint64_t change;		/*< Change attribute of the pages */
+	uint64_t gen;			/*< Bumped when the pages are dropped */
+	struct avltree pages;		/*< Pages by index */
+	size_t keylen;
+	char key[];
+};
+
+struct pcache_params pcache_param;
+
+static pthread_rwlock_t pcache_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct glist_head pcache_files[PCACHE_FILE_BUCKETS];
+static struct glist_head pcache_clock;
+static uint64_t pcache_bytes;
+
+static int pcache_page_cmpf(const struct avltree_node *lhs,
+			    const struct avltree_node *rhs)
+{
+	struct pcache_page *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct pcache_page, node);
+	rk = avltree_container_of(rhs, struct pcache_page, node);
+
+	if (lk->index < rk->index)
+		return -1;
+
+	return lk->index > rk->index;
+}
+
+static inline size_t pcache_page_bytes(void)
+{
+	return sizeof(struct pcache_page) + pcache_param.page_size;
+}
+
+static struct pcache_page *pcache_page_lookup(struct pcache_file *file,
+					      uint64_t index)
+{
+	struct pcache_page key;
+	struct avltree_node *node;
+
+	key.index = index;
+	node = avltree_lookup(&key.node, &file->pages);
+
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, struct pcache_page, node);
+}
+
+/**
+ * @brief Free a page
+ *
+ * @note pcache_lock MUST be held for write
+ */
+static void pcache_page_free(struct pcache_page *page)
+{
+	avltree_remove(&page->node, &page->file->pages);
+	glist_del(&page->clock);
+	gsh_free(page);
+	pcache_bytes -= pcache_page_bytes();
+}
+
+/**
+ * @brief Drop all the pages of a file
+ *
+ * @note pcache_lock MUST be held for write
+ */
+static void pcache_file_drop(struct pcache_file *file)
+{
+	struct avltree_node *node;
+
+	while ((node = avltree_first(&file->pages)) != NULL)
+		pcache_page_free(avltree_container_of(node, struct pcache_page,
+						      node));
+
+	file->gen++;
+}
+
+/**
+ * @brief Free pages until the cache fits in Cache_Size
+ *
+ * @note pcache_lock MUST be held for write
+ */
+static void pcache_evict(void)
+{
+	struct pcache_page *page;
+
+	while (pcache_bytes > pcache_param.cache_size) {
+		page = glist_first_entry(&pcache_clock, struct pcache_page,
+					 clock);
+		if (page == NULL)
+			break;
+
+		if (atomic_fetch_uint32_t(&page->referenced)) {
+			/* Second chance */
+			atomic_store_uint32_t(&page->referenced, 0);
+			glist_del(&page->clock);
+			glist_add_tail(&pcache_clock, &page->clock);
+			continue;
+		}
+
+		pcache_page_free(page);
+	}
+}
+
+static struct glist_head *pcache_bucket(struct fsal_module *sub_fsal,
+					struct gsh_buffdesc *key)
+{
+	uint64_t hash = CityHash64(key->addr, key->len) ^
+			(uint64_t)(uintptr_t)sub_fsal;
+
+	return &pcache_files[hash % PCACHE_FILE_BUCKETS];
+}
+
+/**
+ * @brief Find a file by key
+ *
+ * @note pcache_lock MUST be held
+ */
+static struct pcache_file *pcache_file_lookup(struct glist_head *bucket,
+					      struct fsal_module *sub_fsal,
+					      struct gsh_buffdesc *key)
+{
+	struct pcache_file *file;
+	struct glist_head *glist;
+
+	glist_for_each(glist, bucket) {
+		file = glist_entry(glist, struct pcache_file, link);
+		if (file->sub_fsal == sub_fsal && file->keylen == key->len &&
+		    memcmp(file->key, key->addr, key->len) == 0)
+			return file;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Get the cache of a file, for a new handle
+ *
+ * @param[in] sub_fsal	FSAL of the sub handle
+ * @param[in] key	Handle key of the sub handle
+ *
+ * @return The file, referenced.
+ */
+struct pcache_file *pcache_file_get(struct fsal_module *sub_fsal,
+				    struct gsh_buffdesc *key)
+{
+	struct glist_head *bucket = pcache_bucket(sub_fsal, key);
+	struct pcache_file *file;
+
+	PTHREAD_RWLOCK_wrlock(&pcache_lock);
+
+	file = pcache_file_lookup(bucket, sub_fsal, key);
+	if (file == NULL) {
+		file = gsh_calloc(1, sizeof(*file) + key->len);
+		file->sub_fsal = sub_fsal;
+		file->keylen = key->len;
+		memcpy(file->key, key->addr, key->len);
+		avltree_init(&file->pages, pcache_page_cmpf, 0);
+		glist_add(bucket, &file->link);
+	}
+	file->refcnt++;
+
+	PTHREAD_RWLOCK_unlock(&pcache_lock);
+
+	return file;
+}
+
+/**
+ * @brief Release the cache of a file, for a released handle
+ *
+ * The pages go with the last handle.
+ *
+ * @param[in] file	The file
+ */
+void pcache_file_put(struct pcache_file *file)
+{
+	PTHREAD_RWLOCK_wrlock(&pcache_lock);
+
+	if (--file->refcnt == 0) {
+		pcache_file_drop(file);
+		glist_del(&file->link);
+		gsh_free(file);
+	}
+
+	PTHREAD_RWLOCK_unlock(&pcache_lock);
+}
+
+/**
+ * @brief Drop the pages of a file whose data changed
+ *
+ * The change attribute is forgotten too, the next read learns it
+ * again.
+ *
+ * @param[in] file	The file
+ */
+void pcache_file_invalidate(struct pcache_file *file)
+{
+	PTHREAD_RWLOCK_wrlock(&pcache_lock);
+	pcache_file_drop(file);
+	file->change = 0;
+	PTHREAD_RWLOCK_unlock(&pcache_lock);
+}
+
+/**
+ * @brief Note the change attribute of a file
+ *
+ * Pages read with another change attribute are dropped.
+ *
+ * @param[in] file	The file
+ * @param[in] change	Its current change attribute
+ */
+void pcache_file_change(struct pcache_file *file, uint64_t change)
+{
+	PTHREAD_RWLOCK_rdlock(&pcache_lock);
+	if (file->change == change) {
+		PTHREAD_RWLOCK_unlock(&pcache_lock);
+		return;
+	}
+	PTHREAD_RWLOCK_unlock(&pcache_lock);
+
+	PTHREAD_RWLOCK_wrlock(&pcache_lock);
+	if (file->change != change) {
+		pcache_file_drop(file);
+		file->change = change;
+	}
+	PTHREAD_RWLOCK_unlock(&pcache_lock);
+}
+
+/**
+ * @brief Drop the pages of a file by key, for upcalls
+ *
+ * @param[in] sub_fsal	FSAL the key belongs to
+ * @param[in] key	Handle key
+ */
+void pcache_key_invalidate(struct fsal_module *sub_fsal,
+			   struct gsh_buffdesc *key)
+{
+	struct glist_head *bucket = pcache_bucket(sub_fsal, key);
+	struct pcache_file *file;
+
+	PTHREAD_RWLOCK_wrlock(&pcache_lock);
+
+	file = pcache_file_lookup(bucket, sub_fsal, key);
+	if (file != NULL) {
+		pcache_file_drop(file);
+		file->change = 0;
+	}
+
+	PTHREAD_RWLOCK_unlock(&pcache_lock);
+}
+
+/**
+ * @brief Copy a range out of the cached pages
+ *
+ * @note pcache_lock MUST be held
+ *
+ * @return true if the whole range, or all of it up to end of file,
+ *         was cached.
+ */
+static bool pcache_copy_out(struct pcache_file *file, uint64_t offset,
+			    struct iovec *iov, int iovcnt,
+			    size_t *read_amount, bool *eof)
+{
+	uint32_t psize = pcache_param.page_size;
+	struct pcache_page *page;
+	uint64_t pos = offset;
+	size_t want = 0, n, in, done;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		want += iov[i].iov_len;
+
+	if (file->change == 0)
+		return false;
+
+	/* Check first, so a miss costs no copy */
+	while (pos < offset + want) {
+		page = pcache_page_lookup(file, pos / psize);
+		if (page == NULL)
+			return false;
+		if (page->eof)
+			break;
+		pos = (page->index + 1) * psize;
+	}
+
+	pos = offset;
+	*eof = false;
+	for (i = 0, in = 0; i < iovcnt && pos < offset + want; ) {
+		page = pcache_page_lookup(file, pos / psize);
+		done = pos - page->index * psize;
+
+		if (done >= page->len) {
+			/* Past end of file */
+			*eof = true;
+			break;
+		}
+
+		n = page->len - done;
+		if (n > iov[i].iov_len - in)
+			n = iov[i].iov_len - in;
+
+		memcpy((char *)iov[i].iov_base + in, page->data + done, n);
+		atomic_store_uint32_t(&page->referenced, 1);
+
+		pos += n;
+		in += n;
+		if (in == iov[i].iov_len) {
+			i++;
+			in = 0;
+		}
+
+		if (page->eof && done + n == page->len) {
+			*eof = true;
+			break;
+		}
+	}
+
+	*read_amount = pos - offset;
+	return true;
+}
+
+/**
+ * @brief Cache the pages of a range just read
+ *
+ * Only full pages, and the last page at end of file, are kept.
+ *
+ * @note pcache_lock MUST be held for write
+ */
+static void pcache_insert(struct pcache_file *file, uint64_t first,
+			  struct pcache_page **pages, int npages,
+			  size_t amount, bool eof)
+{
+	uint32_t psize = pcache_param.page_size;
+	struct pcache_page *page, *old;
+	int i;
+
+	for (i = 0; i < npages; i++) {
+		page = pages[i];
+		page->file = file;
+		page->index = first + i;
+
+		if (amount >= (size_t)(i + 1) * psize) {
+			page->len = psize;
+			page->eof = eof && amount == (size_t)(i + 1) * psize;
+		} else if (eof && amount >= (size_t)i * psize &&
+			   (amount > (size_t)i * psize || i == 0)) {
+			page->len = amount - i * psize;
+			page->eof = true;
+		} else {
+			gsh_free(page);
+			pages[i] = NULL;
+			continue;
+		}
+
+		old = pcache_page_lookup(file, page->index);
+		if (old != NULL)
+			pcache_page_free(old);
+
+		avltree_insert(&page->node, &file->pages);
+		glist_add_tail(&pcache_clock, &page->clock);
+		pcache_bytes += pcache_page_bytes();
+		pages[i] = NULL;
+
+		if (page->eof) {
+			/* Nothing can be cached past end of file */
+			for (i++; i < npages; i++) {
+				gsh_free(pages[i]);
+				pages[i] = NULL;
+			}
+			break;
+		}
+	}
+
+	pcache_evict();
+}
+
+/**
+ * @brief Read through the page cache
+ *
+ * A miss reads all the pages covering the range from the sub-FSAL,
+ * with the caller's state, so the sub-FSAL still checks access.
+ *
+ * @param[in]  handle	 File to read
+ * @param[in]  bypass	 Bypass any non-mandatory deny read
+ * @param[in]  state	 Open file state to read with
+ * @param[in]  offset	 Offset of the read
+ * @param[in]  iov	 Buffers to read into
+ * @param[in]  iovcnt	 Number of buffers in iov
+ * @param[out] read_amount Bytes read
+ * @param[out] eof	 true if the read ended at end of file
+ *
+ * @return FSAL status
+ */
+fsal_status_t pcache_cached_read(struct pcache_fsal_obj_handle *handle,
+				 bool bypass,
+				 struct state_t *state,
+				 uint64_t offset,
+				 struct iovec *iov,
+				 int iovcnt,
+				 size_t *read_amount,
+				 bool *eof)
+{
+	struct pcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct pcache_fsal_export,
+			     export);
+	struct pcache_file *file = handle->file;
+	uint32_t psize = pcache_param.page_size;
+	struct pcache_page **pages;
+	struct iovec *piov;
+	struct iovec src;
+	struct attrlist attrs;
+	fsal_status_t status;
+	uint64_t first, gen;
+	size_t want = 0, amount = 0, skip, n, in;
+	bool sub_eof = false;
+	int i, npages;
+
+	for (i = 0; i < iovcnt; i++)
+		want += iov[i].iov_len;
+
+	if (file == NULL || want == 0 || pcache_param.cache_size == 0) {
+		op_ctx->fsal_export = export->export.sub_export;
+		status = handle->sub_handle->obj_ops.readv2(
+				handle->sub_handle, bypass, state, offset,
+				iov, iovcnt, read_amount, eof);
+		op_ctx->fsal_export = &export->export;
+		return status;
+	}
+
+	PTHREAD_RWLOCK_rdlock(&pcache_lock);
+	if (pcache_copy_out(file, offset, iov, iovcnt, read_amount, eof)) {
+		PTHREAD_RWLOCK_unlock(&pcache_lock);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+	gen = file->gen;
+	PTHREAD_RWLOCK_unlock(&pcache_lock);
+
+	op_ctx->fsal_export = export->export.sub_export;
+
+	if (atomic_fetch_uint64_t(&file->change) == 0) {
+		/* Learn what the pages will be valid for */
+		fsal_prepare_attrs(&attrs, ATTR_CHANGE);
+		status = handle->sub_handle->obj_ops.getattrs(
+				handle->sub_handle, &attrs);
+		if (!FSAL_IS_ERROR(status) &&
+		    FSAL_TEST_MASK(attrs.valid_mask, ATTR_CHANGE))
+			pcache_file_change(file, attrs.change);
+		fsal_release_attrs(&attrs);
+		gen = atomic_fetch_uint64_t(&file->gen);
+	}
+
+	first = offset / psize;
+	npages = (offset + want - 1) / psize - first + 1;
+	pages = gsh_malloc(npages * sizeof(*pages));
+	piov = gsh_malloc(npages * sizeof(*piov));
+	for (i = 0; i < npages; i++) {
+		pages[i] = gsh_malloc(pcache_page_bytes());
+		pages[i]->referenced = 0;
+		piov[i].iov_base = pages[i]->data;
+		piov[i].iov_len = psize;
+	}
+
+	status = handle->sub_handle->obj_ops.readv2(
+			handle->sub_handle, bypass, state, first * psize,
+			piov, npages, &amount, &sub_eof);
+
+	op_ctx->fsal_export = &export->export;
+
+	if (!FSAL_IS_ERROR(status)) {
+		/* Hand the caller its part */
+		skip = offset - first * psize;
+		*read_amount = amount > skip ? amount - skip : 0;
+		if (*read_amount > want)
+			*read_amount = want;
+		*eof = sub_eof && skip + *read_amount >= amount;
+
+		for (i = 0, in = 0, n = 0; n < *read_amount; i++) {
+			src.iov_len = iov[i].iov_len;
+			if (src.iov_len > *read_amount - n)
+				src.iov_len = *read_amount - n;
+			for (in = 0; in < src.iov_len; ) {
+				uint64_t pos = skip + n + in;
+				size_t len = psize - pos % psize;
+
+				if (len > src.iov_len - in)
+					len = src.iov_len - in;
+				memcpy((char *)iov[i].iov_base + in,
+				       pages[pos / psize]->data + pos % psize,
+				       len);
+				in += len;
+			}
+			n += src.iov_len;
+		}
+
+		PTHREAD_RWLOCK_wrlock(&pcache_lock);
+		if (file->gen == gen && file->change != 0)
+			pcache_insert(file, first, pages, npages, amount,
+				      sub_eof);
+		PTHREAD_RWLOCK_unlock(&pcache_lock);
+	}
+
+	for (i = 0; i < npages; i++)
+		gsh_free(pages[i]);
+	gsh_free(pages);
+	gsh_free(piov);
+
+	return status;
+}
+
+/**
+ * @brief Set up the page cache, at module load
+ */
+void pcache_pages_init(void)
+{
+	int i;
+
+	for (i = 0; i < PCACHE_FILE_BUCKETS; i++)
+		glist_init(&pcache_files[i]);
+	glist_init(&pcache_clock);
+}
@@ -0,0 +1,543 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* writeback.c
+ * Write-back of unstable writes of the PCACHE module
+ *
+ * With Journal_Path set, an unstable write is copied to a local log
+ * file and answered at once, still unstable; a flusher thread writes
+ * it to the sub-FSAL afterwards.  A COMMIT, a close, a read, a
+ * truncate or a stable write of the file first writes out what the log
+ * holds for it, so the sub-FSAL sees the writes in order and COMMIT
+ * only succeeds once they reached it.
+ *
+ * The log needs no replay: unstable data is only promised after a
+ * COMMIT, and a restart changes the write verifier, so clients send
+ * again whatever was not committed.  The log is reused from its start
+ * whenever everything in it has been flushed; a write that does not
+ * fit goes straight to the sub-FSAL.
+ *
+ * Lock order is the file's mtx, then pcache_wb_mtx.
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include "gsh_list.h"
+#include "fsal_convert.h"
+#include "export_mgr.h"
+#include "pcache_methods.h"
+
+/** Seconds the flusher waits before retrying after a failure */
+#define PCACHE_WB_RETRY 1
+
+struct pcache_wb_extent {
+	struct glist_head link;		/*< In the file's extents */
+	uint64_t offset;		/*< In the file */
+	uint64_t log_off;		/*< In the log */
+	size_t len;
+};
+
+struct pcache_wb {
+	pthread_mutex_t mtx;		/*< Protects the fields below */
+	struct glist_head extents;	/*< Not yet flushed, oldest first */
+	uint64_t end;			/*< End of the furthest extent */
+	fsal_status_t error;		/*< Of the last failed flush */
+	struct gsh_export *export;	/*< Referenced while there are
+					    extents */
+	struct pcache_fsal_export *fsal_export;
+	struct pcache_fsal_obj_handle *handle;
+	/* Protected by pcache_wb_mtx */
+	struct glist_head dirty;	/*< On pcache_wb_dirty */
+	bool busy;			/*< Being flushed by the flusher */
+};
+
+static pthread_mutex_t pcache_wb_mtx = PTHREAD_MUTEX_INITIALIZER;
+/** Wakes the flusher */
+static pthread_cond_t pcache_wb_cond = PTHREAD_COND_INITIALIZER;
+/** Signalled when the flusher is done with a file */
+static pthread_cond_t pcache_wb_idle = PTHREAD_COND_INITIALIZER;
+static struct glist_head pcache_wb_dirty =
+	GLIST_HEAD_INIT(pcache_wb_dirty);
+static uint64_t pcache_wb_used;		/*< Log bytes handed out */
+static uint64_t pcache_wb_live;		/*< Of which not yet flushed */
+static int pcache_wb_fd = -1;
+static bool pcache_wb_stop;
+static pthread_t pcache_wb_thread;
+
+/**
+ * @brief Give back the log space of flushed bytes
+ */
+static void pcache_wb_unuse(size_t len)
+{
+	PTHREAD_MUTEX_lock(&pcache_wb_mtx);
+	pcache_wb_live -= len;
+	if (pcache_wb_live == 0)
+		pcache_wb_used = 0;
+	PTHREAD_MUTEX_unlock(&pcache_wb_mtx);
+}
+
+static void pcache_wb_drop(struct pcache_wb *wb,
+			   struct pcache_wb_extent *ext)
+{
+	glist_del(&ext->link);
+	pcache_wb_unuse(ext->len);
+	gsh_free(ext);
+}
+
+/**
+ * @brief Write an extent from the log to the sub-FSAL
+ */
+static fsal_status_t pcache_wb_write_out(struct pcache_wb *wb,
+					 struct pcache_wb_extent *ext)
+{
+	struct pcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct pcache_fsal_export,
+			     export);
+	struct fsal_obj_handle *sub_handle = wb->handle->sub_handle;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	char *buf = gsh_malloc(ext->len);
+	size_t done = 0, written;
+	bool stable;
+	ssize_t n;
+
+	while (done < ext->len) {
+		n = pread(pcache_wb_fd, buf + done, ext->len - done,
+			  ext->log_off + done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			status = posix2fsal_status(n < 0 ? errno : EIO);
+			goto out;
+		}
+		done += n;
+	}
+
+	/* Without the state of the write, which may be gone: the access
+	 * was checked when the write came in.
+	 */
+	for (done = 0; done < ext->len; done += written) {
+		written = 0;
+		stable = false;
+		op_ctx->fsal_export = export->export.sub_export;
+		status = sub_handle->obj_ops.write2(sub_handle, true, NULL,
+						    ext->offset + done,
+						    ext->len - done,
+						    buf + done, &written,
+						    &stable, NULL);
+		op_ctx->fsal_export = &export->export;
+		if (FSAL_IS_ERROR(status))
+			break;
+		if (written == 0) {
+			status = fsalstat(ERR_FSAL_IO, 0);
+			break;
+		}
+	}
+
+ out:
+	gsh_free(buf);
+	return status;
+}
+
+/**
+ * @brief Write out the extents of a file
+ *
+ * @note wb->mtx MUST be held, and op_ctx be on the PCACHE export
+ *
+ * @return The status of the first write that failed, whose extent and
+ *         the ones after it are kept.
+ */
+static fsal_status_t pcache_wb_flush_locked(struct pcache_wb *wb)
+{
+	struct glist_head *glist, *glistn;
+	struct pcache_wb_extent *ext;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	glist_for_each_safe(glist, glistn, &wb->extents) {
+		ext = glist_entry(glist, struct pcache_wb_extent, link);
+		status = pcache_wb_write_out(wb, ext);
+		if (FSAL_IS_ERROR(status)) {
+			LogInfo(COMPONENT_FSAL,
+				"Write-back of %zu bytes at %" PRIu64
+				" failed with %s", ext->len, ext->offset,
+				fsal_err_txt(status));
+			wb->error = status;
+			return status;
+		}
+		pcache_wb_drop(wb, ext);
+	}
+
+	wb->end = 0;
+	if (wb->export != NULL) {
+		put_gsh_export(wb->export);
+		wb->export = NULL;
+	}
+
+	return status;
+}
+
+/**
+ * @brief Flush a file on behalf of the flusher thread
+ *
+ * @return true if extents are left after a failure.
+ */
+static bool pcache_wb_background(struct pcache_wb *wb)
+{
+	struct root_op_context root_op_context;
+	struct gsh_export *export;
+	bool left;
+
+	PTHREAD_MUTEX_lock(&wb->mtx);
+	export = wb->export;
+	if (export == NULL) {
+		PTHREAD_MUTEX_unlock(&wb->mtx);
+		return false;
+	}
+
+	/* The flush puts the file's reference once it is clean */
+	get_gsh_export_ref(export);
+	init_root_op_context(&root_op_context, export, export->fsal_export,
+			     0, 0, UNKNOWN_REQUEST);
+	op_ctx->fsal_export = &wb->fsal_export->export;
+
+	(void) pcache_wb_flush_locked(wb);
+	left = !glist_empty(&wb->extents);
+
+	release_root_op_context();
+	put_gsh_export(export);
+	PTHREAD_MUTEX_unlock(&wb->mtx);
+
+	return left;
+}
+
+static void *pcache_wb_flusher(void *arg)
+{
+	struct pcache_wb *wb;
+	struct timespec ts;
+	bool retry = false;
+
+	SetNameFunction("pcache_wb");
+
+	PTHREAD_MUTEX_lock(&pcache_wb_mtx);
+	while (!pcache_wb_stop) {
+		if (retry) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += PCACHE_WB_RETRY;
+			(void) pthread_cond_timedwait(&pcache_wb_cond,
+						      &pcache_wb_mtx, &ts);
+			retry = false;
+			continue;
+		}
+		if (glist_empty(&pcache_wb_dirty)) {
+			pthread_cond_wait(&pcache_wb_cond, &pcache_wb_mtx);
+			continue;
+		}
+
+		wb = glist_first_entry(&pcache_wb_dirty, struct pcache_wb,
+				       dirty);
+		glist_del(&wb->dirty);
+		wb->busy = true;
+		PTHREAD_MUTEX_unlock(&pcache_wb_mtx);
+
+		retry = pcache_wb_background(wb);
+
+		PTHREAD_MUTEX_lock(&pcache_wb_mtx);
+		if (retry && glist_null(&wb->dirty))
+			glist_add_tail(&pcache_wb_dirty, &wb->dirty);
+		wb->busy = false;
+		pthread_cond_broadcast(&pcache_wb_idle);
+	}
+	PTHREAD_MUTEX_unlock(&pcache_wb_mtx);
+
+	return NULL;
+}
+
+/**
+ * @brief Open the log and start the flusher, if Journal_Path is set
+ */
+void pcache_wb_init(void)
+{
+	int rc;
+
+	if (pcache_param.journal_path == NULL ||
+	    pcache_param.journal_size == 0 || pcache_wb_fd >= 0)
+		return;
+
+	/* Nothing in an old log was committed, see above */
+	pcache_wb_fd = open(pcache_param.journal_path,
+			    O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (pcache_wb_fd < 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Could not open PCACHE journal %s: %s, unstable writes will not be written back",
+			pcache_param.journal_path, strerror(errno));
+		return;
+	}
+
+	rc = pthread_create(&pcache_wb_thread, NULL, pcache_wb_flusher, NULL);
+	if (rc != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Could not start PCACHE flusher: %s", strerror(rc));
+		close(pcache_wb_fd);
+		pcache_wb_fd = -1;
+		return;
+	}
+
+	LogInfo(COMPONENT_FSAL,
+		"PCACHE writes back unstable writes through %s, up to %"
+		PRIu64 " bytes", pcache_param.journal_path,
+		pcache_param.journal_size);
+}
+
+/**
+ * @brief Stop the flusher, what is not flushed was not committed
+ */
+void pcache_wb_shutdown(void)
+{
+	if (pcache_wb_fd < 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&pcache_wb_mtx);
+	pcache_wb_stop = true;
+	pthread_cond_signal(&pcache_wb_cond);
+	PTHREAD_MUTEX_unlock(&pcache_wb_mtx);
+
+	pthread_join(pcache_wb_thread, NULL);
+	close(pcache_wb_fd);
+	pcache_wb_fd = -1;
+}
+
+/**
+ * @brief Set up write-back for a new file handle
+ *
+ * @param[in] handle The handle
+ */
+void pcache_wb_alloc(struct pcache_fsal_obj_handle *handle)
+{
+	struct pcache_wb *wb;
+
+	if (pcache_wb_fd < 0)
+		return;
+
+	wb = gsh_calloc(1, sizeof(*wb));
+	PTHREAD_MUTEX_init(&wb->mtx, NULL);
+	glist_init(&wb->extents);
+	wb->handle = handle;
+	handle->wb = wb;
+}
+
+/**
+ * @brief Write out and free what a handle being released holds
+ *
+ * @note op_ctx MUST be on the PCACHE export
+ *
+ * @param[in] handle The handle
+ */
+void pcache_wb_release(struct pcache_fsal_obj_handle *handle)
+{
+	struct pcache_wb *wb = handle->wb;
+	struct glist_head *glist, *glistn;
+	fsal_status_t status;
+
+	if (wb == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&pcache_wb_mtx);
+	while (wb->busy)
+		pthread_cond_wait(&pcache_wb_idle, &pcache_wb_mtx);
+	if (!glist_null(&wb->dirty))
+		glist_del(&wb->dirty);
+	PTHREAD_MUTEX_unlock(&pcache_wb_mtx);
+
+	PTHREAD_MUTEX_lock(&wb->mtx);
+	status = pcache_wb_flush_locked(wb);
+	if (FSAL_IS_ERROR(status))
+		LogCrit(COMPONENT_FSAL,
+			"Uncommitted writes of a released file were lost: %s",
+			fsal_err_txt(status));
+	glist_for_each_safe(glist, glistn, &wb->extents) {
+		pcache_wb_drop(wb, glist_entry(glist, struct pcache_wb_extent,
+					       link));
+	}
+	if (wb->export != NULL)
+		put_gsh_export(wb->export);
+	PTHREAD_MUTEX_unlock(&wb->mtx);
+
+	PTHREAD_MUTEX_destroy(&wb->mtx);
+	gsh_free(wb);
+	handle->wb = NULL;
+}
+
+/**
+ * @brief Take an unstable write into the log
+ *
+ * @param[in] handle The file
+ * @param[in] offset Offset of the write
+ * @param[in] len    Its length
+ * @param[in] buffer Its data
+ *
+ * @return false if the write must go to the sub-FSAL, after
+ *         pcache_wb_flush().
+ */
+bool pcache_wb_write(struct pcache_fsal_obj_handle *handle,
+		     uint64_t offset, size_t len, void *buffer)
+{
+	struct pcache_wb *wb = handle->wb;
+	struct pcache_wb_extent *ext;
+	uint64_t log_off;
+	size_t done = 0;
+	ssize_t n;
+
+	if (wb == NULL || len == 0)
+		return false;
+
+	PTHREAD_MUTEX_lock(&wb->mtx);
+
+	/* Keep whatever failed to be written back for the next COMMIT */
+	if (FSAL_IS_ERROR(wb->error)) {
+		PTHREAD_MUTEX_unlock(&wb->mtx);
+		return false;
+	}
+
+	PTHREAD_MUTEX_lock(&pcache_wb_mtx);
+	if (pcache_wb_used + len > pcache_param.journal_size) {
+		PTHREAD_MUTEX_unlock(&pcache_wb_mtx);
+		PTHREAD_MUTEX_unlock(&wb->mtx);
+		return false;
+	}
+	log_off = pcache_wb_used;
+	pcache_wb_used += len;
+	pcache_wb_live += len;
+	PTHREAD_MUTEX_unlock(&pcache_wb_mtx);
+
+	while (done < len) {
+		n = pwrite(pcache_wb_fd, (char *)buffer + done, len - done,
+			   log_off + done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			LogInfo(COMPONENT_FSAL,
+				"Write to the PCACHE journal failed: %s",
+				n < 0 ? strerror(errno) : "no space");
+			pcache_wb_unuse(len);
+			PTHREAD_MUTEX_unlock(&wb->mtx);
+			return false;
+		}
+		done += n;
+	}
+
+	ext = gsh_malloc(sizeof(*ext));
+	ext->offset = offset;
+	ext->log_off = log_off;
+	ext->len = len;
+	glist_add_tail(&wb->extents, &ext->link);
+	if (offset + len > wb->end)
+		wb->end = offset + len;
+
+	if (wb->export == NULL) {
+		wb->export = op_ctx->ctx_export;
+		get_gsh_export_ref(wb->export);
+		wb->fsal_export = container_of(op_ctx->fsal_export,
+					       struct pcache_fsal_export,
+					       export);
+	}
+
+	PTHREAD_MUTEX_lock(&pcache_wb_mtx);
+	if (glist_null(&wb->dirty)) {
+		glist_add_tail(&pcache_wb_dirty, &wb->dirty);
+		pthread_cond_signal(&pcache_wb_cond);
+	}
+	PTHREAD_MUTEX_unlock(&pcache_wb_mtx);
+
+	PTHREAD_MUTEX_unlock(&wb->mtx);
+
+	return true;
+}
+
+/**
+ * @brief Write out the unstable writes a file has in the log
+ *
+ * A failed write-back is reported once, to this caller, and its writes
+ * are dropped: the client learns from the COMMIT or close that they
+ * did not make it.
+ *
+ * @note op_ctx MUST be on the PCACHE export
+ *
+ * @param[in] handle The file
+ *
+ * @return Status of the write-back.
+ */
+fsal_status_t pcache_wb_flush(struct pcache_fsal_obj_handle *handle)
+{
+	struct pcache_wb *wb = handle->wb;
+	struct glist_head *glist, *glistn;
+	fsal_status_t status;
+
+	if (wb == NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	PTHREAD_MUTEX_lock(&wb->mtx);
+	if (glist_empty(&wb->extents) && !FSAL_IS_ERROR(wb->error)) {
+		PTHREAD_MUTEX_unlock(&wb->mtx);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	status = pcache_wb_flush_locked(wb);
+	if (FSAL_IS_ERROR(wb->error)) {
+		status = wb->error;
+		wb->error = fsalstat(ERR_FSAL_NO_ERROR, 0);
+		glist_for_each_safe(glist, glistn, &wb->extents) {
+			pcache_wb_drop(wb, glist_entry(glist,
+						       struct pcache_wb_extent,
+						       link));
+		}
+		wb->end = 0;
+		if (wb->export != NULL) {
+			put_gsh_export(wb->export);
+			wb->export = NULL;
+		}
+	}
+	PTHREAD_MUTEX_unlock(&wb->mtx);
+
+	return status;
+}
+
+/**
+ * @brief Account the log in the size of a file
+ *
+ * @param[in]     handle The file
+ * @param[in,out] attrs  Attributes from the sub-FSAL
+ */
+void pcache_wb_attrs(struct pcache_fsal_obj_handle *handle,
+		     struct attrlist *attrs)
+{
+	struct pcache_wb *wb = handle->wb;
+
+	if (wb == NULL || !FSAL_TEST_MASK(attrs->valid_mask, ATTR_SIZE))
+		return;
+
+	PTHREAD_MUTEX_lock(&wb->mtx);
+	if (wb->end > attrs->filesize)
+		attrs->filesize = wb->end;
+	PTHREAD_MUTEX_unlock(&wb->mtx);
+}
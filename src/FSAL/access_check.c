@@ -431,11 +431,11 @@ static void fsal_print_access_by_acl(int naces, int ace_number,
  * @return ERR_FSAL_NO_ERROR, ERR_FSAL_ACCESS, or ERR_FSAL_NO_ACE
  */
 
-static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
-					   fsal_aceperm_t v4mask,
-					   fsal_accessflags_t *allowed,
-					   fsal_accessflags_t *denied,
-					   struct attrlist *p_object_attributes)
+static fsal_status_t fsal_eval_access_acl(struct user_cred *creds,
+					  fsal_aceperm_t v4mask,
+					  fsal_accessflags_t *allowed,
+					  fsal_accessflags_t *denied,
+					  struct attrlist *p_object_attributes)
 {
 	fsal_aceperm_t missing_access;
 	fsal_aceperm_t tperm;
@@ -676,6 +676,141 @@ static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
 	}
 }
 
+/** Results cached per ACL */
+#define FSAL_ACL_ACCESS_SLOTS 8
+/** Most groups of a caller whose results are cached */
+#define FSAL_ACL_ACCESS_GROUPS 16
+
+/**
+ * @brief What the result of fsal_eval_access_acl() depends on
+ *
+ * The ACL itself is not part of the key, as the results are kept on
+ * the ACL.  ACLs are shared and never change, a new ACL on an object
+ * is a new fsal_acl_t, so the results need no invalidation.  The mode
+ * is not looked at when evaluating an ACL.
+ */
+struct fsal_acl_access_key {
+	uint64_t owner;
+	uint64_t group;
+	uid_t uid;
+	gid_t gid;
+	uint32_t glen;
+	gid_t groups[FSAL_ACL_ACCESS_GROUPS];
+	fsal_aceperm_t v4mask;
+	bool is_dir;
+	bool is_root;
+	bool want_allowed;
+	bool want_denied;
+};
+
+struct fsal_acl_access_slot {
+	struct fsal_acl_access_key key;	/*< Compared with memcmp */
+	fsal_errors_t major;
+	fsal_accessflags_t allowed;
+	fsal_accessflags_t denied;
+};
+
+struct fsal_acl_access {
+	uint32_t used;		/*< Slots filled */
+	uint32_t next;		/*< Slot to fill next once all are used */
+	struct fsal_acl_access_slot slots[FSAL_ACL_ACCESS_SLOTS];
+};
+
+/**
+ * @brief Check access using v4 ACL list, remembering the result
+ *
+ * An ACL is shared by the objects that have it, which are checked for
+ * the same few callers again and again, so the last results of
+ * evaluating it are kept with the ACL.
+ *
+ * @param[in] creds
+ * @param[in] v4mask
+ * @param[in] allowed
+ * @param[in] denied
+ * @param[in] p_object_attributes
+ *
+ * @return ERR_FSAL_NO_ERROR, ERR_FSAL_ACCESS, or ERR_FSAL_NO_ACE
+ */
+
+static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
+					   fsal_aceperm_t v4mask,
+					   fsal_accessflags_t *allowed,
+					   fsal_accessflags_t *denied,
+					   struct attrlist *p_object_attributes)
+{
+	fsal_acl_t *pacl = p_object_attributes->acl;
+	struct fsal_acl_access_key key;
+	struct fsal_acl_access *access;
+	struct fsal_acl_access_slot *slot;
+	fsal_accessflags_t tallowed = 0, tdenied = 0;
+	fsal_status_t status;
+	uint32_t i;
+
+	/* Keep the trace of the evaluation when it is asked for */
+	if (pacl == NULL || creds->caller_glen > FSAL_ACL_ACCESS_GROUPS ||
+	    isFullDebug(COMPONENT_NFS_V4_ACL))
+		return fsal_eval_access_acl(creds, v4mask, allowed, denied,
+					    p_object_attributes);
+
+	memset(&key, 0, sizeof(key));
+	key.owner = p_object_attributes->owner;
+	key.group = p_object_attributes->group;
+	key.uid = creds->caller_uid;
+	key.gid = creds->caller_gid;
+	key.glen = creds->caller_glen;
+	memcpy(key.groups, creds->caller_garray,
+	       creds->caller_glen * sizeof(gid_t));
+	key.v4mask = v4mask;
+	key.is_dir = p_object_attributes->type == DIRECTORY;
+	key.is_root = op_ctx->fsal_export->exp_ops.is_superuser(
+						op_ctx->fsal_export, creds);
+	key.want_allowed = allowed != NULL;
+	key.want_denied = denied != NULL;
+
+	PTHREAD_MUTEX_lock(&pacl->access_mtx);
+	access = pacl->access;
+	for (i = 0; access != NULL && i < access->used; i++) {
+		slot = &access->slots[i];
+		if (memcmp(&slot->key, &key, sizeof(key)) != 0)
+			continue;
+		if (allowed != NULL)
+			*allowed = slot->allowed;
+		if (denied != NULL)
+			*denied = slot->denied;
+		status = fsalstat(slot->major, 0);
+		PTHREAD_MUTEX_unlock(&pacl->access_mtx);
+		return status;
+	}
+	PTHREAD_MUTEX_unlock(&pacl->access_mtx);
+
+	status = fsal_eval_access_acl(creds, v4mask,
+				      allowed != NULL ? &tallowed : NULL,
+				      denied != NULL ? &tdenied : NULL,
+				      p_object_attributes);
+	if (allowed != NULL)
+		*allowed = tallowed;
+	if (denied != NULL)
+		*denied = tdenied;
+
+	PTHREAD_MUTEX_lock(&pacl->access_mtx);
+	if (pacl->access == NULL)
+		pacl->access = gsh_calloc(1, sizeof(*pacl->access));
+	access = pacl->access;
+	if (access->used < FSAL_ACL_ACCESS_SLOTS) {
+		slot = &access->slots[access->used++];
+	} else {
+		slot = &access->slots[access->next];
+		access->next = (access->next + 1) % FSAL_ACL_ACCESS_SLOTS;
+	}
+	memcpy(&slot->key, &key, sizeof(key));
+	slot->major = status.major;
+	slot->allowed = tallowed;
+	slot->denied = tdenied;
+	PTHREAD_MUTEX_unlock(&pacl->access_mtx);
+
+	return status;
+}
+
 /**
  * @brief Check access using mode bits only
  *
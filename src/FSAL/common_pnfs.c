@@ -36,7 +36,10 @@
 #include <errno.h>
 #include <string.h>
 #include <pthread.h>
+#include <time.h>
 #include "log.h"
+#include "gsh_list.h"
+#include "abstract_mem.h"
 #include "fsal.h"
 #include "fsal_pnfs.h"
 #include "pnfs_utils.h"
@@ -345,6 +348,369 @@ nfsstat4 FSAL_encode_v4_multipath(XDR *xdrs, const uint32_t num_hosts,
 	return NFS4_OK;
 }
 
+/*
+ * Data server load
+ */
+
+/**
+ * @brief Load seen on the devices layouts were handed out for
+ *
+ * Clients report the I/O they did through a layout with LAYOUTSTATS,
+ * which is charged to the device the layout pointed at.  Each layout
+ * granted is charged up front too, so that a burst of LAYOUTGETs is
+ * spread out before any statistics come back.  The load halves every
+ * DEVLOAD_HALF_LIFE seconds so an idle device soon looks idle.  The
+ * table is small; when full, the least loaded device is forgotten.
+ */
+
+#define DEVLOAD_SLOTS 256
+#define DEVLOAD_HALF_LIFE 30
+/* Cost of one I/O, in bytes, on top of the bytes it moved */
+#define DEVLOAD_IO_COST 4096
+/* Cost charged for a layout granted, before it is used */
+#define DEVLOAD_GRANT_COST (1024 * 1024)
+
+struct devload_entry {
+	struct pnfs_deviceid deviceid;	/*< Device, fsal_id 0 if unused */
+	time_t stamp;		/*< When load was last decayed */
+	uint64_t load;		/*< Decayed bytes-equivalent */
+};
+
+static struct devload_table {
+	pthread_mutex_t mtx;
+	struct devload_entry slots[DEVLOAD_SLOTS];
+} devload_table = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * @brief Bring the load of a device up to now
+ */
+static void devload_decay(struct devload_entry *entry, time_t now)
+{
+	time_t halvings = (now - entry->stamp) / DEVLOAD_HALF_LIFE;
+
+	if (halvings <= 0)
+		return;
+
+	entry->load = halvings >= 64 ? 0 : entry->load >> halvings;
+	entry->stamp += halvings * DEVLOAD_HALF_LIFE;
+}
+
+/**
+ * @brief Find the slot of a device
+ *
+ * @note devload_table.mtx MUST be held
+ *
+ * @param[in] deviceid Device to look up
+ * @param[in] create   Take a slot for it if it has none
+ *
+ * @return The slot, or NULL if none and not creating.
+ */
+static struct devload_entry *devload_find(const struct pnfs_deviceid *deviceid,
+					  bool create, time_t now)
+{
+	struct devload_entry *entry, *victim = NULL;
+	int i;
+
+	for (i = 0; i < DEVLOAD_SLOTS; i++) {
+		entry = &devload_table.slots[i];
+
+		if (entry->deviceid.fsal_id == FSAL_ID_NO_PNFS) {
+			if (victim == NULL || victim->load != 0)
+				victim = entry;
+			continue;
+		}
+
+		if (memcmp(&entry->deviceid, deviceid, sizeof(*deviceid)) == 0)
+			return entry;
+
+		devload_decay(entry, now);
+		if (victim == NULL || entry->load < victim->load)
+			victim = entry;
+	}
+
+	if (!create)
+		return NULL;
+
+	victim->deviceid = *deviceid;
+	victim->stamp = now;
+	victim->load = 0;
+
+	return victim;
+}
+
+/**
+ * @brief Charge I/O reported through a layout to its device
+ *
+ * @param[in] deviceid Device the layout pointed at
+ * @param[in] ios      Number of I/Os done
+ * @param[in] bytes    Bytes they moved
+ */
+void pnfs_device_load_report(const struct pnfs_deviceid *deviceid,
+			     uint64_t ios, uint64_t bytes)
+{
+	time_t now = time(NULL);
+	struct devload_entry *entry;
+
+	if (deviceid->fsal_id == FSAL_ID_NO_PNFS)
+		return;
+
+	PTHREAD_MUTEX_lock(&devload_table.mtx);
+	entry = devload_find(deviceid, true, now);
+	devload_decay(entry, now);
+	entry->load += bytes + ios * DEVLOAD_IO_COST;
+	PTHREAD_MUTEX_unlock(&devload_table.mtx);
+}
+
+/**
+ * @brief Pick the least loaded of the devices able to serve a layout
+ *
+ * Devices equally loaded are chosen starting from the hint, so that
+ * an FSAL passing a hash of the file keeps its usual placement on an
+ * idle cluster.  The device picked is charged for the new layout.
+ *
+ * @param[in] candidates Devices holding the data
+ * @param[in] count      Number of candidates, at least one
+ * @param[in] hint       Where to start among equals
+ *
+ * @return Index of the device picked.
+ */
+unsigned int pnfs_device_pick(const struct pnfs_deviceid *candidates,
+			      unsigned int count, unsigned int hint)
+{
+	time_t now = time(NULL);
+	struct devload_entry *entry;
+	uint64_t load, best_load = UINT64_MAX;
+	unsigned int i, idx, best = hint % count;
+
+	PTHREAD_MUTEX_lock(&devload_table.mtx);
+
+	for (i = 0; i < count; i++) {
+		idx = (hint + i) % count;
+		entry = devload_find(&candidates[idx], false, now);
+		if (entry != NULL) {
+			devload_decay(entry, now);
+			load = entry->load;
+		} else {
+			load = 0;
+		}
+
+		if (load < best_load) {
+			best_load = load;
+			best = idx;
+			if (load == 0)
+				break;
+		}
+	}
+
+	entry = devload_find(&candidates[best], true, now);
+	devload_decay(entry, now);
+	entry->load += DEVLOAD_GRANT_COST;
+
+	PTHREAD_MUTEX_unlock(&devload_table.mtx);
+
+	return best;
+}
+
+/*
+ * Device address cache
+ */
+
+/**
+ * @brief Cache of encoded device addresses
+ *
+ * GETDEVICEINFO asks the FSAL for the same few devices over and over,
+ * mostly right after the layouts were recalled and fetched again.  The
+ * da_addr_body the FSAL encoded is kept, keyed by layout type and
+ * deviceid, until a layout of that FSAL is recalled, since a recall is
+ * how a change in the data servers is seen.  The cache is small and
+ * simply forgets its oldest entries when full.
+ */
+
+#define DEVINFO_CACHE_BUCKETS 64
+#define DEVINFO_CACHE_MAX 1024
+
+struct devinfo_entry {
+	struct glist_head bucket;	/*< Link in the hash bucket */
+	struct glist_head age;	/*< Link in order of insertion */
+	layouttype4 type;	/*< Layout type of the device address */
+	struct pnfs_deviceid deviceid;	/*< Device it describes */
+	size_t len;		/*< Length of the encoded da_addr_body */
+	char body[];		/*< The encoded da_addr_body */
+};
+
+static struct devinfo_cache {
+	pthread_rwlock_t lock;
+	uint32_t count;
+	struct glist_head age;
+	struct glist_head buckets[DEVINFO_CACHE_BUCKETS];
+} devinfo_cache = {
+	.lock = PTHREAD_RWLOCK_INITIALIZER,
+};
+
+/**
+ * @brief Hash bucket of a device
+ *
+ * The buckets are only set up with the first entry so the cache needs
+ * no initialization; a bucket not yet set up has a NULL next.
+ *
+ * @note devinfo_cache.lock MUST be held
+ */
+static struct glist_head *devinfo_bucket(layouttype4 type,
+					 const struct pnfs_deviceid *deviceid)
+{
+	uint64_t h = deviceid->devid ^ deviceid->device_id4 ^
+		     ((uint64_t) deviceid->device_id2 << 32) ^
+		     ((uint64_t) deviceid->fsal_id << 48) ^ type;
+
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 32;
+
+	return &devinfo_cache.buckets[h % DEVINFO_CACHE_BUCKETS];
+}
+
+static struct devinfo_entry *devinfo_find(layouttype4 type,
+					  const struct pnfs_deviceid *deviceid)
+{
+	struct glist_head *bucket = devinfo_bucket(type, deviceid);
+	struct glist_head *glist;
+
+	if (bucket->next == NULL)
+		return NULL;
+
+	glist_for_each(glist, bucket) {
+		struct devinfo_entry *entry =
+			glist_entry(glist, struct devinfo_entry, bucket);
+
+		if (entry->type == type &&
+		    memcmp(&entry->deviceid, deviceid,
+			   sizeof(*deviceid)) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void devinfo_drop(struct devinfo_entry *entry)
+{
+	glist_del(&entry->bucket);
+	glist_del(&entry->age);
+	devinfo_cache.count--;
+	gsh_free(entry);
+}
+
+/**
+ * @brief Look up an encoded device address
+ *
+ * @param[in]  type     Layout type asked for
+ * @param[in]  deviceid Device asked for
+ * @param[in]  maxlen   Room the reply has for the da_addr_body
+ * @param[out] body     Copy of the da_addr_body, to be freed by the caller
+ * @param[out] len      Its length
+ *
+ * @retval true if it was cached and fits.
+ */
+bool pnfs_devinfo_cache_get(layouttype4 type,
+			    const struct pnfs_deviceid *deviceid,
+			    size_t maxlen, char **body, size_t *len)
+{
+	struct devinfo_entry *entry;
+	bool found = false;
+
+	PTHREAD_RWLOCK_rdlock(&devinfo_cache.lock);
+	entry = devinfo_find(type, deviceid);
+	if (entry != NULL && entry->len <= maxlen) {
+		*body = gsh_malloc(entry->len);
+		memcpy(*body, entry->body, entry->len);
+		*len = entry->len;
+		found = true;
+	}
+	PTHREAD_RWLOCK_unlock(&devinfo_cache.lock);
+
+	return found;
+}
+
+/**
+ * @brief Remember a device address the FSAL encoded
+ *
+ * @param[in] type     Layout type
+ * @param[in] deviceid Device
+ * @param[in] body     The encoded da_addr_body
+ * @param[in] len      Its length
+ */
+void pnfs_devinfo_cache_put(layouttype4 type,
+			    const struct pnfs_deviceid *deviceid,
+			    const char *body, size_t len)
+{
+	struct devinfo_entry *entry;
+	int i;
+
+	entry = gsh_malloc(sizeof(*entry) + len);
+	entry->type = type;
+	entry->deviceid = *deviceid;
+	entry->len = len;
+	memcpy(entry->body, body, len);
+
+	PTHREAD_RWLOCK_wrlock(&devinfo_cache.lock);
+
+	if (devinfo_cache.age.next == NULL) {
+		glist_init(&devinfo_cache.age);
+		for (i = 0; i < DEVINFO_CACHE_BUCKETS; i++)
+			glist_init(&devinfo_cache.buckets[i]);
+	}
+
+	if (devinfo_find(type, deviceid) != NULL) {
+		/* Somebody beat us to it */
+		PTHREAD_RWLOCK_unlock(&devinfo_cache.lock);
+		gsh_free(entry);
+		return;
+	}
+
+	if (devinfo_cache.count >= DEVINFO_CACHE_MAX)
+		devinfo_drop(glist_first_entry(&devinfo_cache.age,
+					       struct devinfo_entry, age));
+
+	glist_add_tail(devinfo_bucket(type, deviceid), &entry->bucket);
+	glist_add_tail(&devinfo_cache.age, &entry->age);
+	devinfo_cache.count++;
+
+	PTHREAD_RWLOCK_unlock(&devinfo_cache.lock);
+}
+
+/**
+ * @brief Forget the device addresses of an FSAL
+ *
+ * @param[in] fsal The FSAL whose layouts are being recalled
+ */
+void pnfs_devinfo_cache_flush(struct fsal_module *fsal)
+{
+	struct glist_head *glist, *glistn;
+	uint8_t fsal_id;
+
+	for (fsal_id = 0; fsal_id < FSAL_ID_COUNT; fsal_id++)
+		if (pnfs_fsal[fsal_id] == fsal)
+			break;
+
+	if (fsal_id == FSAL_ID_COUNT)
+		return;
+
+	PTHREAD_RWLOCK_wrlock(&devinfo_cache.lock);
+
+	if (devinfo_cache.count != 0) {
+		glist_for_each_safe(glist, glistn, &devinfo_cache.age) {
+			struct devinfo_entry *entry =
+				glist_entry(glist, struct devinfo_entry, age);
+
+			if (entry->deviceid.fsal_id == fsal_id)
+				devinfo_drop(entry);
+		}
+	}
+
+	PTHREAD_RWLOCK_unlock(&devinfo_cache.lock);
+}
+
 /**
  * @brief Convert POSIX error codes to NFS 4 error codes
  *
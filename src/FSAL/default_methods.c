@@ -611,6 +611,25 @@ bool is_superuser(struct fsal_export *exp_hdl, const struct user_cred *creds)
 	return (creds->caller_uid == 0);
 }
 
+/* getattrs_bulk
+ * default is one getattrs per handle
+ */
+
+static fsal_status_t getattrs_bulk(struct fsal_export *exp_hdl,
+				   uint32_t count,
+				   struct fsal_obj_handle **obj_hdls,
+				   struct attrlist *attrs_out,
+				   fsal_status_t *status)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		status[i] = obj_hdls[i]->obj_ops.getattrs(obj_hdls[i],
+							  &attrs_out[i]);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /* Default fsal export method vector.
  * copied to allocated vector at register time
  */
@@ -649,6 +668,7 @@ struct export_ops def_export_ops = {
 	.alloc_state = alloc_state,
 	.free_state = free_state,
 	.is_superuser = is_superuser,
+	.getattrs_bulk = getattrs_bulk,
 };
 
 /* fsal_obj_handle common methods
@@ -732,6 +752,125 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
+/* lookup_bulk
+ * default is one lookup per name
+ */
+
+static fsal_status_t lookup_bulk(struct fsal_obj_handle *dir_hdl,
+				 uint32_t count, const char **names,
+				 struct fsal_obj_handle **handles,
+				 struct attrlist *attrs_out,
+				 fsal_status_t *status)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		handles[i] = NULL;
+		status[i] = dir_hdl->obj_ops.lookup(dir_hdl, names[i],
+						    &handles[i],
+						    &attrs_out[i]);
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/** Bounce buffer of the default copy2 */
+#define DEFAULT_COPY_CHUNK (1024 * 1024)
+
+/* copy2
+ * default is to read and write through a bounce buffer
+ */
+
+static fsal_status_t copy2(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count,
+			   uint64_t *copied)
+{
+	fsal_status_t status = {0, 0};
+	size_t chunk, nread, nwritten;
+	bool eof = false, stable;
+	char *buf;
+
+	*copied = 0;
+	if (count == 0)
+		return status;
+
+	buf = gsh_malloc(count < DEFAULT_COPY_CHUNK ? count
+						    : DEFAULT_COPY_CHUNK);
+
+	while (*copied < count && !eof) {
+		chunk = count - *copied < DEFAULT_COPY_CHUNK ?
+				count - *copied : DEFAULT_COPY_CHUNK;
+
+		status = src_hdl->obj_ops.read2(src_hdl, false, src_state,
+						src_offset + *copied, chunk,
+						buf, &nread, &eof, NULL);
+		if (FSAL_IS_ERROR(status) || nread == 0)
+			break;
+
+		stable = false;
+		status = dst_hdl->obj_ops.write2(dst_hdl, false, dst_state,
+						 dst_offset + *copied, nread,
+						 buf, &nwritten, &stable, NULL);
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		*copied += nwritten;
+		if (nwritten < nread)
+			break;
+	}
+
+	gsh_free(buf);
+
+	/* What was copied stays copied */
+	if (FSAL_IS_ERROR(status) && *copied != 0)
+		status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	return status;
+}
+
+/* clone2
+ * default case not supported
+ */
+
+static fsal_status_t clone2(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state,
+			    uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state,
+			    uint64_t dst_offset,
+			    uint64_t count)
+{
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+}
+
+/* read_dirent_names
+ * default case not supported, the caller uses readdir
+ */
+
+static fsal_status_t read_dirent_names(struct fsal_obj_handle *dir_hdl,
+				       fsal_cookie_t *whence, void *dir_state,
+				       fsal_readdir_names_cb cb, bool *eof)
+{
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+}
+
+/* read_fd
+ * default case not supported, the caller uses readv2
+ */
+
+static fsal_status_t read_fd(struct fsal_obj_handle *obj_hdl,
+			     bool bypass, struct state_t *state,
+			     uint64_t offset, size_t size, int *fd,
+			     size_t *read_amount, bool *end_of_file)
+{
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+}
+
 /* read_dirents
  * default case not supported
  */
@@ -1482,6 +1621,122 @@ static fsal_status_t write2(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
+/* readv2
+ * default case emulated with one read2 per segment
+ */
+
+static fsal_status_t readv2(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    struct iovec *iov,
+			    int iovcnt,
+			    size_t *read_amount,
+			    bool *end_of_file)
+{
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	size_t nb_read;
+	int i;
+
+	*read_amount = 0;
+	*end_of_file = false;
+
+	for (i = 0; i < iovcnt && !*end_of_file; i++) {
+		nb_read = 0;
+		status = obj_hdl->obj_ops.read2(obj_hdl, bypass, state,
+						offset + *read_amount,
+						iov[i].iov_len,
+						iov[i].iov_base,
+						&nb_read, end_of_file, NULL);
+
+		if (FSAL_IS_ERROR(status)) {
+			/* Only report an error if nothing was read */
+			if (*read_amount != 0)
+				status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+			break;
+		}
+
+		*read_amount += nb_read;
+
+		/* A short read ends the request */
+		if (nb_read < iov[i].iov_len)
+			break;
+	}
+
+	return status;
+}
+
+/* read2_async
+ * default case performs a synchronous readv2
+ */
+
+static void read2_async(struct fsal_obj_handle *obj_hdl,
+			bool bypass,
+			struct fsal_io_arg *io_arg,
+			fsal_async_cb done_cb,
+			void *caller_arg)
+{
+	fsal_status_t status;
+
+	io_arg->io_amount = 0;
+	io_arg->end_of_file = false;
+
+	status = obj_hdl->obj_ops.readv2(obj_hdl, bypass, io_arg->state,
+					 io_arg->offset, io_arg->iov,
+					 io_arg->iovcnt, &io_arg->io_amount,
+					 &io_arg->end_of_file);
+
+	done_cb(obj_hdl, status, io_arg, caller_arg);
+}
+
+/* write2_async
+ * default case performs a synchronous write2 per buffer
+ */
+
+static void write2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct fsal_io_arg *io_arg,
+			 fsal_async_cb done_cb,
+			 void *caller_arg)
+{
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	size_t nb_written;
+	bool stable;
+	bool all_stable = true;
+	int i;
+
+	io_arg->io_amount = 0;
+
+	for (i = 0; i < io_arg->iovcnt; i++) {
+		nb_written = 0;
+		stable = io_arg->fsal_stable;
+		status = obj_hdl->obj_ops.write2(obj_hdl, bypass,
+						 io_arg->state,
+						 io_arg->offset +
+							io_arg->io_amount,
+						 io_arg->iov[i].iov_len,
+						 io_arg->iov[i].iov_base,
+						 &nb_written, &stable, NULL);
+
+		if (FSAL_IS_ERROR(status)) {
+			/* Only report an error if nothing was written */
+			if (io_arg->io_amount != 0)
+				status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+			break;
+		}
+
+		all_stable = all_stable && stable;
+		io_arg->io_amount += nb_written;
+
+		if (nb_written < io_arg->iov[i].iov_len)
+			break;
+	}
+
+	io_arg->fsal_stable = all_stable;
+
+	done_cb(obj_hdl, status, io_arg, caller_arg);
+}
+
 /* seek2
  * default case not supported
  */
@@ -1632,6 +1887,14 @@ struct fsal_obj_ops def_handle_ops = {
 	.lock_op2 = lock_op2,
 	.setattr2 = setattr2,
 	.close2 = close2,
+	.readv2 = readv2,
+	.read2_async = read2_async,
+	.write2_async = write2_async,
+	.lookup_bulk = lookup_bulk,
+	.copy2 = copy2,
+	.clone2 = clone2,
+	.readdir_names = read_dirent_names,
+	.read_fd = read_fd,
 };
 
 /* fsal_pnfs_ds common methods */
@@ -110,6 +110,14 @@ bool fsal_supports(struct fsal_staticfsinfo_t *info,
 		return !!info->compute_readdir_cookie;
 	case fso_whence_is_name:
 		return !!info->whence_is_name;
+	case fso_bulk_ops:
+		return !!info->bulk_ops;
+	case fso_up_invalidate:
+		return !!info->up_invalidate;
+	case fso_lock_avail_upcall:
+		return !!info->lock_avail_upcall;
+	case fso_readv:
+		return !!info->readv;
 	default:
 		return false;	/* whatever I don't know about,
 				 * you can't do
@@ -425,6 +425,11 @@ void posix2fsal_attributes_all(const struct stat *buffstat,
 /* fsalattr->valid_mask should be set to POSIX attributes that need to
  * be filled in. buffstat is expected to have those attributes filled in
  * correctly for converting the attributes from POSIX to FSAL.
+ *
+ * The change attribute is derived from the later of mtime and ctime,
+ * which misses changes made within one tick of a coarse clock.  An
+ * FSAL whose file system keeps a version counter (i_version, Ceph's
+ * stx_version) should overwrite fsalattr->change with it afterwards.
  */
 void posix2fsal_attributes(const struct stat *buffstat,
 			   struct attrlist *fsalattr)
@@ -1042,6 +1042,92 @@ fsal_status_t fsal_read2(struct fsal_obj_handle *obj,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief New style scattered reads
+ *
+ * @param[in]     obj          File to be read
+ * @param[in]     bypass       If state doesn't indicate a share reservation,
+ *                             bypass any deny read
+ * @param[in]     state        state_t associated with the operation
+ * @param[in]     offset       Absolute file position for I/O
+ * @param[in,out] iov          Buffers into which to read data
+ * @param[in]     iovcnt       Number of buffers in iov
+ * @param[out]    bytes_moved  The length of data successfuly read
+ * @param[out]    eof          Whether a READ encountered the end of file
+ *
+ * @return FSAL status
+ */
+
+fsal_status_t fsal_readv2(struct fsal_obj_handle *obj,
+			  bool bypass,
+			  struct state_t *state,
+			  uint64_t offset,
+			  struct iovec *iov,
+			  int iovcnt,
+			  size_t *bytes_moved,
+			  bool *eof)
+{
+	/* Error return from FSAL calls */
+	fsal_status_t status = { 0, 0 };
+
+	status = obj->obj_ops.readv2(obj, bypass, state, offset, iov, iovcnt,
+				     bytes_moved, eof);
+
+	/* Fixup FSAL_SHARE_DENIED status */
+	if (status.major == ERR_FSAL_SHARE_DENIED)
+		status = fsalstat(ERR_FSAL_LOCKED, 0);
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "FSAL READV operation returned %s, iovcnt=%d, effective_size=%zu",
+		     fsal_err_txt(status), iovcnt, *bytes_moved);
+
+	if (FSAL_IS_ERROR(status)) {
+		*bytes_moved = 0;
+		return status;
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Get a descriptor to read a range of a file from later
+ *
+ * @param[in]  obj          File to be read
+ * @param[in]  bypass       If state doesn't indicate a share reservation,
+ *                          bypass any deny read
+ * @param[in]  state        state_t associated with the operation
+ * @param[in]  offset       Absolute file position for I/O
+ * @param[in]  size         Amount of data to be read
+ * @param[out] fd           Descriptor to close, -1 if nothing to read
+ * @param[out] bytes_avail  The length of data that can be read from fd
+ * @param[out] eof          Whether the range reaches the end of file
+ *
+ * @return FSAL status, ERR_FSAL_NOTSUPP if the data must be read now.
+ */
+
+fsal_status_t fsal_read_fd(struct fsal_obj_handle *obj, bool bypass,
+			   struct state_t *state, uint64_t offset, size_t size,
+			   int *fd, size_t *bytes_avail, bool *eof)
+{
+	fsal_status_t status;
+
+	*fd = -1;
+	*bytes_avail = 0;
+
+	status = obj->obj_ops.read_fd(obj, bypass, state, offset, size, fd,
+				      bytes_avail, eof);
+
+	/* Fixup FSAL_SHARE_DENIED status */
+	if (status.major == ERR_FSAL_SHARE_DENIED)
+		status = fsalstat(ERR_FSAL_LOCKED, 0);
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "FSAL READ_FD operation returned %s, fd=%d, effective_size=%zu",
+		     fsal_err_txt(status), *fd, *bytes_avail);
+
+	return status;
+}
+
 /**
  * @brief New style writes
  *
@@ -1494,6 +1580,50 @@ fsal_status_t fsal_readdir(struct fsal_obj_handle *directory,
 	return fsal_status;
 }
 
+/**
+ * @brief Lists the names in a directory
+ *
+ * The callback gets the name, fileid and type of each entry, and
+ * returns DIR_TERMINATE for the first one it can't take.  Junctions
+ * are not crossed: the fileid is that of the directory under the
+ * junction.
+ *
+ * @param[in]  directory The directory to be read
+ * @param[in]  cookie    Starting cookie for the readdir operation
+ * @param[out] eod_met   Whether the end of directory was met
+ * @param[in]  cb        The callback function to receive entries
+ * @param[in]  opaque    Passed to the callback as dir_state
+ *
+ * @return FSAL status, ERR_FSAL_NOTSUPP if the caller must use
+ *         fsal_readdir.
+ */
+
+fsal_status_t fsal_readdir_names(struct fsal_obj_handle *directory,
+				 uint64_t cookie, bool *eod_met,
+				 fsal_readdir_names_cb cb, void *opaque)
+{
+	fsal_status_t fsal_status;
+
+	if (directory->type != DIRECTORY) {
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "Not a directory");
+		return fsalstat(ERR_FSAL_NOTDIR, 0);
+	}
+
+	fsal_status = fsal_access(directory,
+				  FSAL_MODE_MASK_SET(FSAL_R_OK) |
+				  FSAL_ACE4_MASK_SET(FSAL_ACE_PERM_LIST_DIR));
+	if (FSAL_IS_ERROR(fsal_status)) {
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "permission check for directory status=%s",
+			     fsal_err_txt(fsal_status));
+		return fsal_status;
+	}
+
+	return directory->obj_ops.readdir_names(directory, &cookie, opaque,
+						cb, eod_met);
+}
+
 /**
  *
  * @brief Remove a name from a directory.
@@ -64,6 +64,11 @@
 pthread_mutex_t fsal_lock = PTHREAD_MUTEX_INITIALIZER;
 GLIST_HEAD(fsal_list);
 
+/**
+ * @brief Serializes fsal_load_init
+ */
+static pthread_mutex_t fsal_load_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * @{
  *
@@ -526,6 +531,11 @@ int fsal_load_init(void *node, const char *name, struct fsal_module **fsal_hdl,
 		return 1;
 	}
 
+	/* Exports may be set up in parallel, keep a second thread from
+	 * loading the module while the first is initializing it.
+	 */
+	PTHREAD_MUTEX_lock(&fsal_load_init_lock);
+
 	*fsal_hdl = lookup_fsal(name);
 	if (*fsal_hdl == NULL) {
 		int retval;
@@ -533,6 +543,7 @@ int fsal_load_init(void *node, const char *name, struct fsal_module **fsal_hdl,
 
 		retval = load_fsal(name, fsal_hdl);
 		if (retval != 0) {
+			PTHREAD_MUTEX_unlock(&fsal_load_init_lock);
 			config_proc_error(node, err_type,
 					  "Failed to load FSAL (%s) because: %s",
 					  name,	strerror(retval));
@@ -544,6 +555,7 @@ int fsal_load_init(void *node, const char *name, struct fsal_module **fsal_hdl,
 		status = (*fsal_hdl)->m_ops.init_config(*fsal_hdl,
 							myconfig, err_type);
 		if (FSAL_IS_ERROR(status)) {
+			PTHREAD_MUTEX_unlock(&fsal_load_init_lock);
 			config_proc_error(node, err_type,
 					  "Failed to initialize FSAL (%s)",
 					  name);
@@ -553,6 +565,7 @@ int fsal_load_init(void *node, const char *name, struct fsal_module **fsal_hdl,
 		}
 	}
 
+	PTHREAD_MUTEX_unlock(&fsal_load_init_lock);
 	return 0;
 }
 
@@ -48,6 +48,12 @@
  * returns it after execution.
  *
  * Every async call returns 0 on success and a POSIX error code on error.
+ *
+ * Invalidates are the exception to one job per call: they go through a
+ * queue keyed by handle, split in partitions, where a repeated
+ * invalidate of a queued handle only merges its flags.  Each busy
+ * partition has one fridge job delivering its queue in batches, so a
+ * storm of invalidates cannot take over the fridge.
  */
 
 #include "config.h"
@@ -61,31 +67,101 @@
 #include "fsal_convert.h"
 #include "sal_functions.h"
 #include "pnfs_utils.h"
+#include "city.h"
 
 /* Invalidate */
 
+/** Number of partitions of the invalidate queue */
+#define UP_INVALIDATE_PARTS 8
+
+/** Hash buckets per partition */
+#define UP_INVALIDATE_BUCKETS 256
+
+/** Invalidates delivered by one fridge job before it yields */
+#define UP_INVALIDATE_BATCH 64
+
+struct invalidate_waiter {
+	struct glist_head node;
+	void (*cb)(void *, fsal_status_t);
+	void *cb_arg;
+};
+
 struct invalidate_args {
+	struct glist_head q;		/*< On the partition queue */
+	struct glist_head chain;	/*< On a hash bucket */
 	const struct fsal_up_vector *vec;
 	struct gsh_buffdesc obj;
-	uint32_t flags;
-	void (*cb)(void *, fsal_status_t);
-	void *cb_arg;
+	uint32_t flags;			/*< Union of the merged flags */
+	uint64_t hk;
+	struct glist_head waiters;	/*< Callbacks of merged calls */
 	char key[];
 };
 
+struct invalidate_part {
+	pthread_mutex_t lock;
+	struct glist_head queue;
+	struct glist_head buckets[UP_INVALIDATE_BUCKETS];
+	bool scheduled;			/*< A fridge job owns the queue */
+	struct fridgethr *fr;
+};
+
+static struct invalidate_part invalidate_parts[UP_INVALIDATE_PARTS];
+static pthread_once_t invalidate_once = PTHREAD_ONCE_INIT;
+
+static void invalidate_parts_init(void)
+{
+	int i, j;
+
+	for (i = 0; i < UP_INVALIDATE_PARTS; i++) {
+		PTHREAD_MUTEX_init(&invalidate_parts[i].lock, NULL);
+		glist_init(&invalidate_parts[i].queue);
+		for (j = 0; j < UP_INVALIDATE_BUCKETS; j++)
+			glist_init(&invalidate_parts[i].buckets[j]);
+	}
+}
+
 static void queue_invalidate(struct fridgethr_context *ctx)
 {
-	struct invalidate_args *args = ctx->arg;
+	struct invalidate_part *part = ctx->arg;
+	struct invalidate_args *args;
+	struct glist_head *glist, *glistn;
+	struct invalidate_waiter *waiter;
 	fsal_status_t status;
+	int n;
+
+	for (n = 0; n < UP_INVALIDATE_BATCH; n++) {
+		PTHREAD_MUTEX_lock(&part->lock);
+		args = glist_first_entry(&part->queue, struct invalidate_args,
+					 q);
+		if (args == NULL) {
+			part->scheduled = false;
+			PTHREAD_MUTEX_unlock(&part->lock);
+			return;
+		}
+		glist_del(&args->q);
+		glist_del(&args->chain);
+		PTHREAD_MUTEX_unlock(&part->lock);
+
+		status = args->vec->up_fsal_export->up_ops->invalidate(
+						args->vec, &args->obj,
+						args->flags);
+
+		glist_for_each_safe(glist, glistn, &args->waiters) {
+			waiter = glist_entry(glist, struct invalidate_waiter,
+					     node);
+			waiter->cb(waiter->cb_arg, status);
+			gsh_free(waiter);
+		}
 
-	status = args->vec->up_fsal_export->up_ops->invalidate(args->vec,
-							       &args->obj,
-							       args->flags);
-
-	if (args->cb)
-		args->cb(args->cb_arg, status);
-
-	gsh_free(args);
+		gsh_free(args);
+	}
+
+	/* Let other deferred work in before the rest of the batch */
+	PTHREAD_MUTEX_lock(&part->lock);
+	if (glist_empty(&part->queue) ||
+	    fridgethr_submit(part->fr, queue_invalidate, part) != 0)
+		part->scheduled = false;
+	PTHREAD_MUTEX_unlock(&part->lock);
 }
 
 fsal_status_t up_async_invalidate(struct fridgethr *fr,
@@ -94,24 +170,74 @@ fsal_status_t up_async_invalidate(struct fridgethr *fr,
 			void (*cb)(void *, fsal_status_t), void *cb_arg)
 {
 	struct invalidate_args *args = NULL;
+	struct invalidate_part *part;
+	struct glist_head *bucket, *glist;
+	struct invalidate_waiter *waiter = NULL;
+	uint64_t hk;
 	int rc = 0;
 
+	(void) pthread_once(&invalidate_once, invalidate_parts_init);
+
+	hk = CityHash64WithSeed(obj->addr, obj->len, (uint64_t) vec);
+	part = &invalidate_parts[hk % UP_INVALIDATE_PARTS];
+	bucket = &part->buckets[(hk / UP_INVALIDATE_PARTS) %
+				UP_INVALIDATE_BUCKETS];
+
+	if (cb != NULL) {
+		waiter = gsh_malloc(sizeof(*waiter));
+		waiter->cb = cb;
+		waiter->cb_arg = cb_arg;
+	}
+
+	PTHREAD_MUTEX_lock(&part->lock);
+
+	glist_for_each(glist, bucket) {
+		args = glist_entry(glist, struct invalidate_args, chain);
+		if (args->hk == hk && args->vec == vec &&
+		    args->obj.len == obj->len &&
+		    memcmp(args->key, obj->addr, obj->len) == 0)
+			break;
+		args = NULL;
+	}
+
+	if (args != NULL) {
+		/* Already queued, just widen it */
+		args->flags |= flags;
+		if (waiter != NULL)
+			glist_add_tail(&args->waiters, &waiter->node);
+		PTHREAD_MUTEX_unlock(&part->lock);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	if (!part->scheduled) {
+		rc = fridgethr_submit(fr, queue_invalidate, part);
+		if (rc != 0) {
+			PTHREAD_MUTEX_unlock(&part->lock);
+			gsh_free(waiter);
+			return fsalstat(posix2fsal_error(rc), rc);
+		}
+		part->scheduled = true;
+		part->fr = fr;
+	}
+
 	args = gsh_malloc(sizeof(struct invalidate_args) + obj->len);
 
 	args->vec = vec;
 	args->flags = flags;
-	args->cb = cb;
-	args->cb_arg = cb_arg;
+	args->hk = hk;
+	glist_init(&args->waiters);
+	if (waiter != NULL)
+		glist_add_tail(&args->waiters, &waiter->node);
 	memcpy(args->key, obj->addr, obj->len);
 	args->obj.addr = args->key;
 	args->obj.len = obj->len;
 
-	rc = fridgethr_submit(fr, queue_invalidate, args);
+	glist_add_tail(bucket, &args->chain);
+	glist_add_tail(&part->queue, &args->q);
 
-	if (rc != 0)
-		gsh_free(args);
+	PTHREAD_MUTEX_unlock(&part->lock);
 
-	return fsalstat(posix2fsal_error(rc), rc);
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
 /* Update */
@@ -433,7 +559,10 @@ static void queue_delegrecall(struct fridgethr_context *ctx)
 {
 	struct fsal_obj_handle *obj = ctx->arg;
 
-	(void)delegrecall_impl(obj);
+	/* Only conflicting operations queue recalls here, and they are
+	 * waiting on the result.
+	 */
+	(void)delegrecall_impl(obj, true);
 }
 
 int async_delegrecall(struct fridgethr *fr, struct fsal_obj_handle *obj)
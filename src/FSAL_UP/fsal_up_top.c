@@ -41,6 +41,7 @@
 #include "pnfs_utils.h"
 #include "nfs_rpc_callback.h"
 #include "nfs_proto_tools.h"
+#include "nfs_proto_functions.h"
 #include "nfs_convert.h"
 #include "delayed_exec.h"
 #include "export_mgr.h"
@@ -53,6 +54,10 @@ struct delegrecall_context {
 	stateid4 drc_stateid;
 	/* Hold a reference to the export during delegation recall */
 	struct gsh_export *drc_exp;
+	/* When the recall was started, for recall latency */
+	struct timespec drc_recall_time;
+	/* An operation is waiting on this recall */
+	bool drc_urgent;
 };
 
 enum recall_resp_action {
@@ -87,6 +92,23 @@ static fsal_status_t invalidate_close(const struct fsal_up_vector *vec,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief Forget the GETQUOTA answers a quota change made stale
+ *
+ * @param[in] vec        Up ops vector
+ * @param[in] quota_type USRQUOTA or GRPQUOTA
+ * @param[in] quota_id   User or group, -1 for all of them
+ *
+ * @return FSAL status
+ */
+static fsal_status_t quota_changed(const struct fsal_up_vector *vec,
+				   int quota_type, int quota_id)
+{
+	rquota_cache_invalidate(vec->up_gsh_export->export_id, quota_type,
+				quota_id);
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /** Invalidate some or all of a cache entry
  *
  * @param[in] vec    Up ops vector
@@ -413,6 +435,9 @@ state_status_t layoutrecall(const struct fsal_up_vector *vec,
 	if (rc != STATE_SUCCESS)
 		return rc;
 
+	/* The data servers may be changing, fetch the devices afresh */
+	pnfs_devinfo_cache_flush(export->fsal);
+
 	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
 	/* We build up the list before consuming it so that we have
 	   every state on the list before we start executing returns. */
@@ -1089,9 +1114,7 @@ static enum recall_resp_action handle_recall_response(
 static inline void
 free_delegrecall_context(struct delegrecall_context *deleg_ctx)
 {
-	PTHREAD_MUTEX_lock(&deleg_ctx->drc_clid->cid_mutex);
 	update_lease(deleg_ctx->drc_clid);
-	PTHREAD_MUTEX_unlock(&deleg_ctx->drc_clid->cid_mutex);
 
 	put_gsh_export(deleg_ctx->drc_exp);
 
@@ -1160,10 +1183,18 @@ static int32_t delegrecall_completion_func(rpc_call_t *call,
 				 call->stat);
 			set_cb_chan_down(deleg_ctx->drc_clid, true);
 			resp_act = DELEG_RECALL_SCHED;
-		} else
+		} else {
+			struct timespec ts;
+
+			now(&ts);
+			record_recall_latency(
+				deleg_ctx->drc_clid->gsh_client,
+				timespec_diff(&deleg_ctx->drc_recall_time,
+					      &ts));
 			resp_act = handle_recall_response(deleg_ctx,
 							  state,
 							  call);
+		}
 		break;
 	default:
 		LogEvent(COMPONENT_NFS_CB,
@@ -1314,6 +1345,10 @@ void delegrecall_one(struct fsal_obj_handle *obj,
 	/* set completion hook */
 	call->call_hook = delegrecall_completion_func;
 
+	/* Someone is waiting on this one, send it ahead of bulk recalls */
+	if (p_cargs->drc_urgent)
+		call->flags |= NFS_RPC_CALL_URGENT;
+
 	/* call it (here, in current thread context)
 	   ret is always 0 for async calls, might change in future */
 	if (nfs_rpc_submit_call(call, p_cargs, NFS_RPC_CALL_NONE) == 0)
@@ -1487,9 +1522,9 @@ static int schedule_delegrevoke_check(struct delegrecall_context *ctx,
 	return rc;
 }
 
-state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
+state_status_t delegrecall_impl(struct fsal_obj_handle *obj, bool urgent)
 {
-	struct glist_head *glist, *glist_n;
+	struct glist_head *glist, *glist_n, *list;
 	state_status_t rc = 0;
 	uint32_t *deleg_state = NULL;
 	struct state_t *state;
@@ -1500,9 +1535,13 @@ state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
 		 "FSAL_UP_DELEG: obj %p type %u",
 		 obj, obj->type);
 
+	if (obj->type == DIRECTORY)
+		list = &obj->state_hdl->dir.list_of_states;
+	else
+		list = &obj->state_hdl->file.list_of_states;
+
 	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
-	glist_for_each_safe(glist, glist_n,
-			    &obj->state_hdl->file.list_of_states) {
+	glist_for_each_safe(glist, glist_n, list) {
 		state = glist_entry(glist, struct state_t, state_list);
 
 		if (state->state_type != STATE_TYPE_DELEG)
@@ -1542,10 +1581,13 @@ state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
 
 		drc_ctx->drc_clid = owner->so_owner.so_nfs4_owner.so_clientrec;
 		COPY_STATEID(&drc_ctx->drc_stateid, state);
+		now(&drc_ctx->drc_recall_time);
+		drc_ctx->drc_urgent = urgent;
 		inc_client_id_ref(drc_ctx->drc_clid);
 		dec_state_owner_ref(owner);
 
-		obj->state_hdl->file.fdeleg_stats.fds_last_recall = time(NULL);
+		if (obj->type == REGULAR_FILE)
+			deleg_heuristics_conflict(obj->state_hdl);
 
 		/* Prevent client's lease expiring until we complete
 		 * this recall/revoke operation. If the client's lease
@@ -1553,15 +1595,12 @@ state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
 		 * expired clients revoke this delegation, and we just
 		 * skip it here.
 		 */
-		PTHREAD_MUTEX_lock(&drc_ctx->drc_clid->cid_mutex);
 		if (!reserve_lease(drc_ctx->drc_clid)) {
-			PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
 			put_gsh_export(drc_ctx->drc_exp);
 			dec_client_id_ref(drc_ctx->drc_clid);
 			gsh_free(drc_ctx);
 			continue;
 		}
-		PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
 
 		delegrecall_one(obj, state, drc_ctx);
 	}
@@ -1599,7 +1638,7 @@ state_status_t delegrecall(const struct fsal_up_vector *vec,
 		return rc;
 	}
 
-	rc = delegrecall_impl(obj);
+	rc = delegrecall_impl(obj, false);
 	obj->obj_ops.put_ref(obj);
 	return rc;
 }
@@ -1647,7 +1686,8 @@ struct fsal_up_vector fsal_up_top = {
 	.layoutrecall = layoutrecall,
 	.notify_device = notify_device,
 	.delegrecall = delegrecall,
-	.invalidate_close = invalidate_close
+	.invalidate_close = invalidate_close,
+	.quota_changed = quota_changed
 };
 
 /** @} */
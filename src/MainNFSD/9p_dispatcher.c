@@ -44,7 +44,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
-#include <poll.h>
+#include <sys/epoll.h>
 #include <arpa/inet.h>		/* For inet_ntop() */
 #include "hashtable.h"
 #include "log.h"
@@ -99,242 +99,349 @@ void DispatchWork9P(request_data_t *req)
 }
 
 /**
- * _9p_socket_thread: 9p socket manager.
+ * @brief A 9P/TCP connection, as seen by the event threads
  *
- * This function is the main loop for the 9p socket manager.
- * One such thread exists per connection.
- *
- * @param Arg the socket number cast as a void * in pthread_create
+ * The message being received is kept here between wakeups, so that an
+ * event thread never blocks on one client.
+ */
+struct _9p_tcp_conn {
+	struct _9p_conn conn;
+	char strcaller[INET6_ADDRSTRLEN];
+	char hdr[_9P_HDR_SIZE];	/* size header being read */
+	char *msg;		/* message being read, NULL while the
+				   header is */
+	uint32_t msglen;
+	uint32_t readlen;
+};
+
+/* messages read from one connection before the others get a turn */
+#define _9P_TCP_READ_BUDGET 16
+
+#define _9P_TCP_EVENTS 64
+
+/* one epoll instance per event thread */
+static int *_9p_epfds;
+static uint32_t _9p_next_epfd;
+
+/**
+ * @brief Release a reference on a 9P/TCP connection
  *
- * @return NULL
+ * The event thread owns one reference until the connection is shut
+ * down, and each request in flight owns another.  The last one closes
+ * the socket and frees the connection.
  *
+ * @param[in] conn The connection
  */
-
-void *_9p_socket_thread(void *Arg)
+void _9p_tcp_conn_put(struct _9p_conn *conn)
 {
-	long int tcp_sock = (long int)Arg;
-	int rc = -1;
-	struct pollfd fds[1];
-	int fdcount = 1;
-	static char my_name[MAXNAMLEN + 1];
-	char strcaller[INET6_ADDRSTRLEN];
-	request_data_t *req = NULL;
-	int tag;
-	unsigned long sequence = 0;
-	unsigned int i = 0;
-	char *_9pmsg = NULL;
-	uint32_t msglen;
+	struct _9p_tcp_conn *tc = container_of(conn, struct _9p_tcp_conn,
+					       conn);
+	unsigned int i;
 
-	struct _9p_conn _9p_conn;
-	socklen_t addrpeerlen;
+	if (atomic_dec_uint32_t(&conn->refcount) != 0)
+		return;
 
-	int readlen = 0;
-	int total_readlen = 0;
+	LogEvent(COMPONENT_9P, "Closing connection on socket %lu",
+		 conn->trans_data.sockfd);
 
-	snprintf(my_name, MAXNAMLEN, "9p_sock_mgr#fd=%ld", tcp_sock);
-	SetNameFunction(my_name);
+	close(conn->trans_data.sockfd);
+
+	_9p_cleanup_fids(conn);
+
+	if (conn->client != NULL)
+		put_gsh_client(conn->client);
+
+	for (i = 0; i < FLUSH_BUCKETS; i++)
+		PTHREAD_MUTEX_destroy(&conn->flush_buckets[i].lock);
+	PTHREAD_MUTEX_destroy(&conn->sock_lock);
+
+	gsh_free(tc->msg);
+	gsh_free(tc);
+}
+
+/**
+ * @brief Set up a new 9P/TCP connection
+ *
+ * @param[in] tcp_sock The accepted socket
+ *
+ * @return The connection, holding the event thread's reference.
+ */
+static struct _9p_tcp_conn *_9p_tcp_conn_new(long int tcp_sock)
+{
+	struct _9p_tcp_conn *tc = gsh_calloc(1, sizeof(*tc));
+	struct _9p_conn *conn = &tc->conn;
+	socklen_t addrpeerlen;
+	unsigned int i;
+	int rc;
 
 	/* Init the struct _9p_conn structure */
-	memset(&_9p_conn, 0, sizeof(_9p_conn));
-	PTHREAD_MUTEX_init(&_9p_conn.sock_lock, NULL);
-	_9p_conn.trans_type = _9P_TCP;
-	_9p_conn.trans_data.sockfd = tcp_sock;
+	PTHREAD_MUTEX_init(&conn->sock_lock, NULL);
+	conn->trans_type = _9P_TCP;
+	conn->trans_data.sockfd = tcp_sock;
 	for (i = 0; i < FLUSH_BUCKETS; i++) {
-		PTHREAD_MUTEX_init(&_9p_conn.flush_buckets[i].lock, NULL);
-		glist_init(&_9p_conn.flush_buckets[i].list);
+		PTHREAD_MUTEX_init(&conn->flush_buckets[i].lock, NULL);
+		glist_init(&conn->flush_buckets[i].list);
 	}
-	atomic_store_uint32_t(&_9p_conn.refcount, 0);
-
-	/* Init the fids pointers array */
-	memset(&_9p_conn.fids, 0, _9P_FID_PER_CONN * sizeof(struct _9p_fid *));
+	atomic_store_uint32_t(&conn->refcount, 1);
 
 	/* Set initial msize.
 	 * Client may request a lower value during TVERSION */
-	_9p_conn.msize = _9p_param._9p_tcp_msize;
+	conn->msize = _9p_param._9p_tcp_msize;
 
-	if (gettimeofday(&_9p_conn.birth, NULL) == -1)
+	if (gettimeofday(&conn->birth, NULL) == -1)
 		LogFatal(COMPONENT_9P, "Cannot get connection's time of birth");
 
-	addrpeerlen = sizeof(_9p_conn.addrpeer);
-	rc = getpeername(tcp_sock, (struct sockaddr *)&_9p_conn.addrpeer,
+	addrpeerlen = sizeof(conn->addrpeer);
+	rc = getpeername(tcp_sock, (struct sockaddr *)&conn->addrpeer,
 			 &addrpeerlen);
 	if (rc == -1) {
 		LogMajor(COMPONENT_9P,
 			 "Cannot get peername to tcp socket for 9p, error %d (%s)",
 			 errno, strerror(errno));
-		/* XXX */
-		strncpy(strcaller, "(unresolved)", INET6_ADDRSTRLEN);
-		strcaller[12] = '\0';
+		strncpy(tc->strcaller, "(unresolved)", INET6_ADDRSTRLEN);
 	} else {
-		switch (_9p_conn.addrpeer.ss_family) {
+		switch (conn->addrpeer.ss_family) {
 		case AF_INET:
-			inet_ntop(_9p_conn.addrpeer.ss_family,
-				  &((struct sockaddr_in *)&_9p_conn.addrpeer)->
-				  sin_addr, strcaller, INET6_ADDRSTRLEN);
+			inet_ntop(conn->addrpeer.ss_family,
+				  &((struct sockaddr_in *)&conn->addrpeer)->
+				  sin_addr, tc->strcaller, INET6_ADDRSTRLEN);
 			break;
 		case AF_INET6:
-			inet_ntop(_9p_conn.addrpeer.ss_family,
-				  &((struct sockaddr_in6 *)&_9p_conn.addrpeer)->
-				  sin6_addr, strcaller, INET6_ADDRSTRLEN);
+			inet_ntop(conn->addrpeer.ss_family,
+				  &((struct sockaddr_in6 *)&conn->addrpeer)->
+				  sin6_addr, tc->strcaller, INET6_ADDRSTRLEN);
 			break;
 		default:
-			snprintf(strcaller, INET6_ADDRSTRLEN, "BAD ADDRESS");
+			snprintf(tc->strcaller, INET6_ADDRSTRLEN,
+				 "BAD ADDRESS");
 			break;
 		}
 
 		LogEvent(COMPONENT_9P, "9p socket #%ld is connected to %s",
-			 tcp_sock, strcaller);
+			 tcp_sock, tc->strcaller);
 	}
-	_9p_conn.client = get_gsh_client(&_9p_conn.addrpeer, false);
+	conn->client = get_gsh_client(&conn->addrpeer, false);
 
-	/* Set up the structure used by poll */
-	memset((char *)fds, 0, sizeof(struct pollfd));
-	fds[0].fd = tcp_sock;
-	fds[0].events =
-	    POLLIN | POLLPRI | POLLRDBAND | POLLRDNORM | POLLRDHUP | POLLHUP |
-	    POLLERR | POLLNVAL;
+	return tc;
+}
 
-	for (;;) {
-		total_readlen = 0;  /* new message */
-		rc = poll(fds, fdcount, -1);
-		if (rc == -1) {
-			/* timeout = -1 => Wait indefinitely for events */
-			/* Interruption if not an issue */
+/**
+ * @brief Hand a fully received message over to the workers
+ *
+ * @param[in] tc The connection the message was read from
+ */
+static void _9p_tcp_dispatch(struct _9p_tcp_conn *tc)
+{
+	request_data_t *req;
+	int tag;
+
+	LogFullDebug(COMPONENT_9P,
+		     "Received 9P/TCP message of size %u from client %s on socket %lu",
+		     tc->msglen, tc->strcaller, tc->conn.trans_data.sockfd);
+
+	server_stats_transport_done(tc->conn.client, tc->msglen, 1, 0,
+				    0, 0, 0);
+
+	req = pool_alloc(request_9p_pool);
+
+	req->rtype = _9P_REQUEST;
+	req->r_u._9p._9pmsg = tc->msg;
+	req->r_u._9p.pconn = &tc->conn;
+
+	/* Add this request to the request list,
+	 * should it be flushed later. */
+	tag = *(u16 *) (tc->msg + _9P_HDR_SIZE + _9P_TYPE_SIZE);
+	_9p_AddFlushHook(&req->r_u._9p, tag, tc->conn.sequence++);
+	LogFullDebug(COMPONENT_9P, "Request tag is %d\n", tag);
+
+	/* Not our buffer anymore */
+	tc->msg = NULL;
+	tc->readlen = 0;
+
+	/* Message was OK push it */
+	DispatchWork9P(req);
+}
+
+/**
+ * @brief Read what a connection has to offer without blocking
+ *
+ * Every complete message is dispatched as soon as it is read, so a
+ * client may have many requests in flight.
+ *
+ * @param[in] tc The connection
+ *
+ * @return false if the connection is to be closed.
+ */
+static bool _9p_tcp_read(struct _9p_tcp_conn *tc)
+{
+	long int tcp_sock = tc->conn.trans_data.sockfd;
+	int budget = _9P_TCP_READ_BUDGET;
+	ssize_t readlen;
+
+	while (budget > 0) {
+		/* An incoming 9P request: the msg has a 4 bytes header
+		   showing the size of the msg including the header */
+		if (tc->msg == NULL)
+			readlen = recv(tcp_sock, tc->hdr + tc->readlen,
+				       _9P_HDR_SIZE - tc->readlen,
+				       MSG_DONTWAIT);
+		else
+			readlen = recv(tcp_sock, tc->msg + tc->readlen,
+				       tc->msglen - tc->readlen,
+				       MSG_DONTWAIT);
+
+		if (readlen < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
 			if (errno == EINTR)
 				continue;
-
-			LogCrit(COMPONENT_9P,
-				"Got error %u (%s) on fd %ld connect to %s while polling on socket",
-				errno, strerror(errno), tcp_sock, strcaller);
+			LogEvent(COMPONENT_9P,
+				 "Read error client %s on socket %lu errno=%d, total read = %u",
+				 tc->strcaller, tcp_sock, errno, tc->readlen);
+			return false;
 		}
 
-		if (fds[0].revents & POLLNVAL) {
-			LogEvent(COMPONENT_9P,
-				 "Client %s on socket %lu produced POLLNVAL",
-				 strcaller, tcp_sock);
-			goto end;
+		if (readlen == 0) {
+			if (tc->readlen != 0 || tc->msg != NULL)
+				LogEvent(COMPONENT_9P,
+					 "Premature end for Client %s on socket %lu, total read = %u",
+					 tc->strcaller, tcp_sock,
+					 tc->readlen);
+			else
+				LogEvent(COMPONENT_9P,
+					 "Client %s on socket %lu has shut down and closed",
+					 tc->strcaller, tcp_sock);
+			return false;
 		}
 
-		if (fds[0].revents & (POLLERR | POLLHUP | POLLRDHUP)) {
-			LogEvent(COMPONENT_9P,
-				 "Client %s on socket %lu has shut down and closed",
-				 strcaller, tcp_sock);
-			goto end;
+		tc->readlen += readlen;
+
+		if (tc->msg == NULL) {
+			if (tc->readlen < _9P_HDR_SIZE)
+				continue;
+
+			tc->msglen = *(uint32_t *) tc->hdr;
+			if (tc->msglen > tc->conn.msize) {
+				LogCrit(COMPONENT_9P,
+					"Message size too big! got %u, max = %u",
+					tc->msglen, tc->conn.msize);
+				return false;
+			}
+			if (tc->msglen < _9P_STD_HDR_SIZE) {
+				LogEvent(COMPONENT_9P,
+					 "Header too small! for client %s on socket %lu: msglen=%u expected=%u",
+					 tc->strcaller, tcp_sock, tc->msglen,
+					 _9P_STD_HDR_SIZE);
+				return false;
+			}
+
+			/* Prepare to read the message */
+			tc->msg = gsh_malloc(tc->conn.msize);
+			memcpy(tc->msg, tc->hdr, _9P_HDR_SIZE);
 		}
 
-		if (!(fds[0].revents & (POLLIN | POLLRDNORM)))
+		if (tc->readlen < tc->msglen)
 			continue;
 
-		/* Prepare to read the message */
-		_9pmsg = gsh_malloc(_9p_conn.msize);
+		_9p_tcp_dispatch(tc);
+		budget--;
+	}
 
-		/* An incoming 9P request: the msg has a 4 bytes header
-		   showing the size of the msg including the header */
-		readlen = recv(fds[0].fd, _9pmsg,
-			       _9P_HDR_SIZE, MSG_WAITALL);
-		if (readlen != _9P_HDR_SIZE)
-			goto badmsg;
+	/* More may be pending, level triggered epoll will tell again */
+	return true;
+}
+
+/**
+ * _9p_event_thread: 9p connections manager.
+ *
+ * Each such thread waits on its own epoll instance for the connections
+ * it was given, reads the requests they send and hands them to the
+ * worker threads. Connections are never closed here while requests
+ * are in flight, the last reference does it.
+ *
+ * @param Arg the epoll fd cast as a void * in pthread_create
+ *
+ * @return NULL
+ *
+ */
+static void *_9p_event_thread(void *Arg)
+{
+	int epfd = (long int)Arg;
+	struct epoll_event events[_9P_TCP_EVENTS];
+	char my_name[MAXNAMLEN + 1];
+	int n, i;
+
+	snprintf(my_name, MAXNAMLEN, "9p_evchan#fd=%d", epfd);
+	SetNameFunction(my_name);
+
+	for (;;) {
+		n = epoll_wait(epfd, events, _9P_TCP_EVENTS, -1);
+		if (n == -1) {
+			/* Interruption if not an issue */
+			if (errno == EINTR)
+				continue;
 
-		msglen = *(uint32_t *) _9pmsg;
-		if (msglen > _9p_conn.msize) {
 			LogCrit(COMPONENT_9P,
-				"Message size too big! got %u, max = %u",
-				msglen, _9p_conn.msize);
-			goto end;
+				"Got error %u (%s) on epoll fd %d",
+				errno, strerror(errno), epfd);
+			continue;
 		}
 
-		LogFullDebug(COMPONENT_9P,
-			     "Received 9P/TCP message of size %u from client %s on socket %lu",
-			     msglen, strcaller, tcp_sock);
+		for (i = 0; i < n; i++) {
+			struct _9p_tcp_conn *tc = events[i].data.ptr;
+			long int tcp_sock = tc->conn.trans_data.sockfd;
 
-		total_readlen += readlen;
-		while (total_readlen < msglen) {
-			readlen = recv(fds[0].fd,
-				       _9pmsg + total_readlen,
-				       msglen - total_readlen,
-				       0);
+			if ((events[i].events & EPOLLIN) && _9p_tcp_read(tc))
+				continue;
 
-			if (readlen > 0) {
-				total_readlen += readlen;
+			if (!(events[i].events & EPOLLIN) &&
+			    !(events[i].events & (EPOLLERR | EPOLLHUP |
+						  EPOLLRDHUP)))
 				continue;
-			}
-			if (readlen == 0 ||
-			    (readlen < 0 && errno != EINTR))
-				goto badmsg;
-		}	/* while */
-
-		server_stats_transport_done(_9p_conn.client,
-					    total_readlen, 1, 0,
-					    0, 0, 0);
-
-		/* Message is good. */
-		req = pool_alloc(request_pool);
-
-		req->rtype = _9P_REQUEST;
-		req->r_u._9p._9pmsg = _9pmsg;
-		req->r_u._9p.pconn = &_9p_conn;
-
-		/* Add this request to the request list,
-		 * should it be flushed later. */
-		tag = *(u16 *) (_9pmsg + _9P_HDR_SIZE +
-				_9P_TYPE_SIZE);
-		_9p_AddFlushHook(&req->r_u._9p, tag,
-				 sequence++);
-		LogFullDebug(COMPONENT_9P,
-			     "Request tag is %d\n", tag);
-
-		/* Message was OK push it */
-		DispatchWork9P(req);
-
-		/* Not our buffer anymore */
-		_9pmsg = NULL;
-		continue;
-
-badmsg:
-		if (readlen == 0)
-			LogEvent(COMPONENT_9P,
-				 "Premature end for Client %s on socket %lu, total read = %u",
-				 strcaller, tcp_sock, total_readlen);
-		else if (readlen < 0) {
-			LogEvent(COMPONENT_9P,
-				 "Read error client %s on socket %lu errno=%d, total read = %u",
-				 strcaller, tcp_sock,
-				 errno, total_readlen);
-		} else
-			LogEvent(COMPONENT_9P,
-				 "Header too small! for client %s on socket %lu: readlen=%u expected=%u",
-				 strcaller, tcp_sock, readlen,
-				 _9P_HDR_SIZE);
-
-		/* Either way, we close the connection.
-		 * It is not possible to survive
-		 * once we get out of sync in the TCP stream
-		 * with the client
-		 */
-		break; /* bail out */
-	}			/* for( ;; ) */
-
-end:
-	LogEvent(COMPONENT_9P, "Closing connection on socket %lu", tcp_sock);
-	close(tcp_sock);
-
-	/* Free buffer if we encountered an error
-	 * before we could give it to a worker */
-	if (_9pmsg)
-		gsh_free(_9pmsg);
-
-	while (atomic_fetch_uint32_t(&_9p_conn.refcount)) {
-		LogEvent(COMPONENT_9P, "Waiting for workers to release pconn");
-		sleep(1);
+
+			/* Either way, we close the connection.
+			 * It is not possible to survive
+			 * once we get out of sync in the TCP stream
+			 * with the client
+			 */
+			epoll_ctl(epfd, EPOLL_CTL_DEL, tcp_sock, NULL);
+			shutdown(tcp_sock, SHUT_RDWR);
+			_9p_tcp_conn_put(&tc->conn);
+		}
 	}
 
-	_9p_cleanup_fids(&_9p_conn);
+	return NULL;
+}				/* _9p_event_thread */
 
-	if (_9p_conn.client != NULL)
-		put_gsh_client(_9p_conn.client);
+/**
+ * @brief Start the threads polling the 9P/TCP connections
+ *
+ * @param[in] attr_thr Thread attributes
+ */
+static void _9p_start_event_threads(pthread_attr_t *attr_thr)
+{
+	uint32_t i;
+	pthread_t thrid;
+	int rc;
+
+	_9p_epfds = gsh_calloc(_9p_param._9p_tcp_event_threads,
+			       sizeof(*_9p_epfds));
+
+	for (i = 0; i < _9p_param._9p_tcp_event_threads; i++) {
+		_9p_epfds[i] = epoll_create1(EPOLL_CLOEXEC);
+		if (_9p_epfds[i] == -1)
+			LogFatal(COMPONENT_9P_DISPATCH,
+				 "Could not create 9p epoll fd, error = %d (%s)",
+				 errno, strerror(errno));
 
-	pthread_exit(NULL);
-}				/* _9p_socket_thread */
+		rc = pthread_create(&thrid, attr_thr, _9p_event_thread,
+				    (void *)(long int)_9p_epfds[i]);
+		if (rc != 0)
+			LogFatal(COMPONENT_THREAD,
+				 "Could not create 9p event thread, error = %d (%s)",
+				 rc, strerror(rc));
+	}
+}
 
 /**
  * _9p_create_socket_V4 : create the socket and bind for 9P using
@@ -540,10 +647,11 @@ err:
 void *_9p_dispatcher_thread(void *Arg)
 {
 	int _9p_socket;
-	int rc = 0;
 	long int newsock = -1;
 	pthread_attr_t attr_thr;
-	pthread_t tcp_thrid;
+	struct _9p_tcp_conn *tc;
+	struct epoll_event ev;
+	int epfd;
 
 	SetNameFunction("_9p_disp");
 
@@ -576,6 +684,8 @@ void *_9p_dispatcher_thread(void *Arg)
 		LogDebug(COMPONENT_9P_DISPATCH,
 			 "can't set pthread's join state");
 
+	_9p_start_event_threads(&attr_thr);
+
 	LogEvent(COMPONENT_9P_DISPATCH, "9P dispatcher started");
 
 	while (true) {
@@ -587,13 +697,19 @@ void *_9p_dispatcher_thread(void *Arg)
 			continue;
 		}
 
-		/* Starting the thread dedicated to signal handling */
-		rc = pthread_create(&tcp_thrid, &attr_thr,
-				    _9p_socket_thread, (void *)newsock);
-		if (rc != 0) {
-			LogFatal(COMPONENT_THREAD,
-				 "Could not create 9p socket manager thread, error = %d (%s)",
-				 errno, strerror(errno));
+		tc = _9p_tcp_conn_new(newsock);
+
+		/* Spread the connections over the event threads */
+		epfd = _9p_epfds[atomic_inc_uint32_t(&_9p_next_epfd) %
+				 _9p_param._9p_tcp_event_threads];
+
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = tc;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, newsock, &ev) == -1) {
+			LogCrit(COMPONENT_9P_DISPATCH,
+				"Could not poll 9p socket %ld, error = %d (%s)",
+				newsock, errno, strerror(errno));
+			_9p_tcp_conn_put(&tc->conn);
 		}
 	}			/* while */
 
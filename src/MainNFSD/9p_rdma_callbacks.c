@@ -115,6 +115,16 @@ void _9p_rdma_callback_disconnect(msk_trans_t *trans)
 	_9p_rdma_cleanup_conn(trans);
 }
 
+/**
+ * @brief Process a 9P request received over RDMA
+ *
+ * There is no copy of the payload on this path: the request is parsed
+ * in place in the registered receive buffer, which Twrite hands to the
+ * FSAL as is, and the reply is built straight into a registered send
+ * buffer, which Tread has the FSAL read into. The receive buffer is
+ * posted back once the request is done with, the send buffer goes back
+ * to the outqueue on send completion.
+ */
 void _9p_rdma_process_request(struct _9p_request_data *req9p)
 {
 	uint32_t msglen;
@@ -123,7 +133,23 @@ void _9p_rdma_process_request(struct _9p_request_data *req9p)
 	struct _9p_rdma_priv *priv = _9p_rdma_priv_of(trans);
 	msk_data_t *dataout;
 
-	/* get output buffer and move forward in queue */
+	/* Use buffer received via RDMA as a 9P message */
+	req9p->_9pmsg = req9p->data->data;
+	msglen = *(uint32_t *)req9p->_9pmsg;
+
+	if (req9p->data->size < _9P_HDR_SIZE
+	    || msglen != req9p->data->size) {
+		LogMajor(COMPONENT_9P,
+			 "Malformed 9P/RDMA packet, bad header size");
+		/* send a rerror ? */
+		msk_post_recv(trans, req9p->data, _9p_rdma_callback_recv,
+			      _9p_rdma_callback_recv_err, NULL);
+		_9p_DiscardFlushHook(req9p);
+		return;
+	}
+
+	/* get output buffer and move forward in queue, only once the
+	 * request is known to be good so that none is held for nothing */
 	PTHREAD_MUTEX_lock(&priv->outqueue->lock);
 	while (priv->outqueue->data == NULL) {
 		LogDebug(COMPONENT_9P,
@@ -139,54 +165,41 @@ void _9p_rdma_process_request(struct _9p_request_data *req9p)
 	dataout->size = 0;
 	dataout->mr = priv->pernic->outmr;
 
-	/* Use buffer received via RDMA as a 9P message */
-	req9p->_9pmsg = req9p->data->data;
-	msglen = *(uint32_t *)req9p->_9pmsg;
+	LogFullDebug(COMPONENT_9P,
+		     "Received 9P/RDMA message of size %u",
+		     msglen);
 
-	if (req9p->data->size < _9P_HDR_SIZE
-	    || msglen != req9p->data->size) {
+	rc = _9p_process_buffer(req9p, dataout->data, &dataout->size);
+	if (rc != 1) {
 		LogMajor(COMPONENT_9P,
-			 "Malformed 9P/RDMA packet, bad header size");
-		/* send a rerror ? */
-		msk_post_recv(trans, req9p->data, _9p_rdma_callback_recv,
-			      _9p_rdma_callback_recv_err, NULL);
-	} else {
-		LogFullDebug(COMPONENT_9P,
-			     "Received 9P/RDMA message of size %u",
-			     msglen);
-
-		rc = _9p_process_buffer(req9p, dataout->data, &dataout->size);
-		if (rc != 1) {
-			LogMajor(COMPONENT_9P,
-				 "Could not process 9P buffer on trans %p",
-				 req9p->pconn->trans_data.rdma_trans);
-		}
+			 "Could not process 9P buffer on trans %p",
+			 req9p->pconn->trans_data.rdma_trans);
+	}
 
-		msk_post_recv(trans, req9p->data, _9p_rdma_callback_recv,
-			      _9p_rdma_callback_recv_err, NULL);
+	msk_post_recv(trans, req9p->data, _9p_rdma_callback_recv,
+		      _9p_rdma_callback_recv_err, NULL);
+
+	/* If earlier processing succeeded, post it */
+	if (rc == 1) {
+		if (0 !=
+		    msk_post_send(trans, dataout,
+				  _9p_rdma_callback_send,
+				  _9p_rdma_callback_send_err,
+				  NULL))
+			rc = -1;
+	}
 
-		/* If earlier processing succeeded, post it */
-		if (rc == 1) {
-			if (0 !=
-			    msk_post_send(trans, dataout,
-					  _9p_rdma_callback_send,
-					  _9p_rdma_callback_send_err,
-					  NULL))
-				rc = -1;
-		}
-
-		if (rc != 1) {
-			LogMajor(COMPONENT_9P,
-				 "Could not send buffer on trans %p",
-				 req9p->pconn->trans_data.rdma_trans);
-			/* Give the buffer back right away
-			 * since no buffer is being sent */
-			PTHREAD_MUTEX_lock(&priv->outqueue->lock);
-			dataout->next = priv->outqueue->data;
-			priv->outqueue->data = dataout;
-			pthread_cond_signal(&priv->outqueue->cond);
-			PTHREAD_MUTEX_unlock(&priv->outqueue->lock);
-		}
+	if (rc != 1) {
+		LogMajor(COMPONENT_9P,
+			 "Could not send buffer on trans %p",
+			 req9p->pconn->trans_data.rdma_trans);
+		/* Give the buffer back right away
+		 * since no buffer is being sent */
+		PTHREAD_MUTEX_lock(&priv->outqueue->lock);
+		dataout->next = priv->outqueue->data;
+		priv->outqueue->data = dataout;
+		pthread_cond_signal(&priv->outqueue->cond);
+		PTHREAD_MUTEX_unlock(&priv->outqueue->lock);
 	}
 	_9p_DiscardFlushHook(req9p);
 }
@@ -197,7 +210,7 @@ void _9p_rdma_callback_recv(msk_trans_t *trans, msk_data_t *data, void *arg)
 	u16 tag = 0;
 	char *_9pmsg = NULL;
 
-	req = pool_alloc(request_pool);
+	req = pool_alloc(request_9p_pool);
 
 	req->rtype = _9P_REQUEST;
 	req->r_u._9p._9pmsg = _9pmsg;
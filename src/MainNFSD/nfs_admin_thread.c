@@ -32,7 +32,9 @@
 #include "config.h"
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <pthread.h>
+#include "abstract_atomic.h"
 #include "nfs_core.h"
 #include "log.h"
 #include "sal_functions.h"
@@ -41,7 +43,14 @@
 #include "delayed_exec.h"
 #include "export_mgr.h"
 #include "fsal.h"
+#include "mdcache.h"
 #include "netgroup_cache.h"
+#include "nfs_proto_functions.h"
+#include "nfs_metrics.h"
+#include "server_stats.h"
+#include "nfs_dupreq.h"
+#include "gsh_mem_pressure.h"
+#include "nsm.h"
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
 #endif
@@ -110,6 +119,66 @@ static struct gsh_dbus_method method_get_grace = {
 		 END_ARG_LIST}
 };
 
+/**
+ * @brief Dbus method get grace period progress
+ *
+ * @param[in]  args  dbus args
+ * @param[out] reply dbus reply message with grace period progress
+ */
+static bool admin_dbus_get_grace_status(DBusMessageIter *args,
+					DBusMessage *reply,
+					DBusError *error)
+{
+	char *errormsg = "get grace status success";
+	bool success = true;
+	DBusMessageIter iter;
+	dbus_bool_t ingrace;
+	uint32_t remaining, clients, reclaimed;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args != NULL) {
+		errormsg = "Get grace status takes no arguments.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+		goto out;
+	}
+
+	ingrace = nfs_in_grace();
+	nfs_grace_status(&remaining, &clients, &reclaimed);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_BOOLEAN, &ingrace);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &remaining);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &clients);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &reclaimed);
+
+ out:
+	dbus_status_reply(&iter, success, errormsg);
+	return success;
+}
+
+static struct gsh_dbus_method method_get_grace_status = {
+	.name = "get_grace_status",
+	.method = admin_dbus_get_grace_status,
+	.args = {
+		 {.name = "isgrace",
+		  .type = "b",
+		  .direction = "out",
+		 },
+		 {.name = "remaining",
+		  .type = "u",
+		  .direction = "out",
+		 },
+		 {.name = "clients",
+		  .type = "u",
+		  .direction = "out",
+		 },
+		 {.name = "reclaimed",
+		  .type = "u",
+		  .direction = "out",
+		 },
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
 /**
  * @brief Dbus method start grace period
  *
@@ -285,12 +354,286 @@ static struct gsh_dbus_method method_purge_netgroups = {
 		 END_ARG_LIST}
 };
 
+/**
+ * @brief Parameters that can be changed while the server runs
+ *
+ * Each is named as in the configuration file and keeps the range it
+ * has there.
+ */
+
+struct admin_tunable {
+	const char *name;
+	uint64_t min;
+	uint64_t max;
+	uint64_t (*get)(void);
+	int (*set)(uint64_t value);
+};
+
+static uint64_t tunable_get_nb_worker(void)
+{
+	return nfs_param.core_param.nb_worker;
+}
+
+static int tunable_set_nb_worker(uint64_t value)
+{
+	return worker_resize(value);
+}
+
+static uint64_t tunable_get_max_reqs(void)
+{
+	return nfs_param.core_param.dispatch_max_reqs;
+}
+
+static int tunable_set_max_reqs(uint64_t value)
+{
+	atomic_store_uint32_t(&nfs_param.core_param.dispatch_max_reqs, value);
+	return 0;
+}
+
+static uint64_t tunable_get_max_reqs_xprt(void)
+{
+	return nfs_param.core_param.dispatch_max_reqs_xprt;
+}
+
+static int tunable_set_max_reqs_xprt(uint64_t value)
+{
+	atomic_store_uint32_t(&nfs_param.core_param.dispatch_max_reqs_xprt,
+			      value);
+	return 0;
+}
+
+static uint64_t tunable_get_hwmark(void)
+{
+	return mdcache_lru_get_hwmark();
+}
+
+static int tunable_set_hwmark(uint64_t value)
+{
+	mdcache_lru_set_hwmark(value);
+	return 0;
+}
+
+static uint64_t tunable_get_lru_interval(void)
+{
+	return mdcache_lru_get_run_interval();
+}
+
+static int tunable_set_lru_interval(uint64_t value)
+{
+	mdcache_lru_set_run_interval(value);
+	return 0;
+}
+
+static uint64_t tunable_get_drc_tcp_size(void)
+{
+	return nfs_param.core_param.drc.tcp.size;
+}
+
+static int tunable_set_drc_tcp_size(uint64_t value)
+{
+	atomic_store_uint32_t(&nfs_param.core_param.drc.tcp.size, value);
+	return 0;
+}
+
+static uint64_t tunable_get_drc_tcp_hiwat(void)
+{
+	return nfs_param.core_param.drc.tcp.hiwat;
+}
+
+static int tunable_set_drc_tcp_hiwat(uint64_t value)
+{
+	atomic_store_uint32_t(&nfs_param.core_param.drc.tcp.hiwat, value);
+	return 0;
+}
+
+static uint64_t tunable_get_drc_udp_size(void)
+{
+	return nfs_param.core_param.drc.udp.size;
+}
+
+static int tunable_set_drc_udp_size(uint64_t value)
+{
+	atomic_store_uint32_t(&nfs_param.core_param.drc.udp.size, value);
+	drc_update_udp_limits();
+	return 0;
+}
+
+static uint64_t tunable_get_drc_udp_hiwat(void)
+{
+	return nfs_param.core_param.drc.udp.hiwat;
+}
+
+static int tunable_set_drc_udp_hiwat(uint64_t value)
+{
+	atomic_store_uint32_t(&nfs_param.core_param.drc.udp.hiwat, value);
+	drc_update_udp_limits();
+	return 0;
+}
+
+static struct admin_tunable admin_tunables[] = {
+	{"Nb_Worker", 1, 1024*128,
+	 tunable_get_nb_worker, tunable_set_nb_worker},
+	{"Dispatch_Max_Reqs", 1, 10000,
+	 tunable_get_max_reqs, tunable_set_max_reqs},
+	{"Dispatch_Max_Reqs_Xprt", 1, 2048,
+	 tunable_get_max_reqs_xprt, tunable_set_max_reqs_xprt},
+	{"Entries_HWMark", 1, UINT32_MAX,
+	 tunable_get_hwmark, tunable_set_hwmark},
+	{"LRU_Run_Interval", 1, 24 * 60 * 60,
+	 tunable_get_lru_interval, tunable_set_lru_interval},
+	{"DRC_TCP_Size", 1, 32767,
+	 tunable_get_drc_tcp_size, tunable_set_drc_tcp_size},
+	{"DRC_TCP_Hiwat", 1, 256,
+	 tunable_get_drc_tcp_hiwat, tunable_set_drc_tcp_hiwat},
+	{"DRC_UDP_Size", 512, 32768,
+	 tunable_get_drc_udp_size, tunable_set_drc_udp_size},
+	{"DRC_UDP_Hiwat", 1, 32768,
+	 tunable_get_drc_udp_hiwat, tunable_set_drc_udp_hiwat},
+	{NULL, 0, 0, NULL, NULL}
+};
+
+/**
+ * @brief Dbus method for changing a tunable parameter
+ *
+ * @param[in]  args  Name of the parameter and its new value
+ * @param[out] reply Status
+ */
+static bool admin_dbus_set_tunable(DBusMessageIter *args,
+				   DBusMessage *reply,
+				   DBusError *error)
+{
+	char *errormsg = "Tunable set";
+	bool success = true;
+	DBusMessageIter iter;
+	struct admin_tunable *t;
+	char *name = NULL;
+	uint64_t value;
+	int rc;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		errormsg = "Set tunable takes a name and a value.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &name);
+
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT64) {
+		errormsg = "Set tunable arg 2 not a uint64.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &value);
+
+	for (t = admin_tunables; t->name != NULL; t++)
+		if (strcasecmp(t->name, name) == 0)
+			break;
+
+	if (t->name == NULL) {
+		errormsg = "No such tunable.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s %s", errormsg, name);
+		goto out;
+	}
+
+	if (value < t->min || value > t->max) {
+		errormsg = "Tunable value out of range.";
+		success = false;
+		LogWarn(COMPONENT_DBUS,
+			"%s %s %"PRIu64" not in %"PRIu64"..%"PRIu64,
+			errormsg, t->name, value, t->min, t->max);
+		goto out;
+	}
+
+	rc = t->set(value);
+	if (rc != 0) {
+		errormsg = "Failed to apply tunable.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s %s error %d",
+			errormsg, t->name, rc);
+		goto out;
+	}
+
+	LogEvent(COMPONENT_DBUS, "%s set to %"PRIu64, t->name, value);
+
+ out:
+	dbus_status_reply(&iter, success, errormsg);
+	return success;
+}
+
+static struct gsh_dbus_method method_set_tunable = {
+	.name = "set_tunable",
+	.method = admin_dbus_set_tunable,
+	.args = {{.name = "name",
+		  .type = "s",
+		  .direction = "in"},
+		 {.name = "value",
+		  .type = "t",
+		  .direction = "in"},
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * @brief Dbus method for listing the tunable parameters
+ *
+ * @param[in]  args  Unused
+ * @param[out] reply Array of name, value, min and max
+ */
+static bool admin_dbus_get_tunables(DBusMessageIter *args,
+				    DBusMessage *reply,
+				    DBusError *error)
+{
+	DBusMessageIter iter, array_iter, struct_iter;
+	struct admin_tunable *t;
+	uint64_t value;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(sttt)",
+					 &array_iter);
+
+	for (t = admin_tunables; t->name != NULL; t++) {
+		value = t->get();
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING, &t->name);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &value);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &t->min);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &t->max);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+
+	dbus_message_iter_close_container(&iter, &array_iter);
+	return true;
+}
+
+static struct gsh_dbus_method method_get_tunables = {
+	.name = "get_tunables",
+	.method = admin_dbus_get_tunables,
+	.args = {{.name = "tunables",
+		  .type = "a(sttt)",
+		  .direction = "out"},
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method *admin_methods[] = {
 	&method_shutdown,
 	&method_grace_period,
 	&method_get_grace,
+	&method_get_grace_status,
 	&method_purge_gids,
 	&method_purge_netgroups,
+	&method_set_tunable,
+	&method_get_tunables,
 	NULL
 };
 
@@ -356,10 +699,22 @@ static void do_shutdown(void)
 
 	LogEvent(COMPONENT_MAIN, "NFS EXIT: stopping NFS service");
 
+	LogEvent(COMPONENT_MAIN, "Stopping socket handoff listener.");
+	nfs_handoff_shutdown();
+
+	LogEvent(COMPONENT_MAIN, "Stopping metrics endpoint.");
+	metrics_shutdown();
+
+	LogEvent(COMPONENT_MAIN, "Stopping statistics segment.");
+	stats_shm_shutdown();
+
 	LogEvent(COMPONENT_MAIN, "Stopping delayed executor.");
 	delayed_shutdown();
 	LogEvent(COMPONENT_MAIN, "Delayed executor stopped.");
 
+	LogEvent(COMPONENT_MAIN, "Stopping cluster grace thread.");
+	nfs4_cluster_grace_shutdown();
+
 	LogEvent(COMPONENT_MAIN, "Stopping state asynchronous request thread");
 	rc = state_async_shutdown();
 	if (rc != 0) {
@@ -372,6 +727,11 @@ static void do_shutdown(void)
 			 "State asynchronous request system shut down.");
 	}
 
+#ifdef _USE_NLM
+	LogEvent(COMPONENT_MAIN, "Stopping NSM asynchronous request thread");
+	nsm_async_shutdown();
+#endif /* _USE_NLM */
+
 	LogEvent(COMPONENT_MAIN, "Stopping request listener threads.");
 	nfs_rpc_dispatch_stop();
 
@@ -409,6 +769,15 @@ static void do_shutdown(void)
 			 "Worker threads successfully shut down.");
 	}
 
+	rc = nfs4_copy_pkgshutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down copy fridge: %d", rc);
+		disorderly = true;
+	} else {
+		LogEvent(COMPONENT_THREAD, "Copy fridge shut down.");
+	}
+
 	rc = general_fridge_shutdown();
 	if (rc != 0) {
 		LogMajor(COMPONENT_THREAD,
@@ -427,6 +796,19 @@ static void do_shutdown(void)
 		LogEvent(COMPONENT_THREAD, "Reaper thread shut down.");
 	}
 
+	rc = mem_pressure_shutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down memory pressure thread: %d", rc);
+		disorderly = true;
+	} else {
+		LogEvent(COMPONENT_THREAD,
+			 "Memory pressure thread shut down.");
+	}
+
+	/* Nothing touches the cache anymore, save what is hot in it */
+	mdcache_snapshot_save();
+
 	LogEvent(COMPONENT_MAIN, "Removing all exports.");
 	remove_all_exports();
 
@@ -0,0 +1,410 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_handoff.c
+ * @brief Hand the listening sockets over to a new server
+ *
+ * With Handoff_Socket set, a running server listens on that Unix
+ * socket.  A new server started with the same setting connects to it
+ * before making its own sockets and is sent the listening sockets of
+ * the old one.  The old server then shuts down, leaving the sockets,
+ * and their rpcbind registrations, to the new one.  Clients never see
+ * a refused connection or a missing program, they only reconnect.
+ *
+ * Only the old process may answer, the peer must run as the same
+ * user.
+ */
+
+#include "config.h"
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "fridgethr.h"
+#include "abstract_atomic.h"
+
+#define HANDOFF_MAGIC 0x4e465348	/* "NFSH" */
+#define HANDOFF_VERSION 1
+
+/** Two sockets per protocol at most */
+#define HANDOFF_MAX_FDS (2 * P_COUNT)
+
+/** Seconds the new server waits for the old one */
+#define HANDOFF_TIMEOUT 10
+
+struct handoff_sock {
+	int32_t proto;		/*< protos index */
+	int32_t type;		/*< SOCK_DGRAM or SOCK_STREAM */
+};
+
+struct handoff_msg {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t v6disabled;
+	struct handoff_sock sock[HANDOFF_MAX_FDS];
+};
+
+static struct fridgethr *handoff_fridge;
+static int handoff_fd = -1;
+static uint32_t handoff_given;
+
+static int handoff_address(struct sockaddr_un *addr)
+{
+	const char *path = nfs_param.core_param.handoff_socket;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		LogCrit(COMPONENT_INIT, "Handoff_Socket %s is too long", path);
+		return ENAMETOOLONG;
+	}
+
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+/**
+ * @brief Take the listening sockets of a running server
+ *
+ * @param[out] udp        UDP sockets by protocol, -1 where none
+ * @param[out] tcp        TCP sockets by protocol, -1 where none
+ * @param[out] v6disabled Whether the sockets are IPv4 ones
+ *
+ * @return true if the sockets were handed over, already bound.
+ */
+bool nfs_handoff_receive(int *udp, int *tcp, bool *v6disabled)
+{
+	struct handoff_msg msg;
+	char cbuf[CMSG_SPACE(HANDOFF_MAX_FDS * sizeof(int))];
+	struct iovec iov = { &msg, sizeof(msg) };
+	struct msghdr mh = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct sockaddr_un addr;
+	struct pollfd pfd;
+	struct cmsghdr *cmsg;
+	int *fds = NULL;
+	int nfds = 0;
+	int fd, i;
+	ssize_t len;
+
+	if (nfs_param.core_param.handoff_socket == NULL ||
+	    handoff_address(&addr) != 0)
+		return false;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return false;
+
+	/* Nobody there, this is a plain start */
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		LogInfo(COMPONENT_INIT, "No server to take over at %s: %s",
+			addr.sun_path, strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, HANDOFF_TIMEOUT * 1000) <= 0) {
+		LogCrit(COMPONENT_INIT,
+			"Server at %s did not hand its sockets over",
+			addr.sun_path);
+		close(fd);
+		return false;
+	}
+
+	len = recvmsg(fd, &mh, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+	close(fd);
+
+	for (cmsg = CMSG_FIRSTHDR(&mh); cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_RIGHTS) {
+			fds = (int *)CMSG_DATA(cmsg);
+			nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			break;
+		}
+	}
+
+	if (len != sizeof(msg) || msg.magic != HANDOFF_MAGIC ||
+	    msg.version != HANDOFF_VERSION || msg.count != (uint32_t)nfds ||
+	    (mh.msg_flags & MSG_CTRUNC)) {
+		LogCrit(COMPONENT_INIT,
+			"Bad handoff from %s, making new sockets",
+			addr.sun_path);
+		for (i = 0; i < nfds; i++)
+			close(fds[i]);
+		return false;
+	}
+
+	for (i = 0; i < P_COUNT; i++) {
+		udp[i] = -1;
+		tcp[i] = -1;
+	}
+
+	for (i = 0; i < nfds; i++) {
+		if (msg.sock[i].proto < 0 || msg.sock[i].proto >= P_COUNT) {
+			close(fds[i]);
+			continue;
+		}
+		if (msg.sock[i].type == SOCK_DGRAM)
+			udp[msg.sock[i].proto] = fds[i];
+		else
+			tcp[msg.sock[i].proto] = fds[i];
+	}
+
+	*v6disabled = msg.v6disabled;
+
+	LogEvent(COMPONENT_INIT, "Took over %d listening sockets from %s",
+		 nfds, addr.sun_path);
+	return true;
+}
+
+/**
+ * @brief Send our listening sockets to a new server
+ *
+ * @param[in] fd Connection from the new server
+ *
+ * @return true if they were sent.
+ */
+static bool handoff_send(int fd)
+{
+	struct handoff_msg msg;
+	int fds[HANDOFF_MAX_FDS];
+	char cbuf[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov = { &msg, sizeof(msg) };
+	struct msghdr mh = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+	};
+	struct cmsghdr *cmsg;
+	struct ucred cred;
+	socklen_t credlen = sizeof(cred);
+	int p, n = 0;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) != 0 ||
+	    cred.uid != geteuid()) {
+		LogWarn(COMPONENT_MAIN,
+			"Refusing socket handoff to a process of another user");
+		return false;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.magic = HANDOFF_MAGIC;
+	msg.version = HANDOFF_VERSION;
+	msg.v6disabled = v6disabled;
+
+	for (p = 0; p < P_COUNT; p++) {
+		if (udp_socket[p] >= 0) {
+			msg.sock[n].proto = p;
+			msg.sock[n].type = SOCK_DGRAM;
+			fds[n++] = udp_socket[p];
+		}
+		if (tcp_socket[p] >= 0) {
+			msg.sock[n].proto = p;
+			msg.sock[n].type = SOCK_STREAM;
+			fds[n++] = tcp_socket[p];
+		}
+	}
+
+	if (n == 0)
+		return false;
+
+	msg.count = n;
+	memset(cbuf, 0, sizeof(cbuf));
+	mh.msg_controllen = CMSG_SPACE(n * sizeof(int));
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(n * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, n * sizeof(int));
+
+	/* Keep rpcbind pointing at the sockets the new server now has */
+	atomic_store_uint32_t(&handoff_given, 1);
+
+	if (sendmsg(fd, &mh, MSG_NOSIGNAL) != sizeof(msg)) {
+		atomic_store_uint32_t(&handoff_given, 0);
+		LogCrit(COMPONENT_MAIN, "Socket handoff failed: %s",
+			strerror(errno));
+		return false;
+	}
+
+	LogEvent(COMPONENT_MAIN,
+		 "Handed %d listening sockets over, shutting down", n);
+	return true;
+}
+
+/**
+ * @brief Wait for a new server to take over
+ *
+ * @param[in] ctx Thread context
+ */
+static void handoff_run(struct fridgethr_context *ctx)
+{
+	struct pollfd pfd;
+	int fd, rc;
+
+	SetNameFunction("handoff");
+
+	pfd.fd = handoff_fd;
+	pfd.events = POLLIN;
+
+	/* Once is enough, the sockets are not ours to give any more */
+	while (!fridgethr_you_should_break(ctx) && !nfs_handoff_given()) {
+		rc = poll(&pfd, 1, 1000);
+		if (rc <= 0)
+			continue;
+
+		fd = accept4(handoff_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		if (handoff_send(fd))
+			admin_halt();
+
+		close(fd);
+	}
+}
+
+/**
+ * @brief Listen for a new server, if Handoff_Socket is set
+ *
+ * Called once our own sockets are up.  A server that took over from
+ * another replaces its Unix socket.
+ *
+ * @return 0 on success or when disabled, an errno otherwise.
+ */
+int nfs_handoff_start(void)
+{
+	struct fridgethr_params frp;
+	struct sockaddr_un addr;
+	int rc;
+
+	if (nfs_param.core_param.handoff_socket == NULL)
+		return 0;
+
+	rc = handoff_address(&addr);
+	if (rc != 0)
+		return rc;
+
+	handoff_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (handoff_fd < 0) {
+		rc = errno;
+		LogCrit(COMPONENT_MAIN, "Could not create handoff socket: %s",
+			strerror(rc));
+		return rc;
+	}
+
+	(void)unlink(addr.sun_path);
+
+	if (bind(handoff_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    chmod(addr.sun_path, 0600) != 0 || listen(handoff_fd, 1) != 0) {
+		rc = errno;
+		LogCrit(COMPONENT_MAIN, "Could not listen for handoff on %s: %s",
+			addr.sun_path, strerror(rc));
+		goto err;
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = 1;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&handoff_fridge, "handoff", &frp);
+	if (rc != 0) {
+		LogCrit(COMPONENT_MAIN,
+			"Unable to initialize handoff fridge, error code %d.",
+			rc);
+		goto err;
+	}
+
+	rc = fridgethr_submit(handoff_fridge, handoff_run, NULL);
+	if (rc != 0) {
+		LogCrit(COMPONENT_MAIN,
+			"Unable to start handoff thread, error code %d.", rc);
+		fridgethr_destroy(handoff_fridge);
+		handoff_fridge = NULL;
+		goto err;
+	}
+
+	LogEvent(COMPONENT_MAIN, "Sockets may be taken over through %s",
+		 addr.sun_path);
+	return 0;
+
+ err:
+	close(handoff_fd);
+	handoff_fd = -1;
+	return rc;
+}
+
+/**
+ * @brief Stop listening for a new server
+ *
+ * The Unix socket is left in place after a handoff, it belongs to the
+ * new server by then.
+ */
+void nfs_handoff_shutdown(void)
+{
+	int rc;
+
+	if (handoff_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(handoff_fridge, fridgethr_comm_stop, 10);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_MAIN,
+			 "Shutdown timed out, cancelling handoff thread.");
+		fridgethr_cancel(handoff_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_MAIN,
+			 "Failed shutting down handoff thread: %d", rc);
+	}
+
+	fridgethr_destroy(handoff_fridge);
+	handoff_fridge = NULL;
+	close(handoff_fd);
+	handoff_fd = -1;
+
+	if (!nfs_handoff_given())
+		(void)unlink(nfs_param.core_param.handoff_socket);
+}
+
+/**
+ * @brief Whether our sockets now belong to another server
+ */
+bool nfs_handoff_given(void)
+{
+	return atomic_fetch_uint32_t(&handoff_given) != 0;
+}
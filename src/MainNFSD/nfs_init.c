@@ -38,6 +38,8 @@
 #include "nfs_exports.h"
 #include "nfs_ip_stats.h"
 #include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+#include "gsh_numa.h"
 #include "nfs_dupreq.h"
 #include "config_parsing.h"
 #include "nfs4_acls.h"
@@ -64,6 +66,8 @@
 #include "delayed_exec.h"
 #include "client_mgr.h"
 #include "export_mgr.h"
+#include "server_stats.h"
+#include "nfs_metrics.h"
 #ifdef USE_CAPS
 #include <sys/capability.h>	/* For capget/capset */
 #endif
@@ -71,6 +75,7 @@
 #include "netgroup_cache.h"
 #include "pnfs_utils.h"
 #include "mdcache.h"
+#include "gsh_mem_pressure.h"
 #include <execinfo.h>
 
 
@@ -107,6 +112,8 @@ pthread_t nfs_rdma_dispatcher_thrid;
 
 char *config_path = GANESHA_CONFIG_PATH;
 
+char *config_cache_path;
+
 char *pidfile_path = GANESHA_PIDFILE_PATH;
 
 /**
@@ -147,7 +154,8 @@ void reread_config(void)
 	if (!init_error_type(&err_type))
 		return;
 	/* Attempt to parse the new configuration file */
-	config_struct = config_ParseFile(config_path, &err_type);
+	config_struct = config_ParseFile_cached(config_path, config_cache_path,
+						&err_type);
 	if (!config_error_no_error(&err_type)) {
 		config_Free(config_struct);
 		LogCrit(COMPONENT_CONFIG,
@@ -410,6 +418,20 @@ int nfs_set_param_from_conf(config_file_t parse_tree,
 	}
 #endif
 
+#ifdef USE_TLS
+	/* RPC-with-TLS configuration */
+	(void) load_config_from_parse(parse_tree,
+				      &tls_param,
+				      &nfs_param.tls_param,
+				      true,
+				      err_type);
+	if (!config_error_is_harmless(err_type)) {
+		LogCrit(COMPONENT_INIT,
+			"Error while parsing NFS_TLS configuration");
+		return -1;
+	}
+#endif
+
 	/* NFSv4 specific configuration */
 	(void) load_config_from_parse(parse_tree,
 				      &version4_param,
@@ -449,7 +471,7 @@ int init_server_pkgs(void)
 	state_status_t state_status;
 
 	/* init uid2grp cache */
-	uid2grp_cache_init();
+	uid2grp_init();
 
 	ng_cache_init(); /* netgroup cache */
 
@@ -601,6 +623,23 @@ static void nfs_Start_threads(void)
 	}
 	LogEvent(COMPONENT_THREAD, "reaper thread was started successfully");
 
+	/* Starting the metrics endpoint, if configured */
+	(void)metrics_start();
+
+	/* Starting the shared-memory statistics, if configured */
+	(void)stats_shm_start();
+
+	/* Listening for a server to take our sockets, if configured */
+	(void)nfs_handoff_start();
+
+	/* Starting the memory pressure monitor, if configured */
+	rc = mem_pressure_start();
+	if (rc != 0) {
+		LogFatal(COMPONENT_THREAD,
+			 "Could not start memory pressure monitor, error = %d (%s)",
+			 rc, strerror(rc));
+	}
+
 	/* Starting the general fridge */
 	rc = general_fridge_init();
 	if (rc != 0) {
@@ -610,6 +649,15 @@ static void nfs_Start_threads(void)
 	}
 	LogEvent(COMPONENT_THREAD, "General fridge was started successfully");
 
+	/* Starting the threads of asynchronous copies */
+	rc = nfs4_copy_pkginit();
+	if (rc != 0) {
+		LogFatal(COMPONENT_THREAD,
+			 "Could not create copy fridge, error = %d (%s)",
+			 rc, strerror(rc));
+	}
+	LogEvent(COMPONENT_THREAD, "Copy fridge was started successfully");
+
 }
 
 /**
@@ -626,6 +674,8 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	char GssError[MAXNAMLEN + 1];
 #endif
 
+	server_stats_init();
+
 #ifdef USE_DBUS
 	/* DBUS init */
 	gsh_dbus_pkginit();
@@ -647,7 +697,20 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	    pool_basic_init("NFSv4.1 session pool", sizeof(nfs41_session_t));
 
 	request_pool =
-	    pool_basic_init("Request pool", sizeof(request_data_t));
+	    pool_magazine_init("Request pool", sizeof(request_data_t));
+	request_call_pool =
+	    pool_basic_init("Callback request pool", REQUEST_DATA_SIZE(call));
+#ifdef _USE_9P
+	request_9p_pool =
+	    pool_magazine_init("9P request pool", REQUEST_DATA_SIZE(_9p));
+#endif
+
+	nfs_read_iov_pkginit();
+#ifdef _USE_NFS3
+	nfs3_readdir_cache_pkginit();
+#endif
+
+	gsh_numa_init();
 
 	/* If rpcsec_gss is used, set the path to the keytab */
 #ifdef _HAVE_GSSAPI
@@ -710,6 +773,11 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 #endif				/* HAVE_KRB5 */
 #endif				/* _HAVE_GSSAPI */
 
+#ifdef USE_TLS
+	/* Certificate and key for RPC-with-TLS - exits on failure */
+	nfs_rpc_tls_init();
+#endif
+
 	/* RPC Initialisation - exits on failure */
 	nfs_Init_svc();
 	LogInfo(COMPONENT_INIT, "RPC resources successfully initialized");
@@ -769,6 +837,7 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 		LogInfo(COMPONENT_INIT,
 			"NLM State cache successfully initialized");
 		nlm_init();
+		nsm_async_init();
 	}
 #endif /* _USE_NLM */
 #ifdef _USE_9P
@@ -810,10 +879,10 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	/* Save Ganesha thread credentials with Frank's routine for later use */
 	fsal_save_ganesha_credentials();
 
-	/* Create stable storage directory, this needs to be done before
+	/* Set up stable storage, this needs to be done before
 	 * starting the recovery thread.
 	 */
-	nfs4_create_recov_dir();
+	nfs4_recovery_init();
 
 	/* read in the client IDs */
 	nfs4_load_recov_clids(NULL);
@@ -821,6 +890,9 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	/* Start grace period */
 	nfs4_start_grace(NULL);
 
+	/* Prewarm the cache while clients are kept out by the grace */
+	mdcache_snapshot_restore();
+
 	/* callback dispatch */
 	nfs_rpc_cb_pkginit();
 #ifdef _USE_CB_SIMULATOR
@@ -965,7 +1037,7 @@ void nfs_start(nfs_start_info_t *p_start_info)
 
 	/* if not in grace period, clean up the old state directory */
 	if (!nfs_in_grace())
-		nfs4_clean_old_recov_dir(v4_old_dir);
+		nfs4_recovery_cleanup();
 
 	Cleanup();
 
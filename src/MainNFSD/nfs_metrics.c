@@ -0,0 +1,427 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_metrics.c
+ * @brief Serve the server counters in OpenMetrics text format
+ *
+ * A single thread accepts HTTP connections on Metrics_Port and
+ * answers GET /metrics, one request per connection.  Scrapes are
+ * rare and small, so nothing fancier is needed, and unlike DBus the
+ * rendering does not go through the thread serving admin requests.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "fridgethr.h"
+#include "nfs_metrics.h"
+#include "gsh_lat_hist.h"
+
+/** Largest request head we read */
+#define METRICS_REQ_MAX 4096
+
+/** Seconds a scraper gets to send its request and read the reply */
+#define METRICS_IO_TIMEOUT 5
+
+#define METRICS_CONTENT_TYPE \
+	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/** Most sources loadable modules may register */
+#define METRICS_SOURCES_MAX 8
+
+static struct fridgethr *metrics_fridge;
+static int metrics_fd = -1;
+
+/** Registered sources, protected by metrics_sources_mtx */
+static metrics_source_t metrics_sources[METRICS_SOURCES_MAX];
+static pthread_mutex_t metrics_sources_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Add a source of metric families to every scrape
+ *
+ * A module unregisters its source before it goes away, a scrape in
+ * progress is waited for.
+ *
+ * @param[in] source Function writing the families
+ *
+ * @retval 0 on success.
+ * @retval ENOSPC if METRICS_SOURCES_MAX are registered.
+ */
+int metrics_register(metrics_source_t source)
+{
+	int i, rc = ENOSPC;
+
+	PTHREAD_MUTEX_lock(&metrics_sources_mtx);
+	for (i = 0; i < METRICS_SOURCES_MAX; i++) {
+		if (metrics_sources[i] == NULL) {
+			metrics_sources[i] = source;
+			rc = 0;
+			break;
+		}
+	}
+	PTHREAD_MUTEX_unlock(&metrics_sources_mtx);
+
+	return rc;
+}
+
+/**
+ * @brief Remove a source added by metrics_register()
+ *
+ * @param[in] source Function writing the families
+ */
+void metrics_unregister(metrics_source_t source)
+{
+	int i;
+
+	PTHREAD_MUTEX_lock(&metrics_sources_mtx);
+	for (i = 0; i < METRICS_SOURCES_MAX; i++) {
+		if (metrics_sources[i] == source)
+			metrics_sources[i] = NULL;
+	}
+	PTHREAD_MUTEX_unlock(&metrics_sources_mtx);
+}
+
+/**
+ * @brief Write a metric family with a single counter sample
+ *
+ * @param[in] out   Reply stream
+ * @param[in] name  Family name, without the _total suffix
+ * @param[in] help  Description of the counter
+ * @param[in] value Value of the counter
+ */
+void metrics_counter(FILE *out, const char *name, const char *help,
+		     uint64_t value)
+{
+	fprintf(out, "# TYPE %s counter\n# HELP %s %s\n%s_total %" PRIu64 "\n",
+		name, name, help, name, value);
+}
+
+/**
+ * @brief Write a metric family with a single gauge sample
+ *
+ * @param[in] out   Reply stream
+ * @param[in] name  Family name
+ * @param[in] help  Description of the gauge
+ * @param[in] value Value of the gauge
+ */
+void metrics_gauge(FILE *out, const char *name, const char *help,
+		   double value)
+{
+	fprintf(out, "# TYPE %s gauge\n# HELP %s %s\n%s %.9g\n",
+		name, name, help, name, value);
+}
+
+/**
+ * @brief Write the samples of a latency histogram
+ *
+ * Only the power of two bucket bounds are reported, the sub-buckets
+ * would multiply the size of a scrape by LAT_HIST_SUB.
+ *
+ * @param[in] out     Reply stream
+ * @param[in] name    Family name
+ * @param[in] labels  Labels of the samples, without braces
+ * @param[in] h       The histogram
+ * @param[in] sum     Total latency in seconds, negative if unknown
+ */
+void metrics_lat_hist(FILE *out, const char *name, const char *labels,
+		      struct lat_hist *h, double sum)
+{
+	const char *sep = labels[0] != '\0' ? "," : "";
+	uint64_t count = 0;
+	int i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS - 1; i++) {
+		count += h->bucket[i];
+		if (i % LAT_HIST_SUB == 0)
+			fprintf(out, "%s_bucket{%s%sle=\"%.9g\"} %" PRIu64
+				"\n", name, labels, sep,
+				lat_hist_bound(i) / 1e9, count);
+	}
+	count += h->bucket[LAT_HIST_BUCKETS - 1];
+
+	fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %" PRIu64 "\n",
+		name, labels, sep, count);
+	if (sum >= 0)
+		fprintf(out, "%s_sum{%s} %.9g\n", name, labels, sum);
+	fprintf(out, "%s_count{%s} %" PRIu64 "\n", name, labels, count);
+}
+
+/**
+ * @brief Send a whole buffer
+ *
+ * @return true if it was all sent.
+ */
+static bool metrics_send(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = send(fd, buf, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		buf += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Send a reply with no metrics
+ */
+static void metrics_reply_error(int fd, const char *status)
+{
+	char head[256];
+	int len;
+
+	len = snprintf(head, sizeof(head),
+		       "HTTP/1.1 %s\r\nContent-Length: 0\r\n"
+		       "Connection: close\r\n\r\n", status);
+	(void)metrics_send(fd, head, len);
+}
+
+/**
+ * @brief Answer one connection
+ *
+ * @param[in] fd The accepted connection
+ */
+static void metrics_serve(int fd)
+{
+	char req[METRICS_REQ_MAX];
+	char head[256];
+	struct timeval tv = {METRICS_IO_TIMEOUT, 0};
+	char *body = NULL;
+	size_t body_len = 0;
+	size_t len = 0;
+	const char *path;
+	FILE *out;
+	ssize_t n;
+	int hlen, i;
+
+	(void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	(void)setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	/* Read the request head, a GET has no body */
+	while (len < sizeof(req) - 1) {
+		n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return;
+		len += n;
+		req[len] = '\0';
+		if (strstr(req, "\r\n\r\n") != NULL ||
+		    strstr(req, "\n\n") != NULL)
+			break;
+	}
+	req[len] = '\0';
+
+	if (strncmp(req, "GET ", 4) != 0) {
+		metrics_reply_error(fd, "405 Method Not Allowed");
+		return;
+	}
+
+	path = req + 4;
+	if (strncmp(path, "/metrics", 8) != 0 ||
+	    (path[8] != ' ' && path[8] != '?')) {
+		metrics_reply_error(fd, "404 Not Found");
+		return;
+	}
+
+	out = open_memstream(&body, &body_len);
+	if (out == NULL) {
+		metrics_reply_error(fd, "500 Internal Server Error");
+		return;
+	}
+
+	server_stats_metrics(out);
+	mdcache_metrics(out);
+	dupreq_metrics(out);
+	nfs_rpc_metrics(out);
+	mem_metrics(out);
+	fridgethr_metrics(out);
+
+	PTHREAD_MUTEX_lock(&metrics_sources_mtx);
+	for (i = 0; i < METRICS_SOURCES_MAX; i++) {
+		if (metrics_sources[i] != NULL)
+			metrics_sources[i](out);
+	}
+	PTHREAD_MUTEX_unlock(&metrics_sources_mtx);
+
+	fputs("# EOF\n", out);
+	fclose(out);
+
+	hlen = snprintf(head, sizeof(head),
+			"HTTP/1.1 200 OK\r\nContent-Type: %s\r\n"
+			"Content-Length: %zu\r\nConnection: close\r\n\r\n",
+			METRICS_CONTENT_TYPE, body_len);
+
+	if (metrics_send(fd, head, hlen))
+		(void)metrics_send(fd, body, body_len);
+
+	free(body);
+}
+
+/**
+ * @brief Accept and answer scrapes until told to stop
+ *
+ * @param[in] ctx Thread context
+ */
+static void metrics_run(struct fridgethr_context *ctx)
+{
+	struct pollfd pfd;
+	int fd, rc;
+
+	SetNameFunction("metrics");
+
+	pfd.fd = metrics_fd;
+	pfd.events = POLLIN;
+
+	while (!fridgethr_you_should_break(ctx)) {
+		rc = poll(&pfd, 1, 1000);
+		if (rc <= 0)
+			continue;
+
+		fd = accept4(metrics_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno != EINTR && errno != EAGAIN)
+				LogDebug(COMPONENT_MAIN,
+					 "metrics accept failed: %s",
+					 strerror(errno));
+			continue;
+		}
+
+		metrics_serve(fd);
+		close(fd);
+	}
+}
+
+/**
+ * @brief Start the metrics endpoint if one is configured
+ *
+ * The endpoint listens on Bind_addr, the same address as the NFS
+ * services.  Failing to set it up is not fatal.
+ *
+ * @return 0 on success or when disabled, an errno otherwise.
+ */
+int metrics_start(void)
+{
+	struct fridgethr_params frp;
+	struct sockaddr_in addr;
+	int one = 1;
+	int rc;
+
+	if (nfs_param.core_param.metrics_port == 0)
+		return 0;
+
+	metrics_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (metrics_fd < 0) {
+		rc = errno;
+		LogCrit(COMPONENT_MAIN, "Could not create metrics socket: %s",
+			strerror(rc));
+		return rc;
+	}
+
+	(void)setsockopt(metrics_fd, SOL_SOCKET, SO_REUSEADDR, &one,
+			 sizeof(one));
+
+	addr = nfs_param.core_param.bind_addr;
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(nfs_param.core_param.metrics_port);
+
+	if (bind(metrics_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    listen(metrics_fd, 16) != 0) {
+		rc = errno;
+		LogCrit(COMPONENT_MAIN,
+			"Could not listen for metrics on port %" PRIu16 ": %s",
+			nfs_param.core_param.metrics_port, strerror(rc));
+		goto err;
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = 1;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&metrics_fridge, "metrics", &frp);
+	if (rc != 0) {
+		LogCrit(COMPONENT_MAIN,
+			"Unable to initialize metrics fridge, error code %d.",
+			rc);
+		goto err;
+	}
+
+	rc = fridgethr_submit(metrics_fridge, metrics_run, NULL);
+	if (rc != 0) {
+		LogCrit(COMPONENT_MAIN,
+			"Unable to start metrics thread, error code %d.", rc);
+		fridgethr_destroy(metrics_fridge);
+		metrics_fridge = NULL;
+		goto err;
+	}
+
+	LogEvent(COMPONENT_MAIN, "Serving metrics on port %" PRIu16,
+		 nfs_param.core_param.metrics_port);
+	return 0;
+
+ err:
+	close(metrics_fd);
+	metrics_fd = -1;
+	return rc;
+}
+
+/**
+ * @brief Stop the metrics endpoint
+ */
+void metrics_shutdown(void)
+{
+	int rc;
+
+	if (metrics_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(metrics_fridge, fridgethr_comm_stop, 10);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_MAIN,
+			 "Shutdown timed out, cancelling metrics thread.");
+		fridgethr_cancel(metrics_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_MAIN,
+			 "Failed shutting down metrics thread: %d", rc);
+	}
+
+	fridgethr_destroy(metrics_fridge);
+	metrics_fridge = NULL;
+	close(metrics_fd);
+	metrics_fd = -1;
+}
@@ -858,7 +858,7 @@ static inline void free_resop(nfs_cb_resop4 *op)
 
 rpc_call_t *alloc_rpc_call(void)
 {
-	request_data_t *reqdata = pool_alloc(request_pool);
+	request_data_t *reqdata = pool_alloc(request_call_pool);
 
 	reqdata->rtype = NFS_CALL;
 	return &reqdata->r_u.call;
@@ -875,7 +875,7 @@ void free_rpc_call(rpc_call_t *call)
 
 	free_argop(call->cbt.v_u.v4.args.argarray.argarray_val);
 	free_resop(call->cbt.v_u.v4.res.resarray.resarray_val);
-	pool_free(request_pool, reqdata);
+	pool_free(request_call_pool, reqdata);
 }
 
 /**
@@ -896,9 +896,22 @@ static inline void RPC_CALL_HOOK(rpc_call_t *call, rpc_call_hook hook,
 		call->call_hook(call, hook, arg, flags);
 }
 
+/**
+ * @brief Most CB_RECALLs merged into one CB_COMPOUND
+ */
+#define NFS_CB_BATCH_MAX 16
+
+static void nfs_rpc_drain_chan(rpc_call_channel_t *chan, rpc_call_t *call);
+
 /**
  * @brief Fire off an RPC call
  *
+ * Calls are serialized per channel.  The first call on an idle channel
+ * is handed to a worker; calls submitted while that worker is busy are
+ * queued on the channel and sent by the same worker, so a burst of
+ * callbacks to one client occupies one worker rather than all of them.
+ * Calls flagged NFS_RPC_CALL_URGENT are queued ahead of the others.
+ *
  * @param[in] call           The constructed call
  * @param[in] completion_arg Argument to completion function
  * @param[in] flags          Control flags for call
@@ -909,37 +922,84 @@ int32_t nfs_rpc_submit_call(rpc_call_t *call, void *completion_arg,
 			    uint32_t flags)
 {
 	request_data_t *reqdata;
+	rpc_call_channel_t *chan = call->chan;
+	bool queued = false;
 
-	assert(call->chan);
+	assert(chan);
 
 	call->completion_arg = completion_arg;
 	if (flags & NFS_RPC_CALL_INLINE)
-		return nfs_rpc_dispatch_call(call, NFS_RPC_CALL_NONE);
+		return nfs_rpc_dispatch_call(call, NFS_RPC_CALL_INLINE);
 
 	reqdata = container_of(call, request_data_t, r_u.call);
 	PTHREAD_MUTEX_lock(&call->we.mtx);
 	call->states = NFS_CB_CALL_QUEUED;
-	nfs_rpc_enqueue_req(reqdata);
+
+	PTHREAD_MUTEX_lock(&chan->pending_mtx);
+	if (chan->dispatching) {
+		struct glist_head *before = &chan->pending;
+
+		/* Urgent calls go after other urgent calls but ahead of
+		 * everything else.
+		 */
+		if (call->flags & NFS_RPC_CALL_URGENT) {
+			struct glist_head *glist;
+			request_data_t *queued_req;
+
+			glist_for_each(glist, &chan->pending) {
+				queued_req = glist_entry(glist, request_data_t,
+							 req_q);
+				if (!(queued_req->r_u.call.flags &
+				      NFS_RPC_CALL_URGENT)) {
+					before = glist;
+					break;
+				}
+			}
+		}
+
+		glist_add_tail(before, &reqdata->req_q);
+		queued = true;
+	} else {
+		chan->dispatching = true;
+	}
+	PTHREAD_MUTEX_unlock(&chan->pending_mtx);
+
+	if (!queued)
+		nfs_rpc_enqueue_req(reqdata);
 	PTHREAD_MUTEX_unlock(&call->we.mtx);
 
 	return 0;
 }
 
 /**
- * @brief Dispatch a call
+ * @brief Mark a call finished and run its completion hook
  *
- * @param[in,out] call  The call to dispatch
- * @param[in]     flags Flags governing call
- *
- * @return 0 or POSIX errors.
+ * @param[in] call        The call
+ * @param[in] hook_status How the call ended
  */
-
-int32_t nfs_rpc_dispatch_call(rpc_call_t *call, uint32_t flags)
+static void nfs_rpc_complete_call(rpc_call_t *call, rpc_call_hook hook_status)
 {
-	struct timeval CB_TIMEOUT = { 15, 0 };	/* XXX */
-	rpc_call_hook hook_status = RPC_CALL_COMPLETE;
+	/* signal waiter(s) */
+	PTHREAD_MUTEX_lock(&call->we.mtx);
+	call->states |= NFS_CB_CALL_FINISHED;
 
-	/* send the call, set states, wake waiters, etc */
+	/* broadcast will generally be inexpensive */
+	if (call->flags & NFS_RPC_CALL_BROADCAST)
+		pthread_cond_broadcast(&call->we.cv);
+	PTHREAD_MUTEX_unlock(&call->we.mtx);
+
+	/* call completion hook */
+	RPC_CALL_HOOK(call, hook_status, call->completion_arg,
+		      NFS_RPC_CALL_NONE);
+}
+
+/**
+ * @brief Move a call to the dispatch state
+ *
+ * @param[in] call The call
+ */
+static void nfs_rpc_start_call(rpc_call_t *call)
+{
 	PTHREAD_MUTEX_lock(&call->we.mtx);
 
 	if ((call->states == NFS_CB_CALL_DISPATCH) ||
@@ -949,6 +1009,20 @@ int32_t nfs_rpc_dispatch_call(rpc_call_t *call, uint32_t flags)
 
 	call->states = NFS_CB_CALL_DISPATCH;
 	PTHREAD_MUTEX_unlock(&call->we.mtx);
+}
+
+/**
+ * @brief Send a single call and complete it
+ *
+ * @param[in,out] call The call to send
+ */
+static void nfs_rpc_send_one(rpc_call_t *call)
+{
+	struct timeval CB_TIMEOUT = { 15, 0 };	/* XXX */
+	rpc_call_hook hook_status = RPC_CALL_COMPLETE;
+
+	/* send the call, set states, wake waiters, etc */
+	nfs_rpc_start_call(call);
 
 	/* XXX TI-RPC does the signal masking */
 	PTHREAD_MUTEX_lock(&call->chan->mtx);
@@ -974,18 +1048,196 @@ int32_t nfs_rpc_dispatch_call(rpc_call_t *call, uint32_t flags)
  unlock:
 	PTHREAD_MUTEX_unlock(&call->chan->mtx);
 
-	/* signal waiter(s) */
-	PTHREAD_MUTEX_lock(&call->we.mtx);
-	call->states |= NFS_CB_CALL_FINISHED;
+	nfs_rpc_complete_call(call, hook_status);
+}
 
-	/* broadcast will generally be inexpensive */
-	if (call->flags & NFS_RPC_CALL_BROADCAST)
-		pthread_cond_broadcast(&call->we.cv);
-	PTHREAD_MUTEX_unlock(&call->we.mtx);
+/**
+ * @brief Whether a call may share a CB_COMPOUND with others
+ *
+ * Only v4.0 compounds holding a single CB_RECALL qualify: recalls are
+ * independent of one another and their completions only look at the
+ * status.  Anything carrying a CB_SEQUENCE owns a slot and goes alone.
+ */
+static inline bool nfs_rpc_batchable(rpc_call_t *call)
+{
+	CB_COMPOUND4args *args = &call->cbt.v_u.v4.args;
 
-	/* call completion hook */
-	RPC_CALL_HOOK(call, hook_status, call->completion_arg,
-		      NFS_RPC_CALL_NONE);
+	return args->minorversion == 0 &&
+	       args->argarray.argarray_len == 1 &&
+	       args->argarray.argarray_val[0].argop == NFS4_OP_CB_RECALL;
+}
+
+/**
+ * @brief Send several recalls in one CB_COMPOUND
+ *
+ * Each call is completed with its own operation's status.  Calls after
+ * the operation that stopped the compound were not executed and are put
+ * back at the head of the channel's queue.
+ *
+ * @param[in] chan  Channel all the calls are on
+ * @param[in] calls Calls to send
+ * @param[in] n     Number of calls, at least 2
+ */
+static void nfs_rpc_send_batch(rpc_call_channel_t *chan, rpc_call_t **calls,
+			       int n)
+{
+	struct timeval CB_TIMEOUT = { 15, 0 };	/* XXX */
+	rpc_call_hook hook_status = RPC_CALL_COMPLETE;
+	CB_COMPOUND4args *args0 = &calls[0]->cbt.v_u.v4.args;
+	rpc_call_t *batch = alloc_rpc_call();
+	CB_COMPOUND4res *res;
+	nfs_cb_resop4 *resop;
+	request_data_t *reqdata;
+	uint32_t executed;
+	int i;
+
+	batch->chan = chan;
+	cb_compound_init_v4(&batch->cbt, n, 0, args0->callback_ident,
+			    args0->tag.utf8string_val,
+			    args0->tag.utf8string_len);
+
+	for (i = 0; i < n; i++) {
+		nfs_rpc_start_call(calls[i]);
+		cb_compound_add_op(&batch->cbt,
+				   calls[i]->cbt.v_u.v4.args.argarray.argarray_val);
+	}
+
+	LogFullDebug(COMPONENT_NFS_CB, "Sending %d recalls in one compound", n);
+
+	PTHREAD_MUTEX_lock(&chan->mtx);
+
+	if (!chan->clnt) {
+		batch->stat = RPC_INTR;
+		hook_status = RPC_CALL_ABORT;
+	} else {
+		batch->stat = clnt_call(chan->clnt, chan->auth, CB_COMPOUND,
+					(xdrproc_t) xdr_CB_COMPOUND4args,
+					&batch->cbt.v_u.v4.args,
+					(xdrproc_t) xdr_CB_COMPOUND4res,
+					&batch->cbt.v_u.v4.res, CB_TIMEOUT);
+
+		if (batch->stat != RPC_SUCCESS) {
+			_nfs_rpc_destroy_chan(chan);
+			hook_status = RPC_CALL_ABORT;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&chan->mtx);
+
+	res = &batch->cbt.v_u.v4.res;
+	executed = hook_status == RPC_CALL_COMPLETE
+		? MIN(res->resarray.resarray_len, (uint32_t) n) : 0;
+
+	/* Requeue what the client never got to, unless it refused the
+	 * whole compound, newest first so they keep their order.
+	 */
+	if (executed != 0 && executed < (uint32_t) n) {
+		for (i = executed; i < n; i++) {
+			PTHREAD_MUTEX_lock(&calls[i]->we.mtx);
+			calls[i]->states = NFS_CB_CALL_QUEUED;
+			PTHREAD_MUTEX_unlock(&calls[i]->we.mtx);
+		}
+
+		PTHREAD_MUTEX_lock(&chan->pending_mtx);
+		for (i = n - 1; i >= (int) executed; i--) {
+			reqdata = container_of(calls[i], request_data_t,
+					       r_u.call);
+			glist_add(&chan->pending, &reqdata->req_q);
+		}
+		PTHREAD_MUTEX_unlock(&chan->pending_mtx);
+		n = executed;
+	}
+
+	for (i = 0; i < n; i++) {
+		CB_COMPOUND4res *cres = &calls[i]->cbt.v_u.v4.res;
+
+		calls[i]->stat = batch->stat;
+
+		if ((uint32_t) i < executed) {
+			resop = &res->resarray.resarray_val[i];
+			cres->resarray.resarray_val[0] = *resop;
+			cres->resarray.resarray_len = 1;
+			/* Every CB result starts with its status */
+			cres->status = resop->nfs_cb_resop4_u.opcbrecall.status;
+		} else {
+			cres->status = res->status;
+		}
+
+		nfs_rpc_complete_call(calls[i], hook_status);
+	}
+
+	/* The operations belong to the individual calls */
+	batch->cbt.v_u.v4.args.argarray.argarray_len = 0;
+	free_rpc_call(batch);
+}
+
+/**
+ * @brief Send a channel's calls until its queue is empty
+ *
+ * Consecutive recalls are merged into one CB_COMPOUND.
+ *
+ * @param[in] chan The channel
+ * @param[in] call The call to start with
+ */
+static void nfs_rpc_drain_chan(rpc_call_channel_t *chan, rpc_call_t *call)
+{
+	rpc_call_t *calls[NFS_CB_BATCH_MAX];
+	request_data_t *reqdata;
+	int n;
+
+	while (call != NULL) {
+		n = 0;
+		calls[n++] = call;
+
+		PTHREAD_MUTEX_lock(&chan->pending_mtx);
+		while (nfs_rpc_batchable(call) && n < NFS_CB_BATCH_MAX &&
+		       !glist_empty(&chan->pending)) {
+			reqdata = glist_first_entry(&chan->pending,
+						    request_data_t, req_q);
+			if (!nfs_rpc_batchable(&reqdata->r_u.call))
+				break;
+			glist_del(&reqdata->req_q);
+			calls[n++] = &reqdata->r_u.call;
+		}
+		PTHREAD_MUTEX_unlock(&chan->pending_mtx);
+
+		if (n == 1)
+			nfs_rpc_send_one(call);
+		else
+			nfs_rpc_send_batch(chan, calls, n);
+
+		PTHREAD_MUTEX_lock(&chan->pending_mtx);
+		reqdata = glist_first_entry(&chan->pending, request_data_t,
+					    req_q);
+		if (reqdata != NULL) {
+			glist_del(&reqdata->req_q);
+			call = &reqdata->r_u.call;
+		} else {
+			chan->dispatching = false;
+			call = NULL;
+		}
+		PTHREAD_MUTEX_unlock(&chan->pending_mtx);
+	}
+}
+
+/**
+ * @brief Dispatch a call
+ *
+ * A queued call is sent along with anything queued behind it on the
+ * same channel.
+ *
+ * @param[in,out] call  The call to dispatch
+ * @param[in]     flags Flags governing call
+ *
+ * @return 0 or POSIX errors.
+ */
+
+int32_t nfs_rpc_dispatch_call(rpc_call_t *call, uint32_t flags)
+{
+	if (flags & NFS_RPC_CALL_INLINE)
+		nfs_rpc_send_one(call);
+	else
+		nfs_rpc_drain_chan(call->chan, call);
 
 	return 0;
 }
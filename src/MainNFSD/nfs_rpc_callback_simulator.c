@@ -72,7 +72,7 @@ static bool nfs_rpc_cbsim_get_v40_client_ids(DBusMessageIter *args,
 					     DBusMessage *reply,
 					     DBusError *error)
 {
-	uint32_t i;
+	uint32_t i, count;
 	hash_table_t *ht = ht_confirmed_client_id;
 	struct rbt_head *head_rbt;
 	struct hash_data *pdata = NULL;
@@ -90,11 +90,12 @@ static bool nfs_rpc_cbsim_get_v40_client_ids(DBusMessageIter *args,
 	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
 					 DBUS_TYPE_UINT64_AS_STRING, &sub_iter);
 	/* For each bucket of the hashtable */
-	for (i = 0; i < ht->parameter.index_size; i++) {
-		head_rbt = &(ht->partitions[i].rbt);
+	count = hashtable_walk_begin(ht);
+	for (i = 0; i < count; i++) {
+		head_rbt = &hashtable_partition(ht, i)->rbt;
 
 		/* acquire mutex */
-		PTHREAD_RWLOCK_wrlock(&(ht->partitions[i].lock));
+		PTHREAD_RWLOCK_wrlock(&hashtable_partition(ht, i)->lock);
 
 		/* go through all entries in the red-black-tree */
 		RBT_LOOP(head_rbt, pn) {
@@ -106,8 +107,9 @@ static bool nfs_rpc_cbsim_get_v40_client_ids(DBusMessageIter *args,
 						       &clientid);
 			RBT_INCREMENT(pn);
 		}
-		PTHREAD_RWLOCK_unlock(&(ht->partitions[i].lock));
+		PTHREAD_RWLOCK_unlock(&hashtable_partition(ht, i)->lock);
 	}
+	hashtable_walk_end(ht);
 	dbus_message_iter_close_container(&iter, &sub_iter);
 	return true;
 }
@@ -142,7 +144,7 @@ static bool nfs_rpc_cbsim_get_session_ids(DBusMessageIter *args,
 					  DBusMessage *reply,
 					  DBusError *error)
 {
-	uint32_t i;
+	uint32_t i, count;
 	hash_table_t *ht = ht_session_id;
 	struct rbt_head *head_rbt;
 	struct hash_data *pdata = NULL;
@@ -160,11 +162,12 @@ static bool nfs_rpc_cbsim_get_session_ids(DBusMessageIter *args,
 	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
 					 DBUS_TYPE_UINT64_AS_STRING, &sub_iter);
 	/* For each bucket of the hashtable */
-	for (i = 0; i < ht->parameter.index_size; i++) {
-		head_rbt = &(ht->partitions[i].rbt);
+	count = hashtable_walk_begin(ht);
+	for (i = 0; i < count; i++) {
+		head_rbt = &hashtable_partition(ht, i)->rbt;
 
 		/* acquire mutex */
-		PTHREAD_RWLOCK_wrlock(&(ht->partitions[i].lock));
+		PTHREAD_RWLOCK_wrlock(&hashtable_partition(ht, i)->lock);
 
 		/* go through all entries in the red-black-tree */
 		RBT_LOOP(head_rbt, pn) {
@@ -179,8 +182,9 @@ static bool nfs_rpc_cbsim_get_session_ids(DBusMessageIter *args,
 						       &session_id);
 			RBT_INCREMENT(pn);
 		}
-		PTHREAD_RWLOCK_unlock(&(ht->partitions[i].lock));
+		PTHREAD_RWLOCK_unlock(&hashtable_partition(ht, i)->lock);
 	}
+	hashtable_walk_end(ht);
 	dbus_message_iter_close_container(&iter, &sub_iter);
 	return true;
 }
@@ -36,6 +36,7 @@
 #include <sys/file.h>		/* for having FNDELAY */
 #include <sys/select.h>
 #include <poll.h>
+#include <unistd.h>
 #ifdef RPC_VSOCK
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -55,13 +56,25 @@
 #include "rquota.h"
 #include "nfs_init.h"
 #include "nfs_core.h"
+#include "sal_functions.h"
 #include "nfs_convert.h"
 #include "nfs_exports.h"
+#include "nfs_creds.h"
 #include "nfs_proto_functions.h"
 #include "nfs_req_queue.h"
 #include "nfs_dupreq.h"
+#include "client_mgr.h"
 #include "nfs_file_handle.h"
 #include "fridgethr.h"
+#include "gsh_numa.h"
+#include "nfs_metrics.h"
+#include "export_mgr.h"
+#include "delayed_exec.h"
+#include "server_stats.h"
+
+#ifdef USE_LTTNG
+#include "gsh_lttng/nfs_rpc.h"
+#endif
 
 #define NFS_pcp nfs_param.core_param
 #define NFS_options NFS_pcp.core_options
@@ -319,8 +332,8 @@ void create_vsock(void)
 {
 	tcp_xprt[P_NFS_VSOCK] =
 		svc_vc_ncreatef(tcp_socket[P_NFS_VSOCK],
-				nfs_param.core_param.rpc.max_send_buffer_size,
-				nfs_param.core_param.rpc.max_recv_buffer_size,
+				nfs_param.core_param.rpc.vsock_send_buffer_size,
+				nfs_param.core_param.rpc.vsock_recv_buffer_size,
 				SVC_CREATE_FLAG_CLOSE | SVC_CREATE_FLAG_LISTEN);
 	if (tcp_xprt[P_NFS_VSOCK] == NULL)
 		LogFatal(COMPONENT_DISPATCH,
@@ -680,6 +693,32 @@ static int alloc_socket_setopts(int p)
 		}
 	}
 
+#ifdef SO_BUSY_POLL
+	/* Let the kernel poll the device a while on an empty receive
+	 * queue; accepted connections inherit it.  Not fatal, it needs
+	 * CAP_NET_ADMIN to raise above the sysctl.
+	 */
+	if (nfs_cp->busy_poll_usec) {
+		if (setsockopt(udp_socket[p], SOL_SOCKET, SO_BUSY_POLL,
+			       &nfs_cp->busy_poll_usec,
+			       sizeof(nfs_cp->busy_poll_usec)) ||
+		    setsockopt(tcp_socket[p], SOL_SOCKET, SO_BUSY_POLL,
+			       &nfs_cp->busy_poll_usec,
+			       sizeof(nfs_cp->busy_poll_usec)))
+			LogWarn(COMPONENT_DISPATCH,
+				"Bad socket option SO_BUSY_POLL for %s, error %d(%s)",
+				tags[p], errno, strerror(errno));
+#ifdef SO_PREFER_BUSY_POLL
+		/* Keep the device interrupts off while we poll it */
+		if (setsockopt(tcp_socket[p], SOL_SOCKET, SO_PREFER_BUSY_POLL,
+			       &one, sizeof(one)))
+			LogWarn(COMPONENT_DISPATCH,
+				"Bad socket option SO_PREFER_BUSY_POLL for %s, error %d(%s)",
+				tags[p], errno, strerror(errno));
+#endif
+	}
+#endif
+
 	/* We prefer using non-blocking socket
 	 * in the specific case */
 	if (fcntl(udp_socket[p], F_SETFL, FNDELAY) == -1) {
@@ -738,6 +777,8 @@ static int Allocate_sockets_V4(int p)
 static int allocate_socket_vsock(void)
 {
 	int one = 1;
+	unsigned long long bufsz =
+		nfs_param.core_param.rpc.vsock_transport_buffer_size;
 
 	tcp_socket[P_NFS_VSOCK] = socket(AF_VSOCK, SOCK_STREAM, 0);
 	if (tcp_socket[P_NFS_VSOCK] == -1) {
@@ -756,6 +797,21 @@ static int allocate_socket_vsock(void)
 		return -1;
 	}
 
+	/* The vsock transport buffer caps how much a guest can have in
+	 * flight; accepted connections inherit it from the listener.
+	 * The maximum has to be raised before the size.
+	 */
+	if (bufsz &&
+	    (setsockopt(tcp_socket[P_NFS_VSOCK], AF_VSOCK,
+			SO_VM_SOCKETS_BUFFER_MAX_SIZE,
+			&bufsz, sizeof(bufsz)) ||
+	     setsockopt(tcp_socket[P_NFS_VSOCK], AF_VSOCK,
+			SO_VM_SOCKETS_BUFFER_SIZE,
+			&bufsz, sizeof(bufsz))))
+		LogWarn(COMPONENT_DISPATCH,
+			"Cannot set vsock buffer size %llu for %s, error %d(%s)",
+			bufsz, tags[P_NFS_VSOCK], errno, strerror(errno));
+
 	return 0;
 }
 #endif /* RPC_VSOCK */
@@ -771,12 +827,12 @@ static void Allocate_sockets(void)
 	LogFullDebug(COMPONENT_DISPATCH, "Allocation of the sockets");
 
 	for (p = P_NFS; p < P_COUNT; p++) {
-		if (nfs_protocol_enabled(p)) {
-			/* Initialize all the sockets to -1 because
-			 * it makes some code later easier */
-			udp_socket[p] = -1;
-			tcp_socket[p] = -1;
+		/* Initialize all the sockets to -1 because
+		 * it makes some code later easier */
+		udp_socket[p] = -1;
+		tcp_socket[p] = -1;
 
+		if (nfs_protocol_enabled(p)) {
 			if (v6disabled)
 				goto try_V4;
 
@@ -855,7 +911,9 @@ void Clean_RPC(void)
    * @todo Consider the need to call Svc_dg_destroy for UDP & ?? for
    * TCP based services
    */
-	unregister_rpc();
+	/* The registrations are the new server's after a handoff */
+	if (!nfs_handoff_given())
+		unregister_rpc();
 	close_rpc_fd();
 }
 
@@ -932,6 +990,7 @@ void nfs_Init_svc(void)
 {
 	svc_init_params svc_params;
 	int ix, code __attribute__ ((unused)) = 0;
+	bool handoff;
 
 	LogDebug(COMPONENT_DISPATCH, "NFS INIT: Core options = %d",
 		 NFS_options);
@@ -1029,8 +1088,12 @@ void nfs_Init_svc(void)
 		LogFullDebug(COMPONENT_DISPATCH,
 			     "netconfig found for UDPv6 and TCPv6");
 
-	/* Allocate the UDP and TCP sockets for the RPC */
-	Allocate_sockets();
+	/* Take over the sockets of the server we replace, if any, else
+	 * allocate the UDP and TCP sockets for the RPC
+	 */
+	handoff = nfs_handoff_receive(udp_socket, tcp_socket, &v6disabled);
+	if (!handoff)
+		Allocate_sockets();
 
 	if ((NFS_options & CORE_OPTION_NFSV3) != 0) {
 		/* Some log that can be useful when debug ONC/RPC
@@ -1062,7 +1125,8 @@ void nfs_Init_svc(void)
 
 	if ((NFS_options & CORE_OPTION_ALL_NFS_VERS) != 0) {
 		/* Bind the tcp and udp sockets */
-		Bind_sockets();
+		if (!handoff)
+			Bind_sockets();
 
 		/* Unregister from portmapper/rpcbind */
 		unregister_rpc();
@@ -1158,13 +1222,44 @@ void nfs_rpc_dispatch_stop(void)
 	}
 }
 
+/**
+ * @brief Event channel of the device queue a connection comes in on
+ *
+ * An epoll wait busy polls the device queue of its sockets only as
+ * long as they all come in on the same one, so with Busy_Poll_Usec
+ * connections are grouped by queue.  Each channel thread then polls
+ * its queues from the device up to the decoder, without an interrupt
+ * or a wakeup when the queue is busy.
+ *
+ * @param[in] xprt The new connection
+ *
+ * @return The channel, or 0 to cycle through them.
+ */
+static uint32_t nfs_rpc_napi_chan(SVCXPRT *xprt)
+{
+#ifdef SO_INCOMING_NAPI_ID
+	unsigned int napi_id;
+	socklen_t len = sizeof(napi_id);
+
+	if (nfs_param.core_param.busy_poll_usec == 0 ||
+	    getsockopt(xprt->xp_fd, SOL_SOCKET, SO_INCOMING_NAPI_ID,
+		       &napi_id, &len) != 0 || napi_id == 0)
+		return 0;
+
+	return TCP_EVCHAN_0 + napi_id % N_TCP_EVENT_CHAN;
+#else
+	return 0;
+#endif
+}
+
 /**
  * @brief Rendezvous callout.  This routine will be called by TI-RPC
  *        after newxprt has been accepted.
  *
  * Register newxprt on a TCP event channel.  Balancing events/channels
  * could become involved.  To start with, just cycle through them as
- * new connections are accepted.
+ * new connections are accepted, unless they are busy polled, see
+ * nfs_rpc_napi_chan().
  *
  * @param[in] xprt    Transport
  * @param[in] newxprt Newly created transport
@@ -1178,24 +1273,37 @@ static u_int nfs_rpc_recv_user_data(SVCXPRT *xprt, SVCXPRT *newxprt,
 {
 	static uint32_t next_chan = TCP_EVCHAN_0;
 	static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
-	uint32_t tchan;
+	gsh_xprt_private_t *xu;
+	uint32_t tchan = nfs_rpc_napi_chan(newxprt);
 
 	PTHREAD_MUTEX_lock(&mtx);
 
-	tchan = next_chan;
-	assert((next_chan >= TCP_EVCHAN_0) && (next_chan < N_EVENT_CHAN));
-	if (++next_chan >= N_EVENT_CHAN)
-		next_chan = TCP_EVCHAN_0;
+	if (tchan == 0) {
+		tchan = next_chan;
+		assert((next_chan >= TCP_EVCHAN_0) &&
+		       (next_chan < N_EVENT_CHAN));
+		if (++next_chan >= N_EVENT_CHAN)
+			next_chan = TCP_EVCHAN_0;
+	}
 
 	/* setup private data (freed when xprt is destroyed) */
-	newxprt->xp_u1 =
-	    alloc_gsh_xprt_private(newxprt, XPRT_PRIVATE_FLAG_NONE);
+	xu = alloc_gsh_xprt_private(newxprt, XPRT_PRIVATE_FLAG_NONE);
+	xu->export_perms = xprt_export_perms_alloc();
+	xu->gss_creds = xprt_gss_creds_alloc();
+	xu->sessions = xprt_session_cache_alloc();
+	newxprt->xp_u1 = xu;
 
 	/* NB: xu->drc is allocated on first request--we need shared
 	 * TCP DRC for v3, but per-connection for v4 */
 
 	PTHREAD_MUTEX_unlock(&mtx);
 
+	/* per client scheduling and rate limits need to know who is on
+	 * the other end, export limits can be set by a later update
+	 */
+	xu->client = get_gsh_client((sockaddr_t *)svc_getrpccaller(newxprt),
+				    false);
+
 	(void)svc_rqst_evchan_reg(rpc_evchan[tchan].chan_id, newxprt,
 				  SVC_RQST_FLAG_NONE);
 
@@ -1213,6 +1321,15 @@ static void nfs_rpc_free_user_data(SVCXPRT *xprt)
 		nfs_dupreq_put_drc(xprt, xprt->xp_u2, DRC_FLAG_RELEASE);
 		xprt->xp_u2 = NULL;
 	}
+	if (xprt->xp_u1) {
+		gsh_xprt_private_t *xu = xprt->xp_u1;
+
+		if (xu->client)
+			put_gsh_client(xu->client);
+		xprt_export_perms_free(xu->export_perms);
+		xprt_gss_creds_free(xu->gss_creds);
+		xprt_session_cache_free(xu->sessions);
+	}
 	free_gsh_xprt_private(xprt);
 }
 
@@ -1221,27 +1338,58 @@ uint32_t nfs_rpc_outstanding_reqs_est(void)
 	static uint32_t ctr;
 	static uint32_t nreqs;
 	struct req_q_pair *qpair;
-	uint32_t treqs;
+	uint32_t treqs, sx;
 	int ix;
 
 	if ((atomic_inc_uint32_t(&ctr) % 10) != 0)
 		return atomic_fetch_uint32_t(&nreqs);
 
 	treqs = 0;
-	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_req_st.reqs.nfs_request_q.qset[ix]);
-		treqs += atomic_fetch_uint32_t(&qpair->producer.size);
-		treqs += atomic_fetch_uint32_t(&qpair->consumer.size);
+	for (sx = 0; sx < nfs_req_st.reqs.nshards; ++sx) {
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			qpair = &nfs_req_st.reqs.nfs_request_q[sx].qset[ix];
+			treqs += atomic_fetch_uint32_t(&qpair->producer.size);
+			treqs += atomic_fetch_uint32_t(&qpair->consumer.size);
+		}
 	}
 
 	atomic_store_uint32_t(&nreqs, treqs);
 	return treqs;
 }
 
+/**
+ * @brief Client of a connection, if tracked
+ */
+static inline struct gsh_client *nfs_rpc_xprt_client(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+
+	return xu ? xu->client : NULL;
+}
+
+/**
+ * @brief Whether a client is over its outstanding request cap
+ *
+ * @param[in] xprt  Transport of the client
+ * @param[in] limit Number of requests allowed
+ */
+static inline bool nfs_rpc_client_over(SVCXPRT *xprt, uint32_t limit)
+{
+	struct gsh_client *client = nfs_rpc_xprt_client(xprt);
+
+	if (client == NULL || nfs_param.core_param.dispatch_max_reqs_client
+	    == 0)
+		return false;
+
+	return atomic_fetch_uint32_t(&client->outstanding) >= limit;
+}
+
 static inline bool stallq_should_unstall(SVCXPRT *xprt)
 {
 	return ((xprt->xp_requests
-		 < nfs_param.core_param.dispatch_max_reqs_xprt / 2)
+		 < nfs_param.core_param.dispatch_max_reqs_xprt / 2
+		 && !nfs_rpc_client_over(xprt,
+			nfs_param.core_param.dispatch_max_reqs_client / 2))
 		|| (xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED));
 }
 
@@ -1303,8 +1451,10 @@ static bool nfs_rpc_cond_stall_xprt(SVCXPRT *xprt)
 	bool activate = false;
 	uint32_t nreqs = xprt->xp_requests;
 
-	/* check per-xprt quota */
-	if (likely(nreqs < nfs_param.core_param.dispatch_max_reqs_xprt)) {
+	/* check per-xprt and per-client quota */
+	if (likely(nreqs < nfs_param.core_param.dispatch_max_reqs_xprt &&
+		   !nfs_rpc_client_over(xprt,
+			nfs_param.core_param.dispatch_max_reqs_client))) {
 		LogDebug(COMPONENT_DISPATCH,
 			 "xprt %p xp_refs %" PRIu32 " has %" PRIu32
 			 " reqs active (max %d)",
@@ -1364,6 +1514,7 @@ void nfs_rpc_queue_init(void)
 	struct fridgethr_params reqparams;
 	struct req_q_pair *qpair;
 	int rc = 0;
+	uint32_t sx;
 	int ix;
 
 	memset(&reqparams, 0, sizeof(struct fridgethr_params));
@@ -1384,15 +1535,34 @@ void nfs_rpc_queue_init(void)
 		LogFatal(COMPONENT_DISPATCH,
 			 "Unable to initialize decoder thread pool: %d", rc);
 
-	/* queues */
+	/* queues, one set per shard */
 	pthread_spin_init(&nfs_req_st.reqs.sp, PTHREAD_PROCESS_PRIVATE);
 	nfs_req_st.reqs.size = 0;
-	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_req_st.reqs.nfs_request_q.qset[ix]);
-		qpair->s = req_q_s[ix];
-		nfs_rpc_q_init(&qpair->producer);
-		nfs_rpc_q_init(&qpair->consumer);
+	nfs_req_st.reqs.nshards = nfs_param.core_param.dispatch_queue_shards;
+	if (nfs_req_st.reqs.nshards == 0)
+		nfs_req_st.reqs.nshards = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nfs_req_st.reqs.nshards == 0)
+		nfs_req_st.reqs.nshards = 1;
+	nfs_req_st.reqs.nfs_request_q =
+		gsh_calloc(nfs_req_st.reqs.nshards, sizeof(struct req_q_set));
+	for (sx = 0; sx < nfs_req_st.reqs.nshards; ++sx) {
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			qpair = &nfs_req_st.reqs.nfs_request_q[sx].qset[ix];
+			qpair->s = req_q_s[ix];
+			nfs_rpc_q_init(&qpair->producer);
+			nfs_rpc_q_init(&qpair->consumer);
+		}
 	}
+	LogInfo(COMPONENT_DISPATCH, "%" PRIu32 " request queue shards",
+		nfs_req_st.reqs.nshards);
+
+	/* overload control */
+	pthread_spin_init(&codel.sp, PTHREAD_PROCESS_PRIVATE);
+
+	/* fair share queue */
+	gsh_mutex_init(&nfs_req_st.reqs.fair_q.mtx, NULL);
+	glist_init(&nfs_req_st.reqs.fair_q.active);
+	nfs_req_st.reqs.fair_q.size = 0;
 
 	/* waitq */
 	glist_init(&nfs_req_st.reqs.wait_list);
@@ -1418,11 +1588,568 @@ uint32_t get_dequeue_count(void)
 	return dequeued_reqs;
 }
 
+/** Moving average of the time requests wait in the queues, in ns */
+static uint64_t queue_wait_ns;
+/** When a worker was last added for queue wait, in ns */
+static uint64_t worker_grown_ns;
+
+/** Overload control state, see nfs_rpc_codel() */
+static struct {
+	pthread_spinlock_t sp;
+	uint64_t first_above_ns;	/*< When a wait above target may shed,
+					 *  0 while below target.
+					 */
+	uint64_t drop_next_ns;		/*< When to shed the next request */
+	uint32_t count;			/*< Requests shed this episode */
+	bool dropping;			/*< Shedding episode in progress */
+} codel;
+/** Requests answered with NFS4ERR_DELAY or NFS3ERR_JUKEBOX */
+static uint64_t requests_shed;
+
+/**
+ * @brief Whether overload control may shed a request
+ *
+ * Only NFS READ, WRITE, COMMIT and READDIR class requests are shed,
+ * they are the bulk of the load and a client simply retries them.
+ * Anything that opens, closes or locks is always executed, as are
+ * MOUNT, NLM and callbacks.  A request whose transport is already
+ * destroyed is dropped by the worker anyway, shedding it would spare
+ * nothing.
+ *
+ * @param[in] reqdata The request
+ */
+static inline bool nfs_rpc_sheddable(request_data_t *reqdata)
+{
+	nfs_request_t *reqnfs = &reqdata->r_u.req;
+
+	if (reqdata->rtype != NFS_REQUEST ||
+	    reqnfs->svc.rq_msg.cb_prog != NFS_program[P_NFS])
+		return false;
+
+	if (reqnfs->svc.rq_xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED)
+		return false;
+
+	if (reqnfs->svc.rq_msg.cb_vers != NFS_V3 &&
+	    reqnfs->svc.rq_msg.cb_vers != NFS_V4)
+		return false;
+
+	return NFS_LOOKAHEAD_HIGH_LATENCY(reqnfs->lookahead) &&
+	       !(reqnfs->lookahead.flags & (NFS_LOOKAHEAD_OPEN |
+					    NFS_LOOKAHEAD_CLOSE |
+					    NFS_LOOKAHEAD_LOCK));
+}
+
+/**
+ * @brief Time to the next shed request, interval / sqrt(count)
+ */
+static inline uint64_t nfs_rpc_codel_next(uint64_t interval, uint32_t count)
+{
+	uint64_t root = 1;
+
+	while ((root + 1) * (root + 1) <= count)
+		root++;
+
+	return interval / root;
+}
+
+/**
+ * @brief Decide whether to shed a dequeued request
+ *
+ * CoDel (RFC 8289) on the time requests wait in the queues.  Once the
+ * wait of every request has stayed above Overload_Target_Delay for a
+ * whole Overload_Interval, requests are shed at a rate that grows with
+ * the square root of the number shed, until a request waits less than
+ * the target.  A shed request is answered with NFS4ERR_DELAY or
+ * NFS3ERR_JUKEBOX instead of being executed, so clients back off
+ * rather than time out and retransmit into the queues.  A request that
+ * may not be shed is executed and the shed passes to the next one.
+ *
+ * @param[in] reqdata The request
+ * @param[in] wait    Time it waited in the queues, in ns
+ * @param[in] nsnow   Current time, in ns
+ *
+ * @return true if the request is to be shed.
+ */
+static bool nfs_rpc_codel(request_data_t *reqdata, uint64_t wait,
+			  uint64_t nsnow)
+{
+	uint64_t target = (uint64_t) nfs_param.core_param.overload_target_delay
+			  * NS_PER_USEC;
+	uint64_t interval = (uint64_t) nfs_param.core_param.overload_interval
+			    * NS_PER_USEC;
+	bool sheddable, ok_to_shed = false, shed = false;
+
+	if (target == 0)
+		return false;
+
+	sheddable = nfs_rpc_sheddable(reqdata);
+
+	pthread_spin_lock(&codel.sp);
+
+	if (wait < target)
+		codel.first_above_ns = 0;
+	else if (codel.first_above_ns == 0)
+		codel.first_above_ns = nsnow + interval;
+	else if (nsnow >= codel.first_above_ns)
+		ok_to_shed = true;
+
+	if (codel.dropping) {
+		if (!ok_to_shed) {
+			codel.dropping = false;
+		} else if (sheddable && nsnow >= codel.drop_next_ns) {
+			shed = true;
+			codel.count++;
+			codel.drop_next_ns +=
+				nfs_rpc_codel_next(interval, codel.count);
+		}
+	} else if (ok_to_shed && sheddable) {
+		shed = true;
+		codel.dropping = true;
+		/* An episode soon after the last one resumes near its rate */
+		if (codel.count > 2 &&
+		    (int64_t) (nsnow - codel.drop_next_ns) <
+		    (int64_t) (16 * interval))
+			codel.count -= 2;
+		else
+			codel.count = 1;
+		codel.drop_next_ns = nsnow +
+				     nfs_rpc_codel_next(interval, codel.count);
+	}
+
+	pthread_spin_unlock(&codel.sp);
+
+	if (shed) {
+		(void) atomic_inc_uint64_t(&requests_shed);
+		LogDebug(COMPONENT_DISPATCH,
+			 "Shed request xid=%" PRIu32 " after %" PRIu64
+			 " us in queue",
+			 reqdata->r_u.req.svc.rq_msg.rm_xid,
+			 wait / NS_PER_USEC);
+	}
+
+	return shed;
+}
+
+/**
+ * @brief Account the queue wait of a dequeued request
+ *
+ * Each request weighs 1/8 in the average.  With Worker_Autoscale, a
+ * worker is added when the average is above target and no worker is
+ * waiting for work, at most one per target interval so a burst does
+ * not spawn Nb_Worker threads at once.
+ *
+ * @param[in] reqdata The request
+ */
+static void nfs_rpc_queue_wait_done(request_data_t *reqdata)
+{
+	struct timespec ts;
+	uint64_t wait, avg, target, nsnow;
+
+	now(&ts);
+	wait = timespec_diff(&reqdata->time_queued, &ts);
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, dequeue, reqdata,
+		   reqdata->rtype == NFS_REQUEST
+		   ? reqdata->r_u.req.svc.rq_msg.rm_xid : 0, wait);
+#endif
+	avg = atomic_fetch_uint64_t(&queue_wait_ns);
+	avg = avg - avg / 8 + wait / 8;
+	atomic_store_uint64_t(&queue_wait_ns, avg);
+
+	nsnow = timespec_to_nsecs(&ts);
+	if (reqdata->rtype == NFS_REQUEST)
+		reqdata->r_u.req.shed = nfs_rpc_codel(reqdata, wait, nsnow);
+
+	if (!nfs_param.core_param.worker_autoscale)
+		return;
+
+	target = nfs_param.core_param.worker_target_queue_wait * NS_PER_USEC;
+	if (avg <= target ||
+	    atomic_fetch_uint32_t(&nfs_req_st.reqs.waiters) != 0)
+		return;
+
+	if (nsnow - atomic_fetch_uint64_t(&worker_grown_ns) < target)
+		return;
+
+	atomic_store_uint64_t(&worker_grown_ns, nsnow);
+	worker_grow();
+}
+
+/**
+ * @brief Whether an idle worker may leave the pool
+ *
+ * Called each time an idle worker's wait times out.  Nothing was
+ * dequeued meanwhile, so the average wait is decayed first.
+ *
+ * @param[in] idle_since When the worker ran out of work
+ *
+ * @return true if the worker is surplus.
+ */
+static bool nfs_rpc_worker_surplus(time_t idle_since)
+{
+	uint64_t avg = atomic_fetch_uint64_t(&queue_wait_ns) / 2;
+
+	atomic_store_uint64_t(&queue_wait_ns, avg);
+
+	if (!nfs_param.core_param.worker_autoscale ||
+	    time(NULL) - idle_since <
+	    (time_t) nfs_param.core_param.worker_idle_timeout)
+		return false;
+
+	return avg < nfs_param.core_param.worker_target_queue_wait *
+		     NS_PER_USEC / 2;
+}
+
+/**
+ * @brief Write the request queue gauges in OpenMetrics text format
+ *
+ * @param[in] out  Reply stream
+ */
+void nfs_rpc_metrics(FILE *out)
+{
+	metrics_gauge(out, "ganesha_requests_outstanding",
+		      "Requests queued or being worked on",
+		      nfs_rpc_outstanding_reqs_est());
+	metrics_gauge(out, "ganesha_queue_wait_seconds",
+		      "Moving average of the time requests wait in the queues",
+		      atomic_fetch_uint64_t(&queue_wait_ns) / 1e9);
+	metrics_counter(out, "ganesha_requests_shed",
+			"Requests answered with DELAY by overload control",
+			atomic_fetch_uint64_t(&requests_shed));
+}
+
+/**
+ * @brief Queue a request on its client's fair share flow
+ *
+ * @param[in] client  Client the request came from
+ * @param[in] reqdata The request
+ */
+static void nfs_rpc_fair_enqueue(struct gsh_client *client,
+				 request_data_t *reqdata)
+{
+	struct req_fair_q *fq = &nfs_req_st.reqs.fair_q;
+
+	PTHREAD_MUTEX_lock(&fq->mtx);
+	glist_add_tail(&client->fq_reqs, &reqdata->req_q);
+	if (client->fq_len++ == 0) {
+		/* client becomes active, starts with a full round */
+		client->fq_deficit = client->fq_weight ? client->fq_weight : 1;
+		glist_add_tail(&fq->active, &client->fq_active);
+	}
+	++(fq->size);
+	PTHREAD_MUTEX_unlock(&fq->mtx);
+}
+
+/**
+ * @brief Find the export a READ or WRITE request is limited by
+ *
+ * Only the first file handle of a COMPOUND is looked at, which is the
+ * export of its I/O for all but the most unusual clients.
+ *
+ * @param[in] reqdata The request, decoded
+ *
+ * @return The export id, or -1 if the request is not limited.
+ */
+static int32_t nfs_rpc_qos_export_id(request_data_t *reqdata)
+{
+	nfs_request_t *reqnfs = &reqdata->r_u.req;
+	struct gsh_export *export;
+	int32_t export_id = -1;
+	u_int i;
+
+	if (!(reqnfs->lookahead.flags &
+	      (NFS_LOOKAHEAD_READ | NFS_LOOKAHEAD_WRITE)) ||
+	    reqnfs->svc.rq_msg.cb_prog != NFS_program[P_NFS])
+		return -1;
+
+	switch (reqnfs->svc.rq_msg.cb_vers) {
+	case NFS_V3:
+		if (reqnfs->svc.rq_msg.cb_proc == NFSPROC3_READ)
+			export_id = nfs3_FhandleToExportId(
+					&reqnfs->arg_nfs.arg_read3.file);
+		else if (reqnfs->svc.rq_msg.cb_proc == NFSPROC3_WRITE)
+			export_id = nfs3_FhandleToExportId(
+					&reqnfs->arg_nfs.arg_write3.file);
+		break;
+	case NFS_V4:
+		for (i = 0;
+		     i < reqnfs->arg_nfs.arg_compound4.argarray.argarray_len;
+		     i++) {
+			nfs_argop4 *op = &reqnfs->arg_nfs.arg_compound4.
+						argarray.argarray_val[i];
+			nfs_fh4 *fh = &op->nfs_argop4_u.opputfh.object;
+
+			if (op->argop != NFS4_OP_PUTFH)
+				continue;
+			if (fh->nfs_fh4_len >=
+			    offsetof(struct file_handle_v4, fsopaque))
+				export_id = ntohs(((struct file_handle_v4 *)
+						   fh->nfs_fh4_val)->id.exports);
+			break;
+		}
+		break;
+	}
+
+	if (export_id < 0)
+		return -1;
+
+	export = get_gsh_export(export_id);
+	if (export == NULL)
+		return -1;
+	if (atomic_fetch_uint64_t(&export->ops_limit) == 0 &&
+	    atomic_fetch_uint64_t(&export->bytes_limit) == 0)
+		export_id = -1;
+	put_gsh_export(export);
+
+	return export_id;
+}
+
+/** Whether a wakeup for rate limited requests is pending, protected
+ *  by the fair queue lock
+ */
+static bool qos_wakeup_armed;
+
+static void nfs_rpc_wake_worker(void);
+
+static void nfs_rpc_qos_wakeup(void *arg)
+{
+	struct req_fair_q *fq = &nfs_req_st.reqs.fair_q;
+
+	PTHREAD_MUTEX_lock(&fq->mtx);
+	qos_wakeup_armed = false;
+	PTHREAD_MUTEX_unlock(&fq->mtx);
+
+	nfs_rpc_wake_worker();
+}
+
+/**
+ * @brief Charge a request to its client's and export's rate limits
+ *
+ * Called with the fair queue lock held.
+ *
+ * @param[in] client  Client the request came from
+ * @param[in] reqdata The request
+ * @param[in] now_ns  Current monotonic time
+ *
+ * @return 0 if the request was charged, else how long until it fits.
+ */
+static nsecs_elapsed_t nfs_rpc_qos_admit(struct gsh_client *client,
+					 request_data_t *reqdata,
+					 nsecs_elapsed_t now_ns)
+{
+	uint64_t ops = nfs_param.core_param.client_ops_limit;
+	uint64_t bytes = nfs_param.core_param.client_bytes_limit;
+	uint64_t io_bytes = reqdata->r_u.req.lookahead.io_bytes;
+	uint64_t exp_ops = 0, exp_bytes = 0;
+	struct gsh_export *export = NULL;
+	nsecs_elapsed_t wait, w;
+
+	wait = gsh_token_bucket_wait(&client->fq_ops_tb, ops, now_ns);
+	if (io_bytes != 0) {
+		w = gsh_token_bucket_wait(&client->fq_bytes_tb, bytes, now_ns);
+		if (w > wait)
+			wait = w;
+	}
+
+	if (wait == 0 && reqdata->qos_export_id >= 0) {
+		export = get_gsh_export(reqdata->qos_export_id);
+		if (export != NULL) {
+			exp_ops = atomic_fetch_uint64_t(&export->ops_limit);
+			exp_bytes = atomic_fetch_uint64_t(&export->bytes_limit);
+			wait = gsh_token_bucket_wait(&export->ops_tb, exp_ops,
+						     now_ns);
+			w = gsh_token_bucket_wait(&export->bytes_tb,
+						  exp_bytes, now_ns);
+			if (w > wait)
+				wait = w;
+		}
+	}
+
+	if (wait == 0) {
+		gsh_token_bucket_charge(&client->fq_ops_tb, ops, 1, now_ns);
+		gsh_token_bucket_charge(&client->fq_bytes_tb, bytes, io_bytes,
+					now_ns);
+		if (export != NULL) {
+			gsh_token_bucket_charge(&export->ops_tb, exp_ops, 1,
+						now_ns);
+			gsh_token_bucket_charge(&export->bytes_tb, exp_bytes,
+						io_bytes, now_ns);
+		}
+	}
+
+	if (export != NULL)
+		put_gsh_export(export);
+
+	return wait;
+}
+
+/**
+ * @brief Take the next request off the fair share queue
+ *
+ * Deficit round robin: the client at the head of the active list is
+ * served until it used up its weight for this round, then moves to
+ * the tail with a new round.  A client whose next request is over a
+ * rate limit is passed over, and if every client is, a worker is woken
+ * once the first of them fits again; meanwhile the requests wait here
+ * instead of in a worker.
+ *
+ * @return A request or NULL if the queue is empty or rate limited.
+ */
+static request_data_t *nfs_rpc_fair_dequeue(void)
+{
+	struct req_fair_q *fq = &nfs_req_st.reqs.fair_q;
+	request_data_t *reqdata = NULL;
+	struct gsh_client *client;
+	struct gsh_client *first_limited = NULL;
+	nsecs_elapsed_t now_ns, wait, min_wait = 0;
+	struct timespec ts;
+	bool more = false;
+
+	if (atomic_fetch_uint32_t(&fq->size) == 0)
+		return NULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now_ns = timespec_to_nsecs(&ts);
+
+	PTHREAD_MUTEX_lock(&fq->mtx);
+	while (!glist_empty(&fq->active)) {
+		client = glist_first_entry(&fq->active, struct gsh_client,
+					   fq_active);
+
+		if (client->fq_deficit <= 0) {
+			client->fq_deficit +=
+				client->fq_weight ? client->fq_weight : 1;
+			glist_del(&client->fq_active);
+			glist_add_tail(&fq->active, &client->fq_active);
+			continue;
+		}
+
+		reqdata = glist_first_entry(&client->fq_reqs, request_data_t,
+					    req_q);
+
+		wait = nfs_rpc_qos_admit(client, reqdata, now_ns);
+		if (wait != 0) {
+			reqdata = NULL;
+			if (client == first_limited)
+				break;	/* every client is limited */
+			if (first_limited == NULL)
+				first_limited = client;
+			if (min_wait == 0 || wait < min_wait)
+				min_wait = wait;
+			glist_del(&client->fq_active);
+			glist_add_tail(&fq->active, &client->fq_active);
+			continue;
+		}
+
+		glist_del(&reqdata->req_q);
+		--(client->fq_deficit);
+		--(fq->size);
+
+		if (--(client->fq_len) == 0) {
+			/* idle clients don't carry credit over */
+			glist_del(&client->fq_active);
+			client->fq_deficit = 0;
+		}
+		more = fq->size != 0;
+		break;
+	}
+
+	if (reqdata == NULL && min_wait != 0 && !qos_wakeup_armed &&
+	    delayed_submit(nfs_rpc_qos_wakeup, NULL, min_wait) == 0)
+		qos_wakeup_armed = true;
+	PTHREAD_MUTEX_unlock(&fq->mtx);
+
+	/* requests passed over may fit now, don't leave them to the
+	 * next enqueue
+	 */
+	if (more && first_limited != NULL)
+		nfs_rpc_wake_worker();
+
+	return reqdata;
+}
+
+/**
+ * @brief Account for a request leaving the dispatcher
+ *
+ * @param[in] xprt Transport the request came in on
+ */
+void nfs_rpc_client_req_done(SVCXPRT *xprt)
+{
+	struct gsh_client *client = nfs_rpc_xprt_client(xprt);
+
+	if (client != NULL)
+		(void) atomic_dec_uint32_t(&client->outstanding);
+}
+
+/** Requests a decoder holds back to put on the queues together */
+#define NFS_RPC_ENQ_BATCH 16
+
+/**
+ * @brief Requests decoded in one decoder pass, not yet queued
+ *
+ * While a decoder thread drains a transport, the requests it decodes
+ * are gathered here and spliced onto the producer queues with one
+ * lock round per queue, then the workers are woken.
+ */
+struct nfs_rpc_enq_batch {
+	struct req_q_set *set;	/*< Queue set the batch goes to */
+	struct glist_head q[N_REQ_QUEUES];
+	uint32_t size[N_REQ_QUEUES];
+	uint32_t total;
+};
+
+static __thread struct nfs_rpc_enq_batch *nfs_rpc_enq_batch;
+
+static void nfs_rpc_enq_batch_init(struct nfs_rpc_enq_batch *batch)
+{
+	int i;
+
+	batch->set = &nfs_req_st.reqs.nfs_request_q[nfs_rpc_q_home_shard()];
+	for (i = 0; i < N_REQ_QUEUES; i++) {
+		glist_init(&batch->q[i]);
+		batch->size[i] = 0;
+	}
+	batch->total = 0;
+}
+
+/**
+ * @brief Put a batch of requests on the queues and wake workers
+ */
+static void nfs_rpc_enq_batch_flush(struct nfs_rpc_enq_batch *batch)
+{
+	struct req_q *q;
+	uint32_t n;
+	int i;
+
+	for (i = 0; i < N_REQ_QUEUES; i++) {
+		if (batch->size[i] == 0)
+			continue;
+
+		q = &batch->set->qset[i].producer;
+		pthread_spin_lock(&q->sp);
+		glist_splice_tail(&q->q, &batch->q[i]);
+		q->size += batch->size[i];
+		pthread_spin_unlock(&q->sp);
+
+		batch->size[i] = 0;
+	}
+
+	for (n = batch->total; n > 0; n--)
+		nfs_rpc_wake_worker();
+
+	batch->total = 0;
+}
+
 void nfs_rpc_enqueue_req(request_data_t *reqdata)
 {
+	struct nfs_rpc_enq_batch *batch = nfs_rpc_enq_batch;
 	struct req_q_set *nfs_request_q;
 	struct req_q_pair *qpair;
 	struct req_q *q;
+	struct gsh_client *client = NULL;
+	bool fair = false;
+	bool limited;
+	int qix;
 
 #if defined(HAVE_BLKIN)
 	BLKIN_TIMESTAMP(
@@ -1431,7 +2158,12 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 		"enqueue-enter");
 #endif
 
-	nfs_request_q = &nfs_req_st.reqs.nfs_request_q;
+	/* queue on the shard of the CPU that decoded it */
+	if (batch != NULL)
+		nfs_request_q = batch->set;
+	else
+		nfs_request_q =
+		    &nfs_req_st.reqs.nfs_request_q[nfs_rpc_q_home_shard()];
 
 	switch (reqdata->rtype) {
 	case NFS_REQUEST:
@@ -1439,14 +2171,26 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 			     "enter rq_xid=%" PRIu32 " lookahead.flags=%u",
 			     reqdata->r_u.req.svc.rq_msg.rm_xid,
 			     reqdata->r_u.req.lookahead.flags);
+		client = nfs_rpc_xprt_client(reqdata->r_u.req.svc.rq_xprt);
 		if (reqdata->r_u.req.lookahead.flags & NFS_LOOKAHEAD_MOUNT) {
 			qpair = &(nfs_request_q->qset[REQ_Q_MOUNT]);
 			break;
 		}
-		if (NFS_LOOKAHEAD_HIGH_LATENCY(reqdata->r_u.req.lookahead))
+		/* rate limited requests wait on the fair share queue, the
+		 * only one that can pass over a request
+		 */
+		reqdata->qos_export_id = nfs_rpc_qos_export_id(reqdata);
+		limited = client != NULL &&
+			  (nfs_param.core_param.client_ops_limit ||
+			   nfs_param.core_param.client_bytes_limit ||
+			   reqdata->qos_export_id >= 0);
+		if (NFS_LOOKAHEAD_HIGH_LATENCY(reqdata->r_u.req.lookahead)) {
 			qpair = &(nfs_request_q->qset[REQ_Q_HIGH_LATENCY]);
-		else
+			fair = client != NULL &&
+			       nfs_param.core_param.fair_share;
+		} else
 			qpair = &(nfs_request_q->qset[REQ_Q_LOW_LATENCY]);
+		fair = fair || limited;
 		break;
 	case NFS_CALL:
 		qpair = &(nfs_request_q->qset[REQ_Q_CALL]);
@@ -1465,7 +2209,37 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 	/* this one is real, timestamp it
 	 */
 	now(&reqdata->time_queued);
-	/* always append to producer queue */
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, enqueue, reqdata,
+		   reqdata->rtype == NFS_REQUEST
+		   ? reqdata->r_u.req.svc.rq_msg.rm_xid : 0);
+#endif
+
+	if (client != NULL)
+		(void) atomic_inc_uint32_t(&client->outstanding);
+
+	if (fair) {
+		nfs_rpc_fair_enqueue(client, reqdata);
+		(void) atomic_inc_uint32_t(&enqueued_reqs);
+		LogDebug(COMPONENT_DISPATCH,
+			 "enqueued req on fair share queue for %s",
+			 client->hostaddr_str);
+		goto wakeup;
+	}
+
+	/* a decoder draining a transport queues its requests together */
+	if (batch != NULL) {
+		qix = qpair - nfs_request_q->qset;
+		glist_add_tail(&batch->q[qix], &reqdata->req_q);
+		batch->size[qix]++;
+		(void) atomic_inc_uint32_t(&enqueued_reqs);
+
+		if (++batch->total >= NFS_RPC_ENQ_BATCH)
+			nfs_rpc_enq_batch_flush(batch);
+		goto out;
+	}
+
+	/* otherwise append to producer queue */
 	q = &qpair->producer;
 	pthread_spin_lock(&q->sp);
 	glist_add_tail(&q->q, &reqdata->req_q);
@@ -1493,41 +2267,50 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 		 q, qpair->s, &qpair->producer, &qpair->consumer, q->size,
 		 enqueued_reqs, dequeued_reqs);
 
+ wakeup:
 	/* potentially wakeup some thread */
+	nfs_rpc_wake_worker();
 
-	/* global waitq */
-	{
-		wait_q_entry_t *wqe;
+ out:
+	return;
+}
 
-		/* SPIN LOCKED */
-		pthread_spin_lock(&nfs_req_st.reqs.sp);
-		if (nfs_req_st.reqs.waiters) {
-			wqe = glist_first_entry(&nfs_req_st.reqs.wait_list,
-						wait_q_entry_t, waitq);
+/**
+ * @brief Wake up one idle worker, if any
+ */
+static void nfs_rpc_wake_worker(void)
+{
+	wait_q_entry_t *wqe;
 
-			LogFullDebug(COMPONENT_DISPATCH,
-				     "nfs_req_st.reqs.waiters %u signal wqe %p (for q %p)",
-				     nfs_req_st.reqs.waiters, wqe, q);
-
-			/* release 1 waiter */
-			glist_del(&wqe->waitq);
-			--(nfs_req_st.reqs.waiters);
-			--(wqe->waiters);
-			/* ! SPIN LOCKED */
-			pthread_spin_unlock(&nfs_req_st.reqs.sp);
-			PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
-			/* XXX reliable handoff */
-			wqe->flags |= Wqe_LFlag_SyncDone;
-			if (wqe->flags & Wqe_LFlag_WaitSync)
-				pthread_cond_signal(&wqe->lwe.cv);
-			PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
-		} else
-			/* ! SPIN LOCKED */
-			pthread_spin_unlock(&nfs_req_st.reqs.sp);
-	}
+	/* Nobody idle, don't touch the shared lock */
+	if (atomic_fetch_uint32_t(&nfs_req_st.reqs.waiters) == 0)
+		return;
 
- out:
-	return;
+	/* SPIN LOCKED */
+	pthread_spin_lock(&nfs_req_st.reqs.sp);
+	if (nfs_req_st.reqs.waiters) {
+		wqe = glist_first_entry(&nfs_req_st.reqs.wait_list,
+					wait_q_entry_t, waitq);
+
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "nfs_req_st.reqs.waiters %u signal wqe %p",
+			     nfs_req_st.reqs.waiters, wqe);
+
+		/* release 1 waiter */
+		glist_del(&wqe->waitq);
+		--(nfs_req_st.reqs.waiters);
+		--(wqe->waiters);
+		/* ! SPIN LOCKED */
+		pthread_spin_unlock(&nfs_req_st.reqs.sp);
+		PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
+		/* XXX reliable handoff */
+		wqe->flags |= Wqe_LFlag_SyncDone;
+		if (wqe->flags & Wqe_LFlag_WaitSync)
+			pthread_cond_signal(&wqe->lwe.cv);
+		PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
+	} else
+		/* ! SPIN LOCKED */
+		pthread_spin_unlock(&nfs_req_st.reqs.sp);
 }
 
 /* static inline */
@@ -1591,56 +2374,85 @@ request_data_t *nfs_rpc_consume_req(struct req_q_pair *qpair)
 request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 {
 	request_data_t *reqdata = NULL;
-	struct req_q_set *nfs_request_q = &nfs_req_st.reqs.nfs_request_q;
+	struct req_q_set *nfs_request_q;
 	struct req_q_pair *qpair;
-	uint32_t ix, slot;
+	uint32_t ix, qx, slot, sx, home, nshards = nfs_req_st.reqs.nshards;
 	struct timespec timeout;
+	time_t idle_since = 0;
+	nsecs_elapsed_t spin_until = 0, now_ns;
+	int rc;
 
 	/* XXX: the following stands in for a more robust/flexible
 	 * weighting function */
 
-	/* slot in 1..4 */
+	/* Try our own shard first, then steal from the others, nearest
+	 * first since neighbouring CPUs tend to share a node.  Within a
+	 * shard, start at a rotating slot in 0..3 (MOUNT, NFS_CALL, LL,
+	 * HL) as before.
+	 */
  retry_deq:
-	slot = (nfs_rpc_q_next_slot() % 4);
-	for (ix = 0; ix < 4; ++ix) {
-		switch (slot) {
-		case 0:
-			/* MOUNT */
-			qpair = &(nfs_request_q->qset[REQ_Q_MOUNT]);
-			break;
-		case 1:
-			/* NFS_CALL */
-			qpair = &(nfs_request_q->qset[REQ_Q_CALL]);
-			break;
-		case 2:
-			/* LL */
-			qpair = &(nfs_request_q->qset[REQ_Q_LOW_LATENCY]);
-			break;
-		case 3:
-			/* HL */
-			qpair = &(nfs_request_q->qset[REQ_Q_HIGH_LATENCY]);
-			break;
-		default:
-			/* not here */
-			abort();
-			break;
-		}
-
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "dequeue_req try qpair %s %p:%p", qpair->s,
-			     &qpair->producer, &qpair->consumer);
+	home = nfs_rpc_q_home_shard();
+	slot = (nfs_rpc_q_next_slot() % N_REQ_QUEUES);
+	for (sx = 0; sx < nshards && !reqdata; ++sx) {
+		nfs_request_q =
+			&nfs_req_st.reqs.nfs_request_q[(home + sx) % nshards];
+
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			qx = (slot + ix) % N_REQ_QUEUES;
+			qpair = &nfs_request_q->qset[qx];
+
+			/* the fair share queue stands in for the high
+			 * latency queues of all shards, check it once
+			 */
+			if (qx == REQ_Q_HIGH_LATENCY && sx == 0) {
+				reqdata = nfs_rpc_fair_dequeue();
+				if (reqdata) {
+					(void) atomic_inc_uint32_t(
+							&dequeued_reqs);
+					break;
+				}
+			}
 
-		/* anything? */
-		reqdata = nfs_rpc_consume_req(qpair);
-		if (reqdata) {
-			(void) atomic_inc_uint32_t(&dequeued_reqs);
-			break;
-		}
+			/* skip empty queues without locking them */
+			if (atomic_fetch_uint32_t(&qpair->consumer.size) == 0
+			    && atomic_fetch_uint32_t(&qpair->producer.size)
+			    == 0)
+				continue;
 
-		++slot;
-		slot = slot % 4;
+			LogFullDebug(COMPONENT_DISPATCH,
+				     "dequeue_req try shard %" PRIu32
+				     " qpair %s %p:%p",
+				     (home + sx) % nshards, qpair->s,
+				     &qpair->producer, &qpair->consumer);
+
+			/* anything? */
+			reqdata = nfs_rpc_consume_req(qpair);
+			if (reqdata) {
+				(void) atomic_inc_uint32_t(&dequeued_reqs);
+				break;
+			}
+		}			/* for */
+	}
 
-	}			/* for */
+	/* spin a while before sleeping, once per call, rescanning when
+	 * something was queued
+	 */
+	if (!reqdata && nfs_param.core_param.worker_spin_usec) {
+		now(&timeout);
+		now_ns = timespec_to_nsecs(&timeout);
+		if (spin_until == 0)
+			spin_until = now_ns +
+				nfs_param.core_param.worker_spin_usec *
+				NS_PER_USEC;
+		while (now_ns < spin_until) {
+			if (atomic_fetch_uint32_t(&enqueued_reqs) !=
+			    atomic_fetch_uint32_t(&dequeued_reqs))
+				goto retry_deq;
+			gsh_cpu_relax();
+			now(&timeout);
+			now_ns = timespec_to_nsecs(&timeout);
+		}
+	}
 
 	/* wait */
 	if (!reqdata) {
@@ -1657,11 +2469,20 @@ request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 		glist_add_tail(&nfs_req_st.reqs.wait_list, &wqe->waitq);
 		++(nfs_req_st.reqs.waiters);
 		pthread_spin_unlock(&nfs_req_st.reqs.sp);
+		if (idle_since == 0)
+			idle_since = time(NULL);
 		while (!(wqe->flags & Wqe_LFlag_SyncDone)) {
 			timeout.tv_sec = time(NULL) + 5;
 			timeout.tv_nsec = 0;
-			pthread_cond_timedwait(&wqe->lwe.cv, &wqe->lwe.mtx,
-					       &timeout);
+			rc = pthread_cond_timedwait(&wqe->lwe.cv,
+						    &wqe->lwe.mtx, &timeout);
+			if (rc == ETIMEDOUT &&
+			    ((nfs_rpc_worker_surplus(idle_since) &&
+			      fridgethr_retire(ctx)) ||
+			     fridgethr_retire_excess(ctx)))
+				LogDebug(COMPONENT_DISPATCH,
+					 "Idle worker %u leaving",
+					 worker->worker_index);
 			if (fridgethr_you_should_break(ctx)) {
 				/* We are returning;
 				 * so take us out of the waitq */
@@ -1691,6 +2512,8 @@ request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 		goto retry_deq;
 	} /* !reqdata */
 
+	nfs_rpc_queue_wait_done(reqdata);
+
 #if defined(HAVE_BLKIN)
 	/* thread id */
 	BLKIN_KEYVAL_INTEGER(
@@ -1868,6 +2691,8 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 	bool enqueued = false;
 	uint32_t lo_vers, hi_vers;
 	bool recv_status;
+	bool decoded;
+	uint64_t cpu_start;
 
 	if (!xprt) {
 		LogCrit(COMPONENT_DISPATCH,
@@ -1991,6 +2816,14 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 	 * GSSAPI. It should not be processed by the worker and SVC_STAT
 	 * should be returned to the dispatcher.
 	 */
+#ifdef USE_TLS
+	/* An RPC-with-TLS probe, ntirpc knows no such flavor */
+	if (req->rq_msg.cb_cred.oa_flavor == AUTH_TLS) {
+		stat = nfs_rpc_starttls(req) ? SVC_STAT(xprt) : XPRT_DIED;
+		goto done;
+	}
+#endif
+
 	why = svc_auth_authenticate(&reqdata->r_u.req.svc, &no_dispatch);
 	if (why != AUTH_OK) {
 		LogInfo(COMPONENT_DISPATCH,
@@ -2014,6 +2847,18 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 #endif
 	}
 
+#ifdef USE_TLS
+	if (nfs_param.tls_param.require_tls &&
+	    req->rq_msg.cb_prog == NFS_program[P_NFS] &&
+	    req->rq_msg.cb_proc != NFSPROC_NULL && !nfs_rpc_xprt_tls(xprt)) {
+		LogDebug(COMPONENT_DISPATCH,
+			 "Rejecting NFS request without TLS, xid=%" PRIu32,
+			 req->rq_msg.rm_xid);
+		svcerr_auth(req, AUTH_TOOWEAK);
+		goto finish;
+	}
+#endif
+
 	/*
 	 * Extract RPC argument.
 	 */
@@ -2023,10 +2868,25 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 		     "Before SVC_GETARGS on socket %d, xprt=%p",
 		     xprt->xp_fd, xprt);
 
-	if (!SVC_GETARGS(&reqdata->r_u.req.svc,
-			 reqdata->r_u.req.funcdesc->xdr_decode_func,
-			 &reqdata->r_u.req.arg_nfs,
-			 &reqdata->r_u.req.lookahead)) {
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, decode_start, reqdata,
+		   reqdata->r_u.req.svc.rq_msg.rm_xid,
+		   reqdata->r_u.req.svc.rq_msg.cb_prog,
+		   reqdata->r_u.req.svc.rq_msg.cb_vers,
+		   reqdata->r_u.req.svc.rq_msg.cb_proc);
+#endif
+	cpu_start = server_stats_cpu_now();
+	decoded = SVC_GETARGS(&reqdata->r_u.req.svc,
+			      reqdata->r_u.req.funcdesc->xdr_decode_func,
+			      &reqdata->r_u.req.arg_nfs,
+			      &reqdata->r_u.req.lookahead);
+	if (cpu_start != 0)
+		reqdata->r_u.req.cpu_decode = server_stats_cpu_now() - cpu_start;
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, decode_end, reqdata,
+		   reqdata->r_u.req.svc.rq_msg.rm_xid, decoded);
+#endif
+	if (!decoded) {
 		LogInfo(COMPONENT_DISPATCH,
 			"SVC_GETARGS failed for Program %" PRIu32
 			", Version %" PRIu32
@@ -2095,25 +2955,101 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 	return stat;
 }
 
-static inline bool thr_continue_decoding(SVCXPRT *xprt, enum xprt_stat stat)
+/** Most datagrams a decoder takes from a UDP transport per wakeup */
+#define UDP_DECODE_BATCH 32
+
+/**
+ * @brief Check whether another datagram is waiting on a UDP transport
+ */
+static inline bool udp_datagram_pending(SVCXPRT *xprt)
+{
+	struct pollfd pfd = {
+		.fd = xprt->xp_fd,
+		.events = POLLIN,
+	};
+
+	return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN) != 0;
+}
+
+/**
+ * @brief Decide whether a decoder keeps going on a transport
+ *
+ * A UDP transport always reports XPRT_IDLE, so a decoder woken for it
+ * would take a single datagram and go back through the event channel
+ * for the next.  Instead it drains up to UDP_DECODE_BATCH datagrams
+ * that are already queued on the socket.
+ *
+ * @param[in] xprt     The transport
+ * @param[in] stat     Status after the last request
+ * @param[in] ndecoded Requests decoded in this wakeup
+ */
+static inline bool thr_continue_decoding(SVCXPRT *xprt, enum xprt_stat stat,
+					 uint32_t ndecoded)
 {
 	if (unlikely(xprt->xp_requests
 		     > nfs_param.core_param.dispatch_max_reqs_xprt))
 		return false;
 
+	if (xprt->xp_type == XPRT_UDP)
+		return stat == XPRT_IDLE && ndecoded < UDP_DECODE_BATCH &&
+		       udp_datagram_pending(xprt);
+
 	return (stat == XPRT_MOREREQS);
 }
 
+/** Node the calling decoder is bound to, -1 if none */
+static __thread int32_t decoder_node = -1;
+
+/**
+ * @brief Move a decoder to the node receiving a transport's packets
+ *
+ * With Thread_Affinity, decoding where the packets came in keeps the
+ * request on the node whose cache holds it, and the requests are then
+ * queued on that node's shards for the workers bound there.
+ *
+ * @param[in] xprt  The transport about to be decoded
+ */
+static void nfs_rpc_decoder_follow(SVCXPRT *xprt)
+{
+#ifdef SO_INCOMING_CPU
+	int cpu;
+	socklen_t len = sizeof(cpu);
+	uint32_t node;
+
+	if (getsockopt(xprt->xp_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu,
+		       &len) != 0 || cpu < 0)
+		return;
+
+	node = gsh_numa_cpu_node(cpu);
+	if ((int32_t)node == decoder_node)
+		return;
+
+	if (gsh_numa_bind_node(node) == 0)
+		decoder_node = node;
+#endif
+}
+
 void thr_decode_rpc_requests(struct fridgethr_context *thr_ctx)
 {
 	enum xprt_stat stat;
 	SVCXPRT *xprt = (SVCXPRT *) thr_ctx->arg;
+	uint32_t ndecoded = 0;
+	struct nfs_rpc_enq_batch batch;
 
 	LogFullDebug(COMPONENT_RPC, "enter xprt=%p", xprt);
 
+	if (nfs_param.core_param.thread_affinity)
+		nfs_rpc_decoder_follow(xprt);
+
+	nfs_rpc_enq_batch_init(&batch);
+	nfs_rpc_enq_batch = &batch;
+
 	do {
 		stat = thr_decode_rpc_request(NULL, xprt);
-	} while (thr_continue_decoding(xprt, stat));
+	} while (thr_continue_decoding(xprt, stat, ++ndecoded));
+
+	nfs_rpc_enq_batch = NULL;
+	nfs_rpc_enq_batch_flush(&batch);
 
 	LogDebug(COMPONENT_DISPATCH, "exiting, stat=%s", xprt_stat_s[stat]);
 
@@ -39,16 +39,23 @@
 #endif
 
 #include "gsh_rpc.h"
+#include "gsh_config.h"
 #include "nfs_init.h"
 
 /**
- * rpc_rdma_disconnect_callback: placeholder
+ * rpc_rdma_disconnect_callback: a client went away
+ *
+ * The transport is destroyed on disconnect, along with the requests
+ * still queued on it, so only the event is noted here.
  *
  * @param[inout] xprt	must be init first
  */
 static void
 rpc_rdma_disconnect_callback(SVCXPRT *xprt)
 {
+	LogEvent(COMPONENT_DISPATCH,
+		"NFS/RDMA transport %p disconnected",
+		xprt);
 }
 
 /**
@@ -67,22 +74,30 @@ rpc_rdma_disconnect_callback(SVCXPRT *xprt)
 void *
 nfs_rdma_dispatcher_thread(void *nullarg)
 {
+	char port[8];
+	uint32_t credits = nfs_param.core_param.rdma.credits;
+	uint32_t max_inline = nfs_param.core_param.rdma.max_inline;
 	struct rpc_rdma_attr xa = {
 		.statistics_prefix = NULL,
 		.node = "::",
-		.port = "20049",
+		.port = port,
 		.disconnect_cb = rpc_rdma_disconnect_callback,
 		.request_cb = thr_decode_rpc_request,
-		.sq_depth = 32,			/* default was 50 */
+		/* one receive per credit, plus room for the protocol */
+		.sq_depth = credits + 2,	/* default was 50 */
 		.max_send_sge = 32,		/* minimum 2 */
-		.rq_depth = 32,			/* default was 50 */
+		.rq_depth = credits + 2,	/* default was 50 */
 		.max_recv_sge = 31,		/* minimum 1 */
 		.backlog = 10,			/* minimum 2 */
-		.credits = 30,			/* default 10 */
+		.credits = credits,		/* default 10 */
 		.destroy_on_disconnect = true,
 		.use_srq = false,
 	};
-	SVCXPRT *l_xprt = rpc_rdma_create(&xa);
+	SVCXPRT *l_xprt;
+
+	snprintf(port, sizeof(port), "%u", nfs_param.core_param.rdma.port);
+
+	l_xprt = rpc_rdma_create(&xa);
 
 	if (!l_xprt) {
 		LogCrit(COMPONENT_DISPATCH,
@@ -90,17 +105,17 @@ nfs_rdma_dispatcher_thread(void *nullarg)
 		return NULL;
 	}
 	LogEvent(COMPONENT_DISPATCH,
-		"NFS/RDMA engine initialized");
+		"NFS/RDMA engine initialized on port %s, %u credits, %u bytes inline",
+		port, credits, max_inline);
 
 	/* All clones and large allocations are done in this loop,
 	 * avoiding contention in the heap(s), serialized by the
 	 * connection_requests queue.
 	 */
 	while (l_xprt->xp_refs > 0) {
-		/* values used in Mooshika were 8*1024, 4*8*1024;
-		 * should be configurable.
-		 */
-		SVCXPRT *c_xprt = svc_rdma_create(l_xprt, 4*1024, 4*1024,
+		/* values used in Mooshika were 8*1024, 4*8*1024 */
+		SVCXPRT *c_xprt = svc_rdma_create(l_xprt, max_inline,
+							max_inline,
 							SVC_XPRT_FLAG_NONE);
 		if (!c_xprt) {
 			/* message already logged */
@@ -0,0 +1,239 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_stats_shm.c
+ * @brief Publish the server counters in shared memory
+ *
+ * A single thread sums the counters into a private copy every
+ * Stats_Shm_Interval milliseconds, then copies that into the segment
+ * between two increments of its sequence count.  The segment is only
+ * written for the time of that copy, and readers never make the
+ * server wait.  See gsh_stats_shm.h for the layout.
+ */
+
+#include "config.h"
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "fridgethr.h"
+#include "client_mgr.h"
+#include "server_stats.h"
+#include "gsh_stats_shm.h"
+#include "abstract_atomic.h"
+
+static struct fridgethr *stats_shm_fridge;
+static struct gsh_stats_shm *stats_shm;
+static struct gsh_stats_shm *stats_shm_copy;
+
+static uint64_t stats_shm_now(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+	return timespec_to_nsecs(&ts);
+}
+
+/**
+ * @brief Copy the counters into the segment
+ */
+static void stats_shm_publish(void)
+{
+	struct gsh_stats_shm *copy = stats_shm_copy;
+
+	memset(copy, 0, sizeof(*copy));
+	server_stats_shm_fill(copy);
+
+	/* Readers retry while seq is odd or has moved */
+	(void)atomic_inc_uint64_t(&stats_shm->seq);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	stats_shm->updated_ns = stats_shm_now();
+	stats_shm->nclasses = copy->nclasses;
+	stats_shm->nexports = copy->nexports;
+	memcpy(stats_shm->server, copy->server,
+	       sizeof(*copy) - offsetof(struct gsh_stats_shm, server));
+
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	(void)atomic_inc_uint64_t(&stats_shm->seq);
+}
+
+/**
+ * @brief Publish every Stats_Shm_Interval until told to stop
+ *
+ * The looper delay is whole seconds, so the thread keeps its own time.
+ *
+ * @param[in] ctx Thread context
+ */
+static void stats_shm_run(struct fridgethr_context *ctx)
+{
+	nsecs_elapsed_t interval =
+		nfs_param.core_param.stats_shm_interval * NS_PER_MSEC;
+	struct timespec ts;
+
+	SetNameFunction("stats_shm");
+
+	ts.tv_sec = interval / NS_PER_SEC;
+	ts.tv_nsec = interval % NS_PER_SEC;
+
+	while (!fridgethr_you_should_break(ctx)) {
+		stats_shm_publish();
+		(void)nanosleep(&ts, NULL);
+	}
+}
+
+/**
+ * @brief Create the segment and start publishing, if configured
+ *
+ * Failing to set it up is not fatal.
+ *
+ * @return 0 on success or when disabled, an errno otherwise.
+ */
+int stats_shm_start(void)
+{
+	const char *name = nfs_param.core_param.stats_shm_name;
+	struct fridgethr_params frp;
+	void *addr;
+	int fd, rc;
+
+	if (name == NULL)
+		return 0;
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		rc = errno;
+		LogCrit(COMPONENT_MAIN,
+			"Could not open statistics segment %s: %s", name,
+			strerror(rc));
+		return rc;
+	}
+
+	/* Start from zeroes, an agent may have the old one mapped */
+	if (ftruncate(fd, 0) != 0 ||
+	    ftruncate(fd, sizeof(struct gsh_stats_shm)) != 0) {
+		rc = errno;
+		LogCrit(COMPONENT_MAIN,
+			"Could not size statistics segment %s: %s", name,
+			strerror(rc));
+		close(fd);
+		goto err;
+	}
+
+	addr = mmap(NULL, sizeof(struct gsh_stats_shm),
+		    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	rc = errno;
+	close(fd);
+
+	if (addr == MAP_FAILED) {
+		LogCrit(COMPONENT_MAIN,
+			"Could not map statistics segment %s: %s", name,
+			strerror(rc));
+		goto err;
+	}
+
+	stats_shm = addr;
+	stats_shm->size = sizeof(struct gsh_stats_shm);
+	stats_shm->hist_buckets = GSH_STATS_SHM_HIST;
+	stats_shm->start_ns = timespec_to_nsecs(&ServerBootTime);
+	stats_shm->version = GSH_STATS_SHM_VERSION;
+	__atomic_store_n(&stats_shm->magic, GSH_STATS_SHM_MAGIC,
+			 __ATOMIC_RELEASE);
+
+	stats_shm_copy = gsh_malloc(sizeof(*stats_shm_copy));
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = 1;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&stats_shm_fridge, "stats_shm", &frp);
+	if (rc != 0) {
+		LogCrit(COMPONENT_MAIN,
+			"Unable to initialize statistics segment fridge, error code %d.",
+			rc);
+		goto unmap;
+	}
+
+	rc = fridgethr_submit(stats_shm_fridge, stats_shm_run, NULL);
+	if (rc != 0) {
+		LogCrit(COMPONENT_MAIN,
+			"Unable to start statistics segment thread, error code %d.",
+			rc);
+		fridgethr_destroy(stats_shm_fridge);
+		stats_shm_fridge = NULL;
+		goto unmap;
+	}
+
+	LogEvent(COMPONENT_MAIN,
+		 "Publishing statistics in %s every %" PRIu32 " ms", name,
+		 nfs_param.core_param.stats_shm_interval);
+	return 0;
+
+ unmap:
+	gsh_free(stats_shm_copy);
+	stats_shm_copy = NULL;
+	(void)munmap(stats_shm, sizeof(struct gsh_stats_shm));
+	stats_shm = NULL;
+ err:
+	(void)shm_unlink(name);
+	return rc;
+}
+
+/**
+ * @brief Stop publishing and remove the segment
+ */
+void stats_shm_shutdown(void)
+{
+	int rc;
+
+	if (stats_shm_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(stats_shm_fridge, fridgethr_comm_stop,
+				    10);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_MAIN,
+			 "Shutdown timed out, cancelling statistics segment thread.");
+		fridgethr_cancel(stats_shm_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_MAIN,
+			 "Failed shutting down statistics segment thread: %d",
+			 rc);
+	}
+
+	fridgethr_destroy(stats_shm_fridge);
+	stats_shm_fridge = NULL;
+
+	/* Agents still mapping it keep their last sample */
+	(void)shm_unlink(nfs_param.core_param.stats_shm_name);
+	(void)munmap(stats_shm, sizeof(struct gsh_stats_shm));
+	stats_shm = NULL;
+	gsh_free(stats_shm_copy);
+	stats_shm_copy = NULL;
+}
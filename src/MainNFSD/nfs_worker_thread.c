@@ -59,6 +59,7 @@
 #include "export_mgr.h"
 #include "server_stats.h"
 #include "uid2grp.h"
+#include "gsh_numa.h"
 
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs_rpc.h"
@@ -68,8 +69,13 @@
 #define NFS_program NFS_pcp.program
 
 pool_t *request_pool;
+pool_t *request_call_pool;
+#ifdef _USE_9P
+pool_t *request_9p_pool;
+#endif
 
 static struct fridgethr *worker_fridge;
+static struct fridgethr *ioc_fridge;
 
 const nfs_function_desc_t invalid_funcdesc = {
 	.service_function = nfs_null,
@@ -282,7 +288,7 @@ const nfs_function_desc_t nfs4_func_desc[] = {
 	 .service_function = nfs4_Compound,
 	 .free_function = nfs4_Compound_Free,
 	 .xdr_decode_func = (xdrproc_t) xdr_COMPOUND4args,
-	 .xdr_encode_func = (xdrproc_t) xdr_COMPOUND4res,
+	 .xdr_encode_func = (xdrproc_t) xdr_COMPOUND4res_extended,
 	 .funcname = "nfs4_Comp",
 	 .dispatch_behaviour = CAN_BE_DUP}
 };
@@ -702,26 +708,95 @@ const nfs_function_desc_t *nfs_rpc_get_funcdesc(nfs_request_t *reqnfs)
 	return funcdesc;
 }
 
+/**
+ * @brief Apply the log filters to the request in op_ctx
+ *
+ * Called again whenever the export of the request becomes known or
+ * changes, so filters on an export start to apply right there.
+ */
+void nfs_log_filter_update(void)
+{
+	log_filter_match(op_ctx->client != NULL
+				? op_ctx->client->hostaddr_str : NULL,
+			 op_ctx->ctx_export != NULL
+				? op_ctx->ctx_export->export_id : -1,
+			 op_ctx->xid);
+}
+
+static void nfs_rpc_release_req(request_data_t *reqdata);
+static void nfs_rpc_complete_req(request_data_t *reqdata, int rc);
+#ifdef _USE_9P
+static void _9p_free_reqdata(struct _9p_request_data *req9p);
+#endif
+
+/**
+ * @brief Add the thread CPU time since cpu_mark to the execute stage
+ *
+ * A request resumed on another thread only accounts what ran before
+ * it was suspended.
+ *
+ * @param[in,out] reqdata	NFS request
+ */
+static void nfs_rpc_cpu_execute(request_data_t *reqdata)
+{
+	nfs_request_t *reqnfs = &reqdata->r_u.req;
+
+	if (reqnfs->cpu_mark == 0)
+		return;
+
+	reqnfs->cpu_execute += server_stats_cpu_now() - reqnfs->cpu_mark;
+	reqnfs->cpu_mark = 0;
+}
+
+/**
+ * @brief Answer a request shed by overload control
+ *
+ * The reply carries only NFS4ERR_DELAY, with no operation results, or
+ * NFS3ERR_JUKEBOX.  It is sent before the request reaches the DRC, so
+ * the client's retry is executed rather than answered from the cache.
+ *
+ * @param[in] reqdata NFS request
+ */
+static void nfs_rpc_reply_shed(request_data_t *reqdata)
+{
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	nfs_res_t res;
+
+	memset(&res, 0, sizeof(res));
+
+	/* Every NFSv3 result and COMPOUND4res start with the status */
+	if (reqdata->r_u.req.svc.rq_msg.cb_vers == NFS_V3)
+		res.res_getattr3.status = NFS3ERR_JUKEBOX;
+	else
+		res.res_compound4.status = NFS4ERR_DELAY;
+
+	if (!svc_sendreply(&reqdata->r_u.req.svc, reqdesc->xdr_encode_func,
+			   (caddr_t) &res))
+		LogDebug(COMPONENT_DISPATCH,
+			 "Error sending DELAY for shed request xid=%" PRIu32,
+			 reqdata->r_u.req.svc.rq_msg.rm_xid);
+}
+
 /**
  * @brief Main RPC dispatcher routine
  *
  * @param[in,out] reqdata	NFS request
  *
  */
-void nfs_rpc_execute(request_data_t *reqdata)
+int nfs_rpc_execute(request_data_t *reqdata)
 {
 	const char *client_ip = "<unknown client>";
 	const char *progname = "unknown";
 	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
 	nfs_arg_t *arg_nfs = &reqdata->r_u.req.arg_nfs;
 	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
 	nfs_res_t *res_nfs;
-	struct export_perms export_perms;
-	struct user_cred user_credentials;
-	struct req_op_context req_ctx;
+	struct export_perms *export_perms = &reqdata->r_u.req.export_perms;
 	dupreq_status_t dpq_status;
 	struct timespec timer_start;
 	enum auth_stat auth_rc;
+	bool sent;
 	int port;
 	int rc = NFS_REQ_OK;
 #ifdef _USE_NFS3
@@ -741,14 +816,18 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 	/* set up the request context
 	 */
-	memset(&export_perms, 0, sizeof(export_perms));
-	memset(&req_ctx, 0, sizeof(req_ctx));
-	op_ctx = &req_ctx;
-	op_ctx->creds = &user_credentials;
+	memset(export_perms, 0, sizeof(*export_perms));
+	memset(&reqdata->r_u.req.req_ctx, 0, sizeof(reqdata->r_u.req.req_ctx));
+	op_ctx = &reqdata->r_u.req.req_ctx;
+	op_ctx->creds = &reqdata->r_u.req.user_credentials;
 	op_ctx->caller_addr = (sockaddr_t *)svc_getrpccaller(xprt);
 	op_ctx->nfs_vers = reqdata->r_u.req.svc.rq_msg.cb_vers;
 	op_ctx->req_type = reqdata->rtype;
-	op_ctx->export_perms = &export_perms;
+	op_ctx->export_perms = export_perms;
+	op_ctx->xid = reqdata->r_u.req.svc.rq_msg.rm_xid;
+	reqdata->r_u.req.async_phase = 0;
+	reqdata->r_u.req.async_resume = NULL;
+	reqdata->r_u.req.async_arg = NULL;
 
 	/* Set up initial export permissions that don't allow anything. */
 	export_check_access();
@@ -762,6 +841,8 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	op_ctx->queue_wait =
 	    op_ctx->start_time - timespec_diff(&ServerBootTime,
 					       &reqdata->time_queued);
+	reqdata->r_u.req.cpu_execute = 0;
+	reqdata->r_u.req.cpu_mark = server_stats_cpu_now();
 
 	/* Initialized user_credentials */
 	init_credentials();
@@ -771,12 +852,17 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 	/* XXX also, need to check UDP correctness, this may need some more
 	 * TI-RPC work (for UDP, if we -really needed it-, we needed to
-	 * capture hostaddr at SVC_RECV).  For TCP, if we intend to use
-	 * this, we should sprint a buffer once, in when we're setting up
-	 * xprt private data. */
+	 * capture hostaddr at SVC_RECV).  Connections have their client
+	 * looked up once, when the xprt private data is set up; only
+	 * UDP requests look it up here.
+	 */
 
 	port = get_port(op_ctx->caller_addr);
-	op_ctx->client = get_gsh_client(op_ctx->caller_addr, false);
+	if (xu != NULL && xu->client != NULL) {
+		op_ctx->client = xu->client;
+		inc_gsh_client_refcount(op_ctx->client);
+	} else
+		op_ctx->client = get_gsh_client(op_ctx->caller_addr, false);
 	if (op_ctx->client == NULL) {
 		LogDebug(COMPONENT_DISPATCH,
 			 "Cannot get client block for Program %" PRIu32
@@ -789,6 +875,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		/* Set the Client IP for this thread */
 		SetClientIP(op_ctx->client->hostaddr_str);
 		client_ip = op_ctx->client->hostaddr_str;
+		nfs_log_filter_update();
 		LogDebug(COMPONENT_DISPATCH,
 			 "Request from %s for Program %" PRIu32
 			 ", Version %" PRIu32
@@ -807,11 +894,20 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		&reqdata->r_u.req.svc.rq_xprt->blkin.endp,
 		"rpc_execute-have-clientid");
 #endif
-	/* If req is uncacheable, or if req is v41+, nfs_dupreq_start will do
-	 * nothing but allocate a result object and mark the request (ie, the
-	 * path is short, lockless, and does no hash/search). */
+	if (reqdata->r_u.req.shed) {
+		nfs_rpc_reply_shed(reqdata);
+		goto freeargs;
+	}
+
+	/* If req is uncacheable, nfs_dupreq_start will do nothing but
+	 * allocate a result object and mark the request (ie, the path is
+	 * short, lockless, and does no hash/search).  A v41+ compound does
+	 * not even allocate, its result lives in the request. */
 	dpq_status = nfs_dupreq_start(&reqdata->r_u.req, &reqdata->r_u.req.svc);
 	res_nfs = reqdata->r_u.req.res_nfs;
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, drc, reqdata, op_ctx->xid, dpq_status);
+#endif
 	if (dpq_status == DUPREQ_SUCCESS) {
 		/* A new request, continue processing it. */
 		LogFullDebug(COMPONENT_DISPATCH,
@@ -830,9 +926,18 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				     "Before svc_sendreply on socket %d (dup req)",
 				     xprt->xp_fd);
 
-			if (!svc_sendreply(&reqdata->r_u.req.svc,
-					   reqdesc->xdr_encode_func,
-					   (caddr_t) res_nfs)) {
+#ifdef USE_LTTNG
+			tracepoint(nfs_rpc, reply_start, reqdata, op_ctx->xid,
+				   1);
+#endif
+			sent = svc_sendreply(&reqdata->r_u.req.svc,
+					     reqdesc->xdr_encode_func,
+					     (caddr_t) res_nfs);
+#ifdef USE_LTTNG
+			tracepoint(nfs_rpc, reply_end, reqdata, op_ctx->xid,
+				   sent);
+#endif
+			if (!sent) {
 				LogDebug(COMPONENT_DISPATCH,
 					 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a duplicate request."
 					 " rpcxid=%" PRIu32
@@ -924,6 +1029,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			}
 
 			op_ctx->ctx_export = get_gsh_export(exportid);
+			nfs_log_filter_update();
 
 			if (op_ctx->ctx_export == NULL) {
 				LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
@@ -936,6 +1042,13 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				goto req_error;
 			}
 
+			if (!export_attach(op_ctx->ctx_export)) {
+				/* FSAL not reachable yet, have it retry */
+				res_nfs->res_getattr3.status = NFS3ERR_JUKEBOX;
+				rc = NFS_REQ_OK;
+				goto req_error;
+			}
+
 			op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
 
 			LogMidDebugAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
@@ -1011,6 +1124,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				 */
 			} else {
 				op_ctx->ctx_export = get_gsh_export(exportid);
+				nfs_log_filter_update();
 
 				if (op_ctx->ctx_export == NULL) {
 					LogInfoAlt(COMPONENT_DISPATCH,
@@ -1055,9 +1169,9 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			    "nfs_rpc_execute about to call nfs_export_check_access for client %s",
 			    client_ip);
 
-		export_check_access();
+		export_check_access_req(&reqdata->r_u.req.svc);
 
-		if ((export_perms.options & EXPORT_OPTION_ACCESS_MASK) == 0) {
+		if ((export_perms->options & EXPORT_OPTION_ACCESS_MASK) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Client %s is not allowed to access Export_Id %d %s"
 				", vers=%" PRIu32
@@ -1072,7 +1186,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			goto auth_failure;
 		}
 
-		if ((EXPORT_OPTION_NFSV3 & export_perms.options) == 0) {
+		if ((EXPORT_OPTION_NFSV3 & export_perms->options) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %" PRIu32
 				" not allowed on Export_Id %d %s for client %s",
@@ -1088,9 +1202,9 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 		/* Check transport type */
 		if (((xprt_type == XPRT_UDP)
-		     && ((export_perms.options & EXPORT_OPTION_UDP) == 0))
+		     && ((export_perms->options & EXPORT_OPTION_UDP) == 0))
 		    || ((xprt_type == XPRT_TCP)
-			&& ((export_perms.options & EXPORT_OPTION_TCP) == 0))) {
+			&& ((export_perms->options & EXPORT_OPTION_TCP) == 0))) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %" PRIu32
 				" over %s not allowed on Export_Id %d %s for client %s",
@@ -1124,7 +1238,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		/* Check if client is using a privileged port,
 		 * but only for NFS protocol */
 		if ((reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS])
-		 && (export_perms.options & EXPORT_OPTION_PRIVILEGED_PORT)
+		 && (export_perms->options & EXPORT_OPTION_PRIVILEGED_PORT)
 		 && (port >= IPPORT_RESERVED)) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Non-reserved Port %d is not allowed on Export_Id %d %s for client %s",
@@ -1143,7 +1257,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	 */
 	if (op_ctx->ctx_export != NULL
 	    && (reqdesc->dispatch_behaviour & MAKES_IO)
-	    && !(export_perms.options & EXPORT_OPTION_RW_ACCESS)) {
+	    && !(export_perms->options & EXPORT_OPTION_RW_ACCESS)) {
 		/* Request of type MDONLY_RO were rejected at the
 		 * nfs_rpc_dispatcher level.
 		 * This is done by replying EDQUOT
@@ -1175,7 +1289,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		}
 	} else if (op_ctx->ctx_export != NULL
 		   && (reqdesc->dispatch_behaviour & MAKES_WRITE)
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_WRITE_ACCESS
 			| EXPORT_OPTION_MD_WRITE_ACCESS)) == 0) {
 		if (reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS])
@@ -1202,7 +1316,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			rc = NFS_REQ_DROP;
 		}
 	} else if (op_ctx->ctx_export != NULL
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_READ_ACCESS
 			 | EXPORT_OPTION_MD_READ_ACCESS)) == 0) {
 		LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
@@ -1222,7 +1336,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				/* If NEEDS_CRED and not NEEDS_EXPORT,
 				 * don't squash
 				 */
-				export_perms.options = EXPORT_OPTION_ROOT;
+				export_perms->options = EXPORT_OPTION_ROOT;
 			}
 
 			if (nfs_req_creds(&reqdata->r_u.req.svc) != NFS4_OK) {
@@ -1303,10 +1417,81 @@ void nfs_rpc_execute(request_data_t *reqdata)
 #endif
 	}
 
+	if (rc == NFS_REQ_ASYNC_WAIT) {
+		/* The service function suspended the request waiting for
+		 * an asynchronous I/O, the I/O completion stage will send
+		 * the reply and release the request.
+		 */
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "Suspended request rpc_xid=%" PRIu32,
+			     reqdata->r_u.req.svc.rq_msg.rm_xid);
+		nfs_rpc_cpu_execute(reqdata);
+		SetClientIP(NULL);
+		log_filter_done();
+		op_ctx = NULL;
+		return rc;
+	}
+
 #ifdef _USE_NFS3
  req_error:
 #endif /* _USE_NFS3 */
 
+	nfs_rpc_complete_req(reqdata, rc);
+	return NFS_REQ_OK;
+
+	/* Reject the request for authentication reason (incompatible
+	 * file handle) */
+	if (isInfo(COMPONENT_DISPATCH) || isInfo(COMPONENT_EXPORT)) {
+		char dumpfh[1024];
+
+		sprint_fhandle3(dumpfh, (nfs_fh3 *) arg_nfs);
+		LogInfo(COMPONENT_DISPATCH,
+			"%s Request from host %s V3 not allowed on this export"
+			", proc=%" PRIu32
+			", FH=%s",
+			progname, client_ip,
+			reqdata->r_u.req.svc.rq_msg.cb_proc, dumpfh);
+	}
+	auth_rc = AUTH_FAILED;
+
+ auth_failure:
+	svcerr_auth(&reqdata->r_u.req.svc, auth_rc);
+	/* nb, a no-op when req is uncacheable */
+	if (nfs_dupreq_delete(&reqdata->r_u.req.svc) != DUPREQ_SUCCESS) {
+		LogCrit(COMPONENT_DISPATCH,
+			"Attempt to delete duplicate request failed on line %d",
+			__LINE__);
+	}
+
+ freeargs:
+	nfs_rpc_release_req(reqdata);
+	return NFS_REQ_OK;
+}
+
+/**
+ * @brief Send the reply to a processed request
+ *
+ * This is the tail of request processing, either called directly by
+ * nfs_rpc_execute or by the I/O completion stage when a suspended
+ * request is resumed.  op_ctx must be set to the request's context.
+ *
+ * @param[in,out] reqdata	NFS request
+ * @param[in]     rc		Return of the service function
+ */
+static void nfs_rpc_complete_req(request_data_t *reqdata, int rc)
+{
+	const char *client_ip = "<unknown client>";
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+	nfs_res_t *res_nfs = reqdata->r_u.req.res_nfs;
+	uint64_t cpu_start;
+	bool sent;
+
+	nfs_rpc_cpu_execute(reqdata);
+
+	if (op_ctx->client != NULL)
+		client_ip = op_ctx->client->hostaddr_str;
+
 /* NFSv4 stats are handled in nfs4_compound()
  */
 	if (reqdata->r_u.req.svc.rq_msg.cb_prog != NFS_program[P_NFS]
@@ -1341,10 +1526,28 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		LogFullDebug(COMPONENT_DISPATCH,
 			     "Before svc_sendreply on socket %d", xprt->xp_fd);
 
-		/* encoding the result on xdr output */
-		if (!svc_sendreply(&reqdata->r_u.req.svc,
-				   reqdesc->xdr_encode_func,
-				   (caddr_t) res_nfs)) {
+		/* encoding the result on xdr output
+		 *
+		 * The reply is encoded and written by the transport in one
+		 * go, under its send lock.  Coalescing the replies of several
+		 * workers into one writev would have to happen there, since
+		 * neither the encoded record nor the socket write is visible
+		 * from here.
+		 */
+#ifdef USE_LTTNG
+		tracepoint(nfs_rpc, reply_start, reqdata, op_ctx->xid, 0);
+#endif
+		cpu_start = server_stats_cpu_now();
+		sent = svc_sendreply(&reqdata->r_u.req.svc,
+				     reqdesc->xdr_encode_func,
+				     (caddr_t) res_nfs);
+#ifdef USE_LTTNG
+		tracepoint(nfs_rpc, reply_end, reqdata, op_ctx->xid, sent);
+#endif
+		if (cpu_start != 0)
+			server_stats_cpu_done(reqdata,
+					      server_stats_cpu_now() - cpu_start);
+		if (!sent) {
 			LogDebug(COMPONENT_DISPATCH,
 				 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request."
 				 " rpcxid=%" PRIu32
@@ -1372,35 +1575,22 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	}			/* rc == NFS_REQ_DROP */
 
 	/* Finish any request not already deleted */
-	if (dpq_status == DUPREQ_SUCCESS)
-		dpq_status = nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
-	goto freeargs;
-
-	/* Reject the request for authentication reason (incompatible
-	 * file handle) */
-	if (isInfo(COMPONENT_DISPATCH) || isInfo(COMPONENT_EXPORT)) {
-		char dumpfh[1024];
+	(void) nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
 
-		sprint_fhandle3(dumpfh, (nfs_fh3 *) arg_nfs);
-		LogInfo(COMPONENT_DISPATCH,
-			"%s Request from host %s V3 not allowed on this export"
-			", proc=%" PRIu32
-			", FH=%s",
-			progname, client_ip,
-			reqdata->r_u.req.svc.rq_msg.cb_proc, dumpfh);
-	}
-	auth_rc = AUTH_FAILED;
+ freeargs:
+	nfs_rpc_release_req(reqdata);
+}
 
- auth_failure:
-	svcerr_auth(&reqdata->r_u.req.svc, auth_rc);
-	/* nb, a no-op when req is uncacheable */
-	if (nfs_dupreq_delete(&reqdata->r_u.req.svc) != DUPREQ_SUCCESS) {
-		LogCrit(COMPONENT_DISPATCH,
-			"Attempt to delete duplicate request failed on line %d",
-			__LINE__);
-	}
+/**
+ * @brief Release the arguments, reply and context of a request
+ *
+ * @param[in,out] reqdata	NFS request
+ */
+static void nfs_rpc_release_req(request_data_t *reqdata)
+{
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	nfs_arg_t *arg_nfs = &reqdata->r_u.req.arg_nfs;
 
- freeargs:
 	/* Free the allocated resources once the work is done */
 	/* Free the arguments */
 	if ((reqdata->r_u.req.svc.rq_msg.cb_vers == 2)
@@ -1416,10 +1606,11 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	}
 
 	/* Finalize the request. */
-	if (res_nfs)
+	if (reqdata->r_u.req.res_nfs)
 		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
 
 	SetClientIP(NULL);
+	log_filter_done();
 	if (op_ctx->client != NULL) {
 		put_gsh_client(op_ctx->client);
 		op_ctx->client = NULL;
@@ -1436,6 +1627,134 @@ void nfs_rpc_execute(request_data_t *reqdata)
 #endif
 }
 
+/**
+ * @brief Return the transport reference and free a finished request
+ *
+ * @param[in] reqdata	Request to free
+ */
+static void nfs_rpc_finalize_req(request_data_t *reqdata)
+{
+	/* XXX needed? */
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "Signaling completion of request");
+
+	switch (reqdata->rtype) {
+	case NFS_REQUEST:
+		nfs_rpc_client_req_done(reqdata->r_u.req.svc.rq_xprt);
+		/* adjust request count and return xprt ref */
+		gsh_xprt_unref(reqdata->r_u.req.svc.rq_xprt,
+			       XPRT_PRIVATE_FLAG_DECREQ, __func__,
+			       __LINE__);
+		break;
+	case NFS_CALL:
+		break;
+#ifdef _USE_9P
+	case _9P_REQUEST:
+		_9p_free_reqdata(&reqdata->r_u._9p);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	/* Free the req by releasing the entry */
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "Invalidating processed entry");
+
+	pool_free(request_pool_of(reqdata->rtype), reqdata);
+}
+
+/**
+ * @brief Resume a request whose asynchronous I/O has completed
+ *
+ * Runs in the I/O completion stage.  The request context saved in
+ * the request is reinstated, the service function's resume hook
+ * builds the result, then the reply is sent as usual.
+ *
+ * @param[in] ctx Thread context, the argument is the request
+ */
+static void nfs_rpc_resume_req(struct fridgethr_context *ctx)
+{
+	nfs_request_t *reqnfs = ctx->arg;
+	request_data_t *reqdata =
+		container_of(reqnfs, request_data_t, r_u.req);
+	int rc;
+
+	op_ctx = &reqnfs->req_ctx;
+
+	if (op_ctx->client != NULL)
+		SetClientIP(op_ctx->client->hostaddr_str);
+	nfs_log_filter_update();
+
+	rc = reqnfs->async_resume(reqnfs);
+
+	nfs_rpc_complete_req(reqdata, rc);
+	nfs_rpc_finalize_req(reqdata);
+}
+
+/**
+ * @brief Check whether a request may be suspended on asynchronous I/O
+ *
+ * Requests executed directly from the transport's receive path (with
+ * an RPC context) are not owned by a worker and cannot be suspended.
+ *
+ * @param[in] req Request to check
+ *
+ * @return true if the service function may use asynchronous I/O.
+ */
+bool nfs_rpc_async_allowed(struct svc_req *req)
+{
+	return nfs_param.core_param.enable_async_io &&
+	       req->rq_context == NULL;
+}
+
+/**
+ * @brief Mark a request as waiting for an asynchronous I/O
+ *
+ * Called by a service function after it has submitted its I/O.
+ *
+ * @param[in] reqnfs Request that submitted the I/O
+ *
+ * @retval true if the request is suspended, the service function must
+ *         return NFS_REQ_ASYNC_WAIT.
+ * @retval false if the I/O has already completed, the service function
+ *         must call its resume hook itself.
+ */
+bool nfs_rpc_async_suspend(nfs_request_t *reqnfs)
+{
+	return atomic_inc_uint32_t(&reqnfs->async_phase) == 1;
+}
+
+/**
+ * @brief Signal completion of a request's asynchronous I/O
+ *
+ * Called from the FSAL completion callback, on whatever thread the
+ * FSAL completes on.  If the submitting worker has already suspended
+ * the request it is handed to the I/O completion stage, otherwise
+ * the worker will pick up the result inline.
+ *
+ * @param[in] reqnfs Request whose I/O completed
+ */
+void nfs_rpc_async_done(nfs_request_t *reqnfs)
+{
+	struct fridgethr_context ctx;
+	int rc;
+
+	if (atomic_inc_uint32_t(&reqnfs->async_phase) == 1)
+		return;
+
+	rc = fridgethr_submit(ioc_fridge, nfs_rpc_resume_req, reqnfs);
+
+	if (rc != 0) {
+		LogCrit(COMPONENT_DISPATCH,
+			"Unable to schedule I/O completion: %d, completing inline",
+			rc);
+		memset(&ctx, 0, sizeof(ctx));
+		ctx.arg = reqnfs;
+		nfs_rpc_resume_req(&ctx);
+	}
+}
+
 #ifdef _USE_9P
 /**
  * @brief Execute a 9p request
@@ -1473,11 +1792,13 @@ static void _9p_execute(request_data_t *reqdata)
  */
 static void _9p_free_reqdata(struct _9p_request_data *req9p)
 {
-	if (req9p->pconn->trans_type == _9P_TCP)
-		gsh_free(req9p->_9pmsg);
-
 	/* decrease connection refcount */
-	(void) atomic_dec_uint32_t(&req9p->pconn->refcount);
+	if (req9p->pconn->trans_type == _9P_TCP) {
+		gsh_free(req9p->_9pmsg);
+		_9p_tcp_conn_put(req9p->pconn);
+	} else {
+		(void) atomic_dec_uint32_t(&req9p->pconn->refcount);
+	}
 }
 #endif
 
@@ -1498,6 +1819,13 @@ static void worker_thread_initializer(struct fridgethr_context *ctx)
 	snprintf(thr_name, sizeof(thr_name), "work-%u", wd->worker_index);
 	SetNameFunction(thr_name);
 
+	/* Deal the workers out over the nodes */
+	if (nfs_param.core_param.thread_affinity &&
+	    gsh_numa_bind_node(wd->worker_index % gsh_numa_nodes()) != 0)
+		LogDebug(COMPONENT_DISPATCH,
+			 "Could not bind worker %u to a node",
+			 wd->worker_index);
+
 	/* Initalize thr waitq */
 	init_wait_q_entry(&wd->wqe);
 }
@@ -1510,6 +1838,9 @@ static void worker_thread_initializer(struct fridgethr_context *ctx)
 
 static void worker_thread_finalizer(struct fridgethr_context *ctx)
 {
+	/* Release the handles PUTFH cached in this thread */
+	nfs4_fh_cache_flush();
+
 	ctx->thread_info = NULL;
 }
 
@@ -1536,6 +1867,8 @@ static void worker_run(struct fridgethr_context *ctx)
 		if (!reqdata)
 			continue;
 
+		fridgethr_job_start(ctx, &reqdata->time_queued);
+
 /* need to do a getpeername(2) on the socket fd before we dive into the
  * rpc_execute.  9p is messy but we do have the fd....
  */
@@ -1560,7 +1893,11 @@ static void worker_run(struct fridgethr_context *ctx)
 				 reqdata,
 				 reqdata->r_u.req.svc.rq_xprt,
 				 reqdata->r_u.req.svc.rq_xprt->xp_requests);
-			nfs_rpc_execute(reqdata);
+			if (nfs_rpc_execute(reqdata) == NFS_REQ_ASYNC_WAIT) {
+				/* The I/O completion stage owns it now */
+				fridgethr_job_end(ctx);
+				continue;
+			}
 			break;
 
 		case NFS_CALL:
@@ -1576,33 +1913,11 @@ static void worker_run(struct fridgethr_context *ctx)
 		}
 
  finalize_req:
-		/* XXX needed? */
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "Signaling completion of request");
+		nfs_rpc_finalize_req(reqdata);
+		fridgethr_job_end(ctx);
 
-		switch (reqdata->rtype) {
-		case NFS_REQUEST:
-			/* adjust request count and return xprt ref */
-			gsh_xprt_unref(reqdata->r_u.req.svc.rq_xprt,
-				       XPRT_PRIVATE_FLAG_DECREQ, __func__,
-				       __LINE__);
-			break;
-		case NFS_CALL:
-			break;
-#ifdef _USE_9P
-		case _9P_REQUEST:
-			_9p_free_reqdata(&reqdata->r_u._9p);
-			break;
-#endif
-		default:
-			break;
-		}
-
-		/* Free the req by releasing the entry */
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "Invalidating processed entry");
-
-		pool_free(request_pool, reqdata);
+		/* Leave if Nb_Worker was lowered under us */
+		(void) fridgethr_retire_excess(ctx);
 	}
 }
 
@@ -1614,6 +1929,9 @@ int worker_init(void)
 	memset(&frp, 0, sizeof(struct fridgethr_params));
 	frp.thr_max = nfs_param.core_param.nb_worker;
 	frp.thr_min = nfs_param.core_param.nb_worker;
+	if (nfs_param.core_param.worker_autoscale)
+		frp.thr_min = MIN(nfs_param.core_param.nb_worker_min,
+				  nfs_param.core_param.nb_worker);
 	frp.flavor = fridgethr_flavor_looper;
 	frp.thread_initialize = worker_thread_initializer;
 	frp.thread_finalize = worker_thread_finalizer;
@@ -1632,11 +1950,70 @@ int worker_init(void)
 	if (rc != 0) {
 		LogMajor(COMPONENT_DISPATCH,
 			 "Unable to populate worker fridge: %d", rc);
+		return rc;
+	}
+
+	if (!nfs_param.core_param.enable_async_io)
+		return 0;
+
+	/* The I/O completion stage resumes requests suspended on
+	 * asynchronous FSAL I/O.
+	 */
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.core_param.nb_ioc_worker;
+	frp.thr_min = 1;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&ioc_fridge, "IOC", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_DISPATCH,
+			 "Unable to initialize I/O completion fridge: %d", rc);
 	}
 
 	return rc;
 }
 
+/**
+ * @brief Add a worker thread, if below Nb_Worker
+ *
+ * Called by the dispatcher when requests wait too long.
+ */
+
+void worker_grow(void)
+{
+	int rc = fridgethr_grow(worker_fridge, worker_run, NULL);
+
+	if (rc == 0)
+		LogDebug(COMPONENT_DISPATCH, "Added a worker thread");
+	else if (rc != EBUSY)
+		LogMajor(COMPONENT_DISPATCH,
+			 "Unable to add a worker thread: %d", rc);
+}
+
+/**
+ * @brief Resize the worker pool to a new Nb_Worker
+ *
+ * Workers are added at once; surplus ones leave after their current
+ * request, or once idle.
+ *
+ * @param[in] nb_worker New number of workers
+ *
+ * @return 0 on success, an error code otherwise.
+ */
+
+int worker_resize(uint32_t nb_worker)
+{
+	uint32_t thr_min = nb_worker;
+
+	atomic_store_uint32_t(&nfs_param.core_param.nb_worker, nb_worker);
+	if (nfs_param.core_param.worker_autoscale)
+		thr_min = MIN(nfs_param.core_param.nb_worker_min, nb_worker);
+
+	return fridgethr_set_limits(worker_fridge, thr_min, nb_worker,
+				    worker_run, NULL);
+}
+
 int worker_shutdown(void)
 {
 	int rc = fridgethr_sync_command(worker_fridge,
@@ -1651,5 +2028,15 @@ int worker_shutdown(void)
 		LogMajor(COMPONENT_DISPATCH,
 			 "Failed shutting down worker threads: %d", rc);
 	}
+
+	if (ioc_fridge == NULL)
+		return rc;
+
+	if (fridgethr_sync_command(ioc_fridge, fridgethr_comm_stop,
+				   120) == ETIMEDOUT) {
+		LogMajor(COMPONENT_DISPATCH,
+			 "I/O completion shutdown timed out, cancelling threads.");
+		fridgethr_cancel(ioc_fridge);
+	}
 	return rc;
 }
@@ -119,6 +119,11 @@ int _9p_attach(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		goto errout;
 	}
 
+	if (!export_attach(op_ctx->ctx_export)) {
+		err = EAGAIN;
+		goto errout;
+	}
+
 	/* Fill in more of the op_ctx */
 	op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
 	op_ctx->caller_addr = &req9p->pconn->addrpeer;
@@ -147,8 +147,10 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		} else {
 			op_ctx->client = client;
 
-			server_stats_io_done(*count, read_size,
-					     FSAL_IS_ERROR(fsal_status), false);
+			server_stats_io_done(pfid->pentry, *offset, *count,
+					     read_size,
+					     !FSAL_IS_ERROR(fsal_status),
+					     false);
 		}
 
 		if (FSAL_IS_ERROR(fsal_status))
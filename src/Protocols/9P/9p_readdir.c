@@ -82,6 +82,53 @@ static inline u8 *fill_entry(u8 *cursor, u8 qid_type, u64 qid_path, u64 cookie,
 	return cursor;
 }
 
+/* qid type and VFS d_type of each object type, d_type 0 for the types
+ * that are not listed */
+static const struct {
+	u8 qid_type;
+	u8 d_type;
+} _9p_dirent_types[] = {
+	[REGULAR_FILE] = { _9P_QTFILE, DT_REG },
+	[CHARACTER_FILE] = { _9P_QTFILE, DT_CHR },
+	[BLOCK_FILE] = { _9P_QTFILE, DT_BLK },
+	[SYMBOLIC_LINK] = { _9P_QTSYMLINK, DT_LNK },
+	[SOCKET_FILE] = { _9P_QTFILE, DT_SOCK },
+	[FIFO_FILE] = { _9P_QTFILE, DT_FIFO },
+	[DIRECTORY] = { _9P_QTDIR, DT_DIR },
+};
+
+/**
+ * @brief Add an entry to the reply
+ *
+ * @return false if there is no room left for it.
+ */
+static bool _9p_readdir_add(struct _9p_cb_data *tracker, const char *name,
+			    uint64_t fileid, object_file_type_t type,
+			    uint64_t cookie)
+{
+	int name_len = strlen(name);
+
+	if (tracker->count + 24 + name_len > tracker->max)
+		return false;
+
+	if (type >= sizeof(_9p_dirent_types) / sizeof(_9p_dirent_types[0]) ||
+	    _9p_dirent_types[type].d_type == 0) {
+		/* Not listed, but the walk goes on */
+		return true;
+	}
+
+	/* Add 13 bytes in recsize for qid + 8 bytes for offset + 1 for type
+	 * + 2 for strlen = 24 bytes */
+	tracker->count += 24 + name_len;
+
+	tracker->cursor =
+	    fill_entry(tracker->cursor, _9p_dirent_types[type].qid_type,
+		       fileid, cookie, _9p_dirent_types[type].d_type,
+		       name_len, name);
+
+	return true;
+}
+
 static fsal_errors_t _9p_readdir_callback(void *opaque,
 					 struct fsal_obj_handle *obj,
 					 const struct attrlist *attr,
@@ -91,70 +138,33 @@ static fsal_errors_t _9p_readdir_callback(void *opaque,
 {
 	struct fsal_readdir_cb_parms *cb_parms = opaque;
 	struct _9p_cb_data *tracker = cb_parms->opaque;
-	int name_len = strlen(cb_parms->name);
-	u8 qid_type, d_type;
 
 	if (tracker == NULL) {
 		cb_parms->in_result = false;
 		return ERR_FSAL_NO_ERROR;
 	}
 
-	if (tracker->count + 24 + name_len > tracker->max) {
-		cb_parms->in_result = false;
-		return ERR_FSAL_NO_ERROR;
-	}
-
-	switch (obj->type) {
-	case FIFO_FILE:
-		qid_type = _9P_QTFILE;
-		d_type = DT_FIFO;
-		break;
-
-	case CHARACTER_FILE:
-		qid_type = _9P_QTFILE;
-		d_type = DT_CHR;
-		break;
-
-	case BLOCK_FILE:
-		qid_type = _9P_QTFILE;
-		d_type = DT_BLK;
-		break;
-
-	case REGULAR_FILE:
-		qid_type = _9P_QTFILE;
-		d_type = DT_REG;
-		break;
-
-	case SOCKET_FILE:
-		qid_type = _9P_QTFILE;
-		d_type = DT_SOCK;
-		break;
-
-	case DIRECTORY:
-		qid_type = _9P_QTDIR;
-		d_type = DT_DIR;
-		break;
-
-	case SYMBOLIC_LINK:
-		qid_type = _9P_QTSYMLINK;
-		d_type = DT_LNK;
-		break;
-
-	default:
-		cb_parms->in_result = false;
-		return ERR_FSAL_NO_ERROR;
-	}
-
-	/* Add 13 bytes in recsize for qid + 8 bytes for offset + 1 for type
-	 * + 2 for strlen = 24 bytes */
-	tracker->count += 24 + name_len;
+	cb_parms->in_result = _9p_readdir_add(tracker, cb_parms->name,
+					      obj->fileid, obj->type, cookie);
+	return ERR_FSAL_NO_ERROR;
+}
 
-	tracker->cursor =
-	    fill_entry(tracker->cursor, qid_type, obj->fileid,
-		       cookie, d_type, name_len, cb_parms->name);
+/**
+ * @brief Take an entry straight from the cached dirents
+ *
+ * The fileid and type the qid is made of are kept with the cached
+ * name, so no object is looked up.
+ */
+static enum fsal_dir_result _9p_readdir_names_callback(const char *name,
+						       uint64_t fileid,
+						       object_file_type_t type,
+						       void *dir_state,
+						       fsal_cookie_t cookie)
+{
+	struct _9p_cb_data *tracker = dir_state;
 
-	cb_parms->in_result = true;
-	return ERR_FSAL_NO_ERROR;
+	return _9p_readdir_add(tracker, name, fileid, type, cookie)
+		? DIR_CONTINUE : DIR_TERMINATE;
 }
 
 int _9p_readdir(struct _9p_request_data *req9p, u32 *plenout, char *preply)
@@ -278,8 +288,17 @@ int _9p_readdir(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	tracker.count = dcount;
 	tracker.max = *count;
 
-	fsal_status = fsal_readdir(pfid->pentry, cookie, &num_entries, &eod_met,
-				   0, _9p_readdir_callback, &tracker);
+	/* From the dirent cache if it can, resuming at the cookie */
+	fsal_status = fsal_readdir_names(pfid->pentry, cookie, &eod_met,
+					 _9p_readdir_names_callback, &tracker);
+	if (fsal_status.major == ERR_FSAL_NOTSUPP) {
+		/* Back to where the entries were put */
+		tracker.cursor = cursor;
+		tracker.count = dcount;
+		fsal_status = fsal_readdir(pfid->pentry, cookie, &num_entries,
+					   &eod_met, 0, _9p_readdir_callback,
+					   &tracker);
+	}
 	if (FSAL_IS_ERROR(fsal_status)) {
 		/* The avl lookup will try to get the next entry after 'cookie'.
 		 * If none is found CACHE_INODE_NOT_FOUND is returned
@@ -42,6 +42,43 @@
 #include "fsal.h"
 #include "9p.h"
 
+/**
+ * @brief Build the qid of a walked object
+ *
+ * @param[in]  obj The object
+ * @param[out] qid Its qid
+ *
+ * @return false if the object type has no qid.
+ */
+static bool _9p_walk_qid(struct fsal_obj_handle *obj, struct _9p_qid *qid)
+{
+	/* No cache, we want the client to stay synchronous
+	 * with the server */
+	qid->version = 0;
+	qid->path = obj->fileid;
+
+	switch (obj->type) {
+	case REGULAR_FILE:
+	case CHARACTER_FILE:
+	case BLOCK_FILE:
+	case SOCKET_FILE:
+	case FIFO_FILE:
+		qid->type = _9P_QTFILE;
+		return true;
+
+	case SYMBOLIC_LINK:
+		qid->type = _9P_QTSYMLINK;
+		return true;
+
+	case DIRECTORY:
+		qid->type = _9P_QTDIR;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
 int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 {
 	char *cursor = req9p->_9pmsg + _9P_HDR_SIZE + _9P_TYPE_SIZE;
@@ -58,6 +95,8 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	char name[MAXNAMLEN+1];
 
 	u16 *nwqid;
+	/* one qid per component walked */
+	struct _9p_qid wqids[_9P_MAXWELEM];
 
 	struct _9p_fid *pfid = NULL;
 	struct _9p_fid *pnewfid = NULL;
@@ -77,6 +116,9 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	if (*newfid >= _9P_FID_PER_CONN)
 		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
 
+	if (*nwname > _9P_MAXWELEM)
+		return _9p_rerror(req9p, msgtag, E2BIG, plenout, preply);
+
 	pfid = req9p->pconn->fids[*fid];
 	/* Check that it is a valid fid */
 	if (pfid == NULL || pfid->pentry == NULL) {
@@ -103,6 +145,8 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		for (i = 0; i < *nwname; i++) {
 			_9p_getstr(cursor, wnames_len, wnames_str);
 			if (*wnames_len >= sizeof(name)) {
+				if (pentry != pfid->pentry)
+					pentry->obj_ops.put_ref(pentry);
 				gsh_free(pnewfid);
 				return _9p_rerror(req9p, msgtag, ENAMETOOLONG,
 						  plenout, preply);
@@ -122,6 +166,9 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 			fsal_status = fsal_lookup(pentry, name,
 						  &pnewfid->pentry, NULL);
 			if (FSAL_IS_ERROR(fsal_status)) {
+				/* drop the component walked so far */
+				if (pentry != pfid->pentry)
+					pentry->obj_ops.put_ref(pentry);
 				gsh_free(pnewfid);
 				return _9p_rerror(req9p, msgtag,
 						  _9p_tools_errno(fsal_status),
@@ -132,6 +179,15 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 				pentry->obj_ops.put_ref(pentry);
 
 			pentry = pnewfid->pentry;
+
+			if (!_9p_walk_qid(pentry, &wqids[i])) {
+				LogMajor(COMPONENT_9P,
+					 "implementation error, you should not see this message !!!!!!");
+				pentry->obj_ops.put_ref(pentry);
+				gsh_free(pnewfid);
+				return _9p_rerror(req9p, msgtag, EINVAL,
+						  plenout, preply);
+			}
 		}
 
 		pnewfid->fid = *newfid;
@@ -150,41 +206,10 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		pnewfid->export = pfid->export;
 		pnewfid->ucred = pfid->ucred;
 
-		/* Build the qid */
-		/* No cache, we want the client to stay synchronous
-		 * with the server */
-		pnewfid->qid.version = 0;
-		pnewfid->qid.path = pnewfid->pentry->fileid;
+		/* The qid of the new fid is the last one walked */
+		pnewfid->qid = wqids[*nwname - 1];
 
 		pnewfid->xattr = NULL;
-
-		switch (pnewfid->pentry->type) {
-		case REGULAR_FILE:
-		case CHARACTER_FILE:
-		case BLOCK_FILE:
-		case SOCKET_FILE:
-		case FIFO_FILE:
-			pnewfid->qid.type = _9P_QTFILE;
-			break;
-
-		case SYMBOLIC_LINK:
-			pnewfid->qid.type = _9P_QTSYMLINK;
-			break;
-
-		case DIRECTORY:
-			pnewfid->qid.type = _9P_QTDIR;
-			break;
-
-		default:
-			LogMajor(COMPONENT_9P,
-				 "implementation error, you should not see this message !!!!!!");
-			pentry->obj_ops.put_ref(pentry);
-			gsh_free(pnewfid);
-			return _9p_rerror(req9p, msgtag, EINVAL,
-					  plenout, preply);
-			break;
-		}
-
 	}
 
 	/* Initialize state_t embeded in fid. The refcount is initialized
@@ -220,11 +245,8 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	_9p_setptr(cursor, msgtag, u16);
 
 	_9p_setptr(cursor, nwqid, u16);
-	for (i = 0; i < *nwqid; i++) {
-		/** @todo: should be different qids
-		 * for each directory walked through */
-		_9p_setqid(cursor, pnewfid->qid);
-	}
+	for (i = 0; i < *nwqid; i++)
+		_9p_setqid(cursor, wqids[i]);
 
 	_9p_setendptr(cursor, preply);
 	_9p_checkbound(cursor, preply, plenout);
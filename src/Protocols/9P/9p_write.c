@@ -170,9 +170,9 @@ int _9p_write(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		} else {
 			op_ctx->client = client;
 
-			server_stats_io_done(size,
+			server_stats_io_done(pfid->pentry, *offset, size,
 					     written_size,
-					     FSAL_IS_ERROR(fsal_status),
+					     !FSAL_IS_ERROR(fsal_status),
 					     true);
 		}
 
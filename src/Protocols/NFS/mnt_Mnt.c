@@ -119,6 +119,12 @@ int mnt_Mnt(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 	/* set the export in the context */
 	op_ctx->ctx_export = export;
+
+	if (!export_attach(export)) {
+		res->res_mnt3.fhs_status = MNT3ERR_SERVERFAULT;
+		goto out;
+	}
+
 	op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
 
 	/* Check access based on client. Don't bother checking TCP/UDP as some
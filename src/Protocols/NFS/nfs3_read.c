@@ -46,6 +46,8 @@
 #include "sal_functions.h"
 
 static void nfs_read_ok(struct svc_req *req, nfs_res_t *res, char *data,
+			struct iovec *iov, u_int iovcnt,
+			struct nfs_read_fd *rfd,
 			uint32_t read_size, struct fsal_obj_handle *obj,
 			int eof)
 {
@@ -54,6 +56,17 @@ static void nfs_read_ok(struct svc_req *req, nfs_res_t *res, char *data,
 		data = NULL;
 	}
 
+	if ((read_size == 0) && (iov != NULL)) {
+		nfs_read_iov_free(iov, iovcnt);
+		iov = NULL;
+		iovcnt = 0;
+	}
+
+	if ((read_size == 0) && (rfd != NULL)) {
+		nfs_read_fd_release(rfd);
+		rfd = NULL;
+	}
+
 	/* Build Post Op Attributes */
 	nfs_SetPostOpAttr(obj,
 			  &res->res_read3.READ3res_u.resok.file_attributes,
@@ -63,10 +76,160 @@ static void nfs_read_ok(struct svc_req *req, nfs_res_t *res, char *data,
 	res->res_read3.READ3res_u.resok.count = read_size;
 	res->res_read3.READ3res_u.resok.data.data_val = data;
 	res->res_read3.READ3res_u.resok.data.data_len = read_size;
+	res->res_read3.READ3res_u.resok.data_iov = iov;
+	res->res_read3.READ3res_u.resok.data_iovcnt = iovcnt;
+	res->res_read3.READ3res_u.resok.data_fd = rfd;
 
 	res->res_read3.status = NFS3_OK;
 }
 
+/**
+ * @brief Per request state of an asynchronous READ
+ */
+struct nfs3_read_async_data {
+	struct fsal_obj_handle *obj;	/*< File being read */
+	nfs_res_t *res;			/*< Result to fill in */
+	size_t size;			/*< Requested size */
+	fsal_status_t status;		/*< Status of the I/O */
+	u_int iovcnt;			/*< Number of buffers */
+	struct fsal_io_arg io_arg;	/*< FSAL I/O description */
+};
+
+/**
+ * @brief Build the READ3 result once the I/O is done
+ *
+ * Releases the share reservation, the reference on obj and, on
+ * error, the data buffers or descriptor.
+ *
+ * @return NFS_REQ_OK or NFS_REQ_DROP.
+ */
+static int nfs3_read_finish(struct svc_req *req, nfs_res_t *res,
+			    struct fsal_obj_handle *obj,
+			    fsal_status_t fsal_status, uint64_t offset,
+			    size_t size, void *data, struct iovec *iov,
+			    u_int iovcnt, struct nfs_read_fd *rfd,
+			    size_t read_size, bool eof_met)
+{
+	int rc = NFS_REQ_OK;
+
+	state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
+
+	if (!FSAL_IS_ERROR(fsal_status)) {
+		nfs_read_ok(req, res, data, iov, iovcnt, rfd, read_size, obj,
+			    eof_met);
+		goto out;
+	}
+
+	gsh_free(data);
+	if (iov != NULL)
+		nfs_read_iov_free(iov, iovcnt);
+	if (rfd != NULL)
+		nfs_read_fd_release(rfd);
+
+	/* If we are here, there was an error */
+	if (nfs_RetryableError(fsal_status.major)) {
+		rc = NFS_REQ_DROP;
+		goto out;
+	}
+
+	res->res_read3.status = nfs3_Errno_status(fsal_status);
+
+	nfs_SetPostOpAttr(obj,
+			  &res->res_read3.READ3res_u.resfail.file_attributes,
+			  NULL);
+
+ out:
+	server_stats_io_done(obj, offset, size, read_size,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     false);
+
+	/* return references */
+	obj->obj_ops.put_ref(obj);
+	return rc;
+}
+
+/**
+ * @brief Resume an asynchronous READ
+ *
+ * @param[in] reqnfs Request whose I/O completed
+ *
+ * @return NFS_REQ_OK or NFS_REQ_DROP.
+ */
+static int nfs3_read_resume(nfs_request_t *reqnfs)
+{
+	struct nfs3_read_async_data *rd = reqnfs->async_arg;
+	int rc;
+
+	rc = nfs3_read_finish(&reqnfs->svc, rd->res, rd->obj, rd->status,
+			      rd->io_arg.offset, rd->size, NULL, rd->io_arg.iov,
+			      rd->iovcnt, NULL, rd->io_arg.io_amount,
+			      rd->io_arg.end_of_file);
+
+	reqnfs->async_arg = NULL;
+	gsh_free(rd);
+
+	return rc;
+}
+
+/**
+ * @brief FSAL completion callback for an asynchronous READ
+ */
+static void nfs3_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			 struct fsal_io_arg *io_arg, void *caller_arg)
+{
+	nfs_request_t *reqnfs = caller_arg;
+	struct nfs3_read_async_data *rd = reqnfs->async_arg;
+
+	/* Fixup ERR_FSAL_SHARE_DENIED status */
+	if (ret.major == ERR_FSAL_SHARE_DENIED)
+		ret = fsalstat(ERR_FSAL_LOCKED, 0);
+
+	if (FSAL_IS_ERROR(ret))
+		io_arg->io_amount = 0;
+
+	rd->status = ret;
+
+	nfs_rpc_async_done(reqnfs);
+}
+
+/**
+ * @brief Submit an asynchronous READ
+ *
+ * The share reservation, the buffers and the reference on obj are
+ * handed over to the completion.
+ *
+ * @return NFS_REQ_ASYNC_WAIT if the request is suspended, otherwise
+ *         the final result.
+ */
+static int nfs3_read_async(struct svc_req *req, nfs_res_t *res,
+			   struct fsal_obj_handle *obj, uint64_t offset,
+			   size_t size, struct iovec *iov, u_int iovcnt)
+{
+	nfs_request_t *reqnfs = container_of(req, nfs_request_t, svc);
+	struct nfs3_read_async_data *rd = gsh_calloc(1, sizeof(*rd));
+
+	rd->obj = obj;
+	rd->res = res;
+	rd->size = size;
+	rd->iovcnt = iovcnt;
+	/** @todo for now pass NULL state */
+	rd->io_arg.state = NULL;
+	rd->io_arg.offset = offset;
+	rd->io_arg.iov = iov;
+	rd->io_arg.iovcnt = iovcnt;
+
+	reqnfs->async_resume = nfs3_read_resume;
+	reqnfs->async_arg = rd;
+
+	obj->obj_ops.read2_async(obj, true, &rd->io_arg, nfs3_read_cb,
+				 reqnfs);
+
+	if (nfs_rpc_async_suspend(reqnfs))
+		return NFS_REQ_ASYNC_WAIT;
+
+	return nfs3_read_resume(reqnfs);
+}
+
 /**
  *
  * @brief The NFSPROC3_READ
@@ -92,6 +255,9 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	size_t read_size = 0;
 	uint64_t offset = 0;
 	void *data = NULL;
+	struct iovec *iov = NULL;
+	u_int iovcnt = 0;
+	struct nfs_read_fd *rfd = NULL;
 	bool eof_met = false;
 	int rc = NFS_REQ_OK;
 	bool sync = false;
@@ -121,6 +287,9 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	res->res_read3.READ3res_u.resok.count = 0;
 	res->res_read3.READ3res_u.resok.data.data_val = NULL;
 	res->res_read3.READ3res_u.resok.data.data_len = 0;
+	res->res_read3.READ3res_u.resok.data_iov = NULL;
+	res->res_read3.READ3res_u.resok.data_iovcnt = 0;
+	res->res_read3.READ3res_u.resok.data_fd = NULL;
 	res->res_read3.status = NFS3_OK;
 	obj = nfs3_FhandleToCache(&arg->arg_read3.file,
 				    &res->res_read3.status, &rc);
@@ -200,12 +369,10 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	}
 
 	if (size == 0) {
-		nfs_read_ok(req, res, NULL, 0, obj, 0);
+		nfs_read_ok(req, res, NULL, NULL, 0, NULL, 0, obj, 0);
 		rc = NFS_REQ_OK;
 		goto out;
 	} else {
-		data = gsh_malloc(size);
-
 		res->res_read3.status = nfs3_Errno_state(
 				state_share_anonymous_io_start(
 					obj,
@@ -214,22 +381,52 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 		if (res->res_read3.status != NFS3_OK) {
 			rc = NFS_REQ_OK;
-			gsh_free(data);
 			goto out;
 		}
 
-		if (obj->fsal->m_ops.support_ex(obj)) {
-			/* Call the new fsal_read2 */
+		/** @todo for now pass NULL state */
+		if (nfs_read_fd_get(obj, true, NULL, offset, size, &rfd,
+				    &read_size, &eof_met, &fsal_status)) {
+			/* The data is read when the reply is encoded */
+			return nfs3_read_finish(req, res, obj, fsal_status,
+						offset, size, NULL, NULL, 0,
+						rfd, read_size, eof_met);
+		}
+
+		if (nfs_read_use_iov(obj))
+			iov = nfs_read_iov_alloc(size, &iovcnt);
+		else
+			data = gsh_malloc(size);
+
+		if (iov != NULL && nfs_rpc_async_allowed(req)) {
+			/* Completion releases the share and obj reference */
+			return nfs3_read_async(req, res, obj, offset, size,
+					       iov, iovcnt);
+		}
+
+		if (iov != NULL) {
+			/* Call the new fsal_readv2 */
 			/** @todo for now pass NULL state */
-			fsal_status = fsal_read2(obj,
+			fsal_status = fsal_readv2(obj,
 						  true,
 						  NULL,
 						  offset,
-						  size,
+						  iov,
+						  iovcnt,
 						  &read_size,
-						  data,
-						  &eof_met,
-						  NULL);
+						  &eof_met);
+		} else if (obj->fsal->m_ops.support_ex(obj)) {
+			/* Call the new fsal_read2 */
+			/** @todo for now pass NULL state */
+			fsal_status = fsal_read2(obj,
+						 true,
+						 NULL,
+						 offset,
+						 size,
+						 &read_size,
+						 data,
+						 &eof_met,
+						 NULL);
 		} else {
 			/* Call legacy fsal_rdwr */
 			fsal_status = fsal_rdwr(obj,
@@ -243,38 +440,20 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 						NULL);
 		}
 
-		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
-
-		if (!FSAL_IS_ERROR(fsal_status)) {
-			nfs_read_ok(req, res, data, read_size, obj, eof_met);
-			rc = NFS_REQ_OK;
-			goto out;
-		}
-		gsh_free(data);
-	}
-
-	/* If we are here, there was an error */
-	if (nfs_RetryableError(fsal_status.major)) {
-		rc = NFS_REQ_DROP;
-		goto out;
+		return nfs3_read_finish(req, res, obj, fsal_status, offset,
+					size,
+					data, iov, iovcnt, NULL, read_size,
+					eof_met);
 	}
 
-	res->res_read3.status = nfs3_Errno_status(fsal_status);
-
-	nfs_SetPostOpAttr(obj,
-			  &res->res_read3.READ3res_u.resfail.file_attributes,
-			  NULL);
-
-	rc = NFS_REQ_OK;
-
  out:
+	server_stats_io_done(obj, offset, size, read_size,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     false);
+
 	/* return references */
 	if (obj)
 		obj->obj_ops.put_ref(obj);
-
-	server_stats_io_done(size, read_size,
-			     (rc == NFS_REQ_OK) ? true : false,
-			     false);
 	return rc;
 }				/* nfs3_read */
 
@@ -287,8 +466,14 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
  */
 void nfs3_read_free(nfs_res_t *res)
 {
-	if ((res->res_read3.status == NFS3_OK)
-	    && (res->res_read3.READ3res_u.resok.data.data_len != 0)) {
+	if (res->res_read3.status != NFS3_OK)
+		return;
+
+	if (res->res_read3.READ3res_u.resok.data_iov != NULL)
+		nfs_read_iov_free(res->res_read3.READ3res_u.resok.data_iov,
+				  res->res_read3.READ3res_u.resok.data_iovcnt);
+	else if (res->res_read3.READ3res_u.resok.data_fd != NULL)
+		nfs_read_fd_release(res->res_read3.READ3res_u.resok.data_fd);
+	else if (res->res_read3.READ3res_u.resok.data.data_len != 0)
 		gsh_free(res->res_read3.READ3res_u.resok.data.data_val);
-	}
 }
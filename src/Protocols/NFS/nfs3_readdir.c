@@ -69,6 +69,9 @@ struct nfs3_readdir_cb_data {
 				   buffer */
 	size_t total_entries;	/*< The total number of entries in the
 				   array */
+	char *names;		/*< Where the next name goes, in the same
+				   allocation as entries */
+	size_t names_left;	/*< Bytes left there */
 	nfsstat3 error;		/*< Set to a value other than NFS_OK if the
 				   callback function finds a fatal error. */
 };
@@ -127,6 +130,8 @@ int nfs3_readdir(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	fsal_status_t fsal_status_gethandle = {0, 0};
 	int rc = NFS_REQ_OK;
 	struct nfs3_readdir_cb_data tracker = { NULL };
+	struct nfs3_readdir_key cache_key;
+	bool cacheable = false;
 	bool use_cookie_verifier = op_ctx_export_has_option(
 					EXPORT_OPTION_USE_COOKIE_VERIFIER);
 
@@ -241,9 +246,26 @@ int nfs3_readdir(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		}
 	}
 
-	tracker.entries = gsh_calloc(estimated_num_entries, sizeof(entry3));
+	cacheable = nfs3_readdir_cache_key(dir_obj, cookie, count, 0, false,
+					   &cache_key);
+	if (cacheable &&
+	    nfs3_readdir_cache_get(&cache_key, (void **)&tracker.entries,
+				   &eod_met)) {
+		RES_READDIR3_OK->reply.entries = tracker.entries;
+		RES_READDIR3_OK->reply.eof = eod_met;
+		goto out_ok;
+	}
+
 	tracker.total_entries = estimated_num_entries;
 	tracker.mem_left = count - sizeof(READDIR3resok);
+	/* The names follow the entries, in a single allocation */
+	tracker.names_left = MIN(tracker.mem_left,
+				 estimated_num_entries * (MAXNAMLEN + 1));
+	tracker.entries = nfs3_dirents_alloc(estimated_num_entries *
+					     sizeof(entry3) +
+					     tracker.names_left);
+	memset(tracker.entries, 0, estimated_num_entries * sizeof(entry3));
+	tracker.names = (char *)(tracker.entries + estimated_num_entries);
 	tracker.count = 0;
 	tracker.error = NFS3_OK;
 
@@ -325,12 +347,19 @@ int nfs3_readdir(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		     fsal_cookie);
 
 	if ((num_entries == 0) && (cookie > 1)) {
+		nfs3_dirents_put(tracker.entries);
+		tracker.entries = NULL;
 		RES_READDIR3_OK->reply.entries = NULL;
 		RES_READDIR3_OK->reply.eof = TRUE;
 	} else {
 		RES_READDIR3_OK->reply.entries = tracker.entries;
 		RES_READDIR3_OK->reply.eof = eod_met;
+		if (cacheable)
+			nfs3_readdir_cache_put(&cache_key, tracker.entries,
+					       eod_met);
 	}
+
+ out_ok:
 	nfs_SetPostOpAttr(dir_obj, &RES_READDIR3_OK->dir_attributes, NULL);
 	memcpy(RES_READDIR3_OK->cookieverf, cookie_verifier,
 	       sizeof(cookieverf3));
@@ -347,8 +376,7 @@ int nfs3_readdir(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		parent_dir_obj->obj_ops.put_ref(parent_dir_obj);
 
 	/* Deallocate memory in the event of an error */
-	if (((res->res_readdir3.status != NFS3_OK) || (rc != NFS_REQ_OK) ||
-	    ((num_entries == 0) && (cookie > 1))) &&
+	if (((res->res_readdir3.status != NFS3_OK) || (rc != NFS_REQ_OK)) &&
 	    (tracker.entries != NULL)) {
 		free_entry3s(tracker.entries);
 		RES_READDIR3_OK->reply.entries = NULL;
@@ -376,8 +404,8 @@ void nfs3_readdir_free(nfs_res_t *resp)
  * @brief Populate entry3s when called from fsal_readdir
  *
  * This function is a callback passed to fsal_readdir.  It
- * fills in a pre-allocated array of entry3 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * fills in a pre-allocated array of entry3 structures and copies the
+ * name into the space that follows the array.
  *
  * @param opaque [in] Pointer to a struct nfs3_readdir_cb_data that is
  *                    gives the location of the array and other
@@ -409,7 +437,7 @@ fsal_errors_t nfs3_readdir_callback(void *opaque,
 		cb_parms->in_result = false;
 		return ERR_FSAL_NO_ERROR;
 	}
-	if (tracker->mem_left < need) {
+	if (tracker->mem_left < need || tracker->names_left < namelen + 1) {
 		if (tracker->count == 0)
 			tracker->error = NFS3ERR_TOOSMALL;
 
@@ -418,7 +446,10 @@ fsal_errors_t nfs3_readdir_callback(void *opaque,
 	}
 
 	e3->fileid = obj->fileid;
-	e3->name = gsh_strdup(cb_parms->name);
+	e3->name = tracker->names;
+	memcpy(e3->name, cb_parms->name, namelen + 1);
+	tracker->names += namelen + 1;
+	tracker->names_left -= namelen + 1;
 	e3->cookie = cookie;
 
 	if (tracker->count > 0)
@@ -433,18 +464,13 @@ fsal_errors_t nfs3_readdir_callback(void *opaque,
 /**
  * @brief Clean up memory allocated to serve NFSv3 READDIR
  *
- * This function traverses the list of entries, freeing all names
- * allocated in the callback function, then frees the list itself.
+ * The names live in the same allocation as the entries, which the
+ * reply cache may share.
  *
  * @param entry3s [in] Pointer to first obj
  */
 
 static void free_entry3s(entry3 *entry3s)
 {
-	entry3 *entry = NULL;
-
-	for (entry = entry3s; entry != NULL; entry = entry->nextentry)
-		gsh_free(entry->name);
-
-	gsh_free(entry3s);
+	nfs3_dirents_put(entry3s);
 }
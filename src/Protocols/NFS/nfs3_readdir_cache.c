@@ -0,0 +1,257 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file  nfs3_readdir_cache.c
+ * @brief Cache of NFSv3 READDIR and READDIRPLUS replies
+ *
+ * A reply's entries, names and handles are a single block, which the
+ * cache shares with every reply built from it.  A cached reply is
+ * keyed by the directory and its change attribute, so any change to
+ * the directory misses it, and by everything else the reply depends
+ * on.  As READDIRPLUS also carries the attributes of the entries,
+ * which change without the directory, a reply is only served for
+ * NFS3_READDIR_CACHE_TIME seconds.
+ *
+ * The cache is direct mapped, a new reply replaces whatever was in
+ * its slot.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <time.h>
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
+#include "nfs_proto_tools.h"
+#include "abstract_atomic.h"
+#include "city.h"
+
+/** Seconds a cached reply is served */
+#define NFS3_READDIR_CACHE_TIME 2
+
+/**
+ * @brief Header of a block of directory entries
+ */
+struct nfs3_dirents {
+	int32_t refcount;
+	int32_t pad;		/*< Keeps the entries 8 byte aligned */
+	/* The entries follow */
+};
+
+struct nfs3_readdir_slot {
+	pthread_mutex_t mtx;
+	struct nfs3_readdir_key key;
+	void *entries;		/*< Referenced, NULL if the slot is empty */
+	bool eof;
+	time_t filled;
+};
+
+static struct nfs3_readdir_slot *nfs3_readdir_slots;
+static uint32_t nfs3_readdir_nslots;
+
+/**
+ * @brief Allocate a block of directory entries
+ *
+ * @param[in] size Bytes of the block
+ *
+ * @return The block, with one reference.
+ */
+void *nfs3_dirents_alloc(size_t size)
+{
+	struct nfs3_dirents *dirents = gsh_malloc(sizeof(*dirents) + size);
+
+	dirents->refcount = 1;
+
+	return dirents + 1;
+}
+
+static void *nfs3_dirents_get(void *entries)
+{
+	struct nfs3_dirents *dirents = (struct nfs3_dirents *)entries - 1;
+
+	(void) atomic_inc_int32_t(&dirents->refcount);
+
+	return entries;
+}
+
+/**
+ * @brief Release a reference on a block of directory entries
+ *
+ * @param[in] entries The block, may be NULL
+ */
+void nfs3_dirents_put(void *entries)
+{
+	struct nfs3_dirents *dirents;
+
+	if (entries == NULL)
+		return;
+
+	dirents = (struct nfs3_dirents *)entries - 1;
+	if (atomic_dec_int32_t(&dirents->refcount) == 0)
+		gsh_free(dirents);
+}
+
+/**
+ * @brief Allocate the reply cache, sized by Readdir_Cache_Size
+ */
+void nfs3_readdir_cache_pkginit(void)
+{
+	uint32_t i;
+
+	nfs3_readdir_nslots = nfs_param.core_param.readdir_cache_size;
+	if (nfs3_readdir_nslots == 0)
+		return;
+
+	nfs3_readdir_slots = gsh_calloc(nfs3_readdir_nslots,
+					sizeof(*nfs3_readdir_slots));
+	for (i = 0; i < nfs3_readdir_nslots; i++)
+		PTHREAD_MUTEX_init(&nfs3_readdir_slots[i].mtx, NULL);
+}
+
+/**
+ * @brief Make the key of a listing of a directory
+ *
+ * Makes the access checks fsal_readdir() would, so that a cached reply
+ * is only served to a caller that may list the directory, and only
+ * with attributes to one that may have them.
+ *
+ * @param[in]  dir      The directory
+ * @param[in]  cookie   Cookie of the request
+ * @param[in]  count    dircount, or count for READDIR
+ * @param[in]  maxcount maxcount, 0 for READDIR
+ * @param[in]  plus     Whether this is READDIRPLUS
+ * @param[out] key      The key
+ *
+ * @return false if the cache is off or the listing is not cacheable.
+ */
+bool nfs3_readdir_cache_key(struct fsal_obj_handle *dir, uint64_t cookie,
+			    uint32_t count, uint32_t maxcount, bool plus,
+			    struct nfs3_readdir_key *key)
+{
+	fsal_accessflags_t access_mask =
+	    (FSAL_MODE_MASK_SET(FSAL_R_OK) |
+	     FSAL_ACE4_MASK_SET(FSAL_ACE_PERM_LIST_DIR));
+	fsal_accessflags_t access_mask_attr =
+	    (FSAL_MODE_MASK_SET(FSAL_R_OK) | FSAL_MODE_MASK_SET(FSAL_X_OK) |
+	     FSAL_ACE4_MASK_SET(FSAL_ACE_PERM_LIST_DIR) |
+	     FSAL_ACE4_MASK_SET(FSAL_ACE_PERM_EXECUTE));
+	struct attrlist attrs;
+	fsal_status_t status;
+
+	if (nfs3_readdir_nslots == 0)
+		return false;
+
+	if (FSAL_IS_ERROR(fsal_access(dir, access_mask)))
+		return false;
+
+	/* compared with memcmp, padding included */
+	memset(key, 0, sizeof(*key));
+
+	if (plus)
+		key->attrs = !FSAL_IS_ERROR(fsal_access(dir,
+							access_mask_attr));
+
+	fsal_prepare_attrs(&attrs, ATTR_CHANGE | ATTR_CTIME);
+	status = dir->obj_ops.getattrs(dir, &attrs);
+	key->change = attrs.change;
+	key->ctime = attrs.ctime;
+	fsal_release_attrs(&attrs);
+
+	if (FSAL_IS_ERROR(status))
+		return false;
+
+	key->fsid = dir->fsid;
+	key->fileid = dir->fileid;
+	key->cookie = cookie;
+	key->count = count;
+	key->maxcount = maxcount;
+	key->export_id = op_ctx->ctx_export->export_id;
+	key->plus = plus;
+
+	return true;
+}
+
+static struct nfs3_readdir_slot *
+nfs3_readdir_slot(const struct nfs3_readdir_key *key)
+{
+	uint64_t hash = CityHash64WithSeed((const char *)key, sizeof(*key),
+					   557);
+
+	return &nfs3_readdir_slots[hash % nfs3_readdir_nslots];
+}
+
+/**
+ * @brief Look up a cached reply
+ *
+ * @param[in]  key     Key from nfs3_readdir_cache_key()
+ * @param[out] entries The entries, with a reference for the caller
+ * @param[out] eof     Whether they reach the end of the directory
+ *
+ * @return true if a reply was found.
+ */
+bool nfs3_readdir_cache_get(const struct nfs3_readdir_key *key,
+			    void **entries, bool *eof)
+{
+	struct nfs3_readdir_slot *slot = nfs3_readdir_slot(key);
+	bool found = false;
+
+	PTHREAD_MUTEX_lock(&slot->mtx);
+	if (slot->entries != NULL &&
+	    memcmp(&slot->key, key, sizeof(*key)) == 0 &&
+	    time(NULL) - slot->filled < NFS3_READDIR_CACHE_TIME) {
+		*entries = nfs3_dirents_get(slot->entries);
+		*eof = slot->eof;
+		found = true;
+	}
+	PTHREAD_MUTEX_unlock(&slot->mtx);
+
+	LogFullDebug(COMPONENT_NFS_READDIR,
+		     "cookie=%" PRIu64 " %s", key->cookie,
+		     found ? "hit" : "miss");
+
+	return found;
+}
+
+/**
+ * @brief Cache a reply
+ *
+ * @param[in] key     Key from nfs3_readdir_cache_key()
+ * @param[in] entries The entries, the cache takes a reference of its own
+ * @param[in] eof     Whether they reach the end of the directory
+ */
+void nfs3_readdir_cache_put(const struct nfs3_readdir_key *key,
+			    void *entries, bool eof)
+{
+	struct nfs3_readdir_slot *slot = nfs3_readdir_slot(key);
+	void *old;
+
+	PTHREAD_MUTEX_lock(&slot->mtx);
+	old = slot->entries;
+	slot->key = *key;
+	slot->entries = nfs3_dirents_get(entries);
+	slot->eof = eof;
+	slot->filled = time(NULL);
+	PTHREAD_MUTEX_unlock(&slot->mtx);
+
+	nfs3_dirents_put(old);
+}
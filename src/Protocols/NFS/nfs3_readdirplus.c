@@ -70,6 +70,9 @@ struct nfs3_readdirplus_cb_data {
 				   buffer */
 	size_t total_entries;	/*< The number of entires we allocated for
 				   the array. */
+	char *names;		/*< Where the next name or handle goes, in
+				   the same allocation as entries */
+	size_t names_left;	/*< Bytes left there */
 	nfsstat3 error;		/*< Set to a value other than NFS_OK if the
 				   callback function finds a fatal error. */
 };
@@ -129,6 +132,8 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		.error = NFS3_OK,
 	};
 	struct attrlist attrs_dir, attrs_parent;
+	struct nfs3_readdir_key cache_key;
+	bool cacheable = false;
 	bool use_cookie_verifier = op_ctx_export_has_option(
 					EXPORT_OPTION_USE_COOKIE_VERIFIER);
 
@@ -252,14 +257,37 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries = NULL;
 	res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.eof = FALSE;
 
+	cacheable = nfs3_readdir_cache_key(dir_obj, begin_cookie,
+					   arg->arg_readdirplus3.dircount,
+					   arg->arg_readdirplus3.maxcount,
+					   true, &cache_key);
+	if (cacheable &&
+	    nfs3_readdir_cache_get(&cache_key, (void **)&tracker.entries,
+				   &eod_met)) {
+		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries =
+		    tracker.entries;
+		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.eof =
+		    eod_met;
+		goto out_ok;
+	}
+
 	/* Fudge cookie for "." and "..", if necessary */
 	if (begin_cookie > 2)
 		fsal_cookie = begin_cookie;
 	else
 		fsal_cookie = 0;
 
-	/* Allocate space for entries */
-	tracker.entries = gsh_calloc(estimated_num_entries, sizeof(entryplus3));
+	/* Allocate space for entries, followed by their names and
+	 * handles, so the whole reply is a single allocation.
+	 */
+	tracker.names_left = MIN(tracker.mem_left,
+				 estimated_num_entries *
+				 (MAXNAMLEN + 1 + NFS3_FHSIZE));
+	tracker.entries = nfs3_dirents_alloc(estimated_num_entries *
+					     sizeof(entryplus3) +
+					     tracker.names_left);
+	memset(tracker.entries, 0, estimated_num_entries * sizeof(entryplus3));
+	tracker.names = (char *)(tracker.entries + estimated_num_entries);
 
 	if (begin_cookie == 0) {
 		/* Fill in "." */
@@ -331,6 +359,8 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		     PRIu64 ")", fsal_cookie);
 
 	if ((num_entries == 0) && (begin_cookie > 1)) {
+		nfs3_dirents_put(tracker.entries);
+		tracker.entries = NULL;
 		res->res_readdirplus3.status = NFS3_OK;
 		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries =
 		    NULL;
@@ -340,8 +370,12 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		    tracker.entries;
 		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.eof =
 		    eod_met;
+		if (cacheable)
+			nfs3_readdir_cache_put(&cache_key, tracker.entries,
+					       eod_met);
 	}
 
+ out_ok:
 	nfs_SetPostOpAttr(dir_obj,
 			  &res->res_readdirplus3.READDIRPLUS3res_u.resok.
 				dir_attributes,
@@ -401,8 +435,8 @@ void nfs3_readdirplus_free(nfs_res_t *resp)
  * @brief Populate entryplus3s when called from fsal_readdir
  *
  * This function is a callback passed to fsal_readdir.  It
- * fills in a pre-allocated array of entryplys3 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * fills in a pre-allocated array of entryplys3 structures and copies
+ * the name and handle into the space that follows the array.
  *
  * @param opaque [in] Pointer to a struct nfs3_readdirplus_cb_data that is
  *                    gives the location of the array and other
@@ -436,7 +470,8 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 	 * we're close enough to the buffer size limit and t's time to
 	 * stop anyway */
 	if (tracker->mem_left
-	    < (sizeof(entryplus3) + namelen + NFS3_FHSIZE)) {
+	    < (sizeof(entryplus3) + namelen + NFS3_FHSIZE) ||
+	    tracker->names_left < namelen + 1 + NFS3_FHSIZE) {
 		if (tracker->count == 0)
 			tracker->error = NFS3ERR_TOOSMALL;
 
@@ -445,7 +480,10 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 	}
 
 	ep3->fileid = obj->fileid;
-	ep3->name = gsh_strdup(cb_parms->name);
+	ep3->name = tracker->names;
+	memcpy(ep3->name, cb_parms->name, namelen + 1);
+	tracker->names += namelen + 1;
+	tracker->names_left -= namelen + 1;
 	ep3->cookie = cookie;
 
 	/* Account for file name + length + cookie */
@@ -453,17 +491,23 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 
 	if (cb_parms->attr_allowed) {
 		ep3->name_handle.handle_follows = TRUE;
+		ep3->name_handle.post_op_fh3_u.handle.data.data_val =
+		    tracker->names;
 
-		if (!nfs3_FSALToFhandle(true,
+		if (!nfs3_FSALToFhandle(false,
 					&ep3->name_handle.post_op_fh3_u.handle,
 					obj,
 					op_ctx->ctx_export)) {
 			tracker->error = NFS3ERR_SERVERFAULT;
-			gsh_free(ep3->name);
 			cb_parms->in_result = false;
 			return ERR_FSAL_NO_ERROR;
 		}
 
+		tracker->names +=
+		    ep3->name_handle.post_op_fh3_u.handle.data.data_len;
+		tracker->names_left -=
+		    ep3->name_handle.post_op_fh3_u.handle.data.data_len;
+
 		/* Account for filehande + length + follows + nextentry */
 		tracker->mem_left -=
 		    ep3->name_handle.post_op_fh3_u.handle.data.data_len + 12;
@@ -497,20 +541,13 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 /**
  * @brief Clean up memory allocated to serve NFSv3 READDIRPLUS
  *
- * This function traverses the list of entries, freeing all names
- * allocated in the callback function, then frees the list itself.
+ * The names and handles live in the same allocation as the entries,
+ * which the reply cache may share.
  *
  * @param entryplus3s [in] Pointer to first obj
  */
 
 static void free_entryplus3s(entryplus3 *entryplus3s)
 {
-	entryplus3 *entry = NULL;
-
-	for (entry = entryplus3s; entry != NULL; entry = entry->nextentry) {
-		gsh_free(entry->name);
-		gsh_free(entry->name_handle.post_op_fh3_u.handle.data.data_val);
-	}
-
-	gsh_free(entryplus3s);
+	nfs3_dirents_put(entryplus3s);
 }
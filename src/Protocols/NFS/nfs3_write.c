@@ -47,6 +47,177 @@
 #include "export_mgr.h"
 #include "sal_functions.h"
 
+/**
+ * @brief Per request state of an asynchronous WRITE
+ */
+struct nfs3_write_async_data {
+	struct fsal_obj_handle *obj;	/*< File being written */
+	nfs_res_t *res;			/*< Result to fill in */
+	size_t size;			/*< Requested size */
+	fsal_status_t status;		/*< Status of the I/O */
+	struct iovec iov;		/*< The data to write */
+	struct fsal_io_arg io_arg;	/*< FSAL I/O description */
+};
+
+/**
+ * @brief Build the WRITE3 result once the I/O is done
+ *
+ * Releases the share reservation and the reference on obj.
+ *
+ * @param[in]  obj          File written
+ * @param[out] res          Result structure
+ * @param[in]  fsal_status  Status of the write
+ * @param[in]  offset       Offset written at
+ * @param[in]  size         Requested size
+ * @param[in]  written_size Amount written
+ * @param[in]  sync         Whether the data is stable
+ *
+ * @return NFS_REQ_OK or NFS_REQ_DROP.
+ */
+static int nfs3_write_finish(struct fsal_obj_handle *obj, nfs_res_t *res,
+			     fsal_status_t fsal_status, uint64_t offset,
+			     size_t size,
+			     size_t written_size, bool sync)
+{
+	int rc = NFS_REQ_OK;
+
+	state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		/* If we are here, there was an error */
+		LogFullDebug(COMPONENT_NFSPROTO,
+			     "failed write: fsal_status=%s",
+			     fsal_err_txt(fsal_status));
+
+		if (nfs_RetryableError(fsal_status.major)) {
+			rc = NFS_REQ_DROP;
+			goto out;
+		}
+
+		res->res_write3.status = nfs3_Errno_status(fsal_status);
+
+		nfs_SetWccData(NULL, obj,
+			       &res->res_write3.WRITE3res_u.resfail.file_wcc);
+	} else {
+		/* Build Weak Cache Coherency data */
+		nfs_SetWccData(NULL, obj,
+			       &res->res_write3.WRITE3res_u.resok.file_wcc);
+
+		/* Set the written size */
+		res->res_write3.WRITE3res_u.resok.count = written_size;
+
+		/* How do we commit data ? */
+		if (sync)
+			res->res_write3.WRITE3res_u.resok.committed = FILE_SYNC;
+		else
+			res->res_write3.WRITE3res_u.resok.committed = UNSTABLE;
+
+		/* Set the write verifier */
+		memcpy(res->res_write3.WRITE3res_u.resok.verf,
+		       NFS3_write_verifier,
+		       sizeof(writeverf3));
+
+		res->res_write3.status = NFS3_OK;
+	}
+
+ out:
+	server_stats_io_done(obj, offset, size, written_size,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     true);
+
+	/* return references */
+	obj->obj_ops.put_ref(obj);
+	return rc;
+}
+
+/**
+ * @brief Resume an asynchronous WRITE
+ *
+ * @param[in] reqnfs Request whose I/O completed
+ *
+ * @return NFS_REQ_OK or NFS_REQ_DROP.
+ */
+static int nfs3_write_resume(nfs_request_t *reqnfs)
+{
+	struct nfs3_write_async_data *wd = reqnfs->async_arg;
+	int rc;
+
+	rc = nfs3_write_finish(wd->obj, wd->res, wd->status,
+			       wd->io_arg.offset, wd->size,
+			       wd->io_arg.io_amount, wd->io_arg.fsal_stable);
+
+	reqnfs->async_arg = NULL;
+	gsh_free(wd);
+
+	return rc;
+}
+
+/**
+ * @brief FSAL completion callback for an asynchronous WRITE
+ */
+static void nfs3_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			  struct fsal_io_arg *io_arg, void *caller_arg)
+{
+	nfs_request_t *reqnfs = caller_arg;
+	struct nfs3_write_async_data *wd = reqnfs->async_arg;
+
+	/* Fixup ERR_FSAL_SHARE_DENIED status */
+	if (ret.major == ERR_FSAL_SHARE_DENIED)
+		ret = fsalstat(ERR_FSAL_LOCKED, 0);
+
+	if (FSAL_IS_ERROR(ret))
+		io_arg->io_amount = 0;
+
+	wd->status = ret;
+
+	nfs_rpc_async_done(reqnfs);
+}
+
+/**
+ * @brief Submit an asynchronous WRITE
+ *
+ * The share reservation and the reference on obj are handed over to
+ * the completion.
+ *
+ * @return NFS_REQ_ASYNC_WAIT if the request is suspended, otherwise
+ *         the final result.
+ */
+static int nfs3_write_async(struct svc_req *req, nfs_res_t *res,
+			    struct fsal_obj_handle *obj, uint64_t offset,
+			    size_t size, void *data, bool sync)
+{
+	nfs_request_t *reqnfs = container_of(req, nfs_request_t, svc);
+	struct nfs3_write_async_data *wd = gsh_calloc(1, sizeof(*wd));
+
+	if (op_ctx->export_perms->options & EXPORT_OPTION_COMMIT) {
+		/* Force sync if export requires it */
+		sync = true;
+	}
+
+	wd->obj = obj;
+	wd->res = res;
+	wd->size = size;
+	wd->iov.iov_base = data;
+	wd->iov.iov_len = size;
+	/** @todo for now pass NULL state */
+	wd->io_arg.state = NULL;
+	wd->io_arg.offset = offset;
+	wd->io_arg.iov = &wd->iov;
+	wd->io_arg.iovcnt = 1;
+	wd->io_arg.fsal_stable = sync;
+
+	reqnfs->async_resume = nfs3_write_resume;
+	reqnfs->async_arg = wd;
+
+	obj->obj_ops.write2_async(obj, true, &wd->io_arg, nfs3_write_cb,
+				  reqnfs);
+
+	if (nfs_rpc_async_suspend(reqnfs))
+		return NFS_REQ_ASYNC_WAIT;
+
+	return nfs3_write_resume(reqnfs);
+}
+
 /**
  *
  * @brief The NFSPROC3_WRITE
@@ -228,6 +399,13 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		goto out;
 	}
 
+	if (obj->fsal->m_ops.support_ex(obj) &&
+	    nfs_rpc_async_allowed(req)) {
+		/* Completion releases the share and obj reference */
+		return nfs3_write_async(req, res, obj, offset, size, data,
+					sync);
+	}
+
 	if (obj->fsal->m_ops.support_ex(obj)) {
 		/* Call the new fsal_write */
 		/** @todo for now pass NULL state */
@@ -253,56 +431,17 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 					NULL);
 	}
 
-	state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
-
-	if (FSAL_IS_ERROR(fsal_status)) {
-		/* If we are here, there was an error */
-		LogFullDebug(COMPONENT_NFSPROTO,
-			     "failed write: fsal_status=%s",
-			     fsal_err_txt(fsal_status));
-
-		if (nfs_RetryableError(fsal_status.major)) {
-			rc = NFS_REQ_DROP;
-			goto out;
-		}
-
-		res->res_write3.status = nfs3_Errno_status(fsal_status);
-
-		nfs_SetWccData(NULL, obj,
-			       &res->res_write3.WRITE3res_u.resfail.file_wcc);
-
-		rc = NFS_REQ_OK;
-	} else {
-		/* Build Weak Cache Coherency data */
-		nfs_SetWccData(NULL, obj,
-			       &res->res_write3.WRITE3res_u.resok.file_wcc);
-
-		/* Set the written size */
-		res->res_write3.WRITE3res_u.resok.count = written_size;
-
-		/* How do we commit data ? */
-		if (sync)
-			res->res_write3.WRITE3res_u.resok.committed = FILE_SYNC;
-		else
-			res->res_write3.WRITE3res_u.resok.committed = UNSTABLE;
-
-		/* Set the write verifier */
-		memcpy(res->res_write3.WRITE3res_u.resok.verf,
-		       NFS3_write_verifier,
-		       sizeof(writeverf3));
-
-		res->res_write3.status = NFS3_OK;
-	}
-
-	rc = NFS_REQ_OK;
+	return nfs3_write_finish(obj, res, fsal_status, offset, size,
+				 written_size,
+				 sync);
 
  out:
-	/* return references */
-	obj->obj_ops.put_ref(obj);
-
-	server_stats_io_done(size, written_size,
+	server_stats_io_done(obj, offset, size, written_size,
 			     (rc == NFS_REQ_OK) ? true : false,
 			     true);
+
+	/* return references */
+	obj->obj_ops.put_ref(obj);
 	return rc;
 
 }				/* nfs3_write */
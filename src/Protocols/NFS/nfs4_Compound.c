@@ -295,9 +295,9 @@ static const struct nfs4_op_desc optabv4[] = {
 		.exp_perm_flags = 0},
 	[NFS4_OP_GET_DIR_DELEGATION] = {
 		.name = "OP_GET_DIR_DELEGATION",
-		.funct = nfs4_op_illegal,
-		.free_res = nfs4_op_illegal_Free,
-		.exp_perm_flags = 0	/* tbd */},
+		.funct = nfs4_op_get_dir_delegation,
+		.free_res = nfs4_op_get_dir_delegation_Free,
+		.exp_perm_flags = 0},
 	[NFS4_OP_GETDEVICEINFO] = {
 		.name = "OP_GETDEVICEINFO",
 		.funct = nfs4_op_getdeviceinfo,
@@ -367,8 +367,8 @@ static const struct nfs4_op_desc optabv4[] = {
 				.exp_perm_flags = 0},
 	[NFS4_OP_COPY] = {
 				.name = "OP_COPY",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_copy,
+				.free_res = nfs4_op_copy_Free,
 				.exp_perm_flags = 0},
 	[NFS4_OP_COPY_NOTIFY] = {
 				.name = "OP_COPY_NOTIFY",
@@ -397,13 +397,13 @@ static const struct nfs4_op_desc optabv4[] = {
 				.exp_perm_flags = 0},
 	[NFS4_OP_OFFLOAD_CANCEL] = {
 				.name = "OP_OFFLOAD_CANCEL",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_offload_cancel,
+				.free_res = nfs4_op_offload_cancel_Free,
 				.exp_perm_flags = 0},
 	[NFS4_OP_OFFLOAD_STATUS] = {
 				.name = "OP_OFFLOAD_STATUS",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_offload_status,
+				.free_res = nfs4_op_offload_status_Free,
 				.exp_perm_flags = 0},
 	[NFS4_OP_READ_PLUS] = {
 				.name = "OP_READ_PLUS",
@@ -422,8 +422,8 @@ static const struct nfs4_op_desc optabv4[] = {
 				.exp_perm_flags = 0},
 	[NFS4_OP_CLONE] = {
 				.name = "OP_CLONE",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_clone,
+				.free_res = nfs4_op_clone_Free,
 				.exp_perm_flags = 0},
 
 	/* NFSv4.3 */
@@ -458,6 +458,272 @@ nfs_opnum4 LastOpcode[] = {
 	NFS4_OP_REMOVEXATTR
 };
 
+/**
+ * @brief Encode a COMPOUND reply into a slot's reply cache
+ *
+ * Only the XDR encoding of the reply is kept, so the result itself is
+ * freed as usual once sent and the slot holds no more than the reply
+ * size negotiated for the session.  A reply that does not fit is not
+ * cached, its replay will get NFS4ERR_RETRY_UNCACHED_REP.
+ *
+ * @param[in,out] slot    Slot to cache the reply in
+ * @param[in]     res     The reply
+ * @param[in]     maxsize Largest encoding to keep
+ */
+static void nfs4_Compound_Cache(nfs41_session_slot_t *slot,
+				COMPOUND4res *res, u_int maxsize)
+{
+	XDR xdrs;
+	char *buf = gsh_malloc(maxsize);
+	u_int len = 0;
+
+	xdrmem_create(&xdrs, buf, maxsize, XDR_ENCODE);
+	if (xdr_COMPOUND4res(&xdrs, res))
+		len = xdr_getpos(&xdrs);
+	xdr_destroy(&xdrs);
+
+	PTHREAD_MUTEX_lock(&slot->lock);
+
+	/* A later request on the slot may have acknowledged this reply
+	 * already.
+	 */
+	if (slot->cache_used && slot->cached_xdr == NULL) {
+		if (len == 0) {
+			LogDebug(COMPONENT_SESSIONS,
+				 "Reply too large for slot %p (max %u)",
+				 slot, maxsize);
+			slot->cache_used = false;
+		} else {
+			slot->cached_status = res->status;
+			slot->cached_xdr = gsh_realloc(buf, len);
+			slot->cached_xdr_len = len;
+			buf = NULL;
+			LogFullDebug(COMPONENT_SESSIONS,
+				     "Save result in session replay cache %p, %u bytes",
+				     slot, len);
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&slot->lock);
+
+	gsh_free(buf);
+}
+
+/**
+ * @brief Reply to a retransmission from a slot's reply cache
+ *
+ * @param[in]  slot The slot
+ * @param[out] res  Reply to send, takes a copy of the cached encoding
+ *
+ * @return Status of the cached reply, NFS4ERR_DELAY if there is none
+ *         any more.
+ */
+static nfsstat4 nfs4_Compound_Replay(nfs41_session_slot_t *slot,
+				     nfs_res_t *res)
+{
+	nfsstat4 status = NFS4ERR_DELAY;
+
+	PTHREAD_MUTEX_lock(&slot->lock);
+
+	if (slot->cached_xdr != NULL) {
+		res->res_compound4_extended.res_xdr =
+		    gsh_malloc(slot->cached_xdr_len);
+		memcpy(res->res_compound4_extended.res_xdr, slot->cached_xdr,
+		       slot->cached_xdr_len);
+		res->res_compound4_extended.res_xdr_len =
+		    slot->cached_xdr_len;
+		status = slot->cached_status;
+	}
+
+	PTHREAD_MUTEX_unlock(&slot->lock);
+
+	return status;
+}
+
+/**
+ * @brief Encode a COMPOUND reply
+ *
+ * Replays are sent as cached, already encoded.
+ *
+ * @param[in] xdrs XDR stream
+ * @param[in] objp The reply
+ *
+ * @return true on success.
+ */
+bool xdr_COMPOUND4res_extended(XDR *xdrs,
+			       struct COMPOUND4res_extended *objp)
+{
+	if (xdrs->x_op == XDR_ENCODE && objp->res_xdr != NULL)
+		return xdr_opaque(xdrs, objp->res_xdr, objp->res_xdr_len);
+
+	return xdr_COMPOUND4res(xdrs, &objp->res_compound4);
+}
+
+/**
+ * @brief A COMPOUND shape run through nfs4_Compound_fast
+ */
+struct nfs4_compound_shape {
+	uint32_t len;		/*< Number of ops */
+	nfs_opnum4 ops[4];	/*< The ops, in order */
+};
+
+/**
+ * @brief The COMPOUNDs most of the NFSv4.1 traffic of Linux clients is
+ *
+ * They all start with SEQUENCE, PUTFH and only carry ops that need a
+ * current filehandle, known to be there once PUTFH succeeded.
+ */
+static const struct nfs4_compound_shape fast_shapes[] = {
+	{ 3, { NFS4_OP_SEQUENCE, NFS4_OP_PUTFH, NFS4_OP_GETATTR } },
+	{ 3, { NFS4_OP_SEQUENCE, NFS4_OP_PUTFH, NFS4_OP_READ } },
+	{ 4, { NFS4_OP_SEQUENCE, NFS4_OP_PUTFH, NFS4_OP_WRITE,
+	       NFS4_OP_GETATTR } },
+	{ 4, { NFS4_OP_SEQUENCE, NFS4_OP_PUTFH, NFS4_OP_ACCESS,
+	       NFS4_OP_GETATTR } },
+};
+
+/**
+ * @brief Check whether a COMPOUND has one of the fast shapes
+ *
+ * @param[in] minor     Minor version of the COMPOUND
+ * @param[in] argarray  The ops
+ * @param[in] len       Number of ops
+ *
+ * @return true if nfs4_Compound_fast can run it.
+ */
+static bool nfs4_Compound_is_fast(uint32_t minor, const nfs_argop4 *argarray,
+				  uint32_t len)
+{
+	size_t i;
+	uint32_t j;
+
+	if (minor == 0 || len < 3 || len > 4 ||
+	    argarray[0].argop != NFS4_OP_SEQUENCE ||
+	    argarray[1].argop != NFS4_OP_PUTFH)
+		return false;
+
+	for (i = 0; i < sizeof(fast_shapes) / sizeof(fast_shapes[0]); i++) {
+		if (fast_shapes[i].len != len)
+			continue;
+
+		for (j = 2; j < len; j++)
+			if (argarray[j].argop != fast_shapes[i].ops[j])
+				break;
+
+		if (j == len)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Run a COMPOUND of one of the fast shapes
+ *
+ * Same semantics as the loop in nfs4_Compound, without the checks the
+ * shape makes moot: every opcode is valid, none of them is
+ * BIND_CONN_TO_SESSION or DESTROY_SESSION, and all ops after PUTFH find
+ * a current filehandle.  This stops after the op that failed, or after
+ * SEQUENCE if the reply is to come from the slot's replay cache.
+ *
+ * @param[in]     argarray  The ops
+ * @param[in]     len       Number of ops
+ * @param[in,out] data      Compound data
+ * @param[out]    resarray  The results
+ * @param[out]    last      Index of the last op run
+ *
+ * @return Status of the last op run.
+ */
+static int nfs4_Compound_fast(nfs_argop4 *argarray, uint32_t len,
+			      compound_data_t *data, nfs_resop4 *resarray,
+			      unsigned int *last)
+{
+	unsigned int i;
+	int status = NFS4_OK;
+	nfs_opnum4 opcode;
+	nsecs_elapsed_t op_start_time;
+	uint64_t op_cpu_start;
+	struct timespec ts;
+	int perm_flags;
+	struct gsh_export *log_export = op_ctx->ctx_export;
+
+	for (i = 0; i < len; i++) {
+		data->oppos = i;
+		opcode = argarray[i].argop;
+		resarray[i].resop = opcode;
+
+		now(&ts);
+		op_start_time = timespec_diff(&ServerBootTime, &ts);
+		op_cpu_start = server_stats_cpu_now();
+
+		/* SEQUENCE succeeded, so there is a session from here on */
+		if (i > 0 &&
+		    data->session->fore_channel_attrs.ca_maxoperations == i) {
+			status = NFS4ERR_TOO_MANY_OPS;
+			resarray[i].nfs_resop4_u.opaccess.status = status;
+			break;
+		}
+
+		perm_flags =
+		    optabv4[opcode].exp_perm_flags & EXPORT_OPTION_ACCESS_MASK;
+
+		if ((op_ctx->export_perms->options & perm_flags) !=
+		    perm_flags) {
+			if ((perm_flags & EXPORT_OPTION_MODIFY_ACCESS) != 0)
+				status = NFS4ERR_ROFS;
+			else
+				status = NFS4ERR_ACCESS;
+
+			LogDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
+				    "Status of %s due to export permissions in position %d = %s",
+				    optabv4[opcode].name, i,
+				    nfsstat4_to_str(status));
+			resarray[i].nfs_resop4_u.opaccess.status = status;
+			break;
+		}
+
+#ifdef USE_LTTNG
+		tracepoint(nfs_rpc, v4op_start, data->req->rq_msg.rm_xid, i,
+			   opcode, optabv4[opcode].name);
+#endif
+
+		status = (optabv4[opcode].funct) (&argarray[i], data,
+						  &resarray[i]);
+
+#ifdef USE_LTTNG
+		tracepoint(nfs_rpc, v4op_end, data->req->rq_msg.rm_xid, i,
+			   opcode, optabv4[opcode].name, status);
+#endif
+
+		LogCompoundFH(data);
+
+		resarray[i].nfs_resop4_u.opaccess.status = status;
+
+		server_stats_nfsv4_op_done(opcode, op_start_time, status);
+		server_stats_nfsv4_op_cpu(opcode, op_cpu_start);
+
+		if (status != NFS4_OK) {
+			LogDebug(COMPONENT_NFS_V4,
+				 "Status of %s in position %d = %s",
+				 optabv4[opcode].name, i,
+				 nfsstat4_to_str(status));
+			break;
+		}
+
+		/* PUTFH and friends may have crossed into another export */
+		if (op_ctx->ctx_export != log_export) {
+			log_export = op_ctx->ctx_export;
+			nfs_log_filter_update();
+		}
+
+		if (data->use_drc)
+			break;
+	}
+
+	*last = i;
+	return status;
+}
+
 /**
  * @brief The NFS PROC4 COMPOUND
  *
@@ -491,10 +757,12 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	nfs_argop4 * const argarray = arg->arg_compound4.argarray.argarray_val;
 	nfs_resop4 *resarray;
 	nsecs_elapsed_t op_start_time;
+	uint64_t op_cpu_start;
 	struct timespec ts;
 	int perm_flags;
 	char *tagname = NULL;
 	char *notag = "NO TAG";
+	struct gsh_export *log_export = op_ctx->ctx_export;
 
 	if (compound4_minor > 2) {
 		LogCrit(COMPONENT_NFS_V4, "Bad Minor Version %d",
@@ -511,7 +779,8 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	if (res->res_compound4.tag.utf8string_len > 0) {
 
 		res->res_compound4.tag.utf8string_val =
-		    gsh_malloc(res->res_compound4.tag.utf8string_len + 1);
+		    gsh_arena_alloc(&res->res_compound4_extended.res_arena,
+				    res->res_compound4.tag.utf8string_len + 1);
 
 		memcpy(res->res_compound4.tag.utf8string_val,
 		       arg->arg_compound4.tag.utf8string_val,
@@ -571,6 +840,8 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	/* Minor version related stuff */
 	data.minorversion = compound4_minor;
 	data.req = req;
+	data.opcnt = argarray_len;
+	data.arena = &res->res_compound4_extended.res_arena;
 
 	/* Building the client credential field */
 	if (nfs_rpc_req2client_cred(req, &(data.credential)) == -1)
@@ -582,7 +853,8 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 	/* Allocating the reply nfs_resop4 */
 	res->res_compound4.resarray.resarray_val =
-		gsh_calloc(argarray_len, sizeof(struct nfs_resop4));
+		gsh_arena_calloc(data.arena, argarray_len,
+				 sizeof(struct nfs_resop4));
 
 	res->res_compound4.resarray.resarray_len = argarray_len;
 	resarray = res->res_compound4.resarray.resarray_val;
@@ -650,6 +922,18 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		}
 	}
 
+	if (nfs4_Compound_is_fast(compound4_minor, argarray, argarray_len)) {
+		status = nfs4_Compound_fast(argarray, argarray_len, &data,
+					    resarray, &i);
+
+		if (status != NFS4_OK)
+			res->res_compound4.resarray.resarray_len = i + 1;
+		else if (!data.use_drc)
+			i = argarray_len;
+
+		goto done;
+	}
+
 	for (i = 0; i < argarray_len; i++) {
 		/* Used to check if OP_SEQUENCE is the first operation */
 		data.oppos = i;
@@ -666,6 +950,7 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		/* time each op */
 		now(&ts);
 		op_start_time = timespec_diff(&ServerBootTime, &ts);
+		op_cpu_start = server_stats_cpu_now();
 		opcode = argarray[i].argop;
 
 		/* Handle opcode overflow */
@@ -678,6 +963,12 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			goto bad_op_state;
 		}
 
+		/* PUTFH and friends may have crossed into another export */
+		if (op_ctx->ctx_export != log_export) {
+			log_export = op_ctx->ctx_export;
+			nfs_log_filter_update();
+		}
+
 		LogDebug(COMPONENT_NFS_V4, "Request %d: opcode %d is %s", i,
 			 argarray[i].argop, optabv4[opcode].name);
 		perm_flags =
@@ -736,8 +1027,8 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		}
 
 #ifdef USE_LTTNG
-		tracepoint(nfs_rpc, v4op_start, i, argarray[i].argop,
-			   optabv4[opcode].name);
+		tracepoint(nfs_rpc, v4op_start, req->rq_msg.rm_xid, i,
+			   argarray[i].argop, optabv4[opcode].name);
 #endif
 
 		status = (optabv4[opcode].funct) (&argarray[i],
@@ -745,8 +1036,8 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 						  &resarray[i]);
 
 #ifdef USE_LTTNG
-		tracepoint(nfs_rpc, v4op_end, i, argarray[i].argop,
-			   optabv4[opcode].name);
+		tracepoint(nfs_rpc, v4op_end, req->rq_msg.rm_xid, i,
+			   argarray[i].argop, optabv4[opcode].name, status);
 #endif
 
 		LogCompoundFH(&data);
@@ -757,6 +1048,7 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		resarray[i].nfs_resop4_u.opaccess.status = status;
 
 		server_stats_nfsv4_op_done(opcode, op_start_time, status);
+		server_stats_nfsv4_op_cpu(opcode, op_cpu_start);
 
 		if (status != NFS4_OK) {
 			/* An error occured, we do not manage the other requests
@@ -775,25 +1067,27 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		/* Check Req size */
 
 		/* NFS_V4.1 specific stuff */
-		if (data.use_drc) {
-			/* Replay cache, only true for SEQUENCE or
-			 * CREATE_SESSION w/o SEQUENCE. Since will only be set
-			 * in those cases, no need to check operation or
-			 * anything.
-			 */
+		if (data.use_drc)
+			break;
+	}			/* for */
 
-			/* Free the reply allocated above */
-			gsh_free(res->res_compound4.resarray.resarray_val);
+ done:
+	if (status == NFS4_OK && data.use_drc) {
+		/* Replay cache, only true for SEQUENCE or CREATE_SESSION
+		 * w/o SEQUENCE. Since will only be set in those cases, no
+		 * need to check operation or anything.
+		 */
 
-			/* Copy the reply from the cache */
-			res->res_compound4_extended = *data.cached_res;
-			status = ((COMPOUND4res *) data.cached_res)->status;
-			LogFullDebug(COMPONENT_SESSIONS,
-				     "Use session replay cache %p result %s",
-				     data.cached_res, nfsstat4_to_str(status));
-			break;	/* Exit the for loop */
-		}
-	}			/* for */
+		/* Drop the reply allocated above, the arena has it */
+		res->res_compound4.resarray.resarray_val = NULL;
+		res->res_compound4.resarray.resarray_len = 0;
+
+		/* Send the reply from the cache */
+		status = nfs4_Compound_Replay(data.cached_slot, res);
+		LogFullDebug(COMPONENT_SESSIONS,
+			     "Use session replay cache %p result %s",
+			     data.cached_slot, nfsstat4_to_str(status));
+	}
 
 	server_stats_compound_done(argarray_len, status);
 
@@ -805,35 +1099,22 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	/* Manage session's DRC: keep NFS4.1 replay for later use, but don't
 	 * save a replayed result again.
 	 */
-	if (data.cached_res != NULL && !data.use_drc) {
-		/* Pointer has been set by nfs4_op_sequence and points to slot
-		 * to cache result in.
+	if (data.cached_slot != NULL && !data.use_drc) {
+		/* Pointer has been set by nfs4_op_sequence or
+		 * nfs4_op_create_session and points to slot to cache result
+		 * in.
 		 */
-		LogFullDebug(COMPONENT_SESSIONS,
-			     "Save result in session replay cache %p sizeof nfs_res_t=%d",
-			     data.cached_res, (int)sizeof(nfs_res_t));
-
-		/* Indicate to nfs4_Compound_Free that this reply is cached. */
-		res->res_compound4_extended.res_cached = true;
-
-		/* If the cache is already in use, free it. */
-		if (data.cached_res->res_cached) {
-			data.cached_res->res_cached = false;
-			nfs4_Compound_Free((nfs_res_t *) data.cached_res);
-		}
-
-		/* Save the result in the cache. */
-		*data.cached_res = res->res_compound4_extended;
+		nfs4_Compound_Cache(data.cached_slot, &res->res_compound4,
+				    data.session != NULL
+				    ? data.session->fore_channel_attrs
+						.ca_maxresponsesize_cached
+				    : NFS41_MAX_CACHED_REPLY);
 	}
 
 	/* If we have reserved a lease, update it and release it */
 	if (data.preserved_clientid != NULL) {
 		/* Update and release lease */
-		PTHREAD_MUTEX_lock(&data.preserved_clientid->cid_mutex);
-
 		update_lease(data.preserved_clientid);
-
-		PTHREAD_MUTEX_unlock(&data.preserved_clientid->cid_mutex);
 	}
 
 	if (status != NFS4_OK)
@@ -881,11 +1162,9 @@ void nfs4_Compound_Free(nfs_res_t *res)
 	if (isFullDebug(COMPONENT_SESSIONS))
 		component = COMPONENT_SESSIONS;
 
-	if (res->res_compound4_extended.res_cached) {
-		LogFullDebug(component,
-			     "Skipping free of NFS4 result %p",
-			     res);
-		return;
+	if (res->res_compound4_extended.res_xdr != NULL) {
+		gsh_free(res->res_compound4_extended.res_xdr);
+		res->res_compound4_extended.res_xdr = NULL;
 	}
 
 	LogFullDebug(component,
@@ -904,10 +1183,8 @@ void nfs4_Compound_Free(nfs_res_t *res)
 		}
 	}
 
-	gsh_free(res->res_compound4.resarray.resarray_val);
-
-	if (res->res_compound4.tag.utf8string_val)
-		gsh_free(res->res_compound4.tag.utf8string_val);
+	/* The resarray, tag and what the ops allocated from the arena */
+	gsh_arena_release(&res->res_compound4_extended.res_arena);
 }
 
 /**
@@ -0,0 +1,946 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs4_op_copy.c
+ * @brief NFSv4.2 COPY, CLONE, OFFLOAD_STATUS and OFFLOAD_CANCEL
+ *
+ * Copies are done by the FSAL, within the server, so the data never
+ * goes to the client.  Only copies within this server are supported.
+ *
+ * A synchronous COPY copies at most NFS4_COPY_SYNC_MAX bytes, and the
+ * client asks again for the rest.  An asynchronous COPY is given a
+ * copy stateid and runs in the background in chunks of
+ * NFS4_COPY_CHUNK bytes, between which OFFLOAD_CANCEL can stop it.
+ * Its outcome is sent to the client with CB_OFFLOAD and can also be
+ * polled with OFFLOAD_STATUS, until the client has heard of it.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+#include "nfs_convert.h"
+#include "nfs_file_handle.h"
+#include "nfs_rpc_callback.h"
+#include "fridgethr.h"
+#include "export_mgr.h"
+#include "common_utils.h"
+
+/** Most bytes copied by a synchronous COPY */
+#define NFS4_COPY_SYNC_MAX (64 * 1024 * 1024)
+
+/** Bytes copied between checks for cancellation */
+#define NFS4_COPY_CHUNK (64 * 1024 * 1024)
+
+/**
+ * @brief An asynchronous copy
+ */
+struct nfs4_copy {
+	struct glist_head copy_list;	/*< Link in copy_list */
+	stateid4 stateid;		/*< Copy stateid */
+	nfs_client_id_t *clientid;	/*< Client that asked for it */
+	struct gsh_export *export;	/*< Export of the files */
+	struct fsal_obj_handle *src;	/*< File copied from */
+	struct fsal_obj_handle *dst;	/*< File copied to */
+	struct state_t *src_state;	/*< State to read with */
+	struct state_t *dst_state;	/*< State to write with */
+	struct user_cred creds;		/*< Credentials of the caller */
+	uint64_t src_offset;
+	uint64_t dst_offset;
+	uint64_t count;
+	uint64_t copied;		/*< Bytes copied so far */
+	nfsstat4 status;		/*< Outcome, once complete */
+	stable_how4 committed;		/*< Stability of the copied data */
+	bool cancel;			/*< OFFLOAD_CANCEL asked for */
+	bool complete;			/*< Copy is over */
+	bool idle;			/*< Complete, no CB_OFFLOAD in flight */
+	time_t finished;		/*< When it became idle */
+	nfs_cb_argop4 cb_arg;		/*< CB_OFFLOAD arguments */
+};
+
+static pthread_mutex_t copy_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head copy_list = GLIST_HEAD_INIT(copy_list);
+static struct fridgethr *copy_fridge;
+
+/**
+ * @brief Free an asynchronous copy
+ *
+ * The copy has to be out of copy_list.
+ */
+static void nfs4_copy_free(struct nfs4_copy *copy)
+{
+	nfs4_freeFH(&copy->cb_arg.nfs_cb_argop4_u.opcboffload.coa_fh);
+	dec_client_id_ref(copy->clientid);
+	gsh_free(copy->creds.caller_garray);
+	gsh_free(copy);
+}
+
+/**
+ * @brief Find an asynchronous copy of the client
+ *
+ * @note copy_mtx MUST be held
+ */
+static struct nfs4_copy *nfs4_copy_find(compound_data_t *data,
+					stateid4 *stateid)
+{
+	struct glist_head *glist;
+	struct nfs4_copy *copy;
+
+	if (data->session == NULL)
+		return NULL;
+
+	glist_for_each(glist, &copy_list) {
+		copy = glist_entry(glist, struct nfs4_copy, copy_list);
+		if (copy->clientid == data->session->clientid_record &&
+		    memcmp(copy->stateid.other, stateid->other,
+			   OTHERSIZE) == 0)
+			return copy;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Drop copies the client never came back for
+ *
+ * @note copy_mtx MUST be held
+ */
+static void nfs4_copy_reap(void)
+{
+	struct glist_head *glist, *glistn;
+	struct nfs4_copy *copy;
+	time_t limit = time(NULL) -
+		2 * nfs_param.nfsv4_param.lease_lifetime;
+
+	glist_for_each_safe(glist, glistn, &copy_list) {
+		copy = glist_entry(glist, struct nfs4_copy, copy_list);
+		if (copy->idle && copy->finished < limit) {
+			glist_del(&copy->copy_list);
+			nfs4_copy_free(copy);
+		}
+	}
+}
+
+/**
+ * @brief Handle CB_OFFLOAD response
+ */
+static int32_t nfs4_copy_cb_completion(rpc_call_t *call, rpc_call_hook hook,
+				       void *arg, uint32_t flags)
+{
+	struct nfs4_copy *copy = arg;
+	bool delivered = hook == RPC_CALL_COMPLETE &&
+			 call->cbt.v_u.v4.res.status == NFS4_OK;
+
+	LogFullDebug(COMPONENT_NFS_CB, "CB_OFFLOAD %p %s", copy,
+		     delivered ? "delivered" : "failed");
+
+	PTHREAD_MUTEX_lock(&copy_mtx);
+	if (delivered) {
+		glist_del(&copy->copy_list);
+		PTHREAD_MUTEX_unlock(&copy_mtx);
+		nfs4_copy_free(copy);
+		return 0;
+	}
+
+	/* Leave it for OFFLOAD_STATUS */
+	copy->idle = true;
+	copy->finished = time(NULL);
+	PTHREAD_MUTEX_unlock(&copy_mtx);
+
+	return 0;
+}
+
+/**
+ * @brief Tell the client an asynchronous copy is over
+ */
+static void nfs4_copy_notify(struct nfs4_copy *copy)
+{
+	CB_OFFLOAD4args *cb = &copy->cb_arg.nfs_cb_argop4_u.opcboffload;
+	offload_info4 *info = &cb->coa_offload_info;
+	write_response4 *wr = &info->offload_info4_u.coa_resok4;
+	struct gsh_buffdesc verf_desc;
+	int code = -1;
+
+	copy->cb_arg.argop = NFS4_OP_CB_OFFLOAD;
+	cb->coa_stateid = copy->stateid;
+	info->coa_status = copy->status;
+
+	if (copy->status == NFS4_OK) {
+		memset(wr, 0, sizeof(*wr));
+		wr->wr_count = copy->copied;
+		wr->wr_committed = copy->committed;
+		verf_desc.addr = wr->wr_writeverf;
+		verf_desc.len = sizeof(verifier4);
+		copy->export->fsal_export->exp_ops.get_write_verifier(
+				copy->export->fsal_export, &verf_desc);
+	} else {
+		info->offload_info4_u.coa_bytes_copied = copy->copied;
+	}
+
+	if (!get_cb_chan_down(copy->clientid))
+		code = nfs_rpc_v41_single(copy->clientid, &copy->cb_arg, NULL,
+					  nfs4_copy_cb_completion, copy, NULL);
+
+	if (code != 0) {
+		PTHREAD_MUTEX_lock(&copy_mtx);
+		copy->idle = true;
+		copy->finished = time(NULL);
+		PTHREAD_MUTEX_unlock(&copy_mtx);
+	}
+}
+
+/**
+ * @brief Run an asynchronous copy
+ */
+static void nfs4_copy_run(struct fridgethr_context *ctx)
+{
+	struct nfs4_copy *copy = ctx->arg;
+	struct root_op_context root_op_context;
+	fsal_status_t status = {0, 0};
+	uint64_t chunk, copied;
+	bool cancel = false;
+
+	init_root_op_context(&root_op_context, copy->export,
+			     copy->export->fsal_export, NFS_V4, 2,
+			     NFS_REQUEST);
+	root_op_context.req_ctx.creds = &copy->creds;
+
+	while (copy->copied < copy->count) {
+		PTHREAD_MUTEX_lock(&copy_mtx);
+		cancel = copy->cancel;
+		PTHREAD_MUTEX_unlock(&copy_mtx);
+		if (cancel)
+			break;
+
+		chunk = copy->count - copy->copied;
+		if (chunk > NFS4_COPY_CHUNK)
+			chunk = NFS4_COPY_CHUNK;
+
+		copied = 0;
+		status = copy->src->obj_ops.copy2(
+				copy->src, copy->src_state,
+				copy->src_offset + copy->copied,
+				copy->dst, copy->dst_state,
+				copy->dst_offset + copy->copied,
+				chunk, &copied);
+		if (FSAL_IS_ERROR(status) || copied == 0)
+			break;
+
+		atomic_add_uint64_t(&copy->copied, copied);
+	}
+
+	copy->committed = UNSTABLE4;
+	if (FSAL_IS_ERROR(status) && copy->copied == 0) {
+		copy->status = nfs4_Errno_status(status);
+	} else {
+		copy->status = NFS4_OK;
+		if (!cancel && copy->copied != 0 &&
+		    !FSAL_IS_ERROR(copy->dst->obj_ops.commit2(
+				copy->dst, copy->dst_offset, copy->copied)))
+			copy->committed = FILE_SYNC4;
+	}
+
+	LogDebug(COMPONENT_NFS_V4,
+		 "Copy %p of %" PRIu64 " bytes done, %" PRIu64 " copied: %s",
+		 copy, copy->count, copy->copied,
+		 nfsstat4_to_str(copy->status));
+
+	dec_state_t_ref(copy->src_state);
+	dec_state_t_ref(copy->dst_state);
+	copy->src->obj_ops.put_ref(copy->src);
+	copy->dst->obj_ops.put_ref(copy->dst);
+	release_root_op_context();
+
+	PTHREAD_MUTEX_lock(&copy_mtx);
+	copy->complete = true;
+	if (copy->cancel) {
+		/* Nobody wants to hear of it */
+		glist_del(&copy->copy_list);
+		PTHREAD_MUTEX_unlock(&copy_mtx);
+		put_gsh_export(copy->export);
+		nfs4_copy_free(copy);
+		return;
+	}
+	PTHREAD_MUTEX_unlock(&copy_mtx);
+
+	nfs4_copy_notify(copy);
+	put_gsh_export(copy->export);
+}
+
+/**
+ * @brief Start an asynchronous copy
+ *
+ * @return NFS4_OK, or an error if the copy could not be started.
+ */
+static nfsstat4 nfs4_copy_start(compound_data_t *data, COPY4args *arg,
+				struct fsal_obj_handle *src,
+				struct state_t *src_state,
+				struct fsal_obj_handle *dst,
+				struct state_t *dst_state,
+				uint64_t count,
+				write_response4 *wr)
+{
+	struct nfs4_copy *copy = gsh_calloc(1, sizeof(*copy));
+	CB_OFFLOAD4args *cb = &copy->cb_arg.nfs_cb_argop4_u.opcboffload;
+	int rc;
+
+	if (!nfs4_FSALToFhandle(true, &cb->coa_fh, dst,
+				op_ctx->ctx_export)) {
+		gsh_free(copy);
+		return NFS4ERR_SERVERFAULT;
+	}
+
+	copy->clientid = data->session->clientid_record;
+	inc_client_id_ref(copy->clientid);
+	copy->stateid.seqid = 1;
+	nfs4_BuildStateId_Other(copy->clientid, copy->stateid.other);
+
+	copy->creds = *op_ctx->creds;
+	if (copy->creds.caller_glen != 0) {
+		copy->creds.caller_garray =
+			gsh_malloc(copy->creds.caller_glen * sizeof(gid_t));
+		memcpy(copy->creds.caller_garray,
+		       op_ctx->creds->caller_garray,
+		       copy->creds.caller_glen * sizeof(gid_t));
+	} else {
+		copy->creds.caller_garray = NULL;
+	}
+
+	copy->export = op_ctx->ctx_export;
+	get_gsh_export_ref(copy->export);
+	copy->src = src;
+	src->obj_ops.get_ref(src);
+	copy->dst = dst;
+	dst->obj_ops.get_ref(dst);
+	copy->src_state = src_state;
+	inc_state_t_ref(src_state);
+	copy->dst_state = dst_state;
+	inc_state_t_ref(dst_state);
+	copy->src_offset = arg->ca_src_offset;
+	copy->dst_offset = arg->ca_dst_offset;
+	copy->count = count;
+
+	PTHREAD_MUTEX_lock(&copy_mtx);
+	nfs4_copy_reap();
+	glist_add_tail(&copy_list, &copy->copy_list);
+	PTHREAD_MUTEX_unlock(&copy_mtx);
+
+	rc = fridgethr_submit(copy_fridge, nfs4_copy_run, copy);
+	if (rc != 0) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "Unable to schedule copy: %d", rc);
+		PTHREAD_MUTEX_lock(&copy_mtx);
+		glist_del(&copy->copy_list);
+		PTHREAD_MUTEX_unlock(&copy_mtx);
+		dec_state_t_ref(src_state);
+		dec_state_t_ref(dst_state);
+		src->obj_ops.put_ref(src);
+		dst->obj_ops.put_ref(dst);
+		put_gsh_export(copy->export);
+		nfs4_copy_free(copy);
+		return NFS4ERR_DELAY;
+	}
+
+	wr->wr_ids = 1;
+	wr->wr_callback_id = copy->stateid;
+	wr->wr_count = 0;
+	wr->wr_committed = UNSTABLE4;
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Check a stateid used to copy and get its state
+ *
+ * @param[in]  data	Compound request's data
+ * @param[in]  stateid	Stateid to check
+ * @param[in]  obj	File the stateid is used on
+ * @param[in]  write	The file is written to
+ * @param[out] state	State found, NULL for a special stateid
+ * @param[in]  tag	Operation, for logging
+ *
+ * @return NFS4_OK or an error.
+ */
+static nfsstat4 nfs4_copy_check_stateid(compound_data_t *data,
+					stateid4 *stateid,
+					struct fsal_obj_handle *obj,
+					bool write,
+					struct state_t **state,
+					const char *tag)
+{
+	struct state_t *state_open = NULL;
+	struct state_deleg *sdeleg;
+	nfsstat4 status;
+
+	status = nfs4_Check_Stateid(stateid, obj, state, data,
+				    STATEID_SPECIAL_ANY, 0, false, tag);
+	if (status != NFS4_OK || *state == NULL)
+		return status;
+
+	switch ((*state)->state_type) {
+	case STATE_TYPE_SHARE:
+		state_open = *state;
+		break;
+
+	case STATE_TYPE_LOCK:
+		state_open = (*state)->state_data.lock.openstate;
+		break;
+
+	case STATE_TYPE_DELEG:
+		sdeleg = &(*state)->state_data.deleg;
+		if ((write && !(sdeleg->sd_type & OPEN_DELEGATE_WRITE)) ||
+		    sdeleg->sd_state != DELEG_GRANTED)
+			status = NFS4ERR_BAD_STATEID;
+		break;
+
+	case STATE_TYPE_LAYOUT:
+		break;
+
+	default:
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "%s with invalid stateid of type %d",
+			 tag, (int)(*state)->state_type);
+		status = NFS4ERR_BAD_STATEID;
+		break;
+	}
+
+	if (status == NFS4_OK && state_open != NULL &&
+	    (state_open->state_data.share.share_access &
+	     (write ? OPEN4_SHARE_ACCESS_WRITE : OPEN4_SHARE_ACCESS_READ))
+	    == 0)
+		status = NFS4ERR_OPENMODE;
+
+	if (status != NFS4_OK) {
+		dec_state_t_ref(*state);
+		*state = NULL;
+	}
+
+	return status;
+}
+
+/**
+ * @brief What COPY and CLONE have in common
+ */
+struct nfs4_copy_args {
+	stateid4 *src_stateid;
+	stateid4 *dst_stateid;
+	uint64_t src_offset;
+	uint64_t dst_offset;
+	uint64_t count;
+	const char *tag;
+};
+
+/**
+ * @brief Check the files, stateids and ranges of a COPY or CLONE
+ *
+ * On success, the states are referenced and anonymous I/O started
+ * for special stateids, to be undone by nfs4_copy_done.  A count of
+ * 0 is turned into the length up to the end of the source.
+ */
+static nfsstat4 nfs4_copy_prepare(compound_data_t *data,
+				  struct nfs4_copy_args *args,
+				  struct state_t **src_state,
+				  struct state_t **dst_state)
+{
+	struct fsal_obj_handle *src, *dst;
+	struct attrlist attrs;
+	fsal_status_t fsal_status;
+	uint64_t filesize;
+	nfsstat4 status;
+
+	*src_state = NULL;
+	*dst_state = NULL;
+
+	status = nfs4_sanity_check_FH(data, REGULAR_FILE, true);
+	if (status != NFS4_OK)
+		return status;
+
+	status = nfs4_sanity_check_saved_FH(data, REGULAR_FILE, true);
+	if (status != NFS4_OK)
+		return status;
+
+	if (op_ctx->ctx_export != NULL && data->saved_export != NULL &&
+	    op_ctx->ctx_export->export_id != data->saved_export->export_id)
+		return NFS4ERR_XDEV;
+
+	src = data->saved_obj;
+	dst = data->current_obj;
+
+	status = nfs4_copy_check_stateid(data, args->src_stateid, src, false,
+					 src_state, args->tag);
+	if (status != NFS4_OK)
+		return status;
+
+	status = nfs4_copy_check_stateid(data, args->dst_stateid, dst, true,
+					 dst_state, args->tag);
+	if (status != NFS4_OK)
+		goto out;
+
+	fsal_status = src->obj_ops.test_access(src, FSAL_READ_ACCESS,
+					       NULL, NULL, true);
+	if (!FSAL_IS_ERROR(fsal_status))
+		fsal_status = dst->obj_ops.test_access(dst, FSAL_WRITE_ACCESS,
+						       NULL, NULL, true);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	fsal_prepare_attrs(&attrs, ATTR_SIZE);
+	fsal_status = src->obj_ops.getattrs(src, &attrs);
+	filesize = attrs.filesize;
+	fsal_release_attrs(&attrs);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	/* Written so that a huge count can't wrap around */
+	if (args->src_offset > filesize ||
+	    args->count > filesize - args->src_offset) {
+		status = NFS4ERR_INVAL;
+		goto out;
+	}
+
+	if (args->count == 0)
+		args->count = filesize - args->src_offset;
+
+	/* The destination range must not wrap either */
+	if (args->count > UINT64_MAX - args->dst_offset) {
+		status = NFS4ERR_INVAL;
+		goto out;
+	}
+
+	/* Ranges of a file copied onto itself can't overlap */
+	if (src == dst &&
+	    args->src_offset < args->dst_offset + args->count &&
+	    args->dst_offset < args->src_offset + args->count) {
+		status = NFS4ERR_INVAL;
+		goto out;
+	}
+
+	if (*src_state == NULL) {
+		status = nfs4_Errno_state(
+			state_share_anonymous_io_start(
+				src, OPEN4_SHARE_ACCESS_READ,
+				SHARE_BYPASS_NONE));
+		if (status != NFS4_OK)
+			goto out;
+	}
+
+	if (*dst_state == NULL) {
+		status = nfs4_Errno_state(
+			state_share_anonymous_io_start(
+				dst, OPEN4_SHARE_ACCESS_WRITE,
+				SHARE_BYPASS_NONE));
+		if (status != NFS4_OK) {
+			if (*src_state == NULL)
+				state_share_anonymous_io_done(
+					src, OPEN4_SHARE_ACCESS_READ);
+			goto out;
+		}
+	}
+
+	return NFS4_OK;
+
+ out:
+	if (*src_state != NULL)
+		dec_state_t_ref(*src_state);
+	if (*dst_state != NULL)
+		dec_state_t_ref(*dst_state);
+	*src_state = NULL;
+	*dst_state = NULL;
+
+	return status;
+}
+
+/**
+ * @brief Undo nfs4_copy_prepare
+ */
+static void nfs4_copy_done(compound_data_t *data,
+			   struct state_t *src_state,
+			   struct state_t *dst_state)
+{
+	if (src_state != NULL)
+		dec_state_t_ref(src_state);
+	else
+		state_share_anonymous_io_done(data->saved_obj,
+					      OPEN4_SHARE_ACCESS_READ);
+
+	if (dst_state != NULL)
+		dec_state_t_ref(dst_state);
+	else
+		state_share_anonymous_io_done(data->current_obj,
+					      OPEN4_SHARE_ACCESS_WRITE);
+}
+
+/**
+ * @brief The NFS4_OP_COPY operation
+ *
+ * This functions handles the NFS4_OP_COPY operation in NFSv4.2. This
+ * function can be called only from nfs4_Compound.  SAVED_FH is the
+ * source and CURRENT_FH the destination.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862
+ */
+
+int nfs4_op_copy(struct nfs_argop4 *op, compound_data_t *data,
+		 struct nfs_resop4 *resp)
+{
+	COPY4args * const arg_COPY4 = &op->nfs_argop4_u.opcopy;
+	COPY4res * const res_COPY4 = &resp->nfs_resop4_u.opcopy;
+	COPY4resok *resok = &res_COPY4->COPY4res_u.cr_resok4;
+	write_response4 *wr = &resok->cr_response;
+	struct nfs4_copy_args args = {
+		.src_stateid = &arg_COPY4->ca_src_stateid,
+		.dst_stateid = &arg_COPY4->ca_dst_stateid,
+		.src_offset = arg_COPY4->ca_src_offset,
+		.dst_offset = arg_COPY4->ca_dst_offset,
+		.count = arg_COPY4->ca_count,
+		.tag = "COPY",
+	};
+	struct state_t *src_state, *dst_state;
+	struct gsh_buffdesc verf_desc;
+	fsal_status_t fsal_status;
+	uint64_t count, copied = 0;
+
+	resp->resop = NFS4_OP_COPY;
+	memset(resok, 0, sizeof(*resok));
+
+	/* Only copies within this server */
+	if (arg_COPY4->ca_source_server.ca_source_server_len != 0) {
+		res_COPY4->cr_status = NFS4ERR_NOTSUPP;
+		return res_COPY4->cr_status;
+	}
+
+	res_COPY4->cr_status = nfs4_copy_prepare(data, &args, &src_state,
+						 &dst_state);
+	if (res_COPY4->cr_status != NFS4_OK)
+		return res_COPY4->cr_status;
+
+	resok->cr_requirements.cr_consecutive = true;
+	resok->cr_requirements.cr_synchronous = true;
+
+	/* Copies in the background have to hold their states */
+	if (!arg_COPY4->ca_synchronous && data->session != NULL &&
+	    src_state != NULL && dst_state != NULL &&
+	    args.count > NFS4_COPY_SYNC_MAX) {
+		res_COPY4->cr_status =
+			nfs4_copy_start(data, arg_COPY4, data->saved_obj,
+					src_state, data->current_obj,
+					dst_state, args.count, wr);
+		if (res_COPY4->cr_status == NFS4_OK) {
+			resok->cr_requirements.cr_synchronous = false;
+			goto verifier;
+		}
+		if (res_COPY4->cr_status != NFS4ERR_DELAY)
+			goto out;
+	}
+
+	count = args.count;
+	if (count > NFS4_COPY_SYNC_MAX)
+		count = NFS4_COPY_SYNC_MAX;
+
+	if (count != 0) {
+		fsal_status = data->saved_obj->obj_ops.copy2(
+				data->saved_obj, src_state, args.src_offset,
+				data->current_obj, dst_state, args.dst_offset,
+				count, &copied);
+		if (FSAL_IS_ERROR(fsal_status)) {
+			LogDebug(COMPONENT_NFS_V4, "copy returned %s",
+				 fsal_err_txt(fsal_status));
+			res_COPY4->cr_status = nfs4_Errno_status(fsal_status);
+			goto out;
+		}
+	}
+
+	res_COPY4->cr_status = NFS4_OK;
+	wr->wr_ids = 0;
+	wr->wr_count = copied;
+	wr->wr_committed = UNSTABLE4;
+
+ verifier:
+	verf_desc.addr = wr->wr_writeverf;
+	verf_desc.len = sizeof(verifier4);
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+
+ out:
+	nfs4_copy_done(data, src_state, dst_state);
+
+	return res_COPY4->cr_status;
+}
+
+/**
+ * @brief Free memory allocated for COPY result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_copy_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_CLONE operation
+ *
+ * This functions handles the NFS4_OP_CLONE operation in NFSv4.2. This
+ * function can be called only from nfs4_Compound.  SAVED_FH is the
+ * source and CURRENT_FH the destination.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862
+ */
+
+int nfs4_op_clone(struct nfs_argop4 *op, compound_data_t *data,
+		  struct nfs_resop4 *resp)
+{
+	CLONE4args * const arg_CLONE4 = &op->nfs_argop4_u.opclone;
+	CLONE4res * const res_CLONE4 = &resp->nfs_resop4_u.opclone;
+	struct nfs4_copy_args args = {
+		.src_stateid = &arg_CLONE4->cl_src_stateid,
+		.dst_stateid = &arg_CLONE4->cl_dst_stateid,
+		.src_offset = arg_CLONE4->cl_src_offset,
+		.dst_offset = arg_CLONE4->cl_dst_offset,
+		.count = arg_CLONE4->cl_count,
+		.tag = "CLONE",
+	};
+	struct state_t *src_state, *dst_state;
+	fsal_status_t fsal_status;
+
+	resp->resop = NFS4_OP_CLONE;
+
+	res_CLONE4->cl_status = nfs4_copy_prepare(data, &args, &src_state,
+						  &dst_state);
+	if (res_CLONE4->cl_status != NFS4_OK)
+		return res_CLONE4->cl_status;
+
+	fsal_status = data->saved_obj->obj_ops.clone2(
+			data->saved_obj, src_state, args.src_offset,
+			data->current_obj, dst_state, args.dst_offset,
+			arg_CLONE4->cl_count);
+
+	res_CLONE4->cl_status = nfs4_Errno_status(fsal_status);
+
+	nfs4_copy_done(data, src_state, dst_state);
+
+	return res_CLONE4->cl_status;
+}
+
+/**
+ * @brief Free memory allocated for CLONE result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_clone_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_STATUS operation
+ *
+ * Report how far an asynchronous copy got.  Once the client has seen
+ * it complete, the copy is forgotten.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862
+ */
+
+int nfs4_op_offload_status(struct nfs_argop4 *op, compound_data_t *data,
+			   struct nfs_resop4 *resp)
+{
+	OFFLOAD_STATUS4args * const arg_STATUS4 =
+		&op->nfs_argop4_u.opoffload_status;
+	OFFLOAD_STATUS4res * const res_STATUS4 =
+		&resp->nfs_resop4_u.opoffload_status;
+	OFFLOAD_STATUS4resok *resok =
+		&res_STATUS4->OFFLOAD_STATUS4res_u.osr_resok4;
+	struct nfs4_copy *copy;
+
+	resp->resop = NFS4_OP_OFFLOAD_STATUS;
+
+	PTHREAD_MUTEX_lock(&copy_mtx);
+
+	copy = nfs4_copy_find(data, &arg_STATUS4->osa_stateid);
+	if (copy == NULL) {
+		PTHREAD_MUTEX_unlock(&copy_mtx);
+		res_STATUS4->osr_status = NFS4ERR_BAD_STATEID;
+		return res_STATUS4->osr_status;
+	}
+
+	resok->osr_count = atomic_fetch_uint64_t(&copy->copied);
+	resok->osr_complete.osr_complete_len = copy->complete ? 1 : 0;
+	resok->osr_complete.osr_complete_val = copy->status;
+
+	if (copy->idle)
+		glist_del(&copy->copy_list);
+	else
+		copy = NULL;
+
+	PTHREAD_MUTEX_unlock(&copy_mtx);
+
+	if (copy != NULL)
+		nfs4_copy_free(copy);
+
+	res_STATUS4->osr_status = NFS4_OK;
+	return res_STATUS4->osr_status;
+}
+
+/**
+ * @brief Free memory allocated for OFFLOAD_STATUS result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_offload_status_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_CANCEL operation
+ *
+ * Stop an asynchronous copy.  What was copied stays copied, and no
+ * CB_OFFLOAD is sent for it.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862
+ */
+
+int nfs4_op_offload_cancel(struct nfs_argop4 *op, compound_data_t *data,
+			   struct nfs_resop4 *resp)
+{
+	OFFLOAD_CANCEL4args * const arg_CANCEL4 =
+		&op->nfs_argop4_u.opoffload_cancel;
+	OFFLOAD_CANCEL4res * const res_CANCEL4 =
+		&resp->nfs_resop4_u.opoffload_cancel;
+	struct nfs4_copy *copy;
+
+	resp->resop = NFS4_OP_OFFLOAD_CANCEL;
+
+	PTHREAD_MUTEX_lock(&copy_mtx);
+
+	copy = nfs4_copy_find(data, &arg_CANCEL4->oca_stateid);
+	if (copy == NULL) {
+		PTHREAD_MUTEX_unlock(&copy_mtx);
+		res_CANCEL4->ocr_status = NFS4ERR_BAD_STATEID;
+		return res_CANCEL4->ocr_status;
+	}
+
+	copy->cancel = true;
+	if (copy->idle)
+		glist_del(&copy->copy_list);
+	else
+		copy = NULL;
+
+	PTHREAD_MUTEX_unlock(&copy_mtx);
+
+	if (copy != NULL)
+		nfs4_copy_free(copy);
+
+	res_CANCEL4->ocr_status = NFS4_OK;
+	return res_CANCEL4->ocr_status;
+}
+
+/**
+ * @brief Free memory allocated for OFFLOAD_CANCEL result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief Start the threads of asynchronous copies
+ *
+ * @return 0 or an error code.
+ */
+int nfs4_copy_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 4;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&copy_fridge, "NFS4_Copy", &frp);
+	if (rc != 0)
+		LogMajor(COMPONENT_NFS_V4,
+			 "Unable to initialize copy fridge, error code %d.",
+			 rc);
+
+	return rc;
+}
+
+/**
+ * @brief Stop asynchronous copies and their threads
+ *
+ * @return 0 or an error code.
+ */
+int nfs4_copy_pkgshutdown(void)
+{
+	struct glist_head *glist;
+	struct nfs4_copy *copy;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&copy_mtx);
+	glist_for_each(glist, &copy_list) {
+		copy = glist_entry(glist, struct nfs4_copy, copy_list);
+		copy->cancel = true;
+	}
+	PTHREAD_MUTEX_unlock(&copy_mtx);
+
+	rc = fridgethr_sync_command(copy_fridge, fridgethr_comm_stop, 120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(copy_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "Failed shutting down copy fridge: %d", rc);
+	}
+
+	return rc;
+}
@@ -41,6 +41,39 @@
 #include "nfs_creds.h"
 #include "client_mgr.h"
 #include "fsal.h"
+#include "gsh_token_bucket.h"
+
+/** Paces new sessions, see Max_Session_Create_Rate */
+static struct gsh_token_bucket create_session_tb;
+static pthread_mutex_t create_session_tb_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Whether a session may be created now
+ *
+ * A client turned away gets NFS4ERR_DELAY and retries, so a reconnect
+ * storm is spread out instead of piling up on workers.
+ */
+static bool create_session_admit(void)
+{
+	uint64_t rate = nfs_param.nfsv4_param.max_session_create_rate;
+	struct timespec ts;
+	nsecs_elapsed_t now_ns;
+	bool admit;
+
+	if (rate == 0)
+		return true;
+
+	now(&ts);
+	now_ns = timespec_to_nsecs(&ts);
+
+	PTHREAD_MUTEX_lock(&create_session_tb_mtx);
+	admit = gsh_token_bucket_wait(&create_session_tb, rate, now_ns) == 0;
+	if (admit)
+		gsh_token_bucket_charge(&create_session_tb, rate, 1, now_ns);
+	PTHREAD_MUTEX_unlock(&create_session_tb_mtx);
+
+	return admit;
+}
 
 /**
  *
@@ -87,6 +120,8 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 		sizeof(str_clientid4), str_clientid4, str_clientid4};
 	/* Return code from clientid calls */
 	int i, rc = 0;
+	/* Size of the forechannel slot table */
+	uint32_t nslots;
 	/* Component for logging */
 	log_components_t component = COMPONENT_CLIENTID;
 	/* Abbreviated alias for arguments */
@@ -120,6 +155,13 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	if (data->minorversion == 0)
 		return res_CREATE_SESSION4->csr_status = NFS4ERR_INVAL;
 
+	if (!create_session_admit()) {
+		LogDebug(component,
+			 "CREATE_SESSION client addr=%s clientid=%s delayed, too many new sessions",
+			 str_client_addr, str_clientid4);
+		return res_CREATE_SESSION4->csr_status = NFS4ERR_DELAY;
+	}
+
 	LogDebug(component,
 		 "CREATE_SESSION client addr=%s clientid=%s -------------------",
 		 str_client_addr, str_clientid4);
@@ -198,8 +240,7 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 		     found->cid_create_session_sequence)
 		    && (found->cid_create_session_slot.cache_used)) {
 			data->use_drc = true;
-			data->cached_res =
-			    &found->cid_create_session_slot.cached_result;
+			data->cached_slot = &found->cid_create_session_slot;
 
 			res_CREATE_SESSION4->csr_status = NFS4_OK;
 
@@ -207,7 +248,7 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 
 			LogDebug(component,
 				 "CREATE_SESSION replay=%p special case",
-				 data->cached_res);
+				 data->cached_slot);
 
 			goto out;
 		} else if (arg_CREATE_SESSION4->csa_sequence !=
@@ -324,7 +365,29 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	nfs41_session->cb_program = 0;
 	PTHREAD_MUTEX_init(&nfs41_session->cb_mutex, NULL);
 	PTHREAD_COND_init(&nfs41_session->cb_cond, NULL);
-	for (i = 0; i < NFS41_NB_SLOTS; i++)
+	PTHREAD_MUTEX_init(&nfs41_session->cb_chan.mtx, NULL);
+	PTHREAD_MUTEX_init(&nfs41_session->cb_chan.pending_mtx, NULL);
+	glist_init(&nfs41_session->cb_chan.pending);
+	nfs41_session->cb_chan.dispatching = false;
+
+	/* Size the slot table by what the client asked for, up to our
+	 * limit.
+	 */
+	nslots = MIN(arg_CREATE_SESSION4->csa_fore_chan_attrs.ca_maxrequests,
+		     nfs_param.nfsv4_param.max_session_slots);
+	if (nslots == 0)
+		nslots = 1;
+	nfs41_session->fore_channel_attrs.ca_maxrequests = nslots;
+	nfs41_session->fore_channel_attrs.ca_maxresponsesize_cached =
+	    MIN(arg_CREATE_SESSION4->csa_fore_chan_attrs
+		.ca_maxresponsesize_cached, NFS41_MAX_CACHED_REPLY);
+	nfs41_session->target_slots = nslots;
+	nfs41_session->slots =
+	    gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+			       nslots * sizeof(*nfs41_session->slots));
+	memset(nfs41_session->slots, 0,
+	       nslots * sizeof(*nfs41_session->slots));
+	for (i = 0; i < nslots; i++)
 		PTHREAD_MUTEX_init(&nfs41_session->slots[i].lock, NULL);
 
 	/* Take reference to clientid record on behalf the session. */
@@ -336,8 +399,6 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 		  &nfs41_session->session_link);
 	PTHREAD_MUTEX_unlock(&found->cid_mutex);
 
-	/* Set ca_maxrequests */
-	nfs41_session->fore_channel_attrs.ca_maxrequests = NFS41_NB_SLOTS;
 	nfs41_Build_sessionid(&clientid, nfs41_session->session_id);
 
 	res_CREATE_SESSION4ok->csr_sequence = arg_CREATE_SESSION4->csa_sequence;
@@ -356,10 +417,13 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	       NFS4_SESSIONID_SIZE);
 
 	/* Create Session replay cache */
-	data->cached_res = &found->cid_create_session_slot.cached_result;
+	PTHREAD_MUTEX_lock(&found->cid_create_session_slot.lock);
+	nfs41_Session_Slot_Uncache(&found->cid_create_session_slot);
 	found->cid_create_session_slot.cache_used = true;
+	PTHREAD_MUTEX_unlock(&found->cid_create_session_slot.lock);
+	data->cached_slot = &found->cid_create_session_slot;
 
-	LogDebug(component, "CREATE_SESSION replay=%p", data->cached_res);
+	LogDebug(component, "CREATE_SESSION replay=%p", data->cached_slot);
 
 	if (!nfs41_Session_Set(nfs41_session)) {
 		LogDebug(component, "Could not insert session into table");
@@ -473,7 +537,7 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	conf->cid_create_session_sequence++;
 
 	/* Bump the lease timer */
-	conf->cid_last_renew = time(NULL);
+	atomic_store_time_t(&conf->cid_last_renew, time(NULL));
 
 	/* Release our reference to the confirmed record */
 	dec_client_id_ref(conf);
@@ -78,15 +78,18 @@ int nfs4_op_delegreturn(struct nfs_argop4 *op, compound_data_t *data,
 	resp->resop = NFS4_OP_DELEGRETURN;
 
 	/* If the filehandle is invalid. Delegations are only supported on
-	 * regular files at the moment.
+	 * regular files and directories.
 	 */
 	res_DELEGRETURN4->status = nfs4_sanity_check_FH(data,
-							REGULAR_FILE,
+							NO_FILE_TYPE,
 							false);
 
-	if (res_DELEGRETURN4->status != NFS4_OK) {
-		if (res_DELEGRETURN4->status == NFS4ERR_ISDIR)
-			res_DELEGRETURN4->status = NFS4ERR_INVAL;
+	if (res_DELEGRETURN4->status != NFS4_OK)
+		return res_DELEGRETURN4->status;
+
+	if (data->current_filetype != REGULAR_FILE &&
+	    data->current_filetype != DIRECTORY) {
+		res_DELEGRETURN4->status = NFS4ERR_INVAL;
 		return res_DELEGRETURN4->status;
 	}
 
@@ -0,0 +1,131 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file    nfs4_op_get_dir_delegation.c
+ * @brief   Routines used for managing the NFS4 COMPOUND functions.
+ *
+ * Routines used for managing the NFS4 COMPOUND functions.
+ *
+ *
+ */
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "gsh_rpc.h"
+#include "nfs4.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
+#include "sal_functions.h"
+#include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+
+/**
+ *
+ * @brief The NFS4_OP_GET_DIR_DELEGATION operation.
+ *
+ * Directory delegations are granted without notifications, so that the
+ * client may cache the directory until it is changed by someone else,
+ * at which point the delegation is recalled.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC5661 pp. 377-82
+ *
+ * @see nfs4_Compound
+ */
+
+int nfs4_op_get_dir_delegation(struct nfs_argop4 *op, compound_data_t *data,
+			       struct nfs_resop4 *resp)
+{
+	GET_DIR_DELEGATION4args * const arg_GDD4 __attribute__ ((unused))
+	    = &op->nfs_argop4_u.opget_dir_delegation;
+	GET_DIR_DELEGATION4res * const res_GDD4 =
+	    &resp->nfs_resop4_u.opget_dir_delegation;
+	GET_DIR_DELEGATION4res_non_fatal *res_nf =
+	    &res_GDD4->GET_DIR_DELEGATION4res_u.gddr_res_non_fatal4;
+	GET_DIR_DELEGATION4resok *resok =
+	    &res_nf->GET_DIR_DELEGATION4res_non_fatal_u.gddrnf_resok4;
+	struct fsal_obj_handle *obj;
+	struct state_refer refer;
+	state_t *state = NULL;
+	state_status_t state_status;
+
+	resp->resop = NFS4_OP_GET_DIR_DELEGATION;
+	res_GDD4->gddr_status = NFS4_OK;
+
+	if (data->minorversion == 0)
+		return res_GDD4->gddr_status = NFS4ERR_INVAL;
+
+	res_GDD4->gddr_status = nfs4_sanity_check_FH(data, DIRECTORY, false);
+	if (res_GDD4->gddr_status != NFS4_OK)
+		return res_GDD4->gddr_status;
+
+	obj = data->current_obj;
+
+	if (!dir_deleg_supported(obj, op_ctx->export_perms))
+		return res_GDD4->gddr_status = NFS4ERR_NOTSUPP;
+
+	memcpy(refer.session, data->session->session_id, sizeof(sessionid4));
+	refer.sequence = data->sequence;
+	refer.slot = data->slot;
+
+	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
+	state_status = acquire_dir_deleg(obj, data->session->clientid_record,
+					 &refer, &state);
+	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+
+	if (state_status != STATE_SUCCESS) {
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "Not delegating directory: %s",
+			 state_err_str(state_status));
+		res_nf->gddrnf_status = GDD4_UNAVAIL;
+		res_nf->GET_DIR_DELEGATION4res_non_fatal_u.
+			gddrnf_will_signal_deleg_avail = false;
+		return res_GDD4->gddr_status;
+	}
+
+	res_nf->gddrnf_status = GDD4_OK;
+	memset(resok, 0, sizeof(*resok));
+	COPY_STATEID(&resok->gddr_stateid, state);
+
+	dec_state_t_ref(state);
+
+	return res_GDD4->gddr_status;
+}				/* nfs4_op_get_dir_delegation */
+
+/**
+ * @brief free memory allocated for GET_DIR_DELEGATION result
+ *
+ * This function frees memory allocated for the
+ * NFS4_OP_GET_DIR_DELEGATION result.
+ *
+ * @param[in,out] resp nfs4_op results
+ *
+ */
+void nfs4_op_get_dir_delegation_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
@@ -158,8 +158,5 @@ int nfs4_op_getattr(struct nfs_argop4 *op, compound_data_t *data,
  */
 void nfs4_op_getattr_Free(nfs_resop4 *res)
 {
-	GETATTR4res *resp = &res->nfs_resop4_u.opgetattr;
-
-	if (resp->status == NFS4_OK)
-		nfs4_Fattr_Free(&resp->GETATTR4res_u.resok4.obj_attributes);
+	/* Nothing to be done, the attributes come from the compound's arena */
 }				/* nfs4_op_getattr_Free */
@@ -47,6 +47,7 @@
 #include "nfs_proto_functions.h"
 #include "nfs_file_handle.h"
 #include "export_mgr.h"
+#include "pnfs_utils.h"
 
 /**
  *
@@ -137,6 +138,11 @@ int nfs4_op_getdeviceinfo(struct nfs_argop4 *op, compound_data_t *data,
 	res_GETDEVICEINFO4->GETDEVICEINFO4res_u.gdir_resok4.gdir_device_addr.
 	    da_layout_type = arg_GETDEVICEINFO4->gdia_layout_type;
 
+	if (pnfs_devinfo_cache_get(arg_GETDEVICEINFO4->gdia_layout_type,
+				   deviceid, da_addr_size,
+				   &da_buffer, &da_length))
+		goto found;
+
 	da_buffer = gsh_malloc(da_addr_size);
 
 	xdrmem_create(&da_addr_body, da_buffer, da_addr_size, XDR_ENCODE);
@@ -156,6 +162,11 @@ int nfs4_op_getdeviceinfo(struct nfs_argop4 *op, compound_data_t *data,
 	if (nfs_status != NFS4_OK)
 		goto out;
 
+	pnfs_devinfo_cache_put(arg_GETDEVICEINFO4->gdia_layout_type,
+			       deviceid, da_buffer, da_length);
+
+ found:
+
 	memset(&res_GETDEVICEINFO4->GETDEVICEINFO4res_u.gdir_resok4.
 	       gdir_notification, 0,
 	       sizeof(res_GETDEVICEINFO4->GETDEVICEINFO4res_u.gdir_resok4.
@@ -47,6 +47,7 @@
 #include "fsal_pnfs.h"
 #include "sal_data.h"
 #include "sal_functions.h"
+#include "pnfs_utils.h"
 
 /**
  *
@@ -305,6 +306,23 @@ static nfsstat4 one_segment(struct fsal_obj_handle *obj,
 	current->lo_length = res->segment.length;
 	current->lo_iomode = res->segment.io_mode;
 
+	/* A file layout starts with its deviceid, a flexible file
+	 * layout has its first data server's after the stripe unit and
+	 * the two array counts.  Remember where the client's I/O is
+	 * going for LAYOUTSTATS.
+	 */
+	if (arg->type == LAYOUT4_NFSV4_1_FILES &&
+	    current->lo_content.loc_body.loc_body_len >= NFS4_DEVICEID4_SIZE)
+		memcpy(layout_state->state_data.layout.state_deviceid,
+		       current->lo_content.loc_body.loc_body_val,
+		       NFS4_DEVICEID4_SIZE);
+	else if (arg->type == LAYOUT4_FLEX_FILES &&
+		 current->lo_content.loc_body.loc_body_len >=
+						16 + NFS4_DEVICEID4_SIZE)
+		memcpy(layout_state->state_data.layout.state_deviceid,
+		       current->lo_content.loc_body.loc_body_val + 16,
+		       NFS4_DEVICEID4_SIZE);
+
 	state_status = state_add_segment(layout_state,
 					 &res->segment,
 					 res->fsal_seg_data,
@@ -561,13 +579,16 @@ int nfs4_op_layoutstats(struct nfs_argop4 *op, compound_data_t *data,
 					&resp->nfs_resop4_u.oplayoutstats;
 	/* NFSv4.2 status code */
 	nfsstat4 nfs_status = 0;
+	/* Layout state the stats are about */
+	state_t *layout_state = NULL;
+	struct pnfs_deviceid deviceid;
 
-	LogEvent(COMPONENT_PNFS,
+	LogDebug(COMPONENT_PNFS,
 		 "LAYOUTSTATS offset %" PRIu64 " length %" PRIu64,
 		 arg_LAYOUTSTATS4->lsa_offset,
 		 arg_LAYOUTSTATS4->lsa_length);
 
-	LogEvent(COMPONENT_PNFS,
+	LogDebug(COMPONENT_PNFS,
 		 "LAYOUTSTATS read count %u bytes %" PRIu64
 		 " write count %u bytes %" PRIu64,
 		 arg_LAYOUTSTATS4->lsa_read.ii_count,
@@ -575,7 +596,44 @@ int nfs4_op_layoutstats(struct nfs_argop4 *op, compound_data_t *data,
 		 arg_LAYOUTSTATS4->lsa_write.ii_count,
 		 arg_LAYOUTSTATS4->lsa_write.ii_bytes);
 
-	/** @todo: what else do we want to do with the stats ???  */
+	nfs_status = nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+	if (nfs_status != NFS4_OK)
+		goto out;
+
+	nfs_status = nfs4_Check_Stateid(&arg_LAYOUTSTATS4->lsa_stateid,
+					data->current_obj,
+					&layout_state,
+					data,
+					STATEID_SPECIAL_CURRENT,
+					0,
+					false,
+					"LAYOUTSTATS");
+	if (nfs_status != NFS4_OK)
+		goto out;
+
+	if (layout_state->state_type != STATE_TYPE_LAYOUT) {
+		nfs_status = NFS4ERR_BAD_STATEID;
+		goto out;
+	}
+
+	/* Charge the I/O to the device the layout points at, for the FSAL
+	 * to steer new layouts away from busy data servers.
+	 */
+	PTHREAD_RWLOCK_rdlock(&data->current_obj->state_hdl->state_lock);
+	memcpy(&deviceid, layout_state->state_data.layout.state_deviceid,
+	       sizeof(deviceid));
+	PTHREAD_RWLOCK_unlock(&data->current_obj->state_hdl->state_lock);
+
+	pnfs_device_load_report(&deviceid,
+				(uint64_t) arg_LAYOUTSTATS4->lsa_read.ii_count +
+				arg_LAYOUTSTATS4->lsa_write.ii_count,
+				arg_LAYOUTSTATS4->lsa_read.ii_bytes +
+				arg_LAYOUTSTATS4->lsa_write.ii_bytes);
+
+ out:
+
+	if (layout_state != NULL)
+		dec_state_t_ref(layout_state);
 
 	res_LAYOUTSTATS4->lsr_status = nfs_status;
 
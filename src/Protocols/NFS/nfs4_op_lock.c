@@ -581,6 +581,14 @@ int nfs4_op_lock(struct nfs_argop4 *op, compound_data_t *data,
 			Process_nfs4_conflict(&res_LOCK4->LOCK4res_u.denied,
 					      conflict_owner,
 					      &conflict_desc);
+
+			/* Tell a 4.1 client when it is worth retrying */
+			if (blocking == STATE_NFSV4_BLOCKING &&
+			    data->minorversion > 0)
+				nfs4_lock_notify_wait(
+					data->session->clientid_record,
+					lock_owner, data->current_obj,
+					&data->currentFH, &lock_desc);
 		}
 
 		LogDebug(COMPONENT_NFS_V4_LOCK, "LOCK failed with status %s",
@@ -609,6 +617,8 @@ int nfs4_op_lock(struct nfs_argop4 *op, compound_data_t *data,
 
 	if (data->minorversion == 0)
 		op_ctx->clientid = NULL;
+	else if (blocking == STATE_NFSV4_BLOCKING)
+		nfs4_lock_notify_granted(lock_owner, data->current_obj);
 
 	res_LOCK4->status = NFS4_OK;
 
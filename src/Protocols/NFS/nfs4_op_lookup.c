@@ -142,9 +142,19 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t *data,
 			/* Stash the new export in the compound data. */
 			op_ctx->ctx_export =
 				file_obj->state_hdl->dir.junction_export;
-			op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
 
 			PTHREAD_RWLOCK_unlock(&file_obj->state_hdl->state_lock);
+
+			/* An Attach_On_Demand export gets its FSAL export
+			 * when it is first crossed into.
+			 */
+			if (!export_attach(op_ctx->ctx_export)) {
+				op_ctx->fsal_export = NULL;
+				res_LOOKUP4->status = NFS4ERR_DELAY;
+				goto out;
+			}
+
+			op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
 			/* Build credentials */
 			res_LOOKUP4->status =
 				nfs4_export_check_access(data->req);
@@ -114,7 +114,6 @@ int nfs4_op_nverify(struct nfs_argop4 *op, compound_data_t *data,
 			res_NVERIFY4->status = NFS4ERR_SAME;
 	}
 
-	nfs4_Fattr_Free(&file_attr4);
 	return res_NVERIFY4->status;
 }				/* nfs4_op_nverify */
 
@@ -1045,6 +1045,8 @@ static void do_delegation(OPEN4args *arg_OPEN4, OPEN4res *res_OPEN4,
 	/* This will be updated later if we actually delegate */
 	resok->delegation.delegation_type = OPEN_DELEGATE_NONE;
 
+	deleg_heuristics_open(ostate);
+
 	/* Client doesn't want a delegation. */
 	if (arg_OPEN4->share_access & OPEN4_SHARE_ACCESS_WANT_NO_DELEG) {
 		resok->delegation.open_delegation4_u.
@@ -1774,18 +1776,16 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
 		return res_OPEN4->status;
 	}
 
-	/* Check if lease is expired and reserve it */
-	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	/* The client may only hold state once it can reclaim it */
+	nfs4_wait_clid(clientid);
 
+	/* Check if lease is expired and reserve it */
 	if (data->minorversion == 0 && !reserve_lease(clientid)) {
-		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
 		res_OPEN4->status = NFS4ERR_EXPIRED;
 		LogDebug(COMPONENT_NFS_V4, "Lease expired");
 		goto out3;
 	}
 
-	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
-
 	/* Get the open owner */
 	if (!open4_open_owner(op, data, resp, clientid, &owner)) {
 		LogDebug(COMPONENT_NFS_V4, "open4_open_owner failed");
@@ -1840,6 +1840,12 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
 		goto out;
 	}
 
+	/* No one writes to an immutable export, so denying writes
+	 * changes nothing, and denying reads is not honored there.
+	 */
+	if (op_ctx->ctx_export->immutable)
+		arg_OPEN4->share_deny = OPEN4_SHARE_DENY_NONE;
+
 	if (data->current_obj->fsal->m_ops.support_ex(data->current_obj)) {
 		/* Utilize the extended FSAL APU functionality to
 		 * perform the open.
@@ -1987,6 +1993,11 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
 
 	res_OPEN4->OPEN4res_u.resok4.rflags |= OPEN4_RESULT_LOCKTYPE_POSIX;
 
+	/* Blocking locks of 4.1 clients get CB_NOTIFY_LOCK */
+	if (data->minorversion > 0)
+		res_OPEN4->OPEN4res_u.resok4.rflags |=
+			OPEN4_RESULT_MAY_NOTIFY_LOCK;
+
 	LogFullDebug(COMPONENT_STATE, "NFS4 OPEN returning NFS4_OK");
 
 	/* regular exit */
@@ -2027,11 +2038,8 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
  out2:
 
 	/* Update the lease before exit */
-	if (data->minorversion == 0) {
-		PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	if (data->minorversion == 0)
 		update_lease(clientid);
-		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
-	}
 
 	if (file_state != NULL)
 		dec_state_t_ref(file_state);
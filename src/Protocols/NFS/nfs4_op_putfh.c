@@ -139,6 +139,7 @@ static int nfs4_mds_putfh(compound_data_t *data)
 	struct fsal_obj_handle *new_hdl;
 	fsal_status_t fsal_status = { 0, 0 };
 	bool changed = true;
+	bool cached;
 
 	LogFullDebug(COMPONENT_FILEHANDLE,
 		     "NFS4 Handle flags 0x%X export id %d",
@@ -146,10 +147,17 @@ static int nfs4_mds_putfh(compound_data_t *data)
 	LogFullDebugOpaque(COMPONENT_FILEHANDLE, "NFS4 FSAL Handle %s",
 			   LEN_FH_STR, v4_handle->fsopaque, v4_handle->fs_len);
 
+	/* Clients keep coming back with the same handles; if this thread
+	 * resolved this one recently, skip the export lookup and the
+	 * handle decode.
+	 */
+	cached = nfs4_fh_cache_get(&data->currentFH, &exporting, &new_hdl);
+
 	/* Find any existing export by the "id" from the handle,
 	 * before releasing the old export (to prevent thrashing).
 	 */
-	exporting = get_gsh_export(ntohs(v4_handle->id.exports));
+	if (!cached)
+		exporting = get_gsh_export(ntohs(v4_handle->id.exports));
 	if (exporting == NULL) {
 		LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 			   "NFS4 Request from client (%s) has invalid export identifier %d",
@@ -161,6 +169,14 @@ static int nfs4_mds_putfh(compound_data_t *data)
 		return NFS4ERR_STALE;
 	}
 
+	/* Handles of an Attach_On_Demand export outlive its attachment
+	 * across restarts.
+	 */
+	if (!cached && !export_attach(exporting)) {
+		put_gsh_export(exporting);
+		return NFS4ERR_DELAY;
+	}
+
 	/* If old CurrentFH had a related export, release reference. */
 	if (op_ctx->ctx_export != NULL) {
 		changed = ntohs(v4_handle->id.exports) !=
@@ -189,10 +205,15 @@ static int nfs4_mds_putfh(compound_data_t *data)
 			LogFullDebug(COMPONENT_FILEHANDLE,
 				     "Export check access failed %s",
 				     nfsstat4_to_str(status));
+			if (cached)
+				new_hdl->obj_ops.put_ref(new_hdl);
 			return status;
 		}
 	}
 
+	if (cached)
+		goto set_entry;
+
 	fh_desc.len = v4_handle->fs_len;
 	fh_desc.addr = &v4_handle->fsopaque;
 
@@ -217,6 +238,9 @@ static int nfs4_mds_putfh(compound_data_t *data)
 		return nfs4_Errno_status(fsal_status);
 	}
 
+	nfs4_fh_cache_put(&data->currentFH, exporting, new_hdl);
+
+ set_entry:
 	/* Set the current entry using the ref from get */
 	set_current_entry(data, new_hdl);
 
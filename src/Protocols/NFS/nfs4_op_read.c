@@ -48,6 +48,9 @@
 #include "server_stats.h"
 #include "export_mgr.h"
 
+/** Most data and hole segments returned by a READ_PLUS */
+#define NFS4_READ_PLUS_SEGS 64
+
 /**
  * @brief Read on a pNFS pNFS data server
  *
@@ -134,7 +137,7 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 {
 	READ4args * const arg_READ4 = &op->nfs_argop4_u.opread;
 	READ_PLUS4res * const res_RPLUS = &resp->nfs_resop4_u.opread_plus;
-	contents *contentp = &res_RPLUS->rpr_resok4.rpr_contents;
+	contents *contentp;
 	/* NFSv4 return code */
 	nfsstat4 nfs_status = 0;
 	/* Buffer into which data is to be read */
@@ -142,10 +145,13 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 	/* End of file flag */
 	bool eof = false;
 
+	contentp = gsh_calloc(1, sizeof(contents));
+	res_RPLUS->rpr_resok4.rpr_contents.rpr_contents_len = 1;
+	res_RPLUS->rpr_resok4.rpr_contents.rpr_contents_val = contentp;
+
 	/* Don't bother calling the FSAL if the read length is 0. */
 
 	if (arg_READ4->count == 0) {
-		res_RPLUS->rpr_resok4.rpr_contents_count = 1;
 		res_RPLUS->rpr_resok4.rpr_eof = FALSE;
 		contentp->what = NFS4_CONTENT_DATA;
 		contentp->data.d_offset = arg_READ4->offset;
@@ -172,16 +178,18 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 	res_RPLUS->rpr_status = nfs_status;
 	if (nfs_status != NFS4_OK) {
 		gsh_free(buffer);
+		gsh_free(contentp);
+		res_RPLUS->rpr_resok4.rpr_contents.rpr_contents_val = NULL;
 		return res_RPLUS->rpr_status;
 	}
 
 	contentp->what = info->io_content.what;
-	res_RPLUS->rpr_resok4.rpr_contents_count = 1;
 	res_RPLUS->rpr_resok4.rpr_eof = eof;
 
 	if (info->io_content.what == NFS4_CONTENT_HOLE) {
 		contentp->hole.di_offset = info->io_content.hole.di_offset;
 		contentp->hole.di_length = info->io_content.hole.di_length;
+		gsh_free(buffer);
 	}
 	if (info->io_content.what == NFS4_CONTENT_DATA) {
 		contentp->data.d_offset = info->io_content.data.d_offset;
@@ -205,6 +213,9 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	uint64_t offset = 0;
 	bool eof_met = false;
 	void *bufferdata = NULL;
+	struct iovec *iov = NULL;
+	u_int iovcnt = 0;
+	struct nfs_read_fd *rfd = NULL;
 	fsal_status_t fsal_status = {0, 0};
 	state_t *state_found = NULL;
 	state_t *state_open = NULL;
@@ -221,6 +232,9 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	/* Say we are managing NFS4_OP_READ */
 	resp->resop = NFS4_OP_READ;
 	res_READ4->status = NFS4_OK;
+	res_READ4->READ4res_u.resok4.data_iov = NULL;
+	res_READ4->READ4res_u.resok4.data_iovcnt = 0;
+	res_READ4->READ4res_u.resok4.data_fd = NULL;
 
 	/* Do basic checks on a filehandle Only files can be read */
 
@@ -447,9 +461,6 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		goto done;
 	}
 
-	/* Some work is to be done */
-	bufferdata = gsh_malloc_aligned(4096, size);
-
 	if (!anonymous_started && data->minorversion == 0) {
 		owner = get_state_owner_ref(state_found);
 		if (owner != NULL) {
@@ -458,19 +469,50 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
-	if (obj->fsal->m_ops.support_ex(obj)) {
+	if (info == NULL && data->oppos + 1 == data->opcnt &&
+	    nfs_read_fd_get(obj, bypass, state_found, offset, size, &rfd,
+			    &read_size, &eof_met, &fsal_status)) {
+		/* Plain READ ending the compound, nothing else in it can
+		 * change the data before it is read, when encoding.
+		 */
+	} else if (info == NULL && nfs_read_use_iov(obj)) {
+		/* Plain READ, read into a scatter list that is encoded
+		 * as is.
+		 */
+		iov = nfs_read_iov_alloc(size, &iovcnt);
+		fsal_status = fsal_readv2(obj, bypass, state_found, offset,
+					  iov, iovcnt, &read_size, &eof_met);
+	} else if (obj->fsal->m_ops.support_ex(obj)) {
 		/* Call the new fsal_read2 */
+		bufferdata = gsh_malloc_aligned(4096, size);
 		fsal_status = fsal_read2(obj, bypass, state_found, offset, size,
 					 &read_size, bufferdata, &eof_met,
 					 info);
+		if (fsal_status.major == ERR_FSAL_NOTSUPP && info != NULL &&
+		    info->io_segs != NULL) {
+			/* No holes known, it is all data */
+			fsal_status = fsal_read2(obj, bypass, state_found,
+						 offset, size, &read_size,
+						 bufferdata, &eof_met, NULL);
+			info->io_segcnt = 0;
+			info->io_content.what = NFS4_CONTENT_DATA;
+			info->io_content.data.d_offset = offset;
+			info->io_content.data.d_data.data_len = read_size;
+			info->io_content.data.d_data.data_val = bufferdata;
+		}
 	} else {
 		/* Call legacy fsal_rdwr */
+		bufferdata = gsh_malloc_aligned(4096, size);
 		fsal_status = fsal_rdwr(obj, io, offset, size, &read_size,
 					bufferdata, &eof_met, &sync, info);
 	}
 
 	if (FSAL_IS_ERROR(fsal_status)) {
 		res_READ4->status = nfs4_Errno_status(fsal_status);
+		if (iov != NULL)
+			nfs_read_iov_free(iov, iovcnt);
+		if (rfd != NULL)
+			nfs_read_fd_release(rfd);
 		gsh_free(bufferdata);
 		res_READ4->READ4res_u.resok4.data.data_val = NULL;
 		goto done;
@@ -496,6 +538,9 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 
 	res_READ4->READ4res_u.resok4.data.data_len = read_size;
 	res_READ4->READ4res_u.resok4.data.data_val = bufferdata;
+	res_READ4->READ4res_u.resok4.data_iov = iov;
+	res_READ4->READ4res_u.resok4.data_iovcnt = iovcnt;
+	res_READ4->READ4res_u.resok4.data_fd = rfd;
 
 	LogFullDebug(COMPONENT_NFS_V4,
 		     "NFS4_OP_READ: offset = %" PRIu64
@@ -512,7 +557,7 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	if (anonymous_started)
 		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
 
-	server_stats_io_done(size, read_size,
+	server_stats_io_done(obj, offset, size, read_size,
 			     (res_READ4->status == NFS4_OK) ? true : false,
 			     false);
 
@@ -566,9 +611,16 @@ void nfs4_op_read_Free(nfs_resop4 *res)
 {
 	READ4res *resp = &res->nfs_resop4_u.opread;
 
-	if (resp->status == NFS4_OK)
-		if (resp->READ4res_u.resok4.data.data_val != NULL)
-			gsh_free(resp->READ4res_u.resok4.data.data_val);
+	if (resp->status != NFS4_OK)
+		return;
+
+	if (resp->READ4res_u.resok4.data_iov != NULL)
+		nfs_read_iov_free(resp->READ4res_u.resok4.data_iov,
+				  resp->READ4res_u.resok4.data_iovcnt);
+	else if (resp->READ4res_u.resok4.data_fd != NULL)
+		nfs_read_fd_release(resp->READ4res_u.resok4.data_fd);
+	else if (resp->READ4res_u.resok4.data.data_val != NULL)
+		gsh_free(resp->READ4res_u.resok4.data.data_val);
 }
 
 /**
@@ -589,46 +641,109 @@ int nfs4_op_read_plus(struct nfs_argop4 *op, compound_data_t *data,
 {
 	struct nfs_resop4 res;
 	struct io_info info;
+	struct io_segment segs[NFS4_READ_PLUS_SEGS];
 	/* Response */
 	READ_PLUS4res * const res_RPLUS = &resp->nfs_resop4_u.opread_plus;
 	READ4res *res_READ4 = &res.nfs_resop4_u.opread;
-	contents *contentp = &res_RPLUS->rpr_resok4.rpr_contents;
+	char *buffer;
+	contents *contentp;
+	bool has_data = false;
+	uint32_t i;
 
 	resp->resop = NFS4_OP_READ_PLUS;
 
+	memset(&info, 0, sizeof(info));
+
+	/* A data server fills in the READ_PLUS reply itself */
+	if (data->minorversion > 0 &&
+	    nfs4_Is_Fh_DSHandle(&data->currentFH))
+		return op_dsread_plus(op, data, resp, &info);
+
+	info.io_segs = segs;
+	info.io_segmax = NFS4_READ_PLUS_SEGS;
+
 	nfs4_read(op, data, &res, FSAL_IO_READ_PLUS, &info);
 
 	res_RPLUS->rpr_status = res_READ4->status;
 	if (res_RPLUS->rpr_status != NFS4_OK)
 		return res_RPLUS->rpr_status;
 
-	contentp->what = info.io_content.what;
-	res_RPLUS->rpr_resok4.rpr_contents_count = 1;
 	res_RPLUS->rpr_resok4.rpr_eof =
 			res_READ4->READ4res_u.resok4.eof;
-
-	if (info.io_content.what == NFS4_CONTENT_HOLE) {
-		contentp->hole.di_offset = info.io_content.hole.di_offset;
-		contentp->hole.di_length = info.io_content.hole.di_length;
-	}
-	if (info.io_content.what == NFS4_CONTENT_DATA) {
-		contentp->data.d_offset = info.io_content.data.d_offset;
-		contentp->data.d_data.data_len =
+	buffer = res_READ4->READ4res_u.resok4.data.data_val;
+
+	if (info.io_segcnt == 0) {
+		/* A single segment, or nothing read */
+		contentp = gsh_calloc(1, sizeof(contents));
+		res_RPLUS->rpr_resok4.rpr_contents.rpr_contents_len = 1;
+		res_RPLUS->rpr_resok4.rpr_contents.rpr_contents_val = contentp;
+
+		contentp->what = info.io_content.what;
+		if (info.io_content.what == NFS4_CONTENT_HOLE) {
+			contentp->hole.di_offset =
+					info.io_content.hole.di_offset;
+			contentp->hole.di_length =
+					info.io_content.hole.di_length;
+		}
+		if (info.io_content.what == NFS4_CONTENT_DATA) {
+			contentp->data.d_offset =
+					info.io_content.data.d_offset;
+			contentp->data.d_data.data_len =
 					info.io_content.data.d_data.data_len;
-		contentp->data.d_data.data_val =
+			contentp->data.d_data.data_val =
 					info.io_content.data.d_data.data_val;
+			has_data = contentp->data.d_data.data_val != NULL;
+		}
+		if (!has_data)
+			gsh_free(buffer);
+		return res_RPLUS->rpr_status;
+	}
+
+	/* Data of the data segments is packed at the start of buffer,
+	 * so the first data segment carries the buffer to free.
+	 */
+	contentp = gsh_calloc(info.io_segcnt, sizeof(contents));
+	res_RPLUS->rpr_resok4.rpr_contents.rpr_contents_len = info.io_segcnt;
+	res_RPLUS->rpr_resok4.rpr_contents.rpr_contents_val = contentp;
+
+	for (i = 0; i < info.io_segcnt; i++, contentp++) {
+		contentp->what = segs[i].what;
+		if (segs[i].what == NFS4_CONTENT_HOLE) {
+			contentp->hole.di_offset = segs[i].offset;
+			contentp->hole.di_length = segs[i].length;
+			continue;
+		}
+		contentp->data.d_offset = segs[i].offset;
+		contentp->data.d_data.data_len = segs[i].length;
+		contentp->data.d_data.data_val = buffer;
+		buffer += segs[i].length;
+		has_data = true;
 	}
+
+	if (!has_data)
+		gsh_free(res_READ4->READ4res_u.resok4.data.data_val);
+
 	return res_RPLUS->rpr_status;
 }
 
 void nfs4_op_read_plus_Free(nfs_resop4 *res)
 {
 	READ_PLUS4res *resp = &res->nfs_resop4_u.opread_plus;
-	contents *conp = &resp->rpr_resok4.rpr_contents;
+	contents *conp = resp->rpr_resok4.rpr_contents.rpr_contents_val;
+	u_int i;
+
+	if (resp->rpr_status != NFS4_OK || conp == NULL)
+		return;
+
+	/* The first data segment holds the start of the buffer */
+	for (i = 0; i < resp->rpr_resok4.rpr_contents.rpr_contents_len; i++) {
+		if (conp[i].what == NFS4_CONTENT_DATA) {
+			gsh_free(conp[i].data.d_data.data_val);
+			break;
+		}
+	}
 
-	if (resp->rpr_status == NFS4_OK && conp->what == NFS4_CONTENT_DATA)
-		if (conp->data.d_data.data_val != NULL)
-			gsh_free(conp->data.d_data.data_val);
+	gsh_free(conp);
 }
 
 /**
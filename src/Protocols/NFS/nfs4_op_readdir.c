@@ -161,6 +161,14 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 			goto not_junction;
 		}
 
+		if (!export_attached(obj->state_hdl->dir.junction_export)) {
+			/* Listing a directory should not attach every
+			 * Attach_On_Demand export in it, report the
+			 * junction itself until a LOOKUP crosses it.
+			 */
+			goto not_junction;
+		}
+
 		get_gsh_export_ref(obj->state_hdl->dir.junction_export);
 
 		/* Save the compound data context */
@@ -303,7 +311,8 @@ not_junction:
 
 	tracker->mem_left -= (namelen + 1);
 	tracker_entry->name.utf8string_len = namelen;
-	tracker_entry->name.utf8string_val = gsh_malloc(namelen + 1);
+	tracker_entry->name.utf8string_val =
+		gsh_arena_alloc(data->arena, namelen + 1);
 
 	memcpy(tracker_entry->name.utf8string_val,
 	       cb_parms->name,
@@ -365,6 +374,7 @@ not_junction:
 	args.mounted_on_fileid = mounted_on_fileid;
 	args.fileid = obj->fileid;
 	args.fsid = obj->fsid;
+	args.arena = data->arena;
 
 	if (nfs4_FSALattr_To_Fattr(&args,
 				   tracker->req_attr,
@@ -389,7 +399,7 @@ not_junction:
 			goto failure;
 		}
 
-		if (nfs4_Fattr_Fill_Error(&tracker_entry->attrs,
+		if (nfs4_Fattr_Fill_Error(data, &tracker_entry->attrs,
 					  rdattr_error) == -1)
 			goto server_fault;
 	}
@@ -421,15 +431,9 @@ not_junction:
 
  failure:
 
-	if (tracker_entry->attrs.attr_vals.attrlist4_val != NULL) {
-		gsh_free(tracker_entry->attrs.attr_vals.attrlist4_val);
-		tracker_entry->attrs.attr_vals.attrlist4_val = NULL;
-	}
-
-	if (tracker_entry->name.utf8string_val != NULL) {
-		gsh_free(tracker_entry->name.utf8string_val);
-		tracker_entry->name.utf8string_val = NULL;
-	}
+	/* The name and attributes stay in the arena until the reply is freed */
+	tracker_entry->attrs.attr_vals.attrlist4_val = NULL;
+	tracker_entry->name.utf8string_val = NULL;
 
  not_inresult:
 
@@ -440,28 +444,6 @@ not_junction:
 	return ERR_FSAL_NO_ERROR;
 }
 
-/**
- * @brief Free a list of entry4s
- *
- * This function frees a list of entry4s and all dependent strctures.
- *
- * @param[in,out] entries The entries to be freed
- */
-
-static void free_entries(entry4 *entries)
-{
-	entry4 *entry = NULL;
-
-	for (entry = entries; entry != NULL; entry = entry->nextentry) {
-		if (entry->attrs.attr_vals.attrlist4_val != NULL)
-			gsh_free(entry->attrs.attr_vals.attrlist4_val);
-
-		if (entry->name.utf8string_val != NULL)
-			gsh_free(entry->name.utf8string_val);
-	}
-	gsh_free(entries);
-}
-
 /**
  * @brief NFS4_OP_READDIR
  *
@@ -610,7 +592,8 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Prepare to read the entries */
 
-	entries = gsh_calloc(estimated_num_entries, sizeof(entry4));
+	entries = gsh_arena_calloc(data->arena, estimated_num_entries,
+				   sizeof(entry4));
 	tracker.entries = entries;
 	tracker.mem_left = maxcount - sizeof(READDIR4resok);
 	tracker.count = 0;
@@ -662,8 +645,6 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 		 */
 		res_READDIR4->READDIR4res_u.resok4.reply.entries = entries;
 	} else {
-		gsh_free(entries);
-		entries = NULL;
 		res_READDIR4->READDIR4res_u.resok4.reply.entries = NULL;
 	}
 
@@ -685,9 +666,6 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 	res_READDIR4->status = NFS4_OK;
 
  out:
-	if ((res_READDIR4->status != NFS4_OK) && (entries != NULL))
-		free_entries(entries);
-
 	LogFullDebug(COMPONENT_NFS_READDIR,
 		     "Returning %s",
 		     nfsstat4_to_str(res_READDIR4->status));
@@ -705,7 +683,5 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
  */
 void nfs4_op_readdir_Free(nfs_resop4 *res)
 {
-	READDIR4res *resp = &res->nfs_resop4_u.opreaddir;
-
-	free_entries(resp->READDIR4res_u.resok4.reply.entries);
+	/* Nothing to be done, the entries come from the compound's arena */
 }				/* nfs4_op_readdir_Free */
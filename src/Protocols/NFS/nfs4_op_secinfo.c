@@ -128,6 +128,13 @@ int nfs4_op_secinfo(struct nfs_argop4 *op, compound_data_t *data,
 		saved_gsh_export = op_ctx->ctx_export;
 
 		op_ctx->ctx_export = junction_export;
+
+		if (!export_attach(junction_export)) {
+			op_ctx->fsal_export = NULL;
+			res_SECINFO4->status = NFS4ERR_DELAY;
+			goto out;
+		}
+
 		op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
 
 		/* Build credentials */
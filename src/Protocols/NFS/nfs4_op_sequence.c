@@ -34,6 +34,46 @@
 #include "sal_functions.h"
 #include "nfs_rpc_callback.h"
 #include "nfs_convert.h"
+#include "abstract_atomic.h"
+
+/**
+ * @brief Number of slots a session should use under the current load
+ *
+ * While the dispatcher holds less than half of Dispatch_Max_Reqs the
+ * whole slot table is offered.  Beyond that the target shrinks in
+ * proportion to the headroom left, down to a single slot when the
+ * dispatcher is full.  Shrinking takes effect at once; growing back is
+ * limited to doubling per SEQUENCE so a recovering server is not
+ * flooded again.
+ *
+ * @param[in,out] session The session
+ *
+ * @return The number of slots, at least 1.
+ */
+static uint32_t nfs41_session_target_slots(nfs41_session_t *session)
+{
+	uint32_t nslots = session->fore_channel_attrs.ca_maxrequests;
+	uint32_t max = nfs_param.core_param.dispatch_max_reqs;
+	uint32_t load = nfs_rpc_outstanding_reqs_est();
+	uint32_t prev = atomic_fetch_uint32_t(&session->target_slots);
+	uint32_t target = nslots;
+
+	if (load >= max)
+		target = 1;
+	else if (load > max / 2)
+		target = (uint64_t) nslots * (max - load) / (max - max / 2);
+
+	if (target == 0)
+		target = 1;
+
+	if (target > prev * 2)
+		target = prev * 2;
+
+	if (target != prev)
+		atomic_store_uint32_t(&session->target_slots, target);
+
+	return target;
+}
 
 /**
  * @brief the NFS4_OP_SEQUENCE operation
@@ -54,6 +94,8 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	SEQUENCE4res * const res_SEQUENCE4 = &resp->nfs_resop4_u.opsequence;
 
 	nfs41_session_t *session;
+	nfs41_session_slot_t *slot;
+	gsh_xprt_private_t *xu;
 
 	resp->resop = NFS4_OP_SEQUENCE;
 	res_SEQUENCE4->sr_status = NFS4_OK;
@@ -69,7 +111,10 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 		return res_SEQUENCE4->sr_status;
 	}
 
-	if (!nfs41_Session_Get_Pointer(arg_SEQUENCE4->sa_sessionid, &session)) {
+	xu = data->req->rq_xprt->xp_u1;
+	if (!nfs41_Session_Get_Pointer_cached(xu ? xu->sessions : NULL,
+					      arg_SEQUENCE4->sa_sessionid,
+					      &session)) {
 		res_SEQUENCE4->sr_status = NFS4ERR_BADSESSION;
 		LogDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
 			    "SEQUENCE returning status %s",
@@ -83,11 +128,7 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	LogDebug(COMPONENT_SESSIONS, "SEQUENCE session=%p", session);
 
 	/* Check if lease is expired and reserve it */
-	PTHREAD_MUTEX_lock(&session->clientid_record->cid_mutex);
-
 	if (!reserve_lease(session->clientid_record)) {
-		PTHREAD_MUTEX_unlock(&session->clientid_record->cid_mutex);
-
 		dec_session_ref(session);
 		res_SEQUENCE4->sr_status = NFS4ERR_EXPIRED;
 		LogDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
@@ -98,8 +139,6 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 
 	data->preserved_clientid = session->clientid_record;
 
-	PTHREAD_MUTEX_unlock(&session->clientid_record->cid_mutex);
-
 	/* Check is slot is compliant with ca_maxrequests */
 	if (arg_SEQUENCE4->sa_slotid >=
 	    session->fore_channel_attrs.ca_maxrequests) {
@@ -114,58 +153,55 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	/* By default, no DRC replay */
 	data->use_drc = false;
 
-	PTHREAD_MUTEX_lock(&session->slots[arg_SEQUENCE4->sa_slotid].lock);
-	if (session->slots[arg_SEQUENCE4->sa_slotid].sequence + 1 !=
-	    arg_SEQUENCE4->sa_sequenceid) {
-		if (session->slots[arg_SEQUENCE4->sa_slotid].sequence ==
-		    arg_SEQUENCE4->sa_sequenceid) {
-#if IMPLEMENT_CACHETHIS
-			/** @todo
-			 *
-			 * Ganesha always caches result anyway so ignore
-			 * cachethis
-			 */
-			if (session->slots[arg_SEQUENCE4->sa_slotid]
-			    .cache_used) {
-#endif
+	slot = &session->slots[arg_SEQUENCE4->sa_slotid];
+
+	PTHREAD_MUTEX_lock(&slot->lock);
+	if (slot->sequence + 1 != arg_SEQUENCE4->sa_sequenceid) {
+		if (slot->sequence == arg_SEQUENCE4->sa_sequenceid) {
+			if (slot->cache_used && slot->cached_xdr == NULL) {
+				/* The original is still being processed */
+				PTHREAD_MUTEX_unlock(&slot->lock);
+				dec_session_ref(session);
+				res_SEQUENCE4->sr_status = NFS4ERR_DELAY;
+				LogDebugAlt(COMPONENT_SESSIONS,
+					    COMPONENT_CLIENTID,
+					    "SEQUENCE returning status %s",
+					    nfsstat4_to_str(res_SEQUENCE4->
+							    sr_status));
+				return res_SEQUENCE4->sr_status;
+			}
+
+			if (slot->cache_used) {
 				/* Replay operation through the DRC */
 				data->use_drc = true;
-				data->cached_res =
-				    &session->slots[arg_SEQUENCE4->sa_slotid].
-				    cached_result;
+				data->cached_slot = slot;
 
 				LogFullDebugAlt(COMPONENT_SESSIONS,
 						COMPONENT_CLIENTID,
 						"Use sesson slot %" PRIu32
 						"=%p for DRC",
 						arg_SEQUENCE4->sa_slotid,
-						data->cached_res);
+						slot);
 
-				PTHREAD_MUTEX_unlock(&session->
-					slots[arg_SEQUENCE4->sa_slotid].lock);
+				PTHREAD_MUTEX_unlock(&slot->lock);
 				dec_session_ref(session);
 				res_SEQUENCE4->sr_status = NFS4_OK;
 				return res_SEQUENCE4->sr_status;
-#if IMPLEMENT_CACHETHIS
-			} else {
-				/* Illegal replay */
-				PTHREAD_MUTEX_unlock(&session->
-					slots[arg_SEQUENCE4->sa_slotid].lock);
-				dec_session_ref(session);
-				res_SEQUENCE4->sr_status =
-				    NFS4ERR_RETRY_UNCACHED_REP;
-				LogDebugAlt(COMPONENT_SESSIONS,
-					    COMPONENT_CLIENTID,
-					    "SEQUENCE returning status %s",
-					    nfsstat4_to_str(res_SEQUENCE4->
-							    sr_status));
-				return res_SEQUENCE4->sr_status;
 			}
-#endif
+
+			/* Replay of a reply the client did not ask us
+			 * to cache.
+			 */
+			PTHREAD_MUTEX_unlock(&slot->lock);
+			dec_session_ref(session);
+			res_SEQUENCE4->sr_status = NFS4ERR_RETRY_UNCACHED_REP;
+			LogDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
+				    "SEQUENCE returning status %s",
+				    nfsstat4_to_str(res_SEQUENCE4->sr_status));
+			return res_SEQUENCE4->sr_status;
 		}
 
-		PTHREAD_MUTEX_unlock(&session->
-			slots[arg_SEQUENCE4->sa_slotid].lock);
+		PTHREAD_MUTEX_unlock(&slot->lock);
 		dec_session_ref(session);
 		res_SEQUENCE4->sr_status = NFS4ERR_SEQ_MISORDERED;
 		LogDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
@@ -182,18 +218,18 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	data->slot = arg_SEQUENCE4->sa_slotid;
 
 	/* Update the sequence id within the slot */
-	session->slots[arg_SEQUENCE4->sa_slotid].sequence += 1;
+	slot->sequence += 1;
 
 	memcpy(res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_sessionid,
 	       arg_SEQUENCE4->sa_sessionid, NFS4_SESSIONID_SIZE);
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_sequenceid =
-	    session->slots[arg_SEQUENCE4->sa_slotid].sequence;
+	    slot->sequence;
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_slotid =
 	    arg_SEQUENCE4->sa_slotid;
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_highest_slotid =
-	    NFS41_NB_SLOTS - 1;
-	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_target_highest_slotid =
 	    session->fore_channel_attrs.ca_maxrequests - 1;
+	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_target_highest_slotid =
+	    nfs41_session_target_slots(session) - 1;
 
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_status_flags = 0;
 
@@ -202,29 +238,28 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 		    SEQ4_STATUS_CB_PATH_DOWN;
 	}
 
-#if IMPLEMENT_CACHETHIS
-/* Ganesha always caches result anyway so ignore cachethis */
+	/* The previous reply of the slot is acknowledged by this request,
+	 * drop it.  The reply to this one is encoded into the slot once
+	 * the COMPOUND completes, if the client asked for it.
+	 */
+	nfs41_Session_Slot_Uncache(slot);
+
 	if (arg_SEQUENCE4->sa_cachethis) {
-#endif
-		data->cached_res =
-		    &session->slots[arg_SEQUENCE4->sa_slotid].cached_result;
-		session->slots[arg_SEQUENCE4->sa_slotid].cache_used = true;
+		data->cached_slot = slot;
+		slot->cache_used = true;
 
 		LogFullDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
 				"Use sesson slot %" PRIu32 "=%p for DRC",
-				arg_SEQUENCE4->sa_slotid, data->cached_res);
-#if IMPLEMENT_CACHETHIS
+				arg_SEQUENCE4->sa_slotid, slot);
 	} else {
-		data->cached_res = NULL;
-		session->slots[arg_SEQUENCE4->sa_slotid].cache_used = false;
+		data->cached_slot = NULL;
 
 		LogFullDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
 				"Don't use sesson slot %" PRIu32
 				"=NULL for DRC", arg_SEQUENCE4->sa_slotid);
 	}
-#endif
 
-	PTHREAD_MUTEX_unlock(&session->slots[arg_SEQUENCE4->sa_slotid].lock);
+	PTHREAD_MUTEX_unlock(&slot->lock);
 
 	/* If we were successful, stash the clientid in the request
 	 * context.
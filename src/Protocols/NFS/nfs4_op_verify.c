@@ -112,7 +112,6 @@ int nfs4_op_verify(struct nfs_argop4 *op, compound_data_t *data,
 	else
 		res_VERIFY4->status = NFS4ERR_NOT_SAME;
 
-	nfs4_Fattr_Free(&file_attr4);
 	return res_VERIFY4->status;
 }				/* nfs4_op_verify */
 
@@ -443,7 +443,7 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 	if (anonymous_started)
 		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
 
-	server_stats_io_done(size, written_size,
+	server_stats_io_done(obj, offset, size, written_size,
 			     (res_WRITE4->status == NFS4_OK) ? true : false,
 			     true);
 
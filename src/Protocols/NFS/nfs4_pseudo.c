@@ -65,6 +65,10 @@ struct pseudofs_state {
  */
 static bool is_export_pseudo(struct gsh_export *export)
 {
+	/* Not attached yet, PSEUDO exports always are */
+	if (export->fsal_export == NULL)
+		return false;
+
 	/* If it's PSEUDO, it's PSEUDO */
 	if (strcmp(export->fsal_export->fsal->name, "PSEUDO") == 0)
 		return true;
@@ -351,6 +355,15 @@ bool pseudo_mount_export(struct gsh_export *export)
 			 export->pseudopath, tmp_pseudopath);
 	}
 
+	/* Exports below an Attach_On_Demand export attach it now */
+	if (!export_attach(op_ctx->ctx_export)) {
+		LogCrit(COMPONENT_EXPORT,
+			"BUILDING PSEUDOFS: Could not attach mounted on export for %s",
+			export->pseudopath);
+		put_gsh_export(op_ctx->ctx_export);
+		return false;
+	}
+
 	op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
 
 	/* Put the slash back in */
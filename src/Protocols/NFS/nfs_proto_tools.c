@@ -30,6 +30,8 @@
  *
  * A set of functions used to managed NFS.
  */
+#include <unistd.h>
+#include <sys/mman.h>
 #include "log.h"
 #include "fsal.h"
 #include "fsal_convert.h"
@@ -280,6 +282,298 @@ bool nfs_RetryableError(fsal_errors_t fsal_errors)
 		 fsal_errors, __LINE__);
 	return false;
 }
+
+/**
+ * @brief Preallocated READ buffer segments
+ *
+ * Read_Buffer_Pool_Size bytes of segments are allocated at startup as
+ * one slab, faulted in and, where the kernel supports it, backed by
+ * huge pages.  Free segments are linked through their first word.
+ * Segments beyond the slab come from the heap and go back to it.
+ */
+static pthread_mutex_t nfs_read_seg_mtx = PTHREAD_MUTEX_INITIALIZER;
+static char *nfs_read_seg_slab;
+static size_t nfs_read_seg_slab_size;
+static void *nfs_read_seg_free;
+
+/** Alignment of the segment slab, that of a huge page */
+#define NFS_READ_SEG_SLAB_ALIGN (2 * 1024 * 1024)
+
+/**
+ * @brief Set up the READ buffer segment pool
+ */
+void nfs_read_iov_pkginit(void)
+{
+	size_t size = nfs_param.core_param.read_buffer_pool_size;
+	char *seg;
+
+	size -= size % NFS_READ_IOV_SEGMENT;
+	if (size == 0)
+		return;
+
+	nfs_read_seg_slab = gsh_malloc_aligned(NFS_READ_SEG_SLAB_ALIGN, size);
+	nfs_read_seg_slab_size = size;
+
+#ifdef MADV_HUGEPAGE
+	(void) madvise(nfs_read_seg_slab, size, MADV_HUGEPAGE);
+#endif
+
+	/* Fault the slab in now rather than on the first READs */
+	memset(nfs_read_seg_slab, 0, size);
+
+	for (seg = nfs_read_seg_slab + size - NFS_READ_IOV_SEGMENT;
+	     seg >= nfs_read_seg_slab; seg -= NFS_READ_IOV_SEGMENT) {
+		*(void **)seg = nfs_read_seg_free;
+		nfs_read_seg_free = seg;
+	}
+
+	LogInfo(COMPONENT_INIT, "READ buffer pool of %zu segments",
+		size / NFS_READ_IOV_SEGMENT);
+}
+
+static void *nfs_read_seg_get(void)
+{
+	void *seg;
+
+	if (nfs_read_seg_slab == NULL)
+		return gsh_malloc_aligned(4096, NFS_READ_IOV_SEGMENT);
+
+	PTHREAD_MUTEX_lock(&nfs_read_seg_mtx);
+
+	seg = nfs_read_seg_free;
+	if (seg != NULL)
+		nfs_read_seg_free = *(void **)seg;
+
+	PTHREAD_MUTEX_unlock(&nfs_read_seg_mtx);
+
+	if (seg == NULL)
+		seg = gsh_malloc_aligned(4096, NFS_READ_IOV_SEGMENT);
+
+	return seg;
+}
+
+static void nfs_read_seg_put(void *seg)
+{
+	if ((char *)seg < nfs_read_seg_slab ||
+	    (char *)seg >= nfs_read_seg_slab + nfs_read_seg_slab_size) {
+		gsh_free(seg);
+		return;
+	}
+
+	PTHREAD_MUTEX_lock(&nfs_read_seg_mtx);
+
+	*(void **)seg = nfs_read_seg_free;
+	nfs_read_seg_free = seg;
+
+	PTHREAD_MUTEX_unlock(&nfs_read_seg_mtx);
+}
+
+/**
+ * @brief Allocate the scatter list for a READ reply
+ *
+ * The reply data is split into NFS_READ_IOV_SEGMENT sized buffers so
+ * large READs don't require one big contiguous allocation, and the
+ * buffers can be encoded straight from the list.
+ *
+ * @param[in]  size   Total number of bytes to be read
+ * @param[out] iovcnt Number of buffers allocated
+ *
+ * @return The list of buffers, to be released with nfs_read_iov_free.
+ */
+struct iovec *nfs_read_iov_alloc(size_t size, u_int *iovcnt)
+{
+	struct iovec *iov;
+	u_int cnt = (size + NFS_READ_IOV_SEGMENT - 1) / NFS_READ_IOV_SEGMENT;
+	u_int i;
+
+	iov = gsh_malloc(cnt * sizeof(*iov));
+
+	for (i = 0; i < cnt; i++) {
+		iov[i].iov_len = size < NFS_READ_IOV_SEGMENT
+					? size : NFS_READ_IOV_SEGMENT;
+		iov[i].iov_base = nfs_read_seg_get();
+		size -= iov[i].iov_len;
+	}
+
+	*iovcnt = cnt;
+	return iov;
+}
+
+/**
+ * @brief Whether to read a READ reply into a scatter list
+ *
+ * Only pays off when the FSAL has a native readv2, the default one
+ * issues a read2 per segment.  Otherwise a single buffer is read
+ * with read2.
+ *
+ * @param[in] obj File to read
+ *
+ * @return true if nfs_read_iov_alloc and fsal_readv2 are to be used.
+ */
+bool nfs_read_use_iov(struct fsal_obj_handle *obj)
+{
+	struct fsal_export *exp_hdl = op_ctx->fsal_export;
+
+	return obj->fsal->m_ops.support_ex(obj) &&
+	       exp_hdl->exp_ops.fs_supports(exp_hdl, fso_readv);
+}
+
+/**
+ * @brief Release a scatter list allocated by nfs_read_iov_alloc
+ *
+ * @param[in] iov    The list of buffers
+ * @param[in] iovcnt Number of buffers in iov
+ */
+void nfs_read_iov_free(struct iovec *iov, u_int iovcnt)
+{
+	u_int i;
+
+	for (i = 0; i < iovcnt; i++)
+		nfs_read_seg_put(iov[i].iov_base);
+
+	gsh_free(iov);
+}
+
+/** Smallest piece of data read straight into the encoding buffers */
+#define NFS_READ_FD_MIN_INLINE 4096
+
+/**
+ * @brief Leave the data of a large READ in the file until encoding
+ *
+ * With Deferred_Read_Min set, a READ of at least that many bytes on
+ * an FSAL that can give a descriptor of the file is not read into
+ * buffers: the data is read by xdr_opaque_fd, straight into the reply.
+ *
+ * @param[in]  obj       File to read
+ * @param[in]  bypass    Bypass any non-mandatory deny read
+ * @param[in]  state     state_t to use for this operation
+ * @param[in]  offset    Position at which to read
+ * @param[in]  size      Amount of data to read
+ * @param[out] rfd       Where to encode the data from, NULL if none
+ * @param[out] read_size Amount of data that will be sent
+ * @param[out] eof       true if the READ reaches end of file
+ * @param[out] status    Result of the READ
+ *
+ * @return false if the caller must read the data itself.
+ */
+bool nfs_read_fd_get(struct fsal_obj_handle *obj, bool bypass,
+		     struct state_t *state, uint64_t offset, size_t size,
+		     struct nfs_read_fd **rfd, size_t *read_size, bool *eof,
+		     fsal_status_t *status)
+{
+	uint32_t min = nfs_param.core_param.deferred_read_min;
+	int fd;
+
+	if (min == 0 || size < min || !obj->fsal->m_ops.support_ex(obj))
+		return false;
+
+	*status = fsal_read_fd(obj, bypass, state, offset, size, &fd,
+			       read_size, eof);
+
+	if (status->major == ERR_FSAL_NOTSUPP)
+		return false;
+
+	*rfd = NULL;
+
+	if (!FSAL_IS_ERROR(*status) && fd >= 0) {
+		*rfd = gsh_malloc(sizeof(**rfd));
+		(*rfd)->fd = fd;
+		(*rfd)->offset = offset;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Release what nfs_read_fd_get returned
+ *
+ * @param[in] rfd The descriptor of the data
+ */
+void nfs_read_fd_release(struct nfs_read_fd *rfd)
+{
+	close(rfd->fd);
+	gsh_free(rfd);
+}
+
+/**
+ * @brief Encode the data of a READ straight from the file
+ *
+ * Same wire format as xdr_opaque_iov.  The data is read into the
+ * encoding buffers wherever the stream has room inline, and through a
+ * segment otherwise, so it is copied once on its way from the page
+ * cache to the transport.  The file having shrunk since the READ was
+ * served fails the encoding, no reply is sent and the client retries.
+ *
+ * @param[in] xdrs XDR stream, must be XDR_ENCODE
+ * @param[in] rfd  Where the data is
+ * @param[in] len  Number of bytes to encode
+ *
+ * @return true on success.
+ */
+bool xdr_opaque_fd(XDR *xdrs, struct nfs_read_fd *rfd, u_int len)
+{
+	static char zeroes[BYTES_PER_XDR_UNIT];
+	u_int left = len;
+	u_int pad = (BYTES_PER_XDR_UNIT - (len % BYTES_PER_XDR_UNIT))
+		    % BYTES_PER_XDR_UNIT;
+	uint64_t offset = rfd->offset;
+	char *bounce = NULL;
+	bool ok = false;
+	char *p;
+	u_int n;
+
+	if (xdrs->x_op != XDR_ENCODE)
+		return false;
+
+	if (!xdr_u_int(xdrs, &len))
+		return false;
+
+	while (left > 0) {
+		/* As much as fits in the current buffer, in whole units */
+		n = left < NFS_READ_IOV_SEGMENT ? left : NFS_READ_IOV_SEGMENT;
+		n -= n % BYTES_PER_XDR_UNIT;
+		p = NULL;
+
+		while (n >= NFS_READ_FD_MIN_INLINE &&
+		       (p = (char *)XDR_INLINE(xdrs, n)) == NULL) {
+			n /= 2;
+			n -= n % BYTES_PER_XDR_UNIT;
+		}
+
+		if (p == NULL) {
+			if (bounce == NULL)
+				bounce = nfs_read_seg_get();
+			n = left < NFS_READ_IOV_SEGMENT
+				? left : NFS_READ_IOV_SEGMENT;
+			p = bounce;
+		}
+
+		if (pread(rfd->fd, p, n, offset) != (ssize_t) n) {
+			LogDebug(COMPONENT_DISPATCH,
+				 "Could not read %u bytes at %" PRIu64
+				 " for the reply", n, offset);
+			goto out;
+		}
+
+		if (p == bounce && !XDR_PUTBYTES(xdrs, bounce, n))
+			goto out;
+
+		offset += n;
+		left -= n;
+	}
+
+	if (pad != 0 && !XDR_PUTBYTES(xdrs, zeroes, pad))
+		goto out;
+
+	ok = true;
+
+ out:
+	if (bounce != NULL)
+		nfs_read_seg_put(bounce);
+
+	return ok;
+}
+
 /**
  * @brief Returns the maximun attribute index possbile for a 4.x protocol.
  *
@@ -3448,6 +3742,7 @@ nfsstat4 file_To_Fattr(compound_data_t *data,
 		.attrs = attr,
 		.data = data,
 		.hdl4 = &data->currentFH,
+		.arena = data->arena,
 	};
 
 	/* Permission check only if ACL is asked for.
@@ -3534,7 +3829,8 @@ nfsstat4 file_To_Fattr(compound_data_t *data,
 	return NFS4_OK;
 }
 
-int nfs4_Fattr_Fill_Error(fattr4 *Fattr, nfsstat4 rdattr_error)
+int nfs4_Fattr_Fill_Error(compound_data_t *data, fattr4 *Fattr,
+			  nfsstat4 rdattr_error)
 {
 	u_int LastOffset;
 	XDR attr_body;
@@ -3543,8 +3839,12 @@ int nfs4_Fattr_Fill_Error(fattr4 *Fattr, nfsstat4 rdattr_error)
 
 	/* basic init */
 	memset(&Fattr->attrmask, 0, sizeof(Fattr->attrmask));
-	Fattr->attr_vals.attrlist4_val =
-	    gsh_malloc(fattr4tab[FATTR4_RDATTR_ERROR].size_fattr4);
+	if (data->arena != NULL)
+		Fattr->attr_vals.attrlist4_val = gsh_arena_alloc(data->arena,
+				fattr4tab[FATTR4_RDATTR_ERROR].size_fattr4);
+	else
+		Fattr->attr_vals.attrlist4_val =
+		    gsh_malloc(fattr4tab[FATTR4_RDATTR_ERROR].size_fattr4);
 
 	LastOffset = 0;
 	memset(&attr_body, 0, sizeof(attr_body));
@@ -3570,7 +3870,8 @@ int nfs4_Fattr_Fill_Error(fattr4 *Fattr, nfsstat4 rdattr_error)
 
 		if (LastOffset == 0) {	/* no supported attrs so we can free */
 			assert(Fattr->attrmask.bitmap4_len == 0);
-			gsh_free(Fattr->attr_vals.attrlist4_val);
+			if (data->arena == NULL)
+				gsh_free(Fattr->attr_vals.attrlist4_val);
 			Fattr->attr_vals.attrlist4_val = NULL;
 		}
 		Fattr->attr_vals.attrlist4_len = LastOffset;
@@ -3582,12 +3883,315 @@ int nfs4_Fattr_Fill_Error(fattr4 *Fattr, nfsstat4 rdattr_error)
 			     fattr4tab[FATTR4_RDATTR_ERROR].name);
 		/* signal fail so if(LastOffset > 0) works right */
 
-		gsh_free(Fattr->attr_vals.attrlist4_val);
+		if (data->arena == NULL)
+			gsh_free(Fattr->attr_vals.attrlist4_val);
 		Fattr->attr_vals.attrlist4_val = NULL;
 		return -1;
 	}
 }
 
+/**
+ * @brief A compiled fattr4 bitmap
+ *
+ * Clients ask for a handful of distinct bitmaps, mostly made of the
+ * fixed size POSIX attributes.  Such a bitmap is compiled once into
+ * the list of attributes to encode and the bitmap that results, so
+ * that nfs4_FSALattr_To_Fattr can encode it in one pass with direct
+ * calls, without walking the bitmap and fattr4tab.
+ */
+
+#define FATTR4_PLAN_ATTRS 16
+#define FATTR4_PLANS 16
+
+struct fattr4_plan {
+	struct bitmap4 request;	/*< Bitmap as requested */
+	int max_attr_idx;	/*< Bound the plan was compiled for */
+	bool fast;		/*< false if the bitmap has other attributes */
+	bool memo;		/*< Worth remembering encodings of, it has
+				    owner names to map */
+	uint32_t nattrs;	/*< Entries in attrs */
+	uint8_t attrs[FATTR4_PLAN_ATTRS];	/*< Attributes, in order */
+	struct bitmap4 result;	/*< Bitmap of the encoded attributes */
+};
+
+/* Plans are only added, under fattr4_plan_lock, and published by
+ * bumping fattr4_nplans, so lookups need no lock.
+ */
+static struct fattr4_plan fattr4_plans[FATTR4_PLANS];
+static uint32_t fattr4_nplans;
+static pthread_mutex_t fattr4_plan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Is an attribute one the fast path encodes?
+ *
+ * These are the attributes whose encoder never returns
+ * FATTR_XDR_NOOP.
+ */
+static inline bool fattr4_plan_attr(int attr)
+{
+	switch (attr) {
+	case FATTR4_TYPE:
+	case FATTR4_CHANGE:
+	case FATTR4_SIZE:
+	case FATTR4_FSID:
+	case FATTR4_RDATTR_ERROR:
+	case FATTR4_FILEID:
+	case FATTR4_MODE:
+	case FATTR4_NUMLINKS:
+	case FATTR4_OWNER:
+	case FATTR4_OWNER_GROUP:
+	case FATTR4_RAWDEV:
+	case FATTR4_SPACE_USED:
+	case FATTR4_TIME_ACCESS:
+	case FATTR4_TIME_METADATA:
+	case FATTR4_TIME_MODIFY:
+	case FATTR4_MOUNTED_ON_FILEID:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static inline bool fattr4_plan_match(const struct fattr4_plan *plan,
+				     const struct bitmap4 *bitmap,
+				     int max_attr_idx)
+{
+	return plan->max_attr_idx == max_attr_idx &&
+	       plan->request.bitmap4_len == bitmap->bitmap4_len &&
+	       memcmp(plan->request.map, bitmap->map,
+		      bitmap->bitmap4_len * sizeof(uint32_t)) == 0;
+}
+
+/**
+ * @brief Find, or compile, the plan for a bitmap
+ *
+ * @param[in] bitmap        Bitmap of attributes being requested
+ * @param[in] max_attr_idx  Highest attribute of the minor version
+ *
+ * @return The plan, or NULL if the bitmap must take the slow path.
+ */
+static const struct fattr4_plan *fattr4_plan_get(struct bitmap4 *bitmap,
+						 int max_attr_idx)
+{
+	struct fattr4_plan *plan = NULL;
+	uint32_t i, n;
+	int attr;
+
+	if (bitmap->bitmap4_len > BITMAP4_MAPLEN)
+		return NULL;
+
+	n = atomic_fetch_uint32_t(&fattr4_nplans);
+	for (i = 0; i < n; i++) {
+		if (fattr4_plan_match(&fattr4_plans[i], bitmap, max_attr_idx))
+			return fattr4_plans[i].fast ? &fattr4_plans[i] : NULL;
+	}
+
+	if (n == FATTR4_PLANS)
+		return NULL;
+
+	PTHREAD_MUTEX_lock(&fattr4_plan_lock);
+
+	/* Someone may have compiled it meanwhile */
+	n = fattr4_nplans;
+	for (; i < n; i++) {
+		if (fattr4_plan_match(&fattr4_plans[i], bitmap, max_attr_idx)) {
+			plan = &fattr4_plans[i];
+			goto out;
+		}
+	}
+
+	if (n == FATTR4_PLANS)
+		goto out;
+
+	plan = &fattr4_plans[n];
+	memset(plan, 0, sizeof(*plan));
+	plan->request.bitmap4_len = bitmap->bitmap4_len;
+	memcpy(plan->request.map, bitmap->map,
+	       bitmap->bitmap4_len * sizeof(uint32_t));
+	plan->max_attr_idx = max_attr_idx;
+	plan->fast = true;
+
+	for (attr = next_attr_from_bitmap(bitmap, -1);
+	     attr != -1 && attr <= max_attr_idx;
+	     attr = next_attr_from_bitmap(bitmap, attr)) {
+		if (!fattr4_plan_attr(attr)) {
+			/* Remember the bitmap as one for the slow path */
+			plan->fast = false;
+			break;
+		}
+		plan->attrs[plan->nattrs++] = attr;
+		set_attribute_in_bitmap(&plan->result, attr);
+		if (attr == FATTR4_OWNER || attr == FATTR4_OWNER_GROUP)
+			plan->memo = true;
+	}
+
+	atomic_store_uint32_t(&fattr4_nplans, n + 1);
+
+	LogDebug(COMPONENT_NFS_V4,
+		 "Compiled fattr4 bitmap %d: %"PRIx32" %"PRIx32" %"PRIx32
+		 " fast %s",
+		 n, bitmap->map[0],
+		 bitmap->bitmap4_len > 1 ? bitmap->map[1] : 0,
+		 bitmap->bitmap4_len > 2 ? bitmap->map[2] : 0,
+		 plan->fast ? "yes" : "no");
+
+ out:
+	PTHREAD_MUTEX_unlock(&fattr4_plan_lock);
+
+	return plan != NULL && plan->fast ? plan : NULL;
+}
+
+/**
+ * @brief Encode the attributes of a plan
+ *
+ * @param[in]     plan  The compiled bitmap
+ * @param[in,out] xdr   Stream to encode into
+ * @param[in]     args  XDR attribute arguments
+ *
+ * @return FATTR_XDR_SUCCESS or FATTR_XDR_FAILED.
+ */
+static fattr_xdr_result fattr4_plan_encode(const struct fattr4_plan *plan,
+					   XDR *xdr,
+					   struct xdr_attrs_args *args)
+{
+	fattr_xdr_result res = FATTR_XDR_SUCCESS;
+	uint32_t i;
+
+	for (i = 0; i < plan->nattrs && res == FATTR_XDR_SUCCESS; i++) {
+		switch (plan->attrs[i]) {
+		case FATTR4_TYPE:
+			res = encode_type(xdr, args);
+			break;
+		case FATTR4_CHANGE:
+			res = encode_change(xdr, args);
+			break;
+		case FATTR4_SIZE:
+			res = encode_filesize(xdr, args);
+			break;
+		case FATTR4_FSID:
+			res = encode_fsid(xdr, args);
+			break;
+		case FATTR4_RDATTR_ERROR:
+			res = encode_rdattr_error(xdr, args);
+			break;
+		case FATTR4_FILEID:
+			res = encode_fileid(xdr, args);
+			break;
+		case FATTR4_MODE:
+			res = encode_mode(xdr, args);
+			break;
+		case FATTR4_NUMLINKS:
+			res = encode_numlinks(xdr, args);
+			break;
+		case FATTR4_OWNER:
+			res = encode_owner(xdr, args);
+			break;
+		case FATTR4_OWNER_GROUP:
+			res = encode_group(xdr, args);
+			break;
+		case FATTR4_RAWDEV:
+			res = encode_rawdev(xdr, args);
+			break;
+		case FATTR4_SPACE_USED:
+			res = encode_spaceused(xdr, args);
+			break;
+		case FATTR4_TIME_ACCESS:
+			res = encode_accesstime(xdr, args);
+			break;
+		case FATTR4_TIME_METADATA:
+			res = encode_metatime(xdr, args);
+			break;
+		case FATTR4_TIME_MODIFY:
+			res = encode_modifytime(xdr, args);
+			break;
+		case FATTR4_MOUNTED_ON_FILEID:
+			res = encode_mounted_on_fileid(xdr, args);
+			break;
+		default:
+			res = FATTR_XDR_FAILED;
+			break;
+		}
+	}
+
+	return res;
+}
+
+/**
+ * @brief Encodings of plans remembered by each thread
+ *
+ * A client polling the same file gets the same bytes back until one of
+ * its attributes changes.  The key holds everything the plan's
+ * encoders read, and mapping the owner and group to names is what a
+ * hit saves.  Only the names can go stale, so an encoding is kept for
+ * FATTR4_MEMO_TIME seconds, leaving the idmapper its refreshes.
+ */
+
+#define FATTR4_MEMO_SLOTS 16
+#define FATTR4_MEMO_LEN 256
+#define FATTR4_MEMO_TIME 2
+
+struct fattr4_memo_key {
+	const struct fattr4_plan *plan;
+	uint64_t fileid;
+	fsal_fsid_t fsid;
+	uint64_t mounted_on_fileid;
+	uint64_t change;
+	uint64_t filesize;
+	uint64_t spaceused;
+	uint64_t owner;
+	uint64_t group;
+	fsal_dev_t rawdev;
+	struct timespec atime;
+	struct timespec ctime;
+	struct timespec mtime;
+	uint32_t mode;
+	uint32_t numlinks;
+	object_file_type_t type;
+	nfsstat4 rdattr_error;
+	int32_t export_id;	/*< For the export's fsid, -1 for none */
+};
+
+struct fattr4_memo {
+	struct fattr4_memo_key key;
+	u_int len;		/*< 0 if the slot is empty */
+	time_t filled;
+	char vals[FATTR4_MEMO_LEN];
+};
+
+static __thread struct fattr4_memo fattr4_memo[FATTR4_MEMO_SLOTS];
+
+static struct fattr4_memo *fattr4_memo_slot(const struct fattr4_plan *plan,
+					    struct xdr_attrs_args *args,
+					    struct fattr4_memo_key *key)
+{
+	const struct attrlist *attrs = args->attrs;
+
+	/* compared with memcmp, padding included */
+	memset(key, 0, sizeof(*key));
+	key->plan = plan;
+	key->fileid = args->fileid;
+	key->fsid = args->fsid;
+	key->mounted_on_fileid = args->mounted_on_fileid;
+	key->change = attrs->change;
+	key->filesize = attrs->filesize;
+	key->spaceused = attrs->spaceused;
+	key->owner = attrs->owner;
+	key->group = attrs->group;
+	key->rawdev = attrs->rawdev;
+	key->atime = attrs->atime;
+	key->ctime = attrs->ctime;
+	key->mtime = attrs->mtime;
+	key->mode = attrs->mode;
+	key->numlinks = attrs->numlinks;
+	key->type = attrs->type;
+	key->rdattr_error = args->rdattr_error;
+	key->export_id = args->data != NULL ?
+			 op_ctx->ctx_export->export_id : -1;
+
+	return &fattr4_memo[(key->fileid ^ key->fsid.minor) %
+			    FATTR4_MEMO_SLOTS];
+}
+
 /**
  * @brief Converts FSAL Attributes to NFSv4 Fattr buffer.
  *
@@ -3598,7 +4202,8 @@ int nfs4_Fattr_Fill_Error(fattr4 *Fattr, nfsstat4 rdattr_error)
  * @param[out] Fattr   NFSv4 Fattr buffer
  *		       Memory for bitmap_val and attr_val is
  *                     dynamically allocated,
- *		       caller is responsible for freeing it.
+ *		       caller is responsible for freeing it,
+ *		       unless it comes from args->arena.
  *
  * @return -1 if failed, 0 if successful.
  *
@@ -3613,6 +4218,11 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	fsal_dynamicfsinfo_t dynamicinfo;
 	XDR attr_body;
 	fattr_xdr_result xdr_res;
+	const struct fattr4_plan *plan;
+	struct fattr4_memo *memo = NULL;
+	struct fattr4_memo_key key;
+	time_t now = 0;
+	char buffer[NFS4_ATTRVALS_BUFFLEN];
 
 	/* basic init */
 	memset(Fattr, 0, sizeof(*Fattr));
@@ -3620,7 +4230,12 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	if (Bitmap->bitmap4_len == 0)
 		return 0;	/* they ask for nothing, they get nothing */
 
-	Fattr->attr_vals.attrlist4_val = gsh_malloc(NFS4_ATTRVALS_BUFFLEN);
+	/* With an arena, encode on the stack and keep just what it takes */
+	if (args->arena != NULL)
+		Fattr->attr_vals.attrlist4_val = buffer;
+	else
+		Fattr->attr_vals.attrlist4_val =
+					gsh_malloc(NFS4_ATTRVALS_BUFFLEN);
 
 	max_attr_idx = nfs4_max_attr_index(args->data);
 	LogFullDebug(COMPONENT_NFS_V4, "Maximum allowed attr index = %d",
@@ -3634,6 +4249,38 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	if (args->dynamicinfo == NULL)
 		args->dynamicinfo = &dynamicinfo;
 
+	plan = fattr4_plan_get(Bitmap, max_attr_idx);
+	if (plan != NULL) {
+		if (plan->memo) {
+			memo = fattr4_memo_slot(plan, args, &key);
+			now = time(NULL);
+			if (memo->len != 0 &&
+			    now - memo->filled < FATTR4_MEMO_TIME &&
+			    memcmp(&memo->key, &key, sizeof(key)) == 0) {
+				memcpy(Fattr->attr_vals.attrlist4_val,
+				       memo->vals, memo->len);
+				xdr_setpos(&attr_body, memo->len);
+				Fattr->attrmask = plan->result;
+				goto done;
+			}
+		}
+		if (fattr4_plan_encode(plan, &attr_body, args) !=
+		    FATTR_XDR_SUCCESS) {
+			LogFullDebug(COMPONENT_NFS_V4,
+				     "Encode FAILED for compiled bitmap");
+			goto err;
+		}
+		Fattr->attrmask = plan->result;
+		if (memo != NULL && xdr_getpos(&attr_body) <= FATTR4_MEMO_LEN) {
+			memo->key = key;
+			memo->len = xdr_getpos(&attr_body);
+			memo->filled = now;
+			memcpy(memo->vals, Fattr->attr_vals.attrlist4_val,
+			       memo->len);
+		}
+		goto done;
+	}
+
 	for (attribute_to_set = next_attr_from_bitmap(Bitmap, -1);
 	     attribute_to_set != -1;
 	     attribute_to_set =
@@ -3667,19 +4314,27 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 		}
 		/* mark the attribute in the bitmap should be new bitmap btw */
 	}
+
+ done:
 	LastOffset = xdr_getpos(&attr_body);	/* dumb but for now */
 	xdr_destroy(&attr_body);
 
 	if (LastOffset == 0) {	/* no supported attrs so we can free */
 		assert(Fattr->attrmask.bitmap4_len == 0);
-		gsh_free(Fattr->attr_vals.attrlist4_val);
+		if (args->arena == NULL)
+			gsh_free(Fattr->attr_vals.attrlist4_val);
 		Fattr->attr_vals.attrlist4_val = NULL;
+	} else if (args->arena != NULL) {
+		Fattr->attr_vals.attrlist4_val =
+				gsh_arena_alloc(args->arena, LastOffset);
+		memcpy(Fattr->attr_vals.attrlist4_val, buffer, LastOffset);
 	}
 	Fattr->attr_vals.attrlist4_len = LastOffset;
 	return 0;
 
  err:
-	gsh_free(Fattr->attr_vals.attrlist4_val);
+	if (args->arena == NULL)
+		gsh_free(Fattr->attr_vals.attrlist4_val);
 	Fattr->attr_vals.attrlist4_val = NULL;
 	return -1;
 }
@@ -4414,6 +5069,25 @@ int nfs4_Fattr_To_FSAL_attr(struct attrlist *FSAL_attr, fattr4 *Fattr,
 	return Fattr4_To_FSAL_attr(FSAL_attr, Fattr, NULL, NULL, data);
 }
 
+/**
+ * @brief Convert NFSv4 attributes, including the file handle
+ *
+ * @param[out]    FSAL_attr FSAL attributes
+ * @param[in]     Fattr     NFSv4 attributes
+ * @param[in,out] hdl4      Where the FATTR4_FILEHANDLE attribute is
+ *                          decoded to, if present; the caller provides
+ *                          nfs_fh4_val with room for NFS4_FHSIZE bytes
+ *
+ * @return NFS4_OK if successful, NFS4ERR codes if not.
+ *
+ */
+int nfs4_Fattr_To_FSAL_attr_fh(struct attrlist *FSAL_attr, fattr4 *Fattr,
+			       nfs_fh4 *hdl4)
+{
+	memset(FSAL_attr, 0, sizeof(struct attrlist));
+	return Fattr4_To_FSAL_attr(FSAL_attr, Fattr, hdl4, NULL, NULL);
+}
+
 /**
  *
  * nfs4_Fattr_To_fsinfo: Decode filesystem info out of NFSv4 attributes.
@@ -112,19 +112,180 @@ xdrproc_t nlm_reply_proc[] = {
 	[NLMPROC4_UNLOCK_RES] = (xdrproc_t) xdr_nlm4_res,
 };
 
-static void *resp_key;
+/**
+ * @brief A GRANTED_MSG callback waiting for its GRANTED_RES
+ *
+ * Callbacks are pipelined: the sender only records the key and moves on
+ * to the next callback.  A host may have at most NLM_ASYNC_WINDOW
+ * callbacks outstanding; once the window is full the sender waits for
+ * a reply, or for the oldest callback to expire, before sending more.
+ */
+struct nlm_async_wait {
+	struct glist_head naw_list;	/*< On nlm_async_waits */
+	void *naw_key;			/*< Key passed to nlm_signal_async_resp */
+	state_nlm_client_t *naw_host;	/*< Host the callback went to */
+	time_t naw_expire;		/*< Give up waiting after this */
+};
+
+static struct glist_head nlm_async_waits = GLIST_HEAD_INIT(nlm_async_waits);
 
 static const int MAX_ASYNC_RETRY = 2;
+static const uint32_t NLM_ASYNC_WINDOW = 32;
+static const time_t NLM_ASYNC_RESP_TIMEOUT = 5;
+
+/**
+ * @brief Drop a wait from the list
+ *
+ * Must be called with nlm_async_resp_mutex held.  The caller frees the
+ * wait and its host reference once the mutex has been released.
+ *
+ * @param[in] wait The wait to remove
+ */
+static void nlm_async_wait_remove(struct nlm_async_wait *wait)
+{
+	glist_del(&wait->naw_list);
+	wait->naw_host->slc_callback_inflight--;
+	pthread_cond_broadcast(&nlm_async_resp_cond);
+}
+
+static void nlm_async_wait_free(struct nlm_async_wait *wait)
+{
+	dec_nlm_client_ref(wait->naw_host);
+	gsh_free(wait);
+}
+
+/**
+ * @brief Expire waits that will never see a reply
+ *
+ * Must be called with nlm_async_resp_mutex held.  Expired waits are
+ * moved to @a expired so they may be freed outside the mutex.
+ *
+ * @param[in]  now     Current time
+ * @param[out] expired List to collect expired waits on
+ *
+ * @return The earliest expiry time still pending, or 0 if none.
+ */
+static time_t nlm_async_wait_expire(time_t now, struct glist_head *expired)
+{
+	struct glist_head *glist, *glistn;
+	struct nlm_async_wait *wait;
+	time_t next = 0;
+
+	glist_for_each_safe(glist, glistn, &nlm_async_waits) {
+		wait = glist_entry(glist, struct nlm_async_wait, naw_list);
+
+		if (wait->naw_expire <= now) {
+			LogFullDebug(COMPONENT_NLM,
+				     "No response for key %p", wait->naw_key);
+			nlm_async_wait_remove(wait);
+			glist_add_tail(expired, &wait->naw_list);
+		} else if (next == 0 || wait->naw_expire < next) {
+			next = wait->naw_expire;
+		}
+	}
+
+	return next;
+}
+
+/**
+ * @brief Reserve a slot in the host's callback window
+ *
+ * @param[in] host Host the callback is going to
+ * @param[in] key  Key that nlm_signal_async_resp will be called with
+ *
+ * @return The wait, to be passed to nlm_async_wait_commit.
+ */
+static struct nlm_async_wait *nlm_async_wait_reserve(state_nlm_client_t *host,
+						     void *key)
+{
+	struct nlm_async_wait *wait = gsh_malloc(sizeof(*wait));
+	struct glist_head expired = GLIST_HEAD_INIT(expired);
+	struct glist_head *glist, *glistn;
+	struct timespec timeout;
+	time_t now, next;
+
+	inc_nlm_client_ref(host);
+	wait->naw_key = key;
+	wait->naw_host = host;
+
+	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
+
+	now = time(NULL);
+	next = nlm_async_wait_expire(now, &expired);
+
+	while (host->slc_callback_inflight >= NLM_ASYNC_WINDOW) {
+		LogFullDebug(COMPONENT_NLM,
+			     "Callback window full for %s, waiting",
+			     host->slc_nlm_caller_name);
+
+		timeout.tv_sec = next != 0 ? next : now + 1;
+		timeout.tv_nsec = 0;
+		(void) pthread_cond_timedwait(&nlm_async_resp_cond,
+					      &nlm_async_resp_mutex,
+					      &timeout);
+
+		now = time(NULL);
+		next = nlm_async_wait_expire(now, &expired);
+	}
+
+	host->slc_callback_inflight++;
+
+	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
+
+	glist_for_each_safe(glist, glistn, &expired) {
+		glist_del(glist);
+		nlm_async_wait_free(glist_entry(glist, struct nlm_async_wait,
+						naw_list));
+	}
+
+	return wait;
+}
+
+/**
+ * @brief Start waiting for the reply, or give the slot back
+ *
+ * The wait is only put on the list once the callback has gone out, so
+ * nothing else can expire and free it while the sender still holds it.
+ *
+ * @param[in] wait Wait from nlm_async_wait_reserve
+ * @param[in] sent Whether the callback was sent
+ */
+static void nlm_async_wait_commit(struct nlm_async_wait *wait, bool sent)
+{
+	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
+
+	if (sent) {
+		wait->naw_expire = time(NULL) + NLM_ASYNC_RESP_TIMEOUT;
+		glist_add_tail(&nlm_async_waits, &wait->naw_list);
+	} else {
+		wait->naw_host->slc_callback_inflight--;
+		pthread_cond_broadcast(&nlm_async_resp_cond);
+	}
+
+	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
+
+	if (!sent)
+		nlm_async_wait_free(wait);
+}
 
 /* Client routine  to send the asynchrnous response,
- * key is used to wait for a response
+ * key is used to match the response.
+ *
+ * The callback client is cached on the host and shared by every callback
+ * to that host; the per-host mutex serializes its use so callbacks to
+ * different hosts do not contend.  Sending never waits for the reply
+ * unless the host already has NLM_ASYNC_WINDOW callbacks outstanding.
  */
 int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 {
 	struct timeval tout = { 0, 10 };
-	int retval, retry;
-	struct timeval start, now;
-	struct timespec timeout;
+	struct nlm_async_wait *wait = NULL;
+	int retval = -1, retry;
+
+	if (key != NULL)
+		wait = nlm_async_wait_reserve(host, key);
+
+	PTHREAD_MUTEX_lock(&host->slc_callback_mutex);
 
 	for (retry = 0; retry < MAX_ASYNC_RETRY; retry++) {
 		if (host->slc_callback_clnt == NULL) {
@@ -142,7 +303,7 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 
 				fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
 				if (fd < 0)
-					return -1;
+					goto out;
 
 				memcpy(&server_addr,
 				       &(host->slc_server_addr),
@@ -154,7 +315,7 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 					  sizeof(server_addr)) == -1) {
 					LogMajor(COMPONENT_NLM, "Cannot bind");
 					close(fd);
-					return -1;
+					goto out;
 				}
 
 				buf = rpcb_find_mapped_addr(
@@ -173,7 +334,7 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 						 host->slc_nsm_client->
 						 ssc_nlm_caller_name);
 					close(fd);
-					return -1;
+					goto out;
 				}
 
 				memset(&hints, 0, sizeof(struct addrinfo));
@@ -218,7 +379,7 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 						 host->slc_nsm_client->
 						 ssc_nlm_caller_name,
 						 gai_strerror(retval));
-					return -1;
+					goto out;
 				}
 
 				/* setup the netbuf with in6 address */
@@ -247,17 +408,13 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 							  slc_client_type),
 					 host->slc_nsm_client->
 					 ssc_nlm_caller_name);
-				return -1;
+				goto out;
 			}
 
 			/* split auth (for authnone, idempotent) */
 			host->slc_callback_auth = authnone_create();
 		}
 
-		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-		resp_key = key;
-		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
-
 		LogFullDebug(COMPONENT_NLM, "About to make clnt_call");
 
 		retval = clnt_call(host->slc_callback_clnt,
@@ -281,62 +438,50 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 			proc, retval,
 			clnt_sperror(host->slc_callback_clnt, ""));
 
+		AUTH_DESTROY(host->slc_callback_auth);
+		host->slc_callback_auth = NULL;
 		gsh_clnt_destroy(host->slc_callback_clnt);
 		host->slc_callback_clnt = NULL;
 	}
 
-	if (retry == MAX_ASYNC_RETRY) {
+	if (retry == MAX_ASYNC_RETRY)
 		LogMajor(COMPONENT_NLM,
 			 "NLM async Client exceeded retry count %d",
 			 MAX_ASYNC_RETRY);
-		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-		resp_key = NULL;
-		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
-		return retval;
-	}
 
-	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
+out:
+	PTHREAD_MUTEX_unlock(&host->slc_callback_mutex);
 
-	if (resp_key != NULL) {
-		/* Wait for 5 seconds or a signal */
-		gettimeofday(&start, NULL);
-		gettimeofday(&now, NULL);
-		timeout.tv_sec = 5 + start.tv_sec;
-		timeout.tv_nsec = 0;
-
-		LogFullDebug(COMPONENT_NLM,
-			     "About to wait for signal for key %p", resp_key);
-
-		while (resp_key != NULL && now.tv_sec < (start.tv_sec + 5)) {
-			int rc;
-
-			rc = pthread_cond_timedwait(&nlm_async_resp_cond,
-						    &nlm_async_resp_mutex,
-						    &timeout);
-			LogFullDebug(COMPONENT_NLM,
-				     "pthread_cond_timedwait returned %d",
-				     rc);
-			gettimeofday(&now, NULL);
-		}
-		LogFullDebug(COMPONENT_NLM, "Done waiting");
-	}
-
-	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
+	if (wait != NULL)
+		nlm_async_wait_commit(wait, retval == RPC_SUCCESS);
 
 	return retval;
 }
 
 void nlm_signal_async_resp(void *key)
 {
+	struct glist_head *glist;
+	struct nlm_async_wait *wait = NULL;
+
 	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
 
-	if (resp_key == key) {
-		resp_key = NULL;
-		pthread_cond_signal(&nlm_async_resp_cond);
-		LogFullDebug(COMPONENT_NLM, "Signaled condition variable");
+	glist_for_each(glist, &nlm_async_waits) {
+		wait = glist_entry(glist, struct nlm_async_wait, naw_list);
+		if (wait->naw_key == key)
+			break;
+		wait = NULL;
+	}
+
+	if (wait != NULL) {
+		nlm_async_wait_remove(wait);
+		LogFullDebug(COMPONENT_NLM, "Signaled key %p", key);
 	} else {
-		LogFullDebug(COMPONENT_NLM, "Didn't signal condition variable");
+		LogFullDebug(COMPONENT_NLM, "No callback waiting on key %p",
+			     key);
 	}
 
 	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
+
+	if (wait != NULL)
+		nlm_async_wait_free(wait);
 }
@@ -29,6 +29,8 @@
 #include "gsh_rpc.h"
 #include "nsm.h"
 #include "sal_data.h"
+#include "sal_functions.h"
+#include "fridgethr.h"
 
 pthread_mutex_t nsm_mutex = PTHREAD_MUTEX_INITIALIZER;
 CLIENT *nsm_clnt;
@@ -78,40 +80,54 @@ void nsm_disconnect(void)
 	}
 }
 
-bool nsm_monitor(state_nsm_client_t *host)
+/**
+ * @brief A queued SM_MON or SM_UNMON
+ *
+ * Monitor requests hold a reference on the host until they are sent.
+ * Unmonitor requests are queued as the host is being freed, so they
+ * carry their own copy of the name.
+ */
+struct nsm_async_req {
+	struct glist_head nar_list;	/*< On nsm_async_queue */
+	bool nar_monitor;		/*< SM_MON rather than SM_UNMON */
+	state_nsm_client_t *nar_host;	/*< Host to monitor */
+	char *nar_name;			/*< Name to unmonitor */
+};
+
+static pthread_mutex_t nsm_async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head nsm_async_queue = GLIST_HEAD_INIT(nsm_async_queue);
+static bool nsm_async_scheduled;
+static struct fridgethr *nsm_async_fridge;
+
+/**
+ * @brief Send SM_MON for a host
+ *
+ * Must be called with nsm_mutex held.
+ *
+ * @param[in] name Host to monitor
+ *
+ * @return true if statd is now monitoring the host.
+ */
+static bool nsm_send_mon(char *name)
 {
 	enum clnt_stat ret;
 	struct mon nsm_mon;
 	struct sm_stat_res res;
 	struct timeval tout = { 25, 0 };
 
-	if (host == NULL)
-		return true;
-
-	PTHREAD_MUTEX_lock(&host->ssc_mutex);
-
-	if (atomic_fetch_int32_t(&host->ssc_monitored)) {
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
-		return true;
-	}
-
 	memset(&nsm_mon, 0, sizeof(nsm_mon));
-	nsm_mon.mon_id.mon_name = host->ssc_nlm_caller_name;
+	nsm_mon.mon_id.mon_name = name;
 	nsm_mon.mon_id.my_id.my_prog = NLMPROG;
 	nsm_mon.mon_id.my_id.my_vers = NLM4_VERS;
 	nsm_mon.mon_id.my_id.my_proc = NLMPROC4_SM_NOTIFY;
 	/* nothing to put in the private data */
-	LogDebug(COMPONENT_NLM, "Monitor %s", host->ssc_nlm_caller_name);
-
-	PTHREAD_MUTEX_lock(&nsm_mutex);
+	LogDebug(COMPONENT_NLM, "Monitor %s", name);
 
 	/* create a connection to nsm on the localhost */
 	if (!nsm_connect()) {
 		LogCrit(COMPONENT_NLM,
 			"Can not monitor %s clnt_create returned NULL",
-			nsm_mon.mon_id.mon_name);
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+			name);
 		return false;
 	}
 
@@ -130,70 +146,55 @@ bool nsm_monitor(state_nsm_client_t *host)
 	if (ret != RPC_SUCCESS) {
 		LogCrit(COMPONENT_NLM,
 			"Can not monitor %s SM_MON ret %d %s",
-			nsm_mon.mon_id.mon_name,
-			ret,
-			clnt_sperror(nsm_clnt, ""));
+			name, ret, clnt_sperror(nsm_clnt, ""));
 
 		nsm_disconnect();
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return false;
 	}
 
 	if (res.res_stat != STAT_SUCC) {
 		LogCrit(COMPONENT_NLM,
 			"Can not monitor %s SM_MON status %d",
-			nsm_mon.mon_id.mon_name, res.res_stat);
+			name, res.res_stat);
 
 		nsm_disconnect();
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return false;
 	}
 
 	nsm_count++;
-	atomic_store_int32_t(&host->ssc_monitored, true);
 
 	LogDebug(COMPONENT_NLM,
-		 "Monitored %s for nodename %s",
-		 nsm_mon.mon_id.mon_name, nodename);
+		 "Monitored %s for nodename %s", name, nodename);
 
-	PTHREAD_MUTEX_unlock(&nsm_mutex);
-	PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 	return true;
 }
 
-bool nsm_unmonitor(state_nsm_client_t *host)
+/**
+ * @brief Send SM_UNMON for a host
+ *
+ * Must be called with nsm_mutex held.
+ *
+ * @param[in] name Host to unmonitor
+ *
+ * @return true if statd has stopped monitoring the host.
+ */
+static bool nsm_send_unmon(char *name)
 {
 	enum clnt_stat ret;
 	struct sm_stat res;
 	struct mon_id nsm_mon_id;
 	struct timeval tout = { 25, 0 };
 
-	if (host == NULL)
-		return true;
-
-	PTHREAD_MUTEX_lock(&host->ssc_mutex);
-
-	if (!atomic_fetch_int32_t(&host->ssc_monitored)) {
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
-		return true;
-	}
-
-	nsm_mon_id.mon_name = host->ssc_nlm_caller_name;
+	nsm_mon_id.mon_name = name;
 	nsm_mon_id.my_id.my_prog = NLMPROG;
 	nsm_mon_id.my_id.my_vers = NLM4_VERS;
 	nsm_mon_id.my_id.my_proc = NLMPROC4_SM_NOTIFY;
 
-	PTHREAD_MUTEX_lock(&nsm_mutex);
-
 	/* create a connection to nsm on the localhost */
 	if (!nsm_connect()) {
 		LogCrit(COMPONENT_NLM,
 			"Can not unmonitor %s clnt_create returned NULL",
-			nsm_mon_id.mon_name);
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+			name);
 		return false;
 	}
 
@@ -212,26 +213,266 @@ bool nsm_unmonitor(state_nsm_client_t *host)
 	if (ret != RPC_SUCCESS) {
 		LogCrit(COMPONENT_NLM,
 			"Can not unmonitor %s SM_MON ret %d %s",
-			nsm_mon_id.mon_name,
-			ret,
-			clnt_sperror(nsm_clnt, ""));
+			name, ret, clnt_sperror(nsm_clnt, ""));
 
 		nsm_disconnect();
-		PTHREAD_MUTEX_unlock(&nsm_mutex);
-		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
 		return false;
 	}
 
-	atomic_store_int32_t(&host->ssc_monitored, false);
 	nsm_count--;
 
 	LogDebug(COMPONENT_NLM, "Unonitored %s for nodename %s",
-		 nsm_mon_id.mon_name, nodename);
+		 name, nodename);
 
-	nsm_disconnect();
+	return true;
+}
+
+/**
+ * @brief Send a batch of queued requests
+ *
+ * The whole batch shares one acquisition of nsm_mutex and one statd
+ * connection.
+ *
+ * @param[in] batch Requests to send, emptied on return
+ */
+static void nsm_async_send(struct glist_head *batch)
+{
+	struct glist_head *glist, *glistn;
+	struct nsm_async_req *req;
+	bool ok;
+
+	PTHREAD_MUTEX_lock(&nsm_mutex);
 
+	glist_for_each(glist, batch) {
+		req = glist_entry(glist, struct nsm_async_req, nar_list);
+
+		if (!req->nar_monitor) {
+			(void) nsm_send_unmon(req->nar_name);
+			continue;
+		}
+
+		ok = nsm_send_mon(req->nar_host->ssc_nlm_caller_name);
+
+		PTHREAD_MUTEX_lock(&req->nar_host->ssc_mutex);
+		atomic_store_int32_t(&req->nar_host->ssc_monitored, ok);
+		req->nar_host->ssc_mon_pending = false;
+		PTHREAD_MUTEX_unlock(&req->nar_host->ssc_mutex);
+	}
+
+	nsm_disconnect();
 	PTHREAD_MUTEX_unlock(&nsm_mutex);
+
+	/* Dropping the host reference may queue an unmonitor, so do it
+	 * with no locks held.
+	 */
+	glist_for_each_safe(glist, glistn, batch) {
+		req = glist_entry(glist, struct nsm_async_req, nar_list);
+		glist_del(&req->nar_list);
+
+		if (req->nar_monitor)
+			dec_nsm_client_ref(req->nar_host);
+		else
+			gsh_free(req->nar_name);
+
+		gsh_free(req);
+	}
+}
+
+/**
+ * @brief Drain the NSM request queue
+ *
+ * @param[in] ctx Thread context
+ */
+static void nsm_async_worker(struct fridgethr_context *ctx)
+{
+	struct glist_head batch = GLIST_HEAD_INIT(batch);
+
+	while (true) {
+		PTHREAD_MUTEX_lock(&nsm_async_mutex);
+
+		if (glist_empty(&nsm_async_queue)) {
+			nsm_async_scheduled = false;
+			PTHREAD_MUTEX_unlock(&nsm_async_mutex);
+			return;
+		}
+
+		glist_splice_tail(&batch, &nsm_async_queue);
+		PTHREAD_MUTEX_unlock(&nsm_async_mutex);
+
+		nsm_async_send(&batch);
+	}
+}
+
+/**
+ * @brief Queue a request for the NSM worker
+ *
+ * If the worker is not running the request is sent inline.
+ *
+ * @param[in] req Request to queue
+ */
+static void nsm_async_queue_req(struct nsm_async_req *req)
+{
+	struct glist_head batch = GLIST_HEAD_INIT(batch);
+	int rc = 0;
+
+	PTHREAD_MUTEX_lock(&nsm_async_mutex);
+
+	if (nsm_async_fridge != NULL) {
+		glist_add_tail(&nsm_async_queue, &req->nar_list);
+
+		if (!nsm_async_scheduled) {
+			rc = fridgethr_submit(nsm_async_fridge,
+					      nsm_async_worker, NULL);
+			if (rc == 0)
+				nsm_async_scheduled = true;
+			else
+				glist_del(&req->nar_list);
+		}
+
+		if (rc == 0) {
+			PTHREAD_MUTEX_unlock(&nsm_async_mutex);
+			return;
+		}
+
+		LogCrit(COMPONENT_NLM,
+			"Unable to schedule NSM request: %d", rc);
+	}
+
+	PTHREAD_MUTEX_unlock(&nsm_async_mutex);
+
+	glist_add_tail(&batch, &req->nar_list);
+	nsm_async_send(&batch);
+}
+
+/**
+ * @brief Start the NSM worker
+ *
+ * Until this is called, and after nsm_async_shutdown, requests are sent
+ * synchronously.
+ */
+void nsm_async_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(frp));
+	frp.thr_max = 1;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&nsm_async_fridge, "NSM_Async", &frp);
+
+	if (rc != 0) {
+		LogMajor(COMPONENT_NLM,
+			 "Unable to initialize NSM async thread fridge: %d",
+			 rc);
+		nsm_async_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Flush queued requests and stop the NSM worker
+ */
+void nsm_async_shutdown(void)
+{
+	struct fridgethr *fr;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&nsm_async_mutex);
+	fr = nsm_async_fridge;
+	nsm_async_fridge = NULL;
+	PTHREAD_MUTEX_unlock(&nsm_async_mutex);
+
+	if (fr == NULL)
+		return;
+
+	rc = fridgethr_sync_command(fr, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_NLM,
+			 "Shutdown timed out, cancelling NSM thread.");
+		fridgethr_cancel(fr);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_NLM,
+			 "Failed shutting down NSM thread: %d", rc);
+	}
+}
+
+/**
+ * @brief Arrange for statd to monitor a host
+ *
+ * The SM_MON is queued and the caller proceeds optimistically; a host
+ * that is already monitored, or has a monitor queued, costs nothing.
+ * If statd refuses, the next lock from the host queues another attempt.
+ *
+ * @param[in] host Host to monitor
+ *
+ * @return true unless the request could not be sent.
+ */
+bool nsm_monitor(state_nsm_client_t *host)
+{
+	struct nsm_async_req *req;
+
+	if (host == NULL)
+		return true;
+
+	PTHREAD_MUTEX_lock(&host->ssc_mutex);
+
+	if (atomic_fetch_int32_t(&host->ssc_monitored) ||
+	    host->ssc_mon_pending) {
+		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+		return true;
+	}
+
+	host->ssc_mon_pending = true;
+
 	PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+
+	req = gsh_malloc(sizeof(*req));
+	req->nar_monitor = true;
+	req->nar_host = host;
+	req->nar_name = NULL;
+	inc_nsm_client_ref(host);
+
+	nsm_async_queue_req(req);
+
+	return true;
+}
+
+/**
+ * @brief Arrange for statd to stop monitoring a host
+ *
+ * Called as the host is freed; a queued monitor holds a reference, so
+ * one can not be pending here.
+ *
+ * @param[in] host Host to unmonitor
+ *
+ * @return true.
+ */
+bool nsm_unmonitor(state_nsm_client_t *host)
+{
+	struct nsm_async_req *req;
+
+	if (host == NULL)
+		return true;
+
+	PTHREAD_MUTEX_lock(&host->ssc_mutex);
+
+	if (!atomic_fetch_int32_t(&host->ssc_monitored)) {
+		PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+		return true;
+	}
+
+	atomic_store_int32_t(&host->ssc_monitored, false);
+
+	PTHREAD_MUTEX_unlock(&host->ssc_mutex);
+
+	req = gsh_malloc(sizeof(*req));
+	req->nar_monitor = false;
+	req->nar_host = NULL;
+	req->nar_name = gsh_strdup(host->ssc_nlm_caller_name);
+
+	nsm_async_queue_req(req);
+
 	return true;
 }
 
@@ -0,0 +1,183 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/**
+ * @file rquota_cache.c
+ * @brief Recent GETQUOTA results
+ *
+ * Clients ask for their quota at every login and df, and asking the
+ * FSAL may cost an ioctl or a round trip to the cluster.  Answers,
+ * including "no quota", are kept RQUOTA_Cache_Expiration seconds in a
+ * direct-mapped table, a newer answer taking the slot of an older one.
+ * SETQUOTA and the quota_changed upcall drop the answers they make
+ * stale.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "rquota.h"
+#include "nfs_proto_functions.h"
+#include "city.h"
+
+/** Slots in the table, a power of two */
+#define RQUOTA_CACHE_SIZE 4096
+
+struct rquota_cache_entry {
+	uint64_t hash;		/*< of the path, seeded with the rest */
+	time_t expires;		/*< 0 when the slot is empty */
+	uint16_t export_id;
+	int quota_type;
+	int quota_id;
+	int status;		/*< Q_OK or Q_NOQUOTA */
+	fsal_quota_t quota;
+};
+
+static struct rquota_cache_entry rquota_cache[RQUOTA_CACHE_SIZE];
+static pthread_rwlock_t rquota_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static uint64_t rquota_cache_hash(uint16_t export_id, const char *path,
+				  int quota_type, int quota_id)
+{
+	uint64_t seed = ((uint64_t) export_id << 48) ^
+			((uint64_t) quota_type << 32) ^ (uint32_t) quota_id;
+
+	return CityHash64WithSeed(path, strlen(path), seed);
+}
+
+/**
+ * @brief Look up a recent answer
+ *
+ * @param[in]  export_id  Export the path was found in
+ * @param[in]  path       Path the FSAL would be asked about
+ * @param[in]  quota_type USRQUOTA or GRPQUOTA
+ * @param[in]  quota_id   User or group
+ * @param[out] status     Q_OK or Q_NOQUOTA
+ * @param[out] quota      The quota, when Q_OK
+ *
+ * @return true if found and not expired.
+ */
+bool rquota_cache_get(uint16_t export_id, const char *path, int quota_type,
+		      int quota_id, int *status, fsal_quota_t *quota)
+{
+	uint64_t hash;
+	struct rquota_cache_entry *entry;
+	bool found;
+
+	if (nfs_param.core_param.rquota_cache_expiration == 0)
+		return false;
+
+	hash = rquota_cache_hash(export_id, path, quota_type, quota_id);
+	entry = &rquota_cache[hash & (RQUOTA_CACHE_SIZE - 1)];
+
+	PTHREAD_RWLOCK_rdlock(&rquota_cache_lock);
+
+	found = entry->expires > time(NULL) && entry->hash == hash &&
+		entry->export_id == export_id &&
+		entry->quota_type == quota_type &&
+		entry->quota_id == quota_id;
+
+	if (found) {
+		*status = entry->status;
+		*quota = entry->quota;
+	}
+
+	PTHREAD_RWLOCK_unlock(&rquota_cache_lock);
+
+	return found;
+}
+
+/**
+ * @brief Remember an answer of the FSAL
+ *
+ * @param[in] export_id  Export the path was found in
+ * @param[in] path       Path the FSAL was asked about
+ * @param[in] quota_type USRQUOTA or GRPQUOTA
+ * @param[in] quota_id   User or group
+ * @param[in] status     Q_OK or Q_NOQUOTA
+ * @param[in] quota      The quota, when Q_OK
+ */
+void rquota_cache_put(uint16_t export_id, const char *path, int quota_type,
+		      int quota_id, int status, const fsal_quota_t *quota)
+{
+	uint32_t expiration = nfs_param.core_param.rquota_cache_expiration;
+	uint64_t hash;
+	struct rquota_cache_entry *entry;
+
+	if (expiration == 0)
+		return;
+
+	hash = rquota_cache_hash(export_id, path, quota_type, quota_id);
+	entry = &rquota_cache[hash & (RQUOTA_CACHE_SIZE - 1)];
+
+	PTHREAD_RWLOCK_wrlock(&rquota_cache_lock);
+
+	entry->hash = hash;
+	entry->export_id = export_id;
+	entry->quota_type = quota_type;
+	entry->quota_id = quota_id;
+	entry->status = status;
+	if (status == Q_OK)
+		entry->quota = *quota;
+	else
+		memset(&entry->quota, 0, sizeof(entry->quota));
+	entry->expires = time(NULL) + expiration;
+
+	PTHREAD_RWLOCK_unlock(&rquota_cache_lock);
+}
+
+/**
+ * @brief Drop the answers about a user or group on an export
+ *
+ * The path is not known here, so the whole table is looked at, which
+ * is cheap next to the quota changes that call for it.
+ *
+ * @param[in] export_id  The export
+ * @param[in] quota_type USRQUOTA or GRPQUOTA
+ * @param[in] quota_id   User or group, -1 for all of them
+ */
+void rquota_cache_invalidate(uint16_t export_id, int quota_type,
+			     int quota_id)
+{
+	struct rquota_cache_entry *entry;
+	int i;
+
+	if (nfs_param.core_param.rquota_cache_expiration == 0)
+		return;
+
+	LogFullDebug(COMPONENT_NFSPROTO,
+		     "Dropping quotas of type %d id %d on export %" PRIu16,
+		     quota_type, quota_id, export_id);
+
+	PTHREAD_RWLOCK_wrlock(&rquota_cache_lock);
+
+	for (i = 0; i < RQUOTA_CACHE_SIZE; i++) {
+		entry = &rquota_cache[i];
+
+		if (entry->expires != 0 && entry->export_id == export_id &&
+		    entry->quota_type == quota_type &&
+		    (quota_id == -1 || entry->quota_id == quota_id))
+			entry->expires = 0;
+	}
+
+	PTHREAD_RWLOCK_unlock(&rquota_cache_lock);
+}
@@ -57,6 +57,7 @@ int rquota_getquota(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	getquota_rslt *qres = &res->res_rquota_getquota;
 	char path[MAXPATHLEN];
 	int quota_id;
+	int status;
 
 	LogFullDebug(COMPONENT_NFSPROTO,
 		     "REQUEST PROCESSING: Calling rquota_getquota");
@@ -110,16 +111,33 @@ int rquota_getquota(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		goto out;
 	}
 
+	if (rquota_cache_get(exp->export_id, quota_path, quota_type,
+			     quota_id, &status, &fsal_quota)) {
+		if (status != Q_OK) {
+			qres->status = status;
+			goto out;
+		}
+		goto found;
+	}
+
 	fsal_status =
 	    exp->fsal_export->exp_ops.get_quota(exp->fsal_export,
 					     quota_path, quota_type,
 					     quota_id, &fsal_quota);
 	if (FSAL_IS_ERROR(fsal_status)) {
-		if (fsal_status.major == ERR_FSAL_NO_QUOTA)
+		if (fsal_status.major == ERR_FSAL_NO_QUOTA) {
 			qres->status = Q_NOQUOTA;
+			rquota_cache_put(exp->export_id, quota_path,
+					 quota_type, quota_id, Q_NOQUOTA,
+					 NULL);
+		}
 		goto out;
 	}
 
+	rquota_cache_put(exp->export_id, quota_path, quota_type, quota_id,
+			 Q_OK, &fsal_quota);
+
+ found:
 	/* success */
 
 	qres->getquota_rslt_u.gqr_rquota.rq_active = TRUE;
@@ -150,6 +150,10 @@ static int do_rquota_setquota(char *quota_path, int quota_type,
 						       quota_id,
 						       &fsal_quota_in,
 						       &fsal_quota_out);
+
+	/* Whatever happened, what was cached may be wrong now */
+	rquota_cache_invalidate(exp->export_id, quota_type, quota_id);
+
 	if (FSAL_IS_ERROR(fsal_status)) {
 		if (fsal_status.major == ERR_FSAL_NO_QUOTA)
 			qres->status = Q_NOQUOTA;
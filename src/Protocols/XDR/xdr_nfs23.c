@@ -10,7 +10,8 @@
 static struct nfs_request_lookahead dummy_lookahead = {
 	.flags = 0,
 	.read = 0,
-	.write = 0
+	.write = 0,
+	.io_bytes = 0
 };
 
 bool xdr_nfspath2(xdrs, objp)
@@ -1244,6 +1245,7 @@ READ3args *objp;
 		return (false);
 	lkhd->flags = NFS_LOOKAHEAD_READ;
 	(lkhd->read)++;
+	lkhd->io_bytes += objp->count;
 	return (true);
 }
 
@@ -1264,6 +1266,11 @@ READ3resok *objp;
 		return (false);
 	if (!xdr_bool(xdrs, &objp->eof))
 		return (false);
+	if (xdrs->x_op == XDR_ENCODE && objp->data_iov != NULL)
+		return xdr_opaque_iov(xdrs, objp->data_iov, objp->data_iovcnt,
+				      objp->data.data_len);
+	if (xdrs->x_op == XDR_ENCODE && objp->data_fd != NULL)
+		return xdr_opaque_fd(xdrs, objp->data_fd, objp->data.data_len);
 	if (!xdr_bytes
 	    (xdrs, (char **)&objp->data.data_val,
 	     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
@@ -1350,12 +1357,18 @@ WRITE3args *objp;
 		return (false);
 	if (!xdr_stable_how(xdrs, &objp->stable))
 		return (false);
+	/* The data must be copied out: requests are decoded by the
+	 * dispatcher and queued for a worker, and the transport's receive
+	 * stream is reused for the next record as soon as this one is
+	 * queued, so it cannot be referenced until the write is done.
+	 */
 	if (!xdr_bytes
 	    (xdrs, (char **)&objp->data.data_val,
 	     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
 		return (false);
 	lkhd->flags |= NFS_LOOKAHEAD_WRITE;
 	(lkhd->write)++;
+	lkhd->io_bytes += objp->data.data_len;
 	return (true);
 }
 
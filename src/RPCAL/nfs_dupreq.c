@@ -45,13 +45,20 @@
 #include "nfs_proto_functions.h"
 
 #include "nfs_dupreq.h"
-#include "city.h"
+#include "gsh_crc32c.h"
 #include "abstract_mem.h"
 #include "gsh_intrinsic.h"
 #include "wait_queue.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#include "nfs_metrics.h"
+#include "gsh_mem_pressure.h"
+#endif
 
 #define DUPREQ_BAD_ADDR1 0x01	/* safe for marked pointers, etc */
 #define DUPREQ_NOCACHE   0x02
+#define DUPREQ_SESSION   0x03	/* v4.1+, result in nfs_request_t */
 #define DUPREQ_MAX_RETRIES 5
 
 #define NFS_pcp nfs_param.core_param
@@ -104,6 +111,12 @@ const char *dupreq_state_table[] = {
  * the current implementation. If we let nfs_dupreq_get_drc() reuse the
  * drc before it gets into recycle queue, we could end up with multiple
  * threads that decrement the ref count to zero.
+ *
+ * Requests themselves never take drc->mtx.  Each partition of a DRC's
+ * dictionary has its own retire queue under the partition lock, the
+ * size, retire window and ref count are atomics, and a request is
+ * retired from the queue of the partition it completed in.  Only
+ * dropping the last ref on a TCP DRC, and recycling it, lock the DRC.
  */
 struct drc_st {
 	pthread_mutex_t mtx;
@@ -117,6 +130,16 @@ struct drc_st {
 
 static struct drc_st *drc_st;
 
+/**
+ * @brief NFSv4.1+ compounds that bypassed the DRC, and the bytes of
+ *        result objects they did not allocate
+ */
+static uint64_t drc_session_calls;
+static uint64_t drc_session_bytes;
+
+/** @brief Requests held by all the TCP DRCs together, atomic */
+static uint32_t drc_tcp_entries;
+
 /**
  * @brief Comparison function for duplicate request entries.
  *
@@ -270,18 +293,22 @@ static inline void init_shared_drc(void)
 	assert(!code);
 
 	/* completed requests */
-	TAILQ_INIT(&drc->dupreq_q);
+	drc->part = gsh_calloc(drc->npart, sizeof(struct drc_part));
 
 	/* init closed-form "cache" partition */
 	for (ix = 0; ix < drc->npart; ++ix) {
 		struct rbtree_x_part *xp = &(drc->xt.tree[ix]);
 
+		TAILQ_INIT(&drc->part[ix].dupreq_q);
+
 		drc->xt.cachesz = drc->cachesz;
 		xp->cache =
 		    gsh_calloc(drc->cachesz, sizeof(struct opr_rbtree_node *));
 	}
 }
 
+static void drc_shrink(uint32_t percent);
+
 /**
  * @brief Initialize the DRC package.
  */
@@ -290,9 +317,9 @@ void dupreq2_pkginit(void)
 	int code __attribute__ ((unused)) = 0;
 
 	dupreq_pool =
-	    pool_basic_init("Duplicate Request Pool", sizeof(dupreq_entry_t));
+	    pool_magazine_init("Duplicate Request Pool", sizeof(dupreq_entry_t));
 
-	nfs_res_pool = pool_basic_init("nfs_res_t pool", sizeof(nfs_res_t));
+	nfs_res_pool = pool_magazine_init("nfs_res_t pool", sizeof(nfs_res_t));
 
 	tcp_drc_pool = pool_basic_init("TCP DRC Pool", sizeof(drc_t));
 
@@ -316,6 +343,8 @@ void dupreq2_pkginit(void)
 
 	/* UDP DRC is global, shared */
 	init_shared_drc();
+
+	mem_pressure_register("drc", drc_shrink);
 }
 
 /**
@@ -376,6 +405,10 @@ static inline drc_t *alloc_tcp_drc(enum drc_type dtype)
 	drc->refcnt = 0;
 	drc->retwnd = 0;
 	drc->d_u.tcp.recycle_time = 0;
+	drc->d_u.tcp.inflight = 0;
+	drc->d_u.tcp.peak = 0;
+	drc->d_u.tcp.finished = 0;
+	drc->d_u.tcp.hits = 0;
 	drc->maxsize = nfs_param.core_param.drc.tcp.size;
 	drc->cachesz = nfs_param.core_param.drc.tcp.cachesz;
 	drc->npart = nfs_param.core_param.drc.tcp.npart;
@@ -390,7 +423,7 @@ static inline drc_t *alloc_tcp_drc(enum drc_type dtype)
 	assert(!code);
 
 	/* completed requests */
-	TAILQ_INIT(&drc->dupreq_q);
+	drc->part = gsh_calloc(drc->npart, sizeof(struct drc_part));
 
 	/* recycling DRC */
 	TAILQ_INIT_ENTRY(drc, d_u.tcp.recycle_q);
@@ -399,6 +432,8 @@ static inline drc_t *alloc_tcp_drc(enum drc_type dtype)
 	for (ix = 0; ix < drc->npart; ++ix) {
 		struct rbtree_x_part *xp = &(drc->xt.tree[ix]);
 
+		TAILQ_INIT(&drc->part[ix].dupreq_q);
+
 		drc->xt.cachesz = drc->cachesz;
 		xp->cache =
 		    gsh_calloc(drc->cachesz, sizeof(struct opr_rbtree_node *));
@@ -422,6 +457,7 @@ static inline void free_tcp_drc(drc_t *drc)
 		if (drc->xt.tree[ix].cache)
 			gsh_free(drc->xt.tree[ix].cache);
 	}
+	gsh_free(drc->part);
 	PTHREAD_MUTEX_destroy(&drc->mtx);
 	LogFullDebug(COMPONENT_DUPREQ, "free TCP drc %p", drc);
 	pool_free(tcp_drc_pool, drc);
@@ -436,7 +472,7 @@ static inline void free_tcp_drc(drc_t *drc)
  */
 static inline uint32_t nfs_dupreq_ref_drc(drc_t *drc)
 {
-	return ++(drc->refcnt); /* locked */
+	return atomic_inc_uint32_t(&drc->refcnt);
 }
 
 /**
@@ -448,7 +484,21 @@ static inline uint32_t nfs_dupreq_ref_drc(drc_t *drc)
  */
 static inline uint32_t nfs_dupreq_unref_drc(drc_t *drc)
 {
-	return --(drc->refcnt); /* locked */
+	return atomic_dec_uint32_t(&drc->refcnt);
+}
+
+/**
+ * @brief Find the retire queue matching a dictionary partition
+ *
+ * @param[in] drc  The DRC
+ * @param[in] t    A partition of drc->xt
+ *
+ * @return The retire queue of that partition.
+ */
+static inline struct drc_part *drc_part_of(drc_t *drc,
+					   struct rbtree_x_part *t)
+{
+	return &drc->part[t - drc->xt.tree];
 }
 
 #define DRC_ST_LOCK()				\
@@ -457,6 +507,42 @@ static inline uint32_t nfs_dupreq_unref_drc(drc_t *drc)
 #define DRC_ST_UNLOCK()				\
 	PTHREAD_MUTEX_unlock(&drc_st->mtx)
 
+/**
+ * @brief Take a DRC off the recycle queue, freeing it if unreferenced
+ *
+ * Called with drc_st->mtx held.
+ *
+ * @param[in] drc  The DRC, at the head of the recycle queue
+ */
+static void drc_retire_recycled(drc_t *drc)
+{
+	struct rbtree_x_part *t;
+	struct opr_rbtree_node *odrc = NULL;
+
+	t = rbtx_partition_of_scalar(&drc_st->tcp_drc_recycle_t,
+				     drc->d_u.tcp.hk);
+
+	odrc = opr_rbtree_lookup(&t->t, &drc->d_u.tcp.recycle_k);
+	if (!odrc) {
+		LogCrit(COMPONENT_DUPREQ,
+			"BUG: asked to dequeue DRC not on queue");
+	} else {
+		(void)opr_rbtree_remove(&t->t, &drc->d_u.tcp.recycle_k);
+	}
+	TAILQ_REMOVE(&drc_st->tcp_drc_recycle_q, drc, d_u.tcp.recycle_q);
+	--(drc_st->tcp_drc_recycle_qlen);
+	/* expect DRC to be reachable from some xprt(s) */
+	PTHREAD_MUTEX_lock(&drc->mtx);
+	drc->flags &= ~DRC_FLAG_RECYCLE;
+	/* but if not, dispose it */
+	if (drc->refcnt == 0) {
+		PTHREAD_MUTEX_unlock(&drc->mtx);
+		free_tcp_drc(drc);
+		return;
+	}
+	PTHREAD_MUTEX_unlock(&drc->mtx);
+}
+
 /**
  * @brief Check for expired TCP DRCs.
  */
@@ -464,10 +550,16 @@ static inline void drc_free_expired(void)
 {
 	drc_t *drc;
 	time_t now = time(NULL);
-	struct rbtree_x_part *t;
-	struct opr_rbtree_node *odrc = NULL;
 
-	DRC_ST_LOCK();
+	/* New connections call this, don't make them queue on the
+	 * global lock only to find that nothing is due.
+	 */
+	if ((now - atomic_fetch_time_t(&drc_st->last_expire_check)) < 600 ||
+	    atomic_fetch_int32_t(&drc_st->tcp_drc_recycle_qlen) < 1)
+		return;
+
+	if (pthread_mutex_trylock(&drc_st->mtx) != 0)
+		return;	/* someone else is expiring */
 
 	if ((drc_st->tcp_drc_recycle_qlen < 1) ||
 	    (now - drc_st->last_expire_check) < 600) /* 10m */
@@ -481,37 +573,12 @@ static inline void drc_free_expired(void)
 			LogFullDebug(COMPONENT_DUPREQ,
 				     "remove expired drc %p from recycle queue",
 				     drc);
-			t = rbtx_partition_of_scalar(&drc_st->tcp_drc_recycle_t,
-						     drc->d_u.tcp.hk);
-
-			odrc =
-			    opr_rbtree_lookup(&t->t, &drc->d_u.tcp.recycle_k);
-			if (!odrc) {
-				LogCrit(COMPONENT_DUPREQ,
-					"BUG: asked to dequeue DRC not on queue");
-			} else {
-				(void)opr_rbtree_remove(&t->t,
-							&drc->d_u.tcp.
-							recycle_k);
-			}
-			TAILQ_REMOVE(&drc_st->tcp_drc_recycle_q, drc,
-				     d_u.tcp.recycle_q);
-			--(drc_st->tcp_drc_recycle_qlen);
-			/* expect DRC to be reachable from some xprt(s) */
-			PTHREAD_MUTEX_lock(&drc->mtx);
-			drc->flags &= ~DRC_FLAG_RECYCLE;
-			/* but if not, dispose it */
-			if (drc->refcnt == 0) {
-				PTHREAD_MUTEX_unlock(&drc->mtx);
-				free_tcp_drc(drc);
-				continue;
-			}
-			PTHREAD_MUTEX_unlock(&drc->mtx);
+			drc_retire_recycled(drc);
 		} else {
 			LogFullDebug(COMPONENT_DUPREQ,
 				     "unexpired drc %p in recycle queue expire check (nothing happens)",
 				     drc);
-			drc_st->last_expire_check = now;
+			atomic_store_time_t(&drc_st->last_expire_check, now);
 			break;
 		}
 
@@ -521,6 +588,56 @@ static inline void drc_free_expired(void)
 	DRC_ST_UNLOCK();
 }
 
+/**
+ * @brief Shrink the TCP DRC recycle queue under memory pressure
+ *
+ * Frees the oldest recycled DRCs whether or not they have expired.
+ *
+ * @param[in] percent Share of the recycle queue to free
+ */
+static void drc_shrink(uint32_t percent)
+{
+	drc_t *drc;
+	int32_t count;
+	int32_t freed = 0;
+
+	if (atomic_fetch_int32_t(&drc_st->tcp_drc_recycle_qlen) < 1)
+		return;
+
+	DRC_ST_LOCK();
+
+	count = (drc_st->tcp_drc_recycle_qlen * percent + 99) / 100;
+
+	while (freed < count) {
+		drc = TAILQ_FIRST(&drc_st->tcp_drc_recycle_q);
+		if (drc == NULL || drc->refcnt != 0)
+			break;
+		drc_retire_recycled(drc);
+		++freed;
+	}
+
+	DRC_ST_UNLOCK();
+
+	LogDebug(COMPONENT_DUPREQ,
+		 "Freed %"PRIi32" recycled DRCs for memory pressure", freed);
+}
+
+/**
+ * @brief Apply changed DRC_UDP_Size and DRC_UDP_Hiwat to the shared DRC
+ *
+ * TCP DRCs pick up DRC_TCP_Size and DRC_TCP_Hiwat when they are
+ * allocated or recycled.
+ */
+void drc_update_udp_limits(void)
+{
+	drc_t *drc = &drc_st->udp_drc;
+
+	PTHREAD_MUTEX_lock(&drc->mtx);
+	drc->maxsize = nfs_param.core_param.drc.udp.size;
+	drc->hiwat = nfs_param.core_param.drc.udp.hiwat;
+	PTHREAD_MUTEX_unlock(&drc->mtx);
+}
+
 /**
  * @brief Find and reference a DRC to process the supplied svc_req.
  *
@@ -539,9 +656,7 @@ nfs_dupreq_get_drc(struct svc_req *req)
 	case DRC_UDP_V234:
 		LogFullDebug(COMPONENT_DUPREQ, "ref shared UDP DRC");
 		drc = &(drc_st->udp_drc);
-		DRC_ST_LOCK();
 		(void)nfs_dupreq_ref_drc(drc);
-		DRC_ST_UNLOCK();
 		goto out;
 retry:
 	case DRC_TCP_V4:
@@ -551,10 +666,13 @@ retry:
 		 */
 		drc = (drc_t *)req->rq_xprt->xp_u2;
 		if (drc) {
-			/* found, no danger of removal */
+			/* found, no danger of removal, the xprt holds a
+			 * ref so ours cannot be the one raising it from 0
+			 */
 			LogFullDebug(COMPONENT_DUPREQ, "ref DRC=%p for xprt=%p",
 				     drc, req->rq_xprt);
-			PTHREAD_MUTEX_lock(&drc->mtx);	/* LOCKED */
+			(void)nfs_dupreq_ref_drc(drc);
+			goto out;
 		} else {
 			drc_t drc_k;
 			struct rbtree_x_part *t = NULL;
@@ -571,8 +689,8 @@ retry:
 			(void)copy_xprt_addr(&drc_k.d_u.tcp.addr, req->rq_xprt);
 
 			drc_k.d_u.tcp.hk =
-			    CityHash64WithSeed((char *)&drc_k.d_u.tcp.addr,
-					       sizeof(sockaddr_t), 911);
+			    gsh_crc32c(911, &drc_k.d_u.tcp.addr,
+				       sizeof(sockaddr_t));
 			{
 				char str[SOCK_NAME_MAX];
 
@@ -609,6 +727,16 @@ retry:
 					--(drc_st->tcp_drc_recycle_qlen);
 					tdrc->flags &= ~DRC_FLAG_RECYCLE;
 				}
+				/* Limits may have been changed at runtime,
+				 * an adaptive DRC keeps the size it learnt.
+				 */
+				tdrc->maxsize =
+					nfs_param.core_param.drc.tcp.size;
+				if (!nfs_param.core_param.drc.tcp.adaptive)
+					tdrc->hiwat =
+					    nfs_param.core_param.drc.tcp.hiwat;
+				else if (tdrc->hiwat > tdrc->maxsize)
+					tdrc->hiwat = tdrc->maxsize;
 				drc = tdrc;
 				LogFullDebug(COMPONENT_DUPREQ,
 					     "recycle TCP DRC=%p for xprt=%p",
@@ -681,40 +809,38 @@ out:
  */
 void nfs_dupreq_put_drc(SVCXPRT *xprt, drc_t *drc, uint32_t flags)
 {
-	if (!(flags & DRC_FLAG_LOCKED))
-		PTHREAD_MUTEX_lock(&drc->mtx);
-	/* drc LOCKED */
+	uint32_t refcnt;
 
-	if (drc->refcnt == 0) {
+	if (flags & DRC_FLAG_LOCKED)
+		PTHREAD_MUTEX_unlock(&drc->mtx);
+
+	if (unlikely(atomic_fetch_uint32_t(&drc->refcnt) == 0)) {
 		LogCrit(COMPONENT_DUPREQ,
 			"drc %p refcnt will underrun refcnt=%u", drc,
 			drc->refcnt);
 	}
 
-	nfs_dupreq_unref_drc(drc);
+	refcnt = nfs_dupreq_unref_drc(drc);
 
-	LogFullDebug(COMPONENT_DUPREQ, "drc %p refcnt==%u", drc, drc->refcnt);
+	LogFullDebug(COMPONENT_DUPREQ, "drc %p refcnt==%u", drc, refcnt);
 
 	switch (drc->type) {
 	case DRC_UDP_V234:
 		/* do nothing */
-		break;
+		return;
 	case DRC_TCP_V4:
 	case DRC_TCP_V3:
-		if (drc->refcnt != 0) /* quick path */
-			break;
+		if (refcnt != 0) /* quick path */
+			return;
 
-		/* note t's lock order wrt drc->mtx is the opposite of
-		 * drc->xt[*].lock. Drop and reacquire locks in correct
-		 * order.
+		/* Whoever dropped the last ref queues the DRC for
+		 * recycling, in the DRC_ST then drc->mtx lock order.
 		 */
-		PTHREAD_MUTEX_unlock(&drc->mtx);
 		DRC_ST_LOCK();
 		PTHREAD_MUTEX_lock(&drc->mtx);
 
-		/* Since we dropped and reacquired the drc lock for the
-		 * correct lock order, we need to recheck the drc fields
-		 * again!
+		/* A reconnect may have picked the DRC up meanwhile,
+		 * recheck.
 		 */
 		if (drc->refcnt == 0 && !(drc->flags & DRC_FLAG_RECYCLE)) {
 			drc->d_u.tcp.recycle_time = time(NULL);
@@ -725,14 +851,13 @@ void nfs_dupreq_put_drc(SVCXPRT *xprt, drc_t *drc, uint32_t flags)
 			LogFullDebug(COMPONENT_DUPREQ,
 				     "enqueue drc %p for recycle", drc);
 		}
+		PTHREAD_MUTEX_unlock(&drc->mtx);
 		DRC_ST_UNLOCK();
 		break;
 
 	default:
 		break;
 	};
-
-	PTHREAD_MUTEX_unlock(&drc->mtx); /* !LOCKED */
 }
 
 /**
@@ -899,14 +1024,15 @@ static inline void dupreq_entry_put(dupreq_entry_t *dv)
  *
  * @param[in] drc The duplicate request cache
  */
-#define drc_inc_retwnd(drc)					\
-	do {							\
-		if ((drc)->retwnd == 0)				\
-			(drc)->retwnd = RETWND_START_BIAS;	\
-		else						\
-			if ((drc)->retwnd < (drc)->maxsize)	\
-				(drc)->retwnd += 2;		\
-	} while (0)
+static inline void drc_inc_retwnd(drc_t *drc)
+{
+	int32_t retwnd = atomic_fetch_int32_t(&drc->retwnd);
+
+	if (retwnd <= 0)
+		atomic_store_int32_t(&drc->retwnd, RETWND_START_BIAS);
+	else if ((uint32_t)retwnd < drc->maxsize)
+		(void)atomic_add_int32_t(&drc->retwnd, 2);
+}
 
 /**
  * @brief conditionally decrement retwnd.
@@ -915,11 +1041,109 @@ static inline void dupreq_entry_put(dupreq_entry_t *dv)
  *
  * @param[in] drc The duplicate request cache
  */
-#define drc_dec_retwnd(drc)			\
-	do {					\
-		if ((drc)->retwnd > 0)		\
-			--((drc)->retwnd);	\
-	} while (0)
+static inline void drc_dec_retwnd(drc_t *drc)
+{
+	/* Racing decrements may overshoot below 0, undo ours then */
+	if (atomic_fetch_int32_t(&drc->retwnd) > 0 &&
+	    atomic_dec_int32_t(&drc->retwnd) < 0)
+		(void)atomic_inc_int32_t(&drc->retwnd);
+}
+
+/**
+ * @page DRC_ADAPT Adaptive TCP DRC sizing
+ *
+ * With DRC_TCP_Adaptive, the high water mark of each TCP DRC moves
+ * between DRC_TCP_Min_Hiwat and DRC_TCP_Size instead of staying at
+ * DRC_TCP_Hiwat.  Every DRC_TCP_ADAPT_PERIOD finished requests, it
+ * doubles if the client retransmitted meanwhile and loses a quarter if
+ * not, but stays above twice the most requests the client had
+ * outstanding: a client retransmits after a reconnect all those it had
+ * no reply for.  While the TCP DRCs together hold more than
+ * DRC_TCP_Budget requests, none grows and the quiet ones drop straight
+ * to that floor.
+ */
+
+#define DRC_TCP_ADAPT_PERIOD 128
+
+/**
+ * @brief Account a request entering a DRC
+ *
+ * @param[in] drc The duplicate request cache
+ */
+static inline void drc_count_start(drc_t *drc)
+{
+	uint32_t inflight;
+
+	(void)atomic_inc_uint32_t(&drc->size);
+
+	if (drc->type == DRC_UDP_V234)
+		return;
+
+	(void)atomic_inc_uint32_t(&drc_tcp_entries);
+
+	/* A racing update may lose a peak, the next request restores it */
+	inflight = atomic_inc_uint32_t(&drc->d_u.tcp.inflight);
+	if (inflight > atomic_fetch_uint32_t(&drc->d_u.tcp.peak))
+		atomic_store_uint32_t(&drc->d_u.tcp.peak, inflight);
+}
+
+/**
+ * @brief Account a request leaving a DRC
+ *
+ * @param[in] drc The duplicate request cache
+ */
+static inline void drc_count_retire(drc_t *drc)
+{
+	(void)atomic_dec_uint32_t(&drc->size);
+
+	if (drc->type != DRC_UDP_V234)
+		(void)atomic_dec_uint32_t(&drc_tcp_entries);
+}
+
+/**
+ * @brief Move the high water mark of a TCP DRC, see @ref DRC_ADAPT
+ *
+ * @param[in] drc The duplicate request cache
+ */
+static void drc_adapt(drc_t *drc)
+{
+	uint32_t budget = nfs_param.core_param.drc.tcp.budget;
+	uint32_t hits = atomic_fetch_uint32_t(&drc->d_u.tcp.hits);
+	uint32_t floor = nfs_param.core_param.drc.tcp.min_hiwat;
+	uint32_t hiwat = atomic_fetch_uint32_t(&drc->hiwat);
+	uint32_t old = hiwat;
+	bool over = budget != 0 &&
+		    atomic_fetch_uint32_t(&drc_tcp_entries) > budget;
+
+	if (2 * atomic_fetch_uint32_t(&drc->d_u.tcp.peak) > floor)
+		floor = 2 * atomic_fetch_uint32_t(&drc->d_u.tcp.peak);
+
+	/* Start the next period */
+	(void)atomic_sub_uint32_t(&drc->d_u.tcp.hits, hits);
+	atomic_store_uint32_t(&drc->d_u.tcp.peak,
+			      atomic_fetch_uint32_t(&drc->d_u.tcp.inflight));
+
+	if (hits != 0 && !over)
+		hiwat *= 2;
+	else if (hits == 0 && over)
+		hiwat = floor;
+	else if (hits == 0)
+		hiwat -= hiwat / 4;
+
+	if (hiwat < floor)
+		hiwat = floor;
+	if (hiwat > drc->maxsize)
+		hiwat = drc->maxsize;
+
+	if (hiwat == old)
+		return;
+
+	atomic_store_uint32_t(&drc->hiwat, hiwat);
+
+	LogFullDebug(COMPONENT_DUPREQ,
+		     "DRC=%p hiwat %" PRIu32 " -> %" PRIu32 " after %" PRIu32
+		     " retransmissions", drc, old, hiwat, hits);
+}
 
 /**
  * @brief retire request predicate.
@@ -933,16 +1157,18 @@ static inline void dupreq_entry_put(dupreq_entry_t *dv)
  */
 static inline bool drc_should_retire(drc_t *drc)
 {
+	uint32_t size = atomic_fetch_uint32_t(&drc->size);
+
 	/* do not exeed the hard bound on cache size */
-	if (unlikely(drc->size > drc->maxsize))
+	if (unlikely(size > drc->maxsize))
 		return true;
 
 	/* otherwise, are we permitted to retire requests */
-	if (unlikely(drc->retwnd > 0))
+	if (unlikely(atomic_fetch_int32_t(&drc->retwnd) > 0))
 		return false;
 
 	/* finally, retire if drc->size is above intended high water mark */
-	if (unlikely(drc->size > drc->hiwat))
+	if (unlikely(size > atomic_fetch_uint32_t(&drc->hiwat)))
 		return true;
 
 	return false;
@@ -986,7 +1212,23 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 	dupreq_status_t status = DUPREQ_SUCCESS;
 	dupreq_entry_t *dv = NULL, *dk = NULL;
 	drc_t *drc;
-	enum drc_type dtype = get_drc_type(req);
+	enum drc_type dtype;
+
+	/* Sessions have exactly-once semantics of their own, skip
+	 * everything DRC related, including the result allocation.
+	 */
+	if (reqnfs->funcdesc->service_function == nfs4_Compound &&
+	    ((COMPOUND4args *)&reqnfs->arg_nfs)->minorversion > 0) {
+		req->rq_u1 = (void *)DUPREQ_SESSION;
+		/* zeroed along with the request */
+		reqnfs->res_nfs = req->rq_u2 = &reqnfs->res_session;
+		(void)atomic_inc_uint64_t(&drc_session_calls);
+		(void)atomic_add_uint64_t(&drc_session_bytes,
+					  sizeof(nfs_res_t));
+		return DUPREQ_SUCCESS;
+	}
+
+	dtype = get_drc_type(req);
 
 	if (nfs_param.core_param.drc.disabled)
 		goto no_cache;
@@ -1051,6 +1293,8 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 		struct opr_rbtree_node *nv;
 		struct rbtree_x_part *t =
 		    rbtx_partition_of_scalar(&drc->xt, dk->hk);
+		struct drc_part *p = drc_part_of(drc, t);
+
 		PTHREAD_MUTEX_lock(&t->mtx);	/* partition lock */
 		nv = rbtree_x_cached_lookup(&drc->xt, t, &dk->rbt_k, dk->hk);
 		if (nv) {
@@ -1070,11 +1314,11 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 			}
 			PTHREAD_MUTEX_unlock(&dv->mtx);
 
-			if (status == DUPREQ_EXISTS) {
-				PTHREAD_MUTEX_lock(&drc->mtx);
+			if (status == DUPREQ_EXISTS)
 				drc_inc_retwnd(drc);
-				PTHREAD_MUTEX_unlock(&drc->mtx);
-			}
+
+			if (drc->type != DRC_UDP_V234)
+				(void)atomic_inc_uint32_t(&drc->d_u.tcp.hits);
 
 			LogDebug(COMPONENT_DUPREQ,
 				 "dupreq hit dv=%p, dv xid=%" PRIu32
@@ -1096,11 +1340,10 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 			 */
 			dk->refcnt = 2;
 
-			/* add to q tail */
-			PTHREAD_MUTEX_lock(&drc->mtx);
-			TAILQ_INSERT_TAIL(&drc->dupreq_q, dk, fifo_q);
-			++(drc->size);
-			PTHREAD_MUTEX_unlock(&drc->mtx);
+			/* add to q tail, under the partition lock */
+			TAILQ_INSERT_TAIL(&p->dupreq_q, dk, fifo_q);
+			++(p->size);
+			drc_count_start(drc);
 
 			LogFullDebug(COMPONENT_DUPREQ,
 				     "starting dk=%p xid=%" PRIu32
@@ -1153,11 +1396,12 @@ dupreq_status_t nfs_dupreq_finish(struct svc_req *req, nfs_res_t *res_nfs)
 	dupreq_entry_t *ov = NULL, *dv = (dupreq_entry_t *)req->rq_u1;
 	dupreq_status_t status = DUPREQ_SUCCESS;
 	struct rbtree_x_part *t;
+	struct drc_part *p;
 	drc_t *drc = NULL;
 	int16_t cnt = 0;
 
 	/* do nothing if req is marked no-cache */
-	if (dv == (void *)DUPREQ_NOCACHE)
+	if (dv == (void *)DUPREQ_NOCACHE || dv == (void *)DUPREQ_SESSION)
 		goto out;
 
 	/* do nothing if nfs_dupreq_start failed completely */
@@ -1171,9 +1415,6 @@ dupreq_status_t nfs_dupreq_finish(struct svc_req *req, nfs_res_t *res_nfs)
 	drc = dv->hin.drc;
 	PTHREAD_MUTEX_unlock(&dv->mtx);
 
-	/* cond. remove from q head */
-	PTHREAD_MUTEX_lock(&drc->mtx);
-
 	LogFullDebug(COMPONENT_DUPREQ,
 		     "completing dv=%p xid=%" PRIu32
 		     " on DRC=%p state=%s, status=%s, refcnt=%d, drc->size=%d",
@@ -1184,69 +1425,51 @@ dupreq_status_t nfs_dupreq_finish(struct svc_req *req, nfs_res_t *res_nfs)
 	/* (all) finished requests count against retwnd */
 	drc_dec_retwnd(drc);
 
-	/* conditionally retire entries */
-dq_again:
-	if (drc_should_retire(drc)) {
-		ov = TAILQ_FIRST(&drc->dupreq_q);
-		if (likely(ov)) {
-			/* remove dict entry */
-			t = rbtx_partition_of_scalar(&drc->xt, ov->hk);
-			uint64_t ov_hk = ov->hk;
-
-			/* Need to acquire partition lock, but the lock
-			 * order is partition lock followed by drc lock.
-			 * Drop drc lock and reacquire it!
-			 */
-			PTHREAD_MUTEX_unlock(&drc->mtx);
-			PTHREAD_MUTEX_lock(&t->mtx);	/* partition lock */
-			PTHREAD_MUTEX_lock(&drc->mtx);
-
-			/* Since we dropped drc lock and reacquired it,
-			 * the drc dupreq list may have changed. Get the
-			 * dupreq entry from the list again.
-			 */
-			ov = TAILQ_FIRST(&drc->dupreq_q);
+	if (drc->type != DRC_UDP_V234) {
+		(void)atomic_dec_uint32_t(&drc->d_u.tcp.inflight);
 
-			/* Make sure that we are removing the entry we
-			 * expected (imperfect, but harmless).
-			 */
-			if (ov == NULL || ov->hk != ov_hk) {
-				PTHREAD_MUTEX_unlock(&t->mtx);
-				goto unlock;
-			}
+		if (nfs_param.core_param.drc.tcp.adaptive &&
+		    atomic_inc_uint32_t(&drc->d_u.tcp.finished) %
+		    DRC_TCP_ADAPT_PERIOD == 0)
+			drc_adapt(drc);
+	}
 
-			/* remove q entry */
-			TAILQ_REMOVE(&drc->dupreq_q, ov, fifo_q);
-			--(drc->size);
-			/* release dv's ref */
-			nfs_dupreq_put_drc(NULL, drc, DRC_FLAG_LOCKED);
-			/* drc->mtx gets unlocked in the above call! */
+	/* conditionally retire entries, oldest first, from the partition
+	 * this request lives in
+	 */
+	t = rbtx_partition_of_scalar(&drc->xt, dv->hk);
+	p = drc_part_of(drc, t);
 
-			rbtree_x_cached_remove(&drc->xt, t, &ov->rbt_k, ov->hk);
+	while (cnt++ <= DUPREQ_MAX_RETRIES && drc_should_retire(drc)) {
+		PTHREAD_MUTEX_lock(&t->mtx);	/* partition lock */
 
+		ov = TAILQ_FIRST(&p->dupreq_q);
+		if (unlikely(ov == NULL)) {
 			PTHREAD_MUTEX_unlock(&t->mtx);
-
-			LogDebug(COMPONENT_DUPREQ,
-				 "retiring ov=%p xid=%" PRIu32
-				 " on DRC=%p state=%s, status=%s, refcnt=%d",
-				 ov, ov->hin.tcp.rq_xid,
-				 ov->hin.drc, dupreq_state_table[dv->state],
-				 dupreq_status_table[status], ov->refcnt);
-
-			/* release hashtable ref count */
-			dupreq_entry_put(ov);
-
-			/* conditionally retire another */
-			if (cnt++ < DUPREQ_MAX_RETRIES) {
-				PTHREAD_MUTEX_lock(&drc->mtx);
-				goto dq_again; /* calls drc_should_retire() */
-			}
-			goto out;
+			break;
 		}
-	}
 
- unlock:
-	PTHREAD_MUTEX_unlock(&drc->mtx);
+		/* remove q entry and dict entry */
+		TAILQ_REMOVE(&p->dupreq_q, ov, fifo_q);
+		--(p->size);
+		drc_count_retire(drc);
+		rbtree_x_cached_remove(&drc->xt, t, &ov->rbt_k, ov->hk);
+
+		PTHREAD_MUTEX_unlock(&t->mtx);
+
+		LogDebug(COMPONENT_DUPREQ,
+			 "retiring ov=%p xid=%" PRIu32
+			 " on DRC=%p state=%s, status=%s, refcnt=%d",
+			 ov, ov->hin.tcp.rq_xid,
+			 ov->hin.drc, dupreq_state_table[dv->state],
+			 dupreq_status_table[status], ov->refcnt);
+
+		/* release dv's ref */
+		nfs_dupreq_put_drc(NULL, drc, DRC_FLAG_NONE);
+
+		/* release hashtable ref count */
+		dupreq_entry_put(ov);
+	}
 
  out:
 	return status;
@@ -1273,10 +1496,12 @@ dupreq_status_t nfs_dupreq_delete(struct svc_req *req)
 	dupreq_entry_t *dv = (dupreq_entry_t *)req->rq_u1;
 	dupreq_status_t status = DUPREQ_SUCCESS;
 	struct rbtree_x_part *t;
+	struct drc_part *p;
 	drc_t *drc;
+	bool finished;
 
 	/* do nothing if req is marked no-cache */
-	if (dv == (void *)DUPREQ_NOCACHE)
+	if (dv == (void *)DUPREQ_NOCACHE || dv == (void *)DUPREQ_SESSION)
 		goto out;
 
 	/* do nothing if nfs_dupreq_start failed completely */
@@ -1285,6 +1510,7 @@ dupreq_status_t nfs_dupreq_delete(struct svc_req *req)
 
 	PTHREAD_MUTEX_lock(&dv->mtx);
 	drc = dv->hin.drc;
+	finished = dv->state != DUPREQ_START;
 	dv->state = DUPREQ_DELETED;
 	PTHREAD_MUTEX_unlock(&dv->mtx);
 
@@ -1298,18 +1524,20 @@ dupreq_status_t nfs_dupreq_delete(struct svc_req *req)
 	/* XXX dv holds a ref on drc */
 	t = rbtx_partition_of_scalar(&drc->xt, dv->hk);
 
+	p = drc_part_of(drc, t);
+
 	PTHREAD_MUTEX_lock(&t->mtx);
 	rbtree_x_cached_remove(&drc->xt, t, &dv->rbt_k, dv->hk);
+	TAILQ_REMOVE(&p->dupreq_q, dv, fifo_q);
+	--(p->size);
+	drc_count_retire(drc);
 	PTHREAD_MUTEX_unlock(&t->mtx);
 
-	PTHREAD_MUTEX_lock(&drc->mtx);
-
-	TAILQ_REMOVE(&drc->dupreq_q, dv, fifo_q);
-	--(drc->size);
+	if (!finished && drc->type != DRC_UDP_V234)
+		(void)atomic_dec_uint32_t(&drc->d_u.tcp.inflight);
 
-	/* release dv's ref on drc and unlock */
-	nfs_dupreq_put_drc(req->rq_xprt, drc, DRC_FLAG_LOCKED);
-	/* !LOCKED */
+	/* release dv's ref on drc */
+	nfs_dupreq_put_drc(req->rq_xprt, drc, DRC_FLAG_NONE);
 
 	/* we removed the dupreq from hashtable, release a ref */
 	dupreq_entry_put(dv);
@@ -1340,6 +1568,11 @@ void nfs_dupreq_rele(struct svc_req *req, const nfs_function_desc_t *func)
 		goto out;
 	}
 
+	if (dv == (void *)DUPREQ_SESSION) {
+		func->free_function(req->rq_u2);
+		goto out;
+	}
+
 	LogFullDebug(COMPONENT_DUPREQ,
 		     "releasing dv=%p xid=%" PRIu32
 		     " on DRC=%p state=%s, refcnt=%d",
@@ -1354,6 +1587,54 @@ void nfs_dupreq_rele(struct svc_req *req, const nfs_function_desc_t *func)
 		SVCAUTH_RELEASE(req->rq_auth, req);
 }
 
+#ifdef USE_DBUS
+/**
+ * @brief Report DRC bypass statistics over DBus
+ *
+ * @param[in,out] iter  The reply being built
+ */
+void dupreq_dbus_show(DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	uint64_t val;
+	char *type;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	type = "session_calls";
+	val = atomic_fetch_uint64_t(&drc_session_calls);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	type = "session_bytes_saved";
+	val = atomic_fetch_uint64_t(&drc_session_bytes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif /* USE_DBUS */
+
+/**
+ * @brief Write the DRC statistics in OpenMetrics text format
+ *
+ * @param[in] out  Reply stream
+ */
+void dupreq_metrics(FILE *out)
+{
+	metrics_counter(out, "ganesha_drc_session_calls",
+			"Requests on NFSv4.1+ sessions that bypassed the DRC",
+			atomic_fetch_uint64_t(&drc_session_calls));
+	metrics_counter(out, "ganesha_drc_session_saved_bytes",
+			"Reply bytes not cached in the DRC thanks to sessions",
+			atomic_fetch_uint64_t(&drc_session_bytes));
+	metrics_gauge(out, "ganesha_drc_tcp_requests",
+		      "Requests held by the TCP DRCs",
+		      atomic_fetch_uint32_t(&drc_tcp_entries));
+}
+
 /**
  * @brief Shutdown the dupreq2 package.
  */
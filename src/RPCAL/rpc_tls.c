@@ -0,0 +1,252 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file    rpc_tls.c
+ * @brief   RPC-with-TLS (RFC 9289) on kernel TLS
+ *
+ * A client asks for TLS with a NULL call whose credential is AUTH_TLS.
+ * The reply carries the STARTTLS verifier, then the TLS handshake runs
+ * on the connection, in the decoder that received the call.  OpenSSL
+ * does the handshake and hands the keys to kernel TLS, which encrypts
+ * and decrypts the records from then on, on the NIC if it can.  The
+ * transport keeps reading and writing the socket as before, so replies
+ * are still written straight from their buffers.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "log.h"
+#include "gsh_rpc.h"
+#include "nfs_core.h"
+#include "abstract_atomic.h"
+
+/** ALPN identifier of RPC-with-TLS, RFC 9289 section 5.2 */
+static const unsigned char rpc_tls_alpn[] = "\x06sunrpc";
+
+/** Verifier of the reply to the AUTH_TLS probe */
+static char rpc_tls_starttls[] = "STARTTLS";
+
+static SSL_CTX *tls_ctx;
+
+static void log_tls_errors(log_components_t component, const char *what)
+{
+	char buf[256];
+	unsigned long err;
+
+	while ((err = ERR_get_error()) != 0) {
+		ERR_error_string_n(err, buf, sizeof(buf));
+		LogWarn(component, "%s: %s", what, buf);
+	}
+}
+
+static int rpc_tls_alpn_select(SSL *ssl, const unsigned char **out,
+			       unsigned char *outlen, const unsigned char *in,
+			       unsigned int inlen, void *arg)
+{
+	if (SSL_select_next_proto((unsigned char **) out, outlen,
+				  rpc_tls_alpn, sizeof(rpc_tls_alpn) - 1,
+				  in, inlen) != OPENSSL_NPN_NEGOTIATED)
+		return SSL_TLSEXT_ERR_ALERT_FATAL;
+
+	return SSL_TLSEXT_ERR_OK;
+}
+
+void nfs_rpc_tls_init(void)
+{
+	nfs_tls_parameter_t *param = &nfs_param.tls_param;
+
+	if (!param->active_tls)
+		return;
+
+	tls_ctx = SSL_CTX_new(TLS_server_method());
+	if (tls_ctx == NULL) {
+		log_tls_errors(COMPONENT_INIT, "SSL_CTX_new");
+		LogFatal(COMPONENT_INIT, "Can't set up TLS");
+	}
+
+	/* RFC 9289 section 5.1 */
+	(void) SSL_CTX_set_min_proto_version(tls_ctx, TLS1_3_VERSION);
+
+	/* The session is gone once the kernel has the keys, so there is
+	 * nothing to resume from a ticket.
+	 */
+	(void) SSL_CTX_set_options(tls_ctx,
+				   SSL_OP_ENABLE_KTLS | SSL_OP_NO_TICKET);
+	(void) SSL_CTX_set_num_tickets(tls_ctx, 0);
+	SSL_CTX_set_alpn_select_cb(tls_ctx, rpc_tls_alpn_select, NULL);
+
+	if (SSL_CTX_use_certificate_chain_file(tls_ctx,
+					       param->cert_file) != 1 ||
+	    SSL_CTX_use_PrivateKey_file(tls_ctx, param->key_file,
+					SSL_FILETYPE_PEM) != 1 ||
+	    SSL_CTX_check_private_key(tls_ctx) != 1) {
+		log_tls_errors(COMPONENT_INIT, "TLS certificate");
+		LogFatal(COMPONENT_INIT,
+			 "Can't load TLS certificate \"%s\" and key \"%s\"",
+			 param->cert_file, param->key_file);
+	}
+
+	if (*param->ca_file != '\0') {
+		if (SSL_CTX_load_verify_locations(tls_ctx, param->ca_file,
+						  NULL) != 1) {
+			log_tls_errors(COMPONENT_INIT, "TLS CA");
+			LogFatal(COMPONENT_INIT,
+				 "Can't load TLS CA certificates \"%s\"",
+				 param->ca_file);
+		}
+		SSL_CTX_set_verify(tls_ctx, SSL_VERIFY_PEER |
+				   SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+	}
+
+	LogInfo(COMPONENT_INIT, "RPC-with-TLS enabled, certificate \"%s\"",
+		param->cert_file);
+}
+
+/**
+ * @brief Run the server side of the handshake and hand over to the kernel
+ *
+ * The socket is non-blocking, so the handshake waits for it in poll,
+ * for at most Handshake_Timeout seconds in all.
+ *
+ * @param[in] xprt The connection
+ *
+ * @return true if the connection now runs over kernel TLS.
+ */
+static bool nfs_rpc_tls_handshake(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+	struct pollfd pfd = { .fd = xprt->xp_fd };
+	time_t deadline = time(NULL) +
+			  nfs_param.tls_param.handshake_timeout;
+	time_t left;
+	bool ok = false;
+	SSL *ssl;
+	int rc;
+
+	ssl = SSL_new(tls_ctx);
+	if (ssl == NULL) {
+		log_tls_errors(COMPONENT_DISPATCH, "SSL_new");
+		return false;
+	}
+
+	/* Leaves the socket open when the SSL is freed */
+	if (SSL_set_fd(ssl, xprt->xp_fd) != 1) {
+		log_tls_errors(COMPONENT_DISPATCH, "SSL_set_fd");
+		goto out;
+	}
+
+	while ((rc = SSL_accept(ssl)) != 1) {
+		switch (SSL_get_error(ssl, rc)) {
+		case SSL_ERROR_WANT_READ:
+			pfd.events = POLLIN;
+			break;
+		case SSL_ERROR_WANT_WRITE:
+			pfd.events = POLLOUT;
+			break;
+		default:
+			log_tls_errors(COMPONENT_DISPATCH, "TLS handshake");
+			LogInfo(COMPONENT_DISPATCH,
+				"TLS handshake failed on socket %d",
+				xprt->xp_fd);
+			goto out;
+		}
+
+		left = deadline - time(NULL);
+		if (left <= 0 || poll(&pfd, 1, left * 1000) <= 0) {
+			LogInfo(COMPONENT_DISPATCH,
+				"TLS handshake timed out on socket %d",
+				xprt->xp_fd);
+			goto out;
+		}
+	}
+
+	/* The transport reads and writes the socket itself, so both
+	 * directions must be done by the kernel.
+	 */
+	if (!BIO_get_ktls_send(SSL_get_wbio(ssl)) ||
+	    !BIO_get_ktls_recv(SSL_get_rbio(ssl))) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Kernel TLS unavailable for %s, closing socket %d",
+			SSL_get_cipher_name(ssl), xprt->xp_fd);
+		goto out;
+	}
+
+	(void) atomic_set_uint16_t_bits(&xu->flags, XPRT_PRIVATE_FLAG_TLS);
+	ok = true;
+
+	LogDebug(COMPONENT_DISPATCH, "Socket %d now uses TLS with %s",
+		 xprt->xp_fd, SSL_get_cipher_name(ssl));
+
+ out:
+	SSL_free(ssl);
+	return ok;
+}
+
+/**
+ * @brief Answer an AUTH_TLS probe and start TLS on its connection
+ *
+ * @param[in] req The call, its credential is AUTH_TLS
+ *
+ * @return false if the connection must be closed.
+ */
+bool nfs_rpc_starttls(struct svc_req *req)
+{
+	SVCXPRT *xprt = req->rq_xprt;
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+
+	/* RFC 9289 section 4.1, a NULL call on a stream not yet in TLS */
+	if (tls_ctx == NULL || xprt->xp_type != XPRT_TCP || xu == NULL ||
+	    req->rq_msg.cb_proc != NULLPROC ||
+	    (atomic_fetch_uint16_t(&xu->flags) & XPRT_PRIVATE_FLAG_TLS)) {
+		svcerr_auth(req, AUTH_REJECTEDCRED);
+		return true;
+	}
+
+	/* The reply still goes out in clear */
+	req->rq_auth = &svc_auth_none;
+	req->rq_msg.RPCM_ack.ar_verf.oa_flavor = AUTH_NONE;
+	req->rq_msg.RPCM_ack.ar_verf.oa_base = rpc_tls_starttls;
+	req->rq_msg.RPCM_ack.ar_verf.oa_length = sizeof(rpc_tls_starttls) - 1;
+
+	if (!svc_sendreply(req, (xdrproc_t) xdr_void, NULL))
+		return false;
+
+	return nfs_rpc_tls_handshake(xprt);
+}
+
+/**
+ * @brief Whether a connection runs over TLS
+ *
+ * @param[in] xprt The transport
+ */
+bool nfs_rpc_xprt_tls(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+
+	return xu != NULL &&
+	       (atomic_fetch_uint16_t(&xu->flags) & XPRT_PRIVATE_FLAG_TLS);
+}
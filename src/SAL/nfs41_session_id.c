@@ -55,6 +55,25 @@ hash_table_t *ht_session_id;
 
 uint64_t global_sequence = 0;
 
+/**
+ * @param Bumped on every session removal, stales the connection caches
+ */
+
+static uint64_t session_del_gen;
+
+/**
+ * @brief The session last used on a connection
+ *
+ * The cache holds a reference, so a removed session lingers until the
+ * connection looks up another one or goes away.
+ */
+
+struct xprt_session_cache {
+	pthread_mutex_t mtx;
+	nfs41_session_t *session;	/*< Referenced, or NULL */
+	uint64_t gen;			/*< session_del_gen when cached */
+};
+
 /**
  * @brief Display a session ID
  *
@@ -189,7 +208,7 @@ static hash_parameter_t session_id_param = {
 	.compare_key = compare_session_id,
 	.key_to_str = display_session_id_key,
 	.val_to_str = display_session_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_RCU | HT_FLAG_GROW,
 };
 
 /**
@@ -237,6 +256,21 @@ int32_t inc_session_ref(nfs41_session_t *session)
 	return refcnt;
 }
 
+/**
+ * @brief Drop the cached reply of a slot
+ *
+ * The caller holds the slot lock, or the slot is no longer reachable.
+ *
+ * @param[in,out] slot The slot
+ */
+void nfs41_Session_Slot_Uncache(nfs41_session_slot_t *slot)
+{
+	gsh_free(slot->cached_xdr);
+	slot->cached_xdr = NULL;
+	slot->cached_xdr_len = 0;
+	slot->cache_used = false;
+}
+
 int32_t dec_session_ref(nfs41_session_t *session)
 {
 	int i;
@@ -254,8 +288,12 @@ int32_t dec_session_ref(nfs41_session_t *session)
 		dec_client_id_ref(session->clientid_record);
 		/* Destroy this session's mutexes and condition variable */
 
-		for (i = 0; i < NFS41_NB_SLOTS; i++)
+		for (i = 0; i < session->fore_channel_attrs.ca_maxrequests;
+		     i++) {
+			nfs41_Session_Slot_Uncache(&session->slots[i]);
 			PTHREAD_MUTEX_destroy(&session->slots[i].lock);
+		}
+		gsh_free(session->slots);
 
 		PTHREAD_COND_destroy(&session->cb_cond);
 		PTHREAD_MUTEX_destroy(&session->cb_mutex);
@@ -263,6 +301,8 @@ int32_t dec_session_ref(nfs41_session_t *session)
 		/* Destroy the session's back channel (if any) */
 		if (session->flags & session_bc_up)
 			nfs_rpc_destroy_chan(&session->cb_chan);
+		PTHREAD_MUTEX_destroy(&session->cb_chan.pending_mtx);
+		PTHREAD_MUTEX_destroy(&session->cb_chan.mtx);
 
 		/* Free the memory for the session */
 		pool_free(nfs41_session_pool, session);
@@ -366,6 +406,85 @@ int nfs41_Session_Get_Pointer(char sessionid[NFS4_SESSIONID_SIZE],
 	return 1;
 }
 
+struct xprt_session_cache *xprt_session_cache_alloc(void)
+{
+	struct xprt_session_cache *cache = gsh_calloc(1, sizeof(*cache));
+
+	PTHREAD_MUTEX_init(&cache->mtx, NULL);
+
+	return cache;
+}
+
+void xprt_session_cache_free(struct xprt_session_cache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	if (cache->session != NULL)
+		dec_session_ref(cache->session);
+	PTHREAD_MUTEX_destroy(&cache->mtx);
+	gsh_free(cache);
+}
+
+/**
+ * @brief Get a pointer to a session, trying the connection's first
+ *
+ * Like nfs41_Session_Get_Pointer(), but reuses the session found by
+ * the last lookup on the same connection if no session has been
+ * removed since.
+ *
+ * @param[in]  cache        The connection's cache, may be NULL
+ * @param[in]  sessionid    The sessionid to look up
+ * @param[out] session_data The associated session data
+ *
+ * @retval 1 if successful.
+ * @retval 0 otherwise.
+ */
+
+int nfs41_Session_Get_Pointer_cached(struct xprt_session_cache *cache,
+				     char sessionid[NFS4_SESSIONID_SIZE],
+				     nfs41_session_t **session_data)
+{
+	nfs41_session_t *old;
+	uint64_t gen;
+
+	if (cache == NULL)
+		return nfs41_Session_Get_Pointer(sessionid, session_data);
+
+	/* read before the lookup, a removal racing with it stales the
+	 * entry we make
+	 */
+	gen = atomic_fetch_uint64_t(&session_del_gen);
+
+	PTHREAD_MUTEX_lock(&cache->mtx);
+	if (cache->session != NULL && cache->gen == gen &&
+	    memcmp(cache->session->session_id, sessionid,
+		   NFS4_SESSIONID_SIZE) == 0) {
+		*session_data = cache->session;
+		inc_session_ref(*session_data);
+		PTHREAD_MUTEX_unlock(&cache->mtx);
+		return 1;
+	}
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+
+	if (!nfs41_Session_Get_Pointer(sessionid, session_data))
+		return 0;
+
+	/* one for the cache */
+	inc_session_ref(*session_data);
+
+	PTHREAD_MUTEX_lock(&cache->mtx);
+	old = cache->session;
+	cache->session = *session_data;
+	cache->gen = gen;
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+
+	if (old != NULL)
+		dec_session_ref(old);
+
+	return 1;
+}
+
 /**
  * @brief Remove a session from the session hashtable.
  *
@@ -388,6 +507,9 @@ int nfs41_Session_Del(char sessionid[NFS4_SESSIONID_SIZE])
 	    HASHTABLE_SUCCESS) {
 		nfs41_session_t *session = old_value.addr;
 
+		/* after the removal, so no lookup can cache it again */
+		(void) atomic_inc_uint64_t(&session_del_gen);
+
 		/* unref session */
 		dec_session_ref(session);
 
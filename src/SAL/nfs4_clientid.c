@@ -345,10 +345,16 @@ void free_client_id(nfs_client_id_t *clientid)
 		clientid->cid_recov_dir = NULL;
 	}
 
+	nfs41_Session_Slot_Uncache(&clientid->cid_create_session_slot);
+
 	PTHREAD_MUTEX_destroy(&clientid->cid_mutex);
 	PTHREAD_MUTEX_destroy(&clientid->cid_owner.so_mutex);
-	if (clientid->cid_minorversion == 0)
+	PTHREAD_MUTEX_destroy(&clientid->cid_create_session_slot.lock);
+	if (clientid->cid_minorversion == 0) {
 		PTHREAD_MUTEX_destroy(&clientid->cid_cb.v40.cb_chan.mtx);
+		PTHREAD_MUTEX_destroy(
+			&clientid->cid_cb.v40.cb_chan.pending_mtx);
+	}
 
 	put_gsh_client(clientid->gsh_client);
 
@@ -532,6 +538,7 @@ nfs_client_id_t *create_client_id(clientid4 clientid,
 	state_owner_t *owner;
 
 	PTHREAD_MUTEX_init(&client_rec->cid_mutex, NULL);
+	PTHREAD_MUTEX_init(&client_rec->cid_create_session_slot.lock, NULL);
 
 	owner = &client_rec->cid_owner;
 
@@ -540,6 +547,9 @@ nfs_client_id_t *create_client_id(clientid4 clientid,
 	/* initialize the chan mutex for v4 */
 	if (minorversion == 0) {
 		PTHREAD_MUTEX_init(&client_rec->cid_cb.v40.cb_chan.mtx, NULL);
+		PTHREAD_MUTEX_init(&client_rec->cid_cb.v40.cb_chan.pending_mtx,
+				   NULL);
+		glist_init(&client_rec->cid_cb.v40.cb_chan.pending);
 		client_rec->cid_cb.v40.cb_chan_down = true;
 		client_rec->first_path_down_resp_time = 0;
 	}
@@ -635,6 +645,9 @@ clientid_status_t nfs_client_id_insert(nfs_client_id_t *clientid)
 	/* Take a reference to the unconfirmed clientid for the hash table. */
 	(void)inc_client_id_ref(clientid);
 
+	/* Have the reaper look at it when its lease runs out */
+	lease_wheel_add(clientid);
+
 	if (isFullDebug(COMPONENT_CLIENTID) &&
 	    isFullDebug(COMPONENT_HASHTABLE)) {
 		LogFullDebug(COMPONENT_CLIENTID,
@@ -682,6 +695,9 @@ int remove_confirmed_client_id(nfs_client_id_t *clientid)
 	/* Set this up so this client id record will be freed. */
 	clientid->cid_confirmed = EXPIRED_CLIENT_ID;
 
+	/* Nothing left for the reaper to expire */
+	lease_wheel_del(clientid);
+
 	/* Release hash table reference to the unconfirmed record */
 	(void)dec_client_id_ref(clientid);
 
@@ -726,6 +742,9 @@ int remove_unconfirmed_client_id(nfs_client_id_t *clientid)
 	/* Set this up so this client id record will be freed. */
 	clientid->cid_confirmed = EXPIRED_CLIENT_ID;
 
+	/* Nothing left for the reaper to expire */
+	lease_wheel_del(clientid);
+
 	/* Release hash table reference to the unconfirmed record */
 	(void)dec_client_id_ref(clientid);
 
@@ -801,6 +820,8 @@ clientid_status_t nfs_client_id_confirm(nfs_client_id_t *clientid,
 		   freed. */
 		clientid->cid_confirmed = EXPIRED_CLIENT_ID;
 
+		lease_wheel_del(clientid);
+
 		/* Release hash table reference to the unconfirmed
 		   record */
 		(void)dec_client_id_ref(clientid);
@@ -956,6 +977,8 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 				" error=%s", clientid->cid_clientid,
 				hash_table_err_to_str(rc));
 		}
+
+		lease_wheel_del(clientid);
 	}
 
 	/* Traverse the client's lock owners, and release all
@@ -1100,7 +1123,7 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 	}
 
 	if (clientid->cid_recov_dir != NULL && !make_stale) {
-		nfs4_rm_clid(clientid->cid_recov_dir, v4_recov_dir, 0);
+		nfs4_rm_clid(clientid);
 		gsh_free(clientid->cid_recov_dir);
 		clientid->cid_recov_dir = NULL;
 	}
@@ -1242,7 +1265,7 @@ static hash_parameter_t cid_confirmed_hash_param = {
 	.key_to_str = display_client_id_key,
 	.val_to_str = display_client_id_val,
 	.ht_name = "Confirmed Client ID",
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_RCU | HT_FLAG_GROW,
 	.ht_log_component = COMPONENT_CLIENTID,
 };
 
@@ -1255,7 +1278,7 @@ static hash_parameter_t cid_unconfirmed_hash_param = {
 	.key_to_str = display_client_id_key,
 	.val_to_str = display_client_id_val,
 	.ht_name = "Unconfirmed Client ID",
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_RCU | HT_FLAG_GROW,
 	.ht_log_component = COMPONENT_CLIENTID,
 };
 
@@ -1268,7 +1291,7 @@ static hash_parameter_t cr_hash_param = {
 	.key_to_str = display_client_record_key,
 	.val_to_str = display_client_record_val,
 	.ht_name = "Client Record",
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_CACHE | HT_FLAG_GROW,
 	.ht_log_component = COMPONENT_CLIENTID,
 };
 
@@ -1310,6 +1333,8 @@ int nfs_Init_client_id(void)
 	client_id_pool =
 	    pool_basic_init("NFS4 Client ID Pool", sizeof(nfs_client_id_t));
 
+	lease_wheel_init();
+
 	return CLIENT_ID_SUCCESS;
 }
 
@@ -1744,7 +1769,7 @@ void
 nfs41_foreach_client_callback(bool(*cb) (nfs_client_id_t *cl, void *state),
 			      void *state)
 {
-	uint32_t i;
+	uint32_t i, count;
 	hash_table_t *ht = ht_confirmed_client_id;
 	struct rbt_head *head_rbt;
 	struct hash_data *pdata = NULL;
@@ -1754,11 +1779,12 @@ nfs41_foreach_client_callback(bool(*cb) (nfs_client_id_t *cl, void *state),
 	int rc;
 
 	/* For each bucket of the hashtable */
-	for (i = 0; i < ht->parameter.index_size; i++) {
-		head_rbt = &(ht->partitions[i].rbt);
+	count = hashtable_walk_begin(ht);
+	for (i = 0; i < count; i++) {
+		head_rbt = &hashtable_partition(ht, i)->rbt;
 
 		/* acquire mutex */
-		PTHREAD_RWLOCK_wrlock(&(ht->partitions[i].lock));
+		PTHREAD_RWLOCK_wrlock(&hashtable_partition(ht, i)->lock);
 
 		/* go through all entries in the red-black-tree */
 		RBT_LOOP(head_rbt, pn) {
@@ -1786,8 +1812,9 @@ nfs41_foreach_client_callback(bool(*cb) (nfs_client_id_t *cl, void *state),
 				}
 			}
 		}
-		PTHREAD_RWLOCK_unlock(&(ht->partitions[i].lock));
+		PTHREAD_RWLOCK_unlock(&hashtable_partition(ht, i)->lock);
 	}
+	hashtable_walk_end(ht);
 }
 
 /** @} */
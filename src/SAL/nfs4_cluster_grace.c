@@ -0,0 +1,265 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @defgroup SAL State abstraction layer
+ * @{
+ */
+
+/**
+ * @file  nfs4_cluster_grace.c
+ * @brief Grace period shared by the heads serving the same exports
+ *
+ * Heads serving an export together leave locking and delegations to
+ * the cluster file system below, which sees every head's locks and
+ * leases.  What it can't see is a head that restarted and whose
+ * clients are still reclaiming their locks: another head must not
+ * grant a conflicting one meanwhile.
+ *
+ * Each head in grace keeps a file named after its node id, or its host
+ * name when the FSAL gave it none, in Cluster_Grace_Dir, on storage all
+ * heads share, and every head polls the directory.  A head is in grace as long as any of them is.  A
+ * head that died in grace leaves a file nobody refreshes any more,
+ * which is ignored after a grace period and a lease.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "fridgethr.h"
+#include "abstract_atomic.h"
+
+/** Seconds between two looks at the other heads */
+#define CLUSTER_GRACE_POLL 2
+
+static struct fridgethr *cluster_grace_fridge;
+
+/** Whether another head is in grace */
+static uint32_t cluster_peer_grace;
+
+/** Whether our file is there, only the polling thread changes it */
+static bool cluster_grace_marked;
+
+/** Name of our file */
+static char cluster_grace_self[NAME_MAX];
+
+static int cluster_grace_path(char *path, size_t size)
+{
+	return snprintf(path, size, "%s/%s",
+			nfs_param.nfsv4_param.cluster_grace_dir,
+			cluster_grace_self);
+}
+
+/**
+ * @brief Tell the other heads we are in grace
+ *
+ * Done at once when grace starts, and again at every poll so that our
+ * file stays fresh.
+ */
+void nfs4_cluster_grace_mark(void)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	if (nfs_param.nfsv4_param.cluster_grace_dir == NULL)
+		return;
+
+	(void)cluster_grace_path(path, sizeof(path));
+
+	fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		LogCrit(COMPONENT_STATE, "Could not mark grace in %s: %s",
+			path, strerror(errno));
+		return;
+	}
+
+	(void)futimens(fd, NULL);
+	close(fd);
+	cluster_grace_marked = true;
+}
+
+static void cluster_grace_unmark(void)
+{
+	char path[PATH_MAX];
+
+	(void)cluster_grace_path(path, sizeof(path));
+
+	if (unlink(path) != 0 && errno != ENOENT)
+		LogCrit(COMPONENT_STATE, "Could not unmark grace in %s: %s",
+			path, strerror(errno));
+
+	cluster_grace_marked = false;
+}
+
+/**
+ * @brief Whether a head other than us is in grace
+ */
+static bool cluster_grace_peers(void)
+{
+	const char *dir = nfs_param.nfsv4_param.cluster_grace_dir;
+	time_t stale = time(NULL) - nfs_param.nfsv4_param.grace_period -
+		       nfs_param.nfsv4_param.lease_lifetime;
+	struct dirent *dentp;
+	struct stat st;
+	bool peers = false;
+	DIR *dp;
+
+	dp = opendir(dir);
+	if (dp == NULL) {
+		LogCrit(COMPONENT_STATE, "Could not read %s: %s", dir,
+			strerror(errno));
+		return false;
+	}
+
+	while (!peers && (dentp = readdir(dp)) != NULL) {
+		if (dentp->d_name[0] == '.' ||
+		    strcmp(dentp->d_name, cluster_grace_self) == 0)
+			continue;
+
+		if (fstatat(dirfd(dp), dentp->d_name, &st, 0) == 0 &&
+		    st.st_mtime > stale)
+			peers = true;
+	}
+
+	closedir(dp);
+	return peers;
+}
+
+static void cluster_grace_run(struct fridgethr_context *ctx)
+{
+	bool peers;
+
+	SetNameFunction("cluster_grace");
+
+	if (nfs_in_local_grace())
+		nfs4_cluster_grace_mark();
+	else if (cluster_grace_marked)
+		cluster_grace_unmark();
+
+	peers = cluster_grace_peers();
+
+	if (peers != (atomic_fetch_uint32_t(&cluster_peer_grace) != 0)) {
+		LogEvent(COMPONENT_STATE, "Another head is %s grace",
+			 peers ? "in" : "out of");
+		atomic_store_uint32_t(&cluster_peer_grace, peers);
+	}
+}
+
+/**
+ * @brief Whether another head is in grace
+ */
+bool nfs4_cluster_in_grace(void)
+{
+	return atomic_fetch_uint32_t(&cluster_peer_grace) != 0;
+}
+
+/**
+ * @brief Start watching the other heads, if Cluster_Grace_Dir is set
+ *
+ * The first look is taken right away, so that a head never starts
+ * granting state while another one is reclaiming.
+ */
+void nfs4_cluster_grace_init(void)
+{
+	const char *dir = nfs_param.nfsv4_param.cluster_grace_dir;
+	struct fridgethr_params frp;
+	char host[NAME_MAX - 5];
+	int rc;
+
+	if (dir == NULL)
+		return;
+
+	if (g_nodeid != 0) {
+		(void)snprintf(cluster_grace_self, sizeof(cluster_grace_self),
+			       "node%d", g_nodeid);
+	} else {
+		if (gethostname(host, sizeof(host)) != 0)
+			LogFatal(COMPONENT_INIT, "Could not get host name: %s",
+				 strerror(errno));
+		host[sizeof(host) - 1] = '\0';
+		(void)snprintf(cluster_grace_self, sizeof(cluster_grace_self),
+			       "host-%s", host);
+	}
+
+	if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+		LogFatal(COMPONENT_INIT, "Could not create %s: %s", dir,
+			 strerror(errno));
+
+	atomic_store_uint32_t(&cluster_peer_grace, cluster_grace_peers());
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = CLUSTER_GRACE_POLL;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&cluster_grace_fridge, "cluster_grace", &frp);
+	if (rc != 0)
+		LogFatal(COMPONENT_INIT,
+			 "Unable to initialize cluster grace fridge, error code %d.",
+			 rc);
+
+	rc = fridgethr_submit(cluster_grace_fridge, cluster_grace_run, NULL);
+	if (rc != 0)
+		LogFatal(COMPONENT_INIT,
+			 "Unable to start cluster grace thread, error code %d.",
+			 rc);
+
+	LogEvent(COMPONENT_INIT, "Sharing grace through %s as %s",
+		 dir, cluster_grace_self);
+}
+
+/**
+ * @brief Stop watching the other heads
+ *
+ * Our file stays if we are still in grace, the other heads stop
+ * waiting for us once it is stale.
+ */
+void nfs4_cluster_grace_shutdown(void)
+{
+	int rc;
+
+	if (cluster_grace_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(cluster_grace_fridge, fridgethr_comm_stop,
+				    10);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_STATE,
+			 "Shutdown timed out, cancelling cluster grace thread.");
+		fridgethr_cancel(cluster_grace_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_STATE,
+			 "Failed shutting down cluster grace thread: %d", rc);
+	}
+
+	fridgethr_destroy(cluster_grace_fridge);
+	cluster_grace_fridge = NULL;
+}
+
+/** @} */
@@ -40,6 +40,184 @@
 #include "nfs4.h"
 #include "sal_functions.h"
 
+/**
+ * @brief Lease expiry wheel
+ *
+ * Each clientid sits in the slot of the second its lease runs out, so
+ * that the reaper only looks at the clientids due for expiry instead of
+ * walking the clientid tables.  A lease renewed since it was scheduled
+ * is simply scheduled again when its slot comes round, keeping renewals
+ * free of any wheel work.  Leases being much shorter than the wheel, one
+ * level is all it needs; anything further out is rechecked a wheel turn
+ * later.
+ *
+ * The wheel holds a reference on each clientid on it.
+ */
+
+#define LEASE_WHEEL_SLOTS 512
+#define LEASE_WHEEL_MASK (LEASE_WHEEL_SLOTS - 1)
+
+static struct lease_wheel {
+	pthread_mutex_t mtx;
+	/** Next second to look at */
+	time_t next;
+	struct glist_head slots[LEASE_WHEEL_SLOTS];
+} lease_wheel;
+
+/**
+ * @brief Initialize the lease expiry wheel
+ */
+void lease_wheel_init(void)
+{
+	int i;
+
+	PTHREAD_MUTEX_init(&lease_wheel.mtx, NULL);
+	lease_wheel.next = time(NULL);
+	for (i = 0; i < LEASE_WHEEL_SLOTS; i++)
+		glist_init(&lease_wheel.slots[i]);
+}
+
+/**
+ * @brief Put a clientid in the slot for a time
+ *
+ * @note lease_wheel.mtx MUST be held
+ *
+ * @param[in] clientid	Client record, already on no slot
+ * @param[in] due	When to look at it again
+ */
+static void lease_wheel_put(nfs_client_id_t *clientid, time_t due)
+{
+	if (due < lease_wheel.next)
+		due = lease_wheel.next;
+	else if (due - lease_wheel.next >= LEASE_WHEEL_SLOTS)
+		due = lease_wheel.next + LEASE_WHEEL_SLOTS - 1;
+
+	clientid->cid_lease_due = due;
+	glist_add_tail(&lease_wheel.slots[due & LEASE_WHEEL_MASK],
+		       &clientid->cid_lease_list);
+}
+
+/**
+ * @brief Schedule the expiry of a new clientid
+ *
+ * @param[in] clientid	Client record just made known
+ */
+void lease_wheel_add(nfs_client_id_t *clientid)
+{
+	(void) inc_client_id_ref(clientid);
+
+	PTHREAD_MUTEX_lock(&lease_wheel.mtx);
+	lease_wheel_put(clientid, clientid->cid_last_renew +
+				  nfs_param.nfsv4_param.lease_lifetime);
+	PTHREAD_MUTEX_unlock(&lease_wheel.mtx);
+}
+
+/**
+ * @brief Schedule again a clientid taken off the wheel
+ *
+ * The reference taken off with it goes back to the wheel.
+ *
+ * @note The cid_mutex MUST be held
+ *
+ * @param[in] clientid	Client record with a valid lease
+ */
+void lease_wheel_resched(nfs_client_id_t *clientid)
+{
+	time_t now = time(NULL);
+	time_t due;
+
+	if (atomic_fetch_int32_t(&clientid->cid_lease_reservations) > 0)
+		due = now + nfs_param.nfsv4_param.lease_lifetime;
+	else
+		due = atomic_fetch_time_t(&clientid->cid_last_renew) +
+		      nfs_param.nfsv4_param.lease_lifetime;
+
+	/* Not back into the slot being looked at */
+	if (due <= now)
+		due = now + 1;
+
+	PTHREAD_MUTEX_lock(&lease_wheel.mtx);
+	lease_wheel_put(clientid, due);
+	PTHREAD_MUTEX_unlock(&lease_wheel.mtx);
+}
+
+/**
+ * @brief Take a clientid off the wheel once it left the clientid tables
+ *
+ * The caller must hold a reference of its own.
+ *
+ * @param[in] clientid	Client record
+ */
+void lease_wheel_del(nfs_client_id_t *clientid)
+{
+	bool queued;
+
+	PTHREAD_MUTEX_lock(&lease_wheel.mtx);
+	queued = !glist_null(&clientid->cid_lease_list);
+	glist_del(&clientid->cid_lease_list);
+	PTHREAD_MUTEX_unlock(&lease_wheel.mtx);
+
+	if (queued)
+		(void) dec_client_id_ref(clientid);
+}
+
+/**
+ * @brief Take off the wheel the next clientid now due
+ *
+ * @return The clientid, with the reference the wheel held on it, or
+ *	   NULL if none is due.
+ */
+nfs_client_id_t *lease_wheel_next_due(void)
+{
+	time_t now = time(NULL);
+	nfs_client_id_t *clientid = NULL;
+	struct glist_head *slot;
+
+	PTHREAD_MUTEX_lock(&lease_wheel.mtx);
+	while (lease_wheel.next <= now) {
+		slot = &lease_wheel.slots[lease_wheel.next & LEASE_WHEEL_MASK];
+		clientid = glist_first_entry(slot, nfs_client_id_t,
+					     cid_lease_list);
+		if (clientid != NULL) {
+			glist_del(&clientid->cid_lease_list);
+			break;
+		}
+		lease_wheel.next++;
+	}
+	PTHREAD_MUTEX_unlock(&lease_wheel.mtx);
+
+	return clientid;
+}
+
+/**
+ * @brief Bias of the reservation count of a lease frozen by the reaper
+ *
+ * Reservations are counted without the cid_mutex.  To expire a lease,
+ * the reaper knocks this off an unreserved count under the cid_mutex,
+ * so that a reservation racing with it either shows up in the count it
+ * gets back, or sees the count negative and goes through the cid_mutex
+ * to learn the outcome.
+ */
+#define LEASE_FROZEN_BIAS 0x40000000
+
+/**
+ * @brief Return what is left of a lease since its last renewal
+ *
+ * @param[in] clientid The client record to check
+ *
+ * @return The seconds left or 0 if it ran out.
+ */
+static unsigned int lease_time_left(nfs_client_id_t *clientid)
+{
+	time_t t = time(NULL);
+	time_t last_renew = atomic_fetch_time_t(&clientid->cid_last_renew);
+
+	if (last_renew + nfs_param.nfsv4_param.lease_lifetime > t)
+		return (last_renew + nfs_param.nfsv4_param.lease_lifetime) - t;
+
+	return 0;
+}
+
 /**
  * @brief Return the lifetime of a valid lease
  *
@@ -49,21 +227,13 @@
  */
 static unsigned int _valid_lease(nfs_client_id_t *clientid)
 {
-	time_t t;
-
 	if (clientid->cid_confirmed == EXPIRED_CLIENT_ID)
 		return 0;
 
-	if (clientid->cid_lease_reservations != 0)
+	if (atomic_fetch_int32_t(&clientid->cid_lease_reservations) > 0)
 		return nfs_param.nfsv4_param.lease_lifetime;
 
-	t = time(NULL);
-
-	if (clientid->cid_last_renew + nfs_param.nfsv4_param.lease_lifetime > t)
-		return (clientid->cid_last_renew +
-			nfs_param.nfsv4_param.lease_lifetime) - t;
-
-	return 0;
+	return lease_time_left(clientid);
 }
 
 /**
@@ -96,11 +266,40 @@ bool valid_lease(nfs_client_id_t *clientid)
 }
 
 /**
- * @brief Check if lease is valid and reserve it and retain cid_mutex.
+ * @brief Freeze a lease that ran out, for the reaper to expire it
+ *
+ * A lease neither reserved nor renewed in time is frozen, which fails
+ * every reservation from then on.  Otherwise it is left as is.
+ *
+ * @note The cid_mutex MUST be held
+ *
+ * @param[in] clientid Record to check lease for.
+ *
+ * @return true if the lease ran out and is now frozen.
+ */
+bool freeze_expired_lease(nfs_client_id_t *clientid)
+{
+	if (atomic_sub_int32_t(&clientid->cid_lease_reservations,
+			       LEASE_FROZEN_BIAS) != -LEASE_FROZEN_BIAS ||
+	    valid_lease(clientid)) {
+		/* Reserved meanwhile, or renewed since */
+		(void) atomic_add_int32_t(&clientid->cid_lease_reservations,
+					  LEASE_FROZEN_BIAS);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Check if lease is valid and reserve it.
  *
  * Lease reservation prevents any other thread from expiring the lease. Caller
  * must call update lease to release the reservation.
  *
+ * The cid_mutex is not needed: only a lease the reaper is busy with sends
+ * the caller through it.  The caller must not hold it either.
+ *
  * @param[in] clientid Client record to check lease for
  *
  * @return 1 if lease is valid, 0 if not.
@@ -108,13 +307,39 @@ bool valid_lease(nfs_client_id_t *clientid)
  */
 int reserve_lease(nfs_client_id_t *clientid)
 {
-	unsigned int valid;
+	unsigned int valid = 0;
+	int32_t reservations;
 
-	valid = _valid_lease(clientid);
+	while ((reservations =
+		atomic_inc_int32_t(&clientid->cid_lease_reservations)) <= 0) {
+		/* Frozen, wait for the reaper to make up its mind */
+		(void) atomic_dec_int32_t(&clientid->cid_lease_reservations);
+
+		PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+		reservations =
+			atomic_fetch_int32_t(&clientid->cid_lease_reservations);
+		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+		if (reservations < 0)
+			goto out;
+	}
+
+	/* Only the first reservation checks the renewal time, any other
+	 * rides on a lease already held valid.  At worst a lease that ran
+	 * out is revived by racing requests before the reaper froze it,
+	 * which the reaper, having the last word, simply sees as renewed.
+	 */
+	if (clientid->cid_confirmed == EXPIRED_CLIENT_ID)
+		valid = 0;
+	else if (reservations > 1)
+		valid = nfs_param.nfsv4_param.lease_lifetime;
+	else
+		valid = lease_time_left(clientid);
 
-	if (valid != 0)
-		clientid->cid_lease_reservations++;
+	if (valid == 0)
+		(void) atomic_dec_int32_t(&clientid->cid_lease_reservations);
 
+ out:
 	if (isFullDebug(COMPONENT_CLIENTID)) {
 		char str[LOG_BUFF_LEN] = "\0";
 		struct display_buffer dspbuf = {sizeof(str), str, str};
@@ -132,21 +357,22 @@ int reserve_lease(nfs_client_id_t *clientid)
  * @brief Release a lease reservation and update lease.
  *
  * Lease reservation prevents any other thread from expiring the lease. This
- * function releases the lease reservation. Before releasing the last
- * reservation, cid_last_renew will be updated.
+ * function releases the lease reservation, renewing cid_last_renew first so
+ * the reaper never sees the lease unreserved and stale.  The renewal is only
+ * written once a second, to keep the clientid's cache line quiet under many
+ * concurrent requests.
  *
  * @param[in] clientid Clientid record to update
  *
- * @return 1 if lease is valid, 0 if not.
- *
  */
 void update_lease(nfs_client_id_t *clientid)
 {
-	clientid->cid_lease_reservations--;
+	time_t now = time(NULL);
+
+	if (atomic_fetch_time_t(&clientid->cid_last_renew) != now)
+		atomic_store_time_t(&clientid->cid_last_renew, now);
 
-	/* Renew lease when last reservation is released */
-	if (clientid->cid_lease_reservations == 0)
-		clientid->cid_last_renew = time(NULL);
+	(void) atomic_dec_int32_t(&clientid->cid_lease_reservations);
 
 	if (isFullDebug(COMPONENT_CLIENTID)) {
 		char str[LOG_BUFF_LEN] = "\0";
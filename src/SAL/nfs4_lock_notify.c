@@ -0,0 +1,298 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @defgroup SAL State abstraction layer
+ * @{
+ */
+
+/**
+ * @file  nfs4_lock_notify.c
+ * @brief CB_NOTIFY_LOCK for NFSv4.1 blocking locks
+ *
+ * NFSv4 has no blocked lock queue, a client denied a READW_LT or
+ * WRITEW_LT lock polls for it.  We remember such requests and send
+ * CB_NOTIFY_LOCK (RFC 5661, 20.11) as soon as an overlapping lock is
+ * released, so the client retries right away.  A waiter is dropped once
+ * notified, once its owner gets the lock or after two leases.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "nfs4.h"
+#include "sal_functions.h"
+#include "nfs_rpc_callback.h"
+#include "abstract_atomic.h"
+
+/** Most waiters remembered at once */
+#define NFS4_LOCK_WAITERS_MAX 1024
+
+struct nfs4_lock_waiter {
+	struct glist_head list;
+	nfs_client_id_t *clientid;	/*< Client to notify, referenced */
+	state_owner_t *owner;		/*< Compared only, not referenced */
+	fsal_fsid_t fsid;
+	uint64_t fileid;
+	fsal_lock_param_t lock;
+	time_t expire;
+	nfs_cb_argop4 arg;
+	char fh[NFS4_FHSIZE];
+	char owner_val[NFS4_OPAQUE_LIMIT];
+};
+
+static struct glist_head lock_waiters = GLIST_HEAD_INIT(lock_waiters);
+static pthread_mutex_t lock_waiters_mtx = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t lock_waiters_count;
+
+static void free_lock_waiter(struct nfs4_lock_waiter *waiter)
+{
+	dec_client_id_ref(waiter->clientid);
+	gsh_free(waiter);
+}
+
+static bool waiter_on_file(struct nfs4_lock_waiter *waiter,
+			   struct fsal_obj_handle *obj)
+{
+	return waiter->fileid == obj->fileid &&
+	       waiter->fsid.major == obj->fsid.major &&
+	       waiter->fsid.minor == obj->fsid.minor;
+}
+
+static bool locks_overlap(fsal_lock_param_t *l1, fsal_lock_param_t *l2)
+{
+	if (l1->lock_length != 0 &&
+	    l1->lock_start + l1->lock_length <= l2->lock_start)
+		return false;
+
+	if (l2->lock_length != 0 &&
+	    l2->lock_start + l2->lock_length <= l1->lock_start)
+		return false;
+
+	return true;
+}
+
+/**
+ * @brief Remove a waiter, lock_waiters_mtx must be held
+ */
+static void unlink_lock_waiter(struct nfs4_lock_waiter *waiter)
+{
+	glist_del(&waiter->list);
+	(void) atomic_dec_uint32_t(&lock_waiters_count);
+}
+
+/**
+ * @brief Drop expired waiters, lock_waiters_mtx must be held
+ */
+static void expire_lock_waiters(struct glist_head *freelist)
+{
+	struct glist_head *glist, *glistn;
+	struct nfs4_lock_waiter *waiter;
+	time_t now = time(NULL);
+
+	glist_for_each_safe(glist, glistn, &lock_waiters) {
+		waiter = glist_entry(glist, struct nfs4_lock_waiter, list);
+
+		if (waiter->expire > now)
+			continue;
+
+		unlink_lock_waiter(waiter);
+		glist_add_tail(freelist, &waiter->list);
+	}
+}
+
+static void free_lock_waiters(struct glist_head *freelist)
+{
+	struct nfs4_lock_waiter *waiter;
+
+	while ((waiter = glist_first_entry(freelist, struct nfs4_lock_waiter,
+					   list)) != NULL) {
+		glist_del(&waiter->list);
+		free_lock_waiter(waiter);
+	}
+}
+
+void nfs4_lock_notify_wait(nfs_client_id_t *clientid,
+			   state_owner_t *owner,
+			   struct fsal_obj_handle *obj,
+			   nfs_fh4 *fh,
+			   fsal_lock_param_t *lock)
+{
+	struct state_nfs4_owner_t *nfs4_owner = &owner->so_owner.so_nfs4_owner;
+	struct glist_head freelist = GLIST_HEAD_INIT(freelist);
+	struct nfs4_lock_waiter *waiter;
+	struct glist_head *glist;
+	time_t expire = time(NULL) +
+			2 * nfs_param.nfsv4_param.lease_lifetime;
+
+	if (clientid == NULL || clientid->cid_minorversion == 0 ||
+	    fh->nfs_fh4_len > NFS4_FHSIZE ||
+	    owner->so_owner_len > NFS4_OPAQUE_LIMIT)
+		return;
+
+	PTHREAD_MUTEX_lock(&lock_waiters_mtx);
+
+	expire_lock_waiters(&freelist);
+
+	/* A client polling for its lock refreshes its waiter */
+	glist_for_each(glist, &lock_waiters) {
+		waiter = glist_entry(glist, struct nfs4_lock_waiter, list);
+
+		if (waiter->owner == owner && waiter_on_file(waiter, obj) &&
+		    waiter->lock.lock_start == lock->lock_start &&
+		    waiter->lock.lock_length == lock->lock_length) {
+			waiter->lock.lock_type = lock->lock_type;
+			waiter->expire = expire;
+			goto out;
+		}
+	}
+
+	if (lock_waiters_count >= NFS4_LOCK_WAITERS_MAX) {
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "Too many lock waiters, client will poll");
+		goto out;
+	}
+
+	waiter = gsh_calloc(1, sizeof(*waiter));
+	waiter->clientid = clientid;
+	inc_client_id_ref(clientid);
+	waiter->owner = owner;
+	waiter->fsid = obj->fsid;
+	waiter->fileid = obj->fileid;
+	waiter->lock = *lock;
+	waiter->expire = expire;
+
+	memcpy(waiter->fh, fh->nfs_fh4_val, fh->nfs_fh4_len);
+	memcpy(waiter->owner_val, owner->so_owner_val, owner->so_owner_len);
+
+	waiter->arg.argop = NFS4_OP_CB_NOTIFY_LOCK;
+	waiter->arg.nfs_cb_argop4_u.opcbnotify_lock.cnla_fh.nfs_fh4_len =
+		fh->nfs_fh4_len;
+	waiter->arg.nfs_cb_argop4_u.opcbnotify_lock.cnla_fh.nfs_fh4_val =
+		waiter->fh;
+	waiter->arg.nfs_cb_argop4_u.opcbnotify_lock.cnla_lock_owner.clientid =
+		nfs4_owner->so_clientid;
+	waiter->arg.nfs_cb_argop4_u.opcbnotify_lock.cnla_lock_owner.owner
+		.owner_len = owner->so_owner_len;
+	waiter->arg.nfs_cb_argop4_u.opcbnotify_lock.cnla_lock_owner.owner
+		.owner_val = waiter->owner_val;
+
+	glist_add_tail(&lock_waiters, &waiter->list);
+	(void) atomic_inc_uint32_t(&lock_waiters_count);
+
+	LogLock(COMPONENT_NFS_V4_LOCK, NIV_FULL_DEBUG,
+		"Will notify lock", obj, owner, lock);
+
+ out:
+	PTHREAD_MUTEX_unlock(&lock_waiters_mtx);
+
+	free_lock_waiters(&freelist);
+}
+
+void nfs4_lock_notify_granted(state_owner_t *owner,
+			      struct fsal_obj_handle *obj)
+{
+	struct glist_head freelist = GLIST_HEAD_INIT(freelist);
+	struct glist_head *glist, *glistn;
+	struct nfs4_lock_waiter *waiter;
+
+	if (atomic_fetch_uint32_t(&lock_waiters_count) == 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&lock_waiters_mtx);
+
+	glist_for_each_safe(glist, glistn, &lock_waiters) {
+		waiter = glist_entry(glist, struct nfs4_lock_waiter, list);
+
+		if (waiter->owner != owner || !waiter_on_file(waiter, obj))
+			continue;
+
+		unlink_lock_waiter(waiter);
+		glist_add_tail(&freelist, &waiter->list);
+	}
+
+	PTHREAD_MUTEX_unlock(&lock_waiters_mtx);
+
+	free_lock_waiters(&freelist);
+}
+
+static int32_t notify_lock_completion(rpc_call_t *call, rpc_call_hook hook,
+				      void *arg, uint32_t flags)
+{
+	struct nfs4_lock_waiter *waiter = arg;
+
+	LogFullDebug(COMPONENT_NFS_CB, "CB_NOTIFY_LOCK %p %s", waiter,
+		     hook == RPC_CALL_COMPLETE ? "delivered" : "failed");
+
+	free_lock_waiter(waiter);
+	return 0;
+}
+
+void nfs4_lock_notify_release(struct fsal_obj_handle *obj,
+			      fsal_lock_param_t *lock)
+{
+	struct glist_head notify = GLIST_HEAD_INIT(notify);
+	struct glist_head freelist = GLIST_HEAD_INIT(freelist);
+	struct glist_head *glist, *glistn;
+	struct nfs4_lock_waiter *waiter;
+
+	if (atomic_fetch_uint32_t(&lock_waiters_count) == 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&lock_waiters_mtx);
+
+	expire_lock_waiters(&freelist);
+
+	glist_for_each_safe(glist, glistn, &lock_waiters) {
+		waiter = glist_entry(glist, struct nfs4_lock_waiter, list);
+
+		if (!waiter_on_file(waiter, obj) ||
+		    !locks_overlap(&waiter->lock, lock))
+			continue;
+
+		unlink_lock_waiter(waiter);
+		glist_add_tail(&notify, &waiter->list);
+	}
+
+	PTHREAD_MUTEX_unlock(&lock_waiters_mtx);
+
+	free_lock_waiters(&freelist);
+
+	while ((waiter = glist_first_entry(&notify, struct nfs4_lock_waiter,
+					   list)) != NULL) {
+		glist_del(&waiter->list);
+
+		LogFullDebug(COMPONENT_NFS_CB,
+			     "CB_NOTIFY_LOCK %p to clientid %" PRIx64,
+			     waiter, waiter->clientid->cid_clientid);
+
+		if (get_cb_chan_down(waiter->clientid) ||
+		    nfs_rpc_v41_single(waiter->clientid, &waiter->arg, NULL,
+				       notify_lock_completion, waiter,
+				       NULL) != 0)
+			free_lock_waiter(waiter);
+	}
+}
+
+/** @} */
@@ -41,17 +41,81 @@
 #include "bsd-base64.h"
 #include "client_mgr.h"
 #include "fsal.h"
+#include "fridgethr.h"
 
 #define NFS_V4_RECOV_DIR "v4recov"
 #define NFS_V4_OLD_DIR "v4old"
 
+/** Most threads helping to read a recovery directory */
+#define RECOV_LOAD_THREADS 7
+
+/** Clients read in by a thread before another one helps */
+#define RECOV_LOAD_BATCH 256
+
 char v4_recov_dir[PATH_MAX];
 char v4_old_dir[PATH_MAX];
 time_t current_grace;
 pthread_mutex_t grace_mutex = PTHREAD_MUTEX_INITIALIZER;        /*< Mutex */
 struct glist_head clid_list = GLIST_HEAD_INIT(clid_list);  /*< Clients */
 
+/** Clients in clid_list, and those of them done reclaiming.  Protected
+ *  by grace_mutex.
+ */
+static uint32_t clid_count;
+static uint32_t reclaim_completes;
+
+/** Whether the grace period may end once all clients reclaimed.
+ *  Protected by grace_mutex.
+ */
+static bool grace_liftable;
+
+/** The stable storage in use, set by nfs4_recovery_init */
+static struct nfs4_recovery_backend *recovery_backend = &fs_backend;
+
+/**
+ * @brief A change of the stable storage, waiting to be written
+ */
+enum recov_op_type {
+	RECOV_ADD_CLID,
+	RECOV_RM_CLID,
+	RECOV_ADD_REVOKE,
+};
+
+struct recov_op {
+	struct glist_head rop_list;	/*< Link in the writer queue */
+	enum recov_op_type rop_type;
+	char *rop_name;			/*< Client name */
+	char *rop_fh;			/*< Revoked handle, as base64 */
+};
+
+/**
+ * @brief Writer of the stable storage
+ *
+ * Changes are queued in order and written in batches, each made
+ * durable by a single sync of the backend.  Whoever needs a change
+ * on stable storage writes the whole queue unless a batch is already
+ * being written, in which case it waits and the next batch is written
+ * for everybody who queued in the meantime.
+ */
+static struct {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	struct glist_head queue;	/*< Changes not written yet */
+	uint64_t queued;		/*< Sequence of the last change queued */
+	uint64_t done;			/*< Sequence of the last change synced */
+	bool writing;			/*< A batch is being written */
+	bool kicked;			/*< The fridge was asked to write */
+} recov_writer = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.cv = PTHREAD_COND_INITIALIZER,
+	.queue = GLIST_HEAD_INIT(recov_writer.queue),
+};
+
+/** Writes changes nobody waits for */
+static struct fridgethr *recov_fridge;
+
 static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp);
+static void nfs_try_lift_grace_locked(void);
 static void nfs_release_nlm_state(char *release_ip);
 static void nfs_release_v4_client(char *ip);
 
@@ -91,6 +155,17 @@ void nfs4_start_grace(nfs_grace_start_t *gsp)
 
 	LogEvent(COMPONENT_STATE, "NFS Server Now IN GRACE, duration %d",
 		 (int)nfs_param.nfsv4_param.grace_period);
+
+	/* The other heads must not grant what our clients may reclaim */
+	nfs4_cluster_grace_mark();
+
+	/* Only the clients read in at startup are known to be all who
+	 * may reclaim: a cluster may yet move clients here, and NLM
+	 * clients reclaim with no RECLAIM_COMPLETE.
+	 */
+	grace_liftable = gsp == NULL && !nfs_param.core_param.clustered &&
+			 !nfs_param.core_param.enable_NLM;
+
 	/*
 	 * if called from failover code and given a nodeid, then this node
 	 * is doing a take over.  read in the client ids from the failing node
@@ -110,12 +185,102 @@ void nfs4_start_grace(nfs_grace_start_t *gsp)
 				nfs4_load_recov_clids_nolock(gsp);
 		}
 	}
+
+	nfs_try_lift_grace_locked();
+
+	PTHREAD_MUTEX_unlock(&grace_mutex);
+}
+
+/**
+ * @brief End the grace period if no client is left to reclaim
+ *
+ * @note grace_mutex MUST be held
+ */
+static void nfs_try_lift_grace_locked(void)
+{
+	if (!grace_liftable || reclaim_completes < clid_count ||
+	    !nfs_in_grace())
+		return;
+
+	LogEvent(COMPONENT_STATE,
+		 "NFS Server lifting GRACE, %"PRIu32" of %"PRIu32
+		 " clients reclaimed",
+		 reclaim_completes, clid_count);
+
+	atomic_store_time_t(&current_grace, 0);
+	grace_liftable = false;
+}
+
+/**
+ * @brief Note a client sent RECLAIM_COMPLETE
+ *
+ * The grace period ends as soon as all clients that may reclaim are
+ * done with it.
+ *
+ * @param[in] clientid Client record
+ */
+void nfs4_recovery_reclaim_complete(nfs_client_id_t *clientid)
+{
+	clid_entry_t *clid_ent;
+
+	if (!nfs_in_grace())
+		return;
+
+	PTHREAD_MUTEX_lock(&grace_mutex);
+
+	nfs4_chk_clid_impl(clientid, &clid_ent);
+	if (clid_ent != NULL && !clid_ent->cl_reclaimed) {
+		clid_ent->cl_reclaimed = true;
+		reclaim_completes++;
+		nfs_try_lift_grace_locked();
+	}
+
+	PTHREAD_MUTEX_unlock(&grace_mutex);
+}
+
+/**
+ * @brief Report where the grace period stands
+ *
+ * @param[out] remaining Seconds of grace left, 0 when not in grace
+ * @param[out] clients   Clients that may reclaim
+ * @param[out] reclaimed Clients of those done reclaiming
+ */
+void nfs_grace_status(uint32_t *remaining, uint32_t *clients,
+		      uint32_t *reclaimed)
+{
+	time_t end;
+	time_t now = time(NULL);
+
+	PTHREAD_MUTEX_lock(&grace_mutex);
+
+	end = atomic_fetch_time_t(&current_grace) +
+	      nfs_param.nfsv4_param.grace_period;
+	*remaining = nfs_in_grace() && end > now ? end - now : 0;
+	*clients = clid_count;
+	*reclaimed = reclaim_completes;
+
 	PTHREAD_MUTEX_unlock(&grace_mutex);
 }
 
+/**
+ * @brief Check if our own grace period runs
+ *
+ * Leaves out the other heads of a cluster, see nfs4_cluster_grace.c.
+ */
+bool nfs_in_local_grace(void)
+{
+	if (nfs_param.nfsv4_param.graceless)
+		return false;
+
+	return (atomic_fetch_time_t(&current_grace) +
+		nfs_param.nfsv4_param.grace_period) > time(NULL);
+}
+
 /**
  * @brief Check if we are in the grace period
  *
+ * We are as long as any head of the cluster is.
+ *
  * @retval true if so.
  * @retval false if not.
  */
@@ -127,8 +292,7 @@ int nfs_in_grace(void)
 	if (nfs_param.nfsv4_param.graceless)
 		return 0;
 
-	in_grace = ((atomic_fetch_time_t(&current_grace) +
-		     nfs_param.nfsv4_param.grace_period) > time(NULL));
+	in_grace = nfs_in_local_grace() || nfs4_cluster_in_grace();
 
 	if (in_grace != last_grace) {
 		LogEvent(COMPONENT_STATE, "NFS Server Now %s",
@@ -241,44 +405,296 @@ void nfs4_create_clid_name(nfs_client_record_t *cl_rec,
 }
 
 /**
- * @brief Create an entry in the recovery directory
+ * @brief Write a batch of changes and make them durable
+ *
+ * @param[in] batch Changes, freed here
+ */
+static void recov_write_batch(struct glist_head *batch)
+{
+	struct recov_op *op;
+
+	if (glist_empty(batch))
+		return;
+
+	while ((op = glist_first_entry(batch, struct recov_op,
+				       rop_list)) != NULL) {
+		glist_del(&op->rop_list);
+
+		switch (op->rop_type) {
+		case RECOV_ADD_CLID:
+			recovery_backend->add_clid(op->rop_name);
+			break;
+		case RECOV_RM_CLID:
+			recovery_backend->rm_clid(op->rop_name);
+			break;
+		case RECOV_ADD_REVOKE:
+			recovery_backend->add_revoke_fh(op->rop_name,
+							op->rop_fh);
+			break;
+		}
+
+		gsh_free(op->rop_name);
+		gsh_free(op->rop_fh);
+		gsh_free(op);
+	}
+
+	recovery_backend->sync();
+}
+
+/**
+ * @brief Take the writer and write out what is queued
+ *
+ * @note recov_writer.mtx MUST be held, it is dropped while writing.
+ *
+ * @return Sequence of the last change written.
+ */
+static uint64_t recov_writer_take(void)
+{
+	struct glist_head batch;
+	uint64_t mine;
+
+	while (recov_writer.writing)
+		pthread_cond_wait(&recov_writer.cv, &recov_writer.mtx);
+
+	recov_writer.writing = true;
+	mine = recov_writer.queued;
+	glist_init(&batch);
+	glist_splice_tail(&batch, &recov_writer.queue);
+	PTHREAD_MUTEX_unlock(&recov_writer.mtx);
+
+	recov_write_batch(&batch);
+
+	PTHREAD_MUTEX_lock(&recov_writer.mtx);
+
+	return mine;
+}
+
+/**
+ * @brief Give the writer back
+ *
+ * @note recov_writer.mtx MUST be held
+ *
+ * @param[in] mine Sequence of the last change written
+ */
+static void recov_writer_give(uint64_t mine)
+{
+	recov_writer.done = mine;
+	recov_writer.writing = false;
+	pthread_cond_broadcast(&recov_writer.cv);
+}
+
+/**
+ * @brief Wait until a change is on stable storage
+ *
+ * @param[in] target Sequence of the change
+ */
+static void recov_writer_flush(uint64_t target)
+{
+	PTHREAD_MUTEX_lock(&recov_writer.mtx);
+
+	while (recov_writer.done < target) {
+		if (recov_writer.writing) {
+			pthread_cond_wait(&recov_writer.cv, &recov_writer.mtx);
+			continue;
+		}
+		recov_writer_give(recov_writer_take());
+	}
+
+	PTHREAD_MUTEX_unlock(&recov_writer.mtx);
+}
+
+static void recov_writer_run(struct fridgethr_context *ctx)
+{
+	uint64_t target;
+
+	PTHREAD_MUTEX_lock(&recov_writer.mtx);
+	recov_writer.kicked = false;
+	target = recov_writer.queued;
+	PTHREAD_MUTEX_unlock(&recov_writer.mtx);
+
+	recov_writer_flush(target);
+}
+
+/**
+ * @brief Have a change written without waiting for it
+ *
+ * @param[in] seq Sequence of the change
+ */
+static void recov_writer_kick(uint64_t seq)
+{
+	PTHREAD_MUTEX_lock(&recov_writer.mtx);
+	if (recov_writer.kicked) {
+		PTHREAD_MUTEX_unlock(&recov_writer.mtx);
+		return;
+	}
+	recov_writer.kicked = true;
+	PTHREAD_MUTEX_unlock(&recov_writer.mtx);
+
+	if (recov_fridge != NULL &&
+	    fridgethr_submit(recov_fridge, recov_writer_run, NULL) == 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&recov_writer.mtx);
+	recov_writer.kicked = false;
+	PTHREAD_MUTEX_unlock(&recov_writer.mtx);
+
+	recov_writer_flush(seq);
+}
+
+/**
+ * @brief Queue a change of the stable storage
+ *
+ * @param[in] type Change
+ * @param[in] name Client name
+ * @param[in] fh   Revoked handle, for RECOV_ADD_REVOKE
+ *
+ * @return Sequence of the change.
+ */
+static uint64_t recov_queue(enum recov_op_type type, const char *name,
+			    const char *fh)
+{
+	struct recov_op *op = gsh_malloc(sizeof(*op));
+	uint64_t seq;
+
+	op->rop_type = type;
+	op->rop_name = gsh_strdup(name);
+	op->rop_fh = fh != NULL ? gsh_strdup(fh) : NULL;
+
+	PTHREAD_MUTEX_lock(&recov_writer.mtx);
+	glist_add_tail(&recov_writer.queue, &op->rop_list);
+	seq = ++recov_writer.queued;
+	PTHREAD_MUTEX_unlock(&recov_writer.mtx);
+
+	return seq;
+}
+
+/**
+ * @brief Record a client on stable storage
  *
- * This entry alows the client to reclaim state after a server
- * reboot/restart.
+ * This allows the client to reclaim state after a server
+ * reboot/restart.  The record is written in the background with
+ * those of the other clients confirmed meanwhile, nfs4_wait_clid()
+ * waits for it before the client gets any state.  A reconnect storm
+ * thus costs a sync per batch and does not hold workers.
  *
  * @param[in] clientid Client record
  */
 void nfs4_add_clid(nfs_client_id_t *clientid)
+{
+	uint64_t seq;
+
+	nfs4_create_clid_name(clientid->cid_client_record, clientid);
+
+	if (clientid->cid_recov_dir == NULL)
+		return;
+
+	seq = recov_queue(RECOV_ADD_CLID, clientid->cid_recov_dir, NULL);
+	atomic_store_uint64_t(&clientid->cid_recov_seq, seq);
+	recov_writer_kick(seq);
+}
+
+/**
+ * @brief Wait until a client is on stable storage
+ *
+ * Must be called before the client is given state.  Only the first
+ * call may wait, the record is usually written by then.
+ *
+ * @param[in] clientid Client record
+ */
+void nfs4_wait_clid(nfs_client_id_t *clientid)
+{
+	uint64_t seq = atomic_fetch_uint64_t(&clientid->cid_recov_seq);
+
+	if (seq == 0)
+		return;
+
+	recov_writer_flush(seq);
+	atomic_store_uint64_t(&clientid->cid_recov_seq, 0);
+}
+
+/**
+ * @brief Remove a client from stable storage
+ *
+ * This function would be called when a client expires.  Nothing
+ * waits for the removal: until it is written the client merely
+ * keeps the right to reclaim after a restart.
+ *
+ * @param[in] clientid Client record
+ */
+void nfs4_rm_clid(nfs_client_id_t *clientid)
+{
+	if (clientid->cid_recov_dir == NULL)
+		return;
+
+	recov_writer_kick(recov_queue(RECOV_RM_CLID,
+				      clientid->cid_recov_dir, NULL));
+}
+
+/**
+ * @brief Sync a directory
+ *
+ * @param[in] path Directory
+ */
+static void fs_sync_dir(const char *path)
+{
+	int fd = open(path, O_RDONLY | O_DIRECTORY);
+
+	if (fd < 0 || fsync(fd) < 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to sync recovery dir (%s), errno=%d",
+			 path, errno);
+	if (fd >= 0)
+		close(fd);
+}
+
+/**
+ * @brief Create an entry in the recovery directory
+ *
+ * Levels under the first are synced here, the first one is synced
+ * with the rest of the batch by fs_sync.
+ *
+ * @param[in] cl_name Client name
+ */
+static void fs_add_clid(const char *cl_name)
 {
 	int err = 0;
 	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
 	int length, position = 0;
-
-	nfs4_create_clid_name(clientid->cid_client_record, clientid);
+	size_t parent;
 
 	/* break clientid down if it is greater than max dir name */
 	/* and create a directory hierachy to represent the clientid. */
 	snprintf(path, sizeof(path), "%s", v4_recov_dir);
 
-	length = strlen(clientid->cid_recov_dir);
+	length = strlen(cl_name);
 	while (position < length) {
 		/* if the (remaining) clientid is shorter than 255 */
 		/* create the last level of dir and break out */
-		int len = strlen(&clientid->cid_recov_dir[position]);
+		int len = strlen(&cl_name[position]);
 
+		parent = strlen(path);
 		if (len <= NAME_MAX) {
 			strcat(path, "/");
-			strncat(path, &clientid->cid_recov_dir[position], len);
+			strncat(path, &cl_name[position], len);
 			err = mkdir(path, 0700);
-			break;
+		} else {
+			/* if (remaining) clientid is longer than 255, */
+			/* get the next 255 bytes and create a subdir */
+			strncpy(segment, &cl_name[position], NAME_MAX);
+			strcat(path, "/");
+			strncat(path, segment, NAME_MAX);
+			err = mkdir(path, 0700);
+			if (err == -1 && errno != EEXIST)
+				break;
 		}
-		/* if (remaining) clientid is longer than 255, */
-		/* get the next 255 bytes and create a subdir */
-		strncpy(segment, &clientid->cid_recov_dir[position], NAME_MAX);
-		strcat(path, "/");
-		strncat(path, segment, NAME_MAX);
-		err = mkdir(path, 0700);
-		if (err == -1 && errno != EEXIST)
+
+		if (err == 0 && position > 0) {
+			path[parent] = '\0';
+			fs_sync_dir(path);
+			path[parent] = '/';
+		}
+
+		if (len <= NAME_MAX)
 			break;
 		position += NAME_MAX;
 	}
@@ -334,11 +750,12 @@ void nfs4_rm_revoked_handles(char *path)
 /**
  * @brief Remove a client entry from the recovery directory
  *
- * This function would be called when a client expires.
- *
- * @param[in] recov_dir Recovery directory
+ * @param[in] recov_dir   Client name
+ * @param[in] parent_path Directory holding the next level
+ * @param[in] position    Position of the next level in the name
  */
-void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
+static void fs_rm_clid_path(const char *recov_dir, char *parent_path,
+			    int position)
 {
 	int err;
 	char *path;
@@ -377,7 +794,7 @@ void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
 	/* recursively remove the directory hirerchy which represent the
 	 *clientid
 	 */
-	nfs4_rm_clid(recov_dir, path, position+segment_len);
+	fs_rm_clid_path(recov_dir, path, position+segment_len);
 
 	err = rmdir(path);
 	if (err == -1) {
@@ -390,6 +807,11 @@ void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
 	gsh_free(path);
 }
 
+static void fs_rm_clid(const char *cl_name)
+{
+	fs_rm_clid_path(cl_name, v4_recov_dir, 0);
+}
+
 /**
  * @brief Determine whether or not this client may reclaim state
  *
@@ -557,37 +979,36 @@ void nfs4_cp_pop_revoked_delegs(clid_entry_t *clid_ent,
 }
 
 
+static int nfs4_read_recov_clids(DIR *dp,
+				 const char *parent_path,
+				 char *clid_str,
+				 char *tgtdir,
+				 int takeover,
+				 struct glist_head *list);
+
 /**
- * @brief Create the client reclaim list
+ * @brief Read a client, or a level of its name, from a recovery directory
  *
- * When not doing a take over, first open the old state dir and read
- * in those entries.  The reason for the two directories is in case of
- * a reboot/restart during grace period.  Next, read in entries from
- * the recovery directory and then move them into the old state
- * directory.  if called due to a take over, nodeid will be nonzero.
- * in this case, add that node's clientids to the existing list.  Then
- * move those entries into the old state directory.
- *
- * @param[in] dp       Recovery directory
- * @param[in] srcdir   Path to the source directory on failover
- * @param[in] takeover Whether this is a takeover.
- *
- * @return POSIX error codes.
+ * @param[in]     d_name      Entry of the directory
+ * @param[in]     parent_path Path to the directory
+ * @param[in]     clid_str    Client name read so far, or NULL
+ * @param[in]     tgtdir      Directory to copy the entry to, or NULL
+ * @param[in]     takeover    Whether this is a takeover.
+ * @param[in,out] list        Clients read
  */
-static int nfs4_read_recov_clids(DIR *dp,
+static void nfs4_read_recov_clid(const char *d_name,
 				 const char *parent_path,
 				 char *clid_str,
 				 char *tgtdir,
-				 int takeover)
+				 int takeover,
+				 struct glist_head *list)
 {
-	struct dirent *dentp;
 	DIR *subdp;
 	clid_entry_t *new_ent;
 	char *path = NULL;
 	char *new_path = NULL;
 	char *build_clid = NULL;
 	int rc = 0;
-	int num = 0;
 	char *ptr, *ptr2;
 	char temp[10];
 	int cid_len, len;
@@ -596,188 +1017,415 @@ static int nfs4_read_recov_clids(DIR *dp,
 	int total_tgt_len;
 	int total_clid_len;
 
-	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
-		/* don't add '.' and '..' entry */
-		if (!strcmp(dentp->d_name, ".") || !strcmp(dentp->d_name, ".."))
-			continue;
-
-		/* Skip names that start with '\x1' as they are files
-		 * representing revoked file handles
-		 */
-		if (dentp->d_name[0] == '\x1')
-			continue;
+	/* construct the path by appending the subdir for the
+	 * next readdir. This recursion keeps reading the
+	 * subdirectory until reaching the end.
+	 */
+	segment_len = strlen(d_name);
+	total_len = segment_len + 2 + strlen(parent_path);
+	path = gsh_malloc(total_len);
 
-		num++;
-		new_path = NULL;
+	memset(path, 0, total_len);
 
-		/* construct the path by appending the subdir for the
-		 * next readdir. This recursion keeps reading the
-		 * subdirectory until reaching the end.
+	strcpy(path, parent_path);
+	strcat(path, "/");
+	strncat(path, d_name, segment_len);
+	/* if tgtdir is not NULL, we need to build
+	 * nfs4old/currentnode
+	 */
+	if (tgtdir) {
+		total_tgt_len = segment_len + 2 +
+				strlen(tgtdir);
+		new_path = gsh_malloc(total_tgt_len);
+
+		memset(new_path, 0, total_tgt_len);
+		strcpy(new_path, tgtdir);
+		strcat(new_path, "/");
+		strncat(new_path, d_name, segment_len);
+		rc = mkdir(new_path, 0700);
+		if ((rc == -1) && (errno != EEXIST)) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "mkdir %s faied errno=%d",
+				 new_path, errno);
+		}
+	}
+	/* keep building the clientid str by cursively */
+	/* reading the directory structure */
+	if (clid_str)
+		total_clid_len = segment_len + 1 +
+				 strlen(clid_str);
+	else
+		total_clid_len = segment_len + 1;
+	build_clid = gsh_malloc(total_clid_len);
+
+	memset(build_clid, 0, total_clid_len);
+	if (clid_str)
+		strcpy(build_clid, clid_str);
+	strncat(build_clid, d_name, segment_len);
+	subdp = opendir(path);
+	if (subdp == NULL) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "opendir %s failed errno=%d",
+			 d_name, errno);
+		free_heap(path, new_path, build_clid);
+		/* this shouldn't happen, but we should skip
+		 * the entry to avoid infinite loops
 		 */
-		segment_len = strlen(dentp->d_name);
-		total_len = segment_len + 2 + strlen(parent_path);
-		path = gsh_malloc(total_len);
+		return;
+	}
 
-		memset(path, 0, total_len);
+	if (tgtdir)
+		rc = nfs4_read_recov_clids(subdp,
+					   path,
+					   build_clid,
+					   new_path,
+					   takeover,
+					   list);
+	else
+		rc = nfs4_read_recov_clids(subdp,
+					   path,
+					   build_clid,
+					   NULL,
+					   takeover,
+					   list);
+
+	/* close the sub directory */
+	(void)closedir(subdp);
 
-		strcpy(path, parent_path);
-		strcat(path, "/");
-		strncat(path, dentp->d_name, segment_len);
-		/* if tgtdir is not NULL, we need to build
-		 * nfs4old/currentnode
+	if (new_path)
+		gsh_free(new_path);
+
+	/* after recursion, if the subdir has no non-hidden
+	 * directory this is the end of this clientid str. Add
+	 * the clientstr to the list.
+	 */
+	if (rc == 0) {
+		/* the clid format is
+		 * <IP>-(clid-len:long-form-clid-in-string-form)
+		 * make sure this reconstructed string is valid
+		 * by comparing clid-len and the actual
+		 * long-form-clid length in the string. This is
+		 * to prevent getting incompleted strings that
+		 * might exist due to program crash.
 		 */
-		if (tgtdir) {
-			total_tgt_len = segment_len + 2 +
-					strlen(tgtdir);
-			new_path = gsh_malloc(total_tgt_len);
-
-			memset(new_path, 0, total_tgt_len);
-			strcpy(new_path, tgtdir);
-			strcat(new_path, "/");
-			strncat(new_path, dentp->d_name, segment_len);
-			rc = mkdir(new_path, 0700);
-			if ((rc == -1) && (errno != EEXIST)) {
-				LogEvent(COMPONENT_CLIENTID,
-					 "mkdir %s faied errno=%d",
-					 new_path, errno);
-			}
+		if (strlen(build_clid) >= PATH_MAX) {
+			LogEvent(COMPONENT_CLIENTID,
+				"invalid clid format: %s, too long",
+				build_clid);
+			free_heap(path, NULL, build_clid);
+			return;
 		}
-		/* keep building the clientid str by cursively */
-		/* reading the directory structure */
-		if (clid_str)
-			total_clid_len = segment_len + 1 +
-					 strlen(clid_str);
-		else
-			total_clid_len = segment_len + 1;
-		build_clid = gsh_malloc(total_clid_len);
-
-		memset(build_clid, 0, total_clid_len);
-		if (clid_str)
-			strcpy(build_clid, clid_str);
-		strncat(build_clid, dentp->d_name, segment_len);
-		subdp = opendir(path);
-		if (subdp == NULL) {
+		ptr = strchr(build_clid, '(');
+		if (ptr == NULL) {
 			LogEvent(COMPONENT_CLIENTID,
-				 "opendir %s failed errno=%d",
-				 dentp->d_name, errno);
-			free_heap(path, new_path, build_clid);
-			/* this shouldn't happen, but we should skip
-			 * the entry to avoid infinite loops
-			 */
-			continue;
+				 "invalid clid format: %s",
+				 build_clid);
+			free_heap(path, NULL, build_clid);
+			return;
 		}
-
-		if (tgtdir)
-			rc = nfs4_read_recov_clids(subdp,
-						   path,
-						   build_clid,
-						   new_path,
-						   takeover);
-		else
-			rc = nfs4_read_recov_clids(subdp,
-						   path,
-						   build_clid,
-						   NULL,
-						   takeover);
-
-		/* close the sub directory */
-		(void)closedir(subdp);
-
-		if (new_path)
-			gsh_free(new_path);
-
-		/* after recursion, if the subdir has no non-hidden
-		 * directory this is the end of this clientid str. Add
-		 * the clientstr to the list.
-		 */
-		if (rc == 0) {
-			/* the clid format is
-			 * <IP>-(clid-len:long-form-clid-in-string-form)
-			 * make sure this reconstructed string is valid
-			 * by comparing clid-len and the actual
-			 * long-form-clid length in the string. This is
-			 * to prevent getting incompleted strings that
-			 * might exist due to program crash.
-			 */
-			if (strlen(build_clid) >= PATH_MAX) {
-				LogEvent(COMPONENT_CLIENTID,
-					"invalid clid format: %s, too long",
-					build_clid);
-				free_heap(path, NULL, build_clid);
-				continue;
-			}
-			ptr = strchr(build_clid, '(');
-			if (ptr == NULL) {
-				LogEvent(COMPONENT_CLIENTID,
-					 "invalid clid format: %s",
-					 build_clid);
-				free_heap(path, NULL, build_clid);
-				continue;
-			}
-			ptr2 = strchr(ptr, ':');
-			if (ptr2 == NULL) {
-				LogEvent(COMPONENT_CLIENTID,
-					 "invalid clid format: %s",
-					 build_clid);
-				free_heap(path, NULL, build_clid);
-				continue;
-			}
-			len = ptr2-ptr-1;
-			if (len >= 9) {
-				LogEvent(COMPONENT_CLIENTID,
-					 "invalid clid format: %s",
-					 build_clid);
-				free_heap(path, NULL, build_clid);
-				continue;
-			}
-			strncpy(temp, ptr+1, len);
-			temp[len] = 0;
-			cid_len = atoi(temp);
-			len = strlen(ptr2);
-			if ((len == (cid_len+2)) && (ptr2[len-1] == ')')) {
-				new_ent = gsh_malloc(sizeof(clid_entry_t));
-
-				nfs4_cp_pop_revoked_delegs(new_ent,
-							path,
-							tgtdir,
-							!takeover);
-				strcpy(new_ent->cl_name, build_clid);
-				glist_add(&clid_list,
-					  &new_ent->cl_list);
-				LogDebug(COMPONENT_CLIENTID,
-					 "added %s to clid list",
-					 new_ent->cl_name);
-			}
+		ptr2 = strchr(ptr, ':');
+		if (ptr2 == NULL) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "invalid clid format: %s",
+				 build_clid);
+			free_heap(path, NULL, build_clid);
+			return;
 		}
-		gsh_free(build_clid);
-		/* If this is not for takeover, remove the directory
-		 * hierarchy  that represent the current clientid
-		 */
-		if (!takeover) {
-			rc = rmdir(path);
-			if (rc == -1) {
-				LogEvent(COMPONENT_CLIENTID,
-					 "Failed to rmdir (%s), errno=%d",
-					 path, errno);
-			}
+		len = ptr2-ptr-1;
+		if (len >= 9) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "invalid clid format: %s",
+				 build_clid);
+			free_heap(path, NULL, build_clid);
+			return;
+		}
+		strncpy(temp, ptr+1, len);
+		temp[len] = 0;
+		cid_len = atoi(temp);
+		len = strlen(ptr2);
+		if ((len == (cid_len+2)) && (ptr2[len-1] == ')')) {
+			new_ent = gsh_malloc(sizeof(clid_entry_t));
+			new_ent->cl_reclaimed = false;
+
+			nfs4_cp_pop_revoked_delegs(new_ent,
+						path,
+						tgtdir,
+						!takeover);
+			strcpy(new_ent->cl_name, build_clid);
+			glist_add(list, &new_ent->cl_list);
+			LogDebug(COMPONENT_CLIENTID,
+				 "added %s to clid list",
+				 new_ent->cl_name);
 		}
-		gsh_free(path);
+	}
+	gsh_free(build_clid);
+	/* If this is not for takeover, remove the directory
+	 * hierarchy  that represent the current clientid
+	 */
+	if (!takeover) {
+		rc = rmdir(path);
+		if (rc == -1) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to rmdir (%s), errno=%d",
+				 path, errno);
+		}
+	}
+	gsh_free(path);
+}
+
+/**
+ * @brief Read the clients of a level of a recovery directory
+ *
+ * @param[in]     dp          Recovery directory
+ * @param[in]     parent_path Path to the directory
+ * @param[in]     clid_str    Client name read so far, or NULL
+ * @param[in]     tgtdir      Directory to copy the entries to, or NULL
+ * @param[in]     takeover    Whether this is a takeover.
+ * @param[in,out] list        Clients read
+ *
+ * @return Number of entries read.
+ */
+static int nfs4_read_recov_clids(DIR *dp,
+				 const char *parent_path,
+				 char *clid_str,
+				 char *tgtdir,
+				 int takeover,
+				 struct glist_head *list)
+{
+	struct dirent *dentp;
+	int num = 0;
+
+	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
+		/* don't add '.' and '..' entry */
+		if (!strcmp(dentp->d_name, ".") || !strcmp(dentp->d_name, ".."))
+			continue;
+
+		/* Skip names that start with '\x1' as they are files
+		 * representing revoked file handles
+		 */
+		if (dentp->d_name[0] == '\x1')
+			continue;
+
+		num++;
+		nfs4_read_recov_clid(dentp->d_name, parent_path, clid_str,
+				     tgtdir, takeover, list);
 	}
 
 	return num;
 }
 
+/**
+ * @brief Top level of a recovery directory, read in parallel
+ */
+struct recov_load {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	const char *path;	/*< Recovery directory */
+	char *tgtdir;		/*< Directory to copy clients to, or NULL */
+	int takeover;
+	char **names;		/*< Entries of the directory */
+	uint32_t count;		/*< Number of names */
+	uint32_t next;		/*< Next name to read, taken atomically */
+	uint32_t running;	/*< Helpers not done */
+	struct glist_head list;	/*< Clients read */
+};
+
+/** Helps reading recovery directories */
+static struct fridgethr *recov_load_fridge;
+
+static void recov_load_names(struct recov_load *load)
+{
+	struct glist_head list;
+	uint32_t i;
+
+	glist_init(&list);
+
+	while ((i = atomic_postinc_uint32_t(&load->next)) < load->count)
+		nfs4_read_recov_clid(load->names[i], load->path, NULL,
+				     load->tgtdir, load->takeover, &list);
+
+	PTHREAD_MUTEX_lock(&load->mtx);
+	glist_splice_tail(&load->list, &list);
+	PTHREAD_MUTEX_unlock(&load->mtx);
+}
+
+static void recov_load_run(struct fridgethr_context *ctx)
+{
+	struct recov_load *load = ctx->arg;
+
+	recov_load_names(load);
+
+	PTHREAD_MUTEX_lock(&load->mtx);
+	load->running--;
+	pthread_cond_signal(&load->cv);
+	PTHREAD_MUTEX_unlock(&load->mtx);
+}
+
+/**
+ * @brief Create the client reclaim list
+ *
+ * When not doing a take over, first open the old state dir and read
+ * in those entries.  The reason for the two directories is in case of
+ * a reboot/restart during grace period.  Next, read in entries from
+ * the recovery directory and then move them into the old state
+ * directory.  if called due to a take over, nodeid will be nonzero.
+ * in this case, add that node's clientids to the existing list.  Then
+ * move those entries into the old state directory.
+ *
+ * The clients at the top level of the directory are shared out to
+ * the recov_load fridge, the calling thread reading its part too.
+ *
+ * @param[in] path     Recovery directory
+ * @param[in] tgtdir   Directory to copy the clients to, or NULL
+ * @param[in] takeover Whether this is a take over.
+ */
+static void nfs4_load_recov_dir(const char *path, char *tgtdir, int takeover)
+{
+	struct recov_load load;
+	struct dirent *dentp;
+	DIR *dp;
+	uint32_t size = 0, helpers, i;
+
+	dp = opendir(path);
+	if (dp == NULL) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to open v4 recovery dir (%s), errno=%d",
+			 path, errno);
+		return;
+	}
+
+	memset(&load, 0, sizeof(load));
+	PTHREAD_MUTEX_init(&load.mtx, NULL);
+	PTHREAD_COND_init(&load.cv, NULL);
+	load.path = path;
+	load.tgtdir = tgtdir;
+	load.takeover = takeover;
+	glist_init(&load.list);
+
+	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
+		if (!strcmp(dentp->d_name, ".") ||
+		    !strcmp(dentp->d_name, "..") ||
+		    dentp->d_name[0] == '\x1')
+			continue;
+
+		if (load.count == size) {
+			size = size == 0 ? 64 : 2 * size;
+			load.names = gsh_realloc(load.names,
+						 size * sizeof(char *));
+		}
+		load.names[load.count++] = gsh_strdup(dentp->d_name);
+	}
+
+	if (closedir(dp) == -1) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to close v4 recovery dir (%s), errno=%d",
+			 path, errno);
+	}
+
+	/* Small directories are not worth the threads */
+	helpers = load.count / RECOV_LOAD_BATCH;
+	if (helpers > RECOV_LOAD_THREADS)
+		helpers = RECOV_LOAD_THREADS;
+
+	for (i = 0; i < helpers && recov_load_fridge != NULL; i++) {
+		PTHREAD_MUTEX_lock(&load.mtx);
+		load.running++;
+		PTHREAD_MUTEX_unlock(&load.mtx);
+
+		if (fridgethr_submit(recov_load_fridge, recov_load_run,
+				     &load) != 0) {
+			PTHREAD_MUTEX_lock(&load.mtx);
+			load.running--;
+			PTHREAD_MUTEX_unlock(&load.mtx);
+			break;
+		}
+	}
+
+	recov_load_names(&load);
+
+	PTHREAD_MUTEX_lock(&load.mtx);
+	while (load.running > 0)
+		pthread_cond_wait(&load.cv, &load.mtx);
+	PTHREAD_MUTEX_unlock(&load.mtx);
+
+	glist_splice_tail(&clid_list, &load.list);
+
+	LogEvent(COMPONENT_CLIENTID, "Read %"PRIu32" clients from %s",
+		 load.count, path);
+
+	for (i = 0; i < load.count; i++)
+		gsh_free(load.names[i]);
+	gsh_free(load.names);
+	PTHREAD_COND_destroy(&load.cv);
+	PTHREAD_MUTEX_destroy(&load.mtx);
+}
+
+/**
+ * @brief Read the clients allowed to reclaim from the recovery directory
+ *
+ * @param[in] gsp Grace period start information, on takeover
+ */
+static void fs_read_clids(nfs_grace_start_t *gsp)
+{
+	char path[PATH_MAX];
+
+	if (gsp == NULL) {
+		nfs4_load_recov_dir(v4_old_dir, NULL, 0);
+		nfs4_load_recov_dir(v4_recov_dir, v4_old_dir, 0);
+		return;
+	}
+
+	if (gsp->event == EVENT_UPDATE_CLIENTS)
+		snprintf(path, sizeof(path), "%s", v4_recov_dir);
+
+	else if (gsp->event == EVENT_TAKE_IP)
+		snprintf(path, sizeof(path), "%s/%s/%s",
+			 NFS_V4_RECOV_ROOT, gsp->ipaddr,
+			 NFS_V4_RECOV_DIR);
+
+	else if (gsp->event == EVENT_TAKE_NODEID)
+		snprintf(path, sizeof(path), "%s/%s/node%d",
+			 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_DIR,
+			 gsp->nodeid);
+
+	else
+		return;
+
+	LogEvent(COMPONENT_CLIENTID, "Recovery for nodeid %d dir (%s)",
+		 gsp->nodeid, path);
+
+	nfs4_load_recov_dir(path, v4_old_dir, 1);
+}
+
+/**
+ * @brief Free an entry of the reclaim list
+ *
+ * @param[in] clid_ent Entry, off any list
+ */
+void nfs4_free_clid_entry(clid_entry_t *clid_ent)
+{
+	rdel_fh_t *rfh_entry;
+
+	while ((rfh_entry = glist_first_entry(&clid_ent->cl_rfh_list,
+					      rdel_fh_t,
+					      rdfh_list)) != NULL) {
+		glist_del(&rfh_entry->rdfh_list);
+		gsh_free(rfh_entry->rdfh_handle_str);
+		gsh_free(rfh_entry);
+	}
+	gsh_free(clid_ent);
+}
+
 /**
  * @brief Load clients for recovery, with no lock
  *
- * @param[in] nodeid Node, on takeover
+ * @param[in] gsp Grace period start information, on takeover
  */
 static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
 {
-	DIR *dp;
+	struct glist_head *node;
 	struct clid_entry *clid_entry;
-	int rc;
-	char path[PATH_MAX];
+	uint64_t mine;
 
 	LogDebug(COMPONENT_STATE, "Load recovery cli %p", gsp);
 
@@ -787,98 +1435,37 @@ static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
 						       struct clid_entry,
 						       cl_list)) != NULL) {
 			glist_del(&clid_entry->cl_list);
-			gsh_free(clid_entry);
-		}
-
-		dp = opendir(v4_old_dir);
-		if (dp == NULL) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to open v4 recovery dir (%s), errno=%d",
-				 v4_old_dir, errno);
-			return;
+			nfs4_free_clid_entry(clid_entry);
 		}
-		rc = nfs4_read_recov_clids(dp, v4_old_dir, NULL, NULL, 0);
-		if (rc == -1) {
-			(void)closedir(dp);
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to read v4 recovery dir (%s)",
-				 v4_old_dir);
-			return;
-		}
-		(void)closedir(dp);
-
-		dp = opendir(v4_recov_dir);
-		if (dp == NULL) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to open v4 recovery dir (%s), errno=%d",
-				 v4_recov_dir, errno);
-			return;
-		}
-
-		rc = nfs4_read_recov_clids(dp, v4_recov_dir,
-					   NULL, v4_old_dir, 0);
-		if (rc == -1) {
-			(void)closedir(dp);
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to read v4 recovery dir (%s)",
-				 v4_recov_dir);
-			return;
-		}
-		rc = closedir(dp);
-		if (rc == -1) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to close v4 recovery dir (%s), errno=%d",
-				 v4_recov_dir, errno);
-		}
-
-	} else {
-		if (gsp->event == EVENT_UPDATE_CLIENTS)
-			snprintf(path, sizeof(path), "%s", v4_recov_dir);
-
-		else if (gsp->event == EVENT_TAKE_IP)
-			snprintf(path, sizeof(path), "%s/%s/%s",
-				 NFS_V4_RECOV_ROOT, gsp->ipaddr,
-				 NFS_V4_RECOV_DIR);
-
-		else if (gsp->event == EVENT_TAKE_NODEID)
-			snprintf(path, sizeof(path), "%s/%s/node%d",
-				 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_DIR,
-				 gsp->nodeid);
+	}
 
-		else
-			return;
+	/* Write out what is queued, and keep the writer while the
+	 * backend reads what it wrote.
+	 */
+	PTHREAD_MUTEX_lock(&recov_writer.mtx);
+	mine = recov_writer_take();
+	PTHREAD_MUTEX_unlock(&recov_writer.mtx);
 
-		LogEvent(COMPONENT_CLIENTID, "Recovery for nodeid %d dir (%s)",
-			 gsp->nodeid, path);
+	recovery_backend->read_clids(gsp);
 
-		dp = opendir(path);
-		if (dp == NULL) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to open v4 recovery dir (%s), errno=%d",
-				 path, errno);
-			return;
-		}
+	PTHREAD_MUTEX_lock(&recov_writer.mtx);
+	recov_writer_give(mine);
+	PTHREAD_MUTEX_unlock(&recov_writer.mtx);
 
-		rc = nfs4_read_recov_clids(dp, path, NULL, v4_old_dir, 1);
-		if (rc == -1) {
-			(void)closedir(dp);
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to read v4 recovery dir (%s)", path);
-			return;
-		}
-		rc = closedir(dp);
-		if (rc == -1) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to close v4 recovery dir (%s), errno=%d",
-				 path, errno);
-		}
+	clid_count = 0;
+	reclaim_completes = 0;
+	glist_for_each(node, &clid_list) {
+		clid_entry = glist_entry(node, struct clid_entry, cl_list);
+		clid_count++;
+		if (clid_entry->cl_reclaimed)
+			reclaim_completes++;
 	}
 }
 
 /**
  * @brief Load clients for recovery
  *
- * @param[in] nodeid Node, on takeover
+ * @param[in] gsp Grace period start information, on takeover
  */
 void nfs4_load_recov_clids(nfs_grace_start_t *gsp)
 {
@@ -891,8 +1478,10 @@ void nfs4_load_recov_clids(nfs_grace_start_t *gsp)
 
 /**
  * @brief Clean up recovery directory
+ *
+ * @param[in] parent_path Directory to empty
  */
-void nfs4_clean_old_recov_dir(char *parent_path)
+static void fs_clean_old_recov_dir(char *parent_path)
 {
 	DIR *dp;
 	struct dirent *dentp;
@@ -938,7 +1527,7 @@ void nfs4_clean_old_recov_dir(char *parent_path)
 
 		snprintf(path, total_len, "%s/%s", parent_path, dentp->d_name);
 
-		nfs4_clean_old_recov_dir(path);
+		fs_clean_old_recov_dir(path);
 		rc = rmdir(path);
 		if (rc == -1) {
 			LogEvent(COMPONENT_CLIENTID,
@@ -949,6 +1538,11 @@ void nfs4_clean_old_recov_dir(char *parent_path)
 	(void)closedir(dp);
 }
 
+static void fs_cleanup(void)
+{
+	fs_clean_old_recov_dir(v4_old_dir);
+}
+
 /**
  * @brief Create the recovery directory
  *
@@ -956,8 +1550,9 @@ void nfs4_clean_old_recov_dir(char *parent_path)
  * should only need to be done once (if at all).  Also, the location
  * of the directory could be configurable.
  */
-void nfs4_create_recov_dir(void)
+static void fs_init(void)
 {
+	struct fridgethr_params frp;
 	int err;
 
 	err = mkdir(NFS_V4_RECOV_ROOT, 0755);
@@ -1005,6 +1600,136 @@ void nfs4_create_recov_dir(void)
 				 v4_old_dir, errno);
 		}
 	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = RECOV_LOAD_THREADS;
+	frp.thr_min = 0;
+	frp.thread_delay = 60;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	err = fridgethr_init(&recov_load_fridge, "recov_load", &frp);
+	if (err != 0) {
+		LogMajor(COMPONENT_CLIENTID,
+			 "Unable to initialize recovery load fridge, error code %d.",
+			 err);
+		recov_load_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Record revoked filehandle under the client.
+ *
+ * @param[in] cl_name Client name
+ * @param[in] rhdlstr Revoked handle, as base64
+ */
+static void fs_add_revoke_fh(const char *cl_name, const char *rhdlstr)
+{
+	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
+	int length, position = 0;
+	size_t parent;
+	int fd;
+
+	/* Parse through the clientid directory structure */
+	snprintf(path, sizeof(path), "%s", v4_recov_dir);
+	length = strlen(cl_name);
+	while (position < length) {
+		int len = strlen(&cl_name[position]);
+
+		if (len <= NAME_MAX) {
+			strcat(path, "/");
+			strncat(path, &cl_name[position], len);
+			parent = strlen(path);
+			strcat(path, "/\x1"); /* Prefix 1 to converted fh */
+			strncat(path, rhdlstr, strlen(rhdlstr));
+			fd = creat(path, 0700);
+			if (fd < 0) {
+				LogEvent(COMPONENT_CLIENTID,
+					"Failed to record revoke errno:%d\n",
+					errno);
+			} else {
+				close(fd);
+				path[parent] = '\0';
+				fs_sync_dir(path);
+			}
+			return;
+		}
+		strncpy(segment, &cl_name[position], NAME_MAX);
+		strcat(path, "/");
+		strncat(path, segment, NAME_MAX);
+		position += NAME_MAX;
+	}
+}
+
+/**
+ * @brief Make the changes written so far durable
+ *
+ * Client entries are made durable by syncing the recovery directory,
+ * deeper levels were synced as they were created.
+ */
+static void fs_sync(void)
+{
+	fs_sync_dir(v4_recov_dir);
+}
+
+/**
+ * @brief Stable storage as a tree of directories, one per client
+ */
+struct nfs4_recovery_backend fs_backend = {
+	.name = "fs",
+	.recovery_init = fs_init,
+	.recovery_cleanup = fs_cleanup,
+	.read_clids = fs_read_clids,
+	.add_clid = fs_add_clid,
+	.rm_clid = fs_rm_clid,
+	.add_revoke_fh = fs_add_revoke_fh,
+	.sync = fs_sync,
+};
+
+/**
+ * @brief Set up stable storage
+ *
+ * This needs to be done before reading the clients in and starting
+ * the grace period.
+ */
+void nfs4_recovery_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (nfs_param.nfsv4_param.recovery_backend == RECOVERY_BACKEND_FS_LOG)
+		recovery_backend = &fs_log_backend;
+	else
+		recovery_backend = &fs_backend;
+
+	LogInfo(COMPONENT_CLIENTID, "Recovery backend %s",
+		recovery_backend->name);
+
+	recovery_backend->recovery_init();
+	nfs4_cluster_grace_init();
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 0;
+	frp.thread_delay = 60;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&recov_fridge, "recovery", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CLIENTID,
+			 "Unable to initialize recovery fridge, error code %d.",
+			 rc);
+		recov_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Drop what only the grace period that ended needed
+ */
+void nfs4_recovery_cleanup(void)
+{
+	recovery_backend->recovery_cleanup();
 }
 
 /**
@@ -1016,9 +1741,6 @@ void nfs4_create_recov_dir(void)
 void nfs4_record_revoke(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle)
 {
 	char rhdlstr[NAME_MAX];
-	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
-	int length, position = 0;
-	int fd;
 	int retval;
 
 	/* Convert nfs_fh4_val into base64 encoded string */
@@ -1043,34 +1765,11 @@ void nfs4_record_revoke(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle)
 	}
 	PTHREAD_MUTEX_unlock(&delr_clid->cid_mutex);
 
-	/* Parse through the clientid directory structure */
 	assert(delr_clid->cid_recov_dir != NULL);
 
-	snprintf(path, sizeof(path), "%s", v4_recov_dir);
-	length = strlen(delr_clid->cid_recov_dir);
-	while (position < length) {
-		int len = strlen(&delr_clid->cid_recov_dir[position]);
-
-		if (len <= NAME_MAX) {
-			strcat(path, "/");
-			strncat(path, &delr_clid->cid_recov_dir[position], len);
-			strcat(path, "/\x1"); /* Prefix 1 to converted fh */
-			strncat(path, rhdlstr, strlen(rhdlstr));
-			fd = creat(path, 0700);
-			if (fd < 0) {
-				LogEvent(COMPONENT_CLIENTID,
-					"Failed to record revoke errno:%d\n",
-					errno);
-			} else {
-				close(fd);
-			}
-			return;
-		}
-		strncpy(segment, &delr_clid->cid_recov_dir[position], NAME_MAX);
-		strcat(path, "/");
-		strncat(path, segment, NAME_MAX);
-		position += NAME_MAX;
-	}
+	/* The delegation must not be reclaimed after a restart */
+	recov_writer_flush(recov_queue(RECOV_ADD_REVOKE,
+				       delr_clid->cid_recov_dir, rhdlstr));
 }
 
 /**
@@ -1202,16 +1901,17 @@ static void nfs_release_nlm_state(char *release_ip)
 	struct hash_data *pdata;
 	state_status_t state_status;
 	char serverip[SOCK_NAME_MAX + 1];
-	int i;
+	uint32_t i, count;
 
 	LogDebug(COMPONENT_STATE, "Release all NLM locks");
 
 	cancel_all_nlm_blocked();
 
 	/* walk the client list and call state_nlm_notify */
-	for (i = 0; i < ht->parameter.index_size; i++) {
-		PTHREAD_RWLOCK_wrlock(&ht->partitions[i].lock);
-		head_rbt = &ht->partitions[i].rbt;
+	count = hashtable_walk_begin(ht);
+	for (i = 0; i < count; i++) {
+		PTHREAD_RWLOCK_wrlock(&hashtable_partition(ht, i)->lock);
+		head_rbt = &hashtable_partition(ht, i)->rbt;
 		/* go through all entries in the red-black-tree */
 		RBT_LOOP(head_rbt, pn) {
 			pdata = RBT_OPAQ(pn);
@@ -1234,8 +1934,9 @@ static void nfs_release_nlm_state(char *release_ip)
 			}
 			RBT_INCREMENT(pn);
 		}
-		PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
+		PTHREAD_RWLOCK_unlock(&hashtable_partition(ht, i)->lock);
 	}
+	hashtable_walk_end(ht);
 #endif /* _USE_NLM */
 }
 
@@ -1266,15 +1967,16 @@ static void nfs_release_v4_client(char *ip)
 	struct hash_data *pdata;
 	nfs_client_id_t *cp;
 	nfs_client_record_t *recp;
-	int i;
+	uint32_t i, count;
 
 	LogEvent(COMPONENT_STATE, "NFS Server V4 recovery release ip %s", ip);
 
 	/* go through the confirmed clients looking for a match */
-	for (i = 0; i < ht->parameter.index_size; i++) {
+	count = hashtable_walk_begin(ht);
+	for (i = 0; i < count; i++) {
 
-		PTHREAD_RWLOCK_wrlock(&ht->partitions[i].lock);
-		head_rbt = &ht->partitions[i].rbt;
+		PTHREAD_RWLOCK_wrlock(&hashtable_partition(ht, i)->lock);
+		head_rbt = &hashtable_partition(ht, i)->rbt;
 
 		/* go through all entries in the red-black-tree */
 		RBT_LOOP(head_rbt, pn) {
@@ -1297,7 +1999,9 @@ static void nfs_release_v4_client(char *ip)
 
 				PTHREAD_MUTEX_unlock(&cp->cid_mutex);
 
-				PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
+				PTHREAD_RWLOCK_unlock(
+					&hashtable_partition(ht, i)->lock);
+				hashtable_walk_end(ht);
 
 				/* nfs_client_id_expire requires cr_mutex
 				 * if not decoupled alread
@@ -1320,8 +2024,9 @@ static void nfs_release_v4_client(char *ip)
 			}
 			RBT_INCREMENT(pn);
 		}
-		PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
+		PTHREAD_RWLOCK_unlock(&hashtable_partition(ht, i)->lock);
 	}
+	hashtable_walk_end(ht);
 }
 
 /** @} */
@@ -0,0 +1,481 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup SAL
+ * @{
+ */
+
+/**
+ * @file nfs4_recovery_log.c
+ * @brief NFSv4 recovery in an append-only log
+ *
+ * Each change of the stable storage is a line of the log:
+ *
+ *   A <client name>
+ *   D <client name>
+ *   R <revoked handle> <client name>
+ *
+ * and a batch of changes costs one write and one fdatasync.  When a
+ * grace period starts, the clients read in are written to the old
+ * log, which keeps them through a restart during grace, and the log
+ * starts over.  A log mostly made of clients gone is rewritten with
+ * just the ones left.
+ */
+
+#include "config.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "fsal.h"
+
+#define NFS_V4_RECOV_LOG "v4recov"
+#define NFS_V4_OLD_LOG "v4old"
+
+/** Records beyond twice the clients left before the log is rewritten */
+#define LOG_COMPACT_SLACK 1024
+
+static char log_path[PATH_MAX];
+static char old_log_path[PATH_MAX];
+static int log_fd = -1;
+
+/** Changes of the batch being written */
+static char *log_buf;
+static size_t log_buf_len;
+static size_t log_buf_size;
+
+/** Records in the log, and clients they leave */
+static uint64_t log_records;
+static uint64_t log_live;
+
+static void log_sync_root(void)
+{
+	int fd = open(NFS_V4_RECOV_ROOT, O_RDONLY | O_DIRECTORY);
+
+	if (fd < 0 || fsync(fd) < 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to sync v4 recovery dir (%s), errno=%d",
+			 NFS_V4_RECOV_ROOT, errno);
+	if (fd >= 0)
+		close(fd);
+}
+
+static void log_open(void)
+{
+	if (log_fd >= 0)
+		close(log_fd);
+
+	log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (log_fd < 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to open v4 recovery log (%s), errno=%d",
+			 log_path, errno);
+}
+
+static clid_entry_t *log_find(struct glist_head *list, const char *cl_name)
+{
+	struct glist_head *node;
+	clid_entry_t *clid_ent;
+
+	glist_for_each(node, list) {
+		clid_ent = glist_entry(node, clid_entry_t, cl_list);
+		if (!strcmp(clid_ent->cl_name, cl_name))
+			return clid_ent;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Add the clients of a log to a list
+ *
+ * @param[in]     path Log
+ * @param[in,out] list Clients
+ */
+static void log_replay(const char *path, struct glist_head *list)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	char *name, *fh;
+	clid_entry_t *clid_ent;
+	rdel_fh_t *rfh_entry;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		if (errno != ENOENT)
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to open v4 recovery log (%s), errno=%d",
+				 path, errno);
+		return;
+	}
+
+	while ((len = getline(&line, &size, fp)) > 0) {
+		/* A record cut short by a crash is dropped */
+		if (len < 4 || line[len - 1] != '\n' || line[1] != ' ')
+			continue;
+
+		line[len - 1] = '\0';
+		name = line + 2;
+		fh = NULL;
+
+		if (line[0] == 'R') {
+			fh = name;
+			name = strchr(fh, ' ');
+			if (name == NULL)
+				continue;
+			*name++ = '\0';
+		}
+
+		if (strlen(name) >= PATH_MAX) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "invalid clid format: %s, too long", name);
+			continue;
+		}
+
+		clid_ent = log_find(list, name);
+
+		switch (line[0]) {
+		case 'A':
+			if (clid_ent != NULL)
+				break;
+			clid_ent = gsh_malloc(sizeof(clid_entry_t));
+			glist_init(&clid_ent->cl_rfh_list);
+			clid_ent->cl_reclaimed = false;
+			strcpy(clid_ent->cl_name, name);
+			glist_add_tail(list, &clid_ent->cl_list);
+			LogDebug(COMPONENT_CLIENTID,
+				 "added %s to clid list", clid_ent->cl_name);
+			break;
+
+		case 'D':
+			if (clid_ent == NULL)
+				break;
+			glist_del(&clid_ent->cl_list);
+			nfs4_free_clid_entry(clid_ent);
+			break;
+
+		case 'R':
+			if (clid_ent == NULL)
+				break;
+			rfh_entry = gsh_malloc(sizeof(rdel_fh_t));
+			rfh_entry->rdfh_handle_str = gsh_strdup(fh);
+			glist_add(&clid_ent->cl_rfh_list,
+				  &rfh_entry->rdfh_list);
+			LogFullDebug(COMPONENT_CLIENTID,
+				     "revoked handle: %s",
+				     rfh_entry->rdfh_handle_str);
+			break;
+
+		default:
+			LogEvent(COMPONENT_CLIENTID,
+				 "invalid record in %s: %s", path, line);
+			break;
+		}
+	}
+
+	free(line);
+	(void)fclose(fp);
+}
+
+/**
+ * @brief Replace a log with one holding just a list of clients
+ *
+ * @param[in]  path    Log
+ * @param[in]  list    Clients
+ * @param[out] records Records written
+ * @param[out] live    Clients written
+ *
+ * @return 0 or an errno.
+ */
+static int log_write_list(const char *path, struct glist_head *list,
+			  uint64_t *records, uint64_t *live)
+{
+	char tmp[PATH_MAX];
+	struct glist_head *node, *rnode;
+	clid_entry_t *clid_ent;
+	rdel_fh_t *rfh_entry;
+	FILE *fp;
+	int rc = 0;
+
+	*records = 0;
+	*live = 0;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	fp = fopen(tmp, "w");
+	if (fp == NULL) {
+		rc = errno;
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery log (%s), errno=%d",
+			 tmp, rc);
+		return rc;
+	}
+
+	glist_for_each(node, list) {
+		clid_ent = glist_entry(node, clid_entry_t, cl_list);
+		fprintf(fp, "A %s\n", clid_ent->cl_name);
+		(*records)++;
+		(*live)++;
+
+		glist_for_each(rnode, &clid_ent->cl_rfh_list) {
+			rfh_entry = glist_entry(rnode, rdel_fh_t, rdfh_list);
+			fprintf(fp, "R %s %s\n", rfh_entry->rdfh_handle_str,
+				clid_ent->cl_name);
+			(*records)++;
+		}
+	}
+
+	if (fflush(fp) != 0 || fdatasync(fileno(fp)) != 0)
+		rc = errno;
+	if (fclose(fp) != 0 && rc == 0)
+		rc = errno;
+	if (rc == 0 && rename(tmp, path) != 0)
+		rc = errno;
+
+	if (rc != 0) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to write v4 recovery log (%s), errno=%d",
+			 path, rc);
+		(void)unlink(tmp);
+		return rc;
+	}
+
+	log_sync_root();
+
+	return 0;
+}
+
+/**
+ * @brief Rewrite the log with just the clients it leaves
+ */
+static void log_compact(void)
+{
+	struct glist_head list;
+	clid_entry_t *clid_ent;
+	uint64_t records, live;
+
+	glist_init(&list);
+	log_replay(log_path, &list);
+
+	if (log_write_list(log_path, &list, &records, &live) == 0) {
+		log_open();
+		log_records = records;
+		log_live = live;
+	} else {
+		/* Try again once the log has doubled */
+		log_live = log_records;
+	}
+
+	while ((clid_ent = glist_first_entry(&list, clid_entry_t,
+					     cl_list)) != NULL) {
+		glist_del(&clid_ent->cl_list);
+		nfs4_free_clid_entry(clid_ent);
+	}
+}
+
+static void log_append(char type, const char *fh, const char *cl_name)
+{
+	size_t need = strlen(cl_name) + 4;
+
+	if (fh != NULL)
+		need += strlen(fh) + 1;
+
+	if (log_buf_len + need > log_buf_size) {
+		log_buf_size = 2 * log_buf_size;
+		if (log_buf_size < log_buf_len + need)
+			log_buf_size = log_buf_len + need;
+		log_buf = gsh_realloc(log_buf, log_buf_size);
+	}
+
+	if (fh != NULL)
+		log_buf_len += sprintf(log_buf + log_buf_len, "%c %s %s\n",
+				       type, fh, cl_name);
+	else
+		log_buf_len += sprintf(log_buf + log_buf_len, "%c %s\n",
+				       type, cl_name);
+	log_records++;
+}
+
+static void log_add_clid(const char *cl_name)
+{
+	log_append('A', NULL, cl_name);
+	log_live++;
+}
+
+static void log_rm_clid(const char *cl_name)
+{
+	log_append('D', NULL, cl_name);
+	if (log_live > 0)
+		log_live--;
+}
+
+static void log_add_revoke_fh(const char *cl_name, const char *rhdlstr)
+{
+	log_append('R', rhdlstr, cl_name);
+}
+
+/**
+ * @brief Append the batch to the log and make it durable
+ */
+static void log_sync(void)
+{
+	size_t done = 0;
+	ssize_t len;
+
+	if (log_buf_len == 0)
+		return;
+
+	while (done < log_buf_len) {
+		len = write(log_fd, log_buf + done, log_buf_len - done);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to write v4 recovery log (%s), errno=%d",
+				 log_path, errno);
+			break;
+		}
+		done += len;
+	}
+
+	if (done == log_buf_len && fdatasync(log_fd) != 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to sync v4 recovery log (%s), errno=%d",
+			 log_path, errno);
+
+	log_buf_len = 0;
+
+	if (log_records > 2 * log_live + LOG_COMPACT_SLACK)
+		log_compact();
+}
+
+/**
+ * @brief Read the clients allowed to reclaim from the logs
+ *
+ * @param[in] gsp Grace period start information, on takeover
+ */
+static void log_read_clids(nfs_grace_start_t *gsp)
+{
+	char path[PATH_MAX];
+	uint64_t records, live;
+
+	if (gsp == NULL) {
+		log_replay(old_log_path, &clid_list);
+		log_replay(log_path, &clid_list);
+	} else {
+		if (gsp->event == EVENT_UPDATE_CLIENTS)
+			snprintf(path, sizeof(path), "%s", log_path);
+
+		else if (gsp->event == EVENT_TAKE_IP)
+			snprintf(path, sizeof(path), "%s/%s/%s.log",
+				 NFS_V4_RECOV_ROOT, gsp->ipaddr,
+				 NFS_V4_RECOV_LOG);
+
+		else if (gsp->event == EVENT_TAKE_NODEID)
+			snprintf(path, sizeof(path), "%s/%s.node%d.log",
+				 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_LOG,
+				 gsp->nodeid);
+
+		else
+			return;
+
+		LogEvent(COMPONENT_CLIENTID, "Recovery for nodeid %d log (%s)",
+			 gsp->nodeid, path);
+
+		log_replay(path, &clid_list);
+	}
+
+	/* Keep what this grace period allows through a restart */
+	(void)log_write_list(old_log_path, &clid_list, &records, &live);
+
+	if (gsp != NULL)
+		return;
+
+	/* Clients are logged again as they come back */
+	if (log_fd >= 0 &&
+	    (ftruncate(log_fd, 0) != 0 || fdatasync(log_fd) != 0))
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to truncate v4 recovery log (%s), errno=%d",
+			 log_path, errno);
+	log_records = 0;
+	log_live = 0;
+}
+
+static void log_init(void)
+{
+	int err;
+
+	err = mkdir(NFS_V4_RECOV_ROOT, 0755);
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir (%s), errno=%d",
+			 NFS_V4_RECOV_ROOT, errno);
+	}
+
+	if (nfs_param.core_param.clustered) {
+		snprintf(log_path, sizeof(log_path), "%s/%s.node%d.log",
+			 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_LOG, g_nodeid);
+		snprintf(old_log_path, sizeof(old_log_path),
+			 "%s/%s.node%d.log",
+			 NFS_V4_RECOV_ROOT, NFS_V4_OLD_LOG, g_nodeid);
+	} else {
+		snprintf(log_path, sizeof(log_path), "%s/%s.log",
+			 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_LOG);
+		snprintf(old_log_path, sizeof(old_log_path), "%s/%s.log",
+			 NFS_V4_RECOV_ROOT, NFS_V4_OLD_LOG);
+	}
+
+	log_open();
+}
+
+static void log_cleanup(void)
+{
+	if (unlink(old_log_path) != 0 && errno != ENOENT) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to remove old v4 recovery log (%s), errno=%d",
+			 old_log_path, errno);
+		return;
+	}
+
+	log_sync_root();
+}
+
+/**
+ * @brief Stable storage as an append-only log
+ */
+struct nfs4_recovery_backend fs_log_backend = {
+	.name = "fs_log",
+	.recovery_init = log_init,
+	.recovery_cleanup = log_cleanup,
+	.read_clids = log_read_clids,
+	.add_clid = log_add_clid,
+	.rm_clid = log_rm_clid,
+	.add_revoke_fh = log_add_revoke_fh,
+	.sync = log_sync,
+};
+
+/** @} */
@@ -201,7 +201,14 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 
 	/* Add state to list for file */
 	PTHREAD_MUTEX_lock(&pnew_state->state_mutex);
-	glist_add_tail(&ostate->file.list_of_states, &pnew_state->state_list);
+	if (obj->type == DIRECTORY) {
+		glist_add_tail(&ostate->dir.list_of_states,
+			       &pnew_state->state_list);
+		atomic_inc_uint32_t(&ostate->dir.deleg_count);
+	} else {
+		glist_add_tail(&ostate->file.list_of_states,
+			       &pnew_state->state_list);
+	}
 	/* Get ref for this state entry */
 	obj->obj_ops.get_ref(obj);
 	PTHREAD_MUTEX_unlock(&pnew_state->state_mutex);
@@ -232,6 +239,7 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 #endif
 
 	if (pnew_state->state_type == STATE_TYPE_DELEG &&
+	    obj->type == REGULAR_FILE &&
 	    pnew_state->state_data.deleg.sd_type == OPEN_DELEGATE_WRITE)
 		ostate->file.write_delegated = true;
 
@@ -383,6 +391,8 @@ void _state_del_locked(state_t *state, const char *func, int line)
 	/* Remove from the list of states for a particular file */
 	PTHREAD_MUTEX_lock(&state->state_mutex);
 	glist_del(&state->state_list);
+	if (obj->type == DIRECTORY)
+		atomic_dec_uint32_t(&obj->state_hdl->dir.deleg_count);
 	/* Put ref for this state entry */
 	obj->obj_ops.put_ref(obj);
 	state->state_obj = NULL;
@@ -470,6 +480,7 @@ void _state_del_locked(state_t *state, const char *func, int line)
 
 	/* Reset write delegated if this is a write delegation */
 	if (state->state_type == STATE_TYPE_DELEG &&
+	    obj->type == REGULAR_FILE &&
 	    state->state_data.deleg.sd_type == OPEN_DELEGATE_WRITE)
 		obj->state_hdl->file.write_delegated = false;
 
@@ -641,6 +652,24 @@ void state_nfs4_state_wipe(struct state_hdl *ostate)
 	}
 }
 
+/**
+ * @brief Remove all directory delegations from a directory
+ *
+ * @note state_lock MUST be held for write
+ *
+ * @param[in,out] ostate Directory state to wipe
+ */
+void state_nfs4_dir_state_wipe(struct state_hdl *ostate)
+{
+	struct glist_head *glist, *glistn;
+	state_t *state = NULL;
+
+	glist_for_each_safe(glist, glistn, &ostate->dir.list_of_states) {
+		state = glist_entry(glist, state_t, state_list);
+		state_del_locked(state);
+	}
+}
+
 /**
  * @brief Remove every state belonging to the lock owner.
  *
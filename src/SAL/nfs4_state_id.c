@@ -61,6 +61,9 @@
 #include "sal_functions.h"
 #include "nfs_proto_tools.h"
 #include "city.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /**
  * @brief Hash table for stateids.
@@ -79,6 +82,57 @@ char all_zero[OTHERSIZE];
 char all_ones[OTHERSIZE];
 #define seqid_all_one 0xFFFFFFFF
 
+/**
+ * @brief What the other field of a stateid holds
+ */
+enum stateid_other_kind {
+	STATEID_OTHER_STATE,	/*< Anything else, looked up in the table */
+	STATEID_OTHER_ZERO,	/*< All zeros */
+	STATEID_OTHER_ONES,	/*< All ones */
+};
+
+/**
+ * @brief Classify the other field of a stateid
+ *
+ * A stateid4 is 16 bytes, seqid first, so the whole of it is compared
+ * at once rather than the other field twice with memcmp.
+ *
+ * @param[in] stateid The stateid
+ *
+ * @return What the other field holds.
+ */
+static inline enum stateid_other_kind
+stateid_other_kind(const stateid4 *stateid)
+{
+#ifdef __SSE2__
+	/* Bytes 4 to 15 of the stateid are the other field */
+	const int other_mask = 0xFFF0;
+	__m128i v = _mm_loadu_si128((const __m128i *)stateid);
+
+	if ((_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) &
+	     other_mask) == other_mask)
+		return STATEID_OTHER_ZERO;
+
+	if ((_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(-1))) &
+	     other_mask) == other_mask)
+		return STATEID_OTHER_ONES;
+#else
+	uint64_t lo;
+	uint32_t hi;
+
+	memcpy(&lo, stateid->other, sizeof(lo));
+	memcpy(&hi, stateid->other + sizeof(lo), sizeof(hi));
+
+	if (lo == 0 && hi == 0)
+		return STATEID_OTHER_ZERO;
+
+	if (lo == UINT64_MAX && hi == UINT32_MAX)
+		return STATEID_OTHER_ONES;
+#endif
+
+	return STATEID_OTHER_STATE;
+}
+
 /**
  * @brief Display a stateid other
  *
@@ -319,7 +373,7 @@ static hash_parameter_t state_id_param = {
 	.compare_key = compare_state_id,
 	.key_to_str = display_state_id_key,
 	.val_to_str = display_state_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_OPEN | HT_FLAG_RCU,
 	.ht_log_component = COMPONENT_STATE,
 	.ht_name = "State ID Table"
 };
@@ -431,7 +485,7 @@ static hash_parameter_t state_obj_param = {
 	.compare_key = compare_state_obj,
 	.key_to_str = display_state_id_val,
 	.val_to_str = display_state_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_OPEN | HT_FLAG_RCU,
 	.ht_log_component = COMPONENT_STATE,
 	.ht_name = "State Obj Table"
 };
@@ -637,7 +691,7 @@ struct state_t *nfs4_State_Get_Pointer(char *other)
 	buffkey.addr = other;
 	buffkey.len = OTHERSIZE;
 
-	rc = hashtable_getlatch(ht_state_id, &buffkey, &buffval, true, &latch);
+	rc = hashtable_getlatch(ht_state_id, &buffkey, &buffval, false, &latch);
 
 	if (rc != HASHTABLE_SUCCESS) {
 		if (rc == HASHTABLE_ERROR_NO_SUCH_KEY)
@@ -686,7 +740,7 @@ struct state_t *nfs4_State_Get_Obj(struct fsal_obj_handle *obj,
 	rc = hashtable_getlatch(ht_state_obj,
 				&buffkey,
 				&buffval,
-				true,
+				false,
 				&latch);
 
 	if (rc != HASHTABLE_SUCCESS) {
@@ -814,6 +868,7 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 	nfs_client_id_t *pclientid;
 	int rc;
 	nfsstat4 status;
+	enum stateid_other_kind kind = stateid_other_kind(stateid);
 
 	if (isDebug(COMPONENT_STATE)) {
 		display_stateid4(&dspbuf, stateid);
@@ -830,7 +885,7 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 		     flags == 0 ? " NONE" : "");
 
 	/* Test for OTHER is all zeros */
-	if (memcmp(stateid->other, all_zero, OTHERSIZE) == 0) {
+	if (kind == STATEID_OTHER_ZERO) {
 		if (stateid->seqid == 0 &&
 		    (flags & STATEID_SPECIAL_ALL_0) != 0) {
 			/* All 0 stateid */
@@ -871,7 +926,7 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 	}
 
 	/* Test for OTHER is all ones */
-	if (memcmp(stateid->other, all_ones, OTHERSIZE) == 0) {
+	if (kind == STATEID_OTHER_ONES) {
 		/* Test for special all ones stateid */
 		if (stateid->seqid == seqid_all_one &&
 		    (flags & STATEID_SPECIAL_ALL_1) != 0) {
@@ -956,21 +1011,14 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 				/* We don't expect this, but, just in case...
 				 * Update and release already reserved lease.
 				 */
-				PTHREAD_MUTEX_lock(&data->preserved_clientid
-						   ->cid_mutex);
 				update_lease(data->preserved_clientid);
-				PTHREAD_MUTEX_unlock(&data->preserved_clientid
-						     ->cid_mutex);
 				data->preserved_clientid = NULL;
 			}
 
 			/* Check if lease is expired and reserve it */
-			PTHREAD_MUTEX_lock(&pclientid->cid_mutex);
-
 			if (!reserve_lease(pclientid)) {
 				LogDebug(COMPONENT_STATE,
 					 "Returning NFS4ERR_EXPIRED");
-				PTHREAD_MUTEX_unlock(&pclientid->cid_mutex);
 				status = NFS4ERR_EXPIRED;
 				goto failure;
 			}
@@ -986,7 +1034,6 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 				 */
 				data->preserved_clientid = pclientid;
 			}
-			PTHREAD_MUTEX_unlock(&pclientid->cid_mutex);
 
 			/* Replayed close, it's ok, but stateid doesn't exist */
 			LogDebug(COMPONENT_STATE,
@@ -1004,12 +1051,9 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 			 * midst of tear down due to expired lease or if
 			 * in fact the entry is actually stale.
 			 */
-			PTHREAD_MUTEX_lock(&pclientid->cid_mutex);
-
 			if (!reserve_lease(pclientid)) {
 				LogDebug(COMPONENT_STATE,
 					 "Returning NFS4ERR_EXPIRED");
-				PTHREAD_MUTEX_unlock(&pclientid->cid_mutex);
 
 				/* Release the clientid reference we just
 				 * acquired.
@@ -1023,7 +1067,6 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 			 * clientid NULL.
 			 */
 			update_lease(pclientid);
-			PTHREAD_MUTEX_unlock(&pclientid->cid_mutex);
 
 			/* The lease was valid, so this must be a stale
 			 * entry.
@@ -1043,37 +1086,22 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 			/* We don't expect this to happen, but, just in case...
 			 * Update and release already reserved lease.
 			 */
-			PTHREAD_MUTEX_lock(&data->preserved_clientid
-					   ->cid_mutex);
-
 			update_lease(data->preserved_clientid);
 
-			PTHREAD_MUTEX_unlock(&data->preserved_clientid
-					     ->cid_mutex);
-
 			data->preserved_clientid = NULL;
 		}
 
 		/* Check if lease is expired and reserve it */
-		PTHREAD_MUTEX_lock(
-		    &owner2->so_owner.so_nfs4_owner.so_clientrec->cid_mutex);
-
 		if (!reserve_lease(
 				owner2->so_owner.so_nfs4_owner.so_clientrec)) {
 			LogDebug(COMPONENT_STATE, "Returning NFS4ERR_EXPIRED");
 
-			PTHREAD_MUTEX_unlock(&owner2->so_owner.so_nfs4_owner
-					     .so_clientrec->cid_mutex);
-
 			status = NFS4ERR_EXPIRED;
 			goto failure;
 		}
 
 		data->preserved_clientid =
 		    owner2->so_owner.so_nfs4_owner.so_clientrec;
-
-		PTHREAD_MUTEX_unlock(
-		    &owner2->so_owner.so_nfs4_owner.so_clientrec->cid_mutex);
 	}
 
 	/* Sanity check : Is this the right file ? */
@@ -697,7 +697,7 @@ static hash_parameter_t nsm_client_hash_param = {
 	.compare_key = compare_nsm_client_key,
 	.key_to_str = display_nsm_client_key,
 	.val_to_str = display_nsm_client_val,
-	.flags = HT_FLAG_NONE,
+	.flags = HT_FLAG_GROW,
 };
 
 static hash_parameter_t nlm_client_hash_param = {
@@ -707,7 +707,7 @@ static hash_parameter_t nlm_client_hash_param = {
 	.compare_key = compare_nlm_client_key,
 	.key_to_str = display_nlm_client_key,
 	.val_to_str = display_nlm_client_val,
-	.flags = HT_FLAG_NONE,
+	.flags = HT_FLAG_GROW,
 };
 
 static hash_parameter_t nlm_owner_hash_param = {
@@ -717,7 +717,7 @@ static hash_parameter_t nlm_owner_hash_param = {
 	.compare_key = compare_nlm_owner_key,
 	.key_to_str = display_nlm_owner_key,
 	.val_to_str = display_nlm_owner_val,
-	.flags = HT_FLAG_NONE,
+	.flags = HT_FLAG_GROW,
 };
 
 /**
@@ -985,6 +985,8 @@ state_nsm_client_t *get_nsm_client(care_t care, SVCXPRT *xprt,
 	glist_init(&pclient->ssc_lock_list);
 	glist_init(&pclient->ssc_share_list);
 	pclient->ssc_refcount = 1;
+	pclient->ssc_monitored = false;
+	pclient->ssc_mon_pending = false;
 
 	if (op_ctx->client != NULL) {
 		pclient->ssc_client = op_ctx->client;
@@ -1047,6 +1049,13 @@ void free_nlm_client(state_nlm_client_t *client)
 	if (client->slc_nlm_caller_name != NULL)
 		gsh_free(client->slc_nlm_caller_name);
 
+	if (client->slc_callback_clnt != NULL) {
+		AUTH_DESTROY(client->slc_callback_auth);
+		gsh_clnt_destroy(client->slc_callback_clnt);
+	}
+
+	PTHREAD_MUTEX_destroy(&client->slc_callback_mutex);
+
 	gsh_free(client);
 }
 
@@ -1262,6 +1271,11 @@ not_found:
 	/* Copy everything over */
 	memcpy(pclient, &key, sizeof(key));
 
+	pclient->slc_callback_clnt = NULL;
+	pclient->slc_callback_auth = NULL;
+	pclient->slc_callback_inflight = 0;
+	PTHREAD_MUTEX_init(&pclient->slc_callback_mutex, NULL);
+
 	pclient->slc_nlm_caller_name = gsh_strdup(key.slc_nlm_caller_name);
 
 	/* Take a reference to the NSM Client */
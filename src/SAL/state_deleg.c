@@ -225,7 +225,13 @@ state_status_t release_lease_lock(struct fsal_obj_handle *obj, state_t *state)
 {
 	state_status_t status;
 	fsal_lock_param_t lock_desc;
-	state_owner_t *owner = get_state_owner_ref(state);
+	state_owner_t *owner;
+
+	/* Directory delegations are kept by SAL alone */
+	if (obj->type == DIRECTORY)
+		return STATE_SUCCESS;
+
+	owner = get_state_owner_ref(state);
 
 	if (owner == NULL) {
 		/* Something is going stale. */
@@ -299,18 +305,20 @@ void deleg_heuristics_recall(struct fsal_obj_handle *obj,
 			     struct state_t *deleg)
 {
 	nfs_client_id_t *client = owner->so_owner.so_nfs4_owner.so_clientrec;
-	/* Update delegation stats for file. */
-	struct file_deleg_stats *statistics =
-		&obj->state_hdl->file.fdeleg_stats;
-
-	statistics->fds_curr_delegations--;
-	statistics->fds_recall_count++;
+	struct file_deleg_stats *statistics;
 
 	/* Update delegation stats for client. */
 	dec_grants(client->gsh_client);
 	client->curr_deleg_grants--;
 
+	if (obj->type != REGULAR_FILE)
+		return;
+
 	/* Update delegation stats for file. */
+	statistics = &obj->state_hdl->file.fdeleg_stats;
+	statistics->fds_curr_delegations--;
+	statistics->fds_recall_count++;
+
 	statistics->fds_avg_hold = advance_avg(statistics->fds_avg_hold,
 					   time(NULL)
 					   - statistics->fds_last_delegation,
@@ -346,10 +354,95 @@ bool init_deleg_heuristics(struct fsal_obj_handle *obj)
 	statistics->fds_avg_hold = 0;
 	statistics->fds_num_opens = 0;
 	statistics->fds_first_open = 0;
+	statistics->fds_open_heat = 0;
+	statistics->fds_recall_heat = 0;
+	statistics->fds_heat_time = 0;
 
 	return true;
 }
 
+/** One open or recall, in the fixed point of the heats */
+#define DELEG_HEAT_ONE 256
+
+/**
+ * @brief Decay one heat
+ *
+ * Whole half lives shift the heat, the rest of the time is
+ * interpolated linearly.
+ */
+static inline uint32_t deleg_heat_decayed(uint32_t heat, time_t elapsed,
+					  uint32_t half_life)
+{
+	time_t halves = elapsed / half_life;
+
+	if (halves >= 32)
+		return 0;
+
+	heat >>= halves;
+
+	return heat - ((uint64_t)heat * (elapsed % half_life)) /
+		      (2 * half_life);
+}
+
+/**
+ * @brief Bring the open and recall heats of a file up to now
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in,out] statistics Delegation statistics of the file
+ * @param[in]     now        Current time
+ */
+static void deleg_heat_decay(struct file_deleg_stats *statistics, time_t now)
+{
+	uint32_t half_life = nfs_param.nfsv4_param.deleg_heat_half_life;
+	time_t elapsed = now - statistics->fds_heat_time;
+
+	if (elapsed <= 0)
+		return;
+
+	statistics->fds_heat_time = now;
+	statistics->fds_open_heat =
+		deleg_heat_decayed(statistics->fds_open_heat, elapsed,
+				   half_life);
+	statistics->fds_recall_heat =
+		deleg_heat_decayed(statistics->fds_recall_heat, elapsed,
+				   half_life);
+}
+
+/**
+ * @brief Count an open of a file for delegation heuristics
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] ostate File state
+ */
+void deleg_heuristics_open(struct state_hdl *ostate)
+{
+	struct file_deleg_stats *statistics = &ostate->file.fdeleg_stats;
+
+	deleg_heat_decay(statistics, time(NULL));
+	if (statistics->fds_open_heat < UINT32_MAX - DELEG_HEAT_ONE)
+		statistics->fds_open_heat += DELEG_HEAT_ONE;
+}
+
+/**
+ * @brief Count a recall of a delegation on a file
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] ostate File state
+ */
+void deleg_heuristics_conflict(struct state_hdl *ostate)
+{
+	struct file_deleg_stats *statistics = &ostate->file.fdeleg_stats;
+	time_t now = time(NULL);
+
+	statistics->fds_last_recall = now;
+	deleg_heat_decay(statistics, now);
+	if (statistics->fds_recall_heat < UINT32_MAX - DELEG_HEAT_ONE)
+		statistics->fds_recall_heat += DELEG_HEAT_ONE;
+}
+
 /* Most clients retry NFS operations after 5 seconds. The following
  * should be good enough to avoid starving a client's open
  */
@@ -375,6 +468,8 @@ bool should_we_grant_deleg(struct state_hdl *ostate, nfs_client_id_t *client,
 	struct file_deleg_stats *file_stats = &ostate->file.fdeleg_stats;
 	/* specific client, all files stats */
 	open_claim_type4 claim = args->claim.claim;
+	uint32_t budget = nfs_param.nfsv4_param.max_deleg_per_client;
+	uint32_t ratio = nfs_param.nfsv4_param.deleg_opens_per_recall;
 
 	LogDebug(COMPONENT_STATE, "Checking if we should grant delegation.");
 
@@ -421,9 +516,11 @@ bool should_we_grant_deleg(struct state_hdl *ostate, nfs_client_id_t *client,
 	/* If there is a recent recall on this file, the client that made
 	 * the conflicting open may retry the open later. Don't give out
 	 * delegation to avoid starving the client's open that caused
-	 * the recall.
+	 * the recall.  Nothing recalls a read delegation on an immutable
+	 * export, past recalls don't matter there.
 	 */
-	if (file_stats->fds_last_recall != 0 &&
+	if (!op_ctx->ctx_export->immutable &&
+	    file_stats->fds_last_recall != 0 &&
 	    time(NULL) - file_stats->fds_last_recall < RECALL2DELEG_TIME)
 		return false;
 
@@ -431,6 +528,35 @@ bool should_we_grant_deleg(struct state_hdl *ostate, nfs_client_id_t *client,
 	if (client->num_revokes > 2) /* more than 2 revokes */
 		return false;
 
+	/* Keep a client from holding more than its share of the
+	 * delegations, each one having to be recalled some day.
+	 */
+	if (budget != 0 && client->curr_deleg_grants >= budget) {
+		inc_budget_declines(client->gsh_client);
+		return false;
+	}
+
+	if (op_ctx->ctx_export->immutable) {
+		LogDebug(COMPONENT_STATE, "Immutable export, let's delegate");
+		return true;
+	}
+
+	/* A file recalled often is shared: until it sees enough opens
+	 * per recall, a delegation on it saves fewer round trips than
+	 * its recall costs.
+	 */
+	deleg_heat_decay(file_stats, time(NULL));
+	if ((uint64_t)file_stats->fds_recall_heat * ratio >
+	    file_stats->fds_open_heat) {
+		LogFullDebug(COMPONENT_STATE,
+			     "File recalled too often, open heat %"PRIu32
+			     " recall heat %"PRIu32,
+			     file_stats->fds_open_heat,
+			     file_stats->fds_recall_heat);
+		inc_heat_declines(client->gsh_client);
+		return false;
+	}
+
 	LogDebug(COMPONENT_STATE, "Let's delegate!!");
 	return true;
 }
@@ -620,6 +746,149 @@ bool deleg_supported(struct fsal_obj_handle *obj,
 	return true;
 }
 
+/**
+ * @brief Check if a directory may be delegated
+ *
+ * @param[in] obj		Directory
+ * @param[in] export_perms	Permissions of the export
+ *
+ * @return true if directory delegations are allowed.
+ */
+bool dir_deleg_supported(struct fsal_obj_handle *obj,
+			 struct export_perms *export_perms)
+{
+	if (!nfs_param.nfsv4_param.allow_delegations ||
+	    !nfs_param.nfsv4_param.allow_dir_delegations)
+		return false;
+	if (obj->type != DIRECTORY)
+		return false;
+	if (!(export_perms->options & EXPORT_OPTION_READ_DELEG))
+		return false;
+
+	return true;
+}
+
+/**
+ * @brief Grant a directory delegation
+ *
+ * No notifications are offered: a directory delegation is recalled on
+ * any change to the directory not made by its holder.  A client asking
+ * again for a directory it holds gets its delegation back.
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in]  obj	Directory
+ * @param[in]  client	Client asking for the delegation
+ * @param[in]  refer	Compound creating the delegation
+ * @param[out] state	Delegation, with a reference for the caller
+ *
+ * @retval STATE_SUCCESS if it was granted.
+ * @retval STATE_LOCK_CONFLICT if it can't be granted now.
+ */
+state_status_t acquire_dir_deleg(struct fsal_obj_handle *obj,
+				 nfs_client_id_t *client,
+				 struct state_refer *refer,
+				 state_t **state)
+{
+	struct state_hdl *ostate = obj->state_hdl;
+	state_owner_t *owner = &client->cid_owner;
+	uint32_t budget = nfs_param.nfsv4_param.max_deleg_per_client;
+	union state_data state_data;
+	struct glist_head *glist;
+	state_t *deleg;
+	state_status_t status;
+
+	glist_for_each(glist, &ostate->dir.list_of_states) {
+		deleg = glist_entry(glist, state_t, state_list);
+
+		/* The directory changed and is being recalled */
+		if (deleg->state_data.deleg.sd_state != DELEG_GRANTED)
+			return STATE_LOCK_CONFLICT;
+
+		if (deleg->state_owner == owner) {
+			inc_state_t_ref(deleg);
+			*state = deleg;
+			return STATE_SUCCESS;
+		}
+	}
+
+	/* A delegation that can't be recalled would have to be revoked */
+	if (get_cb_chan_down(client) || client->num_revokes > 2)
+		return STATE_LOCK_CONFLICT;
+
+	if (budget != 0 && client->curr_deleg_grants >= budget) {
+		inc_budget_declines(client->gsh_client);
+		return STATE_LOCK_CONFLICT;
+	}
+
+	init_new_deleg_state(&state_data, OPEN_DELEGATE_READ, client);
+
+	status = state_add_impl(obj, STATE_TYPE_DELEG, &state_data, owner,
+				state, refer);
+	if (status != STATE_SUCCESS)
+		return status;
+
+	(*state)->state_seqid++;
+
+	inc_grants(client->gsh_client);
+	client->curr_deleg_grants++;
+
+	return STATE_SUCCESS;
+}
+
+/**
+ * @brief Check if a change to a directory conflicts with delegations
+ *
+ * Changes made by the client holding the only delegations don't
+ * conflict.  Any other change recalls all the delegations of the
+ * directory, and is to be retried once they are returned.
+ *
+ * @note The state_lock MUST NOT be held
+ *
+ * @param[in] obj	Directory about to change
+ *
+ * @retval true if there is a conflict and the delegations are recalled.
+ * @retval false if there is no delegation conflict.
+ */
+bool state_dir_deleg_conflict(struct fsal_obj_handle *obj)
+{
+	struct state_hdl *ostate = obj->state_hdl;
+	struct glist_head *glist;
+	state_owner_t *owner;
+	state_t *deleg;
+	bool conflict = false;
+
+	if (obj->type != DIRECTORY ||
+	    atomic_fetch_uint32_t(&ostate->dir.deleg_count) == 0)
+		return false;
+
+	PTHREAD_RWLOCK_rdlock(&ostate->state_lock);
+	glist_for_each(glist, &ostate->dir.list_of_states) {
+		deleg = glist_entry(glist, state_t, state_list);
+		owner = deleg->state_owner;
+
+		if (op_ctx->clientid == NULL || owner == NULL ||
+		    owner->so_owner.so_nfs4_owner.so_clientid !=
+		    *op_ctx->clientid) {
+			conflict = true;
+			break;
+		}
+	}
+	PTHREAD_RWLOCK_unlock(&ostate->state_lock);
+
+	if (!conflict)
+		return false;
+
+	LogDebug(COMPONENT_STATE,
+		 "Change to directory %p conflicts with its delegations", obj);
+
+	if (async_delegrecall(general_fridge, obj) != 0)
+		LogCrit(COMPONENT_STATE,
+			"Failed to start thread to recall directory delegation.");
+
+	return true;
+}
+
 /**
  * @brief Check to see if a delegation can be granted
  *
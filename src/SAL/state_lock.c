@@ -715,6 +715,209 @@ static void lock_entry_dec_ref(state_lock_entry_t *lock_entry)
 	}
 }
 
+/******************************************************************************
+ *
+ * Index of the locks of a file by range
+ *
+ * Each file keeps its lock entries in an AVL tree by start offset
+ * alongside lock_list.  Since no lock of the file is longer than
+ * lock_span, the locks overlapping a range are found among those
+ * starting between range start - lock_span and range end, rather than
+ * by walking every lock of the file.  A lock to EOF makes that the
+ * whole file again, until the file has no more locks.
+ *
+ ******************************************************************************/
+
+/**
+ * @brief Compare lock entries by start offset
+ *
+ * Entries starting at the same offset are ordered by address, so that
+ * every entry has its own place in the index.
+ *
+ * @param[in] lhs An entry
+ * @param[in] rhs Another entry
+ *
+ * @retval -1 if lhs sorts first.
+ * @retval 0 if they are the same entry.
+ * @retval 1 if rhs sorts first.
+ */
+int state_lock_range_cmpf(const struct avltree_node *lhs,
+			  const struct avltree_node *rhs)
+{
+	state_lock_entry_t *lk = avltree_container_of(lhs, state_lock_entry_t,
+						      sle_range_node);
+	state_lock_entry_t *rk = avltree_container_of(rhs, state_lock_entry_t,
+						      sle_range_node);
+
+	if (lk->sle_lock.lock_start != rk->sle_lock.lock_start)
+		return lk->sle_lock.lock_start < rk->sle_lock.lock_start
+			? -1 : 1;
+
+	if (lk != rk)
+		return (uintptr_t) lk < (uintptr_t) rk ? -1 : 1;
+
+	return 0;
+}
+
+/**
+ * @brief Add an entry to the lock index of a file
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] ostate     File state
+ * @param[in,out] lock_entry Entry on ostate's lock_list
+ */
+static void lock_index_insert(struct state_hdl *ostate,
+			      state_lock_entry_t *lock_entry)
+{
+	struct state_file *file = &ostate->file;
+	uint64_t span = lock_end(&lock_entry->sle_lock) -
+			lock_entry->sle_lock.lock_start;
+
+	if (avltree_size(&file->lock_tree) == 0) {
+		file->lock_span = 0;
+		file->lock_export = lock_entry->sle_export;
+		file->lock_exports_mixed = false;
+	} else if (lock_entry->sle_export != file->lock_export) {
+		file->lock_exports_mixed = true;
+	}
+
+	if (span > file->lock_span)
+		file->lock_span = span;
+
+	avltree_insert(&lock_entry->sle_range_node, &file->lock_tree);
+	lock_entry->sle_indexed = true;
+}
+
+/**
+ * @brief Remove an entry from the lock index of its file, if there
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] lock_entry Entry to remove
+ */
+static void lock_index_remove(state_lock_entry_t *lock_entry)
+{
+	struct state_file *file;
+
+	if (!lock_entry->sle_indexed)
+		return;
+
+	file = &lock_entry->sle_obj->state_hdl->file;
+	avltree_remove(&lock_entry->sle_range_node, &file->lock_tree);
+	lock_entry->sle_indexed = false;
+
+	if (avltree_size(&file->lock_tree) == 0) {
+		file->lock_span = 0;
+		file->lock_export = NULL;
+		file->lock_exports_mixed = false;
+	}
+}
+
+/**
+ * @brief Add an entry to the lock list of a file
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] ostate     File state
+ * @param[in,out] lock_entry Entry to add
+ */
+static inline void lock_list_add(struct state_hdl *ostate,
+				 state_lock_entry_t *lock_entry)
+{
+	glist_add_tail(&ostate->file.lock_list, &lock_entry->sle_list);
+	lock_index_insert(ostate, lock_entry);
+}
+
+/**
+ * @brief First lock of a file that may reach an offset
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] ostate File state
+ * @param[in] offset Offset
+ *
+ * @return The first entry in start order that may end at or after
+ *         offset, or NULL.
+ */
+static state_lock_entry_t *lock_index_first(struct state_hdl *ostate,
+					    uint64_t offset)
+{
+	struct avltree_node *node = ostate->file.lock_tree.root;
+	struct avltree_node *found = NULL;
+	uint64_t from = offset > ostate->file.lock_span
+			? offset - ostate->file.lock_span : 0;
+	state_lock_entry_t *entry;
+
+	while (node != NULL) {
+		entry = avltree_container_of(node, state_lock_entry_t,
+					     sle_range_node);
+		if (entry->sle_lock.lock_start >= from) {
+			found = node;
+			node = node->left;
+		} else {
+			node = node->right;
+		}
+	}
+
+	if (found == NULL)
+		return NULL;
+
+	return avltree_container_of(found, state_lock_entry_t, sle_range_node);
+}
+
+/**
+ * @brief Next lock of a file in start order
+ *
+ * @param[in] lock_entry Indexed entry
+ *
+ * @return The next entry or NULL.
+ */
+static inline state_lock_entry_t *lock_index_next(
+					state_lock_entry_t *lock_entry)
+{
+	struct avltree_node *node = avltree_next(&lock_entry->sle_range_node);
+
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, state_lock_entry_t, sle_range_node);
+}
+
+/**
+ * @brief Find a lock of an owner on a file via another export
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] ostate File state
+ * @param[in] owner  Lock owner
+ *
+ * @return A lock entry of owner for another export than op_ctx's, or
+ *         NULL.
+ */
+static state_lock_entry_t *lock_owner_other_export(struct state_hdl *ostate,
+						   state_owner_t *owner)
+{
+	struct glist_head *glist;
+	state_lock_entry_t *found_entry;
+
+	/* Usually all the locks of a file are via the same export */
+	if (!ostate->file.lock_exports_mixed &&
+	    (ostate->file.lock_export == NULL ||
+	     ostate->file.lock_export == op_ctx->ctx_export))
+		return NULL;
+
+	glist_for_each(glist, &ostate->file.lock_list) {
+		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+
+		if (found_entry->sle_export != op_ctx->ctx_export &&
+		    !different_owners(found_entry->sle_owner, owner))
+			return found_entry;
+	}
+
+	return NULL;
+}
+
 /**
  * @brief Remove an entry from the lock lists
  *
@@ -770,6 +973,8 @@ static void remove_from_locklist(state_lock_entry_t *lock_entry)
 	}
 
 	lock_entry->sle_owner = NULL;
+	lock_index_remove(lock_entry);
+	glist_del(&lock_entry->sle_blocked_list);
 	glist_del(&lock_entry->sle_list);
 	lock_entry_dec_ref(lock_entry);
 }
@@ -789,13 +994,13 @@ static state_lock_entry_t *get_overlapping_entry(struct state_hdl *ostate,
 						 state_owner_t *owner,
 						 fsal_lock_param_t *lock)
 {
-	struct glist_head *glist;
-	state_lock_entry_t *found_entry = NULL;
+	state_lock_entry_t *found_entry;
 	uint64_t found_entry_end, range_end = lock_end(lock);
 
-	glist_for_each(glist, &ostate->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
-
+	for (found_entry = lock_index_first(ostate, lock->lock_start);
+	     found_entry != NULL &&
+	     found_entry->sle_lock.lock_start <= range_end;
+	     found_entry = lock_index_next(found_entry)) {
 		LogEntry("Checking", found_entry);
 
 		/* Skip blocked or cancelled locks */
@@ -828,9 +1033,10 @@ static state_lock_entry_t *get_overlapping_entry(struct state_hdl *ostate,
 /**
  * @brief Add a lock, potentially merging with existing locks
  *
- * We need to iterate over the full lock list and remove
- * any mapping entry. And l_offset = 0 and sle_lock.lock_length = 0 lock_entry
- * implies remove all entries
+ * The entries touching or overlapping the lock, found through the lock
+ * index, are merged into it, or shrunk or split if of another type.
+ * And l_offset = 0 and sle_lock.lock_length = 0 lock_entry implies
+ * remove all entries
  *
  * @note The state_lock MUST be held for write
  *
@@ -841,20 +1047,31 @@ static void merge_lock_entry(struct state_hdl *ostate,
 			     state_lock_entry_t *lock_entry)
 {
 	state_lock_entry_t *check_entry;
+	state_lock_entry_t *check_entry_next;
 	state_lock_entry_t *check_entry_right;
 	uint64_t check_entry_end;
 	uint64_t lock_entry_end;
-	struct glist_head *glist;
-	struct glist_head *glistn;
+	bool indexed = lock_entry->sle_indexed;
 
 	/* lock_entry might be STATE_NON_BLOCKING or STATE_GRANTING */
 
-	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
-		check_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	/* lock_entry could be in the list; its range changes as it
+	 * merges, so keep it out of the index meanwhile.
+	 */
+	lock_index_remove(lock_entry);
 
-		/* Skip entry being merged - it could be in the list */
-		if (check_entry == lock_entry)
-			continue;
+	/* Only locks touching or overlapping lock_entry matter */
+	for (check_entry = lock_index_first(ostate,
+				lock_entry->sle_lock.lock_start == 0
+				? 0 : lock_entry->sle_lock.lock_start - 1);
+	     check_entry != NULL;
+	     check_entry = check_entry_next) {
+		check_entry_next = lock_index_next(check_entry);
+
+		lock_entry_end = lock_end(&lock_entry->sle_lock);
+		if (lock_entry_end != UINT64_MAX &&
+		    check_entry->sle_lock.lock_start > lock_entry_end + 1)
+			break;
 
 		if (different_owners
 		    (check_entry->sle_owner, lock_entry->sle_owner))
@@ -888,11 +1105,11 @@ static void merge_lock_entry(struct state_hdl *ostate,
 			if (lock_entry_end < check_entry_end
 			    && check_entry->sle_lock.lock_start <
 			    lock_entry->sle_lock.lock_start) {
-				/* Need to split old lock */
+				/* Need to split old lock, the right part is
+				 * added once its range is set.
+				 */
 				check_entry_right =
 				    state_lock_entry_t_dup(check_entry);
-				glist_add_tail(&ostate->file.lock_list,
-					       &(check_entry_right->sle_list));
 			} else {
 				/* No split, just shrink, make the logic below
 				 * work on original lock
@@ -905,10 +1122,14 @@ static void merge_lock_entry(struct state_hdl *ostate,
 				 */
 				LogEntry("Merge shrinking right",
 					 check_entry_right);
+				if (check_entry_right == check_entry)
+					lock_index_remove(check_entry);
 				check_entry_right->sle_lock.lock_start =
 				    lock_entry_end + 1;
 				check_entry_right->sle_lock.lock_length =
 				    check_entry_end - lock_entry_end;
+				if (check_entry_right == check_entry)
+					lock_index_insert(ostate, check_entry);
 				LogEntry("Merge shrunk right",
 					 check_entry_right);
 			}
@@ -923,6 +1144,8 @@ static void merge_lock_entry(struct state_hdl *ostate,
 				    check_entry->sle_lock.lock_start;
 				LogEntry("Merge shrunk left", check_entry);
 			}
+			if (check_entry_right != check_entry)
+				lock_list_add(ostate, check_entry_right);
 			/* Done splitting/shrinking old lock */
 			continue;
 		}
@@ -949,6 +1172,9 @@ static void merge_lock_entry(struct state_hdl *ostate,
 		LogEntry("Merging removing", check_entry);
 		remove_from_locklist(check_entry);
 	}
+
+	if (indexed)
+		lock_index_insert(ostate, lock_entry);
 }
 
 /**
@@ -1048,6 +1274,7 @@ static state_status_t subtract_lock_from_entry(state_lock_entry_t *found_entry,
 	/* Remove the lock from the list it's
 	 * on and put it on the remove_list
 	 */
+	lock_index_remove(found_entry);
 	glist_del(&found_entry->sle_list);
 	glist_add_tail(remove_list, &(found_entry->sle_list));
 
@@ -1055,11 +1282,65 @@ static state_status_t subtract_lock_from_entry(state_lock_entry_t *found_entry,
 	return status;
 }
 
+/**
+ * @brief Subtract a lock from one entry of a list, if it applies
+ *
+ * @param[in]     found_entry Entry to check
+ * @param[in]     owner       Lock owner
+ * @param[in]     state       Associated lock state
+ * @param[in]     lock        Lock to remove
+ * @param[out]    split_list  Remaining fragments of found_entry
+ * @param[out]    remove_list Removed lock entries
+ * @param[in,out] removed     Set if found_entry was removed
+ *
+ * @return State status.
+ */
+static state_status_t
+subtract_lock_check_entry(state_lock_entry_t *found_entry,
+			  state_owner_t *owner,
+			  bool state_applies,
+			  int32_t state,
+			  fsal_lock_param_t *lock,
+			  struct glist_head *split_list,
+			  struct glist_head *remove_list,
+			  bool *removed)
+{
+	state_status_t status;
+	bool removed_one = false;
+
+	if (owner != NULL
+	    && different_owners(found_entry->sle_owner, owner))
+		return STATE_SUCCESS;
+
+	/* Only care about granted locks */
+	if (found_entry->sle_blocked != STATE_NON_BLOCKING)
+		return STATE_SUCCESS;
+
+	/* Skip locks owned by this NLM state.
+	 * This protects NLM locks from the current iteration of an NLM
+	 * client from being released by SM_NOTIFY.
+	 */
+	if (state_applies &&
+	    found_entry->sle_state->state_seqid == state)
+		return STATE_SUCCESS;
+
+	/* We have matched owner. Even though we are taking a reference
+	 * to found_entry, we don't inc the ref count because we want
+	 * to drop the lock entry.
+	 */
+	status = subtract_lock_from_entry(found_entry, lock, split_list,
+					  remove_list, &removed_one);
+	*removed |= removed_one;
+
+	return status;
+}
+
 /**
  * @brief Subtract a lock from a list of locks
  *
  * This function possibly splits entries in the list.
  *
+ * @param[in]     ostate  File state if list is its lock_list, else NULL
  * @param[in]     owner   Lock owner
  * @param[in]     state   Associated lock state
  * @param[in]     lock    Lock to remove
@@ -1068,58 +1349,53 @@ static state_status_t subtract_lock_from_entry(state_lock_entry_t *found_entry,
  *
  * @return State status.
  */
-static state_status_t subtract_lock_from_list(state_owner_t *owner,
+static state_status_t subtract_lock_from_list(struct state_hdl *ostate,
+					      state_owner_t *owner,
 					      bool state_applies,
 					      int32_t state,
 					      fsal_lock_param_t *lock,
 					      bool *removed,
 					      struct glist_head *list)
 {
-	state_lock_entry_t *found_entry;
+	state_lock_entry_t *found_entry, *next_entry;
 	struct glist_head split_lock_list, remove_list;
 	struct glist_head *glist, *glistn;
 	state_status_t status = STATE_SUCCESS;
-	bool removed_one = false;
+	uint64_t range_end = lock_end(lock);
 
 	*removed = false;
 
 	glist_init(&split_lock_list);
 	glist_init(&remove_list);
 
-	glist_for_each_safe(glist, glistn, list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
-
-		if (owner != NULL
-		    && different_owners(found_entry->sle_owner, owner))
-			continue;
-
-		/* Only care about granted locks */
-		if (found_entry->sle_blocked != STATE_NON_BLOCKING)
-			continue;
-
-		/* Skip locks owned by this NLM state.
-		 * This protects NLM locks from the current iteration of an NLM
-		 * client from being released by SM_NOTIFY.
-		 */
-		if (state_applies &&
-		    found_entry->sle_state->state_seqid == state)
-			continue;
-
-		/* We have matched owner. Even though we are taking a reference
-		 * to found_entry, we don't inc the ref count because we want
-		 * to drop the lock entry.
-		 */
-		status =
-		    subtract_lock_from_entry(found_entry, lock,
-					     &split_lock_list, &remove_list,
-					     &removed_one);
-		*removed |= removed_one;
-
-		if (status != STATE_SUCCESS) {
-			/* We ran out of memory while splitting,
-			 * deal with it outside loop
-			 */
-			break;
+	if (ostate != NULL) {
+		/* Only the locks overlapping lock can be affected */
+		for (found_entry = lock_index_first(ostate, lock->lock_start);
+		     found_entry != NULL &&
+		     found_entry->sle_lock.lock_start <= range_end;
+		     found_entry = next_entry) {
+			next_entry = lock_index_next(found_entry);
+			status = subtract_lock_check_entry(found_entry, owner,
+							   state_applies, state,
+							   lock,
+							   &split_lock_list,
+							   &remove_list,
+							   removed);
+			if (status != STATE_SUCCESS)
+				break;
+		}
+	} else {
+		glist_for_each_safe(glist, glistn, list) {
+			found_entry = glist_entry(glist, state_lock_entry_t,
+						  sle_list);
+			status = subtract_lock_check_entry(found_entry, owner,
+							   state_applies, state,
+							   lock,
+							   &split_lock_list,
+							   &remove_list,
+							   removed);
+			if (status != STATE_SUCCESS)
+				break;
 		}
 	}
 
@@ -1134,12 +1410,22 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 			    glist_entry(glist, state_lock_entry_t, sle_list);
 			glist_del(&found_entry->sle_list);
 			glist_add_tail(list, &(found_entry->sle_list));
+			if (ostate != NULL)
+				lock_index_insert(ostate, found_entry);
 		}
 	} else {
 		/* free the enttries on the remove_list */
 		free_list(&remove_list);
 
 		/* now add the split lock list */
+		if (ostate != NULL) {
+			glist_for_each(glist, &split_lock_list) {
+				found_entry = glist_entry(glist,
+							  state_lock_entry_t,
+							  sle_list);
+				lock_index_insert(ostate, found_entry);
+			}
+		}
 		glist_add_list_tail(list, &split_lock_list);
 	}
 
@@ -1171,7 +1457,7 @@ static state_status_t subtract_list_from_list(struct fsal_obj_handle *obj,
 	glist_for_each_safe(glist, glistn, source) {
 		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
 
-		status = subtract_lock_from_list(NULL, false, 0,
+		status = subtract_lock_from_list(NULL, NULL, false, 0,
 						 &found_entry->sle_lock,
 						 &removed, target);
 		if (status != STATE_SUCCESS)
@@ -1692,6 +1978,7 @@ void grant_blocked_lock_immediate(struct state_hdl *ostate,
 
 	/* Mark lock as granted */
 	lock_entry->sle_blocked = STATE_NON_BLOCKING;
+	glist_del(&lock_entry->sle_blocked_list);
 
 	/* Merge any touching or overlapping locks into this one. */
 	LogEntry("Granted immediate, merging locks for", lock_entry);
@@ -1731,6 +2018,7 @@ void state_complete_grant(state_cookie_entry_t *cookie_entry)
 	if (lock_entry->sle_blocked == STATE_GRANTING) {
 		/* Mark lock as granted */
 		lock_entry->sle_blocked = STATE_NON_BLOCKING;
+		glist_del(&lock_entry->sle_blocked_list);
 
 		/* Merge any touching or overlapping locks into this one. */
 		LogEntry("Granted, merging locks for", lock_entry);
@@ -1874,8 +2162,9 @@ static void grant_blocked_locks(struct state_hdl *ostate)
 	if (export->exp_ops.fs_supports(export, fso_lock_support_async_block))
 		return;
 
-	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	glist_for_each_safe(glist, glistn, &ostate->file.blocked_locks) {
+		found_entry = glist_entry(glist, state_lock_entry_t,
+					  sle_blocked_list);
 
 		if (found_entry->sle_blocked != STATE_NLM_BLOCKING
 		    && found_entry->sle_blocked != STATE_NFSV4_BLOCKING)
@@ -2006,8 +2295,9 @@ void cancel_blocked_locks_range(struct state_hdl *ostate,
 	state_lock_entry_t *found_entry = NULL;
 	uint64_t found_entry_end, range_end = lock_end(lock);
 
-	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	glist_for_each_safe(glist, glistn, &ostate->file.blocked_locks) {
+		found_entry = glist_entry(glist, state_lock_entry_t,
+					  sle_blocked_list);
 
 		/* Skip locks not owned by owner */
 		if (owner != NULL
@@ -2289,6 +2579,8 @@ state_status_t do_lock_op(struct fsal_obj_handle *obj,
 	if (!fsal_export->exp_ops.fs_supports(fsal_export, fso_lock_support)
 	    || (!fsal_export->exp_ops.
 		fs_supports(fsal_export, fso_lock_support_async_block)
+		&& !fsal_export->exp_ops.
+		fs_supports(fsal_export, fso_lock_avail_upcall)
 		&& lock_op == FSAL_OP_CANCEL)
 	    || (!fsal_export->exp_ops.
 		fs_supports(fsal_export, fso_lock_support_owner)
@@ -2305,10 +2597,16 @@ state_status_t do_lock_op(struct fsal_obj_handle *obj,
 	    || lock_op != FSAL_OP_UNLOCK) {
 		fsal_lock_op_t fsal_lock_op = lock_op;
 
+		/* An FSAL that only signals availability is still told
+		 * the lock would block, so it can watch for its release.
+		 */
 		if (lock_op == FSAL_OP_LOCKB &&
 		    !fsal_export->exp_ops.fs_supports(
 						fsal_export,
-						fso_lock_support_async_block))
+						fso_lock_support_async_block) &&
+		    !fsal_export->exp_ops.fs_supports(
+						fsal_export,
+						fso_lock_avail_upcall))
 			fsal_lock_op = FSAL_OP_LOCK;
 
 		if (!obj->fsal->m_ops.support_ex(obj)) {
@@ -2338,7 +2636,10 @@ state_status_t do_lock_op(struct fsal_obj_handle *obj,
 			     state_err_str(status));
 
 		if (status == STATE_LOCK_BLOCKED
-		    && fsal_lock_op != FSAL_OP_LOCKB) {
+		    && (fsal_lock_op != FSAL_OP_LOCKB
+			|| !fsal_export->exp_ops.fs_supports(
+					fsal_export,
+					fso_lock_support_async_block))) {
 			/* This is an unexpected return code,
 			 * make sure caller reports an error
 			 */
@@ -2549,39 +2850,38 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 
 	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
 
+	/* Need to reject lock request if this lock owner already has
+	 * a lock on this file via a different export.
+	 */
+	found_entry = lock_owner_other_export(obj->state_hdl, owner);
+	if (found_entry != NULL) {
+		LogEvent(COMPONENT_STATE,
+			 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
+			 found_entry->sle_export->export_id,
+			 op_ctx_export_path(found_entry->sle_export),
+			 op_ctx->ctx_export->export_id,
+			 op_ctx_export_path(op_ctx->ctx_export));
+
+		LogEntry("Found lock entry belonging to another export",
+			 found_entry);
+
+		status = STATE_INVALID_ARGUMENT;
+		goto out_unlock;
+	}
+
 	if (blocking != STATE_NON_BLOCKING) {
 		/* First search for a blocked request. Client can ignore the
 		 * blocked request and keep sending us new lock request again
 		 * and again. So if we have a mapping blocked request return
 		 * that
 		 */
-		glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-			found_entry =
-			    glist_entry(glist, state_lock_entry_t, sle_list);
+		glist_for_each(glist, &obj->state_hdl->file.blocked_locks) {
+			found_entry = glist_entry(glist, state_lock_entry_t,
+						  sle_blocked_list);
 
 			if (different_owners(found_entry->sle_owner, owner))
 				continue;
 
-			/* Need to reject lock request if this lock owner
-			 * already has a lock on this file via a different
-			 * export.
-			 */
-			if (found_entry->sle_export != op_ctx->ctx_export) {
-				LogEvent(COMPONENT_STATE,
-					 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-					 found_entry->sle_export->export_id,
-					 op_ctx_export_path(
-						found_entry->sle_export),
-					 op_ctx->ctx_export->export_id,
-					 op_ctx_export_path(
-							op_ctx->ctx_export));
-				LogEntry(
-					"Found lock entry belonging to another export",
-					found_entry);
-				status = STATE_INVALID_ARGUMENT;
-				goto out_unlock;
-			}
-
 			if (found_entry->sle_blocked != blocking)
 				continue;
 
@@ -2598,27 +2898,10 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		}
 	}
 
-	glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
-		/* Need to reject lock request if this lock owner already has
-		 * a lock on this file via a different export.
-		 */
-		if (found_entry->sle_export != op_ctx->ctx_export
-		    && !different_owners(found_entry->sle_owner, owner)) {
-			LogEvent(COMPONENT_STATE,
-				 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-				 found_entry->sle_export->export_id,
-				 op_ctx_export_path(found_entry->sle_export),
-				 op_ctx->ctx_export->export_id,
-				 op_ctx_export_path(op_ctx->ctx_export));
-
-			LogEntry("Found lock entry belonging to another export",
-				 found_entry);
-
-			status = STATE_INVALID_ARGUMENT;
-			goto out_unlock;
-		}
-
+	for (found_entry = lock_index_first(obj->state_hdl, lock->lock_start);
+	     found_entry != NULL &&
+	     found_entry->sle_lock.lock_start <= range_end;
+	     found_entry = lock_index_next(found_entry)) {
 		/* Don't skip blocked locks for fairness */
 		found_entry_end = lock_end(&found_entry->sle_lock);
 
@@ -2807,8 +3090,7 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		/* Insert entry into lock list */
 		LogEntry("New lock", found_entry);
 
-		glist_add_tail(&obj->state_hdl->file.lock_list,
-			       &found_entry->sle_list);
+		lock_list_add(obj->state_hdl, found_entry);
 
 		/* A lock downgrade could unblock blocked locks */
 		grant_blocked_locks(obj->state_hdl);
@@ -2840,8 +3122,9 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		/* Insert entry into lock list */
 		LogEntry("FSAL block for", found_entry);
 
-		glist_add_tail(&obj->state_hdl->file.lock_list,
-			       &found_entry->sle_list);
+		lock_list_add(obj->state_hdl, found_entry);
+		glist_add_tail(&obj->state_hdl->file.blocked_locks,
+			       &found_entry->sle_blocked_list);
 
 		PTHREAD_MUTEX_lock(&blocked_locks_mutex);
 
@@ -2914,8 +3197,8 @@ state_status_t state_unlock(struct fsal_obj_handle *obj,
 				   nsm_state, lock);
 
 	/* Release the lock from cache inode lock list for entry */
-	status = subtract_lock_from_list(owner, state_applies, nsm_state, lock,
-					 &removed,
+	status = subtract_lock_from_list(obj->state_hdl, owner, state_applies,
+					 nsm_state, lock, &removed,
 					 &obj->state_hdl->file.lock_list);
 
 	/* If the lock list has become zero; decrement the pin ref count pt
@@ -2966,6 +3249,7 @@ state_status_t state_unlock(struct fsal_obj_handle *obj,
 
 	grant_blocked_locks(obj->state_hdl);
 
+	nfs4_lock_notify_release(obj, lock);
 
 	if (isFullDebug(COMPONENT_STATE) && isFullDebug(COMPONENT_MEMLEAKS)
 	    && lock->lock_start == 0 && lock->lock_length == 0 && empty)
@@ -3009,8 +3293,9 @@ state_status_t state_cancel(struct fsal_obj_handle *obj,
 		goto out_unlock;
 	}
 
-	glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	glist_for_each(glist, &obj->state_hdl->file.blocked_locks) {
+		found_entry = glist_entry(glist, state_lock_entry_t,
+					  sle_blocked_list);
 
 		if (different_owners(found_entry->sle_owner, owner))
 			continue;
@@ -3660,6 +3945,15 @@ static void find_blocked_lock_upcall(struct fsal_obj_handle *obj, void *owner,
 
 	PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
 
+	/* FSALs that don't block themselves only say a lock may now be
+	 * had, the blocked lock may have been granted or cancelled since.
+	 */
+	if (grant_type == STATE_GRANT_FSAL_AVAILABLE) {
+		LogLockDesc(COMPONENT_STATE, NIV_DEBUG,
+			    "No blocked lock left for", obj, owner, lock);
+		return;
+	}
+
 	/* We must be out of sync with FSAL, this is fatal */
 	LogLockDesc(COMPONENT_STATE, NIV_MAJ, "Blocked Lock Not Found for",
 		    obj, owner, lock);
@@ -3697,6 +3991,9 @@ void available_blocked_lock_upcall(struct fsal_obj_handle *obj, void *owner,
 
 	find_blocked_lock_upcall(obj, owner, lock,
 				 STATE_GRANT_FSAL_AVAILABLE);
+
+	/* NFSv4.1 clients waiting on the same range may retry too */
+	nfs4_lock_notify_release(obj, lock);
 }
 
 /**
@@ -837,7 +837,8 @@ void free_state_owner(state_owner_t *owner)
 		return;
 	}
 
-	if (owner->so_owner_val != NULL)
+	if (owner->so_owner_val != NULL &&
+	    owner->so_owner_val != owner->so_owner_inline)
 		gsh_free(owner->so_owner_val);
 
 	PTHREAD_MUTEX_destroy(&owner->so_mutex);
@@ -1164,13 +1165,15 @@ not_found:
 		init_owner(owner);
 
 
-	if (key->so_owner_len != 0) {
+	if (key->so_owner_len > STATE_OWNER_INLINE_LEN)
 		owner->so_owner_val = gsh_malloc(key->so_owner_len);
+	else
+		owner->so_owner_val = owner->so_owner_inline;
 
+	if (key->so_owner_len != 0)
 		memcpy(owner->so_owner_val,
 		       key->so_owner_val,
 		       key->so_owner_len);
-	}
 
 	glist_init(&owner->so_lock_list);
 
@@ -1225,12 +1228,18 @@ not_found:
 void state_wipe_file(struct fsal_obj_handle *obj)
 {
 	bool release;
+
 	/*
-	 * currently, only REGULAR files can have state; byte range locks and
-	 * stateid (for v4).  In the future, 4.1, directories could have
-	 * delegations, which is state.  At that point, we may need to modify
-	 * this routine to clear state on directories.
+	 * Regular files have byte range locks and stateids (for v4),
+	 * directories only have directory delegations.
 	 */
+	if (obj->type == DIRECTORY) {
+		PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
+		state_nfs4_dir_state_wipe(obj->state_hdl);
+		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+		return;
+	}
+
 	if (obj->type != REGULAR_FILE)
 		return;
 
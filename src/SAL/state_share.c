@@ -58,6 +58,9 @@ static unsigned int state_share_get_share_access(struct state_hdl *hstate);
 
 static unsigned int state_share_get_share_deny(struct state_hdl *hstate);
 
+static bool state_share_anon_conflict(struct state_hdl *hstate,
+				      unsigned int share_deny);
+
 /**
  * @brief Push share state down to FSAL
  *
@@ -128,6 +131,17 @@ state_status_t state_share_add(struct fsal_obj_handle *obj,
 				   OPEN4_SHARE_DENY_NONE, new_share_access,
 				   new_share_deny, true);
 
+	/* Anonymous I/O does not take the state_lock, so it is only seen
+	 * now that the new deny mode has been published.
+	 */
+	if (state_share_anon_conflict(obj->state_hdl, new_share_deny)) {
+		state_share_update_counter(obj->state_hdl, new_share_access,
+					   new_share_deny,
+					   OPEN4_SHARE_ACCESS_NONE,
+					   OPEN4_SHARE_DENY_NONE, true);
+		return STATE_SHARE_DENIED;
+	}
+
 	/* Get the updated union of share states of this file. */
 	new_entry_share_access = state_share_get_share_access(obj->state_hdl);
 	new_entry_share_deny = state_share_get_share_deny(obj->state_hdl);
@@ -297,6 +311,14 @@ state_status_t state_share_upgrade(struct fsal_obj_handle *obj,
 				   old_share_deny, new_share_access,
 				   new_share_deny, true);
 
+	if (state_share_anon_conflict(obj->state_hdl,
+				      new_share_deny & ~old_share_deny)) {
+		state_share_update_counter(obj->state_hdl, new_share_access,
+					   new_share_deny, old_share_access,
+					   old_share_deny, true);
+		return STATE_SHARE_DENIED;
+	}
+
 	/* Get the updated union of share states of this file. */
 	new_entry_share_access = state_share_get_share_access(obj->state_hdl);
 	new_entry_share_deny = state_share_get_share_deny(obj->state_hdl);
@@ -506,6 +528,11 @@ state_status_t state_share_check_conflict(struct state_hdl *hstate,
 		goto out_conflict;
 	}
 
+	if (state_share_anon_conflict(hstate, share_deny)) {
+		cause = "deny denied by anonymous I/O in progress";
+		goto out_conflict;
+	}
+
 	return STATE_SUCCESS;
 
  out_conflict:
@@ -543,12 +570,22 @@ static void state_share_update_counter(struct state_hdl *hstate, int
 	    ((new_deny & OPEN4_SHARE_DENY_WRITE) !=
 	     0) - ((old_deny & OPEN4_SHARE_DENY_WRITE) != 0);
 
-	hstate->file.share_state.share_access_read += access_read_inc;
-	hstate->file.share_state.share_access_write += access_write_inc;
-	hstate->file.share_state.share_deny_read += deny_read_inc;
-	hstate->file.share_state.share_deny_write += deny_write_inc;
+	/* Anonymous I/O reads the deny counts without the state_lock, and
+	 * a new deny mode must be published before it is checked against
+	 * that I/O, so these are full barriers.
+	 */
+	(void) atomic_add_uint32_t(&hstate->file.share_state.share_access_read,
+				   access_read_inc);
+	(void) atomic_add_uint32_t(&hstate->file.share_state.share_access_write,
+				   access_write_inc);
+	(void) atomic_add_uint32_t(&hstate->file.share_state.share_deny_read,
+				   deny_read_inc);
+	(void) atomic_add_uint32_t(&hstate->file.share_state.share_deny_write,
+				   deny_write_inc);
 	if (v4)
-		hstate->file.share_state.share_deny_write_v4 += deny_write_inc;
+		(void) atomic_add_uint32_t(
+			&hstate->file.share_state.share_deny_write_v4,
+			deny_write_inc);
 
 	LogFullDebug(COMPONENT_STATE,
 		     "obj %p: share counter: access_read %u, access_write %u, deny_read %u, deny_write %u, deny_write_v4 %u",
@@ -610,12 +647,110 @@ static unsigned int state_share_get_share_deny(struct state_hdl *hstate)
 	return share_deny;
 }
 
+/**
+ * @brief Check a deny mode against anonymous I/O in progress
+ *
+ * This does not need the state_lock, a caller adding a deny mode must
+ * call it after the deny counts have been updated.
+ *
+ * @param[in] hstate     File state to check
+ * @param[in] share_deny Deny mode to check
+ *
+ * @return true if the deny mode conflicts with anonymous I/O.
+ */
+static bool state_share_anon_conflict(struct state_hdl *hstate,
+				      unsigned int share_deny)
+{
+	sal_share_t *share = &hstate->file.share_state;
+
+	if ((share_deny & OPEN4_SHARE_DENY_READ) != 0
+	    && atomic_fetch_uint32_t(&share->share_anon_read) > 0)
+		return true;
+
+	if ((share_deny & OPEN4_SHARE_DENY_WRITE) != 0
+	    && atomic_fetch_uint32_t(&share->share_anon_write) > 0)
+		return true;
+
+	return false;
+}
+
+/**
+ * @brief Check anonymous I/O against existing deny modes
+ *
+ * This is the access half of state_share_check_conflict, done without
+ * the state_lock.
+ *
+ * @param[in] hstate       File state to check
+ * @param[in] share_access Access matching I/O done
+ * @param[in] bypass       Indicates if any bypass is to be used
+ *
+ * @return true if the I/O is denied.
+ */
+static bool state_share_anon_denied(struct state_hdl *hstate,
+				    int share_access,
+				    enum share_bypass_modes bypass)
+{
+	sal_share_t *share = &hstate->file.share_state;
+
+	if ((share_access & OPEN4_SHARE_ACCESS_READ) != 0
+	    && bypass != SHARE_BYPASS_READ
+	    && atomic_fetch_uint32_t(&share->share_deny_read) > 0)
+		return true;
+
+	if ((share_access & OPEN4_SHARE_ACCESS_WRITE) != 0
+	    && (atomic_fetch_uint32_t(&share->share_deny_write_v4) > 0 ||
+		(bypass != SHARE_BYPASS_V3_WRITE &&
+		 atomic_fetch_uint32_t(&share->share_deny_write) > 0)))
+		return true;
+
+	return false;
+}
+
+/**
+ * @brief Count anonymous I/O in or out
+ *
+ * @param[in] hstate       File state to update
+ * @param[in] share_access Access matching I/O done
+ * @param[in] start        true if the I/O is starting
+ */
+static void state_share_anon_update(struct state_hdl *hstate,
+				    int share_access, bool start)
+{
+	sal_share_t *share = &hstate->file.share_state;
+	uint32_t inc = start ? 1 : -1;
+
+	if ((share_access & OPEN4_SHARE_ACCESS_READ) != 0)
+		(void) atomic_add_uint32_t(&share->share_anon_read, inc);
+
+	if ((share_access & OPEN4_SHARE_ACCESS_WRITE) != 0)
+		(void) atomic_add_uint32_t(&share->share_anon_write, inc);
+}
+
+/**
+ * @brief Whether I/O is a read on an Immutable export
+ *
+ * No write or deny mode is ever granted there, so such a read need not
+ * be counted or checked.  Immutable is static, so start and done agree.
+ *
+ * @param[in] share_access Access matching I/O done
+ */
+static inline bool state_share_immutable_read(int share_access)
+{
+	return (share_access & OPEN4_SHARE_ACCESS_WRITE) == 0 &&
+	       op_ctx->ctx_export != NULL && op_ctx->ctx_export->immutable;
+}
+
 /**
  * @brief Start I/O by an anonymous stateid
  *
  * This function checks for conflicts with existing deny modes and
  * marks the I/O as in process to conflicting shares won't be granted.
  *
+ * The I/O is counted before the deny modes are looked at, and a new
+ * deny mode is counted before the I/O is looked at, so at least one
+ * side sees the other and the state_lock is only needed when there are
+ * delegations to check.
+ *
  * @brief[in]     obj          File on which to operate
  * @brief[in]     share_access Access matching I/O done
  * @brief[in]     bypass       Indicates if any bypass is to be used
@@ -631,41 +766,49 @@ state_status_t state_share_anonymous_io_start(struct fsal_obj_handle *obj,
 	 *             work for v3 and v4, and in fact, this function
 	 *             should be called indicating v3 or v4...
 	 */
-	state_status_t status = 0;
+	struct state_hdl *hstate = obj->state_hdl;
+	state_status_t status = STATE_SUCCESS;
 
-	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
+	/* Reads of an immutable export conflict with nothing */
+	if (state_share_immutable_read(share_access))
+		return STATE_SUCCESS;
 
-	status = state_share_check_conflict(obj->state_hdl,
-					    share_access,
-					    OPEN4_SHARE_DENY_NONE,
-					    bypass);
-	if (status != STATE_SUCCESS) {
-		/* Need to convert the error from STATE_SHARE_CONFLICT */
-		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+	/* update a counter that says we are processing an anonymous
+	 * request and can't currently grant a new delegation */
+	(void) atomic_inc_uint32_t(&hstate->file.anon_ops);
+
+	state_share_anon_update(hstate, share_access, true);
+
+	if (state_share_anon_denied(hstate, share_access, bypass)) {
+		LogDebug(COMPONENT_STATE,
+			 "Share conflict detected: anonymous I/O denied by existing deny");
+		/* Not STATE_SHARE_DENIED, that is for share reservations */
 		status = STATE_LOCKED;
-		return status;
+		goto out_undo;
 	}
 
+	if (atomic_fetch_uint32_t(
+		&hstate->file.fdeleg_stats.fds_curr_delegations) == 0)
+		return STATE_SUCCESS;
+
+	PTHREAD_RWLOCK_wrlock(&hstate->state_lock);
+
 	if (state_deleg_conflict(obj,
 				 share_access & OPEN4_SHARE_ACCESS_WRITE)) {
 		/* Delegations are being recalled. Delay client until that
 		 * process finishes. */
-		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
-		return STATE_FSAL_DELAY;
+		status = STATE_FSAL_DELAY;
 	}
 
-	/* update a counter that says we are processing an anonymous
-	 * request and can't currently grant a new delegation */
-	(void) atomic_inc_uint32_t(&obj->state_hdl->file.anon_ops);
+	PTHREAD_RWLOCK_unlock(&hstate->state_lock);
 
-	/* Temporarily bump the access counters, v4 mode doesn't matter
-	 * since there is no deny mode associated with anonymous I/O.
-	 */
-	state_share_update_counter(obj->state_hdl, OPEN4_SHARE_ACCESS_NONE,
-				   OPEN4_SHARE_DENY_NONE, share_access,
-				   OPEN4_SHARE_DENY_NONE, false);
+	if (status == STATE_SUCCESS)
+		return status;
 
-	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+ out_undo:
+
+	state_share_anon_update(hstate, share_access, false);
+	(void) atomic_dec_uint32_t(&hstate->file.anon_ops);
 	return status;
 }
 
@@ -678,13 +821,10 @@ state_status_t state_share_anonymous_io_start(struct fsal_obj_handle *obj,
 void state_share_anonymous_io_done(struct fsal_obj_handle *obj,
 				   int share_access)
 {
-	/* Undo the temporary bump to the access counters, v4 mode doesn't
-	 * matter since there is no deny mode associated with anonymous I/O.
-	 */
-	state_share_update_counter(obj->state_hdl, share_access,
-				   OPEN4_SHARE_DENY_NONE,
-				   OPEN4_SHARE_ACCESS_NONE,
-				   OPEN4_SHARE_DENY_NONE, false);
+	if (state_share_immutable_read(share_access))
+		return;
+
+	state_share_anon_update(obj->state_hdl, share_access, false);
 
 	/* If we are this far, then delegations weren't recalled and we
 	 * incremented this variable. */
@@ -994,6 +1134,21 @@ state_status_t state_nlm_share(struct fsal_obj_handle *obj,
 				   share_deny,
 				   false);
 
+	if (state_share_anon_conflict(obj->state_hdl,
+				      share_deny & ~old_share_deny)) {
+		state_share_update_counter(obj->state_hdl,
+					   share_access,
+					   share_deny,
+					   old_share_access,
+					   old_share_deny,
+					   false);
+
+		remove_nlm_share(state);
+
+		status = STATE_SHARE_DENIED;
+		goto out_unlock;
+	}
+
 	/* Get the updated union of share states of this file. */
 	new_entry_share_access = state_share_get_share_access(obj->state_hdl);
 	new_entry_share_deny = state_share_get_share_deny(obj->state_hdl);
@@ -30,17 +30,32 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <ctype.h>
 #if HAVE_STRING_H
 #include <string.h>
 #endif
 #include "abstract_mem.h"
 
+static inline uint32_t token_hash(const char *token)
+{
+	uint32_t h = 2166136261U;
+
+	while (*token != '\0') {
+		h ^= (unsigned char)tolower(*token++);
+		h *= 16777619U;
+	}
+
+	return h % TOKEN_HASH_SIZE;
+}
+
 /**
  * @brief Insert a scanner token into the token table
  *
- * Look up the token in the list matching case insensitive.
+ * Look up the token in the table matching case insensitive.
  * If there is a match, return a pointer to the token in the table.
  * Otherwise, allocate space, link it and return the pointer.
+ * The table is hashed on the case folded token, so huge configs do not
+ * scan the whole list for every token.
  * if 'esc' == true, this is a double quoted string which needs to
  * be filtered.  Turn the escaped non-printable into the non-printable.
  *
@@ -53,10 +68,15 @@
 char *save_token(char *token, bool esc, struct parser_state *st)
 {
 	struct token_tab *tokp, *new_tok;
+	uint32_t bucket;
+
+	if (st->token_hash == NULL)
+		st->token_hash = gsh_calloc(TOKEN_HASH_SIZE,
+					    sizeof(struct token_tab *));
 
-	for (tokp = st->root_node->tokens;
+	for (tokp = st->token_hash[token_hash(token)];
 	     tokp != NULL;
-	     tokp = tokp->next) {
+	     tokp = tokp->hash_next) {
 		if (strcasecmp(token, tokp->token) == 0)
 			return tokp->token;
 	}
@@ -105,6 +125,9 @@ char *save_token(char *token, bool esc, struct parser_state *st)
 	}
 	new_tok->next = st->root_node->tokens;
 	st->root_node->tokens = new_tok;
+	bucket = token_hash(new_tok->token);
+	new_tok->hash_next = st->token_hash[bucket];
+	st->token_hash[bucket] = new_tok;
 	return new_tok->token;
 }
 
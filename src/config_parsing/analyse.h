@@ -85,9 +85,14 @@ struct file_list {
 
 struct token_tab {
 	struct token_tab *next;
+	struct token_tab *hash_next;	/* chain in parser_state.token_hash */
+	uint32_t cache_index;		/* index in a parse cache */
 	char token[];
 };
 
+/* Buckets of the token table hash, see save_token */
+#define TOKEN_HASH_SIZE 4096
+
 /*
  * Parse tree root
  * A parse tree consists of several blocks,
@@ -116,6 +121,7 @@ struct parser_state {
 	char *current_file;
 	int block_depth; /* block/subblock nesting level */
 	struct config_error_type *err_type;
+	struct token_tab **token_hash; /* tokens hashed case insensitive */
 };
 
 char *save_token(char *token, bool esc, struct parser_state *st);
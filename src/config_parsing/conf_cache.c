@@ -0,0 +1,546 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file conf_cache.c
+ * @brief Binary cache of configuration parse trees
+ *
+ * Huge generated configs spend most of their load time in the scanner
+ * and the parser.  The parse tree of a config that parsed cleanly is
+ * written out to a cache file, along with the hash of the contents of
+ * every file that went into it.  As long as none of those files
+ * changed, the next load maps the cache and rebuilds the tree straight
+ * from it.
+ *
+ * The rebuilt tree is allocated just as the parser would have, so it
+ * is processed and freed by the usual code.  What the blocks mean is
+ * still worked out from the tree on every load; only the parse is
+ * cached.
+ *
+ * The cache holds, in order: a magic, the name of the config file, the
+ * source files (hash, path), the configuration directory, the token
+ * table and the nodes below the root, in pre-order.  Integers are in
+ * host order; a cache is only meant for the host that wrote it.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "config_parsing.h"
+#include "analyse.h"
+#include "abstract_mem.h"
+#include "log.h"
+
+#define CONF_CACHE_MAGIC "GSHCONF1"
+#define CONF_CACHE_NONE UINT32_MAX
+
+/**
+ * @brief Hash the contents of a file
+ *
+ * @param[in]  path  The file
+ * @param[out] hash  Its hash
+ *
+ * @return 0 or an errno.
+ */
+
+static int conf_cache_hash_file(const char *path, uint64_t *hash)
+{
+	char buf[16384];
+	uint64_t h = 0xcbf29ce484222325ULL;
+	ssize_t n, i;
+	int fd, rc = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return errno;
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < n; i++) {
+			h ^= (unsigned char)buf[i];
+			h *= 0x100000001b3ULL;
+		}
+	}
+
+	if (n < 0)
+		rc = errno;
+
+	close(fd);
+	*hash = h;
+	return rc;
+}
+
+/*
+ * Writing
+ */
+
+static void put_u32(FILE *fp, uint32_t v)
+{
+	(void)fwrite(&v, sizeof(v), 1, fp);
+}
+
+static void put_str(FILE *fp, const char *s)
+{
+	uint32_t len = strlen(s);
+
+	put_u32(fp, len);
+	(void)fwrite(s, len, 1, fp);
+}
+
+static uint32_t file_index(struct config_root *tree, const char *filename)
+{
+	struct file_list *file;
+	uint32_t i = 0;
+
+	for (file = tree->files; file != NULL; file = file->next, i++)
+		if (file->pathname == filename)
+			return i;
+
+	return CONF_CACHE_NONE;
+}
+
+static uint32_t token_index(const char *token)
+{
+	if (token == NULL)
+		return CONF_CACHE_NONE;
+
+	return container_of(token, struct token_tab, token[0])->cache_index;
+}
+
+static void put_node(FILE *fp, struct config_root *tree,
+		     struct config_node *node)
+{
+	struct glist_head *ns;
+
+	put_u32(fp, node->type);
+	put_u32(fp, node->linenumber);
+	put_u32(fp, file_index(tree, node->filename));
+
+	if (node->type == TYPE_TERM) {
+		put_u32(fp, node->u.term.type);
+		put_u32(fp, token_index(node->u.term.op_code));
+		put_u32(fp, token_index(node->u.term.varvalue));
+		return;
+	}
+
+	put_u32(fp, token_index(node->u.nterm.name));
+	put_u32(fp, glist_length(&node->u.nterm.sub_nodes));
+
+	glist_for_each(ns, &node->u.nterm.sub_nodes)
+		put_node(fp, tree, glist_entry(ns, struct config_node, node));
+}
+
+/**
+ * @brief Write the cache of a parse tree
+ *
+ * The cache is written aside and renamed into place, so a reader never
+ * sees a partial one.  Failing to write it is not an error, the next
+ * load just parses again.
+ *
+ * @param[in] config      A parse tree without errors
+ * @param[in] cache_path  Where to store it
+ */
+
+static void conf_cache_save(config_file_t config, const char *cache_path)
+{
+	struct config_root *tree = (struct config_root *)config;
+	struct file_list *file;
+	struct token_tab *token;
+	struct glist_head *ns;
+	uint32_t count;
+	uint64_t hash;
+	char *tmp_path;
+	FILE *fp;
+	int rc;
+
+	tmp_path = gsh_malloc(strlen(cache_path) + sizeof(".tmp"));
+	sprintf(tmp_path, "%s.tmp", cache_path);
+
+	fp = fopen(tmp_path, "w");
+	if (fp == NULL) {
+		LogInfo(COMPONENT_CONFIG,
+			"Could not create config cache %s: %s",
+			tmp_path, strerror(errno));
+		goto out;
+	}
+
+	(void)fwrite(CONF_CACHE_MAGIC, sizeof(CONF_CACHE_MAGIC) - 1, 1, fp);
+	put_str(fp, tree->root.filename);
+
+	for (count = 0, file = tree->files; file != NULL; file = file->next)
+		count++;
+	put_u32(fp, count);
+
+	for (file = tree->files; file != NULL; file = file->next) {
+		rc = conf_cache_hash_file(file->pathname, &hash);
+		if (rc != 0) {
+			LogInfo(COMPONENT_CONFIG,
+				"Could not hash %s for the config cache: %s",
+				file->pathname, strerror(rc));
+			fclose(fp);
+			unlink(tmp_path);
+			goto out;
+		}
+		(void)fwrite(&hash, sizeof(hash), 1, fp);
+		put_str(fp, file->pathname);
+	}
+
+	put_str(fp, tree->conf_dir != NULL ? tree->conf_dir : "");
+
+	for (count = 0, token = tree->tokens; token != NULL;
+	     token = token->next)
+		token->cache_index = count++;
+	put_u32(fp, count);
+
+	for (token = tree->tokens; token != NULL; token = token->next)
+		put_str(fp, token->token);
+
+	put_u32(fp, glist_length(&tree->root.u.nterm.sub_nodes));
+
+	glist_for_each(ns, &tree->root.u.nterm.sub_nodes)
+		put_node(fp, tree, glist_entry(ns, struct config_node, node));
+
+	if (ferror(fp) || fclose(fp) != 0) {
+		LogInfo(COMPONENT_CONFIG,
+			"Could not write config cache %s", tmp_path);
+		unlink(tmp_path);
+		goto out;
+	}
+
+	if (rename(tmp_path, cache_path) != 0) {
+		LogInfo(COMPONENT_CONFIG,
+			"Could not rename config cache to %s: %s",
+			cache_path, strerror(errno));
+		unlink(tmp_path);
+		goto out;
+	}
+
+	LogEvent(COMPONENT_CONFIG, "Saved config parse cache %s", cache_path);
+
+out:
+	gsh_free(tmp_path);
+}
+
+/*
+ * Reading
+ */
+
+struct conf_cache_reader {
+	const char *pos;
+	const char *end;
+	struct config_root *tree;
+	char **files;		/*< pathnames by index */
+	uint32_t nfiles;
+	char **tokens;		/*< tokens by index */
+	uint32_t ntokens;
+};
+
+static bool get_u32(struct conf_cache_reader *rd, uint32_t *v)
+{
+	if ((size_t)(rd->end - rd->pos) < sizeof(*v))
+		return false;
+
+	memcpy(v, rd->pos, sizeof(*v));
+	rd->pos += sizeof(*v);
+	return true;
+}
+
+static bool get_bytes(struct conf_cache_reader *rd, const char **s,
+		      uint32_t *len)
+{
+	if (!get_u32(rd, len) || (size_t)(rd->end - rd->pos) < *len)
+		return false;
+
+	*s = rd->pos;
+	rd->pos += *len;
+	return true;
+}
+
+static bool get_token(struct conf_cache_reader *rd, char **token)
+{
+	uint32_t idx;
+
+	if (!get_u32(rd, &idx))
+		return false;
+
+	if (idx == CONF_CACHE_NONE) {
+		*token = NULL;
+		return true;
+	}
+
+	if (idx >= rd->ntokens)
+		return false;
+
+	*token = rd->tokens[idx];
+	return true;
+}
+
+/**
+ * @brief Load a node and whatever is below it
+ *
+ * Nodes are linked into their parent as soon as they are allocated, so
+ * that on error, freeing the tree frees everything loaded so far.
+ */
+
+static bool get_node(struct conf_cache_reader *rd,
+		     struct config_node *parent, int depth)
+{
+	struct config_node *node;
+	uint32_t type, line, fidx, term_type, nsub, i;
+
+	if (depth > 64 || !get_u32(rd, &type) || !get_u32(rd, &line) ||
+	    !get_u32(rd, &fidx))
+		return false;
+
+	if (type != TYPE_BLOCK && type != TYPE_STMT && type != TYPE_TERM)
+		return false;
+
+	node = gsh_calloc(1, sizeof(struct config_node));
+	node->type = type;
+	node->linenumber = line;
+	node->filename = fidx < rd->nfiles ? rd->files[fidx]
+					   : rd->tree->root.filename;
+	if (type != TYPE_TERM)
+		glist_init(&node->u.nterm.sub_nodes);
+	glist_add_tail(&parent->u.nterm.sub_nodes, &node->node);
+
+	if (type == TYPE_TERM) {
+		if (!get_u32(rd, &term_type) ||
+		    !get_token(rd, &node->u.term.op_code) ||
+		    !get_token(rd, &node->u.term.varvalue) ||
+		    node->u.term.varvalue == NULL)
+			return false;
+		node->u.term.type = term_type;
+		return true;
+	}
+
+	if (type == TYPE_BLOCK)
+		node->u.nterm.parent = parent;
+
+	if (!get_token(rd, &node->u.nterm.name) ||
+	    node->u.nterm.name == NULL || !get_u32(rd, &nsub))
+		return false;
+
+	for (i = 0; i < nsub; i++)
+		if (!get_node(rd, node, depth + 1))
+			return false;
+
+	return true;
+}
+
+/**
+ * @brief Rebuild a parse tree from its cache
+ *
+ * @param[in] file_path   The config file that was asked for
+ * @param[in] start       The mapped cache
+ * @param[in] size        Size of the cache
+ *
+ * @return The tree, or NULL if the cache is stale or damaged.
+ */
+
+static struct config_root *conf_cache_read(const char *file_path,
+					   const char *start, size_t size)
+{
+	struct conf_cache_reader rd = {
+		.pos = start,
+		.end = start + size,
+	};
+	struct config_root *tree;
+	struct file_list *file, **file_tail;
+	struct token_tab *token, **token_tail;
+	const char *s;
+	uint32_t len, nsub, i;
+	uint64_t hash, cur_hash;
+
+	if (size < sizeof(CONF_CACHE_MAGIC) - 1 ||
+	    memcmp(start, CONF_CACHE_MAGIC, sizeof(CONF_CACHE_MAGIC) - 1))
+		return NULL;
+	rd.pos += sizeof(CONF_CACHE_MAGIC) - 1;
+
+	tree = gsh_calloc(1, sizeof(struct config_root));
+	glist_init(&tree->root.node);
+	glist_init(&tree->root.u.nterm.sub_nodes);
+	tree->root.type = TYPE_ROOT;
+	rd.tree = tree;
+
+	/* Must be the cache of the same config file */
+	if (!get_bytes(&rd, &s, &len) || len != strlen(file_path) ||
+	    memcmp(s, file_path, len) != 0) {
+		gsh_free(tree);
+		return NULL;
+	}
+	tree->root.filename = gsh_strdup(file_path);
+
+	if (!get_u32(&rd, &rd.nfiles) || rd.nfiles == 0 ||
+	    rd.nfiles > size)
+		goto stale;
+
+	rd.files = gsh_calloc(rd.nfiles, sizeof(char *));
+	file_tail = &tree->files;
+
+	for (i = 0; i < rd.nfiles; i++) {
+		if ((size_t)(rd.end - rd.pos) < sizeof(hash))
+			goto stale;
+		memcpy(&hash, rd.pos, sizeof(hash));
+		rd.pos += sizeof(hash);
+
+		if (!get_bytes(&rd, &s, &len))
+			goto stale;
+
+		file = gsh_calloc(1, sizeof(struct file_list));
+		file->pathname = gsh_malloc(len + 1);
+		memcpy(file->pathname, s, len);
+		file->pathname[len] = '\0';
+		*file_tail = file;
+		file_tail = &file->next;
+		rd.files[i] = file->pathname;
+
+		/* Any change to any of the files makes the cache stale */
+		if (conf_cache_hash_file(file->pathname, &cur_hash) != 0 ||
+		    cur_hash != hash)
+			goto stale;
+	}
+
+	if (!get_bytes(&rd, &s, &len))
+		goto stale;
+	tree->conf_dir = gsh_malloc(len + 1);
+	memcpy(tree->conf_dir, s, len);
+	tree->conf_dir[len] = '\0';
+
+	if (!get_u32(&rd, &rd.ntokens) || rd.ntokens > size)
+		goto stale;
+
+	rd.tokens = gsh_calloc(rd.ntokens ? rd.ntokens : 1, sizeof(char *));
+	token_tail = &tree->tokens;
+
+	for (i = 0; i < rd.ntokens; i++) {
+		if (!get_bytes(&rd, &s, &len))
+			goto stale;
+
+		token = gsh_calloc(1, sizeof(struct token_tab) + len + 1);
+		memcpy(token->token, s, len);
+		*token_tail = token;
+		token_tail = &token->next;
+		rd.tokens[i] = token->token;
+	}
+
+	if (!get_u32(&rd, &nsub))
+		goto stale;
+
+	for (i = 0; i < nsub; i++)
+		if (!get_node(&rd, &tree->root, 0))
+			goto stale;
+
+	if (rd.pos != rd.end)
+		goto stale;
+
+	gsh_free(rd.files);
+	gsh_free(rd.tokens);
+	return tree;
+
+stale:
+	gsh_free(rd.files);
+	gsh_free(rd.tokens);
+	free_parse_tree(tree);
+	return NULL;
+}
+
+/**
+ * @brief Load a parse tree from its cache
+ *
+ * @param[in] file_path   The config file that was asked for
+ * @param[in] cache_path  The cache
+ *
+ * @return The tree, or NULL if there is no usable cache.
+ */
+
+static config_file_t conf_cache_load(const char *file_path,
+				     const char *cache_path)
+{
+	struct config_root *tree;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(cache_path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return NULL;
+
+	tree = conf_cache_read(file_path, map, st.st_size);
+	munmap(map, st.st_size);
+
+	if (tree == NULL)
+		LogInfo(COMPONENT_CONFIG,
+			"Config parse cache %s is stale", cache_path);
+	else
+		LogEvent(COMPONENT_CONFIG,
+			 "Loaded config %s from parse cache %s",
+			 file_path, cache_path);
+
+	return (config_file_t)tree;
+}
+
+/**
+ * @brief Parse a config file, going through a parse cache
+ *
+ * @param[in]  file_path   The config file
+ * @param[in]  cache_path  The cache, NULL to always parse
+ * @param[out] err_type    Parse errors
+ *
+ * @return The parse tree, as config_ParseFile.
+ */
+
+config_file_t config_ParseFile_cached(char *file_path, const char *cache_path,
+				      struct config_error_type *err_type)
+{
+	config_file_t config;
+
+	if (cache_path == NULL || cache_path[0] == '\0')
+		return config_ParseFile(file_path, err_type);
+
+	config = conf_cache_load(file_path, cache_path);
+	if (config != NULL)
+		return config;
+
+	config = config_ParseFile(file_path, err_type);
+
+	/* Only cache what parsed cleanly, errors must show up each time */
+	if (config != NULL && config_error_no_error(err_type))
+		conf_cache_save(config, cache_path);
+
+	return config;
+}
@@ -67,6 +67,7 @@ config_file_t config_ParseFile(char *file_path,
 	print_parse_tree(stderr, root);
 #endif
 	ganeshun_yy_cleanup_parser(&st);
+	gsh_free(st.token_hash);
 	return (config_file_t)root;
 }
 
@@ -1784,6 +1785,61 @@ out:
 	return rc;
 }
 
+static inline uint64_t config_hash_bytes(uint64_t h, const char *s,
+					 bool fold)
+{
+	/* FNV-1a; the terminating NUL keeps adjacent strings apart */
+	do {
+		h ^= (unsigned char)(fold ? tolower(*s) : *s);
+		h *= 0x100000001b3ULL;
+	} while (*s++ != '\0');
+
+	return h;
+}
+
+static uint64_t config_hash_node(uint64_t h, struct config_node *node)
+{
+	struct glist_head *ns;
+
+	h = config_hash_bytes(h, node->type == TYPE_BLOCK ? "{" :
+			      node->type == TYPE_STMT ? "=" : "", false);
+
+	if (node->type == TYPE_TERM) {
+		h = config_hash_bytes(h, node->u.term.op_code != NULL
+					 ? node->u.term.op_code : "", false);
+		return config_hash_bytes(h, node->u.term.varvalue != NULL
+					    ? node->u.term.varvalue : "",
+					 false);
+	}
+
+	/* Names are matched ignoring case, so hash them that way */
+	h = config_hash_bytes(h, node->u.nterm.name, true);
+
+	glist_for_each(ns, &node->u.nterm.sub_nodes)
+		h = config_hash_node(h,
+				     glist_entry(ns, struct config_node, node));
+
+	return config_hash_bytes(h, "}", false);
+}
+
+/**
+ * @brief Hash a block of the parse tree
+ *
+ * The hash covers the names and values of the block and all its
+ * sub-blocks, but not where they were read from, so a block that did
+ * not change between two parses of a config hashes the same.
+ *
+ * @param tree_node [IN] A CONFIG_BLOCK node in the parse tree
+ *
+ * @return The hash of the block.
+ */
+
+uint64_t config_node_hash(void *tree_node)
+{
+	return config_hash_node(0xcbf29ce484222325ULL,
+				(struct config_node *)tree_node);
+}
+
 /**
  * @brief Fill configuration structure from a parse tree node
  *
@@ -0,0 +1,423 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * In-process microbenchmarks of hot server paths.
+ *
+ * Like test_ci_hash_dist1, this boots a server with nfs_libmain() and
+ * works on an existing export, which should be FSAL_MEM (or any FSAL
+ * that is cheap to call) so that the numbers measure ganesha itself.
+ * Every benchmark runs --repeat rounds of --iterations operations
+ * after one warm up round, and reports the best and the median round
+ * in ns per operation.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "gtest/gtest.h"
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Ganesha headers */
+#include "nfs_lib.h"
+#include "nfs_core.h"
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "nfs_proto_tools.h"
+#include "sal_functions.h"
+#include "hashtable.h"
+#include "fsal.h"
+}
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  uint64_t iterations = 100000;
+  uint32_t repeat = 5;
+  uint32_t nfiles = 1000;
+
+  struct req_op_context req_ctx;
+  struct user_cred user_credentials;
+
+  struct gsh_export* a_export = nullptr;
+  struct fsal_obj_handle *root_entry = nullptr;
+  struct fsal_obj_handle *test_root = nullptr;
+  std::vector<std::string> names;
+
+  int ganesha_server() {
+    /* XXX */
+    return nfs_libmain(
+      ganesha_conf,
+      lpath,
+      dlevel
+      );
+  }
+
+  /* Run op iterations times per round and report ns/op */
+  template <typename Op>
+  void bench(const char *name, Op op) {
+    std::vector<double> rounds;
+
+    for (uint64_t i = 0; i < iterations; ++i)
+      op(i);
+
+    for (uint32_t r = 0; r < repeat; ++r) {
+      auto start = std::chrono::steady_clock::now();
+      for (uint64_t i = 0; i < iterations; ++i)
+	op(i);
+      auto end = std::chrono::steady_clock::now();
+      rounds.push_back(
+	std::chrono::duration<double, std::nano>(end - start).count()
+	/ iterations);
+    }
+
+    std::sort(rounds.begin(), rounds.end());
+    std::cout << std::left << std::setw(24) << name << std::right
+	      << std::fixed << std::setprecision(1)
+	      << " best " << std::setw(10) << rounds.front()
+	      << " ns/op  median " << std::setw(10)
+	      << rounds[rounds.size() / 2] << " ns/op" << std::endl;
+  }
+
+  /* Keys of the private hash table are plain 64 bit integers */
+  int bench_ht_both(struct hash_param *p, struct gsh_buffdesc *key,
+		    uint32_t *index, uint64_t *rbt_hash) {
+    uint64_t k = *(uint64_t *) key->addr;
+
+    *rbt_hash = k * 0x9e3779b97f4a7c15ULL;
+    *index = *rbt_hash % p->index_size;
+    return 1;
+  }
+
+  int bench_ht_compare(struct gsh_buffdesc *a, struct gsh_buffdesc *b) {
+    return *(uint64_t *) a->addr != *(uint64_t *) b->addr;
+  }
+
+  int bench_ht_display(struct gsh_buffdesc *buff, char *str) {
+    return sprintf(str, "%" PRIu64, *(uint64_t *) buff->addr);
+  }
+
+} /* namespace */
+
+TEST(BENCH_CORE, INIT)
+{
+  a_export = get_gsh_export(export_id);
+  ASSERT_NE(a_export, nullptr);
+
+  (void) nfs_export_get_root_entry(a_export, &root_entry);
+  ASSERT_NE(root_entry, nullptr);
+
+  /* Ganesha call paths need real or forged context info */
+  memset(&user_credentials, 0, sizeof(struct user_cred));
+  memset(&req_ctx, 0, sizeof(struct req_op_context));
+
+  req_ctx.ctx_export = a_export;
+  req_ctx.fsal_export = a_export->fsal_export;
+  req_ctx.creds = &user_credentials;
+
+  /* stashed in tls */
+  op_ctx = &req_ctx;
+}
+
+TEST(BENCH_CORE, CREATE_TREE)
+{
+  fsal_status_t status;
+  struct attrlist object_attributes;
+  struct fsal_obj_handle *obj;
+
+  memset(&object_attributes, 0, sizeof(object_attributes));
+  FSAL_SET_MASK(object_attributes.mask, ATTR_MODE | ATTR_OWNER | ATTR_GROUP);
+  object_attributes.mode = 0777;
+  object_attributes.owner = 667;
+  object_attributes.group = 766;
+
+  status = root_entry->obj_ops.mkdir(root_entry, "bench_core",
+				    &object_attributes, &test_root,
+				    nullptr);
+  ASSERT_EQ(status.major, ERR_FSAL_NO_ERROR);
+
+  for (uint32_t i = 0; i < nfiles; ++i) {
+    names.push_back("d" + std::to_string(i));
+    status = test_root->obj_ops.mkdir(test_root, names.back().c_str(),
+				     &object_attributes, &obj, nullptr);
+    ASSERT_EQ(status.major, ERR_FSAL_NO_ERROR);
+    obj->obj_ops.put_ref(obj);
+  }
+}
+
+TEST(BENCH_CORE, MDCACHE_LOOKUP)
+{
+  bench("mdcache lookup", [](uint64_t i) {
+      struct fsal_obj_handle *obj = nullptr;
+      fsal_status_t status;
+
+      status = test_root->obj_ops.lookup(test_root,
+					 names[i % nfiles].c_str(),
+					 &obj, nullptr);
+      if (!FSAL_IS_ERROR(status))
+	obj->obj_ops.put_ref(obj);
+    });
+}
+
+TEST(BENCH_CORE, MDCACHE_GETATTRS)
+{
+  struct attrlist attrs;
+
+  bench("mdcache getattrs", [&attrs](uint64_t i) {
+      fsal_prepare_attrs(&attrs, ATTRS_NFS3);
+      (void) test_root->obj_ops.getattrs(test_root, &attrs);
+      fsal_release_attrs(&attrs);
+    });
+}
+
+TEST(BENCH_CORE, HASHTABLE_GETLATCH)
+{
+  struct hash_param param;
+  struct hash_table *ht;
+  std::vector<uint64_t> keys(nfiles);
+
+  memset(&param, 0, sizeof(param));
+  param.index_size = 17;
+  param.hash_func_both = bench_ht_both;
+  param.compare_key = bench_ht_compare;
+  param.key_to_str = bench_ht_display;
+  param.val_to_str = bench_ht_display;
+  param.ht_name = (char *) "Bench HT";
+  param.ht_log_component = COMPONENT_HASHTABLE;
+
+  ht = hashtable_init(&param);
+  ASSERT_NE(ht, nullptr);
+
+  for (uint32_t i = 0; i < nfiles; ++i) {
+    struct gsh_buffdesc key, val;
+
+    keys[i] = i;
+    key.addr = val.addr = &keys[i];
+    key.len = val.len = sizeof(keys[i]);
+    ASSERT_EQ(hashtable_test_and_set(ht, &key, &val,
+				     HASHTABLE_SET_HOW_SET_NO_OVERWRITE),
+	      HASHTABLE_SUCCESS);
+  }
+
+  bench("hashtable_getlatch", [ht, &keys](uint64_t i) {
+      struct gsh_buffdesc key, val;
+      struct hash_latch latch;
+
+      key.addr = &keys[i % nfiles];
+      key.len = sizeof(uint64_t);
+      if (hashtable_getlatch(ht, &key, &val, false, &latch) ==
+	  HASHTABLE_SUCCESS)
+	hashtable_releaselatched(ht, &latch);
+    });
+
+  for (uint32_t i = 0; i < nfiles; ++i) {
+    struct gsh_buffdesc key;
+
+    key.addr = &keys[i];
+    key.len = sizeof(keys[i]);
+    (void) HashTable_Del(ht, &key, nullptr, nullptr);
+  }
+  (void) hashtable_destroy(ht, nullptr);
+}
+
+TEST(BENCH_CORE, STATEID_LOOKUP)
+{
+  /* No state exists for these, this is the lookup a bad or expired
+   * stateid costs.
+   */
+  bench("stateid lookup (miss)", [](uint64_t i) {
+      char other[OTHERSIZE];
+      struct state_t *state;
+
+      memset(other, 0, sizeof(other));
+      memcpy(other, &i, sizeof(i));
+      state = nfs4_State_Get_Pointer(other);
+      if (state != nullptr)
+	dec_state_t_ref(state);
+    });
+}
+
+TEST(BENCH_CORE, FATTR4_ENCODE)
+{
+  struct attrlist attrs;
+  struct bitmap4 bitmap;
+  fsal_status_t status;
+
+  memset(&bitmap, 0, sizeof(bitmap));
+  set_attribute_in_bitmap(&bitmap, FATTR4_TYPE);
+  set_attribute_in_bitmap(&bitmap, FATTR4_CHANGE);
+  set_attribute_in_bitmap(&bitmap, FATTR4_SIZE);
+  set_attribute_in_bitmap(&bitmap, FATTR4_FSID);
+  set_attribute_in_bitmap(&bitmap, FATTR4_FILEID);
+  set_attribute_in_bitmap(&bitmap, FATTR4_MODE);
+  set_attribute_in_bitmap(&bitmap, FATTR4_NUMLINKS);
+  set_attribute_in_bitmap(&bitmap, FATTR4_OWNER);
+  set_attribute_in_bitmap(&bitmap, FATTR4_OWNER_GROUP);
+  set_attribute_in_bitmap(&bitmap, FATTR4_SPACE_USED);
+  set_attribute_in_bitmap(&bitmap, FATTR4_TIME_ACCESS);
+  set_attribute_in_bitmap(&bitmap, FATTR4_TIME_METADATA);
+  set_attribute_in_bitmap(&bitmap, FATTR4_TIME_MODIFY);
+
+  fsal_prepare_attrs(&attrs, ATTRS_NFS3);
+  status = test_root->obj_ops.getattrs(test_root, &attrs);
+  ASSERT_EQ(status.major, ERR_FSAL_NO_ERROR);
+
+  bench("fattr4 encode", [&attrs, &bitmap](uint64_t i) {
+      struct xdr_attrs_args args;
+      fattr4 fattr;
+
+      memset(&args, 0, sizeof(args));
+      args.attrs = &attrs;
+      args.fileid = test_root->fileid;
+      args.fsid = test_root->fsid;
+      args.mounted_on_fileid = test_root->fileid;
+
+      if (nfs4_FSALattr_To_Fattr(&args, &bitmap, &fattr) == 0)
+	nfs4_Fattr_Free(&fattr);
+    });
+
+  fsal_release_attrs(&attrs);
+}
+
+TEST(BENCH_CORE, CLEANUP)
+{
+  struct fsal_obj_handle *obj;
+  fsal_status_t status;
+
+  for (auto& name : names) {
+    status = test_root->obj_ops.lookup(test_root, name.c_str(), &obj,
+				       nullptr);
+    if (FSAL_IS_ERROR(status))
+      continue;
+    (void) test_root->obj_ops.unlink(test_root, obj, name.c_str());
+    obj->obj_ops.put_ref(obj);
+  }
+
+  status = root_entry->obj_ops.unlink(root_entry, test_root, "bench_core");
+  EXPECT_EQ(status.major, ERR_FSAL_NO_ERROR);
+  test_root->obj_ops.put_ref(test_root);
+  root_entry->obj_ops.put_ref(root_entry);
+  put_gsh_export(a_export);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+	"path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+	"log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+	"id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+	"ganesha debug level")
+
+      ("iterations", po::value<uint64_t>(),
+	"operations per round (default 100000)")
+
+      ("repeat", po::value<uint32_t>(),
+	"rounds per benchmark (default 5)")
+
+      ("files", po::value<uint32_t>(),
+	"entries created in the test directory (default 1000)")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::store(po::command_line_parser(argc, argv).options(opts)
+	      .allow_unregistered().run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("iterations");
+    if (vm_iter != vm.end()) {
+      iterations = max<uint64_t>(vm_iter->second.as<uint64_t>(), 1);
+    }
+    vm_iter = vm.find("repeat");
+    if (vm_iter != vm.end()) {
+      repeat = max<uint32_t>(vm_iter->second.as<uint32_t>(), 1);
+    }
+    vm_iter = vm.find("files");
+    if (vm_iter != vm.end()) {
+      nfiles = max<uint32_t>(vm_iter->second.as<uint32_t>(), 1);
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+
+    std::thread ganesha(ganesha_server);
+    std::this_thread::sleep_for(5s);
+
+    code  = RUN_ALL_TESTS();
+
+    /* Unlike the tests, benchmarks are meant to be run in a loop */
+    admin_halt();
+    ganesha.join();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
@@ -39,6 +39,17 @@
  * determines which of the partitions (each containing a tree and each
  * separately locked), and a hash which acts as the key within an
  * individual Red-Black Tree.
+ *
+ * Tables created with HT_FLAG_RCU serve read-only lookups without
+ * taking the partition lock.  Readers walk the tree optimistically
+ * and validate the walk against the partition sequence counter,
+ * falling back to the read lock if a writer keeps getting in the way.
+ * Nodes and values removed from such a table are only released once
+ * every reader that might still see them has left its read-side
+ * section (epoch based reclamation).
+ *
+ * Tables created with HT_FLAG_OPEN replace the trees with open
+ * addressed slot arrays that keep the hash inline, see below.
  */
 
 #include "config.h"
@@ -46,11 +57,160 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
 #include "hashtable.h"
 #include "log.h"
 #include "abstract_atomic.h"
 #include "common_utils.h"
+#include "gsh_list.h"
+#include "gsh_intrinsic.h"
 #include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Lockless walks give up after this many steps
+ *
+ * A walk racing with a rotation can briefly loop; a balanced tree
+ * of any realistic size is far shallower than this.
+ */
+#define HT_RCU_MAX_STEPS 128
+
+/**
+ * @brief Optimistic attempts before falling back to the read lock
+ */
+#define HT_RCU_RETRIES 4
+
+/**
+ * @brief Per-thread RCU reader state
+ */
+struct ht_rcu_reader {
+	struct glist_head link; /*< Link in ht_rcu_readers */
+	uint64_t epoch; /*< Epoch entered, 0 when quiescent */
+	GSH_CACHE_PAD(0);
+};
+
+static __thread struct ht_rcu_reader *ht_rcu_self;
+static uint64_t ht_rcu_epoch = 1;
+static pthread_mutex_t ht_rcu_mutex = PTHREAD_MUTEX_INITIALIZER;
+static GLIST_HEAD(ht_rcu_readers);
+static pthread_key_t ht_rcu_key;
+static pthread_once_t ht_rcu_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Forget the reader state of an exiting thread
+ */
+static void ht_rcu_unregister(void *arg)
+{
+	struct ht_rcu_reader *reader = arg;
+
+	PTHREAD_MUTEX_lock(&ht_rcu_mutex);
+	glist_del(&reader->link);
+	PTHREAD_MUTEX_unlock(&ht_rcu_mutex);
+	gsh_free(reader);
+}
+
+static void ht_rcu_key_init(void)
+{
+	(void)pthread_key_create(&ht_rcu_key, ht_rcu_unregister);
+}
+
+/**
+ * @brief Enter a read-side section
+ *
+ * Sections do not nest.
+ */
+static inline void ht_rcu_read_lock(void)
+{
+	struct ht_rcu_reader *reader = ht_rcu_self;
+
+	if (unlikely(reader == NULL)) {
+		(void)pthread_once(&ht_rcu_once, ht_rcu_key_init);
+		reader = gsh_calloc(1, sizeof(*reader));
+		PTHREAD_MUTEX_lock(&ht_rcu_mutex);
+		glist_add_tail(&ht_rcu_readers, &reader->link);
+		PTHREAD_MUTEX_unlock(&ht_rcu_mutex);
+		(void)pthread_setspecific(ht_rcu_key, reader);
+		ht_rcu_self = reader;
+	}
+
+	/* Sequentially consistent, so the walk that follows cannot be
+	   seen before the announcement. */
+	atomic_store_uint64_t(&reader->epoch,
+			      atomic_fetch_uint64_t(&ht_rcu_epoch));
+}
+
+/**
+ * @brief Leave a read-side section
+ */
+static inline void ht_rcu_read_unlock(void)
+{
+	atomic_store_uint64_t(&ht_rcu_self->epoch, 0);
+}
+
+/**
+ * @brief Wait until every reader present on entry has left its section
+ *
+ * Must not be called from within a read-side section, nor with a
+ * partition lock held.
+ */
+static void ht_rcu_synchronize(void)
+{
+	uint64_t target = atomic_inc_uint64_t(&ht_rcu_epoch);
+	struct glist_head *glist;
+	struct ht_rcu_reader *reader;
+	uint64_t epoch;
+
+	PTHREAD_MUTEX_lock(&ht_rcu_mutex);
+
+	glist_for_each(glist, &ht_rcu_readers) {
+		reader = glist_entry(glist, struct ht_rcu_reader, link);
+		if (reader == ht_rcu_self)
+			continue;
+
+		for (;;) {
+			epoch = atomic_fetch_uint64_t(&reader->epoch);
+			if (epoch == 0 || epoch >= target)
+				break;
+			sched_yield();
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&ht_rcu_mutex);
+}
+
+/**
+ * @brief Keep loads of the walk ahead of the sequence re-check
+ */
+static inline void ht_rcu_read_barrier(void)
+{
+#if defined(GCC_ATOMIC_FUNCTIONS)
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+#else
+	__sync_synchronize();
+#endif
+}
+
+/**
+ * @brief Mark the start of a tree change in an RCU table
+ */
+static inline void ht_rcu_write_begin(struct hash_table *ht,
+				      struct hash_partition *partition)
+{
+	if (ht->parameter.flags & HT_FLAG_RCU)
+		atomic_inc_uint32_t(&partition->seq);
+}
+
+/**
+ * @brief Mark the end of a tree change in an RCU table
+ */
+static inline void ht_rcu_write_end(struct hash_table *ht,
+				    struct hash_partition *partition)
+{
+	if (ht->parameter.flags & HT_FLAG_RCU)
+		atomic_inc_uint32_t(&partition->seq);
+}
 
 /**
  * @brief Total size of the cache page configured for a table
@@ -142,7 +302,7 @@ key_locate(struct hash_table *ht, const struct gsh_buffdesc *key,
 	   uint32_t index, uint64_t rbthash, struct rbt_node **node)
 {
 	/* The current partition */
-	struct hash_partition *partition = &(ht->partitions[index]);
+	struct hash_partition *partition = hashtable_partition(ht, index);
 
 	/* The root of the red black tree matching this index */
 	struct rbt_head *root = NULL;
@@ -177,7 +337,7 @@ key_locate(struct hash_table *ht, const struct gsh_buffdesc *key,
 		}
 	}
 
-	root = &(ht->partitions[index].rbt);
+	root = &partition->rbt;
 
 	/* The lefmost occurrence of the value is the one from which we
 	   may start iteration to visit all nodes containing a value. */
@@ -223,6 +383,382 @@ key_locate(struct hash_table *ht, const struct gsh_buffdesc *key,
 	return HASHTABLE_SUCCESS;
 }
 
+/**
+ * @brief Locate a key within a partition without locking
+ *
+ * This function is the lockless counterpart of key_locate for tables
+ * created with HT_FLAG_RCU.  It must be called within a read-side
+ * section.  The walk only follows tree links, so a node with the
+ * right hash but a different key (a 64-bit hash collision) makes it
+ * give up and let the locked path sort the duplicates out.
+ *
+ * @param[in]  ht      The hashtable to be used
+ * @param[in]  key     The key to look up
+ * @param[in]  index   Index into RBT array
+ * @param[in]  rbthash Hash in red-black tree
+ * @param[out] node    On success, the found node, NULL otherwise
+ * @param[out] rc      HASHTABLE_SUCCESS or HASHTABLE_ERROR_NO_SUCH_KEY
+ *
+ * @retval true if the result is consistent
+ * @retval false if a writer interfered, the caller should retry
+ */
+static bool
+key_locate_rcu(struct hash_table *ht, const struct gsh_buffdesc *key,
+	       uint32_t index, uint64_t rbthash, struct rbt_node **node,
+	       hash_error_t *rc)
+{
+	/* The current partition */
+	struct hash_partition *partition = hashtable_partition(ht, index);
+	/* The node in the red-black tree currently being traversed */
+	struct rbt_node *cursor = NULL;
+	/* A pair of buffer descriptors locating key and value */
+	struct hash_data *data = NULL;
+	/* Partition sequence at the start of the walk */
+	uint32_t seq;
+	/* Steps taken so far */
+	int steps;
+
+	seq = atomic_fetch_uint32_t(&partition->seq);
+	if (seq & 1)
+		return false;
+
+	*node = NULL;
+	*rc = HASHTABLE_ERROR_NO_SUCH_KEY;
+
+	if (partition->cache) {
+		cursor = atomic_fetch_voidptr((void **)
+			&(partition->cache[cache_offsetof(ht, rbthash)]));
+		if (cursor && RBT_VALUE(cursor) == rbthash) {
+			data = atomic_fetch_voidptr(&RBT_OPAQ(cursor));
+			if (ht->parameter.
+			    compare_key((struct gsh_buffdesc *)key,
+					&(data->key)) == 0) {
+				*node = cursor;
+				*rc = HASHTABLE_SUCCESS;
+				goto validate;
+			}
+		}
+	}
+
+	cursor = atomic_fetch_voidptr((void **)&partition->rbt.root);
+
+	for (steps = 0; cursor != NULL; steps++) {
+		if (steps == HT_RCU_MAX_STEPS)
+			return false;
+
+		if (RBT_VALUE(cursor) > rbthash)
+			cursor = atomic_fetch_voidptr((void **)&cursor->left);
+		else if (RBT_VALUE(cursor) < rbthash)
+			cursor = atomic_fetch_voidptr((void **)&cursor->next);
+		else
+			break;
+	}
+
+	if (cursor != NULL) {
+		data = atomic_fetch_voidptr(&RBT_OPAQ(cursor));
+		if (ht->parameter.
+		    compare_key((struct gsh_buffdesc *)key,
+				&(data->key)) != 0)
+			return false;
+
+		*node = cursor;
+		*rc = HASHTABLE_SUCCESS;
+	}
+
+ validate:
+	ht_rcu_read_barrier();
+
+	return atomic_fetch_uint32_t(&partition->seq) == seq;
+}
+
+/* Open addressed partitions (HT_FLAG_OPEN)
+ *
+ * Each partition is an array of slots split into groups of
+ * HT_OPEN_GROUP.  A control byte per slot holds either the low seven
+ * bits of the rbt hash of the entry stored there, HT_CTRL_EMPTY or
+ * HT_CTRL_DELETED, so a whole group is matched against a key with a
+ * couple of vector instructions before any slot is touched.  Groups
+ * are probed in triangular order, which visits every group of a power
+ * of two sized array.  A lookup stops at the first group holding an
+ * empty slot.
+ */
+
+#define HT_OPEN_GROUP 16
+#define HT_OPEN_NO_SLOT UINT32_MAX
+#define HT_CTRL_EMPTY 0x80
+#define HT_CTRL_DELETED 0xFE
+
+/**
+ * @brief A slot in an open addressed partition
+ */
+struct hash_slot {
+	uint64_t hash; /*< Full rbt hash of the entry */
+	struct hash_data data; /*< The entry */
+};
+
+/**
+ * @brief Storage of an open addressed partition
+ */
+struct hash_open_tab {
+	uint32_t capacity; /*< Number of slots, a power of 2, at least
+			       HT_OPEN_GROUP */
+	uint32_t used; /*< Slots not empty, deleted ones included */
+	uint8_t *ctrl; /*< Control bytes */
+	struct hash_slot *slots; /*< The slots */
+};
+
+/**
+ * @brief Slots of the initial array of each partition
+ */
+#define HT_OPEN_MIN_CAPACITY 64
+
+/**
+ * @brief Find the slots of a group holding a given control byte
+ *
+ * @param[in] group First control byte of the group
+ * @param[in] byte  Control byte to look for
+ *
+ * @return A mask with bit i set if slot i of the group matches.
+ */
+static inline uint32_t
+ht_open_match(const uint8_t *group, uint8_t byte)
+{
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl,
+						_mm_set1_epi8(byte)));
+#else
+	uint32_t mask = 0;
+	int i;
+
+	for (i = 0; i < HT_OPEN_GROUP; i++)
+		if (group[i] == byte)
+			mask |= 1 << i;
+
+	return mask;
+#endif
+}
+
+/**
+ * @brief Find the empty or deleted slots of a group
+ *
+ * Both have their high bit set, live slots do not.
+ */
+static inline uint32_t
+ht_open_match_free(const uint8_t *group)
+{
+#ifdef __SSE2__
+	return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+	uint32_t mask = 0;
+	int i;
+
+	for (i = 0; i < HT_OPEN_GROUP; i++)
+		if (group[i] & 0x80)
+			mask |= 1 << i;
+
+	return mask;
+#endif
+}
+
+static inline uint8_t
+ht_open_tag(uint64_t hash)
+{
+	return hash & 0x7F;
+}
+
+static inline uint32_t
+ht_open_first_group(const struct hash_open_tab *tab, uint64_t hash)
+{
+	return (hash >> 7) & (tab->capacity / HT_OPEN_GROUP - 1);
+}
+
+static struct hash_open_tab *
+ht_open_tab_alloc(uint32_t capacity)
+{
+	struct hash_open_tab *tab = gsh_calloc(1, sizeof(*tab));
+
+	tab->capacity = capacity;
+	tab->ctrl = gsh_malloc(capacity);
+	memset(tab->ctrl, HT_CTRL_EMPTY, capacity);
+	tab->slots = gsh_calloc(capacity, sizeof(struct hash_slot));
+
+	return tab;
+}
+
+static void
+ht_open_tab_free(struct hash_open_tab *tab)
+{
+	gsh_free(tab->ctrl);
+	gsh_free(tab->slots);
+	gsh_free(tab);
+}
+
+/**
+ * @brief Find the slot holding a key
+ *
+ * Probing is bounded by the number of groups, so this is also safe
+ * to call on an array being changed under a lockless reader.
+ *
+ * @param[in]  ht   The hashtable to be used
+ * @param[in]  tab  Slot array of the partition
+ * @param[in]  key  The key to look up
+ * @param[in]  hash Hash of the key
+ * @param[out] slot The slot found, HT_OPEN_NO_SLOT otherwise
+ *
+ * @retval HASHTABLE_SUCCESS if successfull
+ * @retval HASHTABLE_NO_SUCH_KEY if key was not found
+ */
+static hash_error_t
+ht_open_find(struct hash_table *ht, struct hash_open_tab *tab,
+	     const struct gsh_buffdesc *key, uint64_t hash, uint32_t *slot)
+{
+	uint32_t ngroups = tab->capacity / HT_OPEN_GROUP;
+	uint32_t group = ht_open_first_group(tab, hash);
+	uint8_t tag = ht_open_tag(hash);
+	const uint8_t *ctrl;
+	uint32_t bits, i, step;
+
+	*slot = HT_OPEN_NO_SLOT;
+
+	for (step = 0; step < ngroups; step++) {
+		ctrl = &tab->ctrl[group * HT_OPEN_GROUP];
+
+		for (bits = ht_open_match(ctrl, tag); bits; bits &= bits - 1) {
+			i = group * HT_OPEN_GROUP + __builtin_ctz(bits);
+			if (tab->slots[i].hash == hash &&
+			    ht->parameter.compare_key(
+					(struct gsh_buffdesc *)key,
+					&tab->slots[i].data.key) == 0) {
+				*slot = i;
+				return HASHTABLE_SUCCESS;
+			}
+		}
+
+		if (ht_open_match(ctrl, HT_CTRL_EMPTY))
+			break;
+
+		group = (group + step + 1) & (ngroups - 1);
+	}
+
+	return HASHTABLE_ERROR_NO_SUCH_KEY;
+}
+
+/**
+ * @brief Find a slot to insert a key known to be absent
+ *
+ * @param[in] tab  Slot array of the partition, not full
+ * @param[in] hash Hash of the key
+ *
+ * @return The slot index.
+ */
+static uint32_t
+ht_open_free_slot(struct hash_open_tab *tab, uint64_t hash)
+{
+	uint32_t ngroups = tab->capacity / HT_OPEN_GROUP;
+	uint32_t group = ht_open_first_group(tab, hash);
+	uint32_t bits, step;
+
+	for (step = 0; ; step++) {
+		bits = ht_open_match_free(&tab->ctrl[group * HT_OPEN_GROUP]);
+		if (bits)
+			return group * HT_OPEN_GROUP + __builtin_ctz(bits);
+
+		group = (group + step + 1) & (ngroups - 1);
+	}
+}
+
+/**
+ * @brief Make room in an open addressed partition
+ *
+ * The array is rebuilt, twice as large if more than half of it is
+ * live, at the same size (dropping deleted slots) otherwise.  The
+ * partition must be write latched.
+ *
+ * @param[in] ht        The hashtable
+ * @param[in] partition The partition
+ * @param[in] latch     The write latch, for deferred reclamation
+ */
+static void
+ht_open_grow(struct hash_table *ht, struct hash_partition *partition,
+	     struct hash_latch *latch)
+{
+	struct hash_open_tab *old = partition->open;
+	struct hash_open_tab *tab;
+	uint32_t capacity = old->capacity;
+	uint32_t i, j;
+
+	if ((partition->count + 1) * 2 > capacity)
+		capacity *= 2;
+
+	tab = ht_open_tab_alloc(capacity);
+
+	for (i = 0; i < old->capacity; i++) {
+		if (old->ctrl[i] & 0x80)
+			continue;
+
+		j = ht_open_free_slot(tab, old->slots[i].hash);
+		tab->ctrl[j] = old->ctrl[i];
+		tab->slots[j] = old->slots[i];
+		tab->used++;
+	}
+
+	ht_rcu_write_begin(ht, partition);
+	atomic_store_voidptr((void **)&partition->open, tab);
+	ht_rcu_write_end(ht, partition);
+
+	if (ht->parameter.flags & HT_FLAG_RCU) {
+		/* Freed by hashtable_releaselatched */
+		latch->retired_tab = old;
+		latch->sync = true;
+	} else {
+		ht_open_tab_free(old);
+	}
+}
+
+/**
+ * @brief Locate a key within an open addressed partition without locking
+ *
+ * The lockless counterpart of ht_open_find, see key_locate_rcu.  As
+ * slots are reused in place, the entry is copied out while the walk
+ * is still being validated.
+ *
+ * @param[in]  ht       The hashtable to be used
+ * @param[in]  key      The key to look up
+ * @param[in]  index    Index into the partition array
+ * @param[in]  hash     Hash of the key
+ * @param[out] slot     The slot found, HT_OPEN_NO_SLOT otherwise
+ * @param[out] snapshot Copy of the entry found
+ * @param[out] rc       HASHTABLE_SUCCESS or HASHTABLE_ERROR_NO_SUCH_KEY
+ *
+ * @retval true if the result is consistent
+ * @retval false if a writer interfered, the caller should retry
+ */
+static bool
+key_locate_open_rcu(struct hash_table *ht, const struct gsh_buffdesc *key,
+		    uint32_t index, uint64_t hash, uint32_t *slot,
+		    struct hash_data *snapshot, hash_error_t *rc)
+{
+	struct hash_partition *partition = hashtable_partition(ht, index);
+	struct hash_open_tab *tab;
+	uint32_t seq;
+
+	seq = atomic_fetch_uint32_t(&partition->seq);
+	if (seq & 1)
+		return false;
+
+	tab = atomic_fetch_voidptr((void **)&partition->open);
+
+	*rc = ht_open_find(ht, tab, key, hash, slot);
+	if (*rc == HASHTABLE_SUCCESS)
+		*snapshot = tab->slots[*slot].data;
+
+	ht_rcu_read_barrier();
+
+	return atomic_fetch_uint32_t(&partition->seq) == seq;
+}
+
 /**
  * @brief Compute the values to search a hash store
  *
@@ -268,6 +804,214 @@ compute(struct hash_table *ht, const struct gsh_buffdesc *key,
 	return HASHTABLE_SUCCESS;
 }
 
+/* Growing tables (HT_FLAG_GROW)
+ *
+ * The partition count doubles by linear hashing, one partition at a
+ * time.  After L doublings, a key lives in partition index + index_size
+ * times the low L bits of a mix of its rbt hash, or the low L + 1 bits
+ * if that partition has been split already.  Partitions split in order,
+ * splitting partition p moves the entries with bit L set to
+ * p + (index_size << L), and the last split of a round starts the next
+ * doubling.  A split holds only the two partitions involved.  A lookup
+ * that raced with one notices the geometry changed once it holds its
+ * partition, and starts over at the new home of its key.
+ */
+
+/**
+ * @brief Split once a partition holds more entries than this
+ */
+#define HT_GROW_LOAD 32
+
+static inline uint32_t
+ht_geom_level(uint64_t geometry)
+{
+	return geometry >> 32;
+}
+
+static inline uint32_t
+ht_geom_split(uint64_t geometry)
+{
+	return (uint32_t)geometry;
+}
+
+/**
+ * @brief Bits of a key choosing among the halves of split partitions
+ *
+ * Some tables hash with little more than a counter, so mix it first.
+ */
+static inline uint32_t
+ht_grow_bits(uint64_t rbt_hash)
+{
+	return (rbt_hash * 0x9E3779B97F4A7C15ULL) >> 40;
+}
+
+/**
+ * @brief Partition holding a key in a growing table
+ *
+ * @param[in] ht       The hash table
+ * @param[in] index    Index computed by the hash functions
+ * @param[in] rbt_hash Hash in the red-black tree
+ * @param[in] geometry Value of ht->geometry to use
+ *
+ * @return The partition number.
+ */
+static inline uint32_t
+ht_address(struct hash_table *ht, uint32_t index, uint64_t rbt_hash,
+	   uint64_t geometry)
+{
+	uint32_t level = ht_geom_level(geometry);
+	uint32_t bits = ht_grow_bits(rbt_hash);
+	uint32_t address;
+
+	address = index + ht->parameter.index_size *
+			  (bits & ((1 << level) - 1));
+
+	if (address < ht_geom_split(geometry))
+		address = index + ht->parameter.index_size *
+				  (bits & ((2 << level) - 1));
+
+	return address;
+}
+
+/**
+ * @brief Split the next partition of a growing table
+ *
+ * Called after an insert left a partition too full, with no latch
+ * held.  Gives up rather than wait, a later insert will try again.
+ *
+ * @param[in] ht The hash table
+ */
+static void
+ht_split(struct hash_table *ht)
+{
+	uint32_t size = ht->parameter.index_size;
+	struct hash_partition *old, *new;
+	struct rbt_node *cursor, *next, *locator;
+	uint32_t level, split, i;
+	uint64_t geometry;
+	size_t moved = 0;
+
+	if (pthread_mutex_trylock(&ht->grow_mtx) != 0)
+		return;
+
+	geometry = atomic_fetch_uint64_t(&ht->geometry);
+	level = ht_geom_level(geometry);
+	split = ht_geom_split(geometry);
+
+	if (level == HT_GROW_MAX_LEVELS)
+		goto out;
+
+	if (ht->segments[level + 1] == NULL) {
+		/* Partitions of the next doubling, unreachable until the
+		   geometry says otherwise */
+		struct hash_partition *segment =
+			gsh_calloc(size << level,
+				   sizeof(struct hash_partition));
+
+		for (i = 0; i < (size << level); i++) {
+			RBT_HEAD_INIT(&segment[i].rbt);
+			PTHREAD_RWLOCK_init(&segment[i].lock, NULL);
+		}
+
+		atomic_store_voidptr((void **)&ht->segments[level + 1],
+				     segment);
+	}
+
+	old = hashtable_partition(ht, split);
+	new = hashtable_partition(ht, split + (size << level));
+
+	if (pthread_rwlock_trywrlock(&old->lock) != 0)
+		goto out;
+
+	PTHREAD_RWLOCK_wrlock(&new->lock);
+
+	ht_rcu_write_begin(ht, old);
+	ht_rcu_write_begin(ht, new);
+
+	/* Nothing cached may point to a node that moved */
+	if (old->cache)
+		memset(old->cache, 0, cache_page_size(ht));
+
+	cursor = RBT_LEFTMOST(&old->rbt);
+
+	while (cursor != NULL) {
+		next = cursor;
+		RBT_INCREMENT(next);
+
+		if (ht_grow_bits(RBT_VALUE(cursor)) & (1 << level)) {
+			RBT_UNLINK(&old->rbt, cursor);
+			RBT_FIND(&new->rbt, locator, RBT_VALUE(cursor));
+			RBT_INSERT(&new->rbt, cursor, locator);
+			moved++;
+		}
+
+		cursor = next;
+	}
+
+	old->count -= moved;
+	new->count += moved;
+
+	if (++split == (size << level)) {
+		split = 0;
+		level++;
+	}
+
+	atomic_store_uint64_t(&ht->geometry,
+			      ((uint64_t)level << 32) | split);
+
+	ht_rcu_write_end(ht, new);
+	ht_rcu_write_end(ht, old);
+
+	PTHREAD_RWLOCK_unlock(&new->lock);
+	PTHREAD_RWLOCK_unlock(&old->lock);
+
+	LogFullDebug(COMPONENT_HASHTABLE,
+		     "%s split, %zu entries moved", ht->parameter.ht_name,
+		     moved);
+
+	if (split == 0)
+		LogDebug(COMPONENT_HASHTABLE,
+			 "%s now has %" PRIu32 " partitions",
+			 ht->parameter.ht_name, size << level);
+
+ out:
+	PTHREAD_MUTEX_unlock(&ht->grow_mtx);
+}
+
+/**
+ * @brief Start walking every partition of a table
+ *
+ * No partition splits until hashtable_walk_end, so each entry is seen
+ * once.  Each partition must still be locked while walked.
+ *
+ * @param[in] ht The hash table
+ *
+ * @return The number of partitions, to be found with hashtable_partition.
+ */
+uint32_t
+hashtable_walk_begin(struct hash_table *ht)
+{
+	uint64_t geometry;
+
+	PTHREAD_MUTEX_lock(&ht->grow_mtx);
+
+	geometry = atomic_fetch_uint64_t(&ht->geometry);
+
+	return (ht->parameter.index_size << ht_geom_level(geometry)) +
+	       ht_geom_split(geometry);
+}
+
+/**
+ * @brief Done walking the partitions of a table
+ *
+ * @param[in] ht The hash table
+ */
+void
+hashtable_walk_end(struct hash_table *ht)
+{
+	PTHREAD_MUTEX_unlock(&ht->grow_mtx);
+}
+
 /* The following are the hash table primitives implementing the
    actual functionality. */
 
@@ -317,6 +1061,11 @@ hashtable_init(struct hash_param *hparam)
 			(sizeof(struct hash_partition) *
 			 hparam->index_size));
 
+	/* Open addressed partitions have no use for the entry cache and
+	   grow on their own */
+	if (hparam->flags & HT_FLAG_OPEN)
+		hparam->flags &= ~(HT_FLAG_CACHE | HT_FLAG_GROW);
+
 	/* Fixup entry size */
 	if (hparam->flags & HT_FLAG_CACHE) {
 		if (!hparam->cache_entry_count)
@@ -340,11 +1089,19 @@ hashtable_init(struct hash_param *hparam)
 		if (hparam->flags & HT_FLAG_CACHE)
 			partition->cache = gsh_calloc(1, cache_page_size(ht));
 
+		if (hparam->flags & HT_FLAG_OPEN)
+			partition->open =
+				ht_open_tab_alloc(HT_OPEN_MIN_CAPACITY);
+
 		completed++;
 	}
 
-	ht->node_pool = pool_basic_init(NULL, sizeof(rbt_node_t));
-	ht->data_pool = pool_basic_init(NULL, sizeof(struct hash_data));
+	PTHREAD_MUTEX_init(&ht->grow_mtx, NULL);
+
+	ht->node_pool = pool_basic_init("Hash table nodes",
+					sizeof(rbt_node_t));
+	ht->data_pool = pool_basic_init("Hash table data",
+					sizeof(struct hash_data));
 
 	pthread_rwlockattr_destroy(&rwlockattr);
 	return ht;
@@ -355,6 +1112,9 @@ hashtable_init(struct hash_param *hparam)
 		if (hparam->flags & HT_FLAG_CACHE)
 			gsh_free(ht->partitions[completed - 1].cache);
 
+		if (hparam->flags & HT_FLAG_OPEN)
+			ht_open_tab_free(ht->partitions[completed - 1].open);
+
 		PTHREAD_RWLOCK_destroy(&(ht->partitions[completed - 1].lock));
 		completed--;
 	}
@@ -388,19 +1148,41 @@ hashtable_destroy(struct hash_table *ht,
 {
 	size_t index = 0;
 	hash_error_t hrc = HASHTABLE_SUCCESS;
+	struct hash_partition *partition;
+	uint32_t count;
+	int seg;
 
 	hrc = hashtable_delall(ht, free_func);
 	if (hrc != HASHTABLE_SUCCESS)
 		goto out;
 
-	for (index = 0; index < ht->parameter.index_size; ++index) {
-		if (ht->partitions[index].cache) {
-			gsh_free(ht->partitions[index].cache);
-			ht->partitions[index].cache = NULL;
+	/* Partitions of a segment are set up as soon as it exists */
+	count = ht->parameter.index_size;
+	for (seg = 1; seg <= HT_GROW_MAX_LEVELS; seg++) {
+		if (ht->segments[seg] != NULL)
+			count = ht->parameter.index_size << seg;
+	}
+
+	for (index = 0; index < count; ++index) {
+		partition = hashtable_partition(ht, index);
+
+		if (partition->cache) {
+			gsh_free(partition->cache);
+			partition->cache = NULL;
 		}
 
-		PTHREAD_RWLOCK_destroy(&(ht->partitions[index].lock));
+		if (partition->open) {
+			ht_open_tab_free(partition->open);
+			partition->open = NULL;
+		}
+
+		PTHREAD_RWLOCK_destroy(&partition->lock);
 	}
+
+	for (seg = 1; seg <= HT_GROW_MAX_LEVELS; seg++)
+		gsh_free(ht->segments[seg]);
+
+	PTHREAD_MUTEX_destroy(&ht->grow_mtx);
 	pool_destroy(ht->node_pool);
 	pool_destroy(ht->data_pool);
 	gsh_free(ht);
@@ -447,25 +1229,103 @@ hashtable_getlatch(struct hash_table *ht,
 	uint64_t rbt_hash = 0;
 	/* Stored error return */
 	hash_error_t rc = HASHTABLE_SUCCESS;
+	/* true if the lookup was done without the partition lock */
+	bool rcu = false;
+	/* true for an open addressed table */
+	bool open = ht->parameter.flags & HT_FLAG_OPEN;
+	/* The slot found for the key (HT_FLAG_OPEN) */
+	uint32_t slot = HT_OPEN_NO_SLOT;
+	/* Copy of the entry found by a lockless walk (HT_FLAG_OPEN) */
+	struct hash_data snapshot;
+	/* true for a growing table */
+	bool grow = ht->parameter.flags & HT_FLAG_GROW;
+	/* Index given by the hash functions (HT_FLAG_GROW) */
+	uint32_t base;
+	/* Geometry the partition was chosen with (HT_FLAG_GROW) */
+	uint64_t geometry = 0;
+	/* The partition to search */
+	struct hash_partition *partition;
 
 	/* This combination of options makes no sense ever */
 	assert(!(may_write && !latch));
 
-	rc = compute(ht, key, &index, &rbt_hash);
+	rc = compute(ht, key, &base, &rbt_hash);
 	if (rc != HASHTABLE_SUCCESS)
 		return rc;
 
-	/* Acquire mutex */
-	if (may_write)
-		PTHREAD_RWLOCK_wrlock(&(ht->partitions[index].lock));
-	else
-		PTHREAD_RWLOCK_rdlock(&(ht->partitions[index].lock));
+	index = base;
+
+ again:
+	if (grow) {
+		geometry = atomic_fetch_uint64_t(&ht->geometry);
+		index = ht_address(ht, base, rbt_hash, geometry);
+	}
+
+	partition = hashtable_partition(ht, index);
+	rcu = false;
 
-	rc = key_locate(ht, key, index, rbt_hash, &locator);
+	if (!may_write && (ht->parameter.flags & HT_FLAG_RCU)) {
+		/* Number of optimistic walks so far */
+		int tries;
+		/* Result of the last walk */
+		bool settled = false;
+
+		ht_rcu_read_lock();
+
+		for (tries = 0; tries < HT_RCU_RETRIES && !settled; tries++) {
+			if (open)
+				settled = key_locate_open_rcu(ht, key, index,
+							      rbt_hash, &slot,
+							      &snapshot, &rc);
+			else
+				settled = key_locate_rcu(ht, key, index,
+							 rbt_hash, &locator,
+							 &rc);
+		}
+
+		if (settled) {
+			rcu = true;
+		} else {
+			/* Writers kept interfering, wait for them */
+			ht_rcu_read_unlock();
+			PTHREAD_RWLOCK_rdlock(&partition->lock);
+		}
+	} else {
+		/* Acquire mutex */
+		if (may_write)
+			PTHREAD_RWLOCK_wrlock(&partition->lock);
+		else
+			PTHREAD_RWLOCK_rdlock(&partition->lock);
+	}
+
+	/* A split may have moved the key before we got here */
+	if (grow && atomic_fetch_uint64_t(&ht->geometry) != geometry &&
+	    ht_address(ht, base, rbt_hash,
+		       atomic_fetch_uint64_t(&ht->geometry)) != index) {
+		if (rcu)
+			ht_rcu_read_unlock();
+		else
+			PTHREAD_RWLOCK_unlock(&partition->lock);
+		goto again;
+	}
+
+	if (!rcu) {
+		if (open)
+			rc = ht_open_find(ht, partition->open, key,
+					  rbt_hash, &slot);
+		else
+			rc = key_locate(ht, key, index, rbt_hash, &locator);
+	}
 
 	if (rc == HASHTABLE_SUCCESS) {
 		/* Key was found */
-		data = RBT_OPAQ(locator);
+		if (!open)
+			data = atomic_fetch_voidptr(&RBT_OPAQ(locator));
+		else if (rcu)
+			data = &snapshot;
+		else
+			data = &partition->open->slots[slot].data;
+
 		if (val) {
 			val->addr = data->val.addr;
 			val->len = data->val.len;
@@ -492,8 +1352,16 @@ hashtable_getlatch(struct hash_table *ht,
 		latch->index = index;
 		latch->rbt_hash = rbt_hash;
 		latch->locator = locator;
+		latch->slot = slot;
+		latch->rcu = rcu;
+		latch->sync = false;
+		latch->retired = NULL;
+		latch->retired_data = NULL;
+		latch->retired_tab = NULL;
+	} else if (rcu) {
+		ht_rcu_read_unlock();
 	} else {
-		PTHREAD_RWLOCK_unlock(&ht->partitions[index].lock);
+		PTHREAD_RWLOCK_unlock(&partition->lock);
 	}
 
 	if (rc != HASHTABLE_SUCCESS && isDebug(COMPONENT_HASHTABLE)
@@ -515,6 +1383,11 @@ hashtable_getlatch(struct hash_table *ht,
  * freed by some other means (hashtable_setlatched or
  * HashTable_DelLatched).
  *
+ * For tables created with HT_FLAG_RCU, an entry removed or replaced
+ * under the latch is freed here, after waiting for lockless readers
+ * to drain.  Once this returns the caller may free the old key and
+ * value.
+ *
  * @param[in] ht    The hash table with the lock to be released
  * @param[in] latch The latch structure holding retained state
  */
@@ -523,11 +1396,98 @@ void
 hashtable_releaselatched(struct hash_table *ht, struct hash_latch *latch)
 {
 	if (latch) {
-		PTHREAD_RWLOCK_unlock(&ht->partitions[latch->index].lock);
+		if (latch->rcu)
+			ht_rcu_read_unlock();
+		else
+			PTHREAD_RWLOCK_unlock(
+				&hashtable_partition(ht, latch->index)->lock);
+
+		if (latch->sync) {
+			/* Lockless readers may still be looking at what
+			   was removed or replaced */
+			ht_rcu_synchronize();
+
+			if (latch->retired != NULL) {
+				pool_free(ht->data_pool,
+					  RBT_OPAQ(latch->retired));
+				pool_free(ht->node_pool, latch->retired);
+			}
+
+			if (latch->retired_data != NULL)
+				pool_free(ht->data_pool, latch->retired_data);
+
+			if (latch->retired_tab != NULL)
+				ht_open_tab_free(latch->retired_tab);
+		}
+
 		memset(latch, 0, sizeof(struct hash_latch));
 	}
 }
 
+/**
+ * @brief Set a value in an open addressed table
+ *
+ * The body of hashtable_setlatched for HT_FLAG_OPEN, the latch is
+ * left for the caller to release.
+ */
+static hash_error_t
+setlatched_open(struct hash_table *ht, struct gsh_buffdesc *key,
+		struct gsh_buffdesc *val, struct hash_latch *latch,
+		int overwrite, struct gsh_buffdesc *stored_key,
+		struct gsh_buffdesc *stored_val)
+{
+	struct hash_partition *partition =
+		hashtable_partition(ht, latch->index);
+	struct hash_open_tab *tab = partition->open;
+	struct hash_slot *slot;
+	uint32_t i;
+
+	if (latch->slot != HT_OPEN_NO_SLOT) {
+		if (!overwrite)
+			return HASHTABLE_ERROR_KEY_ALREADY_EXISTS;
+
+		slot = &tab->slots[latch->slot];
+
+		if (stored_key)
+			*stored_key = slot->data.key;
+
+		if (stored_val)
+			*stored_val = slot->data.val;
+
+		ht_rcu_write_begin(ht, partition);
+		slot->data.key = *key;
+		slot->data.val = *val;
+		ht_rcu_write_end(ht, partition);
+
+		if (ht->parameter.flags & HT_FLAG_RCU)
+			latch->sync = true;
+
+		return HASHTABLE_OVERWRITTEN;
+	}
+
+	/* Keep the load factor at or under 7/8 */
+	if ((uint64_t)(tab->used + 1) * 8 > (uint64_t)tab->capacity * 7) {
+		ht_open_grow(ht, partition, latch);
+		tab = partition->open;
+	}
+
+	i = ht_open_free_slot(tab, latch->rbt_hash);
+	slot = &tab->slots[i];
+
+	ht_rcu_write_begin(ht, partition);
+	slot->hash = latch->rbt_hash;
+	slot->data.key = *key;
+	slot->data.val = *val;
+	if (tab->ctrl[i] == HT_CTRL_EMPTY)
+		tab->used++;
+	tab->ctrl[i] = ht_open_tag(latch->rbt_hash);
+	ht_rcu_write_end(ht, partition);
+
+	++partition->count;
+
+	return HASHTABLE_SUCCESS;
+}
+
 /**
  * @brief Set a value in a table following a previous GetLatch
  *
@@ -571,6 +1531,11 @@ hashtable_setlatched(struct hash_table *ht,
 	struct rbt_node *locator = NULL;
 	/* New node for the case of non-overwrite */
 	struct rbt_node *mutator = NULL;
+	/* The latched partition */
+	struct hash_partition *partition =
+		hashtable_partition(ht, latch->index);
+	/* Whether the partition has grown enough to split one */
+	bool split = false;
 
 	if (isDebug(COMPONENT_HASHTABLE)
 	    && isFullDebug(ht->parameter.ht_log_component)) {
@@ -594,6 +1559,12 @@ hashtable_setlatched(struct hash_table *ht,
 			     latch->index, latch->rbt_hash);
 	}
 
+	if (ht->parameter.flags & HT_FLAG_OPEN) {
+		rc = setlatched_open(ht, key, val, latch, overwrite,
+				     stored_key, stored_val);
+		goto out;
+	}
+
 	/* In the case of collision */
 	if (latch->locator) {
 		if (!overwrite) {
@@ -635,8 +1606,22 @@ hashtable_setlatched(struct hash_table *ht,
 		if (stored_val)
 			*stored_val = descriptors->val;
 
-		descriptors->key = *key;
-		descriptors->val = *val;
+		if (ht->parameter.flags & HT_FLAG_RCU) {
+			/* Publish a new pair rather than tearing the one
+			   lockless readers may be looking at. */
+			struct hash_data *old = descriptors;
+
+			descriptors = pool_alloc(ht->data_pool);
+			descriptors->key = *key;
+			descriptors->val = *val;
+			atomic_store_voidptr(&RBT_OPAQ(latch->locator),
+					     descriptors);
+			latch->retired_data = old;
+			latch->sync = true;
+		} else {
+			descriptors->key = *key;
+			descriptors->val = *val;
+		}
 		rc = HASHTABLE_OVERWRITTEN;
 		goto out;
 	}
@@ -644,30 +1629,40 @@ hashtable_setlatched(struct hash_table *ht,
 	/* We have no collision, so go about creating and inserting a new
 	   node. */
 
-	RBT_FIND(&ht->partitions[latch->index].rbt, locator, latch->rbt_hash);
+	RBT_FIND(&partition->rbt, locator, latch->rbt_hash);
 
 	mutator = pool_alloc(ht->node_pool);
 
 	descriptors = pool_alloc(ht->data_pool);
 
-	RBT_OPAQ(mutator) = descriptors;
-	RBT_VALUE(mutator) = latch->rbt_hash;
-	RBT_INSERT(&ht->partitions[latch->index].rbt, mutator, locator);
-
+	/* Fill the node in before it becomes visible */
 	descriptors->key.addr = key->addr;
 	descriptors->key.len = key->len;
 
 	descriptors->val.addr = val->addr;
 	descriptors->val.len = val->len;
 
+	RBT_OPAQ(mutator) = descriptors;
+	RBT_VALUE(mutator) = latch->rbt_hash;
+
+	ht_rcu_write_begin(ht, partition);
+	RBT_INSERT(&partition->rbt, mutator, locator);
+	ht_rcu_write_end(ht, partition);
+
 	/* Only in the non-overwrite case */
-	++ht->partitions[latch->index].count;
+	++partition->count;
+
+	split = (ht->parameter.flags & HT_FLAG_GROW) &&
+		partition->count > HT_GROW_LOAD;
 
 	rc = HASHTABLE_SUCCESS;
 
  out:
 	hashtable_releaselatched(ht, latch);
 
+	if (split)
+		ht_split(ht);
+
 	if (rc != HASHTABLE_SUCCESS && isDebug(COMPONENT_HASHTABLE)
 	    && isFullDebug(ht->parameter.ht_log_component))
 		LogFullDebug(ht->parameter.ht_log_component,
@@ -677,6 +1672,36 @@ hashtable_setlatched(struct hash_table *ht,
 	return rc;
 }
 
+/**
+ * @brief Remove the latched entry of an open addressed table
+ *
+ * A slot may only go back to empty if its group still has an empty
+ * slot, as no lookup can then have probed past the group.  Otherwise
+ * it is marked deleted so probe sequences stay intact.
+ */
+static void
+deletelatched_open(struct hash_table *ht, struct hash_partition *partition,
+		   struct hash_latch *latch)
+{
+	struct hash_open_tab *tab = partition->open;
+	uint32_t group = latch->slot / HT_OPEN_GROUP;
+
+	ht_rcu_write_begin(ht, partition);
+	if (ht_open_match(&tab->ctrl[group * HT_OPEN_GROUP], HT_CTRL_EMPTY)) {
+		tab->ctrl[latch->slot] = HT_CTRL_EMPTY;
+		tab->used--;
+	} else {
+		tab->ctrl[latch->slot] = HT_CTRL_DELETED;
+	}
+	ht_rcu_write_end(ht, partition);
+
+	if (ht->parameter.flags & HT_FLAG_RCU)
+		latch->sync = true;
+
+	latch->slot = HT_OPEN_NO_SLOT;
+	--partition->count;
+}
+
 /**
  * @brief Delete a value from the store following a previous GetLatch
  *
@@ -705,12 +1730,20 @@ void hashtable_deletelatched(struct hash_table *ht,
 	/* The pair of buffer descriptors comprising the stored entry */
 	struct hash_data *data = NULL;
 	/* Its partition */
-	struct hash_partition *partition = &ht->partitions[latch->index];
+	struct hash_partition *partition =
+		hashtable_partition(ht, latch->index);
 
-	if (!latch->locator)
-		return;
+	if (ht->parameter.flags & HT_FLAG_OPEN) {
+		if (latch->slot == HT_OPEN_NO_SLOT)
+			return;
 
-	data = RBT_OPAQ(latch->locator);
+		data = &partition->open->slots[latch->slot].data;
+	} else {
+		if (!latch->locator)
+			return;
+
+		data = RBT_OPAQ(latch->locator);
+	}
 
 	if (isDebug(COMPONENT_HASHTABLE)
 	    && isFullDebug(ht->parameter.ht_log_component)) {
@@ -741,6 +1774,11 @@ void hashtable_deletelatched(struct hash_table *ht,
 	if (stored_val)
 		*stored_val = data->val;
 
+	if (ht->parameter.flags & HT_FLAG_OPEN) {
+		deletelatched_open(ht, partition, latch);
+		return;
+	}
+
 	/* Clear cache */
 	if (partition->cache) {
 		uint32_t offset = cache_offsetof(ht, latch->rbt_hash);
@@ -768,10 +1806,82 @@ void hashtable_deletelatched(struct hash_table *ht,
 	}
 
 	/* Now remove the entry */
+	ht_rcu_write_begin(ht, partition);
 	RBT_UNLINK(&partition->rbt, latch->locator);
-	pool_free(ht->data_pool, data);
-	pool_free(ht->node_pool, latch->locator);
-	--ht->partitions[latch->index].count;
+	ht_rcu_write_end(ht, partition);
+
+	if (ht->parameter.flags & HT_FLAG_RCU) {
+		/* Freed by hashtable_releaselatched */
+		latch->retired = latch->locator;
+		latch->sync = true;
+	} else {
+		pool_free(ht->data_pool, data);
+		pool_free(ht->node_pool, latch->locator);
+	}
+	latch->locator = NULL;
+	--partition->count;
+}
+
+/**
+ * @brief Free the entries of an open addressed table taken out of use
+ *
+ * @return false if free_func failed for any entry.
+ */
+static bool
+delall_open(struct hash_open_tab *tab,
+	    int (*free_func)(struct gsh_buffdesc, struct gsh_buffdesc))
+{
+	bool ok = true;
+	uint32_t i;
+
+	for (i = 0; i < tab->capacity; i++) {
+		if (tab->ctrl[i] & 0x80)
+			continue;
+
+		if (free_func(tab->slots[i].data.key,
+			      tab->slots[i].data.val) == 0)
+			ok = false;
+	}
+
+	ht_open_tab_free(tab);
+
+	return ok;
+}
+
+/**
+ * @brief Free the entries of a tree taken out of use
+ *
+ * @return false if free_func failed for any entry.
+ */
+static bool
+delall_tree(struct hash_table *ht, struct rbt_head *root,
+	    int (*free_func)(struct gsh_buffdesc, struct gsh_buffdesc))
+{
+	/* Pointer to node in tree for removal */
+	struct rbt_node *cursor = NULL;
+	bool ok = true;
+
+	/* The root still points back into the partition */
+	if (root->root != NULL)
+		root->root->anchor = &root->root;
+
+	while ((cursor = RBT_LEFTMOST(root)) != NULL) {
+		/* Pointer to the key and value descriptors */
+		struct hash_data *data = RBT_OPAQ(cursor);
+		/* Buffer descriptor for key, as stored */
+		struct gsh_buffdesc key = data->key;
+		/* Buffer descriptor for value, as stored */
+		struct gsh_buffdesc val = data->val;
+
+		RBT_UNLINK(root, cursor);
+		pool_free(ht->data_pool, data);
+		pool_free(ht->node_pool, cursor);
+
+		if (free_func(key, val) == 0)
+			ok = false;
+	}
+
+	return ok;
 }
 
 /**
@@ -780,6 +1890,11 @@ void hashtable_deletelatched(struct hash_table *ht,
  * This function removes all (key,val) couples from the hashtable and
  * frees the stored data using the supplied function
  *
+ * Each partition is emptied under its lock by taking its whole tree
+ * or slot array out, the entries are freed once every partition is
+ * done and, for HT_FLAG_RCU, lockless readers have moved on.  A
+ * failure of free_func does not stop the others being freed.
+ *
  * @param[in,out] ht        The hashtable to be cleared of all entries
  * @param[in]     free_func The function with which to free the contents
  *                          of each entry
@@ -793,53 +1908,101 @@ hashtable_delall(struct hash_table *ht,
 {
 	/* Successive partition numbers */
 	uint32_t index = 0;
+	/* Number of partitions */
+	uint32_t count = hashtable_walk_begin(ht);
+	/* The trees or slot arrays taken out of the partitions */
+	struct rbt_head *trees = NULL;
+	struct hash_open_tab **tabs = NULL;
+	bool ok = true;
+
+	if (ht->parameter.flags & HT_FLAG_OPEN)
+		tabs = gsh_calloc(count, sizeof(*tabs));
+	else
+		trees = gsh_calloc(count, sizeof(*trees));
+
+	for (index = 0; index < count; index++) {
+		/* Each successive partition */
+		struct hash_partition *partition =
+			hashtable_partition(ht, index);
+
+		PTHREAD_RWLOCK_wrlock(&partition->lock);
+
+		ht_rcu_write_begin(ht, partition);
+		if (ht->parameter.flags & HT_FLAG_OPEN) {
+			tabs[index] = partition->open;
+			partition->open =
+				ht_open_tab_alloc(tabs[index]->capacity);
+		} else {
+			trees[index] = partition->rbt;
+			RBT_HEAD_INIT(&partition->rbt);
+		}
+		ht_rcu_write_end(ht, partition);
 
-	for (index = 0; index < ht->parameter.index_size; index++) {
-		/* The root of each successive partition */
-		struct rbt_head *root = &ht->partitions[index].rbt;
-		/* Pointer to node in tree for removal */
-		struct rbt_node *cursor = NULL;
-
-		PTHREAD_RWLOCK_wrlock(&ht->partitions[index].lock);
-
-		/* Continue until there are no more entries in the red-black
-		   tree */
-		while ((cursor = RBT_LEFTMOST(root)) != NULL) {
-			/* Pointer to the key and value descriptors
-			   for each successive entry */
-			struct hash_data *data = NULL;
-			/* Aliased poitner to node, for freeing
-			   buffers after removal from tree */
-			struct rbt_node *holder = cursor;
-			/* Buffer descriptor for key, as stored */
-			struct gsh_buffdesc key;
-			/* Buffer descriptor for value, as stored */
-			struct gsh_buffdesc val;
-			/* Return code from the free function.  Zero
-			   on failure */
-			int rc = 0;
-
-			RBT_UNLINK(root, cursor);
-			data = RBT_OPAQ(holder);
-
-			key = data->key;
-			val = data->val;
-
-			pool_free(ht->data_pool, data);
-			pool_free(ht->node_pool, holder);
-			--ht->partitions[index].count;
-			rc = free_func(key, val);
-
-			if (rc == 0) {
-				PTHREAD_RWLOCK_unlock(&ht->partitions[index].
-						      lock);
-				return HASHTABLE_ERROR_DELALL_FAIL;
-			}
+		/* Nothing cached may outlive the nodes */
+		if (partition->cache)
+			memset(partition->cache, 0, cache_page_size(ht));
+
+		partition->count = 0;
+
+		PTHREAD_RWLOCK_unlock(&partition->lock);
+	}
+
+	hashtable_walk_end(ht);
+
+	/* Lockless readers may still be looking at what was taken out */
+	if (ht->parameter.flags & HT_FLAG_RCU)
+		ht_rcu_synchronize();
+
+	for (index = 0; index < count; index++) {
+		if (ht->parameter.flags & HT_FLAG_OPEN) {
+			if (!delall_open(tabs[index], free_func))
+				ok = false;
+		} else if (!delall_tree(ht, &trees[index], free_func)) {
+			ok = false;
 		}
-		PTHREAD_RWLOCK_unlock(&ht->partitions[index].lock);
 	}
 
-	return HASHTABLE_SUCCESS;
+	gsh_free(tabs);
+	gsh_free(trees);
+
+	return ok ? HASHTABLE_SUCCESS : HASHTABLE_ERROR_DELALL_FAIL;
+}
+
+/**
+ * @brief Log one entry of the hashtable
+ *
+ * @param[in] component The component debugging config to use.
+ * @param[in] ht        The hashtable to be used.
+ * @param[in] data      The entry
+ */
+
+static void
+log_entry(log_components_t component, struct hash_table *ht,
+	  struct hash_data *data)
+{
+	/* String representation of the key */
+	char dispkey[HASHTABLE_DISPLAY_STRLEN];
+	/* String representation of the stored value */
+	char dispval[HASHTABLE_DISPLAY_STRLEN];
+	/* Recomputed partitionindex */
+	uint32_t index = 0;
+	/* Recomputed hash for Red-Black tree */
+	uint64_t rbt_hash = 0;
+
+	ht->parameter.key_to_str(&(data->key), dispkey);
+	ht->parameter.val_to_str(&(data->val), dispval);
+
+	if (compute(ht, &data->key, &index, &rbt_hash)
+	    != HASHTABLE_SUCCESS) {
+		LogCrit(component,
+			"Possible implementation error in hash_func_both");
+		index = 0;
+		rbt_hash = 0;
+	}
+
+	LogFullDebug(component,
+		     "%s => %s; index=%" PRIu32 " rbt_hash=%"
+		     PRIu64, dispkey, dispval, index, rbt_hash);
 }
 
 /**
@@ -859,56 +2022,52 @@ hashtable_log(log_components_t component, struct hash_table *ht)
 	struct rbt_node *it = NULL;
 	/* The root of the tree currently being inspected */
 	struct rbt_head *root;
-	/* Buffer descriptors for the key and value */
-	struct hash_data *data = NULL;
-	/* String representation of the key */
-	char dispkey[HASHTABLE_DISPLAY_STRLEN];
-	/* String representation of the stored value */
-	char dispval[HASHTABLE_DISPLAY_STRLEN];
 	/* Index for traversing the partitions */
 	uint32_t i = 0;
 	/* Running count of entries  */
 	size_t nb_entries = 0;
-	/* Recomputed partitionindex */
-	uint32_t index = 0;
-	/* Recomputed hash for Red-Black tree */
-	uint64_t rbt_hash = 0;
+	/* Number of partitions */
+	uint32_t count = hashtable_walk_begin(ht);
+	/* The partition currently being inspected */
+	struct hash_partition *partition;
 
-	LogFullDebug(component, "The hash is partitioned into %d trees",
-		     ht->parameter.index_size);
+	LogFullDebug(component, "The hash is partitioned into %" PRIu32
+		     " trees", count);
 
-	for (i = 0; i < ht->parameter.index_size; i++)
-		nb_entries += ht->partitions[i].count;
+	for (i = 0; i < count; i++)
+		nb_entries += hashtable_partition(ht, i)->count;
 
 	LogFullDebug(component, "The hash contains %zd entries", nb_entries);
 
-	for (i = 0; i < ht->parameter.index_size; i++) {
-		root = &ht->partitions[i].rbt;
+	for (i = 0; i < count; i++) {
+		partition = hashtable_partition(ht, i);
+		root = &partition->rbt;
 		LogFullDebug(component,
 			     "The partition in position %" PRIu32
-			     "contains: %u entries", i, root->rbt_num_node);
-		PTHREAD_RWLOCK_rdlock(&ht->partitions[i].lock);
-		RBT_LOOP(root, it) {
-			data = it->rbt_opaq;
-
-			ht->parameter.key_to_str(&(data->key), dispkey);
-			ht->parameter.val_to_str(&(data->val), dispval);
-
-			if (compute(ht, &data->key, &index, &rbt_hash)
-			    != HASHTABLE_SUCCESS) {
-				LogCrit(component,
-					"Possible implementation error in hash_func_both");
-				index = 0;
-				rbt_hash = 0;
+			     "contains: %zu entries", i,
+			     partition->count);
+		PTHREAD_RWLOCK_rdlock(&partition->lock);
+		if (ht->parameter.flags & HT_FLAG_OPEN) {
+			/* The slot array of this partition */
+			struct hash_open_tab *tab = partition->open;
+			/* Slot index */
+			uint32_t slot;
+
+			for (slot = 0; slot < tab->capacity; slot++) {
+				if (!(tab->ctrl[slot] & 0x80))
+					log_entry(component, ht,
+						  &tab->slots[slot].data);
+			}
+		} else {
+			RBT_LOOP(root, it) {
+				log_entry(component, ht, it->rbt_opaq);
+				RBT_INCREMENT(it);
 			}
-
-			LogFullDebug(component,
-				     "%s => %s; index=%" PRIu32 " rbt_hash=%"
-				     PRIu64, dispkey, dispval, index, rbt_hash);
-			RBT_INCREMENT(it);
 		}
-		PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
+		PTHREAD_RWLOCK_unlock(&partition->lock);
 	}
+
+	hashtable_walk_end(ht);
 }
 
 /**
@@ -53,9 +53,130 @@
 #include "gsh_rpc.h"
 #include "nfs_core.h"
 #include "idmapper.h"
+#include "fridgethr.h"
+#include "gsh_list.h"
 
 static struct gsh_buffdesc owner_domain;
 
+/**
+ * @brief A lookup in progress
+ *
+ * Threads missing the cache for a mapping already being looked up
+ * wait for that lookup rather than issuing their own.
+ */
+
+struct idmapper_inflight {
+	struct glist_head list;
+	bool group;		/*< Group rather than user */
+	bool by_name;		/*< Looking up name rather than id */
+	uint32_t id;
+	struct gsh_buffdesc name;
+	bool done;
+	uint32_t waiters;
+};
+
+static pthread_mutex_t idmapper_inflight_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idmapper_inflight_cv = PTHREAD_COND_INITIALIZER;
+static GLIST_HEAD(idmapper_inflight_list);
+
+/**
+ * @brief A mapping to refresh in the background
+ */
+
+struct idmapper_refresh {
+	bool group;
+	bool by_name;
+	uint32_t id;
+	struct gsh_buffdesc name;
+};
+
+static struct fridgethr *idmapper_fridge;
+
+static bool name2id_qualified(char *name, size_t len, uint32_t *id,
+			      bool group, gid_t *gid, bool *got_gid,
+			      char *at);
+
+/**
+ * @brief Start looking up a mapping, or wait for whoever is
+ *
+ * @param[in] group True for a group, false for a user
+ * @param[in] id    UID or GID looked up, if name is NULL
+ * @param[in] name  Name looked up, or NULL
+ *
+ * @return The lookup to end with idmapper_inflight_end(), or NULL if
+ *         another thread did the lookup while we waited.
+ */
+
+static struct idmapper_inflight *idmapper_inflight_begin(
+					bool group, uint32_t id,
+					const struct gsh_buffdesc *name)
+{
+	struct idmapper_inflight *inflight;
+	struct glist_head *glist;
+	size_t len = name != NULL ? name->len : 0;
+
+	PTHREAD_MUTEX_lock(&idmapper_inflight_mtx);
+
+	glist_for_each(glist, &idmapper_inflight_list) {
+		inflight = glist_entry(glist, struct idmapper_inflight, list);
+
+		if (inflight->group != group ||
+		    inflight->by_name != (name != NULL))
+			continue;
+		if (name == NULL ? inflight->id != id
+				 : (inflight->name.len != len ||
+				    memcmp(inflight->name.addr, name->addr,
+					   len) != 0))
+			continue;
+
+		inflight->waiters++;
+		while (!inflight->done)
+			pthread_cond_wait(&idmapper_inflight_cv,
+					  &idmapper_inflight_mtx);
+		if (--inflight->waiters == 0)
+			gsh_free(inflight);
+
+		PTHREAD_MUTEX_unlock(&idmapper_inflight_mtx);
+		return NULL;
+	}
+
+	inflight = gsh_malloc(sizeof(*inflight) + len);
+	inflight->group = group;
+	inflight->by_name = name != NULL;
+	inflight->id = id;
+	inflight->name.addr = (char *)(inflight + 1);
+	inflight->name.len = len;
+	if (name != NULL)
+		memcpy(inflight->name.addr, name->addr, len);
+	inflight->done = false;
+	inflight->waiters = 0;
+	glist_add_tail(&idmapper_inflight_list, &inflight->list);
+
+	PTHREAD_MUTEX_unlock(&idmapper_inflight_mtx);
+
+	return inflight;
+}
+
+/**
+ * @brief Finish a lookup, its result being in the cache
+ *
+ * @param[in] inflight Lookup from idmapper_inflight_begin()
+ */
+
+static void idmapper_inflight_end(struct idmapper_inflight *inflight)
+{
+	PTHREAD_MUTEX_lock(&idmapper_inflight_mtx);
+
+	glist_del(&inflight->list);
+	inflight->done = true;
+	if (inflight->waiters == 0)
+		gsh_free(inflight);
+	else
+		pthread_cond_broadcast(&idmapper_inflight_cv);
+
+	PTHREAD_MUTEX_unlock(&idmapper_inflight_mtx);
+}
+
 /**
  * @brief Initialize the ID Mapper
  *
@@ -64,6 +185,9 @@ static struct gsh_buffdesc owner_domain;
 
 bool idmapper_init(void)
 {
+	struct fridgethr_params frp;
+	int rc;
+
 #ifdef USE_NFSIDMAP
 	if (!nfs_param.nfsv4_param.use_getpwnam) {
 		if (nfs4_init_name_mapping(nfs_param.nfsv4_param.idmapconf)
@@ -87,9 +211,231 @@ bool idmapper_init(void)
 	}
 
 	idmapper_cache_init();
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 2;
+	frp.thr_min = 0;
+	frp.thread_delay = 60;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	/* Without it mappings are simply not refreshed ahead */
+	rc = fridgethr_init(&idmapper_fridge, "idmapper", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to initialize idmapper fridge, error code %d.",
+			 rc);
+		idmapper_fridge = NULL;
+	}
+
 	return true;
 }
 
+/**
+ * @brief Size of the buffer id2name() needs
+ *
+ * @param[in] group True if this is a GID, false for a UID
+ *
+ * @return The size.
+ */
+
+static size_t id2name_bufsize(bool group)
+{
+	long size;
+
+	if (!nfs_param.nfsv4_param.use_getpwnam)
+		return NFS4_MAX_DOMAIN_LEN + 2;
+
+	if (group)
+		size = sysconf(_SC_GETGR_R_SIZE_MAX);
+	else
+		size = sysconf(_SC_GETPW_R_SIZE_MAX);
+	if (size == -1)
+		size = PWENT_BEST_GUESS_LEN;
+
+	return size + owner_domain.len + 2;
+}
+
+/**
+ * @brief Look up the name of a UID or GID
+ *
+ * @param[in]  id       UID or GID
+ * @param[in]  group    True if this is a GID, false for a UID
+ * @param[in]  namebuff Buffer of id2name_bufsize() bytes
+ * @param[out] new_name The name found, in namebuff
+ *
+ * @retval true if the id was mapped.
+ * @retval false if not.
+ */
+
+static bool id2name(uint32_t id, bool group, char *namebuff,
+		    struct gsh_buffdesc *new_name)
+{
+	int rc;
+
+	new_name->addr = namebuff;
+
+	if (nfs_param.nfsv4_param.use_getpwnam) {
+		char *cursor;
+		bool nulled;
+
+		new_name->len = id2name_bufsize(group) - owner_domain.len - 2;
+
+		if (group) {
+			struct group g;
+			struct group *gres;
+
+			rc = getgrgid_r(id, &g, namebuff, new_name->len,
+					&gres);
+			nulled = (gres == NULL);
+		} else {
+			struct passwd p;
+			struct passwd *pres;
+
+			rc = getpwuid_r(id, &p, namebuff, new_name->len,
+					&pres);
+			nulled = (pres == NULL);
+		}
+
+		if ((rc == 0) && !nulled) {
+			new_name->len = strlen(namebuff);
+			cursor = namebuff + new_name->len;
+			*(cursor++) = '@';
+			++new_name->len;
+			memcpy(cursor, owner_domain.addr,
+			       owner_domain.len);
+			new_name->len += owner_domain.len;
+			return true;
+		}
+
+		LogInfo(COMPONENT_IDMAPPER,
+			"%s failed with code %d.",
+			(group ? "getgrgid_r" : "getpwuid_r"),
+			rc);
+		return false;
+	}
+
+#ifdef USE_NFSIDMAP
+	if (group) {
+		rc = nfs4_gid_to_name(id, owner_domain.addr,
+				      namebuff,
+				      NFS4_MAX_DOMAIN_LEN + 1);
+	} else {
+		rc = nfs4_uid_to_name(id, owner_domain.addr,
+				      namebuff,
+				      NFS4_MAX_DOMAIN_LEN + 1);
+	}
+	if (rc == 0) {
+		new_name->len = strlen(namebuff);
+		return true;
+	}
+
+	LogInfo(COMPONENT_IDMAPPER,
+		"%s failed with code %d.",
+		(group ? "nfs4_gid_to_name" :
+		"nfs4_uid_to_name"), rc);
+#endif				/* USE_NFSIDMAP */
+	return false;
+}
+
+/**
+ * @brief Refresh a mapping in the background
+ *
+ * A refresh that fails leaves the mapping as it was, to expire.
+ */
+
+static void idmapper_refresh_run(struct fridgethr_context *ctx)
+{
+	struct idmapper_refresh *refresh = ctx->arg;
+	struct gsh_buffdesc new_name;
+	char *namebuff, *at;
+	uint32_t id;
+	gid_t gid;
+	bool got_gid = false;
+
+	if (!refresh->by_name) {
+		namebuff = gsh_malloc(id2name_bufsize(refresh->group));
+		if (id2name(refresh->id, refresh->group, namebuff,
+			    &new_name)) {
+			PTHREAD_RWLOCK_wrlock(refresh->group ?
+					      &idmapper_group_lock :
+					      &idmapper_user_lock);
+			if (refresh->group)
+				(void) idmapper_add_group(&new_name,
+							  refresh->id, false);
+			else
+				(void) idmapper_add_user(&new_name,
+							 refresh->id, NULL,
+							 false, false);
+			PTHREAD_RWLOCK_unlock(refresh->group ?
+					      &idmapper_group_lock :
+					      &idmapper_user_lock);
+		}
+		gsh_free(namebuff);
+		gsh_free(refresh);
+		return;
+	}
+
+	/* Only qualified names are refreshed, see name2id() */
+	namebuff = gsh_malloc(refresh->name.len + 1);
+	memcpy(namebuff, refresh->name.addr, refresh->name.len);
+	namebuff[refresh->name.len] = '\0';
+	at = memchr(namebuff, '@', refresh->name.len);
+
+	if (at != NULL &&
+	    name2id_qualified(namebuff, refresh->name.len, &id,
+			      refresh->group, &gid, &got_gid, at)) {
+		PTHREAD_RWLOCK_wrlock(refresh->group ? &idmapper_group_lock :
+				      &idmapper_user_lock);
+		if (refresh->group)
+			(void) idmapper_add_group(&refresh->name, id, false);
+		else
+			(void) idmapper_add_user(&refresh->name, id,
+						 got_gid ? &gid : NULL,
+						 false, false);
+		PTHREAD_RWLOCK_unlock(refresh->group ? &idmapper_group_lock :
+				      &idmapper_user_lock);
+	}
+
+	gsh_free(namebuff);
+	gsh_free(refresh);
+}
+
+/**
+ * @brief Queue the refresh of a mapping used near its expiration
+ *
+ * @param[in] group True for a group, false for a user
+ * @param[in] id    UID or GID to refresh, if name is NULL
+ * @param[in] name  Name to refresh, or NULL
+ */
+
+static void idmapper_refresh(bool group, uint32_t id,
+			     const struct gsh_buffdesc *name)
+{
+	struct idmapper_refresh *refresh;
+	size_t len = name != NULL ? name->len : 0;
+
+	if (idmapper_fridge == NULL)
+		return;
+
+	refresh = gsh_malloc(sizeof(*refresh) + len);
+	refresh->group = group;
+	refresh->by_name = name != NULL;
+	refresh->id = id;
+	refresh->name.addr = (char *)(refresh + 1);
+	refresh->name.len = len;
+	if (name != NULL)
+		memcpy(refresh->name.addr, name->addr, len);
+
+	if (fridgethr_submit(idmapper_fridge, idmapper_refresh_run,
+			     refresh) != 0) {
+		LogDebug(COMPONENT_IDMAPPER,
+			 "Could not queue refresh of %s",
+			 group ? "group" : "user");
+		gsh_free(refresh);
+	}
+}
+
 /**
  * @brief Encode a UID or GID as a string
  *
@@ -104,8 +450,14 @@ bool idmapper_init(void)
 static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 {
 	const struct gsh_buffdesc *found;
+	struct idmapper_inflight *inflight = NULL;
 	uint32_t not_a_size_t;
 	bool success = false;
+	bool refresh = false;
+	bool waited = false;
+	bool looked_up;
+	char *namebuff;
+	struct gsh_buffdesc new_name;
 
 	if (nfs_param.nfsv4_param.only_numeric_owners) {
 		/* 2**32 is 10 digits long in decimal */
@@ -120,148 +472,92 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 					&not_a_size_t, UINT32_MAX);
 	}
 
+ again:
 	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
 			      &idmapper_user_lock);
 	if (group)
-		success = idmapper_lookup_by_gid(id, &found);
+		success = idmapper_lookup_by_gid(id, &found, &refresh);
 	else
-		success = idmapper_lookup_by_uid(id, &found, NULL);
+		success = idmapper_lookup_by_uid(id, &found, NULL, &refresh);
 
 	if (likely(success)) {
-		not_a_size_t = found->len;
+		struct gsh_buffdesc xdr_name;
 
 		/* Fully qualified owners are always stored in the
-		   hash table, no matter what our lookup method. */
-		success =
-		    inline_xdr_bytes(xdrs, (char **)&found->addr, &not_a_size_t,
-				     UINT32_MAX);
+		   hash table, no matter what our lookup method,
+		   and already in XDR form. */
+		idmapper_name_xdr(found, &xdr_name);
+		if (likely(xdrs->x_op == XDR_ENCODE)) {
+			success = XDR_PUTBYTES(xdrs, xdr_name.addr,
+					       xdr_name.len);
+		} else {
+			not_a_size_t = found->len;
+			success = inline_xdr_bytes(xdrs, (char **)&found->addr,
+						   &not_a_size_t, UINT32_MAX);
+		}
 		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
 				      &idmapper_user_lock);
+		if (unlikely(refresh))
+			idmapper_refresh(group, id, NULL);
 		return success;
-	} else {
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		int rc;
-		int size;
-		bool looked_up = false;
-		char *namebuff = NULL;
-		struct gsh_buffdesc new_name;
-
-		if (nfs_param.nfsv4_param.use_getpwnam) {
-			if (group)
-				size = sysconf(_SC_GETGR_R_SIZE_MAX);
-			else
-				size = sysconf(_SC_GETPW_R_SIZE_MAX);
-			if (size == -1)
-				size = PWENT_BEST_GUESS_LEN;
-			new_name.len = size;
-			size += owner_domain.len + 2;
-		} else {
-			size = NFS4_MAX_DOMAIN_LEN + 2;
-		}
-
-		namebuff = alloca(size);
-
-		new_name.addr = namebuff;
-
-		if (nfs_param.nfsv4_param.use_getpwnam) {
-			char *cursor;
-			bool nulled;
+	}
 
-			if (group) {
-				struct group g;
-				struct group *gres;
+	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
 
-				rc = getgrgid_r(id, &g, namebuff, new_name.len,
-						&gres);
-				nulled = (gres == NULL);
-			} else {
-				struct passwd p;
-				struct passwd *pres;
+	/* Let one thread look the id up while the others wait for it */
+	if (!waited) {
+		inflight = idmapper_inflight_begin(group, id, NULL);
+		if (inflight == NULL) {
+			waited = true;
+			goto again;
+		}
+	}
 
-				rc = getpwuid_r(id, &p, namebuff, new_name.len,
-						&pres);
-				nulled = (pres == NULL);
-			}
+	namebuff = alloca(id2name_bufsize(group));
+	looked_up = id2name(id, group, namebuff, &new_name);
 
-			if ((rc == 0) && !nulled) {
-				new_name.len = strlen(namebuff);
-				cursor = namebuff + new_name.len;
-				*(cursor++) = '@';
-				++new_name.len;
-				memcpy(cursor, owner_domain.addr,
-				       owner_domain.len);
-				new_name.len += owner_domain.len;
-				looked_up = true;
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"%s failed with code %d.",
-					(group ? "getgrgid_r" : "getpwuid_r"),
-					rc);
-			}
+	if (!looked_up) {
+		if (nfs_param.nfsv4_param.allow_numeric_owners) {
+			LogInfo(COMPONENT_IDMAPPER,
+				"Lookup for %d failed, using numeric %s",
+				id, (group ? "group" : "owner"));
+			/* 2**32 is 10 digits long in decimal */
+			sprintf(namebuff, "%"PRIu32, id);
+			new_name.len = strlen(namebuff);
 		} else {
-#ifdef USE_NFSIDMAP
-			if (group) {
-				rc = nfs4_gid_to_name(id, owner_domain.addr,
-						      namebuff,
-						      NFS4_MAX_DOMAIN_LEN + 1);
-			} else {
-				rc = nfs4_uid_to_name(id, owner_domain.addr,
-						      namebuff,
-						      NFS4_MAX_DOMAIN_LEN + 1);
-			}
-			if (rc == 0) {
-				new_name.len = strlen(namebuff);
-				looked_up = true;
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"%s failed with code %d.",
-					(group ? "nfs4_gid_to_name" :
-					"nfs4_uid_to_name"), rc);
-			}
-#else				/* USE_NFSIDMAP */
-			looked_up = false;
-#endif				/* !USE_NFSIDMAP */
+			LogInfo(COMPONENT_IDMAPPER,
+				"Lookup for %d failed, using nobody.",
+				id);
+			memcpy(new_name.addr, "nobody", 6);
+			new_name.len = 6;
 		}
+	}
 
-		if (!looked_up) {
-			if (nfs_param.nfsv4_param.allow_numeric_owners) {
-				LogInfo(COMPONENT_IDMAPPER,
-					"Lookup for %d failed, using numeric %s",
-					id, (group ? "group" : "owner"));
-				/* 2**32 is 10 digits long in decimal */
-				sprintf(namebuff, "%"PRIu32, id);
-				new_name.len = strlen(namebuff);
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"Lookup for %d failed, using nobody.",
-					id);
-				memcpy(new_name.addr, "nobody", 6);
-				new_name.len = 6;
-			}
-		}
+	/* Add to the cache and encode the result. */
+	PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
+	if (group)
+		success = idmapper_add_group(&new_name, id, !looked_up);
+	else
+		success = idmapper_add_user(&new_name, id, NULL, false,
+					    !looked_up);
 
-		/* Add to the cache and encode the result. */
-		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (group)
-			success = idmapper_add_group(&new_name, id);
-		else
-			success = idmapper_add_user(&new_name, id, NULL, false);
+	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
 
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (unlikely(!success)) {
-			LogMajor(COMPONENT_IDMAPPER, "%s failed.",
-				 group ? "idmapper_add_group" :
-				 "idmaper_add_user");
-		}
-		not_a_size_t = new_name.len;
-		return inline_xdr_bytes(xdrs, (char **)&new_name.addr,
-					&not_a_size_t, UINT32_MAX);
+	if (inflight != NULL)
+		idmapper_inflight_end(inflight);
+
+	if (unlikely(!success)) {
+		LogMajor(COMPONENT_IDMAPPER, "%s failed.",
+			 group ? "idmapper_add_group" :
+			 "idmaper_add_user");
 	}
+	not_a_size_t = new_name.len;
+	return inline_xdr_bytes(xdrs, (char **)&new_name.addr,
+				&not_a_size_t, UINT32_MAX);
 }
-
 /**
  * @brief Encode a UID as a string
  *
@@ -506,6 +802,31 @@ static bool idmapname2id(char *name, size_t len, uint32_t *id,
 #endif				/* USE_NFSIDMAP */
 }
 
+/**
+ * @brief Look up a name qualified with a domain
+ *
+ * @param[in]  name    C string of name
+ * @param[in]  len     Length of name
+ * @param[out] id      ID found
+ * @param[in]  group   Whether this a group lookup
+ * @param[out] gid     Found GID
+ * @param[out] got_gid Found a GID.
+ * @param[in]  at      Location of the @
+ *
+ * @return true on success, false not making the grade
+ */
+
+static bool name2id_qualified(char *name, size_t len, uint32_t *id,
+			      bool group, gid_t *gid, bool *got_gid,
+			      char *at)
+{
+	/* The anonymous id is only used for unqualified names */
+	if (nfs_param.nfsv4_param.use_getpwnam)
+		return pwentname2id(name, len, id, 0, group, gid, got_gid, at);
+	else
+		return idmapname2id(name, len, id, 0, group, gid, got_gid, at);
+}
+
 /**
  * @brief Convert a name to an ID
  *
@@ -520,75 +841,91 @@ static bool idmapname2id(char *name, size_t len, uint32_t *id,
 static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 		    const uint32_t anon)
 {
+	struct idmapper_inflight *inflight = NULL;
 	bool success;
-
+	bool refresh = false;
+	bool waited = false;
+	gid_t gid;
+	bool got_gid = false;
+	/* Something we can mutate and count on as terminated */
+	char *namebuff = alloca(name->len + 1);
+	char *at;
+	bool looked_up = false;
+
+ again:
 	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
 			      &idmapper_user_lock);
 	if (group)
-		success = idmapper_lookup_by_gname(name, id);
+		success = idmapper_lookup_by_gname(name, id, &refresh);
 	else
-		success = idmapper_lookup_by_uname(name, id, NULL, false);
+		success = idmapper_lookup_by_uname(name, id, NULL, false,
+						   &refresh);
 	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
 			      &idmapper_user_lock);
 
-	if (success)
+	if (success) {
+		if (unlikely(refresh) && memchr(name->addr, '@', name->len))
+			idmapper_refresh(group, 0, name);
 		return true;
-	else {
-		gid_t gid;
-		bool got_gid = false;
-		/* Something we can mutate and count on as terminated */
-		char *namebuff = alloca(name->len + 1);
-		char *at;
-		bool looked_up = false;
-
-		memcpy(namebuff, name->addr, name->len);
-		*(namebuff + name->len) = '\0';
-		at = memchr(namebuff, '@', name->len);
-
-		if (at == NULL) {
-			if (pwentname2id
-			    (namebuff, name->len, id, anon, group, &gid,
-			     &got_gid, NULL))
-				looked_up = true;
-			else if (atless2id(namebuff, name->len, id, anon))
-				looked_up = true;
-			else
-				return false;
-		} else if (nfs_param.nfsv4_param.use_getpwnam) {
-			looked_up =
-			    pwentname2id(namebuff, name->len, id, anon, group,
-					 &gid, &got_gid, at);
-		} else {
-			looked_up =
-			    idmapname2id(namebuff, name->len, id, anon, group,
-					 &gid, &got_gid, at);
+	}
+
+	/* Let one thread look the name up while the others wait for it */
+	if (!waited) {
+		inflight = idmapper_inflight_begin(group, 0, name);
+		if (inflight == NULL) {
+			waited = true;
+			goto again;
 		}
+	}
 
-		if (!looked_up) {
-			LogInfo(COMPONENT_IDMAPPER,
-				"All lookups failed for %s, using anonymous.",
-				namebuff);
-			*id = anon;
+	memcpy(namebuff, name->addr, name->len);
+	*(namebuff + name->len) = '\0';
+	at = memchr(namebuff, '@', name->len);
+
+	if (at == NULL) {
+		if (pwentname2id
+		    (namebuff, name->len, id, anon, group, &gid,
+		     &got_gid, NULL))
+			looked_up = true;
+		else if (atless2id(namebuff, name->len, id, anon))
+			looked_up = true;
+		else {
+			if (inflight != NULL)
+				idmapper_inflight_end(inflight);
+			return false;
 		}
+	} else {
+		looked_up = name2id_qualified(namebuff, name->len, id, group,
+					      &gid, &got_gid, at);
+	}
 
-		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (group)
-			success = idmapper_add_group(name, *id);
-		else
-			success =
-			    idmapper_add_user(name, *id, got_gid ? &gid : NULL,
-					      false);
+	if (!looked_up) {
+		LogInfo(COMPONENT_IDMAPPER,
+			"All lookups failed for %s, using anonymous.",
+			namebuff);
+		*id = anon;
+	}
 
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
+	PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
+	if (group)
+		success = idmapper_add_group(name, *id, !looked_up);
+	else
+		success =
+		    idmapper_add_user(name, *id, got_gid ? &gid : NULL,
+				      false, !looked_up);
 
-		if (!success)
-			LogMajor(COMPONENT_IDMAPPER, "%s(%s %u) failed",
-				 (group ? "gidmap_add" : "uidmap_add"),
-				 namebuff, *id);
-		return true;
-	}
+	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
+			      &idmapper_user_lock);
+
+	if (inflight != NULL)
+		idmapper_inflight_end(inflight);
+
+	if (!success)
+		LogMajor(COMPONENT_IDMAPPER, "%s(%s %u) failed",
+			 (group ? "gidmap_add" : "uidmap_add"),
+			 namebuff, *id);
+	return true;
 }
 
 /**
@@ -663,7 +1000,8 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 #ifdef USE_NFSIDMAP
 	PTHREAD_RWLOCK_rdlock(&idmapper_user_lock);
 	success =
-	    idmapper_lookup_by_uname(&princbuff, &gss_uid, &gss_gidres, true);
+	    idmapper_lookup_by_uname(&princbuff, &gss_uid, &gss_gidres, true,
+				     NULL);
 
 	/* We do need uid and gid. If gid is not in the cache, treat it as a
 	 * failure.
@@ -772,7 +1110,8 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 
 		PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
 		success =
-		    idmapper_add_user(&princbuff, gss_uid, &gss_gid, true);
+		    idmapper_add_user(&princbuff, gss_uid, &gss_gid, true,
+				      false);
 		PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
 
 		if (!success) {
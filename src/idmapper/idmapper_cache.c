@@ -37,12 +37,15 @@
 #include <string.h>
 #include <pwd.h>
 #include <grp.h>
+#include <time.h>
+#include <arpa/inet.h>
 #include "gsh_intrinsic.h"
 #include "gsh_types.h"
 #include "common_utils.h"
 #include "avltree.h"
 #include "idmapper.h"
 #include "abstract_atomic.h"
+#include "gsh_config.h"
 
 /**
  * @brief User entry in the IDMapper cache
@@ -56,6 +59,9 @@ struct cache_user {
 	struct avltree_node uname_node;	/*< Node in the name tree */
 	struct avltree_node uid_node;	/*< Node in the UID tree */
 	bool in_uidtree;		/* true iff this is in uid_tree */
+	bool negative;		/*< Lookup failed, uid is the fallback */
+	uint32_t refreshing;	/*< A background refresh is queued */
+	time_t epoch;		/*< When the mapping was looked up */
 };
 
 /**
@@ -67,6 +73,9 @@ struct cache_group {
 	gid_t gid;		/*< Group ID */
 	struct avltree_node gname_node;	/*< Node in the name tree */
 	struct avltree_node gid_node;	/*< Node in the GID tree */
+	bool negative;		/*< Lookup failed, gid is the fallback */
+	uint32_t refreshing;	/*< A background refresh is queued */
+	time_t epoch;		/*< When the mapping was looked up */
 };
 
 /**
@@ -265,6 +274,70 @@ static int gid_comparator(const struct avltree_node *node1,
 		return 0;
 }
 
+/**
+ * @brief Check whether a cache entry may still be used
+ *
+ * Mappings that were found expire after Idmap_Cache_Expiration
+ * seconds and failed lookups after Idmap_Negative_Expiration, 0
+ * keeping them until the cache is cleared.  A found mapping used in
+ * the last quarter of its life is handed out for refresh, once.
+ *
+ * @param[in]     epoch      When the entry was looked up
+ * @param[in]     negative   Whether the lookup failed
+ * @param[in,out] refreshing Refresh flag of the entry
+ * @param[out]    refresh    Set if the caller should refresh the entry,
+ *                           may be NULL
+ *
+ * @retval true if the entry has not expired.
+ */
+
+static bool idmapper_fresh(time_t epoch, bool negative, uint32_t *refreshing,
+			   bool *refresh)
+{
+	time_t ttl = negative
+		? nfs_param.nfsv4_param.idmap_negative_expiration
+		: nfs_param.nfsv4_param.idmap_cache_expiration;
+	time_t age;
+
+	if (ttl == 0)
+		return true;
+
+	age = time(NULL) - epoch;
+	if (age >= ttl)
+		return false;
+
+	if (refresh != NULL && !negative && age >= ttl - ttl / 4 &&
+	    (atomic_postset_uint32_t_bits(refreshing, 1) & 1) == 0)
+		*refresh = true;
+
+	return true;
+}
+
+/**
+ * @brief Lay a name out in XDR form after a cache entry
+ *
+ * The length word goes at start, the name after it and the padding
+ * is zeroed, see idmapper_name_xdr().
+ *
+ * @param[in]  start Space after the entry, idmapper_xdr_size() bytes
+ * @param[in]  name  Name to store
+ * @param[out] dest  Name as stored
+ */
+
+static void idmapper_store_name(char *start, const struct gsh_buffdesc *name,
+				struct gsh_buffdesc *dest)
+{
+	uint32_t len = htonl(name->len);
+	size_t size = idmapper_xdr_size(name->len);
+
+	memcpy(start, &len, BYTES_PER_XDR_UNIT);
+	dest->addr = start + BYTES_PER_XDR_UNIT;
+	dest->len = name->len;
+	memcpy(dest->addr, name->addr, name->len);
+	memset((char *)dest->addr + name->len, 0,
+	       size - BYTES_PER_XDR_UNIT - name->len);
+}
+
 /**
  * @brief Initialize the IDMapper cache
  */
@@ -290,25 +363,26 @@ void idmapper_cache_init(void)
  * @param[in] gid  Optional.  Set to NULL if no gid is known.
  * @param[in] gss_princ true when name is gss principal.
  *                      The uid to name map is not added for gss principals.
+ * @param[in] negative  true when the lookup failed and uid is a fallback.
  *
  * @retval true on success.
  * @retval false if our reach exceeds our grasp.
  */
 
 bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
-		       const gid_t *gid, bool gss_princ)
+		       const gid_t *gid, bool gss_princ, bool negative)
 {
 	struct avltree_node *found_name;
 	struct avltree_node *found_id;
 	struct cache_user *old;
 	struct cache_user *new;
 
-	new = gsh_malloc(sizeof(struct cache_user) + name->len);
+	new = gsh_malloc_tag(GSH_MEM_IDMAPPER, sizeof(struct cache_user) +
+			     idmapper_xdr_size(name->len));
 
-	new->uname.addr = (char *)new + sizeof(struct cache_user);
-	new->uname.len = name->len;
+	idmapper_store_name((char *)new + sizeof(struct cache_user), name,
+			    &new->uname);
 	new->uid = uid;
-	memcpy(new->uname.addr, name->addr, name->len);
 	if (gid) {
 		new->gid = *gid;
 		new->gid_set = true;
@@ -317,6 +391,9 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 		new->gid_set = false;
 	}
 	new->in_uidtree = (gss_princ) ? false : true;
+	new->negative = negative;
+	new->refreshing = 0;
+	new->epoch = time(NULL);
 
 	/*
 	 * There are 3 cases why we find an existing cache entry.
@@ -366,7 +443,7 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 			uid_cache[old->uid % id_cache_size] = NULL;
 			avltree_remove(&old->uid_node, &uid_tree);
 		}
-		gsh_free(old);
+		gsh_free_tag(GSH_MEM_IDMAPPER, old);
 		found_name = avltree_insert(&new->uname_node, &uname_tree);
 		assert(found_name == NULL);
 	}
@@ -381,7 +458,7 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
 		uid_cache[old->uid % id_cache_size] = NULL;
 		avltree_remove(found_id, &uid_tree);
 		avltree_remove(&old->uname_node, &uname_tree);
-		gsh_free(old);
+		gsh_free_tag(GSH_MEM_IDMAPPER, old);
 		found_id = avltree_insert(&new->uid_node, &uid_tree);
 		assert(found_id == NULL);
 	}
@@ -395,26 +472,31 @@ bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
  *
  * @note The caller must hold idmapper_group_lock for write.
  *
- * @param[in] name The user name
- * @param[in] gid  The group id
+ * @param[in] name     The user name
+ * @param[in] gid      The group id
+ * @param[in] negative true when the lookup failed and gid is a fallback.
  *
  * @retval true on success.
  * @retval false if our reach exceeds our grasp.
  */
 
-bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
+bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid,
+			bool negative)
 {
 	struct avltree_node *found_name;
 	struct avltree_node *found_id;
 	struct cache_group *tmp;
 	struct cache_group *new;
 
-	new = gsh_malloc(sizeof(struct cache_group) + name->len);
+	new = gsh_malloc_tag(GSH_MEM_IDMAPPER, sizeof(struct cache_group) +
+			     idmapper_xdr_size(name->len));
 
-	new->gname.addr = (char *)new + sizeof(struct cache_group);
-	new->gname.len = name->len;
+	idmapper_store_name((char *)new + sizeof(struct cache_group), name,
+			    &new->gname);
 	new->gid = gid;
-	memcpy(new->gname.addr, name->addr, name->len);
+	new->negative = negative;
+	new->refreshing = 0;
+	new->epoch = time(NULL);
 
 	/*
 	 * The threads that lookup by-name or by-id use the read lock. If
@@ -437,7 +519,7 @@ bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
 		avltree_remove(found_name, &gname_tree);
 		avltree_remove(&tmp->gid_node, &gid_tree);
 		gid_cache[tmp->gid % id_cache_size] = NULL;
-		gsh_free(tmp);
+		gsh_free_tag(GSH_MEM_IDMAPPER, tmp);
 		found_name = avltree_insert(&new->gname_node, &gname_tree);
 		assert(found_name == NULL);
 	}
@@ -450,7 +532,7 @@ bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
 		gid_cache[tmp->gid % id_cache_size] = NULL;
 		avltree_remove(found_id, &gid_tree);
 		avltree_remove(&tmp->gname_node, &gname_tree);
-		gsh_free(tmp);
+		gsh_free_tag(GSH_MEM_IDMAPPER, tmp);
 		found_id = avltree_insert(&new->gid_node, &gid_tree);
 		assert(found_id == NULL);
 	}
@@ -471,13 +553,15 @@ bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
  * @param[out] gid  The GID for the user, or NULL if there is
  *                  none. The caller may specify NULL if it isn't
  *                  interested.
+ * @param[out] refresh Set if the caller should refresh the entry,
+ *                     may be NULL.
  *
  * @retval true on success.
  * @retval false if we need to try, try again.
  */
 
 bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
-			      const gid_t **gid, bool gss_princ)
+			      const gid_t **gid, bool gss_princ, bool *refresh)
 {
 	struct cache_user prototype = {
 		.uname = *name
@@ -492,6 +576,10 @@ bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 
 	found_user =
 	    avltree_container_of(found_node, struct cache_user, uname_node);
+	if (!idmapper_fresh(found_user->epoch, found_user->negative,
+			    &found_user->refreshing, refresh))
+		return false;
+
 	if (!gss_princ) {
 		/* I assume that if someone likes this user enough to look it
 		   up by name, they'll like it enough to look it up by ID
@@ -525,13 +613,15 @@ bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
  * @param[out] gid  The GID for the user, or NULL if there is
  *                  none. The caller may specify NULL if it isn't
  *                  interested.
+ * @param[out] refresh Set if the caller should refresh the entry,
+ *                     may be NULL.
  *
  * @retval true on success.
  * @retval false if we weren't so successful.
  */
 
 bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
-			    const gid_t **gid)
+			    const gid_t **gid, bool *refresh)
 {
 	struct cache_user prototype = {
 		.uid = uid
@@ -560,6 +650,10 @@ bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
 						  uid_node);
 	}
 
+	if (!idmapper_fresh(found_user->epoch, found_user->negative,
+			    &found_user->refreshing, refresh))
+		return false;
+
 	if (likely(name))
 		*name = &found_user->uname;
 
@@ -579,12 +673,15 @@ bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
  *                  isn't interested in the GID.  (This seems
  *                  unlikely, since you can't get anything else from
  *                  this function.)
+ * @param[out] refresh Set if the caller should refresh the entry,
+ *                     may be NULL.
  *
  * @retval true on success.
  * @retval false if we need to try, try again.
  */
 
-bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
+bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid,
+			      bool *refresh)
 {
 	struct cache_group prototype = {
 		.gname = *name
@@ -600,6 +697,10 @@ bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
 	found_group =
 	    avltree_container_of(found_node, struct cache_group, gname_node);
 
+	if (!idmapper_fresh(found_group->epoch, found_group->negative,
+			    &found_group->refreshing, refresh))
+		return false;
+
 	/* I assume that if someone likes this group enough to look it
 	   up by name, they'll like it enough to look it up by ID
 	   later. */
@@ -623,12 +724,15 @@ bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
  * @param[in]  gid  The group ID to look up.
  * @param[out] name The user name to look up. (May be NULL if the user
  *                  doesn't care about the name, which would be weird.)
+ * @param[out] refresh Set if the caller should refresh the entry,
+ *                     may be NULL.
  *
  * @retval true on success.
  * @retval false if we're most unfortunate.
  */
 
-bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
+bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name,
+			    bool *refresh)
 {
 	struct cache_group prototype = {
 		.gid = gid
@@ -657,6 +761,10 @@ bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
 						   gid_node);
 	}
 
+	if (!idmapper_fresh(found_group->epoch, found_group->negative,
+			    &found_group->refreshing, refresh))
+		return false;
+
 	if (likely(name))
 		*name = &found_group->gname;
 	else
@@ -688,7 +796,7 @@ void idmapper_clear_cache(void)
 					    struct cache_user, uname_node);
 		avltree_remove(&user->uname_node, &uname_tree);
 		avltree_remove(&user->uid_node, &uid_tree);
-		gsh_free(user);
+		gsh_free_tag(GSH_MEM_IDMAPPER, user);
 	}
 
 	assert(avltree_first(&uid_tree) == NULL);
@@ -702,7 +810,7 @@ void idmapper_clear_cache(void)
 					     struct cache_group, gname_node);
 		avltree_remove(&group->gname_node, &gname_tree);
 		avltree_remove(&group->gid_node, &gid_tree);
-		gsh_free(group);
+		gsh_free_tag(GSH_MEM_IDMAPPER, group);
 	}
 
 	assert(avltree_first(&gid_tree) == NULL);
@@ -606,6 +606,11 @@ do {                                                   \
  */
 #define _9P_TCP_MSIZE 65536
 
+/**
+ * @brief Default value for _9p_tcp_event_threads
+ */
+#define _9P_TCP_EVENT_THREADS 4
+
 /**
  * @brief Default value for _9p_rdma_msize
  */
@@ -645,6 +650,9 @@ struct _9p_param {
 	/** Msize for 9P operation on tcp.  Defaults to _9P_TCP_MSIZE,
 	    settable by _9P_TCP_Msize */
 	uint32_t _9p_tcp_msize;
+	/** Threads polling the 9P tcp connections.  Defaults to
+	    _9P_TCP_EVENT_THREADS, settable by _9P_TCP_Event_Threads */
+	uint32_t _9p_tcp_event_threads;
 	/** Msize for 9P operation on rdma.  Defaults to _9P_RDMA_MSIZE,
 	    settable by _9P_RDMA_Msize */
 	uint32_t _9p_rdma_msize;
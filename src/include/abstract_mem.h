@@ -42,7 +42,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#ifdef LINUX
+#include <malloc.h>
+#endif
 #include "log.h"
+#include "abstract_atomic.h"
+#include "gsh_list.h"
 
 /**
  * @page GeneralAllocator General Allocator Shim
@@ -287,6 +292,78 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
 	free(p);
 }
 
+/**
+ * @page MemTags Tagged Allocations
+ *
+ * Heap allocations of a subsystem that does not use a pool may be
+ * accounted to a tag, by allocating them with gsh_malloc_tag or
+ * gsh_calloc_tag and freeing them with gsh_free_tag.  A tag counts
+ * the blocks it holds and, on Linux, their usable size.  The tags and
+ * the pools are reported by the ShowMemory DBus method and the
+ * metrics endpoint.
+ */
+
+enum gsh_mem_tag {
+	GSH_MEM_MDCACHE_DIRENTS,
+	GSH_MEM_IDMAPPER,
+	GSH_MEM_TAG_COUNT
+};
+
+struct gsh_mem_tag_stats {
+	int64_t objects;
+	int64_t bytes;
+};
+
+extern struct gsh_mem_tag_stats gsh_mem_tags[GSH_MEM_TAG_COUNT];
+
+/**
+ * @brief Usable size of a block, 0 where it cannot be had
+ */
+static inline size_t gsh_mem_size(void *p)
+{
+#ifdef LINUX
+	return malloc_usable_size(p);
+#else
+	return 0;
+#endif
+}
+
+/**
+ * @brief Account a block to a tag
+ *
+ * @param[in] tag The tag
+ * @param[in] p   The block, as allocated
+ *
+ * @return The block.
+ */
+static inline void *gsh_mem_tag_add(enum gsh_mem_tag tag, void *p)
+{
+	(void) atomic_inc_int64_t(&gsh_mem_tags[tag].objects);
+	(void) atomic_add_int64_t(&gsh_mem_tags[tag].bytes, gsh_mem_size(p));
+
+	return p;
+}
+
+#define gsh_malloc_tag(tag, n) gsh_mem_tag_add(tag, gsh_malloc(n))
+#define gsh_calloc_tag(tag, n, s) gsh_mem_tag_add(tag, gsh_calloc(n, s))
+
+/**
+ * @brief Free a block allocated with gsh_malloc_tag or gsh_calloc_tag
+ *
+ * @param[in] tag The tag it was allocated with
+ * @param[in] p   Block of memory to free, may be NULL
+ */
+static inline void
+gsh_free_tag(enum gsh_mem_tag tag, void *p)
+{
+	if (p == NULL)
+		return;
+
+	(void) atomic_dec_int64_t(&gsh_mem_tags[tag].objects);
+	(void) atomic_sub_int64_t(&gsh_mem_tags[tag].bytes, gsh_mem_size(p));
+	free(p);
+}
+
 /**
  * @brief Type representing a pool
  *
@@ -302,8 +379,21 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
 typedef struct pool {
 	char *name; /*< The name of the pool */
 	size_t object_size; /*< The size of the objects created */
+	size_t object_align; /*< Alignment of the objects, 0 for malloc's */
+	int32_t mag_slot; /*< Magazine slot, -1 if objects come from the heap */
+	int64_t objects; /*< Objects allocated, for a pool without magazines */
+	struct glist_head pools; /*< Link in the list of all pools */
 } pool_t;
 
+void pool_mag_init(pool_t *pool);
+void pool_mag_fini(pool_t *pool);
+void *pool_mag_alloc(pool_t *pool);
+void pool_mag_free(pool_t *pool, void *object);
+int64_t pool_mag_objects(pool_t *pool);
+
+void pool_register(pool_t *pool);
+void pool_unregister(pool_t *pool);
+
 /**
  * @brief Create a basic object pool
  *
@@ -337,18 +427,119 @@ pool_basic_init__(const char *name, size_t object_size,
 					function);
 
 	pool->object_size = object_size;
+	pool->object_align = 0;
+	pool->mag_slot = -1;
 
 	if (name)
 		pool->name = gsh_strdup__(name, file, line, function);
 	else
 		pool->name = NULL;
 
+	pool->objects = 0;
+	pool_register(pool);
+
 	return pool;
 }
 
 #define pool_basic_init(name, object_size) \
 	pool_basic_init__(name, object_size, __FILE__, __LINE__, __func__)
 
+/**
+ * @brief Create an object pool with per-thread caches
+ *
+ * Like pool_basic_init, but freed objects are cached per thread and
+ * per NUMA node rather than returned to the heap, see
+ * pool_magazine.c.  Meant for hot, fixed size objects that are
+ * allocated and freed at a high rate.
+ *
+ * @param[in] name             The name of this pool
+ * @param[in] object_size      The size of objects to allocate
+ * @param[in] file             Calling source file
+ * @param[in] line             Calling source line
+ * @param[in] function         Calling source function
+ *
+ * @return A pointer to the pool object.
+ */
+
+static inline pool_t *
+pool_magazine_init__(const char *name, size_t object_size,
+		     const char *file, int line, const char *function)
+{
+	pool_t *pool = pool_basic_init__(name, object_size, file, line,
+					 function);
+
+	pool_mag_init(pool);
+
+	return pool;
+}
+
+#define pool_magazine_init(name, object_size) \
+	pool_magazine_init__(name, object_size, __FILE__, __LINE__, __func__)
+
+/**
+ * @brief Create a magazine pool of aligned objects
+ *
+ * For objects declared aligned, e.g. to a cache line, which malloc
+ * would not honour.
+ *
+ * @param[in] name             The name of this pool
+ * @param[in] object_size      The size of objects to allocate
+ * @param[in] object_align     Their alignment, a power of two
+ * @param[in] file             Calling source file
+ * @param[in] line             Calling source line
+ * @param[in] function         Calling source function
+ *
+ * @return A pointer to the pool object.
+ */
+
+static inline pool_t *
+pool_magazine_init_aligned__(const char *name, size_t object_size,
+			     size_t object_align, const char *file, int line,
+			     const char *function)
+{
+	pool_t *pool = pool_basic_init__(name, object_size, file, line,
+					 function);
+
+	pool->object_align = object_align;
+	pool_mag_init(pool);
+
+	return pool;
+}
+
+#define pool_magazine_init_aligned(name, object_size, object_align) \
+	pool_magazine_init_aligned__(name, object_size, object_align, \
+				     __FILE__, __LINE__, __func__)
+
+/**
+ * @brief Allocate a zeroed object of a pool from the heap
+ *
+ * @param[in] pool       The pool the object is for
+ * @param[in] file       Calling source file
+ * @param[in] line       Calling source line
+ * @param[in] function   Calling source function
+ *
+ * @return The object.
+ */
+
+static inline void *
+pool_heap_alloc__(pool_t *pool, const char *file, int line,
+		  const char *function)
+{
+	void *object;
+
+	if (pool->object_align == 0)
+		return gsh_calloc__(1, pool->object_size, file, line,
+				    function);
+
+	object = gsh_malloc_aligned__(pool->object_align, pool->object_size,
+				      file, line, function);
+	memset(object, 0, pool->object_size);
+	return object;
+}
+
+#define pool_heap_alloc(pool) \
+	pool_heap_alloc__(pool, __FILE__, __LINE__, __func__)
+
 /**
  * @brief Destroy a memory pool
  *
@@ -361,6 +552,9 @@ pool_basic_init__(const char *name, size_t object_size,
 static inline void
 pool_destroy(pool_t *pool)
 {
+	pool_unregister(pool);
+	if (pool->mag_slot >= 0)
+		pool_mag_fini(pool);
 	gsh_free(pool->name);
 	gsh_free(pool);
 }
@@ -392,7 +586,10 @@ pool_destroy(pool_t *pool)
 static inline void *
 pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
 {
-	return gsh_calloc__(1, pool->object_size, file, line, function);
+	if (pool->mag_slot >= 0)
+		return pool_mag_alloc(pool);
+	(void) atomic_inc_int64_t(&pool->objects);
+	return pool_heap_alloc__(pool, file, line, function);
 }
 
 #define pool_alloc(pool) \
@@ -417,6 +614,11 @@ pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
 static inline void
 pool_free(pool_t *pool, void *object)
 {
+	if (pool->mag_slot >= 0) {
+		pool_mag_free(pool, object);
+		return;
+	}
+	(void) atomic_dec_int64_t(&pool->objects);
 	gsh_free(object);
 }
 
@@ -43,7 +43,9 @@
 #include <sys/types.h>
 
 #include "avltree.h"
+#include "gsh_list.h"
 #include "gsh_types.h"
+#include "gsh_token_bucket.h"
 
 struct gsh_client {
 	struct avltree_node node_k;
@@ -52,6 +54,18 @@ struct gsh_client {
 	int64_t refcnt;
 	nsecs_elapsed_t last_update;
 	char *hostaddr_str;
+	/* Fair share scheduling of high latency requests, protected by
+	 * the dispatcher's fair queue lock.
+	 */
+	struct glist_head fq_reqs;	/*< Requests waiting for a worker */
+	struct glist_head fq_active;	/*< On the fair queue's active list */
+	uint32_t fq_len;		/*< Number of requests on fq_reqs */
+	int32_t fq_deficit;		/*< Requests left in this round */
+	uint32_t fq_weight;		/*< Requests per round, 0 means 1 */
+	uint32_t outstanding;		/*< Requests in the dispatcher */
+	/* Rate limits, protected by the fair queue lock */
+	struct gsh_token_bucket fq_ops_tb;	/*< Client_Ops_Limit */
+	struct gsh_token_bucket fq_bytes_tb;	/*< Client_Bytes_Limit */
 	unsigned char addrbuf[];
 };
 
@@ -66,6 +80,7 @@ void dbus_client_init(void);
 #endif
 struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only);
 void put_gsh_client(struct gsh_client *client);
+int set_gsh_client_weight(sockaddr_t *client_ipaddr, uint32_t weight);
 int foreach_gsh_client(bool(*cb) (struct gsh_client *cl, void *state),
 		       void *state);
 
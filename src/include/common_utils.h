@@ -19,6 +19,9 @@
 
 #include "gsh_types.h"
 #include "log.h"
+#ifdef ENABLE_LOCK_PROFILE
+#include "gsh_lock_prof.h"
+#endif
 
 /**
  * BUILD_BUG_ON - break compile if a condition is true.
@@ -131,6 +134,25 @@ extern int portable_clock_gettime(struct timespec *ts);
 		}							\
 	} while (0)
 
+/**
+ * @brief Call a lock function
+ *
+ * With ENABLE_LOCK_PROFILE, the lock is tried first and contention is
+ * accounted to the call site, see gsh_lock_prof.h.
+ *
+ * @param[out] _rc   Result of the lock call
+ * @param[in]  _try  The trylock call
+ * @param[in]  _call The blocking lock call
+ * @param[in]  _lock The lock
+ */
+#ifdef ENABLE_LOCK_PROFILE
+#define PTHREAD_LOCK_CALL(_rc, _try, _call, _lock)			\
+	LOCK_PROF_LOCK(_rc, _try, _call, #_lock)
+#else
+#define PTHREAD_LOCK_CALL(_rc, _try, _call, _lock)			\
+	((_rc) = (_call))
+#endif
+
 /**
  * @brief Logging write-lock
  *
@@ -141,7 +163,8 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_rwlock_wrlock(_lock);			\
+		PTHREAD_LOCK_CALL(rc, pthread_rwlock_trywrlock(_lock),	\
+				  pthread_rwlock_wrlock(_lock), _lock);	\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Got write lock on %p (%s) "	\
@@ -166,7 +189,8 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_rwlock_rdlock(_lock);			\
+		PTHREAD_LOCK_CALL(rc, pthread_rwlock_tryrdlock(_lock),	\
+				  pthread_rwlock_rdlock(_lock), _lock);	\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Got read lock on %p (%s) "	\
@@ -216,7 +240,8 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_mutex_lock(_mtx);				\
+		PTHREAD_LOCK_CALL(rc, pthread_mutex_trylock(_mtx),	\
+				  pthread_mutex_lock(_mtx), _mtx);	\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Acquired mutex %p (%s) at %s:%d",	\
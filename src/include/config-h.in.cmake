@@ -51,15 +51,21 @@
 #cmakedefine BIGEND 1
 #cmakedefine HAVE_XATTR_H 1
 #cmakedefine HAVE_DAEMON 1
+#cmakedefine HAVE_STATX 1
 #cmakedefine USE_LTTNG 1
 #cmakedefine ENABLE_VFS_DEBUG_ACL 1
+#cmakedefine USE_IO_URING 1
+#cmakedefine USE_TLS 1
 #cmakedefine ENABLE_RFC_ACL 1
 #cmakedefine USE_GLUSTER_SYMLINK_MOUNT 1
+#cmakedefine USE_GLUSTER_XREADDIRPLUS 1
 #cmakedefine USE_FSAL_CEPH_MKNOD 1
 #cmakedefine USE_FSAL_CEPH_SETLK 1
 #cmakedefine USE_FSAL_CEPH_LL_LOOKUP_ROOT 1
 #cmakedefine USE_FSAL_CEPH_STATX 1
+#cmakedefine USE_FSAL_RGW_READDIR2 1
 #cmakedefine ENABLE_LOCKTRACE 1
+#cmakedefine ENABLE_LOCK_PROFILE 1
 #cmakedefine SANITIZE_ADDRESS 1
 
 #define NFS_GANESHA 1
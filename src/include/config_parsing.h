@@ -817,6 +817,11 @@ static inline bool is_prime(int v)
 config_file_t config_ParseFile(char *file_path,
 			       struct config_error_type *err_type);
 
+/* Same, going through a cache of the parse if cache_path is set */
+config_file_t config_ParseFile_cached(char *file_path,
+				      const char *cache_path,
+				      struct config_error_type *err_type);
+
 /**
  * config_Print:
  * Print the content of the syntax tree
@@ -840,6 +845,9 @@ int find_config_nodes(config_file_t config, char *expr,
 		     struct config_node_list **node_list,
 		      struct config_error_type *err_type);
 
+/* hash the contents of a block in the parse tree */
+uint64_t config_node_hash(void *tree_node);
+
 /* fill configuration structure from parse tree */
 int load_config_from_node(void *tree_node,
 			  struct config_block *conf_blk,
@@ -39,6 +39,8 @@
 #include "gsh_list.h"
 #include "avltree.h"
 #include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "gsh_token_bucket.h"
 #include "fsal.h"
 
 #ifndef EXPORT_MGR_H
@@ -56,6 +58,9 @@ enum export_status {
  *
  */
 
+struct export_client_index;
+struct export_path_node;
+
 struct gsh_export {
 	/** List of all exports */
 	struct glist_head exp_list;
@@ -69,6 +74,13 @@ struct gsh_export {
 	struct glist_head exp_nlm_share_list;
 	/** List of exports rooted on the same inode */
 	struct glist_head exp_root_list;
+	/** Exports with the same path and its node in the path trie,
+	 *  protected by the export manager lock */
+	struct glist_head exp_path_list;
+	struct export_path_node *exp_path_node;
+	/** Same for the pseudo path */
+	struct glist_head exp_pseudo_list;
+	struct export_path_node *exp_pseudo_node;
 	/** List of exports to be mounted or cleaned up */
 	struct glist_head exp_work;
 	/** List of exports mounted on this export */
@@ -79,6 +91,8 @@ struct gsh_export {
 	struct fsal_obj_handle *exp_root_obj;
 	/** CFG Allowed clients - update protected by lock */
 	struct glist_head clients;
+	/** Compiled form of clients, swapped with it - protected by lock */
+	struct export_client_index *client_index;
 	/** Entry for the junction of this export.  Protected by lock */
 	struct fsal_obj_handle *exp_junction_obj;
 	/** The export this export sits on. Protected by lock */
@@ -107,6 +121,21 @@ struct gsh_export {
 	uint64_t MaxOffsetWrite;
 	/** CFG: Maximum Offset allowed for read - atomic changeable option */
 	uint64_t MaxOffsetRead;
+	/** CFG: READ and WRITE operations per second, 0 for no limit,
+	    settable with Ops_Limit - atomic changeable option */
+	uint64_t ops_limit;
+	/** CFG: READ and WRITE bytes per second, 0 for no limit,
+	    settable with Bytes_Limit - atomic changeable option */
+	uint64_t bytes_limit;
+	/** CFG: Cache entries first reached through this export before
+	    they are recycled in favour of new ones, 0 to share the
+	    global budget, settable with Cache_Entries_HWMark - atomic
+	    changeable option */
+	uint32_t cache_entries_hwmark;
+	/** Buckets for the limits, protected by the dispatcher's fair
+	    queue lock */
+	struct gsh_token_bucket ops_tb;
+	struct gsh_token_bucket bytes_tb;
 	/** CFG: Filesystem ID for overriding fsid from FSAL - ????? */
 	fsal_fsid_t filesystem_id;
 	/** References to this export */
@@ -124,11 +153,24 @@ struct gsh_export {
 	/** CFG: Expiration time interval in seconds for attributes.  Settable
 	    with Attr_Expiration_Time. - atomic changeable option */
 	int32_t expire_time_attr;
+	/** Generation of clients and export_perms, changed on update */
+	uint64_t perms_gen;
+	/** Hash of the EXPORT block last committed, see config_node_hash */
+	uint64_t config_hash;
 	/** CFG: Export_Id for this export - static option */
 	uint16_t export_id;
 
 	uint8_t export_status;		/*< current condition */
 	bool has_pnfs_ds;		/*< id_servers matches export_id */
+	/** CFG: Create the FSAL export on first access, settable with
+	    Attach_On_Demand - static option */
+	bool attach_on_demand;
+	/** CFG: Content never changes behind our back, settable with
+	    Immutable - static option */
+	bool immutable;
+	/** Whether an attach_on_demand export has its FSAL export and
+	    root yet - atomic, only set under the attach lock */
+	uint8_t attached;
 };
 
 /* Use macro to define this to get around include file order. */
@@ -176,6 +218,9 @@ void put_gsh_export(struct gsh_export *a_export);
 void remove_gsh_export(uint16_t export_id);
 bool foreach_gsh_export(bool(*cb) (struct gsh_export *exp, void *state),
 			void *state);
+bool foreach_gsh_export_snapshot(bool(*cb) (struct gsh_export *exp,
+					    void *state),
+				 void *state);
 
 /**
  * @brief Advisory check of export readiness.
@@ -195,6 +240,39 @@ static inline bool export_ready(struct gsh_export *a_export)
 	return a_export->export_status == EXPORT_READY;
 }
 
+bool export_attach_slow(struct gsh_export *a_export);
+
+/**
+ * @brief Test whether an export has its FSAL export
+ *
+ * @param[in] export The export
+ *
+ * @retval true if the FSAL export and export root exist
+ */
+static inline bool export_attached(struct gsh_export *a_export)
+{
+	return !a_export->attach_on_demand ||
+	       atomic_fetch_uint8_t(&a_export->attached);
+}
+
+/**
+ * @brief Make sure an export has its FSAL export
+ *
+ * Exports configured with Attach_On_Demand only create their FSAL
+ * export when a client first reaches them.
+ *
+ * @param[in] export The export
+ *
+ * @retval true if the export can be used
+ */
+static inline bool export_attach(struct gsh_export *a_export)
+{
+	if (likely(export_attached(a_export)))
+		return true;
+
+	return export_attach_slow(a_export);
+}
+
 static inline void get_gsh_export_ref(struct gsh_export *a_export)
 {
 	(void) atomic_inc_int64_t(&a_export->refcnt);
@@ -202,6 +280,7 @@ static inline void get_gsh_export_ref(struct gsh_export *a_export)
 
 void export_revert(struct gsh_export *a_export);
 void export_add_to_mount_work(struct gsh_export *a_export);
+void export_sort_mount_work(void);
 void export_add_to_unexport_work_locked(struct gsh_export *a_export);
 void export_add_to_unexport_work(struct gsh_export *a_export);
 struct gsh_export *export_take_mount_work(void);
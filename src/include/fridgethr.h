@@ -46,6 +46,7 @@
 #include <stdbool.h>
 #include "gsh_list.h"
 #include "wait_queue.h"
+#include "gsh_lat_hist.h"
 
 struct fridgethr;
 
@@ -91,7 +92,13 @@ struct fridgethr_entry {
 	} ctx;
 	uint32_t flags; /*< Thread-fridge flags (for handoff) */
 	bool frozen; /*< Thread is frozen */
+	bool retiring; /*< Thread was allowed to exit by fridgethr_retire */
 	struct timespec timeout; /*< Wait timeout */
+	struct timespec submitted; /*< When the job we were handed was
+				       submitted, zero if not known */
+	struct timespec started; /*< When the current job started */
+	struct timespec ended; /*< When the last job ended, zero before
+				   the first one */
 	struct glist_head thread_link; /*< Link in the list of all
 					   threads */
 	struct glist_head idle_link; /*< Link in the idle queue */
@@ -189,6 +196,7 @@ struct fridgethr_work {
 	void (*func)(struct fridgethr_context *); /*< Function being
 						      executed */
 	void *arg; /*< Functions argument */
+	struct timespec submitted; /*< When it was submitted */
 };
 
 /**
@@ -201,6 +209,25 @@ typedef enum {
 	fridgethr_comm_stop /*< Demand all threads exit */
 } fridgethr_comm_t;
 
+/**
+ * @brief Counters of a fridge
+ *
+ * The counts are kept under the fridge mutex, the times and
+ * histograms are updated atomically by the threads running jobs.
+ */
+
+struct fridgethr_stats {
+	uint64_t submitted;	/*< Jobs submitted */
+	uint32_t deferred_max;	/*< Most jobs deferred at once */
+	uint64_t busy_ns;	/*< Time spent running jobs */
+	uint64_t thread_ns;	/*< Sum over time of nthreads, up to
+				    thread_ts */
+	struct timespec thread_ts;	/*< Last change of nthreads */
+	struct lat_hist wait;	/*< Submission to start of a job */
+	struct lat_hist run;	/*< Run time of a job */
+	struct lat_hist idle;	/*< Time a thread waits between jobs */
+};
+
 /**
  * @brief Structure representing a group of threads
  */
@@ -214,6 +241,8 @@ struct fridgethr {
 	uint32_t nthreads;	/*< Number of threads in fridge */
 	struct glist_head idle_q;	/*< Idle threads */
 	uint32_t nidle;		/*< Number of idle threads */
+	uint32_t nretiring;	/*< Threads on their way out through
+				    fridgethr_retire */
 	uint32_t flags;		/*< Fridge-wide flags */
 	fridgethr_comm_t command;	/*< Command state */
 	void (*cb_func)(void *);	/*< Callback on command completion */
@@ -223,6 +252,9 @@ struct fridgethr {
 	pthread_cond_t *cb_cv;	/*< Condition variable, signalled on
 				   completion */
 	bool transitioning; /*< Changing state */
+	struct glist_head fridges;	/*< Link in the list of fridges */
+	uint32_t nqueued;	/*< Jobs in the work queue */
+	struct fridgethr_stats st;	/*< Counters */
 	union {
 		struct glist_head work_q; /*< Work queued */
 		struct {
@@ -258,12 +290,22 @@ int fridgethr_sync_command(struct fridgethr *, fridgethr_comm_t, time_t);
 bool fridgethr_you_should_break(struct fridgethr_context *);
 int fridgethr_populate(struct fridgethr *, void (*)(struct fridgethr_context *),
 		      void *);
+int fridgethr_grow(struct fridgethr *, void (*)(struct fridgethr_context *),
+		   void *);
+bool fridgethr_retire(struct fridgethr_context *);
+bool fridgethr_retire_excess(struct fridgethr_context *);
+int fridgethr_set_limits(struct fridgethr *, uint32_t, uint32_t,
+			 void (*)(struct fridgethr_context *), void *);
 
 void fridgethr_setwait(struct fridgethr_context *ctx, time_t thread_delay);
 time_t fridgethr_getwait(struct fridgethr_context *ctx);
 
 void fridgethr_cancel(struct fridgethr *fr);
 
+void fridgethr_job_start(struct fridgethr_context *ctx,
+			 const struct timespec *submitted);
+void fridgethr_job_end(struct fridgethr_context *ctx);
+
 extern struct fridgethr *general_fridge;
 int general_fridge_init(void);
 int general_fridge_shutdown(void);
@@ -363,6 +363,17 @@ fsal_status_t fsal_read2(struct fsal_obj_handle *obj,
 			 void *buffer,
 			 bool *eof,
 			 struct io_info *info);
+fsal_status_t fsal_read_fd(struct fsal_obj_handle *obj, bool bypass,
+			   struct state_t *state, uint64_t offset, size_t size,
+			   int *fd, size_t *bytes_avail, bool *eof);
+fsal_status_t fsal_readv2(struct fsal_obj_handle *obj,
+			  bool bypass,
+			  struct state_t *state,
+			  uint64_t offset,
+			  struct iovec *iov,
+			  int iovcnt,
+			  size_t *bytes_moved,
+			  bool *eof);
 fsal_status_t fsal_write2(struct fsal_obj_handle *obj,
 			  bool bypass,
 			  struct state_t *state,
@@ -382,6 +393,9 @@ fsal_status_t fsal_readdir(struct fsal_obj_handle *directory, uint64_t cookie,
 			   unsigned int *nbfound, bool *eod_met,
 			   attrmask_t attrmask, helper_readdir_cb cb,
 			   void *opaque);
+fsal_status_t fsal_readdir_names(struct fsal_obj_handle *directory,
+				 uint64_t cookie, bool *eod_met,
+				 fsal_readdir_names_cb cb, void *opaque);
 fsal_status_t fsal_remove(struct fsal_obj_handle *parent, const char *name);
 fsal_status_t fsal_rename(struct fsal_obj_handle *dir_src,
 			  const char *oldname,
@@ -40,6 +40,7 @@
 #ifndef FSAL_API
 #define FSAL_API
 
+#include <sys/uio.h>
 #include "fsal_types.h"
 #include "fsal_pnfs.h"
 #include "sal_shared.h"
@@ -324,7 +325,7 @@ struct state_t;
  * rules), increment the minor version
  */
 
-#define FSAL_MINOR_VERSION 0
+#define FSAL_MINOR_VERSION 4
 
 /* Forward references for object methods */
 
@@ -353,10 +354,22 @@ struct fsal_dsh_ops;
 #define SEEK_HOLE 4
 #endif
 
+/**
+ * @brief A data or hole segment of a READ_PLUS
+ */
+struct io_segment {
+	data_content4 what;	/*< NFS4_CONTENT_DATA or NFS4_CONTENT_HOLE */
+	uint64_t offset;	/*< Offset of the segment in the file */
+	uint64_t length;	/*< Length of the segment */
+};
+
 struct io_info {
 	contents io_content;
 	uint32_t io_advise;
 	bool_t   io_eof;
+	struct io_segment *io_segs;	/*< Room for READ_PLUS segments */
+	uint32_t io_segmax;		/*< Entries in io_segs */
+	uint32_t io_segcnt;		/*< Entries filled by the FSAL */
 };
 
 struct io_hints {
@@ -420,6 +433,7 @@ struct req_op_context {
 	void *fsal_private;		/*< private for FSAL use */
 	struct fsal_module *fsal_module;	/*< current fsal module */
 	struct fsal_pnfs_ds *fsal_pnfs_ds;	/*< current pNFS DS */
+	uint32_t xid;			/*< RPC xid of the request, if any */
 	/* add new context members here */
 };
 
@@ -1186,6 +1200,32 @@ struct export_ops {
 
 	bool (*is_superuser)(struct fsal_export *exp_hdl,
 			     const struct user_cred *creds);
+
+/**
+ * @brief Get attributes of several objects
+ *
+ * Same semantics as getattrs on each handle, for an FSAL that can
+ * fetch many objects' attributes in fewer requests than one per
+ * object.  The caller sets the request_mask of each attrs_out entry.
+ * The default implementation calls getattrs on each handle.  An FSAL
+ * overriding it should set fso_bulk_ops.
+ *
+ * The caller MUST call fsal_release_attrs on each attrs_out entry.
+ *
+ * @param[in]  exp_hdl    Export the objects belong to
+ * @param[in]  count      Number of objects
+ * @param[in]  obj_hdls   Objects to query
+ * @param[out] attrs_out  Attribute lists, one per object
+ * @param[out] status     Status of each object
+ *
+ * @return FSAL status, an error if no object was queried at all.
+ */
+
+	fsal_status_t (*getattrs_bulk)(struct fsal_export *exp_hdl,
+				       uint32_t count,
+				       struct fsal_obj_handle **obj_hdls,
+				       struct attrlist *attrs_out,
+				       fsal_status_t *status);
 };
 
 /**
@@ -1285,6 +1325,58 @@ typedef enum fsal_dir_result (*fsal_readdir_cb)(
 				const char *name, struct fsal_obj_handle *obj,
 				struct attrlist *attrs,
 				void *dir_state, fsal_cookie_t cookie);
+
+/**
+ * @brief Callback to provide readdir_names caller with each name
+ *
+ * As fsal_readdir_cb, for callers that only want what a getdents
+ * would return: no object is ref'd and no attribute fetched.
+ *
+ * @param[in]      name         The name of the entry
+ * @param[in]      fileid       The fileid of the entry
+ * @param[in]      type         The type of the entry
+ * @param[in]      dir_state    Opaque pointer to be passed to callback
+ * @param[in]      cookie       An FSAL generated cookie for the entry
+ *
+ * @returns fsal_dir_result above
+ */
+typedef enum fsal_dir_result (*fsal_readdir_names_cb)(
+				const char *name, uint64_t fileid,
+				object_file_type_t type,
+				void *dir_state, fsal_cookie_t cookie);
+
+/**
+ * @brief Arguments and results of an asynchronous read or write
+ *
+ * Owned by the caller and must stay valid until the completion
+ * callback has been invoked.
+ */
+struct fsal_io_arg {
+	struct state_t *state;	/*< state_t to use for this operation */
+	uint64_t offset;	/*< Position of the I/O */
+	struct iovec *iov;	/*< Buffers for the data */
+	int iovcnt;		/*< Number of buffers in iov */
+	size_t io_amount;	/*< Out: amount of data read or written */
+	bool end_of_file;	/*< Out: a read hit the end of file */
+	bool fsal_stable;	/*< In/out: write stability, see write2 */
+};
+
+/**
+ * @brief Completion callback for asynchronous I/O
+ *
+ * May be invoked from any thread, including the submitter's own
+ * before the submitting method returns.
+ *
+ * @param[in] obj_hdl    File the I/O was done on
+ * @param[in] ret        Status of the I/O
+ * @param[in] io_arg     The arguments passed at submission, with results
+ * @param[in] caller_arg Opaque argument passed at submission
+ */
+typedef void (*fsal_async_cb)(struct fsal_obj_handle *obj_hdl,
+			      fsal_status_t ret,
+			      struct fsal_io_arg *io_arg,
+			      void *caller_arg);
+
 /**
  * @brief FSAL object operations vector
  */
@@ -2550,6 +2642,16 @@ struct fsal_obj_ops {
  * perform the read whether a state is presented or not. This function also
  * is expected to handle properly bypassing or not share reservations.
  *
+ * For a READ_PLUS, info->io_segs may give room for info->io_segmax
+ * segments.  An FSAL that can tell holes from data then describes the
+ * range read as a list of segments in info->io_segs, and their count in
+ * info->io_segcnt, with the data of all data segments packed one after
+ * the other at the start of buffer; read_amount is then the length of
+ * file covered, holes included.  It may stop short when it runs out of
+ * segments.  An FSAL that can't leaves io_segcnt at 0, and may instead
+ * describe a single segment in info->io_content, or return
+ * ERR_FSAL_NOTSUPP for the caller to do a plain read.
+ *
  * @param[in]     obj_hdl        File on which to operate
  * @param[in]     bypass         If state doesn't indicate a share reservation,
  *                               bypass any deny read
@@ -2722,6 +2824,214 @@ struct fsal_obj_ops {
 	 fsal_status_t (*close2)(struct fsal_obj_handle *obj_hdl,
 				 struct state_t *state);
 
+/**
+ * @brief Read data from a file into a list of buffers
+ *
+ * This is the scatter variant of read2. The data are placed into the
+ * buffers described by iov in order, so the caller does not need one
+ * contiguous buffer for the whole read and the result can be handed
+ * to the XDR encoder segment by segment. The same share reservation
+ * and state rules as read2 apply. READ_PLUS still goes through read2.
+ *
+ * FSALs that don't implement this get a default that calls read2 once
+ * per segment.  Those that do report fso_readv, READ only reads into
+ * a scatter list for them.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position from which to read
+ * @param[in,out] iov            Buffers to which data are to be copied
+ * @param[in]     iovcnt         Number of entries in iov
+ * @param[out]    read_amount    Amount of data read
+ * @param[out]    end_of_file    true if the end of file has been reached
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*readv2)(struct fsal_obj_handle *obj_hdl,
+				 bool bypass,
+				 struct state_t *state,
+				 uint64_t offset,
+				 struct iovec *iov,
+				 int iovcnt,
+				 size_t *read_amount,
+				 bool *end_of_file);
+
+/**
+ * @brief Submit an asynchronous read
+ *
+ * Same semantics as readv2 but the result is delivered through
+ * done_cb, so an FSAL with a natively asynchronous backend need not
+ * block the calling thread.  The default implementation performs a
+ * readv2 and invokes the callback before returning.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in,out] io_arg         The I/O description and results
+ * @param[in]     done_cb        Callback to invoke on completion
+ * @param[in]     caller_arg     Opaque argument for done_cb
+ */
+	 void (*read2_async)(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct fsal_io_arg *io_arg,
+			     fsal_async_cb done_cb,
+			     void *caller_arg);
+
+/**
+ * @brief Submit an asynchronous write
+ *
+ * Same semantics as write2 on the buffers in io_arg, with the result
+ * delivered through done_cb.  The default implementation performs
+ * write2 on each buffer and invokes the callback before returning.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any non-mandatory deny write
+ * @param[in,out] io_arg         The I/O description and results
+ * @param[in]     done_cb        Callback to invoke on completion
+ * @param[in]     caller_arg     Opaque argument for done_cb
+ */
+	 void (*write2_async)(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct fsal_io_arg *io_arg,
+			      fsal_async_cb done_cb,
+			      void *caller_arg);
+
+/**
+ * @brief Look up several names in a directory
+ *
+ * Same semantics as lookup on each name.  The caller sets the
+ * request_mask of each attrs_out entry.  The default implementation
+ * calls lookup on each name.  An FSAL overriding it should set
+ * fso_bulk_ops.
+ *
+ * @param[in]     dir_hdl   Directory to search
+ * @param[in]     count     Number of names
+ * @param[in]     names     Names to look up
+ * @param[out]    handles   Objects found, NULL where status is an error
+ * @param[in,out] attrs_out Attributes of the objects found
+ * @param[out]    status    Status of each lookup
+ *
+ * @note Each handle found has been ref'd
+ *
+ * @return FSAL status, an error if no name was looked up at all.
+ */
+	 fsal_status_t (*lookup_bulk)(struct fsal_obj_handle *dir_hdl,
+				      uint32_t count,
+				      const char **names,
+				      struct fsal_obj_handle **handles,
+				      struct attrlist *attrs_out,
+				      fsal_status_t *status);
+
+/**
+ * @brief Copy a range of a file into another file
+ *
+ * The data is copied by the server, without going through the client.
+ * Fewer bytes than asked may be copied, as with write2; a copy ending
+ * at end of the source file is short.  The default implementation
+ * reads and writes through the server.
+ *
+ * @param[in]  src_hdl     File to copy from
+ * @param[in]  src_state   state_t to read with, may be NULL
+ * @param[in]  src_offset  Where to start reading
+ * @param[in]  dst_hdl     File to copy to, may be src_hdl
+ * @param[in]  dst_state   state_t to write with, may be NULL
+ * @param[in]  dst_offset  Where to start writing
+ * @param[in]  count       Bytes to copy
+ * @param[out] copied      Bytes copied
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*copy2)(struct fsal_obj_handle *src_hdl,
+				struct state_t *src_state,
+				uint64_t src_offset,
+				struct fsal_obj_handle *dst_hdl,
+				struct state_t *dst_state,
+				uint64_t dst_offset,
+				uint64_t count,
+				uint64_t *copied);
+
+/**
+ * @brief Share a range of a file with another file
+ *
+ * After a clone, the destination range reads as the source range did,
+ * sharing its blocks where the file system can.  All of the range is
+ * cloned or nothing is.  There is no default implementation.
+ *
+ * @param[in] src_hdl     File to clone from
+ * @param[in] src_state   state_t to read with, may be NULL
+ * @param[in] src_offset  Start of the source range
+ * @param[in] dst_hdl     File to clone to, may be src_hdl
+ * @param[in] dst_state   state_t to write with, may be NULL
+ * @param[in] dst_offset  Start of the destination range
+ * @param[in] count       Length of the range, 0 for up to end of file
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*clone2)(struct fsal_obj_handle *src_hdl,
+				 struct state_t *src_state,
+				 uint64_t src_offset,
+				 struct fsal_obj_handle *dst_hdl,
+				 struct state_t *dst_state,
+				 uint64_t dst_offset,
+				 uint64_t count);
+
+/**
+ * @brief List the names in a directory
+ *
+ * Like readdir, but only the name, fileid and type of each entry are
+ * passed to the callback, which an FSAL keeping them can do without
+ * instantiating the entries.  There is no default implementation,
+ * callers fall back to readdir on ERR_FSAL_NOTSUPP.
+ *
+ * @param[in]  dir_hdl   Directory to read
+ * @param[in]  whence    Point at which to start reading.  NULL to
+ *                       start at beginning.
+ * @param[in]  dir_state Opaque pointer to be passed to callback
+ * @param[in]  cb        Callback to receive names
+ * @param[out] eof       true if the last entry was reached
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*readdir_names)(struct fsal_obj_handle *dir_hdl,
+					fsal_cookie_t *whence,
+					void *dir_state,
+					fsal_readdir_names_cb cb,
+					bool *eof);
+
+/**
+ * @brief Get a file descriptor to read a range of a file from
+ *
+ * For an FSAL whose files are local files, instead of reading the
+ * data: the caller reads it from the descriptor later, when it has
+ * somewhere to put it.  The checks are those of read2, and the range
+ * is clipped at end of file.  There is no default implementation,
+ * callers fall back to readv2 on ERR_FSAL_NOTSUPP.
+ *
+ * @param[in]  obj_hdl      File on which to operate
+ * @param[in]  bypass       If state doesn't indicate a share reservation,
+ *                          bypass any deny read
+ * @param[in]  state        state_t to use for this operation
+ * @param[in]  offset       Position from which to read
+ * @param[in]  size         Amount of data to read
+ * @param[out] fd           A descriptor the caller must close, -1 if
+ *                          there is no data in the range
+ * @param[out] read_amount  Amount of data that can be read from fd
+ * @param[out] end_of_file  true if the range reaches the end of file
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*read_fd)(struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  struct state_t *state,
+				  uint64_t offset,
+				  size_t size,
+				  int *fd,
+				  size_t *read_amount,
+				  bool *end_of_file);
+
 /**@}*/
 };
 
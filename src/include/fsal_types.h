@@ -201,11 +201,16 @@ typedef struct fsal_ace__ {
 	} who;
 } fsal_ace_t;
 
+struct fsal_acl_access;
+
 typedef struct fsal_acl__ {
 	uint32_t naces;
 	fsal_ace_t *aces;
 	pthread_rwlock_t lock;
 	uint32_t ref;
+	pthread_mutex_t access_mtx;	/*< Protects access */
+	struct fsal_acl_access *access;	/*< Results of access checks,
+					    see access_check.c */
 } fsal_acl_t;
 
 typedef struct fsal_acl_data__ {
@@ -642,6 +647,10 @@ typedef enum enum_fsal_fsinfo_options {
 	fso_rename_changes_key,
 	fso_compute_readdir_cookie,
 	fso_whence_is_name,
+	fso_bulk_ops,
+	fso_up_invalidate,
+	fso_lock_avail_upcall,
+	fso_readv,
 } fsal_fsinfo_options_t;
 
 /* The largest maxread and maxwrite value */
@@ -695,6 +704,12 @@ typedef struct fsal_staticfsinfo_t {
 	bool rename_changes_key;/*< Handle key is changed across rename */
 	bool compute_readdir_cookie;
 	bool whence_is_name;
+	bool bulk_ops;		/*< getattrs_bulk and lookup_bulk are native */
+	bool up_invalidate;	/*< Every change is reported by an upcall */
+	bool lock_avail_upcall;	/*< Sends lock_avail for locks that
+				    would block, without blocking */
+	bool readv;		/*< readv2 is native, not one read2 per
+				    segment */
 } fsal_staticfsinfo_t;
 
 /**
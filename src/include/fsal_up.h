@@ -259,6 +259,18 @@ struct fsal_up_vector {
 	fsal_status_t (*invalidate_close)(const struct fsal_up_vector *vec,
 					  struct gsh_buffdesc *obj,
 					  uint32_t flags);
+
+	/** A quota changed, outside of SETQUOTA through this server
+	 *
+	 * @param[in] vec	 Up ops vector
+	 * @param[in] quota_type USRQUOTA or GRPQUOTA
+	 * @param[in] quota_id	 User or group, -1 for all of them
+	 *
+	 * @return FSAL status
+	 *
+	 */
+	fsal_status_t (*quota_changed)(const struct fsal_up_vector *vec,
+				       int quota_type, int quota_id);
 };
 
 extern struct fsal_up_vector fsal_up_top;
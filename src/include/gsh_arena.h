@@ -0,0 +1,94 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_arena.h
+ * @brief Bump allocator for memory that is freed all at once
+ *
+ * Allocations are carved one after the other out of chunks, and are
+ * never freed on their own; gsh_arena_release frees them all.  A
+ * zeroed struct gsh_arena is an empty arena.  An arena is not thread
+ * safe.
+ */
+
+#ifndef GSH_ARENA_H
+#define GSH_ARENA_H
+
+#include <stddef.h>
+#include <string.h>
+
+/** Alignment of all allocations */
+#define GSH_ARENA_ALIGN 8
+
+struct gsh_arena_chunk {
+	struct gsh_arena_chunk *next;	/*< Chunk allocated before */
+	size_t size;			/*< Bytes in data */
+	size_t used;			/*< Bytes handed out */
+	char data[];
+};
+
+struct gsh_arena {
+	struct gsh_arena_chunk *chunk;	/*< Chunk allocations come from */
+};
+
+void *gsh_arena_alloc_chunk(struct gsh_arena *arena, size_t size);
+void gsh_arena_release(struct gsh_arena *arena);
+
+/**
+ * @brief Allocate memory from an arena
+ *
+ * Like gsh_malloc, this never returns NULL.
+ *
+ * @param[in,out] arena  The arena
+ * @param[in]     size   Bytes to allocate
+ *
+ * @return The memory, aligned on GSH_ARENA_ALIGN.
+ */
+static inline void *gsh_arena_alloc(struct gsh_arena *arena, size_t size)
+{
+	struct gsh_arena_chunk *chunk = arena->chunk;
+	void *p;
+
+	size = (size + GSH_ARENA_ALIGN - 1) & ~(size_t)(GSH_ARENA_ALIGN - 1);
+
+	if (chunk == NULL || chunk->size - chunk->used < size)
+		return gsh_arena_alloc_chunk(arena, size);
+
+	p = chunk->data + chunk->used;
+	chunk->used += size;
+
+	return p;
+}
+
+/**
+ * @brief Allocate zeroed memory from an arena
+ */
+static inline void *gsh_arena_calloc(struct gsh_arena *arena, size_t n,
+				     size_t size)
+{
+	void *p = gsh_arena_alloc(arena, n * size);
+
+	memset(p, 0, n * size);
+
+	return p;
+}
+
+#endif /* GSH_ARENA_H */
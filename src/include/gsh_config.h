@@ -83,6 +83,11 @@ typedef enum protos {
  */
 #define NB_WORKER_THREAD_DEFAULT 256
 
+/**
+ * @brief Default value for core_param.nb_ioc_worker
+ */
+#define NB_IOC_WORKER_THREAD_DEFAULT 16
+
 /**
  * @brief Default value for core_param.drc.tcp.npart
  */
@@ -103,6 +108,11 @@ typedef enum protos {
  */
 #define DRC_TCP_HIWAT 64	/* 1/2(size) */
 
+/**
+ * @brief Default value for core_param.drc.tcp.min_hiwat
+ */
+#define DRC_TCP_MIN_HIWAT 8
+
 /**
  * @brief Default value for core_param.drc.tcp.recycle_npart
  */
@@ -158,6 +168,19 @@ typedef enum protos {
  */
 #define NFS_DEFAULT_RECV_BUFFER_SIZE 1048576
 
+/**
+ * Default value for core_param.rpc.vsock_send_buffer_size and
+ * vsock_recv_buffer_size.  Guests on the same host can move far more
+ * per record than a network peer.
+ */
+#define NFS_DEFAULT_VSOCK_BUFFER_SIZE 4194304
+
+/**
+ * Default value for core_param.rpc.vsock_transport_buffer_size, the
+ * AF_VSOCK socket buffer (the kernel default is 256KiB).
+ */
+#define NFS_DEFAULT_VSOCK_TRANSPORT_BUFFER_SIZE 4194304
+
 /**
  * @brief Support NFSv3
  */
@@ -206,8 +229,59 @@ typedef struct nfs_core_param {
 	    worthwhile option to have. */
 	uint32_t program[P_COUNT];
 	/** Number of worker threads.  Set to NB_WORKER_DEFAULT by
-	    default and changed with the Nb_Worker option. */
+	    default and changed with the Nb_Worker option.  With
+	    Worker_Autoscale, the most worker threads to run. */
 	uint32_t nb_worker;
+	/** Whether to size the worker pool by queue wait time, between
+	    Nb_Worker_Min and Nb_Worker threads.  Defaults to false and
+	    settable with Worker_Autoscale. */
+	bool worker_autoscale;
+	/** Fewest worker threads to keep with Worker_Autoscale.
+	    Defaults to 16 and settable with Nb_Worker_Min. */
+	uint32_t nb_worker_min;
+	/** Queue wait, in microseconds, above which the worker pool
+	    grows.  It shrinks only once the wait is below half of this.
+	    Defaults to 1000 and settable with
+	    Worker_Target_Queue_Wait. */
+	uint32_t worker_target_queue_wait;
+	/** Seconds a worker thread must have found no work before it
+	    may exit.  Defaults to 60 and settable with
+	    Worker_Idle_Timeout. */
+	uint32_t worker_idle_timeout;
+	/** Queue wait, in microseconds, above which overload control
+	    sheds READ, WRITE, COMMIT and READDIR requests.  Defaults to
+	    0, off, and settable with Overload_Target_Delay. */
+	uint32_t overload_target_delay;
+	/** Microseconds the queue wait must stay above
+	    Overload_Target_Delay before requests are shed.  Defaults to
+	    100000 and settable with Overload_Interval. */
+	uint32_t overload_interval;
+	/** Whether to pin workers and decoders to NUMA nodes and decode
+	    each connection on the node that receives it.  Defaults to
+	    false and settable with Thread_Affinity. */
+	bool thread_affinity;
+	/** Microseconds a worker spins for a request before it sleeps.
+	    Defaults to 0 and settable with Worker_Spin_Usec. */
+	uint32_t worker_spin_usec;
+	/** SO_BUSY_POLL for the service sockets, in microseconds.
+	    Defaults to 0 and settable with Busy_Poll_Usec. */
+	uint32_t busy_poll_usec;
+	/** Seconds between memory pressure samples, 0 to not watch
+	    memory pressure.  Defaults to 0 and settable with
+	    Mem_Pressure_Interval. */
+	uint32_t mem_pressure_interval;
+	/** PSI "some" avg10 stall percentage at which caches start to
+	    shrink.  Defaults to 10 and settable with
+	    Mem_Pressure_PSI_Threshold. */
+	uint32_t mem_pressure_psi_threshold;
+	/** Percentage of the cgroup memory limit at which caches start
+	    to shrink.  Defaults to 90 and settable with
+	    Mem_Pressure_Cgroup_Percent. */
+	uint32_t mem_pressure_cgroup_percent;
+	/** Percentage of its entries a cache frees per sample at full
+	    pressure.  Defaults to 10 and settable with
+	    Mem_Pressure_Max_Shrink. */
+	uint32_t mem_pressure_max_shrink;
 	/** For NFSv3, whether to drop rather than reply to requests
 	    yielding I/O errors.  True by default and settable with
 	    Drop_IO_Errors.  As this generally results in client
@@ -232,6 +306,56 @@ typedef struct nfs_core_param {
 	    specific transport.  Defaults to 512 and settable by
 	    Dispatch_Max_Reqs_Xprt. */
 	uint32_t dispatch_max_reqs_xprt;
+	/** Number of request queue sets the dispatcher spreads requests
+	    over.  Decoders queue to and workers dequeue from the set of
+	    the CPU they run on, idle workers steal from other sets.
+	    Defaults to 0, meaning one set per CPU, and settable by
+	    Dispatch_Queue_Shards. */
+	uint32_t dispatch_queue_shards;
+	/** Whether high latency requests arriving on connections are
+	    scheduled round robin between clients, each client getting
+	    as many requests per round as its weight.  Defaults to false
+	    and settable by Fair_Share_Scheduling. */
+	bool fair_share;
+	/** Number of requests one client may have in the dispatcher
+	    across all its connections before they are stalled.
+	    Defaults to 0, no limit, and settable by
+	    Dispatch_Max_Reqs_Client. */
+	uint32_t dispatch_max_reqs_client;
+	/** Requests per second one client may have taken off the queues
+	    by workers.  Defaults to 0, no limit, and settable by
+	    Client_Ops_Limit. */
+	uint64_t client_ops_limit;
+	/** READ and WRITE bytes per second one client may have taken
+	    off the queues by workers.  Defaults to 0, no limit, and
+	    settable by Client_Bytes_Limit. */
+	uint64_t client_bytes_limit;
+	/** Bytes of READ buffers allocated and faulted in at startup.
+	    Defaults to 0, none, and settable by Read_Buffer_Pool_Size. */
+	uint64_t read_buffer_pool_size;
+	/** READs of at least this many bytes are read from the file
+	    straight into the reply as it is encoded.  Defaults to 0,
+	    never, and settable by Deferred_Read_Min. */
+	uint32_t deferred_read_min;
+	/** Slots of the NFSv3 READDIR reply cache.  Defaults to 0, no
+	    cache, and settable by Readdir_Cache_Size. */
+	uint32_t readdir_cache_size;
+	/** Parameters of the NFS/RDMA transport, when built with it. */
+	struct {
+		/** Port the NFS/RDMA listener binds to.  Defaults to
+		    20049 and settable by NFS_RDMA_Port. */
+		uint16_t port;
+		/** Credits granted to each NFS/RDMA client, that is the
+		    number of requests it may have outstanding.  Each is
+		    backed by a posted receive.  Defaults to 30 and settable
+		    by NFS_RDMA_Credits. */
+		uint32_t credits;
+		/** Size of the inline send and receive buffers.  Larger
+		    payloads go in RDMA read and write chunks placed
+		    directly in the request buffers.  Defaults to 4096 and
+		    settable by NFS_RDMA_Max_Inline. */
+		uint32_t max_inline;
+	} rdma;
 	/** Parameters controlling the Duplicate Request Cache.  */
 	struct {
 		/** Whether to disable the DRC entirely.  Defaults to
@@ -257,6 +381,22 @@ typedef struct nfs_core_param {
 			    we can.  Defaults to DRC_TCP_HIWAT and
 			    settable by DRC_TCP_Hiwat. */
 			uint32_t hiwat;
+			/** Whether each TCP DRC sizes its high water
+			    mark from the retransmissions and
+			    outstanding requests of its client.
+			    Defaults to false and settable by
+			    DRC_TCP_Adaptive. */
+			bool adaptive;
+			/** Lowest high water mark of an adaptive TCP
+			    DRC.  Defaults to DRC_TCP_MIN_HIWAT and
+			    settable by DRC_TCP_Min_Hiwat. */
+			uint32_t min_hiwat;
+			/** Requests all the adaptive TCP DRCs
+			    together may hold before they stop growing
+			    and shrink to their minimum, 0 for no
+			    limit.  Defaults to 0 and settable by
+			    DRC_TCP_Budget. */
+			uint32_t budget;
 			/** Number of partitions in the recycle
 			    tree that holds per-connection DRCs so
 			    they can be used on reconnection (or
@@ -321,6 +461,20 @@ typedef struct nfs_core_param {
 		    NFS_DEFAULT_RECV_BUFFER_SIZE and is settable by
 		    MaxRPCRecvBufferSize. */
 		uint32_t max_recv_buffer_size;
+		/** Size of RPC send buffer for AF_VSOCK connections.
+		    Defaults to NFS_DEFAULT_VSOCK_BUFFER_SIZE and is
+		    settable by VSOCK_RPC_Send_Buffer_Size. */
+		uint32_t vsock_send_buffer_size;
+		/** Size of RPC receive buffer for AF_VSOCK connections.
+		    Defaults to NFS_DEFAULT_VSOCK_BUFFER_SIZE and is
+		    settable by VSOCK_RPC_Recv_Buffer_Size. */
+		uint32_t vsock_recv_buffer_size;
+		/** AF_VSOCK socket buffer size, inherited by accepted
+		    connections.  Defaults to
+		    NFS_DEFAULT_VSOCK_TRANSPORT_BUFFER_SIZE and is settable
+		    by VSOCK_Transport_Buffer_Size.  0 keeps the kernel
+		    default. */
+		uint32_t vsock_transport_buffer_size;
 		/** Idle timeout (seconds).  Defaults to 5m */
 		uint32_t idle_timeout_s;
 		/** TIRPC ioq max simultaneous io threads.  Defaults to
@@ -366,8 +520,41 @@ typedef struct nfs_core_param {
 	/** Whether to support the Remote Quota protocol.  Defaults
 	    to true and is settable with Enable_RQUOTA. */
 	bool enable_RQUOTA;
+	/** How long, in seconds, a GETQUOTA answer is reused.  0, the
+	    default, asks the FSAL every time.  Settable with
+	    RQUOTA_Cache_Expiration. */
+	uint32_t rquota_cache_expiration;
 	/** Whether to use fast stats.  Defaults to false. */
 	bool enable_FASTSTATS;
+	/** Whether to account the thread CPU time of requests by
+	    stage, protocol, operation and export.  Defaults to false
+	    and settable with Enable_CPU_Stats. */
+	bool enable_CPUSTATS;
+	/** Number of counter slabs each stats block is split into, so
+	    the CPUs record to their own.  Defaults to 0, meaning one per
+	    CPU up to 16, and settable by Stats_Shards. */
+	uint32_t stats_shards;
+	/** TCP port of the OpenMetrics endpoint, on Bind_addr.  Defaults
+	    to 0, meaning no endpoint, and settable by Metrics_Port. */
+	uint16_t metrics_port;
+	/** Number of hottest files and clients to track.  Defaults to
+	    0, meaning none, and settable by Top_K_Entries. */
+	uint32_t top_k_entries;
+	/** Seconds after which the hot file and client counts halve.
+	    Defaults to 60 and settable by Top_K_Half_Life. */
+	uint32_t top_k_half_life;
+	/** Name of the shared memory object the counters are published
+	    in, see gsh_stats_shm.h.  Defaults to NULL, meaning none, and
+	    settable by Stats_Shm_Name. */
+	char *stats_shm_name;
+	/** Milliseconds between two copies of the counters to shared
+	    memory.  Defaults to 1000 and settable by
+	    Stats_Shm_Interval. */
+	uint32_t stats_shm_interval;
+	/** Unix socket a new server takes the listening sockets over
+	    through.  Defaults to NULL, meaning no handoff, and settable
+	    by Handoff_Socket. */
+	char *handoff_socket;
 	/** Whether tcp sockets should use SO_KEEPALIVE */
 	bool enable_tcp_keepalive;
 	/** Maximum number of TCP probes before dropping the connection */
@@ -385,6 +572,17 @@ typedef struct nfs_core_param {
 	    calling getgroups() when "Manage_Gids = TRUE" is
 	    used in a export entry. */
 	time_t manage_gids_expiration;
+	/** How long past Manage_Gids_Expiration a group list is still
+	    used while it is refreshed in the background. */
+	time_t manage_gids_stale;
+	/** Users, or \@netgroups of users, whose group lists are
+	    fetched at startup. */
+	char *manage_gids_prefetch;
+	/** How long a host found in a netgroup is trusted to be in it. */
+	time_t netgroup_cache_expiration;
+	/** How long a host not found in a netgroup is trusted not to be
+	    in it. */
+	time_t netgroup_negative_expiration;
 	/** Path to the directory containing server specific
 	    modules.  In particular, this is where FSALs live. */
 	char *ganesha_modules_loc;
@@ -395,6 +593,20 @@ typedef struct nfs_core_param {
 	/** Whether to use Pseudo (true) or Path (false) for NFS v3 and 9P
 	    mounts. */
 	bool mount_path_pseudo;
+	/** Whether NFSv3 READ and WRITE use the asynchronous FSAL I/O
+	    methods and suspend the request while the I/O is in
+	    flight.  Defaults to false and settable with
+	    Enable_Async_IO. */
+	bool enable_async_io;
+	/** Maximum number of threads in the I/O completion stage that
+	    resumes requests suspended on asynchronous I/O.  Defaults
+	    to NB_IOC_WORKER_THREAD_DEFAULT and settable with
+	    Nb_IOC_Worker. */
+	uint32_t nb_ioc_worker;
+	/** Number of threads setting up exports at startup, 1 sets them
+	    up one at a time.  Defaults to 1 and settable with
+	    Export_Init_Threads. */
+	uint32_t export_init_threads;
 } nfs_core_parameter_t;
 
 /** @} */
@@ -425,11 +637,49 @@ typedef struct nfs_core_param {
  */
 #define IDMAPCONF_DEFAULT "/etc/idmapd.conf"
 
+/**
+ * @brief Default value of idmap_cache_expiration.
+ */
+#define IDMAP_CACHE_EXPIRATION_DEFAULT 900
+
+/**
+ * @brief Default value of idmap_negative_expiration.
+ */
+#define IDMAP_NEGATIVE_EXPIRATION_DEFAULT 60
+
 /**
  * @brief Default value of deleg_recall_retry_delay.
  */
 #define DELEG_RECALL_RETRY_DELAY_DEFAULT 1
 
+/**
+ * @brief Default value of max_deleg_per_client.
+ */
+#define MAX_DELEG_PER_CLIENT_DEFAULT 4096
+
+/**
+ * @brief Default value of deleg_heat_half_life.
+ */
+#define DELEG_HEAT_HALF_LIFE_DEFAULT 60
+
+/**
+ * @brief Default value of deleg_opens_per_recall.
+ */
+#define DELEG_OPENS_PER_RECALL_DEFAULT 4
+
+/**
+ * @brief Default value of max_session_slots.
+ */
+#define MAX_SESSION_SLOTS_DEFAULT 64
+
+/**
+ * @brief Stable storage for the clients allowed to reclaim
+ */
+enum recovery_backend {
+	RECOVERY_BACKEND_FS,		/*< A directory per client */
+	RECOVERY_BACKEND_FS_LOG,	/*< An append-only log */
+};
+
 typedef struct nfs_version4_parameter {
 	/** Whether to disable the NFSv4 grace period.  Defaults to
 	    false and settable with Graceless. */
@@ -461,15 +711,59 @@ typedef struct nfs_version4_parameter {
 	    Only_Numeric_Owners. NB., this is permissible for a server
 	    implementation (RFC 5661). */
 	bool only_numeric_owners;
+	/** Seconds an id mapping stays in the cache, 0 for ever.
+	    Mappings still used near the end of it are refreshed in
+	    the background.  Defaults to IDMAP_CACHE_EXPIRATION_DEFAULT
+	    and settable with Idmap_Cache_Expiration. */
+	uint32_t idmap_cache_expiration;
+	/** Seconds a failed id mapping stays in the cache, 0 for
+	    ever.  Defaults to IDMAP_NEGATIVE_EXPIRATION_DEFAULT and
+	    settable with Idmap_Negative_Expiration. */
+	uint32_t idmap_negative_expiration;
 	/** Whether to allow delegations. Defaults to false and settable
 	    with Delegations */
 	bool allow_delegations;
+	/** Whether to allow directory delegations as well, recalled on
+	    any change to the directory.  Defaults to false and settable
+	    with Dir_Delegations */
+	bool allow_dir_delegations;
 	/** Delay after which server will retry a recall in case of failures */
 	uint32_t deleg_recall_retry_delay;
+	/** Most delegations a client may hold, 0 for no limit.  Defaults
+	    to MAX_DELEG_PER_CLIENT_DEFAULT and settable with
+	    Max_Deleg_Per_Client. */
+	uint32_t max_deleg_per_client;
+	/** Seconds for the open and recall rates of a file to lose half
+	    their weight.  Defaults to DELEG_HEAT_HALF_LIFE_DEFAULT and
+	    settable with Deleg_Heat_Half_Life. */
+	uint32_t deleg_heat_half_life;
+	/** Opens a file must see per recall, at those rates, to be
+	    delegated again, 0 to delegate regardless.  Defaults to
+	    DELEG_OPENS_PER_RECALL_DEFAULT and settable with
+	    Deleg_Opens_Per_Recall. */
+	uint32_t deleg_opens_per_recall;
+	/** Largest forechannel slot table granted to an NFSv4.1
+	    session.  Clients asking for fewer get what they ask for.
+	    Defaults to MAX_SESSION_SLOTS_DEFAULT and settable with
+	    Max_Session_Slots. */
+	uint32_t max_session_slots;
+	/** Sessions created per second at most, others are asked to
+	    retry.  Defaults to 0, meaning no limit, and settable with
+	    Max_Session_Create_Rate. */
+	uint32_t max_session_create_rate;
 	/** Whether this a pNFS MDS server. Defaults to false */
 	bool pnfs_mds;
 	/** Whether this a pNFS DS server. Defaults to false */
 	bool pnfs_ds;
+	/** Where clients allowed to reclaim after a restart are kept,
+	    an enum recovery_backend.  Defaults to RECOVERY_BACKEND_FS
+	    and settable with RecoveryBackend. */
+	uint32_t recovery_backend;
+	/** Directory, shared by the heads serving the same exports, in
+	    which each head in grace keeps a file.  Defaults to NULL,
+	    meaning grace is not shared, and settable with
+	    Cluster_Grace_Dir. */
+	char *cluster_grace_dir;
 } nfs_version4_parameter_t;
 
 /** @} */
@@ -484,6 +778,11 @@ typedef struct nfs_param {
 	/** kerberos configuration.  Settable in the NFS_KRB5 stanza. */
 	nfs_krb5_parameter_t krb5_param;
 #endif				/* _HAVE_GSSAPI */
+#ifdef USE_TLS
+	/** RPC-with-TLS configuration.  Settable in the NFS_TLS
+	    stanza. */
+	nfs_tls_parameter_t tls_param;
+#endif				/* USE_TLS */
 } nfs_parameter_t;
 
 extern nfs_parameter_t nfs_param;
@@ -0,0 +1,48 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_crc32c.h
+ * @brief CRC32C (Castagnoli) checksum
+ *
+ * Uses the SSE4.2 crc32 instruction on x86_64 when the CPU has it,
+ * the ARMv8 crc32c instructions when built for them, and a table
+ * otherwise.  The choice is made once, at the first call.
+ */
+
+#ifndef GSH_CRC32C_H
+#define GSH_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Extend a CRC32C over a buffer
+ *
+ * @param[in] crc  CRC of the preceding data, or a seed
+ * @param[in] buf  Data
+ * @param[in] len  Length of data
+ *
+ * @return The updated CRC.
+ */
+uint32_t gsh_crc32c(uint32_t crc, const void *buf, size_t len);
+
+#endif				/* GSH_CRC32C_H */
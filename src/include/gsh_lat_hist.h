@@ -0,0 +1,88 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_lat_hist.h
+ * @brief Latency histograms
+ *
+ * Log-linear, in the manner of HdrHistogram: each power of two from
+ * LAT_HIST_MIN_SHIFT up is split in LAT_HIST_SUB linear buckets, so a
+ * bucket is never wider than 1/LAT_HIST_SUB of its lower bound.
+ * Bucket 0 holds everything below 2^LAT_HIST_MIN_SHIFT ns (~1us), the
+ * last one everything from 2^LAT_HIST_MAX_SHIFT ns (~69s) up.
+ */
+
+#ifndef GSH_LAT_HIST_H
+#define GSH_LAT_HIST_H
+
+#include <stdint.h>
+#include "gsh_types.h"
+#include "abstract_atomic.h"
+
+#define LAT_HIST_MIN_SHIFT 10
+#define LAT_HIST_MAX_SHIFT 36
+#define LAT_HIST_SUB_BITS 2
+#define LAT_HIST_SUB (1 << LAT_HIST_SUB_BITS)
+#define LAT_HIST_BUCKETS \
+	((LAT_HIST_MAX_SHIFT - LAT_HIST_MIN_SHIFT) * LAT_HIST_SUB + 2)
+
+struct lat_hist {
+	uint64_t bucket[LAT_HIST_BUCKETS];
+};
+
+static inline uint32_t lat_hist_index(nsecs_elapsed_t t)
+{
+	uint32_t msb;
+
+	if (t < (1ULL << LAT_HIST_MIN_SHIFT))
+		return 0;
+
+	msb = 63 - __builtin_clzll(t);
+	if (msb >= LAT_HIST_MAX_SHIFT)
+		return LAT_HIST_BUCKETS - 1;
+
+	return 1 + (msb - LAT_HIST_MIN_SHIFT) * LAT_HIST_SUB
+		 + ((t >> (msb - LAT_HIST_SUB_BITS)) & (LAT_HIST_SUB - 1));
+}
+
+/* Exclusive upper bound of a bucket, in ns */
+static inline uint64_t lat_hist_bound(uint32_t i)
+{
+	uint32_t msb;
+	uint64_t width;
+
+	if (i == 0)
+		return 1ULL << LAT_HIST_MIN_SHIFT;
+	if (i == LAT_HIST_BUCKETS - 1)
+		return UINT64_MAX;
+
+	msb = (i - 1) / LAT_HIST_SUB + LAT_HIST_MIN_SHIFT;
+	width = 1ULL << (msb - LAT_HIST_SUB_BITS);
+
+	return (1ULL << msb) + ((i - 1) % LAT_HIST_SUB + 1) * width;
+}
+
+static inline void lat_hist_record(struct lat_hist *h, nsecs_elapsed_t t)
+{
+	(void)atomic_inc_uint64_t(&h->bucket[lat_hist_index(t)]);
+}
+
+#endif				/* GSH_LAT_HIST_H */
@@ -239,6 +239,11 @@ static inline size_t glist_length(struct glist_head *head)
 	((node)->next != (head) ? \
 	container_of((node)->next, type, member) : NULL)
 
+/* Return the previous entry in the list before node if any. */
+#define glist_prev_entry(head, type, member, node) \
+	((node)->prev != (head) ? \
+	container_of((node)->prev, type, member) : NULL)
+
 static inline void glist_insert_sorted(struct glist_head *head,
 				       struct glist_head *elt,
 				       glist_compare compare)
@@ -0,0 +1,87 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_lock_prof.h
+ * @brief Lock contention profiling
+ *
+ * Built with ENABLE_LOCK_PROFILE, the PTHREAD_MUTEX_lock and
+ * PTHREAD_RWLOCK_* lock wrappers try the lock first.  Only when that
+ * fails is the site, the file and line of the wrapper, accounted: the
+ * contention is counted, and one in LOCK_PROF_SAMPLE is timed.  An
+ * uncontended lock costs no more than without the profiler.
+ *
+ * A site is a static of the wrapper's expansion, linked to the list of
+ * sites the first time it is contended, and never unlinked.
+ */
+
+#ifndef GSH_LOCK_PROF_H
+#define GSH_LOCK_PROF_H
+
+#include <errno.h>
+#include <stdint.h>
+#include "gsh_types.h"
+
+/** One in this many contentions of a site is timed */
+#define LOCK_PROF_SAMPLE 8
+
+struct lock_prof_site {
+	const char *file;
+	int line;
+	const char *name;	/*< The lock, as written at the site */
+	uint64_t contended;	/*< Times the lock was found held */
+	uint64_t sampled;	/*< Of those, times the wait was timed */
+	uint64_t wait_ns;	/*< Total of the timed waits */
+	uint64_t max_ns;	/*< Longest timed wait */
+	struct lock_prof_site *next;
+	uint32_t linked;
+};
+
+nsecs_elapsed_t lock_prof_begin(struct lock_prof_site *site);
+void lock_prof_end(struct lock_prof_site *site, nsecs_elapsed_t start);
+void lock_prof_reset(void);
+
+/**
+ * @brief Take a lock, accounting any contention to the site
+ *
+ * @param[out] _rc   Result of the lock call
+ * @param[in]  _try  The trylock call
+ * @param[in]  _call The blocking lock call
+ * @param[in]  _name The lock, as a string
+ */
+#define LOCK_PROF_LOCK(_rc, _try, _call, _name)				\
+	do {								\
+		static struct lock_prof_site __lp_site = {		\
+			.file = __FILE__,				\
+			.line = __LINE__,				\
+			.name = _name,					\
+		};							\
+		nsecs_elapsed_t __lp_start;				\
+									\
+		_rc = _try;						\
+		if (_rc == EBUSY) {					\
+			__lp_start = lock_prof_begin(&__lp_site);	\
+			_rc = _call;					\
+			lock_prof_end(&__lp_site, __lp_start);		\
+		}							\
+	} while (0)
+
+#endif				/* GSH_LOCK_PROF_H */
@@ -289,6 +289,50 @@ TRACEPOINT_LOGLEVEL(
 	mdc_readdir,
 	TRACE_INFO)
 
+/**
+ * @brief Trace a call into the FSAL below MDCACHE
+ *
+ * @param[in] function	MDCACHE method making the call
+ * @param[in] xid	RPC transaction id of the request, 0 if none
+ */
+TRACEPOINT_EVENT(
+	mdcache,
+	fsal_start,
+	TP_ARGS(const char *, function,
+		uint32_t, xid),
+	TP_FIELDS(
+		ctf_string(function, function)
+		ctf_integer_hex(uint32_t, xid, xid)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	mdcache,
+	fsal_start,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the return from the FSAL below MDCACHE
+ *
+ * @param[in] function	MDCACHE method making the call
+ * @param[in] xid	RPC transaction id of the request, 0 if none
+ */
+TRACEPOINT_EVENT(
+	mdcache,
+	fsal_end,
+	TP_ARGS(const char *, function,
+		uint32_t, xid),
+	TP_FIELDS(
+		ctf_string(function, function)
+		ctf_integer_hex(uint32_t, xid, xid)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	mdcache,
+	fsal_end,
+	TRACE_INFO)
+
 #endif /* GANESHA_LTTNG_MDCACHE_TP_H */
 
 #undef TRACEPOINT_INCLUDE
@@ -7,6 +7,194 @@
 
 #include <lttng/tracepoint.h>
 
+/**
+ * @brief Trace the start of argument decoding
+ *
+ * A request span runs from decode_start to reply_end, all its events
+ * carry the xid and the address of the request.
+ *
+ * @param req   - the request being decoded
+ * @param xid   - RPC transaction id
+ * @param prog  - RPC program
+ * @param vers  - program version
+ * @param proc  - procedure
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	decode_start,
+	TP_ARGS(request_data_t *, req,
+		uint32_t, xid,
+		uint32_t, prog,
+		uint32_t, vers,
+		uint32_t, proc),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer_hex(uint32_t, xid, xid)
+		ctf_integer(uint32_t, prog, prog)
+		ctf_integer(uint32_t, vers, vers)
+		ctf_integer(uint32_t, proc, proc)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	decode_start,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the end of argument decoding
+ *
+ * @param req - the request
+ * @param xid - RPC transaction id
+ * @param ok  - whether the arguments decoded
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	decode_end,
+	TP_ARGS(request_data_t *, req,
+		uint32_t, xid,
+		int, ok),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer_hex(uint32_t, xid, xid)
+		ctf_integer(int, ok, ok)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	decode_end,
+	TRACE_INFO)
+
+/**
+ * @brief Trace a request put on a worker queue
+ *
+ * @param req - the request
+ * @param xid - RPC transaction id
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	enqueue,
+	TP_ARGS(request_data_t *, req,
+		uint32_t, xid),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer_hex(uint32_t, xid, xid)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	enqueue,
+	TRACE_INFO)
+
+/**
+ * @brief Trace a request taken by a worker
+ *
+ * @param req  - the request
+ * @param xid  - RPC transaction id
+ * @param wait - nanoseconds spent in the queue
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	dequeue,
+	TP_ARGS(request_data_t *, req,
+		uint32_t, xid,
+		uint64_t, wait),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer_hex(uint32_t, xid, xid)
+		ctf_integer(uint64_t, wait, wait)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	dequeue,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the duplicate request cache lookup
+ *
+ * @param req    - the request
+ * @param xid    - RPC transaction id
+ * @param status - dupreq_status_t of nfs_dupreq_start
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	drc,
+	TP_ARGS(request_data_t *, req,
+		uint32_t, xid,
+		int, status),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer_hex(uint32_t, xid, xid)
+		ctf_integer(int, status, status)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	drc,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the start of encoding and sending a reply
+ *
+ * @param req - the request
+ * @param xid - RPC transaction id
+ * @param dup - whether the reply comes from the DRC
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	reply_start,
+	TP_ARGS(request_data_t *, req,
+		uint32_t, xid,
+		int, dup),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer_hex(uint32_t, xid, xid)
+		ctf_integer(int, dup, dup)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	reply_start,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the end of encoding and sending a reply
+ *
+ * @param req - the request
+ * @param xid - RPC transaction id
+ * @param ok  - whether the reply was sent
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	reply_end,
+	TP_ARGS(request_data_t *, req,
+		uint32_t, xid,
+		int, ok),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer_hex(uint32_t, xid, xid)
+		ctf_integer(int, ok, ok)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	reply_end,
+	TRACE_INFO)
+
 /**
  * @brief Trace the start of the rpc_execute function
  *
@@ -98,6 +286,7 @@ TRACEPOINT_LOGLEVEL(
 /**
  * @brief Trace the start of the NFSv4 op function
  *
+ * @param xid  - RPC transaction id of the compound
  * @param op_num  - Op number within compound
  * @param op_code  - Numerical opcode of op
  * @param op_name  - Text name of op
@@ -106,10 +295,12 @@ TRACEPOINT_LOGLEVEL(
 TRACEPOINT_EVENT(
 	nfs_rpc,
 	v4op_start,
-	TP_ARGS(int, op_num,
+	TP_ARGS(uint32_t, xid,
+		int, op_num,
 		int, op_code,
 		const char *, op_name),
 	TP_FIELDS(
+		ctf_integer_hex(uint32_t, xid, xid)
 		ctf_integer(int, op_num, op_num)
 		ctf_integer(int, op_code, op_code)
 		ctf_string(op_name, op_name)
@@ -126,21 +317,27 @@ TRACEPOINT_LOGLEVEL(
  *
  * The timestamp difference is the latency of the request
  *
+ * @param xid  - RPC transaction id of the compound
  * @param op_num  - Op number within compound
  * @param op_code  - Numerical opcode of op
  * @param op_name  - Text name of op
+ * @param status  - nfsstat4 result of the op
  */
 
 TRACEPOINT_EVENT(
 	nfs_rpc,
 	v4op_end,
-	TP_ARGS(int, op_num,
+	TP_ARGS(uint32_t, xid,
+		int, op_num,
 		int, op_code,
-		const char *, op_name),
+		const char *, op_name,
+		int, status),
 	TP_FIELDS(
+		ctf_integer_hex(uint32_t, xid, xid)
 		ctf_integer(int, op_num, op_num)
 		ctf_integer(int, op_code, op_code)
 		ctf_string(op_name, op_name)
+		ctf_integer(int, status, status)
 	)
 )
 
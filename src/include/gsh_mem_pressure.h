@@ -0,0 +1,74 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_mem_pressure.h
+ * @brief Shrink caches under system memory pressure
+ *
+ * A monitor thread samples Linux pressure stall information and the
+ * limits and events of our cgroup (v2).  When memory is short, every
+ * registered cache is asked to give back a share of its entries, so
+ * the server degrades by caching less instead of being OOM killed.
+ */
+
+#ifndef GSH_MEM_PRESSURE_H
+#define GSH_MEM_PRESSURE_H
+
+#include <stdint.h>
+
+/** Caches that can register a shrinker */
+#define MEM_PRESSURE_MAX_SHRINKERS 16
+
+/**
+ * @brief Give back memory
+ *
+ * Called from the monitor thread, must not block for long.
+ *
+ * @param[in] percent  Share of its entries the cache should free,
+ *                     1 to 100
+ */
+typedef void (*mem_pressure_shrink_t)(uint32_t percent);
+
+/**
+ * @brief Register a cache shrinker
+ *
+ * May be called before the monitor is started.
+ *
+ * @param[in] name    Name of the cache, for logging
+ * @param[in] shrink  Shrinker to call under pressure
+ */
+void mem_pressure_register(const char *name, mem_pressure_shrink_t shrink);
+
+/**
+ * @brief Start the monitor, if Mem_Pressure_Interval is set
+ *
+ * @return 0 on success, an error code otherwise.
+ */
+int mem_pressure_start(void);
+
+/**
+ * @brief Stop the monitor
+ *
+ * @return 0 on success, an error code otherwise.
+ */
+int mem_pressure_shutdown(void);
+
+#endif /* GSH_MEM_PRESSURE_H */
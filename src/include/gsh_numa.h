@@ -0,0 +1,67 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_numa.h
+ * @brief NUMA topology and thread placement
+ *
+ * The CPUs of each node are read from sysfs once, at startup, so no
+ * NUMA library is needed.  A system without the sysfs node directory
+ * is treated as a single node holding every CPU.
+ */
+
+#ifndef GSH_NUMA_H
+#define GSH_NUMA_H
+
+#include <stdint.h>
+
+/** Nodes that are told apart, higher nodes fold onto these */
+#define GSH_NUMA_MAX_NODES 64
+
+/**
+ * @brief Learn which CPUs belong to which node
+ */
+void gsh_numa_init(void);
+
+/**
+ * @brief Number of NUMA nodes
+ */
+uint32_t gsh_numa_nodes(void);
+
+/**
+ * @brief NUMA node of a CPU
+ *
+ * @param[in] cpu  The CPU, as from sched_getcpu()
+ *
+ * @return The node, 0 if the CPU is not known.
+ */
+uint32_t gsh_numa_cpu_node(int cpu);
+
+/**
+ * @brief Restrict the calling thread to the CPUs of a node
+ *
+ * @param[in] node  The node
+ *
+ * @return 0 on success, an errno otherwise.
+ */
+int gsh_numa_bind_node(uint32_t node);
+
+#endif				/* GSH_NUMA_H */
@@ -7,6 +7,7 @@
 #include "config.h"
 
 #include <stdbool.h>
+#include <sys/uio.h>
 
 /* Ganesha project has abstract_atomic.h file and tirpc also has a
  * similar header with the same name.  We want to include ganesha
@@ -56,6 +57,7 @@ struct nfs_request_lookahead {
 	uint32_t flags;
 	uint16_t read;
 	uint16_t write;
+	uint64_t io_bytes;	/*< Bytes asked for by READs and WRITEs */
 };
 
 #define NFS_LOOKAHEAD_HIGH_LATENCY(lkhd)		\
@@ -71,6 +73,63 @@ struct nfs_request_lookahead {
 #define XDR_BYTES_MAXLEN_IO (64*1024*1024)
 #define XDR_STRING_MAXLEN (8*1024)
 
+/**
+ * @brief Encode a variable length opaque held in a list of buffers
+ *
+ * Produces exactly the same wire format as xdr_bytes, but takes the
+ * data from the buffers in iov (in order) so I/O results never need
+ * to be gathered into one contiguous buffer first.  Only the first
+ * len bytes described by iov are sent.
+ *
+ * @param[in] xdrs   XDR stream, must be XDR_ENCODE
+ * @param[in] iov    Buffers holding the data
+ * @param[in] iovcnt Number of buffers in iov
+ * @param[in] len    Number of bytes to encode
+ *
+ * @return true on success.
+ */
+static inline bool xdr_opaque_iov(XDR *xdrs, struct iovec *iov, int iovcnt,
+				  u_int len)
+{
+	static char zeroes[BYTES_PER_XDR_UNIT];
+	u_int left = len;
+	u_int pad = (BYTES_PER_XDR_UNIT - (len % BYTES_PER_XDR_UNIT))
+		    % BYTES_PER_XDR_UNIT;
+	u_int seg;
+	int i;
+
+	if (xdrs->x_op != XDR_ENCODE)
+		return false;
+
+	if (!xdr_u_int(xdrs, &len))
+		return false;
+
+	for (i = 0; i < iovcnt && left > 0; i++) {
+		seg = iov[i].iov_len < left ? iov[i].iov_len : left;
+		if (!XDR_PUTBYTES(xdrs, iov[i].iov_base, seg))
+			return false;
+		left -= seg;
+	}
+
+	if (left != 0)
+		return false;
+
+	if (pad != 0 && !XDR_PUTBYTES(xdrs, zeroes, pad))
+		return false;
+
+	return true;
+}
+
+/**
+ * @brief Data of a READ reply left in the file until encoding
+ */
+struct nfs_read_fd {
+	int fd;			/*< Private descriptor of the file */
+	uint64_t offset;	/*< Where the data starts */
+};
+
+bool xdr_opaque_fd(XDR *xdrs, struct nfs_read_fd *rfd, u_int len);
+
 typedef struct sockaddr_storage sockaddr_t;
 
 #define SOCK_NAME_MAX 128
@@ -138,6 +197,46 @@ void log_sperror_gss(char *, OM_uint32, OM_uint32);
 const char *str_gc_proc(rpc_gss_proc_t);
 #endif /* _HAVE_GSSAPI */
 
+#ifdef USE_TLS
+/**
+ * @brief Default value for tls_param.handshake_timeout
+ */
+#define DEFAULT_TLS_HANDSHAKE_TIMEOUT 10
+
+/**
+ * @brief RPC-with-TLS (RFC 9289) parameters
+ */
+typedef struct nfs_tls_param {
+	/** Whether to accept RPC-with-TLS.  Defaults to false and
+	    settable with Active_TLS. */
+	bool active_tls;
+	/** PEM certificate chain of the server.  Settable with
+	    Certificate_File. */
+	char *cert_file;
+	/** PEM private key of the certificate.  Settable with
+	    Key_File. */
+	char *key_file;
+	/** PEM CA certificates client certificates must chain to.  If
+	    empty, clients need no certificate.  Settable with CA_File. */
+	char *ca_file;
+	/** Seconds a client has to complete the handshake.  Defaults
+	    to DEFAULT_TLS_HANDSHAKE_TIMEOUT and settable with
+	    Handshake_Timeout. */
+	uint32_t handshake_timeout;
+	/** Whether NFS requests are refused on connections without
+	    TLS.  Defaults to false and settable with Require_TLS. */
+	bool require_tls;
+} nfs_tls_parameter_t;
+
+#ifndef AUTH_TLS
+#define AUTH_TLS 7	/*< RFC 9289 probe flavor */
+#endif
+
+void nfs_rpc_tls_init(void);
+bool nfs_rpc_starttls(struct svc_req *req);
+bool nfs_rpc_xprt_tls(SVCXPRT *xprt);
+#endif /* USE_TLS */
+
 /* Private data associated with a new TI-RPC (TCP) SVCXPRT (transport
  * connection), ie, xprt->xp_u1.
  */
@@ -145,6 +244,7 @@ const char *str_gc_proc(rpc_gss_proc_t);
 /* uint16_t actually used */
 #define XPRT_PRIVATE_FLAG_DECODING 0x0008
 #define XPRT_PRIVATE_FLAG_STALLED 0x0010	/* ie, -on stallq- */
+#define XPRT_PRIVATE_FLAG_TLS 0x0020	/* records go through kernel TLS */
 
 /* uint32_t instructions */
 #define XPRT_PRIVATE_FLAG_LOCKED	SVC_XPRT_FLAG_LOCKED
@@ -152,9 +252,20 @@ const char *str_gc_proc(rpc_gss_proc_t);
 #define XPRT_PRIVATE_FLAG_INCREQ	0x00040000
 #define XPRT_PRIVATE_FLAG_DECREQ	0x00080000
 
+struct gsh_client;
+struct xprt_export_perms;
+struct xprt_session_cache;
+
 typedef struct gsh_xprt_private {
 	SVCXPRT *xprt;
 	struct glist_head stallq;
+	struct gsh_client *client;	/*< Peer of a connection, if tracked */
+	struct xprt_export_perms *export_perms; /*< Resolved export perms,
+						    connections only */
+	struct xprt_gss_creds *gss_creds; /*< Mapped GSS principals,
+					      connections only */
+	struct xprt_session_cache *sessions; /*< Last NFSv4.1 session,
+						 connections only */
 	uint16_t flags;
 } gsh_xprt_private_t;
 
@@ -165,6 +276,10 @@ static inline gsh_xprt_private_t *alloc_gsh_xprt_private(SVCXPRT *xprt,
 		gsh_malloc(sizeof(gsh_xprt_private_t));
 
 	xu->xprt = xprt;
+	xu->client = NULL;
+	xu->export_perms = NULL;
+	xu->gss_creds = NULL;
+	xu->sessions = NULL;
 	xu->flags = flags;
 
 	return xu;
@@ -0,0 +1,109 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_stats_shm.h
+ * @brief Layout of the shared-memory statistics segment
+ *
+ * With Stats_Shm_Name set, the server copies its counters every
+ * Stats_Shm_Interval milliseconds into the POSIX shared memory object
+ * of that name.  A monitoring agent maps it read-only and reads it
+ * without a system call, and without the server taking a lock for it.
+ *
+ * The copy is guarded by a sequence count, odd while the server
+ * writes.  A reader does:
+ *
+ *	do {
+ *		while ((seq = __atomic_load_n(&shm->seq,
+ *					      __ATOMIC_ACQUIRE)) & 1)
+ *			;
+ *		memcpy(&copy, shm, sizeof(copy));
+ *		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+ *	} while (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) != seq);
+ *
+ * and must check magic and version first.  Counters only grow, rates
+ * are the differences between two samples over updated_ns.  This file
+ * depends on nothing else so that agents can include it alone.
+ */
+
+#ifndef GSH_STATS_SHM_H
+#define GSH_STATS_SHM_H
+
+#include <stdint.h>
+
+#define GSH_STATS_SHM_MAGIC 0x47534853	/* "GSHS" */
+#define GSH_STATS_SHM_VERSION 1
+
+/** Latency histogram buckets, see gsh_lat_hist.h for their bounds */
+#define GSH_STATS_SHM_HIST 106
+/** Request classes, e.g. NFSv3 reads or NFSv4.1 compounds */
+#define GSH_STATS_SHM_CLASSES 20
+/** NFSv3 procedures, NULL to COMMIT */
+#define GSH_STATS_SHM_V3_OPS 22
+/** NFSv4 operations, indexed by operation number */
+#define GSH_STATS_SHM_V4_OPS 76
+/** Most exports published, the others are left out */
+#define GSH_STATS_SHM_EXPORTS 256
+
+/** Counters of a request class */
+struct gsh_stats_shm_counts {
+	char proto[12];		/*< e.g. "nfsv4.1" */
+	char kind[12];		/*< "all", "compound", "read" or "write" */
+	uint64_t total;		/*< requests */
+	uint64_t errors;	/*< requests that failed */
+	uint64_t dups;		/*< requests answered from the DRC */
+	uint64_t latency_ns;	/*< total time executing */
+	uint64_t queue_wait_ns;	/*< total time waiting for a worker */
+	uint64_t requested;	/*< bytes asked for, reads and writes */
+	uint64_t transferred;	/*< bytes read or written */
+};
+
+struct gsh_stats_shm_class {
+	struct gsh_stats_shm_counts c;
+	uint64_t hist[GSH_STATS_SHM_HIST];	/*< execution latency */
+};
+
+struct gsh_stats_shm_export {
+	uint16_t export_id;
+	uint16_t nclasses;
+	uint32_t pad;
+	struct gsh_stats_shm_counts classes[GSH_STATS_SHM_CLASSES];
+};
+
+struct gsh_stats_shm {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;		/*< sizeof(struct gsh_stats_shm) */
+	uint32_t hist_buckets;	/*< GSH_STATS_SHM_HIST */
+	uint64_t seq;		/*< odd while being written */
+	uint64_t updated_ns;	/*< CLOCK_REALTIME of the last copy */
+	uint64_t start_ns;	/*< CLOCK_REALTIME the server started */
+	uint32_t nclasses;	/*< valid entries of server[] */
+	uint32_t nexports;	/*< valid entries of exports[] */
+	struct gsh_stats_shm_class server[GSH_STATS_SHM_CLASSES];
+	uint64_t v3_ops[GSH_STATS_SHM_V3_OPS];
+	uint64_t v3_hist[GSH_STATS_SHM_V3_OPS][GSH_STATS_SHM_HIST];
+	uint64_t v4_ops[GSH_STATS_SHM_V4_OPS];
+	uint64_t v4_hist[GSH_STATS_SHM_V4_OPS][GSH_STATS_SHM_HIST];
+	struct gsh_stats_shm_export exports[GSH_STATS_SHM_EXPORTS];
+};
+
+#endif /* GSH_STATS_SHM_H */
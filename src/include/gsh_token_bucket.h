@@ -0,0 +1,94 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_token_bucket.h
+ * @brief Token buckets for rate limiting
+ *
+ * The bucket is kept as the time its tokens will be paid back
+ * (generic cell rate algorithm), which needs no refill step.  It holds
+ * at most one second worth of tokens, and the rate is given on each
+ * call so a change takes effect at once.  A charge may take the
+ * bucket into debt: a request larger than the burst still goes
+ * through once the bucket is out of debt, and is paid back before the
+ * next one.  A zeroed bucket is full.  A bucket is not thread safe.
+ */
+
+#ifndef GSH_TOKEN_BUCKET_H
+#define GSH_TOKEN_BUCKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gsh_types.h"
+
+/** Largest rate a bucket can account without overflow */
+#define GSH_TOKEN_BUCKET_MAX_RATE (UINT64_C(1) << 34)
+
+struct gsh_token_bucket {
+	nsecs_elapsed_t paid;	/*< When all charges are paid back */
+};
+
+/**
+ * @brief Time until the bucket allows a charge
+ *
+ * @param[in] tb     The bucket
+ * @param[in] rate   Tokens per second, 0 for unlimited
+ * @param[in] now_ns Current time
+ *
+ * @return Nanoseconds to wait, 0 if a charge may be made now.
+ */
+static inline nsecs_elapsed_t gsh_token_bucket_wait(
+					struct gsh_token_bucket *tb,
+					uint64_t rate,
+					nsecs_elapsed_t now_ns)
+{
+	if (rate == 0 || tb->paid <= now_ns)
+		return 0;
+
+	return tb->paid - now_ns;
+}
+
+/**
+ * @brief Charge a bucket
+ *
+ * @param[in,out] tb     The bucket
+ * @param[in]     rate   Tokens per second, 0 for unlimited
+ * @param[in]     amount Tokens to take
+ * @param[in]     now_ns Current time
+ */
+static inline void gsh_token_bucket_charge(struct gsh_token_bucket *tb,
+					   uint64_t rate, uint64_t amount,
+					   nsecs_elapsed_t now_ns)
+{
+	nsecs_elapsed_t full = now_ns > NS_PER_SEC ? now_ns - NS_PER_SEC : 0;
+
+	if (rate == 0)
+		return;
+
+	/* an idle bucket earns no more than one second of tokens */
+	if (tb->paid < full)
+		tb->paid = full;
+
+	tb->paid += amount / rate * NS_PER_SEC +
+		    amount % rate * NS_PER_SEC / rate;
+}
+
+#endif				/* GSH_TOKEN_BUCKET_H */
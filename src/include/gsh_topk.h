@@ -0,0 +1,83 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_topk.h
+ * @brief Hottest files and clients
+ *
+ * Operations and bytes are counted per file and per client in
+ * Count-Min sketches, a fixed number of counters however many keys
+ * there are.  A small table remembers the keys whose estimate is among
+ * the Top_K_Entries largest.  Counts halve every Top_K_Half_Life
+ * seconds, so the table follows the current load.
+ */
+
+#ifndef GSH_TOPK_H
+#define GSH_TOPK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Largest Top_K_Entries */
+#define TOPK_MAX_ENTRIES 256
+
+struct fsal_obj_handle;
+struct gsh_client;
+
+/**
+ * @brief Size the tables from Top_K_Entries
+ *
+ * Must be called before the first request is counted.
+ */
+void topk_init(void);
+
+/**
+ * @brief Count a read or write of a file
+ *
+ * @param[in] obj    The file, may be NULL
+ * @param[in] bytes  Bytes transferred
+ */
+void topk_file_io(struct fsal_obj_handle *obj, size_t bytes);
+
+/**
+ * @brief Count a request of a client
+ *
+ * @param[in] client The client, may be NULL
+ */
+void topk_client_op(struct gsh_client *client);
+
+/**
+ * @brief Count bytes transferred for a client
+ *
+ * @param[in] client The client, may be NULL
+ * @param[in] bytes  Bytes transferred
+ */
+void topk_client_io(struct gsh_client *client, size_t bytes);
+
+#ifdef USE_DBUS
+#include <dbus/dbus.h>
+
+void topk_dbus_files(DBusMessageIter *iter, bool by_bytes);
+void topk_dbus_clients(DBusMessageIter *iter, bool by_bytes);
+#endif
+
+#endif /* GSH_TOPK_H */
@@ -77,6 +77,32 @@ typedef int (*val_display_function_t)(struct gsh_buffdesc *, char *);
 #define HT_FLAG_NONE 0x0000	/*< Null hash table flags */
 #define HT_FLAG_CACHE 0x0001	/*< Indicates that caching should be
 				   enabled */
+#define HT_FLAG_RCU 0x0002	/*< Read-only lookups take no lock.
+				   Writers still serialize on the
+				   partition lock and wait for readers
+				   to drain before freeing anything, so
+				   a get_ref callback or the code
+				   between hashtable_getlatch and
+				   hashtable_releaselatched must not
+				   block. */
+#define HT_FLAG_OPEN 0x0004	/*< Partitions are open addressed
+				   arrays instead of red-black trees.
+				   The entry cache is not used and the
+				   partitions cannot be walked through
+				   their rbt head. */
+#define HT_FLAG_GROW 0x0008	/*< Partitions split one at a time as
+				   the table fills, so index_size is
+				   only the starting count.  Ignored
+				   with HT_FLAG_OPEN, whose partitions
+				   grow on their own.  Partitions
+				   added by a split have no entry
+				   cache.  Walk such a table with
+				   hashtable_walk_begin. */
+
+/**
+ * @brief Times a growing table may double its partition count
+ */
+#define HT_GROW_MAX_LEVELS 8
 
 /**
  * @brief Hash parameters
@@ -137,6 +163,9 @@ typedef struct hash_stat {
 				       the rbt used. */
 } hash_stat_t;
 
+/* Open addressed partition storage, private to hashtable.c */
+struct hash_open_tab;
+
 /**
  * @brief Represents an individual partition
  *
@@ -148,7 +177,10 @@ struct hash_partition {
 	size_t count; /*< Numer of entries in this partition */
 	struct rbt_head rbt; /*< The red-black tree */
 	pthread_rwlock_t lock; /*< Lock for this partition */
+	uint32_t seq; /*< Bumped around every tree change, odd while a
+			  writer is changing the tree (HT_FLAG_RCU) */
 	struct rbt_node **cache; /*< Expected entry cache */
+	struct hash_open_tab *open; /*< Slot array (HT_FLAG_OPEN) */
 };
 
 /**
@@ -162,11 +194,43 @@ typedef struct hash_table {
 					 HashTable */
 	pool_t *node_pool; /*< Pool of RBT nodes */
 	pool_t *data_pool; /*< Pool of buffer pairs */
+	uint64_t geometry; /*< Doublings done in the upper half, next
+			       partition to split in the lower half
+			       (HT_FLAG_GROW) */
+	pthread_mutex_t grow_mtx; /*< Held by a split and by walks */
+	struct hash_partition *segments[HT_GROW_MAX_LEVELS + 1];
+				/*< Partitions added by splits, segment k
+				    holds index_size << (k - 1) of them */
 	struct hash_partition partitions[]; /*< Parameter.index_size
 						partitions of the hash
 						table. */
 } hash_table_t;
 
+/**
+ * @brief Find a partition by number
+ *
+ * Numbers past index_size only exist in tables created with
+ * HT_FLAG_GROW.
+ *
+ * @param[in] ht    The hash table
+ * @param[in] index Partition number
+ *
+ * @return The partition.
+ */
+static inline struct hash_partition *
+hashtable_partition(struct hash_table *ht, uint32_t index)
+{
+	uint32_t size = ht->parameter.index_size;
+	uint32_t seg;
+
+	if (index < size)
+		return &ht->partitions[index];
+
+	seg = 32 - __builtin_clz(index / size);
+
+	return &ht->segments[seg][index - (size << (seg - 1))];
+}
+
 /**
  * @brief A 'latching' lock
  *
@@ -178,6 +242,13 @@ struct hash_latch {
 	struct rbt_node *locator; /*< Saved location in the tree */
 	uint64_t rbt_hash; /*< Saved red-black hash */
 	uint32_t index;	/*< Saved partition index */
+	uint32_t slot; /*< Saved slot (HT_FLAG_OPEN) */
+	bool rcu; /*< Latch is a lockless read-side section */
+	bool sync; /*< Wait for lockless readers on release */
+	struct rbt_node *retired; /*< Node unlinked under this latch */
+	struct hash_data *retired_data; /*< Data replaced under this latch */
+	struct hash_open_tab *retired_tab; /*< Slot array replaced under
+					       this latch */
 };
 
 typedef enum hash_set_how {
@@ -229,6 +300,9 @@ hash_error_t hashtable_delall(struct hash_table *,
 
 void hashtable_log(log_components_t, struct hash_table *);
 
+uint32_t hashtable_walk_begin(struct hash_table *);
+void hashtable_walk_end(struct hash_table *);
+
 /* These are very simple wrappers around the primitives */
 
 /**
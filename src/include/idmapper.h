@@ -59,14 +59,42 @@ extern pthread_rwlock_t idmapper_group_lock;
 
 void idmapper_cache_init(void);
 bool idmapper_add_user(const struct gsh_buffdesc *, uid_t, const gid_t *,
-		       bool);
-bool idmapper_add_group(const struct gsh_buffdesc *, gid_t);
+		       bool, bool);
+bool idmapper_add_group(const struct gsh_buffdesc *, gid_t, bool);
 bool idmapper_lookup_by_uname(const struct gsh_buffdesc *, uid_t *,
-			      const gid_t **, bool);
+			      const gid_t **, bool, bool *);
 bool idmapper_lookup_by_uid(const uid_t, const struct gsh_buffdesc **,
-			    const gid_t **);
-bool idmapper_lookup_by_gname(const struct gsh_buffdesc *, uid_t *);
-bool idmapper_lookup_by_gid(const gid_t, const struct gsh_buffdesc **);
+			    const gid_t **, bool *);
+bool idmapper_lookup_by_gname(const struct gsh_buffdesc *, uid_t *, bool *);
+bool idmapper_lookup_by_gid(const gid_t, const struct gsh_buffdesc **,
+			    bool *);
+
+/**
+ * @brief Space a name takes in XDR form
+ */
+static inline size_t idmapper_xdr_size(size_t len)
+{
+	return BYTES_PER_XDR_UNIT +
+	       (len + BYTES_PER_XDR_UNIT - 1) / BYTES_PER_XDR_UNIT *
+	       BYTES_PER_XDR_UNIT;
+}
+
+/**
+ * @brief XDR form of a name returned by a cache lookup
+ *
+ * Cached names are kept as encoded opaques, the length word just
+ * before name->addr and zero padding after the name, so that
+ * encoding one is a single copy.
+ *
+ * @param[in]  name Name from idmapper_lookup_by_uid/gid
+ * @param[out] xdr  Its XDR form
+ */
+static inline void idmapper_name_xdr(const struct gsh_buffdesc *name,
+				     struct gsh_buffdesc *xdr)
+{
+	xdr->addr = (char *)name->addr - BYTES_PER_XDR_UNIT;
+	xdr->len = idmapper_xdr_size(name->len);
+}
 /** @} */
 
 bool idmapper_init(void);
@@ -140,6 +140,7 @@ char *ReturnLevelInt(int level);
 void RegisterCleanup(cleanup_list_element *clean);
 void Cleanup(void);
 void Fatal(void);
+void log_async_stop(void);
 
 /* This function is primarily for setting log level from config, it will
  * not override log level set from environment.
@@ -206,6 +207,30 @@ struct log_component_info {
 
 extern log_levels_t *component_log_level;
 
+/* Levels of the request this thread works on, when a log filter
+ * matched it, NULL otherwise.
+ */
+extern __thread log_levels_t *log_request_levels;
+
+#define LOG_LEVEL(component) \
+	(unlikely(log_request_levels != NULL) \
+		? log_request_levels[component] \
+		: component_log_level[component])
+
+/* Raise log levels for matching requests only */
+#define LOG_MAX_FILTERS 8
+
+int log_filter_add(const char *client, int32_t export_id, uint32_t xid_min,
+		   uint32_t xid_max, log_components_t component,
+		   log_levels_t level);
+void log_filter_clear_all(void);
+void log_filter_match(const char *client, int32_t export_id, uint32_t xid);
+
+static inline void log_filter_done(void)
+{
+	log_request_levels = NULL;
+}
+
 extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogAlways(component, format, args...) \
@@ -227,7 +252,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogMajor(component, format, args...) \
 	do { \
-		if (likely(component_log_level[component] \
+		if (likely(LOG_LEVEL(component) \
 		    >= NIV_MAJ)) \
 			DisplayLogComponentLevel(component,  __FILE__, \
 						 __LINE__, \
@@ -237,7 +262,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogCrit(component, format, args...) \
 	do { \
-		if (likely(component_log_level[component] \
+		if (likely(LOG_LEVEL(component) \
 		    >= NIV_CRIT)) \
 			DisplayLogComponentLevel(component,  __FILE__, \
 						 __LINE__, \
@@ -247,7 +272,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogWarn(component, format, args...) \
 	do { \
-		if (likely(component_log_level[component] \
+		if (likely(LOG_LEVEL(component) \
 		    >= NIV_WARN)) \
 			DisplayLogComponentLevel(component,  __FILE__, \
 						 __LINE__, \
@@ -258,7 +283,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 #define LogWarnOnce(component, format, args...) \
 	do { \
 		static bool warned; \
-		if (unlikely(!warned) && likely(component_log_level[component] \
+		if (unlikely(!warned) && likely(LOG_LEVEL(component) \
 		    >= NIV_WARN)) { \
 			warned = true; \
 			DisplayLogComponentLevel(component,  __FILE__, \
@@ -270,7 +295,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogEvent(component, format, args...) \
 	do { \
-		if (likely(component_log_level[component] \
+		if (likely(LOG_LEVEL(component) \
 		    >= NIV_EVENT)) \
 			DisplayLogComponentLevel(component,  __FILE__,\
 						 __LINE__, \
@@ -280,7 +305,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogInfo(component, format, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
+		if (unlikely(LOG_LEVEL(component) \
 		    >= NIV_INFO)) \
 			DisplayLogComponentLevel(component,  __FILE__,\
 						 __LINE__, \
@@ -290,7 +315,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogDebug(component, format, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
+		if (unlikely(LOG_LEVEL(component) \
 		    >= NIV_DEBUG)) \
 			DisplayLogComponentLevel(component,  __FILE__,\
 						 __LINE__, \
@@ -300,7 +325,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogMidDebug(component, format, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
+		if (unlikely(LOG_LEVEL(component) \
 		    >= NIV_MID_DEBUG)) \
 			DisplayLogComponentLevel(component,  __FILE__,\
 						 __LINE__, \
@@ -311,7 +336,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 
 #define LogFullDebug(component, format, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
+		if (unlikely(LOG_LEVEL(component) \
 		    >= NIV_FULL_DEBUG)) \
 			DisplayLogComponentLevel(component,  __FILE__,\
 						 __LINE__, \
@@ -323,7 +348,7 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 #define \
 LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
+		if (unlikely(LOG_LEVEL(component) \
 		    >= NIV_FULL_DEBUG)) { \
 			char buf[buf_size]; \
 			struct display_buffer dspbuf = {buf_size, buf, buf}; \
@@ -340,7 +365,7 @@ LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 
 #define LogFullDebugBytes(component, format, buf_size, value, length, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
+		if (unlikely(LOG_LEVEL(component) \
 		    >= NIV_FULL_DEBUG)) { \
 			char buf[buf_size]; \
 			struct display_buffer dspbuf = {buf_size, buf, buf}; \
@@ -357,7 +382,7 @@ LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 
 #define LogAtLevel(component, level, format, args...) \
 	do { \
-		if (unlikely(component_log_level[component] \
+		if (unlikely(LOG_LEVEL(component) \
 		    >= level)) \
 			DisplayLogComponentLevel(component,  __FILE__,\
 						 __LINE__, \
@@ -366,31 +391,31 @@ LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 	} while (0)
 
 #define isLevel(component, level) \
-	(unlikely(component_log_level[component] >= level))
+	(unlikely(LOG_LEVEL(component) >= level))
 
 #define isInfo(component) \
-	(unlikely(component_log_level[component] >= NIV_INFO))
+	(unlikely(LOG_LEVEL(component) >= NIV_INFO))
 
 #define isDebug(component) \
-	(unlikely(component_log_level[component] >= NIV_DEBUG))
+	(unlikely(LOG_LEVEL(component) >= NIV_DEBUG))
 
 #define isMidDebug(component) \
-	(unlikely(component_log_level[component] >= NIV_MID_DEBUG))
+	(unlikely(LOG_LEVEL(component) >= NIV_MID_DEBUG))
 
 #define isFullDebug(component) \
-	(unlikely(component_log_level[component] >= NIV_FULL_DEBUG))
+	(unlikely(LOG_LEVEL(component) >= NIV_FULL_DEBUG))
 
 /* Use either the first component, or if it is not at least at level,
  * use the second component.
  */
 #define LogInfoAlt(comp1, comp2, format, args...) \
 	do { \
-		if (unlikely(component_log_level[comp1] \
+		if (unlikely(LOG_LEVEL(comp1) \
 		    >= NIV_INFO) || \
-		    unlikely(component_log_level[comp2] \
+		    unlikely(LOG_LEVEL(comp2) \
 		    >= NIV_INFO)) { \
 			log_components_t component = \
-			    component_log_level[comp1] \
+			    LOG_LEVEL(comp1) \
 				>= NIV_INFO ? comp1 : comp2; \
 			\
 			DisplayLogComponentLevel(component,  __FILE__, \
@@ -405,12 +430,12 @@ LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 
 #define LogDebugAlt(comp1, comp2, format, args...) \
 	do { \
-		if (unlikely(component_log_level[comp1] \
+		if (unlikely(LOG_LEVEL(comp1) \
 		    >= NIV_DEBUG) || \
-		    unlikely(component_log_level[comp2] \
+		    unlikely(LOG_LEVEL(comp2) \
 		    >= NIV_DEBUG)) { \
 			log_components_t component = \
-			    component_log_level[comp1] \
+			    LOG_LEVEL(comp1) \
 				>= NIV_DEBUG ? comp1 : comp2; \
 			\
 			DisplayLogComponentLevel(component,  __FILE__, \
@@ -425,12 +450,12 @@ LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 
 #define LogMidDebugAlt(comp1, comp2, format, args...) \
 	do { \
-		if (unlikely(component_log_level[comp1] \
+		if (unlikely(LOG_LEVEL(comp1) \
 		    >= NIV_MID_DEBUG) || \
-		    unlikely(component_log_level[comp2] \
+		    unlikely(LOG_LEVEL(comp2) \
 		    >= NIV_MID_DEBUG)) { \
 			log_components_t component = \
-			    component_log_level[comp1] \
+			    LOG_LEVEL(comp1) \
 				>= NIV_MID_DEBUG ? comp1 : comp2; \
 			\
 			DisplayLogComponentLevel(component,  __FILE__, \
@@ -445,12 +470,12 @@ LogFullDebugOpaque(component, format, buf_size, value, length, args...) \
 
 #define LogFullDebugAlt(comp1, comp2, format, args...) \
 	do { \
-		if (unlikely(component_log_level[comp1] \
+		if (unlikely(LOG_LEVEL(comp1) \
 		    >= NIV_FULL_DEBUG) || \
-		    unlikely(component_log_level[comp2] \
+		    unlikely(LOG_LEVEL(comp2) \
 		    >= NIV_FULL_DEBUG)) { \
 			log_components_t component = \
-			    component_log_level[comp1] \
+			    LOG_LEVEL(comp1) \
 				>= NIV_FULL_DEBUG ? comp1 : comp2; \
 			\
 			DisplayLogComponentLevel(component,  __FILE__, \
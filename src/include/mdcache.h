@@ -55,4 +55,16 @@ fsal_status_t mdcache_pkginit(void);
 int mdcache_set_param_from_conf(config_file_t parse_tree,
 				struct config_error_type *err_type);
 
+/* Change LRU limits of a running server */
+void mdcache_lru_set_hwmark(uint32_t hwmark);
+uint32_t mdcache_lru_get_hwmark(void);
+void mdcache_lru_set_run_interval(time_t interval);
+time_t mdcache_lru_get_run_interval(void);
+
+/* Save the handles of the hottest entries to the snapshot file */
+void mdcache_snapshot_save(void);
+
+/* Start prewarming the cache from the snapshot file */
+void mdcache_snapshot_restore(void);
+
 #endif /* MDCACHE_H */
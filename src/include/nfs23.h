@@ -446,6 +446,15 @@ struct READ3resok {
 		u_int data_len;
 		char *data_val;
 	} data;
+	/* Server side only: when data_iov is set the reply data is
+	 * encoded from this list instead of data_val.
+	 */
+	struct iovec *data_iov;
+	u_int data_iovcnt;
+	/* Server side only: when data_fd is set the reply data is
+	 * read from the file as it is encoded.
+	 */
+	struct nfs_read_fd *data_fd;
 };
 typedef struct READ3resok READ3resok;
 
@@ -33,6 +33,7 @@
 #define NFS_CORE_H
 
 #include <pthread.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/param.h>
 #include <time.h>
@@ -113,6 +114,10 @@ typedef struct request_data {
 					 *  added to the worker thread queue.
 					 */
 	request_type_t rtype;
+	int32_t qos_export_id;		/*< Export whose rate limits a READ
+					 *  or WRITE is charged to, -1 for
+					 *  none.
+					 */
 
 	union request_content {
 		rpc_call_t call;
@@ -123,7 +128,40 @@ typedef struct request_data {
 	} r_u;
 } request_data_t;
 
+/**
+ * @brief Size of a request_data_t that only uses one member of r_u
+ *
+ * Callbacks and 9P requests are a fraction of an NFS request, so each
+ * kind comes from a pool of its own size.
+ */
+#define REQUEST_DATA_SIZE(_member) \
+	(offsetof(request_data_t, r_u) + \
+	 sizeof(((request_data_t *)0)->r_u._member))
+
 extern pool_t *request_pool;
+extern pool_t *request_call_pool;
+#ifdef _USE_9P
+extern pool_t *request_9p_pool;
+#endif
+
+/**
+ * @brief The pool a request of some type comes from
+ *
+ * @param[in] rtype Type of the request
+ */
+static inline pool_t *request_pool_of(request_type_t rtype)
+{
+	switch (rtype) {
+	case NFS_CALL:
+		return request_call_pool;
+#ifdef _USE_9P
+	case _9P_REQUEST:
+		return request_9p_pool;
+#endif
+	default:
+		return request_pool;
+	}
+}
 
 /* ServerEpoch is ServerBootTime unless overriden by -E command line option */
 extern struct timespec ServerBootTime;
@@ -133,6 +171,7 @@ extern verifier4 NFS4_write_verifier;	/*< NFS V4 write verifier */
 extern writeverf3 NFS3_write_verifier;	/*< NFS V3 write verifier */
 
 extern char *config_path;
+extern char *config_cache_path;
 extern char *pidfile_path;
 
 /*
@@ -146,6 +185,7 @@ int _9p_process_buffer(struct _9p_request_data *req9p, char *replydata,
 		       u32 *poutlen);
 
 void DispatchWork9P(request_data_t *req);
+void _9p_tcp_conn_put(struct _9p_conn *conn);
 #endif
 
 #ifdef _USE_9P_RDMA
@@ -161,18 +201,37 @@ void nfs_Init_svc(void);
 void nfs_rpc_dispatch_threads(pthread_attr_t *attr_thr);
 void nfs_rpc_dispatch_stop(void);
 
+extern int udp_socket[P_COUNT];
+extern int tcp_socket[P_COUNT];
+extern bool v6disabled;
+
 request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker);
 void nfs_rpc_enqueue_req(request_data_t *req);
+void nfs_rpc_client_req_done(SVCXPRT *xprt);
 uint32_t get_dequeue_count(void);
 uint32_t get_enqueue_count(void);
+uint32_t nfs_rpc_outstanding_reqs_est(void);
+
+/* in nfs_handoff.c */
+
+bool nfs_handoff_receive(int *udp, int *tcp, bool *v6disabled);
+int nfs_handoff_start(void);
+void nfs_handoff_shutdown(void);
+bool nfs_handoff_given(void);
 
 /* in nfs_worker_thread.c */
 
-void nfs_rpc_execute(request_data_t *req);
+int nfs_rpc_execute(request_data_t *req);
+bool nfs_rpc_async_allowed(struct svc_req *req);
+bool nfs_rpc_async_suspend(nfs_request_t *reqnfs);
+void nfs_rpc_async_done(nfs_request_t *reqnfs);
 const nfs_function_desc_t *nfs_rpc_get_funcdesc(nfs_request_t *);
+void nfs_log_filter_update(void);
 
 int worker_init(void);
 int worker_shutdown(void);
+void worker_grow(void);
+int worker_resize(uint32_t nb_worker);
 
 /* Config parsing routines */
 extern config_file_t config_struct;
@@ -181,6 +240,9 @@ extern struct config_block nfs_ip_name;
 #ifdef _HAVE_GSSAPI
 extern struct config_block krb5_param;
 #endif
+#ifdef USE_TLS
+extern struct config_block tls_param;
+#endif
 extern struct config_block version4_param;
 
 /* in nfs_admin_thread.c */
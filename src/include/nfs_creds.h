@@ -49,6 +49,9 @@ void squash_setattr(struct attrlist *attr);
 
 nfsstat4 nfs_req_creds(struct svc_req *req);
 
+struct xprt_gss_creds *xprt_gss_creds_alloc(void);
+void xprt_gss_creds_free(struct xprt_gss_creds *cache);
+
 nfsstat4 nfs4_export_check_access(struct svc_req *req);
 
 fsal_errors_t nfs_access_op(struct fsal_obj_handle *hdl,
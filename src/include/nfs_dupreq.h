@@ -56,20 +56,30 @@ enum drc_type {
 #define DRC_FLAG_RECYCLE 0x0020
 #define DRC_FLAG_RELEASE 0x0040
 
+/**
+ * @brief Retire queue of one DRC partition
+ *
+ * Protected by the lock of the matching rbtree_x partition, so the
+ * dictionary and the queue are updated together.
+ */
+struct drc_part {
+	TAILQ_HEAD(drc_tailq, dupreq_entry) dupreq_q;
+	uint32_t size;
+};
+
 typedef struct drc {
 	enum drc_type type;
 	struct rbtree_x xt;
-	/* Define the tail queue */
-	TAILQ_HEAD(drc_tailq, dupreq_entry) dupreq_q;
-	pthread_mutex_t mtx;
+	struct drc_part *part; /* per-partition retire queues */
+	pthread_mutex_t mtx; /* only for recycling, not per request */
 	uint32_t npart;
 	uint32_t cachesz;
-	uint32_t size;
+	uint32_t size; /* atomic */
 	uint32_t maxsize;
 	uint32_t hiwat;
 	uint32_t flags;
-	uint32_t refcnt; /* call path refs */
-	uint32_t retwnd;
+	uint32_t refcnt; /* call path refs, atomic */
+	int32_t retwnd; /* atomic, may briefly dip below 0 */
 	union {
 		struct {
 			sockaddr_t addr;
@@ -78,6 +88,11 @@ typedef struct drc {
 			TAILQ_ENTRY(drc) recycle_q; /* XXX drc */
 			time_t recycle_time;
 			uint64_t hk; /* hash key */
+			/* adaptive sizing, all atomic */
+			uint32_t inflight; /* started, not finished */
+			uint32_t peak; /* most inflight this period */
+			uint32_t finished; /* requests ever finished */
+			uint32_t hits; /* retransmissions this period */
 		} tcp;
 	} d_u;
 } drc_t;
@@ -139,6 +154,7 @@ void dupreq2_pkgshutdown(void);
 drc_t *drc_get_tcp_drc(struct svc_req *);
 void drc_release_tcp_drc(drc_t *);
 void nfs_dupreq_put_drc(SVCXPRT *xprt, drc_t *drc, uint32_t flags);
+void drc_update_udp_limits(void);
 
 dupreq_status_t nfs_dupreq_start(nfs_request_t *,
 				 struct svc_req *);
@@ -220,6 +220,9 @@ typedef struct exportlist_client_entry__ {
 uid_t get_anonymous_uid(void);
 gid_t get_anonymous_gid(void);
 void export_check_access(void);
+void export_check_access_req(struct svc_req *req);
+struct xprt_export_perms *xprt_export_perms_alloc(void);
+void xprt_export_perms_free(struct xprt_export_perms *cache);
 
 bool export_check_security(struct svc_req *req);
 
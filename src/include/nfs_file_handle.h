@@ -206,6 +206,26 @@ static inline int nfs4_Is_Fh_Empty(nfs_fh4 *pfh)
 int nfs4_Is_Fh_Invalid(nfs_fh4 *);
 int nfs4_Is_Fh_DSHandle(nfs_fh4 *);
 
+/* Per-thread cache of wire handles to objects, used by PUTFH */
+extern uint64_t nfs4_fh_cache_gen;
+
+/**
+ * @brief Invalidate every thread's cached handles
+ *
+ * Called when an object may no longer be what its handle resolves to.
+ */
+static inline void nfs4_fh_cache_invalidate(void)
+{
+	atomic_inc_uint64_t(&nfs4_fh_cache_gen);
+}
+
+bool nfs4_fh_cache_get(nfs_fh4 *, struct gsh_export **,
+		       struct fsal_obj_handle **);
+void nfs4_fh_cache_put(nfs_fh4 *, struct gsh_export *,
+		       struct fsal_obj_handle *);
+void nfs4_fh_cache_flush(void);
+void nfs4_fh_cache_drain(struct gsh_export *);
+
 nfsstat4 nfs4_sanity_check_FH(compound_data_t *data,
 			      object_file_type_t required_type,
 			      bool ds_allowed);
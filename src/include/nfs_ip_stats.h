@@ -7,6 +7,7 @@
 #include "gsh_rpc.h"
 #include <netdb.h>		/* for having MAXHOSTNAMELEN */
 #include "hashtable.h"
+#include "gsh_list.h"
 
 /* IP/name cache error */
 #define IP_NAME_SUCCESS             0
@@ -19,6 +20,12 @@
 /* NFS IPaddr cache entry structure */
 typedef struct nfs_ip_name__ {
 	time_t timestamp;
+	sockaddr_t addr;		/* Hash key */
+	struct glist_head lru;		/* MRU at the head */
+	bool resolved;			/* hostname is valid */
+	bool resolving;			/* A lookup is queued or running */
+	bool negative;			/* Lookup failed, hostname is the IP */
+	uint32_t waiters;		/* Requests waiting on the lookup */
 	char hostname[MAXHOSTNAMELEN + 1];
 } nfs_ip_name_t;
 
@@ -0,0 +1,62 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_metrics.h
+ * @brief OpenMetrics endpoint
+ *
+ * With Metrics_Port set, the server answers HTTP GET /metrics with
+ * its counters in OpenMetrics text format.  Each module that has
+ * counters to show provides a function writing its metric families
+ * to the reply stream.  Loadable modules, which the server cannot
+ * call by name, register theirs with metrics_register().
+ */
+
+#ifndef NFS_METRICS_H
+#define NFS_METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+int metrics_start(void);
+void metrics_shutdown(void);
+
+void metrics_counter(FILE *out, const char *name, const char *help,
+		     uint64_t value);
+void metrics_gauge(FILE *out, const char *name, const char *help,
+		   double value);
+
+struct lat_hist;
+void metrics_lat_hist(FILE *out, const char *name, const char *labels,
+		      struct lat_hist *h, double sum);
+
+typedef void (*metrics_source_t)(FILE *out);
+int metrics_register(metrics_source_t source);
+void metrics_unregister(metrics_source_t source);
+
+void server_stats_metrics(FILE *out);
+void mdcache_metrics(FILE *out);
+void dupreq_metrics(FILE *out);
+void nfs_rpc_metrics(FILE *out);
+void mem_metrics(FILE *out);
+void fridgethr_metrics(FILE *out);
+
+#endif /* NFS_METRICS_H */
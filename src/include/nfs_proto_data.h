@@ -38,6 +38,7 @@
 
 #include "fsal_api.h"
 #include "rquota.h"
+#include "gsh_arena.h"
 
 /*
  * mount was autogenerated, and requires several headers to compile;
@@ -102,7 +103,11 @@ typedef union nfs_arg__ {
 
 struct COMPOUND4res_extended {
 	COMPOUND4res res_compound4;
-	bool res_cached;
+	char *res_xdr;		/*< Pre-encoded reply sent in place of
+				    res_compound4, for session replays */
+	u_int res_xdr_len;	/*< Length of res_xdr */
+	struct gsh_arena res_arena;	/*< Memory of res_compound4, freed
+					    with it once sent */
 };
 
 typedef union nfs_res__ {
@@ -189,12 +194,50 @@ typedef struct nfs_function_desc__ {
 	unsigned int dispatch_behaviour;
 } nfs_function_desc_t;
 
+struct nfs_request;
+
+/**
+ * @brief Hook finishing a request suspended on asynchronous I/O
+ *
+ * Returns NFS_REQ_OK or NFS_REQ_DROP like a service function.
+ */
+typedef int (*nfs_async_resume_t) (struct nfs_request *);
+
 typedef struct nfs_request {
 	struct svc_req svc;
 	struct nfs_request_lookahead lookahead;
 	nfs_arg_t arg_nfs;
 	nfs_res_t *res_nfs;
 	const nfs_function_desc_t *funcdesc;
+	/* The request context lives here rather than on the worker's
+	 * stack so a request can be suspended and resumed on another
+	 * thread.
+	 */
+	struct req_op_context req_ctx;
+	struct export_perms export_perms;
+	struct user_cred user_credentials;
+	/* Asynchronous I/O: both the submitter and the completion
+	 * increment async_phase, whoever gets there second finishes the
+	 * request by calling async_resume.
+	 */
+	uint32_t async_phase;
+	nfs_async_resume_t async_resume;
+	void *async_arg;
+	/* Set at dequeue when overload control sheds the request, which
+	 * is then answered with NFS4ERR_DELAY or NFS3ERR_JUKEBOX.
+	 */
+	bool shed;
+	/* Result of an NFSv4.1+ compound, which the session slot table
+	 * rather than the DRC protects, so it needs no allocation of its
+	 * own.
+	 */
+	nfs_res_t res_session;
+	/* Thread CPU time decoding and executing the request, with
+	 * Enable_CPU_Stats, and when the current stage began.
+	 */
+	uint64_t cpu_decode;
+	uint64_t cpu_execute;
+	uint64_t cpu_mark;
 } nfs_request_t;
 
 enum rpc_chan_type {
@@ -213,6 +256,9 @@ typedef struct rpc_call_channel {
 	time_t last_called;
 	CLIENT *clnt;
 	AUTH *auth;
+	pthread_mutex_t pending_mtx;	/*< Protects pending and dispatching */
+	struct glist_head pending;	/*< Calls queued behind the dispatcher */
+	bool dispatching;	/*< A worker is sending this channel's calls */
 #ifdef _HAVE_GSSAPI
 	struct rpc_gss_sec gss_sec;
 #endif /* _HAVE_GSSAPI */
@@ -313,18 +359,20 @@ typedef struct compound_data {
 	nfs_client_cred_t credential;	/*< Raw RPC credentials */
 	nfs_client_id_t *preserved_clientid;	/*< clientid that has lease
 						   reserved, if any */
-	struct COMPOUND4res_extended *cached_res;	/*< NFv41: pointer to
-							   cached RPC result in
-							   a session's slot */
+	nfs41_session_slot_t *cached_slot;	/*< NFv41: slot whose reply
+						    cache to fill or replay */
 	bool use_drc;		/*< Set to true if session DRC is to be used */
 	uint32_t oppos;		/*< Position of the operation within the
 				    request processed  */
+	uint32_t opcnt;		/*< Number of operations in the request */
 	nfs41_session_t *session;	/*< Related session
 					   (found by OP_SEQUENCE) */
 	sequenceid4 sequence;	/*< Sequence ID of the current compound
 				   (if applicable) */
 	slotid4 slot;		/*< Slot ID of the current compound
 				   (if applicable) */
+	struct gsh_arena *arena;	/*< Allocations for the reply, freed
+					    all at once after it is sent */
 } compound_data_t;
 
 typedef int (*nfs4_op_function_t) (struct nfs_argop4 *, compound_data_t *,
@@ -104,6 +104,13 @@ int rquota_setquota(nfs_arg_t *, struct svc_req *, nfs_res_t *);
 
 int rquota_setactivequota(nfs_arg_t *, struct svc_req *, nfs_res_t *);
 
+bool rquota_cache_get(uint16_t export_id, const char *path, int quota_type,
+		      int quota_id, int *status, fsal_quota_t *quota);
+void rquota_cache_put(uint16_t export_id, const char *path, int quota_type,
+		      int quota_id, int status, const fsal_quota_t *quota);
+void rquota_cache_invalidate(uint16_t export_id, int quota_type,
+			     int quota_id);
+
 /* @}
  *  * -- End of RQUOTA protocol functions. --
  *   */
@@ -278,6 +285,9 @@ int nfs4_op_free_stateid(struct nfs_argop4 *, compound_data_t *,
 int nfs4_op_getdeviceinfo(struct nfs_argop4 *, compound_data_t *,
 			  struct nfs_resop4 *);
 
+int nfs4_op_get_dir_delegation(struct nfs_argop4 *, compound_data_t *,
+			       struct nfs_resop4 *);
+
 int nfs4_op_destroy_clientid(struct nfs_argop4 *, compound_data_t *,
 			     struct nfs_resop4 *);
 
@@ -348,6 +358,29 @@ int nfs4_op_layoutstats(struct nfs_argop4 *, compound_data_t *,
 
 void nfs4_op_layoutstats_Free(nfs_resop4 *resp);
 
+int nfs4_op_copy(struct nfs_argop4 *, compound_data_t *,
+		 struct nfs_resop4 *);
+
+void nfs4_op_copy_Free(nfs_resop4 *resp);
+
+int nfs4_op_clone(struct nfs_argop4 *, compound_data_t *,
+		  struct nfs_resop4 *);
+
+void nfs4_op_clone_Free(nfs_resop4 *resp);
+
+int nfs4_op_offload_status(struct nfs_argop4 *, compound_data_t *,
+			   struct nfs_resop4 *);
+
+void nfs4_op_offload_status_Free(nfs_resop4 *resp);
+
+int nfs4_op_offload_cancel(struct nfs_argop4 *, compound_data_t *,
+			   struct nfs_resop4 *);
+
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp);
+
+int nfs4_copy_pkginit(void);
+int nfs4_copy_pkgshutdown(void);
+
 /* NFSv4.3 */
 int nfs4_op_getxattr(struct nfs_argop4 *, compound_data_t *,
 		      struct nfs_resop4 *);
@@ -375,6 +408,7 @@ void nfs4_op_removexattr_Free(nfs_resop4 *resp);
 
 #define NFS_REQ_OK   0
 #define NFS_REQ_DROP 1
+#define NFS_REQ_ASYNC_WAIT 2	/*< Suspended until async I/O completes */
 
 /* Free functions */
 void mnt1_Mnt_Free(nfs_res_t *);
@@ -430,6 +464,7 @@ void nfs3_read_free(nfs_res_t *);
 
 void nfs4_Compound_FreeOne(nfs_resop4 *);
 void nfs4_Compound_Free(nfs_res_t *);
+bool xdr_COMPOUND4res_extended(XDR *, struct COMPOUND4res_extended *);
 void nfs4_Compound_CopyResOne(nfs_resop4 *, nfs_resop4 *);
 void nfs4_Compound_CopyRes(nfs_res_t *, nfs_res_t *);
 
@@ -490,6 +525,7 @@ void nfs4_op_create_session_Free(nfs_resop4 *);
 void nfs4_op_getdevicelist_Free(nfs_resop4 *);
 void nfs4_op_getdeviceinfo_Free(nfs_resop4 *);
 void nfs4_op_free_stateid_Free(nfs_resop4 *);
+void nfs4_op_get_dir_delegation_Free(nfs_resop4 *);
 void nfs4_op_destroy_session_Free(nfs_resop4 *);
 void nfs4_op_lock_Free(nfs_resop4 *);
 void nfs4_op_lockt_Free(nfs_resop4 *);
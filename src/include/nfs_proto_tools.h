@@ -85,6 +85,8 @@ struct xdr_attrs_args {
 	compound_data_t *data;
 	bool statfscalled;
 	fsal_dynamicfsinfo_t *dynamicinfo;
+	struct gsh_arena *arena;	/*< If set, attribute values are
+					    allocated from it */
 };
 
 typedef struct fattr4_dent {
@@ -239,6 +241,51 @@ void nfs_SetPreOpAttr(struct fsal_obj_handle *entry,
 
 bool nfs_RetryableError(fsal_errors_t fsal_errors);
 
+/**
+ * @brief Size of each buffer in a READ scatter list
+ */
+#define NFS_READ_IOV_SEGMENT (64 * 1024)
+
+void nfs_read_iov_pkginit(void);
+bool nfs_read_use_iov(struct fsal_obj_handle *obj);
+struct iovec *nfs_read_iov_alloc(size_t size, u_int *iovcnt);
+void nfs_read_iov_free(struct iovec *iov, u_int iovcnt);
+bool nfs_read_fd_get(struct fsal_obj_handle *obj, bool bypass,
+		     struct state_t *state, uint64_t offset, size_t size,
+		     struct nfs_read_fd **rfd, size_t *read_size, bool *eof,
+		     fsal_status_t *status);
+void nfs_read_fd_release(struct nfs_read_fd *rfd);
+
+#ifdef _USE_NFS3
+/**
+ * @brief What an NFSv3 READDIR or READDIRPLUS reply depends on
+ */
+struct nfs3_readdir_key {
+	fsal_fsid_t fsid;		/*< Directory */
+	uint64_t fileid;
+	uint64_t change;		/*< Directory change attribute */
+	struct timespec ctime;		/*< and ctime, for the verifier */
+	uint64_t cookie;
+	uint32_t count;			/*< dircount, or count */
+	uint32_t maxcount;		/*< maxcount, 0 for READDIR */
+	uint16_t export_id;
+	bool plus;			/*< READDIRPLUS */
+	bool attrs;			/*< Entries carry attributes */
+};
+
+void *nfs3_dirents_alloc(size_t size);
+void nfs3_dirents_put(void *entries);
+
+void nfs3_readdir_cache_pkginit(void);
+bool nfs3_readdir_cache_key(struct fsal_obj_handle *dir, uint64_t cookie,
+			    uint32_t count, uint32_t maxcount, bool plus,
+			    struct nfs3_readdir_key *key);
+bool nfs3_readdir_cache_get(const struct nfs3_readdir_key *key,
+			    void **entries, bool *eof);
+void nfs3_readdir_cache_put(const struct nfs3_readdir_key *key,
+			    void *entries, bool eof);
+#endif
+
 int nfs3_Sattr_To_FSAL_attr(struct attrlist *pFSALattr, sattr3 *psattr);
 
 void nfs4_Fattr_Free(fattr4 *fattr);
@@ -288,9 +335,11 @@ bool nfs3_Sattr_To_FSALattr(struct attrlist *, sattr3 *);
 
 int nfs4_Fattr_To_FSAL_attr(struct attrlist *, fattr4 *, compound_data_t *);
 
+int nfs4_Fattr_To_FSAL_attr_fh(struct attrlist *, fattr4 *, nfs_fh4 *);
+
 int nfs4_Fattr_To_fsinfo(fsal_dynamicfsinfo_t *, fattr4 *);
 
-int nfs4_Fattr_Fill_Error(fattr4 *, nfsstat4);
+int nfs4_Fattr_Fill_Error(compound_data_t *, fattr4 *, nfsstat4);
 
 int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *, struct bitmap4 *,
 			   fattr4 *);
@@ -35,6 +35,7 @@
 #ifndef NFS_REQ_QUEUE_H
 #define NFS_REQ_QUEUE_H
 
+#include <sched.h>
 #include "gsh_list.h"
 #include "wait_queue.h"
 
@@ -67,10 +68,19 @@ struct req_q_set {
 	struct req_q_pair qset[N_REQ_QUEUES];
 };
 
+/* Deficit round robin queue of clients, for fair share scheduling */
+struct req_fair_q {
+	pthread_mutex_t mtx;
+	struct glist_head active;	/* clients with queued requests */
+	uint32_t size;
+};
+
 struct nfs_req_st {
 	struct {
 		uint32_t ctr;
-		struct req_q_set nfs_request_q;
+		uint32_t nshards;	/*< Number of queue sets */
+		struct req_q_set *nfs_request_q;	/*< One set per shard */
+		struct req_fair_q fair_q;	/*< Shared by all shards */
 		uint64_t size;
 		pthread_spinlock_t sp;
 		struct glist_head wait_list;
@@ -106,6 +116,20 @@ static inline uint32_t nfs_rpc_q_next_slot(void)
 	return ix;
 }
 
+/**
+ * @brief Queue set of the CPU the caller runs on
+ */
+static inline uint32_t nfs_rpc_q_home_shard(void)
+{
+	int cpu;
+
+	if (nfs_req_st.reqs.nshards == 1)
+		return 0;
+
+	cpu = sched_getcpu();
+	return (cpu < 0 ? 0 : cpu) % nfs_req_st.reqs.nshards;
+}
+
 static inline void nfs_rpc_queue_awaken(void *arg)
 {
 	struct nfs_req_st *st = arg;
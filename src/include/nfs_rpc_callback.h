@@ -140,6 +140,7 @@ int nfs_rpc_call_init(rpc_call_t call, uint32_t flags);
 #define NFS_RPC_CALL_NONE 0x0000
 #define NFS_RPC_CALL_INLINE 0x0001	/*< execute in current thread ctxt */
 #define NFS_RPC_CALL_BROADCAST 0x0002
+#define NFS_RPC_CALL_URGENT 0x0004	/*< queue ahead of other calls */
 
 /* Submit rpc to be called on chan, optionally waiting for completion. */
 int32_t nfs_rpc_submit_call(rpc_call_t *call, void *completion_arg,
@@ -1645,6 +1645,15 @@ extern "C" {
 			u_int data_len;
 			char *data_val;
 		} data;
+		/* Server side only: when data_iov is set the reply data
+		 * is encoded from this list instead of data_val.
+		 */
+		struct iovec *data_iov;
+		u_int data_iovcnt;
+		/* Server side only: when data_fd is set the reply data
+		 * is read from the file as it is encoded.
+		 */
+		struct nfs_read_fd *data_fd;
 	};
 	typedef struct READ4resok READ4resok;
 
@@ -2564,8 +2573,10 @@ extern "C" {
 
 	typedef struct {
 		bool_t            rpr_eof;
-		count4            rpr_contents_count;
-		contents          rpr_contents;
+		struct {
+			u_int rpr_contents_len;
+			contents *rpr_contents_val;
+		} rpr_contents;
 	} read_plus_res4;
 
 	typedef struct {
@@ -2574,11 +2585,22 @@ extern "C" {
 	} seek_res4;
 
 	typedef struct OFFLOAD_STATUS4resok {
-		length4         osr_bytes_copied;
-		count4          osr_count_complete;
-		nfsstat4        osr_complete;
+		length4         osr_count;
+		struct {
+			u_int osr_complete_len;
+			nfsstat4 osr_complete_val;
+		} osr_complete;
 	} OFFLOAD_STATUS4resok;
 
+	typedef struct netloc4 {
+		netloc_type4        nl_type;
+		union {
+			utf8str_cis nl_name;
+			utf8str_cis nl_url;
+			netaddr4    nl_addr;
+		} netloc4_u;
+	} netloc4;
+
 	struct COPY_NOTIFY4args {
 		stateid4 cna_stateid;
 		netloc_type4        cna_type;
@@ -2622,24 +2644,58 @@ extern "C" {
 		offset4         ca_src_offset;
 		offset4         ca_dst_offset;
 		length4         ca_count;
-		netloc_type4        ca_type;
-		union {
-			utf8str_cis ca_name;
-			utf8str_cis ca_url;
-			netaddr4    ca_addr;
-		};
+		bool_t          ca_consecutive;
+		bool_t          ca_synchronous;
+		struct {
+			u_int ca_source_server_len;
+			netloc4 *ca_source_server_val;
+		} ca_source_server;
 	};
 	typedef struct COPY4args COPY4args;
 
+	typedef struct copy_requirements4 {
+		bool_t          cr_consecutive;
+		bool_t          cr_synchronous;
+	} copy_requirements4;
+
+	typedef struct COPY4resok {
+		write_response4 cr_response;
+		copy_requirements4 cr_requirements;
+	} COPY4resok;
+
 	struct COPY4res {
 		nfsstat4 cr_status;
 		union {
-			write_response4 cr_resok4;
-			length4         cr_bytes_copied;
+			COPY4resok      cr_resok4;
+			copy_requirements4 cr_requirements;
 		} COPY4res_u;
 	};
 	typedef struct COPY4res COPY4res;
 
+	struct CLONE4args {
+		stateid4        cl_src_stateid;
+		stateid4        cl_dst_stateid;
+		offset4         cl_src_offset;
+		offset4         cl_dst_offset;
+		length4         cl_count;
+	};
+	typedef struct CLONE4args CLONE4args;
+
+	struct CLONE4res {
+		nfsstat4 cl_status;
+	};
+	typedef struct CLONE4res CLONE4res;
+
+	struct OFFLOAD_CANCEL4args {
+		stateid4        oca_stateid;
+	};
+	typedef struct OFFLOAD_CANCEL4args OFFLOAD_CANCEL4args;
+
+	struct OFFLOAD_CANCEL4res {
+		nfsstat4 ocr_status;
+	};
+	typedef struct OFFLOAD_CANCEL4res OFFLOAD_CANCEL4res;
+
 	struct OFFLOAD_ABORT4args {
 		stateid4        oaa_stateid;
 	};
@@ -3169,6 +3225,8 @@ extern "C" {
 			COPY4args opcopy;
 			OFFLOAD_ABORT4args opoffload_abort;
 			OFFLOAD_STATUS4args opoffload_status;
+			OFFLOAD_CANCEL4args opoffload_cancel;
+			CLONE4args opclone;
 			WRITE_SAME4args opwrite_plus;
 			ALLOCATE4args opallocate;
 			DEALLOCATE4args opdeallocate;
@@ -3254,6 +3312,8 @@ extern "C" {
 			COPY4res opcopy;
 			OFFLOAD_ABORT4res opoffload_abort;
 			OFFLOAD_STATUS4res opoffload_status;
+			OFFLOAD_CANCEL4res opoffload_cancel;
+			CLONE4res opclone;
 			WRITE_SAME4res opwrite_plus;
 			ALLOCATE4res opallocate;
 			DEALLOCATE4res opdeallocate;
@@ -3606,6 +3666,26 @@ extern "C" {
 	};
 	typedef struct CB_NOTIFY_DEVICEID4res CB_NOTIFY_DEVICEID4res;
 
+	typedef struct offload_info4 {
+		nfsstat4 coa_status;
+		union {
+			write_response4 coa_resok4;
+			length4         coa_bytes_copied;
+		} offload_info4_u;
+	} offload_info4;
+
+	struct CB_OFFLOAD4args {
+		nfs_fh4         coa_fh;
+		stateid4        coa_stateid;
+		offload_info4   coa_offload_info;
+	};
+	typedef struct CB_OFFLOAD4args CB_OFFLOAD4args;
+
+	struct CB_OFFLOAD4res {
+		nfsstat4 cor_status;
+	};
+	typedef struct CB_OFFLOAD4res CB_OFFLOAD4res;
+
 /* Callback operations new to NFSv4.1 */
 
 	enum nfs_cb_opnum4 {
@@ -3621,6 +3701,7 @@ extern "C" {
 		NFS4_OP_CB_WANTS_CANCELLED = 12,
 		NFS4_OP_CB_NOTIFY_LOCK = 13,
 		NFS4_OP_CB_NOTIFY_DEVICEID = 14,
+		NFS4_OP_CB_OFFLOAD = 15,
 		NFS4_OP_CB_ILLEGAL = 10044,
 	};
 	typedef enum nfs_cb_opnum4 nfs_cb_opnum4;
@@ -3640,6 +3721,7 @@ extern "C" {
 			CB_WANTS_CANCELLED4args opcbwants_cancelled;
 			CB_NOTIFY_LOCK4args opcbnotify_lock;
 			CB_NOTIFY_DEVICEID4args opcbnotify_deviceid;
+			CB_OFFLOAD4args opcboffload;
 		} nfs_cb_argop4_u;
 	};
 	typedef struct nfs_cb_argop4 nfs_cb_argop4;
@@ -3659,6 +3741,7 @@ extern "C" {
 			CB_WANTS_CANCELLED4res opcbwants_cancelled;
 			CB_NOTIFY_LOCK4res opcbnotify_lock;
 			CB_NOTIFY_DEVICEID4res opcbnotify_deviceid;
+			CB_OFFLOAD4res opcboffload;
 			CB_ILLEGAL4res opcbillegal;
 		} nfs_cb_resop4_u;
 	};
@@ -6386,6 +6469,13 @@ extern "C" {
 	{
 		if (!inline_xdr_bool(xdrs, &objp->eof))
 			return false;
+		if (xdrs->x_op == XDR_ENCODE && objp->data_iov != NULL)
+			return xdr_opaque_iov(xdrs, objp->data_iov,
+					      objp->data_iovcnt,
+					      objp->data.data_len);
+		if (xdrs->x_op == XDR_ENCODE && objp->data_fd != NULL)
+			return xdr_opaque_fd(xdrs, objp->data_fd,
+					     objp->data.data_len);
 		if (!inline_xdr_bytes
 		    (xdrs, (char **)&objp->data.data_val,
 		     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
@@ -6770,6 +6860,7 @@ extern "C" {
 			return false;
 		if (!xdr_stable_how4(xdrs, &objp->stable))
 			return false;
+		/* Copied out, see xdr_WRITE3args */
 		if (!inline_xdr_bytes
 		    (xdrs, (char **)&objp->data.data_val,
 		     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
@@ -7962,41 +8053,44 @@ extern "C" {
 		return true;
 	}
 
-	static inline bool xdr_READ_PLUS4resok(XDR * xdrs,
-						read_plus_res4 *objp)
+	static inline bool xdr_read_plus_content(XDR * xdrs, contents *objp)
 	{
-		if (!inline_xdr_bool(xdrs, &objp->rpr_eof))
-			return false;
-		if (objp->rpr_contents_count != 1)  /* an array of 1 for now */
-			return false;
-		if (!xdr_count4(xdrs, &objp->rpr_contents_count))
-			return false;
-		if (!inline_xdr_enum(xdrs, (enum_t *)&objp->rpr_contents.what))
+		if (!inline_xdr_enum(xdrs, (enum_t *)&objp->what))
 			return false;
-		if (objp->rpr_contents.what == NFS4_CONTENT_DATA) {
-			if (!xdr_offset4(xdrs,
-					&objp->rpr_contents.data.d_offset))
+		if (objp->what == NFS4_CONTENT_DATA) {
+			if (!xdr_offset4(xdrs, &objp->data.d_offset))
 				return false;
 			if (!inline_xdr_bytes
 			    (xdrs,
-			     (char **)&objp->rpr_contents.data.d_data.data_val,
-			     &objp->rpr_contents.data.d_data.data_len,
+			     (char **)&objp->data.d_data.data_val,
+			     &objp->data.d_data.data_len,
 			     XDR_BYTES_MAXLEN_IO))
 				return false;
 			return true;
 		}
-		if (objp->rpr_contents.what == NFS4_CONTENT_HOLE) {
-			if (!xdr_offset4(xdrs,
-					&objp->rpr_contents.hole.di_offset))
+		if (objp->what == NFS4_CONTENT_HOLE) {
+			if (!xdr_offset4(xdrs, &objp->hole.di_offset))
 				return false;
-			if (!xdr_length4(xdrs,
-				  &objp->rpr_contents.hole.di_length))
+			if (!xdr_length4(xdrs, &objp->hole.di_length))
 				return false;
 			return true;
 		} else
 			return false;
 	}
 
+	static inline bool xdr_READ_PLUS4resok(XDR * xdrs,
+						read_plus_res4 *objp)
+	{
+		if (!inline_xdr_bool(xdrs, &objp->rpr_eof))
+			return false;
+		if (!xdr_array
+		    (xdrs, (char **)&objp->rpr_contents.rpr_contents_val,
+		     &objp->rpr_contents.rpr_contents_len, XDR_ARRAY_MAXLEN,
+		     sizeof(contents), (xdrproc_t) xdr_read_plus_content))
+			return false;
+		return true;
+	}
+
 	static inline bool xdr_READ_PLUS4res(XDR * xdrs, READ_PLUS4res *objp)
 	{
 		if (!xdr_nfsstat4(xdrs, &objp->rpr_status))
@@ -8029,6 +8123,163 @@ extern "C" {
 		return true;
 	}
 
+	static inline bool xdr_netloc4(XDR * xdrs, netloc4 *objp)
+	{
+		if (!inline_xdr_enum(xdrs, (enum_t *)&objp->nl_type))
+			return false;
+		switch (objp->nl_type) {
+		case NL4_NAME:
+			if (!xdr_utf8str_cis(xdrs, &objp->netloc4_u.nl_name))
+				return false;
+			break;
+		case NL4_URL:
+			if (!xdr_utf8str_cis(xdrs, &objp->netloc4_u.nl_url))
+				return false;
+			break;
+		case NL4_NETADDR:
+			if (!xdr_netaddr4(xdrs, &objp->netloc4_u.nl_addr))
+				return false;
+			break;
+		default:
+			return false;
+		}
+		return true;
+	}
+
+	static inline bool xdr_COPY4args(XDR * xdrs, COPY4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->ca_src_stateid))
+			return false;
+		if (!xdr_stateid4(xdrs, &objp->ca_dst_stateid))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->ca_src_offset))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->ca_dst_offset))
+			return false;
+		if (!xdr_length4(xdrs, &objp->ca_count))
+			return false;
+		if (!inline_xdr_bool(xdrs, &objp->ca_consecutive))
+			return false;
+		if (!inline_xdr_bool(xdrs, &objp->ca_synchronous))
+			return false;
+		if (!xdr_array
+		    (xdrs,
+		     (char **)&objp->ca_source_server.ca_source_server_val,
+		     &objp->ca_source_server.ca_source_server_len,
+		     XDR_ARRAY_MAXLEN, sizeof(netloc4),
+		     (xdrproc_t) xdr_netloc4))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_copy_requirements4(XDR * xdrs,
+						  copy_requirements4 *objp)
+	{
+		if (!inline_xdr_bool(xdrs, &objp->cr_consecutive))
+			return false;
+		if (!inline_xdr_bool(xdrs, &objp->cr_synchronous))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_COPY4res(XDR * xdrs, COPY4res *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->cr_status))
+			return false;
+		switch (objp->cr_status) {
+		case NFS4_OK:
+			if (!xdr_WRITE_SAME4resok(xdrs,
+				&objp->COPY4res_u.cr_resok4.cr_response))
+				return false;
+			if (!xdr_copy_requirements4(xdrs,
+				&objp->COPY4res_u.cr_resok4.cr_requirements))
+				return false;
+			break;
+		case NFS4ERR_OFFLOAD_NO_REQS:
+			if (!xdr_copy_requirements4(xdrs,
+				&objp->COPY4res_u.cr_requirements))
+				return false;
+			break;
+		default:
+			break;
+		}
+		return true;
+	}
+
+	static inline bool xdr_CLONE4args(XDR * xdrs, CLONE4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->cl_src_stateid))
+			return false;
+		if (!xdr_stateid4(xdrs, &objp->cl_dst_stateid))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->cl_src_offset))
+			return false;
+		if (!xdr_offset4(xdrs, &objp->cl_dst_offset))
+			return false;
+		if (!xdr_length4(xdrs, &objp->cl_count))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_CLONE4res(XDR * xdrs, CLONE4res *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->cl_status))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_OFFLOAD_CANCEL4args(XDR * xdrs,
+						   OFFLOAD_CANCEL4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->oca_stateid))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_OFFLOAD_CANCEL4res(XDR * xdrs,
+						  OFFLOAD_CANCEL4res *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->ocr_status))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_OFFLOAD_STATUS4args(XDR * xdrs,
+						   OFFLOAD_STATUS4args *objp)
+	{
+		if (!xdr_stateid4(xdrs, &objp->osa_stateid))
+			return false;
+		return true;
+	}
+
+	static inline bool xdr_OFFLOAD_STATUS4res(XDR * xdrs,
+						  OFFLOAD_STATUS4res *objp)
+	{
+		OFFLOAD_STATUS4resok *resok =
+			&objp->OFFLOAD_STATUS4res_u.osr_resok4;
+
+		if (!xdr_nfsstat4(xdrs, &objp->osr_status))
+			return false;
+		switch (objp->osr_status) {
+		case NFS4_OK:
+			if (!xdr_length4(xdrs, &resok->osr_count))
+				return false;
+			if (!inline_xdr_u_int(xdrs,
+				&resok->osr_complete.osr_complete_len))
+				return false;
+			if (resok->osr_complete.osr_complete_len > 1)
+				return false;
+			if (resok->osr_complete.osr_complete_len == 1)
+				if (!xdr_nfsstat4(xdrs,
+				    &resok->osr_complete.osr_complete_val))
+					return false;
+			break;
+		default:
+			break;
+		}
+		return true;
+	}
+
 	static inline bool xdr_SEEK4args(XDR * xdrs, SEEK4args *objp)
 	{
 		if (!xdr_stateid4(xdrs, &objp->sa_stateid))
@@ -8227,7 +8478,8 @@ extern "C" {
 		struct nfs_request_lookahead slhd = {
 			.flags = 0,
 			.read = 0,
-			.write = 0
+			.write = 0,
+			.io_bytes = 0
 		};
 		struct nfs_request_lookahead *lkhd =
 		    xdrs->x_public ? (struct nfs_request_lookahead *)xdrs->
@@ -8345,6 +8597,7 @@ extern "C" {
 				return false;
 			lkhd->flags |= NFS_LOOKAHEAD_READ;
 			(lkhd->read)++;
+			lkhd->io_bytes += objp->nfs_argop4_u.opread.count;
 			break;
 		case NFS4_OP_READDIR:
 			if (!xdr_READDIR4args
@@ -8408,6 +8661,8 @@ extern "C" {
 				return false;
 			lkhd->flags |= NFS_LOOKAHEAD_WRITE;
 			(lkhd->write)++;
+			lkhd->io_bytes +=
+				objp->nfs_argop4_u.opwrite.data.data_len;
 			break;
 		case NFS4_OP_RELEASE_LOCKOWNER:
 			if (!xdr_RELEASE_LOCKOWNER4args
@@ -8525,6 +8780,8 @@ extern "C" {
 				return false;
 			lkhd->flags |= NFS_LOOKAHEAD_READ;
 			(lkhd->read)++;
+			lkhd->io_bytes +=
+				objp->nfs_argop4_u.opread_plus.rpa_count;
 			break;
 		case NFS4_OP_SEEK:
 			if (!xdr_SEEK4args(xdrs,
@@ -8558,10 +8815,26 @@ extern "C" {
 			break;
 
 		case NFS4_OP_COPY:
-		case NFS4_OP_COPY_NOTIFY:
+			if (!xdr_COPY4args(xdrs,
+					&objp->nfs_argop4_u.opcopy))
+				return false;
+			break;
 		case NFS4_OP_OFFLOAD_CANCEL:
+			if (!xdr_OFFLOAD_CANCEL4args(xdrs,
+					&objp->nfs_argop4_u.opoffload_cancel))
+				return false;
+			break;
 		case NFS4_OP_OFFLOAD_STATUS:
+			if (!xdr_OFFLOAD_STATUS4args(xdrs,
+					&objp->nfs_argop4_u.opoffload_status))
+				return false;
+			break;
 		case NFS4_OP_CLONE:
+			if (!xdr_CLONE4args(xdrs,
+					&objp->nfs_argop4_u.opclone))
+				return false;
+			break;
+		case NFS4_OP_COPY_NOTIFY:
 			break;
 
 		/* NFSv4.3 */
@@ -8908,10 +9181,27 @@ extern "C" {
 			break;
 
 		case NFS4_OP_COPY:
-		case NFS4_OP_COPY_NOTIFY:
+			if (!xdr_COPY4res(xdrs,
+					&objp->nfs_resop4_u.opcopy))
+				return false;
+			break;
 		case NFS4_OP_OFFLOAD_CANCEL:
+			if (!xdr_OFFLOAD_CANCEL4res(xdrs,
+					&objp->nfs_resop4_u.opoffload_cancel))
+				return false;
+			break;
 		case NFS4_OP_OFFLOAD_STATUS:
+			if (!xdr_OFFLOAD_STATUS4res(xdrs,
+					&objp->nfs_resop4_u.opoffload_status))
+				return false;
+			break;
 		case NFS4_OP_CLONE:
+			if (!xdr_CLONE4res(xdrs,
+					&objp->nfs_resop4_u.opclone))
+				return false;
+			break;
+		case NFS4_OP_COPY_NOTIFY:
+			break;
 
 		/* NFSv4.3 */
 		case NFS4_OP_GETXATTR:
@@ -9720,6 +10010,40 @@ extern "C" {
 		return true;
 	}
 
+	static inline bool xdr_CB_OFFLOAD4args(XDR * xdrs,
+					       CB_OFFLOAD4args *objp)
+	{
+		offload_info4 *info = &objp->coa_offload_info;
+
+		if (!xdr_nfs_fh4(xdrs, &objp->coa_fh))
+			return false;
+		if (!xdr_stateid4(xdrs, &objp->coa_stateid))
+			return false;
+		if (!xdr_nfsstat4(xdrs, &info->coa_status))
+			return false;
+		switch (info->coa_status) {
+		case NFS4_OK:
+			if (!xdr_WRITE_SAME4resok(xdrs,
+					&info->offload_info4_u.coa_resok4))
+				return false;
+			break;
+		default:
+			if (!xdr_length4(xdrs,
+				&info->offload_info4_u.coa_bytes_copied))
+				return false;
+			break;
+		}
+		return true;
+	}
+
+	static inline bool xdr_CB_OFFLOAD4res(XDR * xdrs,
+					      CB_OFFLOAD4res *objp)
+	{
+		if (!xdr_nfsstat4(xdrs, &objp->cor_status))
+			return false;
+		return true;
+	}
+
 /* Callback operations new to NFSv4.1 */
 
 	static inline bool xdr_nfs_cb_opnum4(XDR * xdrs, nfs_cb_opnum4 *objp)
@@ -9795,6 +10119,11 @@ extern "C" {
 			    (xdrs, &objp->nfs_cb_argop4_u.opcbnotify_deviceid))
 				return false;
 			break;
+		case NFS4_OP_CB_OFFLOAD:
+			if (!xdr_CB_OFFLOAD4args
+			    (xdrs, &objp->nfs_cb_argop4_u.opcboffload))
+				return false;
+			break;
 		case NFS4_OP_CB_ILLEGAL:
 			break;
 		default:
@@ -9869,6 +10198,11 @@ extern "C" {
 			    (xdrs, &objp->nfs_cb_resop4_u.opcbnotify_deviceid))
 				return false;
 			break;
+		case NFS4_OP_CB_OFFLOAD:
+			if (!xdr_CB_OFFLOAD4res
+			    (xdrs, &objp->nfs_cb_resop4_u.opcboffload))
+				return false;
+			break;
 		case NFS4_OP_CB_ILLEGAL:
 			if (!xdr_CB_ILLEGAL4res
 			    (xdrs, &objp->nfs_cb_resop4_u.opcbillegal))
@@ -69,6 +69,8 @@ extern "C" {
 	extern bool nsm_monitor(state_nsm_client_t *host);
 	extern bool nsm_unmonitor(state_nsm_client_t *host);
 	extern void nsm_unmonitor_all(void);
+	extern void nsm_async_init(void);
+	extern void nsm_async_shutdown(void);
 	extern int nsm_notify(char *host, int state);
 
 /* the xdr functions */
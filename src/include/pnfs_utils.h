@@ -227,6 +227,19 @@ nfsstat4 FSAL_encode_v4_multipath(XDR *xdrs, const uint32_t num_hosts,
 
 nfsstat4 posix2nfs4_error(int posix_errorcode);
 
+bool pnfs_devinfo_cache_get(layouttype4 type,
+			    const struct pnfs_deviceid *deviceid,
+			    size_t maxlen, char **body, size_t *len);
+void pnfs_devinfo_cache_put(layouttype4 type,
+			    const struct pnfs_deviceid *deviceid,
+			    const char *body, size_t len);
+void pnfs_devinfo_cache_flush(struct fsal_module *fsal);
+
+void pnfs_device_load_report(const struct pnfs_deviceid *deviceid,
+			     uint64_t ios, uint64_t bytes);
+unsigned int pnfs_device_pick(const struct pnfs_deviceid *candidates,
+			      unsigned int count, unsigned int hint);
+
 /*
 ** in support/ds.c
 */
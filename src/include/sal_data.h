@@ -46,6 +46,8 @@
 
 #include "abstract_atomic.h"
 #include "abstract_mem.h"
+#include "gsh_intrinsic.h"
+#include "avltree.h"
 #include "hashtable.h"
 #include "fsal_pnfs.h"
 #include "config_parsing.h"
@@ -63,6 +65,7 @@
 
 typedef struct nfs_client_id_t		nfs_client_id_t;
 typedef struct nfs41_session		nfs41_session_t;
+typedef struct nfs41_session_slot__	nfs41_session_slot_t;
 
 /**
 ** Consolidated circular dependencies
@@ -116,25 +119,35 @@ extern pool_t *nfs41_session_pool;
 extern hash_table_t *ht_session_id;
 
 /**
- * @brief Number of forechannel slots in a session
+ * @brief Maximum number of backchannel slots we'll use
  *
- * This is also the maximum number of backchannel slots we'll use,
- * even if the client offers more.
+ * We'll use no more, even if the client offers more.
  */
-#define NFS41_NB_SLOTS 3
+#define NFS41_NB_SLOTS 16
+
+/**
+ * @brief Largest encoded reply kept in a slot's reply cache
+ *
+ * Replies of sessions are further limited by ca_maxresponsesize_cached.
+ */
+#define NFS41_MAX_CACHED_REPLY 65536
 
 /**
  * @brief Members in the slot table
+ *
+ * Each slot has a cache line of its own, so that the connections of a
+ * trunked session working different slots do not bounce each other's
+ * locks.
  */
 
-typedef struct nfs41_session_slot__ {
+struct nfs41_session_slot__ {
 	sequenceid4 sequence;	/*< Sequence number of this operation */
 	pthread_mutex_t lock;	/*< Lock on the slot */
-	struct COMPOUND4res_extended cached_result;	/*< NFv41: pointer to
-							   cached RPC result in
-							   a session's slot */
+	nfsstat4 cached_status;	/*< Status of the cached reply */
+	char *cached_xdr;	/*< Cached reply, as encoded on the wire */
+	u_int cached_xdr_len;	/*< Length of cached_xdr */
 	unsigned int cache_used;	/*< If we cached the result */
-} nfs41_session_slot_t;
+} __attribute__ ((aligned(GSH_CACHE_LINE_SIZE)));
 
 /**
  * @brief Bookkeeping for callback slots on the client
@@ -170,7 +183,8 @@ struct nfs41_session {
 	SVCXPRT *xprt;		/*< Referenced pointer to transport */
 
 	channel_attrs4 fore_channel_attrs;	/*< Fore-channel attributes */
-	nfs41_session_slot_t slots[NFS41_NB_SLOTS];	/*< Slot table */
+	nfs41_session_slot_t *slots;	/*< Slot table, ca_maxrequests long */
+	uint32_t target_slots;	/*< Slots we last asked the client to use */
 
 	channel_attrs4 back_channel_attrs;	/*< Back-channel attributes */
 	nfs41_cb_session_slot_t cb_slots[NFS41_NB_SLOTS];	/*< Callback
@@ -216,6 +230,7 @@ typedef struct rdel_fh {
 typedef struct clid_entry {
 	struct glist_head cl_list;	/*< Link in the list */
 	struct glist_head cl_rfh_list;
+	bool cl_reclaimed;	/*< Sent RECLAIM_COMPLETE this grace */
 	char cl_name[PATH_MAX];	/*< Client name */
 } clid_entry_t;
 
@@ -328,6 +343,8 @@ struct state_layout {
 	uint32_t granting;	/*< Number of LAYOUTGETs in progress */
 	bool state_return_on_close;	/*< Whether this layout should be
 					   returned on last close. */
+	deviceid4 state_deviceid;	/*< Device of the last file layout
+					   granted, for LAYOUTSTATS */
 };
 
 /**
@@ -478,6 +495,8 @@ typedef struct state_nsm_client_t {
 				   structure */
 	int32_t ssc_monitored;	/*< If this client is actively
 				   monitored */
+	bool ssc_mon_pending;	/*< An SM_MON is queued for this client,
+				   protected by ssc_mutex */
 	int32_t ssc_nlm_caller_name_len;	/*< Length of identifier */
 	char *ssc_nlm_caller_name;	/*< Client identifier */
 } state_nsm_client_t;
@@ -497,6 +516,10 @@ struct state_nlm_client_t {
 	char *slc_nlm_caller_name;	/*< Client name */
 	CLIENT *slc_callback_clnt;	/*< Callback for blocking locks */
 	AUTH *slc_callback_auth;	/*< Authentication for callback */
+	pthread_mutex_t slc_callback_mutex; /*< Serializes use of the
+					       callback client */
+	uint32_t slc_callback_inflight;	/*< GRANTED_MSG callbacks still
+					   awaiting a GRANTED_RES */
 };
 
 /**
@@ -585,6 +608,14 @@ struct state_nfs4_owner_t {
  * information is contained within the union.
  */
 
+/**
+ * @brief Owner names up to this length are kept in the owner itself
+ *
+ * This covers the open and lock owners of the common clients, so an
+ * owner takes a single allocation.
+ */
+#define STATE_OWNER_INLINE_LEN 32
+
 struct state_owner_t {
 	state_owner_type_t so_type;	/*< Owner type */
 	struct glist_head so_lock_list;	/*< Locks for this owner */
@@ -595,6 +626,7 @@ struct state_owner_t {
 	int32_t so_refcount;	/*< Reference count for lifecyce management */
 	int so_owner_len;	/*< Length of owner name */
 	char *so_owner_val;	/*< Owner name */
+	char so_owner_inline[STATE_OWNER_INLINE_LEN]; /*< Short owner name */
 	union {
 		state_nfs4_owner_t so_nfs4_owner; /*< All NFSv4 state owners */
 		state_nlm_owner_t so_nlm_owner;	/*< NLM lock and share
@@ -653,12 +685,14 @@ struct nfs_client_id_t {
 	clientid4 cid_clientid;	/*< The clientid */
 	verifier4 cid_verifier;	/*< Known verifier */
 	verifier4 cid_incoming_verifier; /*< Most recently supplied verifier */
-	time_t cid_last_renew;	/*< Time of last renewal */
+	time_t cid_last_renew;	/*< Time of last renewal, atomic */
 	nfs_clientid_confirm_state_t cid_confirmed; /*< Confirm/expire state */
 	nfs_client_cred_t cid_credential;	/*< Client credential */
 	int cid_allow_reclaim;	/*< Whether this client can still
 				   reclaim state */
 	char *cid_recov_dir;	/*< Recovery directory */
+	uint64_t cid_recov_seq;	/*< Recovery record not yet known to be
+				   durable, 0 if none */
 	nfs_client_record_t *cid_client_record;	/*< Record for managing
 						   confirmation and
 						   replacement */
@@ -695,8 +729,12 @@ struct nfs_client_id_t {
 						   creation. */
 	state_owner_t cid_owner;	/*< Owner for per-client state */
 	int32_t cid_refcount;	/*< Reference count for lifecycle */
-	int cid_lease_reservations;	/*< Counted lease reservations, to spare
-					   this clientid from the reaper */
+	int32_t cid_lease_reservations;	/*< Counted lease reservations, to
+					   spare this clientid from the reaper,
+					   atomic */
+	struct glist_head cid_lease_list; /*< Link in the lease expiry wheel,
+					      protected by its mutex */
+	time_t cid_lease_due;	/*< When the reaper looks at it next */
 	uint32_t cid_minorversion;
 	uint32_t cid_stateid_counter;
 
@@ -819,6 +857,9 @@ struct state_block_data_t {
 
 struct state_lock_entry_t {
 	struct glist_head sle_list;	/*< Locks on this file */
+	struct avltree_node sle_range_node; /*< Node in the file lock index */
+	bool sle_indexed;		/*< In the file lock index */
+	struct glist_head sle_blocked_list; /*< Blocked locks on this file */
 	struct glist_head sle_owner_locks; /*< Link on the owner lock list */
 	struct glist_head sle_client_locks;	/*< Locks on this client */
 	struct glist_head sle_state_locks;	/*< Locks on this state */
@@ -848,13 +889,20 @@ struct state_lock_entry_t {
  * enforced against v3 writes (v3 deny writes can not be enforced against
  * v3 writes because there is no connection between the share reservation
  * and the write operation). v3 reads will always be allowed.
+ *
+ * Anonymous I/O in flight is counted apart from the share reservations.
+ * Those two counts are changed without the state_lock, so the others are
+ * updated atomically and a new deny mode is checked against the anonymous
+ * I/O only once the deny count has been published.
  */
 typedef struct sal_share__ {
-	unsigned int share_access_read;
-	unsigned int share_access_write;
-	unsigned int share_deny_read;
-	unsigned int share_deny_write;
-	unsigned int share_deny_write_v4; /**< Count of v4 share deny write */
+	uint32_t share_access_read;
+	uint32_t share_access_write;
+	uint32_t share_deny_read;
+	uint32_t share_deny_write;
+	uint32_t share_deny_write_v4; /**< Count of v4 share deny write */
+	uint32_t share_anon_read;     /**< Anonymous reads in flight */
+	uint32_t share_anon_write;    /**< Anonymous writes in flight */
 } sal_share_t;
 
 /**
@@ -872,6 +920,11 @@ struct file_deleg_stats {
 	uint32_t fds_num_opens;         /* total num of opens so far. */
 	time_t fds_first_open;          /* time that we started recording
 					   num_opens */
+	uint32_t fds_open_heat;         /* opens, decayed by
+					   Deleg_Heat_Half_Life, in
+					   DELEG_HEAT_ONE units */
+	uint32_t fds_recall_heat;       /* recalls, decayed likewise */
+	time_t fds_heat_time;           /* time the heats were decayed to */
 };
 
 /**
@@ -888,9 +941,21 @@ struct state_file {
 	struct glist_head layoutrecall_list;
 	/** Pointers for lock list. Protected by state_lock */
 	struct glist_head lock_list;
+	/** Locks of lock_list by start offset. Protected by state_lock */
+	struct avltree lock_tree;
+	/** No lock in lock_tree is longer than this */
+	uint64_t lock_span;
+	/** Export of the locks in lock_tree, if lock_exports_mixed is
+	    false */
+	struct gsh_export *lock_export;
+	bool lock_exports_mixed;
+	/** Locks of lock_list that were blocked and not yet granted.
+	    Protected by state_lock */
+	struct glist_head blocked_locks;
 	/** Pointers for NLM share list. Protected by state_lock */
 	struct glist_head nlm_share_list;
-	/** Share reservation state for this file. Protected by state_lock */
+	/** Share reservation state for this file. Protected by state_lock,
+	    except for the anonymous I/O counts */
 	sal_share_t share_state;
 	bool write_delegated; /* true iff write delegated */
 	/** Delegation statistics. Protected by state_lock */
@@ -917,6 +982,13 @@ struct state_dir {
 	    for which this entry is a root for. This field is used
 	    with the atomic inc/dec/fetch routines. */
 	int32_t exp_root_refcount;
+	/** Directory delegations on this directory.
+	 * Protected by state_lock. */
+	struct glist_head list_of_states;
+	/** Number of directory delegations, so that changes to the
+	    directory can skip the state_lock when there are none.  This
+	    field is used with the atomic inc/dec/fetch routines. */
+	uint32_t deleg_count;
 };
 
 struct state_hdl {
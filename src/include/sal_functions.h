@@ -91,6 +91,9 @@ void state_release_export(struct gsh_export *exp);
 
 bool state_unlock_err_ok(state_status_t status);
 
+int state_lock_range_cmpf(const struct avltree_node *lhs,
+			  const struct avltree_node *rhs);
+
 /**
  * @brief Initialize a state handle
  *
@@ -110,11 +113,15 @@ static inline void state_hdl_init(struct state_hdl *ostate,
 		glist_init(&ostate->file.list_of_states);
 		glist_init(&ostate->file.layoutrecall_list);
 		glist_init(&ostate->file.lock_list);
+		avltree_init(&ostate->file.lock_tree, state_lock_range_cmpf,
+			     0);
+		glist_init(&ostate->file.blocked_locks);
 		glist_init(&ostate->file.nlm_share_list);
 		ostate->file.obj = obj;
 		break;
 	case DIRECTORY:
 		glist_init(&ostate->dir.export_roots);
+		glist_init(&ostate->dir.list_of_states);
 		break;
 	default:
 		break;
@@ -353,6 +360,7 @@ int display_session(struct display_buffer *dspbuf, nfs41_session_t *session);
 
 int32_t inc_session_ref(nfs41_session_t *session);
 int32_t dec_session_ref(nfs41_session_t *session);
+void nfs41_Session_Slot_Uncache(nfs41_session_slot_t *slot);
 
 int display_session_id_key(struct gsh_buffdesc *buff, char *str);
 int display_session_id_val(struct gsh_buffdesc *buff, char *str);
@@ -371,6 +379,14 @@ int nfs41_Session_Set(nfs41_session_t *session_data);
 int nfs41_Session_Get_Pointer(char sessionid[NFS4_SESSIONID_SIZE],
 			      nfs41_session_t **session_data);
 
+struct xprt_session_cache;
+
+struct xprt_session_cache *xprt_session_cache_alloc(void);
+void xprt_session_cache_free(struct xprt_session_cache *cache);
+int nfs41_Session_Get_Pointer_cached(struct xprt_session_cache *cache,
+				     char sessionid[NFS4_SESSIONID_SIZE],
+				     nfs41_session_t **session_data);
+
 int nfs41_Session_Del(char sessionid[NFS4_SESSIONID_SIZE]);
 void nfs41_Build_sessionid(clientid4 *clientid, char *sessionid);
 void nfs41_Session_PrintAll(void);
@@ -476,6 +492,12 @@ uint64_t state_id_rbt_hash_func(hash_parameter_t *hparam,
 int reserve_lease(nfs_client_id_t *clientid);
 void update_lease(nfs_client_id_t *clientid);
 bool valid_lease(nfs_client_id_t *clientid);
+bool freeze_expired_lease(nfs_client_id_t *clientid);
+void lease_wheel_init(void);
+void lease_wheel_add(nfs_client_id_t *clientid);
+void lease_wheel_resched(nfs_client_id_t *clientid);
+void lease_wheel_del(nfs_client_id_t *clientid);
+nfs_client_id_t *lease_wheel_next_due(void);
 
 /******************************************************************************
  *
@@ -827,6 +849,7 @@ bool get_state_obj_export_owner_refs(state_t *state,
 				       state_owner_t **owner);
 
 void state_nfs4_state_wipe(struct state_hdl *ostate);
+void state_nfs4_dir_state_wipe(struct state_hdl *ostate);
 
 enum nfsstat4 release_lock_owner(state_owner_t *owner);
 void release_openstate(state_owner_t *owner);
@@ -860,6 +883,8 @@ void init_new_deleg_state(union state_data *deleg_state,
 			  open_delegation_type4 sd_type,
 			  nfs_client_id_t *clientid);
 
+void deleg_heuristics_open(struct state_hdl *ostate);
+void deleg_heuristics_conflict(struct state_hdl *ostate);
 void deleg_heuristics_recall(struct fsal_obj_handle *obj,
 			     state_owner_t *owner,
 			     struct state_t *deleg);
@@ -867,10 +892,17 @@ void get_deleg_perm(nfsace4 *permissions, open_delegation_type4 type);
 void update_delegation_stats(struct state_hdl *ostate,
 			     state_owner_t *owner,
 			     struct state_t *deleg);
-state_status_t delegrecall_impl(struct fsal_obj_handle *obj);
+state_status_t delegrecall_impl(struct fsal_obj_handle *obj, bool urgent);
 nfsstat4 deleg_revoke(struct fsal_obj_handle *obj, struct state_t *deleg_state);
 void state_deleg_revoke(struct fsal_obj_handle *obj, state_t *state);
 bool state_deleg_conflict(struct fsal_obj_handle *obj, bool write);
+bool dir_deleg_supported(struct fsal_obj_handle *obj,
+			 struct export_perms *export_perms);
+state_status_t acquire_dir_deleg(struct fsal_obj_handle *obj,
+				 nfs_client_id_t *client,
+				 struct state_refer *refer,
+				 state_t **state);
+bool state_dir_deleg_conflict(struct fsal_obj_handle *obj);
 
 /******************************************************************************
  *
@@ -988,23 +1020,76 @@ void process_blocked_lock_upcall(state_block_data_t *block_data);
 
 void blocked_lock_polling(struct fridgethr_context *ctx);
 
+/******************************************************************************
+ *
+ * NFSv4.1 lock notification functions
+ *
+ ******************************************************************************/
+
+void nfs4_lock_notify_wait(nfs_client_id_t *clientid,
+			   state_owner_t *owner,
+			   struct fsal_obj_handle *obj,
+			   nfs_fh4 *fh,
+			   fsal_lock_param_t *lock);
+void nfs4_lock_notify_granted(state_owner_t *owner,
+			      struct fsal_obj_handle *obj);
+void nfs4_lock_notify_release(struct fsal_obj_handle *obj,
+			      fsal_lock_param_t *lock);
+
 /******************************************************************************
  *
  * NFSv4 Recovery functions
  *
  ******************************************************************************/
 
+/**
+ * @brief Stable storage for the clients allowed to reclaim
+ *
+ * Changes are handed to the backend in order by a single writer, in
+ * batches followed by a call to sync, which must make them all
+ * durable.  read_clids is called by the writer too, holding
+ * grace_mutex, and adds what it finds to clid_list.
+ */
+struct nfs4_recovery_backend {
+	const char *name;
+	void (*recovery_init)(void);
+	void (*recovery_cleanup)(void);
+	void (*read_clids)(nfs_grace_start_t *gsp);
+	void (*add_clid)(const char *cl_name);
+	void (*rm_clid)(const char *cl_name);
+	void (*add_revoke_fh)(const char *cl_name, const char *rhdlstr);
+	void (*sync)(void);
+};
+
+extern struct nfs4_recovery_backend fs_backend;
+extern struct nfs4_recovery_backend fs_log_backend;
+
+extern struct glist_head clid_list;
+
 void nfs4_start_grace(nfs_grace_start_t *gsp);
 int nfs_in_grace(void);
+bool nfs_in_local_grace(void);
+void nfs4_recovery_reclaim_complete(nfs_client_id_t *);
+void nfs_grace_status(uint32_t *remaining, uint32_t *clients,
+		      uint32_t *reclaimed);
 void nfs4_add_clid(nfs_client_id_t *);
-void nfs4_rm_clid(const char *, char *, int);
+void nfs4_wait_clid(nfs_client_id_t *);
+void nfs4_rm_clid(nfs_client_id_t *);
 void nfs4_chk_clid(nfs_client_id_t *);
 void nfs4_load_recov_clids(nfs_grace_start_t *gsp);
-void nfs4_clean_old_recov_dir(char *);
-void nfs4_create_recov_dir(void);
+void nfs4_free_clid_entry(clid_entry_t *clid_ent);
+void nfs4_recovery_init(void);
+void nfs4_recovery_cleanup(void);
 void nfs4_record_revoke(nfs_client_id_t *, nfs_fh4 *);
 bool nfs4_check_deleg_reclaim(nfs_client_id_t *, nfs_fh4 *);
 
+/* in nfs4_cluster_grace.c */
+
+void nfs4_cluster_grace_init(void);
+void nfs4_cluster_grace_shutdown(void);
+void nfs4_cluster_grace_mark(void);
+bool nfs4_cluster_in_grace(void);
+
 /**
  * @brief Check to see if an object is a junction
  *
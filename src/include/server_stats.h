@@ -41,14 +41,25 @@
 
 #include <sys/types.h>
 
+struct fsal_obj_handle;
+struct gsh_stats_shm;
+
+void server_stats_init(void);
+void server_stats_shm_fill(struct gsh_stats_shm *shm);
+int stats_shm_start(void);
+void stats_shm_shutdown(void);
 void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup);
+uint64_t server_stats_cpu_now(void);
+void server_stats_cpu_done(request_data_t *reqdata, uint64_t encode_ns);
+void server_stats_nfsv4_op_cpu(int proto_op, uint64_t cpu_start);
 
 #ifdef _USE_9P
 void server_stats_9p_done(u8 msgtype, struct _9p_request_data *req9p);
 #endif
 
-void server_stats_io_done(size_t requested,
-			  size_t transferred, bool success, bool is_write);
+void server_stats_io_done(struct fsal_obj_handle *obj, uint64_t offset,
+			  size_t requested, size_t transferred, bool success,
+			  bool is_write);
 void server_stats_compound_done(int num_ops, int status);
 void server_stats_nfsv4_op_done(int proto_op,
 				nsecs_elapsed_t start_time, int status);
@@ -63,6 +74,9 @@ void dec_grants(struct gsh_client *client);
 void inc_revokes(struct gsh_client *client);
 void inc_recalls(struct gsh_client *client);
 void inc_failed_recalls(struct gsh_client *client);
+void inc_heat_declines(struct gsh_client *client);
+void inc_budget_declines(struct gsh_client *client);
+void record_recall_latency(struct gsh_client *client, nsecs_elapsed_t latency);
 
 #endif				/* !SERVER_STATS_H */
 /** @} */
@@ -60,6 +60,12 @@ struct nfsv41_stats;
 struct nfsv42_stats;
 struct deleg_stats;
 struct _9p_stats;
+struct io_dist_stats;
+struct cpu_stats;
+
+/* Each protocol pointer is an array of counter slabs, one per stats
+ * shard, allocated on first use.  deleg is a single struct.
+ */
 
 struct gsh_stats {
 	struct nfsv3_stats *nfsv3;
@@ -71,6 +77,8 @@ struct gsh_stats {
 	struct nfsv41_stats *nfsv42;
 	struct deleg_stats *deleg;
 	struct _9p_stats *_9p;
+	struct io_dist_stats *io_dist;
+	struct cpu_stats *cpu;
 };
 
 /**
@@ -202,11 +210,12 @@ struct export_stats {
 }
 
 /* number of delegations, number of sent recalls,
- * number of failed recalls, number of revokes */
+ * number of failed recalls, number of revokes, heat and budget
+ * declines, answered recalls, total and max recall latency */
 #define DELEG_REPLY		       \
 {				       \
 	.name = "delegation_stats",    \
-	.type = "(tttt)",	       \
+	.type = "(uuuuuuutt)",	       \
 	.direction = "out"	       \
 }
 
@@ -235,6 +244,60 @@ struct export_stats {
 	.direction = "out"  \
 }
 
+#define LATENCY_HIST_REPLY     \
+{                              \
+	.name = "latency",     \
+	.type = "a(sa(tt))",   \
+	.direction = "out"     \
+}
+
+#define LOCK_PROF_REPLY        \
+{                              \
+	.name = "locks",       \
+	.type = "a(sustttt)",  \
+	.direction = "out"     \
+}
+#define MEMORY_REPLY           \
+{                              \
+	.name = "memory",      \
+	.type = "a(sxx)",      \
+	.direction = "out"     \
+}
+
+#define FRIDGE_REPLY           \
+{                              \
+	.name = "fridges",     \
+	.type = "a(suuuuttt)", \
+	.direction = "out"     \
+}
+
+#define IO_DIST_REPLY          \
+{                              \
+	.name = "io_dist",     \
+	.type = "a(satttt)",   \
+	.direction = "out"     \
+}
+
+#define BY_BYTES_ARG           \
+{                              \
+	.name = "by_bytes",    \
+	.type = "b",           \
+	.direction = "in"      \
+}
+
+#define TOP_FILES_REPLY        \
+{                              \
+	.name = "files",       \
+	.type = "a(qttt)",     \
+	.direction = "out"     \
+}
+
+#define TOP_CLIENTS_REPLY      \
+{                              \
+	.name = "clients",     \
+	.type = "a(stt)",      \
+	.direction = "out"     \
+}
 
 void server_stats_summary(DBusMessageIter *iter, struct gsh_stats *st);
 void server_dbus_v3_iostats(struct nfsv3_stats *v3p, DBusMessageIter *iter);
@@ -250,7 +313,17 @@ void server_dbus_total_ops(struct export_stats *export_st,
 			   DBusMessageIter *iter);
 void global_dbus_total_ops(DBusMessageIter *iter);
 void server_dbus_fast_ops(DBusMessageIter *iter);
+void server_dbus_latency_hist(struct gsh_stats *st, DBusMessageIter *iter);
+void server_dbus_io_dist(struct gsh_stats *st, DBusMessageIter *iter);
+void global_dbus_op_latency_hist(DBusMessageIter *iter);
 void mdcache_dbus_show(DBusMessageIter *iter);
+void dupreq_dbus_show(DBusMessageIter *iter);
+void lock_prof_dbus_show(DBusMessageIter *iter);
+void mem_dbus_show(DBusMessageIter *iter);
+void fridgethr_dbus_show(DBusMessageIter *iter);
+struct lat_hist;
+void server_dbus_lat_hist(char *name, struct lat_hist *h,
+			  DBusMessageIter *iter);
 void server_reset_stats(DBusMessageIter *iter);
 void reset_export_stats(void);
 void reset_client_stats(void);
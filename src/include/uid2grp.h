@@ -57,6 +57,7 @@ typedef struct group_data {
 	time_t epoch;
 	int nbgroups;
 	unsigned int refcount;
+	uint32_t refreshing;	/*< A background refresh is queued */
 	pthread_mutex_t lock;
 	gid_t *groups;
 } group_data_t;
@@ -75,6 +76,7 @@ void uid2grp_remove_by_uid(const uid_t);
 
 void uid2grp_clear_cache(void);
 
+void uid2grp_init(void);
 bool uid2grp(uid_t uid, struct group_data **);
 bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata);
 void uid2grp_unref(struct group_data *gdata);
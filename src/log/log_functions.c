@@ -48,6 +48,8 @@
 #include "gsh_rpc.h"
 #include "common_utils.h"
 #include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
 
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
@@ -299,6 +301,8 @@ void Cleanup(void)
 {
 	cleanup_list_element *c = cleanup_list;
 
+	log_async_stop();
+
 	while (c != NULL) {
 		c->clean();
 		c = c->next;
@@ -415,6 +419,123 @@ void SetClientIP(char *ip_str)
 	clientip = ip_str;
 }
 
+/*
+ * Log filters raise the level of a component for the requests of one
+ * client, one export or a range of xids only, so a single misbehaving
+ * client can be debugged on a busy server.
+ */
+struct log_filter {
+	char client[SOCK_NAME_MAX];	/* empty matches any client */
+	int32_t export_id;		/* -1 matches any export */
+	uint32_t xid_min;
+	uint32_t xid_max;
+	log_components_t component;
+	log_levels_t level;
+};
+
+static struct log_filter log_filters[LOG_MAX_FILTERS];
+static uint32_t log_nfilters;
+static pthread_rwlock_t log_filters_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+__thread log_levels_t *log_request_levels;
+static __thread log_levels_t log_filtered_levels[COMPONENT_COUNT];
+
+int log_filter_add(const char *client, int32_t export_id, uint32_t xid_min,
+		   uint32_t xid_max, log_components_t component,
+		   log_levels_t level)
+{
+	struct log_filter *f;
+	int rc = 0;
+
+	if (client == NULL)
+		client = "";
+
+	if (strlen(client) >= sizeof(f->client))
+		return EINVAL;
+
+	PTHREAD_RWLOCK_wrlock(&log_filters_lock);
+
+	if (log_nfilters >= LOG_MAX_FILTERS) {
+		rc = ENOSPC;
+		goto out;
+	}
+
+	f = &log_filters[log_nfilters];
+	strcpy(f->client, client);
+	f->export_id = export_id;
+	f->xid_min = xid_min;
+	f->xid_max = xid_max;
+	f->component = component;
+	f->level = level;
+	atomic_store_uint32_t(&log_nfilters, log_nfilters + 1);
+
+ out:
+	PTHREAD_RWLOCK_unlock(&log_filters_lock);
+	return rc;
+}
+
+void log_filter_clear_all(void)
+{
+	PTHREAD_RWLOCK_wrlock(&log_filters_lock);
+	atomic_store_uint32_t(&log_nfilters, 0);
+	PTHREAD_RWLOCK_unlock(&log_filters_lock);
+}
+
+/**
+ * @brief Pick the log levels of the request this thread works on
+ *
+ * @param[in] client     Address of the client, may be NULL
+ * @param[in] export_id  Export of the request, -1 if not known yet
+ * @param[in] xid        Xid of the request
+ */
+void log_filter_match(const char *client, int32_t export_id, uint32_t xid)
+{
+	struct log_filter *f;
+	bool matched = false;
+	uint32_t i;
+	int c;
+
+	log_request_levels = NULL;
+
+	/* Keep the common case to one load */
+	if (likely(atomic_fetch_uint32_t(&log_nfilters) == 0))
+		return;
+
+	PTHREAD_RWLOCK_rdlock(&log_filters_lock);
+
+	for (i = 0; i < log_nfilters; i++) {
+		f = &log_filters[i];
+
+		if (f->client[0] != '\0' &&
+		    (client == NULL || strcmp(f->client, client) != 0))
+			continue;
+		if (f->export_id != -1 && f->export_id != export_id)
+			continue;
+		if (xid < f->xid_min || xid > f->xid_max)
+			continue;
+
+		if (!matched) {
+			memcpy(log_filtered_levels, component_log_level,
+			       sizeof(log_filtered_levels));
+			matched = true;
+		}
+
+		if (f->component == COMPONENT_ALL) {
+			for (c = 0; c < COMPONENT_COUNT; c++)
+				log_filtered_levels[c] =
+					MAX(log_filtered_levels[c], f->level);
+		} else {
+			log_filtered_levels[f->component] =
+			    MAX(log_filtered_levels[f->component], f->level);
+		}
+	}
+
+	PTHREAD_RWLOCK_unlock(&log_filters_lock);
+
+	if (matched)
+		log_request_levels = log_filtered_levels;
+}
+
 /* Installs a signal handler */
 static void ArmSignal(int signal, void (*action) ())
 {
@@ -1455,6 +1576,369 @@ static int display_log_component(struct display_buffer *dsp_log,
 	return b_left;
 }
 
+/*
+ * Asynchronous logging
+ *
+ * With LOG { Async = true; } a thread formats its messages as usual
+ * and then copies them to a ring of its own instead of writing them
+ * to the facilities.  A single writer thread drains the rings.  Each
+ * ring has one producer, its thread, and one consumer, the writer, so
+ * neither side takes a lock.  When a ring is full the message is
+ * dropped and counted rather than making the thread wait for the
+ * writer, and the writer reports the drops.
+ *
+ * FATAL and MAJ messages are still written synchronously, so that
+ * they reach the log before the server dies.
+ *
+ * The mutexes below are taken with the raw pthread calls, the
+ * PTHREAD_MUTEX_xxx macros log.
+ */
+
+/** Alignment of the records in a ring */
+#define LOG_REC_ALIGN 16
+
+/** How long the writer sleeps when all rings are empty, in ms */
+#define LOG_WRITER_SLEEP 100
+
+/**
+ * @brief A message in a ring
+ *
+ * A record with a len of 0 fills the end of the ring when the next
+ * message does not fit there.
+ */
+struct log_rec {
+	uint32_t size;		/*< Bytes taken in the ring, header included */
+	uint32_t len;		/*< Length of the message */
+	uint16_t comp_off;	/*< Offset of the component header */
+	uint16_t msg_off;	/*< Offset of the message proper */
+	uint32_t level;
+	char text[];		/*< Room for len + 2 characters */
+};
+
+/**
+ * @brief The ring of one thread
+ */
+struct log_ring {
+	struct glist_head list;	/*< On log_rings */
+	char *buf;
+	uint32_t size;
+	uint32_t dead;		/*< Set when the thread exits */
+	uint64_t reported;	/*< Drops already reported by the writer */
+	uint64_t tail;		/*< Bytes consumed, written by the writer */
+	GSH_CACHE_PAD(0);
+	uint64_t head;		/*< Bytes produced, written by the thread */
+	uint64_t dropped;	/*< Messages that did not fit */
+};
+
+static uint32_t log_async_running;
+static uint32_t log_async_stopping;
+static uint32_t log_async_sleeping;
+static uint32_t log_async_ring_size = 65536;
+static bool log_async_started;
+static pthread_t log_async_thrid;
+static pthread_mutex_t log_async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_async_cond = PTHREAD_COND_INITIALIZER;
+
+static struct glist_head log_rings = GLIST_HEAD_INIT(log_rings);
+static pthread_mutex_t log_rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t log_ring_key;
+static pthread_once_t log_ring_once = PTHREAD_ONCE_INIT;
+static __thread struct log_ring *log_ring_self;
+static __thread bool log_async_writer_self;
+
+static void log_ring_unregister(void *arg)
+{
+	struct log_ring *ring = arg;
+
+	/* The writer frees the ring once it is drained, messages logged
+	 * by destructors that run after this one get a new ring.
+	 */
+	log_ring_self = NULL;
+	atomic_store_uint32_t(&ring->dead, 1);
+}
+
+static void log_ring_key_init(void)
+{
+	(void)pthread_key_create(&log_ring_key, log_ring_unregister);
+}
+
+static struct log_ring *log_ring_register(void)
+{
+	struct log_ring *ring = gsh_calloc(1, sizeof(*ring));
+
+	(void)pthread_once(&log_ring_once, log_ring_key_init);
+
+	ring->size = atomic_fetch_uint32_t(&log_async_ring_size);
+	ring->buf = gsh_malloc(ring->size);
+
+	pthread_mutex_lock(&log_rings_mutex);
+	glist_add_tail(&log_rings, &ring->list);
+	pthread_mutex_unlock(&log_rings_mutex);
+
+	(void)pthread_setspecific(log_ring_key, ring);
+	log_ring_self = ring;
+
+	return ring;
+}
+
+/**
+ * @brief Write a message to the active facilities
+ */
+static void log_to_facilities(log_levels_t level,
+			      struct display_buffer *dsp_log,
+			      char *compstr, char *message)
+{
+	struct glist_head *glist;
+	struct log_facility *facility;
+
+	PTHREAD_RWLOCK_rdlock(&log_rwlock);
+
+	glist_for_each(glist, &active_facility_list) {
+		facility = glist_entry(glist, struct log_facility, lf_active);
+
+		if (level <= facility->lf_max_level
+		    && facility->lf_func != NULL)
+			facility->lf_func(facility->lf_headers,
+					  facility->lf_private,
+					  level, dsp_log,
+					  compstr, message);
+	}
+
+	PTHREAD_RWLOCK_unlock(&log_rwlock);
+}
+
+/**
+ * @brief Queue a formatted message for the writer
+ *
+ * @return false if the message must be written synchronously.
+ */
+static bool log_async_post(log_levels_t level,
+			   struct display_buffer *dsp_log,
+			   char *compstr, char *message)
+{
+	struct log_ring *ring = log_ring_self;
+	struct log_rec *rec;
+	uint64_t head, used;
+	uint32_t len, need, pos, fill;
+
+	if (level <= NIV_MAJ || log_async_writer_self ||
+	    !atomic_fetch_uint32_t(&log_async_running))
+		return false;
+
+	if (unlikely(ring == NULL))
+		ring = log_ring_register();
+
+	len = display_buffer_len(dsp_log);
+	need = sizeof(*rec) + len + 2;
+	need = (need + LOG_REC_ALIGN - 1) & ~(LOG_REC_ALIGN - 1);
+
+	head = ring->head;
+	used = head - atomic_fetch_uint64_t(&ring->tail);
+	pos = head % ring->size;
+	fill = ring->size - pos < need ? ring->size - pos : 0;
+
+	if (fill + need > ring->size - used) {
+		(void)atomic_inc_uint64_t(&ring->dropped);
+		return true;
+	}
+
+	if (fill != 0) {
+		rec = (struct log_rec *)(ring->buf + pos);
+		rec->size = fill;
+		rec->len = 0;
+		head += fill;
+		pos = 0;
+	}
+
+	rec = (struct log_rec *)(ring->buf + pos);
+	rec->size = need;
+	rec->len = len;
+	rec->comp_off = compstr - dsp_log->b_start;
+	rec->msg_off = message - dsp_log->b_start;
+	rec->level = level;
+	memcpy(rec->text, dsp_log->b_start, len);
+	rec->text[len] = '\0';
+
+	atomic_store_uint64_t(&ring->head, head + need);
+
+	if (atomic_fetch_uint32_t(&log_async_sleeping)) {
+		pthread_mutex_lock(&log_async_mutex);
+		pthread_cond_signal(&log_async_cond);
+		pthread_mutex_unlock(&log_async_mutex);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Write out what a ring holds
+ *
+ * @return the number of messages written.
+ */
+static uint32_t log_ring_drain(struct log_ring *ring)
+{
+	uint64_t head = atomic_fetch_uint64_t(&ring->head);
+	uint64_t tail = ring->tail;
+	struct display_buffer dsp;
+	struct log_rec *rec;
+	uint32_t count = 0;
+
+	while (tail != head) {
+		rec = (struct log_rec *)(ring->buf + tail % ring->size);
+
+		if (rec->len != 0) {
+			dsp.b_size = rec->len + 2;
+			dsp.b_start = rec->text;
+			dsp.b_current = rec->text + rec->len;
+			log_to_facilities(rec->level, &dsp,
+					  rec->text + rec->comp_off,
+					  rec->text + rec->msg_off);
+			count++;
+		}
+
+		tail += rec->size;
+		atomic_store_uint64_t(&ring->tail, tail);
+	}
+
+	return count;
+}
+
+/**
+ * @brief Drain all the rings once
+ *
+ * @param[out] dropped  Messages dropped since the last call
+ *
+ * @return the number of messages written.
+ */
+static uint32_t log_rings_drain(uint64_t *dropped)
+{
+	struct glist_head *glist, *glistn;
+	struct log_ring *ring;
+	uint32_t count = 0;
+	uint32_t dead;
+	uint64_t d;
+
+	*dropped = 0;
+
+	pthread_mutex_lock(&log_rings_mutex);
+
+	glist_for_each_safe(glist, glistn, &log_rings) {
+		ring = glist_entry(glist, struct log_ring, list);
+
+		/* Read dead first, a dead ring is empty for good once
+		 * drained after that.
+		 */
+		dead = atomic_fetch_uint32_t(&ring->dead);
+
+		count += log_ring_drain(ring);
+
+		d = atomic_fetch_uint64_t(&ring->dropped);
+		*dropped += d - ring->reported;
+		ring->reported = d;
+
+		if (dead) {
+			glist_del(&ring->list);
+			gsh_free(ring->buf);
+			gsh_free(ring);
+		}
+	}
+
+	pthread_mutex_unlock(&log_rings_mutex);
+
+	return count;
+}
+
+static void *log_async_writer(void *arg)
+{
+	struct timespec ts;
+	uint64_t dropped;
+	bool stopping;
+
+	SetNameFunction("log_writer");
+	log_async_writer_self = true;
+
+	for (;;) {
+		stopping = atomic_fetch_uint32_t(&log_async_stopping);
+
+		if (log_rings_drain(&dropped) == 0 && dropped == 0) {
+			if (stopping)
+				break;
+
+			pthread_mutex_lock(&log_async_mutex);
+			atomic_store_uint32_t(&log_async_sleeping, 1);
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += LOG_WRITER_SLEEP * 1000000L;
+			if (ts.tv_nsec >= 1000000000L) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+			(void)pthread_cond_timedwait(&log_async_cond,
+						     &log_async_mutex, &ts);
+			atomic_store_uint32_t(&log_async_sleeping, 0);
+			pthread_mutex_unlock(&log_async_mutex);
+		}
+
+		if (dropped != 0)
+			LogWarn(COMPONENT_LOG,
+				"%" PRIu64
+				" log messages dropped, the async log buffers were full",
+				dropped);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Start writing log messages from a background thread
+ *
+ * @param[in] ring_size  Size of the ring of each thread that logs,
+ *                       threads that already have one keep it
+ */
+static void log_async_start(uint32_t ring_size)
+{
+	int rc;
+
+	atomic_store_uint32_t(&log_async_ring_size,
+			      ring_size & ~(LOG_REC_ALIGN - 1));
+
+	if (log_async_started)
+		return;
+
+	rc = pthread_create(&log_async_thrid, NULL, log_async_writer, NULL);
+	if (rc != 0) {
+		LogCrit(COMPONENT_LOG,
+			"Could not start the log writer (%s), logging synchronously",
+			strerror(rc));
+		return;
+	}
+
+	log_async_started = true;
+	atomic_store_uint32_t(&log_async_running, 1);
+	LogEvent(COMPONENT_LOG, "Logging asynchronously");
+}
+
+/**
+ * @brief Write out the queued messages and go back to logging
+ *        synchronously
+ */
+void log_async_stop(void)
+{
+	if (!log_async_started || log_async_writer_self)
+		return;
+
+	atomic_store_uint32_t(&log_async_running, 0);
+	atomic_store_uint32_t(&log_async_stopping, 1);
+
+	pthread_mutex_lock(&log_async_mutex);
+	pthread_cond_signal(&log_async_cond);
+	pthread_mutex_unlock(&log_async_mutex);
+
+	pthread_join(log_async_thrid, NULL);
+
+	log_async_started = false;
+	atomic_store_uint32_t(&log_async_stopping, 0);
+}
+
 void display_log_component_level(log_components_t component, const char *file,
 				int line, const char *function,
 				log_levels_t level, const char *format,
@@ -1463,8 +1947,6 @@ void display_log_component_level(log_components_t component, const char *file,
 	char *compstr;
 	char *message;
 	int b_left;
-	struct glist_head *glist;
-	struct log_facility *facility;
 	struct display_buffer dsp_log = {sizeof(log_buffer),
 					 log_buffer, log_buffer};
 
@@ -1494,20 +1976,8 @@ void display_log_component_level(log_components_t component, const char *file,
 		   component, level, file, line, function, message);
 #endif
 
-	PTHREAD_RWLOCK_rdlock(&log_rwlock);
-
-	glist_for_each(glist, &active_facility_list) {
-		facility = glist_entry(glist, struct log_facility, lf_active);
-
-		if (level <= facility->lf_max_level
-		    && facility->lf_func != NULL)
-			facility->lf_func(facility->lf_headers,
-					  facility->lf_private,
-					  level, &dsp_log,
-					  compstr, message);
-	}
-
-	PTHREAD_RWLOCK_unlock(&log_rwlock);
+	if (!log_async_post(level, &dsp_log, compstr, message))
+		log_to_facilities(level, &dsp_log, compstr, message);
 
 	if (level == NIV_FATAL)
 		Fatal();
@@ -1876,11 +2346,186 @@ static struct gsh_dbus_prop *log_props[] = {
 	NULL
 };
 
+/**
+ * @brief Find a component by name, with or without COMPONENT_
+ */
+static int log_component_by_name(const char *name)
+{
+	int component;
+
+	for (component = COMPONENT_ALL; component < COMPONENT_COUNT;
+	     component++) {
+		const char *comp_name = LogComponents[component].comp_name;
+
+		if (strcasecmp(name, comp_name) == 0 ||
+		    strcasecmp(name, comp_name + strlen("COMPONENT_")) == 0)
+			return component;
+	}
+
+	return -1;
+}
+
+/**
+ * DBUS method to add a log filter
+ *
+ * Raises the level of a component for the matching requests only.
+ * An empty client, an export id of -1 and the xid range 0..UINT32_MAX
+ * match any request.
+ */
+static bool dbus_log_add_filter(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	char *errormsg = "Filter added";
+	bool success = false;
+	DBusMessageIter iter;
+	char *client, *comp_name, *level_name;
+	int32_t export_id;
+	uint32_t xid_min, xid_max;
+	int component, level, rc;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		errormsg = "Filter arg 1 not a client address.";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &client);
+
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_INT32) {
+		errormsg = "Filter arg 2 not an export id.";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &export_id);
+
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+		errormsg = "Filter arg 3 not a xid.";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &xid_min);
+
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+		errormsg = "Filter arg 4 not a xid.";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &xid_max);
+
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		errormsg = "Filter arg 5 not a component.";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &comp_name);
+
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		errormsg = "Filter arg 6 not a log level.";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &level_name);
+
+	if (xid_min > xid_max) {
+		errormsg = "Empty xid range.";
+		goto out;
+	}
+
+	component = log_component_by_name(comp_name);
+	if (component < 0) {
+		errormsg = "Unknown component.";
+		goto out;
+	}
+
+	level = ReturnLevelAscii(level_name);
+	if (level < 0) {
+		errormsg = "Unknown log level.";
+		goto out;
+	}
+
+	rc = log_filter_add(client, export_id, xid_min, xid_max,
+			    component, level);
+	if (rc != 0) {
+		errormsg = rc == ENOSPC ? "Too many filters."
+					: "Client address too long.";
+		goto out;
+	}
+
+	success = true;
+	LogEvent(COMPONENT_LOG,
+		 "Logging %s at %s for client \"%s\" export %"PRIi32
+		 " xids %"PRIu32"..%"PRIu32,
+		 LogComponents[component].comp_name,
+		 ReturnLevelInt(level), client, export_id, xid_min, xid_max);
+
+ out:
+	if (!success)
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+	dbus_status_reply(&iter, success, errormsg);
+	return success;
+}
+
+static struct gsh_dbus_method log_add_filter = {
+	.name = "AddFilter",
+	.method = dbus_log_add_filter,
+	.args = {{.name = "client",
+		  .type = "s",
+		  .direction = "in"},
+		 {.name = "export_id",
+		  .type = "i",
+		  .direction = "in"},
+		 {.name = "xid_min",
+		  .type = "u",
+		  .direction = "in"},
+		 {.name = "xid_max",
+		  .type = "u",
+		  .direction = "in"},
+		 {.name = "component",
+		  .type = "s",
+		  .direction = "in"},
+		 {.name = "level",
+		  .type = "s",
+		  .direction = "in"},
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to remove all log filters
+ */
+static bool dbus_log_clear_filters(DBusMessageIter *args,
+				   DBusMessage *reply,
+				   DBusError *error)
+{
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	log_filter_clear_all();
+	LogEvent(COMPONENT_LOG, "Log filters cleared");
+	dbus_status_reply(&iter, true, "Filters cleared");
+	return true;
+}
+
+static struct gsh_dbus_method log_clear_filters = {
+	.name = "ClearFilters",
+	.method = dbus_log_clear_filters,
+	.args = {STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method *log_methods[] = {
+	&log_add_filter,
+	&log_clear_filters,
+	NULL
+};
+
 struct gsh_dbus_interface log_interface = {
 	.name = "org.ganesha.nfsd.log.component",
 	.signal_props = false,
 	.props = log_props,
-	.methods = NULL,
+	.methods = log_methods,
 	.signals = NULL
 };
 
@@ -1909,6 +2554,8 @@ struct facility_config {
 
 struct logger_config {
 	log_levels_t default_level;
+	bool async;
+	uint32_t async_buffer_size;
 	struct glist_head facility_list;
 	struct logfields *logfields;
 	log_levels_t *comp_log_level;
@@ -2528,6 +3175,10 @@ static int log_conf_commit(void *node, void *link_mem, void *self_struct,
 				gsh_free(component_log_level);
 			component_log_level = logger->comp_log_level;
 		}
+		if (logger->async)
+			log_async_start(logger->async_buffer_size);
+		else
+			log_async_stop();
 	} else {
 		if (logger->logfields != NULL) {
 			struct logfields *lf = logger->logfields;
@@ -2549,6 +3200,10 @@ static int log_conf_commit(void *node, void *link_mem, void *self_struct,
 static struct config_item logging_params[] = {
 	CONF_ITEM_TOKEN("Default_log_level", NB_LOG_LEVEL, log_levels,
 			 logger_config, default_level),
+	CONF_ITEM_BOOL("Async", false,
+		       logger_config, async),
+	CONF_ITEM_UI32("Async_Buffer_Size", 4096, 16777216, 65536,
+		       logger_config, async_buffer_size),
 	CONF_ITEM_BLOCK("Facility", facility_params,
 			facility_init, facility_commit,
 			logger_config, facility_list),
@@ -66,12 +66,10 @@ int vfs_readents(int fd, char *buf, unsigned int bcount, off_t *basepp)
 bool to_vfs_dirent(char *buf, int bpos, struct vfs_dirent *vd, off_t base)
 {
 	struct dirent64 *dp = (struct dirent64 *)(buf + bpos);
-	char type;
 
 	vd->vd_ino = dp->d_ino;
 	vd->vd_reclen = dp->d_reclen;
-	type = buf[dp->d_reclen - 1];
-	vd->vd_type = type;
+	vd->vd_type = dp->d_type;
 	vd->vd_offset = dp->d_off;
 	vd->vd_name = dp->d_name;
 	return true;
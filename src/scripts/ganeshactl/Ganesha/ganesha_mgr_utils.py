@@ -268,6 +268,28 @@ class AdminInterface():
         msg = reply[1]
         return status, msg
 
+    def set_tunable(self, name, value):
+        method = self.dbusobj.get_dbus_method("set_tunable",
+                                              self.dbus_interface)
+        try:
+           reply = method(name, dbus.UInt64(value))
+        except dbus.exceptions.DBusException as e:
+           return False, e
+
+        status = reply[0]
+        msg = reply[1]
+        return status, msg
+
+    def get_tunables(self):
+        method = self.dbusobj.get_dbus_method("get_tunables",
+                                              self.dbus_interface)
+        try:
+           reply = method()
+        except dbus.exceptions.DBusException as e:
+           return False, e, []
+
+        return True, "Done", reply
+
 
 LOGGER_PROPS = 'org.ganesha.nfsd.log.component'
 
@@ -321,3 +343,30 @@ class LogManager():
            return False, e
 
         return True, "Done"
+
+    def AddFilter(self, client, export_id, xid_min, xid_max, component,
+                  level):
+        add_method = self.dbusobj.get_dbus_method("AddFilter",
+                                                  LOGGER_PROPS)
+        try:
+           reply = add_method(client, dbus.Int32(export_id),
+                              dbus.UInt32(xid_min), dbus.UInt32(xid_max),
+                              component, level)
+        except dbus.exceptions.DBusException as e:
+           return False, e
+
+        status = reply[0]
+        msg = reply[1]
+        return status, msg
+
+    def ClearFilters(self):
+        clear_method = self.dbusobj.get_dbus_method("ClearFilters",
+                                                    LOGGER_PROPS)
+        try:
+           reply = clear_method()
+        except dbus.exceptions.DBusException as e:
+           return False, e
+
+        status = reply[0]
+        msg = reply[1]
+        return status, msg
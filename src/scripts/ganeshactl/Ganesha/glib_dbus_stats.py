@@ -151,6 +151,11 @@ class DelegStats():
             self.curr_recall = stats[3][1]
             self.fail_recall = stats[3][2]
             self.num_revokes = stats[3][3]
+            self.heat_declines = stats[3][4]
+            self.budget_declines = stats[3][5]
+            self.recall_replies = stats[3][6]
+            self.recall_latency = stats[3][7]
+            self.recall_latency_max = stats[3][8]
     def __str__(self):
         if self.status != "OK":
             return ("GANESHA RESPONSE STATUS: " + self.status)
@@ -160,7 +165,15 @@ class DelegStats():
                      "\nCurrent Delegations: " + str(self.curr_deleg) +
                      "\nCurrent Recalls: " + str(self.curr_recall) +
                      "\nCurrent Failed Recalls: " + str(self.fail_recall) +
-                     "\nCurrent Number of Revokes: " + str(self.num_revokes) )
+                     "\nCurrent Number of Revokes: " + str(self.num_revokes) +
+                     "\nDeclined for Recalls: " + str(self.heat_declines) +
+                     "\nDeclined for Budget: " + str(self.budget_declines) +
+                     "\nAnswered Recalls: " + str(self.recall_replies) +
+                     "\nAverage Recall Latency: " +
+                     str(self.recall_latency / max(self.recall_replies, 1)) +
+                     " nsecs" +
+                     "\nMax Recall Latency: " +
+                     str(self.recall_latency_max) + " nsecs" )
 
 class Export():
     def __init__(self, export):
@@ -170,6 +170,19 @@ class ServerAdmin():
         status, msg = self.admin.purge_netgroups()
         self.status_message(status, msg)
 
+    def set_tunable(self, name, value):
+        print "Set tunable %s to %s" % (name, value)
+        status, msg = self.admin.set_tunable(name, int(value))
+        self.status_message(status, msg)
+
+    def get_tunables(self):
+        status, msg, tunables = self.admin.get_tunables()
+        if status == True:
+           for name, value, minval, maxval in tunables:
+              print "%s = %d (%d..%d)" % (name, value, minval, maxval)
+        else:
+           self.status_message(status, msg)
+
     def status_message(self, status, errormsg):
         print "Returns: status = %s, %s" % (str(status), errormsg)
 
@@ -201,6 +214,20 @@ class ManageLogs():
         else:
            self.status_message(status, msg)
 
+    def add_filter(self, component, level, client, export_id, xid_min,
+                   xid_max):
+        print "Log %s at %s for client \"%s\" export %s xids %s..%s" % \
+              (component, level, client, export_id, xid_min, xid_max)
+        status, msg = self.logmgr.AddFilter(client, int(export_id),
+                                            int(xid_min), int(xid_max),
+                                            component, level)
+        self.status_message(status, msg)
+
+    def clear_filters(self):
+        print "Clear log filters"
+        status, msg = self.logmgr.ClearFilters()
+        self.status_message(status, msg)
+
     def show_loglevel(self, level):
         print "Log level: %s"% (str(level))
 
@@ -241,10 +268,18 @@ if __name__ == '__main__':
        "   shutdown: Shuts down the ganesha nfs server\n\n"                  \
        "   purge netgroups: Purges netgroups cache\n\n"                      \
        "   grace ipaddr: Begins grace for the given IP\n\n"                  \
+       "   set_tunable name value: \n"                                     \
+       "       Changes a tunable parameter of the running server\n\n"       \
+       "   get_tunables: Prints the tunable parameters\n\n"                 \
        "   get_log component: Gets the log level for the given component\n\n"\
        "   set_log component level: \n"                                      \
        "       Sets the given log level to the given component\n\n"          \
-       "   getall_logs: Prints all log components\n\n"
+       "   getall_logs: Prints all log components\n\n"                     \
+       "   add_log_filter component level [client [export_id [xid_min "     \
+       "xid_max]]]:\n"                                                    \
+       "       Sets the given log level to the given component for the\n"   \
+       "       matching requests only, \"\" and -1 match any\n\n"         \
+       "   clear_log_filters: Removes all log filters\n\n"
     if len(sys.argv) < 2:
        print "Too few arguments."\
              " Try \"ganesha_mgr.py help\" for more info"
@@ -311,6 +346,15 @@ if __name__ == '__main__':
            sys.exit(1)
         ganesha.grace(sys.argv[2])
 
+    elif sys.argv[1] == "set_tunable":
+        if len(sys.argv) < 4:
+           print "set_tunable requires a name and a value."\
+                 " Try \"ganesha_mgr.py help\" for more info"
+           sys.exit(1)
+        ganesha.set_tunable(sys.argv[2], sys.argv[3])
+    elif sys.argv[1] == "get_tunables":
+        ganesha.get_tunables()
+
     elif sys.argv[1] == "set_log":
         if len(sys.argv) < 4:
            print "set_log requires a component and a log level."\
@@ -325,6 +369,15 @@ if __name__ == '__main__':
         logmgr.get(sys.argv[2])
     elif sys.argv[1] == "getall_logs":
         logmgr.getall()
+    elif sys.argv[1] == "add_log_filter":
+        if len(sys.argv) < 4:
+           print "add_log_filter requires a component and a log level."\
+                 " Try \"ganesha_mgr.py help\" for more info"
+           sys.exit(1)
+        args = sys.argv[2:] + ["", "-1", "0", "4294967295"][len(sys.argv) - 4:]
+        logmgr.add_filter(*args[:6])
+    elif sys.argv[1] == "clear_log_filters":
+        logmgr.clear_filters()
 
     elif sys.argv[1] == "help":
        print USAGE
@@ -227,6 +227,8 @@ struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only)
 		cl = avltree_container_of(node, struct gsh_client, node_k);
 	} else {
 		PTHREAD_RWLOCK_init(&cl->lock, NULL);
+		glist_init(&cl->fq_reqs);
+		glist_init(&cl->fq_active);
 	}
 
  out:
@@ -249,6 +251,31 @@ void put_gsh_client(struct gsh_client *client)
 	assert(new_refcnt >= 0);
 }
 
+/**
+ * @brief Set the fair share weight of a client
+ *
+ * The client is created if it is not known yet, so weights can be
+ * set before it connects.
+ *
+ * @param client_ipaddr [IN] sockaddr (key) of the client
+ * @param weight [IN] requests served per scheduling round
+ *
+ * @retval 0 on success
+ * @retval ENOMEM if the client could not be created
+ */
+
+int set_gsh_client_weight(sockaddr_t *client_ipaddr, uint32_t weight)
+{
+	struct gsh_client *cl = get_gsh_client(client_ipaddr, false);
+
+	if (cl == NULL)
+		return ENOMEM;
+
+	atomic_store_uint32_t(&cl->fq_weight, weight);
+	put_gsh_client(cl);
+	return 0;
+}
+
 /**
  * @brief Remove a client from the AVL and free its resources
  *
@@ -494,6 +521,56 @@ static struct gsh_dbus_method cltmgr_remove_client = {
 		 END_ARG_LIST}
 };
 
+static bool gsh_client_setweight(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
+{
+	sockaddr_t sockaddr;
+	uint32_t weight;
+	bool success = false;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (!arg_ipaddr(args, &sockaddr, &errormsg))
+		goto out;
+
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+		errormsg = "weight is not a uint32";
+		goto out;
+	}
+
+	dbus_message_iter_get_basic(args, &weight);
+	if (weight == 0) {
+		errormsg = "weight must be at least 1";
+		goto out;
+	}
+
+	if (set_gsh_client_weight(&sockaddr, weight) != 0) {
+		errormsg = "No memory to insert client";
+		goto out;
+	}
+
+	success = true;
+
+ out:
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_set_client_weight = {
+	.name = "SetClientWeight",
+	.method = gsh_client_setweight,
+	.args = {IPADDR_ARG,
+		 {
+		  .name = "weight",
+		  .type = "u",
+		  .direction = "in"},
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
 struct showclients_state {
 	DBusMessageIter client_iter;
 };
@@ -580,6 +657,7 @@ static struct gsh_dbus_method *cltmgr_client_methods[] = {
 	&cltmgr_add_client,
 	&cltmgr_remove_client,
 	&cltmgr_show_clients,
+	&cltmgr_set_client_weight,
 	NULL
 };
 
@@ -995,12 +1073,100 @@ static struct gsh_dbus_method cltmgr_show_9p_op_stats = {
 #endif
 
 
+/**
+ * DBUS method to report the latency histograms of a client
+ *
+ */
+
+static bool get_client_latency_hist(DBusMessageIter *args,
+				    DBusMessage *reply,
+				    DBusError *error)
+{
+	struct gsh_client *client = NULL;
+	struct server_stats *server_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	if (client == NULL) {
+		success = false;
+		if (errormsg == NULL)
+			errormsg = "Client IP address not found";
+	} else {
+		server_st = container_of(client, struct server_stats, client);
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_latency_hist(&server_st->st, &iter);
+
+	if (client != NULL)
+		put_gsh_client(client);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_show_latency_hist = {
+	.name = "GetLatencyHist",
+	.method = get_client_latency_hist,
+	.args = {IPADDR_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LATENCY_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the READ and WRITE size and pattern of a client
+ *
+ */
+
+static bool get_client_io_dist(DBusMessageIter *args,
+			       DBusMessage *reply,
+			       DBusError *error)
+{
+	struct gsh_client *client = NULL;
+	struct server_stats *server_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	if (client == NULL) {
+		success = false;
+		if (errormsg == NULL)
+			errormsg = "Client IP address not found";
+	} else {
+		server_st = container_of(client, struct server_stats, client);
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_io_dist(&server_st->st, &iter);
+
+	if (client != NULL)
+		put_gsh_client(client);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_show_io_dist = {
+	.name = "GetIODist",
+	.method = get_client_io_dist,
+	.args = {IPADDR_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 IO_DIST_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method *cltmgr_stats_methods[] = {
 	&cltmgr_show_v3_io,
 	&cltmgr_show_v40_io,
 	&cltmgr_show_v41_io,
 	&cltmgr_show_v41_layouts,
 	&cltmgr_show_delegations,
+	&cltmgr_show_latency_hist,
+	&cltmgr_show_io_dist,
 #ifdef _USE_9P
 	&cltmgr_show_9p_io,
 	&cltmgr_show_9p_trans,
@@ -37,36 +37,44 @@
 
 #include "config.h"
 #include <pthread.h>
+#include <time.h>
 #ifdef LINUX
 #include <sys/signal.h>
 #elif FREEBSD
 #include <signal.h>
 #endif
 #include "abstract_mem.h"
+#include "abstract_atomic.h"
 #include "delayed_exec.h"
 #include "log.h"
-#include "avltree.h"
 #include "misc/queue.h"
 #include "gsh_intrinsic.h"
 #include "common_utils.h"
 
-/**
- * @brief A list of tasks
+/*
+ * Tasks are kept in a hierarchical timing wheel owned by the executor
+ * thread.  Level 0 has one slot per tick, each higher level one slot
+ * per full turn of the level below; a slot of a higher level is
+ * cascaded down when the level below wraps around.  Submitters never
+ * touch the wheel: they push their task on one of the submission
+ * queues, picked per thread, and the executor moves queued tasks into
+ * the wheel each time it wakes up.  Submitting is thus O(1) and only
+ * takes the lock of a queue few other threads share.
  */
 
-LIST_HEAD(delayed_tasklist, delayed_task);
+/** Wheel resolution */
+#define DELAYED_TICK_NS NS_PER_MSEC
 
-/**
- * @brief All tasks executing at a given time.
- */
+#define WHEEL_BITS 8
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
 
-struct delayed_multi {
-	struct timespec realtime;	/*< A wallclock time at which to
-					   perform the given task. */
-	struct delayed_tasklist list;	/*< The linked list of tasks to
-					   perform. */
-	struct avltree_node node;	/*< Our node in the tree */
-};
+/** Furthest a task can be put, later ones are run this late */
+#define WHEEL_MAX_DELTA ((UINT64_C(1) << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+/** Number of submission queues */
+#define DELAYED_QUEUES 16
 
 /**
  * @brief An individual delayed task
@@ -77,8 +85,20 @@ struct delayed_task {
 	void (*func)(void *);
 	/** Argument for delayed task */
 	void *arg;
-	/** Link in the task list. */
-	LIST_ENTRY(delayed_task) link;
+	/** Tick at which to run */
+	uint64_t expires;
+	/** Link in a wheel slot or a submission queue */
+	struct delayed_task *next;
+};
+
+/**
+ * @brief A submission queue
+ */
+
+struct delayed_queue {
+	pthread_mutex_t mtx;
+	struct delayed_task *head;
+	GSH_CACHE_PAD(0);
 };
 
 /**
@@ -107,8 +127,22 @@ static struct delayed_threadlist thread_list;
 static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
 /** Condition variable for delayed execution */
 static pthread_cond_t cv = PTHREAD_COND_INITIALIZER;
-/** The timer tree */
-static struct avltree tree;
+
+/** The wheel, only touched by the executor */
+static struct delayed_task *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+/** Next tick to process */
+static uint64_t wheel_tick;
+/** Tasks in the wheel */
+static uint64_t wheel_count;
+
+static struct delayed_queue queues[DELAYED_QUEUES];
+/** Tasks submitted but not moved into the wheel yet */
+static uint64_t delayed_pending;
+/** Tick the executor sleeps until, 0 while it is awake */
+static uint64_t delayed_sleep_until;
+/** Queue of the submitting thread, 0 until one is picked */
+static __thread uint32_t delayed_my_queue;
+static uint32_t delayed_next_queue;
 
 /**
  * @brief Posssible states for the delayed executor
@@ -121,74 +155,149 @@ enum delayed_state {
 /** State for the executor */
 static enum delayed_state delayed_state;
 
-enum delayed_employment {
-	delayed_employed,	/*< Work is available, do it. */
-	delayed_on_break,	/*< Work is available, but wait for it */
-	delayed_unemployed	/*< No work is available, wait indefinitely */
-};
-
 /** @} */
 
-static int comparator(const struct avltree_node *a,
-		      const struct avltree_node *b)
+static uint64_t delayed_now_tick(void)
 {
-	struct delayed_multi *p =
-	    avltree_container_of(a, struct delayed_multi, node);
-	struct delayed_multi *q =
-	    avltree_container_of(b, struct delayed_multi, node);
+	struct timespec ts;
 
-	return gsh_time_cmp(&p->realtime, &q->realtime);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * NS_PER_SEC + ts.tv_nsec) / DELAYED_TICK_NS;
 }
 
 /**
- * @brief Get a task to perform
+ * @brief Put a task in the slot its expiry falls in
  *
- * This function must be called with the mutex held.
+ * @param[in] task The task, expires may be in the past
+ */
+
+static void wheel_insert(struct delayed_task *task)
+{
+	uint64_t delta;
+	int level;
+
+	if (task->expires < wheel_tick)
+		task->expires = wheel_tick;
+
+	delta = task->expires - wheel_tick;
+	if (delta > WHEEL_MAX_DELTA) {
+		delta = WHEEL_MAX_DELTA;
+		task->expires = wheel_tick + delta;
+	}
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++)
+		if (delta < (UINT64_C(1) << (WHEEL_BITS * (level + 1))))
+			break;
+
+	task->next = wheel[level][(task->expires >> (WHEEL_BITS * level)) &
+				  WHEEL_MASK];
+	wheel[level][(task->expires >> (WHEEL_BITS * level)) & WHEEL_MASK] =
+	    task;
+}
+
+/**
+ * @brief Move the tasks of a slot down the wheel
  *
- * @param[out] when The time for which to wait, if there is one
- * @param[out] func The function to execute, if there is one
- * @param[out] arg  The argument to supply, if there is one
+ * @param[in] level Level to cascade from
+ *
+ * @return The slot index, 0 meaning the level wrapped around.
+ */
+
+static int wheel_cascade(int level)
+{
+	int idx = (wheel_tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	struct delayed_task *task = wheel[level][idx], *next;
+
+	wheel[level][idx] = NULL;
+	for (; task != NULL; task = next) {
+		next = task->next;
+		wheel_insert(task);
+	}
+
+	return idx;
+}
+
+/**
+ * @brief Take the tasks due at wheel_tick and advance it
  *
- * @retval delayed_employed if there is a task to perform now.  Its
- *         argument and function are stored in @c arg and @c func.
- * @retval delayed_on_break if there is work but it is not to be
- *         performed yet.  The time at which it is to be performed is
- *         set in *when.
- * @retval delayed_unemployed if there is no work at all.  The caller
- *         should wait indefinitely to be signalled.
+ * @return The tasks to run, linked through next.
+ */
+
+static struct delayed_task *wheel_advance(void)
+{
+	int idx = wheel_tick & WHEEL_MASK;
+	struct delayed_task *due;
+	int level;
+
+	if (idx == 0)
+		for (level = 1; level < WHEEL_LEVELS; level++)
+			if (wheel_cascade(level) != 0)
+				break;
+
+	due = wheel[0][idx];
+	wheel[0][idx] = NULL;
+	wheel_tick++;
+
+	return due;
+}
+
+/**
+ * @brief Move the submitted tasks into the wheel
  */
 
-static enum delayed_employment delayed_get_work(struct timespec *when,
-						void (**func) (void *),
-						void **arg)
+static void delayed_drain(void)
 {
-	struct avltree_node *first = avltree_first(&tree);
-	struct delayed_multi *mul;
-	struct timespec current;
-	struct delayed_task *task;
+	struct delayed_task *task, *next;
+	uint64_t moved = 0;
+	int i;
 
-	if (first == NULL)
-		return delayed_unemployed;
+	for (i = 0; i < DELAYED_QUEUES; i++) {
+		if (queues[i].head == NULL)
+			continue;
 
-	now(&current);
-	mul = avltree_container_of(first, struct delayed_multi, node);
+		PTHREAD_MUTEX_lock(&queues[i].mtx);
+		task = queues[i].head;
+		queues[i].head = NULL;
+		PTHREAD_MUTEX_unlock(&queues[i].mtx);
 
-	if (gsh_time_cmp(&mul->realtime, &current) > 0) {
-		*when = mul->realtime;
-		return delayed_on_break;
+		for (; task != NULL; task = next) {
+			next = task->next;
+			wheel_insert(task);
+			moved++;
+		}
 	}
 
-	task = LIST_FIRST(&mul->list);
-	*func = task->func;
-	*arg = task->arg;
-	LIST_REMOVE(task, link);
-	gsh_free(task);
-	if (LIST_EMPTY(&mul->list)) {
-		avltree_remove(first, &tree);
-		gsh_free(mul);
+	if (moved != 0) {
+		(void)atomic_sub_uint64_t(&delayed_pending, moved);
+		wheel_count += moved;
 	}
+}
+
+/**
+ * @brief Find the tick to sleep until
+ *
+ * Looks for the next busy slot of level 0; past its end, the next
+ * cascade is the earliest anything can become due.
+ *
+ * @return The tick, UINT64_MAX if the wheel is empty.
+ */
+
+static uint64_t wheel_next_tick(void)
+{
+	uint64_t tick;
+
+	if (wheel_count == 0)
+		return UINT64_MAX;
 
-	return delayed_employed;
+	/* A cascade is due */
+	if ((wheel_tick & WHEEL_MASK) == 0)
+		return wheel_tick;
+
+	for (tick = wheel_tick; (tick & WHEEL_MASK) != 0; tick++)
+		if (wheel[0][tick & WHEEL_MASK] != NULL)
+			return tick;
+
+	return tick;
 }
 
 /**
@@ -218,27 +327,58 @@ void *delayed_thread(void *arg)
 
 	pthread_sigmask(SIG_SETMASK, NULL, &old_sigmask);
 
+	wheel_tick = delayed_now_tick();
+
 	PTHREAD_MUTEX_lock(&mtx);
 	while (delayed_state == delayed_running) {
+		struct delayed_task *due, *task;
+		uint64_t cur, next;
 		struct timespec then;
-		void (*func)(void *);
-		void *arg;
 
-		switch (delayed_get_work(&then, &func, &arg)) {
-		case delayed_unemployed:
-			pthread_cond_wait(&cv, &mtx);
-			break;
+		PTHREAD_MUTEX_unlock(&mtx);
 
-		case delayed_on_break:
-			pthread_cond_timedwait(&cv, &mtx, &then);
-			break;
+		delayed_drain();
+
+		cur = delayed_now_tick();
+		if (wheel_count == 0 && wheel_tick < cur)
+			wheel_tick = cur;
+
+		while (wheel_tick <= cur) {
+			due = wheel_advance();
+			while ((task = due) != NULL) {
+				due = task->next;
+				wheel_count--;
+				task->func(task->arg);
+				gsh_free(task);
+			}
+			/* Pick up what the tasks submitted */
+			delayed_drain();
+		}
+
+		next = wheel_next_tick();
 
-		case delayed_employed:
-			PTHREAD_MUTEX_unlock(&mtx);
-			func(arg);
-			PTHREAD_MUTEX_lock(&mtx);
+		PTHREAD_MUTEX_lock(&mtx);
+		if (delayed_state != delayed_running)
 			break;
+
+		/* Submitters check delayed_sleep_until after counting
+		 * their task as pending, so either we see it here or
+		 * they see we sleep and signal us.
+		 */
+		atomic_store_uint64_t(&delayed_sleep_until, next);
+		cur = delayed_now_tick();
+		if (atomic_fetch_uint64_t(&delayed_pending) == 0 &&
+		    next > cur) {
+			if (next == UINT64_MAX) {
+				pthread_cond_wait(&cv, &mtx);
+			} else {
+				now(&then);
+				timespec_add_nsecs((next - cur) *
+						   DELAYED_TICK_NS, &then);
+				pthread_cond_timedwait(&cv, &mtx, &then);
+			}
 		}
+		atomic_store_uint64_t(&delayed_sleep_until, 0);
 	}
 	LIST_REMOVE(thr, link);
 	if (LIST_EMPTY(&thread_list))
@@ -256,7 +396,7 @@ void *delayed_thread(void *arg)
 
 void delayed_start(void)
 {
-	/* Make this a parameter later */
+	/* The wheel has a single owner */
 	const size_t threads_to_start = 1;
 	/* Thread attributes */
 	pthread_attr_t attr;
@@ -264,11 +404,10 @@ void delayed_start(void)
 	int i;
 
 	LIST_INIT(&thread_list);
-	avltree_init(&tree, comparator, 0);
 
-	if (threads_to_start == 0) {
-		LogFatal(COMPONENT_THREAD,
-			 "You can't execute tasks with zero threads.");
+	for (i = 0; i < DELAYED_QUEUES; i++) {
+		PTHREAD_MUTEX_init(&queues[i].mtx, NULL);
+		queues[i].head = NULL;
 	}
 
 	if (pthread_attr_init(&attr) != 0)
@@ -340,36 +479,36 @@ void delayed_shutdown(void)
 
 int delayed_submit(void (*func) (void *), void *arg, nsecs_elapsed_t delay)
 {
-	struct delayed_multi *mul = NULL;
-	struct delayed_task *task = NULL;
-	struct avltree_node *collision = NULL;
-	struct avltree_node *first = NULL;
-
-	mul = gsh_malloc(sizeof(struct delayed_multi));
-	task = gsh_malloc(sizeof(struct delayed_task));
-
-	now(&mul->realtime);
-	timespec_add_nsecs(delay, &mul->realtime);
+	struct delayed_task *task = gsh_malloc(sizeof(struct delayed_task));
+	struct delayed_queue *q;
+	uint64_t sleep_until;
 
-	PTHREAD_MUTEX_lock(&mtx);
-	first = avltree_first(&tree);
-	collision = avltree_insert(&mul->node, &tree);
-	if (unlikely(collision)) {
-		gsh_free(mul);
-		/* There is already a node for this exact time in the
-		   tree.  Add our task to its list. */
-		mul =
-		    avltree_container_of(collision, struct delayed_multi, node);
-	} else {
-		LIST_INIT(&mul->list);
-	}
 	task->func = func;
 	task->arg = arg;
-	LIST_INSERT_HEAD(&mul->list, task, link);
-	if (!first || comparator(&mul->node, first) < 0)
-		pthread_cond_broadcast(&cv);
-
-	PTHREAD_MUTEX_unlock(&mtx);
+	/* Round up, a task never runs early */
+	task->expires = delayed_now_tick() +
+			(delay + DELAYED_TICK_NS - 1) / DELAYED_TICK_NS;
+
+	if (unlikely(delayed_my_queue == 0))
+		delayed_my_queue =
+		    atomic_inc_uint32_t(&delayed_next_queue) % DELAYED_QUEUES
+		    + 1;
+	q = &queues[delayed_my_queue - 1];
+
+	PTHREAD_MUTEX_lock(&q->mtx);
+	task->next = q->head;
+	q->head = task;
+	PTHREAD_MUTEX_unlock(&q->mtx);
+
+	(void)atomic_inc_uint64_t(&delayed_pending);
+
+	/* Only wake the executor if it would sleep past this task */
+	sleep_until = atomic_fetch_uint64_t(&delayed_sleep_until);
+	if (sleep_until != 0 && task->expires < sleep_until) {
+		PTHREAD_MUTEX_lock(&mtx);
+		pthread_cond_signal(&cv);
+		PTHREAD_MUTEX_unlock(&mtx);
+	}
 
 	return 0;
 }
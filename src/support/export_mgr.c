@@ -45,6 +45,7 @@
 #include <sys/types.h>
 #include <sys/param.h>
 #include <pthread.h>
+#include <sched.h>
 #include <assert.h>
 #include <arpa/inet.h>
 #include "fsal.h"
@@ -59,6 +60,7 @@
 #include "client_mgr.h"
 #include "server_stats_private.h"
 #include "server_stats.h"
+#include "gsh_topk.h"
 #include "abstract_atomic.h"
 #include "gsh_intrinsic.h"
 #include "nfs_exports.h"
@@ -80,6 +82,64 @@ struct export_by_id {
 
 static struct export_by_id export_by_id;
 
+/**
+ * @brief Reader sections for lock-free export id lookups
+ *
+ * get_gsh_export() resolves cache hits without export_by_id.lock.  A
+ * reader marks itself active in its shard around the cache slot load
+ * and the reference it takes; removal clears the slot under the write
+ * lock and then waits until every shard has been seen idle before the
+ * sentinel reference is released, so a reader never takes a reference
+ * on an export that may already be freed.
+ */
+#define EXPORT_READ_SHARDS 32
+
+struct export_read_shard {
+	int64_t active;
+	GSH_CACHE_PAD(0);
+};
+
+static struct export_read_shard export_read_shards[EXPORT_READ_SHARDS];
+/** Shard of this thread, 0 until one is picked */
+static __thread uint32_t export_my_shard;
+static uint32_t export_next_shard;
+
+static inline struct export_read_shard *export_read_enter(void)
+{
+	struct export_read_shard *shard;
+
+	if (unlikely(export_my_shard == 0))
+		export_my_shard =
+		    atomic_inc_uint32_t(&export_next_shard) %
+		    EXPORT_READ_SHARDS + 1;
+	shard = &export_read_shards[export_my_shard - 1];
+	atomic_inc_int64_t(&shard->active);
+	return shard;
+}
+
+static inline void export_read_exit(struct export_read_shard *shard)
+{
+	atomic_dec_int64_t(&shard->active);
+}
+
+/**
+ * @brief Wait for readers that may still see an unlinked export
+ *
+ * Read sections only cover a slot load and a refcount increment, so
+ * each shard goes idle almost immediately.  Must be called after the
+ * export has been removed from the cache.
+ */
+static void export_read_synchronize(void)
+{
+	int i;
+
+	for (i = 0; i < EXPORT_READ_SHARDS; i++) {
+		while (atomic_fetch_int64_t(&export_read_shards[i].active)
+		       != 0)
+			sched_yield();
+	}
+}
+
 /** List of all active exports,
   * protected by export_by_id.lock
   */
@@ -95,6 +155,245 @@ static struct glist_head mount_work;
   */
 static struct glist_head unexport_work;
 
+/**
+ * @brief Exports are also indexed by path and by pseudo path
+ *
+ * Each trie has one node per path component, holding the exports
+ * whose path ends there in export list order, so that longest prefix
+ * match costs one child lookup per component of the path searched.
+ * Paths not starting with '/' hang off a root of their own.
+ *
+ * Protected by export_by_id.lock
+ */
+
+struct export_path_node {
+	struct avltree_node node_k;	/*< In the children of parent */
+	struct avltree children;	/*< Nodes of the next component */
+	struct export_path_node *parent;
+	struct glist_head exports;	/*< Exports with exactly this path */
+	char *name;			/*< Component, not NUL terminated */
+	size_t len;
+};
+
+struct export_path_trie {
+	struct export_path_node slash;	/*< Root of paths starting '/' */
+	struct export_path_node bare;	/*< Root of other paths */
+	bool pseudo;			/*< Indexes pseudopath */
+};
+
+static struct export_path_trie export_by_path;
+static struct export_path_trie export_by_pseudo = { .pseudo = true };
+
+static int export_path_cmpf(const struct avltree_node *lhs,
+			    const struct avltree_node *rhs)
+{
+	struct export_path_node *lk, *rk;
+	int rc;
+
+	lk = avltree_container_of(lhs, struct export_path_node, node_k);
+	rk = avltree_container_of(rhs, struct export_path_node, node_k);
+
+	rc = memcmp(lk->name, rk->name, lk->len < rk->len ? lk->len : rk->len);
+	if (rc != 0)
+		return rc;
+	if (lk->len != rk->len)
+		return (lk->len < rk->len) ? -1 : 1;
+	return 0;
+}
+
+static void export_path_node_init(struct export_path_node *node)
+{
+	avltree_init(&node->children, export_path_cmpf, 0);
+	glist_init(&node->exports);
+}
+
+/**
+ * @brief Find, and optionally add, the child of a node for a component
+ */
+static struct export_path_node *export_path_child(
+					struct export_path_node *parent,
+					const char *name, size_t len,
+					bool create)
+{
+	struct export_path_node key, *node;
+	struct avltree_node *found;
+
+	key.name = (char *)name;
+	key.len = len;
+	found = avltree_lookup(&key.node_k, &parent->children);
+	if (found != NULL)
+		return avltree_container_of(found, struct export_path_node,
+					    node_k);
+	if (!create)
+		return NULL;
+
+	node = gsh_calloc(1, sizeof(*node) + len);
+	export_path_node_init(node);
+	node->name = (char *)(node + 1);
+	memcpy(node->name, name, len);
+	node->len = len;
+	node->parent = parent;
+	avltree_insert(&node->node_k, &parent->children);
+
+	return node;
+}
+
+/**
+ * @brief Walk a trie along a path
+ *
+ * @param[in]  trie     Trie to walk
+ * @param[in]  path     Path to walk along
+ * @param[in]  len      Length of path
+ * @param[in]  create   Add the nodes missing
+ * @param[out] deepest  Deepest node that holds exports, may be NULL
+ *
+ * @return The node of the whole path, NULL if it is not in the trie.
+ */
+static struct export_path_node *export_path_walk(struct export_path_trie *trie,
+						 const char *path, size_t len,
+						 bool create,
+						 struct export_path_node
+							**deepest)
+{
+	struct export_path_node *node;
+	const char *end = path + len, *slash;
+	bool more;
+
+	if (len > 0 && path[0] == '/') {
+		node = &trie->slash;
+		path++;
+	} else {
+		node = &trie->bare;
+	}
+
+	if (deepest != NULL)
+		*deepest = glist_empty(&node->exports) ? NULL : node;
+
+	/* Components are what every '/' after the first separates */
+	more = path < end;
+	while (node != NULL && more) {
+		slash = memchr(path, '/', end - path);
+		if (slash == NULL) {
+			slash = end;
+			more = false;
+		}
+
+		node = export_path_child(node, path, slash - path, create);
+		if (node != NULL && deepest != NULL &&
+		    !glist_empty(&node->exports))
+			*deepest = node;
+
+		path = slash + 1;
+	}
+
+	return node;
+}
+
+static void export_path_insert(struct export_path_trie *trie,
+			       struct gsh_export *export)
+{
+	const char *path = trie->pseudo ? export->pseudopath
+					: export->fullpath;
+	struct export_path_node *node;
+
+	if (path == NULL)
+		return;
+
+	node = export_path_walk(trie, path, strlen(path), true, NULL);
+	if (trie->pseudo) {
+		glist_add_tail(&node->exports, &export->exp_pseudo_list);
+		export->exp_pseudo_node = node;
+	} else {
+		glist_add_tail(&node->exports, &export->exp_path_list);
+		export->exp_path_node = node;
+	}
+}
+
+static void export_path_remove(struct export_path_trie *trie,
+			       struct gsh_export *export)
+{
+	struct export_path_node *node, *parent;
+
+	if (trie->pseudo) {
+		node = export->exp_pseudo_node;
+		if (node == NULL)
+			return;
+		glist_del(&export->exp_pseudo_list);
+		export->exp_pseudo_node = NULL;
+	} else {
+		node = export->exp_path_node;
+		if (node == NULL)
+			return;
+		glist_del(&export->exp_path_list);
+		export->exp_path_node = NULL;
+	}
+
+	/* Prune the nodes left with nothing under them */
+	while (node->parent != NULL && glist_empty(&node->exports) &&
+	       avltree_size(&node->children) == 0) {
+		parent = node->parent;
+		avltree_remove(&node->node_k, &parent->children);
+		gsh_free(node);
+		node = parent;
+	}
+}
+
+/**
+ * @brief Find the export of the longest prefix of a path
+ *
+ * If path has a trailing '/', ignore it.  When only a shorter prefix
+ * than the whole path matches, the last export with it is taken.
+ *
+ * @param[in] trie        Trie to search
+ * @param[in] path        Path to search for
+ * @param[in] exact_match The path must match exactly
+ *
+ * @return pointer to ref counted export
+ */
+static struct gsh_export *export_path_lookup(struct export_path_trie *trie,
+					     const char *path,
+					     bool exact_match)
+{
+	size_t len_path = strlen(path);
+	struct export_path_node *node, *deepest;
+	struct glist_head *glist;
+	struct gsh_export *export;
+
+	if (len_path > 1 && path[len_path - 1] == '/')
+		len_path--;
+
+	if (len_path == 0) {
+		/* Special case for root match */
+		deepest = node = &trie->slash;
+	} else {
+		node = export_path_walk(trie, path, len_path, false, &deepest);
+	}
+
+	if (exact_match && deepest != node)
+		return NULL;
+
+	if (deepest == NULL)
+		return NULL;
+
+	if (deepest == node)
+		glist = deepest->exports.next;
+	else
+		glist = deepest->exports.prev;
+
+	if (glist == &deepest->exports)
+		return NULL;
+
+	if (trie->pseudo)
+		export = glist_entry(glist, struct gsh_export,
+				     exp_pseudo_list);
+	else
+		export = glist_entry(glist, struct gsh_export, exp_path_list);
+
+	get_gsh_export_ref(export);
+
+	return export;
+}
+
 void export_add_to_mount_work(struct gsh_export *export)
 {
 	PTHREAD_RWLOCK_wrlock(&export_by_id.lock);
@@ -102,6 +401,72 @@ void export_add_to_mount_work(struct gsh_export *export)
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
 }
 
+static int pseudo_depth(const char *pseudopath)
+{
+	int depth = 0;
+
+	if (pseudopath == NULL)
+		return 0;
+
+	for (; *pseudopath != '\0'; pseudopath++)
+		if (*pseudopath == '/' && pseudopath[1] != '\0')
+			depth++;
+
+	return depth;
+}
+
+static int mount_work_cmpf(const void *a, const void *b)
+{
+	const struct gsh_export *ea = *(struct gsh_export * const *)a;
+	const struct gsh_export *eb = *(struct gsh_export * const *)b;
+	int da = pseudo_depth(ea->pseudopath);
+	int db = pseudo_depth(eb->pseudopath);
+
+	if (da != db)
+		return da < db ? -1 : 1;
+	if (ea->export_id != eb->export_id)
+		return ea->export_id < eb->export_id ? -1 : 1;
+	return 0;
+}
+
+/**
+ * @brief Order the mount work by Pseudo path depth
+ *
+ * Exports queued out of config order (as when set up in parallel) are
+ * then still mounted after the exports their Pseudo path is below.
+ */
+
+void export_sort_mount_work(void)
+{
+	struct gsh_export **exports;
+	struct glist_head *glist;
+	size_t count = 0, i;
+
+	PTHREAD_RWLOCK_wrlock(&export_by_id.lock);
+
+	glist_for_each(glist, &mount_work)
+		count++;
+
+	if (count > 1) {
+		exports = gsh_malloc(count * sizeof(*exports));
+
+		i = 0;
+		glist_for_each(glist, &mount_work)
+			exports[i++] = glist_entry(glist, struct gsh_export,
+						   exp_work);
+
+		qsort(exports, count, sizeof(*exports), mount_work_cmpf);
+
+		glist_init(&mount_work);
+		for (i = 0; i < count; i++)
+			glist_add_tail(&mount_work, &exports[i]->exp_work);
+
+		gsh_free(exports);
+	}
+
+	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
+}
+
 void export_add_to_unexport_work_locked(struct gsh_export *export)
 {
 	glist_add_tail(&unexport_work, &export->exp_work);
@@ -181,9 +546,12 @@ void export_revert(struct gsh_export *export)
 		atomic_store_voidptr(cache_slot, NULL);
 	avltree_remove(&export->node_k, &export_by_id.t);
 	glist_del(&export->exp_list);
+	export_path_remove(&export_by_path, export);
+	export_path_remove(&export_by_pseudo, export);
 	glist_del(&export->exp_work);
 
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
+	export_read_synchronize();
 	put_gsh_export(export); /* Release sentinel ref */
 }
 
@@ -229,6 +597,8 @@ struct gsh_export *alloc_export(void)
 	glist_init(&export->exp_nlm_share_list);
 	glist_init(&export->mounted_exports_list);
 	glist_init(&export->clients);
+	glist_init(&export->exp_path_list);
+	glist_init(&export->exp_pseudo_list);
 
 	PTHREAD_RWLOCK_init(&export->lock, NULL);
 
@@ -289,6 +659,8 @@ bool insert_gsh_export(struct gsh_export *export)
 	/* update cache */
 	atomic_store_voidptr(cache_slot, &export->node_k);
 	glist_add_tail(&exportlist, &export->exp_list);
+	export_path_insert(&export_by_path, export);
+	export_path_insert(&export_by_pseudo, export);
 	get_gsh_export_ref(export);		/* == 2 */
 
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
@@ -311,24 +683,29 @@ struct gsh_export *get_gsh_export(uint16_t export_id)
 	struct gsh_export v;
 	struct avltree_node *node;
 	struct gsh_export *exp;
+	struct export_read_shard *shard;
 	void **cache_slot = (void **)
 	    &(export_by_id.cache[eid_cache_offsetof(export_id)]);
 
-	v.export_id = export_id;
-	PTHREAD_RWLOCK_rdlock(&export_by_id.lock);
-
-	/* check cache */
+	/* check cache without the lock */
+	shard = export_read_enter();
 	node = (struct avltree_node *)atomic_fetch_voidptr(cache_slot);
 	if (node) {
 		exp = avltree_container_of(node, struct gsh_export, node_k);
 		if (exp->export_id == export_id) {
 			/* got it in 1 */
+			get_gsh_export_ref(exp);
+			export_read_exit(shard);
 			LogDebug(COMPONENT_HASHTABLE_CACHE,
 				 "export_mgr cache hit slot %d",
 				 eid_cache_offsetof(export_id));
-			goto out;
+			return exp;
 		}
 	}
+	export_read_exit(shard);
+
+	v.export_id = export_id;
+	PTHREAD_RWLOCK_rdlock(&export_by_id.lock);
 
 	/* fall back to AVL */
 	node = avltree_lookup(&v.node_k, &export_by_id.t);
@@ -341,7 +718,6 @@ struct gsh_export *get_gsh_export(uint16_t export_id)
 		return NULL;
 	}
 
- out:
 	get_gsh_export_ref(exp);
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
 	return exp;
@@ -350,9 +726,9 @@ struct gsh_export *get_gsh_export(uint16_t export_id)
 /**
  * @brief Lookup the export manager struct by export path
  *
- * Gets an export entry from its path using a substring match and
- * linear search of the export list, assumes being called with
- * export manager lock held (such as from within foreach_gsh_export.
+ * Gets an export entry from its path using a longest prefix match
+ * in the path trie, assumes being called with export manager lock
+ * held (such as from within foreach_gsh_export.
  * If path has a trailing '/', ignore it.
  *
  * @param path        [IN] the path for the entry to be found.
@@ -364,75 +740,18 @@ struct gsh_export *get_gsh_export(uint16_t export_id)
 struct gsh_export *get_gsh_export_by_path_locked(char *path,
 						 bool exact_match)
 {
-	struct gsh_export *export;
-	struct glist_head *glist;
-	int len_path = strlen(path);
-	int len_export;
-	struct gsh_export *ret_exp = NULL;
-	int len_ret = 0;
-
-	if (len_path > 1 && path[len_path - 1] == '/')
-		len_path--;
-
 	LogFullDebug(COMPONENT_EXPORT,
 		     "Searching for export matching path %s",
 		     path);
 
-	glist_for_each(glist, &exportlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		len_export = strlen(export->fullpath);
-
-		if (len_path == 0 && len_export == 1) {
-			/* Special case for root match */
-			ret_exp = export;
-			len_ret = len_export;
-			break;
-		}
-
-		/* A path shorter than the full path cannot match.
-		 * Also skip if this export has a shorter path than
-		 * the previous match.
-		 */
-		if (len_path < len_export ||
-		    len_export < len_ret)
-			continue;
-
-		/* If partial match is not allowed, lengths must be the same */
-		if (exact_match && len_path != len_export)
-			continue;
-
-		/* if the char in fullpath just after the end of path is not '/'
-		 * it is a name token longer, i.e. /mnt/foo != /mnt/foob/
-		 */
-		if (len_export > 1 &&
-		    path[len_export] != '/' &&
-		    path[len_export] != '\0')
-			continue;
-
-		/* we agree on size, now compare the leading substring
-		 */
-		if (strncmp(export->fullpath, path, len_export) == 0) {
-			ret_exp = export;
-			len_ret = len_export;
-
-			/* If we have found an exact match, exit loop. */
-			if (len_export == len_path)
-				break;
-		}
-	}
-
-	if (ret_exp != NULL)
-		get_gsh_export_ref(ret_exp);
-
-	return ret_exp;
+	return export_path_lookup(&export_by_path, path, exact_match);
 }
 
 /**
  * @brief Lookup the export manager struct by export path
  *
- * Gets an export entry from its path using a substring match and
- * linear search of the export list.
+ * Gets an export entry from its path using a longest prefix match
+ * in the path trie.
  * If path has a trailing '/', ignore it.
  *
  * @param path        [IN] the path for the entry to be found.
@@ -470,78 +789,11 @@ struct gsh_export *get_gsh_export_by_path(char *path, bool exact_match)
 struct gsh_export *get_gsh_export_by_pseudo_locked(char *path,
 						   bool exact_match)
 {
-	struct gsh_export *export;
-	struct glist_head *glist;
-	int len_path = strlen(path);
-	int len_export;
-	struct gsh_export *ret_exp = NULL;
-	int len_ret = 0;
-
-	/* Ignore trailing slash in path */
-	if (len_path > 1 && path[len_path - 1] == '/')
-		len_path--;
-
 	LogFullDebug(COMPONENT_EXPORT,
 		     "Searching for export matching pseudo path %s",
 		     path);
 
-	glist_for_each(glist, &exportlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		if (export->pseudopath == NULL)
-			continue;
-
-		len_export = strlen(export->pseudopath);
-
-		LogFullDebug(COMPONENT_EXPORT,
-			     "Comparing %s %d to %s %d",
-			     path, len_path,
-			     export->pseudopath, len_export);
-
-		if (len_path == 0 && len_export == 1) {
-			/* Special case for Pseudo root match */
-			ret_exp = export;
-			len_ret = len_export;
-			break;
-		}
-
-		/* A path shorter than the full path cannot match.
-		 * Also skip if this export has a shorter path than
-		 * the previous match.
-		 */
-		if (len_path < len_export ||
-		    len_export < len_ret)
-			continue;
-
-		/* If partial match is not allowed, lengths must be the same */
-		if (exact_match && len_path != len_export)
-			continue;
-
-		/* if the char in pseudopath just after the end of path is not
-		 * '/' it is a name token longer, i.e. /mnt/foo != /mnt/foob/
-		 */
-		if (len_export > 1 &&
-		    path[len_export] != '/' &&
-		    path[len_export] != '\0')
-			continue;
-
-		/* we agree on size, now compare the leading substring
-		 */
-		if (strncmp(export->pseudopath, path, len_export)
-		    == 0) {
-			ret_exp = export;
-			len_ret = len_export;
-
-			/* If we have found an exact match, exit loop. */
-			if (len_export == len_path)
-				break;
-		}
-	}
-
-	if (ret_exp != NULL)
-		get_gsh_export_ref(ret_exp);
-
-	return ret_exp;
+	return export_path_lookup(&export_by_pseudo, path, exact_match);
 }
 
 /**
@@ -671,6 +923,8 @@ void remove_gsh_export(uint16_t export_id)
 
 		/* Remove the export from the export list */
 		glist_del(&export->exp_list);
+		export_path_remove(&export_by_path, export);
+		export_path_remove(&export_by_pseudo, export);
 
 		/* No new references will be granted. Idempotent. */
 		export->export_status = EXPORT_STALE;
@@ -686,6 +940,11 @@ void remove_gsh_export(uint16_t export_id)
 			pnfs_ds_remove(export->export_id, true);
 		}
 
+		/* Lock-free lookups that raced the removal have their
+		 * reference by the time the readers are idle.
+		 */
+		export_read_synchronize();
+
 		/* Release sentinel reference to the export.
 		 * Release of resources will occur on last reference.
 		 * Which may or may not be from this call.
@@ -719,6 +978,48 @@ bool foreach_gsh_export(bool(*cb) (struct gsh_export *exp, void *state),
 	return rc;
 }
 
+/**
+ * @brief Do the callback on a referenced snapshot of the exports
+ *
+ * Unlike foreach_gsh_export, export_by_id.lock is only held while the
+ * references are taken, so slow callbacks such as statistics dumps do
+ * not hold off export updates.  The callbacks must not use the _locked
+ * lookups.
+ *
+ * @param cb    [IN] Callback function
+ * @param state [IN] param block to pass
+ */
+
+bool foreach_gsh_export_snapshot(bool(*cb) (struct gsh_export *exp,
+					    void *state),
+				 void *state)
+{
+	struct glist_head *glist;
+	struct gsh_export **exports;
+	size_t count = 0, i;
+	bool rc = true;
+
+	PTHREAD_RWLOCK_rdlock(&export_by_id.lock);
+	glist_for_each(glist, &exportlist)
+		count++;
+	exports = gsh_malloc((count + 1) * sizeof(*exports));
+	i = 0;
+	glist_for_each(glist, &exportlist) {
+		exports[i] = glist_entry(glist, struct gsh_export, exp_list);
+		get_gsh_export_ref(exports[i]);
+		i++;
+	}
+	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
+
+	for (i = 0; i < count; i++) {
+		if (rc)
+			rc = cb(exports[i], state);
+		put_gsh_export(exports[i]);
+	}
+	gsh_free(exports);
+	return rc;
+}
+
 bool remove_one_export(struct gsh_export *export, void *state)
 {
 	export_add_to_unexport_work_locked(export);
@@ -1237,7 +1538,8 @@ static bool gsh_export_showexports(DBusMessageIter *args,
 					 "(qsbbbbbbbb(tt))",
 					 &iter_state.export_iter);
 
-	(void)foreach_gsh_export(export_to_dbus, (void *)&iter_state);
+	(void)foreach_gsh_export_snapshot(export_to_dbus,
+					  (void *)&iter_state);
 
 	dbus_message_iter_close_container(&iter, &iter_state.export_iter);
 	return true;
@@ -1709,6 +2011,87 @@ static bool get_nfsv_global_fast_ops(DBusMessageIter *args,
 	return true;
 }
 
+/**
+ * DBUS method to report the latency histograms of an export
+ *
+ */
+
+static bool get_export_latency_hist(DBusMessageIter *args,
+				    DBusMessage *reply,
+				    DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL)
+		success = false;
+	else
+		export_st = container_of(export, struct export_stats, export);
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_latency_hist(&export_st->st, &iter);
+
+	if (export != NULL)
+		put_gsh_export(export);
+	return true;
+}
+
+/**
+ * DBUS method to report the READ and WRITE size and pattern of an export
+ *
+ */
+
+static bool get_export_io_dist(DBusMessageIter *args,
+			       DBusMessage *reply,
+			       DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL)
+		success = false;
+	else
+		export_st = container_of(export, struct export_stats, export);
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_io_dist(&export_st->st, &iter);
+
+	if (export != NULL)
+		put_gsh_export(export);
+	return true;
+}
+
+/**
+ * DBUS method to report the server wide latency histogram of each op
+ *
+ */
+
+static bool get_global_op_latency_hist(DBusMessageIter *args,
+				       DBusMessage *reply,
+				       DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	global_dbus_op_latency_hist(&iter);
+
+	return true;
+}
+
 static bool show_cache_inode_stats(DBusMessageIter *args,
 				   DBusMessage *reply,
 				   DBusError *error)
@@ -1725,6 +2108,116 @@ static bool show_cache_inode_stats(DBusMessageIter *args,
 	return true;
 }
 
+static bool show_drc_stats(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	dupreq_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_memory(DBusMessageIter *args,
+			DBusMessage *reply,
+			DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	mem_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_fridges(DBusMessageIter *args,
+			 DBusMessage *reply,
+			 DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	fridgethr_dbus_show(&iter);
+
+	return true;
+}
+
+/**
+ * DBUS methods to report the hottest files and clients
+ *
+ * Ranked by operations, or by bytes when the argument is true.
+ */
+
+static bool get_top(DBusMessageIter *args, DBusMessage *reply,
+		    void (*show)(DBusMessageIter *, bool))
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	dbus_bool_t by_bytes = false;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args != NULL) {
+		if (dbus_message_iter_get_arg_type(args) != DBUS_TYPE_BOOLEAN) {
+			success = false;
+			errormsg = "Argument is not a boolean";
+		} else {
+			dbus_message_iter_get_basic(args, &by_bytes);
+		}
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		show(&iter, by_bytes);
+
+	return true;
+}
+
+static bool get_top_files(DBusMessageIter *args,
+			  DBusMessage *reply,
+			  DBusError *error)
+{
+	return get_top(args, reply, topk_dbus_files);
+}
+
+static bool get_top_clients(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
+{
+	return get_top(args, reply, topk_dbus_clients);
+}
+
+#ifdef ENABLE_LOCK_PROFILE
+static bool show_lock_contention(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	lock_prof_dbus_show(&iter);
+
+	return true;
+}
+#endif
+
 static struct gsh_dbus_method export_show_v41_layouts = {
 	.name = "GetNFSv41Layouts",
 	.method = get_nfsv41_export_layouts,
@@ -1886,6 +2379,35 @@ static struct gsh_dbus_method global_show_fast_ops = {
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_method export_show_latency_hist = {
+	.name = "GetLatencyHist",
+	.method = get_export_latency_hist,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LATENCY_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method export_show_io_dist = {
+	.name = "GetIODist",
+	.method = get_export_io_dist,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 IO_DIST_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_op_latency_hist = {
+	.name = "GetGlobalOpLatencyHist",
+	.method = get_global_op_latency_hist,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LATENCY_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method cache_inode_show = {
 	.name = "ShowCacheInode",
 	.method = show_cache_inode_stats,
@@ -1895,6 +2417,65 @@ static struct gsh_dbus_method cache_inode_show = {
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_method drc_show = {
+	.name = "ShowDRC",
+	.method = show_drc_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TOTAL_OPS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method memory_show = {
+	.name = "ShowMemory",
+	.method = show_memory,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 MEMORY_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method fridges_show = {
+	.name = "ShowFridges",
+	.method = show_fridges,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 FRIDGE_REPLY,
+		 LATENCY_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method top_files_show = {
+	.name = "GetTopFiles",
+	.method = get_top_files,
+	.args = {BY_BYTES_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TOP_FILES_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method top_clients_show = {
+	.name = "GetTopClients",
+	.method = get_top_clients,
+	.args = {BY_BYTES_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TOP_CLIENTS_REPLY,
+		 END_ARG_LIST}
+};
+
+#ifdef ENABLE_LOCK_PROFILE
+static struct gsh_dbus_method lock_contention_show = {
+	.name = "GetLockContention",
+	.method = show_lock_contention,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LOCK_PROF_REPLY,
+		 END_ARG_LIST}
+};
+#endif
+
 /**
  * @brief Report all IO stats of all exports in one call
  *
@@ -1934,7 +2515,8 @@ static bool get_nfs_io(DBusMessageIter *args,
 	dbus_message_iter_open_container(&reply_iter, DBUS_TYPE_ARRAY,
 					 NFS_ALL_IO_REPLY_ARRAY_TYPE,
 					 &array_iter);
-	(void) foreach_gsh_export(&get_all_export_io, (void *) &array_iter);
+	(void) foreach_gsh_export_snapshot(&get_all_export_io,
+					   (void *) &array_iter);
 	dbus_message_iter_close_container(&reply_iter, &array_iter);
 
 	return true;
@@ -1961,7 +2543,18 @@ static struct gsh_dbus_method *export_stats_methods[] = {
 #endif
 	&global_show_total_ops,
 	&global_show_fast_ops,
+	&export_show_latency_hist,
+	&export_show_io_dist,
+	&global_show_op_latency_hist,
 	&cache_inode_show,
+	&drc_show,
+	&memory_show,
+	&fridges_show,
+	&top_files_show,
+	&top_clients_show,
+#ifdef ENABLE_LOCK_PROFILE
+	&lock_contention_show,
+#endif
 	&export_show_all_io,
 	&reset_statistics,
 	NULL
@@ -2005,6 +2598,11 @@ void export_pkginit(void)
 	avltree_init(&export_by_id.t, export_id_cmpf, 0);
 	memset(&export_by_id.cache, 0, sizeof(export_by_id.cache));
 
+	export_path_node_init(&export_by_path.slash);
+	export_path_node_init(&export_by_path.bare);
+	export_path_node_init(&export_by_pseudo.slash);
+	export_path_node_init(&export_by_pseudo.bare);
+
 	glist_init(&exportlist);
 	glist_init(&mount_work);
 	glist_init(&unexport_work);
@@ -30,6 +30,7 @@
 #include "cidr.h"
 #include "log.h"
 #include "fsal.h"
+#include "gsh_rpc.h"
 #include "nfs_core.h"
 #include "nfs_file_handle.h"
 #include "nfs_exports.h"
@@ -52,6 +53,7 @@
 #include "pnfs_utils.h"
 #include "netgroup_cache.h"
 #include "mdcache.h"
+#include "fridgethr.h"
 
 /**
  * @brief Protect EXPORT_DEFAULTS structure for dynamic update.
@@ -62,6 +64,10 @@
  */
 pthread_rwlock_t export_opt_lock = PTHREAD_RWLOCK_INITIALIZER;
 
+/* Generations of export permissions, see export_check_access_req() */
+static uint64_t export_perms_gen;
+static uint64_t export_opt_gen;
+
 #define GLOBAL_EXPORT_PERMS_INITIALIZER				\
 	.def.anonymous_uid = ANON_UID,				\
 	.def.anonymous_gid = ANON_GID,				\
@@ -87,6 +93,9 @@ struct global_export_perms export_opt_cfg = {
 };
 
 static void FreeClientList(struct glist_head *clients);
+static struct export_client_index *client_index_build(
+					struct glist_head *clients);
+static void client_index_free(struct export_client_index *index);
 
 static int StrExportOptions(struct display_buffer *dspbuf,
 			    struct export_perms *p_perms)
@@ -739,8 +748,10 @@ void clean_export_paths(struct gsh_export *export)
  * fsal method can process the rest of the parameters in the block
  */
 
-static int fsal_cfg_commit(void *node, void *link_mem, void *self_struct,
-			   struct config_error_type *err_type)
+static int fsal_cfg_commit_common(void *node, void *link_mem,
+				  void *self_struct,
+				  struct config_error_type *err_type,
+				  bool attach)
 {
 	struct fsal_export **exp_hdl = link_mem;
 	struct gsh_export *export =
@@ -757,17 +768,14 @@ static int fsal_cfg_commit(void *node, void *link_mem, void *self_struct,
 			     UNKNOWN_REQUEST);
 
 	errcnt = fsal_load_init(node, fp->name, &fsal, err_type);
-	if (errcnt > 0)
+	if (errcnt > 0) {
+		/* Nothing to attach to, let export_commit reject it */
+		export->attach_on_demand = false;
 		goto err;
+	}
 
 	clean_export_paths(export);
 
-	/* The handle cache (currently MDCACHE) must be at the top of the stack
-	 * of FSALs.  To achieve this, call directly into MDCACHE, passing the
-	 * sub-FSAL's fsal_module.  MDCACHE will stack itself on top of that
-	 * FSAL, continuing down the chain. */
-	status = mdcache_fsal_create_export(fsal, node, err_type, &fsal_up_top);
-
 	PTHREAD_RWLOCK_rdlock(&export_opt_lock);
 
 	if ((export->options_set & EXPORT_OPTION_EXPIRE_SET) == 0)
@@ -775,6 +783,30 @@ static int fsal_cfg_commit(void *node, void *link_mem, void *self_struct,
 
 	PTHREAD_RWLOCK_unlock(&export_opt_lock);
 
+	/* The pseudo FS and its root are needed to reach any other
+	 * export, those are always attached.
+	 */
+	if (export->attach_on_demand &&
+	    (export->export_id == 0 || strcasecmp(fp->name, "PSEUDO") == 0 ||
+	     (export->pseudopath != NULL &&
+	      strcmp(export->pseudopath, "/") == 0)))
+		export->attach_on_demand = false;
+
+	if (export->attach_on_demand && !attach) {
+		/* The FSAL export is created by export_attach */
+		LogDebug(COMPONENT_CONFIG,
+			 "Export %d attaches to FSAL %s on first access",
+			 export->export_id, fp->name);
+		fsal_put(fsal);
+		goto err;
+	}
+
+	/* The handle cache (currently MDCACHE) must be at the top of the stack
+	 * of FSALs.  To achieve this, call directly into MDCACHE, passing the
+	 * sub-FSAL's fsal_module.  MDCACHE will stack itself on top of that
+	 * FSAL, continuing down the chain. */
+	status = mdcache_fsal_create_export(fsal, node, err_type, &fsal_up_top);
+
 	if (FSAL_IS_ERROR(status)) {
 		fsal_put(fsal);
 		LogCrit(COMPONENT_CONFIG,
@@ -817,6 +849,24 @@ err:
 	return errcnt;
 }
 
+static int fsal_cfg_commit(void *node, void *link_mem, void *self_struct,
+			   struct config_error_type *err_type)
+{
+	return fsal_cfg_commit_common(node, link_mem, self_struct, err_type,
+				      false);
+}
+
+/**
+ * @brief Commit the FSAL sub-block of an export being attached
+ */
+
+static int fsal_attach_commit(void *node, void *link_mem, void *self_struct,
+			      struct config_error_type *err_type)
+{
+	return fsal_cfg_commit_common(node, link_mem, self_struct, err_type,
+				      true);
+}
+
 /**
  * @brief Commit a FSAL sub-block for export update
  *
@@ -867,6 +917,14 @@ static int fsal_update_cfg_commit(void *node, void *link_mem, void *self_struct,
 	 * fsal_export to later release...
 	 */
 
+	if (probe_exp->fsal_export == NULL) {
+		/* Not attached yet, it will pick up the FSAL sub-block
+		 * when it is.
+		 */
+		put_gsh_export(probe_exp);
+		return 0;
+	}
+
 	/* Initialize req_ctx from the probe_exp */
 	init_root_op_context(&root_op_context, probe_exp,
 			     probe_exp->fsal_export, 0, 0, UNKNOWN_REQUEST);
@@ -981,6 +1039,10 @@ static inline void update_atomic_fields(struct gsh_export *export,
 	atomic_store_uint64_t(&export->PrefReaddir, src->PrefReaddir);
 	atomic_store_uint64_t(&export->MaxOffsetWrite, src->MaxOffsetWrite);
 	atomic_store_uint64_t(&export->MaxOffsetRead, src->MaxOffsetRead);
+	atomic_store_uint64_t(&export->ops_limit, src->ops_limit);
+	atomic_store_uint64_t(&export->bytes_limit, src->bytes_limit);
+	atomic_store_uint32_t(&export->cache_entries_hwmark,
+			      src->cache_entries_hwmark);
 	atomic_store_uint32_t(&export->options, src->options);
 	atomic_store_uint32_t(&export->options_set, src->options_set);
 	atomic_store_int32_t(&export->expire_time_attr, src->expire_time_attr);
@@ -1004,6 +1066,7 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 				enum export_commit_type commit_type)
 {
 	struct gsh_export *export = self_struct, *probe_exp;
+	struct export_client_index *client_index;
 	int errcnt = 0;
 	char perms[1024] = "\0";
 	struct display_buffer dspbuf = {sizeof(perms), perms, perms};
@@ -1075,8 +1138,15 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 	 * have fsal_export attached.
 	 */
 
+	client_index_free(export->client_index);
+	export->client_index = client_index_build(&export->clients);
+	export->perms_gen = atomic_inc_uint64_t(&export_perms_gen);
+
 	probe_exp = get_gsh_export(export->export_id);
 
+	if (node != NULL)
+		export->config_hash = config_node_hash(node);
+
 	if (commit_type == update_export && probe_exp != NULL) {
 		/* We have an actual update case, probe_exp is the target
 		 * to update. Check all the options that MUST match.
@@ -1142,6 +1212,17 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 			errcnt++;
 		}
 
+		/* The cache trusts an immutable export for as long as it
+		 * exists, so it can't be changed on update.
+		 */
+		if (probe_exp->immutable != export->immutable) {
+			LogCrit(COMPONENT_CONFIG,
+				"Immutable for export update %d doesn't match",
+				export->export_id);
+			err_type->invalid = true;
+			errcnt++;
+		}
+
 		/* We can't compare the FSAL names because we don't actually
 		 * have an fsal_export for "export".
 		 */
@@ -1170,6 +1251,11 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 			     export->clients.next, export->clients.prev);
 
 		glist_swap_lists(&probe_exp->clients, &export->clients);
+		client_index = probe_exp->client_index;
+		probe_exp->client_index = export->client_index;
+		export->client_index = client_index;
+		atomic_store_uint64_t(&probe_exp->perms_gen, export->perms_gen);
+		probe_exp->config_hash = export->config_hash;
 
 		PTHREAD_RWLOCK_unlock(&probe_exp->lock);
 
@@ -1202,7 +1288,7 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 	 * Config code calls export_commit even if fsal_cfg_commit fails at
 	 * the moment, so error out here if fsal_cfg_commit failed.
 	 */
-	if (export->fsal_export == NULL) {
+	if (export->fsal_export == NULL && !export->attach_on_demand) {
 		err_type->validate = true;
 		errcnt++;
 		return errcnt;
@@ -1281,7 +1367,7 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 	    export->export_perms.options & EXPORT_OPTION_NFSV4)
 		export_add_to_mount_work(export);
 
-	if (commit_type != initial_export) {
+	if (commit_type != initial_export && export_attached(export)) {
 		/* add_export or update_export with new export_id. */
 		int rc = init_export_root(export);
 
@@ -1304,7 +1390,9 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 
 			goto out;
 		}
+	}
 
+	if (commit_type != initial_export) {
 		if (!mount_gsh_export(export)) {
 			export_revert(export);
 			err_type->internal = true;
@@ -1347,11 +1435,22 @@ out:
 	return errcnt;
 }
 
+/**
+ * @brief Keeps the duplicate checks of parallel export commits apart
+ */
+static pthread_mutex_t export_commit_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static int export_commit(void *node, void *link_mem, void *self_struct,
 			 struct config_error_type *err_type)
 {
-	return export_commit_common(node, link_mem, self_struct, err_type,
-				    initial_export);
+	int errcnt;
+
+	PTHREAD_MUTEX_lock(&export_commit_lock);
+	errcnt = export_commit_common(node, link_mem, self_struct, err_type,
+				      initial_export);
+	PTHREAD_MUTEX_unlock(&export_commit_lock);
+
+	return errcnt;
 }
 
 /**
@@ -1436,6 +1535,7 @@ static int export_defaults_commit(void *node, void *link_mem,
 	/* Update under lock. */
 	PTHREAD_RWLOCK_wrlock(&export_opt_lock);
 	export_opt = export_opt_cfg;
+	(void) atomic_inc_uint64_t(&export_opt_gen);
 	PTHREAD_RWLOCK_unlock(&export_opt_lock);
 
 	return 0;
@@ -1718,6 +1818,12 @@ static struct config_item fsal_params[] = {
 		       _struct_, MaxOffsetWrite),			\
 	CONF_ITEM_UI64("MaxOffsetRead", 512, UINT64_MAX, UINT64_MAX,	\
 		       _struct_, MaxOffsetRead),			\
+	CONF_ITEM_UI64("Ops_Limit", 0, GSH_TOKEN_BUCKET_MAX_RATE, 0,	\
+		       _struct_, ops_limit),				\
+	CONF_ITEM_UI64("Bytes_Limit", 0, GSH_TOKEN_BUCKET_MAX_RATE, 0,	\
+		       _struct_, bytes_limit),				\
+	CONF_ITEM_UI32("Cache_Entries_HWMark", 0, UINT32_MAX, 0,	\
+		       _struct_, cache_entries_hwmark),			\
 	CONF_ITEM_BOOLBIT_SET("UseCookieVerifier",			\
 		false, EXPORT_OPTION_USE_COOKIE_VERIFIER,		\
 		_struct_, options, options_set),			\
@@ -1741,6 +1847,10 @@ static struct config_item fsal_params[] = {
 static struct config_item export_params[] = {
 	CONF_EXPORT_PARAMS(gsh_export),
 	CONF_EXPORT_PERMS(gsh_export, export_perms),
+	CONF_ITEM_BOOL("Attach_On_Demand", false,
+		       gsh_export, attach_on_demand),
+	CONF_ITEM_BOOL("Immutable", false,
+		       gsh_export, immutable),
 
 	/* NOTE: the Client and FSAL sub-blocks must be the *last*
 	 * two entries in the list.  This is so all other
@@ -1763,6 +1873,10 @@ static struct config_item export_params[] = {
 static struct config_item export_update_params[] = {
 	CONF_EXPORT_PARAMS(gsh_export),
 	CONF_EXPORT_PERMS(gsh_export, export_perms),
+	CONF_ITEM_BOOL("Attach_On_Demand", false,
+		       gsh_export, attach_on_demand),
+	CONF_ITEM_BOOL("Immutable", false,
+		       gsh_export, immutable),
 
 	/* NOTE: the Client and FSAL sub-blocks must be the *last*
 	 * two entries in the list.  This is so all other
@@ -1792,6 +1906,20 @@ static struct config_block export_param = {
 	.blk_desc.u.blk.display = export_display
 };
 
+/**
+ * @brief Definition of the FSAL sub-block of an export being attached
+ */
+
+static struct config_block export_attach_param = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.fsal.%d",
+	.blk_desc.name = "FSAL",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.flags = CONFIG_RELAX,
+	.blk_desc.u.blk.init = fsal_init,
+	.blk_desc.u.blk.params = fsal_params,
+	.blk_desc.u.blk.commit = fsal_attach_commit
+};
+
 /**
  * @brief Top level definition for an ADD EXPORT block
  */
@@ -1978,6 +2106,224 @@ err_out:
 	return -1;
 }
 
+/**
+ * @brief Hash of the EXPORT_DEFAULTS blocks the exports were built with
+ */
+static uint64_t export_defaults_hash;
+
+/**
+ * @brief Hash all EXPORT_DEFAULTS blocks of a config
+ *
+ * @param[in] in_config The parsed config
+ *
+ * @return The combined hash, 0 if there are none.
+ */
+
+static uint64_t export_defaults_config_hash(config_file_t in_config)
+{
+	struct config_node_list *list, *lp, *lp_next;
+	struct config_error_type err_type;
+	uint64_t hash = 0;
+
+	memset(&err_type, 0, sizeof(err_type));
+
+	if (find_config_nodes(in_config, "EXPORT_DEFAULTS", &list,
+			      &err_type) != 0)
+		return 0;
+
+	for (lp = list; lp != NULL; lp = lp_next) {
+		lp_next = lp->next;
+		hash = hash * 31 + config_node_hash(lp->tree_node);
+		gsh_free(lp);
+	}
+
+	return hash;
+}
+
+/**
+ * @brief Work shared by the threads of an export setup stage
+ *
+ * The caller and up to Export_Init_Threads - 1 fridge threads take
+ * items in turn until all are done.
+ */
+struct export_init_stage {
+	void (*fn)(struct export_init_stage *stage, void *item);
+	void **items;
+	uint32_t count;
+	uint32_t next;		/*< Next item to take */
+	uint32_t done;		/*< Items set up without errors */
+	uint32_t running;	/*< Helpers still running, under mtx */
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	struct config_error_type *err_type;	/*< Merged errors, under mtx */
+};
+
+/** Threads helping to set up exports */
+static struct fridgethr *export_init_fridge;
+
+static void export_init_items(struct export_init_stage *stage)
+{
+	uint32_t i;
+
+	while ((i = atomic_postinc_uint32_t(&stage->next)) < stage->count)
+		stage->fn(stage, stage->items[i]);
+}
+
+static void export_init_run(struct fridgethr_context *ctx)
+{
+	struct export_init_stage *stage = ctx->arg;
+
+	export_init_items(stage);
+
+	PTHREAD_MUTEX_lock(&stage->mtx);
+	stage->running--;
+	pthread_cond_signal(&stage->cv);
+	PTHREAD_MUTEX_unlock(&stage->mtx);
+}
+
+/**
+ * @brief Run a stage of export setup on the export init threads
+ *
+ * Returns once every item is done.
+ *
+ * @param[in] stage The stage, with fn, items and count set
+ */
+
+static void export_init_stage_run(struct export_init_stage *stage)
+{
+	uint32_t helpers = nfs_param.core_param.export_init_threads - 1;
+	uint32_t i;
+
+	stage->next = 0;
+	stage->done = 0;
+	stage->running = 0;
+	PTHREAD_MUTEX_init(&stage->mtx, NULL);
+	PTHREAD_COND_init(&stage->cv, NULL);
+
+	if (helpers >= stage->count)
+		helpers = stage->count > 0 ? stage->count - 1 : 0;
+
+	if (helpers > 0 && export_init_fridge == NULL) {
+		struct fridgethr_params frp;
+		int rc;
+
+		memset(&frp, 0, sizeof(struct fridgethr_params));
+		frp.thr_max = nfs_param.core_param.export_init_threads - 1;
+		frp.thr_min = 0;
+		frp.thread_delay = 60;
+		frp.flavor = fridgethr_flavor_worker;
+		frp.deferment = fridgethr_defer_queue;
+
+		rc = fridgethr_init(&export_init_fridge, "export_init", &frp);
+		if (rc != 0) {
+			LogMajor(COMPONENT_EXPORT,
+				 "Unable to initialize export init fridge, error code %d.",
+				 rc);
+			export_init_fridge = NULL;
+		}
+	}
+
+	for (i = 0; i < helpers && export_init_fridge != NULL; i++) {
+		PTHREAD_MUTEX_lock(&stage->mtx);
+		stage->running++;
+		PTHREAD_MUTEX_unlock(&stage->mtx);
+
+		if (fridgethr_submit(export_init_fridge, export_init_run,
+				     stage) != 0) {
+			PTHREAD_MUTEX_lock(&stage->mtx);
+			stage->running--;
+			PTHREAD_MUTEX_unlock(&stage->mtx);
+			break;
+		}
+	}
+
+	export_init_items(stage);
+
+	PTHREAD_MUTEX_lock(&stage->mtx);
+	while (stage->running > 0)
+		pthread_cond_wait(&stage->cv, &stage->mtx);
+	PTHREAD_MUTEX_unlock(&stage->mtx);
+
+	PTHREAD_COND_destroy(&stage->cv);
+	PTHREAD_MUTEX_destroy(&stage->mtx);
+}
+
+/**
+ * @brief Process one EXPORT block of the config
+ *
+ * Errors are collected per block and merged, the error stream itself
+ * is stdio and does its own locking.
+ */
+
+static void export_init_block(struct export_init_stage *stage, void *item)
+{
+	struct config_error_type err_type;
+
+	memset(&err_type, 0, sizeof(err_type));
+	err_type.fp = stage->err_type->fp;
+
+	if (load_config_from_node(item, &export_param, NULL, false,
+				  &err_type) == 0)
+		(void) atomic_inc_uint32_t(&stage->done);
+
+	PTHREAD_MUTEX_lock(&stage->mtx);
+	config_error_comb_errors(stage->err_type, &err_type);
+	stage->err_type->errors += err_type.errors;
+	PTHREAD_MUTEX_unlock(&stage->mtx);
+}
+
+/**
+ * @brief Process the EXPORT blocks of the config in parallel
+ *
+ * Each block may create a remote mount in its FSAL, which is what makes
+ * large configs slow to start.  The blocks are independent until they
+ * are mounted in the pseudo FS, so only that is left in order.
+ *
+ * @return A negative value on error, the number of exports else.
+ */
+
+static int read_exports_parallel(config_file_t in_config,
+				 struct config_error_type *err_type)
+{
+	struct export_init_stage stage;
+	struct config_node_list *list, *lp, *lp_next;
+	uint32_t count = 0, i = 0;
+	int rc;
+
+	rc = find_config_nodes(in_config, "EXPORT", &list, err_type);
+	if (rc == ENOENT)
+		return 0;
+	if (rc != 0)
+		return -1;
+
+	for (lp = list; lp != NULL; lp = lp->next)
+		count++;
+
+	memset(&stage, 0, sizeof(stage));
+	stage.fn = export_init_block;
+	stage.items = gsh_calloc(count, sizeof(void *));
+	stage.count = count;
+	stage.err_type = err_type;
+
+	for (lp = list; lp != NULL; lp = lp_next) {
+		lp_next = lp->next;
+		stage.items[i++] = lp->tree_node;
+		gsh_free(lp);
+	}
+
+	export_init_stage_run(&stage);
+	gsh_free(stage.items);
+
+	/* Mount parents before the exports below them */
+	export_sort_mount_work();
+
+	LogInfo(COMPONENT_CONFIG,
+		"Set up %"PRIu32" of %"PRIu32" export blocks in parallel",
+		stage.done, count);
+
+	return stage.done;
+}
+
 /**
  * @brief Read the export entries from the parsed configuration file.
  *
@@ -2002,16 +2348,21 @@ int ReadExports(config_file_t in_config,
 		return -1;
 	}
 
-	num_exp = load_config_from_parse(in_config,
-				    &export_param,
-				    NULL,
-				    false,
-				    err_type);
+	if (nfs_param.core_param.export_init_threads > 1)
+		num_exp = read_exports_parallel(in_config, err_type);
+	else
+		num_exp = load_config_from_parse(in_config,
+					    &export_param,
+					    NULL,
+					    false,
+					    err_type);
 	if (num_exp < 0) {
 		LogCrit(COMPONENT_CONFIG, "Export block error");
 		return -1;
 	}
 
+	export_defaults_hash = export_defaults_config_hash(in_config);
+
 	rc = build_default_root(err_type);
 	if (rc < 0) {
 		LogCrit(COMPONENT_CONFIG, "No pseudo root!");
@@ -2021,9 +2372,44 @@ int ReadExports(config_file_t in_config,
 	return num_exp;
 }
 
+/**
+ * @brief Sorted hashes of the EXPORT blocks in use
+ */
+struct export_hashes {
+	uint64_t *hash;
+	size_t count;
+	size_t size;
+};
+
+static bool collect_export_hash(struct gsh_export *export, void *state)
+{
+	struct export_hashes *hashes = state;
+
+	if (hashes->count == hashes->size) {
+		hashes->size = hashes->size == 0 ? 64 : hashes->size * 2;
+		hashes->hash = gsh_realloc(hashes->hash,
+					   hashes->size * sizeof(uint64_t));
+	}
+
+	hashes->hash[hashes->count++] = export->config_hash;
+	return true;
+}
+
+static int export_hash_cmpf(const void *a, const void *b)
+{
+	uint64_t ha = *(const uint64_t *)a, hb = *(const uint64_t *)b;
+
+	return ha < hb ? -1 : ha > hb;
+}
+
 /**
  * @brief Reread the export entries from the parsed configuration file.
  *
+ * EXPORT blocks that hash the same as the block an export was last
+ * committed from are skipped, so a reload only touches, and only takes
+ * locks on, the exports that actually changed.  If the EXPORT_DEFAULTS
+ * changed, every export may have, and all blocks are reloaded.
+ *
  * @param[in]  in_config    The file that contains the export list
  *
  * @return A negative value on error,
@@ -2033,7 +2419,11 @@ int ReadExports(config_file_t in_config,
 int reread_exports(config_file_t in_config,
 		   struct config_error_type *err_type)
 {
-	int rc, num_exp;
+	int rc, num_exp = 0, reloaded = 0;
+	uint64_t defaults_hash = export_defaults_config_hash(in_config);
+	struct config_node_list *list, *lp, *lp_next;
+	struct export_hashes hashes = { NULL, 0, 0 };
+	uint64_t hash;
 
 	LogInfo(COMPONENT_CONFIG, "Reread exports");
 
@@ -2048,17 +2438,65 @@ int reread_exports(config_file_t in_config,
 		return -1;
 	}
 
-	num_exp = load_config_from_parse(in_config,
-					 &update_export_param,
-					 NULL,
-					 false,
-					 err_type);
+	if (defaults_hash != export_defaults_hash) {
+		LogInfo(COMPONENT_CONFIG,
+			"Export defaults changed, reloading all exports");
 
-	if (num_exp < 0) {
+		num_exp = load_config_from_parse(in_config,
+						 &update_export_param,
+						 NULL,
+						 false,
+						 err_type);
+
+		if (num_exp < 0) {
+			LogCrit(COMPONENT_CONFIG, "Export block error");
+			return -1;
+		}
+
+		export_defaults_hash = defaults_hash;
+		return num_exp;
+	}
+
+	rc = find_config_nodes(in_config, "EXPORT", &list, err_type);
+	if (rc == ENOENT)
+		return 0;
+	if (rc != 0) {
 		LogCrit(COMPONENT_CONFIG, "Export block error");
 		return -1;
 	}
 
+	(void)foreach_gsh_export(collect_export_hash, &hashes);
+	if (hashes.count > 0)
+		qsort(hashes.hash, hashes.count, sizeof(uint64_t),
+		      export_hash_cmpf);
+
+	for (lp = list; lp != NULL; lp = lp_next) {
+		lp_next = lp->next;
+		hash = config_node_hash(lp->tree_node);
+
+		if (hashes.count > 0 &&
+		    bsearch(&hash, hashes.hash, hashes.count,
+			    sizeof(uint64_t), export_hash_cmpf) != NULL) {
+			/* Same block as the export was built from */
+			num_exp++;
+		} else if (load_config_from_node(lp->tree_node,
+						 &update_export_param,
+						 NULL,
+						 false,
+						 err_type) == 0) {
+			num_exp++;
+			reloaded++;
+		}
+
+		gsh_free(lp);
+	}
+
+	gsh_free(hashes.hash);
+
+	LogInfo(COMPONENT_CONFIG,
+		"Reread exports: %d of %d export blocks changed",
+		reloaded, num_exp);
+
 	return num_exp;
 }
 
@@ -2096,6 +2534,8 @@ static void FreeClientList(struct glist_head *clients)
 
 void free_export_resources(struct gsh_export *export)
 {
+	client_index_free(export->client_index);
+	export->client_index = NULL;
 	FreeClientList(&export->clients);
 	if (export->fsal_export != NULL) {
 		struct fsal_module *fsal = export->fsal_export->fsal;
@@ -2122,16 +2562,69 @@ void free_export_resources(struct gsh_export *export)
 
 static bool init_export_cb(struct gsh_export *exp, void *state)
 {
+	if (!export_attached(exp))
+		return true;
+
 	return !(init_export_root(exp));
 }
 
+/**
+ * @brief Collect references to all exports
+ */
+
+static bool collect_export_cb(struct gsh_export *exp, void *state)
+{
+	struct export_init_stage *stage = state;
+
+	if (!export_attached(exp))
+		return true;
+
+	if (stage->count % 64 == 0)
+		stage->items = gsh_realloc(stage->items,
+					   (stage->count + 64) * sizeof(void *));
+
+	get_gsh_export_ref(exp);
+	stage->items[stage->count++] = exp;
+	return true;
+}
+
+static void export_init_root(struct export_init_stage *stage, void *item)
+{
+	struct gsh_export *exp = item;
+
+	if (init_export_root(exp) == 0)
+		(void) atomic_inc_uint32_t(&stage->done);
+
+	put_gsh_export(exp);
+}
+
 /**
  * @brief Initialize exports over a live cache inode and fsal layer
+ *
+ * Looking up the export roots may go to remote servers, so it is done
+ * on the export init threads.  The pseudo FS is built on the roots
+ * afterwards.
  */
 
 void exports_pkginit(void)
 {
-	foreach_gsh_export(init_export_cb, NULL);
+	struct export_init_stage stage;
+
+	if (nfs_param.core_param.export_init_threads <= 1) {
+		foreach_gsh_export(init_export_cb, NULL);
+		return;
+	}
+
+	memset(&stage, 0, sizeof(stage));
+	stage.fn = export_init_root;
+	(void)foreach_gsh_export(collect_export_cb, &stage);
+
+	export_init_stage_run(&stage);
+	gsh_free(stage.items);
+
+	LogInfo(COMPONENT_EXPORT,
+		"Initialized %"PRIu32" of %"PRIu32" export roots in parallel",
+		stage.done, stage.count);
 }
 
 /**
@@ -2148,8 +2641,8 @@ void exports_pkginit(void)
  * @return FSAL status
  */
 
-fsal_status_t nfs_export_get_root_entry(struct gsh_export *export,
-					struct fsal_obj_handle **obj)
+static fsal_status_t export_get_root_entry(struct gsh_export *export,
+					   struct fsal_obj_handle **obj)
 {
 	PTHREAD_RWLOCK_rdlock(&export->lock);
 
@@ -2169,48 +2662,156 @@ fsal_status_t nfs_export_get_root_entry(struct gsh_export *export,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+fsal_status_t nfs_export_get_root_entry(struct gsh_export *export,
+					struct fsal_obj_handle **obj)
+{
+	if (!export_attach(export)) {
+		*obj = NULL;
+		return fsalstat(ERR_FSAL_DELAY, 0);
+	}
+
+	return export_get_root_entry(export, obj);
+}
+
 /**
- * @brief Set file systems max read write sizes in the export
+ * @brief Serializes attaching exports to their FSAL
+ */
+static pthread_mutex_t export_attach_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Create the FSAL export of an Attach_On_Demand export
  *
- * @param export [IN] the export
- * @param maxread [IN] maxread size
- * @param maxwrite [IN] maxwrite size
+ * The parse tree is long gone, so the FSAL sub-block is read back
+ * from the config file by Export_Id.  On success the export root is
+ * looked up as exports_pkginit would have.
+ *
+ * @param[in] export The export
+ *
+ * @retval true if the export is attached
  */
 
-static void set_fs_max_rdwr_size(struct gsh_export *export, uint64_t maxread,
-				 uint64_t maxwrite)
+bool export_attach_slow(struct gsh_export *export)
 {
-	if (maxread != 0) {
-		if (!op_ctx_export_has_option_set(EXPORT_OPTION_MAXREAD_SET)) {
-			LogInfo(COMPONENT_EXPORT,
-				"Readjusting MaxRead to %" PRIu64,
-				maxread);
-			export->MaxRead = maxread;
-		}
+	struct config_error_type err_type;
+	struct config_node_list *list = NULL, *lp, *lp_next;
+	config_file_t config = NULL;
+	char expr[64];
+	bool attached = false;
+	int rc;
 
-		if (!op_ctx_export_has_option_set(EXPORT_OPTION_PREFREAD_SET) ||
-		    (export->PrefRead > export->MaxRead)) {
-			LogInfo(COMPONENT_EXPORT,
-				"Readjusting PrefRead to %"PRIu64,
-				export->MaxRead);
-			export->PrefRead = export->MaxRead;
-		}
+	PTHREAD_MUTEX_lock(&export_attach_lock);
+
+	if (atomic_fetch_uint8_t(&export->attached)) {
+		PTHREAD_MUTEX_unlock(&export_attach_lock);
+		return true;
 	}
 
-	if (maxwrite != 0) {
-		if (!op_ctx_export_has_option_set(EXPORT_OPTION_MAXWRITE_SET)) {
-			LogInfo(COMPONENT_EXPORT,
-				"Readjusting MaxWrite to %"PRIu64,
-				maxwrite);
-			export->MaxWrite = maxwrite;
-		}
+	if (!export_ready(export) || config_path[0] == '\0')
+		goto out;
 
-		if (!op_ctx_export_has_option_set(EXPORT_OPTION_PREFWRITE_SET)
-		    || (export->PrefWrite > export->MaxWrite)) {
-			LogInfo(COMPONENT_EXPORT,
-				"Readjusting PrefWrite to %"PRIu64,
-				export->MaxWrite);
-			export->PrefWrite = export->MaxWrite;
+	LogEvent(COMPONENT_EXPORT,
+		 "Attaching export %d Path %s to its FSAL",
+		 export->export_id, export->fullpath);
+
+	if (!init_error_type(&err_type))
+		goto out;
+
+	config = config_ParseFile_cached(config_path, config_cache_path,
+					 &err_type);
+	if (!config_error_no_error(&err_type))
+		goto report;
+
+	snprintf(expr, sizeof(expr), "EXPORT(Export_Id=%"PRIu16").FSAL",
+		 export->export_id);
+
+	rc = find_config_nodes(config, expr, &list, &err_type);
+	if (rc != 0) {
+		LogCrit(COMPONENT_EXPORT,
+			"No FSAL block for export %d in %s",
+			export->export_id, config_path);
+		goto report;
+	}
+
+	rc = load_config_from_node(list->tree_node, &export_attach_param,
+				   &export->fsal_export, false, &err_type);
+	if (rc != 0 || export->fsal_export == NULL)
+		goto report;
+
+	rc = init_export_root(export);
+	if (rc != 0) {
+		struct fsal_module *fsal = export->fsal_export->fsal;
+
+		export->fsal_export->exp_ops.release(export->fsal_export);
+		fsal_put(fsal);
+		export->fsal_export = NULL;
+		goto report;
+	}
+
+	atomic_store_uint8_t(&export->attached, true);
+	attached = true;
+
+report:
+	for (lp = list; lp != NULL; lp = lp_next) {
+		lp_next = lp->next;
+		gsh_free(lp);
+	}
+
+	report_config_errors(&err_type, NULL, config_errs_to_log);
+	config_Free(config);
+
+out:
+	PTHREAD_MUTEX_unlock(&export_attach_lock);
+
+	if (!attached)
+		LogCrit(COMPONENT_EXPORT,
+			"Could not attach export %d Path %s",
+			export->export_id, export->fullpath);
+
+	return attached;
+}
+
+/**
+ * @brief Set file systems max read write sizes in the export
+ *
+ * @param export [IN] the export
+ * @param maxread [IN] maxread size
+ * @param maxwrite [IN] maxwrite size
+ */
+
+static void set_fs_max_rdwr_size(struct gsh_export *export, uint64_t maxread,
+				 uint64_t maxwrite)
+{
+	if (maxread != 0) {
+		if (!op_ctx_export_has_option_set(EXPORT_OPTION_MAXREAD_SET)) {
+			LogInfo(COMPONENT_EXPORT,
+				"Readjusting MaxRead to %" PRIu64,
+				maxread);
+			export->MaxRead = maxread;
+		}
+
+		if (!op_ctx_export_has_option_set(EXPORT_OPTION_PREFREAD_SET) ||
+		    (export->PrefRead > export->MaxRead)) {
+			LogInfo(COMPONENT_EXPORT,
+				"Readjusting PrefRead to %"PRIu64,
+				export->MaxRead);
+			export->PrefRead = export->MaxRead;
+		}
+	}
+
+	if (maxwrite != 0) {
+		if (!op_ctx_export_has_option_set(EXPORT_OPTION_MAXWRITE_SET)) {
+			LogInfo(COMPONENT_EXPORT,
+				"Readjusting MaxWrite to %"PRIu64,
+				maxwrite);
+			export->MaxWrite = maxwrite;
+		}
+
+		if (!op_ctx_export_has_option_set(EXPORT_OPTION_PREFWRITE_SET)
+		    || (export->PrefWrite > export->MaxWrite)) {
+			LogInfo(COMPONENT_EXPORT,
+				"Readjusting PrefWrite to %"PRIu64,
+				export->MaxWrite);
+			export->PrefWrite = export->MaxWrite;
 		}
 	}
 }
@@ -2318,8 +2919,22 @@ static void release_export(struct gsh_export *export)
 	struct fsal_obj_handle *obj = NULL;
 	fsal_status_t fsal_status;
 
+	PTHREAD_MUTEX_lock(&export_attach_lock);
+
+	if (!export_attached(export)) {
+		/* Only mounted in the pseudo FS.  Hold the lock until
+		 * export_status keeps it from being attached.
+		 */
+		pseudo_unmount_export(export);
+		remove_gsh_export(export->export_id);
+		PTHREAD_MUTEX_unlock(&export_attach_lock);
+		return;
+	}
+
+	PTHREAD_MUTEX_unlock(&export_attach_lock);
+
 	/* Get a reference to the root entry */
-	fsal_status = nfs_export_get_root_entry(export, &obj);
+	fsal_status = export_get_root_entry(export, &obj);
 
 	if (FSAL_IS_ERROR(fsal_status)) {
 		/* No more root entry, bail out, this export is
@@ -2385,6 +3000,9 @@ void unexport(struct gsh_export *export)
 		op_ctx_set = true;
 	}
 
+	/* PUTFH caches of the workers hold references */
+	nfs4_fh_cache_drain(export);
+
 	release_export(export);
 
 	if (op_ctx_set)
@@ -2392,206 +3010,593 @@ void unexport(struct gsh_export *export)
 }
 
 /**
- * @brief Match a specific option in the client export list
+ * @brief Compiled form of an export's client list
  *
- * @param[in]  hostaddr      Host to search for
- * @param[in]  clients       Client list to search
- * @param[out] client_found Matching entry
- * @param[in]  export_option Option to search for
+ * Host and network entries are kept in a path compressed binary trie
+ * per address family, keyed by address bits in network order, so an
+ * export with many of them costs a walk of at most 32 or 128 bits.
+ * Entries that can not be matched by address (netgroups, wildcards,
+ * MATCH_ANY, and the odd non-contiguous netmask) stay in a list of
+ * their own.  Every entry remembers its position in the client list,
+ * so that the first match of the list still wins.
  *
- * @return true if found, false otherwise.
+ * Lookups that did not need a host name are remembered in a small
+ * cache.  A name based match is left to the IP/name and netgroup
+ * caches, which expire their entries.  The index is built with the
+ * client list and swapped along with it on export update, which
+ * drops the cache with it.
  */
-static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
-					       struct gsh_export *export)
+
+#define CLIENT_INDEX_CACHE_SIZE 256
+
+struct client_trie_node {
+	struct client_trie_node *child[2];
+	/** Earliest client with exactly this prefix, or NULL */
+	exportlist_client_entry_t *client;
+	uint32_t pos;		/*< Position of client in the list */
+	uint32_t plen;		/*< Prefix length in bits */
+	uint8_t key[16];	/*< Prefix, bits past plen are zero */
+};
+
+struct client_linear {
+	exportlist_client_entry_t *client;
+	uint32_t pos;
+};
+
+struct client_cache_slot {
+	bool valid;
+	sa_family_t family;
+	uint8_t addr[16];
+	exportlist_client_entry_t *client;
+};
+
+struct export_client_index {
+	/** Tries and linear entries, [0] for IPv4 and [1] for IPv6 */
+	struct client_trie_node *trie[2];
+	struct client_linear *linear[2];
+	uint32_t nlinear[2];
+	pthread_mutex_t cache_mtx;
+	struct client_cache_slot cache[CLIENT_INDEX_CACHE_SIZE];
+};
+
+static inline int key_bit(const uint8_t *key, uint32_t bit)
 {
+	return (key[bit / 8] >> (7 - bit % 8)) & 1;
+}
+
+/**
+ * @brief Count the leading bits two keys have in common, up to max
+ */
+static uint32_t key_common(const uint8_t *a, const uint8_t *b, uint32_t max)
+{
+	uint32_t bit = 0;
+	uint8_t diff;
+
+	while (bit + 8 <= max && a[bit / 8] == b[bit / 8])
+		bit += 8;
+
+	if (bit >= max)
+		return max;
+
+	diff = a[bit / 8] ^ b[bit / 8];
+	while (bit < max && (diff & (0x80 >> (bit % 8))) == 0)
+		bit++;
+
+	return bit;
+}
+
+static struct client_trie_node *trie_node_new(const uint8_t *key,
+					      uint32_t plen)
+{
+	struct client_trie_node *node = gsh_calloc(1, sizeof(*node));
+	uint32_t bytes = plen / 8;
+
+	memcpy(node->key, key, bytes);
+	if (plen % 8 != 0)
+		node->key[bytes] = key[bytes] & (0xff << (8 - plen % 8));
+	node->plen = plen;
+
+	return node;
+}
+
+/**
+ * @brief Add a prefix to a client trie
+ *
+ * Clients are added in list order, so a later client with the same
+ * prefix as an earlier one can never match and is dropped.
+ */
+static void trie_insert(struct client_trie_node **pnode, const uint8_t *key,
+			uint32_t plen, exportlist_client_entry_t *client,
+			uint32_t pos)
+{
+	struct client_trie_node *node, *mid;
+	uint32_t common;
+
+	while ((node = *pnode) != NULL) {
+		common = key_common(node->key, key,
+				    node->plen < plen ? node->plen : plen);
+
+		if (common < node->plen) {
+			/* Split node at the point we diverge */
+			mid = trie_node_new(key, common);
+			mid->child[key_bit(node->key, common)] = node;
+			*pnode = mid;
+			if (common == plen) {
+				mid->client = client;
+				mid->pos = pos;
+				return;
+			}
+			pnode = &mid->child[key_bit(key, common)];
+			break;
+		}
+
+		if (node->plen == plen) {
+			if (node->client == NULL) {
+				node->client = client;
+				node->pos = pos;
+			}
+			return;
+		}
+
+		pnode = &node->child[key_bit(key, node->plen)];
+	}
+
+	node = trie_node_new(key, plen);
+	node->client = client;
+	node->pos = pos;
+	*pnode = node;
+}
+
+/**
+ * @brief Find the earliest client whose prefix holds an address
+ */
+static struct client_trie_node *trie_lookup(struct client_trie_node *node,
+					    const uint8_t *key, uint32_t bits)
+{
+	struct client_trie_node *best = NULL;
+
+	while (node != NULL &&
+	       key_common(node->key, key, node->plen) == node->plen) {
+		if (node->client != NULL &&
+		    (best == NULL || node->pos < best->pos))
+			best = node;
+		if (node->plen == bits)
+			break;
+		node = node->child[key_bit(key, node->plen)];
+	}
+
+	return best;
+}
+
+static void trie_free(struct client_trie_node *node)
+{
+	if (node == NULL)
+		return;
+
+	trie_free(node->child[0]);
+	trie_free(node->child[1]);
+	gsh_free(node);
+}
+
+/**
+ * @brief Compile a client list
+ *
+ * @param[in] clients	Client list to compile
+ *
+ * @return The index, which refers to but does not own the clients.
+ */
+static struct export_client_index *client_index_build(
+					struct glist_head *clients)
+{
+	struct export_client_index *index = gsh_calloc(1, sizeof(*index));
+	size_t count = glist_length(clients);
 	struct glist_head *glist;
-	in_addr_t addr = get_in_addr(hostaddr);
-	int rc;
-	int ipvalid = -1;	/* -1 need to print, 0 - invalid, 1 - ok */
-	char hostname[MAXHOSTNAMELEN + 1];
-	char ipstring[SOCK_NAME_MAX + 1];
+	uint32_t pos = 0, netaddr;
+	uint8_t key[16];
+	CIDR *cidr;
+	int pflen;
 
-	glist_for_each(glist, &export->clients) {
+	index->linear[0] = gsh_calloc(count + 1, sizeof(struct client_linear));
+	index->linear[1] = gsh_calloc(count + 1, sizeof(struct client_linear));
+	PTHREAD_MUTEX_init(&index->cache_mtx, NULL);
+
+	glist_for_each(glist, clients) {
 		exportlist_client_entry_t *client;
+		int family = -1;
 
 		client = glist_entry(glist, exportlist_client_entry_t,
 				     cle_list);
-		LogClientListEntry(NIV_MID_DEBUG,
-				   COMPONENT_EXPORT,
-				   __LINE__,
-				   (char *) __func__,
-				   "Match V4: ",
-				   client);
 
 		switch (client->type) {
 		case HOSTIF_CLIENT:
-			if (client->client.hostif.clientaddr == addr)
-				return client;
+			memcpy(key, &client->client.hostif.clientaddr, 4);
+			trie_insert(&index->trie[0], key, 32, client, pos);
 			break;
 
 		case NETWORK_CLIENT:
-			if ((client->client.network.netmask & ntohl(addr)) ==
-			    client->client.network.netaddr)
-				return client;
-			break;
+			/* An address with bits outside of its netmask can
+			 * never match.
+			 */
+			if ((client->client.network.netaddr &
+			     ~client->client.network.netmask) != 0)
+				break;
 
-		case NETGROUP_CLIENT:
-			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
+			cidr = cidr_alloc();
+			cidr->proto = CIDR_IPV4;
+			netaddr = htonl(client->client.network.netmask);
+			memcpy(&cidr->mask[12], &netaddr, 4);
+			pflen = cidr_get_pflen(cidr);
+			cidr_free(cidr);
 
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
-				rc = nfs_ip_name_add(hostaddr,
-						     hostname,
-						     sizeof(hostname));
+			if (pflen < 0) {
+				/* Non-contiguous netmask */
+				family = 0;
+				break;
 			}
 
-			if (rc != IP_NAME_SUCCESS)
-				break; /* Fatal failure */
+			netaddr = htonl(client->client.network.netaddr);
+			memcpy(key, &netaddr, 4);
+			trie_insert(&index->trie[0], key, pflen, client, pos);
+			break;
 
-			/* At this point 'hostname' should contain the
-			 * name that was found
-			 */
-			if (ng_innetgr(client->client.netgroup.netgroupname,
-				    hostname)) {
-				return client;
-			}
+		case HOSTIF_CLIENT_V6:
+			trie_insert(&index->trie[1],
+				    client->client.hostif.clientaddr6.s6_addr,
+				    128, client, pos);
 			break;
 
+		case NETGROUP_CLIENT:
 		case WILDCARDHOST_CLIENT:
-			/* Now checking for IP wildcards */
-			if (ipvalid < 0)
-				ipvalid = sprint_sockip(hostaddr,
-							ipstring,
-							sizeof(ipstring));
-
-			if (ipvalid &&
-			    (fnmatch(client->client.wildcard.wildcard,
-				     ipstring,
-				     FNM_PATHNAME) == 0)) {
-				return client;
-			}
+		case GSSPRINCIPAL_CLIENT:
+			family = 0;
+			break;
+
+		case MATCH_ANY_CLIENT:
+			index->linear[1][index->nlinear[1]].client = client;
+			index->linear[1][index->nlinear[1]++].pos = pos;
+			family = 0;
+			break;
+
+		case BAD_CLIENT:
+		default:
+			break;
+		}
+
+		if (family >= 0) {
+			index->linear[family][index->nlinear[family]].client =
+				client;
+			index->linear[family][index->nlinear[family]++].pos =
+				pos;
+		}
+
+		pos++;
+	}
+
+	return index;
+}
 
-			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
+static void client_index_free(struct export_client_index *index)
+{
+	if (index == NULL)
+		return;
+
+	trie_free(index->trie[0]);
+	trie_free(index->trie[1]);
+	gsh_free(index->linear[0]);
+	gsh_free(index->linear[1]);
+	PTHREAD_MUTEX_destroy(&index->cache_mtx);
+	gsh_free(index);
+}
+
+static struct client_cache_slot *client_cache_slot(
+					struct export_client_index *index,
+					const uint8_t *addr, size_t len)
+{
+	uint32_t hash = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= addr[i];
+		hash *= 16777619U;
+	}
+
+	return &index->cache[hash % CLIENT_INDEX_CACHE_SIZE];
+}
+
+static bool client_cache_get(struct export_client_index *index,
+			     sa_family_t family, const uint8_t *addr,
+			     size_t len, exportlist_client_entry_t **client)
+{
+	struct client_cache_slot *slot = client_cache_slot(index, addr, len);
+	bool found;
+
+	PTHREAD_MUTEX_lock(&index->cache_mtx);
+	found = slot->valid && slot->family == family &&
+		memcmp(slot->addr, addr, len) == 0;
+	if (found)
+		*client = slot->client;
+	PTHREAD_MUTEX_unlock(&index->cache_mtx);
+
+	return found;
+}
+
+static void client_cache_put(struct export_client_index *index,
+			     sa_family_t family, const uint8_t *addr,
+			     size_t len, exportlist_client_entry_t *client)
+{
+	struct client_cache_slot *slot = client_cache_slot(index, addr, len);
+
+	PTHREAD_MUTEX_lock(&index->cache_mtx);
+	slot->valid = true;
+	slot->family = family;
+	memcpy(slot->addr, addr, len);
+	slot->client = client;
+	PTHREAD_MUTEX_unlock(&index->cache_mtx);
+}
+
+/**
+ * @brief Match one client entry against an IPv4 host
+ *
+ * @param[in]     client   Client entry
+ * @param[in]     hostaddr Host to match
+ * @param[in,out] ipvalid  -1 if ipstring is not yet filled in,
+ *                         0 if it is invalid, 1 if ok
+ * @param[in,out] ipstring Printed address of the host
+ *
+ * @return true if the entry matches.
+ */
+static bool client_match_entry(exportlist_client_entry_t *client,
+			       sockaddr_t *hostaddr, int *ipvalid,
+			       char *ipstring)
+{
+	in_addr_t addr = get_in_addr(hostaddr);
+	int rc;
+	char hostname[MAXHOSTNAMELEN + 1];
+
+	LogClientListEntry(NIV_MID_DEBUG,
+			   COMPONENT_EXPORT,
+			   __LINE__,
+			   (char *) __func__,
+			   "Match V4: ",
+			   client);
+
+	switch (client->type) {
+	case HOSTIF_CLIENT:
+		return client->client.hostif.clientaddr == addr;
+
+	case NETWORK_CLIENT:
+		return (client->client.network.netmask & ntohl(addr)) ==
+		       client->client.network.netaddr;
+
+	case NETGROUP_CLIENT:
+		/* Try to get the entry from th IP/name cache */
+		rc = nfs_ip_name_get(hostaddr, hostname, sizeof(hostname));
+
+		if (rc == IP_NAME_NOT_FOUND) {
+			/* IPaddr was not cached, add it to the cache */
+			rc = nfs_ip_name_add(hostaddr,
+					     hostname,
 					     sizeof(hostname));
+		}
 
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
+		if (rc != IP_NAME_SUCCESS)
+			return false; /* Fatal failure */
 
-				/** @todo this change from 1.5 is not IPv6
-				 * useful.  come back to this and use the
-				 * string from client mgr inside req_ctx...
-				 */
-				rc = nfs_ip_name_add(hostaddr,
-						     hostname,
-						     sizeof(hostname));
-			}
+		/* At this point 'hostname' should contain the
+		 * name that was found
+		 */
+		return ng_innetgr(client->client.netgroup.netgroupname,
+				  hostname);
 
-			if (rc != IP_NAME_SUCCESS)
-					break;
+	case WILDCARDHOST_CLIENT:
+		/* Now checking for IP wildcards */
+		if (*ipvalid < 0)
+			*ipvalid = sprint_sockip(hostaddr,
+						 ipstring,
+						 SOCK_NAME_MAX + 1);
+
+		if (*ipvalid &&
+		    (fnmatch(client->client.wildcard.wildcard,
+			     ipstring,
+			     FNM_PATHNAME) == 0)) {
+			return true;
+		}
+
+		/* Try to get the entry from th IP/name cache */
+		rc = nfs_ip_name_get(hostaddr, hostname, sizeof(hostname));
 
-			/* At this point 'hostname' should contain the
-			 * name that was found
+		if (rc == IP_NAME_NOT_FOUND) {
+			/* IPaddr was not cached, add it to the cache */
+
+			/** @todo this change from 1.5 is not IPv6
+			 * useful.  come back to this and use the
+			 * string from client mgr inside req_ctx...
 			 */
-			if (fnmatch
-			    (client->client.wildcard.wildcard, hostname,
-			     FNM_PATHNAME) == 0) {
-				return client;
-			}
-			break;
+			rc = nfs_ip_name_add(hostaddr,
+					     hostname,
+					     sizeof(hostname));
+		}
 
-		case GSSPRINCIPAL_CLIENT:
+		if (rc != IP_NAME_SUCCESS)
+			return false;
+
+		/* At this point 'hostname' should contain the
+		 * name that was found
+		 */
+		return fnmatch(client->client.wildcard.wildcard, hostname,
+			       FNM_PATHNAME) == 0;
+
+	case GSSPRINCIPAL_CLIENT:
 	  /** @todo BUGAZOMEU a completer lors de l'integration de RPCSEC_GSS */
-			LogCrit(COMPONENT_EXPORT,
-				"Unsupported type GSS_PRINCIPAL_CLIENT");
-			break;
+		LogCrit(COMPONENT_EXPORT,
+			"Unsupported type GSS_PRINCIPAL_CLIENT");
+		return false;
 
-		case HOSTIF_CLIENT_V6:
+	case MATCH_ANY_CLIENT:
+		return true;
+
+	case HOSTIF_CLIENT_V6:
+	case BAD_CLIENT:
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief Match an IPv4 host against the client export list
+ *
+ * @param[in]  hostaddr Host to search for
+ * @param[in]  export   Export whose client list to search
+ * @param[out] named    Set if the result depended on a host name
+ *
+ * @return The first matching client entry, or NULL.
+ */
+static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
+					       struct gsh_export *export,
+					       bool *named)
+{
+	struct export_client_index *index = export->client_index;
+	struct glist_head *glist;
+	struct client_trie_node *best;
+	exportlist_client_entry_t *client;
+	in_addr_t addr = get_in_addr(hostaddr);
+	int ipvalid = -1;	/* -1 need to print, 0 - invalid, 1 - ok */
+	char ipstring[SOCK_NAME_MAX + 1];
+	uint32_t i;
+
+	*named = false;
+
+	if (index == NULL) {
+		glist_for_each(glist, &export->clients) {
+			client = glist_entry(glist, exportlist_client_entry_t,
+					     cle_list);
+			if (client->type == NETGROUP_CLIENT ||
+			    client->type == WILDCARDHOST_CLIENT)
+				*named = true;
+			if (client_match_entry(client, hostaddr, &ipvalid,
+					       ipstring))
+				return client;
+		}
+
+		/* no export found for this option */
+		return NULL;
+	}
+
+	if (client_cache_get(index, AF_INET, (uint8_t *) &addr, 4, &client))
+		return client;
+
+	best = trie_lookup(index->trie[0], (uint8_t *) &addr, 32);
+	client = best != NULL ? best->client : NULL;
+
+	/* Only entries ahead of the trie's match can take precedence */
+	for (i = 0; i < index->nlinear[0]; i++) {
+		struct client_linear *lin = &index->linear[0][i];
+
+		if (best != NULL && lin->pos > best->pos)
 			break;
 
-		case MATCH_ANY_CLIENT:
-			return client;
+		if (lin->client->type == NETGROUP_CLIENT ||
+		    lin->client->type == WILDCARDHOST_CLIENT)
+			*named = true;
 
-		case BAD_CLIENT:
-		default:
-			continue;
+		if (client_match_entry(lin->client, hostaddr, &ipvalid,
+				       ipstring)) {
+			client = lin->client;
+			break;
 		}
 	}
 
-	/* no export found for this option */
-	return NULL;
+	if (client != NULL)
+		LogClientListEntry(NIV_MID_DEBUG,
+				   COMPONENT_EXPORT,
+				   __LINE__,
+				   (char *) __func__,
+				   "Matched V4: ",
+				   client);
+
+	if (!*named)
+		client_cache_put(index, AF_INET, (uint8_t *) &addr, 4, client);
 
+	return client;
 }
 
 /**
- * @brief Match a specific option in the client export list
+ * @brief Match an IPv6 host against the client export list
  *
- * @param[in]  paddrv6       Host to search for
- * @param[in]  clients       Client list to search
- * @param[out] client_found Matching entry
- * @param[in]  export_option Option to search for
+ * @param[in] paddrv6 Host to search for
+ * @param[in] export  Export whose client list to search
  *
- * @return true if found, false otherwise.
+ * @return The first matching client entry, or NULL.
  */
 static exportlist_client_entry_t *client_matchv6(struct in6_addr *paddrv6,
 						 struct gsh_export *export)
 {
+	struct export_client_index *index = export->client_index;
 	struct glist_head *glist;
+	struct client_trie_node *best;
+	exportlist_client_entry_t *client;
+
+	if (index == NULL) {
+		glist_for_each(glist, &export->clients) {
+			client = glist_entry(glist, exportlist_client_entry_t,
+					     cle_list);
+			LogClientListEntry(NIV_MID_DEBUG,
+					   COMPONENT_EXPORT,
+					   __LINE__,
+					   (char *) __func__,
+					   "Match V6: ",
+					   client);
+
+			/* Remember that IPv6 address are
+			 * 128 bits = 16 bytes long
+			 */
+			if (client->type == MATCH_ANY_CLIENT ||
+			    (client->type == HOSTIF_CLIENT_V6 &&
+			     !memcmp(client->client.hostif.clientaddr6.s6_addr,
+				     paddrv6->s6_addr, 16)))
+				return client;
+		}
 
-	glist_for_each(glist, &export->clients) {
-		exportlist_client_entry_t *client;
+		/* no export found for this option */
+		return NULL;
+	}
 
-		client = glist_entry(glist, exportlist_client_entry_t,
-				     cle_list);
+	if (client_cache_get(index, AF_INET6, paddrv6->s6_addr, 16, &client))
+		return client;
+
+	best = trie_lookup(index->trie[1], paddrv6->s6_addr, 128);
+	client = best != NULL ? best->client : NULL;
+
+	/* Only MATCH_ANY is linear for IPv6, the first one decides */
+	if (index->nlinear[1] != 0 &&
+	    (best == NULL || index->linear[1][0].pos < best->pos))
+		client = index->linear[1][0].client;
+
+	if (client != NULL)
 		LogClientListEntry(NIV_MID_DEBUG,
 				   COMPONENT_EXPORT,
 				   __LINE__,
 				   (char *) __func__,
-				   "Match V6: ",
+				   "Matched V6: ",
 				   client);
 
-		switch (client->type) {
-		case HOSTIF_CLIENT:
-		case NETWORK_CLIENT:
-		case NETGROUP_CLIENT:
-		case WILDCARDHOST_CLIENT:
-		case GSSPRINCIPAL_CLIENT:
-		case BAD_CLIENT:
-			break;
-
-		case HOSTIF_CLIENT_V6:
-			if (!memcmp(client->client.hostif.clientaddr6.s6_addr,
-				    paddrv6->s6_addr, 16)) {
-				/* Remember that IPv6 address are
-				 * 128 bits = 16 bytes long
-				 */
-				return client;
-			}
-			break;
-
-		case MATCH_ANY_CLIENT:
-			return client;
+	client_cache_put(index, AF_INET6, paddrv6->s6_addr, 16, client);
 
-		default:
-			break;
-		}
-	}
-
-	/* no export found for this option */
-	return NULL;
+	return client;
 }
 
 static exportlist_client_entry_t *client_match_any(sockaddr_t *hostaddr,
-						   struct gsh_export *export)
+						   struct gsh_export *export,
+						   bool *named)
 {
 	if (hostaddr->ss_family == AF_INET6) {
 		struct sockaddr_in6 *psockaddr_in6 =
 		    (struct sockaddr_in6 *)hostaddr;
+
+		*named = false;
 		return client_matchv6(&(psockaddr_in6->sin6_addr), export);
 	} else {
-		return client_match(hostaddr, export);
+		return client_match(hostaddr, export, named);
 	}
 }
 
@@ -2811,20 +3816,24 @@ gid_t get_anonymous_gid(void)
 }
 
 /**
- * @brief Checks if a machine is authorized to access an export entry
+ * @brief Resolve the permissions of the caller on the op context export
  *
  * Permissions in the op context get updated based on export and client.
  *
  * Takes the export->lock in read mode to protect the client list and
  * export permissions while performing this work.
+ *
+ * @param[out] named Set if the client matched depended on a host name
  */
 
-void export_check_access(void)
+static void export_resolve_access(bool *named)
 {
 	exportlist_client_entry_t *client = NULL;
 	sockaddr_t alt_hostaddr;
 	sockaddr_t *hostaddr = NULL;
 
+	*named = false;
+
 	assert(op_ctx != NULL);
 	assert(op_ctx->export_perms != NULL);
 
@@ -2856,7 +3865,7 @@ void export_check_access(void)
 	}
 
 	/* Does the client match anyone on the client list? */
-	client = client_match_any(hostaddr, op_ctx->ctx_export);
+	client = client_match_any(hostaddr, op_ctx->ctx_export, named);
 	if (client != NULL) {
 		/* Take client options */
 		op_ctx->export_perms->options = client->client_perms.options &
@@ -2930,6 +3939,15 @@ void export_check_access(void)
 
 	op_ctx->export_perms->set |= export_opt.def.set;
 
+	/* Nothing can change an immutable export, and nothing conflicts
+	 * with a read delegation on it.
+	 */
+	if (op_ctx->ctx_export != NULL && op_ctx->ctx_export->immutable) {
+		op_ctx->export_perms->options &= ~(EXPORT_OPTION_MODIFY_ACCESS |
+						   EXPORT_OPTION_WRITE_DELEG);
+		op_ctx->export_perms->options |= EXPORT_OPTION_READ_DELEG;
+	}
+
 	if (isMidDebug(COMPONENT_EXPORT)) {
 		char perms[1024] = "\0";
 		struct display_buffer dspbuf = {sizeof(perms), perms, perms};
@@ -2976,3 +3994,110 @@ void export_check_access(void)
 		PTHREAD_RWLOCK_unlock(&op_ctx->ctx_export->lock);
 	}
 }
+
+/**
+ * @brief Checks if a machine is authorized to access an export entry
+ *
+ * Permissions in the op context get updated based on export and client.
+ */
+
+void export_check_access(void)
+{
+	bool named;
+
+	export_resolve_access(&named);
+}
+
+/**
+ * @brief Export permissions resolved on a connection
+ *
+ * The caller of a connection never changes, so the permissions it was
+ * given on an export hold until the export or EXPORT_DEFAULTS is
+ * updated, which changes the generation they were resolved under.
+ * Permissions that depended on a host name are not kept, that is left
+ * to the caches that expire names.
+ */
+
+#define XPRT_EXPORT_PERMS_SLOTS 4
+
+struct xprt_export_perms {
+	pthread_mutex_t mtx;
+	uint32_t next;		/*< Slot to replace next */
+	struct {
+		uint64_t perms_gen;	/*< Export generation, 0 if empty */
+		uint64_t opt_gen;	/*< EXPORT_DEFAULTS generation */
+		uint16_t export_id;
+		struct export_perms perms;
+	} slot[XPRT_EXPORT_PERMS_SLOTS];
+};
+
+struct xprt_export_perms *xprt_export_perms_alloc(void)
+{
+	struct xprt_export_perms *cache = gsh_calloc(1, sizeof(*cache));
+
+	PTHREAD_MUTEX_init(&cache->mtx, NULL);
+
+	return cache;
+}
+
+void xprt_export_perms_free(struct xprt_export_perms *cache)
+{
+	if (cache == NULL)
+		return;
+
+	PTHREAD_MUTEX_destroy(&cache->mtx);
+	gsh_free(cache);
+}
+
+/**
+ * @brief Checks if the caller of a request may access an export entry
+ *
+ * Like export_check_access(), reusing what was resolved on the same
+ * connection when the export has not changed since.
+ *
+ * @param[in] req Request being processed
+ */
+
+void export_check_access_req(struct svc_req *req)
+{
+	gsh_xprt_private_t *xu = req->rq_xprt->xp_u1;
+	struct xprt_export_perms *cache;
+	struct gsh_export *export = op_ctx->ctx_export;
+	uint64_t perms_gen, opt_gen;
+	bool named;
+	int i;
+
+	if (xu == NULL || xu->export_perms == NULL || export == NULL) {
+		export_check_access();
+		return;
+	}
+
+	cache = xu->export_perms;
+	perms_gen = atomic_fetch_uint64_t(&export->perms_gen);
+	opt_gen = atomic_fetch_uint64_t(&export_opt_gen);
+
+	PTHREAD_MUTEX_lock(&cache->mtx);
+	for (i = 0; i < XPRT_EXPORT_PERMS_SLOTS; i++) {
+		if (cache->slot[i].perms_gen == perms_gen &&
+		    cache->slot[i].opt_gen == opt_gen &&
+		    cache->slot[i].export_id == export->export_id) {
+			*op_ctx->export_perms = cache->slot[i].perms;
+			PTHREAD_MUTEX_unlock(&cache->mtx);
+			return;
+		}
+	}
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+
+	export_resolve_access(&named);
+	if (named)
+		return;
+
+	PTHREAD_MUTEX_lock(&cache->mtx);
+	i = cache->next;
+	cache->next = (cache->next + 1) % XPRT_EXPORT_PERMS_SLOTS;
+	cache->slot[i].perms_gen = perms_gen;
+	cache->slot[i].opt_gen = opt_gen;
+	cache->slot[i].export_id = export->export_id;
+	cache->slot[i].perms = *op_ctx->export_perms;
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+}
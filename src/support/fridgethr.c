@@ -49,6 +49,62 @@
 #include "abstract_mem.h"
 #include "fridgethr.h"
 #include "nfs_core.h"
+#include "common_utils.h"
+#include "nfs_metrics.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+/* All fridges, from fridgethr_init to fridgethr_destroy */
+static pthread_mutex_t fridge_list_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head fridge_list = GLIST_HEAD_INIT(fridge_list);
+
+/**
+ * @brief Change the thread count of a fridge
+ *
+ * The thread time is brought up to date first, so it adds up the
+ * time each thread existed.
+ *
+ * @note This function must be called with the fridge mutex held.
+ *
+ * @param[in,out] fr    The fridge
+ * @param[in]     delta Threads added, negative if removed
+ */
+
+static void fridgethr_count_threads(struct fridgethr *fr, int delta)
+{
+	struct timespec ts;
+
+	now(&ts);
+	fr->st.thread_ns += fr->nthreads * timespec_diff(&fr->st.thread_ts,
+							 &ts);
+	fr->st.thread_ts = ts;
+	fr->nthreads += delta;
+}
+
+/**
+ * @brief Number of jobs waiting for a thread
+ *
+ * @note This function must be called with the fridge mutex held.
+ */
+
+static uint32_t fridgethr_ndeferred(struct fridgethr *fr)
+{
+	if (fr->p.flavor != fridgethr_flavor_worker)
+		return 0;
+
+	switch (fr->p.deferment) {
+	case fridgethr_defer_queue:
+		return fr->nqueued;
+	case fridgethr_defer_block:
+		return fr->deferment.block.waiters;
+	case fridgethr_defer_fail:
+		break;
+	}
+
+	return 0;
+}
 
 /**
  * @brief Initialize a thread fridge
@@ -99,7 +155,11 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 	frobj->s = NULL;
 	frobj->nthreads = 0;
 	frobj->nidle = 0;
+	frobj->nretiring = 0;
+	frobj->nqueued = 0;
 	frobj->flags = fridgethr_flag_none;
+	memset(&frobj->st, 0, sizeof(frobj->st));
+	now(&frobj->st.thread_ts);
 
 	/* This always succeeds on Linux, but it might fail on other
 	   systems or future versions of Linux. */
@@ -186,6 +246,10 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 		goto out;
 	}
 
+	PTHREAD_MUTEX_lock(&fridge_list_mtx);
+	glist_add_tail(&fridge_list, &frobj->fridges);
+	PTHREAD_MUTEX_unlock(&fridge_list_mtx);
+
 	*frout = frobj;
 	rc = 0;
 
@@ -221,6 +285,10 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 
 void fridgethr_destroy(struct fridgethr *fr)
 {
+	PTHREAD_MUTEX_lock(&fridge_list_mtx);
+	glist_del(&fr->fridges);
+	PTHREAD_MUTEX_unlock(&fridge_list_mtx);
+
 	PTHREAD_MUTEX_destroy(&fr->mtx);
 	pthread_attr_destroy(&fr->attr);
 	gsh_free(fr->s);
@@ -322,8 +390,10 @@ static bool fridgethr_getwork(struct fridgethr *fr, struct fridgethr_entry *fe)
 				      struct fridgethr_work,
 				      link);
 		glist_del(&q->link);
+		--(fr->nqueued);
 		fe->ctx.func = q->func;
 		fe->ctx.arg = q->arg;
+		fe->submitted = q->submitted;
 		gsh_free(q);
 		return true;
 	}
@@ -367,10 +437,12 @@ static bool fridgethr_freeze(struct fridgethr *fr,
 
 	/* rc would have been set in the while loop below */
 	if (((rc == ETIMEDOUT) && (fr->nthreads > fr->p.thr_min))
-	    || (fr->command == fridgethr_comm_stop)) {
+	    || (fr->command == fridgethr_comm_stop) || fe->retiring) {
 		/* We do this here since we already have the fridge
 		   lock. */
-		--(fr->nthreads);
+		if (fe->retiring)
+			--(fr->nretiring);
+		fridgethr_count_threads(fr, -1);
 		glist_del(&fe->thread_link);
 		if ((fr->nthreads == 0) && (fr->command == fridgethr_comm_stop)
 		    && (fr->transitioning) && !fridgethr_deferredwork(fr)) {
@@ -501,6 +573,55 @@ static bool fridgethr_freeze(struct fridgethr *fr,
 __thread struct req_op_context *op_ctx;
 
 
+/**
+ * @brief Note the start of a job
+ *
+ * Records how long the job waited since its submission and how long
+ * the thread was idle since its last job.  The fridge calls this
+ * around the function of every job, except in loopers with a
+ * wake_threads function, whose functions wait for work themselves
+ * and call this for each piece of work they take.
+ *
+ * @param[in] ctx       The thread context
+ * @param[in] submitted When the job was submitted, NULL or zero if
+ *                      not known
+ */
+
+void fridgethr_job_start(struct fridgethr_context *ctx,
+			 const struct timespec *submitted)
+{
+	struct fridgethr_entry *fe = container_of(ctx, struct fridgethr_entry,
+						  ctx);
+	struct fridgethr *fr = fe->fr;
+
+	now(&fe->started);
+	if (submitted != NULL && submitted->tv_sec != 0)
+		lat_hist_record(&fr->st.wait,
+				timespec_diff(submitted, &fe->started));
+	if (fe->ended.tv_sec != 0)
+		lat_hist_record(&fr->st.idle,
+				timespec_diff(&fe->ended, &fe->started));
+}
+
+/**
+ * @brief Note the end of a job started with fridgethr_job_start
+ *
+ * @param[in] ctx The thread context
+ */
+
+void fridgethr_job_end(struct fridgethr_context *ctx)
+{
+	struct fridgethr_entry *fe = container_of(ctx, struct fridgethr_entry,
+						  ctx);
+	struct fridgethr *fr = fe->fr;
+	nsecs_elapsed_t run;
+
+	now(&fe->ended);
+	run = timespec_diff(&fe->started, &fe->ended);
+	lat_hist_record(&fr->st.run, run);
+	(void)atomic_add_uint64_t(&fr->st.busy_ns, run);
+}
+
 /**
  * @brief Initialization of a new thread in the fridge
  *
@@ -547,7 +668,16 @@ static void *fridgethr_start_routine(void *arg)
 		fr->p.thread_initialize(&fe->ctx);
 
 	do {
-		fe->ctx.func(&fe->ctx);
+		/* A looper that waits for work on its own accounts for
+		   its jobs itself. */
+		if (fr->p.wake_threads == NULL) {
+			fridgethr_job_start(&fe->ctx, &fe->submitted);
+			fe->ctx.func(&fe->ctx);
+			fridgethr_job_end(&fe->ctx);
+		} else {
+			fe->ctx.func(&fe->ctx);
+		}
+		memset(&fe->submitted, 0, sizeof(fe->submitted));
 		if (fr->p.task_cleanup)
 			fr->p.task_cleanup(&fe->ctx);
 
@@ -573,15 +703,17 @@ static void *fridgethr_start_routine(void *arg)
  * @note This function must be called with the fridge mutex held and
  * it releases the fridge mutex.
  *
- * @param[in] fr   The fridge in which to spawn the thread
- * @param[in] func The thing to do
- * @param[in] arg  The thing to do it to
+ * @param[in] fr        The fridge in which to spawn the thread
+ * @param[in] func      The thing to do
+ * @param[in] arg       The thing to do it to
+ * @param[in] submitted When it was submitted, NULL if not a job
  *
  * @return 0 on success or POSIX error codes.
  */
 
 static int fridgethr_spawn(struct fridgethr *fr,
-			   void (*func)(struct fridgethr_context *), void *arg)
+			   void (*func)(struct fridgethr_context *), void *arg,
+			   const struct timespec *submitted)
 {
 	/* Return code */
 	int rc = 0;
@@ -617,6 +749,8 @@ static int fridgethr_spawn(struct fridgethr *fr,
 	fe->ctx.func = func;
 	fe->ctx.arg = arg;
 	fe->frozen = false;
+	if (submitted != NULL)
+		fe->submitted = *submitted;
 
 	rc = pthread_create(&fe->ctx.id, &fr->attr, fridgethr_start_routine,
 			    fe);
@@ -634,7 +768,7 @@ static int fridgethr_spawn(struct fridgethr *fr,
 		     fr, (unsigned int)fe->ctx.id, fr->nthreads, fr->nidle);
 #endif
 	/* Make a new thread */
-	++(fr->nthreads);
+	fridgethr_count_threads(fr, 1);
 
 	glist_add_tail(&fr->thread_list, &fe->thread_link);
 	PTHREAD_MUTEX_unlock(&fr->mtx);
@@ -662,15 +796,17 @@ static int fridgethr_spawn(struct fridgethr *fr,
  *
  * @note This function must be called with the fridge lock held.
  *
- * @param[in] fr   The fridge in which to find a thread
- * @param[in] func The thing to do
- * @param[in] arg  The thing to do it to
+ * @param[in] fr        The fridge in which to find a thread
+ * @param[in] func      The thing to do
+ * @param[in] arg       The thing to do it to
+ * @param[in] submitted When it was submitted
  *
  * @return 0 or POSIX errors.
  */
 
 static int fridgethr_queue(struct fridgethr *fr,
-			   void (*func)(struct fridgethr_context *), void *arg)
+			   void (*func)(struct fridgethr_context *), void *arg,
+			   const struct timespec *submitted)
 {
 	/* Queue */
 	struct fridgethr_work *q;
@@ -682,7 +818,10 @@ static int fridgethr_queue(struct fridgethr *fr,
 	glist_init(&q->link);
 	q->func = func;
 	q->arg = arg;
+	q->submitted = *submitted;
 	glist_add_tail(&fr->deferment.work_q, &q->link);
+	if (++(fr->nqueued) > fr->st.deferred_max)
+		fr->st.deferred_max = fr->nqueued;
 
 	return 0;
 }
@@ -692,16 +831,17 @@ static int fridgethr_queue(struct fridgethr *fr,
  *
  * @note The fridge lock must be held when calling this routine.
  *
- * @param[in] fr   The fridge in which to find a thread
- * @param[in] func The thing to do
- * @param[in] arg  The thing to do it to
+ * @param[in] fr        The fridge in which to find a thread
+ * @param[in] func      The thing to do
+ * @param[in] arg       The thing to do it to
+ * @param[in] submitted When it was submitted
  *
  * @return true if the job was successfully dispatched.
  */
 
 static bool fridgethr_dispatch(struct fridgethr *fr,
 			       void (*func)(struct fridgethr_context *),
-			       void *arg)
+			       void *arg, const struct timespec *submitted)
 {
 	/* The entry for the found thread */
 	struct fridgethr_entry *fe;
@@ -724,6 +864,7 @@ static bool fridgethr_dispatch(struct fridgethr *fr,
 			--(fr->nidle);
 			fe->ctx.func = func;
 			fe->ctx.arg = arg;
+			fe->submitted = *submitted;
 			fe->frozen = false;
 			fe->flags |= fridgethr_flag_dispatched;
 			pthread_cond_signal(&fe->ctx.cv);
@@ -745,22 +886,25 @@ static bool fridgethr_dispatch(struct fridgethr *fr,
  *
  * @note This function must be called with the fridge lock held.
  *
- * @param[in] fr   The fridge in which to find a thread
- * @param[in] func The thing to do
- * @param[in] arg  The thing to do it to
+ * @param[in] fr        The fridge in which to find a thread
+ * @param[in] func      The thing to do
+ * @param[in] arg       The thing to do it to
+ * @param[in] submitted When it was submitted
  *
  * @return 0 or POSIX errors.
  */
 
 static int fridgethr_block(struct fridgethr *fr,
-			   void (*func)(struct fridgethr_context *), void *arg)
+			   void (*func)(struct fridgethr_context *), void *arg,
+			   const struct timespec *submitted)
 {
 	/* Successfully dispatched */
 	bool dispatched = true;
 	/* Return code */
 	int rc = 0;
 
-	++(fr->deferment.block.waiters);
+	if (++(fr->deferment.block.waiters) > fr->st.deferred_max)
+		fr->st.deferred_max = fr->deferment.block.waiters;
 	do {
 		if (fr->p.block_delay > 0) {
 			struct timespec t;
@@ -776,7 +920,8 @@ static int fridgethr_block(struct fridgethr *fr,
 		if (rc == 0) {
 			switch (fr->command) {
 			case fridgethr_comm_run:
-				dispatched = fridgethr_dispatch(fr, func, arg);
+				dispatched = fridgethr_dispatch(fr, func, arg,
+								submitted);
 				break;
 
 			case fridgethr_comm_stop:
@@ -826,6 +971,8 @@ int fridgethr_submit(struct fridgethr *fr,
 {
 	/* Return code */
 	int rc = 0;
+	/* Submission time */
+	struct timespec submitted;
 
 	if (fr == NULL) {
 		LogMajor(COMPONENT_THREAD,
@@ -833,6 +980,8 @@ int fridgethr_submit(struct fridgethr *fr,
 		return EPIPE;
 	}
 
+	now(&submitted);
+
 	PTHREAD_MUTEX_lock(&fr->mtx);
 	if (fr->command == fridgethr_comm_stop) {
 		LogMajor(COMPONENT_THREAD,
@@ -842,6 +991,8 @@ int fridgethr_submit(struct fridgethr *fr,
 		return EPIPE;
 	}
 
+	++(fr->st.submitted);
+
 	if (fr->command == fridgethr_comm_pause) {
 		LogFullDebug(COMPONENT_THREAD,
 			     "Attempt to schedule job in paused fridge %s, pausing.",
@@ -850,19 +1001,19 @@ int fridgethr_submit(struct fridgethr *fr,
 	}
 
 	if (fr->nidle > 0) {
-		if (fridgethr_dispatch(fr, func, arg)) {
+		if (fridgethr_dispatch(fr, func, arg, &submitted)) {
 			PTHREAD_MUTEX_unlock(&fr->mtx);
 			return 0;
 		}
 	}
 
 	if ((fr->p.thr_max == 0) || (fr->nthreads < fr->p.thr_max)) {
-		rc = fridgethr_spawn(fr, func, arg);
+		rc = fridgethr_spawn(fr, func, arg, &submitted);
 	} else {
  defer:
 		switch (fr->p.deferment) {
 		case fridgethr_defer_queue:
-			rc = fridgethr_queue(fr, func, arg);
+			rc = fridgethr_queue(fr, func, arg, &submitted);
 			break;
 
 		case fridgethr_defer_fail:
@@ -870,7 +1021,7 @@ int fridgethr_submit(struct fridgethr *fr,
 			break;
 
 		case fridgethr_defer_block:
-			rc = fridgethr_block(fr, func, arg);
+			rc = fridgethr_block(fr, func, arg, &submitted);
 		};
 		PTHREAD_MUTEX_unlock(&fr->mtx);
 	}
@@ -1109,11 +1260,13 @@ int fridgethr_stop(struct fridgethr *fr, pthread_mutex_t *mtx,
 					      struct fridgethr_work,
 					      link);
 			glist_del(&q->link);
-			rc = fridgethr_spawn(fr, q->func, q->arg);
+			--(fr->nqueued);
+			rc = fridgethr_spawn(fr, q->func, q->arg,
+					     &q->submitted);
 			gsh_free(q);
 		} else {
 			/* Spawn a dummy to clean out the queue */
-			rc = fridgethr_spawn(fr, fridgethr_noop, NULL);
+			rc = fridgethr_spawn(fr, fridgethr_noop, NULL, NULL);
 		}
 		PTHREAD_MUTEX_unlock(&fr->mtx);
 	}
@@ -1217,13 +1370,15 @@ int fridgethr_start(struct fridgethr *fr, pthread_mutex_t *mtx,
 					      struct fridgethr_work,
 					      link);
 			glist_del(&q->link);
-			rc = fridgethr_spawn(fr, q->func, q->arg);
+			--(fr->nqueued);
+			rc = fridgethr_spawn(fr, q->func, q->arg,
+					     &q->submitted);
 			gsh_free(q);
 			PTHREAD_MUTEX_lock(&fr->mtx);
 			if (rc != 0)
 				break;
 		} else {
-			rc = fridgethr_spawn(fr, fridgethr_noop, NULL);
+			rc = fridgethr_spawn(fr, fridgethr_noop, NULL, NULL);
 			PTHREAD_MUTEX_lock(&fr->mtx);
 			if (rc != 0)
 				break;
@@ -1347,8 +1502,9 @@ bool fridgethr_you_should_break(struct fridgethr_context *ctx)
 						  ctx);
 	struct fridgethr *fr = fe->fr;
 
-	/* No locking is needed as it is only read */
-	return fr->transitioning;
+	/* No locking is needed as it is only read, and retiring is only
+	   ever set by this thread. */
+	return fr->transitioning || fe->retiring;
 }
 
 /**
@@ -1389,7 +1545,7 @@ int fridgethr_populate(struct fridgethr *fr,
 		fe = gsh_calloc(1, sizeof(struct fridgethr_entry));
 
 		/* Make a new thread */
-		++(fr->nthreads);
+		fridgethr_count_threads(fr, 1);
 
 		glist_add_tail(&fr->thread_list, &fe->thread_link);
 
@@ -1430,6 +1586,149 @@ int fridgethr_populate(struct fridgethr *fr,
 	return 0;
 }
 
+/**
+ * @brief Add a thread to a running looper fridge
+ *
+ * Used to grow a fridge populated with fewer than its maximum
+ * number of threads.
+ *
+ * @param[in,out] fr   Fridge to grow
+ * @param[in]     func Function the new thread should run
+ * @param[in]     arg  Argument supplied for that function
+ *
+ * @retval 0 on success.
+ * @retval EBUSY if the fridge is at its maximum or not running.
+ * @retval Other codes from thread creation.
+ */
+
+int fridgethr_grow(struct fridgethr *fr,
+		   void (*func)(struct fridgethr_context *), void *arg)
+{
+	PTHREAD_MUTEX_lock(&fr->mtx);
+	if ((fr->command != fridgethr_comm_run) || fr->transitioning
+	    || ((fr->p.thr_max != 0)
+		&& (fr->nthreads - fr->nretiring >= fr->p.thr_max))) {
+		PTHREAD_MUTEX_unlock(&fr->mtx);
+		return EBUSY;
+	}
+
+	/* Releases the fridge mutex */
+	return fridgethr_spawn(fr, func, arg, NULL);
+}
+
+/**
+ * @brief Ask to take the calling thread out of its fridge
+ *
+ * A thread of a looper fridge calls this when it finds itself
+ * surplus.  If the fridge stays above its low water mark without
+ * it, fridgethr_you_should_break will return true from then on and
+ * the thread exits once its function returns.
+ *
+ * @param[in] ctx The thread context
+ *
+ * @retval true if the thread is to exit.
+ * @retval false if it must stay.
+ */
+
+bool fridgethr_retire(struct fridgethr_context *ctx)
+{
+	struct fridgethr_entry *fe = container_of(ctx, struct fridgethr_entry,
+						  ctx);
+	struct fridgethr *fr = fe->fr;
+
+	PTHREAD_MUTEX_lock(&fr->mtx);
+	if (!fe->retiring && (fr->command == fridgethr_comm_run)
+	    && (fr->nthreads - fr->nretiring > fr->p.thr_min)) {
+		fe->retiring = true;
+		++(fr->nretiring);
+	}
+	PTHREAD_MUTEX_unlock(&fr->mtx);
+
+	return fe->retiring;
+}
+
+/**
+ * @brief Take the calling thread out of its fridge if over the maximum
+ *
+ * Threads of a looper fridge whose maximum was lowered by
+ * fridgethr_set_limits call this between jobs.  Cheap when there is
+ * nothing to do.
+ *
+ * @param[in] ctx The thread context
+ *
+ * @retval true if the thread is to exit.
+ * @retval false if it must stay.
+ */
+
+bool fridgethr_retire_excess(struct fridgethr_context *ctx)
+{
+	struct fridgethr_entry *fe = container_of(ctx, struct fridgethr_entry,
+						  ctx);
+	struct fridgethr *fr = fe->fr;
+
+	/* Unlocked peek, a stale value only delays the exit */
+	if (fe->retiring || fr->p.thr_max == 0 ||
+	    fr->nthreads - fr->nretiring <= fr->p.thr_max)
+		return fe->retiring;
+
+	PTHREAD_MUTEX_lock(&fr->mtx);
+	if (!fe->retiring && (fr->command == fridgethr_comm_run)
+	    && (fr->p.thr_max != 0)
+	    && (fr->nthreads - fr->nretiring > fr->p.thr_max)) {
+		fe->retiring = true;
+		++(fr->nretiring);
+	}
+	PTHREAD_MUTEX_unlock(&fr->mtx);
+
+	return fe->retiring;
+}
+
+/**
+ * @brief Change the thread limits of a running looper fridge
+ *
+ * Threads are added at once up to the new minimum.  Threads above
+ * the new maximum leave through fridgethr_retire_excess.
+ *
+ * @param[in,out] fr      Fridge to resize
+ * @param[in]     thr_min New minimum number of threads
+ * @param[in]     thr_max New maximum number of threads
+ * @param[in]     func    Function new threads should run
+ * @param[in]     arg     Argument supplied for that function
+ *
+ * @retval 0 on success.
+ * @retval Other codes from thread creation.
+ */
+
+int fridgethr_set_limits(struct fridgethr *fr, uint32_t thr_min,
+			 uint32_t thr_max,
+			 void (*func)(struct fridgethr_context *), void *arg)
+{
+	int rc = 0;
+
+	PTHREAD_MUTEX_lock(&fr->mtx);
+	fr->p.thr_min = thr_min;
+	fr->p.thr_max = thr_max;
+	PTHREAD_MUTEX_unlock(&fr->mtx);
+
+	LogEvent(COMPONENT_THREAD,
+		 "Fridge %s now runs %"PRIu32" to %"PRIu32" threads",
+		 fr->s, thr_min, thr_max);
+
+	while (rc == 0) {
+		PTHREAD_MUTEX_lock(&fr->mtx);
+		if ((fr->command != fridgethr_comm_run) || fr->transitioning
+		    || (fr->nthreads - fr->nretiring >= fr->p.thr_min)) {
+			PTHREAD_MUTEX_unlock(&fr->mtx);
+			break;
+		}
+
+		/* Releases the fridge mutex */
+		rc = fridgethr_spawn(fr, func, arg, NULL);
+	}
+
+	return rc;
+}
+
 /**
  * @brief Set the wait time of a running fridge
  *
@@ -1497,12 +1796,259 @@ void fridgethr_cancel(struct fridgethr *fr)
 		   good enough for me. */
 		pthread_cancel(t->ctx.id);
 		glist_del(&t->thread_link);
-		--(fr->nthreads);
+		fridgethr_count_threads(fr, -1);
 	}
 	PTHREAD_MUTEX_unlock(&fr->mtx);
 	LogEvent(COMPONENT_THREAD, "All threads in %s cancelled.", fr->s);
 }
 
+struct fridge_row {
+	char *name;
+	uint32_t threads;
+	uint32_t idle;
+	uint32_t deferred;
+	uint32_t deferred_max;
+	uint64_t submitted;
+	uint64_t busy_ns;
+	uint64_t thread_ns;
+	struct lat_hist wait;
+	struct lat_hist run;
+	struct lat_hist idle_hist;
+};
+
+static void fridge_hist_add(struct lat_hist *sum, struct lat_hist *h)
+{
+	int i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++)
+		sum->bucket[i] += atomic_fetch_uint64_t(&h->bucket[i]);
+}
+
+/**
+ * @brief Gather the rows of a report
+ *
+ * Fridges of the same name add up in one row.
+ *
+ * @param[out] nrows Number of rows
+ *
+ * @return The rows, to be freed with fridge_rows_free().
+ */
+
+static struct fridge_row *fridge_rows(int *nrows)
+{
+	struct glist_head *glist;
+	struct fridge_row *rows;
+	struct timespec ts;
+	int n = 0, max = 0, i;
+
+	PTHREAD_MUTEX_lock(&fridge_list_mtx);
+
+	glist_for_each(glist, &fridge_list)
+		max++;
+	rows = gsh_calloc(max ? max : 1, sizeof(*rows));
+
+	glist_for_each(glist, &fridge_list) {
+		struct fridgethr *fr = glist_entry(glist, struct fridgethr,
+						   fridges);
+		struct fridge_row *row;
+
+		for (i = 0; i < n; i++)
+			if (strcmp(rows[i].name, fr->s) == 0)
+				break;
+		if (i == n)
+			rows[n++].name = gsh_strdup(fr->s);
+		row = &rows[i];
+
+		PTHREAD_MUTEX_lock(&fr->mtx);
+		now(&ts);
+		row->threads += fr->nthreads;
+		row->idle += fr->nidle;
+		row->deferred += fridgethr_ndeferred(fr);
+		row->deferred_max += fr->st.deferred_max;
+		row->submitted += fr->st.submitted;
+		row->thread_ns += fr->st.thread_ns +
+			fr->nthreads * timespec_diff(&fr->st.thread_ts, &ts);
+		PTHREAD_MUTEX_unlock(&fr->mtx);
+
+		row->busy_ns += atomic_fetch_uint64_t(&fr->st.busy_ns);
+		fridge_hist_add(&row->wait, &fr->st.wait);
+		fridge_hist_add(&row->run, &fr->st.run);
+		fridge_hist_add(&row->idle_hist, &fr->st.idle);
+	}
+
+	PTHREAD_MUTEX_unlock(&fridge_list_mtx);
+
+	*nrows = n;
+	return rows;
+}
+
+static void fridge_rows_free(struct fridge_row *rows, int nrows)
+{
+	int i;
+
+	for (i = 0; i < nrows; i++)
+		gsh_free(rows[i].name);
+	gsh_free(rows);
+}
+
+/**
+ * @brief Write the fridge families for a scrape
+ *
+ * Utilization is rate(busy_seconds) / rate(thread_seconds).
+ *
+ * @param[in] out Reply stream
+ */
+
+void fridgethr_metrics(FILE *out)
+{
+	struct fridge_row *rows;
+	char labels[64];
+	int nrows, i;
+
+	rows = fridge_rows(&nrows);
+
+	fprintf(out, "# TYPE ganesha_fridge_threads gauge\n"
+		"# HELP ganesha_fridge_threads Threads, by fridge\n");
+	for (i = 0; i < nrows; i++)
+		fprintf(out, "ganesha_fridge_threads{fridge=\"%s\"} %" PRIu32
+			"\n", rows[i].name, rows[i].threads);
+
+	fprintf(out, "# TYPE ganesha_fridge_idle_threads gauge\n"
+		"# HELP ganesha_fridge_idle_threads Threads waiting for a "
+		"job, by fridge\n");
+	for (i = 0; i < nrows; i++)
+		fprintf(out, "ganesha_fridge_idle_threads{fridge=\"%s\"} %"
+			PRIu32 "\n", rows[i].name, rows[i].idle);
+
+	fprintf(out, "# TYPE ganesha_fridge_deferred gauge\n"
+		"# HELP ganesha_fridge_deferred Jobs queued or blocked "
+		"waiting for a thread, by fridge\n");
+	for (i = 0; i < nrows; i++)
+		fprintf(out, "ganesha_fridge_deferred{fridge=\"%s\"} %" PRIu32
+			"\n", rows[i].name, rows[i].deferred);
+
+	fprintf(out, "# TYPE ganesha_fridge_deferred_max gauge\n"
+		"# HELP ganesha_fridge_deferred_max Most jobs ever waiting "
+		"for a thread, by fridge\n");
+	for (i = 0; i < nrows; i++)
+		fprintf(out, "ganesha_fridge_deferred_max{fridge=\"%s\"} %"
+			PRIu32 "\n", rows[i].name, rows[i].deferred_max);
+
+	fprintf(out, "# TYPE ganesha_fridge_jobs counter\n"
+		"# HELP ganesha_fridge_jobs Jobs submitted, by fridge\n");
+	for (i = 0; i < nrows; i++)
+		fprintf(out, "ganesha_fridge_jobs_total{fridge=\"%s\"} %"
+			PRIu64 "\n", rows[i].name, rows[i].submitted);
+
+	fprintf(out, "# TYPE ganesha_fridge_busy_seconds counter\n"
+		"# HELP ganesha_fridge_busy_seconds Time threads spent "
+		"running jobs, by fridge\n");
+	for (i = 0; i < nrows; i++)
+		fprintf(out, "ganesha_fridge_busy_seconds_total{fridge=\"%s\"}"
+			" %.9g\n", rows[i].name, rows[i].busy_ns / 1e9);
+
+	fprintf(out, "# TYPE ganesha_fridge_thread_seconds counter\n"
+		"# HELP ganesha_fridge_thread_seconds Time threads existed, "
+		"by fridge\n");
+	for (i = 0; i < nrows; i++)
+		fprintf(out, "ganesha_fridge_thread_seconds_total{fridge="
+			"\"%s\"} %.9g\n", rows[i].name,
+			rows[i].thread_ns / 1e9);
+
+	fprintf(out, "# TYPE ganesha_fridge_wait_seconds histogram\n"
+		"# HELP ganesha_fridge_wait_seconds Time from submission to "
+		"start of a job, by fridge\n");
+	for (i = 0; i < nrows; i++) {
+		(void) snprintf(labels, sizeof(labels), "fridge=\"%s\"",
+				rows[i].name);
+		metrics_lat_hist(out, "ganesha_fridge_wait_seconds", labels,
+				 &rows[i].wait, -1);
+	}
+
+	fprintf(out, "# TYPE ganesha_fridge_run_seconds histogram\n"
+		"# HELP ganesha_fridge_run_seconds Run time of a job, by "
+		"fridge\n");
+	for (i = 0; i < nrows; i++) {
+		(void) snprintf(labels, sizeof(labels), "fridge=\"%s\"",
+				rows[i].name);
+		metrics_lat_hist(out, "ganesha_fridge_run_seconds", labels,
+				 &rows[i].run, rows[i].busy_ns / 1e9);
+	}
+
+	fprintf(out, "# TYPE ganesha_fridge_idle_seconds histogram\n"
+		"# HELP ganesha_fridge_idle_seconds Time a thread waits "
+		"between jobs, by fridge\n");
+	for (i = 0; i < nrows; i++) {
+		(void) snprintf(labels, sizeof(labels), "fridge=\"%s\"",
+				rows[i].name);
+		metrics_lat_hist(out, "ganesha_fridge_idle_seconds", labels,
+				 &rows[i].idle_hist, -1);
+	}
+
+	fridge_rows_free(rows, nrows);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the counters and histograms of the fridges
+ *
+ * @param[in] iter Reply iterator
+ */
+
+void fridgethr_dbus_show(DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	struct fridge_row *rows;
+	char name[64];
+	int nrows, i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	rows = fridge_rows(&nrows);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(suuuuttt)",
+					 &array_iter);
+	for (i = 0; i < nrows; i++) {
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &rows[i].name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &rows[i].threads);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &rows[i].idle);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &rows[i].deferred);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &rows[i].deferred_max);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &rows[i].submitted);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &rows[i].busy_ns);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &rows[i].thread_ns);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(sa(tt))",
+					 &array_iter);
+	for (i = 0; i < nrows; i++) {
+		(void) snprintf(name, sizeof(name), "%s wait", rows[i].name);
+		server_dbus_lat_hist(name, &rows[i].wait, &array_iter);
+		(void) snprintf(name, sizeof(name), "%s run", rows[i].name);
+		server_dbus_lat_hist(name, &rows[i].run, &array_iter);
+		(void) snprintf(name, sizeof(name), "%s idle", rows[i].name);
+		server_dbus_lat_hist(name, &rows[i].idle_hist, &array_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	fridge_rows_free(rows, nrows);
+}
+#endif				/* USE_DBUS */
+
 struct fridgethr *general_fridge;
 
 int general_fridge_init(void)
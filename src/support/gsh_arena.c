@@ -0,0 +1,101 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_arena.c
+ * @brief Chunk management of the bump allocator
+ */
+
+#include "config.h"
+
+#include "abstract_mem.h"
+#include "gsh_arena.h"
+
+/** Size of the first chunk of an arena */
+#define GSH_ARENA_CHUNK_MIN 4096
+/** Chunks double in size up to this */
+#define GSH_ARENA_CHUNK_MAX (64 * 1024)
+
+/**
+ * @brief Allocate from a new chunk
+ *
+ * Called when the current chunk has no room left.  An allocation of
+ * more than half a chunk gets a chunk of its own, slipped behind the
+ * current one so that what is left of that is still used.
+ *
+ * @param[in,out] arena  The arena
+ * @param[in]     size   Bytes to allocate, already aligned
+ *
+ * @return The memory.
+ */
+void *gsh_arena_alloc_chunk(struct gsh_arena *arena, size_t size)
+{
+	struct gsh_arena_chunk *cur = arena->chunk, *chunk;
+	size_t csize = GSH_ARENA_CHUNK_MIN;
+
+	if (cur != NULL && cur->size < GSH_ARENA_CHUNK_MAX)
+		csize = cur->size * 2;
+	else if (cur != NULL)
+		csize = GSH_ARENA_CHUNK_MAX;
+
+	if (size > csize / 2) {
+		chunk = gsh_malloc(sizeof(*chunk) + size);
+		chunk->size = size;
+		chunk->used = size;
+
+		if (cur != NULL) {
+			chunk->next = cur->next;
+			cur->next = chunk;
+		} else {
+			chunk->next = NULL;
+			arena->chunk = chunk;
+		}
+
+		return chunk->data;
+	}
+
+	chunk = gsh_malloc(sizeof(*chunk) + csize);
+	chunk->size = csize;
+	chunk->used = size;
+	chunk->next = cur;
+	arena->chunk = chunk;
+
+	return chunk->data;
+}
+
+/**
+ * @brief Free all the memory of an arena
+ *
+ * The arena is left empty and may be used again.
+ *
+ * @param[in,out] arena  The arena
+ */
+void gsh_arena_release(struct gsh_arena *arena)
+{
+	struct gsh_arena_chunk *chunk, *next;
+
+	for (chunk = arena->chunk; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		gsh_free(chunk);
+	}
+
+	arena->chunk = NULL;
+}
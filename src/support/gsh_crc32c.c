@@ -0,0 +1,136 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_crc32c.c
+ * @brief CRC32C (Castagnoli) checksum with hardware dispatch
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include "gsh_crc32c.h"
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+/** Reflected Castagnoli polynomial */
+#define CRC32C_POLY 0x82F63B78
+
+static uint32_t crc32c_table[256];
+
+static void crc32c_table_init(void)
+{
+	uint32_t i, j, c;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++)
+			c = (c >> 1) ^ (CRC32C_POLY & (0 - (c & 1)));
+		crc32c_table[i] = c;
+	}
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	crc = ~crc;
+	while (len--)
+		crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__ ((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	uint64_t c = ~crc & 0xffffffff;
+	uint64_t v;
+
+	for (; len >= sizeof(v); len -= sizeof(v), p += sizeof(v)) {
+		memcpy(&v, p, sizeof(v));
+		c = __builtin_ia32_crc32di(c, v);
+	}
+	while (len--)
+		c = __builtin_ia32_crc32qi(c, *p++);
+
+	return ~(uint32_t)c;
+}
+
+static bool crc32c_hw_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2");
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+static uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	uint64_t v;
+
+	crc = ~crc;
+	for (; len >= sizeof(v); len -= sizeof(v), p += sizeof(v)) {
+		memcpy(&v, p, sizeof(v));
+		crc = __crc32cd(crc, v);
+	}
+	while (len--)
+		crc = __crc32cb(crc, *p++);
+
+	return ~crc;
+}
+
+static bool crc32c_hw_supported(void)
+{
+	return true;
+}
+#else
+#define crc32c_hw crc32c_sw
+
+static bool crc32c_hw_supported(void)
+{
+	return false;
+}
+#endif
+
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+static uint32_t (*crc32c_impl)(uint32_t, const void *, size_t);
+
+static void crc32c_init(void)
+{
+	if (crc32c_hw_supported()) {
+		crc32c_impl = crc32c_hw;
+	} else {
+		crc32c_table_init();
+		crc32c_impl = crc32c_sw;
+	}
+}
+
+uint32_t gsh_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	(void)pthread_once(&crc32c_once, crc32c_init);
+	return crc32c_impl(crc, buf, len);
+}
@@ -0,0 +1,216 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_lock_prof.c
+ * @brief Lock contention profiling
+ *
+ * The accounting of the lock wrappers built with ENABLE_LOCK_PROFILE,
+ * and its report over DBus.  Nothing here may take a lock through the
+ * wrappers.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "gsh_lock_prof.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "abstract_mem.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+/** Most sites a report lists */
+#define LOCK_PROF_TOP 32
+
+static pthread_mutex_t lock_prof_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct lock_prof_site *lock_prof_sites;
+
+static void lock_prof_link(struct lock_prof_site *site)
+{
+	(void) pthread_mutex_lock(&lock_prof_mtx);
+	if (!site->linked) {
+		site->next = lock_prof_sites;
+		lock_prof_sites = site;
+		atomic_store_uint32_t(&site->linked, 1);
+	}
+	(void) pthread_mutex_unlock(&lock_prof_mtx);
+}
+
+/**
+ * @brief Account a contended lock
+ *
+ * @param[in] site Site of the lock call
+ *
+ * @return Time the wait starts if it is to be timed, else 0.
+ */
+nsecs_elapsed_t lock_prof_begin(struct lock_prof_site *site)
+{
+	struct timespec ts;
+
+	if (!atomic_fetch_uint32_t(&site->linked))
+		lock_prof_link(site);
+
+	if (atomic_inc_uint64_t(&site->contended) % LOCK_PROF_SAMPLE != 0)
+		return 0;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return timespec_to_nsecs(&ts);
+}
+
+/**
+ * @brief Account the end of a wait for a lock
+ *
+ * The longest wait is kept without a lock, a racing longer wait may
+ * be lost.
+ *
+ * @param[in] site  Site of the lock call
+ * @param[in] start What lock_prof_begin() returned
+ */
+void lock_prof_end(struct lock_prof_site *site, nsecs_elapsed_t start)
+{
+	struct timespec ts;
+	nsecs_elapsed_t elapsed;
+
+	if (start == 0)
+		return;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	elapsed = timespec_to_nsecs(&ts) - start;
+
+	(void) atomic_inc_uint64_t(&site->sampled);
+	(void) atomic_add_uint64_t(&site->wait_ns, elapsed);
+	if (elapsed > atomic_fetch_uint64_t(&site->max_ns))
+		atomic_store_uint64_t(&site->max_ns, elapsed);
+}
+
+/**
+ * @brief Zero the counters of all sites
+ */
+void lock_prof_reset(void)
+{
+	struct lock_prof_site *site;
+
+	(void) pthread_mutex_lock(&lock_prof_mtx);
+	for (site = lock_prof_sites; site != NULL; site = site->next) {
+		atomic_store_uint64_t(&site->contended, 0);
+		atomic_store_uint64_t(&site->sampled, 0);
+		atomic_store_uint64_t(&site->wait_ns, 0);
+		atomic_store_uint64_t(&site->max_ns, 0);
+	}
+	(void) pthread_mutex_unlock(&lock_prof_mtx);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Estimated total wait at a site
+ */
+static double lock_prof_wait(const struct lock_prof_site *site)
+{
+	if (site->sampled == 0)
+		return 0;
+
+	return (double)site->wait_ns * site->contended / site->sampled;
+}
+
+static int lock_prof_cmp(const void *a, const void *b)
+{
+	double wa = lock_prof_wait(a);
+	double wb = lock_prof_wait(b);
+
+	return wa < wb ? 1 : wa > wb ? -1 : 0;
+}
+
+/**
+ * @brief Report the sites that waited longest
+ *
+ * For each of the LOCK_PROF_TOP sites with the longest estimated wait:
+ * file, line, lock, contentions, timed contentions, their total and
+ * longest wait in ns.
+ *
+ * @param[in] iter Reply iterator
+ */
+void lock_prof_dbus_show(DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	struct lock_prof_site *site, *sites;
+	uint32_t line;
+	int nsites = 0, i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	(void) pthread_mutex_lock(&lock_prof_mtx);
+	for (site = lock_prof_sites; site != NULL; site = site->next)
+		nsites++;
+	sites = gsh_calloc(nsites + 1, sizeof(*sites));
+	nsites = 0;
+	for (site = lock_prof_sites; site != NULL; site = site->next) {
+		sites[nsites].file = site->file;
+		sites[nsites].line = site->line;
+		sites[nsites].name = site->name;
+		sites[nsites].contended =
+			atomic_fetch_uint64_t(&site->contended);
+		sites[nsites].sampled = atomic_fetch_uint64_t(&site->sampled);
+		sites[nsites].wait_ns = atomic_fetch_uint64_t(&site->wait_ns);
+		sites[nsites].max_ns = atomic_fetch_uint64_t(&site->max_ns);
+		nsites++;
+	}
+	(void) pthread_mutex_unlock(&lock_prof_mtx);
+
+	qsort(sites, nsites, sizeof(*sites), lock_prof_cmp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(sustttt)",
+					 &array_iter);
+	for (i = 0; i < nsites && i < LOCK_PROF_TOP; i++) {
+		site = &sites[i];
+		if (site->contended == 0)
+			break;
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &site->file);
+		line = site->line;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &line);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &site->name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &site->contended);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &site->sampled);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &site->wait_ns);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &site->max_ns);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	gsh_free(sites);
+}
+#endif				/* USE_DBUS */
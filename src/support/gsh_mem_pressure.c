@@ -0,0 +1,369 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_mem_pressure.c
+ * @brief Shrink caches under system memory pressure
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <unistd.h>
+#include "log.h"
+#include "common_utils.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
+#include "gsh_mem_pressure.h"
+
+struct mem_pressure_shrinker {
+	const char *name;
+	mem_pressure_shrink_t shrink;
+};
+
+static struct mem_pressure_shrinker shrinkers[MEM_PRESSURE_MAX_SHRINKERS];
+static int nshrinkers;
+static pthread_mutex_t shrinkers_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static struct fridgethr *mem_pressure_fridge;
+
+/** Our cgroup v2 directory, empty if there is none */
+static char mp_cgroup[PATH_MAX];
+/** Where to read PSI from */
+static char mp_psi_path[PATH_MAX];
+/** high + max + oom events of the cgroup at the last sample */
+static uint64_t mp_last_events;
+/** True while we are shrinking */
+static bool mp_under_pressure;
+
+void mem_pressure_register(const char *name, mem_pressure_shrink_t shrink)
+{
+	PTHREAD_MUTEX_lock(&shrinkers_mtx);
+
+	if (nshrinkers < MEM_PRESSURE_MAX_SHRINKERS) {
+		shrinkers[nshrinkers].name = name;
+		shrinkers[nshrinkers].shrink = shrink;
+		nshrinkers++;
+	} else {
+		LogCrit(COMPONENT_MAIN,
+			"Too many memory pressure shrinkers, %s not registered",
+			name);
+	}
+
+	PTHREAD_MUTEX_unlock(&shrinkers_mtx);
+}
+
+/**
+ * @brief Find our cgroup v2 directory from /proc/self/cgroup
+ */
+static void mem_pressure_find_cgroup(void)
+{
+	FILE *fp = fopen("/proc/self/cgroup", "r");
+	char line[PATH_MAX];
+	char path[PATH_MAX];
+	size_t len;
+
+	mp_cgroup[0] = '\0';
+
+	if (fp == NULL)
+		return;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		/* The unified hierarchy is the "0::/path" line */
+		if (strncmp(line, "0::", 3) != 0)
+			continue;
+
+		len = strlen(line);
+		if (len > 0 && line[len - 1] == '\n')
+			line[len - 1] = '\0';
+
+		(void) snprintf(path, sizeof(path), "/sys/fs/cgroup%s",
+				line + 3);
+		(void) snprintf(mp_cgroup, sizeof(mp_cgroup), "%s", path);
+		break;
+	}
+
+	fclose(fp);
+
+	if (mp_cgroup[0] != '\0') {
+		(void) snprintf(path, sizeof(path), "%s/memory.current",
+				mp_cgroup);
+		if (access(path, R_OK) != 0)
+			mp_cgroup[0] = '\0';
+	}
+}
+
+/**
+ * @brief Read a number, or "max", from a cgroup file
+ *
+ * @return The value, UINT64_MAX for "max" or if it can't be read.
+ */
+static uint64_t mem_pressure_read_cg(const char *file)
+{
+	char path[PATH_MAX];
+	char buf[64];
+	FILE *fp;
+	uint64_t val = UINT64_MAX;
+
+	(void) snprintf(path, sizeof(path), "%s/%s", mp_cgroup, file);
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return val;
+
+	if (fgets(buf, sizeof(buf), fp) != NULL &&
+	    strncmp(buf, "max", 3) != 0)
+		val = strtoull(buf, NULL, 10);
+
+	fclose(fp);
+	return val;
+}
+
+/**
+ * @brief Sum the high, max and oom events of the cgroup
+ */
+static uint64_t mem_pressure_read_events(void)
+{
+	char path[PATH_MAX];
+	char key[32];
+	unsigned long long val;
+	uint64_t sum = 0;
+	FILE *fp;
+
+	(void) snprintf(path, sizeof(path), "%s/memory.events", mp_cgroup);
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return 0;
+
+	while (fscanf(fp, "%31s %llu", key, &val) == 2) {
+		if (strcmp(key, "high") == 0 || strcmp(key, "max") == 0 ||
+		    strcmp(key, "oom") == 0)
+			sum += val;
+	}
+
+	fclose(fp);
+	return sum;
+}
+
+/**
+ * @brief Read the "some" avg10 memory stall percentage
+ *
+ * @return The percentage, 0 if PSI is not available.
+ */
+static double mem_pressure_read_psi(void)
+{
+	FILE *fp = fopen(mp_psi_path, "r");
+	double avg10 = 0.0;
+
+	if (fp == NULL)
+		return 0.0;
+
+	if (fscanf(fp, "some avg10=%lf", &avg10) != 1)
+		avg10 = 0.0;
+
+	fclose(fp);
+	return avg10;
+}
+
+/**
+ * @brief How hard memory is pressed, 0 to 100
+ *
+ * Stalls from PSI count from Mem_Pressure_PSI_Threshold up to twice
+ * that; cgroup usage counts from Mem_Pressure_Cgroup_Percent of the
+ * lower of memory.high and memory.max up to the limit.  New high, max
+ * or oom events in the cgroup mean full pressure.
+ */
+static uint32_t mem_pressure_severity(void)
+{
+	struct nfs_core_param *cp = &nfs_param.core_param;
+	uint32_t severity = 0;
+	uint32_t sev;
+	double psi;
+
+	psi = mem_pressure_read_psi();
+	if (psi > cp->mem_pressure_psi_threshold) {
+		sev = (psi - cp->mem_pressure_psi_threshold) * 100 /
+		      cp->mem_pressure_psi_threshold;
+		severity = MIN(sev, 100);
+		LogDebug(COMPONENT_MAIN,
+			 "Memory stalled %.2f%% of the time", psi);
+	}
+
+	if (mp_cgroup[0] != '\0') {
+		uint64_t current = mem_pressure_read_cg("memory.current");
+		uint64_t limit = MIN(mem_pressure_read_cg("memory.high"),
+				     mem_pressure_read_cg("memory.max"));
+		uint64_t events = mem_pressure_read_events();
+		uint64_t used;
+
+		if (current != UINT64_MAX && limit != UINT64_MAX &&
+		    limit != 0) {
+			used = current * 100 / limit;
+			if (used > cp->mem_pressure_cgroup_percent) {
+				sev = (used - cp->mem_pressure_cgroup_percent) *
+				      100 /
+				      (100 - cp->mem_pressure_cgroup_percent);
+				severity = MAX(severity, MIN(sev, 100));
+				LogDebug(COMPONENT_MAIN,
+					 "Cgroup memory at %"PRIu64
+					 "%% of its limit", used);
+			}
+		}
+
+		if (events > mp_last_events) {
+			LogDebug(COMPONENT_MAIN,
+				 "Cgroup hit its memory limit %"PRIu64
+				 " times", events - mp_last_events);
+			severity = 100;
+		}
+		mp_last_events = events;
+	}
+
+	return severity;
+}
+
+static void mem_pressure_run(struct fridgethr_context *ctx)
+{
+	uint32_t severity;
+	uint32_t percent;
+	int i;
+
+	SetNameFunction("mem_pressure");
+
+	severity = mem_pressure_severity();
+
+	if (severity == 0) {
+		if (mp_under_pressure) {
+			LogEvent(COMPONENT_MAIN,
+				 "Memory pressure relieved");
+			mp_under_pressure = false;
+		}
+		return;
+	}
+
+	percent = nfs_param.core_param.mem_pressure_max_shrink *
+		  severity / 100;
+	if (percent == 0)
+		percent = 1;
+
+	if (!mp_under_pressure) {
+		LogEvent(COMPONENT_MAIN,
+			 "Under memory pressure, shrinking caches");
+		mp_under_pressure = true;
+	}
+
+	LogDebug(COMPONENT_MAIN,
+		 "Memory pressure severity %"PRIu32", shrinking caches by %"
+		 PRIu32"%%", severity, percent);
+
+	PTHREAD_MUTEX_lock(&shrinkers_mtx);
+
+	for (i = 0; i < nshrinkers; i++) {
+		LogFullDebug(COMPONENT_MAIN, "Shrinking %s",
+			     shrinkers[i].name);
+		shrinkers[i].shrink(percent);
+	}
+
+	PTHREAD_MUTEX_unlock(&shrinkers_mtx);
+}
+
+int mem_pressure_start(void)
+{
+	struct fridgethr_params frp;
+	char path[PATH_MAX];
+	int rc;
+
+	if (nfs_param.core_param.mem_pressure_interval == 0)
+		return 0;
+
+	mem_pressure_find_cgroup();
+
+	/* Prefer the stalls of our own cgroup */
+	(void) snprintf(path, sizeof(path), "%s/memory.pressure", mp_cgroup);
+	if (mp_cgroup[0] != '\0' && access(path, R_OK) == 0)
+		(void) snprintf(mp_psi_path, sizeof(mp_psi_path), "%s", path);
+	else
+		(void) snprintf(mp_psi_path, sizeof(mp_psi_path), "%s",
+				"/proc/pressure/memory");
+
+	if (mp_cgroup[0] != '\0')
+		mp_last_events = mem_pressure_read_events();
+
+	LogInfo(COMPONENT_MAIN,
+		"Watching memory pressure in %s%s%s",
+		mp_psi_path,
+		mp_cgroup[0] != '\0' ? " and cgroup " : "",
+		mp_cgroup);
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = nfs_param.core_param.mem_pressure_interval;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&mem_pressure_fridge, "mem_pressure", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_MAIN,
+			 "Unable to initialize memory pressure fridge, error code %d.",
+			 rc);
+		return rc;
+	}
+
+	rc = fridgethr_submit(mem_pressure_fridge, mem_pressure_run, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_MAIN,
+			 "Unable to start memory pressure thread, error code %d.",
+			 rc);
+		return rc;
+	}
+
+	return 0;
+}
+
+int mem_pressure_shutdown(void)
+{
+	int rc;
+
+	if (mem_pressure_fridge == NULL)
+		return 0;
+
+	rc = fridgethr_sync_command(mem_pressure_fridge,
+				    fridgethr_comm_stop,
+				    120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_MAIN,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(mem_pressure_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_MAIN,
+			 "Failed shutting down memory pressure thread: %d",
+			 rc);
+	}
+
+	return rc;
+}
@@ -0,0 +1,205 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_mem_stats.c
+ * @brief Memory held by pools and allocation tags
+ *
+ * Every pool is on a list from its creation to its destruction.  A
+ * report has a row per pool name, pools of the same name (the pools
+ * of all the hash tables, say) adding up, and a row per tag.  A pool
+ * row counts the objects the pool holds from the heap, which for a
+ * magazine pool includes the free objects it caches.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <pthread.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "nfs_metrics.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+struct gsh_mem_tag_stats gsh_mem_tags[GSH_MEM_TAG_COUNT];
+
+static const char * const gsh_mem_tag_names[GSH_MEM_TAG_COUNT] = {
+	[GSH_MEM_MDCACHE_DIRENTS] = "MDCACHE dirents",
+	[GSH_MEM_IDMAPPER] = "ID mapper cache",
+};
+
+static pthread_mutex_t pool_list_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head pool_list = GLIST_HEAD_INIT(pool_list);
+
+/**
+ * @brief Put a new pool on the list of pools
+ *
+ * @param[in] pool The pool
+ */
+void pool_register(pool_t *pool)
+{
+	PTHREAD_MUTEX_lock(&pool_list_mtx);
+	glist_add_tail(&pool_list, &pool->pools);
+	PTHREAD_MUTEX_unlock(&pool_list_mtx);
+}
+
+/**
+ * @brief Take a pool being destroyed off the list of pools
+ *
+ * @param[in] pool The pool
+ */
+void pool_unregister(pool_t *pool)
+{
+	PTHREAD_MUTEX_lock(&pool_list_mtx);
+	glist_del(&pool->pools);
+	PTHREAD_MUTEX_unlock(&pool_list_mtx);
+}
+
+struct mem_row {
+	char *name;
+	int64_t objects;
+	int64_t bytes;
+};
+
+/**
+ * @brief Gather the rows of a report
+ *
+ * @param[out] nrows Number of rows
+ *
+ * @return The rows, to be freed with mem_rows_free().
+ */
+static struct mem_row *mem_rows(int *nrows)
+{
+	struct glist_head *glist;
+	struct mem_row *rows;
+	int n = 0, max = GSH_MEM_TAG_COUNT, i;
+
+	PTHREAD_MUTEX_lock(&pool_list_mtx);
+
+	glist_for_each(glist, &pool_list)
+		max++;
+	rows = gsh_calloc(max, sizeof(*rows));
+
+	glist_for_each(glist, &pool_list) {
+		pool_t *pool = glist_entry(glist, pool_t, pools);
+		const char *name = pool->name ? pool->name : "(unnamed)";
+		int64_t objects = pool->mag_slot >= 0
+					? pool_mag_objects(pool)
+					: atomic_fetch_int64_t(&pool->objects);
+
+		for (i = 0; i < n; i++)
+			if (strcmp(rows[i].name, name) == 0)
+				break;
+		if (i == n)
+			rows[n++].name = gsh_strdup(name);
+		rows[i].objects += objects;
+		rows[i].bytes += objects * pool->object_size;
+	}
+
+	PTHREAD_MUTEX_unlock(&pool_list_mtx);
+
+	for (i = 0; i < GSH_MEM_TAG_COUNT; i++, n++) {
+		rows[n].name = gsh_strdup(gsh_mem_tag_names[i]);
+		rows[n].objects = atomic_fetch_int64_t(&gsh_mem_tags[i].objects);
+		rows[n].bytes = atomic_fetch_int64_t(&gsh_mem_tags[i].bytes);
+	}
+
+	*nrows = n;
+	return rows;
+}
+
+static void mem_rows_free(struct mem_row *rows, int nrows)
+{
+	int i;
+
+	for (i = 0; i < nrows; i++)
+		gsh_free(rows[i].name);
+	gsh_free(rows);
+}
+
+/**
+ * @brief Write the memory families for a scrape
+ *
+ * @param[in] out Reply stream
+ */
+void mem_metrics(FILE *out)
+{
+	struct mem_row *rows;
+	int nrows, i;
+
+	rows = mem_rows(&nrows);
+
+	fprintf(out, "# TYPE ganesha_memory_objects gauge\n"
+		"# HELP ganesha_memory_objects Objects held, by pool or "
+		"tag\n");
+	for (i = 0; i < nrows; i++)
+		fprintf(out, "ganesha_memory_objects{name=\"%s\"} %" PRId64
+			"\n", rows[i].name, rows[i].objects);
+
+	fprintf(out, "# TYPE ganesha_memory_bytes gauge\n"
+		"# HELP ganesha_memory_bytes Bytes held, by pool or tag\n");
+	for (i = 0; i < nrows; i++)
+		fprintf(out, "ganesha_memory_bytes{name=\"%s\"} %" PRId64
+			"\n", rows[i].name, rows[i].bytes);
+
+	mem_rows_free(rows, nrows);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the memory held by pools and tags
+ *
+ * @param[in] iter Reply iterator
+ */
+void mem_dbus_show(DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	struct mem_row *rows;
+	int nrows, i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	rows = mem_rows(&nrows);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(sxx)",
+					 &array_iter);
+	for (i = 0; i < nrows; i++) {
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &rows[i].name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT64,
+					       &rows[i].objects);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT64,
+					       &rows[i].bytes);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	mem_rows_free(rows, nrows);
+}
+#endif				/* USE_DBUS */
@@ -0,0 +1,142 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_numa.c
+ * @brief NUMA topology and thread placement
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "log.h"
+#include "gsh_numa.h"
+
+static cpu_set_t gsh_numa_cpus[GSH_NUMA_MAX_NODES];
+static uint16_t gsh_numa_node_of[CPU_SETSIZE];
+static uint32_t gsh_numa_nnodes = 1;
+
+/**
+ * @brief Read a sysfs cpulist such as "0-3,8-11" into a CPU set
+ *
+ * @return The number of CPUs read.
+ */
+static int gsh_numa_read_cpulist(const char *path, cpu_set_t *set)
+{
+	FILE *fp = fopen(path, "r");
+	char line[4096];
+	char *p, *end;
+	unsigned long lo, hi;
+	int n = 0;
+
+	if (fp == NULL)
+		return 0;
+
+	if (fgets(line, sizeof(line), fp) == NULL) {
+		fclose(fp);
+		return 0;
+	}
+	fclose(fp);
+
+	for (p = line; *p != '\0' && *p != '\n'; p = end) {
+		lo = strtoul(p, &end, 10);
+		if (end == p)
+			break;
+		hi = lo;
+		if (*end == '-') {
+			p = end + 1;
+			hi = strtoul(p, &end, 10);
+			if (end == p)
+				break;
+		}
+		for (; lo <= hi && lo < CPU_SETSIZE; lo++, n++)
+			CPU_SET(lo, set);
+		if (*end == ',')
+			end++;
+	}
+
+	return n;
+}
+
+/**
+ * @brief Learn which CPUs belong to which node
+ */
+void gsh_numa_init(void)
+{
+	char path[64];
+	uint32_t node, nnodes = 0;
+	int cpu;
+
+	for (node = 0; node < GSH_NUMA_MAX_NODES; node++) {
+		CPU_ZERO(&gsh_numa_cpus[node]);
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/node/node%u/cpulist", node);
+		if (gsh_numa_read_cpulist(path, &gsh_numa_cpus[node]) == 0)
+			continue;
+
+		for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &gsh_numa_cpus[node]))
+				gsh_numa_node_of[cpu] = node;
+		nnodes = node + 1;
+	}
+
+	if (nnodes == 0) {
+		/* No topology, one node of whatever we may run on */
+		if (sched_getaffinity(0, sizeof(cpu_set_t),
+				      &gsh_numa_cpus[0]) != 0)
+			for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+				CPU_SET(cpu, &gsh_numa_cpus[0]);
+		nnodes = 1;
+	}
+
+	gsh_numa_nnodes = nnodes;
+
+	LogInfo(COMPONENT_INIT, "%u NUMA node(s)", nnodes);
+}
+
+uint32_t gsh_numa_nodes(void)
+{
+	return gsh_numa_nnodes;
+}
+
+uint32_t gsh_numa_cpu_node(int cpu)
+{
+	if (cpu < 0 || cpu >= CPU_SETSIZE)
+		return 0;
+
+	return gsh_numa_node_of[cpu];
+}
+
+int gsh_numa_bind_node(uint32_t node)
+{
+	node %= gsh_numa_nnodes;
+
+	/* node numbers may have holes */
+	if (CPU_COUNT(&gsh_numa_cpus[node]) == 0)
+		return EINVAL;
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+				      &gsh_numa_cpus[node]);
+}
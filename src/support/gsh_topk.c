@@ -0,0 +1,429 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file gsh_topk.c
+ * @brief Hottest files and clients
+ *
+ * Counting a request is a hash and TOPK_CM_DEPTH atomic adds.  One
+ * count in TOPK_SAMPLE of each thread also compares the estimate with
+ * the smallest count of the table, and only an estimate above it takes
+ * the table lock.  A key hot enough to matter is sampled soon enough.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/param.h>
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "city.h"
+#include "common_utils.h"
+#include "log.h"
+#include "fsal.h"
+#include "client_mgr.h"
+#include "export_mgr.h"
+#include "nfs_core.h"
+#include "gsh_topk.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/** Rows of each sketch */
+#define TOPK_CM_DEPTH 4
+/** Counters per row, a power of two */
+#define TOPK_CM_WIDTH 1024
+/** Longest key remembered */
+#define TOPK_KEY_MAX 48
+/** One count in TOPK_SAMPLE looks at the table, a power of two */
+#define TOPK_SAMPLE 16
+
+struct topk_entry {
+	uint64_t hash;
+	uint64_t count;		/*< Estimate when last sampled */
+	uint32_t keylen;
+	char key[TOPK_KEY_MAX];
+};
+
+struct topk {
+	uint64_t cm[TOPK_CM_DEPTH][TOPK_CM_WIDTH];
+	pthread_mutex_t mtx;
+	/** Smallest count of a full table, 0 while there is room */
+	uint64_t min_count;
+	uint32_t nentries;
+	struct topk_entry *entries;
+};
+
+/** Files are their export and fileid */
+struct topk_file_key {
+	uint64_t fileid;
+	uint16_t export_id;
+};
+
+static struct topk topk_file_ops;
+static struct topk topk_file_bytes;
+static struct topk topk_client_ops;
+static struct topk topk_client_bytes;
+
+/** Top_K_Entries, 0 when disabled */
+static uint32_t topk_size;
+static time_t topk_next_decay;
+static pthread_mutex_t topk_decay_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread uint32_t topk_tick;
+
+static void topk_table_init(struct topk *t)
+{
+	PTHREAD_MUTEX_init(&t->mtx, NULL);
+	t->entries = gsh_calloc(topk_size, sizeof(struct topk_entry));
+}
+
+void topk_init(void)
+{
+	topk_size = MIN(nfs_param.core_param.top_k_entries, TOPK_MAX_ENTRIES);
+	if (topk_size == 0)
+		return;
+
+	topk_table_init(&topk_file_ops);
+	topk_table_init(&topk_file_bytes);
+	topk_table_init(&topk_client_ops);
+	topk_table_init(&topk_client_bytes);
+
+	topk_next_decay = time(NULL) + nfs_param.core_param.top_k_half_life;
+
+	LogInfo(COMPONENT_INIT,
+		"Tracking the %"PRIu32" hottest files and clients",
+		topk_size);
+}
+
+static inline uint32_t topk_cm_index(uint64_t hash, int row)
+{
+	uint32_t h1 = hash;
+	uint32_t h2 = (hash >> 32) | 1;
+
+	return (h1 + row * h2) & (TOPK_CM_WIDTH - 1);
+}
+
+static uint64_t topk_estimate(struct topk *t, uint64_t hash)
+{
+	uint64_t est = UINT64_MAX;
+	int row;
+
+	for (row = 0; row < TOPK_CM_DEPTH; row++)
+		est = MIN(est, atomic_fetch_uint64_t(
+				&t->cm[row][topk_cm_index(hash, row)]));
+
+	return est;
+}
+
+/**
+ * @brief Put a key in the table, evicting the coldest if full
+ */
+static void topk_table_update(struct topk *t, uint64_t hash,
+			      const void *key, uint32_t keylen, uint64_t est)
+{
+	struct topk_entry *e;
+	struct topk_entry *coldest = NULL;
+	uint64_t min = UINT64_MAX;
+	uint32_t i;
+
+	PTHREAD_MUTEX_lock(&t->mtx);
+
+	for (i = 0; i < t->nentries; i++) {
+		e = &t->entries[i];
+		if (e->hash == hash && e->keylen == keylen &&
+		    memcmp(e->key, key, keylen) == 0) {
+			e->count = est;
+			goto recompute;
+		}
+		if (e->count < min) {
+			min = e->count;
+			coldest = e;
+		}
+	}
+
+	if (t->nentries < topk_size)
+		e = &t->entries[t->nentries++];
+	else if (est > min)
+		e = coldest;
+	else
+		goto out;
+
+	e->hash = hash;
+	e->count = est;
+	e->keylen = keylen;
+	memcpy(e->key, key, keylen);
+
+ recompute:
+	min = 0;
+	if (t->nentries == topk_size) {
+		min = UINT64_MAX;
+		for (i = 0; i < t->nentries; i++)
+			min = MIN(min, t->entries[i].count);
+	}
+	atomic_store_uint64_t(&t->min_count, min);
+
+ out:
+	PTHREAD_MUTEX_unlock(&t->mtx);
+}
+
+static void topk_add(struct topk *t, uint64_t hash, const void *key,
+		     uint32_t keylen, uint64_t weight, bool sample)
+{
+	uint64_t est = UINT64_MAX;
+	uint64_t v;
+	int row;
+
+	for (row = 0; row < TOPK_CM_DEPTH; row++) {
+		v = atomic_add_uint64_t(&t->cm[row][topk_cm_index(hash, row)],
+					weight);
+		est = MIN(est, v);
+	}
+
+	if (sample && est > atomic_fetch_uint64_t(&t->min_count))
+		topk_table_update(t, hash, key, keylen, est);
+}
+
+static void topk_halve(struct topk *t)
+{
+	uint64_t *c;
+	uint32_t i;
+
+	for (c = &t->cm[0][0]; c < &t->cm[0][0] +
+				   TOPK_CM_DEPTH * TOPK_CM_WIDTH; c++)
+		atomic_store_uint64_t(c, atomic_fetch_uint64_t(c) / 2);
+
+	PTHREAD_MUTEX_lock(&t->mtx);
+	for (i = 0; i < t->nentries; i++)
+		t->entries[i].count /= 2;
+	atomic_store_uint64_t(&t->min_count,
+			      atomic_fetch_uint64_t(&t->min_count) / 2);
+	PTHREAD_MUTEX_unlock(&t->mtx);
+}
+
+/**
+ * @brief Decide whether this count samples, halving counts when due
+ */
+static bool topk_sample(void)
+{
+	time_t now;
+
+	if ((++topk_tick & (TOPK_SAMPLE - 1)) != 0)
+		return false;
+
+	now = time(NULL);
+	if (now >= atomic_fetch_time_t(&topk_next_decay) &&
+	    pthread_mutex_trylock(&topk_decay_mtx) == 0) {
+		if (now >= topk_next_decay) {
+			topk_halve(&topk_file_ops);
+			topk_halve(&topk_file_bytes);
+			topk_halve(&topk_client_ops);
+			topk_halve(&topk_client_bytes);
+			atomic_store_time_t(&topk_next_decay, now +
+				nfs_param.core_param.top_k_half_life);
+		}
+		PTHREAD_MUTEX_unlock(&topk_decay_mtx);
+	}
+
+	return true;
+}
+
+void topk_file_io(struct fsal_obj_handle *obj, size_t bytes)
+{
+	struct topk_file_key key;
+	uint64_t hash;
+	bool sample;
+
+	if (topk_size == 0 || obj == NULL)
+		return;
+
+	memset(&key, 0, sizeof(key));
+	key.fileid = obj->fileid;
+	if (op_ctx->ctx_export != NULL)
+		key.export_id = op_ctx->ctx_export->export_id;
+
+	hash = CityHash64((char *)&key, sizeof(key));
+	sample = topk_sample();
+
+	topk_add(&topk_file_ops, hash, &key, sizeof(key), 1, sample);
+	if (bytes != 0)
+		topk_add(&topk_file_bytes, hash, &key, sizeof(key), bytes,
+			 sample);
+}
+
+static inline uint32_t topk_client_key(struct gsh_client *client,
+				       uint64_t *hash)
+{
+	uint32_t keylen = strnlen(client->hostaddr_str, TOPK_KEY_MAX);
+
+	*hash = CityHash64(client->hostaddr_str, keylen);
+	return keylen;
+}
+
+void topk_client_op(struct gsh_client *client)
+{
+	uint64_t hash;
+	uint32_t keylen;
+
+	if (topk_size == 0 || client == NULL)
+		return;
+
+	keylen = topk_client_key(client, &hash);
+	topk_add(&topk_client_ops, hash, client->hostaddr_str, keylen, 1,
+		 topk_sample());
+}
+
+void topk_client_io(struct gsh_client *client, size_t bytes)
+{
+	uint64_t hash;
+	uint32_t keylen;
+
+	if (topk_size == 0 || client == NULL || bytes == 0)
+		return;
+
+	keylen = topk_client_key(client, &hash);
+	topk_add(&topk_client_bytes, hash, client->hostaddr_str, keylen,
+		 bytes, topk_sample());
+}
+
+#ifdef USE_DBUS
+
+struct topk_row {
+	struct topk_entry e;
+	uint64_t ops;
+	uint64_t bytes;
+	uint64_t rank;
+};
+
+static int topk_row_cmpf(const void *a, const void *b)
+{
+	const struct topk_row *ra = a;
+	const struct topk_row *rb = b;
+
+	if (ra->rank != rb->rank)
+		return ra->rank < rb->rank ? 1 : -1;
+	return 0;
+}
+
+/**
+ * @brief Snapshot a table with fresh estimates, hottest first
+ */
+static struct topk_row *topk_rows(struct topk *ops, struct topk *bytes,
+				  bool by_bytes, uint32_t *nrows)
+{
+	struct topk *t = by_bytes ? bytes : ops;
+	struct topk_row *rows;
+	uint32_t i;
+
+	rows = gsh_calloc(topk_size, sizeof(struct topk_row));
+
+	PTHREAD_MUTEX_lock(&t->mtx);
+	*nrows = t->nentries;
+	for (i = 0; i < t->nentries; i++)
+		rows[i].e = t->entries[i];
+	PTHREAD_MUTEX_unlock(&t->mtx);
+
+	for (i = 0; i < *nrows; i++) {
+		rows[i].ops = topk_estimate(ops, rows[i].e.hash);
+		rows[i].bytes = topk_estimate(bytes, rows[i].e.hash);
+		rows[i].rank = by_bytes ? rows[i].bytes : rows[i].ops;
+	}
+
+	qsort(rows, *nrows, sizeof(struct topk_row), topk_row_cmpf);
+
+	return rows;
+}
+
+void topk_dbus_files(DBusMessageIter *iter, bool by_bytes)
+{
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	struct topk_row *rows = NULL;
+	struct topk_file_key key;
+	uint32_t nrows = 0, i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	if (topk_size != 0)
+		rows = topk_rows(&topk_file_ops, &topk_file_bytes, by_bytes,
+				 &nrows);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(qttt)",
+					 &array_iter);
+	for (i = 0; i < nrows; i++) {
+		memcpy(&key, rows[i].e.key, sizeof(key));
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT16,
+					       &key.export_id);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &key.fileid);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &rows[i].ops);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &rows[i].bytes);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	gsh_free(rows);
+}
+
+void topk_dbus_clients(DBusMessageIter *iter, bool by_bytes)
+{
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	struct topk_row *rows = NULL;
+	char addr[TOPK_KEY_MAX + 1];
+	char *addrp = addr;
+	uint32_t nrows = 0, i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	if (topk_size != 0)
+		rows = topk_rows(&topk_client_ops, &topk_client_bytes,
+				 by_bytes, &nrows);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(stt)",
+					 &array_iter);
+	for (i = 0; i < nrows; i++) {
+		memcpy(addr, rows[i].e.key, rows[i].e.keylen);
+		addr[rows[i].e.keylen] = '\0';
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &addrp);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &rows[i].ops);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &rows[i].bytes);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	gsh_free(rows);
+}
+#endif				/* USE_DBUS */
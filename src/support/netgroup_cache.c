@@ -24,11 +24,14 @@
 #include <unistd.h>
 #include "gsh_intrinsic.h"
 #include "gsh_types.h"
+#include "gsh_config.h"
+#include "gsh_list.h"
 #include "common_utils.h"
 #include "avltree.h"
 #include "abstract_atomic.h"
 #include "netdb.h"
 #include "abstract_mem.h"
+#include "fridgethr.h"
 #include "netgroup_cache.h"
 
 /* Netgroup cache information */
@@ -37,14 +40,54 @@ struct ng_cache_info {
 	struct gsh_buffdesc ng_group;
 	struct gsh_buffdesc ng_host;
 	time_t ng_epoch;
+	uint32_t ng_refreshing;	/*< A background refresh is queued */
 };
 
-#define NG_CACHE_SIZE 1009
+/* A (group, host) being resolved, others missing on it wait */
+struct ng_inflight {
+	struct glist_head list;
+	const char *group;
+	const char *host;
+	bool done;
+	uint32_t waiters;
+};
+
+/* A (group, host) to resolve again in the background */
+struct ng_refresh {
+	char *group;
+	char *host;
+};
+
+/**
+ * @brief Number of partitions of the cache, should be prime.
+ *
+ * Netgroup exports check every new client, so many connections at
+ * once would otherwise all serialize on one lock.
+ */
+#define NG_CACHE_PARTITIONS 17
+
+/* Direct-mapped slots of a partition, should be prime */
+#define NG_CACHE_SIZE 61
+
+struct ng_partition {
+	pthread_rwlock_t lock;
+	/* Positive and negative cache trees */
+	struct avltree pos_ng_tree;
+	struct avltree neg_ng_tree;
+	struct avltree_node *cache[NG_CACHE_SIZE];
+	pthread_mutex_t inflight_mtx;
+	pthread_cond_t inflight_cv;
+	struct glist_head inflight;
+};
+
+static struct ng_partition ng_partitions[NG_CACHE_PARTITIONS];
+
+static struct fridgethr *ng_fridge;
 
 /* Uses FNV hash */
 #define FNV_PRIME32 16777619
 #define FNV_OFFSET32 2166136261U
-static int ng_hash_key(struct ng_cache_info *info)
+static uint32_t ng_hash_key(struct ng_cache_info *info)
 {
 	uint32_t hash = FNV_OFFSET32;
 	char *bp, *end;
@@ -61,16 +104,21 @@ static int ng_hash_key(struct ng_cache_info *info)
 		hash ^= *bp++;
 		hash *= FNV_PRIME32;
 	}
-	return hash % NG_CACHE_SIZE;
+	return hash;
 }
 
-static struct avltree_node *ng_cache[NG_CACHE_SIZE];
+static inline struct ng_partition *ng_partition_of(struct ng_cache_info *info)
+{
+	return &ng_partitions[ng_hash_key(info) % NG_CACHE_PARTITIONS];
+}
 
-pthread_rwlock_t ng_lock = PTHREAD_RWLOCK_INITIALIZER;
+static inline struct avltree_node **ng_slot_of(struct ng_partition *part,
+					       struct ng_cache_info *info)
+{
+	uint32_t hash = ng_hash_key(info) / NG_CACHE_PARTITIONS;
 
-/* Positive and negative cache trees */
-static struct avltree pos_ng_tree;
-static struct avltree neg_ng_tree;
+	return &part->cache[hash % NG_CACHE_SIZE];
+}
 
 static inline int buffdesc_comparator(const struct gsh_buffdesc *buff1,
 				      const struct gsh_buffdesc *buff2)
@@ -100,29 +148,77 @@ static int ng_comparator(const struct avltree_node *node1,
 	return rc;
 }
 
-static bool ng_expired(struct avltree_node *node)
+/**
+ * @brief Check an entry against its expiration
+ *
+ * @param[in]  node     Entry found
+ * @param[in]  negative Whether it was found in the negative tree
+ * @param[out] refresh  Set if the entry is near expiration and nobody
+ *                      is refreshing it yet
+ *
+ * @return true if the entry expired.
+ */
+static bool ng_expired(struct avltree_node *node, bool negative,
+		       bool *refresh)
 {
 	struct ng_cache_info *info;
+	time_t ttl = negative
+		? nfs_param.core_param.netgroup_negative_expiration
+		: nfs_param.core_param.netgroup_cache_expiration;
+	time_t age;
 
 	info = avltree_container_of(node, struct ng_cache_info, ng_node);
 
-	/* Hardcoded to 30 minutes for now */
-	if (time(NULL) - info->ng_epoch > 30 * 60)
+	age = time(NULL) - info->ng_epoch;
+	if (age > ttl)
 		return true;
 
+	/* Resolve again during the last quarter of its life, so that busy
+	 * entries never expire in front of a client.
+	 */
+	if (age >= ttl - ttl / 4 &&
+	    atomic_postset_uint32_t_bits(&info->ng_refreshing, 1) == 0)
+		*refresh = true;
+
 	return false;
 }
 
-
-
 /**
  * @brief Initialize the netgroups cache
  */
 void ng_cache_init(void)
 {
-	avltree_init(&pos_ng_tree, ng_comparator, 0);
-	avltree_init(&neg_ng_tree, ng_comparator, 0);
-	memset(ng_cache, 0, NG_CACHE_SIZE * sizeof(struct avltree_node *));
+	struct fridgethr_params frp;
+	struct ng_partition *part;
+	int i, rc;
+
+	for (i = 0; i < NG_CACHE_PARTITIONS; i++) {
+		part = &ng_partitions[i];
+		PTHREAD_RWLOCK_init(&part->lock, NULL);
+		avltree_init(&part->pos_ng_tree, ng_comparator, 0);
+		avltree_init(&part->neg_ng_tree, ng_comparator, 0);
+		memset(part->cache, 0,
+		       NG_CACHE_SIZE * sizeof(struct avltree_node *));
+		PTHREAD_MUTEX_init(&part->inflight_mtx, NULL);
+		PTHREAD_COND_init(&part->inflight_cv, NULL);
+		glist_init(&part->inflight);
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 2;
+	frp.thr_min = 0;
+	frp.thread_delay = 60;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	/* Without it entries are simply not refreshed ahead */
+	rc = fridgethr_init(&ng_fridge, "netgroup", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to initialize netgroup fridge, error code %d.",
+			 rc);
+		ng_fridge = NULL;
+	}
 }
 
 static void ng_free(struct ng_cache_info *info)
@@ -132,68 +228,72 @@ static void ng_free(struct ng_cache_info *info)
 	gsh_free(info);
 }
 
-/* The caller must hold ng_lock for write */
-static void ng_remove(struct ng_cache_info *info, bool negative)
+/* The caller must hold the partition lock for write */
+static void ng_remove(struct ng_partition *part, struct ng_cache_info *info,
+		      bool negative)
 {
 	if (negative) {
-		avltree_remove(&info->ng_node, &neg_ng_tree);
+		avltree_remove(&info->ng_node, &part->neg_ng_tree);
 	} else {
-		ng_cache[ng_hash_key(info)] = NULL;
-		avltree_remove(&info->ng_node, &pos_ng_tree);
+		struct avltree_node **slot = ng_slot_of(part, info);
+
+		if (*slot == &info->ng_node)
+			*slot = NULL;
+		avltree_remove(&info->ng_node, &part->pos_ng_tree);
 	}
 }
 
- /* The caller must hold ng_lock for write */
-static void ng_add(const char *group, const char *host, bool negative)
+/* The caller must hold the partition lock for write */
+static void ng_add(struct ng_partition *part, const char *group,
+		   const char *host, bool negative)
 {
 	struct ng_cache_info *info;
 	struct avltree_node *found_node;
 	struct ng_cache_info *found_info;
 
 	info = gsh_malloc(sizeof(struct ng_cache_info));
-	if (!info)
-		LogFatal(COMPONENT_IDMAPPER, "memory alloc failed");
 
 	info->ng_group.addr = gsh_strdup(group);
 	info->ng_group.len = strlen(group)+1;
 	info->ng_host.addr = gsh_strdup(host);
 	info->ng_host.len = strlen(host)+1;
 	info->ng_epoch = time(NULL);
+	info->ng_refreshing = 0;
+
+	/* A refresh may have changed the answer, drop the other one */
+	found_node = avltree_lookup(&info->ng_node,
+				    negative ? &part->pos_ng_tree
+					     : &part->neg_ng_tree);
+	if (found_node) {
+		found_info = avltree_container_of(found_node,
+				struct ng_cache_info, ng_node);
+		ng_remove(part, found_info, !negative);
+		ng_free(found_info);
+	}
 
-	if (negative) {
-		/* @todo check positive cache first? */
-		found_node = avltree_insert(&info->ng_node, &neg_ng_tree);
-
-		/* If an already existing entry is found, keep the old
-		 * entry, and free the current entry
-		 */
-		if (found_node) {
-			found_info = avltree_container_of(found_node,
-					struct ng_cache_info, ng_node);
-			found_info->ng_epoch = info->ng_epoch;
-			ng_free(info);
-		}
-	} else {
-		/* @todo delete from negative cache if there? */
-		found_node = avltree_insert(&info->ng_node, &pos_ng_tree);
-
-		/* If an already existing entry is found, keep the old
-		 * entry, and free the current entry
-		 */
-		if (found_node) {
-			found_info = avltree_container_of(found_node,
-					struct ng_cache_info, ng_node);
-			ng_cache[ng_hash_key(found_info)] = found_node;
-			found_info->ng_epoch = info->ng_epoch;
-			ng_free(info);
-		} else {
-			ng_cache[ng_hash_key(info)] = &info->ng_node;
-		}
+	found_node = avltree_insert(&info->ng_node,
+				    negative ? &part->neg_ng_tree
+					     : &part->pos_ng_tree);
+
+	/* If an already existing entry is found, keep the old
+	 * entry, and free the current entry
+	 */
+	if (found_node) {
+		found_info = avltree_container_of(found_node,
+				struct ng_cache_info, ng_node);
+		found_info->ng_epoch = info->ng_epoch;
+		atomic_store_uint32_t(&found_info->ng_refreshing, 0);
+		ng_free(info);
+		info = found_info;
 	}
+
+	if (!negative)
+		*ng_slot_of(part, info) = &info->ng_node;
 }
 
-/* The caller must hold ng_lock for read */
-static bool ng_lookup(const char *group, const char *host, bool negative)
+/* The caller must hold the partition lock for read */
+static bool ng_lookup(struct ng_partition *part, const char *group,
+		      const char *host, bool negative, bool *refresh)
 {
 	struct ng_cache_info prototype = {
 		.ng_group.addr = (char *)group,
@@ -206,31 +306,31 @@ static bool ng_lookup(const char *group, const char *host, bool negative)
 	void **cache_slot;
 
 	if (negative) {
-		node = avltree_lookup(&prototype.ng_node, &neg_ng_tree);
+		node = avltree_lookup(&prototype.ng_node, &part->neg_ng_tree);
 		if (!node)
 			return false;
 
-		if (!ng_expired(node))
+		if (!ng_expired(node, negative, refresh))
 			return true;
 
 		goto expired;
 	}
 
 	/* Positive lookups are stored in the cache */
-	cache_slot = (void **)&ng_cache[ng_hash_key(&prototype)];
+	cache_slot = (void **)ng_slot_of(part, &prototype);
 	node = atomic_fetch_voidptr(cache_slot);
 	if (node && ng_comparator(node, &prototype.ng_node) == 0) {
-		if (!ng_expired(node))
+		if (!ng_expired(node, negative, refresh))
 			return true;
 		goto expired;
 	}
 
 	/* cache miss, search AVL tree */
-	node = avltree_lookup(&prototype.ng_node, &pos_ng_tree);
+	node = avltree_lookup(&prototype.ng_node, &part->pos_ng_tree);
 	if (!node)
 		return false;
 
-	if (ng_expired(node))
+	if (ng_expired(node, negative, refresh))
 		goto expired;
 
 	atomic_store_voidptr(cache_slot, node);
@@ -239,57 +339,203 @@ static bool ng_lookup(const char *group, const char *host, bool negative)
 
 expired:
 	/* entry expired, acquire write mode lock for removal */
-	PTHREAD_RWLOCK_unlock(&ng_lock);
-	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	PTHREAD_RWLOCK_unlock(&part->lock);
+	PTHREAD_RWLOCK_wrlock(&part->lock);
 
 	/* Since we dropped the read mode lock and acquired write mode
 	 * lock, make sure that the entry is still in the tree.
 	 */
 	if (negative)
-		node = avltree_lookup(&prototype.ng_node, &neg_ng_tree);
+		node = avltree_lookup(&prototype.ng_node, &part->neg_ng_tree);
 	else
-		node = avltree_lookup(&prototype.ng_node, &pos_ng_tree);
+		node = avltree_lookup(&prototype.ng_node, &part->pos_ng_tree);
 
 	if (node) {
 		info = avltree_container_of(node, struct ng_cache_info,
 					    ng_node);
-		ng_remove(info, negative);
+		ng_remove(part, info, negative);
 		ng_free(info);
 	}
-	PTHREAD_RWLOCK_unlock(&ng_lock);
-	PTHREAD_RWLOCK_rdlock(&ng_lock);
+	PTHREAD_RWLOCK_unlock(&part->lock);
+	PTHREAD_RWLOCK_rdlock(&part->lock);
 	return false;
 }
 
+/**
+ * @brief Look up the cache
+ *
+ * @param[in]  part    Partition of (group, host)
+ * @param[in]  group   Netgroup
+ * @param[in]  host    Host
+ * @param[out] result  Whether host is in group, if cached
+ * @param[out] refresh Set if the entry should be resolved again
+ *
+ * @return true if the answer was cached.
+ */
+static bool ng_cached(struct ng_partition *part, const char *group,
+		      const char *host, bool *result, bool *refresh)
+{
+	bool found = true;
+
+	PTHREAD_RWLOCK_rdlock(&part->lock);
+	if (ng_lookup(part, group, host, false, refresh)) /* positive */
+		*result = true;
+	else if (ng_lookup(part, group, host, true, refresh)) /* negative */
+		*result = false;
+	else
+		found = false;
+	PTHREAD_RWLOCK_unlock(&part->lock);
+
+	return found;
+}
+
+static void ng_refresh_run(struct fridgethr_context *ctx)
+{
+	struct ng_refresh *refresh = ctx->arg;
+	struct ng_cache_info prototype = {
+		.ng_group.addr = refresh->group,
+		.ng_group.len = strlen(refresh->group)+1,
+		.ng_host.addr = refresh->host,
+		.ng_host.len = strlen(refresh->host)+1
+	};
+	struct ng_partition *part = ng_partition_of(&prototype);
+	int rc;
+
+	rc = innetgr(refresh->group, refresh->host, NULL, NULL);
+
+	PTHREAD_RWLOCK_wrlock(&part->lock);
+	ng_add(part, refresh->group, refresh->host, !rc);
+	PTHREAD_RWLOCK_unlock(&part->lock);
+
+	gsh_free(refresh->group);
+	gsh_free(refresh->host);
+	gsh_free(refresh);
+}
+
+/* Queue resolving (group, host) again; entries not refreshed expire */
+static void ng_refresh(const char *group, const char *host)
+{
+	struct ng_refresh *refresh;
+
+	if (ng_fridge == NULL)
+		return;
+
+	refresh = gsh_malloc(sizeof(*refresh));
+	refresh->group = gsh_strdup(group);
+	refresh->host = gsh_strdup(host);
+
+	if (fridgethr_submit(ng_fridge, ng_refresh_run, refresh) != 0) {
+		LogDebug(COMPONENT_IDMAPPER,
+			 "Could not queue refresh of netgroup %s", group);
+		gsh_free(refresh->group);
+		gsh_free(refresh->host);
+		gsh_free(refresh);
+	}
+}
+
+/**
+ * @brief Start resolving (group, host), or wait for whoever is
+ *
+ * @return The resolution to end with ng_inflight_end(), or NULL if
+ *         another thread resolved it while we waited.
+ */
+static struct ng_inflight *ng_inflight_begin(struct ng_partition *part,
+					     const char *group,
+					     const char *host)
+{
+	struct ng_inflight *inflight;
+	struct glist_head *glist;
+
+	PTHREAD_MUTEX_lock(&part->inflight_mtx);
+
+	glist_for_each(glist, &part->inflight) {
+		inflight = glist_entry(glist, struct ng_inflight, list);
+
+		if (strcmp(inflight->group, group) != 0 ||
+		    strcmp(inflight->host, host) != 0)
+			continue;
+
+		inflight->waiters++;
+		while (!inflight->done)
+			pthread_cond_wait(&part->inflight_cv,
+					  &part->inflight_mtx);
+		if (--inflight->waiters == 0)
+			gsh_free(inflight);
+
+		PTHREAD_MUTEX_unlock(&part->inflight_mtx);
+		return NULL;
+	}
+
+	inflight = gsh_malloc(sizeof(*inflight));
+	inflight->group = group;
+	inflight->host = host;
+	inflight->done = false;
+	inflight->waiters = 0;
+	glist_add_tail(&part->inflight, &inflight->list);
+
+	PTHREAD_MUTEX_unlock(&part->inflight_mtx);
+
+	return inflight;
+}
+
+/* Finish a resolution, its result being in the cache */
+static void ng_inflight_end(struct ng_partition *part,
+			    struct ng_inflight *inflight)
+{
+	PTHREAD_MUTEX_lock(&part->inflight_mtx);
+
+	glist_del(&inflight->list);
+	inflight->done = true;
+	if (inflight->waiters == 0)
+		gsh_free(inflight);
+	else
+		pthread_cond_broadcast(&part->inflight_cv);
+
+	PTHREAD_MUTEX_unlock(&part->inflight_mtx);
+}
+
 /**
  * @brief Verify if the given host is in the given netgroup or not
  */
 bool ng_innetgr(const char *group, const char *host)
 {
+	struct ng_cache_info prototype = {
+		.ng_group.addr = (char *)group,
+		.ng_group.len = strlen(group)+1,
+		.ng_host.addr = (char *)host,
+		.ng_host.len = strlen(host)+1
+	};
+	struct ng_partition *part = ng_partition_of(&prototype);
+	struct ng_inflight *inflight;
+	bool result, refresh = false;
 	int rc;
 
 	/* Check positive lookup and then negative lookup.  If absent in
 	 * both, then do a real innetgr call and cache the results.
 	 */
-	PTHREAD_RWLOCK_rdlock(&ng_lock);
-	if (ng_lookup(group, host, false)) { /* positive lookup */
-		PTHREAD_RWLOCK_unlock(&ng_lock);
-		return true;
+	if (ng_cached(part, group, host, &result, &refresh)) {
+		if (refresh)
+			ng_refresh(group, host);
+		return result;
 	}
-	if (ng_lookup(group, host, true)) { /* negative lookup */
-		PTHREAD_RWLOCK_unlock(&ng_lock);
-		return false;
-	}
-	PTHREAD_RWLOCK_unlock(&ng_lock);
+
+	/* Only one thread calls innetgr() for a given (group, host) */
+	inflight = ng_inflight_begin(part, group, host);
+	if (inflight == NULL &&
+	    ng_cached(part, group, host, &result, &refresh))
+		return result;
 
 	rc = innetgr(group, host, NULL, NULL);
 
-	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	PTHREAD_RWLOCK_wrlock(&part->lock);
 	if (rc)
-		ng_add(group, host, false);	/* positive lookup */
+		ng_add(part, group, host, false);	/* positive lookup */
 	else
-		ng_add(group, host, true);	/* negative lookup */
-	PTHREAD_RWLOCK_unlock(&ng_lock);
+		ng_add(part, group, host, true);	/* negative lookup */
+	PTHREAD_RWLOCK_unlock(&part->lock);
+
+	if (inflight != NULL)
+		ng_inflight_end(part, inflight);
 
 	return rc;
 }
@@ -301,25 +547,30 @@ void ng_clear_cache(void)
 {
 	struct avltree_node *node;
 	struct ng_cache_info *info;
+	struct ng_partition *part;
+	int i;
 
-	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	for (i = 0; i < NG_CACHE_PARTITIONS; i++) {
+		part = &ng_partitions[i];
+		PTHREAD_RWLOCK_wrlock(&part->lock);
 
-	while ((node = avltree_first(&pos_ng_tree))) {
-		info = avltree_container_of(node, struct ng_cache_info,
-					    ng_node);
-		ng_remove(info, false);
-		ng_free(info);
-	}
+		while ((node = avltree_first(&part->pos_ng_tree))) {
+			info = avltree_container_of(node, struct ng_cache_info,
+						    ng_node);
+			ng_remove(part, info, false);
+			ng_free(info);
+		}
 
-	while ((node = avltree_first(&neg_ng_tree))) {
-		info = avltree_container_of(node, struct ng_cache_info,
-					    ng_node);
-		ng_remove(info, true);
-		ng_free(info);
-	}
+		while ((node = avltree_first(&part->neg_ng_tree))) {
+			info = avltree_container_of(node, struct ng_cache_info,
+						    ng_node);
+			ng_remove(part, info, true);
+			ng_free(info);
+		}
 
-	assert(avltree_first(&pos_ng_tree) == NULL);
-	assert(avltree_first(&neg_ng_tree) == NULL);
+		assert(avltree_first(&part->pos_ng_tree) == NULL);
+		assert(avltree_first(&part->neg_ng_tree) == NULL);
 
-	PTHREAD_RWLOCK_unlock(&ng_lock);
+		PTHREAD_RWLOCK_unlock(&part->lock);
+	}
 }
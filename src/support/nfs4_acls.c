@@ -59,7 +59,11 @@ fsal_ace_t *nfs4_ace_alloc(int nace)
 
 fsal_acl_t *nfs4_acl_alloc()
 {
-	return pool_alloc(fsal_acl_pool);
+	fsal_acl_t *acl = pool_alloc(fsal_acl_pool);
+
+	PTHREAD_MUTEX_init(&acl->access_mtx, NULL);
+
+	return acl;
 }
 
 void nfs4_ace_free(fsal_ace_t *ace)
@@ -80,6 +84,9 @@ void nfs4_acl_free(fsal_acl_t *acl)
 	if (acl->aces)
 		nfs4_ace_free(acl->aces);
 
+	gsh_free(acl->access);
+	PTHREAD_MUTEX_destroy(&acl->access_mtx);
+
 	pool_free(fsal_acl_pool, acl);
 }
 
@@ -236,6 +236,105 @@ int nfs_rpc_req2client_cred(struct svc_req *req, nfs_client_cred_t *pcred)
 	return 1;
 }
 
+/**
+ * @brief GSS principals mapped on a connection
+ *
+ * A connection nearly always carries a single GSS context, so keep
+ * the uid/gid its principal mapped to rather than copying the name
+ * and going through the idmapper on every request.  Mappings are
+ * kept no longer than the idmapper itself keeps them.
+ */
+
+#define XPRT_GSS_CREDS_SLOTS 2
+
+struct xprt_gss_creds {
+	pthread_mutex_t mtx;
+	uint32_t next;		/*< Slot to replace next */
+	struct {
+		time_t epoch;	/*< When mapped, 0 if empty */
+		uid_t uid;
+		gid_t gid;
+		size_t len;
+		char principal[MAXNAMLEN + 1];
+	} slot[XPRT_GSS_CREDS_SLOTS];
+};
+
+struct xprt_gss_creds *xprt_gss_creds_alloc(void)
+{
+	struct xprt_gss_creds *cache = gsh_calloc(1, sizeof(*cache));
+
+	PTHREAD_MUTEX_init(&cache->mtx, NULL);
+
+	return cache;
+}
+
+void xprt_gss_creds_free(struct xprt_gss_creds *cache)
+{
+	if (cache == NULL)
+		return;
+
+	PTHREAD_MUTEX_destroy(&cache->mtx);
+	gsh_free(cache);
+}
+
+#ifdef _HAVE_GSSAPI
+static bool xprt_gss_creds_get(struct svc_req *req,
+			       const struct svc_rpc_gss_data *gd,
+			       uid_t *uid, gid_t *gid)
+{
+	gsh_xprt_private_t *xu = req->rq_xprt->xp_u1;
+	struct xprt_gss_creds *cache;
+	time_t ttl = nfs_param.nfsv4_param.idmap_cache_expiration;
+	time_t now = time(NULL);
+	bool found = false;
+	int i;
+
+	if (xu == NULL || xu->gss_creds == NULL)
+		return false;
+
+	cache = xu->gss_creds;
+	PTHREAD_MUTEX_lock(&cache->mtx);
+	for (i = 0; i < XPRT_GSS_CREDS_SLOTS; i++) {
+		if (cache->slot[i].epoch == 0 ||
+		    (ttl != 0 && now - cache->slot[i].epoch >= ttl) ||
+		    cache->slot[i].len != gd->cname.length ||
+		    memcmp(cache->slot[i].principal, gd->cname.value,
+			   gd->cname.length) != 0)
+			continue;
+
+		*uid = cache->slot[i].uid;
+		*gid = cache->slot[i].gid;
+		found = true;
+		break;
+	}
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+
+	return found;
+}
+
+static void xprt_gss_creds_put(struct svc_req *req, const char *principal,
+			       size_t len, uid_t uid, gid_t gid)
+{
+	gsh_xprt_private_t *xu = req->rq_xprt->xp_u1;
+	struct xprt_gss_creds *cache;
+	int i;
+
+	if (xu == NULL || xu->gss_creds == NULL || len > MAXNAMLEN)
+		return;
+
+	cache = xu->gss_creds;
+	PTHREAD_MUTEX_lock(&cache->mtx);
+	i = cache->next;
+	cache->next = (i + 1) % XPRT_GSS_CREDS_SLOTS;
+	cache->slot[i].epoch = time(NULL);
+	cache->slot[i].uid = uid;
+	cache->slot[i].gid = gid;
+	cache->slot[i].len = len;
+	memcpy(cache->slot[i].principal, principal, len);
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+}
+#endif
+
 /**
  * @brief Get numeric credentials from request
  *
@@ -303,6 +402,14 @@ nfsstat4 nfs_req_creds(struct svc_req *req)
 			/* Get the gss data to process them */
 			gd = SVCAUTH_PRIVATE(req->rq_auth);
 
+			if (gd->cname.length <= MAXNAMLEN &&
+			    xprt_gss_creds_get(req, gd,
+					&op_ctx->original_creds.caller_uid,
+					&op_ctx->original_creds.caller_gid)) {
+				op_ctx->cred_flags |= CREDS_LOADED;
+				goto gss_loaded;
+			}
+
 			memcpy(principal, gd->cname.value, gd->cname.length);
 			principal[gd->cname.length] = 0;
 
@@ -335,9 +442,13 @@ nfsstat4 nfs_req_creds(struct svc_req *req)
 				break;
 			}
 
+			xprt_gss_creds_put(req, principal, gd->cname.length,
+					   op_ctx->original_creds.caller_uid,
+					   op_ctx->original_creds.caller_gid);
 			op_ctx->cred_flags |= CREDS_LOADED;
 		}
 
+gss_loaded:
 		auth_label = "RPCSEC_GSS";
 		op_ctx->cred_flags |= MANAGED_GIDS;
 		garray_copy = &op_ctx->managed_garray_copy;
@@ -553,7 +664,7 @@ nfsstat4 nfs4_export_check_access(struct svc_req *req)
 
 	LogMidDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
 		    "nfs4_export_check_access about to call export_check_access");
-	export_check_access();
+	export_check_access_req(req);
 
 	/* Check if any access at all */
 	if ((op_ctx->export_perms->options &
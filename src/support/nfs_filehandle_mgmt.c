@@ -42,6 +42,7 @@
 #include "nfs_convert.h"
 #include "export_mgr.h"
 #include "fsal_convert.h"
+#include "city.h"
 
 #ifdef _USE_NFS3
 /**
@@ -337,6 +338,214 @@ int nfs4_Is_Fh_Invalid(nfs_fh4 *fh)
 	return NFS4_OK;
 }				/* nfs4_Is_Fh_Invalid */
 
+/** Number of handles each thread keeps resolved */
+#define NFS4_FH_CACHE_SIZE 16
+
+/**
+ * @brief A wire handle PUTFH resolved, and what it resolved to
+ *
+ * The entry holds a reference on both the export and the object.
+ */
+struct nfs4_fh_cache_entry {
+	uint64_t gen;			/*< nfs4_fh_cache_gen when filled */
+	struct gsh_export *export;	/*< NULL if the entry is empty */
+	struct fsal_obj_handle *obj;
+	u_int len;
+	char fh[NFS4_FHSIZE];
+};
+
+/**
+ * @brief The handles a thread keeps resolved
+ *
+ * Only its thread fills it, but unexport empties every thread's cache
+ * of the export's handles, so the cache has a lock, which is only ever
+ * contended then.
+ */
+struct nfs4_fh_cache {
+	struct glist_head caches;	/*< Link in nfs4_fh_caches */
+	pthread_mutex_t mtx;
+	struct nfs4_fh_cache_entry entries[NFS4_FH_CACHE_SIZE];
+};
+
+/** Bumped whenever a cached object may have gone stale */
+uint64_t nfs4_fh_cache_gen;
+
+static struct glist_head nfs4_fh_caches = GLIST_HEAD_INIT(nfs4_fh_caches);
+static pthread_mutex_t nfs4_fh_caches_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread struct nfs4_fh_cache *nfs4_fh_cache;
+
+/**
+ * @brief The calling thread's cache, made on first use
+ */
+static struct nfs4_fh_cache *nfs4_fh_cache_self(void)
+{
+	struct nfs4_fh_cache *cache = nfs4_fh_cache;
+
+	if (likely(cache != NULL))
+		return cache;
+
+	cache = gsh_calloc(1, sizeof(*cache));
+	PTHREAD_MUTEX_init(&cache->mtx, NULL);
+
+	PTHREAD_MUTEX_lock(&nfs4_fh_caches_mtx);
+	glist_add_tail(&nfs4_fh_caches, &cache->caches);
+	PTHREAD_MUTEX_unlock(&nfs4_fh_caches_mtx);
+
+	nfs4_fh_cache = cache;
+	return cache;
+}
+
+static inline struct nfs4_fh_cache_entry *
+nfs4_fh_cache_slot(struct nfs4_fh_cache *cache, nfs_fh4 *fh)
+{
+	return &cache->entries[CityHash64(fh->nfs_fh4_val, fh->nfs_fh4_len) %
+			       NFS4_FH_CACHE_SIZE];
+}
+
+static void nfs4_fh_cache_drop(struct nfs4_fh_cache_entry *entry)
+{
+	if (entry->export == NULL)
+		return;
+
+	entry->obj->obj_ops.put_ref(entry->obj);
+	put_gsh_export(entry->export);
+	entry->export = NULL;
+	entry->obj = NULL;
+}
+
+/**
+ * @brief Look a wire handle up in the calling thread's cache
+ *
+ * Objects are handed out only if nothing was invalidated since they were
+ * cached and their export is still up.
+ *
+ * @param[in]  fh      A valid NFSv4 MDS handle
+ * @param[out] export  The export, with a reference for the caller
+ * @param[out] obj     The object, with a reference for the caller
+ *
+ * @retval true on a hit
+ */
+bool nfs4_fh_cache_get(nfs_fh4 *fh, struct gsh_export **export,
+		       struct fsal_obj_handle **obj)
+{
+	struct nfs4_fh_cache *cache = nfs4_fh_cache_self();
+	struct nfs4_fh_cache_entry *entry = nfs4_fh_cache_slot(cache, fh);
+	bool hit = false;
+
+	PTHREAD_MUTEX_lock(&cache->mtx);
+
+	if (entry->export == NULL || entry->len != fh->nfs_fh4_len ||
+	    memcmp(entry->fh, fh->nfs_fh4_val, fh->nfs_fh4_len) != 0)
+		goto out;
+
+	if (entry->gen != atomic_fetch_uint64_t(&nfs4_fh_cache_gen) ||
+	    !export_ready(entry->export)) {
+		nfs4_fh_cache_drop(entry);
+		goto out;
+	}
+
+	get_gsh_export_ref(entry->export);
+	entry->obj->obj_ops.get_ref(entry->obj);
+
+	*export = entry->export;
+	*obj = entry->obj;
+	hit = true;
+
+ out:
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+	return hit;
+}
+
+/**
+ * @brief Remember what a wire handle resolved to
+ *
+ * The cache takes its own references, displacing what was in the slot.
+ * Nothing is cached for an export being removed, see
+ * nfs4_fh_cache_drain.
+ *
+ * @param[in] fh      The NFSv4 handle
+ * @param[in] export  Export the handle belongs to
+ * @param[in] obj     Object the handle resolved to
+ */
+void nfs4_fh_cache_put(nfs_fh4 *fh, struct gsh_export *export,
+		       struct fsal_obj_handle *obj)
+{
+	struct nfs4_fh_cache *cache = nfs4_fh_cache_self();
+	struct nfs4_fh_cache_entry *entry = nfs4_fh_cache_slot(cache, fh);
+	uint64_t gen = atomic_fetch_uint64_t(&nfs4_fh_cache_gen);
+
+	PTHREAD_MUTEX_lock(&cache->mtx);
+
+	nfs4_fh_cache_drop(entry);
+
+	if (export_ready(export)) {
+		get_gsh_export_ref(export);
+		obj->obj_ops.get_ref(obj);
+
+		entry->gen = gen;
+		entry->export = export;
+		entry->obj = obj;
+		entry->len = fh->nfs_fh4_len;
+		memcpy(entry->fh, fh->nfs_fh4_val, fh->nfs_fh4_len);
+	}
+
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+}
+
+/**
+ * @brief Release everything the calling thread has cached
+ */
+void nfs4_fh_cache_flush(void)
+{
+	struct nfs4_fh_cache *cache = nfs4_fh_cache;
+	int i;
+
+	if (cache == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&nfs4_fh_caches_mtx);
+	glist_del(&cache->caches);
+	PTHREAD_MUTEX_unlock(&nfs4_fh_caches_mtx);
+
+	for (i = 0; i < NFS4_FH_CACHE_SIZE; i++)
+		nfs4_fh_cache_drop(&cache->entries[i]);
+
+	PTHREAD_MUTEX_destroy(&cache->mtx);
+	gsh_free(cache);
+	nfs4_fh_cache = NULL;
+}
+
+/**
+ * @brief Release every thread's cached handles of an export
+ *
+ * Called by unexport once the export is no longer ready, so that the
+ * caches don't keep it, and its FSAL export, from being freed.
+ *
+ * @param[in] export  The export being removed
+ */
+void nfs4_fh_cache_drain(struct gsh_export *export)
+{
+	struct nfs4_fh_cache *cache;
+	struct glist_head *glist;
+	int i;
+
+	PTHREAD_MUTEX_lock(&nfs4_fh_caches_mtx);
+
+	glist_for_each(glist, &nfs4_fh_caches) {
+		cache = glist_entry(glist, struct nfs4_fh_cache, caches);
+
+		PTHREAD_MUTEX_lock(&cache->mtx);
+		for (i = 0; i < NFS4_FH_CACHE_SIZE; i++) {
+			if (cache->entries[i].export == export)
+				nfs4_fh_cache_drop(&cache->entries[i]);
+		}
+		PTHREAD_MUTEX_unlock(&cache->mtx);
+	}
+
+	PTHREAD_MUTEX_unlock(&nfs4_fh_caches_mtx);
+}
+
 /**
  * @brief Test if a filehandle is invalid.
  *
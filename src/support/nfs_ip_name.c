@@ -36,6 +36,7 @@
 #include "nfs_exports.h"
 #include "nfs_ip_stats.h"
 #include "config_parsing.h"
+#include "fridgethr.h"
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -131,52 +132,109 @@ int display_ip_name_val(struct gsh_buffdesc *pbuff, char *str)
 			nfs_ip_name->hostname);
 }
 
+/* Lookups, LRU and the entries themselves are protected by ip_name_mutex;
+ * waiters for a lookup in progress sleep on ip_name_cond.
+ */
+static pthread_mutex_t ip_name_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ip_name_cond = PTHREAD_COND_INITIALIZER;
+static struct glist_head ip_name_lru = GLIST_HEAD_INIT(ip_name_lru);
+static uint32_t ip_name_count;
+static uint32_t ip_name_max_entries;
+static uint32_t negative_expiration_time;
+static uint32_t resolve_timeout;
+static struct fridgethr *ip_name_fridge;
+
 /**
+ * @brief Look an address up in the cache
  *
- * nfs_ip_name_add: adds an entry into IP/name cache.
+ * Must be called with ip_name_mutex held.
  *
- * Adds an entry in the duplicate requests cache.
+ * @param[in] ipaddr Address to look for
  *
- * @param ipaddr           [IN]    the ipaddr to be used as key
- * @param hostname         [OUT]    the hostname added (found by using getnameinfo)
+ * @return The entry or NULL.
+ */
+static nfs_ip_name_t *ip_name_lookup(sockaddr_t *ipaddr)
+{
+	struct gsh_buffdesc buffkey;
+	struct gsh_buffdesc buffval;
+
+	buffkey.addr = (caddr_t) ipaddr;
+	buffkey.len = sizeof(sockaddr_t);
+
+	if (HashTable_Get(ht_ip_name, &buffkey, &buffval) != HASHTABLE_SUCCESS)
+		return NULL;
+
+	return buffval.addr;
+}
+
+/**
+ * @brief Drop an entry from the cache
  *
- * @return IP_NAME_SUCCESS if successfull\n.
- * @return IP_NAME_INSERT_MALLOC_ERROR if an error occured during the insertion process \n
- * @return IP_NAME_NETDB_ERROR if an error occured during the netdb query (via gethostbyaddr).
+ * Must be called with ip_name_mutex held, and never on an entry with
+ * a lookup in progress or waiters.
  *
+ * @param[in] nfs_ip_name Entry to free
  */
-
-int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size)
+static void ip_name_free(nfs_ip_name_t *nfs_ip_name)
 {
 	struct gsh_buffdesc buffkey;
-	struct gsh_buffdesc buffdata;
-	nfs_ip_name_t *nfs_ip_name = NULL;
-	sockaddr_t *pipaddr = NULL;
-	struct timeval tv0, tv1, dur;
-	int rc;
-	char ipstring[SOCK_NAME_MAX + 1];
 
-	nfs_ip_name = gsh_malloc(sizeof(nfs_ip_name_t));
+	buffkey.addr = (caddr_t) &nfs_ip_name->addr;
+	buffkey.len = sizeof(sockaddr_t);
+
+	(void) HashTable_Del(ht_ip_name, &buffkey, NULL, NULL);
+	glist_del(&nfs_ip_name->lru);
+	ip_name_count--;
+	gsh_free(nfs_ip_name);
+}
 
-	pipaddr = gsh_malloc(sizeof(sockaddr_t));
+/**
+ * @brief Evict least recently used entries beyond Max_Entries
+ *
+ * Must be called with ip_name_mutex held.
+ */
+static void ip_name_evict(void)
+{
+	struct glist_head *glist = ip_name_lru.prev;
+	nfs_ip_name_t *nfs_ip_name;
 
-	/* I have to keep an integer as key, I wil use the pointer buffkey->addr
-	 * for this, this also means that buffkey->len will be 0
-	 */
-	memcpy(pipaddr, ipaddr, sizeof(sockaddr_t));
+	while (ip_name_count > ip_name_max_entries && glist != &ip_name_lru) {
+		nfs_ip_name = glist_entry(glist, nfs_ip_name_t, lru);
+		glist = glist->prev;
 
-	buffkey.addr = (caddr_t) pipaddr;
-	buffkey.len = sizeof(sockaddr_t);
+		if (nfs_ip_name->resolving || nfs_ip_name->waiters != 0)
+			continue;
+
+		LogFullDebug(COMPONENT_DISPATCH, "Evicting %s",
+			     nfs_ip_name->hostname);
+		ip_name_free(nfs_ip_name);
+	}
+}
+
+/**
+ * @brief Resolve an entry's address and wake any waiters
+ *
+ * @param[in] nfs_ip_name Entry to resolve, marked resolving
+ */
+static void ip_name_resolve(nfs_ip_name_t *nfs_ip_name)
+{
+	char hostname[MAXHOSTNAMELEN + 1];
+	char ipstring[SOCK_NAME_MAX + 1];
+	struct timeval tv0, tv1, dur;
+	int rc;
+
+	/* The entry can not be freed while resolving is set, and nothing
+	 * else changes its address.
+	 */
+	sprint_sockip(&nfs_ip_name->addr, ipstring, sizeof(ipstring));
 
 	gettimeofday(&tv0, NULL);
-	rc = getnameinfo((struct sockaddr *)pipaddr, sizeof(sockaddr_t),
-			 nfs_ip_name->hostname, sizeof(nfs_ip_name->hostname),
+	rc = getnameinfo((struct sockaddr *)&nfs_ip_name->addr,
+			 sizeof(sockaddr_t), hostname, sizeof(hostname),
 			 NULL, 0, 0);
 	gettimeofday(&tv1, NULL);
 	timersub(&tv1, &tv0, &dur);
 
-	sprint_sockip(pipaddr, ipstring, sizeof(ipstring));
-
 	/* display warning if DNS resolution took more that 1.0s */
 	if (dur.tv_sec >= 1) {
 		LogEvent(COMPONENT_DISPATCH,
@@ -185,31 +243,151 @@ int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size)
 			 (unsigned int)dur.tv_usec);
 	}
 
-	/* Ask for the name to be cached */
 	if (rc != 0) {
-		strmaxcpy(nfs_ip_name->hostname, ipstring,
-			sizeof(nfs_ip_name->hostname));
+		strmaxcpy(hostname, ipstring, sizeof(hostname));
 		LogEvent(COMPONENT_DISPATCH,
 			 "Cannot resolve address %s, error %s, using %s as hostname",
-			 ipstring, gai_strerror(rc), nfs_ip_name->hostname);
+			 ipstring, gai_strerror(rc), hostname);
 	}
 
 	LogDebug(COMPONENT_DISPATCH, "Inserting %s->%s to addr cache", ipstring,
-		 nfs_ip_name->hostname);
+		 hostname);
 
-	/* I build the data with the request pointer
-	 * that should be in state 'IN USE'
-	 */
+	PTHREAD_MUTEX_lock(&ip_name_mutex);
+
+	memcpy(nfs_ip_name->hostname, hostname, sizeof(hostname));
+	nfs_ip_name->negative = rc != 0;
 	nfs_ip_name->timestamp = time(NULL);
+	nfs_ip_name->resolved = true;
+	nfs_ip_name->resolving = false;
+	pthread_cond_broadcast(&ip_name_cond);
 
-	buffdata.addr = (caddr_t) nfs_ip_name;
-	buffdata.len = sizeof(nfs_ip_name_t);
+	/* Entries skipped while resolving may now be evicted */
+	ip_name_evict();
 
-	if (HashTable_Set(ht_ip_name, &buffkey, &buffdata) != HASHTABLE_SUCCESS)
-		return IP_NAME_INSERT_MALLOC_ERROR;
+	PTHREAD_MUTEX_unlock(&ip_name_mutex);
+}
 
-	/* Copy the value for the caller */
-	strmaxcpy(hostname, nfs_ip_name->hostname, size);
+static void ip_name_resolve_job(struct fridgethr_context *ctx)
+{
+	ip_name_resolve(ctx->arg);
+}
+
+/**
+ * @brief Hand an entry to the resolver pool
+ *
+ * Must be called without ip_name_mutex held, since the lookup is done
+ * inline if the pool is unavailable.
+ *
+ * @param[in] nfs_ip_name Entry to resolve, marked resolving
+ */
+static void ip_name_submit(nfs_ip_name_t *nfs_ip_name)
+{
+	if (ip_name_fridge != NULL &&
+	    fridgethr_submit(ip_name_fridge, ip_name_resolve_job,
+			     nfs_ip_name) == 0)
+		return;
+
+	ip_name_resolve(nfs_ip_name);
+}
+
+/**
+ *
+ * nfs_ip_name_add: adds an entry into IP/name cache.
+ *
+ * Queues a lookup for the address, unless one is already queued, and
+ * waits up to Resolve_Timeout for it.  If the lookup does not finish in
+ * time the IP address is returned as the hostname; the lookup carries on
+ * and its result is cached for later requests.
+ *
+ * @param ipaddr           [IN]    the ipaddr to be used as key
+ * @param hostname         [OUT]    the hostname added (found by using getnameinfo)
+ *
+ * @return IP_NAME_SUCCESS if successfull\n.
+ * @return IP_NAME_INSERT_MALLOC_ERROR if an error occured during the insertion process \n
+ *
+ */
+
+int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size)
+{
+	struct gsh_buffdesc buffkey;
+	struct gsh_buffdesc buffdata;
+	nfs_ip_name_t *nfs_ip_name;
+	struct timespec timeout;
+	bool submit = false;
+	int rc = 0;
+
+	PTHREAD_MUTEX_lock(&ip_name_mutex);
+
+	nfs_ip_name = ip_name_lookup(ipaddr);
+
+	if (nfs_ip_name == NULL) {
+		nfs_ip_name = gsh_calloc(1, sizeof(nfs_ip_name_t));
+		memcpy(&nfs_ip_name->addr, ipaddr, sizeof(sockaddr_t));
+		nfs_ip_name->resolving = true;
+
+		buffkey.addr = (caddr_t) &nfs_ip_name->addr;
+		buffkey.len = sizeof(sockaddr_t);
+		buffdata.addr = (caddr_t) nfs_ip_name;
+		buffdata.len = sizeof(nfs_ip_name_t);
+
+		if (HashTable_Set(ht_ip_name, &buffkey, &buffdata) !=
+		    HASHTABLE_SUCCESS) {
+			PTHREAD_MUTEX_unlock(&ip_name_mutex);
+			gsh_free(nfs_ip_name);
+			return IP_NAME_INSERT_MALLOC_ERROR;
+		}
+
+		glist_add(&ip_name_lru, &nfs_ip_name->lru);
+		ip_name_count++;
+		ip_name_evict();
+		submit = true;
+	}
+
+	/* Keep the entry from being evicted while we wait on it; lookups
+	 * other threads started for this address are shared.
+	 */
+	nfs_ip_name->waiters++;
+
+	if (submit) {
+		PTHREAD_MUTEX_unlock(&ip_name_mutex);
+		ip_name_submit(nfs_ip_name);
+		PTHREAD_MUTEX_lock(&ip_name_mutex);
+	}
+
+	if (resolve_timeout != 0) {
+		clock_gettime(CLOCK_REALTIME, &timeout);
+		timeout.tv_sec += resolve_timeout / 1000;
+		timeout.tv_nsec += (resolve_timeout % 1000) * 1000000;
+		if (timeout.tv_nsec >= 1000000000) {
+			timeout.tv_sec++;
+			timeout.tv_nsec -= 1000000000;
+		}
+	}
+
+	while (!nfs_ip_name->resolved && rc != ETIMEDOUT) {
+		if (resolve_timeout == 0)
+			rc = pthread_cond_wait(&ip_name_cond, &ip_name_mutex);
+		else
+			rc = pthread_cond_timedwait(&ip_name_cond,
+						    &ip_name_mutex, &timeout);
+	}
+
+	nfs_ip_name->waiters--;
+
+	if (nfs_ip_name->resolved) {
+		/* Copy the value for the caller */
+		strmaxcpy(hostname, nfs_ip_name->hostname, size);
+		PTHREAD_MUTEX_unlock(&ip_name_mutex);
+		return IP_NAME_SUCCESS;
+	}
+
+	PTHREAD_MUTEX_unlock(&ip_name_mutex);
+
+	sprint_sockip(ipaddr, hostname, size);
+	LogEvent(COMPONENT_DISPATCH,
+		 "DNS query for %s still pending after %u msec, using it as hostname",
+		 hostname, resolve_timeout);
 
 	return IP_NAME_SUCCESS;
 }				/* nfs_ip_name_add */
@@ -218,7 +396,8 @@ int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size)
  *
  * nfs_ip_name_get: Tries to get an entry for ip_name cache.
  *
- * Tries to get an entry for ip_name cache.
+ * Tries to get an entry for ip_name cache.  An expired entry is still
+ * returned, and a lookup is queued to refresh it.
  *
  * @param ipaddr   [IN]  the ip address requested
  * @param hostname [OUT] the hostname
@@ -228,38 +407,59 @@ int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size)
  */
 int nfs_ip_name_get(sockaddr_t *ipaddr, char *hostname, size_t size)
 {
-	struct gsh_buffdesc buffkey;
-	struct gsh_buffdesc buffval;
 	nfs_ip_name_t *nfs_ip_name;
-	char ipstring[SOCK_NAME_MAX + 1];
+	bool refresh = false;
+	time_t ttl;
 
-	sprint_sockip(ipaddr, ipstring, sizeof(ipstring));
+	PTHREAD_MUTEX_lock(&ip_name_mutex);
 
-	buffkey.addr = (caddr_t) ipaddr;
-	buffkey.len = sizeof(sockaddr_t);
+	nfs_ip_name = ip_name_lookup(ipaddr);
 
-	if (HashTable_Get(ht_ip_name,
-			  &buffkey,
-			  &buffval) == HASHTABLE_SUCCESS) {
-		nfs_ip_name = buffval.addr;
-		strmaxcpy(hostname, nfs_ip_name->hostname, size);
+	if (nfs_ip_name == NULL || !nfs_ip_name->resolved) {
+		PTHREAD_MUTEX_unlock(&ip_name_mutex);
 
-		LogFullDebug(COMPONENT_DISPATCH, "Cache get hit for %s->%s",
-			     ipstring, nfs_ip_name->hostname);
+		if (isFullDebug(COMPONENT_DISPATCH)) {
+			char ipstring[SOCK_NAME_MAX + 1];
 
-		return IP_NAME_SUCCESS;
+			sprint_sockip(ipaddr, ipstring, sizeof(ipstring));
+			LogFullDebug(COMPONENT_DISPATCH,
+				     "Cache get miss for %s", ipstring);
+		}
+
+		return IP_NAME_NOT_FOUND;
 	}
 
-	LogFullDebug(COMPONENT_DISPATCH, "Cache get miss for %s", ipstring);
+	strmaxcpy(hostname, nfs_ip_name->hostname, size);
 
-	return IP_NAME_NOT_FOUND;
+	glist_del(&nfs_ip_name->lru);
+	glist_add(&ip_name_lru, &nfs_ip_name->lru);
+
+	ttl = nfs_ip_name->negative ? negative_expiration_time
+				    : expiration_time;
+
+	if (!nfs_ip_name->resolving &&
+	    time(NULL) - nfs_ip_name->timestamp >= ttl) {
+		nfs_ip_name->resolving = true;
+		refresh = true;
+	}
+
+	PTHREAD_MUTEX_unlock(&ip_name_mutex);
+
+	LogFullDebug(COMPONENT_DISPATCH, "Cache get hit for %s%s", hostname,
+		     refresh ? ", refreshing" : "");
+
+	if (refresh)
+		ip_name_submit(nfs_ip_name);
+
+	return IP_NAME_SUCCESS;
 }				/* nfs_ip_name_get */
 
 /**
  *
  * nfs_ip_name_remove: Tries to remove an entry for ip_name cache
  *
- * Tries to remove an entry for ip_name cache.
+ * Tries to remove an entry for ip_name cache.  An entry with a lookup in
+ * progress is left alone.
  *
  * @param ipaddr           [IN]    the ip address to be uncached.
  *
@@ -268,26 +468,27 @@ int nfs_ip_name_get(sockaddr_t *ipaddr, char *hostname, size_t size)
  */
 int nfs_ip_name_remove(sockaddr_t *ipaddr)
 {
-	struct gsh_buffdesc buffkey, old_value;
-	nfs_ip_name_t *nfs_ip_name = NULL;
+	nfs_ip_name_t *nfs_ip_name;
 	char ipstring[SOCK_NAME_MAX + 1];
 
 	sprint_sockip(ipaddr, ipstring, sizeof(ipstring));
 
-	buffkey.addr = (caddr_t) ipaddr;
-	buffkey.len = sizeof(sockaddr_t);
+	PTHREAD_MUTEX_lock(&ip_name_mutex);
 
-	if (HashTable_Del(ht_ip_name, &buffkey, NULL, &old_value) ==
-	    HASHTABLE_SUCCESS) {
-		nfs_ip_name = (nfs_ip_name_t *) old_value.addr;
+	nfs_ip_name = ip_name_lookup(ipaddr);
 
+	if (nfs_ip_name != NULL && !nfs_ip_name->resolving &&
+	    nfs_ip_name->waiters == 0) {
 		LogFullDebug(COMPONENT_DISPATCH, "Cache remove hit for %s->%s",
 			     ipstring, nfs_ip_name->hostname);
 
-		gsh_free(nfs_ip_name);
+		ip_name_free(nfs_ip_name);
+		PTHREAD_MUTEX_unlock(&ip_name_mutex);
 		return IP_NAME_SUCCESS;
 	}
 
+	PTHREAD_MUTEX_unlock(&ip_name_mutex);
+
 	LogFullDebug(COMPONENT_DISPATCH, "Cache remove miss for %s", ipstring);
 
 	return IP_NAME_NOT_FOUND;
@@ -309,6 +510,26 @@ int nfs_ip_name_remove(sockaddr_t *ipaddr)
  */
 #define IP_NAME_EXPIRATION 3600
 
+/**
+ * @brief Default value for ip_name_param.negative_expiration_time
+ */
+#define IP_NAME_NEGATIVE_EXPIRATION 60
+
+/**
+ * @brief Default value for ip_name_param.max_entries
+ */
+#define IP_NAME_MAX_ENTRIES 4096
+
+/**
+ * @brief Default value for ip_name_param.resolver_threads
+ */
+#define IP_NAME_RESOLVER_THREADS 4
+
+/**
+ * @brief Default value for ip_name_param.resolve_timeout
+ */
+#define IP_NAME_RESOLVE_TIMEOUT 2000
+
 
 /** @} */
 
@@ -324,6 +545,22 @@ struct ip_name_cache {
 	/** Expiration time for ip-name mappings.  Defautls to
 	    IP_NAME_Expiration, and settable with Expiration_Time. */
 	uint32_t expiration_time;
+	/** Expiration time for addresses that did not resolve.  Defaults
+	    to IP_NAME_NEGATIVE_EXPIRATION, and settable with
+	    Negative_Expiration_Time. */
+	uint32_t negative_expiration_time;
+	/** Least recently used mappings are evicted beyond this many.
+	    Defaults to IP_NAME_MAX_ENTRIES, and settable with
+	    Max_Entries. */
+	uint32_t max_entries;
+	/** Threads doing reverse lookups.  Defaults to
+	    IP_NAME_RESOLVER_THREADS, and settable with
+	    Resolver_Threads. */
+	uint32_t resolver_threads;
+	/** Milliseconds a request waits for a lookup before using the
+	    IP address, 0 to wait for the lookup.  Defaults to
+	    IP_NAME_RESOLVE_TIMEOUT, and settable with Resolve_Timeout. */
+	uint32_t resolve_timeout;
 };
 
 static struct ip_name_cache ip_name_cache = {
@@ -344,6 +581,15 @@ static struct config_item ip_name_params[] = {
 		       ip_name_cache, hash_param.index_size),
 	CONF_ITEM_UI32("Expiration_Time", 1, 60*60*24, IP_NAME_EXPIRATION,
 		       ip_name_cache, expiration_time),
+	CONF_ITEM_UI32("Negative_Expiration_Time", 1, 60*60*24,
+		       IP_NAME_NEGATIVE_EXPIRATION,
+		       ip_name_cache, negative_expiration_time),
+	CONF_ITEM_UI32("Max_Entries", 1, 1000000, IP_NAME_MAX_ENTRIES,
+		       ip_name_cache, max_entries),
+	CONF_ITEM_UI32("Resolver_Threads", 1, 64, IP_NAME_RESOLVER_THREADS,
+		       ip_name_cache, resolver_threads),
+	CONF_ITEM_UI32("Resolve_Timeout", 0, 60000, IP_NAME_RESOLVE_TIMEOUT,
+		       ip_name_cache, resolve_timeout),
 	CONFIG_EOL
 };
 
@@ -388,6 +634,9 @@ struct config_block nfs_ip_name = {
  */
 int nfs_Init_ip_name(void)
 {
+	struct fridgethr_params frp;
+	int rc;
+
 	ht_ip_name = hashtable_init(&ip_name_cache.hash_param);
 
 	if (ht_ip_name == NULL) {
@@ -398,6 +647,23 @@ int nfs_Init_ip_name(void)
 
 	/* Set the expiration time */
 	expiration_time = ip_name_cache.expiration_time;
+	negative_expiration_time = ip_name_cache.negative_expiration_time;
+	ip_name_max_entries = ip_name_cache.max_entries;
+	resolve_timeout = ip_name_cache.resolve_timeout;
+
+	memset(&frp, 0, sizeof(frp));
+	frp.thr_max = ip_name_cache.resolver_threads;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&ip_name_fridge, "IP_Name", &frp);
+
+	if (rc != 0) {
+		/* Lookups are done inline without the pool */
+		LogMajor(COMPONENT_INIT,
+			 "NFS IP_NAME: Cannot start resolver threads: %d",
+			 rc);
+		ip_name_fridge = NULL;
+	}
 
 	return IP_NAME_SUCCESS;
 }				/* nfs_Init_ip_name */
@@ -52,6 +52,8 @@
 #include "nfs_proto_functions.h"
 #include "nfs_dupreq.h"
 #include "config_parsing.h"
+#include "gsh_token_bucket.h"
+#include "gsh_topk.h"
 
 /**
  * @brief Core configuration parameters
@@ -82,6 +84,12 @@ static struct config_item core_params[] = {
 		       nfs_core_param, port[P_RQUOTA]),
 	CONF_ITEM_IP_ADDR("Bind_Addr", "0.0.0.0",
 			  nfs_core_param, bind_addr),
+	CONF_ITEM_UI16("NFS_RDMA_Port", 1, UINT16_MAX, 20049,
+		       nfs_core_param, rdma.port),
+	CONF_ITEM_UI32("NFS_RDMA_Credits", 1, 1024, 30,
+		       nfs_core_param, rdma.credits),
+	CONF_ITEM_UI32("NFS_RDMA_Max_Inline", 1024, 65536, 4096,
+		       nfs_core_param, rdma.max_inline),
 	CONF_ITEM_UI32("NFS_Program", 1, INT32_MAX, NFS_PROGRAM,
 		       nfs_core_param, program[P_NFS]),
 	CONF_ITEM_UI32("MNT_Program", 1, INT32_MAX, MOUNTPROG,
@@ -92,6 +100,32 @@ static struct config_item core_params[] = {
 		       nfs_core_param, program[P_RQUOTA]),
 	CONF_ITEM_UI32("Nb_Worker", 1, 1024*128, NB_WORKER_THREAD_DEFAULT,
 		       nfs_core_param, nb_worker),
+	CONF_ITEM_BOOL("Worker_Autoscale", false,
+		       nfs_core_param, worker_autoscale),
+	CONF_ITEM_UI32("Nb_Worker_Min", 1, 1024*128, 16,
+		       nfs_core_param, nb_worker_min),
+	CONF_ITEM_UI32("Worker_Target_Queue_Wait", 1, 10000000, 1000,
+		       nfs_core_param, worker_target_queue_wait),
+	CONF_ITEM_UI32("Worker_Idle_Timeout", 1, 60*60, 60,
+		       nfs_core_param, worker_idle_timeout),
+	CONF_ITEM_UI32("Overload_Target_Delay", 0, 10000000, 0,
+		       nfs_core_param, overload_target_delay),
+	CONF_ITEM_UI32("Overload_Interval", 1000, 10000000, 100000,
+		       nfs_core_param, overload_interval),
+	CONF_ITEM_BOOL("Thread_Affinity", false,
+		       nfs_core_param, thread_affinity),
+	CONF_ITEM_UI32("Worker_Spin_Usec", 0, 1000, 0,
+		       nfs_core_param, worker_spin_usec),
+	CONF_ITEM_UI32("Busy_Poll_Usec", 0, 10000, 0,
+		       nfs_core_param, busy_poll_usec),
+	CONF_ITEM_UI32("Mem_Pressure_Interval", 0, 3600, 0,
+		       nfs_core_param, mem_pressure_interval),
+	CONF_ITEM_UI32("Mem_Pressure_PSI_Threshold", 1, 100, 10,
+		       nfs_core_param, mem_pressure_psi_threshold),
+	CONF_ITEM_UI32("Mem_Pressure_Cgroup_Percent", 1, 99, 90,
+		       nfs_core_param, mem_pressure_cgroup_percent),
+	CONF_ITEM_UI32("Mem_Pressure_Max_Shrink", 1, 100, 10,
+		       nfs_core_param, mem_pressure_max_shrink),
 	CONF_ITEM_BOOL("Drop_IO_Errors", false,
 		       nfs_core_param, drop_io_errors),
 	CONF_ITEM_BOOL("Drop_Inval_Errors", false,
@@ -102,6 +136,22 @@ static struct config_item core_params[] = {
 		       nfs_core_param, dispatch_max_reqs),
 	CONF_ITEM_UI32("Dispatch_Max_Reqs_Xprt", 1, 2048, 512,
 		       nfs_core_param, dispatch_max_reqs_xprt),
+	CONF_ITEM_UI32("Dispatch_Queue_Shards", 0, 1024, 0,
+		       nfs_core_param, dispatch_queue_shards),
+	CONF_ITEM_BOOL("Fair_Share_Scheduling", false,
+		       nfs_core_param, fair_share),
+	CONF_ITEM_UI32("Dispatch_Max_Reqs_Client", 0, 10000, 0,
+		       nfs_core_param, dispatch_max_reqs_client),
+	CONF_ITEM_UI64("Client_Ops_Limit", 0, GSH_TOKEN_BUCKET_MAX_RATE, 0,
+		       nfs_core_param, client_ops_limit),
+	CONF_ITEM_UI64("Client_Bytes_Limit", 0, GSH_TOKEN_BUCKET_MAX_RATE, 0,
+		       nfs_core_param, client_bytes_limit),
+	CONF_ITEM_UI64("Read_Buffer_Pool_Size", 0, UINT64_C(1) << 36, 0,
+		       nfs_core_param, read_buffer_pool_size),
+	CONF_ITEM_UI32("Deferred_Read_Min", 0, XDR_BYTES_MAXLEN_IO, 0,
+		       nfs_core_param, deferred_read_min),
+	CONF_ITEM_UI32("Readdir_Cache_Size", 0, 1 << 20, 0,
+		       nfs_core_param, readdir_cache_size),
 	CONF_ITEM_BOOL("DRC_Disabled", false,
 		       nfs_core_param, drc.disabled),
 	CONF_ITEM_UI32("DRC_TCP_Npart", 1, 20, DRC_TCP_NPART,
@@ -112,6 +162,12 @@ static struct config_item core_params[] = {
 		       nfs_core_param, drc.tcp.cachesz),
 	CONF_ITEM_UI32("DRC_TCP_Hiwat", 1, 256, DRC_TCP_HIWAT,
 		       nfs_core_param, drc.tcp.hiwat),
+	CONF_ITEM_BOOL("DRC_TCP_Adaptive", false,
+		       nfs_core_param, drc.tcp.adaptive),
+	CONF_ITEM_UI32("DRC_TCP_Min_Hiwat", 1, 256, DRC_TCP_MIN_HIWAT,
+		       nfs_core_param, drc.tcp.min_hiwat),
+	CONF_ITEM_UI32("DRC_TCP_Budget", 0, UINT32_MAX, 0,
+		       nfs_core_param, drc.tcp.budget),
 	CONF_ITEM_UI32("DRC_TCP_Recycle_Npart", 1, 20, DRC_TCP_RECYCLE_NPART,
 		       nfs_core_param, drc.tcp.recycle_npart),
 	CONF_ITEM_UI32("DRC_TCP_Recycle_Expire_S", 0, 60*60, 600,
@@ -140,6 +196,15 @@ static struct config_item core_params[] = {
 	CONF_ITEM_UI32("MaxRPCRecvBufferSize", 1, 1048576*9,
 		       NFS_DEFAULT_RECV_BUFFER_SIZE,
 		       nfs_core_param, rpc.max_recv_buffer_size),
+	CONF_ITEM_UI32("VSOCK_RPC_Send_Buffer_Size", 1, 1048576*9,
+		       NFS_DEFAULT_VSOCK_BUFFER_SIZE,
+		       nfs_core_param, rpc.vsock_send_buffer_size),
+	CONF_ITEM_UI32("VSOCK_RPC_Recv_Buffer_Size", 1, 1048576*9,
+		       NFS_DEFAULT_VSOCK_BUFFER_SIZE,
+		       nfs_core_param, rpc.vsock_recv_buffer_size),
+	CONF_ITEM_UI32("VSOCK_Transport_Buffer_Size", 0, 1048576*64,
+		       NFS_DEFAULT_VSOCK_TRANSPORT_BUFFER_SIZE,
+		       nfs_core_param, rpc.vsock_transport_buffer_size),
 	CONF_ITEM_UI32("RPC_Ioq_ThrdMax", 1, 1024*128, 200,
 		       nfs_core_param, rpc.ioq_thrd_max),
 	CONF_ITEM_UI32("RPC_GSS_Npart", 1, 1021, 13,
@@ -166,6 +231,8 @@ static struct config_item core_params[] = {
 		       nfs_core_param, enable_NLM),
 	CONF_ITEM_BOOL("Enable_RQUOTA", true,
 		       nfs_core_param, enable_RQUOTA),
+	CONF_ITEM_UI32("RQUOTA_Cache_Expiration", 0, 3600, 0,
+		       nfs_core_param, rquota_cache_expiration),
 	CONF_ITEM_BOOL("Enable_TCP_keepalive", true,
 		       nfs_core_param, enable_tcp_keepalive),
 	CONF_ITEM_UI32("TCP_KEEPCNT", 0, 255, 0,
@@ -176,10 +243,34 @@ static struct config_item core_params[] = {
 		       nfs_core_param, tcp_keepintvl),
 	CONF_ITEM_BOOL("Enable_Fast_Stats", false,
 		       nfs_core_param, enable_FASTSTATS),
+	CONF_ITEM_BOOL("Enable_CPU_Stats", false,
+		       nfs_core_param, enable_CPUSTATS),
+	CONF_ITEM_UI32("Stats_Shards", 0, 64, 0,
+		       nfs_core_param, stats_shards),
+	CONF_ITEM_UI16("Metrics_Port", 0, UINT16_MAX, 0,
+		       nfs_core_param, metrics_port),
+	CONF_ITEM_UI32("Top_K_Entries", 0, TOPK_MAX_ENTRIES, 0,
+		       nfs_core_param, top_k_entries),
+	CONF_ITEM_UI32("Top_K_Half_Life", 1, 3600, 60,
+		       nfs_core_param, top_k_half_life),
+	CONF_ITEM_STR("Stats_Shm_Name", 2, NAME_MAX, NULL,
+		      nfs_core_param, stats_shm_name),
+	CONF_ITEM_UI32("Stats_Shm_Interval", 100, 10000, 1000,
+		       nfs_core_param, stats_shm_interval),
+	CONF_ITEM_PATH("Handoff_Socket", 1, MAXPATHLEN, NULL,
+		       nfs_core_param, handoff_socket),
 	CONF_ITEM_BOOL("Short_File_Handle", false,
 		       nfs_core_param, short_file_handle),
 	CONF_ITEM_I64("Manage_Gids_Expiration", 0, 7*24*60*60, 30*60,
 			nfs_core_param, manage_gids_expiration),
+	CONF_ITEM_I64("Manage_Gids_Stale", 0, 7*24*60*60, 5*60,
+			nfs_core_param, manage_gids_stale),
+	CONF_ITEM_STR("Manage_Gids_Prefetch", 1, 65535, NULL,
+		      nfs_core_param, manage_gids_prefetch),
+	CONF_ITEM_I64("Netgroup_Cache_Expiration", 0, 7*24*60*60, 30*60,
+			nfs_core_param, netgroup_cache_expiration),
+	CONF_ITEM_I64("Netgroup_Negative_Expiration", 0, 7*24*60*60, 30*60,
+			nfs_core_param, netgroup_negative_expiration),
 	CONF_ITEM_PATH("Plugins_Dir", 1, MAXPATHLEN, FSAL_MODULE_LOC,
 		       nfs_core_param, ganesha_modules_loc),
 	CONF_ITEM_UI32("heartbeat_freq", 0, 5000, 1000,
@@ -188,6 +279,12 @@ static struct config_item core_params[] = {
 		       nfs_core_param, fsid_device),
 	CONF_ITEM_BOOL("mount_path_pseudo", false,
 		       nfs_core_param, mount_path_pseudo),
+	CONF_ITEM_BOOL("Enable_Async_IO", false,
+		       nfs_core_param, enable_async_io),
+	CONF_ITEM_UI32("Nb_IOC_Worker", 1, 1024, NB_IOC_WORKER_THREAD_DEFAULT,
+		       nfs_core_param, nb_ioc_worker),
+	CONF_ITEM_UI32("Export_Init_Threads", 1, 256, 1,
+		       nfs_core_param, export_init_threads),
 	CONFIG_EOL
 };
 
@@ -229,6 +326,37 @@ struct config_block krb5_param = {
 };
 #endif
 
+/**
+ * @brief RPC-with-TLS parameters
+ */
+#ifdef USE_TLS
+static struct config_item tls_params[] = {
+	CONF_ITEM_BOOL("Active_TLS", false,
+		       nfs_tls_param, active_tls),
+	CONF_ITEM_PATH("Certificate_File", 1, MAXPATHLEN, "",
+		       nfs_tls_param, cert_file),
+	CONF_ITEM_PATH("Key_File", 1, MAXPATHLEN, "",
+		       nfs_tls_param, key_file),
+	CONF_ITEM_PATH("CA_File", 1, MAXPATHLEN, "",
+		       nfs_tls_param, ca_file),
+	CONF_ITEM_UI32("Handshake_Timeout", 1, 600,
+		       DEFAULT_TLS_HANDSHAKE_TIMEOUT,
+		       nfs_tls_param, handshake_timeout),
+	CONF_ITEM_BOOL("Require_TLS", false,
+		       nfs_tls_param, require_tls),
+	CONFIG_EOL
+};
+
+struct config_block tls_param = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.tls",
+	.blk_desc.name = "NFS_TLS",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = tls_params,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+#endif
+
 #ifdef USE_NFSIDMAP
 #define GETPWNAMDEF false
 #else
@@ -239,6 +367,12 @@ struct config_block krb5_param = {
  * @brief NFSv4 specific parameters
  */
 
+static struct config_item_list recovery_backends[] = {
+	CONFIG_LIST_TOK("fs", RECOVERY_BACKEND_FS),
+	CONFIG_LIST_TOK("fs_log", RECOVERY_BACKEND_FS_LOG),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item version4_params[] = {
 	CONF_ITEM_BOOL("Graceless", false,
 		       nfs_version4_parameter, graceless),
@@ -256,15 +390,42 @@ static struct config_item version4_params[] = {
 		       nfs_version4_parameter, allow_numeric_owners),
 	CONF_ITEM_BOOL("Only_Numeric_Owners", false,
 		       nfs_version4_parameter, only_numeric_owners),
+	CONF_ITEM_UI32("Idmap_Cache_Expiration", 0, 7*24*60*60,
+		       IDMAP_CACHE_EXPIRATION_DEFAULT,
+		       nfs_version4_parameter, idmap_cache_expiration),
+	CONF_ITEM_UI32("Idmap_Negative_Expiration", 0, 24*60*60,
+		       IDMAP_NEGATIVE_EXPIRATION_DEFAULT,
+		       nfs_version4_parameter, idmap_negative_expiration),
 	CONF_ITEM_BOOL("Delegations", false,
 		       nfs_version4_parameter, allow_delegations),
+	CONF_ITEM_BOOL("Dir_Delegations", false,
+		       nfs_version4_parameter, allow_dir_delegations),
 	CONF_ITEM_UI32("Deleg_Recall_Retry_Delay", 0, 10,
 			DELEG_RECALL_RETRY_DELAY_DEFAULT,
 			nfs_version4_parameter, deleg_recall_retry_delay),
+	CONF_ITEM_UI32("Max_Deleg_Per_Client", 0, UINT32_MAX,
+		       MAX_DELEG_PER_CLIENT_DEFAULT,
+		       nfs_version4_parameter, max_deleg_per_client),
+	CONF_ITEM_UI32("Deleg_Heat_Half_Life", 1, 24*60*60,
+		       DELEG_HEAT_HALF_LIFE_DEFAULT,
+		       nfs_version4_parameter, deleg_heat_half_life),
+	CONF_ITEM_UI32("Deleg_Opens_Per_Recall", 0, 1024,
+		       DELEG_OPENS_PER_RECALL_DEFAULT,
+		       nfs_version4_parameter, deleg_opens_per_recall),
+	CONF_ITEM_UI32("Max_Session_Slots", 1, 1024,
+		       MAX_SESSION_SLOTS_DEFAULT,
+		       nfs_version4_parameter, max_session_slots),
+	CONF_ITEM_UI32("Max_Session_Create_Rate", 0, 1000000, 0,
+		       nfs_version4_parameter, max_session_create_rate),
 	CONF_ITEM_BOOL("PNFS_MDS", true,
 		       nfs_version4_parameter, pnfs_mds),
 	CONF_ITEM_BOOL("PNFS_DS", true,
 		       nfs_version4_parameter, pnfs_ds),
+	CONF_ITEM_TOKEN("RecoveryBackend", RECOVERY_BACKEND_FS,
+			recovery_backends,
+			nfs_version4_parameter, recovery_backend),
+	CONF_ITEM_PATH("Cluster_Grace_Dir", 1, MAXPATHLEN, NULL,
+		       nfs_version4_parameter, cluster_grace_dir),
 	CONFIG_EOL
 };
 
@@ -0,0 +1,405 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file pool_magazine.c
+ * @brief Per-thread object caches for hot pools
+ *
+ * Pools created with pool_magazine_init keep freed objects in
+ * per-thread magazines, in the manner of Bonwick's "Magazines and
+ * Vmem" (USENIX 2001).  Each thread holds a loaded and a previous
+ * magazine per pool and allocates from and frees to them without any
+ * lock.  Only when both are empty (or both full) does the thread go
+ * to the depot of its NUMA node, trading a whole magazine at a time.
+ *
+ * New objects are allocated and zeroed by the thread that needs them,
+ * so first-touch places their pages on that thread's node, and the
+ * node depots keep objects freed on a node for reuse on it.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "gsh_intrinsic.h"
+
+/** Objects per magazine */
+#define POOL_MAG_ROUNDS 32
+
+/** Pools that may use magazines over the life of the process */
+#define POOL_MAG_MAX_POOLS 16
+
+/** NUMA nodes with their own depot, higher nodes share */
+#define POOL_MAG_MAX_NODES 8
+
+/** Full magazines kept in each depot, beyond that objects are freed */
+#define POOL_MAG_DEPOT_MAX 64
+
+struct pool_magazine {
+	struct pool_magazine *next;
+	uint32_t rounds;
+	void *objs[POOL_MAG_ROUNDS];
+};
+
+/**
+ * @brief Magazines parked on one node
+ */
+struct pool_mag_depot {
+	pthread_mutex_t lock;
+	struct pool_magazine *full;
+	struct pool_magazine *empty;
+	uint32_t nfull;
+	uint32_t nempty;
+	GSH_CACHE_PAD(0);
+};
+
+/**
+ * @brief Global state of one magazine pool
+ *
+ * Slots are never reused, so a thread cache can tell a destroyed
+ * pool from a live one.
+ */
+struct pool_mag_slot {
+	uint32_t live;	/*< Non-zero until the pool is destroyed */
+	int64_t objects;	/*< Objects allocated, cached ones included */
+	struct pool_mag_depot depot[POOL_MAG_MAX_NODES];
+};
+
+/**
+ * @brief A thread's magazines for one pool
+ */
+struct pool_mag_cpu {
+	struct pool_magazine *loaded;
+	struct pool_magazine *previous;
+};
+
+/**
+ * @brief A thread's magazines for all pools
+ */
+struct pool_mag_tcache {
+	struct pool_mag_cpu cpu[POOL_MAG_MAX_POOLS];
+};
+
+static struct pool_mag_slot pool_mag_slots[POOL_MAG_MAX_POOLS];
+static uint32_t pool_mag_nslots;
+static pthread_mutex_t pool_mag_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct pool_mag_tcache *pool_mag_self;
+static pthread_key_t pool_mag_key;
+static pthread_once_t pool_mag_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Node the calling thread currently runs on
+ */
+static inline uint32_t pool_mag_node(void)
+{
+	unsigned int cpu, node;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+		return 0;
+
+	return node % POOL_MAG_MAX_NODES;
+}
+
+/**
+ * @brief Free a magazine and the objects it holds
+ */
+static void pool_mag_release(struct pool_mag_slot *slot,
+			     struct pool_magazine *mag)
+{
+	(void)atomic_sub_int64_t(&slot->objects, mag->rounds);
+	while (mag->rounds > 0)
+		gsh_free(mag->objs[--mag->rounds]);
+
+	gsh_free(mag);
+}
+
+/**
+ * @brief Park a magazine in a depot
+ *
+ * Magazines beyond what the depot keeps are released.
+ */
+static void pool_mag_depot_put(struct pool_mag_slot *slot,
+			       struct pool_mag_depot *depot,
+			       struct pool_magazine *mag)
+{
+	if (mag == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&depot->lock);
+
+	if (mag->rounds == 0 && depot->nempty < POOL_MAG_DEPOT_MAX) {
+		mag->next = depot->empty;
+		depot->empty = mag;
+		depot->nempty++;
+		mag = NULL;
+	} else if (mag->rounds != 0 && depot->nfull < POOL_MAG_DEPOT_MAX) {
+		mag->next = depot->full;
+		depot->full = mag;
+		depot->nfull++;
+		mag = NULL;
+	}
+
+	PTHREAD_MUTEX_unlock(&depot->lock);
+
+	if (mag != NULL)
+		pool_mag_release(slot, mag);
+}
+
+/**
+ * @brief Take a magazine from a depot
+ *
+ * @param[in] depot  The depot
+ * @param[in] full   Whether a full or an empty magazine is wanted
+ *
+ * @return The magazine, or NULL if the depot has none.
+ */
+static struct pool_magazine *pool_mag_depot_get(struct pool_mag_depot *depot,
+						bool full)
+{
+	struct pool_magazine **list = full ? &depot->full : &depot->empty;
+	struct pool_magazine *mag;
+
+	PTHREAD_MUTEX_lock(&depot->lock);
+
+	mag = *list;
+	if (mag != NULL) {
+		*list = mag->next;
+		if (full)
+			depot->nfull--;
+		else
+			depot->nempty--;
+	}
+
+	PTHREAD_MUTEX_unlock(&depot->lock);
+
+	return mag;
+}
+
+/**
+ * @brief Hand the magazines of an exiting thread back
+ */
+static void pool_mag_unregister(void *arg)
+{
+	struct pool_mag_tcache *tc = arg;
+	struct pool_mag_depot *depot;
+	uint32_t node = pool_mag_node();
+	uint32_t i;
+
+	for (i = 0; i < POOL_MAG_MAX_POOLS; i++) {
+		struct pool_mag_cpu *cpu = &tc->cpu[i];
+
+		struct pool_mag_slot *slot = &pool_mag_slots[i];
+
+		if (atomic_fetch_uint32_t(&slot->live)) {
+			depot = &slot->depot[node];
+			pool_mag_depot_put(slot, depot, cpu->loaded);
+			pool_mag_depot_put(slot, depot, cpu->previous);
+		} else {
+			if (cpu->loaded != NULL)
+				pool_mag_release(slot, cpu->loaded);
+			if (cpu->previous != NULL)
+				pool_mag_release(slot, cpu->previous);
+		}
+	}
+
+	gsh_free(tc);
+}
+
+static void pool_mag_key_init(void)
+{
+	(void)pthread_key_create(&pool_mag_key, pool_mag_unregister);
+}
+
+/**
+ * @brief The calling thread's magazines for a pool
+ */
+static inline struct pool_mag_cpu *pool_mag_cpu(pool_t *pool)
+{
+	struct pool_mag_tcache *tc = pool_mag_self;
+
+	if (unlikely(tc == NULL)) {
+		(void)pthread_once(&pool_mag_once, pool_mag_key_init);
+		tc = gsh_calloc(1, sizeof(*tc));
+		(void)pthread_setspecific(pool_mag_key, tc);
+		pool_mag_self = tc;
+	}
+
+	return &tc->cpu[pool->mag_slot];
+}
+
+/**
+ * @brief Set up the magazine layer of a pool
+ *
+ * If every slot is taken the pool simply allocates from the heap.
+ *
+ * @param[in,out] pool  The newly created pool
+ */
+void pool_mag_init(pool_t *pool)
+{
+	struct pool_mag_slot *slot;
+	uint32_t i;
+
+	PTHREAD_MUTEX_lock(&pool_mag_mutex);
+
+	if (pool_mag_nslots == POOL_MAG_MAX_POOLS) {
+		PTHREAD_MUTEX_unlock(&pool_mag_mutex);
+		LogWarn(COMPONENT_INIT,
+			"No magazine slot left for pool %s",
+			pool->name ? pool->name : "(unnamed)");
+		return;
+	}
+
+	slot = &pool_mag_slots[pool_mag_nslots];
+	for (i = 0; i < POOL_MAG_MAX_NODES; i++)
+		PTHREAD_MUTEX_init(&slot->depot[i].lock, NULL);
+	atomic_store_uint32_t(&slot->live, 1);
+	pool->mag_slot = pool_mag_nslots++;
+
+	PTHREAD_MUTEX_unlock(&pool_mag_mutex);
+}
+
+/**
+ * @brief Release the magazine layer of a pool
+ *
+ * Objects still cached by other threads are freed when those threads
+ * exit.
+ *
+ * @param[in] pool  The pool being destroyed
+ */
+void pool_mag_fini(pool_t *pool)
+{
+	struct pool_mag_slot *slot = &pool_mag_slots[pool->mag_slot];
+	struct pool_mag_cpu *cpu = pool_mag_cpu(pool);
+	struct pool_magazine *mag;
+	uint32_t i;
+
+	atomic_store_uint32_t(&slot->live, 0);
+
+	if (cpu->loaded != NULL)
+		pool_mag_release(slot, cpu->loaded);
+	if (cpu->previous != NULL)
+		pool_mag_release(slot, cpu->previous);
+	cpu->loaded = cpu->previous = NULL;
+
+	for (i = 0; i < POOL_MAG_MAX_NODES; i++) {
+		while ((mag = pool_mag_depot_get(&slot->depot[i], true)))
+			pool_mag_release(slot, mag);
+		while ((mag = pool_mag_depot_get(&slot->depot[i], false)))
+			pool_mag_release(slot, mag);
+		PTHREAD_MUTEX_destroy(&slot->depot[i].lock);
+	}
+}
+
+/**
+ * @brief Allocate an object from a magazine pool
+ *
+ * @param[in] pool  The pool
+ *
+ * @return A zeroed object.
+ */
+void *pool_mag_alloc(pool_t *pool)
+{
+	struct pool_mag_cpu *cpu = pool_mag_cpu(pool);
+	struct pool_magazine *mag;
+	void *obj;
+
+	if (cpu->loaded == NULL || cpu->loaded->rounds == 0) {
+		if (cpu->previous != NULL && cpu->previous->rounds != 0) {
+			mag = cpu->loaded;
+			cpu->loaded = cpu->previous;
+			cpu->previous = mag;
+		} else {
+			struct pool_mag_slot *slot =
+			    &pool_mag_slots[pool->mag_slot];
+			struct pool_mag_depot *depot =
+			    &slot->depot[pool_mag_node()];
+
+			mag = pool_mag_depot_get(depot, true);
+			if (mag == NULL) {
+				/* Zeroing here touches the pages on this
+				 * thread's node.
+				 */
+				(void)atomic_inc_int64_t(&slot->objects);
+				return pool_heap_alloc(pool);
+			}
+			pool_mag_depot_put(slot, depot, cpu->previous);
+			cpu->previous = cpu->loaded;
+			cpu->loaded = mag;
+		}
+	}
+
+	obj = cpu->loaded->objs[--cpu->loaded->rounds];
+	memset(obj, 0, pool->object_size);
+
+	return obj;
+}
+
+/**
+ * @brief Objects a magazine pool holds from the heap
+ *
+ * Objects cached in magazines are counted, as they are memory the
+ * pool keeps.
+ *
+ * @param[in] pool  The pool
+ */
+int64_t pool_mag_objects(pool_t *pool)
+{
+	return atomic_fetch_int64_t(&pool_mag_slots[pool->mag_slot].objects);
+}
+
+/**
+ * @brief Return an object to a magazine pool
+ *
+ * @param[in] pool    The pool
+ * @param[in] object  The object
+ */
+void pool_mag_free(pool_t *pool, void *object)
+{
+	struct pool_mag_cpu *cpu = pool_mag_cpu(pool);
+	struct pool_magazine *mag;
+
+	if (cpu->loaded == NULL || cpu->loaded->rounds == POOL_MAG_ROUNDS) {
+		if (cpu->previous != NULL &&
+		    cpu->previous->rounds != POOL_MAG_ROUNDS) {
+			mag = cpu->loaded;
+			cpu->loaded = cpu->previous;
+			cpu->previous = mag;
+		} else {
+			struct pool_mag_slot *slot =
+			    &pool_mag_slots[pool->mag_slot];
+			struct pool_mag_depot *depot =
+			    &slot->depot[pool_mag_node()];
+
+			mag = pool_mag_depot_get(depot, false);
+			if (mag == NULL)
+				mag = gsh_calloc(1, sizeof(*mag));
+			pool_mag_depot_put(slot, depot, cpu->previous);
+			cpu->previous = cpu->loaded;
+			cpu->loaded = mag;
+		}
+	}
+
+	cpu->loaded->objs[cpu->loaded->rounds++] = object;
+}
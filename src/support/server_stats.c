@@ -45,6 +45,7 @@
 #include <stdint.h>
 #include <sys/param.h>
 #include <pthread.h>
+#include <sched.h>
 #include <assert.h>
 #include <arpa/inet.h>
 #include "fsal.h"
@@ -52,6 +53,7 @@
 #include "log.h"
 #include "avltree.h"
 #include "gsh_types.h"
+#include "gsh_lat_hist.h"
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
 #endif
@@ -60,6 +62,9 @@
 #include "server_stats.h"
 #include <abstract_atomic.h>
 #include "nfs_proto_functions.h"
+#include "nfs_metrics.h"
+#include "gsh_topk.h"
+#include "gsh_stats_shm.h"
 
 #define NFS_V3_NB_COMMAND (NFSPROC3_COMMIT + 1)
 #define NFS_V4_NB_COMMAND 2
@@ -75,8 +80,6 @@
 #define NFS_pcp nfs_param.core_param
 #define NFS_program NFS_pcp.program
 
-#ifdef USE_DBUS
-
 struct op_name {
 	char *name;
 };
@@ -226,8 +229,6 @@ static const struct op_name optabv4[] = {
 	[NFS4_OP_REMOVEXATTR] = {.name = "OP_REMOVEXATTR",},
 };
 
-#endif
-
 /* Classify protocol ops for stats purposes
  */
 
@@ -318,6 +319,7 @@ struct proto_op {
 	struct op_latency latency;	/* either executed ops latency */
 	struct op_latency dup_latency;	/* or latency (runtime) to replay */
 	struct op_latency queue_latency;	/* queue wait time */
+	struct lat_hist latency_hist;	/* executed ops latency */
 };
 
 /* basic I/O transfer counter
@@ -328,6 +330,68 @@ struct xfer_op {
 	uint64_t transferred;
 };
 
+/* READ and WRITE size, alignment and sequentiality
+ *
+ * size[i] counts the I/Os of at most 512 << i bytes, the last bucket
+ * those larger than 4MB.
+ */
+
+#define IO_SIZE_BUCKETS 15
+
+struct io_dist {
+	uint64_t size[IO_SIZE_BUCKETS];
+	uint64_t align_4k;	/* offset a multiple of 4KB */
+	uint64_t align_1m;	/* offset a multiple of 1MB */
+	uint64_t sequential;	/* continues the last I/O to the file */
+	uint64_t random;
+};
+
+struct io_dist_stats {
+	struct io_dist read;
+	struct io_dist write;
+};
+
+/* Thread CPU time spent on requests, with Enable_CPU_Stats
+ *
+ * Decoding runs on the decoder thread, executing and encoding the
+ * reply on a worker.  The time a request waits in between is the
+ * queue latency, so CPU time much lower than latency points at queues,
+ * locks or the backend rather than at the CPU.
+ */
+
+enum cpu_stage {
+	CPU_DECODE,
+	CPU_EXECUTE,
+	CPU_ENCODE,
+	CPU_STAGES
+};
+
+enum cpu_proto {
+	CPU_NFSV3,
+	CPU_NFSV4,
+	CPU_MNT,
+	CPU_NLM,
+	CPU_RQUOTA,
+	CPU_PROTOS
+};
+
+static const char * const cpu_stage_names[CPU_STAGES] = {
+	"decode", "execute", "encode"
+};
+
+static const char * const cpu_proto_names[CPU_PROTOS] = {
+	"nfsv3", "nfsv4", "mnt", "nlm", "rquota"
+};
+
+struct cpu_time {
+	uint64_t requests;
+	uint64_t ns[CPU_STAGES];
+};
+
+struct cpu_stats {
+	struct cpu_time proto[CPU_PROTOS];
+};
+
 /* pNFS Layout counters
  */
 
@@ -419,9 +483,14 @@ struct global_stats {
 	struct nfsv41_stats nfsv42; /* Uses v41 stats */
 	struct nfsv3_ops v3;
 	struct nfsv4_ops v4;
+	struct lat_hist v3_hist[NFSPROC3_COMMIT+1];
+	struct lat_hist v4_hist[NFS4_OP_LAST_ONE];
 	struct nlm_ops lm;
 	struct mnt_ops mn;
 	struct qta_ops qt;
+	struct cpu_stats cpu;
+	struct cpu_time v3_cpu[NFSPROC3_COMMIT+1];
+	uint64_t v4_cpu[NFS4_OP_LAST_ONE];	/* execute only */
 };
 
 struct deleg_stats {
@@ -431,9 +500,68 @@ struct deleg_stats {
 				       recall */
 	uint32_t failed_recalls;    /* times client failed to process recall */
 	uint32_t num_revokes;	    /* Num revokes for the client */
+	uint32_t heat_declines;     /* delegations not granted because the
+				       file is recalled too often */
+	uint32_t budget_declines;   /* delegations not granted because the
+				       client holds too many */
+	uint32_t recall_replies;    /* recalls the client answered */
+	uint64_t recall_latency;    /* total nsecs from starting a recall
+				       to the client's answer */
+	uint64_t recall_latency_max; /* slowest answer seen, nsecs */
 };
 
-static struct global_stats global_st;
+/* Counter slabs
+ *
+ * Each stats block, the global one and those of every export and
+ * client, is an array of stats_nshards identical slabs.  Requests are
+ * counted in the slab of the CPU the worker runs on so that the cores
+ * do not bounce the counters' cache lines between them.  Readers add
+ * the slabs up.
+ */
+#define STATS_MAX_SHARDS 64
+#define STATS_AUTO_SHARDS 16
+
+static uint32_t stats_nshards = 1;
+static struct global_stats global_st_boot;
+static struct global_stats *global_st = &global_st_boot;
+
+static inline uint32_t stats_shard(void)
+{
+	int cpu;
+
+	if (stats_nshards == 1)
+		return 0;
+
+	cpu = sched_getcpu();
+	return (cpu < 0 ? 0 : cpu) % stats_nshards;
+}
+
+/**
+ * @brief Size the counter slabs
+ *
+ * Must be called before the first request is counted.
+ */
+
+void server_stats_init(void)
+{
+	long ncpu;
+
+	stats_nshards = nfs_param.core_param.stats_shards;
+	if (stats_nshards == 0) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		stats_nshards = ncpu < 1 ? 1 : MIN(ncpu, STATS_AUTO_SHARDS);
+	}
+	stats_nshards = MIN(stats_nshards, STATS_MAX_SHARDS);
+
+	if (stats_nshards > 1)
+		global_st = gsh_calloc(stats_nshards,
+				       sizeof(struct global_stats));
+
+	LogInfo(COMPONENT_INIT, "Statistics counted in %" PRIu32 " slabs",
+		stats_nshards);
+
+	topk_init();
+}
 
 /* include the top level server_stats struct definition
  */
@@ -448,7 +576,7 @@ static struct global_stats global_st;
  * @param stats [IN] the stats structure to dereference in
  * @param lock  [IN] the lock in the stats owning struct
  *
- * @return pointer to proto struct
+ * @return pointer to the calling CPU's slab of the proto struct
  *
  * @TODO make them inlines for release
  */
@@ -459,11 +587,37 @@ static struct nfsv3_stats *get_v3(struct gsh_stats *stats,
 	if (unlikely(stats->nfsv3 == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->nfsv3 == NULL)
-			stats->nfsv3 =
-			    gsh_calloc(1, sizeof(struct nfsv3_stats));
+			stats->nfsv3 = gsh_calloc(stats_nshards,
+						sizeof(struct nfsv3_stats));
+		PTHREAD_RWLOCK_unlock(lock);
+	}
+	return stats->nfsv3 + stats_shard();
+}
+
+static struct io_dist_stats *get_io_dist(struct gsh_stats *stats,
+					 pthread_rwlock_t *lock)
+{
+	if (unlikely(stats->io_dist == NULL)) {
+		PTHREAD_RWLOCK_wrlock(lock);
+		if (stats->io_dist == NULL)
+			stats->io_dist = gsh_calloc(stats_nshards,
+						sizeof(struct io_dist_stats));
+		PTHREAD_RWLOCK_unlock(lock);
+	}
+	return stats->io_dist + stats_shard();
+}
+
+static struct cpu_stats *get_cpu(struct gsh_stats *stats,
+				 pthread_rwlock_t *lock)
+{
+	if (unlikely(stats->cpu == NULL)) {
+		PTHREAD_RWLOCK_wrlock(lock);
+		if (stats->cpu == NULL)
+			stats->cpu = gsh_calloc(stats_nshards,
+						sizeof(struct cpu_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->nfsv3;
+	return stats->cpu + stats_shard();
 }
 
 static struct mnt_stats *get_mnt(struct gsh_stats *stats,
@@ -472,10 +626,11 @@ static struct mnt_stats *get_mnt(struct gsh_stats *stats,
 	if (unlikely(stats->mnt == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->mnt == NULL)
-			stats->mnt = gsh_calloc(1, sizeof(struct mnt_stats));
+			stats->mnt = gsh_calloc(stats_nshards,
+						sizeof(struct mnt_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->mnt;
+	return stats->mnt + stats_shard();
 }
 
 static struct nlmv4_stats *get_nlm4(struct gsh_stats *stats,
@@ -484,10 +639,11 @@ static struct nlmv4_stats *get_nlm4(struct gsh_stats *stats,
 	if (unlikely(stats->nlm4 == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->nlm4 == NULL)
-			stats->nlm4 = gsh_calloc(1, sizeof(struct nlmv4_stats));
+			stats->nlm4 = gsh_calloc(stats_nshards,
+						sizeof(struct nlmv4_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->nlm4;
+	return stats->nlm4 + stats_shard();
 }
 
 static struct rquota_stats *get_rquota(struct gsh_stats *stats,
@@ -496,11 +652,11 @@ static struct rquota_stats *get_rquota(struct gsh_stats *stats,
 	if (unlikely(stats->rquota == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->rquota == NULL)
-			stats->rquota =
-			    gsh_calloc(1, sizeof(struct rquota_stats));
+			stats->rquota = gsh_calloc(stats_nshards,
+						sizeof(struct rquota_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->rquota;
+	return stats->rquota + stats_shard();
 }
 
 static struct nfsv40_stats *get_v40(struct gsh_stats *stats,
@@ -509,11 +665,11 @@ static struct nfsv40_stats *get_v40(struct gsh_stats *stats,
 	if (unlikely(stats->nfsv40 == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->nfsv40 == NULL)
-			stats->nfsv40 =
-			    gsh_calloc(1, sizeof(struct nfsv40_stats));
+			stats->nfsv40 = gsh_calloc(stats_nshards,
+						sizeof(struct nfsv40_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->nfsv40;
+	return stats->nfsv40 + stats_shard();
 }
 
 static struct nfsv41_stats *get_v41(struct gsh_stats *stats,
@@ -522,11 +678,11 @@ static struct nfsv41_stats *get_v41(struct gsh_stats *stats,
 	if (unlikely(stats->nfsv41 == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->nfsv41 == NULL)
-			stats->nfsv41 =
-			    gsh_calloc(1, sizeof(struct nfsv41_stats));
+			stats->nfsv41 = gsh_calloc(stats_nshards,
+						sizeof(struct nfsv41_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->nfsv41;
+	return stats->nfsv41 + stats_shard();
 }
 
 static struct nfsv41_stats *get_v42(struct gsh_stats *stats,
@@ -535,11 +691,11 @@ static struct nfsv41_stats *get_v42(struct gsh_stats *stats,
 	if (unlikely(stats->nfsv42 == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->nfsv42 == NULL)
-			stats->nfsv42 =
-			    gsh_calloc(1, sizeof(struct nfsv41_stats));
+			stats->nfsv42 = gsh_calloc(stats_nshards,
+						sizeof(struct nfsv41_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->nfsv42;
+	return stats->nfsv42 + stats_shard();
 }
 
 #ifdef _USE_9P
@@ -548,10 +704,11 @@ static struct _9p_stats *get_9p(struct gsh_stats *stats, pthread_rwlock_t *lock)
 	if (unlikely(stats->_9p == NULL)) {
 		PTHREAD_RWLOCK_wrlock(lock);
 		if (stats->_9p == NULL)
-			stats->_9p = gsh_calloc(1, sizeof(struct _9p_stats));
+			stats->_9p = gsh_calloc(stats_nshards,
+						sizeof(struct _9p_stats));
 		PTHREAD_RWLOCK_unlock(lock);
 	}
-	return stats->_9p;
+	return stats->_9p + stats_shard();
 }
 #endif
 
@@ -572,6 +729,7 @@ void record_latency(struct proto_op *op, nsecs_elapsed_t request_time,
 
 	/* dup latency is counted separately */
 	if (likely(!dup)) {
+		lat_hist_record(&op->latency_hist, request_time);
 		(void)atomic_add_uint64_t(&op->latency.latency, request_time);
 		if (op->latency.min == 0L || op->latency.min > request_time)
 			(void)atomic_store_uint64_t(&op->latency.min,
@@ -624,6 +782,80 @@ static void record_io(struct xfer_op *iop, size_t requested, size_t transferred,
 	/* somehow we must record latency */
 }
 
+/* Where the last I/O of each client to each file ended
+ *
+ * Direct mapped by client and file.  A collision or a race between
+ * workers only misclassifies the odd I/O.
+ */
+
+#define IO_SEQ_BITS 12
+
+struct io_seq_slot {
+	uint64_t key;
+	uint64_t next;
+};
+
+static struct io_seq_slot io_seq_cache[1 << IO_SEQ_BITS];
+
+/**
+ * @brief One READ or WRITE, classified once for all its stats blocks
+ */
+
+struct io_sample {
+	int bucket;
+	bool align_4k;
+	bool align_1m;
+	bool sequential;
+};
+
+static void io_classify(struct io_sample *sample,
+			struct fsal_obj_handle *obj, uint64_t offset,
+			size_t requested, size_t transferred)
+{
+	struct io_seq_slot *slot;
+	uint64_t key;
+
+	sample->bucket = 0;
+	while (sample->bucket < IO_SIZE_BUCKETS - 1 &&
+	       requested > ((size_t) 512 << sample->bucket))
+		sample->bucket++;
+
+	sample->align_4k = (offset & (4096 - 1)) == 0;
+	sample->align_1m = (offset & (1024 * 1024 - 1)) == 0;
+
+	sample->sequential = offset == 0;
+	if (obj == NULL)
+		return;
+
+	key = (obj->fileid ^ (uintptr_t) op_ctx->client) *
+	      0x9e3779b97f4a7c15ULL;
+	slot = &io_seq_cache[key >> (64 - IO_SEQ_BITS)];
+
+	if (atomic_fetch_uint64_t(&slot->key) == key &&
+	    atomic_fetch_uint64_t(&slot->next) == offset)
+		sample->sequential = true;
+
+	atomic_store_uint64_t(&slot->key, key);
+	atomic_store_uint64_t(&slot->next, offset + transferred);
+}
+
+static void record_io_dist(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
+			   struct io_sample *sample, bool is_write)
+{
+	struct io_dist_stats *ds = get_io_dist(gsh_st, lock);
+	struct io_dist *d = is_write ? &ds->write : &ds->read;
+
+	(void)atomic_inc_uint64_t(&d->size[sample->bucket]);
+	if (sample->align_4k)
+		(void)atomic_inc_uint64_t(&d->align_4k);
+	if (sample->align_1m)
+		(void)atomic_inc_uint64_t(&d->align_1m);
+	if (sample->sequential)
+		(void)atomic_inc_uint64_t(&d->sequential);
+	else
+		(void)atomic_inc_uint64_t(&d->random);
+}
+
 /**
  * @brief record i/o stats by protocol
  */
@@ -697,6 +929,19 @@ static void record_op(struct proto_op *op, nsecs_elapsed_t request_time,
 }
 
 #ifdef USE_DBUS
+/**
+ *  @brief reset a latency histogram
+ *  @param h            [IN] the histogram
+ */
+
+static void reset_lat_hist(struct lat_hist *h)
+{
+	int i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++)
+		(void)atomic_store_uint64_t(&h->bucket[i], 0);
+}
+
 /**
  *  @brief reset the counts for protocol operation
  *  Use atomic ops to avoid locks.
@@ -718,6 +963,7 @@ static void reset_op(struct proto_op *op)
 	(void)atomic_store_uint64_t(&op->queue_latency.latency, 0);
 	(void)atomic_store_uint64_t(&op->queue_latency.min, 0);
 	(void)atomic_store_uint64_t(&op->queue_latency.max, 0);
+	reset_lat_hist(&op->latency_hist);
 }
 
 /**
@@ -848,6 +1094,40 @@ static void reset_deleg_stats(struct deleg_stats *deleg)
 	(void)atomic_store_uint32_t(&deleg->tot_recalls, 0);
 	(void)atomic_store_uint32_t(&deleg->failed_recalls, 0);
 	(void)atomic_store_uint32_t(&deleg->num_revokes, 0);
+	(void)atomic_store_uint32_t(&deleg->heat_declines, 0);
+	(void)atomic_store_uint32_t(&deleg->budget_declines, 0);
+	(void)atomic_store_uint32_t(&deleg->recall_replies, 0);
+	(void)atomic_store_uint64_t(&deleg->recall_latency, 0);
+	(void)atomic_store_uint64_t(&deleg->recall_latency_max, 0);
+}
+
+static void reset_cpu_time(struct cpu_time *t)
+{
+	int i;
+
+	(void)atomic_store_uint64_t(&t->requests, 0);
+	for (i = 0; i < CPU_STAGES; i++)
+		(void)atomic_store_uint64_t(&t->ns[i], 0);
+}
+
+static void reset_cpu_stats(struct cpu_stats *cs)
+{
+	int i;
+
+	for (i = 0; i < CPU_PROTOS; i++)
+		reset_cpu_time(&cs->proto[i]);
+}
+
+static void reset_io_dist(struct io_dist *d)
+{
+	int i;
+
+	for (i = 0; i < IO_SIZE_BUCKETS; i++)
+		(void)atomic_store_uint64_t(&d->size[i], 0);
+	(void)atomic_store_uint64_t(&d->align_4k, 0);
+	(void)atomic_store_uint64_t(&d->align_1m, 0);
+	(void)atomic_store_uint64_t(&d->sequential, 0);
+	(void)atomic_store_uint64_t(&d->random, 0);
 }
 
 #ifdef _USE_9P
@@ -872,6 +1152,197 @@ static void reset__9P_stats(struct _9p_stats *_9p)
 #endif
 #endif		/* USE_DBUS */
 
+/* Functions for adding up the slabs of a stats block
+ *
+ * The counters are read without atomics, the same as when reporting
+ * them, the totals may miss updates in flight.
+ */
+
+static void add_latency(struct op_latency *sum, struct op_latency *lat)
+{
+	sum->latency += lat->latency;
+	if (lat->min != 0 && (sum->min == 0 || sum->min > lat->min))
+		sum->min = lat->min;
+	if (sum->max < lat->max)
+		sum->max = lat->max;
+}
+
+static void add_lat_hist(struct lat_hist *sum, struct lat_hist *h)
+{
+	int i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++)
+		sum->bucket[i] += h->bucket[i];
+}
+
+static void add_op(struct proto_op *sum, struct proto_op *op)
+{
+	sum->total += op->total;
+	sum->errors += op->errors;
+	sum->dups += op->dups;
+	add_latency(&sum->latency, &op->latency);
+	add_latency(&sum->dup_latency, &op->dup_latency);
+	add_latency(&sum->queue_latency, &op->queue_latency);
+	add_lat_hist(&sum->latency_hist, &op->latency_hist);
+}
+
+static void add_xfer_op(struct xfer_op *sum, struct xfer_op *xfer)
+{
+	add_op(&sum->cmd, &xfer->cmd);
+	sum->requested += xfer->requested;
+	sum->transferred += xfer->transferred;
+}
+
+static void add_layout_op(struct layout_op *sum, struct layout_op *lo)
+{
+	sum->total += lo->total;
+	sum->errors += lo->errors;
+	sum->delays += lo->delays;
+}
+
+static void add_nfsv3_stats(struct nfsv3_stats *sum, struct nfsv3_stats *nfsv3)
+{
+	add_op(&sum->cmds, &nfsv3->cmds);
+	add_xfer_op(&sum->read, &nfsv3->read);
+	add_xfer_op(&sum->write, &nfsv3->write);
+}
+
+static void add_nfsv40_stats(struct nfsv40_stats *sum,
+			     struct nfsv40_stats *nfsv40)
+{
+	add_op(&sum->compounds, &nfsv40->compounds);
+	sum->ops_per_compound += nfsv40->ops_per_compound;
+	add_xfer_op(&sum->read, &nfsv40->read);
+	add_xfer_op(&sum->write, &nfsv40->write);
+}
+
+static void add_nfsv41_stats(struct nfsv41_stats *sum,
+			     struct nfsv41_stats *nfsv41)
+{
+	add_op(&sum->compounds, &nfsv41->compounds);
+	sum->ops_per_compound += nfsv41->ops_per_compound;
+	add_xfer_op(&sum->read, &nfsv41->read);
+	add_xfer_op(&sum->write, &nfsv41->write);
+	add_layout_op(&sum->getdevinfo, &nfsv41->getdevinfo);
+	add_layout_op(&sum->layout_get, &nfsv41->layout_get);
+	add_layout_op(&sum->layout_commit, &nfsv41->layout_commit);
+	add_layout_op(&sum->layout_return, &nfsv41->layout_return);
+	add_layout_op(&sum->recall, &nfsv41->recall);
+}
+
+static void add_mnt_stats(struct mnt_stats *sum, struct mnt_stats *mnt)
+{
+	add_op(&sum->v1_ops, &mnt->v1_ops);
+	add_op(&sum->v3_ops, &mnt->v3_ops);
+}
+
+static void add_nlmv4_stats(struct nlmv4_stats *sum,
+			    struct nlmv4_stats *nlmv4)
+{
+	add_op(&sum->ops, &nlmv4->ops);
+}
+
+static void add_rquota_stats(struct rquota_stats *sum,
+			     struct rquota_stats *rquota)
+{
+	add_op(&sum->ops, &rquota->ops);
+	add_op(&sum->ext_ops, &rquota->ext_ops);
+}
+
+static void add_cpu_time(struct cpu_time *sum, struct cpu_time *t)
+{
+	int i;
+
+	sum->requests += t->requests;
+	for (i = 0; i < CPU_STAGES; i++)
+		sum->ns[i] += t->ns[i];
+}
+
+static void add_cpu_stats(struct cpu_stats *sum, struct cpu_stats *cs)
+{
+	int i;
+
+	for (i = 0; i < CPU_PROTOS; i++)
+		add_cpu_time(&sum->proto[i], &cs->proto[i]);
+}
+
+#ifdef _USE_9P
+/* The per opcode counters are left out, see server_dbus_9p_opstats */
+static void add__9P_stats(struct _9p_stats *sum, struct _9p_stats *_9p)
+{
+	add_op(&sum->cmds, &_9p->cmds);
+	add_xfer_op(&sum->read, &_9p->read);
+	add_xfer_op(&sum->write, &_9p->write);
+	sum->trans.rx_bytes += _9p->trans.rx_bytes;
+	sum->trans.rx_pkt += _9p->trans.rx_pkt;
+	sum->trans.rx_err += _9p->trans.rx_err;
+	sum->trans.tx_bytes += _9p->trans.tx_bytes;
+	sum->trans.tx_pkt += _9p->trans.tx_pkt;
+	sum->trans.tx_err += _9p->trans.tx_err;
+}
+#endif
+
+/**
+ * @brief Add up the slabs of a protocol's stats
+ *
+ * @param add   [IN] the add_ function for the protocol
+ * @param sum   [OUT] the totals
+ * @param slabs [IN] the stats_nshards slabs
+ */
+
+#define SUM_SLABS(add, sum, slabs)				\
+	do {							\
+		uint32_t _i;					\
+								\
+		memset((sum), 0, sizeof(*(sum)));		\
+		for (_i = 0; _i < stats_nshards; _i++)		\
+			add((sum), &(slabs)[_i]);		\
+	} while (0)
+
+/**
+ * @brief Add up the slabs of the global stats
+ *
+ * @return the totals, to be freed by the caller
+ */
+
+static struct global_stats *sum_global_stats(void)
+{
+	struct global_stats *sum = gsh_calloc(1, sizeof(*sum));
+	struct global_stats *gs;
+	uint32_t i;
+	int j;
+
+	for (i = 0; i < stats_nshards; i++) {
+		gs = &global_st[i];
+		add_nfsv3_stats(&sum->nfsv3, &gs->nfsv3);
+		add_mnt_stats(&sum->mnt, &gs->mnt);
+		add_nlmv4_stats(&sum->nlm4, &gs->nlm4);
+		add_rquota_stats(&sum->rquota, &gs->rquota);
+		add_nfsv40_stats(&sum->nfsv40, &gs->nfsv40);
+		add_nfsv41_stats(&sum->nfsv41, &gs->nfsv41);
+		add_nfsv41_stats(&sum->nfsv42, &gs->nfsv42);
+		add_cpu_stats(&sum->cpu, &gs->cpu);
+		for (j = 0; j <= NFSPROC3_COMMIT; j++) {
+			sum->v3.op[j] += gs->v3.op[j];
+			add_lat_hist(&sum->v3_hist[j], &gs->v3_hist[j]);
+			add_cpu_time(&sum->v3_cpu[j], &gs->v3_cpu[j]);
+		}
+		for (j = 0; j < NFS4_OP_LAST_ONE; j++) {
+			sum->v4.op[j] += gs->v4.op[j];
+			add_lat_hist(&sum->v4_hist[j], &gs->v4_hist[j]);
+			sum->v4_cpu[j] += gs->v4_cpu[j];
+		}
+		for (j = 0; j <= NLMPROC4_FREE_ALL; j++)
+			sum->lm.op[j] += gs->lm.op[j];
+		for (j = 0; j <= MOUNTPROC3_EXPORT; j++)
+			sum->mn.op[j] += gs->mn.op[j];
+		for (j = 0; j <= RQUOTAPROC_SETACTIVEQUOTA; j++)
+			sum->qt.op[j] += gs->qt.op[j];
+	}
+
+	return sum;
+}
+
 /**
  * @brief record V4.1 layout op stats
  *
@@ -1031,6 +1502,7 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 	struct svc_req *req = &reqdata->r_u.req.svc;
 	uint32_t proto_op = req->rq_msg.cb_proc;
 	uint32_t program_op = req->rq_msg.cb_prog;
+	struct global_stats *gs = global_st + stats_shard();
 
 	if (program_op == NFS_program[P_NFS]) {
 		if (proto_op == 0)
@@ -1040,7 +1512,7 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 
 			/* record stuff */
 			if (global)
-				record_op(&global_st.nfsv3.cmds, request_time,
+				record_op(&gs->nfsv3.cmds, request_time,
 					  qwait_time, success, dup);
 			switch (nfsv3_optype[proto_op]) {
 			case READ_OP:
@@ -1063,10 +1535,10 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		struct mnt_stats *sp = get_mnt(gsh_st, lock);
 
 		if (global && req->rq_msg.cb_vers == MOUNT_V1)
-			record_op(&global_st.mnt.v1_ops, request_time,
+			record_op(&gs->mnt.v1_ops, request_time,
 				  qwait_time, success, dup);
 		else if (global)
-			record_op(&global_st.mnt.v3_ops, request_time,
+			record_op(&gs->mnt.v3_ops, request_time,
 				  qwait_time, success, dup);
 
 		/* record stuff */
@@ -1080,7 +1552,7 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		struct nlmv4_stats *sp = get_nlm4(gsh_st, lock);
 
 		if (global)
-			record_op(&global_st.nlm4.ops, request_time,
+			record_op(&gs->nlm4.ops, request_time,
 				  qwait_time, success, dup);
 		/* record stuff */
 		record_op(&sp->ops, request_time, qwait_time, success, dup);
@@ -1088,7 +1560,7 @@ static void record_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 		struct rquota_stats *sp = get_rquota(gsh_st, lock);
 
 		if (global)
-			record_op(&global_st.rquota.ops, request_time,
+			record_op(&gs->rquota.ops, request_time,
 				  qwait_time, success, dup);
 		/* record stuff */
 		if (req->rq_msg.cb_vers == RQUOTAVERS)
@@ -1156,6 +1628,7 @@ void server_stats_9p_done(u8 opc, struct _9p_request_data *req9p)
 	struct _9p_stats *sp;
 
 	client = req9p->pconn->client;
+	topk_client_op(client);
 	if (client) {
 		struct server_stats *server_st;
 
@@ -1195,21 +1668,28 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
 	struct svc_req *req = &reqdata->r_u.req.svc;
 	uint32_t proto_op = req->rq_msg.cb_proc;
 	uint32_t program_op = req->rq_msg.cb_prog;
+	struct global_stats *gs = global_st + stats_shard();
+
+	if (!dup)
+		topk_client_op(client);
 
 	if (program_op == NFS_PROGRAM && op_ctx->nfs_vers == NFS_V3)
-		global_st.v3.op[proto_op]++;
+		gs->v3.op[proto_op]++;
 	else if (program_op == NFS_program[P_NLM])
-		global_st.lm.op[proto_op]++;
+		gs->lm.op[proto_op]++;
 	else if (program_op == NFS_program[P_MNT])
-		global_st.mn.op[proto_op]++;
+		gs->mn.op[proto_op]++;
 	else if (program_op == NFS_program[P_RQUOTA])
-		global_st.qt.op[proto_op]++;
+		gs->qt.op[proto_op]++;
 
 	if (nfs_param.core_param.enable_FASTSTATS)
 		return;
 
 	now(&current_time);
 	stop_time = timespec_diff(&ServerBootTime, &current_time);
+	if (program_op == NFS_PROGRAM && op_ctx->nfs_vers == NFS_V3 && !dup)
+		lat_hist_record(&gs->v3_hist[proto_op],
+				stop_time - op_ctx->start_time);
 	if (client != NULL) {
 		struct server_stats *server_st;
 
@@ -1234,6 +1714,97 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
 	}
 }
 
+/**
+ * @brief Thread CPU time of the calling thread
+ *
+ * @return nsecs, or 0 without Enable_CPU_Stats.
+ */
+uint64_t server_stats_cpu_now(void)
+{
+	struct timespec ts;
+
+	if (!nfs_param.core_param.enable_CPUSTATS)
+		return 0;
+
+	(void)clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return timespec_to_nsecs(&ts);
+}
+
+static void record_cpu(struct cpu_time *t, const uint64_t *ns)
+{
+	int i;
+
+	(void)atomic_inc_uint64_t(&t->requests);
+	for (i = 0; i < CPU_STAGES; i++)
+		(void)atomic_add_uint64_t(&t->ns[i], ns[i]);
+}
+
+/**
+ * @brief record the CPU time of a request whose reply was sent
+ *
+ * Server wide by protocol and NFSv3 procedure, and by export.
+ *
+ * @param reqdata   [IN] the request, with its decode and execute time
+ * @param encode_ns [IN] CPU time encoding and sending the reply
+ */
+void server_stats_cpu_done(request_data_t *reqdata, uint64_t encode_ns)
+{
+	nfs_request_t *reqnfs = &reqdata->r_u.req;
+	uint32_t program_op = reqnfs->svc.rq_msg.cb_prog;
+	uint32_t proto_op = reqnfs->svc.rq_msg.cb_proc;
+	struct global_stats *gs = global_st + stats_shard();
+	uint64_t ns[CPU_STAGES];
+	enum cpu_proto proto;
+
+	if (program_op == NFS_PROGRAM && op_ctx->nfs_vers == NFS_V3)
+		proto = CPU_NFSV3;
+	else if (program_op == NFS_PROGRAM && op_ctx->nfs_vers == NFS_V4)
+		proto = CPU_NFSV4;
+	else if (program_op == NFS_program[P_MNT])
+		proto = CPU_MNT;
+	else if (program_op == NFS_program[P_NLM])
+		proto = CPU_NLM;
+	else if (program_op == NFS_program[P_RQUOTA])
+		proto = CPU_RQUOTA;
+	else
+		return;
+
+	ns[CPU_DECODE] = reqnfs->cpu_decode;
+	ns[CPU_EXECUTE] = reqnfs->cpu_execute;
+	ns[CPU_ENCODE] = encode_ns;
+
+	record_cpu(&gs->cpu.proto[proto], ns);
+	if (proto == CPU_NFSV3 && proto_op <= NFSPROC3_COMMIT)
+		record_cpu(&gs->v3_cpu[proto_op], ns);
+
+	if (op_ctx->ctx_export != NULL) {
+		struct export_stats *exp_st;
+		struct cpu_stats *cs;
+
+		exp_st = container_of(op_ctx->ctx_export, struct export_stats,
+				      export);
+		cs = get_cpu(&exp_st->st, &op_ctx->ctx_export->lock);
+		record_cpu(&cs->proto[proto], ns);
+	}
+}
+
+/**
+ * @brief record the CPU time of an NFSv4 operation
+ *
+ * @param proto_op  [IN] the operation
+ * @param cpu_start [IN] server_stats_cpu_now() when it started
+ */
+void server_stats_nfsv4_op_cpu(int proto_op, uint64_t cpu_start)
+{
+	struct global_stats *gs = global_st + stats_shard();
+
+	if (cpu_start == 0)
+		return;
+
+	(void)atomic_add_uint64_t(&gs->v4_cpu[proto_op],
+				  server_stats_cpu_now() - cpu_start);
+}
+
 /**
  * @brief record NFS V4 compound finished
  *
@@ -1244,11 +1815,12 @@ void server_stats_nfsv4_op_done(int proto_op,
 				nsecs_elapsed_t start_time, int status)
 {
 	struct gsh_client *client = op_ctx->client;
+	struct global_stats *gs = global_st + stats_shard();
 	struct timespec current_time;
 	nsecs_elapsed_t stop_time;
 
 	if (op_ctx->nfs_vers == NFS_V4)
-		global_st.v4.op[proto_op]++;
+		gs->v4.op[proto_op]++;
 
 	if (nfs_param.core_param.enable_FASTSTATS)
 		return;
@@ -1256,6 +1828,10 @@ void server_stats_nfsv4_op_done(int proto_op,
 	now(&current_time);
 	stop_time = timespec_diff(&ServerBootTime, &current_time);
 
+	if (op_ctx->nfs_vers == NFS_V4)
+		lat_hist_record(&gs->v4_hist[proto_op],
+				stop_time - start_time);
+
 	if (client != NULL) {
 		struct server_stats *server_st;
 
@@ -1267,13 +1843,13 @@ void server_stats_nfsv4_op_done(int proto_op,
 	}
 
 	if (op_ctx->nfs_minorvers == 0)
-		record_op(&global_st.nfsv40.compounds, stop_time - start_time,
+		record_op(&gs->nfsv40.compounds, stop_time - start_time,
 			  op_ctx->queue_wait, status == NFS4_OK, false);
 	else if (op_ctx->nfs_minorvers == 1)
-		record_op(&global_st.nfsv41.compounds, stop_time - start_time,
+		record_op(&gs->nfsv41.compounds, stop_time - start_time,
 			  op_ctx->queue_wait, status == NFS4_OK, false);
 	else if (op_ctx->nfs_minorvers == 2)
-		record_op(&global_st.nfsv42.compounds, stop_time - start_time,
+		record_op(&gs->nfsv42.compounds, stop_time - start_time,
 			  op_ctx->queue_wait, status == NFS4_OK, false);
 
 	if (op_ctx->ctx_export != NULL) {
@@ -1335,11 +1911,23 @@ void server_stats_compound_done(int num_ops, int status)
  *
  * Called from protocol operation/command handlers to record
  * transfers
+ *
+ * @param[in] obj     The file read or written, may be NULL
+ * @param[in] offset  Where the I/O starts
  */
 
-void server_stats_io_done(size_t requested,
-			  size_t transferred, bool success, bool is_write)
+void server_stats_io_done(struct fsal_obj_handle *obj, uint64_t offset,
+			  size_t requested, size_t transferred, bool success,
+			  bool is_write)
 {
+	struct io_sample sample = { 0 };
+
+	topk_file_io(obj, transferred);
+	topk_client_io(op_ctx->client, transferred);
+
+	if (success)
+		io_classify(&sample, obj, offset, requested, transferred);
+
 	if (op_ctx->client != NULL) {
 		struct server_stats *server_st;
 
@@ -1348,6 +1936,9 @@ void server_stats_io_done(size_t requested,
 		record_io_stats(&server_st->st, &op_ctx->client->lock,
 				requested, transferred, success,
 				is_write);
+		if (success)
+			record_io_dist(&server_st->st, &op_ctx->client->lock,
+				       &sample, is_write);
 	}
 	if (op_ctx->ctx_export != NULL) {
 		struct export_stats *exp_st;
@@ -1357,6 +1948,9 @@ void server_stats_io_done(size_t requested,
 			    export);
 		record_io_stats(&exp_st->st, &op_ctx->ctx_export->lock,
 				requested, transferred, success, is_write);
+		if (success)
+			record_io_dist(&exp_st->st, &op_ctx->ctx_export->lock,
+				       &sample, is_write);
 	}
 }
 
@@ -1392,7 +1986,7 @@ void dec_grants(struct gsh_client *client)
 
 		server_st = container_of(client, struct server_stats, client);
 		check_deleg_struct(&server_st->st, &client->lock);
-		server_st->st.deleg->curr_deleg_grants++;
+		server_st->st.deleg->curr_deleg_grants--;
 	}
 }
 void inc_revokes(struct gsh_client *client)
@@ -1425,6 +2019,42 @@ void inc_failed_recalls(struct gsh_client *client)
 		server_st->st.deleg->failed_recalls++;
 	}
 }
+void inc_heat_declines(struct gsh_client *client)
+{
+	if (client != NULL) {
+		struct server_stats *server_st;
+
+		server_st = container_of(client, struct server_stats, client);
+		check_deleg_struct(&server_st->st, &client->lock);
+		atomic_inc_uint32_t(&server_st->st.deleg->heat_declines);
+	}
+}
+void inc_budget_declines(struct gsh_client *client)
+{
+	if (client != NULL) {
+		struct server_stats *server_st;
+
+		server_st = container_of(client, struct server_stats, client);
+		check_deleg_struct(&server_st->st, &client->lock);
+		atomic_inc_uint32_t(&server_st->st.deleg->budget_declines);
+	}
+}
+void record_recall_latency(struct gsh_client *client, nsecs_elapsed_t latency)
+{
+	if (client != NULL) {
+		struct server_stats *server_st;
+		struct deleg_stats *deleg;
+
+		server_st = container_of(client, struct server_stats, client);
+		check_deleg_struct(&server_st->st, &client->lock);
+		deleg = server_st->st.deleg;
+		atomic_inc_uint32_t(&deleg->recall_replies);
+		(void)atomic_add_uint64_t(&deleg->recall_latency, latency);
+		if (deleg->recall_latency_max < latency)
+			(void)atomic_store_uint64_t(&deleg->recall_latency_max,
+						    latency);
+	}
+}
 
 #ifdef USE_DBUS
 
@@ -1574,8 +2204,10 @@ static void server_dbus_transportstats(struct transport_stats *tstats,
 void server_dbus_total(struct export_stats *export_st, DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
-	uint64_t total = 0;
+	struct gsh_stats *st = &export_st->st;
+	uint64_t total;
 	char *version;
+	uint32_t i;
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
 					 &struct_iter);
@@ -1583,45 +2215,42 @@ void server_dbus_total(struct export_stats *export_st, DBusMessageIter *iter)
 	version = "NFSv3";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
-	if (export_st->st.nfsv3 == NULL)
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&total);
-	else
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv3->cmds.total);
+	total = 0;
+	for (i = 0; st->nfsv3 != NULL && i < stats_nshards; i++)
+		total += st->nfsv3[i].cmds.total;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &total);
 	version = "NFSv40";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
-	if (export_st->st.nfsv40 == NULL)
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&total);
-	else
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv40->compounds.total);
+	total = 0;
+	for (i = 0; st->nfsv40 != NULL && i < stats_nshards; i++)
+		total += st->nfsv40[i].compounds.total;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &total);
 	version = "NFSv41";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
-	if (export_st->st.nfsv41 == NULL)
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&total);
-	else
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv41->compounds.total);
+	total = 0;
+	for (i = 0; st->nfsv41 != NULL && i < stats_nshards; i++)
+		total += st->nfsv41[i].compounds.total;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &total);
 	version = "NFSv42";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
-	if (export_st->st.nfsv42 == NULL)
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&total);
-	else
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv42->compounds.total);
+	total = 0;
+	for (i = 0; st->nfsv42 != NULL && i < stats_nshards; i++)
+		total += st->nfsv42[i].compounds.total;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &total);
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
 void global_dbus_total(DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
+	struct global_stats *gs = sum_global_stats();
 	char *version;
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
@@ -1631,48 +2260,305 @@ void global_dbus_total(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv3.cmds.total);
+					&gs->nfsv3.cmds.total);
 	version = "NFSv40";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv40.compounds.total);
+					&gs->nfsv40.compounds.total);
 	version = "NFSv41";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv41.compounds.total);
+					&gs->nfsv41.compounds.total);
 	version = "NFSv42";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv42.compounds.total);
+					&gs->nfsv42.compounds.total);
 	version = "NLM4";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nlm4.ops.total);
+					&gs->nlm4.ops.total);
 	version = "MNTv1";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.mnt.v1_ops.total);
+					&gs->mnt.v1_ops.total);
 	version = "MNTv3";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.mnt.v3_ops.total);
+					&gs->mnt.v3_ops.total);
 	version = "RQUOTA";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.rquota.ops.total);
+					&gs->rquota.ops.total);
 	dbus_message_iter_close_container(iter, &struct_iter);
+	gsh_free(gs);
+}
+
+/**
+ * @brief Report a latency histogram
+ *
+ * struct {
+ *         string name;
+ *         array of struct {
+ *                 uint64_t upper_bound;	(ns, exclusive)
+ *                 uint64_t count;
+ *         }
+ * }
+ *
+ * Empty buckets are left out.
+ *
+ * @param name  [IN] what the histogram is of
+ * @param h     [IN] the histogram
+ * @param iter  [IN] interator in reply stream to fill
+ */
+
+void server_dbus_lat_hist(char *name, struct lat_hist *h,
+			  DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter, array_iter, bucket_iter;
+	uint64_t bound, count;
+	int i;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY,
+					 "(tt)", &array_iter);
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		count = atomic_fetch_uint64_t(&h->bucket[i]);
+		if (count == 0)
+			continue;
+		bound = lat_hist_bound(i);
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &bucket_iter);
+		dbus_message_iter_append_basic(&bucket_iter, DBUS_TYPE_UINT64,
+					       &bound);
+		dbus_message_iter_append_basic(&bucket_iter, DBUS_TYPE_UINT64,
+					       &count);
+		dbus_message_iter_close_container(&array_iter, &bucket_iter);
+	}
+	dbus_message_iter_close_container(&struct_iter, &array_iter);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+/**
+ * @brief Report the latency histograms of an export or client
+ *
+ * One histogram per protocol operation class with activity.
+ *
+ * @param st    [IN] the export's or client's stats
+ * @param iter  [IN] interator in reply stream to fill
+ */
+
+void server_dbus_latency_hist(struct gsh_stats *st, DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(sa(tt))",
+					 &array_iter);
+	if (st->nfsv3) {
+		struct nfsv3_stats sum;
+
+		SUM_SLABS(add_nfsv3_stats, &sum, st->nfsv3);
+		server_dbus_lat_hist("NFSv3", &sum.cmds.latency_hist,
+				     &array_iter);
+		server_dbus_lat_hist("NFSv3 READ", &sum.read.cmd.latency_hist,
+				     &array_iter);
+		server_dbus_lat_hist("NFSv3 WRITE",
+				     &sum.write.cmd.latency_hist,
+				     &array_iter);
+	}
+	if (st->nfsv40) {
+		struct nfsv40_stats sum;
+
+		SUM_SLABS(add_nfsv40_stats, &sum, st->nfsv40);
+		server_dbus_lat_hist("NFSv4.0 COMPOUND",
+				     &sum.compounds.latency_hist,
+				     &array_iter);
+		server_dbus_lat_hist("NFSv4.0 READ",
+				     &sum.read.cmd.latency_hist,
+				     &array_iter);
+		server_dbus_lat_hist("NFSv4.0 WRITE",
+				     &sum.write.cmd.latency_hist,
+				     &array_iter);
+	}
+	if (st->nfsv41) {
+		struct nfsv41_stats sum;
+
+		SUM_SLABS(add_nfsv41_stats, &sum, st->nfsv41);
+		server_dbus_lat_hist("NFSv4.1 COMPOUND",
+				     &sum.compounds.latency_hist,
+				     &array_iter);
+		server_dbus_lat_hist("NFSv4.1 READ",
+				     &sum.read.cmd.latency_hist,
+				     &array_iter);
+		server_dbus_lat_hist("NFSv4.1 WRITE",
+				     &sum.write.cmd.latency_hist,
+				     &array_iter);
+	}
+	if (st->nfsv42) {
+		struct nfsv41_stats sum;
+
+		SUM_SLABS(add_nfsv41_stats, &sum, st->nfsv42);
+		server_dbus_lat_hist("NFSv4.2 COMPOUND",
+				     &sum.compounds.latency_hist,
+				     &array_iter);
+		server_dbus_lat_hist("NFSv4.2 READ",
+				     &sum.read.cmd.latency_hist,
+				     &array_iter);
+		server_dbus_lat_hist("NFSv4.2 WRITE",
+				     &sum.write.cmd.latency_hist,
+				     &array_iter);
+	}
+	if (st->mnt) {
+		struct mnt_stats sum;
+
+		SUM_SLABS(add_mnt_stats, &sum, st->mnt);
+		server_dbus_lat_hist("MNTv1", &sum.v1_ops.latency_hist,
+				     &array_iter);
+		server_dbus_lat_hist("MNTv3", &sum.v3_ops.latency_hist,
+				     &array_iter);
+	}
+	if (st->nlm4) {
+		struct nlmv4_stats sum;
+
+		SUM_SLABS(add_nlmv4_stats, &sum, st->nlm4);
+		server_dbus_lat_hist("NLMv4", &sum.ops.latency_hist,
+				     &array_iter);
+	}
+	if (st->rquota) {
+		struct rquota_stats sum;
+
+		SUM_SLABS(add_rquota_stats, &sum, st->rquota);
+		server_dbus_lat_hist("RQUOTA", &sum.ops.latency_hist,
+				     &array_iter);
+		server_dbus_lat_hist("RQUOTA EXT", &sum.ext_ops.latency_hist,
+				     &array_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+static void add_io_dist(struct io_dist *sum, struct io_dist *d)
+{
+	int i;
+
+	for (i = 0; i < IO_SIZE_BUCKETS; i++)
+		sum->size[i] += d->size[i];
+	sum->align_4k += d->align_4k;
+	sum->align_1m += d->align_1m;
+	sum->sequential += d->sequential;
+	sum->random += d->random;
+}
+
+static void add_io_dist_stats(struct io_dist_stats *sum,
+			      struct io_dist_stats *ds)
+{
+	add_io_dist(&sum->read, &ds->read);
+	add_io_dist(&sum->write, &ds->write);
+}
+
+static void server_dbus_io_dist_row(char *name, struct io_dist *d,
+				    DBusMessageIter *array_iter)
+{
+	DBusMessageIter struct_iter, size_iter;
+	int i;
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY, "t",
+					 &size_iter);
+	for (i = 0; i < IO_SIZE_BUCKETS; i++)
+		dbus_message_iter_append_basic(&size_iter, DBUS_TYPE_UINT64,
+					       &d->size[i]);
+	dbus_message_iter_close_container(&struct_iter, &size_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &d->align_4k);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &d->align_1m);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &d->sequential);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &d->random);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+}
+
+/**
+ * @brief Report the READ and WRITE size, alignment and sequentiality
+ *
+ * One row each for READ and WRITE: the count of I/Os of at most 512,
+ * 1K, ... 4M bytes and larger, of I/Os at an offset aligned to 4KB
+ * and to 1MB, and of sequential and random I/Os.
+ */
+
+void server_dbus_io_dist(struct gsh_stats *st, DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(satttt)",
+					 &array_iter);
+	if (st->io_dist) {
+		struct io_dist_stats sum;
+
+		SUM_SLABS(add_io_dist_stats, &sum, st->io_dist);
+		server_dbus_io_dist_row("READ", &sum.read, &array_iter);
+		server_dbus_io_dist_row("WRITE", &sum.write, &array_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+/**
+ * @brief Report the server wide latency histogram of each operation
+ *
+ * NFSv3 procedures and NFSv4 operations that have been called.
+ *
+ * @param iter  [IN] interator in reply stream to fill
+ */
+
+void global_dbus_op_latency_hist(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter;
+	struct global_stats *gs = sum_global_stats();
+	struct timespec timestamp;
+	char name[64];
+	int i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(sa(tt))",
+					 &array_iter);
+	for (i = 0; i <= NFSPROC3_COMMIT; i++) {
+		if (gs->v3.op[i] == 0)
+			continue;
+		snprintf(name, sizeof(name), "NFSv3 %s", optabv3[i].name);
+		server_dbus_lat_hist(name, &gs->v3_hist[i], &array_iter);
+	}
+	for (i = 0; i < NFS4_OP_LAST_ONE; i++) {
+		if (gs->v4.op[i] == 0)
+			continue;
+		snprintf(name, sizeof(name), "NFSv4 %s", optabv4[i].name);
+		server_dbus_lat_hist(name, &gs->v4_hist[i], &array_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+	gsh_free(gs);
 }
 
 void global_dbus_fast(DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
+	struct global_stats *gs = sum_global_stats();
 	char *version;
 	char *op;
 	int i;
@@ -1684,103 +2570,112 @@ void global_dbus_fast(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < NFSPROC3_COMMIT; i++) {
-		if (global_st.v3.op[i] > 0) {
+		if (gs->v3.op[i] > 0) {
 			op = optabv3[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.v3.op[i]);
+					DBUS_TYPE_UINT64, &gs->v3.op[i]);
 		}
 	}
 	version = "\nNFSv4:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < NFS4_OP_LAST_ONE; i++) {
-		if (global_st.v4.op[i] > 0) {
+		if (gs->v4.op[i] > 0) {
 			op = optabv4[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.v4.op[i]);
+					DBUS_TYPE_UINT64, &gs->v4.op[i]);
 		}
 	}
 	version = "\nNLM:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < NLM4_FAILED; i++) {
-		if (global_st.lm.op[i] > 0) {
+		if (gs->lm.op[i] > 0) {
 			op = optnlm[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.lm.op[i]);
+					DBUS_TYPE_UINT64, &gs->lm.op[i]);
 		}
 	}
 	version = "\nMNT:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < MOUNTPROC3_EXPORT; i++) {
-		if (global_st.mn.op[i] > 0) {
+		if (gs->mn.op[i] > 0) {
 			op = optmnt[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.mn.op[i]);
+					DBUS_TYPE_UINT64, &gs->mn.op[i]);
 		}
 	}
 	version = "\nQUOTA:";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
 	for (i = 0; i < RQUOTAPROC_SETACTIVEQUOTA; i++) {
-		if (global_st.qt.op[i] > 0) {
+		if (gs->qt.op[i] > 0) {
 			op = optqta[i].name;
 			dbus_message_iter_append_basic(&struct_iter,
 					DBUS_TYPE_STRING, &op);
 			dbus_message_iter_append_basic(&struct_iter,
-					DBUS_TYPE_UINT64, &global_st.qt.op[i]);
+					DBUS_TYPE_UINT64, &gs->qt.op[i]);
 		}
 	}
 	dbus_message_iter_close_container(iter, &struct_iter);
+	gsh_free(gs);
 }
 
 void server_dbus_v3_iostats(struct nfsv3_stats *v3p, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv3_stats sum;
 
+	SUM_SLABS(add_nfsv3_stats, &sum, v3p);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&v3p->read, iter);
-	server_dbus_iostats(&v3p->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
 void server_dbus_v40_iostats(struct nfsv40_stats *v40p, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv40_stats sum;
 
+	SUM_SLABS(add_nfsv40_stats, &sum, v40p);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&v40p->read, iter);
-	server_dbus_iostats(&v40p->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
 void server_dbus_v41_iostats(struct nfsv41_stats *v41p, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv41_stats sum;
 
+	SUM_SLABS(add_nfsv41_stats, &sum, v41p);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&v41p->read, iter);
-	server_dbus_iostats(&v41p->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
 void server_dbus_v42_iostats(struct nfsv41_stats *v42p, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv41_stats sum;
 
+	SUM_SLABS(add_nfsv41_stats, &sum, v42p);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&v42p->read, iter);
-	server_dbus_iostats(&v42p->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
 void server_dbus_fill_io(DBusMessageIter *array_iter, uint16_t *export_id,
@@ -1824,93 +2719,121 @@ void server_dbus_fill_io(DBusMessageIter *array_iter, uint16_t *export_id,
 void server_dbus_all_iostats(struct export_stats *export_statistics,
 			     DBusMessageIter *array_iter)
 {
-	if (export_statistics->st.nfsv3 != NULL) {
+	struct gsh_stats *st = &export_statistics->st;
+
+	if (st->nfsv3 != NULL) {
+		struct nfsv3_stats sum;
+
+		SUM_SLABS(add_nfsv3_stats, &sum, st->nfsv3);
 		server_dbus_fill_io(array_iter,
 				    &(export_statistics->export.export_id),
-				    "NFSv3",
-				    &(export_statistics->st.nfsv3->read),
-				    &(export_statistics->st.nfsv3->write));
+				    "NFSv3", &sum.read, &sum.write);
 	}
 
-	if (export_statistics->st.nfsv40 != NULL) {
+	if (st->nfsv40 != NULL) {
+		struct nfsv40_stats sum;
+
+		SUM_SLABS(add_nfsv40_stats, &sum, st->nfsv40);
 		server_dbus_fill_io(array_iter,
 				    &(export_statistics->export.export_id),
-				    "NFSv40",
-				    &(export_statistics->st.nfsv40->read),
-				    &(export_statistics->st.nfsv40->write));
+				    "NFSv40", &sum.read, &sum.write);
 	}
 
-	if (export_statistics->st.nfsv41 != NULL) {
+	if (st->nfsv41 != NULL) {
+		struct nfsv41_stats sum;
+
+		SUM_SLABS(add_nfsv41_stats, &sum, st->nfsv41);
 		server_dbus_fill_io(array_iter,
 				    &(export_statistics->export.export_id),
-				    "NFSv41",
-				    &(export_statistics->st.nfsv41->read),
-				    &(export_statistics->st.nfsv41->write));
+				    "NFSv41", &sum.read, &sum.write);
 	}
 
-	if (export_statistics->st.nfsv42 != NULL) {
+	if (st->nfsv42 != NULL) {
+		struct nfsv41_stats sum;
+
+		SUM_SLABS(add_nfsv41_stats, &sum, st->nfsv42);
 		server_dbus_fill_io(array_iter,
 				    &(export_statistics->export.export_id),
-				    "NFSv42",
-				    &(export_statistics->st.nfsv42->read),
-				    &(export_statistics->st.nfsv42->write));
+				    "NFSv42", &sum.read, &sum.write);
 	}
 }
 
 void reset_gsh_stats(struct gsh_stats *st)
 {
-	if (st->nfsv3)
-		reset_nfsv3_stats(st->nfsv3);
-	if (st->nfsv40)
-		reset_nfsv40_stats(st->nfsv40);
-	if (st->nfsv41)
-		reset_nfsv41_stats(st->nfsv41);
-	if (st->nfsv42)
-		reset_nfsv41_stats(st->nfsv42); /* Uses v41 stats */
-	if (st->mnt)
-		reset_mnt_stats(st->mnt);
-	if (st->rquota)
-		reset_rquota_stats(st->rquota);
-	if (st->nlm4)
-		reset_nlmv4_stats(st->nlm4);
-	if (st->deleg)
-		reset_deleg_stats(st->deleg);
+	uint32_t i;
+
+	for (i = 0; i < stats_nshards; i++) {
+		if (st->nfsv3)
+			reset_nfsv3_stats(&st->nfsv3[i]);
+		if (st->nfsv40)
+			reset_nfsv40_stats(&st->nfsv40[i]);
+		if (st->nfsv41)
+			reset_nfsv41_stats(&st->nfsv41[i]);
+		if (st->nfsv42)
+			reset_nfsv41_stats(&st->nfsv42[i]); /* Uses v41 stats */
+		if (st->mnt)
+			reset_mnt_stats(&st->mnt[i]);
+		if (st->rquota)
+			reset_rquota_stats(&st->rquota[i]);
+		if (st->nlm4)
+			reset_nlmv4_stats(&st->nlm4[i]);
+		if (st->io_dist) {
+			reset_io_dist(&st->io_dist[i].read);
+			reset_io_dist(&st->io_dist[i].write);
+		}
+		if (st->cpu)
+			reset_cpu_stats(&st->cpu[i]);
 #ifdef _USE_9P
-	if (st->_9p)
-		reset__9P_stats(st->_9p);
+		if (st->_9p)
+			reset__9P_stats(&st->_9p[i]);
 #endif
+	}
+	if (st->deleg)
+		reset_deleg_stats(st->deleg);
 }
 
 void reset_global_stats(void)
 {
+	struct global_stats *gs;
+	uint32_t s;
 	int i;
-	/* Reset all ops counters of nfsv3 */
-	for (i = 0; i < NFSPROC3_COMMIT; i++) {
-		(void)atomic_store_uint64_t(&global_st.v3.op[i], 0);
-	}
-	/* Reset all ops counters of nfsv4 */
-	for (i = 0; i < NFS4_OP_LAST_ONE; i++) {
-		(void)atomic_store_uint64_t(&global_st.v4.op[i], 0);
-	}
-	/* Reset all ops counters of lock manager */
-	for (i = 0; i < NLM4_FAILED; i++) {
-		(void)atomic_store_uint64_t(&global_st.lm.op[i], 0);
-	}
-	/* Reset all ops counters of mountd */
-	for (i = 0; i < MOUNTPROC3_EXPORT; i++) {
-		(void)atomic_store_uint64_t(&global_st.mn.op[i], 0);
-	}
-	/* Reset all ops counters of rquotad */
-	for (i = 0; i < RQUOTAPROC_SETACTIVEQUOTA; i++) {
-		(void)atomic_store_uint64_t(&global_st.qt.op[i], 0);
+
+	for (s = 0; s < stats_nshards; s++) {
+		gs = &global_st[s];
+		/* Reset all ops counters of nfsv3 */
+		for (i = 0; i < NFSPROC3_COMMIT; i++)
+			(void)atomic_store_uint64_t(&gs->v3.op[i], 0);
+		/* Reset all ops counters of nfsv4 */
+		for (i = 0; i < NFS4_OP_LAST_ONE; i++)
+			(void)atomic_store_uint64_t(&gs->v4.op[i], 0);
+		/* Reset the per op latency histograms */
+		for (i = 0; i <= NFSPROC3_COMMIT; i++)
+			reset_lat_hist(&gs->v3_hist[i]);
+		for (i = 0; i < NFS4_OP_LAST_ONE; i++)
+			reset_lat_hist(&gs->v4_hist[i]);
+		/* Reset the CPU time */
+		reset_cpu_stats(&gs->cpu);
+		for (i = 0; i <= NFSPROC3_COMMIT; i++)
+			reset_cpu_time(&gs->v3_cpu[i]);
+		for (i = 0; i < NFS4_OP_LAST_ONE; i++)
+			(void)atomic_store_uint64_t(&gs->v4_cpu[i], 0);
+		/* Reset all ops counters of lock manager */
+		for (i = 0; i < NLM4_FAILED; i++)
+			(void)atomic_store_uint64_t(&gs->lm.op[i], 0);
+		/* Reset all ops counters of mountd */
+		for (i = 0; i < MOUNTPROC3_EXPORT; i++)
+			(void)atomic_store_uint64_t(&gs->mn.op[i], 0);
+		/* Reset all ops counters of rquotad */
+		for (i = 0; i < RQUOTAPROC_SETACTIVEQUOTA; i++)
+			(void)atomic_store_uint64_t(&gs->qt.op[i], 0);
+		reset_nfsv3_stats(&gs->nfsv3);
+		reset_nfsv40_stats(&gs->nfsv40);
+		reset_nfsv41_stats(&gs->nfsv41);
+		reset_nfsv41_stats(&gs->nfsv42);  /* Uses v41 stats */
+		reset_mnt_stats(&gs->mnt);
+		reset_rquota_stats(&gs->rquota);
+		reset_nlmv4_stats(&gs->nlm4);
 	}
-	reset_nfsv3_stats(&global_st.nfsv3);
-	reset_nfsv40_stats(&global_st.nfsv40);
-	reset_nfsv41_stats(&global_st.nfsv41);
-	reset_nfsv41_stats(&global_st.nfsv42);  /* Uses v41 stats */
-	reset_mnt_stats(&global_st.mnt);
-	reset_rquota_stats(&global_st.rquota);
-	reset_nlmv4_stats(&global_st.nlm4);
 }
 
 void global_dbus_reset_stats(DBusMessageIter *iter)
@@ -1955,36 +2878,53 @@ void server_reset_stats(DBusMessageIter *iter)
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
 	global_dbus_reset_stats(iter);
+#ifdef ENABLE_LOCK_PROFILE
+	lock_prof_reset();
+#endif
 }
 
 #ifdef _USE_9P
 void server_dbus_9p_iostats(struct _9p_stats *_9pp, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct _9p_stats sum;
 
+	SUM_SLABS(add__9P_stats, &sum, _9pp);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&_9pp->read, iter);
-	server_dbus_iostats(&_9pp->write, iter);
+	server_dbus_iostats(&sum.read, iter);
+	server_dbus_iostats(&sum.write, iter);
 }
 
 void server_dbus_9p_transstats(struct _9p_stats *_9pp, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct _9p_stats sum;
 
+	SUM_SLABS(add__9P_stats, &sum, _9pp);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_transportstats(&_9pp->trans, iter);
+	server_dbus_transportstats(&sum.trans, iter);
 }
 
 void server_dbus_9p_opstats(struct _9p_stats *_9pp, u8 opcode,
 			    DBusMessageIter *iter)
 {
 	struct timespec timestamp;
-
+	struct proto_op sum;
+	bool found = false;
+	uint32_t i;
+
+	memset(&sum, 0, sizeof(sum));
+	for (i = 0; i < stats_nshards; i++) {
+		if (_9pp[i].opcodes[opcode] != NULL) {
+			add_op(&sum, _9pp[i].opcodes[opcode]);
+			found = true;
+		}
+	}
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_op_stats(_9pp->opcodes[opcode], iter);
+	server_dbus_op_stats(found ? &sum : NULL, iter);
 }
 #endif
 
@@ -2020,27 +2960,31 @@ static void server_dbus_layouts(struct layout_op *lop, DBusMessageIter *iter)
 void server_dbus_v41_layouts(struct nfsv41_stats *v41p, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv41_stats sum;
 
+	SUM_SLABS(add_nfsv41_stats, &sum, v41p);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_layouts(&v41p->getdevinfo, iter);
-	server_dbus_layouts(&v41p->layout_get, iter);
-	server_dbus_layouts(&v41p->layout_commit, iter);
-	server_dbus_layouts(&v41p->layout_return, iter);
-	server_dbus_layouts(&v41p->recall, iter);
+	server_dbus_layouts(&sum.getdevinfo, iter);
+	server_dbus_layouts(&sum.layout_get, iter);
+	server_dbus_layouts(&sum.layout_commit, iter);
+	server_dbus_layouts(&sum.layout_return, iter);
+	server_dbus_layouts(&sum.recall, iter);
 }
 
 void server_dbus_v42_layouts(struct nfsv41_stats *v42p, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	struct nfsv41_stats sum;
 
+	SUM_SLABS(add_nfsv41_stats, &sum, v42p);
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_layouts(&v42p->getdevinfo, iter);
-	server_dbus_layouts(&v42p->layout_get, iter);
-	server_dbus_layouts(&v42p->layout_commit, iter);
-	server_dbus_layouts(&v42p->layout_return, iter);
-	server_dbus_layouts(&v42p->recall, iter);
+	server_dbus_layouts(&sum.getdevinfo, iter);
+	server_dbus_layouts(&sum.layout_get, iter);
+	server_dbus_layouts(&sum.layout_commit, iter);
+	server_dbus_layouts(&sum.layout_return, iter);
+	server_dbus_layouts(&sum.recall, iter);
 }
 
 /**
@@ -2066,6 +3010,16 @@ void server_dbus_delegations(struct deleg_stats *ds, DBusMessageIter *iter)
 				       &ds->failed_recalls);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
 				       &ds->num_revokes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &ds->heat_declines);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &ds->budget_declines);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &ds->recall_replies);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &ds->recall_latency);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &ds->recall_latency_max);
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
@@ -2110,13 +3064,24 @@ void server_stats_free(struct gsh_stats *statsp)
 		gsh_free(statsp->nfsv42);
 		statsp->nfsv42 = NULL;
 	}
+	if (statsp->io_dist != NULL) {
+		gsh_free(statsp->io_dist);
+		statsp->io_dist = NULL;
+	}
+	if (statsp->cpu != NULL) {
+		gsh_free(statsp->cpu);
+		statsp->cpu = NULL;
+	}
 #ifdef _USE_9P
 	if (statsp->_9p != NULL) {
+		uint32_t i;
 		u8 opc;
 
-		for (opc = 0; opc <= _9P_RWSTAT; opc++) {
-			if (statsp->_9p->opcodes[opc] != NULL)
-				gsh_free(statsp->_9p->opcodes[opc]);
+		for (i = 0; i < stats_nshards; i++) {
+			for (opc = 0; opc <= _9P_RWSTAT; opc++) {
+				if (statsp->_9p[i].opcodes[opc] != NULL)
+					gsh_free(statsp->_9p[i].opcodes[opc]);
+			}
 		}
 		gsh_free(statsp->_9p);
 		statsp->_9p = NULL;
@@ -2124,4 +3089,497 @@ void server_stats_free(struct gsh_stats *statsp)
 #endif
 }
 
+
+/* OpenMetrics rendering
+ *
+ * The global, per export and per client blocks are each rendered as
+ * one set of families (ganesha_server_*, ganesha_export_* and
+ * ganesha_client_*) with a sample per protocol and request class.
+ * Blocks are summed first so that every family's samples can be
+ * written together, as the format requires, without holding the
+ * export or client locks while writing.
+ */
+
+/** Request classes of one block */
+#define METRICS_MAX_CLASSES 20
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a) (sizeof(a)/sizeof(a[0]))
+#endif
+
+struct metrics_block {
+	char labels[SOCK_NAME_MAX + 16];	/*< e.g. 'export_id="1",' */
+	struct nfsv3_stats nfsv3;
+	struct mnt_stats mnt;
+	struct nlmv4_stats nlm4;
+	struct rquota_stats rquota;
+	struct nfsv40_stats nfsv40;
+	struct nfsv41_stats nfsv41;
+	struct nfsv41_stats nfsv42;
+	struct cpu_stats cpu;
+#ifdef _USE_9P
+	struct _9p_stats _9p;
+#endif
+};
+
+struct metrics_blocks {
+	struct metrics_block **block;
+	int count;
+	int size;
+};
+
+struct metrics_class {
+	const char *proto;
+	const char *kind;
+	struct proto_op *op;
+	struct xfer_op *xfer;	/*< NULL unless a read or write class */
+};
+
+struct metrics_family {
+	const char *suffix;
+	const char *type;
+	const char *help;
+	void (*sample)(FILE *out, const char *name, const char *labels,
+		       struct metrics_class *c);
+};
+
+static struct metrics_block *metrics_block_new(struct metrics_blocks *mb)
+{
+	if (mb->count == mb->size) {
+		mb->size = mb->size == 0 ? 16 : mb->size * 2;
+		mb->block = gsh_realloc(mb->block,
+					mb->size * sizeof(*mb->block));
+	}
+
+	mb->block[mb->count] = gsh_calloc(1, sizeof(struct metrics_block));
+	return mb->block[mb->count++];
+}
+
+static void metrics_blocks_free(struct metrics_blocks *mb)
+{
+	int i;
+
+	for (i = 0; i < mb->count; i++)
+		gsh_free(mb->block[i]);
+
+	gsh_free(mb->block);
+	memset(mb, 0, sizeof(*mb));
+}
+
+static void metrics_sum_block(struct metrics_block *b, struct gsh_stats *st)
+{
+	if (st->nfsv3 != NULL)
+		SUM_SLABS(add_nfsv3_stats, &b->nfsv3, st->nfsv3);
+	if (st->mnt != NULL)
+		SUM_SLABS(add_mnt_stats, &b->mnt, st->mnt);
+	if (st->nlm4 != NULL)
+		SUM_SLABS(add_nlmv4_stats, &b->nlm4, st->nlm4);
+	if (st->rquota != NULL)
+		SUM_SLABS(add_rquota_stats, &b->rquota, st->rquota);
+	if (st->nfsv40 != NULL)
+		SUM_SLABS(add_nfsv40_stats, &b->nfsv40, st->nfsv40);
+	if (st->nfsv41 != NULL)
+		SUM_SLABS(add_nfsv41_stats, &b->nfsv41, st->nfsv41);
+	if (st->nfsv42 != NULL)
+		SUM_SLABS(add_nfsv41_stats, &b->nfsv42, st->nfsv42);
+	if (st->cpu != NULL)
+		SUM_SLABS(add_cpu_stats, &b->cpu, st->cpu);
+#ifdef _USE_9P
+	if (st->_9p != NULL)
+		SUM_SLABS(add__9P_stats, &b->_9p, st->_9p);
+#endif
+}
+
+static bool metrics_export_cb(struct gsh_export *export, void *state)
+{
+	struct export_stats *exp_st =
+		container_of(export, struct export_stats, export);
+	struct metrics_block *b = metrics_block_new(state);
+
+	(void)snprintf(b->labels, sizeof(b->labels), "export_id=\"%" PRIu16
+		       "\",", export->export_id);
+	metrics_sum_block(b, &exp_st->st);
+	return true;
+}
+
+static bool metrics_client_cb(struct gsh_client *client, void *state)
+{
+	struct server_stats *server_st =
+		container_of(client, struct server_stats, client);
+	struct metrics_block *b = metrics_block_new(state);
+
+	(void)snprintf(b->labels, sizeof(b->labels), "client=\"%s\",",
+		       client->hostaddr_str ? client->hostaddr_str : "");
+	metrics_sum_block(b, &server_st->st);
+	return true;
+}
+
+/**
+ * @brief List the request classes of a block
+ *
+ * The "all" classes count every request of the protocol, reads and
+ * writes included.
+ */
+static int metrics_classes(struct metrics_block *b, struct metrics_class *c)
+{
+	int n = 0;
+
+#define METRICS_CLASS(p, k, o, x) \
+	c[n++] = (struct metrics_class) {p, k, o, x}
+
+	METRICS_CLASS("nfsv3", "all", &b->nfsv3.cmds, NULL);
+	METRICS_CLASS("nfsv3", "read", &b->nfsv3.read.cmd, &b->nfsv3.read);
+	METRICS_CLASS("nfsv3", "write", &b->nfsv3.write.cmd,
+		      &b->nfsv3.write);
+	METRICS_CLASS("nfsv4.0", "compound", &b->nfsv40.compounds, NULL);
+	METRICS_CLASS("nfsv4.0", "read", &b->nfsv40.read.cmd,
+		      &b->nfsv40.read);
+	METRICS_CLASS("nfsv4.0", "write", &b->nfsv40.write.cmd,
+		      &b->nfsv40.write);
+	METRICS_CLASS("nfsv4.1", "compound", &b->nfsv41.compounds, NULL);
+	METRICS_CLASS("nfsv4.1", "read", &b->nfsv41.read.cmd,
+		      &b->nfsv41.read);
+	METRICS_CLASS("nfsv4.1", "write", &b->nfsv41.write.cmd,
+		      &b->nfsv41.write);
+	METRICS_CLASS("nfsv4.2", "compound", &b->nfsv42.compounds, NULL);
+	METRICS_CLASS("nfsv4.2", "read", &b->nfsv42.read.cmd,
+		      &b->nfsv42.read);
+	METRICS_CLASS("nfsv4.2", "write", &b->nfsv42.write.cmd,
+		      &b->nfsv42.write);
+	METRICS_CLASS("mntv1", "all", &b->mnt.v1_ops, NULL);
+	METRICS_CLASS("mntv3", "all", &b->mnt.v3_ops, NULL);
+	METRICS_CLASS("nlmv4", "all", &b->nlm4.ops, NULL);
+	METRICS_CLASS("rquota", "all", &b->rquota.ops, NULL);
+	METRICS_CLASS("rquota_ext", "all", &b->rquota.ext_ops, NULL);
+#ifdef _USE_9P
+	METRICS_CLASS("9p", "all", &b->_9p.cmds, NULL);
+	METRICS_CLASS("9p", "read", &b->_9p.read.cmd, &b->_9p.read);
+	METRICS_CLASS("9p", "write", &b->_9p.write.cmd, &b->_9p.write);
+#endif
+
+#undef METRICS_CLASS
+
+	return n;
+}
+
+static void metrics_requests(FILE *out, const char *name, const char *labels,
+			     struct metrics_class *c)
+{
+	fprintf(out, "%s_total{%s} %" PRIu64 "\n", name, labels,
+		c->op->total);
+}
+
+static void metrics_errors(FILE *out, const char *name, const char *labels,
+			   struct metrics_class *c)
+{
+	fprintf(out, "%s_total{%s} %" PRIu64 "\n", name, labels,
+		c->op->errors);
+}
+
+static void metrics_queue_wait(FILE *out, const char *name,
+			       const char *labels, struct metrics_class *c)
+{
+	fprintf(out, "%s_total{%s} %.9g\n", name, labels,
+		c->op->queue_latency.latency / 1e9);
+}
+
+static void metrics_transferred(FILE *out, const char *name,
+				const char *labels, struct metrics_class *c)
+{
+	if (c->xfer != NULL)
+		fprintf(out, "%s_total{%s} %" PRIu64 "\n", name, labels,
+			c->xfer->transferred);
+}
+
+static void metrics_latency(FILE *out, const char *name, const char *labels,
+			    struct metrics_class *c)
+{
+	metrics_lat_hist(out, name, labels, &c->op->latency_hist,
+			 c->op->latency.latency / 1e9);
+}
+
+static const struct metrics_family metrics_families[] = {
+	{"requests", "counter", "Requests received", metrics_requests},
+	{"errors", "counter", "Requests that failed", metrics_errors},
+	{"queue_wait_seconds", "counter",
+	 "Time requests waited for a worker", metrics_queue_wait},
+	{"transferred_bytes", "counter",
+	 "Bytes read or written", metrics_transferred},
+	{"latency_seconds", "histogram",
+	 "Time taken to execute requests", metrics_latency},
+};
+
+/**
+ * @brief Write the families of a set of blocks
+ *
+ * Classes that saw no request are left out.
+ */
+static void metrics_blocks(FILE *out, const char *prefix,
+			   struct metrics_blocks *mb)
+{
+	struct metrics_class classes[METRICS_MAX_CLASSES];
+	const struct metrics_family *fam;
+	char name[64];
+	char labels[SOCK_NAME_MAX + 64];
+	int f, i, j, n;
+
+	for (f = 0; f < ARRAY_SIZE(metrics_families); f++) {
+		fam = &metrics_families[f];
+		(void)snprintf(name, sizeof(name), "%s_%s", prefix,
+			       fam->suffix);
+		fprintf(out, "# TYPE %s %s\n# HELP %s %s\n", name, fam->type,
+			name, fam->help);
+
+		for (i = 0; i < mb->count; i++) {
+			n = metrics_classes(mb->block[i], classes);
+			for (j = 0; j < n; j++) {
+				if (classes[j].op->total == 0)
+					continue;
+				(void)snprintf(labels, sizeof(labels),
+					       "%sproto=\"%s\",kind=\"%s\"",
+					       mb->block[i]->labels,
+					       classes[j].proto,
+					       classes[j].kind);
+				fam->sample(out, name, labels, &classes[j]);
+			}
+		}
+	}
+
+	if (!nfs_param.core_param.enable_CPUSTATS)
+		return;
+
+	(void)snprintf(name, sizeof(name), "%s_cpu_seconds", prefix);
+	fprintf(out, "# TYPE %s counter\n# HELP %s %s\n", name, name,
+		"Thread CPU time spent on requests, by stage");
+
+	for (i = 0; i < mb->count; i++) {
+		struct cpu_stats *cs = &mb->block[i]->cpu;
+
+		for (j = 0; j < CPU_PROTOS; j++) {
+			if (cs->proto[j].requests == 0)
+				continue;
+			for (n = 0; n < CPU_STAGES; n++)
+				fprintf(out,
+					"%s_total{%sproto=\"%s\",stage=\"%s\"} %.9g\n",
+					name, mb->block[i]->labels,
+					cpu_proto_names[j], cpu_stage_names[n],
+					cs->proto[j].ns[n] / 1e9);
+		}
+	}
+}
+
+/**
+ * @brief Write the per operation counters and histograms
+ */
+static void metrics_ops(FILE *out, struct global_stats *gs)
+{
+	static const struct {
+		const char *proto;
+		const struct op_name *names;
+		int count;
+	} tabs[] = {
+		{"nfsv3", optabv3, ARRAY_SIZE(optabv3)},
+		{"nfsv4", optabv4, ARRAY_SIZE(optabv4)},
+		{"nlm", optnlm, ARRAY_SIZE(optnlm)},
+		{"mnt", optmnt, ARRAY_SIZE(optmnt)},
+		{"rquota", optqta, ARRAY_SIZE(optqta)},
+	};
+	uint64_t *ops[] = {gs->v3.op, gs->v4.op, gs->lm.op, gs->mn.op,
+			   gs->qt.op};
+	struct lat_hist *hists[] = {gs->v3_hist, gs->v4_hist, NULL, NULL,
+				    NULL};
+	char labels[64];
+	int t, i;
+
+	fprintf(out, "# TYPE ganesha_ops counter\n"
+		"# HELP ganesha_ops Requests received, by operation\n");
+	for (t = 0; t < ARRAY_SIZE(tabs); t++) {
+		for (i = 0; i < tabs[t].count; i++) {
+			if (tabs[t].names[i].name == NULL || ops[t][i] == 0)
+				continue;
+			fprintf(out, "ganesha_ops_total{proto=\"%s\",op=\"%s\"} %"
+				PRIu64 "\n", tabs[t].proto,
+				tabs[t].names[i].name, ops[t][i]);
+		}
+	}
+
+	fprintf(out, "# TYPE ganesha_op_latency_seconds histogram\n"
+		"# HELP ganesha_op_latency_seconds Time taken to execute "
+		"operations\n");
+	for (t = 0; t < ARRAY_SIZE(tabs); t++) {
+		if (hists[t] == NULL)
+			continue;
+		for (i = 0; i < tabs[t].count; i++) {
+			if (tabs[t].names[i].name == NULL || ops[t][i] == 0)
+				continue;
+			(void)snprintf(labels, sizeof(labels),
+				       "proto=\"%s\",op=\"%s\"", tabs[t].proto,
+				       tabs[t].names[i].name);
+			metrics_lat_hist(out, "ganesha_op_latency_seconds",
+					 labels, &hists[t][i], -1);
+		}
+	}
+
+	if (!nfs_param.core_param.enable_CPUSTATS)
+		return;
+
+	fprintf(out, "# TYPE ganesha_op_cpu_seconds counter\n"
+		"# HELP ganesha_op_cpu_seconds Thread CPU time spent on "
+		"operations, by stage\n");
+	for (i = 0; i <= NFSPROC3_COMMIT; i++) {
+		if (optabv3[i].name == NULL || gs->v3_cpu[i].requests == 0)
+			continue;
+		for (t = 0; t < CPU_STAGES; t++)
+			fprintf(out, "ganesha_op_cpu_seconds_total{proto=\"nfsv3\","
+				"op=\"%s\",stage=\"%s\"} %.9g\n",
+				optabv3[i].name, cpu_stage_names[t],
+				gs->v3_cpu[i].ns[t] / 1e9);
+	}
+
+	/* NFSv4 decodes and encodes whole compounds, see the protocol */
+	for (i = 0; i < MIN(ARRAY_SIZE(optabv4), NFS4_OP_LAST_ONE); i++) {
+		if (optabv4[i].name == NULL || gs->v4_cpu[i] == 0)
+			continue;
+		fprintf(out, "ganesha_op_cpu_seconds_total{proto=\"nfsv4\","
+			"op=\"%s\",stage=\"execute\"} %.9g\n",
+			optabv4[i].name, gs->v4_cpu[i] / 1e9);
+	}
+}
+
+/**
+ * @brief Write the server statistics in OpenMetrics text format
+ *
+ * @param[in] out  Reply stream
+ */
+void server_stats_metrics(FILE *out)
+{
+	struct global_stats *gs = sum_global_stats();
+	struct metrics_blocks mb = { NULL, 0, 0 };
+	struct metrics_block *b;
+
+	b = metrics_block_new(&mb);
+	b->nfsv3 = gs->nfsv3;
+	b->mnt = gs->mnt;
+	b->nlm4 = gs->nlm4;
+	b->rquota = gs->rquota;
+	b->nfsv40 = gs->nfsv40;
+	b->nfsv41 = gs->nfsv41;
+	b->nfsv42 = gs->nfsv42;
+	b->cpu = gs->cpu;
+	metrics_blocks(out, "ganesha_server", &mb);
+	metrics_blocks_free(&mb);
+
+	(void)foreach_gsh_export_snapshot(metrics_export_cb, &mb);
+	metrics_blocks(out, "ganesha_export", &mb);
+	metrics_blocks_free(&mb);
+
+	(void)foreach_gsh_client(metrics_client_cb, &mb);
+	metrics_blocks(out, "ganesha_client", &mb);
+	metrics_blocks_free(&mb);
+
+	metrics_ops(out, gs);
+	gsh_free(gs);
+}
+
+/* Shared-memory statistics
+ *
+ * The same request classes as the metrics endpoint, in the fixed
+ * layout of gsh_stats_shm.h.
+ */
+
+#if LAT_HIST_BUCKETS != GSH_STATS_SHM_HIST
+#error "GSH_STATS_SHM_HIST must match LAT_HIST_BUCKETS"
+#endif
+
+static void shm_counts(struct gsh_stats_shm_counts *sc,
+		       struct metrics_class *c)
+{
+	(void)snprintf(sc->proto, sizeof(sc->proto), "%s", c->proto);
+	(void)snprintf(sc->kind, sizeof(sc->kind), "%s", c->kind);
+	sc->total = c->op->total;
+	sc->errors = c->op->errors;
+	sc->dups = c->op->dups;
+	sc->latency_ns = c->op->latency.latency;
+	sc->queue_wait_ns = c->op->queue_latency.latency;
+	if (c->xfer != NULL) {
+		sc->requested = c->xfer->requested;
+		sc->transferred = c->xfer->transferred;
+	}
+}
+
+static bool shm_export_cb(struct gsh_export *export, void *state)
+{
+	struct gsh_stats_shm *shm = state;
+	struct export_stats *exp_st =
+		container_of(export, struct export_stats, export);
+	struct metrics_class classes[METRICS_MAX_CLASSES];
+	struct gsh_stats_shm_export *se;
+	struct metrics_block *b;
+	int i, n;
+
+	if (shm->nexports == GSH_STATS_SHM_EXPORTS)
+		return false;
+
+	b = gsh_calloc(1, sizeof(*b));
+	metrics_sum_block(b, &exp_st->st);
+
+	se = &shm->exports[shm->nexports++];
+	se->export_id = export->export_id;
+	n = MIN(metrics_classes(b, classes), GSH_STATS_SHM_CLASSES);
+	se->nclasses = n;
+	for (i = 0; i < n; i++)
+		shm_counts(&se->classes[i], &classes[i]);
+
+	gsh_free(b);
+	return true;
+}
+
+/**
+ * @brief Fill a copy of the shared-memory statistics
+ *
+ * Everything but the header, which the publisher owns.
+ *
+ * @param[out] shm  Zeroed copy to fill
+ */
+void server_stats_shm_fill(struct gsh_stats_shm *shm)
+{
+	struct global_stats *gs = sum_global_stats();
+	struct metrics_class classes[METRICS_MAX_CLASSES];
+	struct metrics_block *b = gsh_calloc(1, sizeof(*b));
+	int i, n;
+
+	b->nfsv3 = gs->nfsv3;
+	b->mnt = gs->mnt;
+	b->nlm4 = gs->nlm4;
+	b->rquota = gs->rquota;
+	b->nfsv40 = gs->nfsv40;
+	b->nfsv41 = gs->nfsv41;
+	b->nfsv42 = gs->nfsv42;
+
+	n = MIN(metrics_classes(b, classes), GSH_STATS_SHM_CLASSES);
+	shm->nclasses = n;
+	for (i = 0; i < n; i++) {
+		shm_counts(&shm->server[i].c, &classes[i]);
+		memcpy(shm->server[i].hist, classes[i].op->latency_hist.bucket,
+		       sizeof(shm->server[i].hist));
+	}
+
+	for (i = 0; i < MIN(NFSPROC3_COMMIT + 1, GSH_STATS_SHM_V3_OPS); i++) {
+		shm->v3_ops[i] = gs->v3.op[i];
+		memcpy(shm->v3_hist[i], gs->v3_hist[i].bucket,
+		       sizeof(shm->v3_hist[i]));
+	}
+
+	for (i = 0; i < MIN(NFS4_OP_LAST_ONE, GSH_STATS_SHM_V4_OPS); i++) {
+		shm->v4_ops[i] = gs->v4.op[i];
+		memcpy(shm->v4_hist[i], gs->v4_hist[i].bucket,
+		       sizeof(shm->v4_hist[i]));
+	}
+
+	(void)foreach_gsh_export_snapshot(shm_export_cb, shm);
+
+	gsh_free(b);
+	gsh_free(gs);
+}
+
 /** @} */
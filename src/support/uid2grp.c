@@ -42,11 +42,29 @@
 #include <sys/types.h>
 #include <pwd.h>
 #include <grp.h>
+#include <netdb.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "common_utils.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
 #include "uid2grp.h"
 
+/**
+ * @brief A group list to refresh in the background
+ */
+
+struct uid2grp_refresh {
+	struct group_data *gdata;	/*< Held, the list being replaced */
+	bool by_name;
+};
+
+/**
+ * @brief Threads for refreshes and the startup prefetch
+ */
+
+static struct fridgethr *uid2grp_fridge;
+
 /* group_data has a reference counter. If it goes to zero, it implies
  * that it is out of the cache (AVL trees) and should be freed. The
  * reference count is 1 when we put it into AVL trees. We decrement when
@@ -199,6 +217,7 @@ static struct group_data *uid2grp_allocate_by_name(
 	PTHREAD_MUTEX_init(&gdata->lock, NULL);
 	gdata->epoch = time(NULL);
 	gdata->refcount = 0;
+	gdata->refreshing = 0;
 	return gdata;
 }
 
@@ -246,9 +265,173 @@ static struct group_data *uid2grp_allocate_by_uid(uid_t uid)
 	PTHREAD_MUTEX_init(&gdata->lock, NULL);
 	gdata->epoch = time(NULL);
 	gdata->refcount = 0;
+	gdata->refreshing = 0;
 	return gdata;
 }
 
+/**
+ * @brief Replace a group list in the background
+ *
+ * A refresh that fails leaves the list as it was, to be retried by
+ * the next request or fetched in line once too stale.
+ */
+
+static void uid2grp_refresh_run(struct fridgethr_context *ctx)
+{
+	struct uid2grp_refresh *refresh = ctx->arg;
+	struct group_data *old = refresh->gdata;
+	struct group_data *gdata;
+
+	if (refresh->by_name)
+		gdata = uid2grp_allocate_by_name(&old->uname);
+	else
+		gdata = uid2grp_allocate_by_uid(old->uid);
+
+	if (gdata) {
+		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
+		uid2grp_add_user(gdata);
+		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	} else {
+		atomic_store_uint32_t(&old->refreshing, 0);
+	}
+
+	uid2grp_release_group_data(old);
+	gsh_free(refresh);
+}
+
+/**
+ * @brief Queue the refresh of an expired group list, once
+ *
+ * @note The caller must hold uid2grp_user_lock for read.
+ *
+ * @param[in] gdata   Group list in the cache
+ * @param[in] by_name Look the user up again by name rather than uid
+ */
+
+static void uid2grp_refresh(struct group_data *gdata, bool by_name)
+{
+	struct uid2grp_refresh *refresh;
+
+	if (uid2grp_fridge == NULL ||
+	    atomic_postset_uint32_t_bits(&gdata->refreshing, 1) != 0)
+		return;
+
+	refresh = gsh_malloc(sizeof(*refresh));
+	refresh->gdata = gdata;
+	refresh->by_name = by_name;
+	uid2grp_hold_group_data(gdata);
+
+	if (fridgethr_submit(uid2grp_fridge, uid2grp_refresh_run,
+			     refresh) != 0) {
+		LogDebug(COMPONENT_IDMAPPER,
+			 "Could not queue refresh of groups of uid %u",
+			 gdata->uid);
+		atomic_store_uint32_t(&gdata->refreshing, 0);
+		uid2grp_release_group_data(gdata);
+		gsh_free(refresh);
+	}
+}
+
+/* Number of users a prefetch entry brought in */
+static int uid2grp_prefetch_user(const char *user)
+{
+	struct gsh_buffdesc name = {
+		.addr = (char *)user,
+		.len = strlen(user)
+	};
+	struct group_data *gdata;
+
+	if (!name2grp(&name, &gdata))
+		return 0;
+
+	uid2grp_unref(gdata);
+	return 1;
+}
+
+/**
+ * @brief Fetch the group lists of Manage_Gids_Prefetch
+ *
+ * Users in many groups can take a long time to look up, better spent
+ * before their first request.  Entries starting with '@' are
+ * netgroups, of which the user of each triple is fetched.
+ */
+
+static void uid2grp_prefetch_run(struct fridgethr_context *ctx)
+{
+	char *list = gsh_strdup(ctx->arg);
+	char *tok, *save = NULL;
+	char *host, *user, *domain;
+	int count = 0;
+
+	for (tok = strtok_r(list, ", \t", &save); tok != NULL;
+	     tok = strtok_r(NULL, ", \t", &save)) {
+		if (tok[0] != '@') {
+			count += uid2grp_prefetch_user(tok);
+			continue;
+		}
+
+		/* Only this thread walks netgroups */
+		if (setnetgrent(tok + 1) == 0) {
+			LogWarn(COMPONENT_IDMAPPER,
+				"Could not find netgroup %s to prefetch",
+				tok + 1);
+			continue;
+		}
+		while (getnetgrent(&host, &user, &domain) != 0) {
+			if (user != NULL && user[0] != '\0')
+				count += uid2grp_prefetch_user(user);
+		}
+		endnetgrent();
+	}
+
+	LogEvent(COMPONENT_IDMAPPER,
+		 "Prefetched supplementary groups of %d users", count);
+	gsh_free(list);
+}
+
+/**
+ * @brief Initialize the uid2grp cache and its background threads
+ */
+
+void uid2grp_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	uid2grp_cache_init();
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 2;
+	frp.thr_min = 0;
+	frp.thread_delay = 60;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	/* Without it, expired group lists are fetched in line */
+	rc = fridgethr_init(&uid2grp_fridge, "uid2grp", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to initialize uid2grp fridge, error code %d.",
+			 rc);
+		uid2grp_fridge = NULL;
+		return;
+	}
+
+	if (nfs_param.core_param.manage_gids_prefetch != NULL &&
+	    fridgethr_submit(uid2grp_fridge, uid2grp_prefetch_run,
+			     nfs_param.core_param.manage_gids_prefetch) != 0)
+		LogWarn(COMPONENT_IDMAPPER,
+			"Could not queue prefetch of supplementary groups");
+}
+
+#define uid2grp_expired(gdata) (time(NULL) - (gdata)->epoch > \
+		nfs_param.core_param.manage_gids_expiration)
+
+/* Expired group lists are served this much longer while refreshed */
+#define uid2grp_usable(gdata) (time(NULL) - (gdata)->epoch <= \
+		nfs_param.core_param.manage_gids_expiration + \
+		nfs_param.core_param.manage_gids_stale)
+
 /**
  * @brief Get supplementary groups given uname
  *
@@ -257,8 +440,6 @@ static struct group_data *uid2grp_allocate_by_uid(uid_t uid)
  *
  * @return true if successful, false otherwise
  */
-#define uid2grp_expired(gdata) (time(NULL) - (gdata)->epoch > \
-		nfs_param.core_param.manage_gids_expiration)
 bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
 {
 	bool success = false;
@@ -268,8 +449,10 @@ bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
 	success = uid2grp_lookup_by_uname(name, &uid, gdata);
 
 	/* Handle common case first */
-	if (success && !uid2grp_expired(*gdata)) {
+	if (success && uid2grp_usable(*gdata)) {
 		uid2grp_hold_group_data(*gdata);
+		if (uid2grp_expired(*gdata))
+			uid2grp_refresh(*gdata, true);
 		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
 		return success;
 	}
@@ -310,8 +493,10 @@ bool uid2grp(uid_t uid, struct group_data **gdata)
 	success = uid2grp_lookup_by_uid(uid, gdata);
 
 	/* Handle common case first */
-	if (success && !uid2grp_expired(*gdata)) {
+	if (success && uid2grp_usable(*gdata)) {
 		uid2grp_hold_group_data(*gdata);
+		if (uid2grp_expired(*gdata))
+			uid2grp_refresh(*gdata, false);
 		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
 		return success;
 	}
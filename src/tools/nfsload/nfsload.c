@@ -0,0 +1,1064 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file nfsload.c
+ * @brief NFSv3 / NFSv4.1 load generator
+ *
+ * Each thread opens its own connection (and, for NFSv4.1, its own
+ * client and session) and issues operations drawn at random from a
+ * weighted op mix, one at a time.  The mix is read from a file of
+ * "OP weight" lines, so the operation counts of ganesha_stats or of
+ * a capture summary can be used as they are.  At the end a latency
+ * histogram is printed per operation.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "gsh_rpc.h"
+#include "nfs23.h"
+#include "mount.h"
+#include "nfsv41.h"
+
+#define USAGE \
+"usage: %s -s <server> -e <export> [options]\n" \
+"  -s <server>    server name or address\n" \
+"  -e <export>    export path (v3) or pseudo path (v4.1)\n" \
+"  -v <3|4.1>     protocol version, default 3\n" \
+"  -p <port>      NFS port, default 2049\n" \
+"  -M <port>      MOUNT port for v3, default 20048\n" \
+"  -m <mixfile>   op mix, \"OP weight\" per line; default GETATTR 1\n" \
+"  -F <name>      file in the export used by READ, WRITE and LOOKUP\n" \
+"  -S <bytes>     span of the file READ and WRITE address, default 1M\n" \
+"  -b <bytes>     READ and WRITE size, default 4096\n" \
+"  -t <threads>   concurrent clients, default 8\n" \
+"  -d <seconds>   duration, default 30\n" \
+"  -n <ops>       stop each thread after ops operations instead\n" \
+"  -r <seed>      random seed, default 1\n" \
+"  -H             print the full histogram of each op\n"
+
+/* Default timeout of a call */
+static struct timeval TIMEOUT = { 25, 0 };
+
+/* This function is dragged in by the use of abstract_mem.h, so
+ * we define a simple version that does a printf rather than
+ * pull in the entirety of log_functions.c into this standalone
+ * program.
+ */
+void LogMallocFailure(const char *file, int line, const char *function,
+		      const char *allocator)
+{
+	printf("Aborting %s due to out of memory", allocator);
+}
+
+enum ld_op {
+	LD_NULL,
+	LD_GETATTR,
+	LD_LOOKUP,
+	LD_ACCESS,
+	LD_READ,
+	LD_WRITE,
+	LD_READDIR,
+	LD_FSSTAT,
+	LD_NUM_OPS
+};
+
+static const char *ld_op_names[LD_NUM_OPS] = {
+	"NULL", "GETATTR", "LOOKUP", "ACCESS", "READ", "WRITE", "READDIR",
+	"FSSTAT"
+};
+
+/** Latency buckets, bucket i counts latencies below 2^i microseconds */
+#define LD_HIST_BUCKETS 32
+
+struct ld_stats {
+	uint64_t count[LD_NUM_OPS];
+	uint64_t errors[LD_NUM_OPS];
+	uint64_t sum_us[LD_NUM_OPS];
+	uint64_t max_us[LD_NUM_OPS];
+	uint64_t hist[LD_NUM_OPS][LD_HIST_BUCKETS];
+};
+
+struct ld_fh {
+	u_int len;
+	char val[NFS4_FHSIZE];
+};
+
+/**
+ * @brief A client, one per thread
+ */
+struct ld_client {
+	int idx;
+	CLIENT *clnt;
+	AUTH *auth;
+	struct ld_fh root;		/*< Export root */
+	struct ld_fh file;		/*< -F file */
+	/* NFSv4.1 */
+	clientid4 clientid;
+	sessionid4 sessionid;
+	sequenceid4 seqid;
+	unsigned int rand;
+	char *buf;			/*< READ and WRITE data */
+	struct ld_stats stats;
+};
+
+/* Options */
+static const char *server;
+static const char *export_path;
+static int minorversion = -1;	/*< -1 for v3 */
+static int nfs_port = 2049;
+static int mnt_port = 20048;
+static const char *mix_file;
+static const char *file_name;
+static uint64_t file_span = 1024 * 1024;
+static uint32_t io_size = 4096;
+static int nthreads = 8;
+static int duration = 30;
+static uint64_t max_ops;
+static unsigned int seed = 1;
+static bool full_hist;
+
+/** Cumulative weights of the op mix */
+static double mix[LD_NUM_OPS];
+
+static struct timespec end_time;
+
+static uint64_t ld_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void ld_fh_set(struct ld_fh *fh, u_int len, const char *val)
+{
+	if (len > sizeof(fh->val)) {
+		fprintf(stderr, "File handle of %u bytes is too long\n", len);
+		exit(1);
+	}
+
+	fh->len = len;
+	memcpy(fh->val, val, len);
+}
+
+/**
+ * @brief Connect a client to a program of the server
+ */
+static CLIENT *ld_connect(int port, rpcprog_t prog, rpcvers_t vers)
+{
+	struct addrinfo hints, *res;
+	struct netbuf raddr;
+	char port_str[16];
+	CLIENT *clnt;
+	int fd, rc;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	sprintf(port_str, "%d", port);
+
+	rc = getaddrinfo(server, port_str, &hints, &res);
+	if (rc != 0) {
+		fprintf(stderr, "Cannot resolve %s: %s\n", server,
+			gai_strerror(rc));
+		return NULL;
+	}
+
+	fd = socket(res->ai_family, SOCK_STREAM, IPPROTO_TCP);
+	if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+		fprintf(stderr, "Cannot connect to %s:%d: %s\n", server,
+			port, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		freeaddrinfo(res);
+		return NULL;
+	}
+
+	raddr.buf = res->ai_addr;
+	raddr.len = raddr.maxlen = res->ai_addrlen;
+
+	clnt = clnt_vc_create(fd, &raddr, prog, vers, 0, 0);
+	freeaddrinfo(res);
+
+	if (clnt == NULL) {
+		close(fd);
+		return NULL;
+	}
+
+	/* Mark the fd to be closed on clnt_destroy */
+	CLNT_CONTROL(clnt, CLSET_FD_CLOSE, NULL);
+
+	return clnt;
+}
+
+/*
+ * NFSv3
+ */
+
+static bool ld_v3_mount(struct ld_client *cl)
+{
+	CLIENT *clnt;
+	mountres3 res;
+	dirpath path = (dirpath) export_path;
+	bool ok;
+
+	clnt = ld_connect(mnt_port, MOUNTPROG, MOUNT_V3);
+	if (clnt == NULL)
+		return false;
+
+	memset(&res, 0, sizeof(res));
+	ok = clnt_call(clnt, cl->auth, MOUNTPROC3_MNT,
+		       (xdrproc_t) xdr_dirpath, (caddr_t) &path,
+		       (xdrproc_t) xdr_mountres3, (caddr_t) &res,
+		       TIMEOUT) == RPC_SUCCESS;
+
+	if (ok && res.fhs_status == MNT3_OK)
+		ld_fh_set(&cl->root,
+			  res.mountres3_u.mountinfo.fhandle.fhandle3_len,
+			  res.mountres3_u.mountinfo.fhandle.fhandle3_val);
+	else
+		fprintf(stderr, "Cannot mount %s:%s: %d\n", server,
+			export_path, ok ? (int) res.fhs_status : -1);
+
+	ok = ok && res.fhs_status == MNT3_OK;
+	if (ok)
+		xdr_free((xdrproc_t) xdr_mountres3, (caddr_t) &res);
+	clnt_destroy(clnt);
+
+	return ok;
+}
+
+static void ld_v3_fh(nfs_fh3 *fh3, struct ld_fh *fh)
+{
+	fh3->data.data_len = fh->len;
+	fh3->data.data_val = fh->val;
+}
+
+/**
+ * @brief Issue one NFSv3 operation
+ *
+ * @return true if both the call and the operation succeeded.
+ */
+static bool ld_v3_op(struct ld_client *cl, enum ld_op op, uint64_t offset)
+{
+	union {
+		GETATTR3args getattr;
+		LOOKUP3args lookup;
+		ACCESS3args access;
+		READ3args read;
+		WRITE3args write;
+		READDIRPLUS3args readdirplus;
+		FSSTAT3args fsstat;
+	} args;
+	union {
+		nfsstat3 status;
+		GETATTR3res getattr;
+		LOOKUP3res lookup;
+		ACCESS3res access;
+		READ3res read;
+		WRITE3res write;
+		READDIRPLUS3res readdirplus;
+		FSSTAT3res fsstat;
+	} res;
+	xdrproc_t xargs, xres;
+	rpcproc_t proc;
+	enum clnt_stat stat;
+	bool ok;
+
+	memset(&args, 0, sizeof(args));
+	memset(&res, 0, sizeof(res));
+
+	switch (op) {
+	case LD_NULL:
+		return clnt_call(cl->clnt, cl->auth, NFSPROC3_NULL,
+				 (xdrproc_t) xdr_void, NULL,
+				 (xdrproc_t) xdr_void, NULL,
+				 TIMEOUT) == RPC_SUCCESS;
+	case LD_GETATTR:
+		ld_v3_fh(&args.getattr.object, &cl->root);
+		proc = NFSPROC3_GETATTR;
+		xargs = (xdrproc_t) xdr_GETATTR3args;
+		xres = (xdrproc_t) xdr_GETATTR3res;
+		break;
+	case LD_LOOKUP:
+		ld_v3_fh(&args.lookup.what.dir, &cl->root);
+		args.lookup.what.name = (filename3) (file_name ? file_name
+							       : ".");
+		proc = NFSPROC3_LOOKUP;
+		xargs = (xdrproc_t) xdr_LOOKUP3args;
+		xres = (xdrproc_t) xdr_LOOKUP3res;
+		break;
+	case LD_ACCESS:
+		ld_v3_fh(&args.access.object, &cl->root);
+		args.access.access = ACCESS3_READ | ACCESS3_LOOKUP;
+		proc = NFSPROC3_ACCESS;
+		xargs = (xdrproc_t) xdr_ACCESS3args;
+		xres = (xdrproc_t) xdr_ACCESS3res;
+		break;
+	case LD_READ:
+		ld_v3_fh(&args.read.file, &cl->file);
+		args.read.offset = offset;
+		args.read.count = io_size;
+		proc = NFSPROC3_READ;
+		xargs = (xdrproc_t) xdr_READ3args;
+		xres = (xdrproc_t) xdr_READ3res;
+		break;
+	case LD_WRITE:
+		ld_v3_fh(&args.write.file, &cl->file);
+		args.write.offset = offset;
+		args.write.count = io_size;
+		args.write.stable = UNSTABLE;
+		args.write.data.data_len = io_size;
+		args.write.data.data_val = cl->buf;
+		proc = NFSPROC3_WRITE;
+		xargs = (xdrproc_t) xdr_WRITE3args;
+		xres = (xdrproc_t) xdr_WRITE3res;
+		break;
+	case LD_READDIR:
+		ld_v3_fh(&args.readdirplus.dir, &cl->root);
+		args.readdirplus.dircount = 4096;
+		args.readdirplus.maxcount = 32768;
+		proc = NFSPROC3_READDIRPLUS;
+		xargs = (xdrproc_t) xdr_READDIRPLUS3args;
+		xres = (xdrproc_t) xdr_READDIRPLUS3res;
+		break;
+	case LD_FSSTAT:
+		ld_v3_fh(&args.fsstat.fsroot, &cl->root);
+		proc = NFSPROC3_FSSTAT;
+		xargs = (xdrproc_t) xdr_FSSTAT3args;
+		xres = (xdrproc_t) xdr_FSSTAT3res;
+		break;
+	default:
+		return false;
+	}
+
+	stat = clnt_call(cl->clnt, cl->auth, proc, xargs, (caddr_t) &args,
+			 xres, (caddr_t) &res, TIMEOUT);
+	if (stat != RPC_SUCCESS)
+		return false;
+
+	ok = res.status == NFS3_OK;
+
+	/* The first -F lookup gives the file handle */
+	if (op == LD_LOOKUP && ok && cl->file.len == 0 && file_name)
+		ld_fh_set(&cl->file,
+			  res.lookup.LOOKUP3res_u.resok.object.data.data_len,
+			  res.lookup.LOOKUP3res_u.resok.object.data.data_val);
+
+	xdr_free(xres, (caddr_t) &res);
+
+	return ok;
+}
+
+static bool ld_v3_setup(struct ld_client *cl)
+{
+	cl->clnt = ld_connect(nfs_port, NFS_PROGRAM, NFS_V3);
+	if (cl->clnt == NULL || !ld_v3_mount(cl))
+		return false;
+
+	if (file_name && !ld_v3_op(cl, LD_LOOKUP, 0)) {
+		fprintf(stderr, "Cannot look %s up in %s\n", file_name,
+			export_path);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * NFSv4.1
+ */
+
+/** Largest compound the generator sends */
+#define LD_V4_MAX_OPS 16
+
+static enum clnt_stat ld_v4_compound(struct ld_client *cl, nfs_argop4 *ops,
+				     u_int nops, COMPOUND4res *res)
+{
+	COMPOUND4args args;
+
+	memset(&args, 0, sizeof(args));
+	args.minorversion = minorversion;
+	args.argarray.argarray_len = nops;
+	args.argarray.argarray_val = ops;
+
+	memset(res, 0, sizeof(*res));
+
+	return clnt_call(cl->clnt, cl->auth, NFSPROC4_COMPOUND,
+			 (xdrproc_t) xdr_COMPOUND4args, (caddr_t) &args,
+			 (xdrproc_t) xdr_COMPOUND4res, (caddr_t) res,
+			 TIMEOUT);
+}
+
+/**
+ * @brief Send a compound and check its status
+ *
+ * @return true if every operation succeeded; res must then be freed.
+ */
+static bool ld_v4_call(struct ld_client *cl, nfs_argop4 *ops, u_int nops,
+		       COMPOUND4res *res)
+{
+	if (ld_v4_compound(cl, ops, nops, res) != RPC_SUCCESS)
+		return false;
+
+	/* The slot was used as long as SEQUENCE went through */
+	if (ops[0].argop == NFS4_OP_SEQUENCE &&
+	    res->resarray.resarray_len > 0 &&
+	    res->resarray.resarray_val[0].nfs_resop4_u.opsequence.sr_status
+	    == NFS4_OK)
+		cl->seqid++;
+
+	if (res->status != NFS4_OK) {
+		xdr_free((xdrproc_t) xdr_COMPOUND4res, (caddr_t) res);
+		return false;
+	}
+
+	return true;
+}
+
+static void ld_v4_sequence(struct ld_client *cl, nfs_argop4 *op)
+{
+	op->argop = NFS4_OP_SEQUENCE;
+	memcpy(op->nfs_argop4_u.opsequence.sa_sessionid, cl->sessionid,
+	       sizeof(sessionid4));
+	op->nfs_argop4_u.opsequence.sa_sequenceid = cl->seqid;
+	op->nfs_argop4_u.opsequence.sa_slotid = 0;
+	op->nfs_argop4_u.opsequence.sa_highest_slotid = 0;
+	op->nfs_argop4_u.opsequence.sa_cachethis = false;
+}
+
+static void ld_v4_putfh(nfs_argop4 *op, struct ld_fh *fh)
+{
+	op->argop = NFS4_OP_PUTFH;
+	op->nfs_argop4_u.opputfh.object.nfs_fh4_len = fh->len;
+	op->nfs_argop4_u.opputfh.object.nfs_fh4_val = fh->val;
+}
+
+static void ld_v4_lookup(nfs_argop4 *op, const char *name)
+{
+	op->argop = NFS4_OP_LOOKUP;
+	op->nfs_argop4_u.oplookup.objname.utf8string_len = strlen(name);
+	op->nfs_argop4_u.oplookup.objname.utf8string_val = (char *) name;
+}
+
+static void ld_bitmap_set(struct bitmap4 *bits, int attr)
+{
+	if (attr / 32 >= bits->bitmap4_len)
+		bits->bitmap4_len = attr / 32 + 1;
+	bits->map[attr / 32] |= 1U << (attr % 32);
+}
+
+/**
+ * @brief Set up the client and session of a thread
+ */
+static bool ld_v4_session(struct ld_client *cl)
+{
+	nfs_argop4 ops[2];
+	COMPOUND4res res;
+	EXCHANGE_ID4args *eia = &ops[0].nfs_argop4_u.opexchange_id;
+	CREATE_SESSION4args *csa = &ops[0].nfs_argop4_u.opcreate_session;
+	callback_sec_parms4 sec_parms;
+	char owner[128];
+	char hostname[64];
+	uint64_t verifier = ld_now_us();
+	nfs_resop4 *r;
+
+	gethostname(hostname, sizeof(hostname));
+	hostname[sizeof(hostname) - 1] = '\0';
+	snprintf(owner, sizeof(owner), "nfsload-%s-%d-%d", hostname,
+		 (int) getpid(), cl->idx);
+
+	memset(ops, 0, sizeof(ops));
+	ops[0].argop = NFS4_OP_EXCHANGE_ID;
+	memcpy(eia->eia_clientowner.co_verifier, &verifier,
+	       sizeof(verifier4));
+	eia->eia_clientowner.co_ownerid.co_ownerid_len = strlen(owner);
+	eia->eia_clientowner.co_ownerid.co_ownerid_val = owner;
+	eia->eia_flags = EXCHGID4_FLAG_USE_NON_PNFS;
+	eia->eia_state_protect.spa_how = SP4_NONE;
+
+	if (!ld_v4_call(cl, ops, 1, &res)) {
+		fprintf(stderr, "EXCHANGE_ID failed: %d\n", (int) res.status);
+		return false;
+	}
+
+	r = &res.resarray.resarray_val[0];
+	cl->clientid =
+		r->nfs_resop4_u.opexchange_id.EXCHANGE_ID4res_u.eir_resok4
+		.eir_clientid;
+	cl->seqid =
+		r->nfs_resop4_u.opexchange_id.EXCHANGE_ID4res_u.eir_resok4
+		.eir_sequenceid;
+	xdr_free((xdrproc_t) xdr_COMPOUND4res, (caddr_t) &res);
+
+	memset(ops, 0, sizeof(ops));
+	memset(&sec_parms, 0, sizeof(sec_parms));
+	sec_parms.cb_secflavor = AUTH_NONE;
+
+	ops[0].argop = NFS4_OP_CREATE_SESSION;
+	csa->csa_clientid = cl->clientid;
+	csa->csa_sequence = cl->seqid;
+	csa->csa_fore_chan_attrs.ca_maxrequestsize = io_size + 4096;
+	csa->csa_fore_chan_attrs.ca_maxresponsesize = io_size + 65536;
+	csa->csa_fore_chan_attrs.ca_maxresponsesize_cached = 4096;
+	csa->csa_fore_chan_attrs.ca_maxoperations = LD_V4_MAX_OPS;
+	csa->csa_fore_chan_attrs.ca_maxrequests = 1;
+	csa->csa_back_chan_attrs = csa->csa_fore_chan_attrs;
+	csa->csa_cb_program = 0x40000000;
+	csa->csa_sec_parms.csa_sec_parms_len = 1;
+	csa->csa_sec_parms.csa_sec_parms_val = &sec_parms;
+
+	if (!ld_v4_call(cl, ops, 1, &res)) {
+		fprintf(stderr, "CREATE_SESSION failed: %d\n",
+			(int) res.status);
+		return false;
+	}
+
+	r = &res.resarray.resarray_val[0];
+	memcpy(cl->sessionid,
+	       r->nfs_resop4_u.opcreate_session.CREATE_SESSION4res_u
+	       .csr_resok4.csr_sessionid, sizeof(sessionid4));
+	cl->seqid = 1;
+	xdr_free((xdrproc_t) xdr_COMPOUND4res, (caddr_t) &res);
+
+	/* Nothing to reclaim, let the server know */
+	memset(ops, 0, sizeof(ops));
+	ld_v4_sequence(cl, &ops[0]);
+	ops[1].argop = NFS4_OP_RECLAIM_COMPLETE;
+	ops[1].nfs_argop4_u.opreclaim_complete.rca_one_fs = false;
+
+	if (ld_v4_call(cl, ops, 2, &res))
+		xdr_free((xdrproc_t) xdr_COMPOUND4res, (caddr_t) &res);
+
+	return true;
+}
+
+/**
+ * @brief Resolve a path from the pseudo root to a file handle
+ */
+static bool ld_v4_resolve(struct ld_client *cl, struct ld_fh *from,
+			  const char *path, struct ld_fh *fh)
+{
+	nfs_argop4 ops[LD_V4_MAX_OPS];
+	char *copy = strdup(path), *comp, *save = NULL;
+	COMPOUND4res res;
+	u_int n = 0;
+	GETFH4resok *getfh;
+	bool ok;
+
+	memset(ops, 0, sizeof(ops));
+	ld_v4_sequence(cl, &ops[n++]);
+
+	if (from != NULL)
+		ld_v4_putfh(&ops[n++], from);
+	else
+		ops[n++].argop = NFS4_OP_PUTROOTFH;
+
+	for (comp = strtok_r(copy, "/", &save); comp != NULL;
+	     comp = strtok_r(NULL, "/", &save)) {
+		if (n == LD_V4_MAX_OPS - 1) {
+			fprintf(stderr, "Path %s is too deep\n", path);
+			free(copy);
+			return false;
+		}
+		ld_v4_lookup(&ops[n++], comp);
+	}
+
+	ops[n++].argop = NFS4_OP_GETFH;
+
+	ok = ld_v4_call(cl, ops, n, &res);
+	if (ok) {
+		getfh = &res.resarray.resarray_val[n - 1].nfs_resop4_u.opgetfh
+			.GETFH4res_u.resok4;
+		ld_fh_set(fh, getfh->object.nfs_fh4_len,
+			  getfh->object.nfs_fh4_val);
+		xdr_free((xdrproc_t) xdr_COMPOUND4res, (caddr_t) &res);
+	} else {
+		fprintf(stderr, "Cannot look %s up: %d\n", path,
+			(int) res.status);
+	}
+
+	free(copy);
+	return ok;
+}
+
+static bool ld_v4_op(struct ld_client *cl, enum ld_op op, uint64_t offset)
+{
+	static const stateid4 anonymous;
+	nfs_argop4 ops[3];
+	COMPOUND4res res;
+	struct bitmap4 *bits;
+
+	if (op == LD_NULL)
+		return clnt_call(cl->clnt, cl->auth, NFSPROC4_NULL,
+				 (xdrproc_t) xdr_void, NULL,
+				 (xdrproc_t) xdr_void, NULL,
+				 TIMEOUT) == RPC_SUCCESS;
+
+	memset(ops, 0, sizeof(ops));
+	ld_v4_sequence(cl, &ops[0]);
+	ld_v4_putfh(&ops[1], op == LD_READ || op == LD_WRITE ? &cl->file
+							     : &cl->root);
+
+	switch (op) {
+	case LD_GETATTR:
+		ops[2].argop = NFS4_OP_GETATTR;
+		bits = &ops[2].nfs_argop4_u.opgetattr.attr_request;
+		ld_bitmap_set(bits, FATTR4_TYPE);
+		ld_bitmap_set(bits, FATTR4_CHANGE);
+		ld_bitmap_set(bits, FATTR4_SIZE);
+		ld_bitmap_set(bits, FATTR4_FILEID);
+		ld_bitmap_set(bits, FATTR4_MODE);
+		ld_bitmap_set(bits, FATTR4_NUMLINKS);
+		ld_bitmap_set(bits, FATTR4_TIME_MODIFY);
+		break;
+	case LD_LOOKUP:
+		if (file_name)
+			ld_v4_lookup(&ops[2], file_name);
+		else
+			ops[2].argop = NFS4_OP_LOOKUPP;
+		break;
+	case LD_ACCESS:
+		ops[2].argop = NFS4_OP_ACCESS;
+		ops[2].nfs_argop4_u.opaccess.access =
+			ACCESS4_READ | ACCESS4_LOOKUP;
+		break;
+	case LD_READ:
+		ops[2].argop = NFS4_OP_READ;
+		ops[2].nfs_argop4_u.opread.stateid = anonymous;
+		ops[2].nfs_argop4_u.opread.offset = offset;
+		ops[2].nfs_argop4_u.opread.count = io_size;
+		break;
+	case LD_WRITE:
+		ops[2].argop = NFS4_OP_WRITE;
+		ops[2].nfs_argop4_u.opwrite.stateid = anonymous;
+		ops[2].nfs_argop4_u.opwrite.offset = offset;
+		ops[2].nfs_argop4_u.opwrite.stable = UNSTABLE4;
+		ops[2].nfs_argop4_u.opwrite.data.data_len = io_size;
+		ops[2].nfs_argop4_u.opwrite.data.data_val = cl->buf;
+		break;
+	case LD_READDIR:
+		ops[2].argop = NFS4_OP_READDIR;
+		ops[2].nfs_argop4_u.opreaddir.dircount = 4096;
+		ops[2].nfs_argop4_u.opreaddir.maxcount = 32768;
+		bits = &ops[2].nfs_argop4_u.opreaddir.attr_request;
+		ld_bitmap_set(bits, FATTR4_TYPE);
+		ld_bitmap_set(bits, FATTR4_FILEID);
+		break;
+	case LD_FSSTAT:
+		/* What FSSTAT is to v3 */
+		ops[2].argop = NFS4_OP_GETATTR;
+		bits = &ops[2].nfs_argop4_u.opgetattr.attr_request;
+		ld_bitmap_set(bits, FATTR4_SPACE_AVAIL);
+		ld_bitmap_set(bits, FATTR4_SPACE_FREE);
+		ld_bitmap_set(bits, FATTR4_SPACE_TOTAL);
+		break;
+	default:
+		return false;
+	}
+
+	if (!ld_v4_call(cl, ops, 3, &res))
+		return false;
+
+	xdr_free((xdrproc_t) xdr_COMPOUND4res, (caddr_t) &res);
+	return true;
+}
+
+static bool ld_v4_setup(struct ld_client *cl)
+{
+	cl->clnt = ld_connect(nfs_port, NFS4_PROGRAM, NFS_V4);
+	if (cl->clnt == NULL || !ld_v4_session(cl))
+		return false;
+
+	if (!ld_v4_resolve(cl, NULL, export_path, &cl->root))
+		return false;
+
+	return file_name == NULL ||
+	       ld_v4_resolve(cl, &cl->root, file_name, &cl->file);
+}
+
+static void ld_v4_teardown(struct ld_client *cl)
+{
+	nfs_argop4 op;
+	COMPOUND4res res;
+
+	memset(&op, 0, sizeof(op));
+	op.argop = NFS4_OP_DESTROY_SESSION;
+	memcpy(op.nfs_argop4_u.opdestroy_session.dsa_sessionid,
+	       cl->sessionid, sizeof(sessionid4));
+	if (ld_v4_call(cl, &op, 1, &res))
+		xdr_free((xdrproc_t) xdr_COMPOUND4res, (caddr_t) &res);
+
+	memset(&op, 0, sizeof(op));
+	op.argop = NFS4_OP_DESTROY_CLIENTID;
+	op.nfs_argop4_u.opdestroy_clientid.dca_clientid = cl->clientid;
+	if (ld_v4_call(cl, &op, 1, &res))
+		xdr_free((xdrproc_t) xdr_COMPOUND4res, (caddr_t) &res);
+}
+
+/*
+ * Load
+ */
+
+static enum ld_op ld_pick(struct ld_client *cl)
+{
+	double x = (double) rand_r(&cl->rand) / ((double) RAND_MAX + 1) *
+		   mix[LD_NUM_OPS - 1];
+	int op;
+
+	for (op = 0; op < LD_NUM_OPS - 1; op++)
+		if (x < mix[op])
+			break;
+
+	return op;
+}
+
+static void ld_record(struct ld_stats *st, enum ld_op op, uint64_t us,
+		      bool ok)
+{
+	int b = 0;
+
+	while (b < LD_HIST_BUCKETS - 1 && us >= (1ULL << b))
+		b++;
+
+	st->count[op]++;
+	st->hist[op][b]++;
+	st->sum_us[op] += us;
+	if (us > st->max_us[op])
+		st->max_us[op] = us;
+	if (!ok)
+		st->errors[op]++;
+}
+
+static void *ld_thread(void *arg)
+{
+	struct ld_client *cl = arg;
+	uint64_t n, start, spans, offset;
+	struct timespec now;
+	enum ld_op op;
+	bool ok;
+
+	spans = file_span > io_size ? file_span / io_size : 1;
+
+	for (n = 0; max_ops == 0 || n < max_ops; n++) {
+		if (max_ops == 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (now.tv_sec > end_time.tv_sec ||
+			    (now.tv_sec == end_time.tv_sec &&
+			     now.tv_nsec >= end_time.tv_nsec))
+				break;
+		}
+
+		op = ld_pick(cl);
+		offset = (rand_r(&cl->rand) % spans) * io_size;
+
+		start = ld_now_us();
+		if (minorversion < 0)
+			ok = ld_v3_op(cl, op, offset);
+		else
+			ok = ld_v4_op(cl, op, offset);
+		ld_record(&cl->stats, op, ld_now_us() - start, ok);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Read the op mix
+ *
+ * Lines are an op name and a weight, separated by blanks, ':' or
+ * '='.  READDIRPLUS counts as READDIR; ops the generator does not
+ * issue are reported and skipped.
+ */
+static void ld_read_mix(void)
+{
+	char line[256], *name, *weight, *save;
+	double w[LD_NUM_OPS] = { 0 };
+	FILE *f;
+	int op;
+
+	if (mix_file == NULL) {
+		w[LD_GETATTR] = 1;
+		goto out;
+	}
+
+	f = fopen(mix_file, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot open %s: %s\n", mix_file,
+			strerror(errno));
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (line[0] == '#')
+			continue;
+
+		name = strtok_r(line, " \t:=,\n", &save);
+		weight = strtok_r(NULL, " \t:=,\n", &save);
+		if (name == NULL || weight == NULL)
+			continue;
+
+		if (strncasecmp(name, "NFSPROC3_", 9) == 0)
+			name += 9;
+		if (strcasecmp(name, "READDIRPLUS") == 0)
+			name = "READDIR";
+
+		for (op = 0; op < LD_NUM_OPS; op++)
+			if (strcasecmp(name, ld_op_names[op]) == 0)
+				break;
+
+		if (op == LD_NUM_OPS) {
+			fprintf(stderr, "Skipping %s, not generated\n", name);
+			continue;
+		}
+
+		w[op] += strtod(weight, NULL);
+	}
+
+	fclose(f);
+
+out:
+	for (op = 0; op < LD_NUM_OPS; op++) {
+		if (w[op] < 0)
+			w[op] = 0;
+		mix[op] = (op > 0 ? mix[op - 1] : 0) + w[op];
+	}
+
+	if (mix[LD_NUM_OPS - 1] <= 0) {
+		fprintf(stderr, "The op mix is empty\n");
+		exit(1);
+	}
+
+	if ((w[LD_READ] > 0 || w[LD_WRITE] > 0) && file_name == NULL) {
+		fprintf(stderr, "READ and WRITE need a file (-F)\n");
+		exit(1);
+	}
+}
+
+static uint64_t ld_percentile(uint64_t *hist, uint64_t count, double pct)
+{
+	uint64_t want = count * pct / 100, seen = 0;
+	int b;
+
+	for (b = 0; b < LD_HIST_BUCKETS; b++) {
+		seen += hist[b];
+		if (seen > want)
+			return 1ULL << b;
+	}
+
+	return 1ULL << (LD_HIST_BUCKETS - 1);
+}
+
+static void ld_report(struct ld_stats *st, double secs)
+{
+	uint64_t total = 0;
+	int op, b;
+
+	printf("%-8s %10s %8s %10s %9s %9s %9s %10s\n", "op", "count",
+	       "errors", "avg(us)", "p50<", "p90<", "p99<", "max(us)");
+
+	for (op = 0; op < LD_NUM_OPS; op++) {
+		if (st->count[op] == 0)
+			continue;
+
+		total += st->count[op];
+		printf("%-8s %10" PRIu64 " %8" PRIu64 " %10.1f %9" PRIu64
+		       " %9" PRIu64 " %9" PRIu64 " %10" PRIu64 "\n",
+		       ld_op_names[op], st->count[op], st->errors[op],
+		       (double) st->sum_us[op] / st->count[op],
+		       ld_percentile(st->hist[op], st->count[op], 50),
+		       ld_percentile(st->hist[op], st->count[op], 90),
+		       ld_percentile(st->hist[op], st->count[op], 99),
+		       st->max_us[op]);
+
+		if (!full_hist)
+			continue;
+
+		for (b = 0; b < LD_HIST_BUCKETS; b++)
+			if (st->hist[op][b] != 0)
+				printf("    < %10llu us %10" PRIu64 "\n",
+				       1ULL << b, st->hist[op][b]);
+	}
+
+	printf("\n%" PRIu64 " ops in %.1f s, %.0f ops/s\n", total, secs,
+	       secs > 0 ? total / secs : 0);
+}
+
+int main(int argc, char **argv)
+{
+	struct ld_client *clients;
+	pthread_t *threads;
+	struct ld_stats total;
+	uint64_t start, i;
+	int c, t, op, b;
+
+	while ((c = getopt(argc, argv, "s:e:v:p:M:m:F:S:b:t:d:n:r:H")) != EOF)
+		switch (c) {
+		case 's':
+			server = optarg;
+			break;
+		case 'e':
+			export_path = optarg;
+			break;
+		case 'v':
+			if (strcmp(optarg, "3") == 0)
+				minorversion = -1;
+			else if (strcmp(optarg, "4.1") == 0)
+				minorversion = 1;
+			else {
+				fprintf(stderr, "Unsupported version %s\n",
+					optarg);
+				exit(1);
+			}
+			break;
+		case 'p':
+			nfs_port = atoi(optarg);
+			break;
+		case 'M':
+			mnt_port = atoi(optarg);
+			break;
+		case 'm':
+			mix_file = optarg;
+			break;
+		case 'F':
+			file_name = optarg;
+			break;
+		case 'S':
+			file_span = strtoull(optarg, NULL, 0);
+			break;
+		case 'b':
+			io_size = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'n':
+			max_ops = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			full_hist = true;
+			break;
+		case '?':
+		default:
+			fprintf(stderr, USAGE, argv[0]);
+			exit(1);
+		}
+
+	if (server == NULL || export_path == NULL || nthreads < 1 ||
+	    io_size == 0) {
+		fprintf(stderr, USAGE, argv[0]);
+		exit(1);
+	}
+
+	ld_read_mix();
+
+	clients = calloc(nthreads, sizeof(*clients));
+	threads = calloc(nthreads, sizeof(*threads));
+	if (clients == NULL || threads == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	for (t = 0; t < nthreads; t++) {
+		struct ld_client *cl = &clients[t];
+		bool ok;
+
+		cl->idx = t;
+		cl->rand = seed + t;
+		cl->buf = calloc(1, io_size);
+		cl->auth = authunix_create_default();
+		if (cl->buf == NULL || cl->auth == NULL) {
+			fprintf(stderr, "Cannot set up client %d\n", t);
+			exit(1);
+		}
+
+		ok = minorversion < 0 ? ld_v3_setup(cl) : ld_v4_setup(cl);
+		if (!ok) {
+			fprintf(stderr, "Cannot set up client %d\n", t);
+			exit(1);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end_time);
+	end_time.tv_sec += duration;
+	start = ld_now_us();
+
+	for (t = 0; t < nthreads; t++)
+		if (pthread_create(&threads[t], NULL, ld_thread,
+				   &clients[t]) != 0) {
+			fprintf(stderr, "Cannot start thread %d\n", t);
+			exit(1);
+		}
+
+	memset(&total, 0, sizeof(total));
+
+	for (t = 0; t < nthreads; t++) {
+		struct ld_client *cl = &clients[t];
+
+		pthread_join(threads[t], NULL);
+
+		for (op = 0; op < LD_NUM_OPS; op++) {
+			total.count[op] += cl->stats.count[op];
+			total.errors[op] += cl->stats.errors[op];
+			total.sum_us[op] += cl->stats.sum_us[op];
+			if (cl->stats.max_us[op] > total.max_us[op])
+				total.max_us[op] = cl->stats.max_us[op];
+			for (b = 0; b < LD_HIST_BUCKETS; b++)
+				total.hist[op][b] += cl->stats.hist[op][b];
+		}
+	}
+
+	i = ld_now_us() - start;
+
+	ld_report(&total, i / 1e6);
+
+	for (t = 0; t < nthreads; t++) {
+		if (minorversion >= 0)
+			ld_v4_teardown(&clients[t]);
+		AUTH_DESTROY(clients[t].auth);
+		clnt_destroy(clients[t].clnt);
+		free(clients[t].buf);
+	}
+
+	free(clients);
+	free(threads);
+
+	return 0;
+}